@@ -0,0 +1,56 @@
+// app.c - Firmware images that the bootloader loads from flash into BRAM
+// (see app.h).
+
+#include <string.h>
+
+#include "app.h"
+#include "flash.h"
+#include "slots.h"
+
+// Slot table sequence number the image was looked up at
+static u32 image_seq;
+static u8 image_found;
+static int image_slot = -1;
+
+int
+app_check(const void *buf, u32 len)
+{
+  struct app_header h;
+
+  if(len < sizeof(h)) {
+    return 0;
+  }
+  memcpy(&h, buf, sizeof(h));
+  return app_header_ok(&h, APP_BOOT_BASE);
+}
+
+int
+app_slot()
+{
+  const struct slot_desc *d;
+  struct app_header h;
+  u32 version = 0;
+  int i;
+
+  if(image_found && image_seq == slots.seq) {
+    return image_slot;
+  }
+  image_found = 1;
+  image_seq = slots.seq;
+  image_slot = -1;
+
+  for(i=0; i<slots.num; i++) {
+    d = &slots.slot[i];
+    if(i == SLOT_GOLDEN || d->len < sizeof(h) ||
+       (image_slot >= 0 && d->version < version)) {
+      continue;
+    }
+    if(read_flash_cached(d->addr, (u8 *)&h, sizeof(h)) != sizeof(h) ||
+       !app_header_ok(&h, d->len - sizeof(h))) {
+      continue;
+    }
+    image_slot = i;
+    version = d->version;
+  }
+  return image_slot;
+}
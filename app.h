@@ -0,0 +1,89 @@
+#ifndef _APP_H_
+#define _APP_H_
+
+// app.h - Firmware images that the bootloader loads from flash into BRAM.
+//
+// With BOOTLDR=1 (see the Makefile), the BRAM initialized with the
+// bitstream holds only the second-stage loader (bootldr/).  It is linked
+// into the top APP_BOOT_SIZE bytes of BRAM, and the reset vector branches
+// to it.  The firmware is an image in a flash slot:
+// - tools/mkapp.py packs executable-bram.elf into executable.app;
+// - the image is a struct app_header followed by the code and data, from
+//   the first vector past the reset vector to the end of the loaded
+//   sections;
+// - "make packed" makes executable-packed.app instead, with the code and
+//   data compressed with heatshrink (heatshrink.h);
+// - an upload starting with a valid header goes into its slot like the web
+//   UI's or the overlays' (tftp.h).
+// A firmware update therefore needs no rebuilt bitstream.
+//
+// On reset, the loader reads the slot table the way init_slots() does.  It
+// tries the images in the slots other than the golden one, newest version
+// first.  Each image is read with Quad Output Fast Read, straight into BRAM
+// or, if compressed, through the decoder into its place in BRAM, and then
+// checked against its CRC-32.  Compressed, there is less to read: the
+// decoder keeps up with the reads, so the load takes about as much less
+// time as the image is smaller.  The first image that passes runs, from
+// its entry point.  If none does, the loader falls back to the golden
+// image, which sits in the last APP_GOLDEN_SIZE bytes of slot 0 and is
+// programmed along with the golden bitstream.
+//
+// The reset vector stays the loader's, so every reset loads the firmware
+// afresh, the watchdog's included.  Sections without contents, such as
+// .noinit (sections.h), are not part of the image and survive the load.
+
+#include "xil_types.h"
+
+#include "crc32.h"
+
+#define APP_MAGIC (0x31505041) // "APP1"
+
+// The loader's share of BRAM, at the top.  The Makefile's BOOT_BASE and
+// bootldr/bootldr.ld place it here too.
+#define APP_BOOT_BASE (0x1f000)
+#define APP_BOOT_SIZE (0x1000)
+
+// Images load from past the reset vector to below the loader
+#define APP_LOAD_MIN  (0x8)
+
+// Room for the golden image at the end of slot 0
+#define APP_GOLDEN_SIZE (128 << 10)
+
+struct app_header {
+  u32 magic;
+  // Bytes of code and data once loaded, where they load and where the
+  // loader jumps to (crt0's _start1)
+  u32 size;
+  u32 load;
+  u32 entry;
+  // CRC-32 of the code and data
+  u32 crc;
+  // Bytes of heatshrink stream they are compressed into, or 0 if stored
+  u32 packed;
+  // CRC-32 of the fields above
+  u32 hcrc;
+};
+
+// Non-zero if `h` is a well-formed header for an image of at most `room`
+// bytes after it, stored or compressed, loading between APP_LOAD_MIN and
+// APP_BOOT_BASE
+static inline int
+app_header_ok(const struct app_header *h, u32 room)
+{
+  return h->magic == APP_MAGIC &&
+      h->hcrc == crc32(0, h, sizeof(*h) - sizeof(h->hcrc)) &&
+      (h->packed ? h->packed : h->size) <= room &&
+      h->load >= APP_LOAD_MIN &&
+      h->size <= APP_BOOT_BASE - h->load &&
+      h->entry >= h->load && h->entry - h->load < h->size;
+}
+
+// Non-zero if the `len` bytes at `buf` start with a valid header
+int app_check(const void *buf, u32 len);
+
+// Slot that holds the newest image with a valid header, which the loader
+// tries first, or -1 if there is none.  Looked up again whenever the slot
+// table changes.
+int app_slot();
+
+#endif // _APP_H_
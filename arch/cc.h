@@ -0,0 +1,53 @@
+#ifndef _ARCH_CC_H_
+#define _ARCH_CC_H_
+
+// arch/cc.h - lwIP compiler/platform glue for standalone MicroBlaze.
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "xil_printf.h"
+
+#include "bswap.h"
+#include "chksum.h"
+#include "iperf.h"
+#include "mbmem.h"
+#include "timebase.h"
+
+#ifndef BYTE_ORDER
+#define BYTE_ORDER LITTLE_ENDIAN
+#endif
+
+// Byte order through the reorder instructions (bswap.h) rather than def.c's
+// shifts and masks, which cost a dozen instructions or more without a
+// barrel shifter.  Constants still fold at compile time.
+#define lwip_htons(x) ((u16_t)(__builtin_constant_p(x) ? PP_HTONS(x) : \
+    swap16((u16_t)(x))))
+#define lwip_htonl(x) ((u32_t)(__builtin_constant_p(x) ? PP_HTONL(x) : \
+    swap32((u32_t)(x))))
+
+// Use xil_printf rather than pulling printf into the image.
+#define LWIP_PLATFORM_DIAG(x) do { xil_printf x; } while(0)
+
+// IGMP's report delays and DHCP's; main() seeds it from the MAC so that
+// boards powered up together pick different ones.
+#define LWIP_RAND() ((u32_t)rand())
+
+#define LWIP_PLATFORM_ASSERT(x) do { \
+    xil_printf("Assertion \"%s\" failed at line %d in %s\n", \
+        x, __LINE__, __FILE__); \
+    abort(); \
+  } while(0)
+
+// Gather the heap and all memp pools in one section so their BRAM cost
+// shows up as a single line in the link map.
+#define LWIP_DECLARE_MEMORY_ALIGNED(variable_name, size) \
+  u8_t variable_name[LWIP_MEM_ALIGN_BUFFER(size)] \
+  __attribute__((section(".lwip_pools")))
+
+#define PACK_STRUCT_FIELD(x) x
+#define PACK_STRUCT_STRUCT __attribute__((packed))
+#define PACK_STRUCT_BEGIN
+#define PACK_STRUCT_END
+
+#endif // _ARCH_CC_H_
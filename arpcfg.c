@@ -0,0 +1,122 @@
+// arpcfg.c - Static ARP entries kept in the flash config store.
+//
+// `entries` is the stored value, saved in the background (kv_save()).
+
+#include <string.h>
+
+#include "lwip/etharp.h"
+
+#include "arpcfg.h"
+#include "bswap.h"
+#include "kv.h"
+#include "log.h"
+
+static struct arpcfg_entry entries[ARPCFG_MAX];
+static u32 count;
+
+static struct kv_save save = KV_SAVE_INIT(save, KV_KEY_ARP);
+
+static void
+arpcfg_save()
+{
+  kv_save(&save, entries, count * sizeof(entries[0]));
+}
+
+// Index of the entry for `ip`, or -1
+static int
+arpcfg_find(u32 ip)
+{
+  u32 i;
+
+  for(i=0; i<count; i++) {
+    if(entries[i].ip == ip) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+static int
+arpcfg_load(const struct arpcfg_entry *e)
+{
+  ip4_addr_t ip;
+  struct eth_addr mac;
+
+  ip4_addr_set_u32(&ip, e->ip);
+  memcpy(mac.addr, e->mac, sizeof(mac.addr));
+  return etharp_add_static_entry(&ip, &mac) == ERR_OK ? 0 : -1;
+}
+
+void
+arpcfg_reload()
+{
+  u32 i;
+
+  for(i=0; i<count; i++) {
+    if(arpcfg_load(&entries[i]) != 0) {
+      LOG("arpcfg: cannot add %x", swap32(entries[i].ip));
+    }
+  }
+}
+
+void
+init_arpcfg()
+{
+  int len = kv_get(KV_KEY_ARP, entries, sizeof(entries));
+
+  count = len > 0 ? len / sizeof(entries[0]) : 0;
+  // Under DHCP, netcfg.h reloads them once there is an address
+  if(!ip4_addr_isany_val(*netif_ip4_addr(netif_default))) {
+    arpcfg_reload();
+  }
+}
+
+int
+arpcfg_add(const ip4_addr_t *ip, const struct eth_addr *mac)
+{
+  struct arpcfg_entry e;
+  int n = arpcfg_find(ip4_addr_get_u32(ip));
+
+  if(n < 0 && count == ARPCFG_MAX) {
+    return -1;
+  }
+  memset(&e, 0, sizeof(e));
+  e.ip = ip4_addr_get_u32(ip);
+  memcpy(e.mac, mac->addr, sizeof(e.mac));
+  if(n >= 0) {
+    etharp_remove_static_entry(ip);
+  }
+  if(arpcfg_load(&e) != 0) {
+    if(n >= 0) {
+      // Put the old one back
+      arpcfg_load(&entries[n]);
+    }
+    return -1;
+  }
+  if(n < 0) {
+    n = count++;
+  }
+  entries[n] = e;
+  arpcfg_save();
+  return 0;
+}
+
+int
+arpcfg_remove(const ip4_addr_t *ip)
+{
+  int n = arpcfg_find(ip4_addr_get_u32(ip));
+
+  if(n < 0) {
+    return -1;
+  }
+  etharp_remove_static_entry(ip);
+  entries[n] = entries[--count];
+  arpcfg_save();
+  return 0;
+}
+
+const struct arpcfg_entry *
+arpcfg_get(u32 n)
+{
+  return n < count ? &entries[n] : NULL;
+}
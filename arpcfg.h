@@ -0,0 +1,45 @@
+#ifndef _ARPCFG_H_
+#define _ARPCFG_H_
+
+// arpcfg.h - Static ARP entries kept in the flash config store.
+//
+// The entries are loaded into lwIP's ARP table as static entries at boot,
+// so the first datagram to a collector goes out without waiting for ARP,
+// and since static entries never expire, streams to it never stall on a
+// refresh either.  Changes take effect at once and are saved to
+// KV_KEY_ARP (see kv.h) in the background.  KATCP's ?arp (see katcp.h)
+// lists and changes them.
+
+#include "lwip/ip4_addr.h"
+#include "lwip/prot/ethernet.h"
+
+#include "xil_types.h"
+
+// Entries kept; each also takes a slot of lwIP's ARP_TABLE_SIZE
+#define ARPCFG_MAX (8)
+
+// As stored: the address in network order
+struct arpcfg_entry {
+  u32 ip;
+  u8 mac[6];
+  u16 pad;
+};
+
+// Load the saved entries.  Call once eth0 is up, after init_kv().
+void init_arpcfg();
+
+// Load the entries into lwIP's ARP table again, e.g. once eth0 has the
+// address whose subnet they are on
+void arpcfg_reload();
+
+// Add or change the entry for `ip`.  Returns 0, or -1 if the table is full
+// or `ip` is not on a local subnet.
+int arpcfg_add(const ip4_addr_t *ip, const struct eth_addr *mac);
+
+// Remove the entry for `ip`.  Returns 0, or -1 if there is none.
+int arpcfg_remove(const ip4_addr_t *ip);
+
+// Entry `n`, or NULL past the last one
+const struct arpcfg_entry *arpcfg_get(u32 n);
+
+#endif // _ARPCFG_H_
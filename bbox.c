@@ -0,0 +1,359 @@
+// bbox.c - Blackbox event log in flash (see bbox.h).
+//
+// Events wait in `q` until the poll timer copies them into `page`, the
+// buffer of the page at log offset `pg`: `fill` bytes of it hold records
+// and `done` of those are programmed.  A full page that is programmed
+// gives way to the next, and the first page of a sector waits for the
+// sector's erase.  The log's offsets run from 0 to `size`, sector 0 of
+// the range first.
+
+#include <string.h>
+
+#include "bbox.h"
+#include "crash.h"
+#include "crc32.h"
+#include "flash.h"
+#include "icap.h"
+#include "log.h"
+#include "ring.h"
+#include "slots.h"
+#include "sntpclock.h"
+#include "timebase.h"
+#include "timer.h"
+#include "version.h"
+#include "wdog.h"
+
+#define REC_CRC(r) crc32(0, (r), offsetof(struct bbox_rec, crc))
+
+// What the flash is doing for the log
+#define BB_IDLE    (0)
+#define BB_ERASE   (1)
+#define BB_PROGRAM (2)
+
+static struct bbox_rec q[BBOX_QUEUE];
+static struct ring rq = RING_INIT(BBOX_QUEUE);
+
+static u32 page[BBOX_PAGE / 4];
+static u32 pg, fill, done;
+static u32 programming;
+
+// Flash address of the range, its size and its sectors' (1 << shift), or
+// a size of 0 without flash
+static u32 base;
+static u32 size;
+static u32 shift;
+
+static u8 state;
+static u8 need_erase;
+static u8 urgent;
+// timebase_ms() when the oldest event not yet programmed came
+static u32 since_ms;
+
+static struct bbox_stats stats;
+
+static int
+rec_blank(const struct bbox_rec *r)
+{
+  const u32 *w = (const u32 *)r;
+  u32 i;
+
+  for(i=0; i<sizeof(*r) / 4; i++) {
+    if(w[i] != 0xffffffff) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+// Read the page at log offset `off` into `page`.  Returns 0, or -1 on
+// error.
+static int
+read_page(u32 off)
+{
+  return read_flash(base + off, (u8 *)page, BBOX_PAGE, FLASH_MODE_BEST) ==
+      BBOX_PAGE ? 0 : -1;
+}
+
+// Move on to the next page, erasing its sector first if it starts one
+static void
+next_page()
+{
+  pg = (pg + BBOX_PAGE) & (size - 1);
+  fill = done = 0;
+  memset(page, 0xff, sizeof(page));
+  if(!(pg & ((1 << shift) - 1))) {
+    need_erase = 1;
+  }
+}
+
+static void
+erased(int err, void *arg)
+{
+  state = BB_IDLE;
+  if(err) {
+    stats.errors++;
+    return;
+  }
+  stats.erases++;
+  need_erase = 0;
+}
+
+static void
+programmed(int err, void *arg)
+{
+  state = BB_IDLE;
+  flash_cache_invalidate(base + pg, BBOX_PAGE);
+  if(err) {
+    // The page may be partly programmed: its events are lost
+    stats.errors++;
+    next_page();
+    return;
+  }
+  done = programming;
+  if(done == BBOX_PAGE) {
+    stats.pages++;
+    next_page();
+  } else {
+    stats.partial++;
+  }
+}
+
+// Timer: fill the page, and program or erase as due.  Returns non-zero
+// while there is more to do.
+static int
+bbox_flush()
+{
+  if(state != BB_IDLE) {
+    return 1;
+  }
+  if(need_erase) {
+    if(erase_flash(base + pg, 1 << shift, erased, NULL) == 0) {
+      state = BB_ERASE;
+    }
+    return 1;
+  }
+  while(fill < BBOX_PAGE && ring_count(&rq)) {
+    memcpy((u8 *)page + fill, &q[ring_tail_slot(&rq)], sizeof(q[0]));
+    ring_pop(&rq, 1);
+    fill += sizeof(q[0]);
+  }
+  if(fill > done && (fill == BBOX_PAGE || urgent ||
+     timebase_ms() - since_ms >= BBOX_STAGE_MS)) {
+    if(program_flash(base + pg, (const u8 *)page, BBOX_PAGE, programmed,
+          NULL) == 0) {
+      state = BB_PROGRAM;
+      programming = fill;
+      if(!ring_count(&rq)) {
+        urgent = 0;
+      }
+    }
+    return 1;
+  }
+  return fill > done || ring_count(&rq) != 0;
+}
+
+static void bbox_poll(void *arg);
+
+static struct timer poll_timer = TIMER_INIT(bbox_poll, NULL);
+
+static void
+bbox_poll(void *arg)
+{
+  if(!bbox_flush()) {
+    timer_stop(&poll_timer);
+  }
+}
+
+void
+bbox_event(u16 type, u16 arg, u32 a, u32 b, u32 c)
+{
+  struct bbox_rec *r;
+  u64 utc_us;
+
+  if(!size) {
+    return;
+  }
+  if(!ring_space(&rq)) {
+    stats.lost++;
+    return;
+  }
+  // Nothing is waiting: the stage timeout counts from now
+  if(fill == done && !ring_count(&rq)) {
+    since_ms = timebase_ms();
+  }
+  r = &q[ring_head_slot(&rq)];
+  utc_us = now_utc_us();
+  r->seq = stats.seq++;
+  r->utc_s = utc_us ? (u32)(utc_us / 1000000) : 0;
+  r->ms = timebase_ms();
+  r->type = type;
+  r->arg = arg;
+  r->a = a;
+  r->b = b;
+  r->c = c;
+  r->crc = REC_CRC(r);
+  ring_push(&rq, 1);
+  if(type < 32 && (BBOX_URGENT & 1 << type)) {
+    urgent = 1;
+  }
+  if(!timer_pending(&poll_timer)) {
+    timer_start(&poll_timer, 0, BBOX_POLL_MS);
+  }
+}
+
+u32
+bbox_size()
+{
+  return size;
+}
+
+u32
+bbox_read(u32 off, void *dst, u32 len)
+{
+  u32 oldest = (pg >> shift) + 1, sector = 1 << shift;
+  u32 at, n, got = 0;
+  u8 *d = dst;
+
+  if(off > size || len > size - off) {
+    return 0;
+  }
+  while(got < len) {
+    at = (((oldest << shift) + off) & (size - 1));
+    n = sector - (at & (sector - 1));
+    if(n > len - got) {
+      n = len - got;
+    }
+    // The page buffer is newer than the flash under it
+    if((at & ~(BBOX_PAGE - 1)) == pg) {
+      if(n > BBOX_PAGE - (at - pg)) {
+        n = BBOX_PAGE - (at - pg);
+      }
+      memcpy(d, (u8 *)page + (at - pg), n);
+    } else {
+      if(at < pg && pg - at < n) {
+        n = pg - at;
+      }
+      if(read_flash(base + at, d, n, FLASH_MODE_BEST) != n) {
+        return got;
+      }
+    }
+    d += n;
+    off += n;
+    got += n;
+  }
+  return got;
+}
+
+const struct bbox_stats *
+bbox_stats()
+{
+  return &stats;
+}
+
+static void bbox_boot(void *arg);
+
+static struct timer boot_timer = TIMER_INIT(bbox_boot, NULL);
+
+// Timer, once the main loop runs: record why the board reset
+static void
+bbox_boot(void *arg)
+{
+  const struct wdog_record *w;
+  const struct crash_record *cr;
+  int expired, fresh;
+  u16 cause = BBOX_RESET_POWER;
+  u32 detail = slots.active;
+
+  w = wdog_last_reset(&expired);
+  cr = crash_last(&fresh);
+  if(cr && fresh) {
+    cause = BBOX_RESET_CRASH;
+    detail = cr->cause;
+  } else if(w) {
+    cause = BBOX_RESET_WDOG;
+    detail = w->pc;
+  } else if(expired) {
+    cause = BBOX_RESET_WDT;
+  }
+  bbox_event(BBOX_BOOT, cause, JAM_VERSION, icap_bootsts(), detail);
+}
+
+// Find the end of the log: the sector whose first record is the newest,
+// and in it the first blank record after the last one written
+static void
+bbox_scan()
+{
+  struct bbox_rec *r = (struct bbox_rec *)page;
+  u32 sectors = size >> shift, s, p, i, newest = 0, end;
+  int found = 0;
+
+  for(s=0; s<sectors; s++) {
+    if(read_flash(base + (s << shift), (u8 *)r, sizeof(*r),
+          FLASH_MODE_BEST) != sizeof(*r) || r->crc != REC_CRC(r)) {
+      continue;
+    }
+    if(!found || (s32)(r->seq - stats.seq) >= 0) {
+      newest = s;
+      stats.seq = r->seq + 1;
+      found = 1;
+    }
+  }
+  if(!found) {
+    pg = 0;
+    need_erase = 1;
+    memset(page, 0xff, sizeof(page));
+    return;
+  }
+  end = newest << shift;
+  for(p=0; p < 1u << shift; p += BBOX_PAGE) {
+    if(read_page((newest << shift) + p) != 0) {
+      break;
+    }
+    for(i=0; i<BBOX_PER_PAGE; i++) {
+      if(rec_blank(&r[i])) {
+        continue;
+      }
+      // Written, whether whole or cut short
+      end = (newest << shift) + p + (i + 1) * sizeof(*r);
+      if(r[i].crc == REC_CRC(&r[i]) && (s32)(r[i].seq - stats.seq) >= 0) {
+        stats.seq = r[i].seq + 1;
+      }
+    }
+  }
+  pg = end & ~(BBOX_PAGE - 1);
+  fill = done = end - pg;
+  if(fill == BBOX_PAGE || read_page(pg) != 0) {
+    // Full, or unreadable: on to the next
+    next_page();
+  }
+}
+
+void
+init_bbox()
+{
+  u32 sector = flash_rsv_size();
+  int i;
+
+  timer_stop(&poll_timer);
+  rq.head = rq.tail = 0;
+  pg = fill = done = 0;
+  size = 0;
+  state = BB_IDLE;
+  need_erase = urgent = 0;
+  memset(&stats, 0, sizeof(stats));
+  if(!flash_info.size) {
+    return;
+  }
+  base = flash_rsv_addr(FLASH_RSV_BBOX);
+  for(i=0; i<slots.num; i++) {
+    if(slots.slot[i].addr + slots.slot[i].size > base) {
+      LOG("bbox: slot %d overlaps the log", i);
+      return;
+    }
+  }
+  size = FLASH_RSV_BBOX_SECTORS * sector;
+  for(shift=0; (1u << shift) < sector; shift++) {
+  }
+  bbox_scan();
+  timer_start(&boot_timer, 0, 0);
+}
@@ -0,0 +1,109 @@
+#ifndef _BBOX_H_
+#define _BBOX_H_
+
+// bbox.h - Blackbox event log in flash, kept across resets and power
+// loss.
+//
+// Critical events (resets and why, XADC alarms, link changes, update
+// results) go as struct bbox_rec records into the flash sectors
+// FLASH_RSV_BBOX (flash.h), a circular log: each sector is erased as the
+// log reaches it, dropping the oldest events.  Records are gathered into
+// a page buffer and a page is only programmed once full, or once
+// BBOX_STAGE_MS has passed since the first event not yet programmed, when
+// what it holds so far is programmed and the rest of the page later (a
+// page may be programmed again where it is still erased).  The events of
+// BBOX_URGENT types are programmed at once.  So most events cost a copy
+// into BRAM, and the flash sees a page program per BBOX_PER_PAGE of them.
+//
+// init_bbox() finds the end of the log from the sequence numbers and CRCs
+// of the records, so a power cut part way through a program loses that
+// page's new events at most.  The log reads as a single stream, oldest
+// sector first, with "tftp -m binary <board> -c get blackbox"; records
+// that are erased (all ones) or fail their CRC are to be skipped, and
+// tools/blackbox.py does that and prints the rest.  KATCP's ?blackbox
+// (katcp.h) shows the counts.
+
+#include "xil_types.h"
+
+// Records queued for the page buffer at most
+#define BBOX_QUEUE    (16)
+
+#define BBOX_PAGE     (256)
+#define BBOX_PER_PAGE (BBOX_PAGE / sizeof(struct bbox_rec))
+
+// Longest an event waits in BRAM
+#define BBOX_STAGE_MS (5000)
+
+// How often the page buffer is looked at while anything waits
+#define BBOX_POLL_MS  (10)
+
+// Event types, and the meanings of `arg`, `a`, `b` and `c`
+#define BBOX_BOOT     (1) // arg: BBOX_RESET_*, a: JAM_VERSION, b: the
+                          // ICAP boot status (icap.h), c: slot active;
+                          // for a watchdog reset c is the record's PC,
+                          // for a crash its cause
+#define BBOX_ALARM    (2) // arg: the XADC alarms active, a: status,
+                          // b: die temperature in mC
+#define BBOX_LINK     (3) // arg: 10 GbE core, a: ETHMON_LINK_*
+#define BBOX_UPDATE   (4) // arg: slot, a: 0 or -1, b: image length,
+                          // c: its CRC-32
+#define BBOX_NOTE     (5) // arg, a, b, c: from ?blackbox note
+
+// Programmed at once
+#define BBOX_URGENT   ((1 << BBOX_BOOT) | (1 << BBOX_UPDATE) | \
+    (1 << BBOX_NOTE))
+
+// Why the board last reset
+#define BBOX_RESET_POWER (0) // power on, or nothing recorded why
+#define BBOX_RESET_WDOG  (1) // the supervisor let the watchdog fire
+#define BBOX_RESET_WDT   (2) // the watchdog fired on its own
+#define BBOX_RESET_CRASH (3) // an exception or assert (crash.h)
+
+// Little-endian, as the processor stores it
+struct bbox_rec {
+  // Counts events since the log was empty
+  u32 seq;
+  // UTC seconds since 1970 (sntpclock.h), 0 before the clock is set, and
+  // timebase_ms()
+  u32 utc_s;
+  u32 ms;
+  u16 type;
+  u16 arg;
+  u32 a;
+  u32 b;
+  u32 c;
+  // CRC-32 of the fields above
+  u32 crc;
+};
+
+struct bbox_stats {
+  // Next sequence number, and events dropped as the queue was full
+  u32 seq;
+  u32 lost;
+  // Pages programmed full, and programs of a page not yet full
+  u32 pages;
+  u32 partial;
+  u32 erases;
+  u32 errors;
+};
+
+// Record an event.  From the main loop only.
+void bbox_event(u16 type, u16 arg, u32 a, u32 b, u32 c);
+
+// Bytes in the log stream
+u32 bbox_size();
+
+// Read `len` bytes at `off` into the log stream into `dst`, the page
+// buffer's events included.  Returns `len`, or less on error (as while
+// the flash is programming).
+u32 bbox_read(u32 off, void *dst, u32 len);
+
+const struct bbox_stats *bbox_stats();
+
+// Find the end of the log and record the boot.  Call after init_flash(),
+// init_crash() and init_slots(); the boot's event waits for the main
+// loop, after init_wdog().  If the slot table lays a bitstream over the
+// sectors, the log is off.
+void init_bbox();
+
+#endif // _BBOX_H_
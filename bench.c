@@ -0,0 +1,717 @@
+// bench.c - On-target micro-benchmarks (see bench.h).
+//
+// Each kernel takes its own stamps, so the loop around it stays out of the
+// measurement.  The bandwidth kernels are unrolled by four, like the copy
+// routines in ethbuf.c, so their results are what a tight copy loop gets.
+//
+// The Wishbone target is eth0's TX buffer: the tests write garbage into it,
+// which is harmless while the core is not sending, and the next frame sent
+// overwrites it.  The suite runs from the main loop, so nothing queues a
+// frame in the meantime; it only has to wait for one in flight to finish.
+// The UDP test comes last, after the Wishbone tests are done with the
+// buffer.  It waits for room in eth0's TX queue the way a busy stream
+// would, so its cycles per datagram are the fast path's sustained rate.
+
+#include <string.h>
+
+#include "lwip/udp.h"
+#include "netif/ethernetif.h"
+
+#include "xparameters.h"
+#include "xil_printf.h"
+#include "xspi.h"
+#include "xsysmon.h"
+
+#include "bench.h"
+#include "chksum.h"
+#include "console.h"
+#include "eth.h"
+#include "ethbuf.h"
+#include "ethloop.h"
+#include "flash.h"
+#include "fmt.h"
+#include "intr.h"
+#include "kv.h"
+#include "mbmem.h"
+#include "ovl.h"
+#include "role.h"
+#include "timebase.h"
+#include "timer.h"
+#include "udpflow.h"
+#include "xadc.h"
+
+#define BENCH_WB_ADDR (ETH0_BASE_ADDRESS + ETH_MAC_TX_BUF_OFFSET)
+
+// mb_chksum() runs over the program's code, past the vectors: the only
+// stretch of LMB long enough for its longest length
+#define BENCH_CHKSUM_ADDR \
+  (XPAR_MICROBLAZE_0_LOCAL_MEMORY_DLMB_BRAM_IF_CNTLR_BASEADDR + 0x50)
+
+// Where read_flash() reads from
+#define BENCH_FLASH_ADDR (0)
+
+// Room a row of dump_bench()'s table takes in the console's buffer, and
+// how often the rest is looked at
+#define BENCH_ROW_MAX  (80)
+#define BENCH_PRINT_MS (10)
+
+// What the driver tests ran with (CHECKED in the Makefile)
+#ifdef NDEBUG
+#define BENCH_ASSERTS "off"
+#else
+#define BENCH_ASSERTS "on"
+#endif
+
+// Bytes of the memcpy and memset tests: room for the source to start up to
+// three bytes into lmb_buf
+#define BENCH_MEM_BYTES (BENCH_BYTES - 4)
+
+// Longest wait for eth0 to finish sending
+#define BENCH_TX_WAIT_US (1000)
+
+static u32 lmb_buf[BENCH_BYTES / 4];
+// Other end of the copies, and where flash reads land
+static u32 copy_buf[BENCH_BYTES / 4];
+
+static struct udpflow udp_flow;
+
+// The driver tests' own instances, filled in by hand rather than by the
+// drivers' CfgInitialize(), which would reset the cores
+static XSysMon bench_sysmon;
+static XSpi bench_spi;
+static volatile u32 bench_sink;
+// Set by a kernel that could not do its work; the result is dropped
+static u8 failed;
+
+typedef u32 (*bench_fn)(u32 addr, u32 n);
+
+// Kernels for accesses of type T: each makes `n` accesses at `addr` (one
+// for read1/write1) and returns the cycles taken
+#define BENCH_KERNELS(sfx, T) \
+static OVL_TEXT(bench) u32 \
+read1_##sfx(u32 addr, u32 n) \
+{ \
+  volatile T *p = (volatile T *)addr; \
+  u32 t0 = timebase_stamp(); \
+  (void)*p; \
+  return timebase_stamp() - t0; \
+} \
+static OVL_TEXT(bench) u32 \
+write1_##sfx(u32 addr, u32 n) \
+{ \
+  volatile T *p = (volatile T *)addr; \
+  u32 t0 = timebase_stamp(); \
+  *p = 0; \
+  return timebase_stamp() - t0; \
+} \
+static OVL_TEXT(bench) u32 \
+read_seq_##sfx(u32 addr, u32 n) \
+{ \
+  volatile T *p = (volatile T *)addr; \
+  u32 t0 = timebase_stamp(); \
+  for(; n; n-=4, p+=4) { \
+    (void)p[0]; \
+    (void)p[1]; \
+    (void)p[2]; \
+    (void)p[3]; \
+  } \
+  return timebase_stamp() - t0; \
+} \
+static OVL_TEXT(bench) u32 \
+write_seq_##sfx(u32 addr, u32 n) \
+{ \
+  volatile T *p = (volatile T *)addr; \
+  u32 t0 = timebase_stamp(); \
+  for(; n; n-=4, p+=4) { \
+    p[0] = n; \
+    p[1] = n; \
+    p[2] = n; \
+    p[3] = n; \
+  } \
+  return timebase_stamp() - t0; \
+} \
+static OVL_TEXT(bench) u32 \
+read_fix_##sfx(u32 addr, u32 n) \
+{ \
+  volatile T *p = (volatile T *)addr; \
+  u32 t0 = timebase_stamp(); \
+  for(; n; n-=4) { \
+    (void)*p; \
+    (void)*p; \
+    (void)*p; \
+    (void)*p; \
+  } \
+  return timebase_stamp() - t0; \
+} \
+static OVL_TEXT(bench) u32 \
+write_fix_##sfx(u32 addr, u32 n) \
+{ \
+  volatile T *p = (volatile T *)addr; \
+  u32 t0 = timebase_stamp(); \
+  for(; n; n-=4) { \
+    *p = n; \
+    *p = n; \
+    *p = n; \
+    *p = n; \
+  } \
+  return timebase_stamp() - t0; \
+}
+
+BENCH_KERNELS(8, u8)
+BENCH_KERNELS(16, u16)
+BENCH_KERNELS(32, u32)
+
+static OVL_TEXT(bench) u32
+copy_in(u32 addr, u32 n)
+{
+  u32 t0 = timebase_stamp();
+
+  ethbuf_read(copy_buf, addr, n);
+  return timebase_stamp() - t0;
+}
+
+static OVL_TEXT(bench) u32
+copy_out(u32 addr, u32 n)
+{
+  u32 t0 = timebase_stamp();
+
+  ethbuf_write(addr, copy_buf, n);
+  return timebase_stamp() - t0;
+}
+
+// `n` register-only instructions (a multiple of 5): three adds and the
+// branch back, with the count's decrement in its delay slot
+static OVL_TEXT(bench) u32
+alu(u32 addr, u32 n)
+{
+  u32 i = n / 5 - 1, a = 0;
+  u32 t0 = timebase_stamp();
+
+  __asm__ volatile (
+      "1: addk  %1, %1, %0\n"
+      "   addk  %1, %1, %0\n"
+      "   addk  %1, %1, %0\n"
+      "   bneid %0, 1b\n"
+      "   addik %0, %0, -1\n"
+      : "+r" (i), "+r" (a));
+  return timebase_stamp() - t0;
+}
+
+static OVL_TEXT(bench) u32
+memcpy_in(u32 addr, u32 n)
+{
+  u32 t0 = timebase_stamp();
+
+  memcpy(copy_buf, (const void *)addr, BENCH_BYTES);
+  return timebase_stamp() - t0;
+}
+
+static OVL_TEXT(bench) u32
+memcpy_out(u32 addr, u32 n)
+{
+  u32 t0 = timebase_stamp();
+
+  memcpy((void *)addr, copy_buf, BENCH_BYTES);
+  return timebase_stamp() - t0;
+}
+
+// LMB to LMB, `addr` the source
+static OVL_TEXT(bench) u32
+lib_copy(u32 addr, u32 n)
+{
+  u32 t0 = timebase_stamp();
+
+  memcpy(copy_buf, (const void *)addr, n);
+  return timebase_stamp() - t0;
+}
+
+static OVL_TEXT(bench) u32
+mb_copy(u32 addr, u32 n)
+{
+  u32 t0 = timebase_stamp();
+
+  mb_memcpy(copy_buf, (const void *)addr, n);
+  return timebase_stamp() - t0;
+}
+
+static OVL_TEXT(bench) u32
+lib_set(u32 addr, u32 n)
+{
+  u32 t0 = timebase_stamp();
+
+  memset((void *)addr, n, n);
+  return timebase_stamp() - t0;
+}
+
+static OVL_TEXT(bench) u32
+mb_set(u32 addr, u32 n)
+{
+  u32 t0 = timebase_stamp();
+
+  mb_memset((void *)addr, n, n);
+  return timebase_stamp() - t0;
+}
+
+static OVL_TEXT(bench) u32
+chksum(u32 addr, u32 n)
+{
+  u32 t0 = timebase_stamp();
+
+  mb_chksum((const void *)addr, n);
+  return timebase_stamp() - t0;
+}
+
+// `addr` is the read mode
+static OVL_TEXT(bench) u32
+flash_read(u32 addr, u32 n)
+{
+  u32 t0 = timebase_stamp();
+
+  if(read_flash(BENCH_FLASH_ADDR, (u8 *)copy_buf, n, addr) != n) {
+    failed = 1;
+  }
+  return timebase_stamp() - t0;
+}
+
+static OVL_TEXT(bench) u32
+snapshot(u32 addr, u32 n)
+{
+  struct xadc_snapshot s;
+  u32 t0 = timebase_stamp();
+
+  xadc_snapshot(&s);
+  return timebase_stamp() - t0;
+}
+
+// `n` datagrams on udp_flow, each retried until the TX queue takes it
+static OVL_TEXT(bench) u32
+flow_send(u32 addr, u32 n)
+{
+  u32 t0 = timebase_stamp();
+  u32 t1;
+
+  for(; n; n--) {
+    t1 = timebase_stamp();
+    while(udpflow_write(&udp_flow, lmb_buf, BENCH_UDP_LEN) != 0) {
+      if(timebase_stamp() - t1 > BENCH_TX_WAIT_US * TIMEBASE_CYCLES_PER_US) {
+        failed = 1;
+        return 0;
+      }
+      ethernetif_tx_poll(udp_flow.netif);
+    }
+  }
+  return timebase_stamp() - t0;
+}
+
+// `n` calls of driver call `addr` (BENCH_DRV_*)
+static OVL_TEXT(bench) u32
+driver_call(u32 addr, u32 n)
+{
+  u32 t0 = timebase_stamp();
+
+  switch(addr) {
+  case BENCH_DRV_ADC_DATA:
+    for(; n; n--) {
+      bench_sink = XSysMon_GetAdcData(&bench_sysmon, XSM_CH_TEMP);
+    }
+    break;
+  case BENCH_DRV_XADC_REG:
+    for(; n; n--) {
+      bench_sink = XSysMon_ReadReg(XPAR_SYSMON_0_BASEADDR, XSM_TEMP_OFFSET);
+    }
+    break;
+  case BENCH_DRV_MIN_MAX:
+    for(; n; n--) {
+      bench_sink = XSysMon_GetMinMaxMeasurement(&bench_sysmon, XSM_MAX_TEMP);
+    }
+    break;
+  case BENCH_DRV_SPI_SS:
+    for(; n; n--) {
+      bench_sink = XSpi_GetSlaveSelect(&bench_spi);
+    }
+    break;
+  case BENCH_DRV_SPI_REG:
+    for(; n; n--) {
+      bench_sink = XSpi_ReadReg(XPAR_SPI_0_BASEADDR, XSP_SR_OFFSET);
+    }
+    break;
+  }
+  return timebase_stamp() - t0;
+}
+
+// Just the stamps
+static OVL_TEXT(bench) u32
+overhead(u32 addr, u32 n)
+{
+  u32 t0 = timebase_stamp();
+
+  return timebase_stamp() - t0;
+}
+
+static const struct {
+  u8 pattern;
+  u8 width;
+  bench_fn fn;
+} tests[] = {
+  { BENCH_READ1,     1, read1_8 },
+  { BENCH_READ1,     2, read1_16 },
+  { BENCH_READ1,     4, read1_32 },
+  { BENCH_WRITE1,    1, write1_8 },
+  { BENCH_WRITE1,    2, write1_16 },
+  { BENCH_WRITE1,    4, write1_32 },
+  { BENCH_READ_SEQ,  1, read_seq_8 },
+  { BENCH_READ_SEQ,  2, read_seq_16 },
+  { BENCH_READ_SEQ,  4, read_seq_32 },
+  { BENCH_WRITE_SEQ, 1, write_seq_8 },
+  { BENCH_WRITE_SEQ, 2, write_seq_16 },
+  { BENCH_WRITE_SEQ, 4, write_seq_32 },
+  { BENCH_READ_FIX,  1, read_fix_8 },
+  { BENCH_READ_FIX,  2, read_fix_16 },
+  { BENCH_READ_FIX,  4, read_fix_32 },
+  { BENCH_WRITE_FIX, 1, write_fix_8 },
+  { BENCH_WRITE_FIX, 2, write_fix_16 },
+  { BENCH_WRITE_FIX, 4, write_fix_32 },
+  { BENCH_COPY_IN,   4, copy_in },
+  { BENCH_COPY_OUT,  4, copy_out },
+  { BENCH_MEMCPY_IN, 4, memcpy_in },
+  { BENCH_MEMCPY_OUT, 4, memcpy_out },
+  // Last, as the Wishbone target skips it
+  { BENCH_ALU,       4, alu },
+};
+
+#define NUM_TESTS (sizeof(tests) / sizeof(tests[0]))
+
+static const u16 chksum_lens[] = BENCH_CHKSUM_LENS;
+
+#define NUM_CHKSUM_LENS (sizeof(chksum_lens) / sizeof(chksum_lens[0]))
+
+// The table on both targets less alu on Wishbone, then the checksums, both
+// copies at four alignments and both sets, the flash's read modes, the
+// snapshot, the driver calls, the datagrams and the loopback sizes
+#define NUM_RESULTS (2 * NUM_TESTS - 1 + NUM_CHKSUM_LENS + 2 * 4 + 2 + \
+    FLASH_NUM_MODES + BENCH_NUM_DRIVERS + 2 + ETHLOOP_NUM_SIZES)
+
+static const char *const target_names[] = {
+  "lmb", "wishbone", "spi", "xadc", "eth0",
+};
+static const char *const pattern_names[] = {
+  "read1", "write1", "read-seq", "write-seq", "read-fix", "write-fix",
+  "copy-in", "copy-out", "alu", "memcpy-in", "memcpy-out", "chksum",
+  "flash-read", "snapshot", "udp-send", "driver", "memcpy", "mb-memcpy",
+  "memset", "mb-memset", "loopback",
+};
+
+static struct bench_result results[NUM_RESULTS];
+static u32 bench_overhead;
+// eth0 was still sending, so the Wishbone tests were skipped
+static u8 wb_skipped;
+
+// Rows of dump_bench()'s table printed so far, of print_count
+static u32 print_next, print_count;
+
+static void print_rows(void *arg);
+static struct timer print_timer = TIMER_INIT(print_rows, NULL);
+
+static struct udp_pcb *bench_pcb;
+
+// Boot flag as stored, once read
+static u8 boot;
+static u8 loaded;
+
+// Time BENCH_RUNS calls of fn(addr, n) into `r`, with interrupts locked if
+// `lock`.  Returns 0, or -1 if a run failed.
+static OVL_TEXT(bench) int
+bench_measure(bench_fn fn, u32 addr, u32 n, struct bench_result *r, int lock)
+{
+  u32 run, c, msr = 0;
+
+  failed = 0;
+  r->min_cycles = ~0;
+  r->max_cycles = 0;
+  for(run=0; run<BENCH_RUNS; run++) {
+    if(lock) {
+      msr = intr_lock();
+    }
+    c = fn(addr, n);
+    if(lock) {
+      intr_unlock(msr);
+    }
+    if(failed) {
+      return -1;
+    }
+    c = c > bench_overhead ? c - bench_overhead : 0;
+    if(c < r->min_cycles) {
+      r->min_cycles = c;
+    }
+    if(c > r->max_cycles) {
+      r->max_cycles = c;
+    }
+  }
+  return 0;
+}
+
+static OVL_TEXT(bench) void
+bench_setup(struct bench_result *r, u8 target, u8 pattern, u8 width, u8 arg,
+    u32 accesses)
+{
+  r->target = target;
+  r->pattern = pattern;
+  r->width = width;
+  r->arg = arg;
+  r->accesses = accesses;
+}
+
+OVL_TEXT(bench) u32
+bench_run(struct bench_result *r, u32 max, const ip4_addr_t *udp_dst)
+{
+  const struct ethloop_result *lr;
+  struct bench_result o;
+  u32 t0, target, accesses, lost, i, n = 0;
+
+  bench_overhead = 0;
+  bench_measure(overhead, 0, 0, &o, 1);
+  bench_overhead = o.min_cycles;
+
+  t0 = (u32)timebase_us();
+  while(eth_get_tx_level(ETH0_BASE_ADDRESS)) {
+    if((u32)timebase_us() - t0 > BENCH_TX_WAIT_US) {
+      break;
+    }
+  }
+
+  wb_skipped = 0;
+  for(target=BENCH_LMB; target<=BENCH_WISHBONE; target++) {
+    // Still sending: leave the bridge alone
+    if(target == BENCH_WISHBONE && eth_get_tx_level(ETH0_BASE_ADDRESS)) {
+      wb_skipped = 1;
+      break;
+    }
+    for(i=0; i<NUM_TESTS && n<max; i++, n++) {
+      if(tests[i].pattern == BENCH_ALU && target != BENCH_LMB) {
+        break;
+      }
+      if(tests[i].pattern == BENCH_READ1 || tests[i].pattern == BENCH_WRITE1) {
+        accesses = 1;
+      } else if(tests[i].pattern == BENCH_ALU) {
+        accesses = 5 * (BENCH_BYTES / 4);
+      } else {
+        accesses = BENCH_BYTES / tests[i].width;
+      }
+      bench_setup(&r[n], target, tests[i].pattern, tests[i].width, 0,
+          accesses);
+      bench_measure(tests[i].fn,
+          target == BENCH_LMB ? (u32)lmb_buf : BENCH_WB_ADDR,
+          r[n].accesses, &r[n], 1);
+    }
+  }
+
+  for(i=0; i<NUM_CHKSUM_LENS && n<max; i++, n++) {
+    bench_setup(&r[n], BENCH_LMB, BENCH_CHKSUM, 1, 0, chksum_lens[i]);
+    bench_measure(chksum, BENCH_CHKSUM_ADDR, chksum_lens[i], &r[n], 1);
+  }
+
+  for(i=0; i<8 && n<max; i++, n++) {
+    bench_setup(&r[n], BENCH_LMB, i < 4 ? BENCH_MEMCPY : BENCH_MB_MEMCPY, 1,
+        i & 3, BENCH_MEM_BYTES);
+    bench_measure(i < 4 ? lib_copy : mb_copy, (u32)lmb_buf + (i & 3),
+        BENCH_MEM_BYTES, &r[n], 1);
+  }
+  for(i=0; i<2 && n<max; i++, n++) {
+    bench_setup(&r[n], BENCH_LMB, i ? BENCH_MB_MEMSET : BENCH_MEMSET, 1, 0,
+        BENCH_MEM_BYTES);
+    bench_measure(i ? mb_set : lib_set, (u32)lmb_buf, BENCH_MEM_BYTES, &r[n],
+        1);
+  }
+
+  // Not while the asynchronous queue or a program or erase has the flash
+  for(i=0; i<=FLASH_MODE_BEST && n<max && !spi_busy() && !flash_busy(); i++) {
+    if(!flash_info.read[i].opcode) {
+      continue;
+    }
+    bench_setup(&r[n], BENCH_SPI, BENCH_FLASH_READ, 1, i, BENCH_BYTES);
+    if(bench_measure(flash_read, i, BENCH_BYTES, &r[n], 0) == 0) {
+      n++;
+    }
+  }
+
+  if(n < max) {
+    bench_setup(&r[n], BENCH_XADC, BENCH_SNAPSHOT, 2, 0, 1);
+    bench_measure(snapshot, 0, 0, &r[n], 1);
+    n++;
+  }
+
+  bench_sysmon.Config.BaseAddress = XPAR_SYSMON_0_BASEADDR;
+  bench_sysmon.IsReady = XIL_COMPONENT_IS_READY;
+  bench_spi.BaseAddr = XPAR_SPI_0_BASEADDR;
+  bench_spi.IsReady = XIL_COMPONENT_IS_READY;
+  for(i=0; i<BENCH_NUM_DRIVERS && n<max; i++) {
+    target = i < BENCH_DRV_SPI_SS ? BENCH_XADC : BENCH_SPI;
+    // The network core of a two-core build has no XADC (role.h)
+    if(target == BENCH_XADC && JAM_ROLE == JAM_ROLE_NET) {
+      continue;
+    }
+    bench_setup(&r[n], target, BENCH_DRIVER, target == BENCH_XADC ? 2 : 4,
+        i, BENCH_DRIVER_CALLS);
+    bench_measure(driver_call, i, BENCH_DRIVER_CALLS, &r[n], 1);
+    n++;
+  }
+
+  // Only once the next hop is resolved: until then the datagrams would pile
+  // up on its ARP entry
+  if(n < max && udp_dst &&
+     udpflow_connect(&udp_flow, udp_dst, BENCH_PORT, BENCH_UDP_PORT) == 0 &&
+     udp_flow.resolved) {
+    bench_setup(&r[n], BENCH_ETH0, BENCH_UDP_SEND, BENCH_UDP_LEN, 0,
+        BENCH_UDP_COUNT);
+    if(bench_measure(flow_send, 0, BENCH_UDP_COUNT, &r[n], 0) == 0) {
+      n++;
+    }
+  }
+
+  // The last loopback self-test's, being too slow to run here
+  for(i=0; n<max && (lr = ethloop_result(i)); i++) {
+    if(ethloop_state() != ETHLOOP_DONE || !lr->good) {
+      break;
+    }
+    lost = lr->sent - lr->good;
+    bench_setup(&r[n], BENCH_ETH0, BENCH_LOOPBACK, 1, lost < 255 ? lost : 255,
+        lr->size);
+    r[n].min_cycles = lr->min_cycles;
+    r[n].max_cycles = lr->max_cycles;
+    n++;
+  }
+  return n;
+}
+
+// Print rows of the table for as long as the console has room for them,
+// then once they are all out the end of it
+static void
+print_rows(void *arg)
+{
+  const struct bench_result *r;
+  u32 cpa, rate;
+  char buf[FMT_FIXED_MAX];
+
+  for(; print_next<print_count; print_next++) {
+    if(console_space() < BENCH_ROW_MAX) {
+      return;
+    }
+    r = &results[print_next];
+    // Hundredths of a cycle per access, and tenths of a MB/s
+    cpa = r->min_cycles * 100 / r->accesses;
+    xil_printf("%-8s %-10s %5d %3d %8d  %9s", target_names[r->target],
+        pattern_names[r->pattern], r->width, r->arg, r->accesses,
+        fmt_fixed(buf, cpa, 100, 2));
+    cpa = r->max_cycles * 100 / r->accesses;
+    xil_printf("  %10s", fmt_fixed(buf, cpa, 100, 2));
+    if(r->accesses > 1 && r->min_cycles && r->pattern != BENCH_ALU &&
+       r->pattern != BENCH_DRIVER) {
+      rate = r->accesses * r->width * TIMEBASE_CYCLES_PER_US * 10 /
+          r->min_cycles;
+      xil_printf("  %7s\n", fmt_fixed(buf, rate, 10, 1));
+    } else {
+      print("       -\n");
+    }
+  }
+  if(wb_skipped) {
+    print("wishbone: eth0 still sending, skipped\n");
+  }
+  print_count = 0;
+  timer_stop(&print_timer);
+}
+
+OVL_TEXT(bench) void
+dump_bench()
+{
+  if(bench_printing()) {
+    print("bench: still printing the last table\n");
+    return;
+  }
+  print_count = bench_run(results, NUM_RESULTS, NULL);
+  print_next = 0;
+  xil_printf("Timer cycles, %d MHz; stamps take %d; driver asserts %s\n",
+      TIMEBASE_CYCLES_PER_US, bench_overhead, BENCH_ASSERTS);
+  print("target   pattern    width arg accesses  min/access  max/access"
+      "    MB/s\n");
+  // The table is longer than the console's buffer: the rest goes out as
+  // it drains
+  print_rows(NULL);
+  if(bench_printing()) {
+    timer_start(&print_timer, BENCH_PRINT_MS, BENCH_PRINT_MS);
+  }
+}
+
+int
+bench_printing()
+{
+  return print_count != 0;
+}
+
+void
+bench_fill_header(struct bench_header *h, u32 count)
+{
+  h->magic = BENCH_MAGIC;
+  h->hz = TIMEBASE_HZ;
+  h->count = count;
+  h->result_size = sizeof(struct bench_result);
+  h->overhead = bench_overhead;
+}
+
+static void
+bench_recv(void *arg, struct udp_pcb *pcb, struct pbuf *p,
+    const ip_addr_t *addr, u16_t port)
+{
+  struct bench_header h;
+  struct pbuf *r;
+  u32 n;
+
+  pbuf_free(p);
+  // The table being printed is in `results`: the host asks again
+  if(bench_printing()) {
+    return;
+  }
+
+  n = ovl_load(OVL_BENCH) == 0 ?
+      bench_run(results, NUM_RESULTS, ip_2_ip4(addr)) : 0;
+  bench_fill_header(&h, n);
+
+  r = pbuf_alloc(PBUF_TRANSPORT, sizeof(h) + n * sizeof(results[0]),
+      PBUF_RAM);
+  if(!r) {
+    return;
+  }
+  pbuf_take(r, &h, sizeof(h));
+  pbuf_take_at(r, results, n * sizeof(results[0]), sizeof(h));
+  udp_sendto(pcb, r, addr, port);
+  pbuf_free(r);
+}
+
+static struct kv_save save = KV_SAVE_INIT(save, KV_KEY_BENCH);
+
+int
+bench_at_boot()
+{
+  if(!loaded && kv_get(KV_KEY_BENCH, &boot, sizeof(boot)) != sizeof(boot)) {
+    boot = 0;
+  }
+  loaded = 1;
+  return boot;
+}
+
+void
+bench_set_boot(int on)
+{
+  boot = on ? 1 : 0;
+  loaded = 1;
+  kv_save(&save, &boot, boot ? sizeof(boot) : 0);
+}
+
+void
+init_bench()
+{
+  bench_pcb = udp_new();
+  if(!bench_pcb || udp_bind(bench_pcb, IP_ADDR_ANY, BENCH_PORT) != ERR_OK) {
+    return;
+  }
+  udp_recv(bench_pcb, bench_recv, NULL);
+}
@@ -0,0 +1,157 @@
+#ifndef _BENCH_H_
+#define _BENCH_H_
+
+// bench.h - On-target micro-benchmarks: bus access latency and bandwidth,
+// and the cost of the firmware's hot paths.
+//
+// The suite times each access width and pattern against a buffer in LMB
+// BRAM and against eth0's TX buffer behind the Wishbone bridge, using
+// timebase_stamp(), along with a register-only loop for the cycles an
+// instruction takes when nothing stalls.  A code path whose cycles per
+// instruction are well above that is waiting on the bus.  Then it times
+// mb_chksum() over BENCH_CHKSUM_LENS, mbmem.h's memcpy and memset against
+// newlib's at each source alignment, a BENCH_BYTES read_flash() in each
+// read mode the flash and SPI core have, an xadc_snapshot(), a few BSP
+// driver calls against the register reads they wrap (run it on a CHECKED=1
+// and a release build to see what the drivers' asserts cost) and, when
+// there is someone to send to, BENCH_UDP_COUNT datagrams on the udpflow.h
+// fast path.  Each test runs BENCH_RUNS times and keeps the fastest and
+// slowest run, less the cost of taking the stamps; all but the flash and
+// UDP tests, which take longer than a timer tick, run with interrupts
+// locked.  Last come the results of the last eth0 loopback self-test
+// (ethloop.h), which runs by itself: a row per frame size, with its
+// fastest and slowest round trip.
+//
+// A datagram to BENCH_PORT runs the suite (it holds up the main loop for
+// a few tens of milliseconds) and the reply carries a struct bench_header
+// followed by `count` struct bench_result, little-endian (none if the
+// suite's overlay cannot be loaded); the datagrams of the UDP test go to
+// the sender's discard port.  The suite also prints
+// its table on the console at startup when built with BENCH_AT_BOOT set or
+// when the flag saved under KV_KEY_BENCH (KATCP's ?bench boot) is on.
+
+#include "lwip/ip4_addr.h"
+
+#include "xil_types.h"
+
+#define BENCH_PORT (7004)
+
+// Bytes each bandwidth test moves, and runs of each test
+#define BENCH_BYTES (1024)
+#define BENCH_RUNS  (4)
+
+// Lengths mb_chksum() is timed over
+#define BENCH_CHKSUM_LENS { 64, 256, 1500, 9000 }
+
+// Datagrams of the UDP test, their payload, and where they go on the
+// requester
+#define BENCH_UDP_COUNT (64)
+#define BENCH_UDP_LEN   (64)
+#define BENCH_UDP_PORT  (9)
+
+#ifndef BENCH_AT_BOOT
+#define BENCH_AT_BOOT (0)
+#endif
+
+#define BENCH_MAGIC (0x31434e42) // "BNC1"
+
+// Targets
+#define BENCH_LMB      (0)
+#define BENCH_WISHBONE (1)
+#define BENCH_SPI      (2) // the configuration flash
+#define BENCH_XADC     (3)
+#define BENCH_ETH0     (4)
+
+// Patterns
+#define BENCH_READ1     (0) // one read
+#define BENCH_WRITE1    (1) // one write
+#define BENCH_READ_SEQ  (2) // consecutive reads through BENCH_BYTES
+#define BENCH_WRITE_SEQ (3) // consecutive writes through BENCH_BYTES
+#define BENCH_READ_FIX  (4) // BENCH_BYTES worth of reads of one address
+#define BENCH_WRITE_FIX (5) // BENCH_BYTES worth of writes of one address
+#define BENCH_COPY_IN   (6) // ethbuf_read() of BENCH_BYTES
+#define BENCH_COPY_OUT  (7) // ethbuf_write() of BENCH_BYTES
+#define BENCH_ALU       (8) // register-only instructions (LMB target only;
+                            // `accesses` counts instructions), the
+                            // compute-bound baseline for the rest
+#define BENCH_MEMCPY_IN  (9)  // memcpy() of BENCH_BYTES to LMB
+#define BENCH_MEMCPY_OUT (10) // memcpy() of BENCH_BYTES from LMB
+#define BENCH_CHKSUM     (11) // mb_chksum() of `accesses` bytes of LMB
+#define BENCH_FLASH_READ (12) // read_flash() of BENCH_BYTES in mode `arg`
+#define BENCH_SNAPSHOT   (13) // xadc_snapshot()
+#define BENCH_UDP_SEND   (14) // udpflow_write() of `accesses` datagrams of
+                              // `width` bytes
+#define BENCH_DRIVER     (15) // `accesses` calls of BENCH_DRV_ `arg`
+#define BENCH_MEMCPY     (16) // memcpy() of `accesses` bytes within LMB,
+                              // from `arg` bytes past a word
+#define BENCH_MB_MEMCPY  (17) // mb_memcpy() likewise
+#define BENCH_MEMSET     (18) // memset() of `accesses` bytes of LMB
+#define BENCH_MB_MEMSET  (19) // mb_memset() likewise
+#define BENCH_LOOPBACK   (20) // round trip of a frame of `accesses` bytes
+                              // (ethloop.h), `arg` of them lost
+
+// Driver calls timed, with the plain register read each one comes down to
+#define BENCH_DRV_ADC_DATA (0) // XSysMon_GetAdcData() of the temperature
+#define BENCH_DRV_XADC_REG (1) // XSysMon_ReadReg() of the same register
+#define BENCH_DRV_MIN_MAX  (2) // XSysMon_GetMinMaxMeasurement()
+#define BENCH_DRV_SPI_SS   (3) // XSpi_GetSlaveSelect()
+#define BENCH_DRV_SPI_REG  (4) // XSpi_ReadReg() of the status register
+#define BENCH_NUM_DRIVERS  (5)
+
+// Calls in each run of a BENCH_DRIVER test
+#define BENCH_DRIVER_CALLS (16)
+
+struct bench_result {
+  u8 target;
+  u8 pattern;
+  // Access width in bytes
+  u8 width;
+  // Test parameter: the FLASH_MODE_ of a flash read, the BENCH_DRV_ of a
+  // driver call, the source's offset of a copy, otherwise 0
+  u8 arg;
+  // Accesses per run
+  u32 accesses;
+  // Fastest and slowest run, in timer cycles
+  u32 min_cycles;
+  u32 max_cycles;
+};
+
+struct bench_header {
+  u32 magic;
+  // Timer clock
+  u32 hz;
+  u16 count;
+  u16 result_size;
+  // Cycles taken by the stamps around each run, already subtracted
+  u32 overhead;
+};
+
+// Listen on BENCH_PORT.  Call after lwip_init().
+void init_bench();
+
+// The suite is the OVL_BENCH overlay (ovl.h): ovl_load() it before calling
+// bench_run() or dump_bench().
+
+// Run the suite, filling `r` (room for `max` results).  The UDP test sends
+// to `udp_dst`, and is skipped if NULL.  Returns the number of results.
+u32 bench_run(struct bench_result *r, u32 max, const ip4_addr_t *udp_dst);
+
+// Fill in the header of `count` results from the last bench_run(), as
+// BENCH_PORT's replies carry it
+void bench_fill_header(struct bench_header *h, u32 count);
+
+// Run the suite and print the table.  The rows the console has no room
+// for yet go out from a timer as it drains (console.h), with the suite
+// and BENCH_PORT's requests held off until they have.
+void dump_bench();
+
+// Non-zero while dump_bench()'s table is still going out
+int bench_printing();
+
+// Non-zero if the suite is to run at startup
+int bench_at_boot();
+
+// Set whether the suite runs at startup, saving the flag in flash
+void bench_set_boot(int on);
+
+#endif // _BENCH_H_
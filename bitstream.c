@@ -0,0 +1,124 @@
+// bitstream.c - Xilinx 7-series bitstream headers and the IDCODE they load
+// for (see bitstream.h).
+
+#include <string.h>
+
+#include "bitstream.h"
+
+// The .bit header's first field: its length, 9, and 9 fixed bytes
+static const u8 bit_magic[] = {
+  0x00, 0x09, 0x0f, 0xf0, 0x0f, 0xf0, 0x0f, 0xf0, 0x0f, 0xf0, 0x00
+};
+
+// Configuration packet headers (UG470): type in bits 31:29, then for type
+// 1 the opcode, register and word count
+#define PKT_TYPE(w)     ((w) >> 29)
+#define PKT_TYPE1       (1)
+#define PKT_OP(w)       (((w) >> 27) & 0x3)
+#define PKT_OP_WRITE    (2)
+#define PKT_REG(w)      (((w) >> 13) & 0x3fff)
+#define PKT_COUNT(w)    ((w) & 0x7ff)
+
+#define CFG_REG_IDCODE  (0x0c)
+
+static u32
+be16(const u8 *p)
+{
+  return (p[0] << 8) | p[1];
+}
+
+static u32
+be32(const u8 *p)
+{
+  return ((u32)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+// Skip a .bit header, keeping its part name.  Returns the offset of the
+// data, 0 if there is no header, or -1 if it is malformed.
+static int
+skip_header(const u8 *buf, u32 len, struct bit_info *info)
+{
+  u32 off, n, m;
+  u8 key;
+
+  if(len < sizeof(bit_magic) ||
+     memcmp(buf, bit_magic, sizeof(bit_magic)) != 0) {
+    return 0;
+  }
+  // Then a 1-byte field, the 'a' key, and the tagged fields
+  off = sizeof(bit_magic) + 2;
+  while(off + 3 <= len) {
+    key = buf[off];
+    if(key == 'e') {
+      return off + 5 <= len ? (int)(off + 5) : -1;
+    }
+    if(key < 'a' || key > 'd') {
+      return -1;
+    }
+    n = be16(&buf[off + 1]);
+    off += 3;
+    if(off + n > len) {
+      return -1;
+    }
+    if(key == 'b' && n) {
+      m = n < BIT_PART_MAX ? n : BIT_PART_MAX;
+      memcpy(info->part, &buf[off], m);
+      info->part[m - 1] = '\0';
+    }
+    off += n;
+  }
+  return -1;
+}
+
+int
+bit_parse(const u8 *buf, u32 len, struct bit_info *info)
+{
+  int off;
+  u32 i, w, n;
+
+  memset(info, 0, sizeof(*info));
+  off = skip_header(buf, len, info);
+  if(off < 0) {
+    return BIT_EHEADER;
+  }
+  info->data_off = off;
+
+  for(i=off; i+4<=len && be32(&buf[i]) != BIT_SYNC; i++) {
+  }
+  if(i + 4 > len) {
+    return BIT_ENOSYNC;
+  }
+  info->sync_off = i;
+
+  // Walk the type 1 packets; the IDCODE comes before any frame data
+  for(i+=4; i+4<=len; i+=4 + n * 4) {
+    w = be32(&buf[i]);
+    if(PKT_TYPE(w) != PKT_TYPE1) {
+      break;
+    }
+    n = PKT_COUNT(w);
+    if(PKT_OP(w) == PKT_OP_WRITE && PKT_REG(w) == CFG_REG_IDCODE && n == 1) {
+      if(i + 8 > len) {
+        break;
+      }
+      info->idcode = be32(&buf[i + 4]);
+      return BIT_OK;
+    }
+  }
+  return BIT_ENOID;
+}
+
+int
+bit_check(const u8 *buf, u32 len, u32 idcode)
+{
+  struct bit_info info;
+  int err = bit_parse(buf, len, &info);
+
+  if(err != BIT_OK) {
+    return err;
+  }
+  if(idcode && ((info.idcode ^ idcode) & BIT_ID_MASK)) {
+    return BIT_EIDCODE;
+  }
+  return BIT_OK;
+}
@@ -0,0 +1,53 @@
+#ifndef _BITSTREAM_H_
+#define _BITSTREAM_H_
+
+// bitstream.h - Xilinx 7-series bitstream headers and the IDCODE they load
+// for.
+//
+// A .bit file starts with a header of tagged fields: the design name
+// ('a'), part ('b'), date and time, then 'e' and the length of the
+// configuration data.  A .bin file is that data alone.  The data is
+// padding, a bus width pattern and the sync word, then configuration
+// packets.  One packet writes the IDCODE the bitstream was built for, and
+// the FPGA refuses the load if its own differs.  bit_parse() finds that
+// packet among the first packets after the sync word, so the first block of
+// an upload is enough to reject one built for another part.
+
+#include "xil_types.h"
+
+// bit_parse() results
+#define BIT_OK       (0)
+#define BIT_EHEADER  (-1) // .bit header cut short or malformed
+#define BIT_ENOSYNC  (-2) // no sync word in the data given
+#define BIT_ENOID    (-3) // no IDCODE write in the data given
+#define BIT_EIDCODE  (-4) // built for another device (bit_check())
+
+#define BIT_SYNC     (0xaa995566)
+// IDCODE bits that name the device; the top four are its revision
+#define BIT_ID_MASK  (0x0fffffff)
+
+// Part name kept from a .bit header, with its NUL
+#define BIT_PART_MAX (24)
+
+struct bit_info {
+  // Offset of the configuration data: the .bit header's length, 0 for .bin
+  u32 data_off;
+  // Offset of the sync word
+  u32 sync_off;
+  u32 idcode;
+  // From the .bit header, empty for .bin
+  char part[BIT_PART_MAX];
+};
+
+// Parse the start of an image, `len` bytes at `buf`, into `*info`.
+//
+// Returns BIT_OK or why not.
+int bit_parse(const u8 *buf, u32 len, struct bit_info *info);
+
+// Parse the start of an image and check it loads on a device whose IDCODE
+// is `idcode` (any with 0).
+//
+// Returns BIT_OK or why not.
+int bit_check(const u8 *buf, u32 len, u32 idcode);
+
+#endif // _BITSTREAM_H_
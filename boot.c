@@ -0,0 +1,42 @@
+// boot.c - Boot timeline (see boot.h).
+
+#include "xil_printf.h"
+
+#include "boot.h"
+#include "fmt.h"
+#include "timebase.h"
+
+static struct boot_stage stages[BOOT_MAX_STAGES];
+static u32 num_stages;
+
+void
+boot_stage(const char *name)
+{
+  if(num_stages == BOOT_MAX_STAGES) {
+    return;
+  }
+  stages[num_stages].name = name;
+  stages[num_stages].time_us = timebase_us();
+  num_stages++;
+}
+
+const struct boot_stage *
+boot_get(u32 n)
+{
+  return n < num_stages ? &stages[n] : NULL;
+}
+
+void
+dump_boot()
+{
+  u32 i, prev = 0, t;
+  char done[FMT_FIXED_MAX], took[FMT_FIXED_MAX];
+
+  print("stage          done ms  took ms\n");
+  for(i=0; i<num_stages; i++) {
+    t = stages[i].time_us;
+    xil_printf("%-12s %10s %9s\n", stages[i].name,
+        fmt_fixed(done, t, 1000, 3), fmt_fixed(took, t - prev, 1000, 3));
+    prev = t;
+  }
+}
@@ -0,0 +1,31 @@
+#ifndef _BOOT_H_
+#define _BOOT_H_
+
+// boot.h - Boot timeline: when each startup stage finished.
+//
+// Startup calls boot_stage() as each stage ends, after init_timebase()
+// has started the clock (stages before it count from the timer's start).
+// The timeline prints on the console with the rest of the startup report,
+// once the network is up, and KATCP's ?boot lists it.
+
+#include "xil_types.h"
+
+// Stages kept; later ones are dropped
+#define BOOT_MAX_STAGES (24)
+
+struct boot_stage {
+  const char *name;
+  // timebase_us() when the stage finished
+  u32 time_us;
+};
+
+// Record that the stage `name` (a string that outlives the call) is done
+void boot_stage(const char *name);
+
+// Stage `n`, or NULL past the last
+const struct boot_stage *boot_get(u32 n);
+
+// Print the timeline on the console
+void dump_boot();
+
+#endif // _BOOT_H_
@@ -0,0 +1,273 @@
+// bootldr.c - Second-stage loader: the firmware from flash into BRAM (see
+// bootldr.h).
+//
+// Each read is a single transaction: the opcode, the address and one dummy
+// byte, then the data.  The data is clocked straight out of the rx fifo
+// into BRAM, with the tx fifo kept topped up as spi.c does, so that SCK
+// never stops.  A compressed image is read the same way, BOOT_CHUNK bytes
+// at a time into a buffer that the decoder (heatshrink.h) works from, so
+// the loader holds no more than that and the decoder's window.
+//
+// Where the core is built for quad mode, the read is Quad Output Fast
+// Read (1-1-4), which the N25Q answers without setting a quad enable bit.
+// The core moves to four data lines for that opcode by itself.
+
+#include <stddef.h>
+
+#include "xparameters.h"
+#include "xspi_l.h"
+
+#include "bootldr/bootldr.h"
+#include "crc32.h"
+#include "heatshrink.h"
+#include "slots.h"
+
+#define BOOT_SPI_BASE   XPAR_SPI_0_BASEADDR
+#define BOOT_FIFO_DEPTH XPAR_SPI_0_FIFO_DEPTH
+
+// Polls of an empty rx fifo before giving up on a read, as in spi.c
+#define BOOT_RX_TIMEOUT (1000)
+
+// Compressed bytes read before each run of the decoder
+#define BOOT_CHUNK (256)
+
+// Read opcodes with 3- and 4-byte addresses, each with 8 dummy clocks on
+// one line: the fastest the core's data lines allow
+#if XPAR_SPI_0_SPI_MODE == 2
+#define BOOT_READ_OP  (0x6b)
+#define BOOT_READ_OP4 (0x6c)
+#elif XPAR_SPI_0_SPI_MODE == 1
+#define BOOT_READ_OP  (0x3b)
+#define BOOT_READ_OP4 (0x3c)
+#else
+#define BOOT_READ_OP  (0x0b)
+#define BOOT_READ_OP4 (0x0c)
+#endif
+
+#define BOOT_ADDR4 (BOOT_FLASH_SIZE > (16 << 20))
+
+// Address of reserved sector `n`, as flash_rsv_addr() has it
+#define BOOT_RSV_ADDR(n) \
+  (BOOT_FLASH_SIZE - (FLASH_RSV_SECTORS - (n)) * BOOT_RSV_SIZE)
+
+static inline u32
+boot_reg(u32 off)
+{
+  return XSpi_ReadReg(BOOT_SPI_BASE, off);
+}
+
+static inline void
+boot_set_reg(u32 off, u32 val)
+{
+  XSpi_WriteReg(BOOT_SPI_BASE, off, val);
+}
+
+// Shift out `len` bytes of `src` (idle bytes if NULL) and store what comes
+// back in `dst` (unless NULL).  Returns 0, or -1 if the rx fifo stayed
+// empty.
+static int
+boot_xfer(const u8 *src, u8 *dst, u32 len)
+{
+  u32 tx = 0, rx = 0, idle = 0;
+  u32 i, n, b;
+
+  while(rx < len) {
+    for(; tx < len && tx - rx < BOOT_FIFO_DEPTH; tx++) {
+      boot_set_reg(XSP_DTR_OFFSET, src ? src[tx] : 0xff);
+    }
+    if(boot_reg(XSP_SR_OFFSET) & XSP_SR_RX_EMPTY_MASK) {
+      if(++idle == BOOT_RX_TIMEOUT) {
+        return -1;
+      }
+      continue;
+    }
+    idle = 0;
+    // Occupancy register holds count - 1
+    n = boot_reg(XSP_RFO_OFFSET) + 1;
+    for(i=0; i<n; i++) {
+      b = boot_reg(XSP_DRR_OFFSET);
+      if(dst) {
+        dst[rx] = b;
+      }
+      rx++;
+    }
+  }
+  return 0;
+}
+
+// Select the flash and send the read command for `addr`, leaving the
+// transaction open for the data.  Returns 0 or -1.
+static int
+boot_read_begin(u32 addr)
+{
+  u8 cmd[6];
+  u32 n = 0;
+
+  cmd[n++] = BOOT_ADDR4 ? BOOT_READ_OP4 : BOOT_READ_OP;
+  if(BOOT_ADDR4) {
+    cmd[n++] = addr >> 24;
+  }
+  cmd[n++] = addr >> 16;
+  cmd[n++] = addr >> 8;
+  cmd[n++] = addr;
+  cmd[n++] = 0xff; // dummy
+
+  boot_set_reg(XSP_SSR_OFFSET, ~1);
+  return boot_xfer(cmd, NULL, n);
+}
+
+static void
+boot_read_end()
+{
+  boot_set_reg(XSP_SSR_OFFSET, ~0);
+}
+
+// Read `len` bytes of flash at `addr` into `dst`.  Returns 0 or -1.
+static int
+boot_read(u32 addr, void *dst, u32 len)
+{
+  int err;
+
+  err = boot_read_begin(addr) || boot_xfer(NULL, dst, len) ? -1 : 0;
+  boot_read_end();
+  return err;
+}
+
+// Decode the compressed image of `h` at `addr` into `out`, reading it
+// BOOT_CHUNK bytes at a time in one transaction.  Returns 0 once all of
+// the image is out, -1 otherwise.
+static int
+boot_unpack(u32 addr, u8 *out, const struct app_header *h)
+{
+  static struct hs_dec dec;
+  static u8 buf[BOOT_CHUNK];
+  const u8 *in;
+  u32 left = h->packed, done = 0, n, in_len;
+  int err;
+
+  hs_init(&dec);
+  err = boot_read_begin(addr);
+  while(!err && left && done < h->size) {
+    n = left < BOOT_CHUNK ? left : BOOT_CHUNK;
+    err = boot_xfer(NULL, buf, n);
+    left -= n;
+    in = buf;
+    in_len = n;
+    done += hs_decode(&dec, &in, &in_len, out + done, h->size - done);
+  }
+  boot_read_end();
+  return !err && done == h->size ? 0 : -1;
+}
+
+// Newest valid copy of the slot table into `t`, as init_slots() finds it.
+// Returns non-zero if there is one.
+static int
+boot_table(struct slot_table *t)
+{
+  struct slot_table c;
+  int found = 0;
+  u32 s, p, seq = 0;
+
+  for(s=0; s<2; s++) {
+    for(p=0; p<BOOT_RSV_SIZE / BOOT_PAGE_SIZE; p++) {
+      if(boot_read(BOOT_RSV_ADDR(FLASH_RSV_SLOTS + s) + p * BOOT_PAGE_SIZE,
+            &c, sizeof(c)) != 0) {
+        continue;
+      }
+      if(c.magic == SLOT_ERASED) {
+        break;
+      }
+      if(c.magic != SLOT_TABLE_MAGIC || c.num > SLOT_MAX ||
+         c.crc != crc32(0, &c, offsetof(struct slot_table, crc))) {
+        continue;
+      }
+      if(!found || (s32)(c.seq - seq) > 0) {
+        *t = c;
+        seq = c.seq;
+        found = 1;
+      }
+    }
+  }
+  return found;
+}
+
+// Load the image at `addr`, of at most `room` bytes, into `bram` and check
+// it.  Returns 0 once it is in place, -1 otherwise.
+static int
+boot_load(u32 addr, u32 room, u8 *bram, struct app_header *h)
+{
+  if(room < sizeof(*h) || boot_read(addr, h, sizeof(*h)) != 0 ||
+     !app_header_ok(h, room - sizeof(*h))) {
+    return -1;
+  }
+  if(h->packed) {
+    if(boot_unpack(addr + sizeof(*h), bram + h->load, h) != 0) {
+      return -1;
+    }
+  } else if(boot_read(addr + sizeof(*h), bram + h->load, h->size) != 0) {
+    return -1;
+  }
+  return crc32(0, bram + h->load, h->size) == h->crc ? 0 : -1;
+}
+
+static int
+boot_find(u8 *bram, struct app_header *h)
+{
+  struct slot_table t;
+  const struct slot_desc *d;
+  u32 tried = 0, version = 0;
+  int i, best;
+
+  if(!boot_table(&t)) {
+    // slots_default()'s layout, of which only the golden slot matters
+    t.num = 1;
+    t.slot[SLOT_GOLDEN].addr = 0;
+    t.slot[SLOT_GOLDEN].size =
+      (BOOT_RSV_ADDR(0) / SLOT_DEFAULT_NUM) & ~(SLOT_ALIGN - 1);
+  }
+
+  // Newest first; an image that fails its checks is not tried again
+  for(;;) {
+    best = -1;
+    for(i=0; i<t.num; i++) {
+      d = &t.slot[i];
+      if(i == SLOT_GOLDEN || !d->len || (tried & (1 << i)) ||
+         (best >= 0 && d->version < version)) {
+        continue;
+      }
+      best = i;
+      version = d->version;
+    }
+    if(best < 0) {
+      break;
+    }
+    tried |= 1 << best;
+    d = &t.slot[best];
+    if(boot_load(d->addr, d->len, bram, h) == 0) {
+      return best;
+    }
+  }
+
+  d = &t.slot[SLOT_GOLDEN];
+  if(d->size >= APP_GOLDEN_SIZE &&
+     boot_load(d->addr + d->size - APP_GOLDEN_SIZE, APP_GOLDEN_SIZE, bram,
+       h) == 0) {
+    return SLOT_GOLDEN;
+  }
+  return -1;
+}
+
+int
+boot_image(u8 *bram, struct app_header *h)
+{
+  int slot;
+
+  boot_set_reg(XSP_SRR_OFFSET, XSP_SRR_RESET_MASK);
+  boot_set_reg(XSP_SSR_OFFSET, ~0);
+  boot_set_reg(XSP_CR_OFFSET, XSP_CR_MASTER_MODE_MASK |
+      XSP_CR_MANUAL_SS_MASK | XSP_CR_ENABLE_MASK |
+      XSP_CR_TXFIFO_RESET_MASK | XSP_CR_RXFIFO_RESET_MASK);
+  slot = boot_find(bram, h);
+  boot_set_reg(XSP_SRR_OFFSET, XSP_SRR_RESET_MASK);
+  return slot;
+}
@@ -0,0 +1,43 @@
+#ifndef _BOOTLDR_H_
+#define _BOOTLDR_H_
+
+// bootldr.h - Second-stage loader: the firmware from flash into BRAM.
+//
+// start.S clears the loader's .bss, sets up its stack at the top of BRAM
+// and calls boot_main() (main.c).  boot_main() runs boot_image() and jumps
+// to the entry point of the image it loaded.  boot_image() is separate from
+// the jump so that the host tests can run it against the flash model, with
+// a buffer standing in for BRAM.  The choice of image is described in
+// app.h.
+//
+// The loader drives the SPI core's registers directly and has none of
+// flash.c's SFDP probing, so it assumes the flash that flash.c defaults to
+// without SFDP: BOOT_FLASH_SIZE bytes, read with 3-byte addresses up to
+// 16 MB and the 4-byte opcodes past that, with 256-byte pages and 4 KB
+// reserved sectors.  A board with another part builds the loader with
+// these defined to match.
+
+#include "xil_types.h"
+
+#include "app.h"
+#include "flash.h"
+
+#ifndef BOOT_FLASH_SIZE
+#define BOOT_FLASH_SIZE (16 << 20)
+#endif
+#ifndef BOOT_PAGE_SIZE
+#define BOOT_PAGE_SIZE (256)
+#endif
+#ifndef BOOT_RSV_SIZE
+#define BOOT_RSV_SIZE (FLASH_RSV_MIN)
+#endif
+
+// Load the image to run into `bram`, the place standing for BRAM address
+// 0, and leave its header in `h`.  The SPI core is reset afterwards, ready
+// for init_spi().
+//
+// Returns the slot loaded from (SLOT_GOLDEN for the golden image), or -1
+// if no image passed its checks.
+int boot_image(u8 *bram, struct app_header *h);
+
+#endif // _BOOTLDR_H_
@@ -0,0 +1,17 @@
+// main.c - Entry of the second-stage loader (see bootldr.h).
+
+#include "bootldr/bootldr.h"
+
+void
+boot_main()
+{
+  struct app_header h;
+
+  // BRAM starts at address 0
+  if(boot_image((u8 *)0, &h) < 0) {
+    // Nothing to run; a reset tries again
+    for(;;) {
+    }
+  }
+  ((void (*)(void))h.entry)();
+}
@@ -56,6 +56,11 @@
 #include "xil_io.h"
 #include "xil_types.h"
 #include "xil_assert.h"
+#include "xparameters.h"
+
+#if defined (__MICROBLAZE__) && XPAR_MICROBLAZE_USE_REORDER_INSTR
+#define XIL_IO_SWAPB (1)
+#endif
 
 /*****************************************************************************/
 /**
@@ -71,7 +76,15 @@
 ******************************************************************************/
 u16 Xil_EndianSwap16(u16 Data)
 {
+#ifdef XIL_IO_SWAPB
+	u32 Swapped;
+
+	/* swapb then swaph leaves the swapped halfword in the low half */
+	__asm__ ("swapb %0, %1\n\tswaph %0, %0" : "=&r"(Swapped) : "r"((u32)Data));
+	return (u16) Swapped;
+#else
 	return (u16) (((Data & 0xFF00U) >> 8U) | ((Data & 0x00FFU) << 8U));
+#endif
 }
 
 /*****************************************************************************/
@@ -88,6 +101,12 @@ u16 Xil_EndianSwap16(u16 Data)
 ******************************************************************************/
 u32 Xil_EndianSwap32(u32 Data)
 {
+#ifdef XIL_IO_SWAPB
+	u32 Swapped;
+
+	__asm__ ("swapb %0, %1" : "=r"(Swapped) : "r"(Data));
+	return Swapped;
+#else
 	u16 LoWord;
 	u16 HiWord;
 
@@ -104,4 +123,5 @@ u32 Xil_EndianSwap32(u32 Data)
 	/* swap the half words before returning the value */
 
 	return ((((u32)LoWord) << (u32)16U) | (u32)HiWord);
+#endif
 }
@@ -0,0 +1,73 @@
+#ifndef _BSWAP_H_
+#define _BSWAP_H_
+
+// bswap.h - Byte and halfword swaps for a MicroBlaze without a barrel shifter.
+//
+// Shifts by constants other than 1 are multi-instruction sequences on this
+// core, so swaps use the reorder instructions (swapb/swaph) when the CPU has
+// them (and the C version builds for the host tests in test/).  With them
+// come the byte-reversed load and store (lwr/swr), which swap a word on its
+// way between a register and memory for free.
+
+#include "xparameters.h"
+#include "xil_types.h"
+
+// Reverse the bytes of a word
+static inline u32
+swap32(u32 x)
+{
+#if XPAR_MICROBLAZE_USE_REORDER_INSTR && defined(__MICROBLAZE__)
+  u32 r;
+  __asm__ ("swapb %0, %1" : "=r"(r) : "r"(x));
+  return r;
+#else
+  return (x >> 24) | ((x >> 8) & 0xff00) | ((x << 8) & 0xff0000) | (x << 24);
+#endif
+}
+
+// Swap the halfwords of a word (rotate by 16)
+static inline u32
+rot16(u32 x)
+{
+#if XPAR_MICROBLAZE_USE_REORDER_INSTR && defined(__MICROBLAZE__)
+  u32 r;
+  __asm__ ("swaph %0, %1" : "=r"(r) : "r"(x));
+  return r;
+#else
+  return (x >> 16) | (x << 16);
+#endif
+}
+
+// Reverse the bytes of the low halfword.  The high halfword must be zero.
+static inline u32
+swap16(u32 x)
+{
+  return rot16(swap32(x));
+}
+
+// Load the word at `p` with its bytes reversed (in memory, not behind a bus
+// bridge that has its own idea of byte order)
+static inline u32
+load_swap32(const u32 *p)
+{
+#if XPAR_MICROBLAZE_USE_REORDER_INSTR && defined(__MICROBLAZE__)
+  u32 r;
+  __asm__ ("lwr %0, %1, r0" : "=r"(r) : "r"(p), "m"(*p));
+  return r;
+#else
+  return swap32(*p);
+#endif
+}
+
+// Store `x` to memory at `p` with its bytes reversed
+static inline void
+store_swap32(u32 *p, u32 x)
+{
+#if XPAR_MICROBLAZE_USE_REORDER_INSTR && defined(__MICROBLAZE__)
+  __asm__ ("swr %1, %2, r0" : "=m"(*p) : "r"(x), "r"(p));
+#else
+  *p = swap32(x);
+#endif
+}
+
+#endif // _BSWAP_H_
@@ -0,0 +1,185 @@
+// chksum.c - Internet checksum tuned for MicroBlaze.
+//
+// The CPU has no barrel shifter and a software multiplier, so the generic
+// lwIP routines' FOLD_U32T (>> 16) and SWAP_BYTES_IN_WORD (<< 8, >> 8) cost
+// a long shift sequence each.  Here whole words are summed into a 32-bit
+// one's complement accumulator (carries added back with addc), the loops are
+// unrolled by four words, and folding and byte swaps use swapb/swaph.
+//
+// This relies on the CPU being little-endian: a lone byte at an even offset
+// is the low byte of its halfword.
+
+#include "bswap.h"
+#include "chksum.h"
+#include "perf.h"
+
+// sum += w0 + w1 + w2 + w3, one's complement (end-around carry)
+static inline u32
+add4(u32 sum, u32 w0, u32 w1, u32 w2, u32 w3)
+{
+#ifdef __MICROBLAZE__
+  __asm__ ("add  %0, %0, %1\n\t"
+           "addc %0, %0, %2\n\t"
+           "addc %0, %0, %3\n\t"
+           "addc %0, %0, %4\n\t"
+           "addc %0, %0, r0"
+           : "+r"(sum) : "r"(w0), "r"(w1), "r"(w2), "r"(w3));
+#else
+  sum += w0; if(sum < w0) sum++;
+  sum += w1; if(sum < w1) sum++;
+  sum += w2; if(sum < w2) sum++;
+  sum += w3; if(sum < w3) sum++;
+#endif
+  return sum;
+}
+
+// sum += w, one's complement
+static inline u32
+add1(u32 sum, u32 w)
+{
+#ifdef __MICROBLAZE__
+  __asm__ ("add  %0, %0, %1\n\t"
+           "addc %0, %0, r0"
+           : "+r"(sum) : "r"(w));
+#else
+  sum += w; if(sum < w) sum++;
+#endif
+  return sum;
+}
+
+// Fold a 32-bit one's complement sum to 16 bits.  Adding the halfword-swapped
+// sum leaves hi + lo plus the carry out of lo + hi in the high halfword,
+// which is exactly the end-around-carry sum of the two halves.
+static inline u32
+fold(u32 sum)
+{
+  return rot16(sum + rot16(sum)) & 0xffff;
+}
+
+u16
+mb_chksum(const void *dataptr, int len)
+{
+  const u8 *pb = (const u8 *)dataptr;
+  const u32 *pl;
+  u32 sum = 0;
+  int odd = (u32)pb & 1;
+  PERF_BEGIN(PERF_CHKSUM);
+
+  // Sum as if the buffer started one byte earlier; swapped back at the end.
+  // The lone leading byte is the high byte of a halfword, so a byte swap of
+  // the whole word puts it in bits 31:24, which folds to the same place.
+  if(odd && len > 0) {
+    sum = swap32(*pb++);
+    len--;
+  }
+  if(((u32)pb & 2) && len > 1) {
+    sum += *(const u16 *)pb;
+    pb += 2;
+    len -= 2;
+  }
+
+  pl = (const u32 *)pb;
+  for(; len >= 16; len -= 16) {
+    sum = add4(sum, pl[0], pl[1], pl[2], pl[3]);
+    pl += 4;
+  }
+  for(; len >= 4; len -= 4) {
+    sum = add1(sum, *pl++);
+  }
+
+  pb = (const u8 *)pl;
+  if(len > 1) {
+    sum = add1(sum, *(const u16 *)pb);
+    pb += 2;
+    len -= 2;
+  }
+  if(len > 0) {
+    sum = add1(sum, *pb);
+  }
+
+  sum = fold(sum);
+  if(odd) {
+    sum = swap16(sum);
+  }
+  PERF_END(PERF_CHKSUM);
+  return (u16)sum;
+}
+
+u16
+mb_chksum_copy(void *dst, const void *src, u16 len)
+{
+  const u8 *s = (const u8 *)src;
+  u8 *d = (u8 *)dst;
+  const u32 *sl;
+  u32 *dl;
+  u32 sum = 0, w0, w1, w2, w3;
+  int n = len;
+  int odd = (u32)s & 1;
+
+  // Word loads and stores only work if both ends can be word aligned
+  // together.  Anything else is rare enough to copy and sum separately.
+  if(((u32)s ^ (u32)d) & 3) {
+    const u8 *end = s + n;
+    while(s < end) {
+      *d++ = *s++;
+    }
+    return mb_chksum(dst, len);
+  }
+
+  if(odd && n > 0) {
+    *d = *s;
+    sum = swap32(*s);
+    d++;
+    s++;
+    n--;
+  }
+  if(((u32)s & 2) && n > 1) {
+    *(u16 *)d = *(const u16 *)s;
+    sum += *(const u16 *)s;
+    d += 2;
+    s += 2;
+    n -= 2;
+  }
+
+  sl = (const u32 *)s;
+  dl = (u32 *)d;
+  for(; n >= 16; n -= 16) {
+    w0 = sl[0];
+    w1 = sl[1];
+    w2 = sl[2];
+    w3 = sl[3];
+    dl[0] = w0;
+    dl[1] = w1;
+    dl[2] = w2;
+    dl[3] = w3;
+    sum = add4(sum, w0, w1, w2, w3);
+    sl += 4;
+    dl += 4;
+  }
+  for(; n >= 4; n -= 4) {
+    w0 = *sl++;
+    *dl++ = w0;
+    sum = add1(sum, w0);
+  }
+
+  s = (const u8 *)sl;
+  d = (u8 *)dl;
+  if(n > 1) {
+    w0 = *(const u16 *)s;
+    *(u16 *)d = (u16)w0;
+    sum = add1(sum, w0);
+    d += 2;
+    s += 2;
+    n -= 2;
+  }
+  if(n > 0) {
+    *d = *s;
+    sum = add1(sum, *s);
+  }
+
+  sum = fold(sum);
+  if(odd) {
+    sum = swap16(sum);
+  }
+  return (u16)sum;
+}
@@ -0,0 +1,19 @@
+#ifndef _CHKSUM_H_
+#define _CHKSUM_H_
+
+// chksum.h - Internet checksum tuned for MicroBlaze, plugged into lwIP as
+// LWIP_CHKSUM and LWIP_CHKSUM_COPY (see lwipopts.h).
+//
+// Both return the folded, non-inverted one's complement sum of `len` bytes
+// in network order, like lwip_standard_chksum().  Buffers may start at any
+// byte address.
+
+#include "xil_types.h"
+
+u16 mb_chksum(const void *dataptr, int len);
+
+// Copy `len` bytes from `src` to `dst` (like MEMCPY) and return the checksum
+// of the copied data, touching each byte once
+u16 mb_chksum_copy(void *dst, const void *src, u16 len);
+
+#endif // _CHKSUM_H_
@@ -0,0 +1,154 @@
+// console.c - Buffered, interrupt-driven console output on axi_uartlite_0.
+//
+// The ring is drained a contiguous run at a time through XUartLite_Send():
+// the driver fills the 16 byte FIFO from the run on each FIFO-empty
+// interrupt and calls console_sent() when the run is done, which starts
+// the next one.  outbyte() is the ring's one producer (ring.h) and is not
+// called from interrupt handlers; it only masks interrupts to start an
+// idle UART.
+//
+// The driver is given no receive buffer, so it calls console_received()
+// on every receive interrupt and leaves the FIFO to it.
+
+#include "xparameters.h"
+#include "xuartlite.h"
+#include "xuartlite_l.h"
+
+#include "console.h"
+#include "intr.h"
+#include "ring.h"
+
+static XUartLite xuartlite;
+static int ready;
+
+static u8 tx_buf[CONSOLE_TX_SIZE];
+static struct ring tx = RING_INIT(CONSOLE_TX_SIZE);
+// Length of the run being sent, 0 if the UART is idle
+static volatile u32 tx_run;
+static u32 dropped;
+
+static u8 rx_buf[CONSOLE_RX_SIZE];
+static struct ring rx = RING_INIT(CONSOLE_RX_SIZE);
+static u32 rx_dropped;
+
+// Send the run of buffered characters at the ring's tail.  Interrupts are
+// masked.
+static void
+console_start()
+{
+  u32 n = ring_run(&tx);
+
+  tx_run = n;
+  if(n) {
+    XUartLite_Send(&xuartlite, &tx_buf[ring_tail_slot(&tx)], n);
+  }
+}
+
+// Send handler, from the UART interrupt
+static void
+console_sent(void *ref, unsigned int count)
+{
+  ring_pop(&tx, tx_run);
+  console_start();
+}
+
+// Receive handler, from the UART interrupt
+static void
+console_received(void *ref, unsigned int count)
+{
+  u8 c;
+
+  while(!XUartLite_IsReceiveEmpty(XPAR_UARTLITE_0_BASEADDR)) {
+    c = XUartLite_ReadReg(XPAR_UARTLITE_0_BASEADDR, XUL_RX_FIFO_OFFSET);
+    if(!ring_space(&rx)) {
+      rx_dropped++;
+      continue;
+    }
+    rx_buf[ring_head_slot(&rx)] = c;
+    ring_push(&rx, 1);
+  }
+}
+
+void
+init_console()
+{
+    XUartLite_Initialize(&xuartlite, XPAR_UARTLITE_0_DEVICE_ID);
+    XUartLite_SetSendHandler(&xuartlite, console_sent, NULL);
+    XUartLite_SetRecvHandler(&xuartlite, console_received, NULL);
+
+    intr_connect(XPAR_INTC_0_UARTLITE_0_VEC_ID,
+        (XInterruptHandler)XUartLite_InterruptHandler, &xuartlite);
+    XUartLite_EnableInterrupt(&xuartlite);
+    ready = 1;
+}
+
+// Replaces the BSP's polled outbyte()
+void
+outbyte(char c)
+{
+  u32 msr;
+
+  if(!ready) {
+    XUartLite_SendByte(STDOUT_BASEADDRESS, c);
+    return;
+  }
+
+  if(!ring_space(&tx)) {
+    dropped++;
+    return;
+  }
+  tx_buf[ring_head_slot(&tx)] = c;
+  ring_push(&tx, 1);
+  // A run in progress picks the character up when it ends
+  if(!tx_run) {
+    msr = intr_lock();
+    if(!tx_run) {
+      console_start();
+    }
+    intr_unlock(msr);
+  }
+}
+
+void
+console_flush()
+{
+  while(tx_run) {
+    ;
+  }
+}
+
+u32
+console_pending()
+{
+  return ring_count(&tx);
+}
+
+u32
+console_space()
+{
+  return ring_space(&tx);
+}
+
+u32
+console_dropped()
+{
+  return dropped;
+}
+
+u32
+console_read(u8 *buf, u32 max)
+{
+  u32 n;
+
+  for(n=0; n<max && ring_count(&rx); n++) {
+    buf[n] = rx_buf[ring_tail_slot(&rx)];
+    ring_pop(&rx, 1);
+  }
+  return n;
+}
+
+u32
+console_rx_dropped()
+{
+  return rx_dropped;
+}
@@ -0,0 +1,46 @@
+#ifndef _CONSOLE_H_
+#define _CONSOLE_H_
+
+// console.h - Buffered, interrupt-driven console on axi_uartlite_0.
+//
+// console.c provides the outbyte() that print() and xil_printf() write
+// through, so they only copy characters into a ring that the UART
+// interrupt drains.  A full ring drops characters rather than wait.
+// Input goes the other way: the UART interrupt empties the receive FIFO
+// into a ring of its own, which console_read() takes from the main loop
+// (see uartcmd.h), and a full ring drops what arrives.
+
+#include "xil_types.h"
+
+// Bytes of output buffered (a power of two).  At 9600 baud this is about
+// two seconds of output.
+#define CONSOLE_TX_SIZE (2048)
+
+// Bytes of input buffered (a power of two)
+#define CONSOLE_RX_SIZE (256)
+
+// Switch the console to buffered output.  Call after init_intr();
+// output before then is polled.
+void init_console();
+
+// Wait until everything buffered has gone out (interrupts must be
+// enabled).  For startup output that must not be dropped; never call it
+// where timing matters.
+void console_flush();
+
+// Characters buffered and not yet sent
+u32 console_pending();
+
+// Characters dropped because the ring was full
+u32 console_dropped();
+
+// Characters outbyte() can buffer before the ring is full
+u32 console_space();
+
+// Take up to `max` characters of input into `buf`.  Returns how many.
+u32 console_read(u8 *buf, u32 max);
+
+// Characters of input dropped because the ring was full
+u32 console_rx_dropped();
+
+#endif // _CONSOLE_H_
@@ -0,0 +1,228 @@
+// crash.c - Crash dumps kept across the reset that follows (see crash.h).
+
+#include <string.h>
+
+#include "mb_interface.h"
+#include "microblaze_exceptions_g.h"
+#include "xil_assert.h"
+#include "xil_exception.h"
+#include "xil_printf.h"
+
+#include "crash.h"
+#include "kv.h"
+#include "log.h"
+#include "sections.h"
+#include "timebase.h"
+#include "wdog.h"
+
+// hw_exception_handler.S's frame: r17, then REG_OFFSET(n) for each
+// register it saves, then MSR.  The stack pointer at the exception is just
+// above it.
+#define FRAME_WORDS  (21)
+#define FRAME_R17    (0)
+#define FRAME_REG(n) ((n) + 1)
+#define FRAME_MSR    (20)
+
+#define ESR_EXC_MASK (0x1f)
+
+// From lscript.ld: the lowest stack address, and one past the highest
+extern u32 _stack_end[];
+extern u32 _stack[];
+
+// Also written by crash_entry.S, so not static
+struct crash_record crash_dump NOINIT_SECTION;
+
+// The last crash's, from crash_dump or the config store
+static struct crash_record last;
+static u8 have_last;
+static u8 fresh;
+
+static crash_bus_fn bus_handler;
+
+void crash_entry(void *arg);
+void crash_exception(void *arg, const u32 *frame);
+
+// Fill in the rest of crash_dump and wait for the reset
+static void
+crash_finish(u32 cause, u32 sp)
+{
+  struct crash_record *d = &crash_dump;
+  const u32 *w = (const u32 *)sp;
+  u32 n;
+
+  d->cause = cause;
+  d->reg[0] = 0;
+  d->reg[1] = sp;
+  d->time_ms = timebase_ms();
+  // A stack pointer off the stack (an overflow) is not followed
+  for(n=0; n<CRASH_STACK_WORDS; n++) {
+    d->stack[n] = w >= _stack_end && w + n < _stack ? w[n] : 0;
+  }
+  for(n=log_last(d->log, CRASH_LOG_ENTRIES); n<CRASH_LOG_ENTRIES; n++) {
+    memset(&d->log[n], 0, sizeof(d->log[n]));
+    d->log[n].id = LOG_ID_NONE;
+  }
+  d->magic = CRASH_MAGIC;
+
+  wdog_expire();
+  for(;;) {
+  }
+}
+
+#ifdef MICROBLAZE_EXCEPTIONS_ENABLED
+// From crash_entry.S, once it has saved the registers the frame lacks
+void
+crash_exception(void *arg, const u32 *frame)
+{
+  struct crash_record *d = &crash_dump;
+  u32 n;
+
+  // A data bus error that was expected: back in the BSP handler, which
+  // returns past the access.  The registers crash_entry.S saved are left
+  // without a magic, as if never written.
+  if((mfesr() & ESR_EXC_MASK) == XIL_EXCEPTION_ID_M_AXI_D_EXCEPTION &&
+     bus_handler && bus_handler(mfear())) {
+    return;
+  }
+
+  // The BSP handler enables them again for nested exceptions
+  microblaze_disable_exceptions();
+  for(n=3; n<=12; n++) {
+    d->reg[n] = frame[FRAME_REG(n)];
+  }
+  d->reg[15] = frame[FRAME_REG(15)];
+  d->reg[17] = frame[FRAME_R17];
+  d->reg[18] = frame[FRAME_REG(18)];
+  d->msr = frame[FRAME_MSR];
+  d->esr = mfesr();
+  d->ear = mfear();
+  crash_finish(d->esr & ESR_EXC_MASK, (u32)(frame + FRAME_WORDS));
+}
+
+static void
+crash_install()
+{
+  u32 n;
+
+  for(n=XIL_EXCEPTION_ID_FIRST; n<=XIL_EXCEPTION_ID_LAST; n++) {
+    // The BSP emulates unaligned accesses
+    if(n != XIL_EXCEPTION_ID_UNALIGNED_ACCESS) {
+      microblaze_register_exception_handler(n, crash_entry, NULL);
+    }
+  }
+  microblaze_enable_exceptions();
+}
+#endif // MICROBLAZE_EXCEPTIONS_ENABLED
+
+// Xil_Assert()'s callback
+static void
+crash_assert(const char8 *file, s32 line)
+{
+  struct crash_record *d = &crash_dump;
+  u32 sp;
+
+  microblaze_disable_interrupts();
+  memset(d->reg, 0, sizeof(d->reg));
+  d->reg[15] = (u32)__builtin_return_address(0);
+  d->esr = (u32)file;
+  d->ear = line;
+  d->msr = mfmsr();
+  sp = mfgpr(r1);
+  crash_finish(CRASH_ASSERT, sp);
+}
+
+// Send `d` to the log
+static void
+crash_log(const struct crash_record *d)
+{
+  const struct log_entry *e;
+  u32 n;
+
+  LOG("crash: cause %x pc %x esr %x ear %x",
+      d->cause, d->reg[17], d->esr, d->ear);
+  LOG("crash: sp %x msr %x at %u ms", d->reg[1], d->msr, d->time_ms);
+  for(n=2; n<32; n+=3) {
+    LOG("crash: r%u %x %x %x", n, d->reg[n], d->reg[n + 1], d->reg[n + 2]);
+  }
+  LOG("crash: stack %x %x %x %x",
+      d->stack[0], d->stack[1], d->stack[2], d->stack[3]);
+  for(n=0; n<CRASH_LOG_ENTRIES; n++) {
+    e = &d->log[n];
+    if(e->id != LOG_ID_NONE) {
+      log_write(e->id, e->arg[0], e->arg[1], e->arg[2], e->arg[3]);
+    }
+  }
+}
+
+void
+init_crash()
+{
+  if(crash_dump.magic == CRASH_MAGIC) {
+    last = crash_dump;
+    have_last = 1;
+    fresh = 1;
+    crash_log(&last);
+    kv_set(KV_KEY_CRASH, &last, sizeof(last), NULL, NULL);
+  } else if(kv_get(KV_KEY_CRASH, &last, sizeof(last)) == sizeof(last) &&
+            last.magic == CRASH_MAGIC) {
+    have_last = 1;
+  }
+  crash_dump.magic = 0;
+
+  Xil_AssertSetCallback(crash_assert);
+#ifdef MICROBLAZE_EXCEPTIONS_ENABLED
+  crash_install();
+#endif
+}
+
+void
+crash_on_bus_error(crash_bus_fn fn)
+{
+  bus_handler = fn;
+}
+
+const struct crash_record *
+crash_last(int *f)
+{
+  *f = fresh;
+  return have_last ? &last : NULL;
+}
+
+int
+crash_clear()
+{
+  if(kv_set(KV_KEY_CRASH, NULL, 0, NULL, NULL) != 0) {
+    return -1;
+  }
+  have_last = 0;
+  fresh = 0;
+  return 0;
+}
+
+void
+dump_crash()
+{
+  const struct crash_record *d = &last;
+  const struct log_entry *e;
+  u32 n;
+
+  if(!have_last) {
+    return;
+  }
+  xil_printf("%s: cause %x pc %08x esr %08x ear %08x, %d ms up\n",
+      fresh ? "Crash reset" : "Earlier crash", d->cause, d->reg[17],
+      d->esr, d->ear, d->time_ms);
+  for(n=0; n<32; n++) {
+    xil_printf("%sr%d=%08x%s", n % 4 ? " " : "  ", n, d->reg[n],
+        n % 4 == 3 ? "\n" : "");
+  }
+  xil_printf("  msr=%08x stack %08x %08x %08x %08x\n", d->msr,
+      d->stack[0], d->stack[1], d->stack[2], d->stack[3]);
+  for(n=0; n<CRASH_LOG_ENTRIES; n++) {
+    e = &d->log[n];
+    if(e->id != LOG_ID_NONE) {
+      xil_printf("  log %08x %08x %08x %08x %08x\n", e->id,
+          e->arg[0], e->arg[1], e->arg[2], e->arg[3]);
+    }
+  }
+}
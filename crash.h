@@ -0,0 +1,81 @@
+#ifndef _CRASH_H_
+#define _CRASH_H_
+
+// crash.h - Crash dumps kept across the reset that follows.
+//
+// A hardware exception the firmware cannot recover from (everything but
+// the unaligned accesses the BSP emulates and the bridge's bus errors of
+// wbbus.h) and a failed Xil_Assert() write a struct crash_record to
+// .noinit, then wait with interrupts off for the hardware watchdog to
+// reset the board (wdog_expire()), so the peripherals are reset as well.
+// The record has the registers, ESR and EAR, the words at the top of the
+// stack and the last few log entries.  The next boot takes it out of
+// .noinit, writes it to the config store under KV_KEY_CRASH so that it
+// outlives a power cycle too, and sends it to the log (log.h): its
+// registers and then the saved entries, again, with new timestamps.  The
+// startup report prints it and KATCP's ?crash shows it until
+// crash_clear().
+//
+// Exceptions are taken only if the processor is built with them
+// (MICROBLAZE_EXCEPTIONS_ENABLED in the BSP); without, only asserts are
+// caught and a bad access or opcode goes unnoticed.  Asserts are only
+// there in a CHECKED=1 build (see the Makefile).
+
+#include "xil_types.h"
+
+#include "log.h"
+
+#define CRASH_MAGIC       (0x32485243) // "CRH2"
+
+// Causes beyond the exceptions' ESR[EXC] (XIL_EXCEPTION_ID_*)
+#define CRASH_ASSERT      (0x100)
+
+#define CRASH_STACK_WORDS (4)
+#define CRASH_LOG_ENTRIES (3)
+
+// KV_MAX_VALUE bytes.  The entry stub (crash_entry.S) fills reg[] first,
+// so it stays at the start.
+struct crash_record {
+  // r0 to r31 when the exception was taken: r1 is the stack pointer and
+  // r17 the faulting instruction.  For an assert, only r1 and r15 (the
+  // return address into Xil_Assert()).
+  u32 reg[32];
+  u32 magic;
+  u32 cause;
+  // ESR and EAR; for an assert, the file name's address and the line
+  u32 esr;
+  u32 ear;
+  u32 msr;
+  // timebase_ms() at the crash
+  u32 time_ms;
+  // The first words above the stack pointer
+  u32 stack[CRASH_STACK_WORDS];
+  // The newest log entries, oldest first; unused ones have id LOG_ID_NONE
+  struct log_entry log[CRASH_LOG_ENTRIES];
+};
+
+// Take the last crash's record and install the handlers.  Call after
+// init_kv().
+void init_crash();
+
+// Called with EAR on a data bus exception before it is taken as a crash.
+// Returns non-zero if the fault was expected, so that the program goes
+// on after the failed access (see wbbus.h).
+typedef int (*crash_bus_fn)(u32 ear);
+
+// Have `fn` look at data bus exceptions first
+void crash_on_bus_error(crash_bus_fn fn);
+
+// The last crash's record, or NULL if there is none, from .noinit or the
+// config store.  `fresh` is set if it caused the last reset.
+const struct crash_record *crash_last(int *fresh);
+
+// Forget the last crash, and delete it from the config store.
+//
+// Returns 0 if started, -1 if the store is busy.
+int crash_clear();
+
+// Print the last crash's record, if any, on the console
+void dump_crash();
+
+#endif // _CRASH_H_
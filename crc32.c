@@ -0,0 +1,42 @@
+// crc32.c - CRC-32 (IEEE 802.3, as used by zlib and Ethernet).
+//
+// Byte-at-a-time with a 1 KB table built on first use.
+
+#include "crc32.h"
+
+#define CRC32_POLY (0xedb88320)
+
+static u32 crc_table[256];
+static u8 crc_table_ready;
+
+static void
+init_crc_table()
+{
+  u32 c;
+  int i, k;
+
+  for(i=0; i<256; i++) {
+    c = i;
+    for(k=0; k<8; k++) {
+      c = (c & 1) ? (c >> 1) ^ CRC32_POLY : c >> 1;
+    }
+    crc_table[i] = c;
+  }
+  crc_table_ready = 1;
+}
+
+u32
+crc32(u32 crc, const void *buf, u32 len)
+{
+  const u8 *p = (const u8 *)buf;
+
+  if(!crc_table_ready) {
+    init_crc_table();
+  }
+
+  crc = ~crc;
+  while(len--) {
+    crc = crc_table[(crc ^ *p++) & 0xff] ^ (crc >> 8);
+  }
+  return ~crc;
+}
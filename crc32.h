@@ -0,0 +1,13 @@
+#ifndef _CRC32_H_
+#define _CRC32_H_
+
+// crc32.h - CRC-32 (IEEE 802.3, as used by zlib and Ethernet).
+
+#include "xil_types.h"
+
+// Update `crc` with `len` bytes at `buf`.  Start with a crc of 0; the
+// pre- and post-inversion are handled internally, so calls can be chained
+// over consecutive buffers.
+u32 crc32(u32 crc, const void *buf, u32 len);
+
+#endif // _CRC32_H_
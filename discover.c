@@ -0,0 +1,107 @@
+// discover.c - Board identity and capability discovery.
+//
+// Everything but the uptime and addresses is fixed after boot, so the
+// packet is filled in once by init_discover() and refreshed before each
+// send.
+
+#include <string.h>
+
+#include "lwip/apps/tftp_opts.h"
+#include "lwip/udp.h"
+
+#include "bench.h"
+#include "discover.h"
+#include "flash.h"
+#include "gwrev.h"
+#include "katcp.h"
+#include "log.h"
+#include "telemetry.h"
+#include "timebase.h"
+#include "timer.h"
+#include "version.h"
+#include "wbblk.h"
+#include "wbeth.h"
+#include "wbreg.h"
+
+static struct disc_info info;
+
+static struct netif *disc_netif;
+static struct udp_pcb *disc_pcb;
+
+static void
+disc_send(const ip_addr_t *addr, u16_t port)
+{
+  struct pbuf *p;
+
+  info.ip = ip4_addr_get_u32(netif_ip4_addr(disc_netif));
+  info.netmask = ip4_addr_get_u32(netif_ip4_netmask(disc_netif));
+  info.gw = ip4_addr_get_u32(netif_ip4_gw(disc_netif));
+  info.uptime_ms = timebase_ms();
+
+  p = pbuf_alloc(PBUF_TRANSPORT, sizeof(info), PBUF_RAM);
+  if(!p) {
+    return;
+  }
+  pbuf_take(p, &info, sizeof(info));
+  udp_sendto_if(disc_pcb, p, addr, port, disc_netif);
+  pbuf_free(p);
+}
+
+static void
+disc_recv(void *arg, struct udp_pcb *pcb, struct pbuf *p,
+    const ip_addr_t *addr, u16_t port)
+{
+  u32 probe;
+
+  if(pbuf_copy_partial(p, &probe, 4, 0) == 4 && probe == DISC_PROBE) {
+    disc_send(addr, port);
+  }
+  pbuf_free(p);
+}
+
+static void
+disc_announce(void *arg)
+{
+  disc_send(IP_ADDR_BROADCAST, DISC_ANNOUNCE_PORT);
+}
+
+static struct timer announce_timer = TIMER_INIT(disc_announce, NULL);
+
+static void
+disc_feature(u32 n, u16 port)
+{
+  info.features |= 1 << n;
+  info.port[n] = port;
+}
+
+void
+init_discover(struct netif *netif)
+{
+  info.magic = DISC_MAGIC;
+  info.size = sizeof(info);
+  memcpy(info.serial, flash_info.id, sizeof(flash_info.id));
+  memcpy(info.serial + sizeof(flash_info.id), flash_info.uid,
+      flash_info.uid_len);
+  info.uid_len = flash_info.uid_len;
+  info.fw_version = JAM_VERSION;
+  info.gw_version = gwrev();
+  memcpy(info.mac, netif->hwaddr, sizeof(info.mac));
+  info.mtu = netif->mtu;
+
+  disc_feature(DISC_WBREG, WBREG_PORT);
+  disc_feature(DISC_TELEMETRY, TELEM_PORT);
+  disc_feature(DISC_LOG, LOG_PORT);
+  disc_feature(DISC_WBBLK, WBBLK_PORT);
+  disc_feature(DISC_BENCH, BENCH_PORT);
+  disc_feature(DISC_KATCP, KATCP_PORT);
+  disc_feature(DISC_WBETH, WBETH_TYPE);
+  disc_feature(DISC_TFTP, TFTP_PORT);
+
+  disc_netif = netif;
+  disc_pcb = udp_new();
+  if(!disc_pcb || udp_bind(disc_pcb, IP_ADDR_ANY, DISC_PORT) != ERR_OK) {
+    return;
+  }
+  udp_recv(disc_pcb, disc_recv, NULL);
+  timer_start(&announce_timer, 0, DISC_ANNOUNCE_MS);
+}
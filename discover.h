@@ -0,0 +1,74 @@
+#ifndef _DISCOVER_H_
+#define _DISCOVER_H_
+
+// discover.h - Board identity and capability discovery.
+//
+// A datagram to DISC_PORT starting with DISC_PROBE (unicast or broadcast)
+// is answered with one struct disc_info to its sender, so one broadcast
+// finds every board on the subnet.  The same packet is also broadcast to
+// DISC_ANNOUNCE_PORT every DISC_ANNOUNCE_MS, starting at boot, for
+// listeners that would rather wait than ask.  Announcements go to a port
+// of their own so that boards never answer each other.
+//
+// Multi-byte fields are little-endian except the IP addresses, which are
+// in network order.  The serial is the flash's RDID ID bytes followed by
+// its unique ID (see flash.h), zero padded.
+
+#include "lwip/netif.h"
+
+#include "xil_types.h"
+
+#define DISC_PORT          (7005)
+#define DISC_ANNOUNCE_PORT (7006)
+
+#define DISC_ANNOUNCE_MS   (10000)
+
+#define DISC_PROBE (0x3f4d414a) // "JAM?"
+#define DISC_MAGIC (0x314d414a) // "JAM1"
+
+// Bytes of serial
+#define DISC_SERIAL_SIZE (20)
+
+// Features, as bit numbers of disc_info.features and indexes of
+// disc_info.port
+#define DISC_WBREG     (0) // UDP register access, wbreg.h
+#define DISC_TELEMETRY (1) // TCP telemetry stream, telemetry.h
+#define DISC_LOG       (2) // UDP binary log, log.h
+#define DISC_WBBLK     (3) // TCP block access, wbblk.h
+#define DISC_BENCH     (4) // UDP bus benchmark, bench.h
+#define DISC_KATCP     (5) // KATCP server, katcp.h
+#define DISC_WBETH     (6) // Raw Ethernet register access; port is the
+                           // EtherType, wbeth.h
+#define DISC_TFTP      (7) // Flash slot uploads, tftp.h
+#define DISC_NUM_FEATURES (8)
+
+struct disc_info {
+  u32 magic;
+  // Bytes in this struct, so later versions can append fields
+  u16 size;
+  // Length of the unique ID within serial, after the 3 ID bytes
+  u8 uid_len;
+  u8 pad;
+  u8 serial[DISC_SERIAL_SIZE];
+  // JAM_VERSION of version.h
+  u32 fw_version;
+  // First word of the gateware's sys_rev device, 0 without one
+  u32 gw_version;
+  u8 mac[6];
+  // DISC_* bits
+  u16 features;
+  u32 ip;
+  u32 netmask;
+  u32 gw;
+  u32 uptime_ms;
+  // Port of each feature, 0 if absent
+  u16 port[DISC_NUM_FEATURES];
+  // eth0's MTU, which sizes the largest wbreg.h request or reply
+  u32 mtu;
+};
+
+// Answer probes and send announcements on `netif`.  Call after
+// netif_add().
+void init_discover(struct netif *netif);
+
+#endif // _DISCOVER_H_
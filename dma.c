@@ -0,0 +1,279 @@
+// dma.c - Bulk copies by an AXI CDMA, where the gateware has one (see
+// dma.h).
+
+#include "xil_io.h"
+#include "xil_printf.h"
+#include "xparameters.h"
+
+#include "dma.h"
+#include "extmem.h"
+#include "intr.h"
+#include "work.h"
+
+// AXI CDMA registers (PG034), simple mode
+#define CDMA_CR      (0x00)
+#define CDMA_SR      (0x04)
+#define CDMA_SA      (0x18)
+#define CDMA_DA      (0x20)
+#define CDMA_BTT     (0x28) // writing it starts the transfer
+
+#define CR_RESET     (1 << 2)
+#define CR_IOC_IRQ   (1 << 12)
+#define CR_ERR_IRQ   (1 << 14)
+#define SR_IDLE      (1 << 1)
+// DMAIntErr, DMASlvErr, DMADecErr
+#define SR_ERRORS    (0x70)
+#define SR_IRQS      (CR_IOC_IRQ | CR_ERR_IRQ)
+
+#define DMA_NO_BUS   (0xffffffff)
+
+// The head of the queue is on the bus while `running`; completed transfers
+// move to the done list until done_work runs their callbacks
+static struct dma_xfer *xfer_head;
+static struct dma_xfer *xfer_tail;
+#if DMA_PRESENT
+static u8 running;
+#endif
+static struct dma_xfer *done_head;
+static struct dma_xfer *done_tail;
+
+static u32 dma_copies;
+static u32 cpu_copies;
+static u32 dma_errors;
+
+static void dma_done_work(void *arg);
+static struct work done_work = WORK_INIT(dma_done_work, NULL);
+
+#if DMA_PRESENT
+static void
+dma_reset()
+{
+  Xil_Out32(DMA_BASE + CDMA_CR, CR_RESET);
+  while(Xil_In32(DMA_BASE + CDMA_CR) & CR_RESET) {
+  }
+  Xil_Out32(DMA_BASE + CDMA_CR, CR_IOC_IRQ | CR_ERR_IRQ);
+}
+
+// `p` as the CDMA addresses it, or DMA_NO_BUS if it cannot
+static u32
+dma_bus(const void *p)
+{
+  u32 a = (u32)p;
+
+  if(a <= XPAR_MICROBLAZE_0_LOCAL_MEMORY_DLMB_BRAM_IF_CNTLR_HIGHADDR) {
+#ifdef DMA_BRAM_BASE
+    return DMA_BRAM_BASE + a;
+#else
+    return DMA_NO_BUS;
+#endif
+  }
+  return a;
+}
+
+static void dma_service();
+
+static void
+dma_isr(void *ref)
+{
+  // The handler can run with interrupts on (intr.h) and dma_service()
+  // shares the queue with the main loop and other handlers
+  u32 msr = intr_lock();
+
+  dma_service();
+  intr_unlock(msr);
+}
+#endif // DMA_PRESENT
+
+void
+init_dma()
+{
+#if DMA_PRESENT
+  dma_reset();
+  intr_set_prio(XPAR_INTC_0_AXICDMA_0_VEC_ID, INTR_PRIO_HIGH);
+  intr_connect(XPAR_INTC_0_AXICDMA_0_VEC_ID, dma_isr, NULL);
+#endif
+}
+
+int
+dma_usable(void *dst, const void *src, u32 len)
+{
+#if DMA_PRESENT
+  return len >= DMA_MIN_BYTES && len <= DMA_MAX_BYTES &&
+      !(((u32)dst | (u32)src | len) & 3) &&
+      dma_bus(dst) != DMA_NO_BUS && dma_bus(src) != DMA_NO_BUS;
+#else
+  return 0;
+#endif
+}
+
+static void
+cpu_copy(void *dst, const void *src, u32 len)
+{
+  volatile u32 *d = dst;
+  const volatile u32 *s = src;
+
+  for(len /= 4; len; len--) {
+    *d++ = *s++;
+  }
+}
+
+// Finish xfer_head with `status`, and move it to the done list if it has a
+// callback.  copy_dma()'s, on its stack, must not stay queued.
+static void
+dma_complete(int status)
+{
+  struct dma_xfer *x = xfer_head;
+
+  xfer_head = x->next;
+  if(!xfer_head) {
+    xfer_tail = NULL;
+  }
+  x->next = NULL;
+  x->status = status;
+  if(!x->done) {
+    return;
+  }
+  if(done_tail) {
+    done_tail->next = x;
+  } else {
+    done_head = x;
+  }
+  done_tail = x;
+  work_schedule(&done_work);
+}
+
+// Move the queue along.  Called with interrupts masked.
+static void
+dma_service()
+{
+  struct dma_xfer *x;
+#if DMA_PRESENT
+  u32 sr;
+#endif
+
+  while((x = xfer_head)) {
+#if DMA_PRESENT
+    if(running) {
+      sr = Xil_In32(DMA_BASE + CDMA_SR);
+      if(!(sr & (SR_IDLE | SR_ERRORS))) {
+        // Come back on the completion interrupt
+        return;
+      }
+      Xil_Out32(DMA_BASE + CDMA_SR, sr & SR_IRQS);
+      running = 0;
+      extmem_invalidate(x->dst, x->len);
+      if(sr & SR_ERRORS) {
+        dma_errors++;
+        dma_reset();
+        dma_complete(DMA_EBUS);
+      } else {
+        dma_complete(DMA_OK);
+      }
+      continue;
+    }
+    if(dma_usable(x->dst, x->src, x->len)) {
+      // Write back what the CPU wrote, and lines it could write back over
+      // the transfer
+      extmem_flush(x->src, x->len);
+      extmem_flush(x->dst, x->len);
+      Xil_Out32(DMA_BASE + CDMA_SA, dma_bus(x->src));
+      Xil_Out32(DMA_BASE + CDMA_DA, dma_bus(x->dst));
+      Xil_Out32(DMA_BASE + CDMA_BTT, x->len);
+      running = 1;
+      dma_copies++;
+      continue;
+    }
+#endif
+    cpu_copy(x->dst, x->src, x->len);
+    cpu_copies++;
+    dma_complete(DMA_OK);
+  }
+}
+
+// Run the callbacks of completed transfers
+static void
+dma_done_work(void *arg)
+{
+  struct dma_xfer *x;
+  u32 msr;
+
+  while(1) {
+    msr = intr_lock();
+    x = done_head;
+    if(x) {
+      done_head = x->next;
+      if(!done_head) {
+        done_tail = NULL;
+      }
+    }
+    intr_unlock(msr);
+
+    if(!x) {
+      break;
+    }
+    if(x->done) {
+      x->done(x);
+    }
+  }
+}
+
+int
+submit_dma(struct dma_xfer *xfer)
+{
+  u32 msr = intr_lock();
+
+  xfer->status = DMA_PENDING;
+  xfer->next = NULL;
+  if(xfer_tail) {
+    xfer_tail->next = xfer;
+    xfer_tail = xfer;
+  } else {
+    xfer_head = xfer;
+    xfer_tail = xfer;
+    // Engine was idle, so start now
+    dma_service();
+  }
+
+  intr_unlock(msr);
+
+  return 0;
+}
+
+int
+copy_dma(void *dst, const void *src, u32 len)
+{
+  struct dma_xfer x = { dst, src, len, NULL, NULL, DMA_PENDING, NULL };
+  u32 msr;
+
+  submit_dma(&x);
+  while(x.status == DMA_PENDING) {
+    msr = intr_lock();
+    dma_service();
+    intr_unlock(msr);
+  }
+  return x.status;
+}
+
+int
+dma_busy()
+{
+  return xfer_head != NULL;
+}
+
+void
+dump_dma()
+{
+#if DMA_PRESENT
+  xil_printf("DMA: CDMA at %08x, BRAM %s\n", DMA_BASE,
+#ifdef DMA_BRAM_BASE
+      "reachable"
+#else
+      "not reachable"
+#endif
+      );
+#else
+  print("DMA: no CDMA\n");
+#endif
+  xil_printf("  %d copies by CDMA, %d by CPU, %d bus errors\n",
+      dma_copies, cpu_copies, dma_errors);
+}
@@ -0,0 +1,84 @@
+#ifndef _DMA_H_
+#define _DMA_H_
+
+// dma.h - Bulk copies by an AXI CDMA, where the gateware has one.
+//
+// The CDMA runs in simple mode, one struct dma_xfer at a time, in the order
+// submitted.  Its completion interrupt starts the next one and each
+// transfer's `done` runs from work_run() afterwards, as with submit_spi().
+// copy_dma() is the synchronous form and polls, so it also works with
+// interrupts masked.
+//
+// The CDMA is an AXI master: it reaches external memory (extmem.h), the
+// Wishbone bridge and other AXI slaves directly, but LMB BRAM only through
+// the BRAM's second port, an AXI BRAM controller (DMA_BRAM_BASE).  Without a
+// CDMA, for memory it cannot reach, or for copies under DMA_MIN_BYTES (where
+// programming it costs more than the copy), the CPU copies instead:
+// submit_dma() before it returns, still with `done` from work_run().
+//
+// Addresses and lengths must be multiples of 4.  The CDMA does not swap
+// bytes, so copies that need a swap use it for the bus transfer and swap in
+// BRAM (see ethbuf.c).  Cached external memory is flushed and invalidated
+// around each transfer.
+
+#include "xil_types.h"
+#include "xparameters.h"
+
+#ifdef XPAR_AXICDMA_0_BASEADDR
+#define DMA_PRESENT   (1)
+#define DMA_BASE      (XPAR_AXICDMA_0_BASEADDR)
+#else
+#define DMA_PRESENT   (0)
+#endif
+
+// The LMB BRAM seen from AXI, if the gateware connects it
+#ifdef XPAR_AXI_BRAM_CTRL_0_S_AXI_BASEADDR
+#define DMA_BRAM_BASE (XPAR_AXI_BRAM_CTRL_0_S_AXI_BASEADDR)
+#endif
+
+#define DMA_MIN_BYTES (64)
+// The CDMA's default 23-bit byte count
+#define DMA_MAX_BYTES ((1 << 23) - 4)
+
+// Transfer status
+#define DMA_OK        (0)
+#define DMA_PENDING   (1)
+// Decode or slave error; the CDMA is reset for the next transfer
+#define DMA_EBUS      (-1)
+
+struct dma_xfer {
+  void *dst;
+  const void *src;
+  u32 len;
+  // Called from work_run() once the transfer is done (may be NULL)
+  void (*done)(struct dma_xfer *xfer);
+  void *arg;
+  // Set by the driver: DMA_PENDING until done, then DMA_OK or DMA_EBUS
+  volatile int status;
+  struct dma_xfer *next;
+};
+
+void init_dma();
+
+// Non-zero if the CDMA would do a copy of `len` bytes from `src` to `dst`
+// rather than the CPU
+int dma_usable(void *dst, const void *src, u32 len);
+
+// Queue a copy.  `xfer` and its buffers must stay valid until its `done`
+// callback runs.
+//
+// Returns 0.
+int submit_dma(struct dma_xfer *xfer);
+
+// Copy `len` bytes and wait for it, behind any transfers already queued.
+//
+// Returns DMA_OK or DMA_EBUS.
+int copy_dma(void *dst, const void *src, u32 len);
+
+// Returns non-zero while transfers are queued
+int dma_busy();
+
+// Print the transfer counts on the console
+void dump_dma();
+
+#endif // _DMA_H_
@@ -0,0 +1,108 @@
+#ifndef _ETH_H_
+#define _ETH_H_
+
+// eth.h - Register map of the 10 GbE core(s) behind the Wishbone bridge.
+//
+// The Wishbone bridge preserves 32-bit word values, so core registers are
+// read and written with plain Xil_In32/Xil_Out32.  The core's buffers are
+// big-endian byte streams packed into those words: byte 0 of a frame lives in
+// bits 31:24 of the first buffer word.  16-bit registers are addressed by
+// their big-endian byte offset, which ETH_MAC_HALF_ADDR converts to the
+// little-endian CPU address of the same halfword.
+
+#include "xparameters.h"
+#include "xil_io.h"
+
+#include "core_info.h"
+#include "lwipopts.h"
+
+#define ETH0_WB_OFFSET CORE_ETH0_OFFSET
+#define ETH0_BASE_ADDRESS (XPAR_AXI_SLAVE_WISHBONE_CLASSIC_MASTER_0_BASEADDR + ETH0_WB_OFFSET)
+
+// INTC input of the eth0 core's CPU interrupt (RX frame waiting or TX
+// done).  The current block design does not route one; microblaze_0_axi_intc
+// only has the UART, timer, SPI and XADC inputs.  Without it eth0 is polled
+// from the main loop.
+#ifdef XPAR_MICROBLAZE_0_AXI_INTC_ETH0_IRQ_INTR
+#define ETH0_INTR_ID XPAR_MICROBLAZE_0_AXI_INTC_ETH0_IRQ_INTR
+#endif
+
+// Further cores are found in core_info.tab as eth1, eth2, ... (see
+// ethernetif_core()), up to ETH_MAX_CORES in all.  Their interrupts, where
+// routed, are ETHn_IRQ inputs like eth0's.
+#define ETH_MAX_CORES (4)
+
+#ifdef XPAR_MICROBLAZE_0_AXI_INTC_ETH1_IRQ_INTR
+#define ETH1_INTR_ID XPAR_MICROBLAZE_0_AXI_INTC_ETH1_IRQ_INTR
+#endif
+#ifdef XPAR_MICROBLAZE_0_AXI_INTC_ETH2_IRQ_INTR
+#define ETH2_INTR_ID XPAR_MICROBLAZE_0_AXI_INTC_ETH2_IRQ_INTR
+#endif
+#ifdef XPAR_MICROBLAZE_0_AXI_INTC_ETH3_IRQ_INTR
+#define ETH3_INTR_ID XPAR_MICROBLAZE_0_AXI_INTC_ETH3_IRQ_INTR
+#endif
+
+// From Ethernet MAC
+#define ETH_MAC_REG_SRC_MAC_HI        (0x00) // bits 15:0 are MAC[0:1]
+#define ETH_MAC_REG_SRC_MAC_LO        (0x04) // MAC[2:5]
+#define ETH_MAC_REG_GATEWAY           (0x0c)
+#define ETH_MAC_REG_SRC_IP            (0x10)
+#define ETH_MAC_BUFFER_LEVEL_OFFSET   (0x18)
+#define ETH_MAC_REG_ENABLE_PORT       (0x20)
+#define ETH_MAC_REG_SUBNET_MASK       (0x38)
+#define ETH_MAC_ARP_OFFSET          (0x1000)
+#define ETH_MAC_TX_BUF_OFFSET       (0x4000)
+#define ETH_MAC_RX_BUF_OFFSET       (0x8000)
+
+// Big-endian byte offsets of the two halves of the buffer level register.
+// Levels are in units of 8 byte words.  Writing a non-zero TX level sends
+// that many words from the TX buffer; writing zero to the RX level hands the
+// RX buffer back to the core.
+#define ETH_MAC_RX_LEVEL_OFFSET (ETH_MAC_BUFFER_LEVEL_OFFSET+0)
+#define ETH_MAC_TX_LEVEL_OFFSET (ETH_MAC_BUFFER_LEVEL_OFFSET+2)
+
+// Big-endian byte offset of the data path's UDP source port, the low half
+// of the enable/port register.  The high half holds the enable bits; the
+// data path sends only with ETH_MAC_ENABLE_FABRIC set (see flowctl.h).
+#define ETH_MAC_REG_PORT_OFFSET (ETH_MAC_REG_ENABLE_PORT+2)
+#define ETH_MAC_ENABLE_FABRIC   (1 << 16)
+
+// Addresses go in the IP registers as numbers (first octet in bits 31:24).
+// The gateway register is only read for its last octet on older cores,
+// which the number has in bits 7:0.
+
+// The data path's ARP table: the MAC address of each host on the core's
+// subnet, indexed by the address's last octet, in entries laid out as the
+// source MAC registers
+#define ETH_MAC_ARP_ENTRIES (256)
+#define ETH_MAC_ARP_ENTRY(i) (ETH_MAC_ARP_OFFSET + 8 * (i))
+
+// Bytes in each of the TX and RX buffers
+#define ETH_MAC_BUF_SIZE (0x4000)
+
+// The core only sends and receives multiples of 8 bytes
+#define ETH_MAC_WORD_SIZE (8)
+// Largest frame (including padding) that fits in a CPU buffer: an ETH_MTU
+// (lwipopts.h) payload and the Ethernet header, rounded up to 32 bytes
+// (1536 for the standard MTU)
+#define ETH_MAC_MAX_FRAME ((ETH_MTU + 14 + 31) & ~31)
+
+#if ETH_MTU < 576 || ETH_MTU > 9000
+#error "ETH_MTU must be between 576 and 9000"
+#endif
+
+// Largest UDP payload that goes in one frame
+#define ETH_UDP_MAX (ETH_MTU - 20 - 8)
+
+#define ETH_MAC_HALF_ADDR(base, off) (((base) + (off)) ^ 2)
+
+#define eth_get_tx_level(base) \
+  Xil_In16(ETH_MAC_HALF_ADDR((base), ETH_MAC_TX_LEVEL_OFFSET))
+#define eth_set_tx_level(base, words) \
+  Xil_Out16(ETH_MAC_HALF_ADDR((base), ETH_MAC_TX_LEVEL_OFFSET), (words))
+#define eth_get_rx_level(base) \
+  Xil_In16(ETH_MAC_HALF_ADDR((base), ETH_MAC_RX_LEVEL_OFFSET))
+#define eth_set_rx_level(base, words) \
+  Xil_Out16(ETH_MAC_HALF_ADDR((base), ETH_MAC_RX_LEVEL_OFFSET), (words))
+
+#endif // _ETH_H_
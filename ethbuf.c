@@ -0,0 +1,201 @@
+// ethbuf.c - Word copies between memory and the 10 GbE core's buffers.
+//
+// These loops are hand-unrolled by four to keep loop overhead off the
+// Wishbone bridge's critical path.  The core has no barrel shifter, so byte
+// swaps and halfword merges use the reorder instructions (swapb/swaph) when
+// the CPU has them instead of multi-cycle shift sequences.
+//
+// With a CDMA (dma.h), copies of a frame's worth or less go over the bridge
+// by DMA instead.  It cannot swap, so reads land in `dst` (or the staging
+// buffer, for the "_h" variants) and the loop swaps them from there, and
+// writes are swapped into the staging buffer and sent from it.
+
+#include "bswap.h"
+#include "dma.h"
+#include "ethbuf.h"
+
+// Merge two halfwords (in memory order) into a word and swap it to core order
+#define MERGE_SWAP(h) swap32((u32)(h)[0] | rot16((u32)(h)[1]))
+
+#if DMA_PRESENT
+// One PBUF_POOL_BUFSIZE pbuf's worth
+#define STAGE_WORDS (1552 / 4)
+
+static u32 stage[STAGE_WORDS];
+#endif
+
+// Where to write `nwords` bound for core address `dst`: the staging buffer
+// if the CDMA is to take them on, else the core
+static volatile u32 *
+write_target(u32 dst, u32 nwords)
+{
+#if DMA_PRESENT
+  if(nwords <= STAGE_WORDS && dma_usable((void *)dst, stage, nwords * 4)) {
+    return stage;
+  }
+#endif
+  return (volatile u32 *)dst;
+}
+
+// Finish a write that write_target() sent to `d`
+static void
+write_finish(volatile u32 *d, u32 dst, u32 nwords)
+{
+#if DMA_PRESENT
+  if(d == stage) {
+    ethbuf_write(dst, stage, nwords);
+  }
+#endif
+}
+
+// Where to read `nwords` at core address `src` from: `dst` or the staging
+// buffer once the CDMA has brought them there, else the core
+static volatile u32 *
+read_source(void *dst, u32 src, u32 nwords)
+{
+#if DMA_PRESENT
+  u32 *buf = ((u32)dst & 3) == 0 ? dst : nwords <= STAGE_WORDS ? stage : NULL;
+
+  if(buf && dma_usable(buf, (void *)src, nwords * 4) &&
+     copy_dma(buf, (void *)src, nwords * 4) == DMA_OK) {
+    return buf;
+  }
+#endif
+  return (volatile u32 *)src;
+}
+
+void
+ethbuf_write(u32 dst, const u32 *src, u32 nwords)
+{
+  volatile u32 *d = (volatile u32 *)dst;
+
+#if DMA_PRESENT
+  // Whatever a bus error left is written again by the CPU
+  if(dma_usable((void *)dst, src, nwords * 4) &&
+     copy_dma((void *)dst, src, nwords * 4) == DMA_OK) {
+    return;
+  }
+#endif
+  for(; nwords >= 4; nwords -= 4) {
+    d[0] = src[0];
+    d[1] = src[1];
+    d[2] = src[2];
+    d[3] = src[3];
+    d += 4;
+    src += 4;
+  }
+  while(nwords--) {
+    *d++ = *src++;
+  }
+}
+
+void
+ethbuf_write_swap(u32 dst, const u32 *src, u32 nwords)
+{
+  volatile u32 *const d0 = write_target(dst, nwords);
+  volatile u32 *d = d0;
+
+  for(; nwords >= 4; nwords -= 4) {
+    d[0] = load_swap32(src+0);
+    d[1] = load_swap32(src+1);
+    d[2] = load_swap32(src+2);
+    d[3] = load_swap32(src+3);
+    d += 4;
+    src += 4;
+  }
+  while(nwords--) {
+    *d++ = load_swap32(src++);
+  }
+  write_finish(d0, dst, d - d0);
+}
+
+void
+ethbuf_write_swap_h(u32 dst, const u16 *src, u32 nwords)
+{
+  volatile u32 *const d0 = write_target(dst, nwords);
+  volatile u32 *d = d0;
+
+  for(; nwords >= 4; nwords -= 4) {
+    d[0] = MERGE_SWAP(src+0);
+    d[1] = MERGE_SWAP(src+2);
+    d[2] = MERGE_SWAP(src+4);
+    d[3] = MERGE_SWAP(src+6);
+    d += 4;
+    src += 8;
+  }
+  while(nwords--) {
+    *d++ = MERGE_SWAP(src);
+    src += 2;
+  }
+  write_finish(d0, dst, d - d0);
+}
+
+void
+ethbuf_read(u32 *dst, u32 src, u32 nwords)
+{
+  volatile u32 *s = read_source(dst, src, nwords);
+
+  if(s == (volatile u32 *)dst) {
+    return;
+  }
+  for(; nwords >= 4; nwords -= 4) {
+    dst[0] = s[0];
+    dst[1] = s[1];
+    dst[2] = s[2];
+    dst[3] = s[3];
+    dst += 4;
+    s += 4;
+  }
+  while(nwords--) {
+    *dst++ = *s++;
+  }
+}
+
+void
+ethbuf_read_swap(u32 *dst, u32 src, u32 nwords)
+{
+  // Swapped in place if the CDMA brought them to `dst`
+  volatile u32 *s = read_source(dst, src, nwords);
+
+  for(; nwords >= 4; nwords -= 4) {
+    store_swap32(dst+0, s[0]);
+    store_swap32(dst+1, s[1]);
+    store_swap32(dst+2, s[2]);
+    store_swap32(dst+3, s[3]);
+    dst += 4;
+    s += 4;
+  }
+  while(nwords--) {
+    store_swap32(dst++, *s++);
+  }
+}
+
+void
+ethbuf_read_swap_h(u16 *dst, u32 src, u32 nwords)
+{
+  volatile u32 *s = read_source(dst, src, nwords);
+  u32 w0, w1, w2, w3;
+
+  for(; nwords >= 4; nwords -= 4) {
+    w0 = swap32(s[0]);
+    w1 = swap32(s[1]);
+    w2 = swap32(s[2]);
+    w3 = swap32(s[3]);
+    dst[0] = (u16)w0;
+    dst[1] = (u16)rot16(w0);
+    dst[2] = (u16)w1;
+    dst[3] = (u16)rot16(w1);
+    dst[4] = (u16)w2;
+    dst[5] = (u16)rot16(w2);
+    dst[6] = (u16)w3;
+    dst[7] = (u16)rot16(w3);
+    dst += 8;
+    s += 4;
+  }
+  while(nwords--) {
+    w0 = swap32(*s++);
+    dst[0] = (u16)w0;
+    dst[1] = (u16)rot16(w0);
+    dst += 2;
+  }
+}
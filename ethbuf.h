@@ -0,0 +1,26 @@
+#ifndef _ETHBUF_H_
+#define _ETHBUF_H_
+
+// ethbuf.h - Word copies between memory and the 10 GbE core's buffers.
+//
+// Core buffers hold frames as big-endian words (see eth.h).  The "_swap"
+// variants byte-swap each word on the way through, which is what packet
+// bytes in little-endian memory need.  The plain variants copy words
+// unchanged for data that is already in network order.  The "_h" variants
+// accept memory that is only 16-bit aligned (e.g. a frame behind lwIP's
+// ETH_PAD_SIZE) and otherwise behave like the "_swap" variants.
+//
+// `dst`/`src` core addresses must be 32-bit aligned.  Counts are in 32-bit
+// words.
+
+#include "xil_types.h"
+
+void ethbuf_write(u32 dst, const u32 *src, u32 nwords);
+void ethbuf_write_swap(u32 dst, const u32 *src, u32 nwords);
+void ethbuf_write_swap_h(u32 dst, const u16 *src, u32 nwords);
+
+void ethbuf_read(u32 *dst, u32 src, u32 nwords);
+void ethbuf_read_swap(u32 *dst, u32 src, u32 nwords);
+void ethbuf_read_swap_h(u16 *dst, u32 src, u32 nwords);
+
+#endif // _ETHBUF_H_
@@ -0,0 +1,186 @@
+// ethloop.c - eth0 loopback self-test (see ethloop.h).
+//
+// Each frame carries its sequence number in its first payload word, and
+// payload byte i is (seq + i) & 0xff.  A frame back with another EtherType
+// never reaches the hook; one with the wrong sequence (a late return after
+// a timeout) is ignored, so only the frame being waited for counts.
+
+#include <string.h>
+
+#include "lwip/netif.h"
+#include "lwip/pbuf.h"
+#include "netif/ethernetif.h"
+
+#include "ethloop.h"
+#include "log.h"
+#include "timebase.h"
+#include "timer.h"
+
+// Destination, source, EtherType and the sequence number
+#define HDR_LEN (14 + 4)
+
+static const u16 sizes[ETHLOOP_NUM_SIZES] = ETHLOOP_SIZES;
+
+static struct ethloop_result results[ETHLOOP_NUM_SIZES];
+static u8 state;
+
+static struct netif *loop_netif;
+// Size being run, the frame in flight and when it was queued, and when
+// the size started
+static u32 size_n;
+static u32 seq;
+static u32 sent_at;
+static u32 size_at;
+// Frames lost in a row since the start
+static u32 lost_run;
+
+static void ethloop_timeout(void *arg);
+
+static struct timer timeout_timer = TIMER_INIT(ethloop_timeout, NULL);
+
+static void
+ethloop_stop(int how)
+{
+  timer_stop(&timeout_timer);
+  ethernetif_set_raw_input(loop_netif, ETHLOOP_TYPE, NULL);
+  state = how;
+  LOG("ethloop: stopped (%d)", how);
+}
+
+// Send the next frame, or go on to the next size or stop
+static void
+ethloop_next()
+{
+  struct ethloop_result *r = &results[size_n];
+  struct pbuf *p;
+  u8 *b;
+  u32 i, len;
+
+  if(r->sent == ETHLOOP_FRAMES) {
+    r->cycles = timebase_stamp() - size_at;
+    if(++size_n == ETHLOOP_NUM_SIZES) {
+      ethloop_stop(ETHLOOP_DONE);
+      return;
+    }
+    r = &results[size_n];
+    size_at = timebase_stamp();
+  }
+  len = r->size;
+  p = pbuf_alloc(PBUF_RAW, ETH_PAD_SIZE + len, PBUF_RAM);
+  if(!p) {
+    ethloop_stop(ETHLOOP_NO_MEM);
+    return;
+  }
+  b = (u8 *)p->payload + ETH_PAD_SIZE;
+  memcpy(b, loop_netif->hwaddr, 6);
+  memcpy(b + 6, loop_netif->hwaddr, 6);
+  b[12] = ETHLOOP_TYPE >> 8;
+  b[13] = ETHLOOP_TYPE & 0xff;
+  seq++;
+  memcpy(b + 14, &seq, 4);
+  for(i=HDR_LEN; i<len; i++) {
+    b[i] = seq + i;
+  }
+  r->sent++;
+  timer_start(&timeout_timer, ETHLOOP_TIMEOUT_MS, 0);
+  sent_at = timebase_stamp();
+  // A frame the driver cannot take is lost when the timeout comes
+  ethernetif_tx_queue(loop_netif, p, NULL, NULL, NULL);
+  pbuf_free(p);
+}
+
+static void
+ethloop_timeout(void *arg)
+{
+  if(++lost_run == ETHLOOP_GIVE_UP && size_n == 0 &&
+     results[0].sent == ETHLOOP_GIVE_UP) {
+    ethloop_stop(ETHLOOP_NO_LOOP);
+    return;
+  }
+  ethloop_next();
+}
+
+// Non-zero if the payload of frame `p` (with ETH_PAD_SIZE) is that of
+// frame `seq` of `len` bytes.  The core may pad or keep the FCS, so only
+// the bytes sent are compared.
+static int
+ethloop_intact(struct pbuf *p, u32 seq, u32 len)
+{
+  u32 i;
+
+  if(p->tot_len < ETH_PAD_SIZE + len) {
+    return 0;
+  }
+  for(i=HDR_LEN; i<len; i++) {
+    if(pbuf_get_at(p, ETH_PAD_SIZE + i) != (u8)(seq + i)) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+// The raw EtherType hook: a frame back, with ETH_PAD_SIZE
+static void
+ethloop_input(struct netif *netif, struct pbuf *p)
+{
+  struct ethloop_result *r = &results[size_n];
+  u32 cycles = ethernetif_rx_stamp(netif) - sent_at;
+  u32 got;
+
+  if(state != ETHLOOP_RUNNING ||
+     pbuf_copy_partial(p, &got, 4, ETH_PAD_SIZE + 14) != 4 || got != seq) {
+    pbuf_free(p);
+    return;
+  }
+  timer_stop(&timeout_timer);
+  lost_run = 0;
+  if(ethloop_intact(p, seq, r->size)) {
+    r->good++;
+    r->sum_cycles += cycles;
+    if(cycles < r->min_cycles) {
+      r->min_cycles = cycles;
+    }
+    if(cycles > r->max_cycles) {
+      r->max_cycles = cycles;
+    }
+  } else {
+    r->bad++;
+  }
+  pbuf_free(p);
+  ethloop_next();
+}
+
+int
+ethloop_start()
+{
+  u32 i;
+
+  if(state == ETHLOOP_RUNNING) {
+    return -1;
+  }
+  loop_netif = netif_default;
+  memset(results, 0, sizeof(results));
+  for(i=0; i<ETHLOOP_NUM_SIZES; i++) {
+    results[i].size = sizes[i];
+    results[i].min_cycles = ~0;
+  }
+  size_n = 0;
+  lost_run = 0;
+  state = ETHLOOP_RUNNING;
+  ethernetif_set_raw_input(loop_netif, ETHLOOP_TYPE, ethloop_input);
+  size_at = timebase_stamp();
+  ethloop_next();
+  return 0;
+}
+
+int
+ethloop_state()
+{
+  return state;
+}
+
+const struct ethloop_result *
+ethloop_result(u32 n)
+{
+  return n < ETHLOOP_NUM_SIZES ? &results[n] : NULL;
+}
@@ -0,0 +1,74 @@
+#ifndef _ETHLOOP_H_
+#define _ETHLOOP_H_
+
+// ethloop.h - eth0 loopback self-test: round trips and rates by frame size.
+//
+// With eth0's port looped back (a loopback plug or a cable between its
+// two fibres, or gateware that turns the port's frames around; the core
+// has no loopback of its own), the test sends ETHLOOP_FRAMES frames of
+// each of ETHLOOP_SIZES bytes to the board's own MAC, with EtherType
+// ETHLOOP_TYPE and a payload that changes with every frame, and takes
+// them back through the driver's raw EtherType hook (ethernetif.h).  Each
+// frame returned is checked byte for byte.  One frame is in flight at a
+// time: its round trip runs from queueing it with ethernetif_tx_queue() to
+// the driver's RX stamp of its return, so it covers the driver, the core
+// and the wire both ways.  A frame not back within ETHLOOP_TIMEOUT_MS is
+// lost and the next one goes.  Frames per second for a size are those
+// returned over the time the size took.
+//
+// It runs from the main loop, started with KATCP's ?loopback (katcp.h),
+// which shows the results too; bench.h's suite reports the last run's.  If
+// none of the first ETHLOOP_GIVE_UP frames comes back the port is taken
+// not to be looped and the run stops.  The normal traffic of a port that
+// is looped comes back to the board too, where it is dropped, so the test
+// is for bring-up, not for a board on its network.
+
+#include "xil_types.h"
+
+#include "eth.h"
+
+// Local experimental EtherType (IEEE 802)
+#define ETHLOOP_TYPE (0x88b5)
+
+// Frame sizes, without the FCS, from the minimum to eth0's MTU
+#define ETHLOOP_SIZES { 60, 128, 256, 512, 1024, ETH_MTU + 14 }
+#define ETHLOOP_NUM_SIZES (6)
+
+// Frames of each size, and how long each may take
+#define ETHLOOP_FRAMES     (64)
+#define ETHLOOP_TIMEOUT_MS (10)
+
+// Frames lost in a row at the start that mean there is no loop
+#define ETHLOOP_GIVE_UP (4)
+
+// State of the last run
+#define ETHLOOP_IDLE    (0) // never run
+#define ETHLOOP_RUNNING (1)
+#define ETHLOOP_DONE    (2)
+#define ETHLOOP_NO_LOOP (3) // nothing came back
+#define ETHLOOP_NO_MEM  (4) // no pbuf for a frame
+
+struct ethloop_result {
+  u16 size;
+  // Frames sent, back intact, and back but wrong
+  u16 sent;
+  u16 good;
+  u16 bad;
+  // Round trips of the good frames, in timer cycles
+  u32 min_cycles;
+  u32 max_cycles;
+  u32 sum_cycles;
+  // Time the size took in all
+  u32 cycles;
+};
+
+// Start a run.  Returns 0, or -1 if one is running.
+int ethloop_start();
+
+// State of the last run
+int ethloop_state();
+
+// Result of size `n` of the last run, NULL past the last size
+const struct ethloop_result *ethloop_result(u32 n);
+
+#endif // _ETHLOOP_H_
@@ -0,0 +1,125 @@
+// ethmon.c - Link state, counters and rates of the 10 GbE cores' data
+// path (see ethmon.h).
+
+#include <string.h>
+
+#include "lwip/netif.h"
+#include "netif/ethernetif.h"
+
+#include "xil_io.h"
+
+#include "bbox.h"
+#include "ethmon.h"
+#include "log.h"
+#include "timer.h"
+#include "wbmap.h"
+#include "wbreg.h"
+
+// Rate per second of `d` counts in ETHMON_PERIOD_MS: d * 1000 / 1024, as
+// d * (1 - 1/64 - 1/128)
+#define PER_SECOND(d) ((d) - ((d) >> 6) - ((d) >> 7))
+
+static const char *const suffix[ETHMON_COUNTERS] = {
+  "txctr", "rxctr", "txofctr", "txfullctr", "rxofctr", "rxbadctr"
+};
+
+static struct ethmon_core cores[ETH_MAX_CORES];
+
+// Bus addresses of each core's counters (0 for none) and link register
+static u32 counter_addr[ETH_MAX_CORES][ETHMON_COUNTERS];
+static u32 link_addr[ETH_MAX_CORES];
+
+// Error counters that moved in the last period, by bit
+static u32 losing[ETH_MAX_CORES];
+
+static void
+ethmon_sample(void *arg)
+{
+  struct ethmon_core *c;
+  u32 n, i, v, d, errors;
+  u8 link;
+
+  for(n=0; n<ETH_MAX_CORES; n++) {
+    c = &cores[n];
+    if(!c->present) {
+      continue;
+    }
+    errors = 0;
+    for(i=0; i<ETHMON_COUNTERS; i++) {
+      if(!counter_addr[n][i]) {
+        continue;
+      }
+      v = Xil_In32(counter_addr[n][i]);
+      d = v - c->count[i];
+      c->rate[i] = PER_SECOND(d);
+      c->count[i] = v;
+      if(c->rate[i] && ((ETHMON_ERRORS >> i) & 1)) {
+        errors |= 1 << i;
+      }
+    }
+    // Only the onset: a clean period, then errors
+    if(errors & ~losing[n]) {
+      LOG("ethmon: eth%u losing frames, errors %x", n, errors);
+    }
+    losing[n] = errors;
+
+    if(link_addr[n]) {
+      link = Xil_In32(link_addr[n]) & 1 ? ETHMON_LINK_UP : ETHMON_LINK_DOWN;
+      if(link != c->link) {
+        c->link = link;
+        c->link_changes++;
+        bbox_event(BBOX_LINK, n, link, 0, 0);
+        LOG("ethmon: eth%u link %s", n, link == ETHMON_LINK_UP ? "up" :
+            "down");
+      }
+    }
+  }
+}
+
+static struct timer sample_timer = TIMER_INIT(ethmon_sample, NULL);
+static struct timer_deadline sample_deadline =
+    TIMER_DEADLINE_INIT("ethmon", ETHMON_DEADLINE_US);
+
+const struct ethmon_core *
+ethmon_core(u32 n)
+{
+  return n < ETH_MAX_CORES && cores[n].present ? &cores[n] : NULL;
+}
+
+void
+init_ethmon()
+{
+  const struct wbmap_entry *e;
+  struct ethmon_core *c;
+  struct netif *netif;
+  char name[WBMAP_NAME_MAX] = "eth0_";
+  u32 n, i;
+
+  for(netif = netif_list; netif; netif = netif->next) {
+    if(!ethernetif_is(netif)) {
+      continue;
+    }
+    n = ethernetif_core_num(netif);
+    c = &cores[n];
+    c->present = 1;
+    name[3] = (char)('0' + n);
+    for(i=0; i<ETHMON_COUNTERS; i++) {
+      strcpy(name + 5, suffix[i]);
+      if((e = wbmap_find(name))) {
+        counter_addr[n][i] = WBREG_BASE + e->offset;
+        c->count[i] = Xil_In32(counter_addr[n][i]);
+        c->have |= 1 << i;
+      }
+    }
+    strcpy(name + 5, "linkup");
+    if((e = wbmap_find(name))) {
+      link_addr[n] = WBREG_BASE + e->offset;
+      c->link = Xil_In32(link_addr[n]) & 1 ? ETHMON_LINK_UP :
+          ETHMON_LINK_DOWN;
+    } else {
+      c->link = ETHMON_LINK_UNKNOWN;
+    }
+  }
+  timer_set_deadline(&sample_timer, &sample_deadline);
+  timer_start(&sample_timer, ETHMON_PERIOD_MS, ETHMON_PERIOD_MS);
+}
@@ -0,0 +1,64 @@
+#ifndef _ETHMON_H_
+#define _ETHMON_H_
+
+// ethmon.h - Link state, counters and rates of the 10 GbE cores' data
+// path.
+//
+// The data path's counters are registers the gateware puts next to each
+// core, found in the register map as <core>_<suffix> in CASPER's naming
+// (eth0_txctr and so on, below), and its link state as <core>_linkup.
+// Every ETHMON_PERIOD_MS each one present is read, and its change since
+// the last sample scaled to a rate per second.  The period is 1024 ms so
+// the scaling is shifts and subtracts (the CPU has no divider); the
+// timer keeps to its deadlines, so sample intervals average out to the
+// period even when a pass runs late.
+//
+// A link going up or down and the first errors after a clean period are
+// logged (log.h).  The latest sample goes out in the telemetry header
+// (telemetry.h) and jamEthTable (snmpmib.h).
+
+#include "xil_types.h"
+
+#include "eth.h"
+
+#define ETHMON_PERIOD_MS (1024)
+// A sample must start this soon after it is due (timer.h), in us
+#define ETHMON_DEADLINE_US (50000)
+
+// Counters, by index
+#define ETHMON_TX       (0) // frames sent: <core>_txctr
+#define ETHMON_RX       (1) // frames received: _rxctr
+#define ETHMON_TX_OF    (2) // frames lost to TX overflow: _txofctr
+#define ETHMON_TX_FULL  (3) // cycles the TX buffer was full: _txfullctr
+#define ETHMON_RX_OF    (4) // frames lost to RX overflow: _rxofctr
+#define ETHMON_RX_BAD   (5) // frames received with errors: _rxbadctr
+#define ETHMON_COUNTERS (6)
+
+// Counters that mean data was lost
+#define ETHMON_ERRORS   ((1 << ETHMON_TX_OF) | (1 << ETHMON_RX_OF) | \
+                         (1 << ETHMON_RX_BAD))
+
+// Link state
+#define ETHMON_LINK_DOWN    (0)
+#define ETHMON_LINK_UP      (1)
+#define ETHMON_LINK_UNKNOWN (2) // no _linkup register
+
+struct ethmon_core {
+  u8 present;
+  u8 link;
+  u16 link_changes;
+  // Bit n set if counter n is in the register map
+  u32 have;
+  // Latest values, and their rates per second over the last period
+  u32 count[ETHMON_COUNTERS];
+  u32 rate[ETHMON_COUNTERS];
+};
+
+// Find each core's registers and start sampling.  Call after the netifs
+// are added.
+void init_ethmon();
+
+// Latest sample of core `n`, or NULL if there is no such core
+const struct ethmon_core *ethmon_core(u32 n);
+
+#endif // _ETHMON_H_
@@ -0,0 +1,112 @@
+// ethport.c - The 10 GbE cores after eth0 (see ethport.h).
+//
+// All ports' addresses are one key, saved in the background (kv_save())
+// as netcfg.c saves its own.
+
+#include <string.h>
+
+#include "netif/etharp.h"
+#include "netif/ethernetif.h"
+
+#include "xil_printf.h"
+
+#include "ethport.h"
+#include "kv.h"
+#include "log.h"
+
+static struct netif ports[ETHPORT_MAX];
+// Which ports have a core
+static u8 present[ETHPORT_MAX];
+
+// As booted with, and as saved for the next boot
+static struct ethport_cfg cfg[ETHPORT_MAX];
+static struct ethport_cfg next_cfg[ETHPORT_MAX];
+
+static struct kv_save save = KV_SAVE_INIT(save, KV_KEY_PORTCFG);
+
+struct netif *
+ethport_netif(u32 n)
+{
+  if(n < 1 || n > ETHPORT_MAX || !present[n - 1]) {
+    return NULL;
+  }
+  return &ports[n - 1];
+}
+
+int
+ethport_get(u32 n, struct ethport_cfg *c)
+{
+  if(n < 1 || n > ETHPORT_MAX) {
+    return -1;
+  }
+  *c = cfg[n - 1];
+  return 0;
+}
+
+int
+ethport_set(u32 n, const struct ethport_cfg *c)
+{
+  if(n < 1 || n > ETHPORT_MAX) {
+    return -1;
+  }
+  next_cfg[n - 1] = *c;
+  kv_save(&save, next_cfg, sizeof(next_cfg));
+  return 0;
+}
+
+struct netif *
+ethport_route_src(const ip4_addr_t *dest, const ip4_addr_t *src)
+{
+  struct netif *netif;
+  u32 n;
+
+  // Called without a source from ip4_route(), and with any address from
+  // unbound pcbs: both route by destination
+  if(!src || ip4_addr_isany(src)) {
+    return NULL;
+  }
+  for(n=0; n<ETHPORT_MAX; n++) {
+    netif = &ports[n];
+    if(present[n] && netif_is_up(netif) &&
+       ip4_addr_cmp(src, netif_ip4_addr(netif))) {
+      return netif;
+    }
+  }
+  return NULL;
+}
+
+void
+init_ethport()
+{
+  ip4_addr_t ip, netmask, gw;
+  struct netif *netif;
+  void *state;
+  u32 n;
+
+  if(kv_get(KV_KEY_PORTCFG, cfg, sizeof(cfg)) != sizeof(cfg)) {
+    memset(cfg, 0, sizeof(cfg));
+  }
+  memcpy(next_cfg, cfg, sizeof(cfg));
+
+  ip4_addr_set_zero(&gw);
+  for(n=0; n<ETHPORT_MAX; n++) {
+    state = ethernetif_core(n + 1);
+    if(!state) {
+      continue;
+    }
+    netif = &ports[n];
+    ip4_addr_set_u32(&ip, cfg[n].ip);
+    ip4_addr_set_u32(&netmask, cfg[n].ip ? cfg[n].netmask : 0);
+    if(!netif_add(netif, &ip, &netmask, &gw, state, ethernetif_init,
+          ethernet_input)) {
+      LOG("ethport: cannot add eth%u", n + 1);
+      continue;
+    }
+    present[n] = 1;
+    netif_set_up(netif);
+    xil_printf("eth%d:   %02x:%02x:%02x:%02x:%02x:%02x %s\n", n + 1,
+        netif->hwaddr[0], netif->hwaddr[1], netif->hwaddr[2],
+        netif->hwaddr[3], netif->hwaddr[4], netif->hwaddr[5],
+        cfg[n].ip ? ip4addr_ntoa(&ip) : "(no address)");
+  }
+}
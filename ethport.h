@@ -0,0 +1,56 @@
+#ifndef _ETHPORT_H_
+#define _ETHPORT_H_
+
+// ethport.h - The 10 GbE cores after eth0, one netif each.
+//
+// init_ethport() adds a netif for each further core the register map has
+// (ethernetif_core()).  Each port has its own TX queue, RX classifier and
+// counters in the driver and a static address from KV_KEY_PORTCFG (see
+// kv.h), set with KATCP's ?port (see katcp.h); a change takes effect at
+// the next boot.  A port without an address is up but carries nothing.
+//
+// eth0 stays the default netif and the control port: DHCP, discovery,
+// mDNS and everything sent to an address off every port's subnet go there.
+// Flows are steered to the other ports by address.  Traffic the board
+// starts follows the subnet route (ip4_route()), and a reply follows the
+// address the request came to: LWIP_HOOK_IP4_ROUTE_SRC (lwipopts.h) sends
+// it out of the port that owns its source address, so a data client
+// talking to a port's address stays on that port even off its subnet.
+
+#include "lwip/ip4_addr.h"
+#include "lwip/netif.h"
+
+#include "xil_types.h"
+
+#include "eth.h"
+
+// Ports after eth0; port n is core eth<n>, from 1
+#define ETHPORT_MAX     (ETH_MAX_CORES - 1)
+
+// As stored, one per port: addresses in network order, ip 0 for none
+struct ethport_cfg {
+  u32 ip;
+  u32 netmask;
+};
+
+// Add a netif for each further core, with its saved address.  Call after
+// eth0's netif is up and init_kv().
+void init_ethport();
+
+// The netif of port `n`, or NULL if the gateware has no such core
+struct netif *ethport_netif(u32 n);
+
+// The configuration of port `n` the board booted with.  Returns 0, or -1
+// if `n` is out of range.
+int ethport_get(u32 n, struct ethport_cfg *cfg);
+
+// Save `cfg` as port `n`'s for the next boot, in the background.  Returns
+// 0, or -1 if `n` is out of range.
+int ethport_set(u32 n, const struct ethport_cfg *cfg);
+
+// LWIP_HOOK_IP4_ROUTE_SRC: the up port whose address is `src`, or NULL to
+// route by `dest`
+struct netif *ethport_route_src(const ip4_addr_t *dest,
+    const ip4_addr_t *src);
+
+#endif // _ETHPORT_H_
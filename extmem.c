@@ -0,0 +1,75 @@
+// extmem.c - External memory behind an AXI memory controller (see
+// extmem.h).
+
+#include "xil_cache.h"
+#include "xil_io.h"
+
+#include "extmem.h"
+#include "log.h"
+
+#define EXTMEM_PATTERN (0xa55a5aa5)
+
+// Next free address, and whether the memory passed init_extmem()
+static u32 next;
+static u8 ok;
+
+void
+init_extmem()
+{
+#if EXTMEM_SIZE
+  const u32 last = EXTMEM_BASE + EXTMEM_SIZE - 4;
+
+  // A controller that failed calibration, or a size in xparameters.h
+  // larger than the part, shows up as a word that does not hold its value
+  Xil_Out32(EXTMEM_BASE, EXTMEM_PATTERN);
+  Xil_Out32(last, ~EXTMEM_PATTERN);
+  extmem_flush((const void *)EXTMEM_BASE, 4);
+  extmem_flush((const void *)last, 4);
+  extmem_invalidate((void *)EXTMEM_BASE, EXTMEM_ALIGN);
+  extmem_invalidate((void *)(last & ~(EXTMEM_ALIGN - 1)), EXTMEM_ALIGN);
+  if(Xil_In32(EXTMEM_BASE) != EXTMEM_PATTERN ||
+     Xil_In32(last) != ~EXTMEM_PATTERN) {
+    LOG("extmem: no memory at %x", EXTMEM_BASE);
+    return;
+  }
+  next = EXTMEM_BASE;
+  ok = 1;
+  LOG("extmem: %u KB at %x, cached %u", EXTMEM_SIZE / 1024, EXTMEM_BASE,
+      EXTMEM_CACHED);
+#endif
+}
+
+void *
+extmem_alloc(u32 size)
+{
+  u32 p = next;
+
+  size = (size + EXTMEM_ALIGN - 1) & ~(EXTMEM_ALIGN - 1);
+  if(!ok || size > extmem_free()) {
+    return NULL;
+  }
+  next += size;
+  return (void *)p;
+}
+
+u32
+extmem_free()
+{
+  return ok ? EXTMEM_BASE + EXTMEM_SIZE - next : 0;
+}
+
+void
+extmem_flush(const void *p, u32 len)
+{
+#if EXTMEM_CACHED
+  Xil_DCacheFlushRange((UINTPTR)p, len);
+#endif
+}
+
+void
+extmem_invalidate(void *p, u32 len)
+{
+#if EXTMEM_CACHED
+  Xil_DCacheInvalidateRange((UINTPTR)p, len);
+#endif
+}
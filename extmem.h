@@ -0,0 +1,71 @@
+#ifndef _EXTMEM_H_
+#define _EXTMEM_H_
+
+// extmem.h - External memory behind an AXI memory controller.
+//
+// Gateware variants with DDR (a MIG) or an AXI EMC in front of HyperRAM or
+// SRAM get EXTMEM_BASE and EXTMEM_SIZE from xparameters.h; on the others
+// EXTMEM_SIZE is 0 and extmem_alloc() always fails.  Code and stack stay in
+// LMB BRAM either way: external memory is for bulk buffers only, such as
+// the telemetry history (telemetry.h), which grows to TELEM_EXT_RECORDS
+// when it is there.
+//
+// External memory is the one place the data cache matters, as LMB bypasses
+// it.  extmem_alloc() hands out whole cache lines, so that invalidating a
+// buffer cannot throw away a neighbour's writes in a shared line.  Around a
+// transfer by another bus master (DMA, or a core reading or writing the
+// memory directly):
+//
+//   extmem_flush(buf, len)      before the device reads what the CPU wrote
+//   extmem_invalidate(buf, len) after the device wrote, before the CPU reads
+//
+// Both are no-ops without a data cache over EXTMEM_BASE.  The CPU's own
+// accesses need neither.
+
+#include "xil_types.h"
+#include "xparameters.h"
+
+#if defined(XPAR_MIG7SERIES_0_BASEADDR)
+#define EXTMEM_BASE (XPAR_MIG7SERIES_0_BASEADDR)
+#define EXTMEM_SIZE (XPAR_MIG7SERIES_0_HIGHADDR - XPAR_MIG7SERIES_0_BASEADDR + 1)
+#elif defined(XPAR_AXI_EMC_0_S_AXI_MEM0_BASEADDR)
+#define EXTMEM_BASE (XPAR_AXI_EMC_0_S_AXI_MEM0_BASEADDR)
+#define EXTMEM_SIZE (XPAR_AXI_EMC_0_S_AXI_MEM0_HIGHADDR - \
+    XPAR_AXI_EMC_0_S_AXI_MEM0_BASEADDR + 1)
+#else
+#define EXTMEM_BASE (0)
+#define EXTMEM_SIZE (0)
+#endif
+
+// Whether the data cache covers external memory
+#if EXTMEM_SIZE && XPAR_MICROBLAZE_USE_DCACHE && \
+    EXTMEM_BASE >= XPAR_MICROBLAZE_DCACHE_BASEADDR && \
+    EXTMEM_BASE + EXTMEM_SIZE - 1 <= XPAR_MICROBLAZE_DCACHE_HIGHADDR
+#define EXTMEM_CACHED (1)
+#else
+#define EXTMEM_CACHED (0)
+#endif
+
+// A data cache line in bytes, and the alignment of every allocation
+#define EXTMEM_ALIGN (XPAR_MICROBLAZE_DCACHE_LINE_LEN * 4)
+
+// Check that the memory answers.  Call after enable_caches().
+void init_extmem();
+
+// `size` bytes of external memory, rounded up to whole cache lines, or NULL
+// if there is none or not that much left.  Allocations last until the
+// reset.
+void *extmem_alloc(u32 size);
+
+// Bytes of external memory not allocated yet
+u32 extmem_free();
+
+// Write the CPU's cached writes to `p` back to memory
+void extmem_flush(const void *p, u32 len);
+
+// Drop cached copies of `p` so the CPU next reads what is in memory.  `p`
+// and `len` should cover whole lines (see extmem_alloc()), or the rest of a
+// partial line is lost along with it on a write-back cache.
+void extmem_invalidate(void *p, u32 len);
+
+#endif // _EXTMEM_H_
@@ -0,0 +1,174 @@
+// fabric.c - Configure the 10 GbE cores' data path (see fabric.h).
+//
+// lwIP's ARP table is mirrored slot by slot: `seen` holds what each slot
+// had when last copied, so a pass writes a core entry only for a slot
+// that changed.  Register and table writes go straight to the bus, one
+// word each, within the pass.
+
+#include <string.h>
+
+#include "lwip/etharp.h"
+#include "netif/ethernetif.h"
+
+#include "xil_io.h"
+
+#include "fabric.h"
+#include "kv.h"
+#include "timer.h"
+
+// What a slot of lwIP's ARP table held when it was last copied
+struct fabric_seen {
+  u32 ip;
+  struct eth_addr mac;
+  // Core it went to, ETH_MAX_CORES for none
+  u8 core;
+};
+
+// A core's registers as last written: addresses in network order
+struct fabric_core {
+  u32 ip;
+  u32 netmask;
+  u32 gw;
+  u16 port;
+  u8 set;
+  u32 arp_writes;
+};
+
+static struct fabric_cfg cfg;
+static struct fabric_core cores[ETH_MAX_CORES];
+static struct fabric_seen seen[ARP_TABLE_SIZE];
+
+static struct kv_save save = KV_SAVE_INIT(save, KV_KEY_FABRIC);
+
+// Write the MAC address pair of registers at `addr`
+static void
+write_mac(u32 addr, const u8 *mac)
+{
+  Xil_Out32(addr, (u32)mac[0] << 8 | mac[1]);
+  Xil_Out32(addr + 4, (u32)mac[2] << 24 | (u32)mac[3] << 16 |
+      (u32)mac[4] << 8 | mac[5]);
+}
+
+// Bring core `n`'s registers in line with `netif`, if they are not
+static void
+fabric_registers(struct netif *netif, u32 n)
+{
+  struct fabric_core *c = &cores[n];
+  u32 base = ethernetif_base(netif);
+  u32 ip = ip4_addr_get_u32(netif_ip4_addr(netif));
+  u32 netmask = ip4_addr_get_u32(netif_ip4_netmask(netif));
+  u32 gw = ip4_addr_get_u32(netif_ip4_gw(netif));
+  u32 i;
+
+  if(!c->set || c->ip != ip || c->netmask != netmask || c->gw != gw) {
+    write_mac(base + ETH_MAC_REG_SRC_MAC_HI, netif->hwaddr);
+    Xil_Out32(base + ETH_MAC_REG_SRC_IP, lwip_ntohl(ip));
+    Xil_Out32(base + ETH_MAC_REG_SUBNET_MASK, lwip_ntohl(netmask));
+    Xil_Out32(base + ETH_MAC_REG_GATEWAY, lwip_ntohl(gw));
+    c->ip = ip;
+    c->netmask = netmask;
+    c->gw = gw;
+    c->set = 1;
+    // A new subnet makes other hosts' entries worth copying
+    for(i=0; i<ARP_TABLE_SIZE; i++) {
+      if(seen[i].core == n) {
+        seen[i].core = ETH_MAX_CORES;
+      }
+    }
+  }
+  if(cfg.port[n] && c->port != cfg.port[n]) {
+    Xil_Out16(ETH_MAC_HALF_ADDR(base, ETH_MAC_REG_PORT_OFFSET),
+        cfg.port[n]);
+    c->port = cfg.port[n];
+  }
+}
+
+// Copy the lwIP ARP entries that changed into the cores' tables
+static void
+fabric_arp()
+{
+  struct fabric_seen *s;
+  struct eth_addr *mac;
+  struct netif *netif;
+  ip4_addr_t *ip;
+  u32 i, n;
+
+  for(i=0; i<ARP_TABLE_SIZE; i++) {
+    s = &seen[i];
+    if(!etharp_get_entry(i, &ip, &netif, &mac) ||
+       !ip4_addr_netcmp(ip, netif_ip4_addr(netif), netif_ip4_netmask(netif))) {
+      s->core = ETH_MAX_CORES;
+      continue;
+    }
+    n = ethernetif_core_num(netif);
+    if(s->core == n && s->ip == ip4_addr_get_u32(ip) &&
+       memcmp(&s->mac, mac, sizeof(s->mac)) == 0) {
+      continue;
+    }
+    write_mac(ethernetif_base(netif) +
+        ETH_MAC_ARP_ENTRY(ip4_addr4(ip) % ETH_MAC_ARP_ENTRIES), mac->addr);
+    cores[n].arp_writes++;
+    s->ip = ip4_addr_get_u32(ip);
+    s->mac = *mac;
+    s->core = n;
+  }
+}
+
+static void
+fabric_poll(void *arg)
+{
+  struct netif *netif;
+
+  for(netif = netif_list; netif; netif = netif->next) {
+    if(ethernetif_is(netif) && netif_is_up(netif) &&
+       !ip4_addr_isany_val(*netif_ip4_addr(netif))) {
+      fabric_registers(netif, ethernetif_core_num(netif));
+    }
+  }
+  fabric_arp();
+}
+
+static struct timer poll_timer = TIMER_INIT(fabric_poll, NULL);
+
+int
+fabric_get_port(u32 n, u16 *port)
+{
+  if(n >= ETH_MAX_CORES) {
+    return -1;
+  }
+  *port = cfg.port[n];
+  return 0;
+}
+
+int
+fabric_set_port(u32 n, u16 port)
+{
+  if(n >= ETH_MAX_CORES) {
+    return -1;
+  }
+  cfg.port[n] = port;
+  kv_save(&save, &cfg, sizeof(cfg));
+  fabric_poll(NULL);
+  return 0;
+}
+
+u32
+fabric_arp_writes(u32 n)
+{
+  return n < ETH_MAX_CORES ? cores[n].arp_writes : 0;
+}
+
+void
+init_fabric()
+{
+  u32 i;
+
+  if(kv_get(KV_KEY_FABRIC, &cfg, sizeof(cfg)) != sizeof(cfg)) {
+    memset(&cfg, 0, sizeof(cfg));
+  }
+  for(i=0; i<ARP_TABLE_SIZE; i++) {
+    seen[i].core = ETH_MAX_CORES;
+  }
+  fabric_poll(NULL);
+  timer_start(&poll_timer, FABRIC_POLL_MS, FABRIC_POLL_MS);
+}
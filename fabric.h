@@ -0,0 +1,47 @@
+#ifndef _FABRIC_H_
+#define _FABRIC_H_
+
+// fabric.h - Configure the 10 GbE cores' gateware data path ("fabric" in
+// CASPER's terms) from the firmware's own network configuration.
+//
+// The data path sends UDP from the core's own registers: a source MAC,
+// IP, subnet mask, gateway and UDP port, and an ARP table of the hosts on
+// its subnet (eth.h).  Every FABRIC_POLL_MS each core's registers are set
+// from its netif, and lwIP's resolved ARP entries on the core's subnet,
+// static ones included (arpcfg.h), are copied into its table.  Only the
+// entries that changed since the last pass are written, so a steady table
+// costs a scan of lwIP's, not a write per host.  An entry lwIP lets
+// expire stays in the core, which goes on sending to the last MAC it had.
+//
+// The UDP port is kept per core in KV_KEY_FABRIC (see kv.h) and set with
+// KATCP's ?fabric (see katcp.h), at once.  Port 0 leaves the gateware's.
+
+#include "lwip/netif.h"
+
+#include "xil_types.h"
+
+#include "eth.h"
+
+#define FABRIC_POLL_MS  (500)
+
+// As stored: the UDP source port of each core, 0 to leave it alone
+struct fabric_cfg {
+  u16 port[ETH_MAX_CORES];
+};
+
+// Load the ports and start keeping the cores in step.  Call after the
+// netifs are added and init_kv().
+void init_fabric();
+
+// The UDP source port configured for core `n`.  Returns 0, or -1 if `n` is
+// out of range.
+int fabric_get_port(u32 n, u16 *port);
+
+// Set core `n`'s UDP source port, and save it in the background.  Returns
+// 0, or -1 if `n` is out of range.
+int fabric_set_port(u32 n, u16 port);
+
+// ARP table entries written to core `n` since boot
+u32 fabric_arp_writes(u32 n);
+
+#endif // _FABRIC_H_
@@ -0,0 +1,529 @@
+// flash.c - SPI configuration flash commands built on send_spi().
+//
+// init_flash() fills flash_info from the JEDEC SFDP basic parameter table
+// (JESD216), so reads use the fastest command the part supports with its
+// real dummy cycle count.  Without SFDP the defaults are those of the Micron
+// N25Q on the board in its power-on configuration, until flash_tune()
+// (flash_cfg.c) sets it up for the SPI clock.
+
+#include "xparameters.h"
+#include "xil_printf.h"
+
+#include "flash.h"
+#include "ovl.h"
+#include "spi.h"
+
+// SFDP read command: 3-byte address and 8 dummy clocks.  The part is never
+// switched into 4-byte address mode (4-byte opcodes are used instead), so
+// this holds for large parts too.
+#define SFDP_OPCODE (0x5a)
+
+// "SFDP" read as a little-endian word
+#define SFDP_SIGNATURE (0x50444653)
+
+// Parameter headers and basic table DWORDs parsed
+#define SFDP_MAX_HEADERS (4)
+#define SFDP_MAX_DWORDS (16)
+
+// Parameter table IDs (MSB and LSB)
+#define SFDP_ID_BASIC (0xff00)
+#define SFDP_ID_4BAIT (0xff84)
+
+// Read identification: 3 ID bytes, the length of what follows and the
+// unique ID
+#define FLASH_OP_RDID (0x9e)
+
+// Write extended address register (bits 31:24 of 3-byte commands' address)
+#define FLASH_OP_WREAR (0xc5)
+
+// Largest part 3-byte addresses reach
+#define FLASH_BANK_SIZE (16 << 20)
+
+// 4-byte address versions of the read modes' opcodes; the 4-byte address
+// instruction table uses the same bit order
+static const u8 read_op4[FLASH_NUM_MODES] = {
+  [FLASH_MODE_READ]    = 0x13,
+  [FLASH_MODE_FAST]    = 0x0c,
+  [FLASH_MODE_DUAL]    = 0x3c,
+  [FLASH_MODE_DUAL_IO] = 0xbc,
+  [FLASH_MODE_QUAD]    = 0x6c,
+  [FLASH_MODE_QUAD_IO] = 0xec
+};
+
+#define FLASH_OP_PP     (0x02)
+#define FLASH_OP_PP4    (0x12)
+
+// 4-byte versions of common erase opcodes, for parts without the table
+static const struct { u8 op3, op4; } erase_op4[] = {
+  { 0x20, 0x21 }, // 4 KB
+  { 0x52, 0x5c }, // 32 KB
+  { 0xd8, 0xdc }  // 64 KB
+};
+
+// Current extended address register value, or FLASH_BANK_UNKNOWN until a
+// write of it has gone out: after a reset that kept the flash powered, or
+// a failed write
+#define FLASH_BANK_UNKNOWN (0x100)
+static u16 flash_bank = FLASH_BANK_UNKNOWN;
+
+struct flash_info flash_info = {
+  .size = 16 << 20,
+  .page_size = 256,
+  .addr_mode = FLASH_ADDR_3,
+  .addr_bytes = 3,
+  .pp_opcode = FLASH_OP_PP,
+  .read = {
+    [FLASH_MODE_READ]    = { 0x03, 1,  0 },
+    [FLASH_MODE_FAST]    = { 0x0b, 1,  8 },
+    [FLASH_MODE_DUAL]    = { 0x3b, 1,  8 },
+    [FLASH_MODE_DUAL_IO] = { 0xbb, 2,  8 },
+    [FLASH_MODE_QUAD]    = { 0x6b, 1,  8 },
+    [FLASH_MODE_QUAD_IO] = { 0xeb, 4, 10 }
+  },
+  .erase = {
+    { 0x20, 12 }, // 4 KB subsector
+    { 0xd8, 16 }  // 64 KB sector
+  }
+};
+
+// Assemble a little-endian SFDP DWORD
+static u32
+sfdp_dword(const u8 *b)
+{
+  return b[0] | (b[1] << 8) | (b[2] << 16) | ((u32)b[3] << 24);
+}
+
+// Read `len` bytes of SFDP data at `addr`.  Returns non-zero on success.
+static int
+read_sfdp(u32 addr, u8 *dst, u32 len)
+{
+  u8 hdr[5];
+
+  hdr[0] = SFDP_OPCODE;
+  hdr[1] = (addr >> 16) & 0xff;
+  hdr[2] = (addr >>  8) & 0xff;
+  hdr[3] =  addr        & 0xff;
+  hdr[4] = 0xff; // dummy
+
+  if(send_spi(hdr, hdr, sizeof(hdr), SEND_SPI_MORE) != sizeof(hdr)) {
+    return 0;
+  }
+  return send_spi(dst, dst, len, 0) == len;
+}
+
+// Decode one 16-bit fast read field (wait states, mode clocks, opcode)
+static void
+sfdp_read_cmd(struct flash_read_cmd *cmd, u32 field, u8 addr_lines)
+{
+  cmd->opcode = (field >> 8) & 0xff;
+  cmd->addr_lines = addr_lines;
+  cmd->dummy_cycles = (field & 0x1f) + ((field >> 5) & 0x7);
+}
+
+// Parse the basic parameter table.  Returns non-zero if it was usable.
+static int
+parse_sfdp(const u32 *dw, u32 ndw)
+{
+  struct flash_info *fi = &flash_info;
+  u32 i;
+
+  // JESD216 tables have at least 9 DWORDs
+  if(ndw < 9) {
+    return 0;
+  }
+
+  // DWORD 1: address bytes and which fast reads exist
+  fi->addr_mode = (dw[0] >> 17) & 0x3;
+  if(!(dw[0] & (1 << 16))) fi->read[FLASH_MODE_DUAL].opcode = 0;
+  if(!(dw[0] & (1 << 20))) fi->read[FLASH_MODE_DUAL_IO].opcode = 0;
+  if(!(dw[0] & (1 << 21))) fi->read[FLASH_MODE_QUAD_IO].opcode = 0;
+  if(!(dw[0] & (1 << 22))) fi->read[FLASH_MODE_QUAD].opcode = 0;
+
+  // DWORD 2: density in bits
+  if(dw[1] & 0x80000000) {
+    fi->size = 1 << ((dw[1] & 0x7fffffff) - 3);
+  } else {
+    fi->size = (dw[1] >> 3) + 1;
+  }
+
+  // DWORDs 3 and 4: quad and dual read parameters
+  if(fi->read[FLASH_MODE_QUAD_IO].opcode) {
+    sfdp_read_cmd(&fi->read[FLASH_MODE_QUAD_IO], dw[2] & 0xffff, 4);
+  }
+  if(fi->read[FLASH_MODE_QUAD].opcode) {
+    sfdp_read_cmd(&fi->read[FLASH_MODE_QUAD], dw[2] >> 16, 1);
+  }
+  if(fi->read[FLASH_MODE_DUAL].opcode) {
+    sfdp_read_cmd(&fi->read[FLASH_MODE_DUAL], dw[3] & 0xffff, 1);
+  }
+  if(fi->read[FLASH_MODE_DUAL_IO].opcode) {
+    sfdp_read_cmd(&fi->read[FLASH_MODE_DUAL_IO], dw[3] >> 16, 2);
+  }
+
+  // DWORDs 8 and 9: erase types (size as a power of two, 0 if unused)
+  for(i=0; i<FLASH_NUM_ERASE_TYPES; i++) {
+    u32 field = (i & 1) ? dw[7 + i/2] >> 16 : dw[7 + i/2] & 0xffff;
+    fi->erase[i].size_shift = field & 0xff;
+    fi->erase[i].opcode = fi->erase[i].size_shift ? (field >> 8) & 0xff : 0;
+  }
+  // DWORD 11 (JESD216A): page size
+  if(ndw >= 11) {
+    fi->page_size = 1 << ((dw[10] >> 4) & 0xf);
+  }
+
+  fi->sfdp = 1;
+  return 1;
+}
+
+// Sort used erase types by size, smallest first
+static void
+sort_erase()
+{
+  struct flash_info *fi = &flash_info;
+  struct flash_erase_cmd e;
+  u32 i, j;
+
+  for(i=1; i<FLASH_NUM_ERASE_TYPES; i++) {
+    e = fi->erase[i];
+    for(j=i; j>0; j--) {
+      if(fi->erase[j-1].opcode &&
+         (!e.opcode || fi->erase[j-1].size_shift <= e.size_shift)) {
+        break;
+      }
+      fi->erase[j] = fi->erase[j-1];
+    }
+    fi->erase[j] = e;
+  }
+
+}
+
+// Pick how addresses above 16 MB are sent.  `bait` holds the first two
+// DWORDs of the 4-byte address instruction table, or is NULL.  Must run
+// before sort_erase(), as the table refers to the basic table's erase types
+// in their original order.
+static void
+setup_addr(const u32 *bait)
+{
+  struct flash_info *fi = &flash_info;
+  u32 i, j;
+
+  if(fi->size <= FLASH_BANK_SIZE) {
+    return;
+  }
+
+  // Always in 4-byte mode: the usual opcodes take 4 address bytes
+  if(fi->addr_mode == FLASH_ADDR_4) {
+    fi->addr_bytes = 4;
+    return;
+  }
+
+  // 3-byte only, or no 4-byte page program: bank switch through the
+  // extended address register
+  if(fi->addr_mode == FLASH_ADDR_3 || (bait && !(bait[0] & (1 << 6)))) {
+    fi->ext_addr = 1;
+    return;
+  }
+
+  fi->addr_bytes = 4;
+  fi->pp_opcode = FLASH_OP_PP4;
+
+  for(i=0; i<FLASH_NUM_MODES; i++) {
+    if(bait && !(bait[0] & (1 << i))) {
+      fi->read[i].opcode = 0;
+    } else if(fi->read[i].opcode) {
+      fi->read[i].opcode = read_op4[i];
+    }
+  }
+
+  for(i=0; i<FLASH_NUM_ERASE_TYPES; i++) {
+    if(!fi->erase[i].opcode) {
+      continue;
+    }
+    if(bait) {
+      fi->erase[i].opcode = (bait[0] & (1 << (9 + i))) ?
+          (bait[1] >> (8 * i)) & 0xff : 0;
+      continue;
+    }
+    for(j=0; j<sizeof(erase_op4)/sizeof(erase_op4[0]); j++) {
+      if(erase_op4[j].op3 == fi->erase[i].opcode) {
+        break;
+      }
+    }
+    fi->erase[i].opcode = j < sizeof(erase_op4)/sizeof(erase_op4[0]) ?
+        erase_op4[j].op4 : 0;
+  }
+}
+
+// Fill in flash_info's ID and unique ID
+static void
+read_id()
+{
+  u8 buf[5];
+  u32 len;
+
+  buf[0] = FLASH_OP_RDID;
+  if(send_spi(buf, buf, 5, SEND_SPI_MORE) != 5) {
+    return;
+  }
+  // buf[0] is the munged opcode byte
+  flash_info.id[0] = buf[1];
+  flash_info.id[1] = buf[2];
+  flash_info.id[2] = buf[3];
+  len = buf[4] > FLASH_UID_MAX ? FLASH_UID_MAX : buf[4];
+  if(send_spi(flash_info.uid, flash_info.uid, len, 0) == len) {
+    flash_info.uid_len = len;
+  }
+}
+
+// Fill in flash_info from the SFDP tables, if the part has them
+static void
+read_params()
+{
+  u8 buf[8 + 8 * SFDP_MAX_HEADERS];
+  u8 tbl[4 * SFDP_MAX_DWORDS];
+  u32 dw[SFDP_MAX_DWORDS];
+  u32 bait_dw[2];
+  u32 nph, ndw, ptr, bait_ptr = 0, i;
+  u8 *ph, *basic, *bait;
+  u16 id;
+
+  // Header and up to SFDP_MAX_HEADERS parameter headers
+  if(!read_sfdp(0, buf, sizeof(buf)) ||
+     sfdp_dword(buf) != SFDP_SIGNATURE) {
+    return;
+  }
+  nph = buf[6] + 1;
+  if(nph > SFDP_MAX_HEADERS) {
+    nph = SFDP_MAX_HEADERS;
+  }
+
+  // Find the JEDEC basic parameter table and 4-byte address instruction
+  // table
+  basic = bait = NULL;
+  for(i=0; i<nph; i++) {
+    ph = &buf[8 + 8*i];
+    id = (ph[7] << 8) | ph[0];
+    if(id == SFDP_ID_BASIC && !basic) {
+      basic = ph;
+    } else if(id == SFDP_ID_4BAIT && !bait && ph[3] >= 2) {
+      bait = ph;
+    }
+  }
+  if(!basic) {
+    return;
+  }
+  ndw = basic[3];
+  ptr = basic[4] | (basic[5] << 8) | (basic[6] << 16);
+  if(ndw > SFDP_MAX_DWORDS) {
+    ndw = SFDP_MAX_DWORDS;
+  }
+  if(bait) {
+    bait_ptr = bait[4] | (bait[5] << 8) | (bait[6] << 16);
+  }
+
+  if(!read_sfdp(ptr, tbl, 4 * ndw)) {
+    return;
+  }
+  for(i=0; i<ndw; i++) {
+    dw[i] = sfdp_dword(&tbl[4*i]);
+  }
+  if(!parse_sfdp(dw, ndw)) {
+    return;
+  }
+
+  if(bait && read_sfdp(bait_ptr, tbl, 8)) {
+    bait_dw[0] = sfdp_dword(&tbl[0]);
+    bait_dw[1] = sfdp_dword(&tbl[4]);
+    setup_addr(bait_dw);
+  } else {
+    setup_addr(NULL);
+  }
+  sort_erase();
+}
+
+void
+init_flash()
+{
+  read_id();
+  read_params();
+  flash_tune();
+}
+
+u32
+flash_cmd(u8 *buf, u8 opcode, u32 addr)
+{
+  u32 n = 0;
+
+  buf[n++] = opcode;
+  if(flash_info.addr_bytes == 4) {
+    buf[n++] = addr >> 24;
+  }
+  buf[n++] = (addr >> 16) & 0xff;
+  buf[n++] = (addr >>  8) & 0xff;
+  buf[n++] =  addr        & 0xff;
+  return n;
+}
+
+u32
+flash_bank_cmd(u8 *buf, u32 addr)
+{
+  u8 bank = addr >> 24;
+
+  if(!flash_info.ext_addr || bank == flash_bank) {
+    return 0;
+  }
+  flash_bank = bank;
+  buf[0] = FLASH_OP_WREAR;
+  buf[1] = bank;
+  return 2;
+}
+
+void
+flash_bank_lost()
+{
+  flash_bank = FLASH_BANK_UNKNOWN;
+}
+
+// Bytes of `len` at `addr` one read command can cover: reads don't cross
+// into the next extended address bank
+static u32
+read_span(u32 addr, u32 len)
+{
+  u32 left = FLASH_BANK_SIZE - (addr & (FLASH_BANK_SIZE - 1));
+
+  if(!flash_info.ext_addr || len <= left) {
+    return len;
+  }
+  return left;
+}
+
+// Send the read command header for the `len` bytes at `addr` in `mode`,
+// leaving the transaction open for the data.  Returns non-zero on success.
+static int
+read_flash_cmd(u32 addr, u32 len, u32 mode)
+{
+  const struct flash_read_cmd *cmd;
+  u8 hdr[16];
+  u32 hdr_len, dummy_bytes;
+
+  // Reads return status bits while a program or erase is in progress
+  if(flash_suspend(addr, len) != 0) {
+    return 0;
+  }
+
+  if(mode > FLASH_MODE_BEST) {
+    mode = FLASH_MODE_BEST;
+  }
+  // Fall back to the next slower mode the part has
+  while(mode > 0 && !flash_info.read[mode].opcode) {
+    mode--;
+  }
+  cmd = &flash_info.read[mode];
+
+  // The SPI core counts the address and dummy phases in FIFO bytes, each of
+  // which takes 8/addr_lines clocks
+  dummy_bytes = (cmd->dummy_cycles * cmd->addr_lines + 7) / 8;
+
+  // Select the bank first if need be (the write takes a WREN)
+  hdr_len = flash_bank_cmd(&hdr[1], addr);
+  if(hdr_len) {
+    hdr[0] = FLASH_OP_WREN;
+    if(send_spi(hdr, hdr, 1, 0) != 1 ||
+       send_spi(&hdr[1], &hdr[1], hdr_len, 0) != hdr_len) {
+      flash_bank_lost();
+      return 0;
+    }
+  }
+
+  hdr_len = flash_cmd(hdr, cmd->opcode, addr);
+  while(dummy_bytes-- && hdr_len < sizeof(hdr)) {
+    hdr[hdr_len++] = 0xff;
+  }
+
+  return send_spi(hdr, hdr, hdr_len, SEND_SPI_MORE) == hdr_len;
+}
+
+u32
+read_flash(u32 addr, u8 *dst, u32 len, u32 mode)
+{
+  u32 done = 0;
+  u32 n, got;
+
+  while(done < len) {
+    n = read_span(addr + done, len - done);
+    if(!read_flash_cmd(addr + done, n, mode)) {
+      break;
+    }
+    got = send_spi(dst + done, dst + done, n, 0);
+    done += got;
+    if(got != n) {
+      break;
+    }
+  }
+  return done;
+}
+
+u32
+stream_flash(u32 addr, u32 len, u32 mode, spi_sink_fn sink, void *arg)
+{
+  u32 done = 0;
+  u32 n, got;
+
+  while(done < len) {
+    n = read_span(addr + done, len - done);
+    if(!read_flash_cmd(addr + done, n, mode)) {
+      break;
+    }
+    got = recv_spi(n, 0, sink, arg);
+    done += got;
+    if(got != n) {
+      break;
+    }
+  }
+  return done;
+}
+
+u32
+flash_rsv_size()
+{
+  u32 size = 1 << flash_info.erase[0].size_shift;
+
+  return size < FLASH_RSV_MIN ? FLASH_RSV_MIN : size;
+}
+
+u32
+flash_rsv_addr(u32 n)
+{
+  return flash_info.size - (FLASH_RSV_SECTORS - n) * flash_rsv_size();
+}
+
+OVL_TEXT(report) void
+dump_flash()
+{
+  struct flash_info *fi = &flash_info;
+  int i;
+
+  xil_printf("Flash (%s):\n", fi->sfdp ? "SFDP" : "defaults");
+  xil_printf("  size      %d KB\n", fi->size >> 10);
+  xil_printf("  page      %d B\n", fi->page_size);
+  xil_printf("  addr      %s, sending %d%s\n",
+      fi->addr_mode == FLASH_ADDR_4 ? "4" :
+      fi->addr_mode == FLASH_ADDR_3_OR_4 ? "3/4" : "3",
+      fi->addr_bytes, fi->ext_addr ? " + extended address register" : "");
+  for(i=0; i<FLASH_NUM_MODES; i++) {
+    if(fi->read[i].opcode) {
+      xil_printf("  read[%d]   %02x x%d %d dummy\n", i, fi->read[i].opcode,
+          fi->read[i].addr_lines, fi->read[i].dummy_cycles);
+    }
+  }
+  for(i=0; i<FLASH_NUM_ERASE_TYPES; i++) {
+    if(fi->erase[i].opcode) {
+      xil_printf("  erase     %02x %d KB\n", fi->erase[i].opcode,
+          (1 << fi->erase[i].size_shift) >> 10);
+    }
+  }
+  if(fi->vcr || fi->evcr) {
+    xil_printf("  vcr       %02x, evcr %02x, SCK %d MHz\n", fi->vcr, fi->evcr,
+        FLASH_SCK_HZ / 1000000);
+  }
+}
@@ -0,0 +1,252 @@
+#ifndef _FLASH_H_
+#define _FLASH_H_
+
+// flash.h - SPI configuration flash commands built on send_spi().
+
+#include "xparameters.h"
+#include "xil_types.h"
+
+#include "spi.h"
+
+// Read modes, in order of the number of data lines they need.  The
+// multi-I/O modes need the AXI Quad SPI core to be built in dual
+// (XPAR_SPI_0_SPI_MODE 1) or quad (2) mode; the core switches its data lines
+// itself based on the opcode.
+#define FLASH_MODE_READ       (0) // 0x03, no dummy cycles, low clock only
+#define FLASH_MODE_FAST       (1) // 1-1-1 Fast Read (0x0B)
+#define FLASH_MODE_DUAL       (2) // 1-1-2 Dual Output Fast Read (0x3B)
+#define FLASH_MODE_DUAL_IO    (3) // 1-2-2 Dual I/O Fast Read (0xBB)
+#define FLASH_MODE_QUAD       (4) // 1-1-4 Quad Output Fast Read (0x6B)
+#define FLASH_MODE_QUAD_IO    (5) // 1-4-4 Quad I/O Fast Read (0xEB)
+#define FLASH_NUM_MODES       (6)
+
+// Fastest mode the SPI core supports
+#if XPAR_SPI_0_SPI_MODE == 2
+#define FLASH_MODE_BEST FLASH_MODE_QUAD_IO
+#elif XPAR_SPI_0_SPI_MODE == 1
+#define FLASH_MODE_BEST FLASH_MODE_DUAL_IO
+#else
+#define FLASH_MODE_BEST FLASH_MODE_FAST
+#endif
+
+// SCK: the core's ext_spi_clk, the AXI clock on this board, over its SCK
+// ratio, which xparameters.h does not give (2, the least, is assumed)
+#ifndef FLASH_SCK_HZ
+#define FLASH_SCK_HZ (XPAR_CPU_CORE_CLOCK_FREQ_HZ / 2)
+#endif
+
+// Number of erase types in the SFDP basic parameter table
+#define FLASH_NUM_ERASE_TYPES (4)
+
+// Longest unique ID kept from RDID (the N25Q has 16 bytes)
+#define FLASH_UID_MAX (16)
+
+// Command header of one read mode
+struct flash_read_cmd {
+  // 0 if the part does not support the mode
+  u8 opcode;
+  // Data lines used for the address, mode and dummy phases
+  u8 addr_lines;
+  // Mode plus dummy clock cycles between address and data
+  u8 dummy_cycles;
+};
+
+// One erase command
+struct flash_erase_cmd {
+  // 0 if unused
+  u8 opcode;
+  // Erase size is 1 << size_shift bytes
+  u8 size_shift;
+};
+
+// Flash geometry and command set, from SFDP if the part has it
+struct flash_info {
+  // Bytes
+  u32 size;
+  u32 page_size;
+  // Address bytes supported: 3, 3 or 4 (FLASH_ADDR_3_OR_4), or 4 only
+  u8 addr_mode;
+  // Address bytes sent with commands.  Parts over 16 MB use the 4-byte
+  // address opcodes in read[], erase[] and pp_opcode if they have them,
+  // otherwise 3 bytes plus the extended address register (ext_addr).
+  u8 addr_bytes;
+  u8 ext_addr;
+  u8 pp_opcode;
+  // Non-zero if the descriptor came from the part's SFDP tables
+  u8 sfdp;
+  // RDID: manufacturer, memory type and capacity, then the unique ID
+  // (uid_len bytes, as many as the part reports up to FLASH_UID_MAX)
+  u8 id[3];
+  u8 uid_len;
+  u8 uid[FLASH_UID_MAX];
+  struct flash_read_cmd read[FLASH_NUM_MODES];
+  // Sorted by size, smallest first
+  struct flash_erase_cmd erase[FLASH_NUM_ERASE_TYPES];
+  // N25Q volatile and enhanced volatile configuration registers after
+  // flash_tune() (0 on other parts)
+  u8 vcr;
+  u8 evcr;
+};
+
+#define FLASH_ADDR_3      (0)
+#define FLASH_ADDR_3_OR_4 (1)
+#define FLASH_ADDR_4      (2)
+
+#define FLASH_OP_WREN (0x06)
+
+extern struct flash_info flash_info;
+
+// Read the flash's ID and SFDP tables and fill in flash_info.  Falls back to
+// the command set of the N25Q fitted to the board if the part has none.  Then
+// calls flash_tune().
+void init_flash();
+
+// Configuration registers (flash_cfg.c)
+
+// On an N25Q, set the fewest dummy clocks the read modes take at
+// FLASH_SCK_HZ, keep XIP and the dual and quad I/O protocols off, and pick
+// the output driver for the clock.  Each read mode up to FLASH_MODE_BEST is
+// then checked against a reference read of the start of the flash: if the
+// new count fails, the part goes back to the counts it had, and modes that
+// still fail are dropped from flash_info.read so reads use the next slower
+// one.  Nothing changes if the start of the flash is blank or a
+// program or erase is running.
+void flash_tune();
+
+// Read `len` bytes starting at flash address `addr` into `dst` using `mode`
+// (clamped to FLASH_MODE_BEST and to what the part supports).
+//
+// Returns `len` on success; less than `len` on error.
+u32 read_flash(u32 addr, u8 *dst, u32 len, u32 mode);
+
+// Like read_flash(), but hand the data to `sink` as it leaves the SPI rx
+// fifo instead of storing it.
+//
+// Returns `len` on success; less than `len` on error.
+u32 stream_flash(u32 addr, u32 len, u32 mode, spi_sink_fn sink, void *arg);
+
+// Reserved sectors at the top of flash.  Each is the smallest erase size
+// (at least FLASH_RSV_MIN), numbered from the lowest.  New ranges go below
+// the others, so that those stay where they are.  Under 128 KB in all, they
+// leave slots_default()'s SLOT_ALIGN aligned slots where they were too.
+#define FLASH_RSV_MIN     (4096)
+#define FLASH_RSV_BBOX    (0) // FLASH_RSV_BBOX_SECTORS sectors, a power of
+                              // two: blackbox event log (bbox.c)
+#define FLASH_RSV_BBOX_SECTORS (8)
+#define FLASH_RSV_TELBUF  (8) // FLASH_RSV_TELBUF_SECTORS sectors, a power
+                              // of two: telemetry held through outages
+                              // (telbuf.c)
+#define FLASH_RSV_TELBUF_SECTORS (16)
+#define FLASH_RSV_SLOTS   (24) // two sectors: slot table (slots.c)
+#define FLASH_RSV_KV      (26) // two sectors: config store (kv.c)
+#define FLASH_RSV_SECTORS (28)
+
+// Size of a reserved sector
+u32 flash_rsv_size();
+
+// Address of reserved sector `n`.  Everything below flash_rsv_addr(0) is
+// free for bitstreams.
+u32 flash_rsv_addr(u32 n);
+
+// Print flash_info
+void dump_flash();
+
+// Largest header flash_cmd() writes
+#define FLASH_CMD_MAX (5)
+
+// Write `opcode` and `addr` into `buf` as a command header, with
+// flash_info.addr_bytes address bytes.
+//
+// Returns the header length.
+u32 flash_cmd(u8 *buf, u8 opcode, u32 addr);
+
+// If `addr` is in a different extended address register bank than the last
+// command used, write the register write command for it into `buf` (it must
+// follow a WREN) and assume it is sent.
+//
+// Returns the command length, or 0 if no bank switch is needed.
+u32 flash_bank_cmd(u8 *buf, u32 addr);
+
+// The command flash_bank_cmd() wrote was not sent, or failed: the next one
+// writes the register whatever the bank
+void flash_bank_lost();
+
+// Program and erase (flash_prog.c)
+//
+// Both run in the background: commands go out through submit_spi() and the
+// status register is polled from an lwIP timeout until the part is done,
+// then `done` is called from the main loop with 0 on success or -1 on error.
+// Only one program or erase runs at a time.
+
+typedef void (*flash_done_fn)(int err, void *arg);
+
+// Erase at least `len` bytes starting at `addr` (aligned to the smallest
+// erase size) using the largest erase blocks that fit.  Erasing the whole
+// part uses the bulk erase command.
+//
+// Returns 0 if started, -1 if busy or misaligned.
+int erase_flash(u32 addr, u32 len, flash_done_fn done, void *arg);
+
+// Program `len` bytes from `src` at `addr`, one page at a time.  `src` must
+// stay valid until `done` is called.
+//
+// Returns 0 if started, -1 if busy.
+int program_flash(u32 addr, const u8 *src, u32 len,
+    flash_done_fn done, void *arg);
+
+// Returns non-zero while a program or erase is running
+int flash_busy();
+
+// Make `len` bytes at `addr` readable, suspending an erase in progress
+// (PES, N25Q-style) if need be.  The erase resumes by itself on its next
+// status poll.  read_flash() and the rest call this before each read.
+//
+// Returns 0 if the range can be read now, -1 if a program is running, the
+// erase covers the range or the part did not suspend in time.
+int flash_suspend(u32 addr, u32 len);
+
+// Erase suspends so far
+u32 flash_suspends();
+
+// Read cache (flash_cache.c)
+
+#define FLASH_CACHE_LINE_SIZE (256)
+#define FLASH_CACHE_LINES     (8)
+#define FLASH_CACHE_WAYS      (2)
+
+struct flash_cache_stats {
+  u32 hits;
+  u32 misses;
+  u32 readaheads;
+};
+
+extern struct flash_cache_stats flash_cache_stats;
+
+// Like read_flash() in FLASH_MODE_BEST, but through the cache
+u32 read_flash_cached(u32 addr, u8 *dst, u32 len);
+
+// Drop cached lines overlapping `len` bytes at `addr`
+void flash_cache_invalidate(u32 addr, u32 len);
+
+// CRC-32 of flash regions (flash_crc.c)
+
+// Update `*crc` (see crc32()) with `len` bytes of flash at `addr`, streamed
+// through the SPI rx fifo.  Blocks until done.
+//
+// Returns 0 on success, -1 on error.
+int crc_flash(u32 addr, u32 len, u32 *crc);
+
+typedef void (*flash_crc_fn)(int err, u32 crc, void *arg);
+
+// Compute the CRC-32 of `len` bytes at `addr` in the background,
+// FLASH_CRC_CHUNK bytes per main loop pass, and pass it to `done`.  Waits
+// out programs and erases in progress.  Suited to verifying images far
+// larger than BRAM.
+//
+// Returns 0 if started, -1 if a CRC is already running.
+int crc_flash_start(u32 addr, u32 len, flash_crc_fn done, void *arg);
+
+// Returns non-zero while a background CRC is running
+int crc_flash_busy();
+
+#endif // _FLASH_H_
@@ -0,0 +1,133 @@
+// flash_cache.c - Read cache in front of read_flash().
+//
+// A small 2-way set-associative cache of flash lines kept in the
+// .flash_cache section.  A miss that follows a miss on the previous line
+// also fetches the next line, so sequential readers mostly hit.
+// program_flash() and erase_flash() invalidate the lines they touch.
+
+#include <string.h>
+
+#include "flash.h"
+#include "mbmem.h"
+#include "sections.h"
+
+#define FLASH_CACHE_SETS (FLASH_CACHE_LINES / FLASH_CACHE_WAYS)
+
+// Read-ahead relies on consecutive lines living in different sets
+#if FLASH_CACHE_SETS < 2
+#error "flash cache needs at least two sets"
+#endif
+
+// Tag of an empty line
+#define LINE_INVALID (0xffffffff)
+
+static u8 cache_data[FLASH_CACHE_SETS][FLASH_CACHE_WAYS][FLASH_CACHE_LINE_SIZE]
+  FLASH_CACHE_SECTION;
+// Line number (flash address / FLASH_CACHE_LINE_SIZE) held by each way
+static u32 cache_tag[FLASH_CACHE_SETS][FLASH_CACHE_WAYS] = {
+  [0 ... FLASH_CACHE_SETS-1] = { [0 ... FLASH_CACHE_WAYS-1] = LINE_INVALID }
+};
+// Way of each set to replace next
+static u8 cache_victim[FLASH_CACHE_SETS];
+// Line of the last miss
+static u32 last_miss = LINE_INVALID;
+
+struct flash_cache_stats flash_cache_stats;
+
+// Return the data of `line`, or NULL if it is not cached
+static u8 *
+cache_lookup(u32 line)
+{
+  u32 set = line % FLASH_CACHE_SETS;
+  int way;
+
+  for(way=0; way<FLASH_CACHE_WAYS; way++) {
+    if(cache_tag[set][way] == line) {
+      // The other way becomes the replacement candidate
+      cache_victim[set] = (way + 1) % FLASH_CACHE_WAYS;
+      return cache_data[set][way];
+    }
+  }
+  return NULL;
+}
+
+// Read `line` into the cache.  Returns its data, or NULL on error.
+static u8 *
+cache_fill(u32 line)
+{
+  u32 set = line % FLASH_CACHE_SETS;
+  int way = cache_victim[set];
+  u8 *data = cache_data[set][way];
+
+  cache_tag[set][way] = LINE_INVALID;
+  if(read_flash(line * FLASH_CACHE_LINE_SIZE, data, FLASH_CACHE_LINE_SIZE,
+        FLASH_MODE_BEST) != FLASH_CACHE_LINE_SIZE) {
+    return NULL;
+  }
+  cache_tag[set][way] = line;
+  cache_victim[set] = (way + 1) % FLASH_CACHE_WAYS;
+  return data;
+}
+
+u32
+read_flash_cached(u32 addr, u8 *dst, u32 len)
+{
+  u32 done = 0;
+  u32 line, off, n;
+  u8 *data;
+
+  while(done < len) {
+    line = addr / FLASH_CACHE_LINE_SIZE;
+    off = addr % FLASH_CACHE_LINE_SIZE;
+    n = FLASH_CACHE_LINE_SIZE - off;
+    if(n > len - done) {
+      n = len - done;
+    }
+
+    data = cache_lookup(line);
+    if(data) {
+      flash_cache_stats.hits++;
+    } else {
+      flash_cache_stats.misses++;
+      data = cache_fill(line);
+      if(!data) {
+        break;
+      }
+      // Sequential reader: fetch the next line (in the next set) as well
+      if(last_miss != LINE_INVALID && line == last_miss + 1 &&
+         !cache_lookup(line + 1) && cache_fill(line + 1)) {
+        flash_cache_stats.readaheads++;
+      }
+      last_miss = line;
+    }
+
+    mb_memcpy(dst, data + off, n);
+    dst += n;
+    addr += n;
+    done += n;
+  }
+
+  return done;
+}
+
+void
+flash_cache_invalidate(u32 addr, u32 len)
+{
+  u32 first, last;
+  int set, way;
+
+  if(len == 0) {
+    return;
+  }
+  first = addr / FLASH_CACHE_LINE_SIZE;
+  last = (addr + len - 1) / FLASH_CACHE_LINE_SIZE;
+
+  for(set=0; set<FLASH_CACHE_SETS; set++) {
+    for(way=0; way<FLASH_CACHE_WAYS; way++) {
+      if(cache_tag[set][way] >= first && cache_tag[set][way] <= last) {
+        cache_tag[set][way] = LINE_INVALID;
+      }
+    }
+  }
+  last_miss = LINE_INVALID;
+}
@@ -0,0 +1,223 @@
+// flash_cfg.c - Configuration registers of the Micron N25Q, set for the
+// SPI clock at boot.
+//
+// The N25Q takes one dummy clock count for every fast read mode, from its
+// volatile configuration register.  The SPI core sends the address and
+// dummy phases in whole FIFO bytes (see read_flash_cmd()), so the count
+// must also fill whole bytes in each mode: with the 1-1-x modes that means
+// 8, the power-on count fast and dual reads already use, and quad I/O reads
+// drop from 10 (5 bytes) to 8 (4 bytes) where the clock allows.
+//
+// Each mode is then checked against a reference read of the start of the
+// flash.  If the new count fails anywhere, the counts from before come
+// back; a mode that fails with those too, a data line not wired through
+// say, is dropped so reads fall back to the next slower one.
+
+#include <string.h>
+
+#include "flash.h"
+#include "log.h"
+#include "spi.h"
+
+#define FLASH_OP_WRVCR     (0x81)
+#define FLASH_OP_RDVCR     (0x85)
+#define FLASH_OP_WREVCR    (0x61)
+#define FLASH_OP_RDEVCR    (0x65)
+
+#define FLASH_ID_MICRON    (0x20)
+
+// VCR: dummy clocks in bits 7:4 (0 and 15 keep each mode's power-on
+// count), XIP off while bit 3 is set, wrap in bits 1:0 (3 is none)
+#define VCR_DUMMY_SHIFT    (4)
+#define VCR_XIP_OFF        (0x08)
+#define VCR_RESERVED       (0x04)
+#define VCR_WRAP_NONE      (0x03)
+
+// EVCR: quad and dual I/O protocols (every command on 4 or 2 lines) while
+// their bits are clear, and the output driver in bits 2:0
+#define EVCR_QUAD_OFF      (0x80)
+#define EVCR_DUAL_OFF      (0x40)
+#define EVCR_DRIVE         (0x07)
+#define EVCR_DRIVE_20_OHM  (0x05)
+#define EVCR_DRIVE_30_OHM  (0x07)
+
+// Output driver: the power-on 30 ohms, or 20 ohms for sharper edges once
+// SCK is above 75 MHz
+#if FLASH_SCK_HZ > 75000000
+#define FLASH_DRIVE        (EVCR_DRIVE_20_OHM)
+#else
+#define FLASH_DRIVE        (EVCR_DRIVE_30_OHM)
+#endif
+
+// READ (0x03) is specified to 54 MHz; above that the reference read is a
+// fast read with the power-on count
+#define FLASH_READ_MAX_HZ  (54000000)
+#if FLASH_SCK_HZ <= FLASH_READ_MAX_HZ
+#define FLASH_MODE_REF     (FLASH_MODE_READ)
+#else
+#define FLASH_MODE_REF     (FLASH_MODE_FAST)
+#endif
+
+// Reference read: the bitstream's padding and sync words
+#define FLASH_VERIFY_ADDR  (0)
+#define FLASH_VERIFY_LEN   (64)
+
+// Highest dummy count in the table; more clocks all reach 108 MHz
+#define FLASH_DUMMY_MAX    (10)
+
+// Highest SCK in MHz for 1 to FLASH_DUMMY_MAX dummy clocks, in the modes
+// from FLASH_MODE_FAST up (N25Q 3 V datasheet, STR)
+static const u8 max_mhz[FLASH_DUMMY_MAX][FLASH_NUM_MODES - 1] = {
+  {  90,  80,  50,  43,  30 },
+  { 100,  90,  70,  60,  40 },
+  { 108, 100,  80,  75,  50 },
+  { 108, 105,  90,  90,  60 },
+  { 108, 108, 100, 100,  70 },
+  { 108, 108, 105, 105,  80 },
+  { 108, 108, 108, 108,  86 },
+  { 108, 108, 108, 108,  95 },
+  { 108, 108, 108, 108, 105 },
+  { 108, 108, 108, 108, 108 }
+};
+
+// Read the one-byte register of `opcode` into `*v`.  Returns non-zero on
+// success.
+static int
+read_reg(u8 opcode, u8 *v)
+{
+  u8 buf[2];
+
+  buf[0] = opcode;
+  if(send_spi(buf, buf, 2, 0) != 2) {
+    return 0;
+  }
+  *v = buf[1];
+  return 1;
+}
+
+// Write `v` to the one-byte register of `opcode` and read it back with
+// `rd`.  Returns non-zero if it took.
+static int
+write_reg(u8 opcode, u8 rd, u8 v)
+{
+  u8 buf[2];
+
+  buf[0] = FLASH_OP_WREN;
+  if(send_spi(buf, buf, 1, 0) != 1) {
+    return 0;
+  }
+  buf[0] = opcode;
+  buf[1] = v;
+  if(send_spi(buf, buf, 2, 0) != 2) {
+    return 0;
+  }
+  return read_reg(rd, &buf[0]) && buf[0] == v;
+}
+
+// Fewest dummy clocks that fill whole FIFO bytes and reach FLASH_SCK_HZ
+// in every mode up to FLASH_MODE_BEST, or 0 if none does
+static u32
+pick_dummy()
+{
+  const struct flash_read_cmd *cmd;
+  u32 n, m, mhz;
+
+  for(n=1; n<15; n++) {
+    for(m=FLASH_MODE_FAST; m<=FLASH_MODE_BEST; m++) {
+      cmd = &flash_info.read[m];
+      if(!cmd->opcode) {
+        continue;
+      }
+      mhz = n <= FLASH_DUMMY_MAX ? max_mhz[n - 1][m - 1] : 108;
+      if((n * cmd->addr_lines) % 8 || mhz * 1000000 < FLASH_SCK_HZ) {
+        break;
+      }
+    }
+    if(m > FLASH_MODE_BEST) {
+      return n;
+    }
+  }
+  return 0;
+}
+
+// Read the reference region in each mode up to FLASH_MODE_BEST and compare
+// it with `ref`.  Modes that differ are dropped if `drop` is set.
+//
+// Returns the number of modes that differ.
+static u32
+check_modes(const u8 *ref, int drop)
+{
+  u8 buf[FLASH_VERIFY_LEN];
+  u32 m, bad = 0;
+
+  for(m=FLASH_MODE_FAST; m<=FLASH_MODE_BEST; m++) {
+    if(!flash_info.read[m].opcode) {
+      continue;
+    }
+    if(read_flash(FLASH_VERIFY_ADDR, buf, sizeof(buf), m) == sizeof(buf) &&
+       memcmp(buf, ref, sizeof(buf)) == 0) {
+      continue;
+    }
+    bad++;
+    if(drop) {
+      LOG("flash: read mode %u (%02x) failed its check, not used", m,
+          flash_info.read[m].opcode);
+      flash_info.read[m].opcode = 0;
+    }
+  }
+  return bad;
+}
+
+void
+flash_tune()
+{
+  struct flash_read_cmd saved[FLASH_NUM_MODES];
+  u8 ref[FLASH_VERIFY_LEN];
+  u8 vcr, evcr;
+  u32 n, m;
+
+  if(flash_info.id[0] != FLASH_ID_MICRON || flash_busy() ||
+     !read_reg(FLASH_OP_RDVCR, &vcr) || !read_reg(FLASH_OP_RDEVCR, &evcr)) {
+    return;
+  }
+  flash_info.vcr = vcr;
+  flash_info.evcr = evcr;
+
+  // A blank or uniform region cannot show a wrong dummy count
+  if(read_flash(FLASH_VERIFY_ADDR, ref, sizeof(ref), FLASH_MODE_REF) !=
+     sizeof(ref)) {
+    return;
+  }
+  for(n=1; n<sizeof(ref) && ref[n] == ref[0]; n++) {
+  }
+  if(n == sizeof(ref)) {
+    LOG("flash: nothing at %x to check read modes against, not tuned",
+        FLASH_VERIFY_ADDR);
+    return;
+  }
+
+  // Commands stay on one line, as flash_info describes them
+  write_reg(FLASH_OP_WREVCR, FLASH_OP_RDEVCR,
+      (evcr & ~EVCR_DRIVE) | EVCR_QUAD_OFF | EVCR_DUAL_OFF | FLASH_DRIVE);
+
+  memcpy(saved, flash_info.read, sizeof(saved));
+  n = pick_dummy();
+  if(n && write_reg(FLASH_OP_WRVCR, FLASH_OP_RDVCR,
+        (n << VCR_DUMMY_SHIFT) | (vcr & VCR_RESERVED) | VCR_XIP_OFF |
+        VCR_WRAP_NONE)) {
+    for(m=FLASH_MODE_FAST; m<FLASH_NUM_MODES; m++) {
+      flash_info.read[m].dummy_cycles = n;
+    }
+    if(check_modes(ref, 0)) {
+      LOG("flash: reads failed with %u dummy clocks, back to %02x %02x", n,
+          vcr, evcr);
+      write_reg(FLASH_OP_WRVCR, FLASH_OP_RDVCR, vcr);
+      write_reg(FLASH_OP_WREVCR, FLASH_OP_RDEVCR, evcr);
+      memcpy(flash_info.read, saved, sizeof(saved));
+    }
+  }
+  check_modes(ref, 1);
+
+  read_reg(FLASH_OP_RDVCR, &flash_info.vcr);
+  read_reg(FLASH_OP_RDEVCR, &flash_info.evcr);
+}
@@ -0,0 +1,110 @@
+// flash_crc.c - Streaming CRC-32 of flash regions.
+//
+// Data is folded into the CRC straight out of the SPI rx fifo, so verifying
+// a multi-megabyte image needs no buffer beyond one fifo burst.  The
+// background version reads FLASH_CRC_CHUNK bytes per lwIP timeout so the
+// main loop keeps servicing the network.
+
+#include "lwip/timeouts.h"
+
+#include "crc32.h"
+#include "flash.h"
+#include "spi.h"
+
+// Bytes read per step of a background CRC
+#define FLASH_CRC_CHUNK (4096)
+
+// Interval between steps
+#define FLASH_CRC_PERIOD_MS (1)
+
+static struct {
+  u8 active;
+  u32 addr;
+  u32 end;
+  u32 crc;
+  flash_crc_fn done;
+  void *arg;
+} job;
+
+static void
+crc_sink(const u8 *buf, u32 len, void *arg)
+{
+  u32 *crc = (u32 *)arg;
+
+  *crc = crc32(*crc, buf, len);
+}
+
+int
+crc_flash(u32 addr, u32 len, u32 *crc)
+{
+  if(len == 0) {
+    return 0;
+  }
+  if(stream_flash(addr, len, FLASH_MODE_BEST, crc_sink, crc) != len) {
+    return -1;
+  }
+  return 0;
+}
+
+static void
+crc_finish(int err)
+{
+  job.active = 0;
+  if(job.done) {
+    job.done(err, job.crc, job.arg);
+  }
+}
+
+// Timeout: CRC the next chunk
+static void
+crc_step(void *arg)
+{
+  u32 n = job.end - job.addr;
+
+  if(n > FLASH_CRC_CHUNK) {
+    n = FLASH_CRC_CHUNK;
+  }
+
+  // The flash can't be read while it programs; try again later
+  if(!flash_busy() && !spi_busy()) {
+    if(crc_flash(job.addr, n, &job.crc)) {
+      crc_finish(-1);
+      return;
+    }
+    job.addr += n;
+    if(job.addr == job.end) {
+      crc_finish(0);
+      return;
+    }
+  }
+
+  sys_timeout(FLASH_CRC_PERIOD_MS, crc_step, NULL);
+}
+
+int
+crc_flash_start(u32 addr, u32 len, flash_crc_fn done, void *arg)
+{
+  if(job.active) {
+    return -1;
+  }
+
+  job.active = 1;
+  job.addr = addr;
+  job.end = addr + len;
+  job.crc = 0;
+  job.done = done;
+  job.arg = arg;
+
+  if(len == 0) {
+    crc_finish(0);
+    return 0;
+  }
+  sys_timeout(0, crc_step, NULL);
+  return 0;
+}
+
+int
+crc_flash_busy()
+{
+  return job.active;
+}
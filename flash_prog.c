@@ -0,0 +1,450 @@
+// flash_prog.c - Background page program and erase for the SPI flash.
+//
+// Each step is one list of asynchronous SPI transfers (submit_spi_chain():
+// WREN, then the program or erase command).  A page program takes well
+// under a millisecond, so its list ends with a status read the SPI queue
+// repeats once per pass of the main loop until the write-in-progress bit
+// clears.  An erase takes far longer and keeps the SPI core free for reads
+// meanwhile: its status is read from an lwIP timeout every
+// FLASH_ERASE_POLL_MS.  While a page programs the next one is staged in the
+// other page buffer, so the SPI core sends it as soon as the part is ready.
+// Each step's completion beats the watchdog (wdog.h) while an operation
+// runs, so a transfer that never completes resets the board.
+//
+// A read that arrives during an erase suspends it (flash_suspend()), and
+// the next poll, FLASH_RESUME_MS later, resumes it first.  Reads in one
+// pass of the main loop share the suspension, and after a resume the erase
+// gets FLASH_RESUME_MIN_US to itself, so a steady stream of reads slows it
+// down without stalling it.  Programs are not suspended: a page is done
+// within a millisecond.
+
+#include <string.h>
+
+#include "lwip/timeouts.h"
+
+#include "flash.h"
+#include "spi.h"
+#include "timebase.h"
+#include "wdog.h"
+
+#define FLASH_OP_RDSR       (0x05)
+#define FLASH_OP_BULK_ERASE (0xc7)
+#define FLASH_OP_PES        (0x75) // program/erase suspend
+#define FLASH_OP_PER        (0x7a) // program/erase resume
+
+// Status register write-in-progress bit
+#define FLASH_SR_WIP (0x01)
+
+// Erase status poll interval
+#define FLASH_ERASE_POLL_MS (10)
+
+// Longest wait for the next status read
+#define FLASH_WDOG_MS (1000)
+
+// Longest wait for the SPI queue to drain and for the part to suspend
+// (the N25Q's erase suspend latency is 30 us at most)
+#define FLASH_SUSPEND_US    (100)
+// Least time an erase runs between a resume and the next suspend
+#define FLASH_RESUME_MIN_US (500)
+// How long a suspension lasts
+#define FLASH_RESUME_MS     (1)
+
+// Largest chunk programmed with one command (at most a page)
+#define FLASH_MAX_PAGE (256)
+
+#define PROG_IDLE    (0)
+#define PROG_PROGRAM (1)
+#define PROG_ERASE   (2)
+
+static struct {
+  u8 state;
+  u32 addr;         // start of the current page or erase block
+  u32 end;
+  const u8 *src;    // program source for addr
+  u32 step;         // bytes covered by the current command
+  flash_done_fn done;
+  void *arg;
+
+  // Non-zero while an erase is suspended, timebase_us() of the last
+  // resume, and the suspends so far
+  u8 suspended;
+  u64 resumed_us;
+  u32 suspends;
+
+  struct spi_xfer bank_wren;
+  struct spi_xfer bank;
+  struct spi_xfer wren;
+  struct spi_xfer cmd;
+  struct spi_xfer data;
+  struct spi_xfer rdsr;
+  struct spi_xfer resume;
+  u8 bank_buf[3];   // WREN, then the extended address register write
+  u8 wren_buf[1];
+  u8 resume_buf[1];
+  u8 cmd_buf[FLASH_CMD_MAX];
+  u8 rdsr_op[2];
+  u8 rdsr_buf[2];
+
+  // Double-buffered page data; page[cur] is being programmed
+  u8 page[2][FLASH_MAX_PAGE];
+  u32 page_len[2];
+  u8 cur;
+} prog;
+
+static void prog_poll(void *arg);
+static void prog_status(struct spi_xfer *xfer);
+
+static struct wdog_task wdog_task = WDOG_TASK_INIT("flash", FLASH_WDOG_MS);
+static u8 wdog_added;
+
+// Start supervising an operation
+static void
+prog_arm()
+{
+  if(!wdog_added) {
+    wdog_add(&wdog_task, 0);
+    wdog_added = 1;
+  }
+  wdog_arm(&wdog_task);
+}
+
+// Finish the current operation
+static void
+prog_finish(int err)
+{
+  flash_done_fn done = prog.done;
+
+  wdog_disarm(&wdog_task);
+  prog.state = PROG_IDLE;
+  if(done) {
+    done(err, prog.arg);
+  }
+}
+
+// Bytes of the chunk starting at `addr`: up to the end of its page, the
+// end of the range, or FLASH_MAX_PAGE
+static u32
+prog_chunk(u32 addr)
+{
+  u32 n = flash_info.page_size - (addr & (flash_info.page_size - 1));
+
+  if(n > prog.end - addr) {
+    n = prog.end - addr;
+  }
+  if(n > FLASH_MAX_PAGE) {
+    n = FLASH_MAX_PAGE;
+  }
+  return n;
+}
+
+// Copy the chunk at `addr` into page buffer `b`
+static void
+prog_stage(u8 b, u32 addr)
+{
+  u32 n = addr < prog.end ? prog_chunk(addr) : 0;
+
+  memcpy(prog.page[b], prog.src + (addr - prog.addr), n);
+  prog.page_len[b] = n;
+}
+
+// Poll the status register next in `ms`, replacing a poll already due
+static void
+prog_wait(u32 ms)
+{
+  sys_untimeout(prog_poll, NULL);
+  sys_timeout(prog.suspended ? FLASH_RESUME_MS : ms, prog_poll, NULL);
+}
+
+// SPI callback once a command has gone out: start polling for completion
+static void
+prog_sent(struct spi_xfer *xfer)
+{
+  if(xfer->count != xfer->len) {
+    prog_finish(-1);
+    return;
+  }
+  prog_wait(FLASH_ERASE_POLL_MS);
+}
+
+// Set up the status register read, with `opt`
+static void
+prog_rdsr(u32 opt)
+{
+  prog.rdsr_op[0] = FLASH_OP_RDSR;
+  prog.rdsr.src = prog.rdsr_op;
+  prog.rdsr.dst = prog.rdsr_buf;
+  prog.rdsr.len = 2;
+  prog.rdsr.opt = opt;
+  prog.rdsr.mask = FLASH_SR_WIP;
+  prog.rdsr.tries = 0;
+  prog.rdsr.done = prog_status;
+}
+
+// The bank switch of a prog_submit() list went out, or failed
+static void
+prog_bank_sent(struct spi_xfer *x)
+{
+  if(x->err != SPI_OK || x->count != x->len) {
+    flash_bank_lost();
+  }
+}
+
+// Send WREN followed by a command of `len` header bytes (and `data_len`
+// bytes of page[cur] if non-zero, then the status polls), switching the
+// extended address bank for prog.addr first if need be
+static void
+prog_submit(u32 len, u32 data_len)
+{
+  struct spi_xfer *first = &prog.wren;
+  u32 bank_len = flash_bank_cmd(&prog.bank_buf[1], prog.addr);
+
+  if(bank_len) {
+    prog.bank_buf[0] = FLASH_OP_WREN;
+    prog.bank_wren.src = prog.bank_wren.dst = &prog.bank_buf[0];
+    prog.bank_wren.len = 1;
+    prog.bank_wren.opt = 0;
+    prog.bank_wren.done = NULL;
+    prog.bank_wren.next = &prog.bank;
+    prog.bank.src = prog.bank.dst = &prog.bank_buf[1];
+    prog.bank.len = bank_len;
+    prog.bank.opt = 0;
+    prog.bank.done = prog_bank_sent;
+    prog.bank.next = &prog.wren;
+    first = &prog.bank_wren;
+  }
+
+  prog.wren_buf[0] = FLASH_OP_WREN;
+  prog.wren.src = prog.wren.dst = prog.wren_buf;
+  prog.wren.len = 1;
+  prog.wren.opt = 0;
+  prog.wren.done = NULL;
+  prog.wren.next = &prog.cmd;
+
+  prog.cmd.src = prog.cmd.dst = prog.cmd_buf;
+  prog.cmd.len = len;
+  prog.cmd.opt = data_len ? SEND_SPI_MORE : 0;
+  prog.cmd.done = data_len ? NULL : prog_sent;
+  prog.cmd.next = NULL;
+
+  if(data_len) {
+    prog.data.src = prog.data.dst = prog.page[prog.cur];
+    prog.data.len = data_len;
+    prog.data.opt = 0;
+    prog.data.done = NULL;
+    prog.data.next = &prog.rdsr;
+    prog.cmd.next = &prog.data;
+    prog_rdsr(SPI_XFER_POLL);
+    prog.rdsr.next = NULL;
+  }
+
+  submit_spi_chain(first);
+}
+
+// Program the page staged in page[cur] at prog.addr and stage the one after
+static void
+prog_page()
+{
+  u32 n = prog.page_len[prog.cur];
+
+  prog.step = n;
+  prog_submit(flash_cmd(prog.cmd_buf, flash_info.pp_opcode, prog.addr), n);
+
+  // Overlaps with sending this page and with its program time
+  prog_stage(prog.cur ^ 1, prog.addr + n);
+}
+
+// Erase the largest block that starts at prog.addr and fits
+static void
+prog_erase_block()
+{
+  const struct flash_erase_cmd *e;
+  int i;
+
+  if(prog.addr == 0 && prog.end >= flash_info.size) {
+    prog.cmd_buf[0] = FLASH_OP_BULK_ERASE;
+    prog.step = flash_info.size;
+    flash_cache_invalidate(0, prog.step);
+    prog_submit(1, 0);
+    return;
+  }
+
+  for(i=FLASH_NUM_ERASE_TYPES-1; i>=0; i--) {
+    e = &flash_info.erase[i];
+    if(e->opcode && !(prog.addr & ((1 << e->size_shift) - 1)) &&
+       prog.end - prog.addr >= (1 << e->size_shift)) {
+      break;
+    }
+  }
+  // Tail shorter than the smallest block: erase one more smallest block
+  if(i < 0) {
+    e = &flash_info.erase[0];
+  }
+
+  prog.step = 1 << e->size_shift;
+  flash_cache_invalidate(prog.addr, prog.step);
+  prog_submit(flash_cmd(prog.cmd_buf, e->opcode, prog.addr), 0);
+}
+
+// SPI callback with the status register
+static void
+prog_status(struct spi_xfer *xfer)
+{
+  if(xfer->count != xfer->len) {
+    prog_finish(-1);
+    return;
+  }
+  wdog_beat(&wdog_task);
+
+  // Still busy, or suspended since the read: ask again after the resume
+  if((prog.rdsr_buf[1] & FLASH_SR_WIP) || prog.suspended) {
+    prog_wait(FLASH_ERASE_POLL_MS);
+    return;
+  }
+
+  if(prog.state == PROG_PROGRAM) {
+    prog.src += prog.step;
+  }
+  prog.addr += prog.step;
+  if(prog.addr >= prog.end) {
+    prog_finish(0);
+    return;
+  }
+
+  if(prog.state == PROG_PROGRAM) {
+    prog.cur ^= 1;
+    prog_page();
+  } else {
+    prog_erase_block();
+  }
+}
+
+// Timeout: resume a suspended erase, and read the status register
+static void
+prog_poll(void *arg)
+{
+  if(prog.suspended) {
+    prog.resume_buf[0] = FLASH_OP_PER;
+    prog.resume.src = prog.resume.dst = prog.resume_buf;
+    prog.resume.len = 1;
+    prog.resume.opt = 0;
+    prog.resume.done = NULL;
+    submit_spi(&prog.resume);
+    prog.suspended = 0;
+    prog.resumed_us = timebase_us();
+  }
+
+  prog_rdsr(0);
+  submit_spi(&prog.rdsr);
+}
+
+int
+erase_flash(u32 addr, u32 len, flash_done_fn done, void *arg)
+{
+  u32 min_size = 1 << flash_info.erase[0].size_shift;
+
+  if(prog.state != PROG_IDLE || (addr & (min_size - 1))) {
+    return -1;
+  }
+
+  prog.state = PROG_ERASE;
+  prog.addr = addr;
+  prog.end = addr + len;
+  prog.done = done;
+  prog.arg = arg;
+
+  if(len == 0) {
+    prog_finish(0);
+    return 0;
+  }
+  prog_arm();
+  prog_erase_block();
+  return 0;
+}
+
+int
+program_flash(u32 addr, const u8 *src, u32 len,
+    flash_done_fn done, void *arg)
+{
+  if(prog.state != PROG_IDLE) {
+    return -1;
+  }
+
+  flash_cache_invalidate(addr, len);
+  prog.state = PROG_PROGRAM;
+  prog.addr = addr;
+  prog.end = addr + len;
+  prog.src = src;
+  prog.done = done;
+  prog.arg = arg;
+
+  if(len == 0) {
+    prog_finish(0);
+    return 0;
+  }
+  prog_arm();
+  prog.cur = 0;
+  prog_stage(0, addr);
+  prog_page();
+  return 0;
+}
+
+int
+flash_busy()
+{
+  return prog.state != PROG_IDLE;
+}
+
+int
+flash_suspend(u32 addr, u32 len)
+{
+  u8 buf[2];
+  u64 t;
+
+  if(prog.state == PROG_IDLE) {
+    return 0;
+  }
+  // The block being erased reads as nothing useful
+  if(prog.state != PROG_ERASE ||
+     (addr < prog.addr + prog.step && addr + len > prog.addr)) {
+    return -1;
+  }
+  if(prog.suspended) {
+    return 0;
+  }
+
+  // The erase command and status reads go out from the SPI queue
+  t = timebase_us();
+  while(spi_busy()) {
+    if(timebase_us() - t > FLASH_SUSPEND_US) {
+      return -1;
+    }
+  }
+  while(timebase_us() - prog.resumed_us < FLASH_RESUME_MIN_US) {
+  }
+
+  buf[0] = FLASH_OP_PES;
+  if(send_spi(buf, buf, 1, 0) != 1) {
+    return -1;
+  }
+  prog.suspended = 1;
+  prog.suspends++;
+  prog_wait(FLASH_RESUME_MS);
+
+  t = timebase_us();
+  do {
+    buf[0] = FLASH_OP_RDSR;
+    if(send_spi(buf, buf, 2, 0) != 2) {
+      return -1;
+    }
+    if(!(buf[1] & FLASH_SR_WIP)) {
+      return 0;
+    }
+  } while(timebase_us() - t <= FLASH_SUSPEND_US);
+  return -1;
+}
+
+u32
+flash_suspends()
+{
+  return prog.suspends;
+}
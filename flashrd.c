@@ -0,0 +1,259 @@
+// flashrd.c - Read-back of flash ranges over TCP (see flashrd.h).
+//
+// One connection is served at a time, through the same steps as wbblk.c:
+// the request is collected from received data and the read is pulled by
+// the send window (tcpsrc.h).  Each fill reads the flash straight into the
+// ring the segments reference, as much as the send buffer has room for in
+// one command, so the data leaves the SPI rx fifo for the ring and is
+// never copied again.  Requests that arrive while a read streams wait in
+// the received data (tcprx.h).
+
+#include "lwip/tcp.h"
+#include "netif/ethernetif.h"
+
+#include "bswap.h"
+#include "flash.h"
+#include "flashrd.h"
+#include "tcprx.h"
+#include "tcpsrc.h"
+#include "timebase.h"
+#include "timer.h"
+
+#define RD_REQ  (0) // collecting a request
+#define RD_READ (1) // streaming a read
+
+static struct {
+  struct tcp_pcb *pcb;
+  u8 state;
+  struct flashrd_req req;
+  u32 have;
+  // The reply header did not fit in the send buffer yet
+  u8 reply_pending;
+  struct flashrd_hdr hdr;
+  // Flash address and bytes left of the current read
+  u32 addr;
+  u32 left;
+  // timebase_ms() of the first read the part refused, while it refuses
+  u32 stall_ms;
+  struct tcprx rx;
+  struct tcpsrc tx;
+} rd;
+
+static err_t rd_input(struct tcp_pcb *pcb);
+static void rd_retry(void *arg);
+
+static struct timer retry_timer = TIMER_INIT(rd_retry, NULL);
+
+// Forget the connection and drop unconsumed data
+static void
+rd_reset()
+{
+  tcprx_free(&rd.rx);
+  timer_stop(&retry_timer);
+  rd.pcb = NULL;
+}
+
+// Close the connection, after anything queued has been sent.  Returns
+// what a callback must return.
+static err_t
+rd_close(struct tcp_pcb *pcb)
+{
+  err_t err = tcprx_close(&rd.rx, pcb);
+
+  rd_reset();
+  return err;
+}
+
+// Send the reply header, or leave it pending until there is room
+static void
+rd_reply(struct tcp_pcb *pcb)
+{
+  rd.reply_pending = tcpsrc_write(&rd.tx, &rd.hdr, sizeof(rd.hdr)) != 0;
+  if(!rd.reply_pending) {
+    tcp_output(pcb);
+  }
+}
+
+// Fill callback of a read: the next `len` bytes of it from the flash
+static u32
+rd_fill(void *dst, u32 len, void *arg)
+{
+  if(len > rd.left) {
+    len = rd.left;
+  }
+  if(len == 0) {
+    return 0;
+  }
+  if(read_flash(rd.addr, dst, len, FLASH_MODE_BEST) != len) {
+    // A program or erase holds the part: try again shortly
+    if(!timer_pending(&retry_timer)) {
+      rd.stall_ms = timebase_ms();
+      timer_start(&retry_timer, FLASHRD_RETRY_MS, FLASHRD_RETRY_MS);
+    }
+    return 0;
+  }
+  timer_stop(&retry_timer);
+  rd.addr += len;
+  rd.left -= len;
+  return len;
+}
+
+// Queue as much of the read as the send buffer takes, and go back to
+// received data once it is all queued
+static err_t
+rd_send(struct tcp_pcb *pcb)
+{
+  // The header goes first
+  if(rd.reply_pending) {
+    return ERR_OK;
+  }
+  tcpsrc_set_fill(&rd.tx, rd_fill, NULL);
+  tcpsrc_pump(&rd.tx);
+
+  if(rd.left) {
+    return ERR_OK;
+  }
+  tcpsrc_set_fill(&rd.tx, NULL, NULL);
+  rd.state = RD_REQ;
+  return rd_input(pcb);
+}
+
+// Timer, while the part refuses reads: pump again, or give up
+static void
+rd_retry(void *arg)
+{
+  struct tcp_pcb *pcb = rd.pcb;
+
+  if(!pcb || rd.state != RD_READ) {
+    timer_stop(&retry_timer);
+    return;
+  }
+  if(timebase_ms() - rd.stall_ms >= FLASHRD_STALL_MS) {
+    tcp_recv(pcb, NULL);
+    tcp_sent(pcb, NULL);
+    tcp_err(pcb, NULL);
+    rd_reset();
+    tcp_abort(pcb);
+    return;
+  }
+  rd_send(pcb);
+}
+
+// Check the request just collected and start on it.  Returns what a
+// callback must return.
+static err_t
+rd_start(struct tcp_pcb *pcb)
+{
+  u32 addr = swap32(rd.req.addr), len = swap32(rd.req.len);
+
+  rd.have = 0;
+  rd.hdr.status = FLASHRD_OK;
+  if(addr > flash_info.size) {
+    rd.hdr.status = FLASHRD_ERANGE;
+    len = 0;
+  } else if(len == FLASHRD_ALL) {
+    len = flash_info.size - addr;
+  } else if(len > flash_info.size - addr) {
+    rd.hdr.status = FLASHRD_ERANGE;
+    len = 0;
+  }
+  rd.hdr.addr = swap32(addr);
+  rd.hdr.len = swap32(len);
+  rd.addr = addr;
+  rd.left = len;
+
+  if(rd.hdr.status != FLASHRD_OK) {
+    rd_reply(pcb);
+    return rd_close(pcb);
+  }
+  rd.state = RD_READ;
+  rd_reply(pcb);
+  return rd_send(pcb);
+}
+
+// Consume received requests until they run out or a read has to stream.
+// Returns what a callback must return.
+static err_t
+rd_input(struct tcp_pcb *pcb)
+{
+  err_t err;
+
+  while(rd.state == RD_REQ && !rd.reply_pending && rd.rx.p) {
+    rd.have += tcprx_take(&rd.rx, pcb, (u8 *)&rd.req + rd.have,
+        sizeof(rd.req) - rd.have);
+    if(rd.have == sizeof(rd.req)) {
+      err = rd_start(pcb);
+      if(err != ERR_OK || !rd.pcb) {
+        return err;
+      }
+    }
+  }
+  return ERR_OK;
+}
+
+static err_t
+rd_recv(void *arg, struct tcp_pcb *pcb, struct pbuf *p, err_t err)
+{
+  if(!p) {
+    return rd_close(pcb);
+  }
+
+  tcprx_add(&rd.rx, p);
+  return rd_input(pcb);
+}
+
+static err_t
+rd_sent(void *arg, struct tcp_pcb *pcb, u16_t len)
+{
+  tcpsrc_sent(&rd.tx, len);
+  if(rd.reply_pending) {
+    rd_reply(pcb);
+  }
+  if(rd.state == RD_READ) {
+    return rd_send(pcb);
+  }
+  return rd_input(pcb);
+}
+
+static void
+rd_err(void *arg, err_t err)
+{
+  rd_reset();
+}
+
+static err_t
+rd_accept(void *arg, struct tcp_pcb *pcb, err_t err)
+{
+  if(err != ERR_OK || rd.pcb) {
+    return ERR_MEM;
+  }
+
+  pcb->tos = ETHERNETIF_TOS_BULK;
+  rd.pcb = pcb;
+  rd.state = RD_REQ;
+  rd.have = 0;
+  rd.reply_pending = 0;
+  tcprx_init(&rd.rx);
+  tcpsrc_init(&rd.tx, pcb, NULL, NULL);
+
+  tcp_recv(pcb, rd_recv);
+  tcp_sent(pcb, rd_sent);
+  tcp_err(pcb, rd_err);
+  return ERR_OK;
+}
+
+void
+init_flashrd()
+{
+  struct tcp_pcb *pcb;
+
+  if(!flash_info.size) {
+    return;
+  }
+  pcb = tcp_new();
+  if(!pcb || tcp_bind(pcb, IP_ADDR_ANY, FLASHRD_PORT) != ERR_OK) {
+    return;
+  }
+  pcb = tcp_listen(pcb);
+  tcp_accept(pcb, rd_accept);
+}
@@ -0,0 +1,47 @@
+#ifndef _FLASHRD_H_
+#define _FLASHRD_H_
+
+// flashrd.h - Read-back of flash ranges over TCP, for backups and audits.
+//
+// A connection to FLASHRD_PORT carries a sequence of requests, each a
+// struct flashrd_req.  The server answers each with a struct flashrd_hdr
+// (status and the length it will send filled in) followed by that many
+// bytes of the flash at `addr`, read in FLASH_MODE_BEST (flash.h).  A
+// `len` of FLASHRD_ALL reads to the end of the flash, so
+// "flashread.py <board> -o image.bin" (tools/flashread.py) takes all of it
+// without knowing its size.  The fields go big-endian.  A request outside
+// the flash is answered with FLASHRD_ERANGE and the connection closed.
+//
+// While a program or erase holds the part, reads wait for it and retry
+// every FLASHRD_RETRY_MS; if it is still held after FLASHRD_STALL_MS the
+// connection is reset, so a client never takes a short read for a whole
+// one.  TFTP reads ranges too, as "get flash.<addr>.<len>" (tftp.h).
+
+#include "xil_types.h"
+
+#define FLASHRD_PORT     (7014)
+
+#define FLASHRD_ALL      (0xffffffff)
+
+#define FLASHRD_OK       (0)
+#define FLASHRD_ERANGE   (1)
+
+#define FLASHRD_RETRY_MS (10)
+#define FLASHRD_STALL_MS (5000)
+
+struct flashrd_req {
+  u32 addr;
+  u32 len;
+};
+
+struct flashrd_hdr {
+  u8 status;
+  u8 pad[3];
+  u32 addr;
+  u32 len;
+};
+
+// Listen on FLASHRD_PORT.  Call after lwip_init() and init_flash().
+void init_flashrd();
+
+#endif // _FLASHRD_H_
@@ -0,0 +1,193 @@
+// flowctl.c - Pause the 10 GbE cores' data path when its receivers fall
+// behind (see flowctl.h).
+
+#include <string.h>
+
+#include "lwip/udp.h"
+#include "netif/ethernetif.h"
+
+#include "xil_io.h"
+
+#include "eth.h"
+#include "flowctl.h"
+#include "log.h"
+#include "timebase.h"
+#include "timer.h"
+#include "wbmap.h"
+#include "wbreg.h"
+
+struct flowctl_core {
+  // Bus addresses of the core's enable/port register and its overflow
+  // counter (0 for none), and the counter's last value
+  u32 enable;
+  u32 ofctr;
+  u32 last_of;
+  u8 present;
+  // Latest feedback, and timebase_ms() when it came
+  u8 fill;
+  u32 fill_ms;
+  // timebase_ms() of the pause under way
+  u32 paused_at;
+  struct flowctl_status st;
+};
+
+static struct flowctl_policy policy = {
+  1, FLOWCTL_DEFAULT_HIGH, FLOWCTL_DEFAULT_LOW, 0,
+  FLOWCTL_DEFAULT_PAUSE_MS, FLOWCTL_DEFAULT_STALE_MS
+};
+
+static struct flowctl_core cores[ETH_MAX_CORES];
+
+static struct udp_pcb *flowctl_pcb;
+
+// Set or clear core `c`'s data path enable bit
+static void
+flowctl_enable(struct flowctl_core *c, int on)
+{
+  u32 v = Xil_In32(c->enable);
+
+  Xil_Out32(c->enable, on ? v | ETH_MAC_ENABLE_FABRIC :
+      v & ~ETH_MAC_ENABLE_FABRIC);
+}
+
+static void
+flowctl_pause(struct flowctl_core *c, u32 n, u32 now)
+{
+  flowctl_enable(c, 0);
+  c->st.paused = 1;
+  c->st.pauses++;
+  c->paused_at = now;
+  LOG("flowctl: eth%u paused, fill %u", n, c->st.fill);
+}
+
+static void
+flowctl_resume(struct flowctl_core *c, u32 n, u32 now)
+{
+  flowctl_enable(c, 1);
+  c->st.paused = 0;
+  c->st.paused_ms += now - c->paused_at;
+  LOG("flowctl: eth%u resumed after %u ms", n, now - c->paused_at);
+}
+
+static void
+flowctl_poll(void *arg)
+{
+  struct flowctl_core *c;
+  u32 n, now = timebase_ms(), of;
+  int overflow;
+
+  if(!policy.enabled) {
+    return;
+  }
+  for(n=0; n<ETH_MAX_CORES; n++) {
+    c = &cores[n];
+    if(!c->present) {
+      continue;
+    }
+    c->st.fill = now - c->fill_ms < policy.stale_ms ? c->fill : 0;
+    overflow = 0;
+    if(c->ofctr) {
+      of = Xil_In32(c->ofctr);
+      overflow = of != c->last_of;
+      c->st.overflows += of - c->last_of;
+      c->last_of = of;
+    }
+    if(!c->st.paused) {
+      if(overflow || c->st.fill >= policy.high) {
+        flowctl_pause(c, n, now);
+      }
+    } else if(!overflow && c->st.fill <= policy.low &&
+        now - c->paused_at >= policy.min_pause_ms) {
+      flowctl_resume(c, n, now);
+    }
+  }
+}
+
+static struct timer poll_timer = TIMER_INIT(flowctl_poll, NULL);
+
+static void
+flowctl_recv(void *arg, struct udp_pcb *pcb, struct pbuf *p,
+    const ip_addr_t *addr, u16_t port)
+{
+  struct flowctl_fb fb;
+  struct flowctl_core *c;
+
+  if(pbuf_copy_partial(p, &fb, sizeof(fb), 0) == sizeof(fb) &&
+     fb.core < ETH_MAX_CORES && cores[fb.core].present) {
+    c = &cores[fb.core];
+    c->fill = fb.fill > 100 ? 100 : fb.fill;
+    c->fill_ms = timebase_ms();
+    // React now rather than at the next pass
+    flowctl_poll(NULL);
+  }
+  pbuf_free(p);
+}
+
+void
+flowctl_get_policy(struct flowctl_policy *p)
+{
+  *p = policy;
+}
+
+int
+flowctl_set_policy(const struct flowctl_policy *p)
+{
+  u32 n, now = timebase_ms();
+
+  if(p->high > 100 || p->low > p->high) {
+    return -1;
+  }
+  policy = *p;
+  policy.pad = 0;
+  if(!policy.enabled) {
+    for(n=0; n<ETH_MAX_CORES; n++) {
+      if(cores[n].st.paused) {
+        flowctl_resume(&cores[n], n, now);
+      }
+    }
+  }
+  return 0;
+}
+
+int
+flowctl_status(u32 n, struct flowctl_status *s)
+{
+  if(n >= ETH_MAX_CORES || !cores[n].present) {
+    return -1;
+  }
+  *s = cores[n].st;
+  return 0;
+}
+
+void
+init_flowctl()
+{
+  const struct wbmap_entry *e;
+  struct netif *netif;
+  struct flowctl_core *c;
+  char name[] = "eth0_txofctr";
+  u32 n;
+
+  for(netif = netif_list; netif; netif = netif->next) {
+    if(!ethernetif_is(netif)) {
+      continue;
+    }
+    n = ethernetif_core_num(netif);
+    c = &cores[n];
+    c->present = 1;
+    c->enable = ethernetif_base(netif) + ETH_MAC_REG_ENABLE_PORT;
+    name[3] = (char)('0' + n);
+    if((e = wbmap_find(name))) {
+      c->ofctr = WBREG_BASE + e->offset;
+      c->last_of = Xil_In32(c->ofctr);
+    }
+  }
+
+  flowctl_pcb = udp_new();
+  if(!flowctl_pcb ||
+     udp_bind(flowctl_pcb, IP_ADDR_ANY, FLOWCTL_PORT) != ERR_OK) {
+    return;
+  }
+  udp_recv(flowctl_pcb, flowctl_recv, NULL);
+  timer_start(&poll_timer, FLOWCTL_POLL_MS, FLOWCTL_POLL_MS);
+}
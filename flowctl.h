@@ -0,0 +1,82 @@
+#ifndef _FLOWCTL_H_
+#define _FLOWCTL_H_
+
+// flowctl.h - Pause the 10 GbE cores' data path when its receivers fall
+// behind.
+//
+// Every FLOWCTL_POLL_MS a control loop looks at each core's two sources of
+// back pressure: feedback datagrams from the collectors and the core's own
+// TX overflow counter.  A collector sends a struct flowctl_fb to
+// FLOWCTL_PORT whenever it likes, reporting how full its receive buffer
+// is.  The overflow counter is the device <core>_txofctr in the register
+// map (eth0_txofctr and so on), as CASPER's debug counters name it; a core
+// without one is steered by feedback alone.
+//
+// A core pauses, by clearing its data path's enable bit (eth.h), when the
+// fill reaches the high mark or the overflow counter moves.  It resumes
+// once it has been paused `min_pause_ms`, the fill is down to the low mark
+// and the counter has stayed put for a pass.  Feedback older than
+// `stale_ms` counts as empty, so a collector that stops reporting cannot
+// hold the stream off for good.  The marks and times are set at run time
+// with KATCP's ?flowctl (see katcp.h), and last until the next boot.
+//
+// The gateware keeps its own enable bit too: a paused core is enabled
+// again at resume even if the gateware had cleared it meanwhile, so an
+// application that gates its stream must do so upstream of the core.
+
+#include "xil_types.h"
+
+#define FLOWCTL_PORT    (7009)
+#define FLOWCTL_POLL_MS (10)
+
+// Default policy: marks in percent of the collector's buffer
+#define FLOWCTL_DEFAULT_HIGH     (90)
+#define FLOWCTL_DEFAULT_LOW      (50)
+#define FLOWCTL_DEFAULT_PAUSE_MS (20)
+#define FLOWCTL_DEFAULT_STALE_MS (1000)
+
+// Feedback datagram, big-endian
+struct flowctl_fb {
+  // Core the collector receives from (0 for eth0)
+  u8 core;
+  // How full its buffer is, in percent
+  u8 fill;
+  u16 pad;
+};
+
+struct flowctl_policy {
+  // Zero leaves every core running and the loop idle
+  u8 enabled;
+  u8 high;
+  u8 low;
+  u8 pad;
+  u32 min_pause_ms;
+  u32 stale_ms;
+};
+
+// A core's state, for ?flowctl
+struct flowctl_status {
+  u8 paused;
+  // Latest fill reported, 0 if stale or none
+  u8 fill;
+  // Pauses since boot, and the time spent paused
+  u32 pauses;
+  u32 paused_ms;
+  // Overflow counter increments seen
+  u32 overflows;
+};
+
+// Listen on FLOWCTL_PORT and start the loop.  Call after the netifs are
+// added.
+void init_flowctl();
+
+void flowctl_get_policy(struct flowctl_policy *p);
+
+// Set the policy, resuming every core if it disables the loop.  Returns 0,
+// or -1 if `low` is above `high` or `high` above 100.
+int flowctl_set_policy(const struct flowctl_policy *p);
+
+// State of core `n`.  Returns 0, or -1 if there is no such core.
+int flowctl_status(u32 n, struct flowctl_status *s);
+
+#endif // _FLOWCTL_H_
@@ -0,0 +1,43 @@
+// fmt.c - Fixed-point numbers for xil_printf() (see fmt.h).
+
+#include "fmt.h"
+
+static const u32 pow10[] = { 1, 10, 100, 1000 };
+
+char *
+fmt_fixed(char *buf, s32 v, u32 div, u32 places)
+{
+  u32 u = v < 0 ? -(u32)v : (u32)v;
+  u32 scale = pow10[places];
+  u32 q = u / div;
+  // r * scale fits: both are at most a million and a thousand
+  u32 frac = (u % div * scale + div / 2) / div;
+  char digits[10];
+  char *p = buf;
+  u32 n = 0;
+
+  if(frac == scale) {
+    q++;
+    frac = 0;
+  }
+  if(v < 0 && (q || frac)) {
+    *p++ = '-';
+  }
+  do {
+    digits[n++] = '0' + q % 10;
+    q /= 10;
+  } while(q);
+  while(n) {
+    *p++ = digits[--n];
+  }
+  if(places) {
+    *p++ = '.';
+    for(n=places; n; n--) {
+      p[n - 1] = '0' + frac % 10;
+      frac /= 10;
+    }
+    p += places;
+  }
+  *p = 0;
+  return buf;
+}
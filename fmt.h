@@ -0,0 +1,25 @@
+#ifndef _FMT_H_
+#define _FMT_H_
+
+// fmt.h - Fixed-point numbers for xil_printf().
+//
+// The firmware prints with xil_printf() and print() only: newlib's printf
+// would bring vfprintf, locale support and soft-float into BRAM (the
+// Makefile's STDIO_CHECK fails the link if it does).  xil_printf() has no
+// %f, so fractional quantities are kept as integers in small units and
+// formatted here into a buffer printed with %s, which keeps the field
+// widths working.
+
+#include "xil_types.h"
+
+// Longest fmt_fixed() result: sign, ten digits, point, terminator
+#define FMT_FIXED_MAX (16)
+
+// Write `v` / `div` into `buf` (FMT_FIXED_MAX bytes) with `places`
+// decimals, rounded half away from zero.  `div` is at most 1000000 and
+// `places` at most 3.
+//
+// Returns `buf`.
+char *fmt_fixed(char *buf, s32 v, u32 div, u32 places);
+
+#endif // _FMT_H_
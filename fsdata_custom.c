@@ -0,0 +1,23 @@
+// fsdata_custom.c - httpd's compiled-in files (HTTPD_USE_CUSTOM_FSDATA).
+//
+// Included by lwip/src/apps/httpd/fs.c rather than built on its own (see
+// the Makefile).  The pages themselves come from flash (webfs.h); this is
+// only the 404 answer for when the image has none.  fs.c has already
+// included fsdata.h.
+
+static const unsigned char data__404_html[] =
+  "/404.html\0"
+  "HTTP/1.1 404 File not found\r\n"
+  "Content-Length: 0\r\n"
+  "\r\n";
+
+const struct fsdata_file file__404_html[] = { {
+  NULL,
+  data__404_html,
+  data__404_html + sizeof("/404.html"),
+  sizeof(data__404_html) - 1 - sizeof("/404.html"),
+  FS_FILE_FLAGS_HEADER_INCLUDED | FS_FILE_FLAGS_HEADER_PERSISTENT,
+}};
+
+#define FS_ROOT file__404_html
+#define FS_NUMFILES 1
@@ -0,0 +1,335 @@
+// ftrace.c - Trace of eth0's frames in BRAM (see ftrace.h).
+//
+// Records hold the 64-bit timebase_cycles() of the driver's stamp, widened
+// as they are recorded, so a trace keeps its times however long it sits.
+// The export is served like pcprof.c's: one connection at a time, each
+// pcapng block built in `tx.blk` and queued as send buffer space frees
+// up.  All of it runs from the main loop, the driver's calls included.
+
+#include <string.h>
+
+#include "lwip/tcp.h"
+#include "netif/ethernetif.h"
+
+#include "xil_printf.h"
+
+#include "ftrace.h"
+#include "log.h"
+#include "sntpclock.h"
+#include "timebase.h"
+
+#define SHB_TYPE   (0x0a0d0d0a)
+#define SHB_MAGIC  (0x1a2b3c4d)
+#define IDB_TYPE   (1)
+#define EPB_TYPE   (6)
+#define LINKTYPE_ETHERNET (1)
+
+// Options: end, comment, if_name and epb_flags
+#define OPT_END     (0)
+#define OPT_COMMENT (1)
+#define OPT_IF_NAME (2)
+#define OPT_FLAGS   (2)
+// epb_flags directions
+#define FLAGS_INBOUND  (1)
+#define FLAGS_OUTBOUND (2)
+
+// Longest comment with its padding, and the largest block: an EPB of
+// seven words, the data, flags, a comment, the end and the length
+#define COMMENT_MAX (24)
+#define BLK_MAX (28 + FTRACE_SNAPLEN + 8 + 4 + COMMENT_MAX + 4 + 4)
+
+struct ftrace_rec {
+  u64 cycles;
+  u16 len;
+  u8 dir;
+  u8 reason;
+  u8 n;
+  u8 data[FTRACE_SNAPLEN];
+};
+
+u8 ftrace_mode;
+
+#if FTRACE_ENABLE
+
+static struct ftrace_rec ring[FTRACE_FRAMES];
+// Next slot to fill, and slots filled
+static u32 next;
+static u32 filled;
+static u32 recorded;
+static u32 missed;
+
+static const char *const reasons[] = {
+  NULL,
+  "drop: classifier rule",
+  "drop: multicast filter",
+  "drop: too long",
+  "drop: no memory",
+  "drop: TX queue full",
+};
+
+// Export in progress: blocks still to build (the headers, then
+// `tx.left` records from ring slot `tx.at` on) and the one being queued
+static struct {
+  struct tcp_pcb *pcb;
+  u8 headers;
+  u32 at;
+  u32 left;
+  u32 blk[BLK_MAX / 4];
+  u32 len;
+  u32 off;
+} tx;
+
+static struct ftrace_rec *
+ftrace_slot(u32 dir, u32 reason, u32 stamp, u32 len)
+{
+  struct ftrace_rec *r;
+
+  if(tx.pcb) {
+    missed++;
+    return NULL;
+  }
+  r = &ring[next];
+  next = (next + 1) % FTRACE_FRAMES;
+  if(filled < FTRACE_FRAMES) {
+    filled++;
+  }
+  recorded++;
+  r->cycles = timebase_widen(stamp);
+  r->len = len;
+  r->dir = dir;
+  r->reason = reason;
+  return r;
+}
+
+void
+ftrace_add(u32 dir, u32 reason, u32 stamp, u32 len, const u8 *head, u32 n)
+{
+  struct ftrace_rec *r = ftrace_slot(dir, reason, stamp, len);
+
+  if(r) {
+    r->n = n < FTRACE_SNAPLEN ? n : FTRACE_SNAPLEN;
+    memcpy(r->data, head, r->n);
+  }
+}
+
+void
+ftrace_add_pbuf(u32 dir, u32 reason, u32 stamp, struct pbuf *p, u32 off)
+{
+  struct ftrace_rec *r;
+
+  r = ftrace_slot(dir, reason, stamp, p->tot_len - off);
+  if(r) {
+    r->n = pbuf_copy_partial(p, r->data, FTRACE_SNAPLEN, off);
+  }
+}
+
+void
+ftrace_set_mode(u32 mode)
+{
+  ftrace_mode = mode <= FTRACE_ALL ? mode : FTRACE_OFF;
+}
+
+void
+ftrace_clear()
+{
+  next = 0;
+  filled = 0;
+  recorded = 0;
+  missed = 0;
+}
+
+void
+ftrace_stats(struct ftrace_stats *s)
+{
+  s->mode = ftrace_mode;
+  s->exporting = tx.pcb != NULL;
+  s->frames = filled;
+  s->recorded = recorded;
+  s->missed = missed;
+}
+
+// The section and interface headers
+static u32
+ftrace_headers(u32 *b)
+{
+  b[0] = SHB_TYPE;
+  b[1] = 28;
+  b[2] = SHB_MAGIC;
+  b[3] = 1; // version 1.0
+  b[4] = 0xffffffff; // section length unknown
+  b[5] = 0xffffffff;
+  b[6] = 28;
+  b[7] = IDB_TYPE;
+  b[8] = 32;
+  b[9] = LINKTYPE_ETHERNET;
+  b[10] = FTRACE_SNAPLEN;
+  b[11] = (4 << 16) | OPT_IF_NAME;
+  memcpy(&b[12], "eth0", 4);
+  b[13] = OPT_END;
+  b[14] = 32;
+  return 15 * 4;
+}
+
+// Record `r` as an Enhanced Packet Block
+static u32
+ftrace_epb(u32 *b, const struct ftrace_rec *r)
+{
+  u64 us = sntpclock_utc_us(r->cycles);
+  const char *why = r->reason < sizeof(reasons) / sizeof(reasons[0]) ?
+      reasons[r->reason] : NULL;
+  u32 n = 7, len;
+
+  if(!us) {
+    us = r->cycles / TIMEBASE_CYCLES_PER_US;
+  }
+  b[0] = EPB_TYPE;
+  b[2] = 0; // interface
+  b[3] = us >> 32;
+  b[4] = us;
+  b[5] = r->n;
+  b[6] = r->len;
+  memset(&b[n], 0, (r->n + 3) & ~3);
+  memcpy(&b[n], r->data, r->n);
+  n += (r->n + 3) >> 2;
+  b[n++] = (4 << 16) | OPT_FLAGS;
+  b[n++] = r->dir == FTRACE_RX ? FLAGS_INBOUND : FLAGS_OUTBOUND;
+  if(why) {
+    len = strlen(why);
+    b[n++] = (len << 16) | OPT_COMMENT;
+    memset(&b[n], 0, (len + 3) & ~3);
+    memcpy(&b[n], why, len);
+    n += (len + 3) >> 2;
+  }
+  b[n++] = OPT_END;
+  b[n] = (n + 1) * 4;
+  b[1] = b[n];
+  return b[n];
+}
+
+// Queue as much of the export as the send buffer takes, closing the
+// connection once all of it is queued
+static void
+ftrace_send(struct tcp_pcb *pcb)
+{
+  u32 n;
+
+  for(;;) {
+    if(tx.off == tx.len) {
+      if(tx.headers) {
+        tx.len = ftrace_headers(tx.blk);
+        tx.headers = 0;
+      } else if(tx.left) {
+        tx.len = ftrace_epb(tx.blk, &ring[tx.at]);
+        tx.at = (tx.at + 1) % FTRACE_FRAMES;
+        tx.left--;
+      } else {
+        break;
+      }
+      tx.off = 0;
+    }
+    n = tx.len - tx.off;
+    if(n > tcp_sndbuf(pcb)) {
+      n = tcp_sndbuf(pcb);
+    }
+    if(n == 0 || tcp_write(pcb, (const u8 *)tx.blk + tx.off, n,
+        TCP_WRITE_FLAG_COPY | TCP_WRITE_FLAG_MORE) != ERR_OK) {
+      break;
+    }
+    tx.off += n;
+  }
+  tcp_output(pcb);
+
+  if(tx.off == tx.len && !tx.headers && !tx.left &&
+     tcp_close(pcb) == ERR_OK) {
+    tcp_recv(pcb, NULL);
+    tcp_sent(pcb, NULL);
+    tcp_err(pcb, NULL);
+    tx.pcb = NULL;
+  }
+}
+
+static err_t
+ftrace_sent(void *arg, struct tcp_pcb *pcb, u16_t len)
+{
+  ftrace_send(pcb);
+  return ERR_OK;
+}
+
+static err_t
+ftrace_recv(void *arg, struct tcp_pcb *pcb, struct pbuf *p, err_t err)
+{
+  // Nothing is expected from the reader
+  if(p) {
+    tcp_recved(pcb, p->tot_len);
+    pbuf_free(p);
+  }
+  return ERR_OK;
+}
+
+static void
+ftrace_err(void *arg, err_t err)
+{
+  tx.pcb = NULL;
+}
+
+static err_t
+ftrace_accept(void *arg, struct tcp_pcb *pcb, err_t err)
+{
+  if(err != ERR_OK || tx.pcb) {
+    return ERR_MEM;
+  }
+
+  pcb->tos = ETHERNETIF_TOS_BULK;
+  tx.pcb = pcb;
+  tx.headers = 1;
+  tx.at = (next + FTRACE_FRAMES - filled) % FTRACE_FRAMES;
+  tx.left = filled;
+  tx.len = tx.off = 0;
+
+  LOG("ftrace: export of %d frames", filled);
+
+  tcp_arg(pcb, NULL);
+  tcp_recv(pcb, ftrace_recv);
+  tcp_sent(pcb, ftrace_sent);
+  tcp_err(pcb, ftrace_err);
+  ftrace_send(pcb);
+  return ERR_OK;
+}
+
+void
+init_ftrace()
+{
+  struct tcp_pcb *pcb = tcp_new();
+
+  if(!pcb || tcp_bind(pcb, IP_ADDR_ANY, FTRACE_PORT) != ERR_OK) {
+    xil_printf("ftrace: cannot bind port %d\n", FTRACE_PORT);
+    return;
+  }
+  pcb = tcp_listen(pcb);
+  tcp_accept(pcb, ftrace_accept);
+}
+
+#else // FTRACE_ENABLE
+
+void
+ftrace_set_mode(u32 mode)
+{
+}
+
+void
+ftrace_clear()
+{
+}
+
+void
+ftrace_stats(struct ftrace_stats *s)
+{
+  memset(s, 0, sizeof(*s));
+}
+
+void
+init_ftrace()
+{
+}
+
+#endif // FTRACE_ENABLE
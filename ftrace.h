@@ -0,0 +1,92 @@
+#ifndef _FTRACE_H_
+#define _FTRACE_H_
+
+// ftrace.h - Trace of eth0's frames in BRAM, exported as pcapng.
+//
+// While tracing, eth0's driver records the frames it handles in a ring of
+// the last FTRACE_FRAMES: the first FTRACE_SNAPLEN bytes of each, its
+// length, its direction, when the driver had it (timebase_stamp(), as
+// ethernetif.h's driver stamps) and what became of it: passed to the
+// stack or handed to the core, or dropped and why.  Frames dropped in the
+// core are read from it for the trace, so a drop costs the bytes traced
+// and nothing is allocated.  In FTRACE_ALL mode every frame in and out is
+// recorded; in FTRACE_RULES mode only received frames matching an RX
+// classifier rule that has `trace` set (ethernetif_set_rx_rule(), KATCP's
+// ?rx-rule), so a trace can be narrowed to one flow and kept for longer.
+// Tracing starts off, and KATCP's ?ftrace (katcp.h) sets the mode.
+//
+// Connecting to TCP port FTRACE_PORT fetches the ring, oldest first, as a
+// pcapng stream that Wireshark or tcpdump read as they are (nc board 7010
+// | wireshark -k -i -).  The section is little-endian; each frame is an
+// Enhanced Packet Block with its direction in epb_flags and, for a drop,
+// the reason as a comment.  Times are UTC once the wall clock is set
+// (sntpclock.h), time since boot before that.  Recording pauses during an
+// export, counting the frames it misses, and the ring is kept until
+// ?ftrace clear.
+//
+// Built with FTRACE_ENABLE 0 (make CFLAGS=-DFTRACE_ENABLE=0) the ring, the
+// export and the driver's calls are left out, and the mode stays off.
+
+#include "lwip/pbuf.h"
+
+#include "xil_types.h"
+
+#ifndef FTRACE_ENABLE
+#define FTRACE_ENABLE (1)
+#endif
+
+#define FTRACE_PORT    (7010)
+
+// Frames kept, and bytes of each
+#define FTRACE_FRAMES  (32)
+#define FTRACE_SNAPLEN (64)
+
+// Modes
+#define FTRACE_OFF   (0)
+#define FTRACE_RULES (1) // received frames of rules with `trace` set
+#define FTRACE_ALL   (2) // every frame in and out
+
+// Directions
+#define FTRACE_RX (0)
+#define FTRACE_TX (1)
+
+// What became of a frame
+#define FTRACE_PASSED      (0) // to the stack, or to the core to send
+#define FTRACE_DROP_RULE   (1) // a classifier rule dropped it
+#define FTRACE_DROP_MCAST  (2) // to a multicast group nothing joined
+#define FTRACE_DROP_LEN    (3) // longer than the core's buffer
+#define FTRACE_DROP_NOMEM  (4) // no pbuf came in time
+#define FTRACE_DROP_TXFULL (5) // the TX queue was full
+
+struct ftrace_stats {
+  u8 mode;
+  // An export is in progress
+  u8 exporting;
+  // Frames in the ring, recorded since the last clear and missed during
+  // exports
+  u32 frames;
+  u32 recorded;
+  u32 missed;
+};
+
+// Mode now, for the driver's checks
+extern u8 ftrace_mode;
+
+// Serve the ring on FTRACE_PORT.  Call after lwip_init().
+void init_ftrace();
+
+void ftrace_set_mode(u32 mode);
+void ftrace_clear();
+
+// Record a frame of `len` bytes in direction `dir` with fate `reason`,
+// stamped `stamp`, whose first `n` bytes are at `head`
+void ftrace_add(u32 dir, u32 reason, u32 stamp, u32 len, const u8 *head,
+    u32 n);
+
+// As ftrace_add(), for the frame in `p` from byte `off` on
+void ftrace_add_pbuf(u32 dir, u32 reason, u32 stamp, struct pbuf *p,
+    u32 off);
+
+void ftrace_stats(struct ftrace_stats *s);
+
+#endif // _FTRACE_H_
@@ -0,0 +1,70 @@
+// gwrev.c - The gateware's revision, and the driver routines bound for it
+// (see gwrev.h).
+
+#include "xil_io.h"
+#include "xil_printf.h"
+
+#include "ethbuf.h"
+#include "gwrev.h"
+#include "wbmap.h"
+#include "wbreg.h"
+
+static const struct gwrev_eth eth_v0 = {
+  ethbuf_read_swap,
+  ethbuf_read_swap_h,
+  ethbuf_write_swap,
+  ethbuf_write_swap_h,
+};
+
+static const struct gwrev_snap snap_v0 = {
+  ethbuf_read_swap,
+  0,
+};
+
+// By revision, oldest first
+static const struct {
+  u32 since;
+  const struct gwrev_eth *eth;
+  const struct gwrev_snap *snap;
+} revs[] = {
+  { 0, &eth_v0, &snap_v0 },
+};
+
+#define NUM_REVS (sizeof(revs) / sizeof(revs[0]))
+
+const struct gwrev_eth *gwrev_eth = &eth_v0;
+const struct gwrev_snap *gwrev_snap = &snap_v0;
+
+static u32 rev;
+static u32 row;
+
+void
+init_gwrev()
+{
+  const struct wbmap_entry *e = wbmap_find("sys_rev");
+  u32 i;
+
+  rev = 0;
+  if(e && (e->mode & WBMAP_MODE_R)) {
+    rev = Xil_In32(WBREG_BASE + e->offset);
+  }
+  row = 0;
+  for(i=1; i<NUM_REVS && revs[i].since <= rev; i++) {
+    row = i;
+  }
+  gwrev_eth = revs[row].eth;
+  gwrev_snap = revs[row].snap;
+}
+
+u32
+gwrev()
+{
+  return rev;
+}
+
+void
+dump_gwrev()
+{
+  xil_printf("Gateware: revision %08x, drivers since %08x\n", rev,
+      revs[row].since);
+}
@@ -0,0 +1,50 @@
+#ifndef _GWREV_H_
+#define _GWREV_H_
+
+// gwrev.h - The gateware's revision, and the driver routines bound for it.
+//
+// The revision is the first word of the sys_rev device (wbmap.h), 0 where
+// the gateware has none, read once by init_gwrev().  Drivers whose cores
+// differ between revisions take their routines from a table per
+// subsystem, picked for the revision at the same time: the last row of
+// gwrev.c's list whose `since` is at or below it.  Hot paths then call
+// through `gwrev_eth` and the rest, or use the offsets there, with no test
+// of the revision of their own.  A core that changes gets a new row from
+// the revision it changed in, quoting the routines of the row before for
+// the subsystems that did not.
+//
+// The tables stay put once bound, so callers may keep a routine or
+// offset from them.
+
+#include "xil_types.h"
+
+// eth0 and the other 10 GbE cores' buffers, as ethbuf.h's routines
+struct gwrev_eth {
+  void (*read_swap)(u32 *dst, u32 src, u32 nwords);
+  void (*read_swap_h)(u16 *dst, u32 src, u32 nwords);
+  void (*write_swap)(u32 dst, const u32 *src, u32 nwords);
+  void (*write_swap_h)(u32 dst, const u16 *src, u32 nwords);
+};
+
+// Snapshot blocks (snap.h)
+struct gwrev_snap {
+  // BRAM words to big-endian bytes
+  void (*read_bram)(u32 *dst, u32 src, u32 nwords);
+  // Offset of the captured-bytes word in the status device
+  u32 status_off;
+};
+
+extern const struct gwrev_eth *gwrev_eth;
+extern const struct gwrev_snap *gwrev_snap;
+
+// Read the revision and bind the tables.  Call after init_wbmap(), before
+// eth0 has a frame to move.
+void init_gwrev();
+
+// The revision init_gwrev() read
+u32 gwrev();
+
+// Print the revision and the row bound
+void dump_gwrev();
+
+#endif // _GWREV_H_
@@ -0,0 +1,91 @@
+// heatshrink.c - Streaming decoder for heatshrink-compressed images (see
+// heatshrink.h).
+
+#include <string.h>
+
+#include "heatshrink.h"
+
+#define HS_TAG     (0) // next is a tag bit
+#define HS_LITERAL (1) // an 8-bit literal
+#define HS_INDEX   (2) // a back-reference's offset
+#define HS_COUNT   (3) // its length
+#define HS_COPY    (4) // copying it out
+
+void
+hs_init(struct hs_dec *d)
+{
+  memset(d, 0, sizeof(*d));
+}
+
+// Take `n` bits of input into `*v`.  Returns 0, or -1 once the input is
+// used up, with the bits kept for the next call.
+static int
+get_bits(struct hs_dec *d, const u8 **in, u32 *in_len, u32 n, u32 *v)
+{
+  while(d->nbits < n) {
+    if(!*in_len) {
+      return -1;
+    }
+    d->acc = (d->acc << 8) | *(*in)++;
+    (*in_len)--;
+    d->nbits += 8;
+  }
+  d->nbits -= n;
+  *v = (d->acc >> d->nbits) & ((1 << n) - 1);
+  return 0;
+}
+
+// Add `c` to the output and the window
+static void
+put(struct hs_dec *d, u8 c, u8 *out, u32 *n)
+{
+  out[(*n)++] = c;
+  d->window[d->head++ & (HS_WINDOW - 1)] = c;
+}
+
+u32
+hs_decode(struct hs_dec *d, const u8 **in, u32 *in_len, u8 *out,
+    u32 out_len)
+{
+  u32 n = 0, v;
+
+  while(n < out_len) {
+    switch(d->state) {
+    case HS_TAG:
+      if(get_bits(d, in, in_len, 1, &v) != 0) {
+        return n;
+      }
+      d->state = v ? HS_LITERAL : HS_INDEX;
+      break;
+    case HS_LITERAL:
+      if(get_bits(d, in, in_len, 8, &v) != 0) {
+        return n;
+      }
+      put(d, v, out, &n);
+      d->state = HS_TAG;
+      break;
+    case HS_INDEX:
+      if(get_bits(d, in, in_len, HS_WINDOW_BITS, &v) != 0) {
+        return n;
+      }
+      d->index = v + 1;
+      d->state = HS_COUNT;
+      break;
+    case HS_COUNT:
+      if(get_bits(d, in, in_len, HS_COUNT_BITS, &v) != 0) {
+        return n;
+      }
+      d->count = v + 1;
+      d->state = HS_COPY;
+      break;
+    case HS_COPY:
+      // One byte at a time, so a reference may overlap its own output
+      put(d, d->window[(d->head - d->index) & (HS_WINDOW - 1)], out, &n);
+      if(--d->count == 0) {
+        d->state = HS_TAG;
+      }
+      break;
+    }
+  }
+  return n;
+}
@@ -0,0 +1,43 @@
+#ifndef _HEATSHRINK_H_
+#define _HEATSHRINK_H_
+
+// heatshrink.h - Streaming decoder for heatshrink-compressed images.
+//
+// heatshrink is LZSS with a bit-packed output: a 1 bit and an 8-bit
+// literal, or a 0 bit, a HS_WINDOW_BITS back-reference offset and a
+// HS_COUNT_BITS length, each less one, all MSB first.  The decoder keeps
+// the last 2^HS_WINDOW_BITS bytes it produced as the window, and nothing
+// else, so it can be fed input and drained of output in pieces of any size.
+// Images are compressed to match with "heatshrink -e -w 8 -l 7", or with
+// tools/hsencode.py.
+
+#include "xil_types.h"
+
+#define HS_WINDOW_BITS (8)
+#define HS_COUNT_BITS  (7)
+#define HS_WINDOW      (1 << HS_WINDOW_BITS)
+
+struct hs_dec {
+  u8 window[HS_WINDOW];
+  u32 head;
+  // Input bits not used yet, the low `nbits` of `acc`
+  u32 acc;
+  u8 nbits;
+  u8 state;
+  // Back-reference being decoded or copied
+  u16 index;
+  u16 count;
+};
+
+// Start a new stream
+void hs_init(struct hs_dec *d);
+
+// Decode from `*in` (`*in_len` bytes, both advanced past what was used)
+// into up to `out_len` bytes at `out`.  Stops when `out` is full or the
+// input runs out, in which case the next call carries on from there.
+//
+// Returns the number of bytes written to `out`.
+u32 hs_decode(struct hs_dec *d, const u8 **in, u32 *in_len, u8 *out,
+    u32 out_len);
+
+#endif // _HEATSHRINK_H_
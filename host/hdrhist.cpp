@@ -0,0 +1,92 @@
+// hdrhist.cpp - Latency histograms with a fixed relative precision (see
+// hdrhist.h).
+
+#include "hdrhist.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace jam {
+
+namespace {
+
+const uint64_t SUB = 1ull << Histogram::SUB_BITS;
+const uint64_t HALF = SUB / 2;
+// Exact buckets, then HALF for each power of two above them
+const size_t BUCKETS = SUB + (64 - Histogram::SUB_BITS) * HALF;
+
+} // namespace
+
+Histogram::Histogram()
+  : counts_(BUCKETS)
+{
+}
+
+size_t Histogram::index(uint64_t value)
+{
+  if(value < SUB) {
+    return value;
+  }
+  unsigned shift = 63 - __builtin_clzll(value) - (SUB_BITS - 1);
+  // In [HALF, SUB)
+  uint64_t sub = value >> shift;
+  return SUB + (shift - 1) * HALF + (sub - HALF);
+}
+
+uint64_t Histogram::highest(size_t i)
+{
+  if(i < SUB) {
+    return i;
+  }
+  unsigned shift = (i - SUB) / HALF + 1;
+  uint64_t sub = (i - SUB) % HALF + HALF;
+  return ((sub + 1) << shift) - 1;
+}
+
+void Histogram::record(uint64_t value)
+{
+  counts_[index(value)]++;
+  count_++;
+  min_ = std::min(min_, value);
+  max_ = std::max(max_, value);
+  sum_ += value;
+}
+
+void Histogram::merge(const Histogram &h)
+{
+  for(size_t i=0; i<BUCKETS; i++) {
+    counts_[i] += h.counts_[i];
+  }
+  count_ += h.count_;
+  min_ = std::min(min_, h.min_);
+  max_ = std::max(max_, h.max_);
+  sum_ += h.sum_;
+}
+
+void Histogram::reset()
+{
+  std::fill(counts_.begin(), counts_.end(), 0);
+  count_ = 0;
+  min_ = UINT64_MAX;
+  max_ = 0;
+  sum_ = 0;
+}
+
+uint64_t Histogram::percentile(double pct) const
+{
+  if(!count_) {
+    return 0;
+  }
+  uint64_t want = (uint64_t)std::ceil(count_ * std::min(pct, 100.0) / 100);
+  uint64_t seen = 0;
+  want = std::max<uint64_t>(want, 1);
+  for(size_t i=0; i<BUCKETS; i++) {
+    seen += counts_[i];
+    if(seen >= want) {
+      return std::min(highest(i), max_);
+    }
+  }
+  return max_;
+}
+
+} // namespace jam
@@ -0,0 +1,54 @@
+#ifndef _HDRHIST_H_
+#define _HDRHIST_H_
+
+// hdrhist.h - Latency histograms with a fixed relative precision, after
+// HdrHistogram.
+//
+// Values below 2^Histogram::SUB_BITS are counted exactly.  Above that each
+// power of two is split into 2^(SUB_BITS - 1) equal buckets, so a value
+// is known to within 1 part in 128 whatever its size, in a fixed 60 KiB
+// of counts.  Recording costs a few instructions and no allocation, so a
+// histogram can take every sample of a run, and percentiles come from
+// the whole distribution rather than a sample of it.  Histograms of the
+// same run on several boards or threads merge by adding their counts.
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace jam {
+
+class Histogram {
+ public:
+  static const unsigned SUB_BITS = 8;
+
+  Histogram();
+
+  void record(uint64_t value);
+  void merge(const Histogram &h);
+  void reset();
+
+  uint64_t count() const { return count_; }
+  uint64_t min() const { return count_ ? min_ : 0; }
+  uint64_t max() const { return max_; }
+  double mean() const { return count_ ? (double)sum_ / count_ : 0; }
+  // The value that `pct` percent of those recorded are at or below, to the
+  // top of its bucket; 0 when empty
+  uint64_t percentile(double pct) const;
+
+ private:
+  static size_t index(uint64_t value);
+  // The highest value counted in bucket `i`
+  static uint64_t highest(size_t i);
+
+  std::vector<uint64_t> counts_;
+  uint64_t count_ = 0;
+  uint64_t min_ = UINT64_MAX;
+  uint64_t max_ = 0;
+  // Wraps only past 2^64 ns in all, some 584 years
+  uint64_t sum_ = 0;
+};
+
+} // namespace jam
+
+#endif // _HDRHIST_H_
@@ -0,0 +1,821 @@
+// jambench.cpp - Load generator and latency benchmark for the boards'
+// network services.
+//
+// usage: jambench [options] board [board ...]
+//
+//   -r, --rate N        register requests a second to each board (1000)
+//   -t, --time S        seconds to run (10)
+//   -m, --mix R:W:B     weights of single-word reads, single-word writes
+//                       and bulk reads in those requests (1:0:0)
+//   --addr A            byte address of the registers read and written (0)
+//   --span N            words from there to spread them over (64)
+//   --bulk-addr A       where bulk reads start (0)
+//   --bulk-words N      words per bulk read (256)
+//   --watch A[:MS[:M]]  watch the register at A, reporting at most every MS
+//                       (100) the bits M (all); repeatable, for as long as
+//                       the benchmark runs
+//   --ping N            ICMP echo requests a second to each board (0)
+//   --sweep             find the highest --rate at which the register
+//                       requests' p99 stays under --p99-us with none
+//                       failing, starting from --rate, then run there
+//   --p99-us N          the sweep's bound (1000)
+//   --step S            seconds per sweep step (2)
+//   --window N, --retries N
+//                       as jamclient.h's Options
+//   --port N            the boards' register port (7000)
+//   --seed N            of the addresses picked (1)
+//   --no-perf           do not touch the boards' perf.h counts
+//
+// Requests go out on a fixed schedule, whether or not the ones before
+// them have been answered, and each one's latency runs from the moment it
+// was due, so a board that falls behind shows it in the percentiles
+// rather than by quietly being offered less load.  Every latency goes
+// into an hdrhist.h histogram.  Loss is what the client retransmitted
+// and what failed after every retransmit, and for pings those that never
+// came back.
+//
+// Unless --no-perf, the boards' perf.h counts are zeroed before the run
+// and fetched after it, and each board's time in its wbreg handler set
+// beside the latency seen here: the difference is the network, the stack
+// and this host.  Writes go where --addr says, so point it at scratch
+// registers before adding writes to the mix.
+
+#include "hdrhist.h"
+#include "jamclient.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <getopt.h>
+#include <netdb.h>
+#include <netinet/ip_icmp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace jam;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+const int PERF_BUCKETS = 32;
+const char *const PERF_SITES[] = {
+  "spi", "eth-tx", "chksum", "wbreg", "tick-latency", "tick-jitter",
+};
+const size_t PERF_WBREG = 3;
+// Where a sweep gives up doubling
+const double MAX_RATE = 1e7;
+// Pings still out this long after a run are lost
+const auto PING_GRACE = std::chrono::seconds(1);
+
+struct Watch {
+  uint32_t addr;
+  uint32_t period_ms;
+  uint32_t mask;
+};
+
+struct Config {
+  double rate = 1000;
+  double seconds = 10;
+  unsigned mix[3] = { 1, 0, 0 };
+  uint32_t addr = 0;
+  uint32_t span = 64;
+  uint32_t bulk_addr = 0;
+  uint32_t bulk_words = 256;
+  std::vector<Watch> watches;
+  double ping_rate = 0;
+  bool sweep = false;
+  double p99_us = 1000;
+  double step = 2;
+  Options opts;
+  uint16_t port = WBREG_PORT;
+  unsigned seed = 1;
+  bool perf = true;
+  std::vector<std::string> boards;
+};
+
+enum { K_READ, K_WRITE, K_BULK, K_PING, NUM_KINDS };
+const char *const KIND_NAMES[NUM_KINDS] = { "read", "write", "bulk", "ping" };
+
+struct Kind {
+  Histogram lat;
+  uint64_t done = 0;
+  uint64_t failed = 0;
+};
+
+struct Result {
+  double rate = 0;
+  double seconds = 0;
+  Kind kinds[NUM_KINDS];
+  Stats stats;
+  uint64_t pings = 0;
+  uint64_t notifies = 0;
+  uint64_t notify_gaps = 0;
+
+  // The register requests together
+  Histogram regs() const
+  {
+    Histogram h;
+    for(int k=K_READ; k<=K_BULK; k++) {
+      h.merge(kinds[k].lat);
+    }
+    return h;
+  }
+
+  uint64_t reg_failed() const
+  {
+    return kinds[K_READ].failed + kinds[K_WRITE].failed +
+           kinds[K_BULK].failed;
+  }
+};
+
+// ICMP echo through the kernel's unprivileged ping sockets, which fill in
+// the identifier and checksum
+class Pinger {
+ public:
+  explicit Pinger(const std::vector<std::string> &boards)
+  {
+    fd_ = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, IPPROTO_ICMP);
+    for(const std::string &b : boards) {
+      struct addrinfo hints, *res;
+      sockaddr_in sin;
+      std::memset(&hints, 0, sizeof(hints));
+      std::memset(&sin, 0, sizeof(sin));
+      hints.ai_family = AF_INET;
+      if(getaddrinfo(b.c_str(), nullptr, &hints, &res) == 0) {
+        std::memcpy(&sin, res->ai_addr, sizeof(sin));
+        freeaddrinfo(res);
+      }
+      addrs_.push_back(sin);
+    }
+  }
+
+  ~Pinger()
+  {
+    if(fd_ >= 0) {
+      close(fd_);
+    }
+  }
+
+  int fd() const { return fd_; }
+  size_t outstanding() const { return out_.size(); }
+
+  void send(size_t board, Clock::time_point due)
+  {
+    struct icmphdr h;
+    std::memset(&h, 0, sizeof(h));
+    h.type = ICMP_ECHO;
+    h.un.echo.sequence = htons(seq_);
+    out_[seq_] = std::make_pair(board, due);
+    seq_++;
+    sendto(fd_, &h, sizeof(h), 0, (const sockaddr *)&addrs_[board],
+           sizeof(addrs_[board]));
+  }
+
+  // Answers arrived, into `k`
+  void receive(Kind &k)
+  {
+    uint8_t buf[1500];
+    for(;;) {
+      sockaddr_in from;
+      socklen_t fromlen = sizeof(from);
+      ssize_t len = recvfrom(fd_, buf, sizeof(buf), 0, (sockaddr *)&from,
+                             &fromlen);
+      if(len < 0) {
+        if(errno == EINTR) {
+          continue;
+        }
+        break;
+      }
+      struct icmphdr h;
+      if((size_t)len < sizeof(h)) {
+        continue;
+      }
+      std::memcpy(&h, buf, sizeof(h));
+      auto it = out_.find(ntohs(h.un.echo.sequence));
+      if(h.type != ICMP_ECHOREPLY || it == out_.end() ||
+         addrs_[it->second.first].sin_addr.s_addr != from.sin_addr.s_addr) {
+        continue;
+      }
+      k.lat.record(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                       Clock::now() - it->second.second).count());
+      k.done++;
+      out_.erase(it);
+    }
+  }
+
+  // Give up on those still out, as lost
+  void expire(Kind &k)
+  {
+    k.failed += out_.size();
+    out_.clear();
+  }
+
+ private:
+  int fd_;
+  std::vector<sockaddr_in> addrs_;
+  uint16_t seq_ = 0;
+  std::map<uint16_t, std::pair<size_t, Clock::time_point>> out_;
+};
+
+class Bench {
+ public:
+  Bench(const Config &cfg, Client &c, Pinger *p)
+    : cfg_(cfg), c_(c), pinger_(p), rng_(cfg.seed),
+      last_seq_(c.boards(), 0), seen_(c.boards(), false)
+  {
+    c_.on_notify([this](int board, uint32_t seq, const uint32_t *,
+                        size_t) {
+      notifies_++;
+      if(seen_[board] && seq > last_seq_[board] + 1) {
+        gaps_ += seq - last_seq_[board] - 1;
+      }
+      seen_[board] = true;
+      last_seq_[board] = seq;
+    });
+  }
+
+  // Offer `rate` register requests a second to each board for `seconds`
+  Result run(double rate, double seconds)
+  {
+    Result res;
+    Stats before = c_.stats();
+    uint64_t notifies = notifies_, gaps = gaps_;
+    size_t nb = c_.boards();
+    auto start = Clock::now();
+    auto end = start + to_ns(seconds);
+    auto period = to_ns(1 / rate);
+    auto ping_period = cfg_.ping_rate > 0 ? to_ns(1 / cfg_.ping_rate)
+                                          : Clock::duration::max();
+    std::vector<Clock::time_point> next(nb), next_ping(nb);
+
+    res.rate = rate;
+    cur_ = &res;
+    // Staggered, so that the boards' requests do not go out together
+    for(size_t b=0; b<nb; b++) {
+      next[b] = start + period * b / nb;
+      next_ping[b] = pinger_ ? start + ping_period / 2 : end;
+    }
+
+    for(;;) {
+      auto now = Clock::now();
+      for(size_t b=0; b<nb; b++) {
+        for(; next[b] <= now && next[b] < end; next[b] += period) {
+          issue(b, next[b]);
+        }
+        for(; next_ping[b] <= now && next_ping[b] < end;
+            next_ping[b] += ping_period) {
+          pinger_->send(b, next_ping[b]);
+          res.pings++;
+        }
+      }
+      c_.poll(0);
+      if(pinger_) {
+        pinger_->receive(res.kinds[K_PING]);
+      }
+
+      if(now >= end && !c_.pending() &&
+         (!pinger_ || !pinger_->outstanding() || now >= end + PING_GRACE)) {
+        break;
+      }
+      auto wake = now >= end ? end + PING_GRACE : end;
+      for(size_t b=0; b<nb; b++) {
+        wake = std::min({wake, next[b], next_ping[b]});
+      }
+      int ms = c_.next_timeout_ms();
+      if(ms >= 0) {
+        wake = std::min(wake, now + std::chrono::milliseconds(ms));
+      }
+      wait(std::max(wake - Clock::now(), Clock::duration::zero()));
+    }
+    if(pinger_) {
+      pinger_->expire(res.kinds[K_PING]);
+    }
+
+    const Stats &after = c_.stats();
+    res.seconds = seconds;
+    res.stats.sent = after.sent - before.sent;
+    res.stats.batches = after.batches - before.batches;
+    res.stats.batched = after.batched - before.batched;
+    res.stats.retransmits = after.retransmits - before.retransmits;
+    res.stats.timeouts = after.timeouts - before.timeouts;
+    res.stats.replies = after.replies - before.replies;
+    res.stats.stale = after.stale - before.stale;
+    res.notifies = notifies_ - notifies;
+    res.notify_gaps = gaps_ - gaps;
+    cur_ = nullptr;
+    return res;
+  }
+
+ private:
+  static Clock::duration to_ns(double s)
+  {
+    return std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double>(s));
+  }
+
+  void wait(Clock::duration d)
+  {
+    struct pollfd pfd[2] = {
+      { c_.fd(), POLLIN, 0 },
+      { pinger_ ? pinger_->fd() : -1, POLLIN, 0 },
+    };
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(d);
+    struct timespec ts = { (time_t)(ns.count() / 1000000000),
+                           (long)(ns.count() % 1000000000) };
+    ppoll(pfd, 2, &ts, nullptr);
+  }
+
+  // The next kind of request, weighted by the mix but spread evenly
+  // through it, so runs repeat
+  int pick()
+  {
+    unsigned total = 0;
+    int best = 0;
+    for(int k=0; k<3; k++) {
+      credit_[k] += cfg_.mix[k];
+      total += cfg_.mix[k];
+      if(credit_[k] > credit_[best]) {
+        best = k;
+      }
+    }
+    credit_[best] -= total;
+    return best;
+  }
+
+  void issue(size_t b, Clock::time_point due)
+  {
+    int kind = pick();
+    Result *res = cur_;
+    auto done = [res, kind, due](int status) {
+      Kind &k = res->kinds[kind];
+      if(status != ST_OK) {
+        k.failed++;
+        return;
+      }
+      k.done++;
+      k.lat.record(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                       Clock::now() - due).count());
+    };
+    uint32_t addr = cfg_.addr + rng_() % cfg_.span * 4;
+
+    switch(kind) {
+    case K_READ:
+      c_.read_word(b, addr, [done](int s, uint32_t) { done(s); });
+      break;
+    case K_WRITE:
+      c_.write_word(b, addr, value_++, done);
+      break;
+    case K_BULK:
+      c_.read(b, cfg_.bulk_addr, cfg_.bulk_words,
+              [done](int s, const uint32_t *, size_t) { done(s); });
+      break;
+    }
+  }
+
+  const Config &cfg_;
+  Client &c_;
+  Pinger *pinger_;
+  std::mt19937 rng_;
+  int credit_[3] = { 0, 0, 0 };
+  uint32_t value_ = 0;
+  Result *cur_ = nullptr;
+  uint64_t notifies_ = 0, gaps_ = 0;
+  std::vector<uint32_t> last_seq_;
+  std::vector<bool> seen_;
+};
+
+struct PerfSite {
+  uint32_t count, min, max;
+  uint64_t sum;
+  uint32_t hist[PERF_BUCKETS];
+
+  // Cycles that `pct` percent of the passes took at most, to the top of
+  // their log2 bucket
+  uint64_t percentile(double pct) const
+  {
+    uint64_t want = (uint64_t)(count * pct / 100 + 0.5), seen = 0;
+    for(int b=0; b<PERF_BUCKETS; b++) {
+      seen += hist[b];
+      if(seen >= std::max<uint64_t>(want, 1)) {
+        return std::min<uint64_t>((2ull << b) - 1, max);
+      }
+    }
+    return max;
+  }
+};
+
+struct Perf {
+  int status = -1;
+  uint32_t hz = 0;
+  std::vector<PerfSite> sites;
+};
+
+// Each board's perf.h counts, zeroing them once read with `clear`
+std::vector<Perf> fetch_perf(Client &c, bool clear)
+{
+  std::vector<Perf> perf(c.boards());
+  for(size_t b=0; b<c.boards(); b++) {
+    Perf *p = &perf[b];
+    c.call(b, OP_PERF, 0, clear, nullptr, 0,
+           [p](int status, uint16_t count, uint32_t addr,
+               const uint32_t *w, size_t n) {
+             const size_t words = 5 + PERF_BUCKETS;
+             p->status = status;
+             p->hz = addr;
+             for(size_t i=0; i<count && (i + 1) * words <= n; i++) {
+               const uint32_t *s = w + i * words;
+               PerfSite site;
+               site.count = s[0];
+               site.min = s[1];
+               site.max = s[2];
+               site.sum = (uint64_t)s[3] << 32 | s[4];
+               std::copy(s + 5, s + words, site.hist);
+               p->sites.push_back(site);
+             }
+           }, !clear);
+  }
+  c.run();
+  return perf;
+}
+
+double us(uint64_t ns)
+{
+  return ns / 1000.0;
+}
+
+void print_result(const Config &cfg, const Result &r)
+{
+  std::printf("offered %.0f req/s to each of %zu boards for %.1f s\n",
+              r.rate, cfg.boards.size(), r.seconds);
+  std::printf("%-6s %10s %8s %9s %9s %9s %9s %9s\n", "kind", "ops",
+              "failed", "p50 us", "p90 us", "p99 us", "p99.9 us", "max us");
+  for(int k=0; k<NUM_KINDS; k++) {
+    const Kind &kd = r.kinds[k];
+    if(!kd.done && !kd.failed) {
+      continue;
+    }
+    std::printf("%-6s %10llu %8llu %9.1f %9.1f %9.1f %9.1f %9.1f\n",
+                KIND_NAMES[k], (unsigned long long)kd.done,
+                (unsigned long long)kd.failed, us(kd.lat.percentile(50)),
+                us(kd.lat.percentile(90)), us(kd.lat.percentile(99)),
+                us(kd.lat.percentile(99.9)), us(kd.lat.max()));
+  }
+  uint64_t regs = r.regs().count();
+  std::printf("achieved %.0f req/s per board; %llu datagrams, %llu of "
+              "them batches of %.1f\n",
+              regs / r.seconds / cfg.boards.size(),
+              (unsigned long long)r.stats.sent,
+              (unsigned long long)r.stats.batches,
+              r.stats.batches ? (double)r.stats.batched / r.stats.batches
+                              : 0.0);
+  std::printf("loss: %llu retransmits (%.3f%%), %llu timed out, %llu stale "
+              "replies\n",
+              (unsigned long long)r.stats.retransmits,
+              r.stats.sent ? 100.0 * r.stats.retransmits / r.stats.sent : 0,
+              (unsigned long long)r.stats.timeouts,
+              (unsigned long long)r.stats.stale);
+  if(r.pings) {
+    std::printf("pings: %llu sent, %llu lost (%.3f%%)\n",
+                (unsigned long long)r.pings,
+                (unsigned long long)r.kinds[K_PING].failed,
+                100.0 * r.kinds[K_PING].failed / r.pings);
+  }
+  if(!cfg.watches.empty()) {
+    std::printf("watches: %llu notifications, %llu lost\n",
+                (unsigned long long)r.notifies,
+                (unsigned long long)r.notify_gaps);
+  }
+}
+
+void print_perf(const Config &cfg, const Result &r,
+                const std::vector<Perf> &perf)
+{
+  uint64_t host_p99 = r.regs().percentile(99);
+
+  for(size_t b=0; b<perf.size(); b++) {
+    const Perf &p = perf[b];
+    if(p.status != ST_OK || !p.hz) {
+      std::printf("%s: no perf counts (%s)\n", cfg.boards[b].c_str(),
+                  status_name(p.status));
+      continue;
+    }
+    double cyc_us = 1e6 / p.hz;
+    std::printf("%s: perf.h counts over the run\n", cfg.boards[b].c_str());
+    std::printf("  %-12s %10s %9s %9s %9s\n", "site", "passes", "mean us",
+                "p99 us", "max us");
+    for(size_t i=0; i<p.sites.size(); i++) {
+      const PerfSite &s = p.sites[i];
+      const char *name = i < sizeof(PERF_SITES) / sizeof(PERF_SITES[0])
+                             ? PERF_SITES[i] : "?";
+      if(!s.count) {
+        std::printf("  %-12s %10u %9s %9s %9s\n", name, 0, "-", "-", "-");
+        continue;
+      }
+      std::printf("  %-12s %10u %9.1f %9.1f %9.1f\n", name, s.count,
+                  (double)s.sum / s.count * cyc_us,
+                  s.percentile(99) * cyc_us, s.max * cyc_us);
+    }
+    if(p.sites.size() > PERF_WBREG && p.sites[PERF_WBREG].count &&
+       host_p99) {
+      double board = p.sites[PERF_WBREG].percentile(99) * cyc_us;
+      std::printf("  p99: %.1f us here, %.1f us of it at most in wbreg, "
+                  "%.1f us the network, stack and host\n",
+                  us(host_p99), board, std::max(0.0, us(host_p99) - board));
+    }
+  }
+}
+
+bool good(const Config &cfg, const Result &r)
+{
+  Histogram h = r.regs();
+  return h.count() && !r.reg_failed() &&
+         us(h.percentile(99)) < cfg.p99_us;
+}
+
+// The highest rate that keeps good(), to within 5%
+double sweep(const Config &cfg, Bench &bench)
+{
+  double lo = 0, hi = 0, rate = cfg.rate;
+
+  for(;;) {
+    Result r = bench.run(rate, cfg.step);
+    bool ok = good(cfg, r);
+    std::printf("sweep: %.0f req/s, p99 %.1f us, %llu failed: %s\n", rate,
+                us(r.regs().percentile(99)),
+                (unsigned long long)r.reg_failed(), ok ? "ok" : "over");
+    std::fflush(stdout);
+    if(ok) {
+      lo = rate;
+    } else {
+      hi = rate;
+    }
+    if(!hi && rate >= MAX_RATE) {
+      return lo;
+    }
+    if(!hi) {
+      rate *= 2;
+    } else if(hi - lo <= std::max(hi * 0.05, 1.0)) {
+      return lo;
+    } else {
+      rate = (lo + hi) / 2;
+    }
+  }
+}
+
+bool parse_u32(const char *s, uint32_t *v)
+{
+  char *end;
+  errno = 0;
+  unsigned long n = std::strtoul(s, &end, 0);
+  if(errno || end == s || (*end && *end != ':') || n > 0xffffffffu) {
+    return false;
+  }
+  *v = n;
+  return true;
+}
+
+bool parse_mix(const char *s, unsigned mix[3])
+{
+  return std::sscanf(s, "%u:%u:%u", &mix[0], &mix[1], &mix[2]) == 3 &&
+         mix[0] + mix[1] + mix[2] > 0;
+}
+
+bool parse_watch(const char *s, Watch *w)
+{
+  const char *p;
+  w->period_ms = 100;
+  w->mask = 0xffffffff;
+  if(!parse_u32(s, &w->addr)) {
+    return false;
+  }
+  if((p = std::strchr(s, ':'))) {
+    if(!parse_u32(p + 1, &w->period_ms)) {
+      return false;
+    }
+    if((p = std::strchr(p + 1, ':')) && !parse_u32(p + 1, &w->mask)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+[[noreturn]] void usage()
+{
+  std::fprintf(stderr,
+      "usage: jambench [-r rate] [-t seconds] [-m R:W:B] [--addr A] "
+      "[--span N]\n"
+      "                [--bulk-addr A] [--bulk-words N] "
+      "[--watch A[:MS[:M]]] ...\n"
+      "                [--ping N] [--sweep] [--p99-us N] [--step S]\n"
+      "                [--window N] [--retries N] [--port N] [--seed N] "
+      "[--no-perf]\n"
+      "                board [board ...]\n");
+  std::exit(2);
+}
+
+Config parse(int argc, char **argv)
+{
+  enum {
+    O_ADDR = 256, O_SPAN, O_BULK_ADDR, O_BULK_WORDS, O_WATCH, O_PING,
+    O_SWEEP, O_P99, O_STEP, O_WINDOW, O_RETRIES, O_PORT, O_SEED, O_NO_PERF,
+  };
+  static const struct option longopts[] = {
+    { "rate", required_argument, nullptr, 'r' },
+    { "time", required_argument, nullptr, 't' },
+    { "mix", required_argument, nullptr, 'm' },
+    { "addr", required_argument, nullptr, O_ADDR },
+    { "span", required_argument, nullptr, O_SPAN },
+    { "bulk-addr", required_argument, nullptr, O_BULK_ADDR },
+    { "bulk-words", required_argument, nullptr, O_BULK_WORDS },
+    { "watch", required_argument, nullptr, O_WATCH },
+    { "ping", required_argument, nullptr, O_PING },
+    { "sweep", no_argument, nullptr, O_SWEEP },
+    { "p99-us", required_argument, nullptr, O_P99 },
+    { "step", required_argument, nullptr, O_STEP },
+    { "window", required_argument, nullptr, O_WINDOW },
+    { "retries", required_argument, nullptr, O_RETRIES },
+    { "port", required_argument, nullptr, O_PORT },
+    { "seed", required_argument, nullptr, O_SEED },
+    { "no-perf", no_argument, nullptr, O_NO_PERF },
+    { nullptr, 0, nullptr, 0 },
+  };
+  Config cfg;
+  uint32_t v;
+  Watch w;
+  int opt;
+
+  while((opt = getopt_long(argc, argv, "r:t:m:", longopts, nullptr)) != -1) {
+    bool ok = true;
+    switch(opt) {
+    case 'r':
+      ok = (cfg.rate = std::atof(optarg)) > 0;
+      break;
+    case 't':
+      ok = (cfg.seconds = std::atof(optarg)) > 0;
+      break;
+    case 'm':
+      ok = parse_mix(optarg, cfg.mix);
+      break;
+    case O_ADDR:
+      ok = parse_u32(optarg, &cfg.addr) && !(cfg.addr & 3);
+      break;
+    case O_SPAN:
+      ok = parse_u32(optarg, &cfg.span) && cfg.span;
+      break;
+    case O_BULK_ADDR:
+      ok = parse_u32(optarg, &cfg.bulk_addr) && !(cfg.bulk_addr & 3);
+      break;
+    case O_BULK_WORDS:
+      ok = parse_u32(optarg, &cfg.bulk_words) && cfg.bulk_words;
+      break;
+    case O_WATCH:
+      ok = parse_watch(optarg, &w) && !(w.addr & 3);
+      cfg.watches.push_back(w);
+      break;
+    case O_PING:
+      ok = (cfg.ping_rate = std::atof(optarg)) >= 0;
+      break;
+    case O_SWEEP:
+      cfg.sweep = true;
+      break;
+    case O_P99:
+      ok = (cfg.p99_us = std::atof(optarg)) > 0;
+      break;
+    case O_STEP:
+      ok = (cfg.step = std::atof(optarg)) > 0;
+      break;
+    case O_WINDOW:
+      ok = parse_u32(optarg, &v) && v;
+      cfg.opts.window = v;
+      break;
+    case O_RETRIES:
+      ok = parse_u32(optarg, &v);
+      cfg.opts.retries = v;
+      break;
+    case O_PORT:
+      ok = parse_u32(optarg, &v) && v && v < 65536;
+      cfg.port = v;
+      break;
+    case O_SEED:
+      ok = parse_u32(optarg, &v);
+      cfg.seed = v;
+      break;
+    case O_NO_PERF:
+      cfg.perf = false;
+      break;
+    default:
+      ok = false;
+      break;
+    }
+    if(!ok) {
+      usage();
+    }
+  }
+  for(int i=optind; i<argc; i++) {
+    cfg.boards.push_back(argv[i]);
+  }
+  if(cfg.boards.empty()) {
+    usage();
+  }
+  return cfg;
+}
+
+void set_watches(const Config &cfg, Client &c, bool on)
+{
+  for(size_t b=0; b<c.boards(); b++) {
+    for(const Watch &w : cfg.watches) {
+      std::string board = cfg.boards[b];
+      uint32_t addr = w.addr;
+      auto done = [board, addr, on](int status, uint16_t, uint32_t,
+                                    const uint32_t *, size_t) {
+        if(status != ST_OK) {
+          std::fprintf(stderr, "%s: %s 0x%x: %s\n", board.c_str(),
+                       on ? "watch" : "unwatch", addr, status_name(status));
+        }
+      };
+      if(on) {
+        c.call(b, OP_WATCH, w.period_ms, w.addr, &w.mask, 1, done);
+      } else {
+        c.call(b, OP_UNWATCH, 0, w.addr, nullptr, 0, done);
+      }
+    }
+  }
+  c.run();
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+  Config cfg = parse(argc, argv);
+  Client c(cfg.opts);
+
+  for(const std::string &b : cfg.boards) {
+    if(c.add_board(b, cfg.port) < 0) {
+      std::fprintf(stderr, "%s: unknown host\n", b.c_str());
+      return 1;
+    }
+  }
+  if(c.boards() != cfg.boards.size()) {
+    std::fprintf(stderr, "a board is named twice\n");
+    return 1;
+  }
+
+  std::unique_ptr<Pinger> pinger;
+  if(cfg.ping_rate > 0) {
+    pinger.reset(new Pinger(cfg.boards));
+    if(pinger->fd() < 0) {
+      std::fprintf(stderr, "pings: no ICMP socket (%s; see "
+                   "net.ipv4.ping_group_range), left out\n",
+                   std::strerror(errno));
+      pinger.reset();
+    }
+  }
+
+  Bench bench(cfg, c, pinger.get());
+  set_watches(cfg, c, true);
+
+  double rate = cfg.rate;
+  if(cfg.sweep) {
+    rate = sweep(cfg, bench);
+    if(!rate) {
+      std::printf("capacity: none, p99 is over %.0f us at any rate tried\n",
+                  cfg.p99_us);
+      set_watches(cfg, c, false);
+      return 1;
+    }
+  }
+
+  if(cfg.perf) {
+    fetch_perf(c, true);
+  }
+  Result r = bench.run(rate, cfg.seconds);
+  std::vector<Perf> perf;
+  if(cfg.perf) {
+    perf = fetch_perf(c, false);
+  }
+  set_watches(cfg, c, false);
+
+  print_result(cfg, r);
+  if(cfg.perf) {
+    print_perf(cfg, r, perf);
+  }
+  if(cfg.sweep) {
+    std::printf("capacity: %.0f req/s per board at p99 < %.0f us (%s)\n",
+                rate, cfg.p99_us,
+                good(cfg, r) ? "confirmed" : "not held over the full run");
+  }
+  return 0;
+}
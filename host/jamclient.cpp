@@ -0,0 +1,525 @@
+// jamclient.cpp - Host library for the boards' UDP register protocol (see
+// jamclient.h).
+
+#include "jamclient.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <random>
+#include <system_error>
+
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace jam {
+
+namespace {
+
+const size_t HDR_BYTES = 12;
+const size_t ENTRY_BYTES = 16;
+// The largest datagram taken, jumbo frames included
+const size_t RX_MAX = 9000;
+
+void put32(std::vector<uint8_t> &p, uint32_t v)
+{
+  p.push_back(v >> 24);
+  p.push_back(v >> 16);
+  p.push_back(v >> 8);
+  p.push_back(v);
+}
+
+void put16(std::vector<uint8_t> &p, uint16_t v)
+{
+  p.push_back(v >> 8);
+  p.push_back(v);
+}
+
+uint32_t get32(const uint8_t *p)
+{
+  return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 |
+         p[3];
+}
+
+std::vector<uint8_t> header(uint32_t id, uint8_t op, uint16_t count,
+                            uint32_t addr)
+{
+  std::vector<uint8_t> p;
+  p.reserve(HDR_BYTES);
+  put32(p, id);
+  p.push_back(op);
+  p.push_back(0);
+  put16(p, count);
+  put32(p, addr);
+  return p;
+}
+
+} // namespace
+
+const char *status_name(int status)
+{
+  static const char *const board[] = {
+    "ok", "bad opcode", "bad address", "bad length", "wait timed out",
+    "no such entry", "no space", "duplicate", "bus error", "bad time",
+  };
+
+  if(status >= 0 && status < (int)(sizeof(board) / sizeof(board[0]))) {
+    return board[status];
+  }
+  switch(status) {
+  case ST_TIMEOUT:
+    return "no reply";
+  case ST_NOTRUN:
+    return "not run";
+  case ST_SHORT:
+    return "short reply";
+  }
+  return "unknown status";
+}
+
+Client::Client(const Options &opts)
+  : opts_(opts)
+{
+  int size = 1 << 20;
+
+  fd_ = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if(fd_ < 0) {
+    throw std::system_error(errno, std::generic_category(), "socket");
+  }
+  // A window of replies from every board may arrive between polls
+  setsockopt(fd_, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+  opts_.window = std::max(opts_.window, 1u);
+  opts_.batch_max = std::min(std::max(opts_.batch_max, 1u),
+                             (unsigned)(WBREG_CACHE_BYTES - HDR_BYTES) / 4);
+  opts_.max_words = std::min(std::max(opts_.max_words, 1u), 0xffffu);
+}
+
+Client::~Client()
+{
+  close(fd_);
+}
+
+int Client::add_board(const std::string &host, uint16_t port)
+{
+  static std::random_device rd;
+  struct addrinfo hints, *res;
+  std::memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_DGRAM;
+  if(getaddrinfo(host.c_str(), nullptr, &hints, &res) != 0) {
+    return -1;
+  }
+  sockaddr_in sin;
+  std::memcpy(&sin, res->ai_addr, sizeof(sin));
+  freeaddrinfo(res);
+  sin.sin_port = htons(port);
+
+  auto key = std::make_pair((uint32_t)sin.sin_addr.s_addr, port);
+  auto it = by_addr_.find(key);
+  if(it != by_addr_.end()) {
+    return it->second;
+  }
+  boards_.emplace_back();
+  Board &b = boards_.back();
+  b.addr = sin;
+  // Not the ids of an earlier run, which the board may still have cached
+  b.next_id = rd();
+  by_addr_[key] = boards_.size() - 1;
+  return boards_.size() - 1;
+}
+
+void Client::read(int board, uint32_t addr, uint32_t count, ReadFn done,
+                  bool noinc)
+{
+  struct Gather {
+    std::vector<uint32_t> words;
+    size_t left = 0;
+    // Part of the first failure, and its status
+    size_t failed = SIZE_MAX;
+    int status = ST_OK;
+    ReadFn done;
+  };
+  auto g = std::make_shared<Gather>();
+  g->words.resize(count);
+  g->done = std::move(done);
+  g->left = count ? (count + opts_.max_words - 1) / opts_.max_words : 1;
+
+  uint8_t op = OP_READ | (noinc ? OP_NOINC : 0);
+  size_t part = 0;
+  uint32_t off = 0;
+  do {
+    uint32_t n = std::min(count - off, opts_.max_words);
+    auto r = std::make_unique<Request>();
+    r->pkt = header(0, op, n, noinc ? addr : addr + off * 4);
+    r->done = [g, part, off, n](int status, uint16_t, uint32_t,
+                                const uint32_t *words, size_t got) {
+      if(status == ST_OK && got < n) {
+        status = ST_SHORT;
+      }
+      if(status == ST_OK) {
+        std::copy(words, words + n, g->words.begin() + off);
+      } else if(part < g->failed) {
+        g->failed = part;
+        g->status = status;
+      }
+      if(--g->left == 0 && g->done) {
+        if(g->status == ST_OK) {
+          g->done(ST_OK, g->words.data(), g->words.size());
+        } else {
+          g->done(g->status, nullptr, 0);
+        }
+      }
+    };
+    submit(board, std::move(r));
+    part++;
+    off += n;
+  } while(off < count);
+}
+
+void Client::write(int board, uint32_t addr, const uint32_t *words,
+                   uint32_t count, DoneFn done, bool noinc)
+{
+  struct Gather {
+    size_t left = 0;
+    size_t failed = SIZE_MAX;
+    int status = ST_OK;
+    DoneFn done;
+  };
+  auto g = std::make_shared<Gather>();
+  g->done = std::move(done);
+  g->left = count ? (count + opts_.max_words - 1) / opts_.max_words : 1;
+
+  uint8_t op = OP_WRITE | (noinc ? OP_NOINC : 0);
+  size_t part = 0;
+  uint32_t off = 0;
+  do {
+    uint32_t n = std::min(count - off, opts_.max_words);
+    auto r = std::make_unique<Request>();
+    r->pkt = header(0, op, n, noinc ? addr : addr + off * 4);
+    r->pkt.reserve(HDR_BYTES + n * 4);
+    for(uint32_t i=0; i<n; i++) {
+      put32(r->pkt, words[off + i]);
+    }
+    r->replayable = false;
+    r->done = [g, part](int status, uint16_t, uint32_t, const uint32_t *,
+                        size_t) {
+      if(status != ST_OK && part < g->failed) {
+        g->failed = part;
+        g->status = status;
+      }
+      if(--g->left == 0 && g->done) {
+        g->done(g->status);
+      }
+    };
+    submit(board, std::move(r));
+    part++;
+    off += n;
+  } while(off < count);
+}
+
+void Client::read_word(int board, uint32_t addr, WordFn done)
+{
+  add_entry(board, Entry{B_READ, addr, 0, 0, std::move(done)});
+}
+
+void Client::write_word(int board, uint32_t addr, uint32_t value, DoneFn done)
+{
+  WordFn fn;
+  if(done) {
+    fn = [done](int status, uint32_t) { done(status); };
+  }
+  add_entry(board, Entry{B_WRITE, addr, value, 0, std::move(fn)});
+}
+
+void Client::rmw(int board, uint32_t addr, uint32_t value, uint32_t mask,
+                 WordFn done)
+{
+  add_entry(board, Entry{B_RMW, addr, value, mask, std::move(done)});
+}
+
+void Client::call(int board, uint8_t op, uint16_t count, uint32_t addr,
+                  const uint32_t *data, size_t n, CallFn done,
+                  bool replayable)
+{
+  auto r = std::make_unique<Request>();
+  r->pkt = header(0, op, count, addr);
+  for(size_t i=0; i<n; i++) {
+    put32(r->pkt, data[i]);
+  }
+  r->replayable = replayable;
+  r->done = std::move(done);
+  submit(board, std::move(r));
+}
+
+void Client::submit(int board, std::unique_ptr<Request> r)
+{
+  Board &b = boards_.at(board);
+  r->id = b.next_id++;
+  r->pkt[0] = r->id >> 24;
+  r->pkt[1] = r->id >> 16;
+  r->pkt[2] = r->id >> 8;
+  r->pkt[3] = r->id;
+  b.queue.push_back(std::move(r));
+}
+
+void Client::add_entry(int board, Entry e)
+{
+  Board &b = boards_.at(board);
+  b.batch.push_back(std::move(e));
+  if(b.batch.size() >= opts_.batch_max) {
+    flush_batch(board);
+  }
+}
+
+void Client::flush_batch(int board)
+{
+  Board &b = boards_[board];
+  if(b.batch.empty()) {
+    return;
+  }
+  auto entries = std::make_shared<std::vector<Entry>>();
+  entries->swap(b.batch);
+
+  auto r = std::make_unique<Request>();
+  r->pkt = header(0, OP_BATCH, entries->size(), 0);
+  r->pkt.reserve(HDR_BYTES + entries->size() * ENTRY_BYTES);
+  for(const Entry &e : *entries) {
+    r->pkt.push_back(e.op);
+    r->pkt.push_back(0);
+    put16(r->pkt, 0);
+    put32(r->pkt, e.addr);
+    put32(r->pkt, e.value);
+    put32(r->pkt, e.mask);
+    if(e.op != B_READ) {
+      r->replayable = false;
+    }
+  }
+  r->done = [entries](int status, uint16_t count, uint32_t,
+                      const uint32_t *words, size_t n) {
+    for(size_t i=0; i<entries->size(); i++) {
+      const Entry &e = (*entries)[i];
+      int s;
+      if(status >= ST_TIMEOUT) {
+        // Not answered at all
+        s = status;
+      } else if(status == ST_OK || i < count) {
+        s = i < n ? ST_OK : ST_SHORT;
+      } else {
+        s = i == count ? status : ST_NOTRUN;
+      }
+      if(e.done) {
+        e.done(s, s == ST_OK ? words[i] : 0);
+      }
+    }
+  };
+  submit(board, std::move(r));
+}
+
+bool Client::may_send(const Board &b, const Request &r) const
+{
+  if(b.flight.size() >= opts_.window) {
+    return false;
+  }
+  // The board remembers its last WBREG_CACHE replies.  Those of requests
+  // in flight when a write went, and of requests sent since, may all come
+  // after the write's, so they and it must fit.
+  if(!r.replayable && b.flight.size() >= WBREG_CACHE) {
+    return false;
+  }
+  for(const auto &kv : b.flight) {
+    const Request &f = *kv.second;
+    if(!f.replayable && f.before + (b.seq - f.seq) + 1 > WBREG_CACHE) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void Client::send_queued(int board)
+{
+  Board &b = boards_[board];
+  while(!b.queue.empty() && may_send(b, *b.queue.front())) {
+    std::unique_ptr<Request> r = std::move(b.queue.front());
+    b.queue.pop_front();
+    r->seq = b.seq++;
+    r->before = b.flight.size();
+    r->rto = opts_.rto;
+    stats_.sent++;
+    if(r->pkt[4] == OP_BATCH) {
+      stats_.batches++;
+      stats_.batched += (r->pkt.size() - HDR_BYTES) / ENTRY_BYTES;
+    }
+    transmit(b, *r);
+    b.flight[r->id] = std::move(r);
+  }
+}
+
+void Client::transmit(Board &b, Request &r)
+{
+  // A send that fails (a full socket buffer) is left to the retransmit
+  sendto(fd_, r.pkt.data(), r.pkt.size(), 0, (const sockaddr *)&b.addr,
+         sizeof(b.addr));
+  r.deadline = Clock::now() + r.rto;
+}
+
+int Client::receive()
+{
+  uint8_t buf[RX_MAX];
+  uint32_t words[RX_MAX / 4];
+  int taken = 0;
+
+  for(;;) {
+    sockaddr_in from;
+    socklen_t fromlen = sizeof(from);
+    ssize_t len = recvfrom(fd_, buf, sizeof(buf), 0, (sockaddr *)&from,
+                           &fromlen);
+    if(len < 0) {
+      if(errno == EINTR) {
+        continue;
+      }
+      // EAGAIN, or an ICMP error from a board that is down, which its
+      // requests' timeouts catch
+      if(errno == EAGAIN || errno == EWOULDBLOCK) {
+        break;
+      }
+      continue;
+    }
+    if((size_t)len < HDR_BYTES) {
+      continue;
+    }
+    auto it = by_addr_.find(std::make_pair((uint32_t)from.sin_addr.s_addr,
+                                           ntohs(from.sin_port)));
+    if(it == by_addr_.end()) {
+      stats_.stale++;
+      continue;
+    }
+    Board &b = boards_[it->second];
+    size_t n = (len - HDR_BYTES) / 4;
+    for(size_t i=0; i<n; i++) {
+      words[i] = get32(buf + HDR_BYTES + i * 4);
+    }
+    if(buf[4] == OP_NOTIFY) {
+      if(notify_) {
+        notify_(it->second, get32(buf), words, n);
+      }
+      continue;
+    }
+    auto f = b.flight.find(get32(buf));
+    if(f == b.flight.end()) {
+      stats_.stale++;
+      continue;
+    }
+    std::unique_ptr<Request> r = std::move(f->second);
+    b.flight.erase(f);
+    stats_.replies++;
+    taken++;
+    finish(b, std::move(r), buf[5], (uint16_t)(buf[6] << 8 | buf[7]),
+           get32(buf + 8), words, n);
+  }
+  return taken;
+}
+
+void Client::retransmit()
+{
+  Clock::time_point now = Clock::now();
+  std::vector<std::pair<Board *, std::unique_ptr<Request>>> dead;
+
+  for(Board &b : boards_) {
+    for(auto it = b.flight.begin(); it != b.flight.end(); ) {
+      Request &r = *it->second;
+      if(r.deadline > now) {
+        ++it;
+      } else if(r.tries >= opts_.retries) {
+        dead.emplace_back(&b, std::move(it->second));
+        it = b.flight.erase(it);
+      } else {
+        r.tries++;
+        r.rto = std::min(r.rto * 2, opts_.rto_max);
+        stats_.retransmits++;
+        transmit(b, r);
+        ++it;
+      }
+    }
+  }
+  // Out of the loop, as callbacks may queue more
+  for(auto &d : dead) {
+    stats_.timeouts++;
+    finish(*d.first, std::move(d.second), ST_TIMEOUT, 0, 0, nullptr, 0);
+  }
+}
+
+void Client::finish(Board &, std::unique_ptr<Request> r, int status,
+                    uint16_t count, uint32_t addr, const uint32_t *words,
+                    size_t n)
+{
+  if(r->done) {
+    r->done(status, count, addr, words, n);
+  }
+}
+
+int Client::poll(int timeout_ms)
+{
+  for(size_t i=0; i<boards_.size(); i++) {
+    flush_batch(i);
+    send_queued(i);
+  }
+
+  int next = next_timeout_ms();
+  int wait = timeout_ms;
+  // No longer than to the next retransmit, and not at all for -1 with
+  // nothing in flight
+  if(wait < 0 || (next >= 0 && next < wait)) {
+    wait = next < 0 ? 0 : next;
+  }
+  struct pollfd pfd = { fd_, POLLIN, 0 };
+  ::poll(&pfd, 1, wait);
+
+  int taken = receive();
+  retransmit();
+  // Into the room the replies left, with what their callbacks queued
+  for(size_t i=0; i<boards_.size(); i++) {
+    flush_batch(i);
+    send_queued(i);
+  }
+  return taken;
+}
+
+void Client::run()
+{
+  while(pending()) {
+    poll(-1);
+  }
+}
+
+size_t Client::pending() const
+{
+  size_t n = 0;
+  for(const Board &b : boards_) {
+    n += b.queue.size() + b.flight.size() + b.batch.size();
+  }
+  return n;
+}
+
+int Client::next_timeout_ms() const
+{
+  Clock::time_point now = Clock::now(), first = Clock::time_point::max();
+  for(const Board &b : boards_) {
+    for(const auto &kv : b.flight) {
+      first = std::min(first, kv.second->deadline);
+    }
+  }
+  if(first == Clock::time_point::max()) {
+    return -1;
+  }
+  if(first <= now) {
+    return 0;
+  }
+  // Rounded up, so that poll() does not wake just before it
+  auto us = std::chrono::duration_cast<std::chrono::microseconds>(first - now);
+  return (us.count() + 999) / 1000;
+}
+
+} // namespace jam
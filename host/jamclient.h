@@ -0,0 +1,238 @@
+#ifndef _JAMCLIENT_H_
+#define _JAMCLIENT_H_
+
+// jamclient.h - Host library for the boards' UDP register protocol
+// (wbreg.h), pipelined and batched, for any number of boards.
+//
+// Requests are queued and a Client sends them from poll(): up to
+// Options::window per board in flight at once, each answered through its
+// callback when the reply comes.  So a board is kept busy for the RTT
+// rather than waiting out each request in turn.  One socket and one
+// poll() loop serve every board added; a caller with its own loop waits
+// on fd() and calls poll(0) when it is readable or next_timeout_ms() has
+// passed.
+//
+// The single-word operations (read_word(), write_word(), rmw()) go into
+// a WBREG_OP_BATCH per board, of up to Options::batch_max entries, sent
+// when it is full or at the next poll().  Each entry may have its own
+// address, so scattered registers cost one round trip.  A batch stops at
+// its first failed entry: that one gets the board's status, and those
+// after it ST_NOTRUN.  read() and write() of more than Options::max_words
+// are split over several requests.  Their callback runs once, when all
+// parts have been answered, with the first status that was not ST_OK.
+//
+// A request that is not answered within its retransmit timeout goes out
+// again with the same id, the timeout doubling up to Options::rto_max.
+// The board answers a retransmit from its cache of each client's last
+// WBREG_CACHE replies without running it again.  Reads may safely run
+// again, so up to Options::window of them may be in flight.  A request
+// that writes goes out only with fewer than WBREG_CACHE in flight, and
+// while it is in flight, it, the requests in flight when it went and
+// those sent since stay within WBREG_CACHE: however the replies come back,
+// its reply is still cached if it must be asked for again.
+// Options::batch_max keeps batch replies short enough to be cached.
+// After Options::retries retransmits the request fails with ST_TIMEOUT.
+//
+// call() sends any other request, and on_notify() takes the watch
+// notifications (WBREG_OP_NOTIFY) boards send to the client's socket.
+//
+// Callbacks run from poll(), and may queue more requests.
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <netinet/in.h>
+
+namespace jam {
+
+// As wbreg.h
+const uint16_t WBREG_PORT = 7000;
+const unsigned WBREG_CACHE = 4;
+const unsigned WBREG_CACHE_BYTES = 256;
+// At eth0's standard MTU
+const unsigned WBREG_MAX_WORDS = 362;
+
+enum {
+  OP_READ = 0x01,
+  OP_WRITE = 0x02,
+  OP_BATCH = 0x03,
+  OP_WATCH = 0x06,
+  OP_UNWATCH = 0x07,
+  OP_NOTIFY = 0x08,
+  OP_PERF = 0x0c,
+  OP_NOINC = 0x80,
+};
+
+enum {
+  B_READ = 0x01,
+  B_WRITE = 0x02,
+  B_RMW = 0x03,
+};
+
+// The board's statuses, then the client's own
+enum {
+  ST_OK = 0,
+  ST_EOP = 1,
+  ST_EADDR = 2,
+  ST_ELEN = 3,
+  ST_ETIMEDOUT = 4,
+  ST_ENOENT = 5,
+  ST_ENOSPC = 6,
+  ST_EDUP = 7,
+  ST_EBUS = 8,
+  ST_ETIME = 9,
+  ST_TIMEOUT = 0x100, // no reply after every retransmit
+  ST_NOTRUN = 0x101,  // an earlier entry of its batch failed
+  ST_SHORT = 0x102,   // the reply was shorter than the request needs
+};
+
+// Name of a status, for messages
+const char *status_name(int status);
+
+struct Options {
+  // Requests in flight per board, while none of them writes
+  unsigned window = 32;
+  // Entries per batch: 61 results and the header fill WBREG_CACHE_BYTES
+  unsigned batch_max = (WBREG_CACHE_BYTES - 12) / 4;
+  // Words per read or write request
+  unsigned max_words = WBREG_MAX_WORDS;
+  std::chrono::microseconds rto{20000};
+  std::chrono::microseconds rto_max{500000};
+  unsigned retries = 6;
+};
+
+struct Stats {
+  uint64_t sent = 0;        // requests, retransmits left out
+  uint64_t batches = 0;     // of those, batches
+  uint64_t batched = 0;     // entries in them
+  uint64_t retransmits = 0;
+  uint64_t timeouts = 0;
+  uint64_t replies = 0;
+  uint64_t stale = 0;       // replies to nothing in flight, as a retransmit's
+};
+
+using ReadFn = std::function<void(int status, const uint32_t *words,
+                                  size_t count)>;
+using WordFn = std::function<void(int status, uint32_t value)>;
+using DoneFn = std::function<void(int status)>;
+// The reply's status, header fields and the words after the header
+using CallFn = std::function<void(int status, uint16_t count, uint32_t addr,
+                                  const uint32_t *words, size_t n)>;
+// A board's notification: its `id`, and the words of its struct
+// wbreg_change, 5 each
+using NotifyFn = std::function<void(int board, uint32_t seq,
+                                    const uint32_t *words, size_t n)>;
+
+class Client {
+ public:
+  explicit Client(const Options &opts = Options());
+  ~Client();
+  Client(const Client &) = delete;
+  Client &operator=(const Client &) = delete;
+
+  // Returns the board's number, from 0, or -1 if `host` does not resolve
+  int add_board(const std::string &host, uint16_t port = WBREG_PORT);
+  size_t boards() const { return boards_.size(); }
+
+  // `count` words from `addr`, or from `addr` over and over with `noinc`
+  void read(int board, uint32_t addr, uint32_t count, ReadFn done,
+            bool noinc = false);
+  void write(int board, uint32_t addr, const uint32_t *words, uint32_t count,
+             DoneFn done, bool noinc = false);
+
+  // One word each, batched
+  void read_word(int board, uint32_t addr, WordFn done);
+  void write_word(int board, uint32_t addr, uint32_t value, DoneFn done);
+  // *addr = (*addr & ~mask) | (value & mask), passing the old *addr
+  void rmw(int board, uint32_t addr, uint32_t value, uint32_t mask,
+           WordFn done);
+
+  // Any other request: `op`, `count` and `addr` in the header, then `n`
+  // words of `data`.  Set `replayable` only if running it twice does no
+  // harm.
+  void call(int board, uint8_t op, uint16_t count, uint32_t addr,
+            const uint32_t *data, size_t n, CallFn done,
+            bool replayable = false);
+  // Where notifications go; without one they are dropped
+  void on_notify(NotifyFn fn) { notify_ = std::move(fn); }
+
+  // Send what is queued, wait up to `timeout_ms` for a reply if there is
+  // none yet (-1 for as long as anything is in flight), take the replies
+  // that arrived and retransmit what is due.  Returns the replies taken.
+  int poll(int timeout_ms);
+  // poll() until nothing is queued or in flight
+  void run();
+
+  // Requests queued or in flight, batch entries not yet sent included
+  size_t pending() const;
+  // Milliseconds to the next retransmit, -1 for none
+  int next_timeout_ms() const;
+  int fd() const { return fd_; }
+  const Stats &stats() const { return stats_; }
+
+ private:
+  using Clock = std::chrono::steady_clock;
+
+  struct Request {
+    uint32_t id = 0;
+    std::vector<uint8_t> pkt;
+    // Safe to run twice
+    bool replayable = true;
+    CallFn done;
+    // Sent as the board's seq'th request, with `before` others in flight
+    uint64_t seq = 0;
+    size_t before = 0;
+    Clock::time_point deadline;
+    std::chrono::microseconds rto{0};
+    unsigned tries = 0;
+  };
+
+  struct Entry {
+    uint8_t op;
+    uint32_t addr, value, mask;
+    WordFn done;
+  };
+
+  struct Board {
+    sockaddr_in addr;
+    uint32_t next_id;
+    std::deque<std::unique_ptr<Request>> queue;
+    std::unordered_map<uint32_t, std::unique_ptr<Request>> flight;
+    // Requests sent so far
+    uint64_t seq = 0;
+    std::vector<Entry> batch;
+  };
+
+  void submit(int board, std::unique_ptr<Request> r);
+  void add_entry(int board, Entry e);
+  void flush_batch(int board);
+  bool may_send(const Board &b, const Request &r) const;
+  void send_queued(int board);
+  void transmit(Board &b, Request &r);
+  int receive();
+  void retransmit();
+  void finish(Board &b, std::unique_ptr<Request> r, int status,
+              uint16_t count, uint32_t addr, const uint32_t *words,
+              size_t n);
+
+  Options opts_;
+  int fd_;
+  // A deque, so that callbacks may add boards under a Board &
+  std::deque<Board> boards_;
+  // Board by address and port
+  std::map<std::pair<uint32_t, uint16_t>, int> by_addr_;
+  Stats stats_;
+  NotifyFn notify_;
+};
+
+} // namespace jam
+
+#endif // _JAMCLIENT_H_
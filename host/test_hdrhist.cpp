@@ -0,0 +1,89 @@
+// test_hdrhist.cpp - Histogram's buckets and percentiles.
+
+#include "hdrhist.h"
+
+#include <cstdio>
+
+using namespace jam;
+
+static int failures;
+
+#define CHECK(cond) do { \
+    if(!(cond)) { \
+      std::fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #cond); \
+      failures++; \
+    } \
+  } while(0)
+
+namespace {
+
+// Small values are exact
+void test_exact()
+{
+  Histogram h;
+
+  for(uint64_t v=0; v<100; v++) {
+    h.record(v);
+  }
+  CHECK(h.count() == 100);
+  CHECK(h.min() == 0 && h.max() == 99);
+  CHECK(h.mean() == 49.5);
+  CHECK(h.percentile(50) == 49);
+  CHECK(h.percentile(99) == 98);
+  CHECK(h.percentile(100) == 99);
+  CHECK(h.percentile(0) == 0);
+}
+
+// Large ones land within 1 part in 128, at or above the value
+void test_precision()
+{
+  const uint64_t values[] = {
+    256, 257, 1000, 123457, 999999, 1ull << 40, (1ull << 40) + 12345,
+    UINT64_MAX,
+  };
+
+  for(uint64_t v : values) {
+    Histogram h;
+    h.record(v);
+    h.record(0);
+    uint64_t p = h.percentile(100);
+    CHECK(p == v);
+    // The bucket's top, with the max out of the way
+    h.record(UINT64_MAX);
+    p = h.percentile(66);
+    CHECK(p >= v && p - v <= v / 128);
+  }
+}
+
+// Merged histograms count as one over all the values
+void test_merge()
+{
+  Histogram a, b, all;
+
+  for(uint64_t v=1; v<=1000; v++) {
+    (v % 2 ? a : b).record(v * 1000);
+    all.record(v * 1000);
+  }
+  a.merge(b);
+  CHECK(a.count() == 1000);
+  CHECK(a.min() == all.min() && a.max() == all.max());
+  CHECK(a.percentile(99) == all.percentile(99));
+  CHECK(a.percentile(50) >= 500000 && a.percentile(50) <= 500000 + 4000);
+  a.reset();
+  CHECK(a.count() == 0 && a.percentile(99) == 0 && a.max() == 0);
+}
+
+} // namespace
+
+int main()
+{
+  test_exact();
+  test_precision();
+  test_merge();
+  if(failures) {
+    std::fprintf(stderr, "%d checks failed\n", failures);
+    return 1;
+  }
+  std::printf("hdrhist: all tests passed\n");
+  return 0;
+}
@@ -0,0 +1,448 @@
+// test_jamclient.cpp - jamclient against fake boards on the loopback: each
+// a thread with a word array behind the register protocol and the board's
+// cache of replies, dropping replies as told.
+
+#include "jamclient.h"
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace jam;
+
+static int failures;
+
+#define CHECK(cond) do { \
+    if(!(cond)) { \
+      std::fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #cond); \
+      failures++; \
+    } \
+  } while(0)
+
+namespace {
+
+uint32_t get32(const uint8_t *p)
+{
+  return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 |
+         p[3];
+}
+
+void put32(uint8_t *p, uint32_t v)
+{
+  p[0] = v >> 24;
+  p[1] = v >> 16;
+  p[2] = v >> 8;
+  p[3] = v;
+}
+
+class FakeBoard {
+ public:
+  static const uint32_t WORDS = 4096;
+
+  // Drop every `drop_every`th reply, none for 0, all for 1
+  explicit FakeBoard(unsigned drop_every = 0)
+    : mem_(WORDS), drop_every_(drop_every)
+  {
+    fd_ = socket(AF_INET, SOCK_DGRAM, 0);
+    sockaddr_in sin;
+    std::memset(&sin, 0, sizeof(sin));
+    sin.sin_family = AF_INET;
+    sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    bind(fd_, (sockaddr *)&sin, sizeof(sin));
+    socklen_t len = sizeof(sin);
+    getsockname(fd_, (sockaddr *)&sin, &len);
+    port_ = ntohs(sin.sin_port);
+    thread_ = std::thread([this] { serve(); });
+  }
+
+  ~FakeBoard()
+  {
+    stop_ = true;
+    thread_.join();
+    close(fd_);
+  }
+
+  uint16_t port() const { return port_; }
+  // Requests that change something run more than once
+  unsigned reruns() const { return reruns_; }
+
+ private:
+  struct Cached {
+    uint32_t id;
+    std::vector<uint8_t> reply;
+  };
+
+  void serve()
+  {
+    uint8_t buf[9000];
+    while(!stop_) {
+      struct pollfd pfd = { fd_, POLLIN, 0 };
+      if(::poll(&pfd, 1, 20) <= 0) {
+        continue;
+      }
+      sockaddr_in from;
+      socklen_t fromlen = sizeof(from);
+      ssize_t len = recvfrom(fd_, buf, sizeof(buf), 0, (sockaddr *)&from,
+                             &fromlen);
+      if(len < 12) {
+        continue;
+      }
+      std::vector<uint8_t> reply = answer(buf, len);
+      if(drop_every_ && ++replies_ % drop_every_ == 0) {
+        continue;
+      }
+      sendto(fd_, reply.data(), reply.size(), 0, (sockaddr *)&from,
+             fromlen);
+      // A watch reports the register's value at once
+      if((buf[4] & 0x7f) == OP_WATCH) {
+        uint8_t n[12 + 20];
+        uint32_t a = get32(buf + 8);
+        std::memset(n, 0, sizeof(n));
+        put32(n, ++notifies_);
+        n[4] = OP_NOTIFY;
+        n[7] = 1;
+        put32(n + 12, a);
+        put32(n + 20, mem_[a / 4]);
+        sendto(fd_, n, sizeof(n), 0, (sockaddr *)&from, fromlen);
+      }
+    }
+  }
+
+  std::vector<uint8_t> answer(const uint8_t *req, size_t len)
+  {
+    uint32_t id = get32(req);
+    for(const Cached &c : cache_) {
+      if(c.id == id) {
+        return c.reply;
+      }
+    }
+    uint8_t op = req[4];
+    bool changes = (op & 0x7f) != OP_READ;
+    if(changes && !ran_.insert(id).second) {
+      reruns_++;
+    }
+    std::vector<uint8_t> reply = exec(req, len);
+    if(reply.size() <= WBREG_CACHE_BYTES) {
+      cache_.push_back(Cached{id, reply});
+      if(cache_.size() > WBREG_CACHE) {
+        cache_.pop_front();
+      }
+    }
+    return reply;
+  }
+
+  bool valid(uint32_t addr) const
+  {
+    return !(addr & 3) && addr / 4 < WORDS;
+  }
+
+  std::vector<uint8_t> exec(const uint8_t *req, size_t len)
+  {
+    std::vector<uint8_t> reply(req, req + 12);
+    uint8_t op = req[4];
+    uint16_t count = req[6] << 8 | req[7];
+    uint32_t addr = get32(req + 8);
+    bool noinc = op & OP_NOINC;
+    uint8_t status = ST_OK;
+
+    switch(op & 0x7f) {
+    case OP_READ:
+      if(!valid(addr) || (!noinc && addr / 4 + count > WORDS)) {
+        status = ST_EADDR;
+        break;
+      }
+      reply.resize(12 + count * 4);
+      for(uint32_t i=0; i<count; i++) {
+        put32(&reply[12 + i * 4], mem_[addr / 4 + (noinc ? 0 : i)]);
+      }
+      break;
+    case OP_WRITE:
+      if(len < 12 + count * 4u) {
+        status = ST_ELEN;
+      } else if(!valid(addr) || (!noinc && addr / 4 + count > WORDS)) {
+        status = ST_EADDR;
+      } else {
+        for(uint32_t i=0; i<count; i++) {
+          mem_[addr / 4 + (noinc ? 0 : i)] = get32(req + 12 + i * 4);
+        }
+      }
+      break;
+    case OP_BATCH: {
+      uint16_t i;
+      if(len < 12 + count * 16u) {
+        status = ST_ELEN;
+        break;
+      }
+      for(i=0; i<count; i++) {
+        const uint8_t *e = req + 12 + i * 16;
+        uint32_t a = get32(e + 4), v = get32(e + 8), m = get32(e + 12);
+        uint32_t result = 0;
+        if(!valid(a)) {
+          status = ST_EADDR;
+          break;
+        }
+        switch(e[0]) {
+        case B_READ:
+          result = mem_[a / 4];
+          break;
+        case B_WRITE:
+          mem_[a / 4] = v;
+          break;
+        case B_RMW:
+          result = mem_[a / 4];
+          mem_[a / 4] = (result & ~m) | (v & m);
+          break;
+        default:
+          status = ST_EOP;
+          break;
+        }
+        if(status != ST_OK) {
+          break;
+        }
+        reply.resize(reply.size() + 4);
+        put32(&reply[reply.size() - 4], result);
+      }
+      if(status != ST_OK) {
+        reply[6] = i >> 8;
+        reply[7] = i;
+      }
+      break;
+    }
+    case OP_WATCH:
+      status = valid(addr) && len >= 16 ? ST_OK : ST_EADDR;
+      break;
+    case OP_PERF:
+      // No sites, at a 100 MHz clock
+      put32(&reply[8], 100000000);
+      break;
+    default:
+      status = ST_EOP;
+      break;
+    }
+    reply[5] = status;
+    return reply;
+  }
+
+  int fd_;
+  uint16_t port_;
+  std::vector<uint32_t> mem_;
+  unsigned drop_every_;
+  unsigned replies_ = 0;
+  uint32_t notifies_ = 0;
+  std::deque<Cached> cache_;
+  std::set<uint32_t> ran_;
+  std::atomic<unsigned> reruns_{0};
+  std::atomic<bool> stop_{false};
+  std::thread thread_;
+};
+
+Options fast()
+{
+  Options o;
+  o.rto = std::chrono::microseconds(2000);
+  o.rto_max = std::chrono::microseconds(20000);
+  o.retries = 10;
+  return o;
+}
+
+// Words written to several boards at once, in whole blocks and singly, come
+// back from each
+void test_fanout()
+{
+  FakeBoard boards[3];
+  Client c(fast());
+  int ok = 0, bad = 0;
+
+  for(FakeBoard &fb : boards) {
+    CHECK(c.add_board("127.0.0.1", fb.port()) >= 0);
+  }
+  CHECK(c.add_board("127.0.0.1", boards[1].port()) == 1);
+  CHECK(c.boards() == 3);
+
+  // More than one request's worth, so split
+  std::vector<uint32_t> block(1000);
+  for(int b=0; b<3; b++) {
+    for(size_t i=0; i<block.size(); i++) {
+      block[i] = b << 16 | i;
+    }
+    c.write(b, 0, block.data(), block.size(),
+            [&](int s) { s == ST_OK ? ok++ : bad++; });
+    for(uint32_t i=0; i<200; i++) {
+      c.write_word(b, 0x2000 + i * 4, b << 24 | i,
+                   [&](int s) { s == ST_OK ? ok++ : bad++; });
+    }
+  }
+  c.run();
+  CHECK(ok == 3 + 600 && bad == 0);
+  // Batched and full: 200 entries in 4 batches per board
+  CHECK(c.stats().batches == 12);
+  CHECK(c.stats().batched == 600);
+
+  ok = 0;
+  for(int b=0; b<3; b++) {
+    c.read(b, 0, 1000, [&, b](int s, const uint32_t *w, size_t n) {
+      bool same = s == ST_OK && n == 1000;
+      for(size_t i=0; same && i<n; i++) {
+        same = w[i] == ((uint32_t)b << 16 | i);
+      }
+      same ? ok++ : bad++;
+    });
+    for(uint32_t i=0; i<200; i++) {
+      c.read_word(b, 0x2000 + i * 4, [&, b, i](int s, uint32_t v) {
+        s == ST_OK && v == ((uint32_t)b << 24 | i) ? ok++ : bad++;
+      });
+    }
+  }
+  c.run();
+  CHECK(ok == 3 + 600 && bad == 0);
+  CHECK(c.pending() == 0);
+}
+
+// With replies lost, every request is still answered, and no write or
+// read-modify-write runs twice
+void test_loss()
+{
+  FakeBoard fb(3);
+  Client c(fast());
+  int b = c.add_board("127.0.0.1", fb.port());
+  int ok = 0, bad = 0;
+
+  // The board notes what runs twice
+  for(uint32_t i=0; i<500; i++) {
+    c.rmw(b, (i % 32) * 4, 1u << (i / 32 % 16), 1u << (i / 32 % 16),
+          [&](int s, uint32_t) { s == ST_OK ? ok++ : bad++; });
+    if(i % 50 == 0) {
+      c.poll(0);
+    }
+  }
+  std::vector<uint32_t> words(100, 0x5a5a5a5a);
+  for(uint32_t i=0; i<40; i++) {
+    c.write(b, 0x1000 + i % 20 * 400, words.data(), words.size(),
+            [&](int s) { s == ST_OK ? ok++ : bad++; });
+  }
+  for(uint32_t i=0; i<40; i++) {
+    c.read(b, 0x1000, 100, [&](int s, const uint32_t *, size_t n) {
+      s == ST_OK && n == 100 ? ok++ : bad++;
+    });
+  }
+  c.run();
+  CHECK(ok == 580 && bad == 0);
+  CHECK(c.stats().retransmits > 0);
+  CHECK(c.stats().timeouts == 0);
+  CHECK(fb.reruns() == 0);
+}
+
+// A batch stops at its bad entry: those before it ran, those after did not
+void test_batch_error()
+{
+  FakeBoard fb;
+  Client c(fast());
+  int b = c.add_board("127.0.0.1", fb.port());
+  int st[4] = { -1, -1, -1, -1 };
+  uint32_t v0 = 0, v3 = 1;
+
+  c.write_word(b, 0x10, 0x1234, [&](int s) { st[0] = s; });
+  c.run();
+  CHECK(st[0] == ST_OK);
+
+  c.read_word(b, 0x10, [&](int s, uint32_t v) { st[0] = s; v0 = v; });
+  c.read_word(b, FakeBoard::WORDS * 4, [&](int s, uint32_t) { st[1] = s; });
+  c.write_word(b, 0x10, 0x5678, [&](int s) { st[2] = s; });
+  c.read_word(b, 0x14, [&](int s, uint32_t v) { st[3] = s; v3 = v; });
+  c.run();
+  CHECK(st[0] == ST_OK && v0 == 0x1234);
+  CHECK(st[1] == ST_EADDR);
+  CHECK(st[2] == ST_NOTRUN);
+  CHECK(st[3] == ST_NOTRUN && v3 == 0);
+
+  c.read_word(b, 0x10, [&](int s, uint32_t v) { st[0] = s; v0 = v; });
+  c.run();
+  CHECK(st[0] == ST_OK && v0 == 0x1234);
+}
+
+// Other requests go through call(), and notifications to on_notify()
+void test_call()
+{
+  FakeBoard fb;
+  Client c(fast());
+  int b = c.add_board("127.0.0.1", fb.port());
+  int st = -1, nb = -1, watched = -1;
+  uint32_t hz = 0, seq = 0, value = 0;
+  uint32_t mask = 0xffffffff;
+
+  c.on_notify([&](int board, uint32_t id, const uint32_t *w, size_t n) {
+    nb = board;
+    seq = id;
+    value = n >= 5 ? w[2] : 0;
+  });
+  c.write_word(b, 0x40, 0xfeed, nullptr);
+  c.run();
+  c.call(b, OP_PERF, 0, 0, nullptr, 0,
+         [&](int s, uint16_t, uint32_t addr, const uint32_t *, size_t) {
+           st = s;
+           hz = addr;
+         }, true);
+  c.call(b, OP_WATCH, 0, 0x40, &mask, 1,
+         [&](int s, uint16_t, uint32_t, const uint32_t *, size_t) {
+           watched = s;
+         });
+  c.run();
+  CHECK(st == ST_OK && hz == 100000000);
+  CHECK(watched == ST_OK);
+  // The notification follows the reply
+  for(int i=0; i<50 && nb < 0; i++) {
+    c.poll(10);
+  }
+  CHECK(nb == b && seq == 1 && value == 0xfeed);
+  CHECK(c.stats().stale == 0);
+}
+
+// A board that never answers fails each request once its retransmits run
+// out
+void test_timeout()
+{
+  FakeBoard fb(1);
+  Options o = fast();
+  o.retries = 3;
+  Client c(o);
+  int b = c.add_board("127.0.0.1", fb.port());
+  int st = -1, rd = -1;
+
+  c.write_word(b, 0, 1, [&](int s) { st = s; });
+  c.read(b, 0, 10, [&](int s, const uint32_t *, size_t n) {
+    rd = n == 0 ? s : -2;
+  });
+  c.run();
+  CHECK(st == ST_TIMEOUT);
+  CHECK(rd == ST_TIMEOUT);
+  CHECK(c.stats().timeouts == 2);
+  CHECK(c.stats().retransmits == 6);
+  CHECK(c.add_board("no.such.host.invalid") == -1);
+}
+
+} // namespace
+
+int main()
+{
+  test_fanout();
+  test_loss();
+  test_batch_error();
+  test_call();
+  test_timeout();
+  if(failures) {
+    std::fprintf(stderr, "%d checks failed\n", failures);
+    return 1;
+  }
+  std::printf("jamclient: all tests passed\n");
+  return 0;
+}
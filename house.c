@@ -0,0 +1,23 @@
+// house.c - main() of the housekeeping core in a two-core build (role.h).
+//
+// Only the board health monitoring runs here; the network core has the
+// UART, the flash and everything on lwIP.  xadc.c sends the results and
+// alarms over the mailbox, so nothing else is needed but the main loop.
+
+#include "intr.h"
+#include "mbox.h"
+#include "sched.h"
+#include "timebase.h"
+#include "timer.h"
+#include "xadc.h"
+
+int main()
+{
+    init_intr();
+    init_timebase();
+    init_timers();
+    init_mbox();
+    init_xadc();
+    sched_run();
+    return 0;
+}
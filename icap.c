@@ -0,0 +1,268 @@
+// icap.c - Reload the FPGA from a flash slot through the ICAP (see icap.h).
+//
+// The HWICAP core passes 32-bit words from its write FIFO to the ICAP, and
+// the ICAP to its read FIFO, so each step below is a short configuration
+// packet sequence (UG470, "Reconfiguration and MultiBoot"): sync, type 1
+// register reads or writes, then a command.
+
+#include "xil_io.h"
+#include "xil_printf.h"
+
+#include "bitstream.h"
+#include "flash.h"
+#include "icap.h"
+#include "log.h"
+#include "slots.h"
+#include "timer.h"
+
+// AXI HWICAP registers (PG134)
+#define HWICAP_WF          (0x100)
+#define HWICAP_RF          (0x104)
+#define HWICAP_SZ          (0x108)
+#define HWICAP_CR          (0x10c)
+#define HWICAP_SR          (0x110)
+#define HWICAP_RFO         (0x118)
+
+#define CR_WRITE           (0x01)
+#define CR_READ            (0x02)
+#define SR_DONE            (0x01)
+
+// Configuration packets
+#define CFG_DUMMY          (0xffffffff)
+#define CFG_SYNC           (0xaa995566)
+#define CFG_NOOP           (0x20000000)
+#define CFG_READ(reg)      (0x28000001 | ((reg) << 13))
+#define CFG_WRITE(reg)     (0x30000001 | ((reg) << 13))
+
+#define CFG_REG_CMD        (0x04)
+#define CFG_REG_IDCODE     (0x0c)
+#define CFG_REG_WBSTAR     (0x10)
+#define CFG_REG_BOOTSTS    (0x16)
+
+#define CFG_CMD_IPROG      (0x0f)
+#define CFG_CMD_DESYNC     (0x0d)
+
+// WBSTAR start address bits (RS pins and their tristate left clear)
+#define WBSTAR_ADDR        (0x1fffffff)
+
+// Polls of the HWICAP before giving up on it
+#define ICAP_TIMEOUT       (100000)
+
+// Start of the golden image read for its IDCODE
+#define ICAP_GOLDEN_PROBE  (256)
+
+static u32 bootsts;
+static u32 idcode;
+static u32 boot_addr;
+static u8 running = SLOT_GOLDEN;
+
+#if ICAP_PRESENT
+// Send `n` words to the ICAP and wait for them to go.  Returns 0, or -1 if
+// the core did not finish.
+static int
+icap_write(const u32 *w, u32 n)
+{
+  u32 i;
+
+  for(i=0; i<n; i++) {
+    Xil_Out32(ICAP_BASE + HWICAP_WF, w[i]);
+  }
+  Xil_Out32(ICAP_BASE + HWICAP_CR, CR_WRITE);
+  for(i=0; i<ICAP_TIMEOUT; i++) {
+    if(!(Xil_In32(ICAP_BASE + HWICAP_CR) & CR_WRITE)) {
+      return 0;
+    }
+  }
+  return -1;
+}
+
+// Read configuration register `reg` into `*v`.  Returns 0, or -1 if the
+// ICAP did not answer.
+static int
+icap_read_reg(u32 reg, u32 *v)
+{
+  const u32 rd[] = {
+    CFG_DUMMY, CFG_SYNC, CFG_NOOP, CFG_NOOP, CFG_READ(reg), CFG_NOOP, CFG_NOOP
+  };
+  const u32 desync[] = {
+    CFG_WRITE(CFG_REG_CMD), CFG_CMD_DESYNC, CFG_NOOP, CFG_NOOP
+  };
+  u32 i;
+  int err = -1;
+
+  if(icap_write(rd, sizeof(rd) / sizeof(rd[0])) != 0) {
+    return -1;
+  }
+  Xil_Out32(ICAP_BASE + HWICAP_SZ, 1);
+  Xil_Out32(ICAP_BASE + HWICAP_CR, CR_READ);
+  for(i=0; i<ICAP_TIMEOUT; i++) {
+    if(!(Xil_In32(ICAP_BASE + HWICAP_CR) & CR_READ) &&
+       Xil_In32(ICAP_BASE + HWICAP_RFO)) {
+      *v = Xil_In32(ICAP_BASE + HWICAP_RF);
+      err = 0;
+      break;
+    }
+  }
+  if(icap_write(desync, sizeof(desync) / sizeof(desync[0])) != 0) {
+    return -1;
+  }
+  return err;
+}
+
+// Load the image at `addr`.  Returns only if the ICAP did not take it.
+static void
+icap_iprog(u32 addr)
+{
+  const u32 w[] = {
+    CFG_DUMMY, CFG_SYNC, CFG_NOOP,
+    CFG_WRITE(CFG_REG_WBSTAR), addr & WBSTAR_ADDR,
+    CFG_WRITE(CFG_REG_CMD), CFG_CMD_IPROG, CFG_NOOP
+  };
+
+  icap_write(w, sizeof(w) / sizeof(w[0]));
+}
+#endif // ICAP_PRESENT
+
+#if ICAP_PRESENT
+// The slot WBSTAR points into, which an IPROG loaded this configuration
+// from, or SLOT_GOLDEN if it cannot be told
+static u8
+wbstar_slot()
+{
+  u32 wbstar;
+  u8 i;
+
+  if(icap_read_reg(CFG_REG_WBSTAR, &wbstar) != 0) {
+    return SLOT_GOLDEN;
+  }
+  wbstar &= WBSTAR_ADDR;
+  for(i=0; i<slots.num; i++) {
+    if((slots.slot[i].addr & WBSTAR_ADDR) == wbstar) {
+      return i;
+    }
+  }
+  return SLOT_GOLDEN;
+}
+#endif
+
+// Non-zero if `slot` holds an image whose flash matches its CRC-32
+static int
+slot_bootable(u8 slot)
+{
+  const struct slot_desc *d = &slots.slot[slot];
+  u32 crc = 0;
+
+  if(slot == SLOT_GOLDEN) {
+    return 1;
+  }
+  if(slot >= slots.num || !d->len || flash_busy()) {
+    return 0;
+  }
+  return crc_flash(d->addr, d->len, &crc) == 0 && crc == d->crc;
+}
+
+static void
+boot_timeout(void *arg)
+{
+#if ICAP_PRESENT
+  icap_iprog(boot_addr);
+  LOG("icap: IPROG of %x not taken", boot_addr);
+#endif
+}
+
+static struct timer boot_timer = TIMER_INIT(boot_timeout, NULL);
+
+// The golden image's IDCODE, 0 if flash has no bitstream there
+static u32
+golden_idcode()
+{
+  u8 buf[ICAP_GOLDEN_PROBE];
+  struct bit_info info;
+
+  if(read_flash(slots.slot[SLOT_GOLDEN].addr, buf, sizeof(buf),
+        FLASH_MODE_BEST) != sizeof(buf) ||
+     bit_parse(buf, sizeof(buf), &info) != BIT_OK) {
+    return 0;
+  }
+  return info.idcode;
+}
+
+void
+init_icap()
+{
+#if ICAP_PRESENT
+  u8 active = slots.active;
+
+  if(icap_read_reg(CFG_REG_IDCODE, &idcode) != 0) {
+    idcode = golden_idcode();
+  }
+  if(icap_read_reg(CFG_REG_BOOTSTS, &bootsts) != 0) {
+    LOG("icap: no answer from the ICAP");
+    return;
+  }
+  if(bootsts & ICAP_BOOT_FALLBACK) {
+    LOG("icap: fell back to golden, boot status %x", bootsts);
+    if(active != SLOT_GOLDEN) {
+      slot_activate(SLOT_GOLDEN, NULL, NULL);
+    }
+    return;
+  }
+  if(bootsts & ICAP_BOOT_IPROG) {
+    running = wbstar_slot();
+    return;
+  }
+  if(active == SLOT_GOLDEN) {
+    return;
+  }
+  if(!slot_bootable(active)) {
+    LOG("icap: slot %u failed its check, staying on golden", active);
+    return;
+  }
+  icap_iprog(slots.slot[active].addr);
+  LOG("icap: IPROG of slot %u not taken", active);
+#else
+  idcode = golden_idcode();
+#endif
+}
+
+int
+icap_boot(u8 slot)
+{
+  if(!ICAP_PRESENT || timer_pending(&boot_timer) || !slot_bootable(slot)) {
+    return -1;
+  }
+  boot_addr = slots.slot[slot].addr;
+  timer_start(&boot_timer, ICAP_BOOT_DELAY_MS, 0);
+  return 0;
+}
+
+u8
+icap_slot()
+{
+  return running;
+}
+
+u32
+icap_bootsts()
+{
+  return bootsts;
+}
+
+u32
+icap_idcode()
+{
+  return idcode;
+}
+
+void
+dump_icap()
+{
+#if ICAP_PRESENT
+  xil_printf("ICAP: boot status %04x%s%s\n", bootsts,
+      bootsts & ICAP_BOOT_IPROG ? ", from IPROG" : "",
+      bootsts & ICAP_BOOT_FALLBACK ? ", fell back to golden" : "");
+#else
+  print("ICAP: none\n");
+#endif
+  xil_printf("  IDCODE %08x, slot %d\n", idcode, running);
+}
@@ -0,0 +1,67 @@
+#ifndef _ICAP_H_
+#define _ICAP_H_
+
+// icap.h - Reload the FPGA from a flash slot (slots.h) through the ICAP.
+//
+// Where the gateware has an AXI HWICAP, icap_boot() writes the slot's
+// flash address to WBSTAR and issues IPROG.  The FPGA then drops its
+// configuration, this firmware included, and loads the image at that
+// address, in the time a power-up load takes.  If that load fails (a CRC
+// or IDCODE error, or the configuration watchdog where the bitstreams
+// enable it), the FPGA falls back by itself to the golden image at
+// address 0.
+//
+// Power-up always loads the golden image, so init_icap() goes on to the
+// slot table's active slot.  It does not when this configuration came from
+// an IPROG or a fallback, which BOOTSTS shows.  After a fallback it makes
+// the golden slot active, so the image that failed is not loaded again.
+// Images are checked against their CRC-32 in the table before each IPROG.
+
+#include "xil_types.h"
+#include "xparameters.h"
+
+#ifdef XPAR_HWICAP_0_BASEADDR
+#define ICAP_PRESENT       (1)
+#define ICAP_BASE          (XPAR_HWICAP_0_BASEADDR)
+#else
+#define ICAP_PRESENT       (0)
+#endif
+
+// Time icap_boot() leaves for replies to go out before the IPROG
+#define ICAP_BOOT_DELAY_MS (200)
+
+// BOOTSTS: status of this configuration in the low byte, of the one before
+// it in the next
+#define ICAP_BOOT_VALID    (0x01)
+#define ICAP_BOOT_FALLBACK (0x02)
+#define ICAP_BOOT_IPROG    (0x04)
+#define ICAP_BOOT_WTO      (0x08) // configuration watchdog expired
+#define ICAP_BOOT_ID_ERR   (0x10)
+#define ICAP_BOOT_CRC_ERR  (0x20)
+
+// Read BOOTSTS and the IDCODE, and chain to the active slot from a power-up
+// load, or make the golden slot active after a fallback.  Call after
+// init_slots().
+void init_icap();
+
+// Check `slot`'s image and reload the FPGA from it ICAP_BOOT_DELAY_MS on.
+//
+// Returns 0 if the reload is coming, -1 if there is no ICAP, the slot
+// holds no image or its CRC is wrong, or flash is busy.
+int icap_boot(u8 slot);
+
+// BOOTSTS as init_icap() read it, 0 without an ICAP
+u32 icap_bootsts();
+
+// Slot this configuration was loaded from: the one WBSTAR points at after
+// an IPROG, else the golden one
+u8 icap_slot();
+
+// IDCODE of this FPGA, as init_icap() read it from the ICAP or else from
+// the golden image's bitstream (bitstream.h), 0 if neither had it
+u32 icap_idcode();
+
+// Print the boot status on the console
+void dump_icap();
+
+#endif // _ICAP_H_
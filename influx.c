@@ -0,0 +1,359 @@
+// influx.c - Metrics exported in InfluxDB line protocol (see influx.h).
+//
+// Each template is the text of one line with a HOST byte where the host
+// tag goes and a VALUE byte before each field's "i" where its value goes;
+// a line's values are gathered into `v` first, in the order of its
+// VALUE bytes.  Lines are formatted straight into `buf` after the ones
+// before; one that runs past ETH_UDP_MAX sends those and moves to the
+// front, which `buf` has INFLUX_LINE_MAX bytes of room beyond for.
+
+#include <string.h>
+
+#include "lwip/stats.h"
+#include "lwip/udp.h"
+
+#include "eth.h"
+#include "ethmon.h"
+#include "influx.h"
+#include "kv.h"
+#include "load.h"
+#include "log.h"
+#include "quota.h"
+#include "sched.h"
+#include "sntpclock.h"
+#include "timebase.h"
+#include "timer.h"
+#include "xadc.h"
+#include "xadccal.h"
+
+#define HOST  "\001"
+#define VALUE "\002"
+
+// Most values in one line
+#define MAX_VALUES (1 + ETHMON_COUNTERS)
+
+// Longest decimal value: sign and ten digits
+#define VALUE_MAX (11)
+
+// What a line reports
+enum {
+  LINE_XADC,
+  LINE_AUX,
+  LINE_ETH,
+  LINE_MEMP,
+  LINE_SCHED,
+  LINE_QUOTA
+};
+
+struct line {
+  const char *text;
+  u8 kind;
+  // Aux channel, core or pool
+  u8 n;
+};
+
+#define AUX(n) \
+  { "jam_xadc" HOST ",ch=aux" #n " value=" VALUE "i", LINE_AUX, n },
+#define ETH(n) \
+  { "jam_eth" HOST ",core=" #n " link=" VALUE "i,tx=" VALUE "i,rx=" VALUE \
+    "i,tx_of=" VALUE "i,tx_full=" VALUE "i,rx_of=" VALUE "i,rx_bad=" \
+    VALUE "i", LINE_ETH, n },
+#define QUOTA(n, name) \
+  { "jam_quota" HOST ",class=" name " active=" VALUE "i,accepted=" VALUE \
+    "i,over_max=" VALUE "i,reserved=" VALUE "i", LINE_QUOTA, n },
+
+static const struct line lines[] = {
+  { "jam_xadc" HOST " temp_mc=" VALUE "i,vccint_mv=" VALUE "i,vccaux_mv="
+    VALUE "i,vbram_mv=" VALUE "i,vpvn_mv=" VALUE "i", LINE_XADC, 0 },
+  AUX(0) AUX(1) AUX(2) AUX(3) AUX(4) AUX(5) AUX(6) AUX(7)
+  AUX(8) AUX(9) AUX(10) AUX(11) AUX(12) AUX(13) AUX(14) AUX(15)
+  ETH(0) ETH(1) ETH(2) ETH(3)
+#define LWIP_MEMPOOL(name, num, size, desc) \
+  { "jam_memp" HOST ",pool=" #name " used=" VALUE "i,max=" VALUE \
+    "i,err=" VALUE "i", LINE_MEMP, MEMP_##name },
+#include "lwip/priv/memp_std.h"
+  { "jam_sched" HOST " busy_pm=" VALUE "i,load_pm=" VALUE "i,stalls=" VALUE
+    "i,longest_us=" VALUE "i", LINE_SCHED, 0 },
+  QUOTA(QUOTA_CONTROL, "control") QUOTA(QUOTA_WEB, "web")
+  QUOTA(QUOTA_BULK, "bulk")
+};
+
+#define NUM_LINES (sizeof(lines) / sizeof(lines[0]))
+
+#if XADC_NUM_AUX != 16 || ETH_MAX_CORES != 4 || QUOTA_CLASSES != 3
+#error "influx.c has a template for each aux channel, core and class"
+#endif
+
+static const u32 pow10[] = {
+  1000000000, 100000000, 10000000, 1000000, 100000, 10000, 1000, 100, 10, 1
+};
+
+static const u64 pow10_64[] = {
+  10000000000000000000ULL, 1000000000000000000ULL, 100000000000000000ULL,
+  10000000000000000ULL, 1000000000000000ULL, 100000000000000ULL,
+  10000000000000ULL, 1000000000000ULL, 100000000000ULL, 10000000000ULL,
+  1000000000ULL
+};
+
+static struct influx_dest dest;
+static struct influx_stats stats;
+static struct udp_pcb *pcb;
+
+// ",host=jam-XXXXXX"
+static char host_tag[17];
+
+static u8 buf[ETH_UDP_MAX + INFLUX_LINE_MAX];
+
+static struct xadc_snapshot snap;
+
+// Write the digits of `v` at `p`, one subtraction loop a digit: no
+// divider needed, and at most 81 subtractions for the largest value.
+// Returns the digits written.
+static u32
+fmt_udec(u8 *p, u32 v)
+{
+  u32 i = 0, n = 0;
+  u8 d;
+
+  while(i < 9 && v < pow10[i]) {
+    i++;
+  }
+  for(; i<10; i++) {
+    for(d='0'; v >= pow10[i]; d++) {
+      v -= pow10[i];
+    }
+    p[n++] = d;
+  }
+  return n;
+}
+
+static u32
+fmt_dec(u8 *p, s32 v)
+{
+  if(v < 0) {
+    *p = '-';
+    return 1 + fmt_udec(p + 1, -(u32)v);
+  }
+  return fmt_udec(p, v);
+}
+
+// As fmt_udec(), for the timestamp: the digits from 10^9 up, then the nine
+// below from what is left, which fits 32 bits
+static u32
+fmt_u64(u8 *p, u64 v)
+{
+  u32 i, r, n = 0;
+  u8 d;
+
+  for(i=0; i<sizeof(pow10_64) / sizeof(pow10_64[0]); i++) {
+    for(d='0'; v >= pow10_64[i]; d++) {
+      v -= pow10_64[i];
+    }
+    if(d != '0' || n) {
+      p[n++] = d;
+    }
+  }
+  r = v;
+  if(!n) {
+    return fmt_udec(p, r);
+  }
+  for(i=1; i<10; i++) {
+    for(d='0'; r >= pow10[i]; d++) {
+      r -= pow10[i];
+    }
+    p[n++] = d;
+  }
+  return n;
+}
+
+// Gather the values of line `l` into `v`.  Returns 0, or -1 to leave the
+// line out.
+static int
+line_values(const struct line *l, s32 *v)
+{
+  const struct ethmon_core *e;
+  const struct quota_class *q;
+  u32 i, longest_us;
+
+  switch(l->kind) {
+  case LINE_XADC:
+    for(i=0; i<XADC_AUX(0); i++) {
+      v[i] = xadccal_value(i, snap.raw[i]);
+    }
+    return 0;
+  case LINE_AUX:
+    if(!(XADC_AUX_CHANNELS & (1 << l->n))) {
+      return -1;
+    }
+    v[0] = xadccal_value(XADC_AUX(l->n), snap.raw[XADC_AUX(l->n)]);
+    return 0;
+  case LINE_ETH:
+    e = ethmon_core(l->n);
+    if(!e || !e->present) {
+      return -1;
+    }
+    v[0] = e->link;
+    for(i=0; i<ETHMON_COUNTERS; i++) {
+      v[1 + i] = e->count[i];
+    }
+    return 0;
+  case LINE_MEMP:
+    v[0] = memp_pools[l->n]->stats->used;
+    v[1] = memp_pools[l->n]->stats->max;
+    v[2] = memp_pools[l->n]->stats->err;
+    return 0;
+  case LINE_SCHED:
+    v[0] = load_stats()->busy_pm;
+    v[1] = load_stats()->load_pm;
+    v[2] = sched_stalls(&longest_us);
+    v[3] = longest_us;
+    return 0;
+  case LINE_QUOTA:
+    q = quota_class(l->n);
+    v[0] = q->active;
+    v[1] = q->accepted;
+    v[2] = q->over_max;
+    v[3] = q->reserved;
+    return 0;
+  }
+  return -1;
+}
+
+// Send the first `n` bytes of `buf`
+static void
+influx_send(u32 n)
+{
+  struct pbuf *p;
+  ip4_addr_t ip;
+
+  p = pbuf_alloc(PBUF_TRANSPORT, n, PBUF_RAM);
+  if(!p) {
+    stats.errors++;
+    return;
+  }
+  memcpy(p->payload, buf, n);
+  ip4_addr_set_u32(&ip, dest.ip);
+  if(udp_sendto(pcb, p, &ip, dest.port) != ERR_OK) {
+    stats.errors++;
+  }
+  pbuf_free(p);
+  stats.datagrams++;
+  stats.bytes += n;
+}
+
+// Timer: format every line and send them
+static void
+influx_poll(void *arg)
+{
+  u64 utc_ns;
+  u32 t0 = timebase_stamp(), i, start, k, len = 0;
+  s32 v[MAX_VALUES];
+  const char *s;
+  // " <ns>", the same for every line
+  u8 ts[1 + 20];
+  u32 ts_len = 0;
+
+  if(!dest.ip) {
+    return;
+  }
+  xadc_snapshot(&snap);
+  utc_ns = sntpclock_utc_ns(timebase_cycles());
+  if(utc_ns) {
+    ts[0] = ' ';
+    ts_len = 1 + fmt_u64(&ts[1], utc_ns);
+  }
+
+  for(i=0; i<NUM_LINES; i++) {
+    if(line_values(&lines[i], v) != 0) {
+      continue;
+    }
+    start = len;
+    for(s=lines[i].text, k=0; *s; s++) {
+      if(*s == HOST[0]) {
+        memcpy(&buf[len], host_tag, sizeof(host_tag) - 1);
+        len += sizeof(host_tag) - 1;
+      } else if(*s == VALUE[0]) {
+        len += fmt_dec(&buf[len], v[k++]);
+      } else {
+        buf[len++] = *s;
+      }
+    }
+    memcpy(&buf[len], ts, ts_len);
+    len += ts_len;
+    buf[len++] = '\n';
+    stats.lines++;
+    if(len > ETH_UDP_MAX) {
+      influx_send(start);
+      memmove(buf, &buf[start], len - start);
+      len -= start;
+    }
+  }
+  if(len) {
+    influx_send(len);
+  }
+  stats.cycles = timebase_stamp() - t0;
+}
+
+static struct timer poll_timer = TIMER_INIT(influx_poll, NULL);
+
+static struct kv_save save = KV_SAVE_INIT(save, KV_KEY_INFLUX);
+
+void
+influx_set_dest(const ip4_addr_t *ip, u16 port)
+{
+  dest.ip = ip ? ip4_addr_get_u32(ip) : 0;
+  dest.port = dest.ip ? port : 0;
+  kv_save(&save, &dest, sizeof(dest));
+}
+
+const struct influx_dest *
+influx_dest()
+{
+  return &dest;
+}
+
+const struct influx_stats *
+influx_stats()
+{
+  return &stats;
+}
+
+void
+init_influx(struct netif *netif)
+{
+  static const char digits[] = "0123456789abcdef";
+  const char *s;
+  u32 i, n, worst;
+
+  // The mDNS name, as mdnsd.c makes it
+  memcpy(host_tag, ",host=jam-", 10);
+  for(n=0; n<3; n++) {
+    host_tag[10 + 2 * n] = digits[netif->hwaddr[3 + n] >> 4];
+    host_tag[11 + 2 * n] = digits[netif->hwaddr[3 + n] & 15];
+  }
+  host_tag[16] = '\0';
+
+  // A template that could outgrow the room past ETH_UDP_MAX is a bug
+  for(i=0; i<NUM_LINES; i++) {
+    // A space, a 20-digit timestamp and the newline
+    worst = 1 + 20 + 1;
+    for(s=lines[i].text; *s; s++) {
+      worst += *s == HOST[0] ? sizeof(host_tag) - 1 :
+          *s == VALUE[0] ? VALUE_MAX : 1;
+    }
+    if(worst > INFLUX_LINE_MAX) {
+      LOG("influx: line %u is too long (%u bytes)", i, worst);
+      return;
+    }
+  }
+
+  if(kv_get(KV_KEY_INFLUX, &dest, sizeof(dest)) != sizeof(dest)) {
+    memset(&dest, 0, sizeof(dest));
+  }
+  pcb = udp_new();
+  if(!pcb || udp_bind(pcb, IP_ADDR_ANY, INFLUX_PORT) != ERR_OK) {
+    LOG("influx: cannot bind port %u", INFLUX_PORT);
+    return;
+  }
+  timer_start(&poll_timer, INFLUX_PERIOD_MS, INFLUX_PERIOD_MS);
+}
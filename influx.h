@@ -0,0 +1,83 @@
+#ifndef _INFLUX_H_
+#define _INFLUX_H_
+
+// influx.h - Metrics exported in InfluxDB line protocol over UDP.
+//
+// Every INFLUX_PERIOD_MS the exporter sends the board's metrics to one
+// collector (an InfluxDB UDP listener, or Telegraf's socket_listener) as
+// lines of the line protocol, so the metrics stack takes them without a
+// translation proxy in between:
+//
+//   jam_xadc,host=jam-XXXXXX temp_mc=41250i,vccint_mv=998i,... <ns>
+//   jam_xadc,host=jam-XXXXXX,ch=aux3 value=1204i <ns>
+//   jam_eth,host=jam-XXXXXX,core=0 link=1i,tx=1234i,rx=5678i,... <ns>
+//   jam_memp,host=jam-XXXXXX,pool=TCP_PCB used=2i,max=5i,err=0i <ns>
+//   jam_sched,host=jam-XXXXXX busy_pm=112i,load_pm=98i,stalls=0i,... <ns>
+//   jam_quota,host=jam-XXXXXX,class=bulk active=1i,accepted=12i,... <ns>
+//
+// The XADC results are scaled as xadccal_value() does (xadccal.h), aux
+// inputs only for the channels in the scan; the eth lines only for the
+// cores ethmon.h found, with their link state and counters; the memp lines
+// for every lwIP pool; busy_pm and load_pm are the main loop's busy share
+// of the last second and its rolling load, in 1/1000ths (load.h); the
+// quota lines the connections of each class of TCP service and those
+// refused (quota.h).  The host tag is the mDNS name of mdnsd.h.  The
+// timestamp is the wall clock of sntpclock.h in nanoseconds, left off
+// until it has been set, so that the collector stamps the lines as they
+// arrive.
+//
+// The lines are templates in .rodata, the measurement, tags and field
+// names already in place; each period copies them out and formats only
+// the integer values, by subtracting powers of ten rather than dividing
+// and without xil_printf().  Lines are packed into datagrams of up to
+// ETH_UDP_MAX bytes, so the whole set goes out in one or two.
+//
+// The collector is kept in KV_KEY_INFLUX (kv.h) and set with KATCP's
+// ?influx (katcp.h).
+
+#include "lwip/ip4_addr.h"
+#include "lwip/netif.h"
+
+#include "xil_types.h"
+
+// Port the metrics are sent from, and the collector's port by default
+// (InfluxDB's UDP listener)
+#define INFLUX_PORT      (7013)
+#define INFLUX_DEST_PORT (8089)
+
+#define INFLUX_PERIOD_MS (1000)
+
+// Longest line a template can make, values, host tag and timestamp
+// included
+#define INFLUX_LINE_MAX  (256)
+
+// As stored: the address in network order, 0 for none
+struct influx_dest {
+  u32 ip;
+  u16 port;
+  u16 pad;
+};
+
+struct influx_stats {
+  u32 datagrams;
+  u32 lines;
+  u32 bytes;
+  // Datagrams lwIP would not send
+  u32 errors;
+  // Timer cycles the last period's formatting took
+  u32 cycles;
+};
+
+// Load the saved collector and start exporting, tagged with the host name
+// of `netif`'s MAC.  Call after lwip_init(), init_kv() and netif_add().
+void init_influx(struct netif *netif);
+
+// Export to `ip`:`port`, or stop if `ip` is NULL or any.  Takes effect at
+// the next period and is saved in the background.
+void influx_set_dest(const ip4_addr_t *ip, u16 port);
+
+const struct influx_dest *influx_dest();
+
+const struct influx_stats *influx_stats();
+
+#endif // _INFLUX_H_
@@ -0,0 +1,358 @@
+// intr.c - microblaze_0_axi_intc setup and interrupt helpers.
+
+#include "xparameters.h"
+#include "xil_printf.h"
+#include "xintc.h"
+#include "mb_interface.h"
+
+#include "intr.h"
+#include "perf.h"
+#include "timebase.h"
+
+// MSR interrupt enable bit
+#define MSR_IE (0x2)
+
+static XIntc xintc;
+
+static struct {
+  XInterruptHandler handler;
+  void *ref;
+} source[INTR_MAX];
+
+static struct intr_stats stats[INTR_MAX];
+
+// Sources as intr_enable() and intr_disable() left them, those masked by
+// the handlers in progress, and those each source's handler masks
+static u32 enabled;
+static u32 blocked;
+static u32 blocks[INTR_MAX];
+
+static u32 lat_count;
+static u32 lat_min;
+static u32 lat_max;
+static u64 lat_sum;
+static u32 lat_max_pc;
+
+// Recording histograms, and the last latency for the jitter
+static u8 diag;
+static u8 diag_prev_valid;
+static u32 diag_prev;
+
+void
+init_intr()
+{
+    XIntc_Initialize(&xintc, XPAR_INTC_0_DEVICE_ID);
+
+    // Dispatch every pending source on each interrupt
+    XIntc_SetOptions(&xintc, XIN_SVC_ALL_ISRS_OPTION);
+
+    // Start in real mode so sources can interrupt the CPU
+    XIntc_Start(&xintc, XIN_REAL_MODE);
+
+    microblaze_register_handler(
+        (XInterruptHandler)XIntc_InterruptHandler, &xintc);
+    microblaze_enable_interrupts();
+}
+
+// Run source `id`'s handler and count it
+static inline __attribute__((always_inline)) void
+intr_dispatch(u32 id)
+{
+  struct intr_stats *s = &stats[id];
+  u32 t = timebase_stamp();
+
+  source[id].handler(source[id].ref);
+  t = timebase_stamp() - t;
+  s->count++;
+  s->cycles += t;
+  if(t > s->max_cycles) {
+    s->max_cycles = t;
+  }
+}
+
+static void
+intr_write_ier()
+{
+  XIntc_EnableIntr(XPAR_INTC_0_BASEADDR, enabled & ~blocked);
+}
+
+// Work out which sources each normal source's handler masks
+static void
+intr_set_blocks()
+{
+  u32 id, n;
+
+  for(id=0; id<INTR_MAX; id++) {
+    blocks[id] = 1 << id;
+    for(n=0; n<INTR_MAX; n++) {
+      if(stats[n].connected && !stats[n].fast &&
+         stats[n].prio <= stats[id].prio) {
+        blocks[id] |= 1 << n;
+      }
+    }
+  }
+}
+
+// XIntc_InterruptHandler()'s entry for every source, its id in `ref`
+static void
+intr_normal(void *ref)
+{
+  u32 id = (u32)ref;
+#if INTR_NEST
+  u32 prev = blocked, ret;
+
+  blocked |= blocks[id];
+  intr_write_ier();
+  // An interrupt taken in the handler overwrites r14, the return address
+  ret = mfgpr(r14);
+  microblaze_enable_interrupts();
+  intr_dispatch(id);
+  microblaze_disable_interrupts();
+  mtgpr(r14, ret);
+  blocked = prev;
+  intr_write_ier();
+#else
+  intr_dispatch(id);
+#endif
+}
+
+#if INTR_FAST
+// Vectors of the fast sources.  The attribute makes each save the registers
+// it uses, here those a call may clobber, and return with rtid.
+#define INTR_FAST_ENTRY(n) \
+  static void __attribute__((fast_interrupt)) \
+  intr_fast_##n() \
+  { \
+    intr_dispatch(n); \
+  }
+
+INTR_FAST_ENTRY(0)
+INTR_FAST_ENTRY(1)
+INTR_FAST_ENTRY(2)
+INTR_FAST_ENTRY(3)
+#if INTR_MAX > 4
+INTR_FAST_ENTRY(4)
+INTR_FAST_ENTRY(5)
+INTR_FAST_ENTRY(6)
+INTR_FAST_ENTRY(7)
+#endif
+
+// Sources past the last entry are connected the normal way
+static const XFastInterruptHandler fast_entry[] = {
+  intr_fast_0, intr_fast_1, intr_fast_2, intr_fast_3,
+#if INTR_MAX > 4
+  intr_fast_4, intr_fast_5, intr_fast_6, intr_fast_7
+#endif
+};
+
+#define INTR_FAST_MAX (sizeof(fast_entry) / sizeof(fast_entry[0]))
+#endif // INTR_FAST
+
+// Connect `handler` to INTC input `id` and enable the input.
+//
+// Returns XST_SUCCESS on success.
+int
+intr_connect(u8 id, XInterruptHandler handler, void *ref)
+{
+  int status;
+
+  if(id >= INTR_MAX) {
+    return XST_INVALID_PARAM;
+  }
+  source[id].handler = handler;
+  source[id].ref = ref;
+  status = XIntc_Connect(&xintc, id, intr_normal, (void *)(u32)id);
+  if(status == XST_SUCCESS) {
+    stats[id].connected = 1;
+    intr_set_blocks();
+    intr_enable(id);
+  }
+
+  return status;
+}
+
+int
+intr_connect_fast(u8 id, XInterruptHandler handler, void *ref)
+{
+#if INTR_FAST
+  int status;
+
+  if(id >= INTR_MAX || id >= INTR_FAST_MAX) {
+    intr_set_prio(id, INTR_PRIO_FAST);
+    return intr_connect(id, handler, ref);
+  }
+  source[id].handler = handler;
+  source[id].ref = ref;
+  status = XIntc_ConnectFastHandler(&xintc, id, fast_entry[id]);
+  if(status == XST_SUCCESS) {
+    stats[id].connected = 1;
+    stats[id].fast = 1;
+    stats[id].prio = INTR_PRIO_FAST;
+    intr_set_blocks();
+    intr_enable(id);
+  }
+  return status;
+#else
+  intr_set_prio(id, INTR_PRIO_FAST);
+  return intr_connect(id, handler, ref);
+#endif
+}
+
+void
+intr_set_prio(u8 id, u8 prio)
+{
+  u32 msr;
+
+  if(id >= INTR_MAX) {
+    return;
+  }
+  msr = intr_lock();
+  stats[id].prio = prio;
+  intr_set_blocks();
+  intr_unlock(msr);
+}
+
+void
+intr_enable(u8 id)
+{
+  u32 msr = intr_lock();
+
+  enabled |= 1 << id;
+  intr_write_ier();
+  intr_unlock(msr);
+}
+
+void
+intr_disable(u8 id)
+{
+  u32 msr = intr_lock();
+
+  enabled &= ~(1 << id);
+  intr_write_ier();
+  intr_unlock(msr);
+}
+
+const struct intr_stats *
+intr_stats(u8 id)
+{
+  return id < INTR_MAX ? &stats[id] : NULL;
+}
+
+void
+intr_note_latency(u32 cycles, u32 pc)
+{
+  if(lat_count == 0 || cycles < lat_min) {
+    lat_min = cycles;
+  }
+  if(cycles > lat_max) {
+    lat_max = cycles;
+    lat_max_pc = pc;
+  }
+  lat_sum += cycles;
+  lat_count++;
+
+#if PERF_ENABLE
+  if(diag) {
+    perf_record(PERF_TICK_LAT, cycles);
+    if(diag_prev_valid) {
+      perf_record(PERF_TICK_JIT, cycles > diag_prev ?
+          cycles - diag_prev : diag_prev - cycles);
+    }
+    diag_prev = cycles;
+    diag_prev_valid = 1;
+  }
+#endif
+}
+
+void
+intr_latency(u32 *min, u32 *mean, u32 *max, u32 *pc)
+{
+  u32 msr = intr_lock();
+
+  *min = lat_min;
+  *mean = lat_count ? lat_sum / lat_count : 0;
+  *max = lat_max;
+  *pc = lat_max_pc;
+  intr_unlock(msr);
+}
+
+int
+intr_diag(int on)
+{
+#if PERF_ENABLE
+  u32 msr;
+
+  if(on) {
+    perf_clear(PERF_TICK_LAT);
+    perf_clear(PERF_TICK_JIT);
+  }
+  msr = intr_lock();
+  if(on) {
+    lat_count = 0;
+    lat_max = 0;
+    lat_sum = 0;
+    lat_max_pc = 0;
+    diag_prev_valid = 0;
+  }
+  diag = on != 0;
+  intr_unlock(msr);
+  return 0;
+#else
+  return -1;
+#endif
+}
+
+int
+intr_diag_running()
+{
+  return diag;
+}
+
+u32
+intr_lock()
+{
+  u32 msr = mfmsr();
+
+  microblaze_disable_interrupts();
+
+  return msr;
+}
+
+void
+intr_unlock(u32 msr)
+{
+  if(msr & MSR_IE) {
+    microblaze_enable_interrupts();
+  }
+}
+
+void
+intr_wait()
+{
+  // mbar 16 puts the core to sleep until an interrupt wakes it
+  // (XPAR_MICROBLAZE_0_ASYNC_WAKEUP), which is then taken straight away.
+  // One arriving between the two instructions is taken before the sleep,
+  // so it is the next one (at worst the 1 ms tick) that wakes us.
+  microblaze_enable_interrupts();
+  __asm__ volatile ("mbar 16" ::: "memory");
+}
+
+void
+dump_intr()
+{
+  const struct intr_stats *s;
+  u32 id, min, mean, max, pc;
+
+  intr_latency(&min, &mean, &max, &pc);
+  xil_printf("Interrupts: tick entry latency %d/%d/%d cycles "
+      "min/mean/max, slowest at pc %08x\n", min, mean, max, pc);
+  for(id=0; id<INTR_MAX; id++) {
+    s = &stats[id];
+    if(!s->connected) {
+      continue;
+    }
+    xil_printf("  %d: %s, priority %d, %d taken, %d cycles mean, %d max\n",
+        id, s->fast ? "fast" : "normal", s->prio, s->count,
+        s->count ? (u32)(s->cycles / s->count) : 0, s->max_cycles);
+  }
+}
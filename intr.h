@@ -0,0 +1,120 @@
+#ifndef _INTR_H_
+#define _INTR_H_
+
+// intr.h - microblaze_0_axi_intc setup and interrupt helpers.
+//
+// Sources connected with intr_connect() go the BSP's way: the processor's
+// one interrupt vector saves every volatile register and calls
+// XIntc_InterruptHandler(), which looks each pending source up in its
+// table.  Where the INTC has a fast interrupt interface (XPAR_INTC_0_HAS_FAST)
+// and INTR_FAST is set, intr_connect_fast() puts a source in hardware
+// vector mode instead: the INTC hands the processor the address of an
+// entry stub of the source's own, which saves only what the C handler may
+// clobber and calls it, and the INTC is acknowledged in hardware.  The
+// latency-critical sources, the 1 ms tick and the SPI fifo, are connected
+// that way.
+//
+// Each source's interrupts and the timer cycles its handler takes are
+// counted.  Entry latency, from the line rising to the handler's first
+// instruction, is measured on the tick, where the timer's count gives the
+// moment it fired; every fast source goes through the same path.  The PC
+// the slowest tick interrupted is kept too: a long wait is almost always a
+// stretch with interrupts masked, and the tick is taken right where it
+// ends, so the PC names the code that held it off.
+//
+// With INTR_NEST set, a handler connected with intr_connect() runs with
+// interrupts enabled and, in the INTC, its own source and every normal
+// source of no higher priority masked, so sources of higher priority
+// preempt it.  The INTC's built-in order (input 0, the UART, first) is
+// ignored.  Housekeeping sources (the console, XADC alarms) stay at
+// INTR_PRIO_LOW, data path sources such as the CDMA are raised to
+// INTR_PRIO_HIGH, and the fast sources run with interrupts masked above
+// both, so their worst-case latency does not depend on a slow housekeeping
+// handler.  Each level can add one handler's frame to the one stack
+// (stack.h).  Code a handler shares with one of higher priority must
+// mask interrupts around it, as work.h and log.h do.
+//
+// intr_diag() adds log2 histograms of the tick's latency and jitter, as
+// perf.h sites read with tools/perf.py --hist.  The tick keeps its 1 ms
+// period, so the histograms sample whatever the network, flash and other
+// handlers were doing at the time.
+
+#include "xil_types.h"
+#include "xil_exception.h"
+#include "xparameters.h"
+
+#ifndef INTR_FAST
+#ifdef XPAR_INTC_0_HAS_FAST
+#define INTR_FAST (XPAR_INTC_0_HAS_FAST)
+#else
+#define INTR_FAST (0)
+#endif
+#endif
+
+#ifndef INTR_NEST
+#define INTR_NEST (1)
+#endif
+
+// Priorities, lowest first.  INTR_PRIO_FAST is what intr_connect_fast()
+// gives a source it has to connect the normal way.
+#define INTR_PRIO_LOW  (0)
+#define INTR_PRIO_HIGH (1)
+#define INTR_PRIO_FAST (2)
+
+// Sources the statistics cover
+#define INTR_MAX (XPAR_INTC_0_NUM_INTR_INPUTS)
+
+struct intr_stats {
+  u8 connected;
+  u8 fast;
+  u8 prio;
+  u32 count;
+  // Timer cycles in the handler, in all and the most one took
+  u64 cycles;
+  u32 max_cycles;
+};
+
+void init_intr();
+int intr_connect(u8 id, XInterruptHandler handler, void *ref);
+void intr_enable(u8 id);
+void intr_disable(u8 id);
+
+// Like intr_connect(), in hardware vector mode if INTR_FAST is set
+int intr_connect_fast(u8 id, XInterruptHandler handler, void *ref);
+
+// Set the priority of normal source `id` (INTR_PRIO_LOW by default)
+void intr_set_prio(u8 id, u8 prio);
+
+// Statistics of source `id`, or NULL if it is out of range
+const struct intr_stats *intr_stats(u8 id);
+
+// Note an entry latency of `cycles` timer cycles, interrupting `pc`
+// (timebase.c, on the tick)
+void intr_note_latency(u32 cycles, u32 pc);
+
+// Fewest, mean and most entry latency cycles so far (0 before the first),
+// and the PC the slowest entry interrupted
+void intr_latency(u32 *min, u32 *mean, u32 *max, u32 *pc);
+
+// Start (`on` non-zero) or stop recording every tick's entry latency in
+// perf.h's PERF_TICK_LAT histogram, and its change from the tick before in
+// PERF_TICK_JIT.  Starting clears both and the figures above.
+//
+// Returns 0, or -1 if perf.h is compiled out (PERF_ENABLE 0).
+int intr_diag(int on);
+
+// Non-zero while intr_diag() is recording
+int intr_diag_running();
+
+// Mask/unmask CPU interrupts around a critical section.  intr_lock returns
+// the previous MSR so critical sections may nest.
+u32 intr_lock();
+void intr_unlock(u32 msr);
+
+// Enable interrupts and sleep the CPU until one arrives
+void intr_wait();
+
+// Print the sources' statistics and the entry latency
+void dump_intr();
+
+#endif // _INTR_H_
@@ -0,0 +1,96 @@
+// iperf.c - TCP throughput benchmark on lwIP's iperf2 implementation.
+
+#include "lwip/apps/lwiperf.h"
+
+#include "iperf.h"
+#include "log.h"
+#include "quota.h"
+#include "sched.h"
+#include "timebase.h"
+
+// lwiperf handles, NULL when not running
+static void *server;
+static void *client;
+
+static struct iperf_result last;
+
+// Load counters as the last session started timing
+static u64 start_cycles;
+static u64 start_idle;
+
+void
+iperf_started()
+{
+  start_cycles = timebase_cycles();
+  start_idle = sched_idle_cycles();
+}
+
+// `arg` is &client for the client session
+static void
+iperf_report(void *arg, enum lwiperf_report_type type,
+    const ip_addr_t *local_addr, u16_t local_port,
+    const ip_addr_t *remote_addr, u16_t remote_port,
+    u32_t bytes, u32_t ms, u32_t kbps)
+{
+  u64 busy = (timebase_cycles() - start_cycles) -
+      (sched_idle_cycles() - start_idle);
+
+  if(arg == &client) {
+    client = NULL;
+  }
+
+  last.runs++;
+  last.type = type;
+  last.bytes = bytes;
+  last.ms = ms;
+  last.kbps = kbps;
+  last.cycles_per_kb = bytes ? (u32)(busy * 1000 / bytes) : 0;
+
+  if(type != LWIPERF_TCP_DONE_SERVER && type != LWIPERF_TCP_DONE_CLIENT) {
+    LOG("iperf: session aborted (%u)", type);
+  }
+  LOG("iperf: %u bytes in %u ms, %u kbit/s, %u busy cycles/kB", bytes, ms,
+      kbps, last.cycles_per_kb);
+}
+
+int
+iperf_server(int on)
+{
+  if(on && !server) {
+    server = lwiperf_start_tcp_server(IP4_ADDR_ANY, IPERF_PORT, iperf_report,
+        NULL);
+    if(!server) {
+      return -1;
+    }
+    quota_listen(IPERF_PORT, QUOTA_BULK);
+  } else if(!on && server) {
+    lwiperf_abort(server);
+    server = NULL;
+  }
+  return 0;
+}
+
+int
+iperf_server_on()
+{
+  return server != NULL;
+}
+
+int
+iperf_client(u32 ip, u16 port, u32 ms)
+{
+  ip_addr_t addr;
+
+  if(client) {
+    return -1;
+  }
+  ip_addr_set_ip4_u32(&addr, ip);
+  client = lwiperf_start_tcp_client(&addr, port, ms, iperf_report, &client);
+  return client ? 0 : -1;
+}
+
+const struct iperf_result *
+iperf_last()
+{
+  return &last;
+}
@@ -0,0 +1,57 @@
+#ifndef _IPERF_H_
+#define _IPERF_H_
+
+// iperf.h - TCP throughput benchmark on lwIP's iperf2 implementation.
+//
+// With the server on, "iperf -c <board>" on a host measures how fast the
+// stack and the eth0 driver sink TCP data, and "-r" or "-d" has the board
+// send back.  iperf_client() has the board send to an "iperf -s" instead.
+// Both are switched at runtime, from KATCP's ?iperf (see katcp.h).
+//
+// Each finished session is logged (see log.h) with its throughput and the
+// CPU it took: the main loop's busy timer cycles (everything but
+// sched_idle_cycles()) per 1000 bytes moved, from the moment the session
+// starts timing.  Sessions running at once (iperf -d) share the count.
+//
+// arch/cc.h includes this for lwipopts.h's LWIPERF_START_HOOK, so it
+// includes no lwIP headers.
+
+#include "xil_types.h"
+
+// The port iperf2 uses by default, on both ends
+#define IPERF_PORT (5001)
+
+// Length of a client test unless given
+#define IPERF_CLIENT_MS (10000)
+
+struct iperf_result {
+  // Sessions finished since boot; the rest is from the last of them
+  u32 runs;
+  // enum lwiperf_report_type: 0 and 1 are done, the rest aborted
+  u32 type;
+  u32 bytes;
+  u32 ms;
+  u32 kbps;
+  // Busy timer cycles per 1000 bytes
+  u32 cycles_per_kb;
+};
+
+// Start (`on` non-zero) or stop the server.  Returns 0, or -1 if it could
+// not be started.
+int iperf_server(int on);
+
+// Non-zero while the server is listening
+int iperf_server_on();
+
+// Send to the iperf server at `ip` (network byte order), port `port`, for
+// `ms` milliseconds.  Returns 0 once connecting, or -1 if a client test is
+// already running or it could not be started.
+int iperf_client(u32 ip, u16 port, u32 ms);
+
+// Results of the last session to finish
+const struct iperf_result *iperf_last();
+
+// Take the load counters for the session starting now.  Called by lwiperf.
+void iperf_started();
+
+#endif // _IPERF_H_
@@ -0,0 +1,2752 @@
+// katcp.c - KATCP control server.
+//
+// Request lines are parsed where they lie in the receive pbuf when they
+// fit in one, and copied to the connection's line buffer only when they
+// straddle two.  Arguments are split and unescaped in place.  A reply is
+// built in a static buffer and handed to tcp_write() whole; a request is
+// only taken once the send buffer has room for the largest reply, so
+// pipelined requests beyond that wait in the receive pbufs and are picked
+// up as acknowledgements free the send buffer.  ?listdev can outgrow the
+// buffer and goes out a buffer at a time.
+
+#include <string.h>
+
+#include "lwip/netif.h"
+#include "lwip/tcp.h"
+#include "lwip/mem.h"
+#include "lwip/memp.h"
+#include "netif/ethernetif.h"
+
+#include "arpcfg.h"
+#include "bbox.h"
+#include "bench.h"
+#include "boot.h"
+#include "bswap.h"
+#include "crash.h"
+#include "ethport.h"
+#include "fabric.h"
+#include "flowctl.h"
+#include "ethloop.h"
+#include "ftrace.h"
+#include "fmt.h"
+#include "icap.h"
+#include "influx.h"
+#include "intr.h"
+#include "iperf.h"
+#include "katcp.h"
+#include "load.h"
+#include "log.h"
+#include "netcfg.h"
+#include "pcprof.h"
+#include "preset.h"
+#include "ptp.h"
+#include "quota.h"
+#include "scrub.h"
+#include "snmptrap.h"
+#include "slots.h"
+#include "sntpclock.h"
+#include "stack.h"
+#include "stream.h"
+#include "tcprx.h"
+#include "telbuf.h"
+#include "telpush.h"
+#include "throttle.h"
+#include "timebase.h"
+#include "timer.h"
+#include "udpflow.h"
+#include "warm.h"
+#include "wdog.h"
+#include "wbbus.h"
+#include "wbmap.h"
+#include "wbreg.h"
+#include "wbshadow.h"
+#include "wbtimed.h"
+#include "websock.h"
+#include "xadc.h"
+#include "xadccal.h"
+
+// Largest reply: an escaped KATCP_READ_MAX ?read and its framing
+#define KATCP_OUT_SIZE (2 * KATCP_READ_MAX + 64)
+// Longest message id kept for a ?listdev
+#define KATCP_ID_MAX (12)
+// Arguments of a request, and the words of a ?wordread
+#define KATCP_MAX_ARGS (8)
+#define KATCP_WORDS_MAX (64)
+// Room one #listdev line can need
+#define KATCP_LISTDEV_LINE (2 * WBMAP_NAME_MAX + 64)
+
+// ?listdev variants
+#define LISTDEV_NAME   (0)
+#define LISTDEV_SIZE   (1)
+#define LISTDEV_DETAIL (2)
+
+struct katcp_conn {
+  struct tcp_pcb *pcb; // NULL for a free slot
+  struct tcprx rx;
+  // Dropping the rest of an overlong line
+  u8 skip;
+  // ?listdev in progress: next device (-1 for none), variant and id
+  s32 list_next;
+  u8 list_mode;
+  char list_id[KATCP_ID_MAX];
+  // Lines that straddle pbufs, and room for a terminating NUL
+  char line[KATCP_LINE_MAX + 1];
+};
+
+struct katcp_req {
+  const char *name;
+  // Message id, "" for none
+  const char *id;
+  u32 argc;
+  char *argv[KATCP_MAX_ARGS];
+  u32 argl[KATCP_MAX_ARGS];
+};
+
+struct katcp_sensor {
+  const char *name;
+  u32 ch;
+  // Nominal range, mC or mV
+  s32 lo, hi;
+};
+
+static const struct katcp_sensor sensors[] = {
+  { "fpga.temperature", XADC_TEMP, -40000, XADC_TEMP_HI_MC },
+  { "fpga.vccint", XADC_VCCINT, XADC_VCCINT_LO_MV, XADC_VCCINT_HI_MV },
+  { "fpga.vccaux", XADC_VCCAUX, XADC_VCCAUX_LO_MV, XADC_VCCAUX_HI_MV },
+  { "fpga.vbram", XADC_VBRAM, XADC_VBRAM_LO_MV, XADC_VBRAM_HI_MV },
+};
+
+#define NUM_SENSORS (sizeof(sensors) / sizeof(sensors[0]))
+
+static struct katcp_conn conns[KATCP_CLIENTS];
+
+// Reply being built
+static char out[KATCP_OUT_SIZE];
+static u32 out_len;
+
+// Data of a ?read or ?wordread, in words so either fits
+static u32 stage[KATCP_READ_MAX / 4];
+
+static void
+out_char(char c)
+{
+  if(out_len < sizeof(out)) {
+    out[out_len++] = c;
+  }
+}
+
+static void
+out_str(const char *s)
+{
+  while(*s) {
+    out_char(*s++);
+  }
+}
+
+// `len` bytes of `s`, escaped as a KATCP argument
+static void
+out_esc(const u8 *s, u32 len)
+{
+  static const char from[] = { '\\', ' ', '\0', '\n', '\r', 0x1b, '\t' };
+  static const char to[] = { '\\', '_', '0', 'n', 'r', 'e', 't' };
+  const char *e;
+
+  if(!len) {
+    out_str("\\@");
+  }
+  for(; len; len--, s++) {
+    e = memchr(from, *s, sizeof(from));
+    if(e) {
+      out_char('\\');
+      out_char(to[e - from]);
+    } else {
+      out_char(*s);
+    }
+  }
+}
+
+static void
+out_udec(u32 v)
+{
+  char buf[10];
+  u32 n = 0;
+
+  do {
+    buf[n++] = '0' + v % 10;
+    v /= 10;
+  } while(v);
+  while(n) {
+    out_char(buf[--n]);
+  }
+}
+
+static void
+out_dec(s32 v)
+{
+  if(v < 0) {
+    out_char('-');
+  }
+  out_udec(v < 0 ? -v : v);
+}
+
+static void
+out_hex(u32 v)
+{
+  static const char digits[] = "0123456789abcdef";
+  int i;
+
+  out_str("0x");
+  for(i=28; i>=0; i-=4) {
+    out_char(digits[(v >> i) & 15]);
+  }
+}
+
+// A MAC address as aa:bb:cc:dd:ee:ff
+static void
+out_mac(const u8 *mac)
+{
+  static const char digits[] = "0123456789abcdef";
+  int i;
+
+  for(i=0; i<6; i++) {
+    if(i) {
+      out_char(':');
+    }
+    out_char(digits[mac[i] >> 4]);
+    out_char(digits[mac[i] & 15]);
+  }
+}
+
+// `v` thousandths as a decimal
+static void
+out_milli(s32 v)
+{
+  char buf[FMT_FIXED_MAX];
+
+  out_str(fmt_fixed(buf, v, 1000, 3));
+}
+
+// Start a reply ('!') or inform ('#') to `r`
+static void
+out_begin(char type, const struct katcp_req *r)
+{
+  out_char(type);
+  out_str(r->name);
+  if(r->id[0]) {
+    out_char('[');
+    out_str(r->id);
+    out_char(']');
+  }
+}
+
+// A whole reply with result `code` and an optional reason
+static void
+out_reply(const struct katcp_req *r, const char *code, const char *reason)
+{
+  out_begin('!', r);
+  out_char(' ');
+  out_str(code);
+  if(reason) {
+    out_char(' ');
+    out_str(reason);
+  }
+  out_char('\n');
+}
+
+// Queue the reply.  katcp_input() made sure there is room.
+static void
+katcp_flush(struct tcp_pcb *pcb)
+{
+  if(out_len) {
+    tcp_write(pcb, out, out_len, TCP_WRITE_FLAG_COPY);
+    out_len = 0;
+  }
+}
+
+// Undo KATCP escapes in the `len` bytes at `s`.  Returns the new length.
+static u32
+katcp_unescape(char *s, u32 len)
+{
+  static const char from[] = { '\\', '_', '0', 'n', 'r', 'e', 't', '@' };
+  static const char to[] = { '\\', ' ', '\0', '\n', '\r', 0x1b, '\t' };
+  const char *e;
+  u32 i, n = 0;
+
+  for(i=0; i<len; i++) {
+    if(s[i] != '\\' || i + 1 == len) {
+      s[n++] = s[i];
+      continue;
+    }
+    e = memchr(from, s[++i], sizeof(from));
+    if(!e) {
+      s[n++] = s[i];
+    } else if(*e != '@') {
+      s[n++] = to[e - from];
+    }
+    // "\@" is the empty argument: nothing
+  }
+  return n;
+}
+
+// Parse decimal or 0x-prefixed hex.  Returns 0 on success, -1 if `s` is
+// not a number.
+static int
+katcp_number(const char *s, u32 len, u32 *v)
+{
+  u32 base = 10, d;
+
+  if(len > 2 && s[0] == '0' && (s[1] == 'x' || s[1] == 'X')) {
+    base = 16;
+    s += 2;
+    len -= 2;
+  }
+  if(!len) {
+    return -1;
+  }
+  for(*v=0; len; len--, s++) {
+    if(*s >= '0' && *s <= '9') {
+      d = *s - '0';
+    } else if(base == 16 && (*s | 0x20) >= 'a' && (*s | 0x20) <= 'f') {
+      d = (*s | 0x20) - 'a' + 10;
+    } else {
+      return -1;
+    }
+    *v = *v * base + d;
+  }
+  return 0;
+}
+
+// Parse a MAC address written as six colon-separated hex bytes.  Returns
+// 0 on success, -1 if `s` is not one.
+static int
+katcp_mac(const char *s, u8 *mac)
+{
+  u32 i, n, v;
+
+  for(i=0; i<6; i++) {
+    for(n=0; s[n] && s[n] != ':'; n++)
+      ;
+    if(n < 1 || n > 2 || (s[n] != ':') != (i == 5)) {
+      return -1;
+    }
+    // Bare hex digits, which katcp_number() only takes after a 0x
+    for(v=0; n; n--, s++) {
+      if(*s >= '0' && *s <= '9') {
+        v = v * 16 + *s - '0';
+      } else if((*s | 0x20) >= 'a' && (*s | 0x20) <= 'f') {
+        v = v * 16 + (*s | 0x20) - 'a' + 10;
+      } else {
+        return -1;
+      }
+    }
+    mac[i] = v;
+    s++;
+  }
+  return 0;
+}
+
+// The device named by argument `n` of `r`, with `mode` access, or NULL
+// after replying why not
+static const struct wbmap_entry *
+katcp_dev(const struct katcp_req *r, u32 n, u32 mode)
+{
+  const struct wbmap_entry *e = wbmap_find(r->argv[n]);
+  u32 can;
+
+  if(!e) {
+    out_reply(r, "fail", "unknown\\_device");
+    return NULL;
+  }
+  // A mirrored device reads back from its mirror, even write-only
+  can = e->mode & WBMAP_MODE_SHADOW ? e->mode | WBMAP_MODE_R : e->mode;
+  if((can & mode) != mode) {
+    out_reply(r, "fail",
+        mode == WBMAP_MODE_R ? "write\\_only" : "read\\_only");
+    e = NULL;
+  }
+  return e;
+}
+
+// Argument `n` of `r` as a number into `v`.  Returns 0 on success, -1
+// after replying if it is not one.
+static int
+katcp_arg(const struct katcp_req *r, u32 n, u32 *v)
+{
+  if(katcp_number(r->argv[n], r->argl[n], v) != 0) {
+    out_reply(r, "invalid", "bad\\_number");
+    return -1;
+  }
+  return 0;
+}
+
+// Argument `n` of `r` as a signed number, an optional '-' then what
+// katcp_arg() takes, into `v`.  Returns 0 on success, -1 after replying if
+// it is not one.
+static int
+katcp_signed_arg(const struct katcp_req *r, u32 n, s32 *v)
+{
+  u32 neg = r->argv[n][0] == '-', mag;
+
+  if(katcp_number(r->argv[n] + neg, r->argl[n] - neg, &mag) != 0 ||
+     mag > 0x7fffffff) {
+    out_reply(r, "invalid", "bad\\_number");
+    return -1;
+  }
+  *v = neg ? -(s32)mag : (s32)mag;
+  return 0;
+}
+
+// Check that `len` units of `unit` bytes from unit `off` on lie within
+// `e`, replying if not
+static int
+katcp_range(const struct katcp_req *r, const struct wbmap_entry *e, u32 off,
+    u32 len, u32 unit)
+{
+  if(off > e->size / unit || len > e->size / unit - off) {
+    out_reply(r, "fail", "out\\_of\\_range");
+    return -1;
+  }
+  return 0;
+}
+
+static void
+katcp_wordread(struct katcp_conn *c, const struct katcp_req *r)
+{
+  const struct wbmap_entry *e;
+  struct wbbus_op run;
+  u32 off, count = 1, addr, i;
+
+  if(r->argc < 3 || r->argc > 4) {
+    out_reply(r, "invalid", "usage:\\_name\\_offset\\_[count]");
+    return;
+  }
+  if(!(e = katcp_dev(r, 1, WBMAP_MODE_R)) || katcp_arg(r, 2, &off) != 0 ||
+     (r->argc > 3 && katcp_arg(r, 3, &count) != 0)) {
+    return;
+  }
+  if(count == 0 || count > KATCP_WORDS_MAX) {
+    out_reply(r, "invalid", "bad\\_count");
+    return;
+  }
+  if(katcp_range(r, e, off, count, 4) != 0) {
+    return;
+  }
+
+  // Read whole before any of it is queued, so a bus error can fail it
+  addr = e->offset + off * 4;
+  wbbus_begin(&run, addr);
+  for(i=0; i<count; i++, addr+=4) {
+    stage[i] = wbshadow_read(addr);
+  }
+  if(wbbus_end(&run, count) != 0) {
+    out_reply(r, "fail", "bus\\_error");
+    return;
+  }
+  out_begin('!', r);
+  out_str(" ok");
+  for(i=0; i<count; i++) {
+    out_char(' ');
+    out_hex(stage[i]);
+  }
+  out_char('\n');
+}
+
+static void
+katcp_wordwrite(struct katcp_conn *c, const struct katcp_req *r)
+{
+  const struct wbmap_entry *e;
+  struct wbbus_op run;
+  u32 off, value;
+
+  if(r->argc != 4) {
+    out_reply(r, "invalid", "usage:\\_name\\_offset\\_value");
+    return;
+  }
+  if(!(e = katcp_dev(r, 1, WBMAP_MODE_W)) || katcp_arg(r, 2, &off) != 0 ||
+     katcp_arg(r, 3, &value) != 0) {
+    return;
+  }
+  if(katcp_range(r, e, off, 1, 4) != 0) {
+    return;
+  }
+  wbbus_begin(&run, e->offset + off * 4);
+  wbshadow_write(e->offset + off * 4, value);
+  if(wbbus_end(&run, 1) != 0) {
+    out_reply(r, "fail", "bus\\_error");
+    return;
+  }
+  out_reply(r, "ok", NULL);
+}
+
+static void
+katcp_read(struct katcp_conn *c, const struct katcp_req *r)
+{
+  const struct wbmap_entry *e;
+  struct wbbus_op run;
+  u32 off, len, addr, word, i, k;
+
+  if(r->argc != 4) {
+    out_reply(r, "invalid", "usage:\\_name\\_offset\\_length");
+    return;
+  }
+  if(!(e = katcp_dev(r, 1, WBMAP_MODE_R)) || katcp_arg(r, 2, &off) != 0 ||
+     katcp_arg(r, 3, &len) != 0 || katcp_range(r, e, off, len, 1) != 0) {
+    return;
+  }
+  if(len > KATCP_READ_MAX) {
+    out_reply(r, "fail", "too\\_long");
+    return;
+  }
+
+  // Whole words, in big-endian byte order
+  addr = e->offset + off;
+  wbbus_begin(&run, addr);
+  for(i=0; i<len; i+=k, addr+=k) {
+    word = swap32(wbshadow_read(addr & ~3));
+    k = 4 - (addr & 3);
+    if(k > len - i) {
+      k = len - i;
+    }
+    memcpy((u8 *)stage + i, (u8 *)&word + (addr & 3), k);
+  }
+  if(wbbus_end(&run, (len + 3) >> 2) != 0) {
+    out_reply(r, "fail", "bus\\_error");
+    return;
+  }
+
+  out_begin('!', r);
+  out_str(" ok ");
+  out_esc((const u8 *)stage, len);
+  out_char('\n');
+}
+
+static void
+katcp_write(struct katcp_conn *c, const struct katcp_req *r)
+{
+  const struct wbmap_entry *e;
+  const u8 *src;
+  struct wbbus_op run;
+  u32 off, len, addr, word = 0, k;
+
+  if(r->argc != 4) {
+    out_reply(r, "invalid", "usage:\\_name\\_offset\\_data");
+    return;
+  }
+  if(!(e = katcp_dev(r, 1, WBMAP_MODE_W)) || katcp_arg(r, 2, &off) != 0 ||
+     katcp_range(r, e, off, r->argl[3], 1) != 0) {
+    return;
+  }
+
+  // Partial words at either end keep their other bytes
+  addr = e->offset + off;
+  src = (const u8 *)r->argv[3];
+  wbbus_begin(&run, addr);
+  for(len=r->argl[3]; len && !wbbus_failed(); len-=k, src+=k, addr+=k) {
+    k = 4 - (addr & 3);
+    if(k > len) {
+      k = len;
+    }
+    if(k < 4) {
+      word = swap32(wbshadow_read(addr & ~3));
+    }
+    memcpy((u8 *)&word + (addr & 3), src, k);
+    wbshadow_write(addr & ~3, swap32(word));
+  }
+  if(wbbus_end(&run, (r->argl[3] + 3) >> 2) != 0) {
+    out_reply(r, "fail", "bus\\_error");
+    return;
+  }
+  out_reply(r, "ok", NULL);
+}
+
+// Queue a buffer's worth of the ?listdev in progress, and its reply once
+// it is done
+static void
+katcp_listdev_more(struct katcp_conn *c)
+{
+  const struct wbmap_entry *e;
+  struct katcp_req r;
+
+  r.name = "listdev";
+  r.id = c->list_id;
+  while((e = wbmap_get(c->list_next)) &&
+        out_len + KATCP_LISTDEV_LINE <= sizeof(out)) {
+    out_begin('#', &r);
+    out_char(' ');
+    out_str(e->name);
+    if(c->list_mode == LISTDEV_DETAIL) {
+      out_char(' ');
+      out_hex(e->offset);
+    }
+    if(c->list_mode != LISTDEV_NAME) {
+      out_char(' ');
+      out_udec(e->size);
+    }
+    out_char('\n');
+    c->list_next++;
+  }
+  if(!e) {
+    out_begin('!', &r);
+    out_str(" ok ");
+    out_udec(wbmap_count());
+    out_char('\n');
+    c->list_next = -1;
+  }
+  katcp_flush(c->pcb);
+}
+
+static void
+katcp_listdev(struct katcp_conn *c, const struct katcp_req *r)
+{
+  u8 mode = LISTDEV_NAME;
+
+  if(r->argc == 2 && strcmp(r->argv[1], "size") == 0) {
+    mode = LISTDEV_SIZE;
+  } else if(r->argc == 2 && strcmp(r->argv[1], "detail") == 0) {
+    mode = LISTDEV_DETAIL;
+  } else if(r->argc != 1) {
+    out_reply(r, "invalid", "usage:\\_[size|detail]");
+    return;
+  }
+  if(strlen(r->id) >= sizeof(c->list_id)) {
+    out_reply(r, "invalid", "id\\_too\\_long");
+    return;
+  }
+  strcpy(c->list_id, r->id);
+  c->list_mode = mode;
+  c->list_next = 0;
+}
+
+static void
+katcp_sensor_value(struct katcp_conn *c, const struct katcp_req *r)
+{
+  const struct katcp_sensor *s;
+  u32 i, n = 0, now = timebase_ms();
+  s32 v;
+
+  if(r->argc > 2) {
+    out_reply(r, "invalid", "usage:\\_[sensor]");
+    return;
+  }
+  for(i=0, s=sensors; i<NUM_SENSORS; i++, s++) {
+    if(r->argc == 2 && strcmp(r->argv[1], s->name) != 0) {
+      continue;
+    }
+    v = xadc_convert(s->ch, xadc_raw(s->ch));
+    out_begin('#', r);
+    out_char(' ');
+    out_milli(now);
+    out_str(" 1 ");
+    out_str(s->name);
+    out_str(v < s->lo || v > s->hi ? " warn " : " nominal ");
+    out_milli(v);
+    out_char('\n');
+    n++;
+  }
+  if(!n) {
+    out_reply(r, "fail", "unknown\\_sensor");
+    return;
+  }
+  out_begin('!', r);
+  out_str(" ok ");
+  out_udec(n);
+  out_char('\n');
+}
+
+static void
+katcp_xadc_cal(struct katcp_conn *c, const struct katcp_req *r)
+{
+  const struct xadccal_entry *e;
+  u32 n;
+  s32 gain, offset;
+
+  if(r->argc == 4) {
+    if(katcp_arg(r, 1, &n) != 0 || katcp_signed_arg(r, 2, &gain) != 0 ||
+       katcp_signed_arg(r, 3, &offset) != 0) {
+      return;
+    }
+    if(xadccal_set(n, gain, offset) != 0) {
+      out_reply(r, "fail", "out\\_of\\_range");
+    } else {
+      out_reply(r, "ok", NULL);
+    }
+    return;
+  }
+  if(r->argc != 1) {
+    out_reply(r, "invalid", "usage:\\_[aux\\_gain\\_offset]");
+    return;
+  }
+  for(n=0; (e = xadccal_get(n)); n++) {
+    if(!(XADC_AUX_CHANNELS & (1 << n))) {
+      continue;
+    }
+    out_begin('#', r);
+    out_char(' ');
+    out_udec(n);
+    out_char(' ');
+    out_dec(e->gain);
+    out_char(' ');
+    out_dec(e->offset);
+    out_char(' ');
+    out_dec(xadccal_value(XADC_AUX(n), xadc_raw(XADC_AUX(n))));
+    out_char('\n');
+  }
+  out_reply(r, "ok", XADC_EXT_MUX ? "mux" : "direct");
+}
+
+static const char *const throttle_causes[] = { "temp", "supply", "manual" };
+
+static void
+katcp_throttle(struct katcp_conn *c, const struct katcp_req *r)
+{
+  struct throttle_event ev;
+  u32 n, count, level;
+  int pinned;
+
+  if(r->argc == 2 && strcmp(r->argv[1], "auto") == 0) {
+    throttle_pin(-1);
+    out_reply(r, "ok", NULL);
+    return;
+  }
+  if(r->argc == 3 && strcmp(r->argv[1], "pin") == 0) {
+    if(katcp_arg(r, 2, &level) != 0) {
+      return;
+    }
+    if(level > THROTTLE_LEVELS || throttle_pin(level) != 0) {
+      out_reply(r, "fail", "out\\_of\\_range");
+    } else {
+      out_reply(r, "ok", NULL);
+    }
+    return;
+  }
+  if(r->argc != 1) {
+    out_reply(r, "invalid", "usage:\\_[auto|pin\\_level]");
+    return;
+  }
+  count = throttle_event_count();
+  for(n=count > THROTTLE_EVENTS ? count - THROTTLE_EVENTS : 0; n<count;
+      n++) {
+    if(throttle_event(n, &ev) != 0) {
+      continue;
+    }
+    out_begin('#', r);
+    out_char(' ');
+    out_udec(ev.time_ms);
+    out_char(' ');
+    out_udec(ev.from);
+    out_char(' ');
+    out_udec(ev.to);
+    out_char(' ');
+    out_str(throttle_causes[ev.cause]);
+    out_char(' ');
+    out_dec(ev.temp_mc);
+    out_char(' ');
+    out_dec(ev.vccint_mv);
+    out_char('\n');
+  }
+  level = throttle_level(&pinned);
+  out_begin('!', r);
+  out_str(" ok ");
+  out_udec(level);
+  out_str(pinned ? " pinned " : " auto ");
+  out_udec(count);
+  out_char('\n');
+}
+
+static void
+katcp_load(struct katcp_conn *c, const struct katcp_req *r)
+{
+  const struct load_stats *s = load_stats();
+  const struct load_task *t;
+  u32 n, pm;
+
+  if(r->argc == 2 && strcmp(r->argv[1], "reset") == 0) {
+    load_reset();
+    out_reply(r, "ok", NULL);
+    return;
+  }
+  if(r->argc == 3 && strcmp(r->argv[1], "alert") == 0) {
+    if(katcp_arg(r, 2, &pm) != 0) {
+      return;
+    }
+    load_set_alert(pm);
+    out_reply(r, "ok", NULL);
+    return;
+  }
+  if(r->argc != 1) {
+    out_reply(r, "invalid", "usage:\\_[reset|alert\\_pm]");
+    return;
+  }
+  for(n=0; (t = load_task(n)); n++) {
+    if(!t->runs) {
+      continue;
+    }
+    out_begin('#', r);
+    out_char(' ');
+    if(n == LOAD_OTHER) {
+      out_str("other");
+    } else {
+      out_hex(t->fn);
+    }
+    out_char(' ');
+    out_udec(t->runs);
+    out_char(' ');
+    out_udec(t->cycles / TIMEBASE_CYCLES_PER_MS);
+    out_char(' ');
+    out_udec(t->max_cycles / TIMEBASE_CYCLES_PER_US);
+    out_char(' ');
+    out_udec(t->share_pm);
+    out_char('\n');
+  }
+  out_begin('!', r);
+  out_str(" ok ");
+  out_udec(s->busy_pm);
+  out_char(' ');
+  out_udec(s->load_pm);
+  out_char(' ');
+  out_udec(s->peak_pm);
+  out_char(' ');
+  out_udec(s->alert_pm);
+  out_str(s->alert ? " alert " : " normal ");
+  out_udec(s->alerts);
+  out_char('\n');
+}
+
+static void
+katcp_timers(struct katcp_conn *c, const struct katcp_req *r)
+{
+  const struct timer_deadline *d;
+  u32 n;
+
+  for(n=0; (d = timer_deadline(n)); n++) {
+    out_begin('#', r);
+    out_char(' ');
+    out_str(d->name);
+    out_char(' ');
+    out_udec(d->deadline_us);
+    out_char(' ');
+    out_udec(d->runs);
+    out_char(' ');
+    out_udec(d->misses);
+    out_char(' ');
+    out_udec(d->late / TIMEBASE_CYCLES_PER_US);
+    out_char(' ');
+    out_udec(d->late_max / TIMEBASE_CYCLES_PER_US);
+    out_char(' ');
+    out_udec(d->runs ? (u32)(d->late_sum / d->runs / TIMEBASE_CYCLES_PER_US) :
+        0);
+    out_char('\n');
+  }
+  out_begin('!', r);
+  out_str(" ok ");
+  out_udec(timer_stats()->runs);
+  out_char(' ');
+  out_udec(timer_stats()->misses);
+  out_char('\n');
+}
+
+static void
+katcp_quota(struct katcp_conn *c, const struct katcp_req *r)
+{
+  const struct quota_class *q;
+  u32 n;
+
+  for(n=0; (q = quota_class(n)); n++) {
+    out_begin('#', r);
+    out_char(' ');
+    out_str(q->name);
+    out_char(' ');
+    out_udec(q->active);
+    out_char(' ');
+    out_udec(q->peak);
+    out_char(' ');
+    out_udec(q->max);
+    out_char(' ');
+    out_udec(q->accepted);
+    out_char(' ');
+    out_udec(q->over_max);
+    out_char(' ');
+    out_udec(q->reserved);
+    out_char('\n');
+  }
+  out_begin('!', r);
+  out_str(" ok ");
+  out_udec(quota_free_pcbs());
+  out_char(' ');
+  out_udec(quota_free_pbufs());
+  out_char(' ');
+  out_udec(quota_timewait());
+  out_char(' ');
+  out_udec(tcp_reaped.tw_reused);
+  out_char(' ');
+  out_udec(tcp_reaped.tw_capped);
+  out_char(' ');
+  out_udec(tcp_reaped.idle);
+  out_char(' ');
+  out_udec(tcp_reaped.keepalive);
+  out_char('\n');
+}
+
+static const char *const burst_states[] = {
+  "idle", "armed", "done", "failed",
+};
+
+static void
+katcp_xburst(struct katcp_conn *c, const struct katcp_req *r)
+{
+  const struct xadc_burst *b;
+  const u16 *samples;
+  u32 ch, n = XADC_BURST_SAMPLES;
+
+  if(r->argc == 1) {
+    b = xadc_burst(&samples);
+    out_begin('!', r);
+    out_str(" ok ");
+    out_str(burst_states[b->state]);
+    out_char(' ');
+    out_udec(b->channel);
+    out_str(b->trigger == XADC_TRIGGER_ALARM ? " alarm " : " command ");
+    out_udec(b->count);
+    out_char(' ');
+    out_udec(b->count > 1 ? (u32)((u64)b->cycles * 1000000000 /
+        TIMEBASE_HZ / (b->count - 1)) : 0);
+    out_char('\n');
+    return;
+  }
+  if(r->argc == 2 && strcmp(r->argv[1], "cancel") == 0) {
+    xadc_burst_cancel();
+    out_reply(r, "ok", NULL);
+    return;
+  }
+  if((r->argc != 3 && r->argc != 4) || (strcmp(r->argv[1], "start") != 0 &&
+     strcmp(r->argv[1], "arm") != 0)) {
+    out_reply(r, "invalid",
+        "usage:\\_[start|arm\\_channel\\_[samples]|cancel]");
+    return;
+  }
+  if(katcp_arg(r, 2, &ch) != 0 || (r->argc == 4 && katcp_arg(r, 3, &n) != 0)) {
+    return;
+  }
+  if(ch >= XADC_NUM_CHANNELS || n == 0 || n > XADC_BURST_SAMPLES) {
+    out_reply(r, "fail", "out\\_of\\_range");
+  } else if(r->argv[1][0] == 'a' ? xadc_burst_arm(ch, n) != 0 :
+            xadc_burst_start(ch, n) != 0) {
+    out_reply(r, "fail", "no\\_xadc");
+  } else {
+    out_reply(r, "ok", NULL);
+  }
+}
+
+static void
+katcp_watchdog(struct katcp_conn *c, const struct katcp_req *r)
+{
+  out_reply(r, "ok", NULL);
+}
+
+static void
+katcp_stack(struct katcp_conn *c, const struct katcp_req *r)
+{
+  out_begin('!', r);
+  out_str(" ok ");
+  out_udec(stack_peak());
+  out_char(' ');
+  out_udec(stack_size());
+  out_str(stack_guard_ok() ? " intact" : " overwritten");
+  out_char('\n');
+}
+
+static void
+katcp_boot(struct katcp_conn *c, const struct katcp_req *r)
+{
+  const struct boot_stage *b;
+  u32 n;
+
+  for(n=0; (b = boot_get(n)); n++) {
+    out_begin('#', r);
+    out_char(' ');
+    out_str(b->name);
+    out_char(' ');
+    out_udec(b->time_us);
+    out_char('\n');
+  }
+  out_begin('!', r);
+  out_str(" ok ");
+  out_udec(n);
+  out_char('\n');
+}
+
+static void
+katcp_warm(struct katcp_conn *c, const struct katcp_req *r)
+{
+  if(r->argc == 1) {
+    out_begin('!', r);
+    out_str(" ok ");
+    out_str(warm_restored() ? "restored " : "cold ");
+    out_udec(warm_saves());
+    out_char('\n');
+  } else if(r->argc == 2 && strcmp(r->argv[1], "save") == 0) {
+    if(warm_save() != 0) {
+      out_reply(r, "fail", "busy");
+    } else {
+      out_reply(r, "ok", NULL);
+    }
+  } else if(r->argc == 2 && strcmp(r->argv[1], "clear") == 0) {
+    if(warm_clear() != 0) {
+      out_reply(r, "fail", "busy");
+    } else {
+      out_reply(r, "ok", NULL);
+    }
+  } else {
+    out_reply(r, "invalid", "usage:\\_[save|clear]");
+  }
+}
+
+static void
+katcp_reconfig(struct katcp_conn *c, const struct katcp_req *r)
+{
+  u32 slot = slots.active;
+
+  if(r->argc > 2) {
+    out_reply(r, "invalid", "usage:\\_[slot]");
+    return;
+  }
+  if(r->argc == 2 && katcp_arg(r, 1, &slot) != 0) {
+    return;
+  }
+  if(!ICAP_PRESENT) {
+    out_reply(r, "fail", "no\\_icap");
+  } else if(slot >= slots.num || icap_boot(slot) != 0) {
+    out_reply(r, "fail", "slot\\_not\\_bootable");
+  } else {
+    out_begin('!', r);
+    out_str(" ok ");
+    out_udec(slot);
+    out_char('\n');
+  }
+}
+
+static void
+katcp_scrub(struct katcp_conn *c, const struct katcp_req *r)
+{
+  const struct scrub_record *s = scrub_get();
+  u32 m;
+
+  if(r->argc == 2 && strcmp(r->argv[1], "clear") == 0) {
+    if(scrub_clear() != 0) {
+      out_reply(r, "fail", "busy");
+    } else {
+      out_reply(r, "ok", NULL);
+    }
+    return;
+  } else if(r->argc != 1) {
+    out_reply(r, "invalid", "usage:\\_[clear]");
+    return;
+  }
+
+  for(m=0; m<FLASH_NUM_MODES; m++) {
+    if(!s->cycles_per_kb[m]) {
+      continue;
+    }
+    out_begin('#', r);
+    out_char(' ');
+    out_udec(m);
+    out_char(' ');
+    out_udec(s->cycles_per_kb[m]);
+    out_char('\n');
+  }
+  out_begin('!', r);
+  out_str(" ok ");
+  out_udec(s->passes);
+  out_char(' ');
+  out_udec(s->sectors);
+  out_char(' ');
+  out_udec(s->unstable);
+  out_char(' ');
+  if(s->last_unstable != SCRUB_NONE) {
+    out_hex(s->last_unstable);
+  } else {
+    out_str("none");
+  }
+  out_char(' ');
+  out_udec(s->bad);
+  out_char('\n');
+}
+
+static void
+katcp_wdog(struct katcp_conn *c, const struct katcp_req *r)
+{
+  const struct wdog_record *w;
+  const struct wdog_task *t;
+  u32 n, now = timebase_ms();
+  int expired;
+
+  for(n=0; (t = wdog_get(n)); n++) {
+    out_begin('#', r);
+    out_char(' ');
+    out_str(t->name);
+    out_char(' ');
+    out_udec(t->deadline_ms);
+    out_char(' ');
+    out_udec(now - t->beat_ms);
+    out_str(t->armed ? " armed\n" : " idle\n");
+  }
+  w = wdog_last_reset(&expired);
+  out_begin('!', r);
+  out_str(" ok ");
+  if(w) {
+    out_str(w->task);
+    out_char(' ');
+    out_udec(w->late_ms);
+    out_char(' ');
+    out_hex(w->pc);
+    out_char('\n');
+  } else {
+    out_str(expired ? "expired\n" : "none\n");
+  }
+}
+
+static void
+katcp_intr(struct katcp_conn *c, const struct katcp_req *r)
+{
+  const struct intr_stats *s;
+  u32 id, min, mean, max, pc;
+
+  if(r->argc == 3 && strcmp(r->argv[1], "diag") == 0) {
+    if(strcmp(r->argv[2], "on") != 0 && strcmp(r->argv[2], "off") != 0) {
+      out_reply(r, "invalid", "usage:\\_[diag\\_on|off]");
+    } else if(intr_diag(strcmp(r->argv[2], "on") == 0) != 0) {
+      out_reply(r, "fail", "no\\_perf\\_counts");
+    } else {
+      out_reply(r, "ok", NULL);
+    }
+    return;
+  } else if(r->argc != 1) {
+    out_reply(r, "invalid", "usage:\\_[diag\\_on|off]");
+    return;
+  }
+
+  for(id=0; (s = intr_stats(id)); id++) {
+    if(!s->connected) {
+      continue;
+    }
+    out_begin('#', r);
+    out_char(' ');
+    out_udec(id);
+    out_str(s->fast ? " fast " : " normal ");
+    out_udec(s->count);
+    out_char(' ');
+    out_udec(s->count ? (u32)(s->cycles / s->count) : 0);
+    out_char(' ');
+    out_udec(s->max_cycles);
+    out_char('\n');
+  }
+  intr_latency(&min, &mean, &max, &pc);
+  out_begin('!', r);
+  out_str(" ok ");
+  out_udec(min);
+  out_char(' ');
+  out_udec(mean);
+  out_char(' ');
+  out_udec(max);
+  out_char(' ');
+  out_hex(pc);
+  out_str(intr_diag_running() ? " on\n" : " off\n");
+}
+
+static void
+katcp_stream(struct katcp_conn *c, const struct katcp_req *r)
+{
+  u32 words[KATCP_MAX_ARGS - 2];
+  u32 type, sent, received, dropped, errors, n;
+
+  if(r->argc >= 2) {
+    if(katcp_arg(r, 1, &type) != 0) {
+      return;
+    }
+    for(n=2; n<r->argc; n++) {
+      if(katcp_arg(r, n, &words[n - 2]) != 0) {
+        return;
+      }
+    }
+    if(type > 0xffff) {
+      out_reply(r, "invalid", "bad\\_type");
+    } else if(stream_send(type, words, r->argc - 2) != 0) {
+      out_reply(r, "fail", "no\\_stream\\_link");
+    } else {
+      out_reply(r, "ok", NULL);
+    }
+    return;
+  }
+
+  stream_counts(&sent, &received, &dropped, &errors);
+  out_begin('!', r);
+  out_str(" ok ");
+  out_udec(sent);
+  out_char(' ');
+  out_udec(received);
+  out_char(' ');
+  out_udec(dropped);
+  out_char(' ');
+  out_udec(errors);
+  out_char('\n');
+}
+
+static void
+katcp_crash(struct katcp_conn *c, const struct katcp_req *r)
+{
+  const struct crash_record *d;
+  u32 n;
+  int fresh;
+
+  if(r->argc == 2 && strcmp(r->argv[1], "clear") == 0) {
+    if(crash_clear() != 0) {
+      out_reply(r, "fail", "busy");
+    } else {
+      out_reply(r, "ok", NULL);
+    }
+    return;
+  } else if(r->argc != 1) {
+    out_reply(r, "invalid", "usage:\\_[clear]");
+    return;
+  }
+
+  d = crash_last(&fresh);
+  if(!d) {
+    out_reply(r, "ok", "none");
+    return;
+  }
+  for(n=0; n<32; n++) {
+    out_begin('#', r);
+    out_str(" r");
+    out_udec(n);
+    out_char(' ');
+    out_hex(d->reg[n]);
+    out_char('\n');
+  }
+  for(n=0; n<CRASH_STACK_WORDS; n++) {
+    out_begin('#', r);
+    out_str(" stack ");
+    out_hex(d->stack[n]);
+    out_char('\n');
+  }
+  out_begin('!', r);
+  out_str(fresh ? " ok last-reset " : " ok earlier ");
+  out_hex(d->cause);
+  out_char(' ');
+  out_hex(d->reg[17]);
+  out_char(' ');
+  out_hex(d->esr);
+  out_char(' ');
+  out_hex(d->ear);
+  out_char('\n');
+}
+
+static void
+katcp_arp(struct katcp_conn *c, const struct katcp_req *r)
+{
+  const struct arpcfg_entry *e;
+  struct eth_addr mac;
+  ip4_addr_t ip;
+  u32 n;
+
+  if(r->argc == 1) {
+    for(n=0; (e = arpcfg_get(n)); n++) {
+      ip4_addr_set_u32(&ip, e->ip);
+      out_begin('#', r);
+      out_char(' ');
+      out_str(ip4addr_ntoa(&ip));
+      out_char(' ');
+      out_mac(e->mac);
+      out_char('\n');
+    }
+    out_begin('!', r);
+    out_str(" ok ");
+    out_udec(n);
+    out_char('\n');
+  } else if(r->argc == 4 && strcmp(r->argv[1], "add") == 0) {
+    if(!ip4addr_aton(r->argv[2], &ip) || katcp_mac(r->argv[3], mac.addr)) {
+      out_reply(r, "invalid", "bad\\_address");
+    } else if(arpcfg_add(&ip, &mac) != 0) {
+      out_reply(r, "fail", "table\\_full\\_or\\_not\\_local");
+    } else {
+      out_reply(r, "ok", NULL);
+    }
+  } else if(r->argc == 3 && strcmp(r->argv[1], "del") == 0) {
+    if(!ip4addr_aton(r->argv[2], &ip)) {
+      out_reply(r, "invalid", "bad\\_address");
+    } else if(arpcfg_remove(&ip) != 0) {
+      out_reply(r, "fail", "no\\_entry");
+    } else {
+      out_reply(r, "ok", NULL);
+    }
+  } else {
+    out_reply(r, "invalid", "usage:\\_[add\\_ip\\_mac|del\\_ip]");
+  }
+}
+
+static void
+katcp_snmp_trap(struct katcp_conn *c, const struct katcp_req *r)
+{
+  ip4_addr_t ip;
+  u32 sent, coalesced;
+
+  if(r->argc == 1) {
+    snmptrap_get_dest(&ip);
+    sent = snmptrap_counts(&coalesced);
+    out_begin('!', r);
+    out_str(" ok ");
+    out_str(ip4_addr_isany_val(ip) ? "off" : ip4addr_ntoa(&ip));
+    out_char(' ');
+    out_udec(sent);
+    out_char(' ');
+    out_udec(coalesced);
+    out_char('\n');
+  } else if(r->argc == 2 && strcmp(r->argv[1], "off") == 0) {
+    snmptrap_set_dest(NULL);
+    out_reply(r, "ok", NULL);
+  } else if(r->argc == 2) {
+    if(!ip4addr_aton(r->argv[1], &ip)) {
+      out_reply(r, "invalid", "bad\\_address");
+    } else {
+      snmptrap_set_dest(&ip);
+      out_reply(r, "ok", NULL);
+    }
+  } else {
+    out_reply(r, "invalid", "usage:\\_[ip|off]");
+  }
+}
+
+static void
+katcp_telpush(struct katcp_conn *c, const struct katcp_req *r)
+{
+  const struct telpush_stats *s = telpush_stats();
+  const struct telbuf_stats *b = telbuf_stats();
+  const struct websock_stats *w = websock_stats();
+  const struct telpush_dest *d;
+  ip4_addr_t ip;
+  u32 n, port = TELPUSH_PORT;
+
+  if(r->argc == 1) {
+    for(n=0; (d = telpush_dest(n)); n++) {
+      ip4_addr_set_u32(&ip, d->ip);
+      out_begin('#', r);
+      out_char(' ');
+      out_udec(n);
+      out_char(' ');
+      out_str(d->ip ? ip4addr_ntoa(&ip) : "off");
+      out_char(' ');
+      out_udec(d->port);
+      out_char('\n');
+    }
+    out_begin('#', r);
+    out_str(" websocket ");
+    out_udec(w->viewers);
+    out_char(' ');
+    out_udec(w->upgrades);
+    out_char(' ');
+    out_udec(w->messages);
+    out_char(' ');
+    out_udec(w->bytes);
+    out_char(' ');
+    out_udec(w->skipped);
+    out_char('\n');
+    out_begin('!', r);
+    out_str(" ok ");
+    out_udec(s->datagrams);
+    out_char(' ');
+    out_udec(s->keyframes);
+    out_char(' ');
+    out_udec(s->bytes);
+    out_char(' ');
+    out_udec(s->errors);
+    out_char(' ');
+    out_udec(s->held);
+    out_char(' ');
+    out_udec(s->backfilled);
+    out_char(' ');
+    out_udec(b->ram_bytes);
+    out_char(' ');
+    out_udec(b->flash_bytes);
+    out_char(' ');
+    out_udec(b->dropped);
+    out_char('\n');
+    return;
+  }
+  if(r->argc < 3 || r->argc > 4) {
+    out_reply(r, "invalid", "usage:\\_[n\\_ip\\_[port]|n\\_off]");
+    return;
+  }
+  if(katcp_arg(r, 1, &n) != 0 ||
+     (r->argc == 4 && katcp_arg(r, 3, &port) != 0)) {
+    return;
+  }
+  if(r->argc == 3 && strcmp(r->argv[2], "off") == 0) {
+    ip4_addr_set_any(&ip);
+  } else if(!ip4addr_aton(r->argv[2], &ip)) {
+    out_reply(r, "invalid", "bad\\_address");
+    return;
+  }
+  if(port > 0xffff || telpush_set_dest(n, &ip, port) != 0) {
+    out_reply(r, "fail", "out\\_of\\_range");
+  } else {
+    out_reply(r, "ok", NULL);
+  }
+}
+
+static void
+katcp_influx(struct katcp_conn *c, const struct katcp_req *r)
+{
+  const struct influx_stats *s = influx_stats();
+  const struct influx_dest *d = influx_dest();
+  ip4_addr_t ip;
+  u32 port = INFLUX_DEST_PORT;
+
+  if(r->argc == 1) {
+    ip4_addr_set_u32(&ip, d->ip);
+    out_begin('!', r);
+    out_str(" ok ");
+    out_str(d->ip ? ip4addr_ntoa(&ip) : "off");
+    out_char(' ');
+    out_udec(d->port);
+    out_char(' ');
+    out_udec(s->datagrams);
+    out_char(' ');
+    out_udec(s->lines);
+    out_char(' ');
+    out_udec(s->bytes);
+    out_char(' ');
+    out_udec(s->errors);
+    out_char(' ');
+    out_udec(s->cycles);
+    out_char('\n');
+    return;
+  }
+  if(r->argc > 3) {
+    out_reply(r, "invalid", "usage:\\_[ip\\_[port]|off]");
+    return;
+  }
+  if(r->argc == 3 && katcp_arg(r, 2, &port) != 0) {
+    return;
+  }
+  if(r->argc == 2 && strcmp(r->argv[1], "off") == 0) {
+    ip4_addr_set_any(&ip);
+  } else if(!ip4addr_aton(r->argv[1], &ip)) {
+    out_reply(r, "invalid", "bad\\_address");
+    return;
+  }
+  if(port > 0xffff) {
+    out_reply(r, "fail", "out\\_of\\_range");
+    return;
+  }
+  influx_set_dest(&ip, port);
+  out_reply(r, "ok", NULL);
+}
+
+static void
+katcp_sntp(struct katcp_conn *c, const struct katcp_req *r)
+{
+  ip4_addr_t ip;
+  struct sntpclock_stats s;
+
+  if(r->argc == 1) {
+    sntpclock_get_server(&ip);
+    sntpclock_stats(&s);
+    out_begin('!', r);
+    out_str(" ok ");
+    out_str(ip4_addr_isany_val(ip) ? "off" : ip4addr_ntoa(&ip));
+    out_char(' ');
+    out_udec(s.syncs);
+    out_char(' ');
+    out_udec(s.steps);
+    out_char(' ');
+    out_dec(s.offset_us);
+    out_char(' ');
+    out_dec(s.drift_ppb);
+    out_str(s.pps_locked ? " pps " : " nopps ");
+    out_udec(s.pps_edges);
+    out_char(' ');
+    out_dec(s.pps_offset_ns);
+    out_char('\n');
+  } else if(r->argc == 2 && strcmp(r->argv[1], "off") == 0) {
+    sntpclock_set_server(NULL);
+    out_reply(r, "ok", NULL);
+  } else if(r->argc == 2) {
+    if(!ip4addr_aton(r->argv[1], &ip)) {
+      out_reply(r, "invalid", "bad\\_address");
+    } else {
+      sntpclock_set_server(&ip);
+      out_reply(r, "ok", NULL);
+    }
+  } else {
+    out_reply(r, "invalid", "usage:\\_[ip|off]");
+  }
+}
+
+static void
+katcp_ptp(struct katcp_conn *c, const struct katcp_req *r)
+{
+  static const char digits[] = "0123456789abcdef";
+  const struct ptp_stats *s = ptp_stats();
+  int i;
+
+  if(r->argc == 1) {
+    out_begin('!', r);
+    out_str(ptp_enabled() ? " ok on " : " ok off ");
+    if(!s->locked) {
+      out_str("none");
+    }
+    for(i=0; s->locked && i<8; i++) {
+      out_char(digits[s->master[i] >> 4]);
+      out_char(digits[s->master[i] & 15]);
+    }
+    out_char(' ');
+    out_udec(s->syncs);
+    out_char(' ');
+    out_udec(s->steps);
+    out_char(' ');
+    out_dec(s->offset_ns);
+    out_char(' ');
+    out_dec(s->delay_ns);
+    out_char(' ');
+    out_dec(s->drift_ppb);
+    out_char('\n');
+  } else if(r->argc == 2 && strcmp(r->argv[1], "on") == 0) {
+    ptp_enable(1);
+    out_reply(r, "ok", NULL);
+  } else if(r->argc == 2 && strcmp(r->argv[1], "off") == 0) {
+    ptp_enable(0);
+    out_reply(r, "ok", NULL);
+  } else {
+    out_reply(r, "invalid", "usage:\\_[on|off]");
+  }
+}
+
+static void
+katcp_prof(struct katcp_conn *c, const struct katcp_req *r)
+{
+  if(r->argc == 1) {
+    out_begin('!', r);
+    out_str(pcprof_running() ? " ok running " : " ok stopped ");
+    out_udec(pcprof_samples());
+    out_char('\n');
+  } else if(r->argc == 2 && strcmp(r->argv[1], "start") == 0) {
+    pcprof_start();
+    out_reply(r, "ok", NULL);
+  } else if(r->argc == 2 && strcmp(r->argv[1], "stop") == 0) {
+    pcprof_stop();
+    out_reply(r, "ok", NULL);
+  } else if(r->argc == 2 && strcmp(r->argv[1], "clear") == 0) {
+    pcprof_clear();
+    out_reply(r, "ok", NULL);
+  } else {
+    out_reply(r, "invalid", "usage:\\_[start|stop|clear]");
+  }
+}
+
+static void
+katcp_bench(struct katcp_conn *c, const struct katcp_req *r)
+{
+  if(r->argc == 1) {
+    out_begin('!', r);
+    out_str(bench_at_boot() ? " ok on\n" : " ok off\n");
+  } else if(r->argc == 3 && strcmp(r->argv[1], "boot") == 0 &&
+      (strcmp(r->argv[2], "on") == 0 || strcmp(r->argv[2], "off") == 0)) {
+    bench_set_boot(strcmp(r->argv[2], "on") == 0);
+    out_reply(r, "ok", NULL);
+  } else {
+    out_reply(r, "invalid", "usage:\\_[boot\\_on|off]");
+  }
+}
+
+static void
+katcp_timed(struct katcp_conn *c, const struct katcp_req *r)
+{
+  const struct wbtimed_stats *s = wbtimed_stats();
+
+  if(r->argc != 1) {
+    out_reply(r, "invalid", "usage:\\_no\\_arguments");
+    return;
+  }
+  out_begin('!', r);
+  out_str(" ok ");
+  out_udec(s->queued);
+  out_char(' ');
+  out_udec(s->done);
+  out_char(' ');
+  out_udec(s->missed);
+  out_char(' ');
+  out_dec(s->skew_last);
+  out_char(' ');
+  out_dec(s->skew_min);
+  out_char(' ');
+  out_dec(s->skew_max);
+  out_char(' ');
+  out_dec(s->done ? (s32)(s->skew_sum / s->done) : 0);
+  out_char('\n');
+}
+
+static void
+katcp_blackbox(struct katcp_conn *c, const struct katcp_req *r)
+{
+  const struct bbox_stats *s = bbox_stats();
+  u32 v[4] = { 0, 0, 0, 0 };
+  u32 i;
+
+  if(r->argc == 1) {
+    out_begin('!', r);
+    out_str(" ok ");
+    out_udec(bbox_size());
+    out_char(' ');
+    out_udec(s->seq);
+    out_char(' ');
+    out_udec(s->lost);
+    out_char(' ');
+    out_udec(s->pages);
+    out_char(' ');
+    out_udec(s->partial);
+    out_char(' ');
+    out_udec(s->erases);
+    out_char(' ');
+    out_udec(s->errors);
+    out_char('\n');
+    return;
+  }
+  if(r->argc < 3 || r->argc > 6 || strcmp(r->argv[1], "note") != 0) {
+    out_reply(r, "invalid", "usage:\\_[note\\_arg\\_[a\\_[b\\_[c]]]]");
+    return;
+  }
+  for(i=2; i<r->argc; i++) {
+    if(katcp_arg(r, i, &v[i - 2]) != 0) {
+      return;
+    }
+  }
+  if(v[0] > 0xffff) {
+    out_reply(r, "fail", "out\\_of\\_range");
+  } else if(!bbox_size()) {
+    out_reply(r, "fail", "no\\_flash");
+  } else {
+    bbox_event(BBOX_NOTE, v[0], v[1], v[2], v[3]);
+    out_reply(r, "ok", NULL);
+  }
+}
+
+static void
+katcp_net(struct katcp_conn *c, const struct katcp_req *r)
+{
+  struct netcfg cfg;
+  ip4_addr_t ip, netmask, gw;
+
+  if(r->argc == 1) {
+    netcfg_get(&cfg);
+    out_begin('!', r);
+    out_str(cfg.mode == NETCFG_DHCP ? " ok dhcp " : " ok static ");
+    out_str(ip4addr_ntoa(netif_ip4_addr(netif_default)));
+    out_char(' ');
+    out_str(ip4addr_ntoa(netif_ip4_netmask(netif_default)));
+    out_char(' ');
+    out_str(ip4addr_ntoa(netif_ip4_gw(netif_default)));
+    out_char('\n');
+    return;
+  }
+  memset(&cfg, 0, sizeof(cfg));
+  if(r->argc == 2 && strcmp(r->argv[1], "dhcp") == 0) {
+    cfg.mode = NETCFG_DHCP;
+  } else if((r->argc == 4 || r->argc == 5) &&
+      strcmp(r->argv[1], "static") == 0) {
+    ip4_addr_set_zero(&gw);
+    if(!ip4addr_aton(r->argv[2], &ip) || !ip4addr_aton(r->argv[3], &netmask) ||
+       (r->argc == 5 && !ip4addr_aton(r->argv[4], &gw))) {
+      out_reply(r, "invalid", "bad\\_address");
+      return;
+    }
+    cfg.mode = NETCFG_STATIC;
+    cfg.ip = ip4_addr_get_u32(&ip);
+    cfg.netmask = ip4_addr_get_u32(&netmask);
+    cfg.gw = ip4_addr_get_u32(&gw);
+  } else {
+    out_reply(r, "invalid", "usage:\\_[dhcp|static\\_ip\\_netmask\\_[gw]]");
+    return;
+  }
+  netcfg_set(&cfg);
+  out_reply(r, "ok", NULL);
+}
+
+// One #port line for port `n`
+static void
+port_line(const struct katcp_req *r, u32 n, struct netif *netif)
+{
+  struct ethernetif_stats s;
+
+  ethernetif_stats(netif, &s);
+  out_begin('#', r);
+  out_char(' ');
+  out_udec(n);
+  out_char(' ');
+  out_str(ip4addr_ntoa(netif_ip4_addr(netif)));
+  out_char(' ');
+  out_str(ip4addr_ntoa(netif_ip4_netmask(netif)));
+  out_char(' ');
+  out_udec(s.tx_frames);
+  out_char(' ');
+  out_udec(s.tx_bytes);
+  out_char(' ');
+  out_udec(s.tx_drops);
+  out_char(' ');
+  out_udec(s.rx_frames);
+  out_char(' ');
+  out_udec(s.rx_bytes);
+  out_char(' ');
+  out_udec(s.rx_drops);
+  out_char('\n');
+}
+
+static void
+katcp_port(struct katcp_conn *c, const struct katcp_req *r)
+{
+  struct ethport_cfg cfg;
+  struct netif *netif;
+  ip4_addr_t ip, netmask;
+  u32 n, count = 1;
+
+  if(r->argc == 1) {
+    port_line(r, 0, netif_default);
+    for(n=1; n<=ETHPORT_MAX; n++) {
+      if((netif = ethport_netif(n))) {
+        port_line(r, n, netif);
+        count++;
+      }
+    }
+    out_begin('!', r);
+    out_str(" ok ");
+    out_udec(count);
+    out_char('\n');
+    return;
+  }
+  if(katcp_arg(r, 1, &n) != 0) {
+    return;
+  }
+  if(n < 1 || n > ETHPORT_MAX) {
+    out_reply(r, "invalid", "no\\_such\\_port");
+    return;
+  }
+  memset(&cfg, 0, sizeof(cfg));
+  if(r->argc == 3 && strcmp(r->argv[2], "off") == 0) {
+    // No address
+  } else if(r->argc == 4 && ip4addr_aton(r->argv[2], &ip) &&
+      ip4addr_aton(r->argv[3], &netmask)) {
+    cfg.ip = ip4_addr_get_u32(&ip);
+    cfg.netmask = ip4_addr_get_u32(&netmask);
+  } else {
+    out_reply(r, "invalid", "bad\\_address");
+    return;
+  }
+  ethport_set(n, &cfg);
+  out_reply(r, "ok", NULL);
+}
+
+static void
+katcp_fabric(struct katcp_conn *c, const struct katcp_req *r)
+{
+  struct netif *netif;
+  u32 n, port, count = 0;
+  u16 p;
+
+  if(r->argc == 1) {
+    for(netif = netif_list; netif; netif = netif->next) {
+      if(!ethernetif_is(netif)) {
+        continue;
+      }
+      n = ethernetif_core_num(netif);
+      fabric_get_port(n, &p);
+      out_begin('#', r);
+      out_char(' ');
+      out_udec(n);
+      out_char(' ');
+      out_str(ip4addr_ntoa(netif_ip4_addr(netif)));
+      out_char(' ');
+      out_udec(p);
+      out_char(' ');
+      out_udec(fabric_arp_writes(n));
+      out_char('\n');
+      count++;
+    }
+    out_begin('!', r);
+    out_str(" ok ");
+    out_udec(count);
+    out_char('\n');
+    return;
+  }
+  if(r->argc != 3) {
+    out_reply(r, "invalid", "usage:\\_[n\\_udp-port]");
+    return;
+  }
+  if(katcp_arg(r, 1, &n) != 0 || katcp_arg(r, 2, &port) != 0) {
+    return;
+  }
+  if(port > 0xffff || fabric_set_port(n, port) != 0) {
+    out_reply(r, "invalid", "out\\_of\\_range");
+    return;
+  }
+  out_reply(r, "ok", NULL);
+}
+
+static void
+katcp_flowctl(struct katcp_conn *c, const struct katcp_req *r)
+{
+  struct flowctl_policy p;
+  struct flowctl_status s;
+  u32 n, v[4];
+
+  flowctl_get_policy(&p);
+  if(r->argc == 1) {
+    for(n=0; n<ETH_MAX_CORES; n++) {
+      if(flowctl_status(n, &s) != 0) {
+        continue;
+      }
+      out_begin('#', r);
+      out_char(' ');
+      out_udec(n);
+      out_str(s.paused ? " paused " : " running ");
+      out_udec(s.fill);
+      out_char(' ');
+      out_udec(s.pauses);
+      out_char(' ');
+      out_udec(s.paused_ms);
+      out_char(' ');
+      out_udec(s.overflows);
+      out_char('\n');
+    }
+    out_begin('!', r);
+    out_str(p.enabled ? " ok on " : " ok off ");
+    out_udec(p.high);
+    out_char(' ');
+    out_udec(p.low);
+    out_char(' ');
+    out_udec(p.min_pause_ms);
+    out_char(' ');
+    out_udec(p.stale_ms);
+    out_char('\n');
+    return;
+  }
+  if(r->argc == 2 && strcmp(r->argv[1], "off") == 0) {
+    p.enabled = 0;
+  } else if(r->argc >= 3 && r->argc <= 5) {
+    v[2] = p.min_pause_ms;
+    v[3] = p.stale_ms;
+    for(n=1; n<r->argc; n++) {
+      if(katcp_arg(r, n, &v[n - 1]) != 0) {
+        return;
+      }
+    }
+    if(v[0] > 100 || v[1] > v[0]) {
+      out_reply(r, "invalid", "bad\\_marks");
+      return;
+    }
+    p.enabled = 1;
+    p.high = v[0];
+    p.low = v[1];
+    p.min_pause_ms = v[2];
+    p.stale_ms = v[3];
+  } else {
+    out_reply(r, "invalid",
+        "usage:\\_[off|high\\_low\\_[min-pause-ms\\_[stale-ms]]]");
+    return;
+  }
+  flowctl_set_policy(&p);
+  out_reply(r, "ok", NULL);
+}
+
+static void
+katcp_pace(struct katcp_conn *c, const struct katcp_req *r)
+{
+  struct udpflow *f;
+  u32 rate = 0, burst = UDPFLOW_PACE_BURST;
+
+  if(r->argc == 1) {
+    for(f=udpflow_next(NULL); f; f=udpflow_next(f)) {
+      out_begin('#', r);
+      out_char(' ');
+      out_str(f->name);
+      out_char(' ');
+      out_udec(f->pace.rate);
+      out_char(' ');
+      out_udec(f->pace.burst);
+      out_char(' ');
+      out_udec(f->held);
+      out_char(' ');
+      out_udec(f->pace_drops);
+      out_char('\n');
+    }
+    out_reply(r, "ok", NULL);
+    return;
+  }
+  if(r->argc < 3 || r->argc > 4) {
+    out_reply(r, "invalid", "usage:\\_[flow\\_off|rate\\_[burst]]");
+    return;
+  }
+  if(!(f = udpflow_find(r->argv[1]))) {
+    out_reply(r, "fail", "no\\_such\\_flow");
+    return;
+  }
+  if(strcmp(r->argv[2], "off") != 0 &&
+     (katcp_arg(r, 2, &rate) != 0 ||
+      (r->argc == 4 && katcp_arg(r, 3, &burst) != 0))) {
+    return;
+  }
+  if(udpflow_set_pace(f, rate, burst) != 0) {
+    out_reply(r, "invalid", "rate\\_too\\_low");
+    return;
+  }
+  out_reply(r, "ok", NULL);
+}
+
+static void
+katcp_shadow(struct katcp_conn *c, const struct katcp_req *r)
+{
+  const struct wbmap_entry *e = NULL;
+  u32 n, words;
+
+  if(r->argc == 1) {
+    for(n=0; (e = wbshadow_get(n)); n++) {
+      out_begin('#', r);
+      out_char(' ');
+      out_str(e->name);
+      out_char(' ');
+      out_hex(e->offset);
+      out_char(' ');
+      out_hex(e->size);
+      out_char('\n');
+    }
+    out_begin('!', r);
+    out_str(" ok ");
+    out_udec(n);
+    out_char(' ');
+    out_udec(wbshadow_saved());
+    out_char('\n');
+    return;
+  }
+  if(r->argc > 3 || (strcmp(r->argv[1], "flush") != 0 &&
+     strcmp(r->argv[1], "refresh") != 0)) {
+    out_reply(r, "invalid", "usage:\\_[flush|refresh\\_[name]]");
+    return;
+  }
+  if(r->argc == 3 && !(e = katcp_dev(r, 2, 0))) {
+    return;
+  }
+  words = r->argv[1][0] == 'f' ? wbshadow_flush(e) : wbshadow_refresh(e);
+  out_begin('!', r);
+  out_str(" ok ");
+  out_udec(words);
+  out_char('\n');
+}
+
+static void
+katcp_bus(struct katcp_conn *c, const struct katcp_req *r)
+{
+  const struct wbbus_stats *s;
+  const struct wbmap_entry *e;
+  u32 n, faults, ear;
+
+  if(r->argc != 1) {
+    out_reply(r, "invalid", "usage:\\_no\\_arguments");
+    return;
+  }
+  for(n=0; (s = wbbus_stats(n, &e)); n++) {
+    if(!s->runs) {
+      continue;
+    }
+    out_begin('#', r);
+    out_char(' ');
+    out_str(e ? e->name : "unmapped");
+    out_char(' ');
+    out_udec(s->runs);
+    out_char(' ');
+    out_udec(s->words);
+    out_char(' ');
+    out_udec((u32)(s->cycles / s->runs));
+    out_char(' ');
+    out_udec(s->max_cycles);
+    out_char(' ');
+    out_udec(s->faults);
+    out_char('\n');
+  }
+  faults = wbbus_faults(&ear);
+  out_begin('!', r);
+  out_str(" ok ");
+  out_udec(faults);
+  out_char(' ');
+  out_hex(ear);
+  out_char('\n');
+}
+
+// ?preset statuses, by PRESET_* value
+static const char *const preset_status[] = {
+  "ok", "not-stored", "malformed", "timed-out", "loop", "stopped",
+  "bus-error"
+};
+
+static void
+katcp_preset(struct katcp_conn *c, const struct katcp_req *r)
+{
+  const struct preset_stats *s = preset_stats();
+  const u8 *code;
+  u32 n = 0, len = 0;
+  int l;
+
+  if(r->argc == 1) {
+    for(n=0; n<PRESET_MAX; n++) {
+      if((l = preset_len(n)) < 0) {
+        continue;
+      }
+      out_begin('#', r);
+      out_char(' ');
+      out_udec(n);
+      out_char(' ');
+      out_udec(l);
+      out_char('\n');
+    }
+    out_begin('!', r);
+    out_str(s->running ? " ok running " : " ok idle ");
+    out_udec(s->runs);
+    out_char(' ');
+    if(s->script == PRESET_MAX) {
+      out_str("exec");
+    } else {
+      out_udec(s->script);
+    }
+    out_char(' ');
+    out_str(preset_status[s->status]);
+    out_char(' ');
+    out_udec(s->at);
+    out_char(' ');
+    out_udec(s->ms);
+    out_char('\n');
+    return;
+  }
+  if(r->argc == 2 && strcmp(r->argv[1], "stop") == 0) {
+    preset_stop();
+    out_reply(r, "ok", NULL);
+    return;
+  }
+
+  code = (const u8 *)r->argv[r->argc - 1];
+  if(r->argc == 3 && strcmp(r->argv[1], "exec") == 0) {
+    len = r->argl[2];
+  } else if((r->argc == 3 && (strcmp(r->argv[1], "run") == 0 ||
+      strcmp(r->argv[1], "del") == 0)) ||
+     (r->argc == 4 && strcmp(r->argv[1], "set") == 0)) {
+    if(katcp_arg(r, 2, &n) != 0) {
+      return;
+    }
+    if(n >= PRESET_MAX) {
+      out_reply(r, "invalid", "out\\_of\\_range");
+      return;
+    }
+    len = r->argc == 4 ? r->argl[3] : 0;
+  } else {
+    out_reply(r, "invalid",
+        "usage:\\_[run\\_n|set\\_n\\_code|del\\_n|exec\\_code|stop]");
+    return;
+  }
+  if(len > PRESET_MAX_LEN || preset_check(code, len, NULL) != PRESET_OK) {
+    out_reply(r, "invalid", "malformed");
+    return;
+  }
+
+  switch(r->argv[1][0]) {
+  case 'e':
+    l = preset_exec(code, len, NULL, NULL);
+    break;
+  case 'r':
+    if(preset_len(n) <= 0) {
+      out_reply(r, "fail", "not\\_stored");
+      return;
+    }
+    l = preset_run(n, NULL, NULL);
+    break;
+  default:
+    l = preset_set(n, code, len);
+    break;
+  }
+  out_reply(r, l == 0 ? "ok" : "fail", l == 0 ? NULL : "busy");
+}
+
+static void
+katcp_memp(struct katcp_conn *c, const struct katcp_req *r)
+{
+  const struct memp_desc *d;
+  const struct memp_fail *f;
+  u32 n, holds, drops, count, total;
+
+  if(r->argc == 1) {
+    for(n=0; n<MEMP_MAX; n++) {
+      d = memp_pools[n];
+      out_begin('#', r);
+      out_char(' ');
+      out_str(d->desc);
+      out_char(' ');
+      out_udec(d->stats->used);
+      out_char(' ');
+      out_udec(d->stats->max);
+      out_char(' ');
+      out_udec(d->stats->avail);
+      out_char(' ');
+      out_udec(d->stats->err);
+      out_char('\n');
+    }
+    ethernetif_rx_nomem(netif_default, &holds, &drops);
+    out_begin('#', r);
+    out_str(" eth0-rx-held ");
+    out_udec(holds);
+    out_char(' ');
+    out_udec(drops);
+    out_char('\n');
+    out_begin('!', r);
+    out_str(" ok ");
+    out_udec(MEMP_MAX);
+    out_char('\n');
+  } else if(r->argc == 2 && strcmp(r->argv[1], "fails") == 0) {
+    n = memp_fail_count();
+    for(n = n > MEMP_FAIL_TRACE ? n - MEMP_FAIL_TRACE : 0;
+        (f = memp_fail_get(n)); n++) {
+      out_begin('#', r);
+      out_char(' ');
+      out_udec(n);
+      out_char(' ');
+      out_udec(f->time);
+      out_char(' ');
+      out_str(memp_pools[f->type]->desc);
+      out_char(' ');
+      out_hex((u32)f->caller);
+      out_char(' ');
+      out_hex((u32)f->origin);
+      out_char('\n');
+    }
+    out_begin('!', r);
+    out_str(" ok ");
+    out_udec(memp_fail_count());
+    out_char('\n');
+  } else if(r->argc == 3 && strcmp(r->argv[1], "sizes") == 0 &&
+      strcmp(r->argv[2], "reset") == 0) {
+    mem_size_reset();
+    out_reply(r, "ok", NULL);
+  } else if(r->argc == 2 && strcmp(r->argv[1], "sizes") == 0) {
+    total = 0;
+    for(n=0; n<MEM_SIZE_TRACE; n++) {
+      count = mem_size_count(n);
+      total += count;
+      if(!count) {
+        continue;
+      }
+      out_begin('#', r);
+      out_char(' ');
+      out_udec(n * MEM_SIZE_TRACE_STEP);
+      out_char(' ');
+      out_udec(count);
+      out_char('\n');
+    }
+    out_begin('!', r);
+    out_str(" ok ");
+    out_udec(total);
+    out_char('\n');
+  } else {
+    out_reply(r, "invalid", "usage:\\_[fails|sizes\\_[reset]]");
+  }
+}
+
+static const char *const rx_actions[] = { "free", "stack", "handler", "drop" };
+
+// Parse the field=value arguments of ?rx-rule set into `rule`, replying if
+// one is bad
+static int
+katcp_rx_match(const struct katcp_req *r, struct ethernetif_rx_rule *rule)
+{
+  const char *v;
+  u32 i, n;
+
+  for(i=4; i<r->argc; i++) {
+    if(strcmp(r->argv[i], "trace") == 0) {
+      rule->trace = 1;
+      continue;
+    }
+    v = strchr(r->argv[i], '=');
+    if(!v) {
+      break;
+    }
+    v++;
+    n = 0;
+    if(strncmp(r->argv[i], "dst=", 4) == 0) {
+      if(strcmp(v, "mcast") == 0) {
+        rule->match |= ETHERNETIF_RX_MATCH_MCAST;
+      } else if(katcp_mac(v, rule->dst.addr) == 0) {
+        rule->match |= ETHERNETIF_RX_MATCH_DST;
+      } else {
+        break;
+      }
+      continue;
+    }
+    if(katcp_number(v, strlen(v), &n) != 0) {
+      break;
+    }
+    if(strncmp(r->argv[i], "type=", 5) == 0 && n <= 0xffff) {
+      rule->match |= ETHERNETIF_RX_MATCH_TYPE;
+      rule->type = n;
+    } else if(strncmp(r->argv[i], "proto=", 6) == 0 && n <= 0xff) {
+      rule->match |= ETHERNETIF_RX_MATCH_PROTO;
+      rule->proto = n;
+    } else if(strncmp(r->argv[i], "port=", 5) == 0 && n <= 0xffff) {
+      rule->match |= ETHERNETIF_RX_MATCH_PORT;
+      rule->port = n;
+    } else {
+      break;
+    }
+  }
+  if(i < r->argc) {
+    out_reply(r, "invalid", "bad\\_match");
+    return -1;
+  }
+  return 0;
+}
+
+static void
+katcp_rx_rule(struct katcp_conn *c, const struct katcp_req *r)
+{
+  const struct ethernetif_rx_rule *e;
+  struct ethernetif_rx_rule rule;
+  u32 n, count = 0;
+
+  if(r->argc == 1) {
+    for(n=0; n<ETHERNETIF_RX_RULES; n++) {
+      e = ethernetif_rx_rule(netif_default, n);
+      if(!e) {
+        continue;
+      }
+      out_begin('#', r);
+      out_char(' ');
+      out_udec(n);
+      out_char(' ');
+      out_str(rx_actions[e->action]);
+      if(e->match & ETHERNETIF_RX_MATCH_TYPE) {
+        out_str(" type=");
+        out_hex(e->type);
+      }
+      if(e->match & ETHERNETIF_RX_MATCH_DST) {
+        out_str(" dst=");
+        out_mac(e->dst.addr);
+      }
+      if(e->match & ETHERNETIF_RX_MATCH_MCAST) {
+        out_str(" dst=mcast");
+      }
+      if(e->match & ETHERNETIF_RX_MATCH_PROTO) {
+        out_str(" proto=");
+        out_udec(e->proto);
+      }
+      if(e->match & ETHERNETIF_RX_MATCH_PORT) {
+        out_str(" port=");
+        out_udec(e->port);
+      }
+      if(e->trace) {
+        out_str(" trace");
+      }
+      out_char(' ');
+      out_udec(e->hits);
+      out_char('\n');
+      count++;
+    }
+    out_begin('!', r);
+    out_str(" ok ");
+    out_udec(count);
+    out_char('\n');
+    return;
+  }
+
+  if(r->argc < 3 || (strcmp(r->argv[1], "set") != 0 &&
+                     strcmp(r->argv[1], "del") != 0) ||
+     (strcmp(r->argv[1], "del") == 0 && r->argc != 3)) {
+    out_reply(r, "invalid",
+        "usage:\\_[set\\_n\\_drop|stack\\_[trace]\\_[field=value...]|del\\_n]");
+    return;
+  }
+  if(katcp_arg(r, 2, &n) != 0) {
+    return;
+  }
+  e = n < ETHERNETIF_RX_RULES ? ethernetif_rx_rule(netif_default, n) : NULL;
+  if(e && e->action == ETHERNETIF_RX_HANDLER) {
+    // Set up by the firmware, for a handler of its own
+    out_reply(r, "fail", "rule\\_in\\_use");
+    return;
+  }
+
+  memset(&rule, 0, sizeof(rule));
+  if(strcmp(r->argv[1], "set") == 0) {
+    if(r->argc < 4 || (strcmp(r->argv[3], "drop") != 0 &&
+                       strcmp(r->argv[3], "stack") != 0)) {
+      out_reply(r, "invalid", "bad\\_action");
+      return;
+    }
+    rule.action = strcmp(r->argv[3], "drop") == 0 ?
+        ETHERNETIF_RX_DROP : ETHERNETIF_RX_STACK;
+    if(katcp_rx_match(r, &rule) != 0) {
+      return;
+    }
+  }
+  if(ethernetif_set_rx_rule(netif_default, n,
+         rule.action ? &rule : NULL) != ERR_OK) {
+    out_reply(r, "fail", "no\\_such\\_rule");
+  } else {
+    out_reply(r, "ok", NULL);
+  }
+}
+
+static const char *const ftrace_modes[] = { "off", "rules", "all" };
+
+static void
+katcp_rx_irq(struct katcp_conn *c, const struct katcp_req *r)
+{
+  const struct ethernetif_rx_irq *q;
+  u32 ms;
+
+  if(r->argc == 2) {
+    if(katcp_arg(r, 1, &ms) != 0) {
+      return;
+    }
+    if(ms > 255 || ethernetif_set_rx_coalesce(netif_default, ms) != ERR_OK) {
+      out_reply(r, "fail", ms > 255 ? "too\\_long" : "no\\_interrupt");
+      return;
+    }
+  } else if(r->argc != 1) {
+    out_reply(r, "invalid", "usage:\\_[coalesce-ms]");
+    return;
+  }
+  q = ethernetif_rx_irq(netif_default);
+  out_begin('!', r);
+  out_str(ethernetif_polled(netif_default) ? " ok polled " : " ok interrupt ");
+  out_udec(q->coalesce_ms);
+  out_char(' ');
+  out_udec(q->interrupts);
+  out_char(' ');
+  out_udec(q->polls);
+  out_char(' ');
+  out_udec(q->full_passes);
+  out_char('\n');
+}
+
+static void
+katcp_ftrace(struct katcp_conn *c, const struct katcp_req *r)
+{
+  struct ftrace_stats s;
+  u32 mode;
+
+  if(r->argc == 1) {
+    ftrace_stats(&s);
+    out_begin('!', r);
+    out_str(" ok ");
+    out_str(ftrace_modes[s.mode]);
+    out_char(' ');
+    out_udec(s.frames);
+    out_char(' ');
+    out_udec(s.recorded);
+    out_char(' ');
+    out_udec(s.missed);
+    out_char('\n');
+    return;
+  }
+  if(r->argc == 2 && strcmp(r->argv[1], "clear") == 0) {
+    ftrace_clear();
+    out_reply(r, "ok", NULL);
+    return;
+  }
+  for(mode=0; r->argc == 2 && mode<=FTRACE_ALL; mode++) {
+    if(strcmp(r->argv[1], ftrace_modes[mode]) == 0) {
+      break;
+    }
+  }
+  if(r->argc != 2 || mode > FTRACE_ALL) {
+    out_reply(r, "invalid", "usage:\\_[off|rules|all|clear]");
+  } else if(!FTRACE_ENABLE && mode != FTRACE_OFF) {
+    out_reply(r, "fail", "not\\_built");
+  } else {
+    ftrace_set_mode(mode);
+    out_reply(r, "ok", NULL);
+  }
+}
+
+static const char *const ethloop_states[] = {
+  "idle", "running", "done", "no_loop", "no_memory",
+};
+
+static void
+katcp_loopback(struct katcp_conn *c, const struct katcp_req *r)
+{
+  const struct ethloop_result *res;
+  u32 i;
+
+  if(r->argc == 2 && strcmp(r->argv[1], "start") == 0) {
+    if(ethloop_start() != 0) {
+      out_reply(r, "fail", "busy");
+    } else {
+      out_reply(r, "ok", "running");
+    }
+    return;
+  }
+  if(r->argc != 1) {
+    out_reply(r, "invalid", "usage:\\_[start]");
+    return;
+  }
+  for(i=0; ethloop_state() != ETHLOOP_IDLE && (res = ethloop_result(i));
+      i++) {
+    if(!res->sent) {
+      break;
+    }
+    out_begin('#', r);
+    out_char(' ');
+    out_udec(res->size);
+    out_char(' ');
+    out_udec(res->sent);
+    out_char(' ');
+    out_udec(res->good);
+    out_char(' ');
+    out_udec(res->bad);
+    out_char(' ');
+    out_udec(res->good ? res->min_cycles : 0);
+    out_char(' ');
+    out_udec(res->good ? res->sum_cycles / res->good : 0);
+    out_char(' ');
+    out_udec(res->max_cycles);
+    out_char(' ');
+    out_udec(res->cycles ?
+        (u32)((u64)res->good * TIMEBASE_HZ / res->cycles) : 0);
+    out_char('\n');
+  }
+  out_reply(r, "ok", ethloop_states[ethloop_state()]);
+}
+
+static void
+katcp_iperf(struct katcp_conn *c, const struct katcp_req *r)
+{
+  const struct iperf_result *res = iperf_last();
+  ip4_addr_t ip;
+  u32 port = IPERF_PORT, ms = IPERF_CLIENT_MS;
+
+  if(r->argc == 1) {
+    out_begin('!', r);
+    out_str(iperf_server_on() ? " ok on " : " ok off ");
+    out_udec(res->runs);
+    out_char(' ');
+    out_udec(res->type);
+    out_char(' ');
+    out_udec(res->bytes);
+    out_char(' ');
+    out_udec(res->ms);
+    out_char(' ');
+    out_udec(res->kbps);
+    out_char(' ');
+    out_udec(res->cycles_per_kb);
+    out_char('\n');
+  } else if(r->argc == 3 && strcmp(r->argv[1], "server") == 0) {
+    if(strcmp(r->argv[2], "on") != 0 && strcmp(r->argv[2], "off") != 0) {
+      out_reply(r, "invalid", "usage:\\_server\\_on|off");
+    } else if(iperf_server(strcmp(r->argv[2], "on") == 0) != 0) {
+      out_reply(r, "fail", "out\\_of\\_memory");
+    } else {
+      out_reply(r, "ok", NULL);
+    }
+  } else if(r->argc >= 3 && r->argc <= 5 &&
+            strcmp(r->argv[1], "client") == 0) {
+    if(!ip4addr_aton(r->argv[2], &ip)) {
+      out_reply(r, "invalid", "bad\\_address");
+      return;
+    }
+    if((r->argc > 3 && katcp_arg(r, 3, &port) != 0) ||
+       (r->argc > 4 && katcp_arg(r, 4, &ms) != 0)) {
+      return;
+    }
+    if(port > 0xffff || iperf_client(ip4_addr_get_u32(&ip), port, ms) != 0) {
+      out_reply(r, "fail", "cannot\\_start");
+    } else {
+      out_reply(r, "ok", NULL);
+    }
+  } else {
+    out_reply(r, "invalid",
+        "usage:\\_[server\\_on|off|client\\_ip\\_[port\\_[ms]]]");
+  }
+}
+
+static const struct {
+  const char *name;
+  void (*fn)(struct katcp_conn *c, const struct katcp_req *r);
+} requests[] = {
+  { "wordread", katcp_wordread },
+  { "wordwrite", katcp_wordwrite },
+  { "read", katcp_read },
+  { "write", katcp_write },
+  { "listdev", katcp_listdev },
+  { "sensor-value", katcp_sensor_value },
+  { "xburst", katcp_xburst },
+  { "xadc-cal", katcp_xadc_cal },
+  { "throttle", katcp_throttle },
+  { "load", katcp_load },
+  { "timers", katcp_timers },
+  { "quota", katcp_quota },
+  { "watchdog", katcp_watchdog },
+  { "iperf", katcp_iperf },
+  { "arp", katcp_arp },
+  { "rx-rule", katcp_rx_rule },
+  { "rx-irq", katcp_rx_irq },
+  { "ftrace", katcp_ftrace },
+  { "loopback", katcp_loopback },
+  { "memp", katcp_memp },
+  { "snmp-trap", katcp_snmp_trap },
+  { "telpush", katcp_telpush },
+  { "influx", katcp_influx },
+  { "sntp", katcp_sntp },
+  { "ptp", katcp_ptp },
+  { "timed", katcp_timed },
+  { "blackbox", katcp_blackbox },
+  { "net", katcp_net },
+  { "port", katcp_port },
+  { "fabric", katcp_fabric },
+  { "flowctl", katcp_flowctl },
+  { "pace", katcp_pace },
+  { "preset", katcp_preset },
+  { "shadow", katcp_shadow },
+  { "bus", katcp_bus },
+  { "prof", katcp_prof },
+  { "bench", katcp_bench },
+  { "stack", katcp_stack },
+  { "boot", katcp_boot },
+  { "warm", katcp_warm },
+  { "reconfig", katcp_reconfig },
+  { "scrub", katcp_scrub },
+  { "wdog", katcp_wdog },
+  { "intr", katcp_intr },
+  { "crash", katcp_crash },
+  { "stream", katcp_stream },
+};
+
+#define NUM_REQUESTS (sizeof(requests) / sizeof(requests[0]))
+
+// Handle the `len` byte line at `line`, which has room for a NUL at
+// line[len]
+static void
+katcp_request(struct katcp_conn *c, char *line, u32 len)
+{
+  struct katcp_req r;
+  char *p, *end = line + len;
+  u32 i;
+
+  if(len && end[-1] == '\r') {
+    end--;
+  }
+  *end = 0;
+  // Only requests need answering
+  if(line == end || line[0] != '?') {
+    return;
+  }
+
+  // Split at blanks, terminating each argument
+  r.argc = 0;
+  for(p=line+1; p<end && r.argc<KATCP_MAX_ARGS; ) {
+    while(p < end && (*p == ' ' || *p == '\t')) {
+      p++;
+    }
+    if(p == end) {
+      break;
+    }
+    r.argv[r.argc] = p;
+    while(p < end && *p != ' ' && *p != '\t') {
+      p++;
+    }
+    r.argl[r.argc] = p - r.argv[r.argc];
+    *p++ = 0;
+    r.argc++;
+  }
+  if(!r.argc) {
+    return;
+  }
+
+  // name[id]
+  r.name = r.argv[0];
+  r.id = "";
+  p = strchr(r.argv[0], '[');
+  if(p && r.argv[0][r.argl[0] - 1] == ']') {
+    *p = 0;
+    r.argv[0][r.argl[0] - 1] = 0;
+    r.id = p + 1;
+  }
+
+  for(i=1; i<r.argc; i++) {
+    r.argl[i] = katcp_unescape(r.argv[i], r.argl[i]);
+    r.argv[i][r.argl[i]] = 0;
+  }
+
+  for(i=0; i<NUM_REQUESTS; i++) {
+    if(strcmp(r.name, requests[i].name) == 0) {
+      requests[i].fn(c, &r);
+      return;
+    }
+  }
+  out_reply(&r, "invalid", "unknown\\_request");
+}
+
+// Find the next whole line of received data.  Returns 0 if there is none
+// yet.  Otherwise sets `*used` to the bytes to consume and `*line` to the
+// line and `*len` to its length without the newline, or `*line` to NULL
+// for data to drop.
+static int
+katcp_line(struct katcp_conn *c, char **line, u32 *len, u32 *used)
+{
+  struct pbuf *q = c->rx.p;
+  u32 off = c->rx.off, n = 0;
+  char *s, *nl = NULL;
+
+  for(; q; q=q->next, off=0) {
+    s = (char *)q->payload + off;
+    nl = memchr(s, '\n', q->len - off);
+    if(nl) {
+      n += nl - s;
+      break;
+    }
+    n += q->len - off;
+  }
+
+  *line = NULL;
+  if(!nl) {
+    if(n <= KATCP_LINE_MAX) {
+      return 0;
+    }
+    // Hopeless: drop it as it comes, up to its end
+    if(!c->skip) {
+      LOG("katcp: dropping a line over %d bytes", KATCP_LINE_MAX);
+    }
+    c->skip = 1;
+    *used = n;
+    return 1;
+  }
+
+  *used = n + 1;
+  if(c->skip || n > KATCP_LINE_MAX) {
+    c->skip = 0;
+    return 1;
+  }
+  if(q == c->rx.p) {
+    *line = (char *)q->payload + c->rx.off;
+  } else {
+    pbuf_copy_partial(c->rx.p, c->line, n, c->rx.off);
+    *line = c->line;
+  }
+  *len = n;
+  return 1;
+}
+
+// Answer received requests while the send buffer has room for replies
+static void
+katcp_input(struct katcp_conn *c)
+{
+  struct tcp_pcb *pcb = c->pcb;
+  char *line;
+  u32 len, used;
+
+  while(tcp_sndbuf(pcb) >= KATCP_OUT_SIZE &&
+        tcp_sndqueuelen(pcb) + 2 <= TCP_SND_QUEUELEN) {
+    if(c->list_next >= 0) {
+      katcp_listdev_more(c);
+      continue;
+    }
+    if(!katcp_line(c, &line, &len, &used)) {
+      break;
+    }
+    if(line) {
+      katcp_request(c, line, len);
+    }
+    tcprx_drop(&c->rx, pcb, used);
+    katcp_flush(pcb);
+  }
+  tcp_output(pcb);
+}
+
+// Forget connection `c` and drop unconsumed data
+static void
+katcp_reset(struct katcp_conn *c)
+{
+  tcprx_free(&c->rx);
+  c->pcb = NULL;
+}
+
+// Close the connection.  Returns what a callback must return.
+static err_t
+katcp_close(struct katcp_conn *c)
+{
+  err_t err = tcprx_close(&c->rx, c->pcb);
+
+  katcp_reset(c);
+  return err;
+}
+
+static err_t
+katcp_recv(void *arg, struct tcp_pcb *pcb, struct pbuf *p, err_t err)
+{
+  struct katcp_conn *c = arg;
+
+  if(!p) {
+    return katcp_close(c);
+  }
+  tcprx_add(&c->rx, p);
+  katcp_input(c);
+  return ERR_OK;
+}
+
+static err_t
+katcp_sent(void *arg, struct tcp_pcb *pcb, u16_t len)
+{
+  katcp_input(arg);
+  return ERR_OK;
+}
+
+static void
+katcp_err(void *arg, err_t err)
+{
+  katcp_reset(arg);
+}
+
+static err_t
+katcp_accept(void *arg, struct tcp_pcb *pcb, err_t err)
+{
+  static const char hello[] = "#version-connect katcp-protocol 5.0-M\n";
+  struct katcp_conn *c = NULL;
+  u32 i;
+
+  for(i=0; i<KATCP_CLIENTS && !c; i++) {
+    if(!conns[i].pcb) {
+      c = &conns[i];
+    }
+  }
+  if(err != ERR_OK || !c) {
+    return ERR_MEM;
+  }
+
+  c->pcb = pcb;
+  tcprx_init(&c->rx);
+  c->skip = 0;
+  c->list_next = -1;
+
+  tcp_arg(pcb, c);
+  tcp_recv(pcb, katcp_recv);
+  tcp_sent(pcb, katcp_sent);
+  tcp_err(pcb, katcp_err);
+  tcp_write(pcb, hello, sizeof(hello) - 1, 0);
+  tcp_output(pcb);
+  return ERR_OK;
+}
+
+void
+init_katcp()
+{
+  struct tcp_pcb *pcb = tcp_new();
+
+  if(!pcb || tcp_bind(pcb, IP_ADDR_ANY, KATCP_PORT) != ERR_OK) {
+    return;
+  }
+  pcb = tcp_listen(pcb);
+  tcp_accept(pcb, katcp_accept);
+}
@@ -0,0 +1,311 @@
+#ifndef _KATCP_H_
+#define _KATCP_H_
+
+// katcp.h - KATCP control server.
+//
+// Speaks the KATCP line protocol (version 5, with message ids) on TCP port
+// KATCP_PORT, for control software that drives CASPER-style boards.  The
+// requests served are:
+//
+//   ?wordread name word-offset [count]   !wordread ok 0x... [0x...]
+//   ?wordwrite name word-offset value    !wordwrite ok
+//   ?read name byte-offset length        !read ok data
+//   ?write name byte-offset data         !write ok
+//   ?listdev [size|detail]               #listdev name [offset] [size]
+//                                        ... !listdev ok count
+//   ?sensor-value [sensor]               #sensor-value time 1 sensor
+//                                        status value ... !sensor-value ok n
+//   ?xburst                              !xburst ok idle|armed|done|failed
+//                                        channel command|alarm samples
+//                                        ns/sample
+//   ?xburst start|arm channel [samples]  !xburst ok
+//   ?xburst cancel                       !xburst ok
+//   ?xadc-cal                            #xadc-cal aux gain offset value
+//                                        ... !xadc-cal ok direct|mux
+//   ?xadc-cal aux gain offset            !xadc-cal ok
+//   ?throttle                            #throttle ms from to
+//                                        temp|supply|manual mC mV ...
+//                                        !throttle ok level auto|pinned
+//                                        changes
+//   ?throttle auto|pin level             !throttle ok
+//   ?load                                #load fn|other runs ms max-us
+//                                        share-pm ... !load ok busy-pm
+//                                        load-pm peak-pm alert-pm
+//                                        normal|alert alerts
+//   ?load reset|alert pm                 !load ok
+//   ?timers                              #timers name deadline-us runs
+//                                        misses late-us max-late-us
+//                                        mean-late-us ... !timers ok runs
+//                                        misses
+//   ?quota                               #quota class active peak max
+//                                        accepted over-max reserved ...
+//                                        !quota ok free-pcbs free-pbufs
+//                                        time-wait tw-reused tw-capped
+//                                        idle keepalive
+//   ?watchdog                            !watchdog ok
+//   ?iperf                               !iperf ok on|off runs type bytes
+//                                        ms kbit/s cycles/kB
+//   ?iperf server on|off                 !iperf ok
+//   ?iperf client ip [port [ms]]         !iperf ok
+//   ?arp                                 #arp ip mac ... !arp ok count
+//   ?arp add ip mac                      !arp ok
+//   ?arp del ip                          !arp ok
+//   ?rx-rule                             #rx-rule n action [field=value]
+//                                        [trace] hits ... !rx-rule ok
+//                                        count
+//   ?rx-rule set n drop|stack [trace] [field=value ...]
+//                                        !rx-rule ok
+//   ?rx-rule del n                       !rx-rule ok
+//   ?rx-irq [coalesce-ms]                !rx-irq ok interrupt|polled
+//                                        coalesce-ms interrupts polls
+//                                        full-passes
+//   ?ftrace                              !ftrace ok off|rules|all frames
+//                                        recorded missed
+//   ?ftrace off|rules|all|clear          !ftrace ok
+//   ?loopback                            #loopback size sent good bad
+//                                        min mean max frames/s ...
+//                                        !loopback ok idle|running|done|
+//                                        no_loop|no_memory
+//   ?loopback start                      !loopback ok running
+//   ?memp                                #memp pool used max avail errors
+//                                        ... #memp eth0-rx-held held drops
+//                                        !memp ok count
+//   ?memp fails                          #memp n ms pool caller origin
+//                                        ... !memp ok total
+//   ?memp sizes                          #memp bytes count ... !memp ok total
+//   ?memp sizes reset                    !memp ok
+//   ?snmp-trap                           !snmp-trap ok ip|off sent
+//                                        coalesced
+//   ?snmp-trap ip|off                    !snmp-trap ok
+//   ?telpush                             #telpush n ip|off port ...
+//                                        #telpush websocket viewers
+//                                        upgrades messages bytes skipped
+//                                        !telpush ok datagrams keyframes
+//                                        bytes errors held backfilled
+//                                        held-ram held-flash dropped
+//   ?telpush n ip [port]|off             !telpush ok
+//   ?influx                              !influx ok ip|off port datagrams
+//                                        lines bytes errors cycles
+//   ?influx ip [port]|off                !influx ok
+//   ?sntp                                !sntp ok ip|off syncs steps
+//                                        offset-us drift-ppb pps|nopps
+//                                        edges pps-offset-ns
+//   ?sntp ip|off                         !sntp ok
+//   ?ptp                                 !ptp ok on|off master|none syncs
+//                                        steps offset-ns delay-ns
+//                                        drift-ppb
+//   ?ptp on|off                          !ptp ok
+//   ?timed                               !timed ok queued done missed
+//                                        skew-ns min-ns max-ns mean-ns
+//   ?blackbox                            !blackbox ok bytes seq lost pages
+//                                        partial erases errors
+//   ?blackbox note arg [a [b [c]]]       !blackbox ok
+//   ?net                                 !net ok static|dhcp ip netmask gw
+//   ?net dhcp                            !net ok
+//   ?net static ip netmask [gw]          !net ok
+//   ?port                                #port n ip netmask tx-frames
+//                                        tx-bytes tx-drops rx-frames
+//                                        rx-bytes rx-drops ... !port ok count
+//   ?port n ip netmask|off               !port ok
+//   ?fabric                              #fabric n ip udp-port arp-writes
+//                                        ... !fabric ok count
+//   ?fabric n udp-port                   !fabric ok
+//   ?flowctl                             #flowctl n running|paused fill
+//                                        pauses paused-ms overflows ...
+//                                        !flowctl ok on|off high low
+//                                        min-pause-ms stale-ms
+//   ?flowctl off                         !flowctl ok
+//   ?flowctl high low [min-pause-ms [stale-ms]]   !flowctl ok
+//   ?pace                                #pace flow rate burst held
+//                                        refused ... !pace ok
+//   ?pace flow off|rate [burst]          !pace ok
+//   ?preset                              #preset n bytes ... !preset ok
+//                                        idle|running runs n|exec status
+//                                        at ms
+//   ?preset run|del n                    !preset ok
+//   ?preset set n code                   !preset ok
+//   ?preset exec code                    !preset ok
+//   ?preset stop                         !preset ok
+//   ?shadow                              #shadow name offset size ...
+//                                        !shadow ok count saved-reads
+//   ?shadow flush|refresh [name]         !shadow ok words
+//   ?bus                                 #bus name runs words cycles
+//                                        max-cycles faults ... !bus ok
+//                                        faults last-address
+//   ?prof                                !prof ok running|stopped samples
+//   ?prof start|stop|clear               !prof ok
+//   ?bench                               !bench ok on|off
+//   ?bench boot on|off                   !bench ok
+//   ?stack                               !stack ok peak size
+//                                        intact|overwritten
+//   ?boot                                #boot stage us ... !boot ok count
+//   ?warm                                !warm ok restored|cold saves
+//   ?warm save|clear                     !warm ok
+//   ?reconfig [slot]                     !reconfig ok slot
+//   ?scrub                               #scrub mode cycles/kB ...
+//                                        !scrub ok passes sectors unstable
+//                                        last-addr|none bad-slots
+//   ?scrub clear                         !scrub ok
+//   ?wdog                                #wdog task deadline-ms age-ms
+//                                        armed|idle ... !wdog ok
+//                                        task late-ms pc|expired|none
+//   ?intr                                #intr id fast|normal count
+//                                        mean-cycles max-cycles ...
+//                                        !intr ok min mean max pc on|off
+//   ?intr diag on|off                    !intr ok
+//   ?crash                               #crash rN value ... #crash stack
+//                                        word ... !crash ok
+//                                        last-reset|earlier cause pc esr
+//                                        ear|none
+//   ?crash clear                         !crash ok
+//   ?stream                              !stream ok sent received
+//                                        unhandled errors
+//   ?stream type [word ...]              !stream ok
+//
+// Names are the devices of wbmap.h and offsets are within the device.
+// Register values go as big-endian words, as in wbreg.h.  ?iperf shows
+// the last result of the throughput benchmark in iperf.h and switches its
+// server and client, and ?arp the static ARP entries of arpcfg.h.
+// ?rx-rule sets eth0's RX classifier (ethernetif_set_rx_rule()): frames
+// matching all of a rule's type=, dst= (a MAC or mcast), proto= and port=
+// are dropped in the core or passed to the stack, first match wins;
+// `trace` puts them in the frame trace.  Rules the firmware set for a
+// handler of its own cannot be changed.  ?rx-irq shows whether eth0's RX
+// runs on its interrupt or is polled under load (ethernetif.c), for how
+// long the interrupt is held masked after the core empties, the interrupts
+// taken, the switches to polling and the passes that took a full budget of
+// frames, and sets the hold.  ?ftrace shows the frame trace of
+// ftrace.h (its mode, the frames in the ring, those recorded since the
+// last clear and those missed during exports), sets what it records and
+// clears it.  ?loopback starts eth0's loopback self-test (ethloop.h), for
+// a port looped back, and shows the last run's state and, per frame size,
+// the frames sent, back intact and back wrong, their round trips in timer
+// cycles and the frames per second.
+// ?memp shows each lwIP memp pool's use and high-water mark, and how often
+// eth0 frames waited in the core for memory; ?memp fails the last
+// MEMP_FAIL_TRACE allocations that failed, with the return addresses of
+// memp_malloc() and, for pbuf_alloc(), of pbuf_alloc().  ?memp sizes
+// counts mem_malloc()'s requests by size since boot or the last reset, in
+// MEM_SIZE_TRACE_STEP byte buckets from `bytes` up, which is what the
+// classes of lwippools.h are sized from.
+// ?telpush lists where the telemetry push (telpush.h) goes, unicast or
+// multicast, the datagrams, keyframes and bytes sent and the sends that
+// failed, then the datagrams held for destinations that were down and
+// those sent on since (telbuf.h), the bytes held now in BRAM and in flash
+// and the datagrams dropped from BRAM, and sets or clears destination n,
+// by default on TELPUSH_PORT.  Its #telpush websocket line counts the web
+// UI's viewers (websock.h), now and since boot, and the messages and
+// bytes sent them and the messages they had no room for.
+// ?influx shows and sets the collector the line protocol exporter
+// (influx.h) sends to, by default on INFLUX_DEST_PORT, with the
+// datagrams, lines and bytes sent, the sends that failed and the timer
+// cycles the last period's formatting took.
+// ?snmp-trap shows and sets the manager SNMP traps go to (snmptrap.h),
+// with the traps sent and the events coalesced into them.  ?sntp shows
+// and sets the server the wall clock follows (sntpclock.h), with its
+// samples so far, how many stepped the clock, the last one's offset and
+// the timer drift being corrected, then whether it follows a 1PPS, the
+// edges seen and the last edge's offset from the clock.  ?ptp shows
+// whether the PTP slave (ptp.h) listens, and turns it on or off: the
+// clock identity of the master it follows, the Syncs followed and the
+// steps they caused, the last offset from the master, the mean path
+// delay and the drift its servo corrects.  ?timed shows the register
+// writes timed on the wall clock (wbtimed.h) queued, made and missed, and
+// the last, least, most and mean skew of those made.  ?blackbox shows the
+// blackbox event log's size in flash (bbox.h), the next sequence number,
+// the events lost to a full queue, the pages programmed full and partly,
+// the sectors erased and the flash operations that failed, and records a
+// note event, as to mark a test on the log.  ?net shows eth0's address and
+// how it got it, and sets how it gets it from the next boot (netcfg.h).  ?port
+// lists eth0 and the further 10 GbE ports (ethport.h) with their
+// addresses and frame counts, and sets a further port's address from the
+// next boot.  ?fabric shows the address and UDP port each core's data
+// path sends from and how many ARP entries have been copied into it
+// (fabric.h), and sets a core's port.  ?flowctl shows whether each core's
+// data path is paused for its collectors (flowctl.h) and how often it has
+// been, and sets or switches off the marks that pause and resume it.
+// ?pace lists the named UDP flows of udpflow.h with their token buckets,
+// in bytes a second and bytes, the frames each holds back and those it
+// refused, and paces a flow or stops pacing it.  ?preset lists the
+// register preset scripts stored (preset.h) and the last run: the script
+// or a one-off exec, how it ended, the offset of the step it stopped at
+// and how long it took.  It runs, stores and deletes scripts, whose code
+// is the argument's bytes (tools/preset.py assembles them), runs code
+// without storing it, and stops a run.  ?shadow lists the devices whose
+// registers are mirrored in BRAM (wbshadow.h) and the bus reads that has
+// saved, and writes a device's mirror, or all of them, back to the
+// gateware or reads it in again.  ?wordread, ?read and the writes go
+// through the mirrors, so a write-only device that is mirrored reads
+// back what was last written.  ?bus shows, for each device of wbmap.h
+// and the unmapped rest of the window, the runs of accesses made to it on
+// a client's behalf, their words, the mean and most timer cycles a run
+// took and the runs that met a bus error (wbbus.h), then the bus errors
+// since boot and the address of the last.  A register request that meets
+// one fails with bus_error.  ?prof
+// runs the PC-sampling profiler whose histogram pcprof.h serves, and
+// ?bench shows and sets whether the benchmarks of bench.h print on the
+// console at startup.  ?stack shows the most stack in use so far, in
+// bytes, and whether its guard words held (stack.h), and ?boot when each
+// startup stage finished (boot.h).  ?warm shows whether this boot
+// restored the runtime state of warm.h and saves it before a planned
+// restart, or clears it so the next boot starts cold.  ?reconfig reloads
+// the FPGA from a flash slot, by default the active one, once its image
+// has passed its CRC check and the reply has gone (icap.h).  ?scrub shows
+// the flash health scan's results (scrub.h), bad-slots one bit per slot,
+// with each read mode's speed, and clears them once the golden image has
+// been rewritten.  ?wdog lists the watchdog's tasks (wdog.h) and why the
+// last reset happened: the task that was late, or an expiry with no
+// record.  ?intr lists the connected interrupt sources (intr.h), whether
+// each is vectored in hardware, and the timer cycles its handler takes,
+// then the tick's entry latency in cycles, the PC the slowest tick
+// interrupted and whether the diagnostic mode is recording the latency
+// histograms tools/perf.py shows; ?intr diag starts and stops it.  ?crash
+// shows the last crash dump (crash.h), whether it caused the last reset or
+// an earlier one, and clears it.  ?stream counts the messages on the
+// AXI4-Stream link to the gateware (stream.h) and sends one of `type`
+// with up to six data words.  ?xburst captures a burst of XADC channel
+// `channel` (an xadc.h index: 0 temperature, 1 VCCINT, 2 VCCAUX, 3 VBRAM,
+// 4 VP/VN, 5 on the aux inputs) at full rate now, or arms one for the next
+// alarm, and shows the last one's state, what triggered it, its samples
+// and the time between them; xburst.h serves the samples.  ?xadc-cal lists
+// the aux inputs in the scan with their calibration (xadccal.h) and
+// latest calibrated value, and whether they come through the external
+// mux, and sets an input's gain (1/65536ths) and offset.  ?throttle lists
+// the last changes of the thermal throttling level (throttle.h), when,
+// from and to which level, why and the temperature and VCCINT then, and
+// shows the level, whether it is pinned and the changes since boot; it
+// pins the level by hand or hands it back to the controller.  ?load lists
+// the main loop's tasks (load.h) by function address, each with its runs,
+// time in all, longest run and share of the last second, then shows the
+// last second's busy share, the rolling load and its peak, the alert
+// threshold, whether the alert is raised and the alerts since boot, all
+// shares in 1/1000ths; it forgets the tasks and peak, or sets the
+// threshold.  ?timers lists the timers with deadlines of their own
+// (timer.h), each with its deadline, runs, misses and how late the last
+// run started, the latest and the mean, then shows the runs and misses of
+// all timers.  ?quota lists the classes of TCP service (quota.h), each
+// with its connections now and at most, its limit (0 for none), the
+// connections admitted and those refused for the limit or the reserve,
+// then shows the PCBs and receive buffers free, the PCBs in TIME-WAIT,
+// and those lwIP took back: from TIME-WAIT for a new connection and for
+// TCP_TW_MAX, and connections reset as idle or as keepalives went
+// unanswered.  ?watchdog is KATCP's
+// ping and does not touch the hardware watchdog.
+// Requests may be pipelined; they are answered in order.
+
+#include "xil_types.h"
+
+// The port KATCP servers conventionally listen on
+#define KATCP_PORT (7147)
+
+// Connections served at once
+#define KATCP_CLIENTS (2)
+
+// Longest request line, and the longest ?read
+#define KATCP_LINE_MAX (1024)
+#define KATCP_READ_MAX (512)
+
+// Listen on KATCP_PORT.  Call after lwip_init().
+void init_katcp();
+
+#endif // _KATCP_H_
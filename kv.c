@@ -0,0 +1,441 @@
+// kv.c - Log-structured key/value config store in SPI flash.
+//
+// Two reserved sectors at the top of flash take turns holding an append-only
+// log of records.  Each sector starts with a header carrying a sequence number;
+// the valid one with the higher sequence is active.  Setting a key appends one
+// record to the active sector, so it costs a single page program (records never
+// straddle a page), and the latest record of a key wins.  When the active
+// sector fills up, its live records are copied into the erased spare sector,
+// whose header is written last so a reset part way through leaves the old
+// sector in charge.  Alternating the sectors spreads the erases.
+//
+// init_kv() scans the active sector once to build the index of each key's
+// record, so kv_get() goes straight to the value.
+
+#include <string.h>
+
+#include "xil_printf.h"
+
+#include "crc32.h"
+#include "flash.h"
+#include "kv.h"
+#include "log.h"
+#include "ovl.h"
+
+// "KVS1" read as a little-endian word
+#define KV_SECTOR_MAGIC (0x3153564b)
+#define KV_REC_MAGIC    (0xa5)
+#define KV_ERASED       (0xff)
+
+struct kv_sector_hdr {
+  u32 magic;
+  u32 seq;
+};
+
+struct kv_rec_hdr {
+  u8 magic;
+  u8 key;
+  u16 len;  // 0 deletes the key
+  u32 crc;  // CRC-32 of key, len and value
+};
+
+#define KV_HDR_SIZE (sizeof(struct kv_rec_hdr))
+// Records are padded to a word so headers stay aligned
+#define KV_REC_SIZE(len) ((KV_HDR_SIZE + (len) + 3) & ~3)
+#define KV_REC_MAX KV_REC_SIZE(KV_MAX_VALUE)
+
+#define KV_IDLE      (0)
+#define KV_WRITE     (1) // appending to the active sector
+#define KV_GC_ERASE  (2) // erasing the spare sector
+#define KV_GC_COPY   (3) // copying live records to the spare sector
+#define KV_GC_NEW    (4) // writing the new record to the spare sector
+#define KV_GC_COMMIT (5) // writing the spare sector's header
+
+// Flash address of sector 0 and the size of each sector
+static u32 kv_base;
+static u32 kv_sector_size;
+// Active sector, its sequence number and where the next record goes
+static u8 kv_active;
+static u32 kv_seq;
+static u32 kv_wr;
+
+// Offset of each key's record in the active sector (0 if unset) and the
+// length of its value
+static u16 kv_off[KV_MAX_KEYS];
+static u8 kv_len[KV_MAX_KEYS];
+
+static struct {
+  u8 state;
+  kv_done_fn done;
+  void *arg;
+
+  // Record being set and where it goes
+  u8 key;
+  u32 len;
+  u32 off;
+  u8 rec[KV_REC_MAX];
+
+  // Compaction: next key to copy, write offset and new index
+  u32 copy_key;
+  u32 wr;
+  u16 off_new[KV_MAX_KEYS];
+  struct kv_sector_hdr hdr;
+  u8 buf[KV_REC_MAX];
+} kv_op;
+
+static void kv_gc_next();
+
+static u32
+kv_sector(u8 s)
+{
+  return kv_base + s * kv_sector_size;
+}
+
+// First offset at or after `off` where a `size` byte record does not cross
+// a page boundary
+static u32
+kv_place(u32 off, u32 size)
+{
+  u32 page = flash_info.page_size;
+
+  if((off & (page - 1)) + size > page) {
+    off = (off + page - 1) & ~(page - 1);
+  }
+  return off;
+}
+
+static u32
+kv_crc(const u8 *rec)
+{
+  const struct kv_rec_hdr *h = (const struct kv_rec_hdr *)rec;
+
+  // key and len are the three bytes after magic
+  return crc32(crc32(0, rec + 1, 3), rec + KV_HDR_SIZE, h->len);
+}
+
+// Rebuild the index from the active sector's log
+static void
+kv_scan()
+{
+  struct kv_rec_hdr *h = (struct kv_rec_hdr *)kv_op.buf;
+  u32 base = kv_sector(kv_active);
+  u32 page = flash_info.page_size;
+  u32 off = sizeof(struct kv_sector_hdr);
+
+  memset(kv_off, 0, sizeof(kv_off));
+
+  while(off + KV_HDR_SIZE <= kv_sector_size) {
+    if(read_flash_cached(base + off, kv_op.buf, KV_HDR_SIZE) != KV_HDR_SIZE) {
+      break;
+    }
+    // Erased at a page start: end of the log
+    if(h->magic == KV_ERASED && !(off & (page - 1))) {
+      break;
+    }
+    // Padding before a page boundary, or a torn write: resume at the next
+    // page
+    if(h->magic != KV_REC_MAGIC || h->key >= KV_MAX_KEYS ||
+       h->len > KV_MAX_VALUE) {
+      off = (off + page) & ~(page - 1);
+      continue;
+    }
+
+    // Records with a bad CRC are skipped
+    if(read_flash_cached(base + off + KV_HDR_SIZE, kv_op.buf + KV_HDR_SIZE,
+          h->len) == h->len && kv_crc(kv_op.buf) == h->crc) {
+      kv_off[h->key] = h->len ? off : 0;
+      kv_len[h->key] = h->len;
+    }
+    off += KV_REC_SIZE(h->len);
+  }
+
+  kv_wr = off;
+}
+
+void
+init_kv()
+{
+  struct kv_sector_hdr h[2];
+  int valid[2];
+  u8 s;
+
+  kv_sector_size = flash_rsv_size();
+  kv_base = flash_rsv_addr(FLASH_RSV_KV);
+
+  for(s=0; s<2; s++) {
+    valid[s] = read_flash_cached(kv_sector(s), (u8 *)&h[s], sizeof(h[s]))
+        == sizeof(h[s]) && h[s].magic == KV_SECTOR_MAGIC;
+  }
+
+  if(!valid[0] && !valid[1]) {
+    // Unformatted: an empty, full sector 1 makes the first kv_set()
+    // format sector 0
+    memset(kv_off, 0, sizeof(kv_off));
+    kv_active = 1;
+    kv_seq = 0;
+    kv_wr = kv_sector_size;
+    return;
+  }
+
+  if(valid[0] && valid[1]) {
+    kv_active = (s32)(h[1].seq - h[0].seq) > 0;
+  } else {
+    kv_active = valid[1];
+  }
+  kv_seq = h[kv_active].seq;
+  kv_scan();
+}
+
+int
+kv_get(u8 key, void *buf, u32 size)
+{
+  u32 n;
+
+  if(key >= KV_MAX_KEYS || !kv_off[key]) {
+    return -1;
+  }
+
+  n = kv_len[key] < size ? kv_len[key] : size;
+  if(read_flash_cached(kv_sector(kv_active) + kv_off[key] + KV_HDR_SIZE,
+        buf, n) != n) {
+    return -1;
+  }
+  return kv_len[key];
+}
+
+static void
+kv_finish(int err)
+{
+  kv_done_fn done = kv_op.done;
+
+  kv_op.state = KV_IDLE;
+  if(done) {
+    done(err, kv_op.arg);
+  }
+}
+
+// Point the index at the record just written
+static void
+kv_index_set(u16 *index)
+{
+  index[kv_op.key] = kv_op.len ? kv_op.off : 0;
+  kv_len[kv_op.key] = kv_op.len;
+}
+
+static void
+kv_write_done(int err, void *arg)
+{
+  u32 page = flash_info.page_size;
+
+  if(err) {
+    // The page may hold part of the record; carry on after it
+    kv_wr = (kv_op.off + page) & ~(page - 1);
+  } else {
+    kv_index_set(kv_off);
+    kv_wr = kv_op.off + KV_REC_SIZE(kv_op.len);
+  }
+  kv_finish(err);
+}
+
+static void
+kv_gc_commit(int err, void *arg)
+{
+  if(!err) {
+    kv_active ^= 1;
+    kv_seq++;
+    kv_index_set(kv_op.off_new);
+    memcpy(kv_off, kv_op.off_new, sizeof(kv_off));
+    kv_wr = kv_op.wr;
+  }
+  kv_finish(err);
+}
+
+static void
+kv_gc_step(int err, void *arg)
+{
+  if(err) {
+    kv_finish(err);
+    return;
+  }
+  kv_gc_next();
+}
+
+// Program `size` bytes of `src` at the next free offset of the spare sector
+static int
+kv_gc_program(const u8 *src, u32 size, u32 *off)
+{
+  *off = kv_place(kv_op.wr, size);
+  if(*off + size > kv_sector_size) {
+    return -1;
+  }
+  kv_op.wr = *off + size;
+  return program_flash(kv_sector(kv_active ^ 1) + *off, src, size,
+      kv_gc_step, NULL);
+}
+
+// Copy the next live record, then the new one, then commit with the header
+static void
+kv_gc_next()
+{
+  u32 src = kv_sector(kv_active);
+  u32 key, size;
+  u32 off;
+
+  if(kv_op.state == KV_GC_COPY) {
+    while(kv_op.copy_key < KV_MAX_KEYS) {
+      key = kv_op.copy_key++;
+      // The key being set is superseded
+      if(!kv_off[key] || key == kv_op.key) {
+        continue;
+      }
+      size = KV_REC_SIZE(kv_len[key]);
+      if(read_flash_cached(src + kv_off[key], kv_op.buf, size) != size ||
+         kv_gc_program(kv_op.buf, size, &off)) {
+        kv_finish(-1);
+        return;
+      }
+      kv_op.off_new[key] = off;
+      return;
+    }
+    kv_op.state = KV_GC_NEW;
+    // A deleted key just stays out of the new sector
+    if(kv_op.len) {
+      if(kv_gc_program(kv_op.rec, KV_REC_SIZE(kv_op.len), &kv_op.off)) {
+        kv_finish(-1);
+      }
+      return;
+    }
+  }
+
+  kv_op.state = KV_GC_COMMIT;
+  kv_op.hdr.magic = KV_SECTOR_MAGIC;
+  kv_op.hdr.seq = kv_seq + 1;
+  if(program_flash(kv_sector(kv_active ^ 1), (const u8 *)&kv_op.hdr,
+        sizeof(kv_op.hdr), kv_gc_commit, NULL)) {
+    kv_finish(-1);
+  }
+}
+
+static void
+kv_gc_erased(int err, void *arg)
+{
+  if(err) {
+    kv_finish(err);
+    return;
+  }
+  kv_op.state = KV_GC_COPY;
+  kv_op.copy_key = 0;
+  kv_op.wr = sizeof(struct kv_sector_hdr);
+  memset(kv_op.off_new, 0, sizeof(kv_op.off_new));
+  kv_gc_next();
+}
+
+int
+kv_set(u8 key, const void *val, u32 len, kv_done_fn done, void *arg)
+{
+  struct kv_rec_hdr *h = (struct kv_rec_hdr *)kv_op.rec;
+  u32 size = KV_REC_SIZE(len);
+
+  if(kv_op.state != KV_IDLE || !kv_sector_size ||
+     key >= KV_MAX_KEYS || len > KV_MAX_VALUE) {
+    return -1;
+  }
+
+  h->magic = KV_REC_MAGIC;
+  h->key = key;
+  h->len = len;
+  if(len) {
+    memcpy(kv_op.rec + KV_HDR_SIZE, val, len);
+  }
+  memset(kv_op.rec + KV_HDR_SIZE + len, KV_ERASED, size - KV_HDR_SIZE - len);
+  h->crc = kv_crc(kv_op.rec);
+
+  kv_op.key = key;
+  kv_op.len = len;
+  kv_op.done = done;
+  kv_op.arg = arg;
+
+  kv_op.off = kv_place(kv_wr, size);
+  if(kv_op.off + size <= kv_sector_size) {
+    kv_op.state = KV_WRITE;
+    if(program_flash(kv_sector(kv_active) + kv_op.off, kv_op.rec, size,
+          kv_write_done, NULL)) {
+      kv_op.state = KV_IDLE;
+      return -1;
+    }
+    return 0;
+  }
+
+  // Active sector is full: compact into the spare one
+  kv_op.state = KV_GC_ERASE;
+  if(erase_flash(kv_sector(kv_active ^ 1), kv_sector_size,
+        kv_gc_erased, NULL)) {
+    kv_op.state = KV_IDLE;
+    return -1;
+  }
+  return 0;
+}
+
+int
+kv_busy()
+{
+  return kv_op.state != KV_IDLE;
+}
+
+static void
+kv_saved(int err, void *arg)
+{
+  struct kv_save *s = arg;
+
+  s->saving = 0;
+  if(err) {
+    LOG("kv: saving key %u failed (%d)", s->key, err);
+    s->dirty = 1;
+  }
+  if(s->dirty) {
+    timer_start(&s->timer, KV_SAVE_RETRY_MS, 0);
+  }
+}
+
+void
+kv_save_run(void *arg)
+{
+  struct kv_save *s = arg;
+
+  if(s->saving) {
+    s->dirty = 1;
+    return;
+  }
+  s->saving = 1;
+  s->dirty = 0;
+  if(kv_set(s->key, s->val, s->len, kv_saved, s) != 0) {
+    // Busy with another key
+    s->saving = 0;
+    s->dirty = 1;
+    timer_start(&s->timer, KV_SAVE_RETRY_MS, 0);
+  }
+}
+
+void
+kv_save(struct kv_save *s, const void *val, u32 len)
+{
+  s->val = val;
+  s->len = len;
+  kv_save_run(s);
+}
+
+OVL_TEXT(report) void
+dump_kv()
+{
+  int i;
+
+  xil_printf("KV store at %08x, %d KB sectors:\n", kv_base,
+      kv_sector_size >> 10);
+  xil_printf("  active    %d (seq %d)\n", kv_active, kv_seq);
+  xil_printf("  used      %d of %d B\n", kv_wr, kv_sector_size);
+  for(i=0; i<KV_MAX_KEYS; i++) {
+    if(kv_off[i]) {
+      xil_printf("  key %d: %d B at %04x\n", i, kv_len[i], kv_off[i]);
+    }
+  }
+}
@@ -0,0 +1,88 @@
+#ifndef _KV_H_
+#define _KV_H_
+
+// kv.h - Log-structured key/value config store in SPI flash.
+
+#include "xil_types.h"
+
+#include "timer.h"
+
+// Keys are small integers, so the index is a plain array
+#define KV_MAX_KEYS  (64)
+// Largest value; a record (8 byte header plus value) fits in one page
+#define KV_MAX_VALUE (240)
+
+// Keys in use
+#define KV_KEY_ARP   (1) // static ARP entries, see arpcfg.h
+#define KV_KEY_SNMP_TRAP (2) // SNMP trap manager, see snmptrap.h
+#define KV_KEY_SNTP  (3) // SNTP server, see sntpclock.h
+#define KV_KEY_NETCFG (4) // eth0 address configuration, see netcfg.h
+#define KV_KEY_DHCP_LEASE (5) // last DHCP lease, see netcfg.h
+#define KV_KEY_BENCH (6) // run the benchmark at boot, see bench.h
+#define KV_KEY_WARM  (7) // runtime state across restarts, see warm.h
+#define KV_KEY_CRASH (8) // the last crash dump, see crash.h
+#define KV_KEY_PORTCFG (9) // addresses of the ports after eth0, see ethport.h
+#define KV_KEY_FABRIC (10) // data path UDP ports, see fabric.h
+#define KV_KEY_SCRUB (11) // flash health scan results, see scrub.h
+#define KV_KEY_PRESET (12) // register preset scripts, up to
+                           // KV_KEY_PRESET + PRESET_MAX - 1, see preset.h
+#define KV_KEY_XADC_CAL (16) // aux input calibration, see xadccal.h
+#define KV_KEY_TELPUSH (17) // telemetry push destinations, see telpush.h
+#define KV_KEY_INFLUX (18) // line protocol collector, see influx.h
+
+typedef void (*kv_done_fn)(int err, void *arg);
+
+// Scan the store's two reserved flash sectors and build the index.
+// Call after init_flash().
+void init_kv();
+
+// Copy the value of `key` into `buf` (at most `size` bytes).
+//
+// Returns the value's length, or -1 if `key` is not set or the value cannot
+// be read (e.g. the flash is busy programming and the record is not cached).
+int kv_get(u8 key, void *buf, u32 size);
+
+// Set `key` to `len` bytes at `val` (`len` 0 deletes it).  The record is
+// appended in the background; `done` is called with 0 once it is on flash
+// and kv_get() returns the new value.  When the active sector is full its
+// live records are first copied to the spare one.
+//
+// Returns 0 if started, -1 if busy or the arguments are invalid.
+int kv_set(u8 key, const void *val, u32 len, kv_done_fn done, void *arg);
+
+// Returns non-zero while a kv_set() is in progress
+int kv_busy();
+
+// How soon a background save tries again when the store is busy
+#define KV_SAVE_RETRY_MS (100)
+
+// A value saved to `key` in the background, for settings changed at run
+// time.  One save of it is in flight at a time: a change made meanwhile
+// marks it dirty, and another save starts once that one is done.  A save
+// that finds the store busy with another key, or fails, is tried again
+// KV_SAVE_RETRY_MS later.
+struct kv_save {
+  u8 key;
+  // Changed since the last save started, and a save in flight
+  u8 dirty;
+  u8 saving;
+  const void *val;
+  u32 len;
+  struct timer timer;
+};
+
+// The timer's routine, for KV_SAVE_INIT
+void kv_save_run(void *arg);
+
+#define KV_SAVE_INIT(name, key) \
+  { (key), 0, 0, NULL, 0, TIMER_INIT(kv_save_run, &(name)) }
+
+// Save `len` bytes at `val` to the key of `s` (`len` 0 deletes it).  The
+// bytes are read when the save starts, so `val` must stay valid, and the
+// latest value is what ends up saved.
+void kv_save(struct kv_save *s, const void *val, u32 len);
+
+// Print the store's location, fill level and keys
+void dump_kv();
+
+#endif // _KV_H_
@@ -0,0 +1,121 @@
+// lmbscrub.c - Background scrub of the local memory (see lmbscrub.h).
+
+#include "xil_io.h"
+#include "xil_printf.h"
+
+#include "dma.h"
+#include "intr.h"
+#include "lmbscrub.h"
+#include "ovl.h"
+#include "sched.h"
+#include "timebase.h"
+
+static struct lmbscrub_stats stats = {
+  .first_ce = LMBSCRUB_NONE,
+  .first_ue = LMBSCRUB_NONE,
+};
+
+#if LMBSCRUB_ECC
+
+#if XPAR_MICROBLAZE_FAULT_TOLERANT
+// The BSP's, in microblaze_scrub.S, which no header declares
+void microblaze_scrub();
+#endif
+
+static u32 last_ms;
+
+// Count and clear what the controller has seen since the last slice
+static void
+lmbscrub_check()
+{
+#ifdef LMBSCRUB_CTRL
+  u32 status = Xil_In32(LMBSCRUB_CTRL + LMBSCRUB_ECC_STATUS);
+  u32 ce = Xil_In32(LMBSCRUB_CTRL + LMBSCRUB_CE_CNT);
+
+  if(!status && !ce) {
+    return;
+  }
+  if(status & LMBSCRUB_ECC_CE) {
+    stats.corrected += ce ? ce : 1;
+    if(stats.first_ce == LMBSCRUB_NONE) {
+      stats.first_ce = Xil_In32(LMBSCRUB_CTRL + LMBSCRUB_CE_FFA);
+    }
+  }
+  if(status & LMBSCRUB_ECC_UE) {
+    stats.uncorrectable++;
+    if(stats.first_ue == LMBSCRUB_NONE) {
+      stats.first_ue = Xil_In32(LMBSCRUB_CTRL + LMBSCRUB_UE_FFA);
+    }
+  }
+  Xil_Out32(LMBSCRUB_CTRL + LMBSCRUB_CE_CNT, 0);
+  Xil_Out32(LMBSCRUB_CTRL + LMBSCRUB_ECC_STATUS, status);
+#endif
+}
+
+// Idle hook: read and write back the next LMBSCRUB_WORDS words
+static int
+lmbscrub_idle(void *arg)
+{
+  volatile u32 *p;
+  u32 now = timebase_ms(), msr, i, v;
+
+  if(now - last_ms < LMBSCRUB_PERIOD_MS || dma_busy()) {
+    return 0;
+  }
+  last_ms = now;
+  p = (volatile u32 *)(LMBSCRUB_BASE + stats.cursor);
+  // A handler writing a word between the read and the write would lose
+  // its write
+  msr = intr_lock();
+  for(i=0; i<LMBSCRUB_WORDS; i++) {
+    v = p[i];
+    p[i] = v;
+  }
+#if XPAR_MICROBLAZE_FAULT_TOLERANT
+  microblaze_scrub();
+#endif
+  intr_unlock(msr);
+  stats.cursor += LMBSCRUB_WORDS * 4;
+  if(stats.cursor >= LMBSCRUB_SIZE) {
+    stats.cursor = 0;
+    stats.passes++;
+  }
+  lmbscrub_check();
+  return 0;
+}
+
+static struct sched_hook idle_hook = SCHED_HOOK_INIT(lmbscrub_idle, NULL);
+
+#endif // LMBSCRUB_ECC
+
+void
+init_lmbscrub()
+{
+#if LMBSCRUB_ECC
+  last_ms = timebase_ms();
+  lmbscrub_check();
+  sched_add_idle(&idle_hook);
+#endif
+}
+
+const struct lmbscrub_stats *
+lmbscrub_stats()
+{
+  return &stats;
+}
+
+OVL_TEXT(report) void
+dump_lmbscrub()
+{
+  if(!LMBSCRUB_ECC) {
+    return;
+  }
+  xil_printf("LMB scrub: %d passes, %d corrected, %d uncorrectable\n",
+      stats.passes, stats.corrected, stats.uncorrectable);
+  if(stats.first_ce != LMBSCRUB_NONE) {
+    xil_printf("  first corrected at %08x\n", stats.first_ce);
+  }
+  if(stats.first_ue != LMBSCRUB_NONE) {
+    xil_printf("  first uncorrectable at %08x\n", stats.first_ue);
+  }
+}
@@ -0,0 +1,81 @@
+#ifndef _LMBSCRUB_H_
+#define _LMBSCRUB_H_
+
+// lmbscrub.h - Background scrub of the local memory under ECC.
+//
+// With ECC on the LMB BRAM controller a single-bit upset is corrected on
+// every read, but is left in the BRAM until the word is written again, and
+// a second upset in the same word is beyond repair.  The BSP's
+// microblaze_scrub() rewrites a word, and a line of each cache, per call,
+// from a timer interrupt; looping it over the whole memory would stall
+// the CPU for the best part of a millisecond.  Instead an idle hook reads
+// and writes back LMBSCRUB_WORDS words at a cursor, with interrupts masked
+// for those only, once every LMBSCRUB_PERIOD_MS while the main loop has
+// nothing else to do, so a full pass over LMBSCRUB_SIZE bytes takes
+// LMBSCRUB_SIZE / (4 * LMBSCRUB_WORDS) slices.  Where the core is fault
+// tolerant each slice also calls microblaze_scrub() once, for its caches,
+// UTLB and branch target cache.  Slices wait while the CDMA runs (dma.h),
+// as it may write the BRAM through its second port between a read and
+// the write back.
+//
+// Where the controller has its status registers, each slice reads the
+// corrected error count and status, counting the corrected and the
+// uncorrectable errors and keeping the first failing address of each,
+// and clears them.  The counts go into the telemetry export's header
+// (telemetry.h) and the startup report.
+//
+// Without LMB ECC in the gateware (LMBSCRUB_ECC 0) none of this is built:
+// init_lmbscrub() adds no hook and the counts stay 0.
+
+#include "xil_types.h"
+#include "xparameters.h"
+
+#define LMBSCRUB_ECC \
+    (XPAR_MICROBLAZE_0_LOCAL_MEMORY_DLMB_BRAM_IF_CNTLR_ECC)
+#define LMBSCRUB_BASE \
+    (XPAR_MICROBLAZE_0_LOCAL_MEMORY_DLMB_BRAM_IF_CNTLR_BASEADDR)
+#define LMBSCRUB_SIZE \
+    (XPAR_MICROBLAZE_0_LOCAL_MEMORY_DLMB_BRAM_IF_CNTLR_HIGHADDR - \
+    LMBSCRUB_BASE + 1)
+
+// The controller's registers (PG112), if it has them
+#if LMBSCRUB_ECC && \
+    XPAR_MICROBLAZE_0_LOCAL_MEMORY_DLMB_BRAM_IF_CNTLR_ECC_STATUS_REGISTERS
+#define LMBSCRUB_CTRL \
+    (XPAR_MICROBLAZE_0_LOCAL_MEMORY_DLMB_BRAM_IF_CNTLR_S_AXI_CTRL_BASEADDR)
+#endif
+#define LMBSCRUB_ECC_STATUS (0x000) // write 1 to clear
+#define LMBSCRUB_ECC_UE     (1 << 0)
+#define LMBSCRUB_ECC_CE     (1 << 1)
+#define LMBSCRUB_CE_CNT     (0x00c) // saturates; written to 0
+#define LMBSCRUB_CE_FFA     (0x100)
+#define LMBSCRUB_UE_FFA     (0x200)
+
+// Words per slice: a few hundred cycles with interrupts masked
+#define LMBSCRUB_WORDS      (64)
+#define LMBSCRUB_PERIOD_MS  (1)
+
+#define LMBSCRUB_NONE       (0xffffffff)
+
+struct lmbscrub_stats {
+  // Passes over the memory completed, and the byte offset of the next
+  // slice
+  u32 passes;
+  u32 cursor;
+  // Errors corrected and found uncorrectable, and the address of the
+  // first of each (LMBSCRUB_NONE if none)
+  u32 corrected;
+  u32 uncorrectable;
+  u32 first_ce;
+  u32 first_ue;
+};
+
+// Add the idle hook, where the gateware has LMB ECC
+void init_lmbscrub();
+
+const struct lmbscrub_stats *lmbscrub_stats();
+
+// Print the counts, if the scrub runs
+void dump_lmbscrub();
+
+#endif // _LMBSCRUB_H_
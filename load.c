@@ -0,0 +1,183 @@
+// load.c - CPU load of the main loop (see load.h).
+//
+// Entries are found by a hash of the function address into `tasks`, open
+// addressed with linear probing, so a dispatch costs two timer reads and
+// a compare or two.  `inner` collects the cycles of the dispatches nested
+// in the current one, which load_end() takes off its time and adds to the
+// one around it.  `mark` holds each entry's cycles at the start of the
+// window, for its share.
+
+#include <string.h>
+
+#include "load.h"
+#include "log.h"
+#include "sched.h"
+#include "timebase.h"
+#include "timer.h"
+
+static struct load_task tasks[LOAD_TASKS + 1];
+static u64 mark[LOAD_TASKS + 1];
+static struct load_stats stats = { .alert_pm = LOAD_ALERT_PM };
+static u32 inner;
+
+// Start of the window, and the idle cycles by then
+static u64 window_cycles;
+static u64 window_idle;
+// Rolling load in 1/1000ths, times 2^LOAD_AVG_SHIFT; 0 before a window
+// has closed
+static u32 avg;
+static u8 started;
+
+// Entry of the function at `fn`, taken if it is new
+static struct load_task *
+load_find(u32 fn)
+{
+  u32 i = (fn >> 2) & (LOAD_TASKS - 1), k;
+
+  for(k=0; k<LOAD_TASKS; k++, i = (i + 1) & (LOAD_TASKS - 1)) {
+    if(tasks[i].fn == fn) {
+      return &tasks[i];
+    }
+    if(!tasks[i].fn) {
+      tasks[i].fn = fn;
+      stats.tasks++;
+      return &tasks[i];
+    }
+  }
+  return &tasks[LOAD_OTHER];
+}
+
+void
+load_begin(struct load_span *s)
+{
+  s->outer = inner;
+  inner = 0;
+  s->t0 = timebase_stamp();
+}
+
+void
+load_end(struct load_span *s, u32 fn)
+{
+  u32 cycles = timebase_stamp() - s->t0, own = cycles - inner;
+  struct load_task *t;
+
+  inner = s->outer + cycles;
+  if(!fn) {
+    return;
+  }
+  t = load_find(fn);
+  t->runs++;
+  t->cycles += own;
+  if(own > t->max_cycles) {
+    t->max_cycles = own;
+  }
+}
+
+// Share of `cycles` in the window, `scale` being 1000ths of it a cycle in
+// 2^-32
+static u16
+load_share(u64 cycles, u64 scale)
+{
+  u64 pm = (cycles * scale) >> 32;
+
+  return pm < 1000 ? pm : 1000;
+}
+
+void
+load_window()
+{
+  u64 now = timebase_cycles(), idle = sched_idle_cycles(), span, scale;
+  u32 i;
+
+  span = now - window_cycles;
+  if(!span) {
+    return;
+  }
+  // The one division: nothing in a window outlasts it, so every share
+  // below is at most 1000 << 32 before the shift
+  scale = (1000ULL << 32) / span;
+  stats.busy_pm = 1000 - load_share(idle - window_idle, scale);
+  for(i=0; i<=LOAD_TASKS; i++) {
+    tasks[i].share_pm = load_share(tasks[i].cycles - mark[i], scale);
+    mark[i] = tasks[i].cycles;
+  }
+  window_cycles = now;
+  window_idle = idle;
+
+  if(started) {
+    avg += stats.busy_pm - (avg >> LOAD_AVG_SHIFT);
+  } else {
+    avg = stats.busy_pm << LOAD_AVG_SHIFT;
+    started = 1;
+  }
+  stats.load_pm = avg >> LOAD_AVG_SHIFT;
+  if(stats.load_pm > stats.peak_pm) {
+    stats.peak_pm = stats.load_pm;
+  }
+  stats.windows++;
+
+  if(!stats.alert && stats.load_pm > stats.alert_pm) {
+    stats.alert = 1;
+    stats.alerts++;
+    LOG("load: %u/1000, over the alert threshold of %u", stats.load_pm,
+        stats.alert_pm);
+  } else if(stats.alert &&
+            stats.load_pm + LOAD_ALERT_HYST_PM <= stats.alert_pm) {
+    stats.alert = 0;
+    LOG("load: %u/1000, alert cleared", stats.load_pm);
+  }
+}
+
+static void
+load_tick(void *arg)
+{
+  load_window();
+}
+
+static struct timer window_timer = TIMER_INIT(load_tick, NULL);
+
+void
+load_reset()
+{
+  memset(tasks, 0, sizeof(tasks));
+  memset(mark, 0, sizeof(mark));
+  stats.busy_pm = 0;
+  stats.load_pm = 0;
+  stats.peak_pm = 0;
+  stats.tasks = 0;
+  avg = 0;
+  started = 0;
+  window_cycles = timebase_cycles();
+  window_idle = sched_idle_cycles();
+}
+
+void
+load_set_alert(u32 pm)
+{
+  stats.alert_pm = pm < 1000 ? pm : 1000;
+}
+
+u32
+load_alert_count()
+{
+  return stats.alerts;
+}
+
+const struct load_task *
+load_task(u32 n)
+{
+  return n <= LOAD_OTHER ? &tasks[n] : NULL;
+}
+
+const struct load_stats *
+load_stats()
+{
+  return &stats;
+}
+
+void
+init_load()
+{
+  load_reset();
+  timer_start(&window_timer, LOAD_WINDOW_MS, LOAD_WINDOW_MS);
+}
@@ -0,0 +1,108 @@
+#ifndef _LOAD_H_
+#define _LOAD_H_
+
+// load.h - CPU load of the main loop, in all and task by task.
+//
+// A task is a function the main loop dispatches: a work item (work.h), a
+// timer's callback (timer.h), a poll or idle hook (sched.h), a thread
+// (pt.h).  Each dispatch is bracketed with load_begin() and load_end(),
+// which charge the timer cycles between them to the function, less those
+// of the dispatches nested inside (timers run from the timer work item),
+// so that each task's time is its own.  Interrupts are charged to the task they
+// interrupt.  Tasks are told apart by their functions' addresses, which
+// mb-nm resolves against the ELF; LOAD_TASKS of them get entries of
+// their own, the rest share entry LOAD_OTHER.
+//
+// Every LOAD_WINDOW_MS the window's busy share (one less its idle share,
+// sched_idle_cycles()) is folded into the rolling load, an average over
+// about 2^LOAD_AVG_SHIFT windows, and each task's share of the window is
+// worked out, all in 1/1000ths and with one division a window.  The
+// rolling load rising over the alert threshold raises an alert, logged
+// and sent as an SNMP trap (snmptrap.h), which clears once the load is
+// LOAD_ALERT_HYST_PM under the threshold again.  The rolling load is the
+// figure that says whether a board has room for another service.
+//
+// KATCP's ?load shows it all and sets the threshold (katcp.h); the
+// telemetry export carries it (telemetry.h), and the line protocol
+// exporter the load and busy share (influx.h).
+
+#include "xil_types.h"
+
+// Tasks with entries of their own, a power of two, and the entry the
+// rest share
+#define LOAD_TASKS (32)
+#define LOAD_OTHER (LOAD_TASKS)
+
+#define LOAD_WINDOW_MS (1000)
+#define LOAD_AVG_SHIFT (3)
+
+// Alert threshold by default, and how far under it the load must drop to
+// clear the alert, in 1/1000ths
+#define LOAD_ALERT_PM      (850)
+#define LOAD_ALERT_HYST_PM (50)
+
+struct load_task {
+  // Function address, 0 for an entry not yet used and for LOAD_OTHER
+  u32 fn;
+  u32 runs;
+  // Timer cycles in all, and the most one run took
+  u64 cycles;
+  u32 max_cycles;
+  // Share of the last window, in 1/1000ths
+  u16 share_pm;
+  u16 pad;
+};
+
+struct load_stats {
+  // The last window's busy share, the rolling load and its highest yet,
+  // in 1/1000ths
+  u16 busy_pm;
+  u16 load_pm;
+  u16 peak_pm;
+  // Alert threshold, and whether the alert is raised
+  u16 alert_pm;
+  u8 alert;
+  u8 pad;
+  // Entries in use, LOAD_OTHER not counted
+  u16 tasks;
+  // Alerts raised and windows closed since boot
+  u32 alerts;
+  u32 windows;
+};
+
+// A dispatch in progress
+struct load_span {
+  u32 t0;
+  // Cycles of the dispatches nested in the one around this one so far
+  u32 outer;
+};
+
+// Start accounting.  Call after init_timers().
+void init_load();
+
+// Forget every task, the rolling load and its peak.  The threshold, the
+// alert and the counts since boot stay.
+void load_reset();
+
+// Bracket a dispatch of the function at address `fn`.  `fn` 0 charges
+// the time to no one, for a poll hook that found nothing to do: the loop
+// counts that as idle.
+void load_begin(struct load_span *s);
+void load_end(struct load_span *s, u32 fn);
+
+// Close the window, as the window timer does every LOAD_WINDOW_MS
+void load_window();
+
+// Alert when the rolling load goes over `pm` 1/1000ths (1000 or more
+// never)
+void load_set_alert(u32 pm);
+
+// Alerts raised since boot, for snmptrap.h
+u32 load_alert_count();
+
+// Entry `n`, 0 to LOAD_OTHER, or NULL past the last
+const struct load_task *load_task(u32 n);
+
+const struct load_stats *load_stats();
+
+#endif // _LOAD_H_
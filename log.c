@@ -0,0 +1,158 @@
+// log.c - Deferred binary logging.
+//
+// log_write() overwrites the oldest entry when the ring is full; the
+// sender notices and counts the entries it never saw.  It is a history
+// ring (ring.h), but with producers in both the main loop and interrupt
+// handlers, so log_write() masks interrupts for the few stores of an
+// entry; readers do not.  A timer sends
+// everything new every LOG_FLUSH_MS, up to a datagram at a time, on a
+// udpflow.h flow to the subscriber.  Entries that do not fit in eth0's TX
+// queue wait for the next flush.
+
+#include <string.h>
+
+#include "lwip/udp.h"
+#include "netif/ethernetif.h"
+
+#include "intr.h"
+#include "log.h"
+#include "ring.h"
+#include "timebase.h"
+#include "timer.h"
+#include "udpflow.h"
+
+// Entries per datagram, keeping it within one Ethernet frame
+#define LOG_BATCH ((UDPFLOW_MAX - sizeof(struct log_header)) / \
+    sizeof(struct log_entry))
+
+static struct log_entry ring[LOG_ENTRIES];
+static struct ring log_ring = RING_INIT(LOG_ENTRIES);
+// Next entry to send
+static u32 ring_sent;
+static u32 lost;
+
+static struct udp_pcb *log_pcb;
+// Where entries go; nowhere (netif NULL) until someone asks
+static struct udpflow log_flow;
+
+void
+log_write(u32 id, u32 a, u32 b, u32 c, u32 d)
+{
+  u32 msr = intr_lock();
+  struct log_entry *e = &ring[ring_head_slot(&log_ring)];
+
+  e->time = (u32)timebase_cycles();
+  e->id = id;
+  e->arg[0] = a;
+  e->arg[1] = b;
+  e->arg[2] = c;
+  e->arg[3] = d;
+  ring_push(&log_ring, 1);
+
+  intr_unlock(msr);
+}
+
+u32
+log_last(struct log_entry *dst, u32 n)
+{
+  u32 head, i;
+
+  do {
+    head = log_ring.head;
+    if(n > head) {
+      n = head;
+    }
+    if(n > LOG_ENTRIES) {
+      n = LOG_ENTRIES;
+    }
+    for(i=0; i<n; i++) {
+      dst[i] = ring[(head - n + i) & log_ring.mask];
+    }
+    // Copy again if an entry was overwritten meanwhile
+  } while(n && !ring_holds(&log_ring, head - n));
+  return n;
+}
+
+// Timer: send new entries to the subscriber
+static void
+log_flush(void *arg)
+{
+  struct log_header h;
+  struct pbuf *p;
+  u32 head, n, i;
+  u8 *dst;
+
+  head = log_ring.head;
+  if(head - ring_sent > LOG_ENTRIES) {
+    lost += head - ring_sent - LOG_ENTRIES;
+    ring_sent = head - LOG_ENTRIES;
+  }
+  if(!log_flow.netif) {
+    ring_sent = head;
+    return;
+  }
+
+  while(ring_sent != head) {
+    n = head - ring_sent;
+    if(n > LOG_BATCH) {
+      n = LOG_BATCH;
+    }
+    p = udpflow_alloc(sizeof(h) + n * sizeof(struct log_entry));
+    if(!p) {
+      return;
+    }
+
+    h.magic = LOG_MAGIC;
+    h.seq = ring_sent;
+    h.count = n;
+    h.entry_size = sizeof(struct log_entry);
+    h.hz = TIMEBASE_HZ;
+    h.lost = lost;
+    dst = p->payload;
+    memcpy(dst, &h, sizeof(h));
+    dst += sizeof(h);
+    // An entry can be overwritten while we copy it; the next flush sees
+    // the overrun and counts it
+    for(i=0; i<n; i++) {
+      memcpy(dst, &ring[(ring_sent + i) & log_ring.mask],
+          sizeof(struct log_entry));
+      dst += sizeof(struct log_entry);
+    }
+
+    if(udpflow_send(&log_flow, p)) {
+      return;
+    }
+    ring_sent += n;
+  }
+}
+
+static struct timer flush_timer = TIMER_INIT(log_flush, NULL);
+
+// Any datagram to LOG_PORT subscribes its sender, or the group it names
+static void
+log_recv(void *arg, struct udp_pcb *pcb, struct pbuf *p,
+    const ip_addr_t *addr, u16_t port)
+{
+  ip4_addr_t group;
+
+  if(p->tot_len == 4 && pbuf_copy_partial(p, &group, 4, 0) == 4 &&
+     ip4_addr_ismulticast(&group)) {
+    udpflow_connect(&log_flow, &group, LOG_PORT, port);
+  } else {
+    udpflow_connect(&log_flow, ip_2_ip4(addr), LOG_PORT, port);
+  }
+  pbuf_free(p);
+}
+
+void
+init_log()
+{
+  log_pcb = udp_new();
+  if(!log_pcb || udp_bind(log_pcb, IP_ADDR_ANY, LOG_PORT) != ERR_OK) {
+    return;
+  }
+  udp_recv(log_pcb, log_recv, NULL);
+  udpflow_register(&log_flow, "log");
+  udpflow_set_tos(&log_flow, ETHERNETIF_TOS_TELEMETRY);
+  timer_start(&flush_timer, LOG_FLUSH_MS, LOG_FLUSH_MS);
+}
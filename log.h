@@ -0,0 +1,79 @@
+#ifndef _LOG_H_
+#define _LOG_H_
+
+// log.h - Deferred binary logging.
+//
+// LOG(fmt, ...) records a timestamp, the message ID of `fmt` and up to four
+// integer arguments in a ring; nothing is formatted on the device.  The
+// format strings are placed in the .logfmt section, which the linker keeps
+// out of BRAM (see lscript.ld), and a message ID is the string's offset in
+// that section.  "make" extracts the section to executable.logfmt for
+// tools/logdecode.py, which formats the entries on the host.
+//
+// The ring is drained over UDP to whoever last sent a datagram to
+// LOG_PORT, or to the multicast group a 4-byte datagram names (network
+// order, on the sender's port) so that any number of hosts can follow it
+// for the cost of one.  Each datagram is a struct log_header followed by
+// `count` struct log_entry, little-endian.
+
+#include "xil_types.h"
+
+#define LOG_PORT      (7002)
+
+// Entries buffered (a power of two)
+#define LOG_ENTRIES   (128)
+#define LOG_MAX_ARGS  (4)
+// How often the ring is sent
+#define LOG_FLUSH_MS  (50)
+
+#define LOG_MAGIC     (0x31474f4c) // "LOG1"
+
+struct log_header {
+  u32 magic;
+  // Sequence number of the first entry, and the number of entries that
+  // follow
+  u32 seq;
+  u16 count;
+  u16 entry_size;
+  // Timestamp clock
+  u32 hz;
+  // Entries overwritten before they could be sent, so far
+  u32 lost;
+};
+
+struct log_entry {
+  // Low 32 bits of timebase_cycles()
+  u32 time;
+  // Offset of the format string in .logfmt
+  u32 id;
+  u32 arg[LOG_MAX_ARGS];
+};
+
+// An id no format has, for entries that hold none (0 is the first
+// format's)
+#define LOG_ID_NONE (0xffffffff)
+
+#define LOG_FMT_SECTION __attribute__((section(".logfmt")))
+
+#define LOG_ARGS_(x, a, b, c, d, ...) \
+  (u32)(a), (u32)(b), (u32)(c), (u32)(d)
+
+// Log `fmt` (%d, %u and %x conversions only) with up to LOG_MAX_ARGS
+// integer arguments.  Safe to call from interrupt handlers.
+#define LOG(fmt, ...) do { \
+    static const char log_fmt_[] LOG_FMT_SECTION = fmt; \
+    log_write((u32)log_fmt_, LOG_ARGS_(0, ##__VA_ARGS__, 0, 0, 0, 0)); \
+  } while(0)
+
+void log_write(u32 id, u32 a, u32 b, u32 c, u32 d);
+
+// Copy the newest `n` entries in the ring, oldest first, to `dst`, sent or
+// not.  Safe to call from interrupt and exception handlers.
+//
+// Returns the number copied: fewer than `n` if fewer were logged.
+u32 log_last(struct log_entry *dst, u32 n);
+
+// Start draining the ring.  Call after lwip_init().
+void init_log();
+
+#endif // _LOG_H_
@@ -111,6 +111,11 @@
 #if LWIP_HTTPD_SUPPORT_11_KEEPALIVE
 #define HTTP11_CONNECTIONKEEPALIVE  "Connection: keep-alive"
 #define HTTP11_CONNECTIONKEEPALIVE2 "Connection: Keep-Alive"
+#define HTTP11_CONNECTIONCLOSE      "Connection: close"
+#define HTTP11_VERSION              " HTTP/1.1" CRLF
+#endif
+#if LWIP_HTTPD_WEBSOCKET
+#define HTTP_HDR_UPGRADE_WEBSOCKET  "Upgrade: websocket"
 #endif
 
 /** These defines check whether tcp_write has to copy data or not */
@@ -1998,10 +2003,12 @@ http_parse_request(struct pbuf *inp, struct http_state *hs, struct tcp_pcb *pcb)
         if (lwip_strnstr(data, CRLF CRLF, data_len) != NULL) {
           char *uri = sp1 + 1;
 #if LWIP_HTTPD_SUPPORT_11_KEEPALIVE
-          /* This is HTTP/1.0 compatible: for strict 1.1, a connection
-             would always be persistent unless "close" was specified. */
+          /* HTTP/1.0 asks for a persistent connection; with HTTP/1.1 a
+             connection is persistent unless "close" was specified. */
           if (!is_09 && (lwip_strnstr(data, HTTP11_CONNECTIONKEEPALIVE, data_len) ||
-              lwip_strnstr(data, HTTP11_CONNECTIONKEEPALIVE2, data_len))) {
+              lwip_strnstr(data, HTTP11_CONNECTIONKEEPALIVE2, data_len) ||
+              (lwip_strnstr(data, HTTP11_VERSION, (u16_t)(crlf + 2 - data)) &&
+               !lwip_strnstr(data, HTTP11_CONNECTIONCLOSE, data_len)))) {
             hs->keepalive = 1;
           } else {
             hs->keepalive = 0;
@@ -2012,6 +2019,17 @@ http_parse_request(struct pbuf *inp, struct http_state *hs, struct tcp_pcb *pcb)
           uri[uri_len] = 0;
           LWIP_DEBUGF(HTTPD_DEBUG, ("Received \"%s\" request for URI: \"%s\"\n",
                       data, uri));
+#if LWIP_HTTPD_WEBSOCKET
+          if (!is_09 && (crlf + 2 < data + data_len)) {
+            /* the request line is cut up by now: look after it */
+            char *hdrs = crlf + 2;
+            u16_t hdrs_len = (u16_t)(data_len - (hdrs - data));
+            if (lwip_strnstr(hdrs, HTTP_HDR_UPGRADE_WEBSOCKET, hdrs_len) &&
+                httpd_websocket_upgrade(pcb, uri, hdrs, hdrs_len)) {
+              return ERR_CLSD;
+            }
+          }
+#endif /* LWIP_HTTPD_WEBSOCKET */
 #if LWIP_HTTPD_SUPPORT_POST
           if (is_post) {
 #if LWIP_HTTPD_SUPPORT_REQUESTLIST
@@ -2468,7 +2486,8 @@ http_recv(void *arg, struct tcp_pcb *pcb, struct pbuf *p, err_t err)
     if (hs->handle == NULL) {
       err_t parsed = http_parse_request(p, hs, pcb);
       LWIP_ASSERT("http_parse_request: unexpected return value", parsed == ERR_OK
-        || parsed == ERR_INPROGRESS ||parsed == ERR_ARG || parsed == ERR_USE);
+        || parsed == ERR_INPROGRESS ||parsed == ERR_ARG || parsed == ERR_USE
+        || parsed == ERR_CLSD);
 #if LWIP_HTTPD_SUPPORT_REQUESTLIST
       if (parsed != ERR_INPROGRESS) {
         /* request fully parsed or error */
@@ -2490,6 +2509,11 @@ http_recv(void *arg, struct tcp_pcb *pcb, struct pbuf *p, err_t err)
       } else if (parsed == ERR_ARG) {
         /* @todo: close on ERR_USE? */
         http_close_conn(pcb, hs);
+#if LWIP_HTTPD_WEBSOCKET
+      } else if (parsed == ERR_CLSD) {
+        /* upgraded: the connection is the application's now */
+        http_state_free(hs);
+#endif /* LWIP_HTTPD_WEBSOCKET */
       }
     } else {
       LWIP_DEBUGF(HTTPD_DEBUG, ("http_recv: already sending data\n"));
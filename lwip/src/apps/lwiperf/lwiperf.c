@@ -75,6 +75,12 @@
 #define LWIPERF_CHECK_RX_DATA       0
 #endif
 
+/** Called when a session starts timing its transfer, e.g. to sample CPU
+    load counters for the report */
+#ifndef LWIPERF_START_HOOK
+#define LWIPERF_START_HOOK()
+#endif
+
 /** This is the Iperf settings struct sent from the client */
 typedef struct _lwiperf_settings {
 #define LWIPERF_FLAGS_ANSWER_TEST 0x80000000
@@ -167,11 +173,8 @@ static void lwiperf_tcp_err(void *arg, err_t err);
 static void
 lwiperf_list_add(lwiperf_state_base_t* item)
 {
-  if (lwiperf_all_connections == NULL) {
-    lwiperf_all_connections = item;
-  } else {
-    item = lwiperf_all_connections;
-  }
+  item->next = lwiperf_all_connections;
+  lwiperf_all_connections = item;
 }
 
 /** Remove an iperf session from the 'active' list */
@@ -185,7 +188,7 @@ lwiperf_list_remove(lwiperf_state_base_t* item)
       if (prev == NULL) {
         lwiperf_all_connections = iter->next;
       } else {
-        prev->next = item;
+        prev->next = iter->next;
       }
       /* @debug: ensure this item is listed only once */
       for (iter = iter->next; iter != NULL; iter = iter->next) {
@@ -209,10 +212,16 @@ lwip_tcp_conn_report(lwiperf_state_tcp_t* conn, enum lwiperf_report_type report_
     } else {
       bandwidth_kbitpsec = (conn->bytes_transferred / duration_ms) * 8U;
     }
-    conn->report_fn(conn->report_arg, report_type,
-      &conn->conn_pcb->local_ip, conn->conn_pcb->local_port,
-      &conn->conn_pcb->remote_ip, conn->conn_pcb->remote_port,
-      conn->bytes_transferred, duration_ms, bandwidth_kbitpsec);
+    if (conn->conn_pcb != NULL) {
+      conn->report_fn(conn->report_arg, report_type,
+        &conn->conn_pcb->local_ip, conn->conn_pcb->local_port,
+        &conn->conn_pcb->remote_ip, conn->conn_pcb->remote_port,
+        conn->bytes_transferred, duration_ms, bandwidth_kbitpsec);
+    } else {
+      /* the pcb is gone (aborted) */
+      conn->report_fn(conn->report_arg, report_type, NULL, 0, NULL, 0,
+        conn->bytes_transferred, duration_ms, bandwidth_kbitpsec);
+    }
   }
 }
 
@@ -235,10 +244,10 @@ lwiperf_tcp_close(lwiperf_state_tcp_t* conn, enum lwiperf_report_type report_typ
       /* don't want to wait for free memory here... */
       tcp_abort(conn->conn_pcb);
     }
-  } else {
+  } else if (conn->server_pcb != NULL) {
     /* no conn pcb, this is the server pcb */
     err = tcp_close(conn->server_pcb);
-    LWIP_ASSERT("error", err != ERR_OK);
+    LWIP_ASSERT("error", err == ERR_OK);
   }
   LWIPERF_FREE(lwiperf_state_tcp_t, conn);
 }
@@ -273,7 +282,7 @@ lwiperf_tcp_client_send_more(lwiperf_state_tcp_t* conn)
       /* this session is byte-limited */
       u32_t amount_bytes = lwip_htonl(conn->settings.amount);
       /* @todo: this can send up to 1*MSS more than requested... */
-      if (amount_bytes >= conn->bytes_transferred) {
+      if (conn->bytes_transferred >= amount_bytes) {
         /* all requested bytes transferred -> close the connection */
         lwiperf_tcp_close(conn, LWIPERF_TCP_DONE_CLIENT);
         return ERR_OK;
@@ -349,55 +358,79 @@ lwiperf_tcp_client_connected(void *arg, struct tcp_pcb *tpcb, err_t err)
   }
   conn->poll_count = 0;
   conn->time_started = sys_now();
+  LWIPERF_START_HOOK();
   return lwiperf_tcp_client_send_more(conn);
 }
 
-/** Start TCP connection back to the client (either parallel or after the
- * receive test has finished.
+/** Start a TCP client session sending to remote_addr:remote_port, as
+ * described by settings (in network byte order)
  */
-static err_t
-lwiperf_tx_start(lwiperf_state_tcp_t* conn)
+static lwiperf_state_tcp_t*
+lwiperf_tx_start_impl(const ip_addr_t* remote_addr, u16_t remote_port,
+  const lwiperf_settings_t* settings, lwiperf_report_fn report_fn,
+  void* report_arg, lwiperf_state_base_t* related_server_state)
 {
   err_t err;
   lwiperf_state_tcp_t* client_conn;
   struct tcp_pcb* newpcb;
-  ip_addr_t remote_addr;
-  u16_t remote_port;
 
   client_conn = (lwiperf_state_tcp_t*)LWIPERF_ALLOC(lwiperf_state_tcp_t);
   if (client_conn == NULL) {
-    return ERR_MEM;
+    return NULL;
   }
   newpcb = tcp_new();
   if (newpcb == NULL) {
     LWIPERF_FREE(lwiperf_state_tcp_t, client_conn);
-    return ERR_MEM;
+    return NULL;
   }
 
-  MEMCPY(client_conn, conn, sizeof(lwiperf_state_tcp_t));
+  memset(client_conn, 0, sizeof(lwiperf_state_tcp_t));
+  client_conn->base.tcp = 1;
   client_conn->base.server = 0;
-  client_conn->server_pcb = NULL;
+  client_conn->base.related_server_state = related_server_state;
   client_conn->conn_pcb = newpcb;
-  client_conn->time_started = sys_now(); /* @todo: set this again on 'connected' */
-  client_conn->poll_count = 0;
+  client_conn->time_started = sys_now(); /* set again on 'connected' */
+  client_conn->report_fn = report_fn;
+  client_conn->report_arg = report_arg;
   client_conn->next_num = 4; /* initial nr is '4' since the header has 24 byte */
-  client_conn->bytes_transferred = 0;
-  client_conn->settings.flags = 0; /* prevent the remote side starting back as client again */
+  MEMCPY(&client_conn->settings, settings, sizeof(lwiperf_settings_t));
+  client_conn->have_settings_buf = 1;
 
   tcp_arg(newpcb, client_conn);
   tcp_sent(newpcb, lwiperf_tcp_client_sent);
   tcp_poll(newpcb, lwiperf_tcp_poll, 2U);
   tcp_err(newpcb, lwiperf_tcp_err);
 
-  ip_addr_copy(remote_addr, conn->conn_pcb->remote_ip);
-  remote_port = (u16_t)lwip_htonl(client_conn->settings.remote_port);
-
-  err = tcp_connect(newpcb, &remote_addr, remote_port, lwiperf_tcp_client_connected);
+  err = tcp_connect(newpcb, remote_addr, remote_port, lwiperf_tcp_client_connected);
   if (err != ERR_OK) {
-    lwiperf_tcp_close(client_conn, LWIPERF_TCP_ABORTED_LOCAL);
-    return err;
+    /* not listed yet: close it here without a report */
+    tcp_abort(newpcb);
+    LWIPERF_FREE(lwiperf_state_tcp_t, client_conn);
+    return NULL;
   }
   lwiperf_list_add(&client_conn->base);
+  return client_conn;
+}
+
+/** Start TCP connection back to the client (either parallel or after the
+ * receive test has finished.
+ */
+static err_t
+lwiperf_tx_start(lwiperf_state_tcp_t* conn)
+{
+  lwiperf_settings_t settings;
+  ip_addr_t remote_addr;
+  u16_t remote_port;
+
+  MEMCPY(&settings, &conn->settings, sizeof(lwiperf_settings_t));
+  settings.flags = 0; /* prevent the remote side starting back as client again */
+  ip_addr_copy(remote_addr, conn->conn_pcb->remote_ip);
+  remote_port = (u16_t)lwip_htonl(settings.remote_port);
+
+  if (lwiperf_tx_start_impl(&remote_addr, remote_port, &settings, conn->report_fn,
+        conn->report_arg, conn->base.related_server_state) == NULL) {
+    return ERR_MEM;
+  }
   return ERR_OK;
 }
 
@@ -466,6 +499,7 @@ lwiperf_tcp_recv(void *arg, struct tcp_pcb *tpcb, struct pbuf *p, err_t err)
     conn->bytes_transferred += sizeof(lwiperf_settings_t);
     if (conn->bytes_transferred <= 24) {
       conn->time_started = sys_now();
+      LWIPERF_START_HOOK();
       tcp_recved(tpcb, p->tot_len);
       pbuf_free(p);
       return ERR_OK;
@@ -512,6 +546,9 @@ lwiperf_tcp_err(void *arg, err_t err)
 {
   lwiperf_state_tcp_t* conn = (lwiperf_state_tcp_t*)arg;
   LWIP_UNUSED_ARG(err);
+  /* the pcb is already freed, don't close it again */
+  conn->conn_pcb = NULL;
+  conn->server_pcb = NULL;
   lwiperf_tcp_close(conn, LWIPERF_TCP_ABORTED_REMOTE);
 }
 
@@ -638,12 +675,44 @@ lwiperf_start_tcp_server(const ip_addr_t* local_addr, u16_t local_port,
 
 /**
  * @ingroup iperf
- * Abort an iperf session (handle returned by lwiperf_start_tcp_server*())
+ * Start a TCP iperf client to a specific IP address and port, sending for
+ * duration_ms milliseconds (rounded down to 10 ms).  The report function
+ * is called once the test is done.
+ *
+ * @returns a connection handle that can be used to abort the client
+ *          by calling @ref lwiperf_abort()
+ */
+void*
+lwiperf_start_tcp_client(const ip_addr_t* remote_addr, u16_t remote_port,
+  u32_t duration_ms, lwiperf_report_fn report_fn, void* report_arg)
+{
+  lwiperf_settings_t settings;
+
+  if ((remote_addr == NULL) || (duration_ms < 10)) {
+    return NULL;
+  }
+
+  memset(&settings, 0, sizeof(settings));
+  settings.num_threads = PP_HTONL(1);
+  settings.remote_port = PP_HTONL((u32_t)LWIPERF_TCP_PORT_DEFAULT);
+  /* negative amount: time in units of 10 ms */
+  settings.amount = lwip_htonl((u32_t)-(s32_t)(duration_ms / 10));
+
+  return lwiperf_tx_start_impl(remote_addr, remote_port, &settings,
+    report_fn, report_arg, NULL);
+}
+
+/**
+ * @ingroup iperf
+ * Abort an iperf session (handle returned by lwiperf_start_tcp_server*()
+ * or lwiperf_start_tcp_client()) and the sessions it started, without
+ * reporting them
  */
 void
 lwiperf_abort(void* lwiperf_session)
 {
   lwiperf_state_base_t* i, *dealloc, *last = NULL;
+  lwiperf_state_tcp_t* conn;
 
   for (i = lwiperf_all_connections; i != NULL; ) {
     if ((i == lwiperf_session) || (i->related_server_state == lwiperf_session)) {
@@ -651,6 +720,19 @@ lwiperf_abort(void* lwiperf_session)
       i = i->next;
       if (last != NULL) {
         last->next = i;
+      } else {
+        lwiperf_all_connections = i;
+      }
+      conn = (lwiperf_state_tcp_t*)dealloc;
+      if (conn->conn_pcb != NULL) {
+        tcp_arg(conn->conn_pcb, NULL);
+        tcp_poll(conn->conn_pcb, NULL, 0);
+        tcp_sent(conn->conn_pcb, NULL);
+        tcp_recv(conn->conn_pcb, NULL);
+        tcp_err(conn->conn_pcb, NULL);
+        tcp_abort(conn->conn_pcb);
+      } else {
+        tcp_close(conn->server_pcb);
       }
       LWIPERF_FREE(lwiperf_state_tcp_t, dealloc); /* @todo: type? */
     } else {
@@ -179,7 +179,12 @@ void
 snmp_receive(void *handle, struct pbuf *p, const ip_addr_t *source_ip, u16_t port)
 {
   err_t err;
+#if NO_SYS
+  /* not reentrant without threads: keep it off the (small) stack */
+  static struct snmp_request request;
+#else
   struct snmp_request request;
+#endif
    
   memset(&request, 0, sizeof(request));
   request.handle       = handle;
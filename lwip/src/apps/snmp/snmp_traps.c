@@ -190,7 +190,12 @@ snmp_send_trap(const struct snmp_obj_id* eoid, s32_t generic_trap, s32_t specifi
           trap_msg.spc_trap = 0;
         }
 
+#if MIB2_STATS
         MIB2_COPY_SYSUPTIME_TO(&trap_msg.ts);
+#else
+        /* MIB2_COPY_SYSUPTIME_TO() does nothing without MIB2_STATS */
+        trap_msg.ts = sys_now() / 10;
+#endif
 
         /* pass 0, calculate length fields */
         tot_len = snmp_trap_varbind_sum(&trap_msg, varbinds);
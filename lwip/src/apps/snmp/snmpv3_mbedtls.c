@@ -48,11 +48,166 @@
 #include "mbedtls/md5.h"
 #include "mbedtls/sha1.h"
 
+/* Feed the next `length` bytes of `stream` to `ctx`, a block at a time */
+static int
+snmpv3_md_stream(mbedtls_md_context_t *ctx, struct snmp_pbuf_stream* stream, u16_t length)
+{
+  u8_t buf[64];
+  u16_t i, n;
+
+  while (length > 0) {
+    n = LWIP_MIN(length, sizeof(buf));
+    for (i = 0; i < n; i++) {
+      if (snmp_pbuf_stream_read(stream, &buf[i])) {
+        return -1;
+      }
+    }
+    if (mbedtls_md_update(ctx, buf, n) != 0) {
+      return -1;
+    }
+    length -= n;
+  }
+  return 0;
+}
+
+#if SNMP_V3_HMAC_CACHE > 0
+
+/* An authentication key's HMAC, keyed: the hash states after the inner
+ * (key ^ ipad) and outer (key ^ opad) blocks. A request clones them into
+ * `work` instead of hashing the key twice, on a set up context. */
+struct snmpv3_hmac {
+  const mbedtls_md_info_t *md_info;
+  u8_t key[SNMP_V3_SHA_LEN];
+  mbedtls_md_context_t inner;
+  mbedtls_md_context_t outer;
+};
+
+static struct snmpv3_hmac snmpv3_hmacs[SNMP_V3_HMAC_CACHE];
+static u8_t snmpv3_hmac_next;
+static mbedtls_md_context_t snmpv3_work_md5;
+static mbedtls_md_context_t snmpv3_work_sha;
+/* (1 << algo) for each work context set up */
+static u8_t snmpv3_work_ready;
+
+/* The context set up for `md_info`'s digest, or NULL if it cannot be */
+static mbedtls_md_context_t *
+snmpv3_hmac_work(const mbedtls_md_info_t *md_info, u8_t algo)
+{
+  mbedtls_md_context_t *work = (algo == SNMP_V3_AUTH_ALGO_MD5) ? &snmpv3_work_md5 : &snmpv3_work_sha;
+
+  if (!(snmpv3_work_ready & (1 << algo))) {
+    mbedtls_md_init(work);
+    if (mbedtls_md_setup(work, md_info, 0) != 0) {
+      mbedtls_md_free(work);
+      return NULL;
+    }
+    snmpv3_work_ready |= (u8_t)(1 << algo);
+  }
+  return work;
+}
+
+/* The cached HMAC of `key`, keying a new one if it is not there */
+static struct snmpv3_hmac *
+snmpv3_hmac_get(const mbedtls_md_info_t *md_info, const u8_t* key, u8_t key_len)
+{
+  struct snmpv3_hmac *h;
+  u8_t pad[64];
+  u8_t i;
+
+  for (i = 0; i < SNMP_V3_HMAC_CACHE; i++) {
+    h = &snmpv3_hmacs[i];
+    if ((h->md_info == md_info) && (memcmp(h->key, key, key_len) == 0)) {
+      return h;
+    }
+  }
+
+  h = &snmpv3_hmacs[snmpv3_hmac_next];
+  snmpv3_hmac_next = (snmpv3_hmac_next + 1) % SNMP_V3_HMAC_CACHE;
+  if (h->md_info != NULL) {
+    mbedtls_md_free(&h->inner);
+    mbedtls_md_free(&h->outer);
+    h->md_info = NULL;
+  }
+  mbedtls_md_init(&h->inner);
+  mbedtls_md_init(&h->outer);
+  if ((mbedtls_md_setup(&h->inner, md_info, 0) != 0) ||
+      (mbedtls_md_setup(&h->outer, md_info, 0) != 0)) {
+    goto error;
+  }
+
+  /* Keys are no longer than a block, so they are used as they are */
+  memset(pad, 0x36, sizeof(pad));
+  for (i = 0; i < key_len; i++) {
+    pad[i] ^= key[i];
+  }
+  if ((mbedtls_md_starts(&h->inner) != 0) ||
+      (mbedtls_md_update(&h->inner, pad, sizeof(pad)) != 0)) {
+    goto error;
+  }
+  memset(pad, 0x5c, sizeof(pad));
+  for (i = 0; i < key_len; i++) {
+    pad[i] ^= key[i];
+  }
+  if ((mbedtls_md_starts(&h->outer) != 0) ||
+      (mbedtls_md_update(&h->outer, pad, sizeof(pad)) != 0)) {
+    goto error;
+  }
+  memset(h->key, 0, sizeof(h->key));
+  MEMCPY(h->key, key, key_len);
+  h->md_info = md_info;
+  return h;
+
+error:
+  mbedtls_md_free(&h->inner);
+  mbedtls_md_free(&h->outer);
+  return NULL;
+}
+
+err_t
+snmpv3_auth(struct snmp_pbuf_stream* stream, u16_t length,
+    const u8_t* key, u8_t algo, u8_t* hmac_out)
+{
+  u8_t key_len;
+  const mbedtls_md_info_t *md_info;
+  mbedtls_md_context_t *work;
+  struct snmpv3_hmac *h;
+  struct snmp_pbuf_stream read_stream;
+  snmp_pbuf_stream_init(&read_stream, stream->pbuf, stream->offset, stream->length);
+
+  if (algo == SNMP_V3_AUTH_ALGO_MD5) {
+    md_info = mbedtls_md_info_from_type(MBEDTLS_MD_MD5);
+    key_len = SNMP_V3_MD5_LEN;
+  } else if (algo == SNMP_V3_AUTH_ALGO_SHA) {
+    md_info = mbedtls_md_info_from_type(MBEDTLS_MD_SHA1);
+    key_len = SNMP_V3_SHA_LEN;
+  } else {
+    return ERR_ARG;
+  }
+
+  work = snmpv3_hmac_work(md_info, algo);
+  h = snmpv3_hmac_get(md_info, key, key_len);
+  if ((work == NULL) || (h == NULL)) {
+    return ERR_ARG;
+  }
+
+  /* H(K ^ opad, H(K ^ ipad, message)) from the keyed states */
+  if ((mbedtls_md_clone(work, &h->inner) != 0) ||
+      (snmpv3_md_stream(work, &read_stream, length) != 0) ||
+      (mbedtls_md_finish(work, hmac_out) != 0) ||
+      (mbedtls_md_clone(work, &h->outer) != 0) ||
+      (mbedtls_md_update(work, hmac_out, mbedtls_md_get_size(md_info)) != 0) ||
+      (mbedtls_md_finish(work, hmac_out) != 0)) {
+    return ERR_ARG;
+  }
+  return ERR_OK;
+}
+
+#else /* SNMP_V3_HMAC_CACHE > 0 */
+
 err_t
 snmpv3_auth(struct snmp_pbuf_stream* stream, u16_t length,
     const u8_t* key, u8_t algo, u8_t* hmac_out)
 {
-  u32_t i;
   u8_t key_len;
   const mbedtls_md_info_t *md_info;
   mbedtls_md_context_t ctx;
@@ -78,16 +233,9 @@ snmpv3_auth(struct snmp_pbuf_stream* stream, u16_t length,
     goto free_md;
   }
 
-  for (i = 0; i < length; i++) {
-    u8_t byte;
-
-    if (snmp_pbuf_stream_read(&read_stream, &byte)) {
-      goto free_md;
-    }
-
-    if (mbedtls_md_hmac_update(&ctx, &byte, 1) != 0) {
-      goto free_md;
-    }
+  /* snmpv3_md_stream() for the HMAC's inner hash */
+  if (snmpv3_md_stream(&ctx, &read_stream, length) != 0) {
+    goto free_md;
   }
 
   if (mbedtls_md_hmac_finish(&ctx, hmac_out) != 0) {
@@ -102,6 +250,8 @@ free_md:
   return ERR_ARG;
 }
 
+#endif /* SNMP_V3_HMAC_CACHE > 0 */
+
 #if LWIP_SNMP_V3_CRYPTO
 
 err_t
@@ -223,8 +373,8 @@ error:
 #endif /* LWIP_SNMP_V3_CRYPTO */
 
 /* A.2.1. Password to Key Sample Code for MD5 */
-void 
-snmpv3_password_to_key_md5(
+static void 
+snmpv3_localize_md5(
     const u8_t *password,    /* IN */
     u8_t        passwordlen, /* IN */
     const u8_t *engineID,    /* IN  - pointer to snmpEngineID  */
@@ -276,8 +426,8 @@ snmpv3_password_to_key_md5(
 }
 
 /* A.2.2. Password to Key Sample Code for SHA */
-void 
-snmpv3_password_to_key_sha(
+static void 
+snmpv3_localize_sha(
     const u8_t *password,    /* IN */
     u8_t        passwordlen, /* IN */
     const u8_t *engineID,    /* IN  - pointer to snmpEngineID  */
@@ -328,4 +478,99 @@ snmpv3_password_to_key_sha(
   return;
 }
 
+#if SNMP_V3_KEY_CACHE > 0
+
+/* A key localized from a password for an engine ID */
+struct snmpv3_key {
+  u8_t algo;
+  u8_t password_len;
+  u8_t engine_id_len;
+  u8_t password[SNMP_V3_KEY_CACHE_PASSWORD];
+  u8_t engine_id[SNMP_V3_MAX_ENGINE_ID_LENGTH];
+  u8_t key[SNMP_V3_SHA_LEN];
+};
+
+static struct snmpv3_key snmpv3_keys[SNMP_V3_KEY_CACHE];
+static u8_t snmpv3_key_next;
+
+/* Copy the cached key for the password and engine ID to `key`, or localize
+ * it and cache it */
+static void
+snmpv3_password_to_key(u8_t algo, const u8_t *password, u8_t passwordlen,
+    const u8_t *engineID, u8_t engineLength, u8_t *key)
+{
+  struct snmpv3_key *k;
+  u8_t key_len = (algo == SNMP_V3_AUTH_ALGO_MD5) ? SNMP_V3_MD5_LEN : SNMP_V3_SHA_LEN;
+  u8_t i;
+
+  if ((passwordlen > SNMP_V3_KEY_CACHE_PASSWORD) ||
+      (engineLength > SNMP_V3_MAX_ENGINE_ID_LENGTH)) {
+    goto localize;
+  }
+  for (i = 0; i < SNMP_V3_KEY_CACHE; i++) {
+    k = &snmpv3_keys[i];
+    if ((k->algo == algo) && (k->password_len == passwordlen) &&
+        (k->engine_id_len == engineLength) &&
+        (memcmp(k->password, password, passwordlen) == 0) &&
+        (memcmp(k->engine_id, engineID, engineLength) == 0)) {
+      MEMCPY(key, k->key, key_len);
+      return;
+    }
+  }
+
+  k = &snmpv3_keys[snmpv3_key_next];
+  snmpv3_key_next = (snmpv3_key_next + 1) % SNMP_V3_KEY_CACHE;
+  if (algo == SNMP_V3_AUTH_ALGO_MD5) {
+    snmpv3_localize_md5(password, passwordlen, engineID, engineLength, k->key);
+  } else {
+    snmpv3_localize_sha(password, passwordlen, engineID, engineLength, k->key);
+  }
+  k->algo = algo;
+  k->password_len = passwordlen;
+  k->engine_id_len = engineLength;
+  MEMCPY(k->password, password, passwordlen);
+  MEMCPY(k->engine_id, engineID, engineLength);
+  MEMCPY(key, k->key, key_len);
+  return;
+
+localize:
+  if (algo == SNMP_V3_AUTH_ALGO_MD5) {
+    snmpv3_localize_md5(password, passwordlen, engineID, engineLength, key);
+  } else {
+    snmpv3_localize_sha(password, passwordlen, engineID, engineLength, key);
+  }
+}
+
+#endif /* SNMP_V3_KEY_CACHE > 0 */
+
+void
+snmpv3_password_to_key_md5(
+    const u8_t *password,    /* IN */
+    u8_t        passwordlen, /* IN */
+    const u8_t *engineID,    /* IN  - pointer to snmpEngineID  */
+    u8_t        engineLength,/* IN  - length of snmpEngineID */
+    u8_t       *key)         /* OUT - pointer to caller 16-octet buffer */
+{
+#if SNMP_V3_KEY_CACHE > 0
+  snmpv3_password_to_key(SNMP_V3_AUTH_ALGO_MD5, password, passwordlen, engineID, engineLength, key);
+#else
+  snmpv3_localize_md5(password, passwordlen, engineID, engineLength, key);
+#endif
+}
+
+void
+snmpv3_password_to_key_sha(
+    const u8_t *password,    /* IN */
+    u8_t        passwordlen, /* IN */
+    const u8_t *engineID,    /* IN  - pointer to snmpEngineID  */
+    u8_t        engineLength,/* IN  - length of snmpEngineID */
+    u8_t       *key)         /* OUT - pointer to caller 20-octet buffer */
+{
+#if SNMP_V3_KEY_CACHE > 0
+  snmpv3_password_to_key(SNMP_V3_AUTH_ALGO_SHA, password, passwordlen, engineID, engineLength, key);
+#else
+  snmpv3_localize_sha(password, passwordlen, engineID, engineLength, key);
+#endif
+}
+
 #endif /* LWIP_SNMP && LWIP_SNMP_V3 && LWIP_SNMP_V3_MBEDTLS */
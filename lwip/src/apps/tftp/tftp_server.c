@@ -55,7 +55,6 @@
 #include "lwip/timeouts.h"
 #include "lwip/debug.h"
 
-#define TFTP_MAX_PAYLOAD_SIZE 512
 #define TFTP_HEADER_LENGTH    4
 
 #define TFTP_RRQ   1
@@ -63,6 +62,10 @@
 #define TFTP_DATA  3
 #define TFTP_ACK   4
 #define TFTP_ERROR 5
+#define TFTP_OACK  6
+
+/* Longest option name or value we look at (RFC 2347) */
+#define TFTP_MAX_OPTION_LEN 16
 
 enum tftp_error {
   TFTP_ERROR_FILE_NOT_FOUND    = 1,
@@ -86,8 +89,16 @@ struct tftp_state {
   int timer;
   int last_pkt;
   u16_t blknum;
+  u16_t blksize;
+  u16_t windowsize;
+  /* Blocks written since the last ACK */
+  u16_t window;
   u8_t retries;
   u8_t mode_write;
+  u8_t ack_pending;
+  u8_t last_block;
+  /* Blocks were dropped while an ACK was pending */
+  u8_t dropped;
 };
 
 static struct tftp_state tftp_state;
@@ -106,6 +117,7 @@ close_handle(void)
   }
 
   sys_untimeout(tftp_tmr, NULL);
+  tftp_state.ack_pending = 0;
   
   if (tftp_state.handle) {
     tftp_state.ctx->close(tftp_state.handle);
@@ -153,6 +165,26 @@ send_ack(u16_t blknum)
   pbuf_free(p);
 }
 
+/* The block before tftp_state.blknum is written: acknowledge it if it
+   ends the window, the transfer, or a run of blocks dropped meanwhile
+   (the client then goes on from the block after it) */
+static void
+block_written(void)
+{
+  if (!tftp_state.last_block && !tftp_state.dropped &&
+      (tftp_state.window < tftp_state.windowsize)) {
+    return;
+  }
+
+  send_ack((u16_t)(tftp_state.blknum - 1));
+  tftp_state.window = 0;
+  tftp_state.dropped = 0;
+
+  if (tftp_state.last_block) {
+    close_handle();
+  }
+}
+
 static void
 resend_data(void)
 {
@@ -180,7 +212,7 @@ send_data(void)
     pbuf_free(tftp_state.last_data);
   }
   
-  tftp_state.last_data = pbuf_alloc(PBUF_TRANSPORT, TFTP_HEADER_LENGTH + TFTP_MAX_PAYLOAD_SIZE, PBUF_RAM);
+  tftp_state.last_data = pbuf_alloc(PBUF_TRANSPORT, (u16_t)(TFTP_HEADER_LENGTH + tftp_state.blksize), PBUF_RAM);
   if(tftp_state.last_data == NULL) {
     return;
   }
@@ -189,7 +221,7 @@ send_data(void)
   payload[0] = PP_HTONS(TFTP_DATA);
   payload[1] = lwip_htons(tftp_state.blknum);
 
-  ret = tftp_state.ctx->read(tftp_state.handle, &payload[2], TFTP_MAX_PAYLOAD_SIZE);
+  ret = tftp_state.ctx->read(tftp_state.handle, &payload[2], tftp_state.blksize);
   if (ret < 0) {
     send_error(&tftp_state.addr, tftp_state.port, TFTP_ERROR_ACCESS_VIOLATION, "Error occured while reading the file.");
     close_handle();
@@ -200,6 +232,93 @@ send_data(void)
   resend_data();
 }
 
+/* Parse a decimal option value; returns 0 if it is not one */
+static u32_t
+option_value(const char *str)
+{
+  u32_t v = 0;
+
+  for (; *str != 0; str++) {
+    if ((*str < '0') || (*str > '9') || (v > 0xffff)) {
+      return 0;
+    }
+    v = v * 10 + (u32_t)(*str - '0');
+  }
+  return v;
+}
+
+/* Append "name\0value\0" to the OACK being built in buf */
+static u16_t
+add_option(char *buf, u16_t len, const char *name, u16_t value)
+{
+  size_t n = strlen(name) + 1;
+
+  MEMCPY(&buf[len], name, n);
+  len = (u16_t)(len + n);
+  lwip_itoa(&buf[len], 6, value);
+  return (u16_t)(len + strlen(&buf[len]) + 1);
+}
+
+/* Take up the blksize (RFC 2348) and windowsize (RFC 7440) options of the
+   request from offset on, within TFTP_MAX_BLKSIZE and TFTP_MAX_WINDOWSIZE.
+   Others are ignored, as RFC 2347 allows. If any is accepted, the OACK
+   naming them is left in tftp_state.last_data. */
+static void
+parse_options(struct pbuf *p, u16_t offset, u8_t write)
+{
+  const char tftp_null = 0;
+  char name[TFTP_MAX_OPTION_LEN];
+  char value[TFTP_MAX_OPTION_LEN];
+  char oack[2 + sizeof("blksize") + 6 + sizeof("windowsize") + 6];
+  u16_t oack_len = 2;
+  u16_t name_end, value_end;
+  u32_t v;
+
+  tftp_state.blksize = TFTP_MAX_PAYLOAD_SIZE;
+  tftp_state.windowsize = 1;
+
+  while (offset < p->tot_len) {
+    name_end = pbuf_memfind(p, &tftp_null, sizeof(tftp_null), offset);
+    if (name_end == 0xFFFF) {
+      break;
+    }
+    value_end = pbuf_memfind(p, &tftp_null, sizeof(tftp_null), name_end + 1);
+    if (value_end == 0xFFFF) {
+      break;
+    }
+    if (((u16_t)(name_end - offset) < sizeof(name)) &&
+        ((u16_t)(value_end - name_end - 1) < sizeof(value))) {
+      pbuf_copy_partial(p, name, name_end - offset + 1, offset);
+      pbuf_copy_partial(p, value, value_end - name_end, name_end + 1);
+      v = option_value(value);
+
+      if (!lwip_stricmp(name, "blksize") && (v >= 8)) {
+        tftp_state.blksize = (u16_t)LWIP_MIN(v, TFTP_MAX_BLKSIZE);
+        oack_len = add_option(oack, oack_len, "blksize", tftp_state.blksize);
+      } else if (write && !lwip_stricmp(name, "windowsize") && (v >= 1)) {
+        /* Reads keep to one block per ACK: only the last is kept for resends */
+        tftp_state.windowsize = (u16_t)LWIP_MIN(v, TFTP_MAX_WINDOWSIZE);
+        oack_len = add_option(oack, oack_len, "windowsize", tftp_state.windowsize);
+      }
+    }
+    offset = value_end + 1;
+  }
+
+  if (oack_len == 2) {
+    return;
+  }
+
+  tftp_state.last_data = pbuf_alloc(PBUF_TRANSPORT, oack_len, PBUF_RAM);
+  if (tftp_state.last_data != NULL) {
+    oack[0] = 0;
+    oack[1] = TFTP_OACK;
+    pbuf_take(tftp_state.last_data, oack, oack_len);
+  } else {
+    tftp_state.blksize = TFTP_MAX_PAYLOAD_SIZE;
+    tftp_state.windowsize = 1;
+  }
+}
+
 static void
 recv(void *arg, struct udp_pcb *upcb, struct pbuf *p, const ip_addr_t *addr, u16_t port)
 {
@@ -232,6 +351,16 @@ recv(void *arg, struct udp_pcb *upcb, struct pbuf *p, const ip_addr_t *addr, u16
       u16_t mode_end_offset;
 
       if(tftp_state.handle != NULL) {
+        /* The client missed our answer to its write request */
+        if ((opcode == PP_HTONS(TFTP_WRQ)) && tftp_state.mode_write &&
+            (tftp_state.blknum == 1) && (port == tftp_state.port)) {
+          if (tftp_state.last_data != NULL) {
+            resend_data();
+          } else {
+            send_ack(0);
+          }
+          break;
+        }
         send_error(addr, port, TFTP_ERROR_ACCESS_VIOLATION, "Only one connection at a time is supported");
         break;
       }
@@ -268,12 +397,20 @@ recv(void *arg, struct udp_pcb *upcb, struct pbuf *p, const ip_addr_t *addr, u16
 
       ip_addr_copy(tftp_state.addr, *addr);
       tftp_state.port = port;
+      tftp_state.mode_write = (opcode == PP_HTONS(TFTP_WRQ));
+      tftp_state.window = 0;
+      tftp_state.dropped = 0;
+      parse_options(p, mode_end_offset + 1, tftp_state.mode_write);
 
-      if (opcode == PP_HTONS(TFTP_WRQ)) {
-        tftp_state.mode_write = 1;
+      if (tftp_state.last_data != NULL) {
+        /* Reads start once the client acknowledges the OACK as block 0 */
+        if (!tftp_state.mode_write) {
+          tftp_state.blknum = 0;
+        }
+        resend_data();
+      } else if (tftp_state.mode_write) {
         send_ack(0);
       } else {
-        tftp_state.mode_write = 0;
         send_data();
       }
 
@@ -295,19 +432,42 @@ recv(void *arg, struct udp_pcb *upcb, struct pbuf *p, const ip_addr_t *addr, u16
         break;
       }
 
+      /* No room for blocks while one is still being written: the ACK
+         sent when it completes has the client resend them */
+      if (tftp_state.ack_pending) {
+        tftp_state.dropped = 1;
+        break;
+      }
+
+      /* A retransmission, or a block after one that went missing:
+         acknowledge the last block in order so that the client goes on
+         from there */
       blknum = lwip_ntohs(sbuf[1]);
+      if (blknum != tftp_state.blknum) {
+        send_ack((u16_t)(tftp_state.blknum - 1));
+        tftp_state.window = 0;
+        break;
+      }
+
+      /* The OACK is answered */
+      if (tftp_state.last_data != NULL) {
+        pbuf_free(tftp_state.last_data);
+        tftp_state.last_data = NULL;
+      }
+
       pbuf_header(p, -TFTP_HEADER_LENGTH);
+      tftp_state.last_block = p->tot_len < tftp_state.blksize;
+      tftp_state.blknum++;
+      tftp_state.window++;
 
       ret = tftp_state.ctx->write(tftp_state.handle, p);
       if (ret < 0) {
         send_error(addr, port, TFTP_ERROR_ACCESS_VIOLATION, "error writing file");
         close_handle();
+      } else if (ret == TFTP_WRITE_PENDING) {
+        tftp_state.ack_pending = 1;
       } else {
-        send_ack(blknum);
-      }
-
-      if (p->tot_len < TFTP_MAX_PAYLOAD_SIZE) {
-        close_handle();
+        block_written();
       }
       break;
     }
@@ -335,8 +495,9 @@ recv(void *arg, struct udp_pcb *upcb, struct pbuf *p, const ip_addr_t *addr, u16
 
       lastpkt = 0;
 
-      if (tftp_state.last_data != NULL) {
-        lastpkt = tftp_state.last_data->tot_len != (TFTP_MAX_PAYLOAD_SIZE + TFTP_HEADER_LENGTH);
+      /* Block 0 is the OACK */
+      if ((tftp_state.last_data != NULL) && (blknum != 0)) {
+        lastpkt = tftp_state.last_data->tot_len != (tftp_state.blksize + TFTP_HEADER_LENGTH);
       }
 
       if (!lastpkt) {
@@ -382,6 +543,38 @@ tftp_tmr(void* arg)
   }
 }
 
+/** @ingroup tftp
+ * Complete a write that tftp_context::write() left pending: acknowledge
+ * the block (and end the transfer if it was the last), or report an
+ * error to the client. Does nothing if the transfer has since ended.
+ * @param err 0 if the block was written, &lt; 0 on error
+ */
+void
+tftp_write_done(int err)
+{
+  if (!tftp_state.ack_pending) {
+    return;
+  }
+  tftp_state.ack_pending = 0;
+
+  if (err < 0) {
+    send_error(&tftp_state.addr, tftp_state.port, TFTP_ERROR_ACCESS_VIOLATION, "error writing file");
+    close_handle();
+  } else {
+    block_written();
+  }
+}
+
+/** @ingroup tftp
+ * Block size of the transfer in progress: TFTP_MAX_PAYLOAD_SIZE unless the
+ * client negotiated another. A write shorter than this is the last.
+ */
+u16_t
+tftp_blksize(void)
+{
+  return tftp_state.blksize;
+}
+
 /** @ingroup tftp
  * Initialize TFTP server.
  * @param ctx TFTP callback struct
@@ -408,6 +601,8 @@ tftp_init(const struct tftp_context *ctx)
   tftp_state.timer     = 0;
   tftp_state.last_data = NULL;
   tftp_state.upcb      = pcb;
+  tftp_state.ack_pending = 0;
+  tftp_state.blksize   = TFTP_MAX_PAYLOAD_SIZE;
 
   udp_recv(pcb, recv, NULL);
 
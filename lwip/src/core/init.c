@@ -155,6 +155,12 @@ PACK_STRUCT_END
   #error "If you want to use TCP, TCP_WND must fit in an u16_t, so, you have to reduce it in your lwipopts.h (or enable window scaling)"
 #endif
 #endif /* LWIP_WND_SCALE */
+#if (LWIP_TCP && LWIP_TCP_SACK_OUT && !TCP_QUEUE_OOSEQ)
+  #error "LWIP_TCP_SACK_OUT builds its SACK blocks from the out-of-sequence queue, so it needs TCP_QUEUE_OOSEQ"
+#endif
+#if (LWIP_TCP && LWIP_TCP_SACK_OUT && ((LWIP_TCP_MAX_SACK_NUM < 1) || (LWIP_TCP_MAX_SACK_NUM > 4)))
+  #error "LWIP_TCP_MAX_SACK_NUM must be 1 to 4: more SACK blocks do not fit in the TCP options"
+#endif
 #if (LWIP_TCP && (TCP_SND_QUEUELEN > 0xffff))
   #error "If you want to use TCP, TCP_SND_QUEUELEN must fit in an u16_t, so, you have to reduce it in your lwipopts.h"
 #endif
@@ -345,6 +351,9 @@ lwip_init(void)
 
   /* Modules initialization */
   stats_init();
+#if LWIP_CYCLE_STATS
+  stats_cycles_reset();
+#endif /* LWIP_CYCLE_STATS */
 #if !NO_SYS
   sys_init();
 #endif /* !NO_SYS */
@@ -705,6 +705,27 @@ void dhcp_cleanup(struct netif *netif)
  */
 err_t
 dhcp_start(struct netif *netif)
+{
+  return dhcp_start_reboot(netif, NULL);
+}
+
+/**
+ * @ingroup dhcp4
+ * Start DHCP negotiation for a network interface in the INIT-REBOOT state
+ * (RFC 2131, section 3.2): broadcast a REQUEST for an address the client
+ * was given before, e.g. a lease kept across a reset, instead of
+ * DISCOVERing.  A server that knows the lease ACKs it at once; a NAK, or
+ * no answer after REBOOT_TRIES requests, falls back to DISCOVER.
+ *
+ * @param netif The lwIP network interface
+ * @param addr The address to ask for again; NULL or any starts with
+ *        DISCOVER as dhcp_start() does
+ * @return lwIP error code
+ * - ERR_OK - No error
+ * - ERR_MEM - Out of memory
+ */
+err_t
+dhcp_start_reboot(struct netif *netif, const ip4_addr_t *addr)
 {
   struct dhcp *dhcp;
   err_t result;
@@ -754,18 +775,27 @@ dhcp_start(struct netif *netif)
     return ERR_MEM;
   }
   dhcp->pcb_allocated = 1;
+  if (!ip4_addr_isany(addr)) {
+    ip4_addr_copy(dhcp->offered_ip_addr, *addr);
+  }
 
 #if LWIP_DHCP_CHECK_LINK_UP
   if (!netif_is_link_up(netif)) {
-    /* set state INIT and wait for dhcp_network_changed() to call dhcp_discover() */
-    dhcp_set_state(dhcp, DHCP_STATE_INIT);
+    /* set state INIT (or REBOOTING, to keep asking for 'addr') and wait for
+       dhcp_network_changed() to call dhcp_discover() or dhcp_reboot() */
+    dhcp_set_state(dhcp, ip4_addr_isany_val(dhcp->offered_ip_addr) ?
+      DHCP_STATE_INIT : DHCP_STATE_REBOOTING);
     return ERR_OK;
   }
 #endif /* LWIP_DHCP_CHECK_LINK_UP */
 
 
   /* (re)start the DHCP negotiation */
-  result = dhcp_discover(netif);
+  if (!ip4_addr_isany_val(dhcp->offered_ip_addr)) {
+    result = dhcp_reboot(netif);
+  } else {
+    result = dhcp_discover(netif);
+  }
   if (result != ERR_OK) {
     /* free resources allocated above */
     dhcp_stop(netif);
@@ -97,10 +97,23 @@ struct etharp_entry {
   struct eth_addr ethaddr;
   u16_t ctime;
   u8_t state;
+#if ETHARP_TABLE_HASH
+  /** Next entry on this entry's hash chain, as index + 1 (0 ends the chain) */
+  u8_t hash_next;
+#endif /* ETHARP_TABLE_HASH */
 };
 
 static struct etharp_entry arp_table[ARP_TABLE_SIZE];
 
+#if ETHARP_TABLE_HASH
+/** First entry of each hash chain, as index + 1 (0 for an empty chain) */
+static u8_t arp_hash[ETHARP_HASH_SIZE];
+
+/** Hash chain of an IP address. The low bytes differ most between hosts on
+ * a subnet; byte access avoids shifts. */
+#define ETHARP_HASH(ipaddr) ((ip4_addr3(ipaddr) ^ ip4_addr4(ipaddr)) & (ETHARP_HASH_SIZE - 1))
+#endif /* ETHARP_TABLE_HASH */
+
 #if !LWIP_NETIF_HWADDRHINT
 static u8_t etharp_cached_entry;
 #endif /* !LWIP_NETIF_HWADDRHINT */
@@ -125,6 +138,9 @@ static u8_t etharp_cached_entry;
 #if (LWIP_ARP && (ARP_TABLE_SIZE > 0x7f))
   #error "ARP_TABLE_SIZE must fit in an s8_t, you have to reduce it in your lwipopts.h"
 #endif
+#if (LWIP_ARP && ETHARP_TABLE_HASH && ((ETHARP_HASH_SIZE & (ETHARP_HASH_SIZE - 1)) != 0))
+  #error "ETHARP_HASH_SIZE must be a power of two, you have to change it in your lwipopts.h"
+#endif
 
 
 static err_t etharp_request_dst(struct netif *netif, const ip4_addr_t *ipaddr, const struct eth_addr* hw_dst_addr);
@@ -157,10 +173,68 @@ free_etharp_q(struct etharp_q_entry *q)
 
 #endif /* ARP_QUEUEING */
 
+#if ETHARP_TABLE_HASH
+/**
+ * Find the entry of an IP address through the hash index.
+ *
+ * @param ipaddr IP address to find
+ * @param netif netif the entry must belong to (ETHARP_TABLE_MATCH_NETIF), or
+ *        NULL for any
+ * @return index of the pending or stable entry, -1 if there is none
+ */
+static s8_t
+etharp_hash_find(const ip4_addr_t *ipaddr, struct netif *netif)
+{
+  u8_t i;
+
+  LWIP_UNUSED_ARG(netif);
+
+  for (i = arp_hash[ETHARP_HASH(ipaddr)]; i != 0; i = arp_table[i - 1].hash_next) {
+    if ((arp_table[i - 1].state != ETHARP_STATE_EMPTY) &&
+#if ETHARP_TABLE_MATCH_NETIF
+        ((netif == NULL) || (netif == arp_table[i - 1].netif)) &&
+#endif /* ETHARP_TABLE_MATCH_NETIF */
+        ip4_addr_cmp(ipaddr, &arp_table[i - 1].ipaddr)) {
+      return (s8_t)(i - 1);
+    }
+  }
+  return -1;
+}
+
+/** Put entry i on the hash chain of its IP address */
+static void
+etharp_hash_add(u8_t i)
+{
+  u8_t h = ETHARP_HASH(&arp_table[i].ipaddr);
+
+  arp_table[i].hash_next = arp_hash[h];
+  arp_hash[h] = (u8_t)(i + 1);
+}
+
+/** Take entry i off the hash chain of its IP address, if it is on it */
+static void
+etharp_hash_remove(u8_t i)
+{
+  u8_t *link = &arp_hash[ETHARP_HASH(&arp_table[i].ipaddr)];
+
+  while (*link != 0) {
+    if (*link == i + 1) {
+      *link = arp_table[i].hash_next;
+      return;
+    }
+    link = &arp_table[*link - 1].hash_next;
+  }
+}
+#endif /* ETHARP_TABLE_HASH */
+
 /** Clean up ARP table entries */
 static void
 etharp_free_entry(int i)
 {
+#if ETHARP_TABLE_HASH
+  /* remove from the hash index while ipaddr is still valid */
+  etharp_hash_remove((u8_t)i);
+#endif /* ETHARP_TABLE_HASH */
   /* remove from SNMP ARP index tree */
   mib2_remove_arp_entry(arp_table[i].netif, &arp_table[i].ipaddr);
   /* and empty packet queue */
@@ -259,6 +333,21 @@ etharp_find_entry(const ip4_addr_t *ipaddr, u8_t flags, struct netif* netif)
 
   LWIP_UNUSED_ARG(netif);
 
+#if ETHARP_TABLE_HASH
+  /* every entry with an address is on its hash chain, so a miss there is
+     final and the sweep below only has to find a candidate to recycle */
+  if (ipaddr != NULL) {
+    s8_t found = etharp_hash_find(ipaddr, netif);
+    if (found >= 0) {
+      LWIP_DEBUGF(ETHARP_DEBUG | LWIP_DBG_TRACE, ("etharp_find_entry: found matching entry %"U16_F"\n", (u16_t)found));
+      return found;
+    }
+    if ((flags & ETHARP_FLAG_FIND_ONLY) != 0) {
+      return (s8_t)ERR_MEM;
+    }
+  }
+#endif /* ETHARP_TABLE_HASH */
+
   /**
    * a) do a search through the cache, remember candidates
    * b) select candidate entry
@@ -284,6 +373,7 @@ etharp_find_entry(const ip4_addr_t *ipaddr, u8_t flags, struct netif* netif)
     } else if (state != ETHARP_STATE_EMPTY) {
       LWIP_ASSERT("state == ETHARP_STATE_PENDING || state >= ETHARP_STATE_STABLE",
         state == ETHARP_STATE_PENDING || state >= ETHARP_STATE_STABLE);
+#if !ETHARP_TABLE_HASH
       /* if given, does IP address match IP address in ARP entry? */
       if (ipaddr && ip4_addr_cmp(ipaddr, &arp_table[i].ipaddr)
 #if ETHARP_TABLE_MATCH_NETIF
@@ -294,6 +384,7 @@ etharp_find_entry(const ip4_addr_t *ipaddr, u8_t flags, struct netif* netif)
         /* found exact IP address match, simply bail out */
         return i;
       }
+#endif /* !ETHARP_TABLE_HASH */
       /* pending entry? */
       if (state == ETHARP_STATE_PENDING) {
         /* pending with queued packets? */
@@ -349,6 +440,11 @@ etharp_find_entry(const ip4_addr_t *ipaddr, u8_t flags, struct netif* netif)
   if (empty < ARP_TABLE_SIZE) {
     i = empty;
     LWIP_DEBUGF(ETHARP_DEBUG | LWIP_DBG_TRACE, ("etharp_find_entry: selecting empty entry %"U16_F"\n", (u16_t)i));
+#if ETHARP_TABLE_HASH
+    /* an entry left empty by the caller of an earlier search may still be
+       on the chain of the address it was returned for */
+    etharp_hash_remove(i);
+#endif /* ETHARP_TABLE_HASH */
   } else {
     /* 2) found recyclable stable entry? */
     if (old_stable < ARP_TABLE_SIZE) {
@@ -386,6 +482,9 @@ etharp_find_entry(const ip4_addr_t *ipaddr, u8_t flags, struct netif* netif)
   if (ipaddr != NULL) {
     /* set IP address */
     ip4_addr_copy(arp_table[i].ipaddr, *ipaddr);
+#if ETHARP_TABLE_HASH
+    etharp_hash_add(i);
+#endif /* ETHARP_TABLE_HASH */
   }
   arp_table[i].ctime = 0;
 #if ETHARP_TABLE_MATCH_NETIF
@@ -889,6 +988,14 @@ etharp_output(struct netif *netif, struct pbuf *q, const ip4_addr_t *ipaddr)
 
     /* find stable entry: do this here since this is a critical path for
        throughput and etharp_find_entry() is kind of slow */
+#if ETHARP_TABLE_HASH
+    i = etharp_hash_find(dst_addr, netif);
+    if ((i >= 0) && (arp_table[i].state >= ETHARP_STATE_STABLE)) {
+      /* found an existing, stable entry */
+      ETHARP_SET_HINT(netif, i);
+      return etharp_output_to_arp_index(netif, q, i);
+    }
+#else /* ETHARP_TABLE_HASH */
     for (i = 0; i < ARP_TABLE_SIZE; i++) {
       if ((arp_table[i].state >= ETHARP_STATE_STABLE) &&
 #if ETHARP_TABLE_MATCH_NETIF
@@ -900,6 +1007,7 @@ etharp_output(struct netif *netif, struct pbuf *q, const ip4_addr_t *ipaddr)
         return etharp_output_to_arp_index(netif, q, i);
       }
     }
+#endif /* ETHARP_TABLE_HASH */
     /* no stable entry found, use the (slower) query function:
        queue on destination Ethernet address belonging to ipaddr */
     return etharp_query(netif, dst_addr, q);
@@ -661,13 +661,17 @@ ip4_input(struct pbuf *p, struct netif *inp)
     case IP_PROTO_UDPLITE:
 #endif /* LWIP_UDPLITE */
       MIB2_STATS_INC(mib2.ipindelivers);
+      CYCLE_STATS_ENTER(CYCLES_UDP);
       udp_input(p, inp);
+      CYCLE_STATS_EXIT();
       break;
 #endif /* LWIP_UDP */
 #if LWIP_TCP
     case IP_PROTO_TCP:
       MIB2_STATS_INC(mib2.ipindelivers);
+      CYCLE_STATS_ENTER(CYCLES_TCP);
       tcp_input(p, inp);
+      CYCLE_STATS_EXIT();
       break;
 #endif /* LWIP_TCP */
 #if LWIP_ICMP
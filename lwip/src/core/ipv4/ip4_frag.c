@@ -48,6 +48,7 @@
 #include "lwip/netif.h"
 #include "lwip/stats.h"
 #include "lwip/icmp.h"
+#include "lwip/prot/udp.h"
 
 #include <string.h>
 
@@ -106,9 +107,29 @@ PACK_STRUCT_END
    ip4_addr_cmp(&(iphdrA)->dest, &(iphdrB)->dest) && \
    IPH_ID(iphdrA) == IPH_ID(iphdrB)) ? 1 : 0
 
+#ifdef IP_REASS_REJECT_UDP
+/** Number of rejected datagrams (IP_REASS_REJECT_UDP) whose later fragments
+ * are recognised and dropped */
+#define IP_REASS_REJECTED_IDS 4
+
+/** A datagram whose first fragment was rejected */
+struct ip_reass_rejected {
+  ip4_addr_t src;
+  u16_t id;
+  /** Seconds left to drop its fragments, 0 if the slot is free */
+  u8_t timer;
+};
+#endif /* IP_REASS_REJECT_UDP */
+
 /* global variables */
 static struct ip_reassdata *reassdatagrams;
 static u16_t ip_reass_pbufcount;
+#ifdef IP_REASS_REJECT_UDP
+static struct ip_reass_rejected ip_reass_rejected[IP_REASS_REJECTED_IDS];
+static u8_t ip_reass_rejected_next;
+#endif /* IP_REASS_REJECT_UDP */
+
+struct ip_reass_drop_counts ip_reass_drops;
 
 /* function prototypes */
 static void ip_reass_dequeue_datagram(struct ip_reassdata *ipr, struct ip_reassdata *prev);
@@ -124,6 +145,15 @@ void
 ip_reass_tmr(void)
 {
   struct ip_reassdata *r, *prev = NULL;
+#ifdef IP_REASS_REJECT_UDP
+  u8_t i;
+
+  for (i = 0; i < IP_REASS_REJECTED_IDS; i++) {
+    if (ip_reass_rejected[i].timer > 0) {
+      ip_reass_rejected[i].timer--;
+    }
+  }
+#endif /* IP_REASS_REJECT_UDP */
 
   r = reassdatagrams;
   while (r != NULL) {
@@ -474,6 +504,95 @@ freepbuf:
 #endif /* IP_REASS_CHECK_OVERLAP */
 }
 
+#ifdef IP_REASS_REJECT_UDP
+/**
+ * Drop the fragment if its datagram goes to an IP_REASS_REJECT_UDP port.
+ * The first fragment carries the UDP header: it is answered with an ICMP
+ * destination unreachable, any fragments of the datagram already queued are
+ * freed and the datagram is remembered, so that the fragments following it
+ * are dropped too.  Fragments arriving before the first are queued as usual
+ * and freed once it arrives (or when they time out).
+ *
+ * @param p the fragment, with p->payload pointing to its IP header
+ * @param offset the fragment offset in bytes
+ * @return 1 if the fragment must be dropped, 0 otherwise
+ */
+static int
+ip_reass_reject(struct pbuf *p, u16_t offset)
+{
+  struct ip_hdr *fraghdr = (struct ip_hdr *)p->payload;
+  struct ip_reassdata *ipr, *prev = NULL;
+  struct ip_reass_rejected *rej;
+  struct udp_hdr *udphdr;
+  u8_t i;
+
+  if (offset != 0) {
+    for (i = 0; i < IP_REASS_REJECTED_IDS; i++) {
+      rej = &ip_reass_rejected[i];
+      if (rej->timer > 0 && ip4_addr_cmp(&rej->src, &fraghdr->src) &&
+          rej->id == IPH_ID(fraghdr)) {
+        return 1;
+      }
+    }
+    return 0;
+  }
+
+  if ((IPH_PROTO(fraghdr) != IP_PROTO_UDP) || (p->len < IP_HLEN + UDP_HLEN)) {
+    return 0;
+  }
+  udphdr = (struct udp_hdr *)((u8_t *)p->payload + IP_HLEN);
+  if (!IP_REASS_REJECT_UDP(lwip_ntohs(udphdr->dest))) {
+    return 0;
+  }
+  LWIP_DEBUGF(IP_REASS_DEBUG, ("ip4_reass: rejecting fragmented datagram to port %"U16_F"\n",
+    lwip_ntohs(udphdr->dest)));
+
+  for (ipr = reassdatagrams; ipr != NULL; prev = ipr, ipr = ipr->next) {
+    if (IP_ADDRESSES_AND_ID_MATCH(&ipr->iphdr, fraghdr)) {
+      /* No ICMP from here: the first fragment was never queued */
+      ip_reass_free_complete_datagram(ipr, prev);
+      break;
+    }
+  }
+
+  rej = &ip_reass_rejected[ip_reass_rejected_next];
+  ip_reass_rejected_next = (ip_reass_rejected_next + 1) % IP_REASS_REJECTED_IDS;
+  ip4_addr_copy(rej->src, fraghdr->src);
+  rej->id = IPH_ID(fraghdr);
+  rej->timer = IP_REASS_MAXAGE;
+
+#if LWIP_ICMP
+  icmp_dest_unreach(p, ICMP_DUR_PROHIBITED);
+#endif /* LWIP_ICMP */
+  return 1;
+}
+#endif /* IP_REASS_REJECT_UDP */
+
+#if IP_REASS_MAX_PBUFS_PER_SRC < IP_REASS_MAX_PBUFS
+/**
+ * Count the pbufs enqueued for datagrams from the source of a fragment.
+ *
+ * @param fraghdr IP header of the fragment
+ * @return the number of pbufs enqueued
+ */
+static u16_t
+ip_reass_src_pbufcount(struct ip_hdr *fraghdr)
+{
+  struct ip_reassdata *ipr;
+  struct pbuf *q;
+  u16_t count = 0;
+
+  for (ipr = reassdatagrams; ipr != NULL; ipr = ipr->next) {
+    if (ip4_addr_cmp(&ipr->iphdr.src, &fraghdr->src)) {
+      for (q = ipr->p; q != NULL; q = ((struct ip_reass_helper*)q->payload)->next_pbuf) {
+        count += pbuf_clen(q);
+      }
+    }
+  }
+  return count;
+}
+#endif /* IP_REASS_MAX_PBUFS_PER_SRC < IP_REASS_MAX_PBUFS */
+
 /**
  * Reassembles incoming IP fragments into an IP datagram.
  *
@@ -503,8 +622,29 @@ ip4_reass(struct pbuf *p)
   offset = (lwip_ntohs(IPH_OFFSET(fraghdr)) & IP_OFFMASK) * 8;
   len = lwip_ntohs(IPH_LEN(fraghdr)) - IPH_HL(fraghdr) * 4;
 
+#ifdef IP_REASS_REJECT_UDP
+  /* Drop fragments of datagrams that must not be fragmented before
+   * allocating anything for them. */
+  if (ip_reass_reject(p, offset)) {
+    ip_reass_drops.rejected++;
+    IPFRAG_STATS_INC(ip_frag.proterr);
+    goto nullreturn;
+  }
+#endif /* IP_REASS_REJECT_UDP */
+
   /* Check if we are allowed to enqueue more datagrams. */
   clen = pbuf_clen(p);
+#if IP_REASS_MAX_PBUFS_PER_SRC < IP_REASS_MAX_PBUFS
+  /* Keep one source from taking the whole reassembly buffer: drop rather
+   * than free other sources' datagrams to make room. */
+  if ((ip_reass_src_pbufcount(fraghdr) + clen) > IP_REASS_MAX_PBUFS_PER_SRC) {
+    LWIP_DEBUGF(IP_REASS_DEBUG,("ip4_reass: source over its limit: clen=%d, MAX_PER_SRC=%d\n",
+      clen, IP_REASS_MAX_PBUFS_PER_SRC));
+    ip_reass_drops.capped++;
+    IPFRAG_STATS_INC(ip_frag.memerr);
+    goto nullreturn;
+  }
+#endif /* IP_REASS_MAX_PBUFS_PER_SRC < IP_REASS_MAX_PBUFS */
   if ((ip_reass_pbufcount + clen) > IP_REASS_MAX_PBUFS) {
 #if IP_REASS_FREE_OLDEST
     if (!ip_reass_remove_oldest_datagram(fraghdr, clen) ||
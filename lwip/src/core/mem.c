@@ -151,6 +151,35 @@ mem_free(void *rmem)
 
 /* lwIP heap implemented with different sized pools */
 
+#if MEM_SIZE_TRACE
+#if MEM_SIZE_TRACE_STEP & (MEM_SIZE_TRACE_STEP - 1)
+#error "MEM_SIZE_TRACE_STEP must be a power of two"
+#endif
+/** mem_malloc() requests of size n, counted in mem_sizes[n / MEM_SIZE_TRACE_STEP] */
+static u32_t mem_sizes[MEM_SIZE_TRACE];
+
+/**
+ * @param bucket the bucket, counting from 0
+ * @return the number of mem_malloc() requests since boot or mem_size_reset()
+ *         of bucket * MEM_SIZE_TRACE_STEP bytes up to the next bucket, or of
+ *         any bigger size for the last; 0 past the last
+ */
+u32_t
+mem_size_count(u16_t bucket)
+{
+  return bucket < MEM_SIZE_TRACE ? mem_sizes[bucket] : 0;
+}
+
+/**
+ * Start counting requests afresh, e.g. to measure a particular load.
+ */
+void
+mem_size_reset(void)
+{
+  memset(mem_sizes, 0, sizeof(mem_sizes));
+}
+#endif /* MEM_SIZE_TRACE */
+
 /**
  * Allocate memory: determine the smallest pool that is big enough
  * to contain an element of 'size' and get an element from that pool.
@@ -166,6 +195,9 @@ mem_malloc(mem_size_t size)
   memp_t poolnr;
   mem_size_t required_size = size + LWIP_MEM_ALIGN_SIZE(sizeof(struct memp_malloc_helper));
 
+#if MEM_SIZE_TRACE
+  mem_sizes[LWIP_MIN(size / MEM_SIZE_TRACE_STEP, MEM_SIZE_TRACE - 1)]++;
+#endif /* MEM_SIZE_TRACE */
   for (poolnr = MEMP_POOL_FIRST; poolnr <= MEMP_POOL_LAST; poolnr = (memp_t)(poolnr + 1)) {
     /* is this pool big enough to hold an element of the required size
        plus a struct memp_malloc_helper that saves the pool this element came from? */
@@ -84,6 +84,69 @@ const struct memp_desc* const memp_pools[MEMP_MAX] = {
 #include "lwip/priv/memp_std.h"
 };
 
+#if MEMP_FAIL_TRACE
+/** The last MEMP_FAIL_TRACE failures, failure n in memp_fails[n % MEMP_FAIL_TRACE] */
+static struct memp_fail memp_fails[MEMP_FAIL_TRACE];
+static u32_t memp_fails_count;
+
+/**
+ * Remember a failed memp_malloc().
+ *
+ * @param type the pool that was empty
+ * @param caller the caller of memp_malloc()
+ */
+static void
+memp_fail_record(memp_t type, void *caller)
+{
+  struct memp_fail *f = &memp_fails[memp_fails_count % MEMP_FAIL_TRACE];
+
+  f->time = sys_now();
+  f->caller = caller;
+  f->origin = NULL;
+  f->type = type;
+  memp_fails_count++;
+}
+
+/**
+ * @return the number of memp_malloc() calls that have failed
+ */
+u32_t
+memp_fail_count(void)
+{
+  return memp_fails_count;
+}
+
+/**
+ * Get a failed memp_malloc() from the trace.
+ *
+ * @param n the failure, counting from 0
+ * @return the failure, or NULL if there have not been that many or it has
+ *         been overwritten
+ */
+const struct memp_fail *
+memp_fail_get(u32_t n)
+{
+  if (n >= memp_fails_count || memp_fails_count - n > MEMP_FAIL_TRACE) {
+    return NULL;
+  }
+  return &memp_fails[n % MEMP_FAIL_TRACE];
+}
+
+/**
+ * Name the caller of the function that called memp_malloc(), for failures
+ * of wrappers such as pbuf_alloc().  Only call this right after the failure.
+ *
+ * @param origin the return address of the wrapper
+ */
+void
+memp_fail_origin(void *origin)
+{
+  if (memp_fails_count > 0) {
+    memp_fails[(memp_fails_count - 1) % MEMP_FAIL_TRACE].origin = origin;
+  }
+}
+#endif /* MEMP_FAIL_TRACE */
+
 #if MEMP_MEM_MALLOC && MEMP_OVERFLOW_CHECK >= 2
 #undef MEMP_OVERFLOW_CHECK
 /* MEMP_OVERFLOW_CHECK >= 2 does not work with MEMP_MEM_MALLOC, use 1 instead */
@@ -397,6 +460,12 @@ memp_malloc_fn(memp_t type, const char* file, const int line)
   memp = do_memp_malloc_pool_fn(memp_pools[type], file, line);
 #endif
 
+#if MEMP_FAIL_TRACE
+  if (memp == NULL) {
+    memp_fail_record(type, MEMP_FAIL_TRACE_CALLER());
+  }
+#endif /* MEMP_FAIL_TRACE */
+
   return memp;
 }
 
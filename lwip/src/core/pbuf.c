@@ -131,6 +131,13 @@ void eth_rx_irq()
    aligned there. Therefore, PBUF_POOL_BUFSIZE_ALIGNED can be used here. */
 #define PBUF_POOL_BUFSIZE_ALIGNED LWIP_MEM_ALIGN_SIZE(PBUF_POOL_BUFSIZE)
 
+/* Blame a failed memp_malloc() on the caller of pbuf_alloc() */
+#if MEMP_FAIL_TRACE
+#define PBUF_FAIL_ORIGIN() memp_fail_origin(MEMP_FAIL_TRACE_CALLER())
+#else /* MEMP_FAIL_TRACE */
+#define PBUF_FAIL_ORIGIN()
+#endif /* MEMP_FAIL_TRACE */
+
 #if !LWIP_TCP || !TCP_QUEUE_OOSEQ || !PBUF_POOL_FREE_OOSEQ
 #define PBUF_POOL_IS_EMPTY()
 #else /* !LWIP_TCP || !TCP_QUEUE_OOSEQ || !PBUF_POOL_FREE_OOSEQ */
@@ -285,6 +292,7 @@ pbuf_alloc(pbuf_layer layer, u16_t length, pbuf_type type)
     p = (struct pbuf *)memp_malloc(MEMP_PBUF_POOL);
     LWIP_DEBUGF(PBUF_DEBUG | LWIP_DBG_TRACE, ("pbuf_alloc: allocated pbuf %p\n", (void *)p));
     if (p == NULL) {
+      PBUF_FAIL_ORIGIN();
       PBUF_POOL_IS_EMPTY();
       return NULL;
     }
@@ -317,6 +325,7 @@ pbuf_alloc(pbuf_layer layer, u16_t length, pbuf_type type)
     while (rem_len > 0) {
       q = (struct pbuf *)memp_malloc(MEMP_PBUF_POOL);
       if (q == NULL) {
+        PBUF_FAIL_ORIGIN();
         PBUF_POOL_IS_EMPTY();
         /* free chain so far allocated */
         pbuf_free(p);
@@ -371,6 +380,7 @@ pbuf_alloc(pbuf_layer layer, u16_t length, pbuf_type type)
     /* only allocate memory for the pbuf structure */
     p = (struct pbuf *)memp_malloc(MEMP_PBUF);
     if (p == NULL) {
+      PBUF_FAIL_ORIGIN();
       LWIP_DEBUGF(PBUF_DEBUG | LWIP_DBG_LEVEL_SERIOUS,
                   ("pbuf_alloc: Could not allocate MEMP_PBUF for PBUF_%s.\n",
                   (type == PBUF_ROM) ? "ROM" : "REF"));
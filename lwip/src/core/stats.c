@@ -167,3 +167,60 @@ stats_display(void)
 
 #endif /* LWIP_STATS */
 
+#if LWIP_CYCLE_STATS
+
+#include "lwip/stats.h"
+#include "lwip/debug.h"
+
+#include <string.h>
+
+struct stats_cycles lwip_cycle_stats;
+
+/* Layers that were current when the ones above them were entered */
+static u8_t cycles_stack[LWIP_CYCLE_STATS_DEPTH];
+static u8_t cycles_depth;
+static u8_t cycles_layer;
+/* Stamp at the last change of layer */
+static u32_t cycles_last;
+
+/* Charge the cycles since the last change of layer to the current one */
+static void
+stats_cycles_charge(void)
+{
+  u32_t now = LWIP_CYCLE_STAMP();
+
+  lwip_cycle_stats.layer[cycles_layer].cycles += now - cycles_last;
+  cycles_last = now;
+}
+
+void
+stats_cycles_enter(u8_t layer)
+{
+  stats_cycles_charge();
+  if (cycles_depth < LWIP_CYCLE_STATS_DEPTH) {
+    cycles_stack[cycles_depth] = cycles_layer;
+    cycles_layer = layer;
+  }
+  cycles_depth++;
+  lwip_cycle_stats.layer[layer].calls++;
+}
+
+void
+stats_cycles_exit(void)
+{
+  LWIP_ASSERT("unbalanced stats_cycles_exit", cycles_depth > 0);
+  stats_cycles_charge();
+  cycles_depth--;
+  if (cycles_depth < LWIP_CYCLE_STATS_DEPTH) {
+    cycles_layer = cycles_stack[cycles_depth];
+  }
+}
+
+void
+stats_cycles_reset(void)
+{
+  memset(&lwip_cycle_stats, 0, sizeof(lwip_cycle_stats));
+  cycles_last = LWIP_CYCLE_STAMP();
+}
+
+#endif /* LWIP_CYCLE_STATS */
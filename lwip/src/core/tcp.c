@@ -121,12 +121,102 @@ struct tcp_pcb *tcp_active_pcbs;
 /** List of all TCP PCBs in TIME-WAIT state */
 struct tcp_pcb *tcp_tw_pcbs;
 
+struct tcp_reap_counts tcp_reaped;
+
 /** An array with all (non-temporary) PCB lists, mainly used for smaller code size */
 struct tcp_pcb ** const tcp_pcb_lists[] = {&tcp_listen_pcbs.pcbs, &tcp_bound_pcbs,
   &tcp_active_pcbs, &tcp_tw_pcbs};
 
 u8_t tcp_active_pcbs_changed;
 
+#if TCP_PCB_HASH
+#if (TCP_HASH_SIZE & (TCP_HASH_SIZE - 1)) != 0
+  #error "TCP_HASH_SIZE must be a power of two, you have to change it in your lwipopts.h"
+#endif
+
+/** Every PCB on tcp_active_pcbs, chained by a hash of its ports and remote
+ * address */
+static struct tcp_pcb *tcp_hash[TCP_HASH_SIZE];
+
+/** Chain of a connection: the ports and the last byte of an IPv4 remote
+ * address (the one that differs between hosts on a subnet), no shifts */
+static u8_t
+tcp_hash_chain(const ip_addr_t *remote_ip, u16_t local_port, u16_t remote_port)
+{
+  u16_t h = local_port ^ remote_port;
+
+#if LWIP_IPV4
+#if LWIP_IPV6
+  if (IP_IS_V4(remote_ip))
+#endif /* LWIP_IPV6 */
+  {
+    h ^= ip4_addr4(ip_2_ip4(remote_ip));
+  }
+#else /* LWIP_IPV4 */
+  LWIP_UNUSED_ARG(remote_ip);
+#endif /* LWIP_IPV4 */
+  return (u8_t)(h & (TCP_HASH_SIZE - 1));
+}
+
+/** Put a PCB that has just become active on its chain */
+void
+tcp_hash_add(struct tcp_pcb *pcb)
+{
+  struct tcp_pcb **head =
+    &tcp_hash[tcp_hash_chain(&pcb->remote_ip, pcb->local_port, pcb->remote_port)];
+
+  pcb->hash_next = *head;
+  *head = pcb;
+}
+
+/** Take a PCB off its chain, if it is on it */
+void
+tcp_hash_remove(struct tcp_pcb *pcb)
+{
+  struct tcp_pcb **link =
+    &tcp_hash[tcp_hash_chain(&pcb->remote_ip, pcb->local_port, pcb->remote_port)];
+
+  for (; *link != NULL; link = &(*link)->hash_next) {
+    if (*link == pcb) {
+      *link = pcb->hash_next;
+      pcb->hash_next = NULL;
+      return;
+    }
+  }
+}
+
+/** Find the active PCB of a connection, moving it to the front of its chain
+ * to exploit locality in segment arrivals as the list walk did */
+struct tcp_pcb *
+tcp_hash_lookup(const ip_addr_t *local_ip, u16_t local_port,
+                const ip_addr_t *remote_ip, u16_t remote_port)
+{
+  struct tcp_pcb **head = &tcp_hash[tcp_hash_chain(remote_ip, local_port, remote_port)];
+  struct tcp_pcb *pcb, *prev = NULL;
+
+  for (pcb = *head; pcb != NULL; pcb = pcb->hash_next) {
+    LWIP_ASSERT("tcp_hash_lookup: active pcb->state != CLOSED", pcb->state != CLOSED);
+    LWIP_ASSERT("tcp_hash_lookup: active pcb->state != TIME-WAIT", pcb->state != TIME_WAIT);
+    LWIP_ASSERT("tcp_hash_lookup: active pcb->state != LISTEN", pcb->state != LISTEN);
+    if (pcb->remote_port == remote_port &&
+        pcb->local_port == local_port &&
+        ip_addr_cmp(&pcb->remote_ip, remote_ip) &&
+        ip_addr_cmp(&pcb->local_ip, local_ip)) {
+      if (prev != NULL) {
+        prev->hash_next = pcb->hash_next;
+        pcb->hash_next = *head;
+        *head = pcb;
+      } else {
+        TCP_STATS_INC(tcp.cachehit);
+      }
+      return pcb;
+    }
+    prev = pcb;
+  }
+  return NULL;
+}
+#endif /* TCP_PCB_HASH */
+
 /** Timer counter to handle calling slow-timer from tcp_tmr() */
 static u8_t tcp_timer;
 static u8_t tcp_timer_ctr;
@@ -276,7 +366,10 @@ tcp_close_shutdown(struct tcp_pcb *pcb, u8_t rst_on_unacked_data)
       if (pcb->state == ESTABLISHED) {
         /* move to TIME_WAIT since we close actively */
         pcb->state = TIME_WAIT;
+        /* TIME_WAIT is timed from here, and TCP_TW_CAP() spares the newest */
+        pcb->tmr = tcp_ticks;
         TCP_REG(&tcp_tw_pcbs, pcb);
+        TCP_TW_CAP();
       } else {
         /* CLOSE_WAIT: deallocate the pcb since we already sent a RST for it */
         if (tcp_input_pcb == pcb) {
@@ -673,6 +766,9 @@ tcp_listen_with_backlog(struct tcp_pcb *pcb, u8_t backlog)
   lpcb->state = LISTEN;
   lpcb->prio = pcb->prio;
   lpcb->so_options = pcb->so_options;
+#if LWIP_TCP_IDLE_TIMEOUT
+  lpcb->idle_limit = pcb->idle_limit;
+#endif /* LWIP_TCP_IDLE_TIMEOUT */
   lpcb->ttl = pcb->ttl;
   lpcb->tos = pcb->tos;
 #if LWIP_IPV4 && LWIP_IPV6
@@ -1014,6 +1110,7 @@ tcp_slowtmr_start:
             pcb->ssthresh = (pcb->mss << 1);
           }
           pcb->cwnd = pcb->mss;
+          pcb->bytes_acked = 0;
           LWIP_DEBUGF(TCP_CWND_DEBUG, ("tcp_slowtmr: cwnd %"TCPWNDSIZE_F
                                        " ssthresh %"TCPWNDSIZE_F"\n",
                                        pcb->cwnd, pcb->ssthresh));
@@ -1051,6 +1148,7 @@ tcp_slowtmr_start:
 
         ++pcb_remove;
         ++pcb_reset;
+        tcp_reaped.keepalive++;
       } else if ((u32_t)(tcp_ticks - pcb->tmr) >
                 (pcb->keep_idle + pcb->keep_cnt_sent * TCP_KEEP_INTVL(pcb))
                 / TCP_SLOW_INTERVAL)
@@ -1062,6 +1160,21 @@ tcp_slowtmr_start:
       }
     }
 
+#if LWIP_TCP_IDLE_TIMEOUT
+    /* Check if the peer has been silent for longer than the service allows */
+    if ((pcb_remove == 0) && (pcb->idle_limit != 0) &&
+        ((pcb->state == ESTABLISHED) || (pcb->state == CLOSE_WAIT)) &&
+        ((u32_t)(tcp_ticks - pcb->tmr) > pcb->idle_limit)) {
+      LWIP_DEBUGF(TCP_DEBUG, ("tcp_slowtmr: idle timeout. Aborting connection to "));
+      ip_addr_debug_print(TCP_DEBUG, &pcb->remote_ip);
+      LWIP_DEBUGF(TCP_DEBUG, ("\n"));
+
+      ++pcb_remove;
+      ++pcb_reset;
+      tcp_reaped.idle++;
+    }
+#endif /* LWIP_TCP_IDLE_TIMEOUT */
+
     /* If this PCB has queued out of sequence data, but has been
        inactive for too long, will drop the data (it will eventually
        be retransmitted). */
@@ -1108,6 +1221,7 @@ tcp_slowtmr_start:
         LWIP_ASSERT("tcp_slowtmr: first pcb == tcp_active_pcbs", tcp_active_pcbs == pcb);
         tcp_active_pcbs = pcb->next;
       }
+      TCP_HASH_REMOVE(pcb);
 
       if (pcb_reset) {
         tcp_rst(pcb->snd_nxt, pcb->rcv_nxt, &pcb->local_ip, &pcb->remote_ip,
@@ -1348,6 +1462,33 @@ tcp_setprio(struct tcp_pcb *pcb, u8_t prio)
   pcb->prio = prio;
 }
 
+#if LWIP_TCP_IDLE_TIMEOUT
+/**
+ * @ingroup tcp_raw
+ * Reset the connection once nothing has arrived on it for `ms`
+ * milliseconds, 0 for never. On a listening pcb, for each connection it
+ * accepts from then on.
+ *
+ * @param pcb tcp_pcb to set the limit for
+ * @param ms the limit, rounded down to the slow timer
+ */
+void
+tcp_idle_timeout(struct tcp_pcb *pcb, u32_t ms)
+{
+  u32_t ticks = ms / TCP_SLOW_INTERVAL;
+  u16_t limit = (u16_t)LWIP_MIN(ticks, 0xffff);
+
+  if ((ms != 0) && (limit == 0)) {
+    limit = 1;
+  }
+  if (pcb->state == LISTEN) {
+    ((struct tcp_pcb_listen *)pcb)->idle_limit = limit;
+  } else {
+    pcb->idle_limit = limit;
+  }
+}
+#endif /* LWIP_TCP_IDLE_TIMEOUT */
+
 #if TCP_QUEUE_OOSEQ
 /**
  * Returns a copy of the given TCP segment.
@@ -1458,8 +1599,10 @@ tcp_kill_state(enum tcp_state state)
 /**
  * Kills the oldest connection that is in TIME_WAIT state.
  * Called from tcp_alloc() if no more connections are available.
+ *
+ * @return 1 if there was one to kill, 0 otherwise
  */
-static void
+static u8_t
 tcp_kill_timewait(void)
 {
   struct tcp_pcb *pcb, *inactive;
@@ -1478,9 +1621,33 @@ tcp_kill_timewait(void)
     LWIP_DEBUGF(TCP_DEBUG, ("tcp_kill_timewait: killing oldest TIME-WAIT PCB %p (%"S32_F")\n",
            (void *)inactive, inactivity));
     tcp_abort(inactive);
+    return 1;
   }
+  return 0;
 }
 
+#if TCP_TW_MAX
+/**
+ * Called as a PCB enters TIME_WAIT: kills the oldest ones while there are
+ * more than TCP_TW_MAX. The PCB entering is the newest and so is spared.
+ */
+void
+tcp_timewait_cap(void)
+{
+  struct tcp_pcb *pcb;
+  u16_t n = 0;
+
+  for (pcb = tcp_tw_pcbs; pcb != NULL; pcb = pcb->next) {
+    n++;
+  }
+  for (; n > TCP_TW_MAX; n--) {
+    if (tcp_kill_timewait()) {
+      tcp_reaped.tw_capped++;
+    }
+  }
+}
+#endif /* TCP_TW_MAX */
+
 /**
  * Allocate a new tcp_pcb structure.
  *
@@ -1497,7 +1664,9 @@ tcp_alloc(u8_t prio)
   if (pcb == NULL) {
     /* Try killing oldest connection in TIME-WAIT. */
     LWIP_DEBUGF(TCP_DEBUG, ("tcp_alloc: killing off oldest TIME-WAIT connection\n"));
-    tcp_kill_timewait();
+    if (tcp_kill_timewait()) {
+      tcp_reaped.tw_reused++;
+    }
     /* Try to allocate a tcp_pcb again. */
     pcb = (struct tcp_pcb *)memp_malloc(MEMP_TCP_PCB);
     if (pcb == NULL) {
@@ -1794,6 +1963,11 @@ void
 tcp_pcb_remove(struct tcp_pcb **pcblist, struct tcp_pcb *pcb)
 {
   TCP_RMV(pcblist, pcb);
+#if TCP_PCB_HASH
+  if (pcblist == &tcp_active_pcbs) {
+    tcp_hash_remove(pcb);
+  }
+#endif /* TCP_PCB_HASH */
 
   tcp_pcb_purge(pcb);
 
@@ -222,6 +222,10 @@ tcp_input(struct pbuf *p, struct netif *inp)
      for an active connection. */
   prev = NULL;
 
+#if TCP_PCB_HASH
+  pcb = tcp_hash_lookup(ip_current_dest_addr(), tcphdr->dest,
+                        ip_current_src_addr(), tcphdr->src);
+#else /* TCP_PCB_HASH */
   for (pcb = tcp_active_pcbs; pcb != NULL; pcb = pcb->next) {
     LWIP_ASSERT("tcp_input: active pcb->state != CLOSED", pcb->state != CLOSED);
     LWIP_ASSERT("tcp_input: active pcb->state != TIME-WAIT", pcb->state != TIME_WAIT);
@@ -246,6 +250,7 @@ tcp_input(struct pbuf *p, struct netif *inp)
     }
     prev = pcb;
   }
+#endif /* TCP_PCB_HASH */
 
   if (pcb == NULL) {
     /* If it did not go to an active connection, we check the connections
@@ -596,6 +601,9 @@ tcp_listen_input(struct tcp_pcb_listen *pcb)
 #endif /* LWIP_CALLBACK_API || TCP_LISTEN_BACKLOG */
     /* inherit socket options */
     npcb->so_options = pcb->so_options & SOF_INHERITED;
+#if LWIP_TCP_IDLE_TIMEOUT
+    npcb->idle_limit = pcb->idle_limit;
+#endif /* LWIP_TCP_IDLE_TIMEOUT */
     /* Register the new PCB so that we can begin receiving segments
        for it. */
     TCP_REG_ACTIVE(npcb);
@@ -892,6 +900,7 @@ tcp_process(struct tcp_pcb *pcb)
         TCP_RMV_ACTIVE(pcb);
         pcb->state = TIME_WAIT;
         TCP_REG(&tcp_tw_pcbs, pcb);
+        TCP_TW_CAP();
       } else {
         tcp_ack_now(pcb);
         pcb->state = CLOSING;
@@ -910,6 +919,7 @@ tcp_process(struct tcp_pcb *pcb)
       TCP_RMV_ACTIVE(pcb);
       pcb->state = TIME_WAIT;
       TCP_REG(&tcp_tw_pcbs, pcb);
+      TCP_TW_CAP();
     }
     break;
   case CLOSING:
@@ -920,6 +930,7 @@ tcp_process(struct tcp_pcb *pcb)
       TCP_RMV_ACTIVE(pcb);
       pcb->state = TIME_WAIT;
       TCP_REG(&tcp_tw_pcbs, pcb);
+      TCP_TW_CAP();
     }
     break;
   case LAST_ACK:
@@ -1098,6 +1109,7 @@ tcp_receive(struct tcp_pcb *pcb)
         pcb->dupacks = 0;
       }
     } else if (TCP_SEQ_BETWEEN(ackno, pcb->lastack+1, pcb->snd_nxt)) {
+      tcpwnd_size_t acked = (tcpwnd_size_t)(ackno - pcb->lastack);
       /* We come here when the ACK acknowledges new data. */
 
       /* Reset the "IN Fast Retransmit" flag, since we are no longer
@@ -1106,6 +1118,7 @@ tcp_receive(struct tcp_pcb *pcb)
       if (pcb->flags & TF_INFR) {
         pcb->flags &= ~TF_INFR;
         pcb->cwnd = pcb->ssthresh;
+        pcb->bytes_acked = 0;
       }
 
       /* Reset the number of retransmissions. */
@@ -1127,9 +1140,17 @@ tcp_receive(struct tcp_pcb *pcb)
           }
           LWIP_DEBUGF(TCP_CWND_DEBUG, ("tcp_receive: slow start cwnd %"TCPWNDSIZE_F"\n", pcb->cwnd));
         } else {
-          tcpwnd_size_t new_cwnd = (pcb->cwnd + pcb->mss * pcb->mss / pcb->cwnd);
-          if (new_cwnd > pcb->cwnd) {
-            pcb->cwnd = new_cwnd;
+          /* One MSS per window's worth of data acknowledged (RFC 3465),
+             rather than mss * mss / cwnd on every ACK: the core has no
+             multiplier or divider, so that was two library calls */
+          if ((tcpwnd_size_t)(pcb->bytes_acked + acked) > pcb->bytes_acked) {
+            pcb->bytes_acked += acked;
+          }
+          if (pcb->bytes_acked >= pcb->cwnd) {
+            pcb->bytes_acked -= pcb->cwnd;
+            if ((tcpwnd_size_t)(pcb->cwnd + pcb->mss) > pcb->cwnd) {
+              pcb->cwnd += pcb->mss;
+            }
           }
           LWIP_DEBUGF(TCP_CWND_DEBUG, ("tcp_receive: congestion avoidance cwnd %"TCPWNDSIZE_F"\n", pcb->cwnd));
         }
@@ -1519,7 +1540,11 @@ tcp_receive(struct tcp_pcb *pcb)
 
       } else {
         /* We get here if the incoming segment is out-of-sequence. */
+#if LWIP_TCP_SACK_OUT
+        pcb->rcv_sack_recent = seqno;
+#else
         tcp_send_empty_ack(pcb);
+#endif
 #if TCP_QUEUE_OOSEQ
         /* We queue the segment on the ->ooseq queue. */
         if (pcb->ooseq == NULL) {
@@ -1667,6 +1692,10 @@ tcp_receive(struct tcp_pcb *pcb)
         }
 #endif /* TCP_OOSEQ_MAX_BYTES || TCP_OOSEQ_MAX_PBUFS */
 #endif /* TCP_QUEUE_OOSEQ */
+#if LWIP_TCP_SACK_OUT
+        /* ACK once the segment is queued, so the SACK blocks cover it */
+        tcp_send_empty_ack(pcb);
+#endif
       }
     } else {
       /* The incoming segment is not within the window. */
@@ -1786,6 +1815,20 @@ tcp_parseopt(struct tcp_pcb *pcb)
         /* Advance to next option (6 bytes already read) */
         tcp_optidx += LWIP_TCP_OPT_LEN_TS - 6;
         break;
+#endif
+#if LWIP_TCP_SACK_OUT
+      case LWIP_TCP_OPT_SACK_PERM:
+        LWIP_DEBUGF(TCP_INPUT_DEBUG, ("tcp_parseopt: SACK_PERM\n"));
+        if (tcp_getoptbyte() != LWIP_TCP_OPT_LEN_SACK_PERM || (tcp_optidx - 2 + LWIP_TCP_OPT_LEN_SACK_PERM) > tcphdr_optlen) {
+          /* Bad length */
+          LWIP_DEBUGF(TCP_INPUT_DEBUG, ("tcp_parseopt: bad length\n"));
+          return;
+        }
+        /* Only a SYN (or SYN|ACK) agrees on sending SACK blocks */
+        if (flags & TCP_SYN) {
+          pcb->flags |= TF_SACK;
+        }
+        break;
 #endif
       default:
         LWIP_DEBUGF(TCP_INPUT_DEBUG, ("tcp_parseopt: other\n"));
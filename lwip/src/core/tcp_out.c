@@ -777,6 +777,12 @@ tcp_enqueue_flags(struct tcp_pcb *pcb, u8_t flags)
       optflags |= TF_SEG_OPTS_WND_SCALE;
     }
 #endif /* LWIP_WND_SCALE */
+#if LWIP_TCP_SACK_OUT
+    if ((pcb->state != SYN_RCVD) || (pcb->flags & TF_SACK)) {
+      /* Likewise, a <SYN,ACK> only permits SACK where the <SYN> did */
+      optflags |= TF_SEG_OPTS_SACK_PERM;
+    }
+#endif /* LWIP_TCP_SACK_OUT */
   }
 #if LWIP_TCP_TIMESTAMPS
   if ((pcb->flags & TF_TIMESTAMP)) {
@@ -873,6 +879,72 @@ tcp_build_wnd_scale_option(u32_t *opts)
 }
 #endif
 
+#if LWIP_TCP_SACK_OUT
+/** Find the SACK blocks of a connection: the ranges of sequence space its
+ * out-of-sequence queue holds, the one with the most recently received
+ * segment first and the rest in order (RFC 2018, section 4).
+ *
+ * @param pcb tcp_pcb with a non-empty ooseq queue
+ * @param blocks where to store the left and right edge of each block
+ * @param max most blocks to find
+ * @return the number of blocks found
+ */
+static u8_t
+tcp_get_sack_blocks(struct tcp_pcb *pcb, u32_t *blocks, u8_t max)
+{
+  struct tcp_seg *seg = pcb->ooseq;
+  u32_t left, right;
+  u8_t n = 1, i, recent = 0;
+
+  /* block 0 is kept for the most recent one */
+  while (seg != NULL) {
+    left = seg->tcphdr->seqno;
+    right = left + TCP_TCPLEN(seg);
+    for (seg = seg->next; seg != NULL && TCP_SEQ_LEQ(seg->tcphdr->seqno, right); seg = seg->next) {
+      if (TCP_SEQ_GT(seg->tcphdr->seqno + TCP_TCPLEN(seg), right)) {
+        right = seg->tcphdr->seqno + TCP_TCPLEN(seg);
+      }
+    }
+    if (!recent && TCP_SEQ_BETWEEN(pcb->rcv_sack_recent, left, right - 1)) {
+      i = 0;
+      recent = 1;
+    } else if (n < max) {
+      i = n++;
+    } else {
+      continue;
+    }
+    blocks[2 * i] = left;
+    blocks[2 * i + 1] = right;
+  }
+  if (!recent) {
+    /* the segment was dropped again: close up */
+    n--;
+    for (i = 0; i < 2 * n; i++) {
+      blocks[i] = blocks[i + 2];
+    }
+  }
+  return n;
+}
+
+/** Build a SACK option of the blocks given at the specified options pointer
+ *
+ * @param opts option pointer where to store the SACK option
+ * @param blocks left and right edge of each block
+ * @param n number of blocks
+ */
+static void
+tcp_build_sack_option(u32_t *opts, const u32_t *blocks, u8_t n)
+{
+  u8_t i;
+
+  /* Pad with two NOP options to make everything nicely aligned */
+  opts[0] = lwip_htonl(0x01010500 | (2 + 8 * n));
+  for (i = 0; i < 2 * n; i++) {
+    opts[i + 1] = lwip_htonl(blocks[i]);
+  }
+}
+#endif /* LWIP_TCP_SACK_OUT */
+
 /**
  * Send an ACK without data.
  *
@@ -885,15 +957,29 @@ tcp_send_empty_ack(struct tcp_pcb *pcb)
   struct pbuf *p;
   u8_t optlen = 0;
   struct netif *netif;
-#if LWIP_TCP_TIMESTAMPS || CHECKSUM_GEN_TCP
+#if LWIP_TCP_TIMESTAMPS || CHECKSUM_GEN_TCP || LWIP_TCP_SACK_OUT
   struct tcp_hdr *tcphdr;
-#endif /* LWIP_TCP_TIMESTAMPS || CHECKSUM_GEN_TCP */
+#endif /* LWIP_TCP_TIMESTAMPS || CHECKSUM_GEN_TCP || LWIP_TCP_SACK_OUT */
+#if LWIP_TCP_SACK_OUT
+  u32_t sack_blocks[2 * LWIP_TCP_MAX_SACK_NUM];
+  u8_t num_sacks = 0;
+#endif /* LWIP_TCP_SACK_OUT */
 
 #if LWIP_TCP_TIMESTAMPS
   if (pcb->flags & TF_TIMESTAMP) {
     optlen = LWIP_TCP_OPT_LENGTH(TF_SEG_OPTS_TS);
   }
 #endif
+#if LWIP_TCP_SACK_OUT
+  if ((pcb->flags & TF_SACK) && (pcb->ooseq != NULL)) {
+    /* 40 bytes of options at most, 4 of them the NOPs, kind and length */
+    num_sacks = tcp_get_sack_blocks(pcb, sack_blocks,
+      (u8_t)LWIP_MIN(LWIP_TCP_MAX_SACK_NUM, (40 - 4 - optlen) / 8));
+    if (num_sacks > 0) {
+      optlen += 4 + 8 * num_sacks;
+    }
+  }
+#endif /* LWIP_TCP_SACK_OUT */
 
   p = tcp_output_alloc_header(pcb, optlen, 0, lwip_htonl(pcb->snd_nxt));
   if (p == NULL) {
@@ -902,9 +988,9 @@ tcp_send_empty_ack(struct tcp_pcb *pcb)
     LWIP_DEBUGF(TCP_OUTPUT_DEBUG, ("tcp_output: (ACK) could not allocate pbuf\n"));
     return ERR_BUF;
   }
-#if LWIP_TCP_TIMESTAMPS || CHECKSUM_GEN_TCP
+#if LWIP_TCP_TIMESTAMPS || CHECKSUM_GEN_TCP || LWIP_TCP_SACK_OUT
   tcphdr = (struct tcp_hdr *)p->payload;
-#endif /* LWIP_TCP_TIMESTAMPS || CHECKSUM_GEN_TCP */
+#endif /* LWIP_TCP_TIMESTAMPS || CHECKSUM_GEN_TCP || LWIP_TCP_SACK_OUT */
   LWIP_DEBUGF(TCP_OUTPUT_DEBUG,
               ("tcp_output: sending ACK for %"U32_F"\n", pcb->rcv_nxt));
 
@@ -916,6 +1002,13 @@ tcp_send_empty_ack(struct tcp_pcb *pcb)
     tcp_build_timestamp_option(pcb, (u32_t *)(tcphdr + 1));
   }
 #endif
+#if LWIP_TCP_SACK_OUT
+  if (num_sacks > 0) {
+    /* after the timestamp option, if any */
+    tcp_build_sack_option((u32_t *)(void *)((u8_t *)(tcphdr + 1) + optlen - 4 - 8 * num_sacks),
+      sack_blocks, num_sacks);
+  }
+#endif
 
   netif = ip_route(&pcb->local_ip, &pcb->remote_ip);
   if (netif == NULL) {
@@ -1190,6 +1283,13 @@ tcp_output_segment(struct tcp_seg *seg, struct tcp_pcb *pcb, struct netif *netif
     opts += 1;
   }
 #endif
+#if LWIP_TCP_SACK_OUT
+  if (seg->flags & TF_SEG_OPTS_SACK_PERM) {
+    /* Pad with two NOP options to make everything nicely aligned */
+    *opts = PP_HTONL(0x01010402);
+    opts += 1;
+  }
+#endif
 
   /* Set retransmission timer running if it is not currently enabled
      This must be set before checking the route. */
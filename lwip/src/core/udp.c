@@ -80,6 +80,43 @@ static u16_t udp_port = UDP_LOCAL_PORT_RANGE_START;
 /* exported in udp.h (was static) */
 struct udp_pcb *udp_pcbs;
 
+#if UDP_PCB_HASH
+#if (UDP_HASH_SIZE & (UDP_HASH_SIZE - 1)) != 0
+  #error "UDP_HASH_SIZE must be a power of two, you have to change it in your lwipopts.h"
+#endif
+
+/** The PCBs on udp_pcbs with a local port, chained by the port's low bits.
+ * Every PCB a datagram can match is on its destination port's chain. */
+static struct udp_pcb *udp_hash[UDP_HASH_SIZE];
+
+#define UDP_HASH(port) ((port) & (UDP_HASH_SIZE - 1))
+
+/** Put a PCB that has just been bound on its port's chain */
+static void
+udp_hash_add(struct udp_pcb *pcb)
+{
+  struct udp_pcb **head = &udp_hash[UDP_HASH(pcb->local_port)];
+
+  pcb->hash_next = *head;
+  *head = pcb;
+}
+
+/** Take a PCB off its port's chain, if it is on it */
+static void
+udp_hash_remove(struct udp_pcb *pcb)
+{
+  struct udp_pcb **link = &udp_hash[UDP_HASH(pcb->local_port)];
+
+  for (; *link != NULL; link = &(*link)->hash_next) {
+    if (*link == pcb) {
+      *link = pcb->hash_next;
+      pcb->hash_next = NULL;
+      return;
+    }
+  }
+}
+#endif /* UDP_PCB_HASH */
+
 /**
  * Initialize this module.
  */
@@ -215,6 +252,9 @@ udp_input(struct pbuf *p, struct netif *inp)
   u16_t src, dest;
   u8_t broadcast;
   u8_t for_us = 0;
+#if UDP_PCB_HASH
+  struct udp_pcb **head;
+#endif /* UDP_PCB_HASH */
 
   LWIP_UNUSED_ARG(inp);
 
@@ -257,11 +297,23 @@ udp_input(struct pbuf *p, struct netif *inp)
   pcb = NULL;
   prev = NULL;
   uncon_pcb = NULL;
+#if UDP_PCB_HASH
+  /* Only the PCBs on the destination port's chain can match; port 0 is
+     never on a chain, so for that walk the whole list as before */
+  head = (dest != 0) ? &udp_hash[UDP_HASH(dest)] : &udp_pcbs;
+#define UDP_INPUT_NEXT(pcb) ((dest != 0) ? (pcb)->hash_next : (pcb)->next)
+#else /* UDP_PCB_HASH */
+#define UDP_INPUT_NEXT(pcb) ((pcb)->next)
+#endif /* UDP_PCB_HASH */
   /* Iterate through the UDP pcb list for a matching pcb.
    * 'Perfect match' pcbs (connected to the remote port & ip address) are
    * preferred. If no perfect match is found, the first unconnected pcb that
    * matches the local port and ip address gets the datagram. */
+#if UDP_PCB_HASH
+  for (pcb = *head; pcb != NULL; pcb = UDP_INPUT_NEXT(pcb)) {
+#else /* UDP_PCB_HASH */
   for (pcb = udp_pcbs; pcb != NULL; pcb = pcb->next) {
+#endif /* UDP_PCB_HASH */
     /* print the PCB local and remote address */
     LWIP_DEBUGF(UDP_DEBUG, ("pcb ("));
     ip_addr_debug_print(UDP_DEBUG, &pcb->local_ip);
@@ -289,11 +341,20 @@ udp_input(struct pbuf *p, struct netif *inp)
           ip_addr_cmp(&pcb->remote_ip, ip_current_src_addr()))) {
         /* the first fully matching PCB */
         if (prev != NULL) {
-          /* move the pcb to the front of udp_pcbs so that is
-             found faster next time */
-          prev->next = pcb->next;
-          pcb->next = udp_pcbs;
-          udp_pcbs = pcb;
+          /* move the pcb to the front of udp_pcbs (or its chain) so that
+             is found faster next time */
+#if UDP_PCB_HASH
+          if (dest != 0) {
+            prev->hash_next = pcb->hash_next;
+            pcb->hash_next = *head;
+            *head = pcb;
+          } else
+#endif /* UDP_PCB_HASH */
+          {
+            prev->next = pcb->next;
+            pcb->next = udp_pcbs;
+            udp_pcbs = pcb;
+          }
         } else {
           UDP_STATS_INC(udp.cachehit);
         }
@@ -303,6 +364,7 @@ udp_input(struct pbuf *p, struct netif *inp)
 
     prev = pcb;
   }
+#undef UDP_INPUT_NEXT
   /* no fully matching pcb found? then look for an unconnected pcb */
   if (pcb == NULL) {
     pcb = uncon_pcb;
@@ -399,7 +461,9 @@ udp_input(struct pbuf *p, struct netif *inp)
                   if (err == ERR_OK) {
                     /* move payload to UDP data */
                     pbuf_header(q, -hdrs_len);
+                    CYCLE_STATS_ENTER(CYCLES_APP);
                     mpcb->recv(mpcb->recv_arg, mpcb, q, ip_current_src_addr(), src);
+                    CYCLE_STATS_EXIT();
                   }
                 }
               }
@@ -415,7 +479,9 @@ udp_input(struct pbuf *p, struct netif *inp)
       /* callback */
       if (pcb->recv != NULL) {
         /* now the recv function is responsible for freeing p */
+        CYCLE_STATS_ENTER(CYCLES_APP);
         pcb->recv(pcb->recv_arg, pcb, p, ip_current_src_addr(), src);
+        CYCLE_STATS_EXIT();
       } else {
         /* no recv function registered? then we have to free the pbuf! */
         pbuf_free(p);
@@ -965,7 +1031,15 @@ udp_bind(struct udp_pcb *pcb, const ip_addr_t *ipaddr, u16_t port)
 
   ip_addr_set_ipaddr(&pcb->local_ip, ipaddr);
 
+#if UDP_PCB_HASH
+  if (rebind != 0) {
+    udp_hash_remove(pcb);
+  }
+#endif /* UDP_PCB_HASH */
   pcb->local_port = port;
+#if UDP_PCB_HASH
+  udp_hash_add(pcb);
+#endif /* UDP_PCB_HASH */
   mib2_udp_bind(pcb);
   /* pcb not active yet? */
   if (rebind == 0) {
@@ -1032,6 +1106,9 @@ udp_connect(struct udp_pcb *pcb, const ip_addr_t *ipaddr, u16_t port)
   /* PCB not yet on the list, add PCB now */
   pcb->next = udp_pcbs;
   udp_pcbs = pcb;
+#if UDP_PCB_HASH
+  udp_hash_add(pcb);
+#endif /* UDP_PCB_HASH */
   return ERR_OK;
 }
 
@@ -1092,6 +1169,9 @@ udp_remove(struct udp_pcb *pcb)
   struct udp_pcb *pcb2;
 
   mib2_udp_unbind(pcb);
+#if UDP_PCB_HASH
+  udp_hash_remove(pcb);
+#endif /* UDP_PCB_HASH */
   /* pcb to be removed is first in list? */
   if (udp_pcbs == pcb) {
     /* make list start at 2nd pcb */
@@ -226,6 +226,18 @@ void httpd_post_data_recved(void *connection, u16_t recved_len);
 
 #endif /* LWIP_HTTPD_SUPPORT_POST */
 
+#if LWIP_HTTPD_WEBSOCKET
+struct tcp_pcb;
+
+/** Called for a request asking for "Upgrade: websocket", with the URI
+ * and the header lines after the request line (neither kept once it
+ * returns). Return 1 to take the connection over: httpd forgets it,
+ * leaving its callbacks and closing to the application. Return 0 to
+ * answer the request as any other. */
+extern u8_t httpd_websocket_upgrade(struct tcp_pcb *pcb, const char *uri,
+                                    const char *hdrs, u16_t hdrs_len);
+#endif /* LWIP_HTTPD_WEBSOCKET */
+
 void httpd_init(void);
 
 
@@ -316,6 +316,12 @@
 #define HTTPD_USE_CUSTOM_FSDATA 0
 #endif
 
+/** Set this to 1 to offer requests with "Upgrade: websocket" to
+ * httpd_websocket_upgrade() (see httpd.h), which the application provides */
+#if !defined LWIP_HTTPD_WEBSOCKET || defined __DOXYGEN__
+#define LWIP_HTTPD_WEBSOCKET 0
+#endif
+
 /**
  * @}
  */
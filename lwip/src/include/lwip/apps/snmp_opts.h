@@ -290,4 +290,31 @@
 #define LWIP_SNMP_V3_MBEDTLS       LWIP_SNMP_V3
 #endif
 
+/**
+ * SNMP_V3_KEY_CACHE: number of localized keys snmpv3_password_to_key_md5()
+ * and snmpv3_password_to_key_sha() remember by password and engine ID, so
+ * that a snmpv3_get_user() which localizes its keys on every request only
+ * pays for the 1 MB hash once. 0 disables the cache.
+ */
+#ifndef SNMP_V3_KEY_CACHE
+#define SNMP_V3_KEY_CACHE          4
+#endif
+
+/**
+ * SNMP_V3_KEY_CACHE_PASSWORD: longest password the key cache keeps;
+ * longer ones are localized every time.
+ */
+#ifndef SNMP_V3_KEY_CACHE_PASSWORD
+#define SNMP_V3_KEY_CACHE_PASSWORD 32
+#endif
+
+/**
+ * SNMP_V3_HMAC_CACHE: number of authentication keys snmpv3_auth() keeps the
+ * HMAC inner and outer hash states of, keyed, so that a request only hashes
+ * its message and the inner digest. 0 disables the cache.
+ */
+#ifndef SNMP_V3_HMAC_CACHE
+#define SNMP_V3_HMAC_CACHE         4
+#endif
+
 #endif /* LWIP_HDR_SNMP_OPTS_H */
@@ -84,6 +84,23 @@
 #define TFTP_TIMER_MSECS      50
 #endif
 
+/**
+ * Largest block size granted to a client asking for more than 512 bytes
+ * (blksize option, RFC 2348). Keep blocks within one frame: fragments
+ * take up reassembly buffers.
+ */
+#if !defined TFTP_MAX_BLKSIZE || defined __DOXYGEN__
+#define TFTP_MAX_BLKSIZE      512
+#endif
+
+/**
+ * Most blocks a client may send before waiting for an ACK (windowsize
+ * option, RFC 7440). Applies to writes only.
+ */
+#if !defined TFTP_MAX_WINDOWSIZE || defined __DOXYGEN__
+#define TFTP_MAX_WINDOWSIZE   1
+#endif
+
 /**
  * Max. length of TFTP filename
  */
@@ -49,6 +49,18 @@
 extern "C" {
 #endif
 
+/** @ingroup tftp
+ * Bytes of data in a full TFTP block, unless the client negotiates another
+ * size (see tftp_blksize()). A shorter block ends a transfer.
+ */
+#define TFTP_MAX_PAYLOAD_SIZE 512
+
+/** @ingroup tftp
+ * Returned by tftp_context::write() when it has taken the data but the
+ * block is not to be acknowledged until tftp_write_done() is called.
+ */
+#define TFTP_WRITE_PENDING    1
+
 /** @ingroup tftp
  * TFTP context containing callback functions for TFTP transfers
  */
@@ -79,13 +91,17 @@ struct tftp_context {
    * @param handle File handle returned by open()
    * @param pbuf PBUF adjusted such that payload pointer points
    *             to the beginning of write data. In other words,
-   *             TFTP headers are stripped off.
-   * @returns &gt;= 0: Success; &lt; 0: Error
+   *             TFTP headers are stripped off. Take a reference
+   *             (pbuf_ref()) to keep it past the call.
+   * @returns 0: Success; TFTP_WRITE_PENDING: Success, acknowledge
+   *          later; &lt; 0: Error
    */
   int (*write)(void* handle, struct pbuf* p);
 };
 
 err_t tftp_init(const struct tftp_context* ctx);
+void tftp_write_done(int err);
+u16_t tftp_blksize(void);
 
 #ifdef __cplusplus
 }
@@ -111,6 +111,7 @@ void dhcp_set_struct(struct netif *netif, struct dhcp *dhcp);
 #define dhcp_remove_struct(netif) do { (netif)->dhcp = NULL; } while(0)
 void dhcp_cleanup(struct netif *netif);
 err_t dhcp_start(struct netif *netif);
+err_t dhcp_start_reboot(struct netif *netif, const ip4_addr_t *addr);
 err_t dhcp_renew(struct netif *netif);
 err_t dhcp_release(struct netif *netif);
 void dhcp_stop(struct netif *netif);
@@ -64,7 +64,9 @@ enum icmp_dur_type {
   /** fragmentation needed and DF set */
   ICMP_DUR_FRAG  = 4,
   /** source route failed */
-  ICMP_DUR_SR    = 5
+  ICMP_DUR_SR    = 5,
+  /** communication administratively prohibited (RFC 1812) */
+  ICMP_DUR_PROHIBITED = 13
 };
 
 /** ICMP time exceeded codes */
@@ -67,6 +67,16 @@ struct ip_reassdata {
   u8_t timer;
 };
 
+/** Fragments ip4_reass() dropped by policy rather than for lack of memory */
+struct ip_reass_drop_counts {
+  /** Fragments of datagrams to IP_REASS_REJECT_UDP ports */
+  u32_t rejected;
+  /** Fragments over IP_REASS_MAX_PBUFS_PER_SRC */
+  u32_t capped;
+};
+
+extern struct ip_reass_drop_counts ip_reass_drops;
+
 void ip_reass_init(void);
 void ip_reass_tmr(void);
 struct pbuf * ip4_reass(struct pbuf *p);
@@ -74,6 +74,11 @@ void *mem_malloc(mem_size_t size);
 void *mem_calloc(mem_size_t count, mem_size_t size);
 void  mem_free(void *mem);
 
+#if MEM_USE_POOLS && MEM_SIZE_TRACE
+u32_t mem_size_count(u16_t bucket);
+void  mem_size_reset(void);
+#endif /* MEM_USE_POOLS && MEM_SIZE_TRACE */
+
 #ifdef __cplusplus
 }
 #endif
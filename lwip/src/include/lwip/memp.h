@@ -146,6 +146,24 @@ void *memp_malloc(memp_t type);
 #endif
 void  memp_free(memp_t type, void *mem);
 
+#if MEMP_FAIL_TRACE
+/** A memp_malloc() that failed */
+struct memp_fail {
+  /** sys_now() when it failed */
+  u32_t time;
+  /** Caller of memp_malloc() */
+  void *caller;
+  /** For pbuf_alloc(), the caller of pbuf_alloc(); NULL otherwise */
+  void *origin;
+  /** The pool that was empty */
+  memp_t type;
+};
+
+u32_t memp_fail_count(void);
+const struct memp_fail *memp_fail_get(u32_t n);
+void memp_fail_origin(void *origin);
+#endif /* MEMP_FAIL_TRACE */
+
 #ifdef __cplusplus
 }
 #endif
@@ -269,6 +269,23 @@
 #define MEMP_OVERFLOW_CHECK             0
 #endif
 
+/**
+ * MEMP_FAIL_TRACE: number of failed memp_malloc() calls to remember, with
+ * the pool, the time (sys_now()) and the caller (see memp_fail_get()), so
+ * that pools can be sized from what actually ran out. 0 to disable.
+ */
+#if !defined MEMP_FAIL_TRACE || defined __DOXYGEN__
+#define MEMP_FAIL_TRACE                 0
+#endif
+
+/**
+ * MEMP_FAIL_TRACE_CALLER(): the return address of the function it is used
+ * in, for MEMP_FAIL_TRACE, e.g. __builtin_return_address(0) with GCC.
+ */
+#if !defined MEMP_FAIL_TRACE_CALLER || defined __DOXYGEN__
+#define MEMP_FAIL_TRACE_CALLER()        NULL
+#endif
+
 /**
  * MEMP_SANITY_CHECK==1: run a sanity check after each memp_free() to make
  * sure that there are no cycles in the linked lists.
@@ -295,6 +312,24 @@
 #define MEM_USE_POOLS_TRY_BIGGER_POOL   0
 #endif
 
+/**
+ * MEM_SIZE_TRACE: with MEM_USE_POOLS, the number of buckets to count
+ * mem_malloc() requests by size in, MEM_SIZE_TRACE_STEP bytes each and the
+ * last counting all bigger ones too (see mem_size_count()), so that the
+ * pools in lwippools.h can be sized from the requests made. 0 to disable.
+ */
+#if !defined MEM_SIZE_TRACE || defined __DOXYGEN__
+#define MEM_SIZE_TRACE                  0
+#endif
+
+/**
+ * MEM_SIZE_TRACE_STEP: width in bytes of a MEM_SIZE_TRACE bucket, a power
+ * of two.
+ */
+#if !defined MEM_SIZE_TRACE_STEP || defined __DOXYGEN__
+#define MEM_SIZE_TRACE_STEP             32
+#endif
+
 /**
  * MEMP_USE_CUSTOM_POOLS==1: whether to include a user file lwippools.h
  * that defines additional pools beyond the "standard" ones required
@@ -619,6 +654,23 @@
 #if !defined ETHARP_TABLE_MATCH_NETIF || defined __DOXYGEN__
 #define ETHARP_TABLE_MATCH_NETIF        0
 #endif
+
+/** ETHARP_TABLE_HASH==1: Index the ARP table by IP address in
+ * ETHARP_HASH_SIZE hash chains, so that looking up an address does not
+ * scan the whole table. etharp_output() to a destination other than the
+ * cached entry (see LWIP_NETIF_HWADDRHINT) and ARP packets from hosts not in
+ * the table then take a chain walk instead of ARP_TABLE_SIZE compares.
+ */
+#if !defined ETHARP_TABLE_HASH || defined __DOXYGEN__
+#define ETHARP_TABLE_HASH               0
+#endif
+
+/** ETHARP_HASH_SIZE: Number of hash chains of the ARP table index
+ * (ETHARP_TABLE_HASH), a power of two.
+ */
+#if !defined ETHARP_HASH_SIZE || defined __DOXYGEN__
+#define ETHARP_HASH_SIZE                16
+#endif
 /**
  * @}
  */
@@ -705,6 +757,30 @@
 #define IP_REASS_MAX_PBUFS              10
 #endif
 
+/**
+ * IP_REASS_MAX_PBUFS_PER_SRC: Maximum amount of pbufs waiting to be
+ * reassembled for datagrams from any one source address. Fragments over it
+ * are dropped (counted in ip_reass_drops.capped) rather than evicting other
+ * sources' datagrams, so that one host sending fragments cannot take all of
+ * IP_REASS_MAX_PBUFS.
+ */
+#if !defined IP_REASS_MAX_PBUFS_PER_SRC || defined __DOXYGEN__
+#define IP_REASS_MAX_PBUFS_PER_SRC      IP_REASS_MAX_PBUFS
+#endif
+
+/**
+ * IP_REASS_REJECT_UDP(port): Non-zero for UDP destination ports (in host
+ * byte order) whose datagrams must not be fragmented. The first fragment of
+ * such a datagram is answered with an ICMP destination unreachable
+ * (administratively prohibited) and dropped, together with any fragments of
+ * it already queued and those that follow, before reassembly buffers are
+ * allocated for it. Counted in ip_reass_drops.rejected. Undefined by
+ * default: all datagrams are reassembled.
+ */
+#ifdef __DOXYGEN__
+#define IP_REASS_REJECT_UDP(port)       0
+#endif
+
 /**
  * IP_DEFAULT_TTL: Default value for Time-To-Live used by transport layers.
  */
@@ -1098,6 +1174,23 @@
 #if !defined LWIP_NETBUF_RECVINFO || defined __DOXYGEN__
 #define LWIP_NETBUF_RECVINFO            0
 #endif
+
+/**
+ * UDP_PCB_HASH==1: Index bound UDP PCBs by local port in UDP_HASH_SIZE
+ * hash chains, so that udp_input() only looks at the PCBs on the
+ * datagram's port instead of walking every PCB.
+ */
+#if !defined UDP_PCB_HASH || defined __DOXYGEN__
+#define UDP_PCB_HASH                    0
+#endif
+
+/**
+ * UDP_HASH_SIZE: Number of hash chains of the UDP PCB index
+ * (UDP_PCB_HASH), a power of two.
+ */
+#if !defined UDP_HASH_SIZE || defined __DOXYGEN__
+#define UDP_HASH_SIZE                   16
+#endif
 /**
  * @}
  */
@@ -1313,6 +1406,64 @@
 #define LWIP_WND_SCALE                  0
 #define TCP_RCV_SCALE                   0
 #endif
+
+/**
+ * TCP_PCB_HASH==1: Index the active TCP PCBs by their local and remote port
+ * and remote address in TCP_HASH_SIZE hash chains, so that tcp_input()
+ * finds a segment's connection without walking every active PCB.
+ */
+#if !defined TCP_PCB_HASH || defined __DOXYGEN__
+#define TCP_PCB_HASH                    0
+#endif
+
+/**
+ * TCP_HASH_SIZE: Number of hash chains of the active PCB index
+ * (TCP_PCB_HASH), a power of two.
+ */
+#if !defined TCP_HASH_SIZE || defined __DOXYGEN__
+#define TCP_HASH_SIZE                   16
+#endif
+
+/**
+ * LWIP_TCP_SACK_OUT==1: Offer selective acknowledgment (RFC 2018) on
+ * connections and, where the remote host agrees, describe what the
+ * out-of-sequence queue holds in SACK blocks on every ACK sent without
+ * data.  The blocks are built from the queue when the ACK is sent, so
+ * connections keep no state for them beyond one sequence number.
+ * Requires TCP_QUEUE_OOSEQ.
+ */
+#if !defined LWIP_TCP_SACK_OUT || defined __DOXYGEN__
+#define LWIP_TCP_SACK_OUT               0
+#endif
+
+/**
+ * LWIP_TCP_MAX_SACK_NUM: The most SACK blocks sent in one ACK (1 to 4).
+ * The TCP option space takes 3 alongside the timestamp option.
+ */
+#if !defined LWIP_TCP_MAX_SACK_NUM || defined __DOXYGEN__
+#define LWIP_TCP_MAX_SACK_NUM           4
+#endif
+
+/**
+ * TCP_TW_MAX: The most PCBs kept in TIME-WAIT. A PCB entering TIME-WAIT
+ * beyond it has the oldest one aborted (counted in tcp_reaped.tw_capped),
+ * so that connections closed in quick succession cannot hold on to
+ * MEMP_NUM_TCP_PCB for 2 * TCP_MSL. 0 for no cap: the oldest then only
+ * goes when tcp_alloc() finds no free PCB (tcp_reaped.tw_reused).
+ */
+#if !defined TCP_TW_MAX || defined __DOXYGEN__
+#define TCP_TW_MAX                      0
+#endif
+
+/**
+ * LWIP_TCP_IDLE_TIMEOUT==1: Enable tcp_idle_timeout(), which resets a
+ * connection once nothing has arrived on it for a time (counted in
+ * tcp_reaped.idle). Set on a listening PCB, it holds for the connections
+ * it accepts.
+ */
+#if !defined LWIP_TCP_IDLE_TIMEOUT || defined __DOXYGEN__
+#define LWIP_TCP_IDLE_TIMEOUT           0
+#endif
 /**
  * @}
  */
@@ -2016,6 +2167,32 @@
 #define MIB2_STATS                      0
 
 #endif /* LWIP_STATS */
+
+/**
+ * LWIP_CYCLE_STATS==1: Count the time spent in each layer of the input
+ * path, in the application callbacks and in the driver's output, in
+ * lwip_cycle_stats (see stats.h).  Independent of LWIP_STATS.
+ */
+#if !defined LWIP_CYCLE_STATS || defined __DOXYGEN__
+#define LWIP_CYCLE_STATS                0
+#endif
+
+/**
+ * LWIP_CYCLE_STAMP(): with LWIP_CYCLE_STATS, a free-running u32_t count of
+ * a fast clock (CPU or timer cycles), wrapping at 32 bits.
+ */
+#if !defined LWIP_CYCLE_STAMP || defined __DOXYGEN__
+#define LWIP_CYCLE_STAMP()              0
+#endif
+
+/**
+ * LWIP_CYCLE_STATS_DEPTH: how deeply layers can nest (e.g. driver input,
+ * ethernet, IP, TCP, application, TCP output, driver output).  Deeper
+ * layers are charged to the one at this depth.
+ */
+#if !defined LWIP_CYCLE_STATS_DEPTH || defined __DOXYGEN__
+#define LWIP_CYCLE_STATS_DEPTH          8
+#endif
 /**
  * @}
  */
@@ -128,10 +128,10 @@ typedef enum {
 
 /** Memory pool descriptor */
 struct memp_desc {
-#if defined(LWIP_DEBUG) || MEMP_OVERFLOW_CHECK || LWIP_STATS_DISPLAY
+#if defined(LWIP_DEBUG) || MEMP_OVERFLOW_CHECK || LWIP_STATS_DISPLAY || MEMP_FAIL_TRACE
   /** Textual description */
   const char *desc;
-#endif /* LWIP_DEBUG || MEMP_OVERFLOW_CHECK || LWIP_STATS_DISPLAY */
+#endif /* LWIP_DEBUG || MEMP_OVERFLOW_CHECK || LWIP_STATS_DISPLAY || MEMP_FAIL_TRACE */
 #if MEMP_STATS
   /** Statistics */
   struct stats_mem *stats;
@@ -152,7 +152,7 @@ struct memp_desc {
 #endif /* MEMP_MEM_MALLOC */
 };
 
-#if defined(LWIP_DEBUG) || MEMP_OVERFLOW_CHECK || LWIP_STATS_DISPLAY
+#if defined(LWIP_DEBUG) || MEMP_OVERFLOW_CHECK || LWIP_STATS_DISPLAY || MEMP_FAIL_TRACE
 #define DECLARE_LWIP_MEMPOOL_DESC(desc) (desc),
 #else
 #define DECLARE_LWIP_MEMPOOL_DESC(desc)
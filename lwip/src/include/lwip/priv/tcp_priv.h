@@ -47,6 +47,7 @@
 #include "lwip/ip.h"
 #include "lwip/icmp.h"
 #include "lwip/err.h"
+#include "lwip/stats.h"
 #include "lwip/ip6.h"
 #include "lwip/ip6_addr.h"
 #include "lwip/prot/tcp.h"
@@ -179,22 +180,28 @@ err_t            tcp_process_refused_data(struct tcp_pcb *pcb);
 
 #define TCP_EVENT_ACCEPT(lpcb,pcb,arg,err,ret)                 \
   do {                                                         \
-    if((lpcb != NULL) && ((lpcb)->accept != NULL))             \
+    if((lpcb != NULL) && ((lpcb)->accept != NULL)) {           \
+      CYCLE_STATS_ENTER(CYCLES_APP);                           \
       (ret) = (lpcb)->accept((arg),(pcb),(err));               \
-    else (ret) = ERR_ARG;                                      \
+      CYCLE_STATS_EXIT();                                      \
+    } else (ret) = ERR_ARG;                                    \
   } while (0)
 
 #define TCP_EVENT_SENT(pcb,space,ret)                          \
   do {                                                         \
-    if((pcb)->sent != NULL)                                    \
+    if((pcb)->sent != NULL) {                                  \
+      CYCLE_STATS_ENTER(CYCLES_APP);                           \
       (ret) = (pcb)->sent((pcb)->callback_arg,(pcb),(space));  \
-    else (ret) = ERR_OK;                                       \
+      CYCLE_STATS_EXIT();                                      \
+    } else (ret) = ERR_OK;                                     \
   } while (0)
 
 #define TCP_EVENT_RECV(pcb,p,err,ret)                          \
   do {                                                         \
     if((pcb)->recv != NULL) {                                  \
+      CYCLE_STATS_ENTER(CYCLES_APP);                           \
       (ret) = (pcb)->recv((pcb)->callback_arg,(pcb),(p),(err));\
+      CYCLE_STATS_EXIT();                                      \
     } else {                                                   \
       (ret) = tcp_recv_null(NULL, (pcb), (p), (err));          \
     }                                                          \
@@ -203,7 +210,9 @@ err_t            tcp_process_refused_data(struct tcp_pcb *pcb);
 #define TCP_EVENT_CLOSED(pcb,ret)                                \
   do {                                                           \
     if(((pcb)->recv != NULL)) {                                  \
+      CYCLE_STATS_ENTER(CYCLES_APP);                             \
       (ret) = (pcb)->recv((pcb)->callback_arg,(pcb),NULL,ERR_OK);\
+      CYCLE_STATS_EXIT();                                        \
     } else {                                                     \
       (ret) = ERR_OK;                                            \
     }                                                            \
@@ -211,22 +220,29 @@ err_t            tcp_process_refused_data(struct tcp_pcb *pcb);
 
 #define TCP_EVENT_CONNECTED(pcb,err,ret)                         \
   do {                                                           \
-    if((pcb)->connected != NULL)                                 \
+    if((pcb)->connected != NULL) {                               \
+      CYCLE_STATS_ENTER(CYCLES_APP);                             \
       (ret) = (pcb)->connected((pcb)->callback_arg,(pcb),(err)); \
-    else (ret) = ERR_OK;                                         \
+      CYCLE_STATS_EXIT();                                        \
+    } else (ret) = ERR_OK;                                       \
   } while (0)
 
 #define TCP_EVENT_POLL(pcb,ret)                                \
   do {                                                         \
-    if((pcb)->poll != NULL)                                    \
+    if((pcb)->poll != NULL) {                                  \
+      CYCLE_STATS_ENTER(CYCLES_APP);                           \
       (ret) = (pcb)->poll((pcb)->callback_arg,(pcb));          \
-    else (ret) = ERR_OK;                                       \
+      CYCLE_STATS_EXIT();                                      \
+    } else (ret) = ERR_OK;                                     \
   } while (0)
 
 #define TCP_EVENT_ERR(errf,arg,err)                            \
   do {                                                         \
-    if((errf) != NULL)                                         \
+    if((errf) != NULL) {                                       \
+      CYCLE_STATS_ENTER(CYCLES_APP);                           \
       (errf)((arg),(err));                                     \
+      CYCLE_STATS_EXIT();                                      \
+    }                                                          \
   } while (0)
 
 #endif /* LWIP_EVENT_API */
@@ -261,6 +277,7 @@ struct tcp_seg {
 #define TF_SEG_DATA_CHECKSUMMED (u8_t)0x04U /* ALL data (not the header) is
                                                checksummed into 'chksum' */
 #define TF_SEG_OPTS_WND_SCALE   (u8_t)0x08U /* Include WND SCALE option */
+#define TF_SEG_OPTS_SACK_PERM   (u8_t)0x10U /* Include SACK Permitted option */
   struct tcp_hdr *tcphdr;  /* the TCP header */
 };
 
@@ -268,6 +285,8 @@ struct tcp_seg {
 #define LWIP_TCP_OPT_NOP        1
 #define LWIP_TCP_OPT_MSS        2
 #define LWIP_TCP_OPT_WS         3
+#define LWIP_TCP_OPT_SACK_PERM  4
+#define LWIP_TCP_OPT_SACK       5
 #define LWIP_TCP_OPT_TS         8
 
 #define LWIP_TCP_OPT_LEN_MSS    4
@@ -283,11 +302,18 @@ struct tcp_seg {
 #else
 #define LWIP_TCP_OPT_LEN_WS_OUT 0
 #endif
+#if LWIP_TCP_SACK_OUT
+#define LWIP_TCP_OPT_LEN_SACK_PERM     2
+#define LWIP_TCP_OPT_LEN_SACK_PERM_OUT 4 /* aligned for output (includes NOP padding) */
+#else
+#define LWIP_TCP_OPT_LEN_SACK_PERM_OUT 0
+#endif
 
 #define LWIP_TCP_OPT_LENGTH(flags) \
   (flags & TF_SEG_OPTS_MSS       ? LWIP_TCP_OPT_LEN_MSS    : 0) + \
   (flags & TF_SEG_OPTS_TS        ? LWIP_TCP_OPT_LEN_TS_OUT : 0) + \
-  (flags & TF_SEG_OPTS_WND_SCALE ? LWIP_TCP_OPT_LEN_WS_OUT : 0)
+  (flags & TF_SEG_OPTS_WND_SCALE ? LWIP_TCP_OPT_LEN_WS_OUT : 0) + \
+  (flags & TF_SEG_OPTS_SACK_PERM ? LWIP_TCP_OPT_LEN_SACK_PERM_OUT : 0)
 
 /** This returns a TCP header option for MSS in an u32_t */
 #define TCP_BUILD_MSS_OPTION(mss) lwip_htonl(0x02040000 | ((mss) & 0xFFFF))
@@ -399,15 +425,31 @@ extern struct tcp_pcb ** const tcp_pcb_lists[NUM_TCP_PCB_LISTS];
 
 #endif /* LWIP_DEBUG */
 
+#if TCP_PCB_HASH
+/* Active PCBs are also on a hash chain (TCP_PCB_HASH): their addresses and
+   ports must be set before they are registered */
+void tcp_hash_add(struct tcp_pcb *pcb);
+void tcp_hash_remove(struct tcp_pcb *pcb);
+struct tcp_pcb *tcp_hash_lookup(const ip_addr_t *local_ip, u16_t local_port,
+                                const ip_addr_t *remote_ip, u16_t remote_port);
+#define TCP_HASH_ADD(npcb) tcp_hash_add(npcb)
+#define TCP_HASH_REMOVE(npcb) tcp_hash_remove(npcb)
+#else /* TCP_PCB_HASH */
+#define TCP_HASH_ADD(npcb)
+#define TCP_HASH_REMOVE(npcb)
+#endif /* TCP_PCB_HASH */
+
 #define TCP_REG_ACTIVE(npcb)                       \
   do {                                             \
     TCP_REG(&tcp_active_pcbs, npcb);               \
+    TCP_HASH_ADD(npcb);                            \
     tcp_active_pcbs_changed = 1;                   \
   } while (0)
 
 #define TCP_RMV_ACTIVE(npcb)                       \
   do {                                             \
     TCP_RMV(&tcp_active_pcbs, npcb);               \
+    TCP_HASH_REMOVE(npcb);                         \
     tcp_active_pcbs_changed = 1;                   \
   } while (0)
 
@@ -420,6 +462,12 @@ extern struct tcp_pcb ** const tcp_pcb_lists[NUM_TCP_PCB_LISTS];
 
 /* Internal functions: */
 struct tcp_pcb *tcp_pcb_copy(struct tcp_pcb *pcb);
+#if TCP_TW_MAX
+void tcp_timewait_cap(void);
+#define TCP_TW_CAP() tcp_timewait_cap()
+#else /* TCP_TW_MAX */
+#define TCP_TW_CAP()
+#endif /* TCP_TW_MAX */
 void tcp_pcb_purge(struct tcp_pcb *pcb);
 void tcp_pcb_remove(struct tcp_pcb **pcblist, struct tcp_pcb *pcb);
 
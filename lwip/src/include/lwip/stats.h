@@ -468,6 +468,57 @@ void stats_init(void);
 #endif
 
 /* Display of statistics */
+#if LWIP_CYCLE_STATS
+/** Layers cycles are charged to (LWIP_CYCLE_STATS) */
+enum lwip_cycle_layer {
+  /** Outside the stack: the application's own work, timers and idle time */
+  CYCLES_OTHER,
+  /** The driver's input, until it hands a frame to netif->input */
+  CYCLES_NETIF_RX,
+  /** ethernet_input, etharp_input */
+  CYCLES_ETHERNET,
+  /** ip4_input */
+  CYCLES_IP,
+  /** udp_input */
+  CYCLES_UDP,
+  /** tcp_input */
+  CYCLES_TCP,
+  /** UDP recv and TCP recv, sent, accept, connected and poll callbacks */
+  CYCLES_APP,
+  /** The driver's linkoutput */
+  CYCLES_NETIF_TX,
+  CYCLES_NUM_LAYERS
+};
+
+/** Time spent in one layer, not counting the layers it called */
+struct stats_cycles_layer {
+  /** Times the layer was entered */
+  u32_t calls;
+  /** LWIP_CYCLE_STAMP() cycles spent in it, wrapping */
+  u32_t cycles;
+};
+
+struct stats_cycles {
+  struct stats_cycles_layer layer[CYCLES_NUM_LAYERS];
+};
+
+/** Global variable containing lwIP's per-layer cycle counts */
+extern struct stats_cycles lwip_cycle_stats;
+
+/** Start charging cycles to layer, until the matching stats_cycles_exit() */
+void stats_cycles_enter(u8_t layer);
+/** Go back to charging the layer that was current at stats_cycles_enter() */
+void stats_cycles_exit(void);
+/** Zero the counts */
+void stats_cycles_reset(void);
+
+#define CYCLE_STATS_ENTER(layer) stats_cycles_enter(layer)
+#define CYCLE_STATS_EXIT()       stats_cycles_exit()
+#else /* LWIP_CYCLE_STATS */
+#define CYCLE_STATS_ENTER(layer)
+#define CYCLE_STATS_EXIT()
+#endif /* LWIP_CYCLE_STATS */
+
 #if LWIP_STATS_DISPLAY
 void stats_display(void);
 void stats_display_proto(struct stats_proto *proto, const char *name);
@@ -145,7 +145,7 @@ typedef u32_t tcpwnd_size_t;
 typedef u16_t tcpwnd_size_t;
 #endif
 
-#if LWIP_WND_SCALE || TCP_LISTEN_BACKLOG
+#if LWIP_WND_SCALE || TCP_LISTEN_BACKLOG || LWIP_TCP_SACK_OUT
 typedef u16_t tcpflags_t;
 #else
 typedef u8_t tcpflags_t;
@@ -193,6 +193,11 @@ struct tcp_pcb_listen {
   u8_t backlog;
   u8_t accepts_pending;
 #endif /* TCP_LISTEN_BACKLOG */
+
+#if LWIP_TCP_IDLE_TIMEOUT
+  /* For the connections accepted, as tcp_pcb's */
+  u16_t idle_limit;
+#endif /* LWIP_TCP_IDLE_TIMEOUT */
 };
 
 
@@ -206,6 +211,11 @@ struct tcp_pcb {
   /* ports are in host byte order */
   u16_t remote_port;
 
+#if TCP_PCB_HASH
+  /* next active PCB on the same hash chain */
+  struct tcp_pcb *hash_next;
+#endif /* TCP_PCB_HASH */
+
   tcpflags_t flags;
 #define TF_ACK_DELAY   0x01U   /* Delayed ACK. */
 #define TF_ACK_NOW     0x02U   /* Immediate ACK. */
@@ -220,6 +230,9 @@ struct tcp_pcb {
 #endif
 #if TCP_LISTEN_BACKLOG
 #define TF_BACKLOGPEND 0x0200U /* If this is set, a connection pcb has increased the backlog on its listener */
+#endif
+#if LWIP_TCP_SACK_OUT
+#define TF_SACK        0x0400U /* Selective ACKs agreed with the remote host */
 #endif
 
   /* the rest of the fields are in host byte order
@@ -235,6 +248,9 @@ struct tcp_pcb {
   tcpwnd_size_t rcv_wnd;   /* receiver window available */
   tcpwnd_size_t rcv_ann_wnd; /* receiver window to announce */
   u32_t rcv_ann_right_edge; /* announced right edge of window */
+#if LWIP_TCP_SACK_OUT
+  u32_t rcv_sack_recent; /* seqno of the last out-of-sequence segment, whose SACK block goes first */
+#endif
 
   /* Retransmission timer. */
   s16_t rtime;
@@ -256,6 +272,8 @@ struct tcp_pcb {
   /* congestion avoidance/control variables */
   tcpwnd_size_t cwnd;
   tcpwnd_size_t ssthresh;
+  /* bytes acknowledged towards the next increase in congestion avoidance */
+  tcpwnd_size_t bytes_acked;
 
   /* sender variables */
   u32_t snd_nxt;   /* next new seqno to be sent */
@@ -320,6 +338,12 @@ struct tcp_pcb {
   /* KEEPALIVE counter */
   u8_t keep_cnt_sent;
 
+#if LWIP_TCP_IDLE_TIMEOUT
+  /* Slow timer ticks without input before the connection is reset, 0 for
+     no limit */
+  u16_t idle_limit;
+#endif /* LWIP_TCP_IDLE_TIMEOUT */
+
 #if LWIP_WND_SCALE
   u8_t snd_scale;
   u8_t rcv_scale;
@@ -403,6 +427,23 @@ err_t            tcp_write   (struct tcp_pcb *pcb, const void *dataptr, u16_t le
                               u8_t apiflags);
 
 void             tcp_setprio (struct tcp_pcb *pcb, u8_t prio);
+#if LWIP_TCP_IDLE_TIMEOUT
+void             tcp_idle_timeout(struct tcp_pcb *pcb, u32_t ms);
+#endif /* LWIP_TCP_IDLE_TIMEOUT */
+
+/** Connections the stack gave up on to get PCBs back */
+struct tcp_reap_counts {
+  /** TIME-WAIT PCBs aborted as tcp_alloc() had no free PCB */
+  u32_t tw_reused;
+  /** TIME-WAIT PCBs aborted for one over TCP_TW_MAX */
+  u32_t tw_capped;
+  /** Connections reset by tcp_idle_timeout() */
+  u32_t idle;
+  /** Connections reset as their keepalive probes went unanswered */
+  u32_t keepalive;
+};
+
+extern struct tcp_reap_counts tcp_reaped;
 
 #define TCP_PRIO_MIN    1
 #define TCP_PRIO_NORMAL 64
@@ -0,0 +1,208 @@
+/**
+ * @file
+ * Ethernet interface for the 10 GbE core behind the Wishbone bridge
+ */
+
+/*
+ * Copyright (c) 2001-2004 Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+ * SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+ * OF SUCH DAMAGE.
+ *
+ * This file is part of the lwIP TCP/IP stack.
+ *
+ */
+#ifndef LWIP_HDR_NETIF_ETHERNETIF_H
+#define LWIP_HDR_NETIF_ETHERNETIF_H
+
+#include "lwip/netif.h"
+#include "lwip/pbuf.h"
+#include "lwip/prot/ethernet.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Identifies a frame queued with ethernetif_tx_queue() */
+typedef u16_t ethernetif_tx_handle_t;
+
+/** Called once a queued frame has been sent */
+typedef void (*ethernetif_tx_fn)(struct netif *netif,
+                                 ethernetif_tx_handle_t handle,
+                                 err_t err, void *arg);
+
+/**
+ * TX classes, each with a queue of its own.  Control frames go out ahead
+ * of the others, which share the rest of the link by deficit round robin
+ * (ETH_TX_QUANTUM_*), so a register reply waits for one frame at most
+ * however much bulk data is queued.
+ */
+#define ETHERNETIF_TX_CONTROL   0
+#define ETHERNETIF_TX_TELEMETRY 1
+#define ETHERNETIF_TX_BULK      2
+#define ETHERNETIF_TX_CLASSES   3
+
+/**
+ * IP TOS bytes (DSCP CS2, "OAM", and AF11, "high-throughput data", of
+ * RFC 4594) that put a frame in the telemetry or the bulk class.  Set them
+ * in a PCB's tos, or with udpflow_set_tos(); any other TOS is control.
+ */
+#define ETHERNETIF_TOS_TELEMETRY 0x40
+#define ETHERNETIF_TOS_BULK      0x28
+
+/** Takes a received frame (including ETH_PAD_SIZE) of the raw EtherType */
+typedef void (*ethernetif_raw_fn)(struct netif *netif, struct pbuf *p);
+
+/** Number of RX classifier rules (see ethernetif_set_rx_rule()) */
+#ifndef ETHERNETIF_RX_RULES
+#define ETHERNETIF_RX_RULES 8
+#endif
+
+/** IPv4 multicast MAC addresses let through with LWIP_IGMP; more joined
+ * groups open the filter to all of them */
+#ifndef ETHERNETIF_MCAST_FILTERS
+#define ETHERNETIF_MCAST_FILTERS 8
+#endif
+
+/** Frames stamped on their way out at once (see ethernetif_tx_stamp()) */
+#ifndef ETHERNETIF_TX_STAMPS
+#define ETHERNETIF_TX_STAMPS 4
+#endif
+
+/** ethernetif_tx_stamps(): the frame has been handed to the core, and the
+ * core has finished sending it */
+#define ETHERNETIF_STAMP_SENT 0x01
+#define ETHERNETIF_STAMP_DONE 0x02
+
+/** What an RX classifier rule does with the frames it matches */
+enum ethernetif_rx_action {
+  /** Slot unused */
+  ETHERNETIF_RX_FREE = 0,
+  /** Pass to the stack (netif->input), skipping the raw EtherType */
+  ETHERNETIF_RX_STACK,
+  /** Pass to the rule's own handler */
+  ETHERNETIF_RX_HANDLER,
+  /** Drop while still in the core, before a pbuf is allocated */
+  ETHERNETIF_RX_DROP
+};
+
+/** Fields an RX classifier rule compares */
+#define ETHERNETIF_RX_MATCH_TYPE  0x01
+#define ETHERNETIF_RX_MATCH_DST   0x02
+/** Broadcast or multicast destination (group bit set) */
+#define ETHERNETIF_RX_MATCH_MCAST 0x04
+/** IPv4 with this protocol */
+#define ETHERNETIF_RX_MATCH_PROTO 0x08
+/** IPv4 UDP, unfragmented or the first fragment, to this port */
+#define ETHERNETIF_RX_MATCH_PORT  0x10
+
+/** A netif's frame and byte counts (see ethernetif_stats()) */
+struct ethernetif_stats {
+  u32_t tx_frames;
+  u32_t tx_bytes;
+  /** Frames lwIP gave up on with the TX queue full */
+  u32_t tx_drops;
+  u32_t rx_frames;
+  u32_t rx_bytes;
+  /** Frames dropped in the core: classifier and multicast filter drops,
+   * oversized frames and those that found no memory */
+  u32_t rx_drops;
+  /** ICMP echo requests answered in the driver, and those over the
+   * per-source rate limit (ETH_ICMP_FAST) */
+  u32_t icmp_fast;
+  u32_t icmp_limited;
+};
+
+/** How a core's interrupt-driven RX is running (see ethernetif_rx_irq()) */
+struct ethernetif_rx_irq {
+  /** Non-zero while the main loop polls the core, its interrupt masked */
+  u8_t polling;
+  /** How long the interrupt stays masked after the core empties, in ms */
+  u8_t coalesce_ms;
+  /** Interrupts taken, and switches from them to polling */
+  u32_t interrupts;
+  u32_t polls;
+  /** Passes that took a full ETH_RX_BUDGET of frames */
+  u32_t full_passes;
+};
+
+/** An RX classifier rule (see ethernetif_set_rx_rule()) */
+struct ethernetif_rx_rule {
+  /** ETHERNETIF_RX_MATCH_* fields that must all match; 0 matches any frame */
+  u8_t match;
+  /** enum ethernetif_rx_action */
+  u8_t action;
+  /** EtherType and UDP destination port, in host order */
+  u16_t type;
+  u16_t port;
+  u8_t proto;
+  struct eth_addr dst;
+  /** Handler of ETHERNETIF_RX_HANDLER, which takes ownership of the frame */
+  ethernetif_raw_fn fn;
+  /** Non-zero to record matched frames in the frame trace (ftrace.h) */
+  u8_t trace;
+  /** Frames matched since the rule was set */
+  u32_t hits;
+};
+
+err_t ethernetif_init(struct netif *netif);
+void *ethernetif_core(u8_t n);
+int ethernetif_poll(struct netif *netif);
+int ethernetif_is(struct netif *netif);
+int ethernetif_polled(struct netif *netif);
+u8_t ethernetif_core_num(struct netif *netif);
+u32_t ethernetif_base(struct netif *netif);
+void ethernetif_stats(struct netif *netif, struct ethernetif_stats *stats);
+u32_t ethernetif_rx_stamp(struct netif *netif);
+u32_t ethernetif_tx_stamp(struct netif *netif, struct pbuf *p);
+int ethernetif_tx_stamps(struct netif *netif, u32_t handle,
+                         u32_t *sent, u32_t *done);
+
+err_t ethernetif_tx_queue(struct netif *netif, struct pbuf *p,
+                          ethernetif_tx_fn done, void *arg,
+                          ethernetif_tx_handle_t *handle);
+int ethernetif_tx_pending(struct netif *netif);
+void ethernetif_tx_poll(struct netif *netif);
+int ethernetif_tx_done(struct netif *netif, ethernetif_tx_handle_t handle);
+
+u16_t ethernetif_rx_room(struct pbuf *p);
+void ethernetif_set_raw_input(struct netif *netif, u16_t type,
+                              ethernetif_raw_fn fn);
+err_t ethernetif_set_rx_rule(struct netif *netif, u8_t n,
+                             const struct ethernetif_rx_rule *rule);
+const struct ethernetif_rx_rule *ethernetif_rx_rule(struct netif *netif, u8_t n);
+void ethernetif_rx_nomem(struct netif *netif, u32_t *holds, u32_t *drops);
+const struct ethernetif_rx_irq *ethernetif_rx_irq(struct netif *netif);
+err_t ethernetif_set_rx_coalesce(struct netif *netif, u8_t ms);
+#if LWIP_IGMP
+u32_t ethernetif_mcast_drops(struct netif *netif);
+#endif /* LWIP_IGMP */
+
+u16_t ethernetif_csum_caps(struct netif *netif);
+err_t ethernetif_set_csum_offload(struct netif *netif, u16_t flags);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LWIP_HDR_NETIF_ETHERNETIF_H */
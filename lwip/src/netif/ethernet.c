@@ -173,7 +173,9 @@ ethernet_input(struct pbuf *p, struct netif *netif)
         goto free_and_return;
       } else {
         /* pass to IP layer */
+        CYCLE_STATS_ENTER(CYCLES_IP);
         ip4_input(p, netif);
+        CYCLE_STATS_EXIT();
       }
       break;
 
@@ -1,6 +1,6 @@
 /**
  * @file
- * Ethernet Interface Skeleton
+ * Ethernet interface for the 10 GbE core behind the Wishbone bridge
  *
  */
 
@@ -37,42 +37,416 @@
  */
 
 /*
- * This file is a skeleton for developing Ethernet network interface
- * drivers for lwIP. Add code to the low_level functions and do a
- * search-and-replace for the word "ethernetif" to replace it with
- * something that better describes your network interface.
+ * This driver moves frames between lwIP and the CPU TX/RX buffers of the
+ * 10 GbE cores (see eth.h for the register map), one netif per core:
+ * eth0 by default, the others found in the register map by
+ * ethernetif_core().  Each core has its own TX queue, RX classifier,
+ * multicast filter and counters; the driver RX buffers are shared.  If a
+ * core's interrupt is routed to the INTC (ETH0_INTR_ID, ...), the
+ * interrupt handler masks the line and schedules deferred work that runs
+ * ethernetif_poll() from the main loop.  Otherwise the main loop calls
+ * ethernetif_poll() directly.
+ *
+ * Each ethernetif_poll() takes at most ETH_RX_BUDGET frames, so a flood
+ * cannot keep the main loop from its other work.  A pass that takes a
+ * full budget leaves the interrupt masked and the core to the main loop's
+ * polling (ethernetif_polled()), one budget a pass, so that at high frame
+ * rates the CPU takes no interrupts at all; the first pass that empties
+ * the core unmasks it again, so that an idle link costs nothing and the
+ * next frame is taken as soon as it comes.  Optionally the interrupt stays
+ * masked for a few milliseconds more (ethernetif_set_rx_coalesce()), which
+ * gathers the frames of a burst into one interrupt at that cost in latency.
  */
 
 #include "lwip/opt.h"
 
-#if 0 /* don't build, this is only a skeleton, see previous comment */
-
 #include "lwip/def.h"
 #include "lwip/mem.h"
+#include "lwip/memp.h"
 #include "lwip/pbuf.h"
 #include "lwip/stats.h"
 #include "lwip/snmp.h"
-#include "lwip/ethip6.h"
+#include "lwip/sys.h"
 #include "lwip/etharp.h"
-#include "netif/ppp/pppoe.h"
+#include "lwip/igmp.h"
+#include "lwip/inet_chksum.h"
+#include "lwip/prot/icmp.h"
+#include "lwip/prot/ip.h"
+#include "lwip/prot/ip4.h"
+#include "netif/ethernetif.h"
+
+#include "eth.h"
+#include "gwrev.h"
+#include "ftrace.h"
+#include "intr.h"
+#include "perf.h"
+#include "sections.h"
+#include "timebase.h"
+#include "timer.h"
+#include "wbmap.h"
+#include "work.h"
+
+#include <string.h>
 
 /* Define those to better describe your network interface. */
 #define IFNAME0 'e'
-#define IFNAME1 'n'
+#define IFNAME1 't'
+
+/** Shortest frame (without FCS) the core is asked to send */
+#define ETH_MIN_FRAME 64
+
+/** Number of polls of the TX level before giving up on a full TX queue */
+#define ETH_TX_TIMEOUT 10000
+
+/** Frames each TX class can queue for transmission (one fewer than this) */
+#ifndef ETH_TX_QUEUE_LEN
+#define ETH_TX_QUEUE_LEN 8
+#endif
+
+/**
+ * Bytes the telemetry and bulk classes may send per turn of the deficit
+ * round robin while both have frames waiting, so the ratio of the two is
+ * the ratio of their shares of the link.  At least a full frame each, so
+ * that every turn sends something.
+ */
+#ifndef ETH_TX_QUANTUM_TELEMETRY
+#define ETH_TX_QUANTUM_TELEMETRY ETH_MAC_MAX_FRAME
+#endif
+#ifndef ETH_TX_QUANTUM_BULK
+#define ETH_TX_QUANTUM_BULK ETH_MAC_MAX_FRAME
+#endif
+
+#if ETH_TX_QUANTUM_TELEMETRY < ETH_MAC_MAX_FRAME || ETH_TX_QUANTUM_BULK < ETH_MAC_MAX_FRAME
+#error "ETH_TX_QUANTUM_* must be at least ETH_MAC_MAX_FRAME"
+#endif
+
+/** A handle's class and its sequence number within the class */
+#define TX_SEQ_BITS 14
+#define TX_HANDLE(c, seq) \
+  ((ethernetif_tx_handle_t)(((c) << TX_SEQ_BITS) | ((seq) & ((1 << TX_SEQ_BITS) - 1))))
+
+/**
+ * Number of driver-owned RX frame buffers handed to the stack as custom
+ * pbufs (0 to receive into PBUF_POOL only).  Fewer for jumbo frames,
+ * which make each buffer six times the size.  Short frames mostly take
+ * the small RX buffers below, which took the place of a fourth.
+ */
+#ifndef ETH_RX_BUFS
+#if ETH_MTU > 1500
+#define ETH_RX_BUFS 2
+#else
+#define ETH_RX_BUFS 3
+#endif
+#endif
+
+/**
+ * Number of small RX buffers, of ETH_RX_SMALL_SIZE bytes, that short frames
+ * take ahead of the others (0 for none).  They come from the ETH_RX_SMALL
+ * memp pool, which lwippools.h declares.
+ */
+#ifndef ETH_RX_SMALL_BUFS
+#define ETH_RX_SMALL_BUFS 0
+#endif
+
+/**
+ * Most frames one ethernetif_poll() takes from the core.  Enough for a
+ * burst to fill every RX buffer in one pass.
+ */
+#ifndef ETH_RX_BUDGET
+#define ETH_RX_BUDGET (ETH_RX_BUFS + ETH_RX_SMALL_BUFS + 2)
+#endif
+
+/**
+ * Milliseconds the interrupt stays masked after a pass empties the core,
+ * to start with (see ethernetif_set_rx_coalesce()); 0 to unmask at once
+ */
+#ifndef ETH_RX_COALESCE_MS
+#define ETH_RX_COALESCE_MS 0
+#endif
+
+/**
+ * How long a received frame may wait in the core for a pbuf before it is
+ * dropped (see low_level_input())
+ */
+#ifndef ETH_RX_HOLD_MS
+#define ETH_RX_HOLD_MS 20
+#endif
+
+/**
+ * Words of the frame the RX classifier reads from the core: up to the
+ * EtherType, or to the UDP destination port of an IP header without
+ * options
+ */
+#define RX_PEEK_ETH 4
+#define RX_PEEK_IP  10
+
+/** Byte i of the frame among the words peeked from the core */
+#define RX_PEEK_BYTE(w, i) ((u8_t)((w)[(i) >> 2] >> (24 - 8 * ((i) & 3))))
+
+/**
+ * NETIF_CHECKSUM_* flags for the checksums the eth0 gateware generates or
+ * verifies itself.  The current core does none, so everything is computed
+ * in software.  A CHECK flag means the gateware drops frames with a bad
+ * checksum before they reach the RX buffer.
+ */
+#ifndef ETH0_CSUM_CAPS
+#define ETH0_CSUM_CAPS 0
+#endif
+
+/**
+ * Answer ICMP echo requests to the interface's address in the driver, in
+ * place, ahead of the stack (see rx_icmp_echo()).  Each source gets
+ * ETH_ICMP_FAST_BURST replies a ETH_ICMP_FAST_WINDOW_MS window; the rest
+ * are dropped.  ETH_ICMP_FAST_SOURCES sources are tracked at once, the
+ * stalest making room for a new one.
+ */
+#ifndef ETH_ICMP_FAST
+#define ETH_ICMP_FAST LWIP_ICMP
+#endif
+#ifndef ETH_ICMP_FAST_SOURCES
+#define ETH_ICMP_FAST_SOURCES 8
+#endif
+#ifndef ETH_ICMP_FAST_WINDOW_MS
+#define ETH_ICMP_FAST_WINDOW_MS 1000
+#endif
+#ifndef ETH_ICMP_FAST_BURST
+#define ETH_ICMP_FAST_BURST 100
+#endif
+
+/** Default MAC address if the core's MAC registers have not been set */
+#define ETH_DEFAULT_MAC {0x02, 0x02, 0x0a, 0x0a, 0x0a, 0x0a}
+
+/** A frame waiting in (or, at the tail, being sent from) a TX queue */
+struct ethernetif_tx_slot {
+  struct pbuf *p;
+  ethernetif_tx_fn done;
+  void *arg;
+};
+
+/** A frame to timestamp on its way out (see ethernetif_tx_stamp()) */
+struct ethernetif_tx_stamp {
+  /** The pbuf asked for (part of the frame), then the frame handed over */
+  struct pbuf *p;
+  u32_t handle;
+  /** timebase_stamp() as the frame went to the core, and as it was sent */
+  u32_t sent;
+  u32_t done;
+  /** 0 until sent, else ETHERNETIF_STAMP_* */
+  u8_t state;
+};
+
+/**
+ * The TX queue of one class (ETHERNETIF_TX_*).  The core sends one frame
+ * at a time, and each time it finishes one the next comes from the control
+ * queue if it has any, so a control frame never waits behind more than the
+ * frame already in flight.  Telemetry and bulk frames share what is left
+ * by deficit round robin: the class whose turn it is sends while its
+ * deficit covers the frame at its tail, and the other class's turn adds
+ * its quantum to its own deficit.
+ */
+struct ethernetif_tx_ring {
+  struct ethernetif_tx_slot slot[ETH_TX_QUEUE_LEN];
+  u8_t head;
+  u8_t tail;
+  /** Sequence number of slot[tail] (see TX_HANDLE()) */
+  u16_t seq;
+  /** Bytes the class may still send this turn */
+  u16_t deficit;
+};
+
+#if ETH_RX_BUFS
+/**
+ * A received frame.  The bridge presents the core's RX buffer as big-endian
+ * words behind uncached Wishbone reads, so the stack cannot parse it in
+ * place; each frame is burst-copied once into one of these and the buffer
+ * goes back on the free list when the stack frees the pbuf.
+ */
+struct ethernetif_rx_buf {
+  struct pbuf_custom pc;
+  struct ethernetif_rx_buf *next;
+  u32_t data[(ETH_PAD_SIZE + ETH_MAC_MAX_FRAME + 3) / 4];
+};
+
+static struct ethernetif_rx_buf rx_bufs[ETH_RX_BUFS] PKTBUF_SECTION;
+static struct ethernetif_rx_buf *rx_free;
+static u8_t rx_bufs_ready;
+#endif /* ETH_RX_BUFS */
+
+#if ETH_RX_SMALL_BUFS
+/**
+ * A received frame of up to ETH_RX_SMALL_SIZE bytes, from the ETH_RX_SMALL
+ * pool (lwippools.h), whose element size is this struct's
+ */
+struct ethernetif_rx_small {
+  struct pbuf_custom pc;
+  u32_t data[(ETH_PAD_SIZE + ETH_RX_SMALL_SIZE + 3) / 4];
+};
+#endif /* ETH_RX_SMALL_BUFS */
 
 /**
  * Helper struct to hold private data used to operate your ethernet interface.
- * Keeping the ethernet address of the MAC in this struct is not necessary
- * as it is already kept in the struct netif.
- * But this is only an example, anyway...
  */
 struct ethernetif {
-  struct eth_addr *ethaddr;
-  /* Add whatever per-interface state that is needed here. */
+  /** Base address of the core in the CPU address space */
+  u32_t base;
+  /** INTC input of the core's interrupt, or -1 if polled */
+  s16_t intr_id;
+  /** NETIF_CHECKSUM_* flags the gateware can take over */
+  u16_t csum_caps;
+  /** NETIF_CHECKSUM_* flags currently left to the gateware */
+  u16_t csum_offload;
+  /** Deferred part of the interrupt handler */
+  struct work intr_work;
+  /** Interrupt or polling, and the counts of each */
+  struct ethernetif_rx_irq rx_irq;
+  /** Unmasks the interrupt once rx_irq.coalesce_ms have passed */
+  struct timer rx_coalesce;
+  /** TX queues by class; each sends its frames in order from its tail */
+  struct ethernetif_tx_ring txq[ETHERNETIF_TX_CLASSES];
+  /** 1 + the class whose tail has been handed to the core, 0 if idle */
+  u8_t tx_busy;
+  /** Class whose turn it is in the deficit round robin */
+  u8_t tx_turn;
+  /** Handler of frames of EtherType raw_type (network order), or NULL */
+  ethernetif_raw_fn raw_input;
+  u16_t raw_type;
+  /** A frame is waiting in the core for memory, since sys_now() rx_hold_since */
+  u8_t rx_holding;
+  u32_t rx_hold_since;
+  /** Classifier rule the waiting frame matched */
+  struct ethernetif_rx_rule *rx_held_rule;
+  /** Frames that had to wait for memory, and those dropped after waiting */
+  u32_t rx_holds;
+  u32_t rx_nomem_drops;
+  /** Frame and byte counts (see ethernetif_stats()) */
+  struct ethernetif_stats stats;
+  /** timebase_stamp() as the frame being input was found in the core */
+  u32_t rx_stamp;
+  /** Frames to stamp on their way out, slot handle % ETHERNETIF_TX_STAMPS;
+   * how many of them are not yet done, and the next handle */
+  struct ethernetif_tx_stamp tx_stamps[ETHERNETIF_TX_STAMPS];
+  u8_t tx_stamps_waiting;
+  u32_t tx_stamp_next;
+  /** Words the classifier peeks at, 0 if no rule is set */
+  u8_t rx_peek;
+  /** RX classifier, tried in order */
+  struct ethernetif_rx_rule rx_rules[ETHERNETIF_RX_RULES];
+#if LWIP_IGMP
+  /** IPv4 multicast MAC filter: the low 23 bits of the groups let through,
+   * and how many joined groups share each (0 for a free slot) */
+  u32_t mcast[ETHERNETIF_MCAST_FILTERS];
+  u8_t mcast_refs[ETHERNETIF_MCAST_FILTERS];
+  /** Groups joined with the filter full: all IPv4 multicast goes through */
+  u8_t mcast_overflow;
+  /** Frames to groups nothing joined, dropped in the core */
+  u32_t mcast_drops;
+#endif /* LWIP_IGMP */
 };
 
-/* Forward declarations. */
-static void  ethernetif_input(struct netif *netif);
+/** INTC inputs of the cores' interrupts, -1 for those polled */
+static const s16_t eth_intr_ids[ETH_MAX_CORES] = {
+#ifdef ETH0_INTR_ID
+  ETH0_INTR_ID,
+#else
+  -1,
+#endif
+#ifdef ETH1_INTR_ID
+  ETH1_INTR_ID,
+#else
+  -1,
+#endif
+#ifdef ETH2_INTR_ID
+  ETH2_INTR_ID,
+#else
+  -1,
+#endif
+#ifdef ETH3_INTR_ID
+  ETH3_INTR_ID,
+#else
+  -1,
+#endif
+};
+
+/** eth0 is always there; the others are filled in by ethernetif_core() */
+static struct ethernetif eth_states[ETH_MAX_CORES] = {
+#ifdef ETH0_INTR_ID
+  { ETH0_BASE_ADDRESS, ETH0_INTR_ID, ETH0_CSUM_CAPS },
+#else
+  { ETH0_BASE_ADDRESS, -1, ETH0_CSUM_CAPS },
+#endif
+};
+
+#if FTRACE_ENABLE
+/** Frames of eth0, the first core, go in the trace (ftrace.h): all of
+ * them in FTRACE_ALL mode, and in FTRACE_RULES mode received ones that
+ * matched a rule with trace set */
+#define ALL_TRACED(ethernetif) \
+  ((ethernetif) == &eth_states[0] && ftrace_mode == FTRACE_ALL)
+#define RX_TRACED(ethernetif, rule) \
+  (ALL_TRACED(ethernetif) || ((ethernetif) == &eth_states[0] && \
+   ftrace_mode == FTRACE_RULES && (rule) != NULL && (rule)->trace))
+#endif /* FTRACE_ENABLE */
+
+#if ETH_RX_BUFS
+/** custom_free_function of RX buffers: put the buffer back on the free list */
+static void
+rx_buf_free(struct pbuf *p)
+{
+  struct ethernetif_rx_buf *rb = (struct ethernetif_rx_buf *)p;
+
+  rb->next = rx_free;
+  rx_free = rb;
+}
+
+/**
+ * Take a free RX buffer and wrap it in a PBUF_REF custom pbuf of len bytes.
+ *
+ * @return the pbuf, or NULL if every RX buffer is held by the stack
+ */
+static struct pbuf *
+rx_buf_alloc(u16_t len)
+{
+  struct ethernetif_rx_buf *rb = rx_free;
+
+  if (rb == NULL) {
+    return NULL;
+  }
+  rx_free = rb->next;
+  rb->pc.custom_free_function = rx_buf_free;
+
+  return pbuf_alloced_custom(PBUF_RAW, len, PBUF_REF, &rb->pc,
+                             rb->data, sizeof(rb->data));
+}
+#endif /* ETH_RX_BUFS */
+
+#if ETH_RX_SMALL_BUFS
+/** custom_free_function of small RX buffers: back to their pool */
+static void
+rx_small_free(struct pbuf *p)
+{
+  memp_free(MEMP_ETH_RX_SMALL, p);
+}
+
+/**
+ * Take a small RX buffer and wrap it in a PBUF_REF custom pbuf of len bytes.
+ *
+ * @return the pbuf, or NULL if the pool is empty
+ */
+static struct pbuf *
+rx_small_alloc(u16_t len)
+{
+  struct ethernetif_rx_small *rs;
+
+  rs = (struct ethernetif_rx_small *)memp_malloc(MEMP_ETH_RX_SMALL);
+  if (rs == NULL) {
+    return NULL;
+  }
+  rs->pc.custom_free_function = rx_small_free;
+
+  return pbuf_alloced_custom(PBUF_RAW, len, PBUF_REF, &rs->pc,
+                             rs->data, sizeof(rs->data));
+}
+#endif /* ETH_RX_SMALL_BUFS */
 
 /**
  * In this function, the hardware should be initialized.
@@ -85,36 +459,788 @@ static void
 low_level_init(struct netif *netif)
 {
   struct ethernetif *ethernetif = netif->state;
+  static const u8_t default_mac[ETHARP_HWADDR_LEN] = ETH_DEFAULT_MAC;
+  u32_t mac_hi, mac_lo;
+  int i;
 
   /* set MAC hardware address length */
   netif->hwaddr_len = ETHARP_HWADDR_LEN;
 
-  /* set MAC hardware address */
-  netif->hwaddr[0] = ;
-  ...
-  netif->hwaddr[5] = ;
+  /* use the MAC address the core was configured with, if any */
+  mac_hi = Xil_In32(ethernetif->base + ETH_MAC_REG_SRC_MAC_HI);
+  mac_lo = Xil_In32(ethernetif->base + ETH_MAC_REG_SRC_MAC_LO);
+  if ((mac_hi & 0xffff) | mac_lo) {
+    netif->hwaddr[0] = (u8_t)(mac_hi >> 8);
+    netif->hwaddr[1] = (u8_t)(mac_hi);
+    netif->hwaddr[2] = (u8_t)(mac_lo >> 24);
+    netif->hwaddr[3] = (u8_t)(mac_lo >> 16);
+    netif->hwaddr[4] = (u8_t)(mac_lo >> 8);
+    netif->hwaddr[5] = (u8_t)(mac_lo);
+  } else {
+    for (i = 0; i < ETHARP_HWADDR_LEN; i++) {
+      netif->hwaddr[i] = default_mac[i];
+    }
+    /* keep the cores' defaults apart */
+    netif->hwaddr[5] += (u8_t)(ethernetif - eth_states);
+  }
 
   /* maximum transfer unit */
-  netif->mtu = 1500;
+  netif->mtu = ETH_MTU;
 
   /* device capabilities */
-  /* don't set NETIF_FLAG_ETHARP if this device is not an ethernet one */
   netif->flags = NETIF_FLAG_BROADCAST | NETIF_FLAG_ETHARP | NETIF_FLAG_LINK_UP;
+#if LWIP_IGMP
+  /* the core passes every multicast frame; ethernetif_mac_filter() keeps
+   * only the joined groups' */
+  netif->flags |= NETIF_FLAG_IGMP;
+#endif /* LWIP_IGMP */
 
-#if LWIP_IPV6 && LWIP_IPV6_MLD
-  /*
-   * For hardware/netifs that implement MAC filtering.
-   * All-nodes link-local is handled by default, so we must let the hardware know
-   * to allow multicast packets in.
-   * Should set mld_mac_filter previously. */
-  if (netif->mld_mac_filter != NULL) {
-    ip6_addr_t ip6_allnodes_ll;
-    ip6_addr_set_allnodes_linklocal(&ip6_allnodes_ll);
-    netif->mld_mac_filter(netif, &ip6_allnodes_ll, NETIF_ADD_MAC_FILTER);
+#if ETH_RX_BUFS
+  if (!rx_bufs_ready) {
+    for (i = 0; i < ETH_RX_BUFS; i++) {
+      rx_buf_free(&rx_bufs[i].pc.pbuf);
+    }
+    rx_bufs_ready = 1;
   }
-#endif /* LWIP_IPV6 && LWIP_IPV6_MLD */
+#endif
+
+  /* the round robin starts with the first class after control */
+  ethernetif->tx_turn = ETHERNETIF_TX_CONTROL + 1;
+
+  /* give any stale frame in the RX buffer back to the core */
+  eth_set_rx_level(ethernetif->base, 0);
+}
+
+/**
+ * Stamp frame p going to the core if any of its pbufs was asked for with
+ * ethernetif_tx_stamp().  The slot then holds the frame itself, the pbuf
+ * tx_stamp_done() will see.
+ */
+static void
+tx_stamp_sent(struct ethernetif *ethernetif, struct pbuf *p)
+{
+  struct ethernetif_tx_stamp *st;
+  struct pbuf *q;
+  u8_t i;
+
+  for (i = 0; i < ETHERNETIF_TX_STAMPS; i++) {
+    st = &ethernetif->tx_stamps[i];
+    if (st->p == NULL || st->state) {
+      continue;
+    }
+    for (q = p; q != NULL && q != st->p; q = q->next) {
+    }
+    if (q != NULL) {
+      st->p = p;
+      st->sent = timebase_stamp();
+      st->state = ETHERNETIF_STAMP_SENT;
+    }
+  }
+}
+
+/**
+ * Stamp frame p as the core is found done with it
+ */
+static void
+tx_stamp_done(struct ethernetif *ethernetif, struct pbuf *p)
+{
+  struct ethernetif_tx_stamp *st;
+  u8_t i;
+
+  for (i = 0; i < ETHERNETIF_TX_STAMPS; i++) {
+    st = &ethernetif->tx_stamps[i];
+    if (st->p == p && st->state == ETHERNETIF_STAMP_SENT) {
+      st->done = timebase_stamp();
+      st->state |= ETHERNETIF_STAMP_DONE;
+      ethernetif->tx_stamps_waiting--;
+    }
+  }
+}
+
+/**
+ * Copy a frame into the core's TX buffer and start sending it.  The core
+ * must be idle (TX level zero).
+ *
+ * The frame is packed into the core's TX buffer as 32-bit words (first byte
+ * in bits 31:24), zero padded to a multiple of 8 bytes and at least
+ * ETH_MIN_FRAME bytes, then sent by writing its length to the TX level.
+ * Each pbuf of the chain is copied straight from where it is, without
+ * gathering the frame first.  Where a pbuf leaves a core word part filled
+ * (the 54 bytes of a TCP segment's headers do), the next one tops it up
+ * a byte at a time and goes on from the word boundary, so that the bulk of
+ * a pbuf that is 16-bit aligned from there takes the ethbuf burst copies
+ * whatever the length of the one before; only a pbuf that is then at an
+ * odd address is packed a byte at a time throughout.  The padding fills
+ * out the last word and then goes a zero word at a time.
+ *
+ * @param netif the lwip network interface structure for this ethernetif
+ * @param p the frame, including ETH_PAD_SIZE
+ */
+static void
+low_level_send(struct netif *netif, struct pbuf *p)
+{
+  struct ethernetif *ethernetif = netif->state;
+  struct pbuf *q;
+  u32_t addr = ethernetif->base + ETH_MAC_TX_BUF_OFFSET;
+  u32_t word = 0;
+  u16_t n = 0;
+  u16_t i, words;
+  u8_t *b;
+  PERF_BEGIN(PERF_ETH_TX);
+
+#if ETH_PAD_SIZE
+  pbuf_header(p, -ETH_PAD_SIZE); /* drop the padding word */
+#endif
+
+  for (q = p; q != NULL; q = q->next) {
+    /* Send the data from the pbuf to the interface, one pbuf at a
+       time. The size of the data in each pbuf is kept in the ->len
+       variable. */
+    b = (u8_t *)q->payload;
+    /* top up the word the pbuf before left part filled */
+    for (i = 0; (n & 3) != 0 && i < q->len; i++) {
+      word = (word << 8) | b[i];
+      if ((++n & 3) == 0) {
+        Xil_Out32(addr, word);
+        addr += 4;
+      }
+    }
+    if ((n & 3) == 0 && q->len - i >= 4) {
+      words = (u16_t)((q->len - i) >> 2);
+      if (((mem_ptr_t)(b + i) & 3) == 0) {
+        gwrev_eth->write_swap(addr, (const u32_t *)(void *)(b + i), words);
+      } else if (((mem_ptr_t)(b + i) & 1) == 0) {
+        gwrev_eth->write_swap_h(addr, (const u16_t *)(void *)(b + i), words);
+      } else {
+        words = 0;
+      }
+      i = (u16_t)(i + (words << 2));
+      n = (u16_t)(n + (words << 2));
+      addr += (u32_t)words << 2;
+    }
+    for (; i < q->len; i++) {
+      word = (word << 8) | b[i];
+      if ((++n & 3) == 0) {
+        Xil_Out32(addr, word);
+        addr += 4;
+      }
+    }
+  }
+
+  /* zero pad to a whole number of core words: the last word, then whole
+     words of zeroes */
+  while ((n & 3) != 0) {
+    word <<= 8;
+    if ((++n & 3) == 0) {
+      Xil_Out32(addr, word);
+      addr += 4;
+    }
+  }
+  while (n < ETH_MIN_FRAME || (n & (ETH_MAC_WORD_SIZE - 1))) {
+    Xil_Out32(addr, 0);
+    addr += 4;
+    n += 4;
+  }
+
+  /* signal that packet should be sent */
+  eth_set_tx_level(ethernetif->base, n / ETH_MAC_WORD_SIZE);
+  PERF_END(PERF_ETH_TX);
+  if (ethernetif->tx_stamps_waiting) {
+    tx_stamp_sent(ethernetif, p);
+  }
+#if FTRACE_ENABLE
+  if (ALL_TRACED(ethernetif)) {
+    ftrace_add_pbuf(FTRACE_TX, FTRACE_PASSED, timebase_stamp(), p, 0);
+  }
+#endif /* FTRACE_ENABLE */
+
+  ethernetif->stats.tx_frames++;
+  ethernetif->stats.tx_bytes += p->tot_len;
+
+  MIB2_STATS_NETIF_ADD(netif, ifoutoctets, p->tot_len);
+  if (((u8_t*)p->payload)[0] & 1) {
+    /* broadcast or multicast packet*/
+    MIB2_STATS_NETIF_INC(netif, ifoutnucastpkts);
+  } else {
+    /* unicast packet */
+    MIB2_STATS_NETIF_INC(netif, ifoutucastpkts);
+  }
+
+#if ETH_PAD_SIZE
+  pbuf_header(p, ETH_PAD_SIZE); /* reclaim the padding word */
+#endif
+
+  LINK_STATS_INC(link.xmit);
+}
+
+/** Quantum of each class in the deficit round robin (none for control) */
+static const u16_t tx_quantum[ETHERNETIF_TX_CLASSES] = {
+  0, ETH_TX_QUANTUM_TELEMETRY, ETH_TX_QUANTUM_BULK
+};
+
+/** Frames queued in a TX ring, the one in flight included */
+#define TX_RING_COUNT(r) \
+  (((r)->head - (r)->tail + ETH_TX_QUEUE_LEN) % ETH_TX_QUEUE_LEN)
+
+/** Bytes the frame at the tail of a TX ring takes on the wire */
+#define TX_RING_LEN(r) ((r)->slot[(r)->tail].p->tot_len - ETH_PAD_SIZE)
+
+/**
+ * Class of a frame from its IPv4 TOS byte: the DSCP values of
+ * ETHERNETIF_TOS_TELEMETRY and ETHERNETIF_TOS_BULK put frames in those
+ * classes and everything else (ARP, ICMP and what the PCB left at TOS 0)
+ * is control.
+ *
+ * @param p the frame, including ETH_PAD_SIZE
+ * @return ETHERNETIF_TX_*
+ */
+static u8_t
+tx_class(struct pbuf *p)
+{
+  const struct eth_hdr *eh = (const struct eth_hdr *)p->payload;
+  u8_t dscp;
+
+  if (p->len < SIZEOF_ETH_HDR + 2 || eh->type != PP_HTONS(ETHTYPE_IP)) {
+    return ETHERNETIF_TX_CONTROL;
+  }
+  dscp = IPH_TOS((const struct ip_hdr *)((const u8_t *)eh + SIZEOF_ETH_HDR)) & 0xfc;
+  if (dscp == ETHERNETIF_TOS_TELEMETRY) {
+    return ETHERNETIF_TX_TELEMETRY;
+  }
+  if (dscp == ETHERNETIF_TOS_BULK) {
+    return ETHERNETIF_TX_BULK;
+  }
+  return ETHERNETIF_TX_CONTROL;
+}
+
+/**
+ * Pick the class to send from next: control whenever it has a frame, and
+ * otherwise the deficit round robin of the others (see struct
+ * ethernetif_tx_ring).  Since each quantum is at least a full frame, the
+ * loop ends within two turns of each class.
+ *
+ * @param ethernetif the interface, with no frame in flight
+ * @return the class, or ETHERNETIF_TX_CLASSES if every queue is empty
+ */
+static u8_t
+tx_next_class(struct ethernetif *ethernetif)
+{
+  struct ethernetif_tx_ring *r;
+  u8_t c, waiting = 0;
+
+  for (c = 0; c < ETHERNETIF_TX_CLASSES; c++) {
+    r = &ethernetif->txq[c];
+    if (r->head != r->tail) {
+      if (c == ETHERNETIF_TX_CONTROL) {
+        return c;
+      }
+      waiting = 1;
+    }
+  }
+  if (!waiting) {
+    return ETHERNETIF_TX_CLASSES;
+  }
+
+  for (;;) {
+    c = ethernetif->tx_turn;
+    r = &ethernetif->txq[c];
+    if (r->head == r->tail) {
+      /* an idle class saves nothing up for later */
+      r->deficit = 0;
+    } else if (TX_RING_LEN(r) <= r->deficit) {
+      return c;
+    }
+    c = c + 1 < ETHERNETIF_TX_CLASSES ? c + 1 : ETHERNETIF_TX_CONTROL + 1;
+    ethernetif->tx_turn = c;
+    r = &ethernetif->txq[c];
+    if (r->head != r->tail) {
+      r->deficit += tx_quantum[c];
+    }
+  }
+}
+
+/**
+ * Advance the TX queues: complete the frame in flight once the core has
+ * sent it, then start the next frame of the class tx_next_class() picks.
+ * Never blocks.
+ *
+ * @param netif the lwip network interface structure for this ethernetif
+ */
+static void
+low_level_tx_service(struct netif *netif)
+{
+  struct ethernetif *ethernetif = netif->state;
+  struct ethernetif_tx_ring *r;
+  struct ethernetif_tx_slot *slot;
+  ethernetif_tx_handle_t handle;
+  u8_t c;
+
+  if (ethernetif->tx_busy) {
+    if (eth_get_tx_level(ethernetif->base)) {
+      return; /* still sending */
+    }
+    c = ethernetif->tx_busy - 1;
+    r = &ethernetif->txq[c];
+    slot = &r->slot[r->tail];
+    if (ethernetif->tx_stamps_waiting) {
+      tx_stamp_done(ethernetif, slot->p);
+    }
+    pbuf_free(slot->p);
+    slot->p = NULL;
+    r->tail = (r->tail + 1) % ETH_TX_QUEUE_LEN;
+    handle = TX_HANDLE(c, r->seq);
+    r->seq++;
+    ethernetif->tx_busy = 0;
+    if (slot->done != NULL) {
+      slot->done(netif, handle, ERR_OK, slot->arg);
+    }
+  }
+
+  if (!ethernetif->tx_busy) {
+    c = tx_next_class(ethernetif);
+    if (c == ETHERNETIF_TX_CLASSES) {
+      return;
+    }
+    r = &ethernetif->txq[c];
+    if (c != ETHERNETIF_TX_CONTROL) {
+      r->deficit -= TX_RING_LEN(r);
+    }
+    CYCLE_STATS_ENTER(CYCLES_NETIF_TX);
+    low_level_send(netif, r->slot[r->tail].p);
+    CYCLE_STATS_EXIT();
+    ethernetif->tx_busy = c + 1;
+  }
+}
+
+/**
+ * Queue a frame for transmission.  The frame goes in the queue of its class
+ * (ETHERNETIF_TX_*, from its IP TOS byte) and is sent after the frames
+ * queued before it in that class, control frames ahead of the others; this
+ * call never waits for the core.
+ *
+ * @param netif the lwip network interface structure for this ethernetif
+ * @param p the frame as passed to netif->linkoutput (including ETH_PAD_SIZE).
+ *        The driver takes its own reference, so the caller still owns p.
+ * @param done optional callback run from ethernetif_poll() once the frame
+ *        has been sent
+ * @param arg argument passed to done
+ * @param handle if not NULL, receives a handle for ethernetif_tx_done()
+ * @return ERR_OK if queued, ERR_BUF if the frame is too long, ERR_MEM if the
+ *         class's queue is full
+ */
+err_t
+ethernetif_tx_queue(struct netif *netif, struct pbuf *p,
+                    ethernetif_tx_fn done, void *arg,
+                    ethernetif_tx_handle_t *handle)
+{
+  struct ethernetif *ethernetif = netif->state;
+  struct ethernetif_tx_ring *r;
+  struct ethernetif_tx_slot *slot;
+  u8_t c, next;
+
+  if (p->tot_len - ETH_PAD_SIZE > ETH_MAC_MAX_FRAME) {
+    LINK_STATS_INC(link.lenerr);
+    MIB2_STATS_NETIF_INC(netif, ifouterrors);
+    return ERR_BUF;
+  }
+
+  c = tx_class(p);
+  r = &ethernetif->txq[c];
+  next = (r->head + 1) % ETH_TX_QUEUE_LEN;
+  if (next == r->tail) {
+    return ERR_MEM;
+  }
+
+  if (handle != NULL) {
+    *handle = TX_HANDLE(c, r->seq + TX_RING_COUNT(r));
+  }
+
+  slot = &r->slot[r->head];
+  pbuf_ref(p);
+  slot->p = p;
+  slot->done = done;
+  slot->arg = arg;
+  r->head = next;
+
+  low_level_tx_service(netif);
+
+  return ERR_OK;
+}
+
+/**
+ * @return the number of frames queued or in flight, in all classes
+ */
+int
+ethernetif_tx_pending(struct netif *netif)
+{
+  struct ethernetif *ethernetif = netif->state;
+  int n = 0;
+  u8_t c;
+
+  for (c = 0; c < ETHERNETIF_TX_CLASSES; c++) {
+    n += TX_RING_COUNT(&ethernetif->txq[c]);
+  }
+  return n;
+}
+
+/**
+ * Advance the TX queues without receiving, for code that waits for room in
+ * them from inside the stack (where ethernetif_poll() would recurse).
+ *
+ * @param netif the lwip network interface structure for this ethernetif
+ */
+void
+ethernetif_tx_poll(struct netif *netif)
+{
+  low_level_tx_service(netif);
+}
+
+/**
+ * Check whether a frame queued with ethernetif_tx_queue() has been sent.
+ * Polls the core, so it can be called in a loop to wait for completion.
+ * Frames of a class are sent in order, so the handle only has to be
+ * compared with its own class's.
+ *
+ * @return 1 if the frame has been sent, 0 if it is still queued or in flight
+ */
+int
+ethernetif_tx_done(struct netif *netif, ethernetif_tx_handle_t handle)
+{
+  struct ethernetif *ethernetif = netif->state;
+  struct ethernetif_tx_ring *r;
+  u8_t c = handle >> TX_SEQ_BITS;
+
+  low_level_tx_service(netif);
+
+  if (c >= ETHERNETIF_TX_CLASSES) {
+    return 1;
+  }
+  r = &ethernetif->txq[c];
+  return (s16_t)((u16_t)(handle - TX_HANDLE(0, r->seq)) << (16 - TX_SEQ_BITS)) < 0;
+}
+
+/**
+ * Bytes of buffer from the payload of a received pbuf to the end of its
+ * storage, so a reply can be built in place over the request.
+ *
+ * @param p a pbuf passed up by this driver
+ * @return the room after p->payload; just p->len unless p is one of the
+ *         driver's RX buffers
+ */
+u16_t
+ethernetif_rx_room(struct pbuf *p)
+{
+#if ETH_RX_BUFS
+  struct ethernetif_rx_buf *rb = (struct ethernetif_rx_buf *)p;
+
+  if ((p->flags & PBUF_FLAG_IS_CUSTOM) &&
+      rb->pc.custom_free_function == rx_buf_free &&
+      (u8_t *)p->payload >= (u8_t *)rb->data &&
+      (u8_t *)p->payload < (u8_t *)rb->data + sizeof(rb->data)) {
+    return (u8_t *)rb->data + sizeof(rb->data) - (u8_t *)p->payload;
+  }
+#endif /* ETH_RX_BUFS */
+#if ETH_RX_SMALL_BUFS
+  {
+    struct ethernetif_rx_small *rs = (struct ethernetif_rx_small *)p;
+
+    if ((p->flags & PBUF_FLAG_IS_CUSTOM) &&
+        rs->pc.custom_free_function == rx_small_free &&
+        (u8_t *)p->payload >= (u8_t *)rs->data &&
+        (u8_t *)p->payload < (u8_t *)rs->data + sizeof(rs->data)) {
+      return (u8_t *)rs->data + sizeof(rs->data) - (u8_t *)p->payload;
+    }
+  }
+#endif /* ETH_RX_SMALL_BUFS */
+  return p->len;
+}
+
+/**
+ * Hand received frames of one EtherType straight to a handler of their own,
+ * ahead of ethernet_input() and so whether or not IP is configured.
+ * Replaces any earlier handler.
+ *
+ * @param netif the lwip network interface structure for this ethernetif
+ * @param type the EtherType, in host order
+ * @param fn the handler, which takes ownership of the frame (NULL to pass
+ *        the EtherType to the stack again)
+ */
+void
+ethernetif_set_raw_input(struct netif *netif, u16_t type, ethernetif_raw_fn fn)
+{
+  struct ethernetif *ethernetif = netif->state;
+
+  ethernetif->raw_type = lwip_htons(type);
+  ethernetif->raw_input = fn;
+}
+
+/**
+ * Set or clear a rule of the RX classifier.  Each received frame is compared
+ * with the rules in order, while it is still in the core, and the first
+ * match decides whether it is dropped there, goes to the rule's handler or
+ * goes to the stack.  Frames matching no rule are handled as if there were
+ * no classifier (the raw EtherType, then the stack).
+ *
+ * @param netif the lwip network interface structure for this ethernetif
+ * @param n the rule, 0 to ETHERNETIF_RX_RULES - 1
+ * @param rule the rule to copy in (its hits are reset), or NULL to clear
+ * @return ERR_OK, or ERR_ARG if n or the rule is invalid
+ */
+err_t
+ethernetif_set_rx_rule(struct netif *netif, u8_t n,
+                       const struct ethernetif_rx_rule *rule)
+{
+  struct ethernetif *ethernetif = netif->state;
+  struct ethernetif_rx_rule *r;
+  u8_t i;
+
+  if (n >= ETHERNETIF_RX_RULES) {
+    return ERR_ARG;
+  }
+  if (rule != NULL && (rule->action == ETHERNETIF_RX_FREE ||
+                       rule->action > ETHERNETIF_RX_DROP ||
+                       (rule->action == ETHERNETIF_RX_HANDLER && rule->fn == NULL))) {
+    return ERR_ARG;
+  }
+
+  r = &ethernetif->rx_rules[n];
+  if (rule != NULL) {
+    *r = *rule;
+  } else {
+    memset(r, 0, sizeof(*r));
+  }
+  r->hits = 0;
+
+  ethernetif->rx_peek = 0;
+  for (i = 0, r = ethernetif->rx_rules; i < ETHERNETIF_RX_RULES; i++, r++) {
+    if (r->action == ETHERNETIF_RX_FREE) {
+      continue;
+    }
+    if (r->match & (ETHERNETIF_RX_MATCH_PROTO | ETHERNETIF_RX_MATCH_PORT)) {
+      ethernetif->rx_peek = RX_PEEK_IP;
+    } else if (ethernetif->rx_peek < RX_PEEK_ETH) {
+      ethernetif->rx_peek = RX_PEEK_ETH;
+    }
+  }
+  return ERR_OK;
+}
+
+/**
+ * @param netif the lwip network interface structure for this ethernetif
+ * @param n the rule, 0 to ETHERNETIF_RX_RULES - 1
+ * @return rule n, or NULL if it is not set
+ */
+const struct ethernetif_rx_rule *
+ethernetif_rx_rule(struct netif *netif, u8_t n)
+{
+  struct ethernetif *ethernetif = netif->state;
+
+  if (n >= ETHERNETIF_RX_RULES || ethernetif->rx_rules[n].action == ETHERNETIF_RX_FREE) {
+    return NULL;
+  }
+  return &ethernetif->rx_rules[n];
+}
+
+/**
+ * Report how often received frames found no memory.
+ *
+ * @param netif the lwip network interface structure for this ethernetif
+ * @param holds set to the number of frames that had to wait in the core
+ * @param drops set to the number of those dropped after ETH_RX_HOLD_MS
+ */
+void
+ethernetif_rx_nomem(struct netif *netif, u32_t *holds, u32_t *drops)
+{
+  struct ethernetif *ethernetif = netif->state;
+
+  *holds = ethernetif->rx_holds;
+  *drops = ethernetif->rx_nomem_drops;
+}
+
+#if LWIP_IGMP
+/** Low 23 bits of an IPv4 group, as they appear in its MAC address */
+#define MCAST_KEY(group) (lwip_ntohl(ip4_addr_get_u32(group)) & 0x7fffff)
+
+/**
+ * netif->igmp_mac_filter: let a group's frames through the MAC filter, or
+ * stop them once no joined group maps to its MAC address.  Groups differing
+ * only in the 5 bits the MAC address leaves out share a slot.
+ *
+ * @param netif the lwip network interface structure for this ethernetif
+ * @param group the group joined or left
+ * @param action NETIF_ADD_MAC_FILTER or NETIF_DEL_MAC_FILTER
+ * @return ERR_OK
+ */
+static err_t
+ethernetif_mac_filter(struct netif *netif, const ip4_addr_t *group,
+                      enum netif_mac_filter_action action)
+{
+  struct ethernetif *ethernetif = netif->state;
+  u32_t key = MCAST_KEY(group);
+  u8_t i, slot = ETHERNETIF_MCAST_FILTERS;
+
+  for (i = 0; i < ETHERNETIF_MCAST_FILTERS; i++) {
+    if (ethernetif->mcast_refs[i] == 0) {
+      slot = i;
+    } else if (ethernetif->mcast[i] == key) {
+      break;
+    }
+  }
+  if (action == NETIF_ADD_MAC_FILTER) {
+    if (i < ETHERNETIF_MCAST_FILTERS) {
+      ethernetif->mcast_refs[i]++;
+    } else if (slot < ETHERNETIF_MCAST_FILTERS) {
+      ethernetif->mcast[slot] = key;
+      ethernetif->mcast_refs[slot] = 1;
+    } else {
+      /* no room: open the filter rather than lose the group */
+      ethernetif->mcast_overflow++;
+    }
+  } else if (i < ETHERNETIF_MCAST_FILTERS) {
+    ethernetif->mcast_refs[i]--;
+  } else if (ethernetif->mcast_overflow > 0) {
+    ethernetif->mcast_overflow--;
+  }
+  return ERR_OK;
+}
+
+/**
+ * Check the frame waiting in the core against the multicast MAC filter.
+ * Only IPv4 multicast addresses (01:00:5e) are filtered; broadcast and
+ * other group addresses go through.
+ *
+ * @param netif the lwip network interface structure for this ethernetif
+ * @return 1 if the frame is to a group nothing joined
+ */
+static int
+rx_mcast_unwanted(struct netif *netif)
+{
+  struct ethernetif *ethernetif = netif->state;
+  u32_t addr = ethernetif->base + ETH_MAC_RX_BUF_OFFSET;
+  u32_t w0 = Xil_In32(addr), key;
+  u8_t i;
+
+  if ((w0 & 0xffffff00UL) != 0x01005e00UL || ethernetif->mcast_overflow) {
+    return 0;
+  }
+  key = ((w0 & 0x7f) << 16) | (Xil_In32(addr + 4) >> 16);
+  for (i = 0; i < ETHERNETIF_MCAST_FILTERS; i++) {
+    if (ethernetif->mcast_refs[i] != 0 && ethernetif->mcast[i] == key) {
+      return 0;
+    }
+  }
+  ethernetif->mcast_drops++;
+  return 1;
+}
+
+/**
+ * @return the number of frames the multicast MAC filter has dropped
+ */
+u32_t
+ethernetif_mcast_drops(struct netif *netif)
+{
+  struct ethernetif *ethernetif = netif->state;
+
+  return ethernetif->mcast_drops;
+}
+#endif /* LWIP_IGMP */
+
+/**
+ * Find the first RX classifier rule matching the frame waiting in the core,
+ * reading no more of it than the rules need.
+ *
+ * @param netif the lwip network interface structure for this ethernetif
+ * @param len length of the frame
+ * @return the rule, with its hits counted, or NULL if none matches
+ */
+static struct ethernetif_rx_rule *
+rx_classify(struct netif *netif, u16_t len)
+{
+  struct ethernetif *ethernetif = netif->state;
+  struct ethernetif_rx_rule *r;
+  u32_t w[RX_PEEK_IP];
+  u32_t addr = ethernetif->base + ETH_MAC_RX_BUF_OFFSET;
+  u16_t type, port = 0;
+  u8_t i, j, proto = 0, fields;
+
+  if (ethernetif->rx_peek == 0) {
+    return NULL;
+  }
+  for (i = 0; i < ethernetif->rx_peek; i++, addr += 4) {
+    w[i] = Xil_In32(addr);
+  }
+
+  /* The fields this frame has */
+  fields = ETHERNETIF_RX_MATCH_TYPE | ETHERNETIF_RX_MATCH_DST;
+  if (RX_PEEK_BYTE(w, 0) & 1) {
+    fields |= ETHERNETIF_RX_MATCH_MCAST;
+  }
+  type = (RX_PEEK_BYTE(w, 12) << 8) | RX_PEEK_BYTE(w, 13);
+  if (ethernetif->rx_peek == RX_PEEK_IP && type == ETHTYPE_IP &&
+      len >= RX_PEEK_IP * 4) {
+    fields |= ETHERNETIF_RX_MATCH_PROTO;
+    proto = RX_PEEK_BYTE(w, 23);
+    /* UDP, IHL 5, fragment offset 0 */
+    if (proto == IP_PROTO_UDP && RX_PEEK_BYTE(w, 14) == 0x45 &&
+        (RX_PEEK_BYTE(w, 20) & 0x1f) == 0 && RX_PEEK_BYTE(w, 21) == 0) {
+      fields |= ETHERNETIF_RX_MATCH_PORT;
+      port = (RX_PEEK_BYTE(w, 36) << 8) | RX_PEEK_BYTE(w, 37);
+    }
+  }
+
+  for (i = 0, r = ethernetif->rx_rules; i < ETHERNETIF_RX_RULES; i++, r++) {
+    if (r->action == ETHERNETIF_RX_FREE || (r->match & ~fields) ||
+        ((r->match & ETHERNETIF_RX_MATCH_TYPE) && r->type != type) ||
+        ((r->match & ETHERNETIF_RX_MATCH_PROTO) && r->proto != proto) ||
+        ((r->match & ETHERNETIF_RX_MATCH_PORT) && r->port != port)) {
+      continue;
+    }
+    if (r->match & ETHERNETIF_RX_MATCH_DST) {
+      for (j = 0; j < ETH_HWADDR_LEN; j++) {
+        if (r->dst.addr[j] != RX_PEEK_BYTE(w, j)) {
+          break;
+        }
+      }
+      if (j < ETH_HWADDR_LEN) {
+        continue;
+      }
+    }
+    r->hits++;
+    return r;
+  }
+  return NULL;
+}
+
+/**
+ * @return the NETIF_CHECKSUM_* flags the gateware can compute or verify
+ */
+u16_t
+ethernetif_csum_caps(struct netif *netif)
+{
+  struct ethernetif *ethernetif = netif->state;
+
+  return ethernetif->csum_caps;
+}
+
+/**
+ * Choose which checksums are left to the gateware.  Checksums not in flags
+ * are generated and checked by the stack in software.
+ *
+ * @param flags NETIF_CHECKSUM_* flags to offload, a subset of
+ *        ethernetif_csum_caps()
+ * @return ERR_OK, or ERR_ARG if the gateware cannot handle some of flags
+ */
+err_t
+ethernetif_set_csum_offload(struct netif *netif, u16_t flags)
+{
+  struct ethernetif *ethernetif = netif->state;
 
-  /* Do whatever else is needed to initialize interface. */
+  if (flags & ~ethernetif->csum_caps) {
+    return ERR_ARG;
+  }
+  ethernetif->csum_offload = flags;
+  NETIF_SET_CHECKSUM_CTRL(netif, NETIF_CHECKSUM_ENABLE_ALL & ~flags);
+  return ERR_OK;
 }
 
 /**
@@ -122,82 +1248,206 @@ low_level_init(struct netif *netif)
  * contained in the pbuf that is passed to the function. This pbuf
  * might be chained.
  *
+ * Frames are queued with ethernetif_tx_queue().  Only if the queue is full
+ * does this wait (up to ETH_TX_TIMEOUT polls) for the core to make room.
+ *
  * @param netif the lwip network interface structure for this ethernetif
  * @param p the MAC packet to send (e.g. IP packet including MAC addresses and type)
  * @return ERR_OK if the packet could be sent
  *         an err_t value if the packet couldn't be sent
- *
- * @note Returning ERR_MEM here if a DMA queue of your MAC is full can lead to
- *       strange results. You might consider waiting for space in the DMA queue
- *       to become available since the stack doesn't retry to send a packet
- *       dropped because of memory failure (except for the TCP timers).
  */
-
 static err_t
 low_level_output(struct netif *netif, struct pbuf *p)
 {
   struct ethernetif *ethernetif = netif->state;
-  struct pbuf *q;
+  err_t err;
+  u16_t i;
 
-  initiate transfer();
-
-#if ETH_PAD_SIZE
-  pbuf_header(p, -ETH_PAD_SIZE); /* drop the padding word */
-#endif
+  err = ethernetif_tx_queue(netif, p, NULL, NULL, NULL);
+  for (i = 0; err == ERR_MEM && i < ETH_TX_TIMEOUT; i++) {
+    low_level_tx_service(netif);
+    err = ethernetif_tx_queue(netif, p, NULL, NULL, NULL);
+  }
 
-  for (q = p; q != NULL; q = q->next) {
-    /* Send the data from the pbuf to the interface, one pbuf at a
-       time. The size of the data in each pbuf is kept in the ->len
-       variable. */
-    send data from(q->payload, q->len);
+  if (err == ERR_MEM) {
+    LWIP_DEBUGF(NETIF_DEBUG, ("low_level_output: TX queue full\n"));
+    LINK_STATS_INC(link.drop);
+    MIB2_STATS_NETIF_INC(netif, ifoutdiscards);
+    ethernetif->stats.tx_drops++;
+#if FTRACE_ENABLE
+    if (ALL_TRACED(ethernetif)) {
+      ftrace_add_pbuf(FTRACE_TX, FTRACE_DROP_TXFULL, timebase_stamp(), p,
+                      ETH_PAD_SIZE);
+    }
+#endif /* FTRACE_ENABLE */
+    err = ERR_IF;
   }
 
-  signal that packet should be sent();
+  return err;
+}
 
-  MIB2_STATS_NETIF_ADD(netif, ifoutoctets, p->tot_len);
-  if (((u8_t*)p->payload)[0] & 1) {
-    /* broadcast or multicast packet*/
-    MIB2_STATS_NETIF_INC(netif, ifoutnucastpkts);
-  } else {
-    /* unicast packet */
-    MIB2_STATS_NETIF_INC(netif, ifoutucastpkts);
-  }
-  /* increase ifoutdiscards or ifouterrors on error */
+/**
+ * Allocate a pbuf for a received frame: a small RX buffer for a short
+ * frame, else a driver RX buffer if one is free, a PBUF_POOL chain
+ * otherwise.  A short frame falls back on the others when the small ones
+ * run out.
+ *
+ * @param len length of the frame, including ETH_PAD_SIZE
+ * @return the pbuf, or NULL if out of memory
+ */
+static struct pbuf *
+rx_alloc(u16_t len)
+{
+  struct pbuf *p = NULL;
 
-#if ETH_PAD_SIZE
-  pbuf_header(p, ETH_PAD_SIZE); /* reclaim the padding word */
+#if ETH_RX_SMALL_BUFS
+  if (len <= ETH_PAD_SIZE + ETH_RX_SMALL_SIZE) {
+    p = rx_small_alloc(len);
+    if (p != NULL) {
+      return p;
+    }
+  }
+#endif /* ETH_RX_SMALL_BUFS */
+#if ETH_RX_BUFS
+  p = rx_buf_alloc(len);
+  if (p == NULL)
 #endif
+  {
+    p = pbuf_alloc(PBUF_RAW, len, PBUF_POOL);
+  }
+  return p;
+}
 
-  LINK_STATS_INC(link.xmit);
+#if FTRACE_ENABLE
+/**
+ * Trace a received frame of len bytes that is still in the core, reading
+ * its first bytes from the RX buffer
+ */
+static void
+rx_trace_core(struct ethernetif *ethernetif, u16_t len, u8_t reason)
+{
+  u8_t head[FTRACE_SNAPLEN];
+  u32_t addr = ethernetif->base + ETH_MAC_RX_BUF_OFFSET;
+  u32_t word = 0;
+  u16_t i, n = len < FTRACE_SNAPLEN ? len : FTRACE_SNAPLEN;
 
-  return ERR_OK;
+  for (i = 0; i < n; i++) {
+    if ((i & 3) == 0) {
+      word = Xil_In32(addr);
+      addr += 4;
+    }
+    head[i] = (u8_t)(word >> 24);
+    word <<= 8;
+  }
+  ftrace_add(FTRACE_RX, reason, ethernetif->rx_stamp, len, head, n);
 }
+#endif /* FTRACE_ENABLE */
 
 /**
  * Should allocate a pbuf and transfer the bytes of the incoming
  * packet from the interface into the pbuf.
  *
+ * The core reports the frame length in 8 byte words, so the pbuf may carry
+ * up to 7 bytes of trailing padding; the IP layer trims it.
+ *
+ * Frames of up to ETH_RX_SMALL_SIZE bytes go into a small RX buffer while
+ * there is one.  Frames go into a driver RX buffer (a single, aligned custom
+ * pbuf) when one is free, e.g. unless TCP out-of-sequence queueing or reassembly holds them
+ * all, and into a PBUF_POOL chain otherwise.  Frames the RX classifier drops
+ * are skipped without reading them out of the core.  A frame there is no
+ * memory for waits in the core, holding up the ones behind it, for up to
+ * ETH_RX_HOLD_MS before it is dropped.
+ *
  * @param netif the lwip network interface structure for this ethernetif
+ * @param rule set to the classifier rule the frame matched, or NULL
  * @return a pbuf filled with the received packet (including MAC header)
- *         NULL on memory error
+ *         NULL on memory error or if no packet is waiting
  */
 static struct pbuf *
-low_level_input(struct netif *netif)
+low_level_input(struct netif *netif, struct ethernetif_rx_rule **rule)
 {
   struct ethernetif *ethernetif = netif->state;
   struct pbuf *p, *q;
-  u16_t len;
+  u32_t addr = ethernetif->base + ETH_MAC_RX_BUF_OFFSET;
+  u32_t word = 0;
+  u16_t len, n = 0;
+  u16_t i, words;
+  u8_t *b;
 
-  /* Obtain the size of the packet and put it into the "len"
-     variable. */
-  len = ;
+  for (;;) {
+    /* Obtain the size of the packet and put it into the "len"
+       variable. */
+    len = eth_get_rx_level(ethernetif->base) * ETH_MAC_WORD_SIZE;
+    if (len == 0) {
+      return NULL;
+    }
+    ethernetif->rx_stamp = timebase_stamp();
+    if (len > ETH_MAC_MAX_FRAME) {
+#if FTRACE_ENABLE
+      if (ALL_TRACED(ethernetif)) {
+        rx_trace_core(ethernetif, len, FTRACE_DROP_LEN);
+      }
+#endif /* FTRACE_ENABLE */
+      eth_set_rx_level(ethernetif->base, 0);
+      LINK_STATS_INC(link.lenerr);
+      LINK_STATS_INC(link.drop);
+      MIB2_STATS_NETIF_INC(netif, ifinerrors);
+      ethernetif->stats.rx_drops++;
+      return NULL;
+    }
+#if LWIP_IGMP
+    if (!ethernetif->rx_holding && rx_mcast_unwanted(netif)) {
+      *rule = NULL;
+    } else
+#endif /* LWIP_IGMP */
+    {
+      *rule = ethernetif->rx_holding ? ethernetif->rx_held_rule :
+                                       rx_classify(netif, len);
+      if (*rule == NULL || (*rule)->action != ETHERNETIF_RX_DROP) {
+        break;
+      }
+    }
+    /* unwanted: leave it in the core and go on to the next frame */
+#if FTRACE_ENABLE
+    if (RX_TRACED(ethernetif, *rule)) {
+      rx_trace_core(ethernetif, len, *rule == NULL ? FTRACE_DROP_MCAST :
+                                                     FTRACE_DROP_RULE);
+    }
+#endif /* FTRACE_ENABLE */
+    eth_set_rx_level(ethernetif->base, 0);
+    LINK_STATS_INC(link.drop);
+    MIB2_STATS_NETIF_INC(netif, ifindiscards);
+    ethernetif->stats.rx_drops++;
+  }
 
 #if ETH_PAD_SIZE
   len += ETH_PAD_SIZE; /* allow room for Ethernet padding */
 #endif
 
-  /* We allocate a pbuf chain of pbufs from the pool. */
-  p = pbuf_alloc(PBUF_RAW, len, PBUF_POOL);
+  p = rx_alloc(len);
+#if LWIP_TCP && TCP_QUEUE_OOSEQ && NO_SYS && PBUF_POOL_FREE_OOSEQ
+  if (p == NULL && pbuf_free_ooseq_pending) {
+    /* the pool ran dry: new frames come before out-of-sequence TCP data */
+    PBUF_CHECK_FREE_OOSEQ();
+    p = rx_alloc(len);
+  }
+#endif /* LWIP_TCP && TCP_QUEUE_OOSEQ && NO_SYS && PBUF_POOL_FREE_OOSEQ */
+  if (p == NULL) {
+    /* Leave the frame in the core until the stack frees some memory: the
+     * core drops what arrives meanwhile rather than this driver dropping
+     * frames it has already paid to classify. */
+    if (!ethernetif->rx_holding) {
+      ethernetif->rx_holding = 1;
+      ethernetif->rx_hold_since = sys_now();
+      ethernetif->rx_held_rule = *rule;
+      ethernetif->rx_holds++;
+    }
+    if (sys_now() - ethernetif->rx_hold_since < ETH_RX_HOLD_MS) {
+      return NULL;
+    }
+    ethernetif->rx_nomem_drops++;
+  }
+  ethernetif->rx_holding = 0;
 
   if (p != NULL) {
 
@@ -208,18 +1458,40 @@ low_level_input(struct netif *netif)
     /* We iterate over the pbuf chain until we have read the entire
      * packet into the pbuf. */
     for (q = p; q != NULL; q = q->next) {
-      /* Read enough bytes to fill this pbuf in the chain. The
-       * available data in the pbuf is given by the q->len
-       * variable.
-       * This does not necessarily have to be a memcpy, you can also preallocate
-       * pbufs for a DMA-enabled MAC and after receiving truncate it to the
-       * actually received size. In this case, ensure the tot_len member of the
-       * pbuf is the sum of the chained pbuf len members.
-       */
-      read data into(q->payload, q->len);
-    }
-    acknowledge that packet has been read();
+      b = (u8_t *)q->payload;
+      i = 0;
+      if ((n & 3) == 0 && q->len >= 4) {
+        words = q->len >> 2;
+        if (((mem_ptr_t)b & 3) == 0) {
+          gwrev_eth->read_swap((u32_t *)b, addr, words);
+        } else if (((mem_ptr_t)b & 1) == 0) {
+          gwrev_eth->read_swap_h((u16_t *)b, addr, words);
+        } else {
+          words = 0;
+        }
+        i = words << 2;
+        n += i;
+        addr += i;
+      }
+      for (; i < q->len; i++) {
+        if ((n++ & 3) == 0) {
+          word = Xil_In32(addr);
+          addr += 4;
+        }
+        b[i] = (u8_t)(word >> 24);
+        word <<= 8;
+      }
+    }
+    /* acknowledge that packet has been read */
+    eth_set_rx_level(ethernetif->base, 0);
+#if FTRACE_ENABLE
+    if (RX_TRACED(ethernetif, *rule)) {
+      ftrace_add_pbuf(FTRACE_RX, FTRACE_PASSED, ethernetif->rx_stamp, p, 0);
+    }
+#endif /* FTRACE_ENABLE */
 
+    ethernetif->stats.rx_frames++;
+    ethernetif->stats.rx_bytes += p->tot_len;
     MIB2_STATS_NETIF_ADD(netif, ifinoctets, p->tot_len);
     if (((u8_t*)p->payload)[0] & 1) {
       /* broadcast or multicast packet*/
@@ -234,15 +1506,185 @@ low_level_input(struct netif *netif)
 
     LINK_STATS_INC(link.recv);
   } else {
-    drop packet();
+    /* drop packet */
+#if FTRACE_ENABLE
+    if (RX_TRACED(ethernetif, *rule)) {
+      rx_trace_core(ethernetif, len - ETH_PAD_SIZE, FTRACE_DROP_NOMEM);
+    }
+#endif /* FTRACE_ENABLE */
+    eth_set_rx_level(ethernetif->base, 0);
     LINK_STATS_INC(link.memerr);
     LINK_STATS_INC(link.drop);
     MIB2_STATS_NETIF_INC(netif, ifindiscards);
+    ethernetif->stats.rx_drops++;
   }
 
   return p;
 }
 
+#if ETH_ICMP_FAST
+/** A source of echo requests and its replies this window */
+struct icmp_fast_source {
+  ip4_addr_t addr;
+  u32_t window_start;
+  u16_t replies;
+};
+
+static struct icmp_fast_source icmp_sources[ETH_ICMP_FAST_SOURCES];
+
+/**
+ * Count a reply to src against its rate limit.
+ *
+ * @return 1 if the reply may go, 0 if src is over ETH_ICMP_FAST_BURST
+ */
+static int
+icmp_fast_allow(const ip4_addr_t *src)
+{
+  struct icmp_fast_source *s, *stalest = icmp_sources;
+  u32_t now = sys_now();
+  u8_t i;
+
+  for (i = 0, s = icmp_sources; i < ETH_ICMP_FAST_SOURCES; i++, s++) {
+    if (ip4_addr_cmp(&s->addr, src)) {
+      break;
+    }
+    if (s->window_start - stalest->window_start > 0x7fffffff) {
+      stalest = s;
+    }
+  }
+  if (i == ETH_ICMP_FAST_SOURCES) {
+    s = stalest;
+    ip4_addr_copy(s->addr, *src);
+    s->window_start = now;
+    s->replies = 0;
+  } else if (now - s->window_start >= ETH_ICMP_FAST_WINDOW_MS) {
+    s->window_start = now;
+    s->replies = 0;
+  }
+  if (s->replies >= ETH_ICMP_FAST_BURST) {
+    return 0;
+  }
+  s->replies++;
+  return 1;
+}
+
+/**
+ * Adjust a checksum for a halfword of the data changing from old to new,
+ * as RFC 1624 has it: HC' = ~(~HC + ~m + m').  All in network order.
+ */
+static u16_t
+csum_adjust(u16_t sum, u16_t from, u16_t to)
+{
+  u32_t acc = (u16_t)~sum + (u32_t)(u16_t)~from + to;
+
+  acc = (acc & 0xffff) + (acc >> 16);
+  acc = (acc & 0xffff) + (acc >> 16);
+  return (u16_t)~acc;
+}
+
+/**
+ * Turn an echo request to the interface's address into the reply and send
+ * it from the same buffer: swap the addresses, reset the TTL and update
+ * both checksums for the changed fields.  That skips ip4_input(),
+ * icmp_input(), the pbuf it allocates and summing the data again.  The
+ * request's ICMP checksum is not checked, but a reply to a corrupt request
+ * carries the same error, so the sender drops it.  Requests with IP
+ * options, fragments, and echoes to broadcast or multicast addresses go up
+ * the stack as before.
+ *
+ * @param netif the lwip network interface structure for this ethernetif
+ * @param p the received frame
+ * @return 1 if p was an echo request, now sent or dropped and freed; 0 to
+ *         pass it up the stack
+ */
+static int
+rx_icmp_echo(struct netif *netif, struct pbuf *p)
+{
+  struct ethernetif *ethernetif = netif->state;
+  struct eth_hdr *ethhdr = (struct eth_hdr *)p->payload;
+  struct ip_hdr *iphdr = (struct ip_hdr *)((u8_t *)p->payload + SIZEOF_ETH_HDR);
+  struct icmp_echo_hdr *echo;
+  ip4_addr_t src;
+  u16_t len, old;
+
+  if (p->len < SIZEOF_ETH_HDR + IP_HLEN + sizeof(struct icmp_echo_hdr) ||
+      ethhdr->type != PP_HTONS(ETHTYPE_IP) || (ethhdr->dest.addr[0] & 1) ||
+      IPH_V(iphdr) != 4 || IPH_HL(iphdr) != IP_HLEN / 4 ||
+      IPH_PROTO(iphdr) != IP_PROTO_ICMP ||
+      (IPH_OFFSET(iphdr) & PP_HTONS(IP_OFFMASK | IP_MF)) != 0 ||
+      ip4_addr_isany_val(*netif_ip4_addr(netif)) ||
+      !ip4_addr_cmp(&iphdr->dest, netif_ip4_addr(netif))) {
+    return 0;
+  }
+  echo = (struct icmp_echo_hdr *)((u8_t *)iphdr + IP_HLEN);
+  len = lwip_ntohs(IPH_LEN(iphdr));
+  if (ICMPH_TYPE(echo) != ICMP_ECHO || ICMPH_CODE(echo) != 0 ||
+      len < IP_HLEN + sizeof(struct icmp_echo_hdr) ||
+      len > p->len - SIZEOF_ETH_HDR) {
+    return 0;
+  }
+  IF__NETIF_CHECKSUM_ENABLED(netif, NETIF_CHECKSUM_CHECK_IP) {
+    if (inet_chksum(iphdr, IP_HLEN) != 0) {
+      return 0; /* let ip4_input() count it */
+    }
+  }
+  ip4_addr_copy(src, iphdr->src);
+  if (ip4_addr_isbroadcast(&src, netif) || ip4_addr_ismulticast(&src)) {
+    return 0;
+  }
+
+  ICMP_STATS_INC(icmp.recv);
+  MIB2_STATS_INC(mib2.icmpinmsgs);
+  MIB2_STATS_INC(mib2.icmpinechos);
+  if (!icmp_fast_allow(&src)) {
+    ethernetif->stats.icmp_limited++;
+    pbuf_free(p);
+    return 1;
+  }
+
+  /* trim the core's padding to the IP packet */
+  pbuf_realloc(p, SIZEOF_ETH_HDR + len);
+
+  memcpy(&ethhdr->dest, &ethhdr->src, ETH_HWADDR_LEN);
+  memcpy(&ethhdr->src, netif->hwaddr, ETH_HWADDR_LEN);
+  /* swapping the addresses leaves both checksums as they are */
+  ip4_addr_copy(iphdr->src, iphdr->dest);
+  ip4_addr_copy(iphdr->dest, src);
+
+  old = ((u16_t *)iphdr)[4];
+  IPH_TTL_SET(iphdr, ICMP_TTL);
+  IF__NETIF_CHECKSUM_ENABLED(netif, NETIF_CHECKSUM_GEN_IP) {
+    IPH_CHKSUM_SET(iphdr, csum_adjust(IPH_CHKSUM(iphdr), old, ((u16_t *)iphdr)[4]));
+  } else {
+    IPH_CHKSUM_SET(iphdr, 0);
+  }
+  old = *(u16_t *)echo;
+  ICMPH_TYPE_SET(echo, ICMP_ER);
+  IF__NETIF_CHECKSUM_ENABLED(netif, NETIF_CHECKSUM_GEN_ICMP) {
+    echo->chksum = csum_adjust(echo->chksum, old, *(u16_t *)echo);
+  } else {
+    echo->chksum = 0;
+  }
+
+  ICMP_STATS_INC(icmp.xmit);
+  MIB2_STATS_INC(mib2.icmpoutmsgs);
+  MIB2_STATS_INC(mib2.icmpoutechoreps);
+  if (ethernetif_tx_queue(netif, p, NULL, NULL, NULL) == ERR_OK) {
+    ethernetif->stats.icmp_fast++;
+  } else {
+    ethernetif->stats.tx_drops++;
+#if FTRACE_ENABLE
+    if (ALL_TRACED(ethernetif)) {
+      ftrace_add_pbuf(FTRACE_TX, FTRACE_DROP_TXFULL, timebase_stamp(), p,
+                      ETH_PAD_SIZE);
+    }
+#endif /* FTRACE_ENABLE */
+  }
+  pbuf_free(p);
+  return 1;
+}
+#endif /* ETH_ICMP_FAST */
+
 /**
  * This function should be called when a packet is ready to be read
  * from the interface. It uses the function low_level_input() that
@@ -251,27 +1693,144 @@ low_level_input(struct netif *netif)
  * the appropriate input function is called.
  *
  * @param netif the lwip network interface structure for this ethernetif
+ * @param p the received frame
+ * @param rule the classifier rule it matched, or NULL
  */
 static void
-ethernetif_input(struct netif *netif)
+ethernetif_input(struct netif *netif, struct pbuf *p,
+                 const struct ethernetif_rx_rule *rule)
 {
-  struct ethernetif *ethernetif;
-  struct eth_hdr *ethhdr;
+  struct ethernetif *ethernetif = netif->state;
+  struct eth_hdr *ethhdr = (struct eth_hdr *)p->payload;
+
+  /* a classifier rule's handler, then the raw EtherType, bypass the stack */
+  if (rule != NULL && rule->action == ETHERNETIF_RX_HANDLER) {
+    CYCLE_STATS_ENTER(CYCLES_APP);
+    rule->fn(netif, p);
+    CYCLE_STATS_EXIT();
+    return;
+  }
+  if (rule == NULL && ethernetif->raw_input != NULL && p->len > SIZEOF_ETH_HDR &&
+      ethhdr->type == ethernetif->raw_type) {
+    CYCLE_STATS_ENTER(CYCLES_APP);
+    ethernetif->raw_input(netif, p);
+    CYCLE_STATS_EXIT();
+    return;
+  }
+
+#if ETH_ICMP_FAST
+  if (rule == NULL && rx_icmp_echo(netif, p)) {
+    return;
+  }
+#endif /* ETH_ICMP_FAST */
+
+  /* pass all packets to ethernet_input, which decides what packets it supports */
+  CYCLE_STATS_ENTER(CYCLES_ETHERNET);
+  if (netif->input(p, netif) != ERR_OK) {
+    LWIP_DEBUGF(NETIF_DEBUG, ("ethernetif_input: IP input error\n"));
+    pbuf_free(p);
+  }
+  CYCLE_STATS_EXIT();
+}
+
+/**
+ * Unmask the core's interrupt, now or rx_irq.coalesce_ms from now
+ */
+static void
+rx_irq_rearm(struct ethernetif *ethernetif)
+{
+  if (ethernetif->rx_irq.coalesce_ms) {
+    timer_start(&ethernetif->rx_coalesce, ethernetif->rx_irq.coalesce_ms, 0);
+  } else {
+    intr_enable((u8_t)ethernetif->intr_id);
+  }
+}
+
+static void
+rx_coalesce_fn(void *arg)
+{
+  struct ethernetif *ethernetif = (struct ethernetif *)arg;
+
+  intr_enable((u8_t)ethernetif->intr_id);
+}
+
+/**
+ * Pass up to ETH_RX_BUDGET frames waiting in the core's RX buffer up the
+ * stack and advance the TX queue.  Must be called regularly from the main
+ * loop while ethernetif_polled() says so.  For a core with an interrupt,
+ * which is masked whenever this runs, a pass that takes a full budget
+ * leaves it masked and the core polled; one that empties the core unmasks
+ * it again.
+ *
+ * @param netif the lwip network interface structure for this ethernetif
+ * @return number of frames received
+ */
+int
+ethernetif_poll(struct netif *netif)
+{
+  struct ethernetif *ethernetif = netif->state;
+  struct ethernetif_rx_rule *rule;
   struct pbuf *p;
+  int count = 0;
 
-  ethernetif = netif->state;
+  CYCLE_STATS_ENTER(CYCLES_NETIF_RX);
+  while (count < ETH_RX_BUDGET &&
+         (p = low_level_input(netif, &rule)) != NULL) {
+    ethernetif_input(netif, p, rule);
+    count++;
+  }
 
-  /* move received packet into a new pbuf */
-  p = low_level_input(netif);
-  /* if no packet could be read, silently ignore this */
-  if (p != NULL) {
-    /* pass all packets to ethernet_input, which decides what packets it supports */
-    if (netif->input(p, netif) != ERR_OK) {
-      LWIP_DEBUGF(NETIF_DEBUG, ("ethernetif_input: IP input error\n"));
-      pbuf_free(p);
-      p = NULL;
+  low_level_tx_service(netif);
+  CYCLE_STATS_EXIT();
+
+  if (count == ETH_RX_BUDGET) {
+    ethernetif->rx_irq.full_passes++;
+  }
+  if (ethernetif->intr_id >= 0) {
+    if (count == ETH_RX_BUDGET) {
+      if (!ethernetif->rx_irq.polling) {
+        ethernetif->rx_irq.polling = 1;
+        ethernetif->rx_irq.polls++;
+      }
+    } else {
+      ethernetif->rx_irq.polling = 0;
+      rx_irq_rearm(ethernetif);
     }
   }
+
+  return count;
+}
+
+/**
+ * Deferred work scheduled by ethernetif_isr(): the first pass over the
+ * core, which unmasks its interrupt again or leaves it polled.
+ */
+static void
+ethernetif_work(void *arg)
+{
+  struct netif *netif = (struct netif *)arg;
+  struct ethernetif *ethernetif = netif->state;
+
+  ethernetif->rx_irq.interrupts++;
+  ethernetif_poll(netif);
+}
+
+/**
+ * Interrupt handler for the core.  The interrupt is level sensitive and
+ * stays asserted until the RX buffer has been drained, so mask it at the
+ * INTC and leave the frame handling to ethernetif_work().
+ */
+static void
+ethernetif_isr(void *ref)
+{
+  struct netif *netif = (struct netif *)ref;
+  struct ethernetif *ethernetif = netif->state;
+
+  intr_disable((u8_t)ethernetif->intr_id);
+  if (work_schedule(&ethernetif->intr_work) != 0) {
+    /* queue full: leave the line enabled so we come back here */
+    intr_enable((u8_t)ethernetif->intr_id);
+  }
 }
 
 /**
@@ -279,11 +1838,12 @@ ethernetif_input(struct netif *netif)
  * network interface. It calls the function low_level_init() to do the
  * actual setup of the hardware.
  *
- * This function should be passed as a parameter to netif_add().
+ * This function should be passed as a parameter to netif_add(), with
+ * ethernetif_core() as the state.  If netif->state is NULL the interface
+ * drives eth0.
  *
  * @param netif the lwip network interface structure for this ethernetif
  * @return ERR_OK if the loopif is initialized
- *         ERR_MEM if private data couldn't be allocated
  *         any other err_t on error
  */
 err_t
@@ -293,43 +1853,234 @@ ethernetif_init(struct netif *netif)
 
   LWIP_ASSERT("netif != NULL", (netif != NULL));
 
-  ethernetif = mem_malloc(sizeof(struct ethernetif));
-  if (ethernetif == NULL) {
-    LWIP_DEBUGF(NETIF_DEBUG, ("ethernetif_init: out of memory\n"));
-    return ERR_MEM;
+  if (netif->state == NULL) {
+    netif->state = &eth_states[0];
   }
+  ethernetif = netif->state;
 
 #if LWIP_NETIF_HOSTNAME
   /* Initialize interface hostname */
-  netif->hostname = "lwip";
+  netif->hostname = "jam";
 #endif /* LWIP_NETIF_HOSTNAME */
 
   /*
    * Initialize the snmp variables and counters inside the struct netif.
-   * The last argument should be replaced with your link speed, in units
-   * of bits per second.
+   * ifSpeed saturates at 2^32-1 for links faster than 4 Gbps.
    */
-  MIB2_INIT_NETIF(netif, snmp_ifType_ethernet_csmacd, LINK_SPEED_OF_YOUR_NETIF_IN_BPS);
+  MIB2_INIT_NETIF(netif, snmp_ifType_ethernet_csmacd, 0xffffffffUL);
 
-  netif->state = ethernetif;
   netif->name[0] = IFNAME0;
   netif->name[1] = IFNAME1;
-  /* We directly use etharp_output() here to save a function call.
-   * You can instead declare your own function an call etharp_output()
-   * from it if you have to do some checks before sending (e.g. if link
-   * is available...) */
+  /* We directly use etharp_output() here to save a function call. */
   netif->output = etharp_output;
-#if LWIP_IPV6
-  netif->output_ip6 = ethip6_output;
-#endif /* LWIP_IPV6 */
   netif->linkoutput = low_level_output;
-
-  ethernetif->ethaddr = (struct eth_addr *)&(netif->hwaddr[0]);
+#if LWIP_IGMP
+  netif_set_igmp_mac_filter(netif, ethernetif_mac_filter);
+#endif /* LWIP_IGMP */
 
   /* initialize the hardware */
   low_level_init(netif);
 
+  /* Offload whatever the gateware can do */
+  ethernetif_set_csum_offload(netif, ethernetif->csum_caps);
+
+  if (ethernetif->intr_id >= 0) {
+    ethernetif->intr_work.fn = ethernetif_work;
+    ethernetif->intr_work.arg = netif;
+    ethernetif->rx_coalesce.fn = rx_coalesce_fn;
+    ethernetif->rx_coalesce.arg = ethernetif;
+    ethernetif->rx_irq.coalesce_ms = ETH_RX_COALESCE_MS;
+    intr_connect((u8_t)ethernetif->intr_id, ethernetif_isr, netif);
+  }
+
+  return ERR_OK;
+}
+
+/**
+ * Driver state for core ethN, to pass to netif_add() with
+ * ethernetif_init().  eth0 is the core of eth.h's ETH0_BASE_ADDRESS; the
+ * others are the devices called "eth1" and so on in the register map
+ * (wbmap.h).  Each may be added once.
+ *
+ * @param n the core's number, below ETH_MAX_CORES
+ * @return the state, or NULL if the register map has no such core
+ */
+void *
+ethernetif_core(u8_t n)
+{
+  struct ethernetif *ethernetif;
+  const struct wbmap_entry *e;
+  char name[] = "eth0";
+
+  if (n >= ETH_MAX_CORES) {
+    return NULL;
+  }
+  ethernetif = &eth_states[n];
+  if (n == 0) {
+    return ethernetif;
+  }
+  name[3] = (char)('0' + n);
+  e = wbmap_find(name);
+  if (e == NULL) {
+    return NULL;
+  }
+  ethernetif->base = XPAR_AXI_SLAVE_WISHBONE_CLASSIC_MASTER_0_BASEADDR +
+      e->offset;
+  ethernetif->intr_id = eth_intr_ids[n];
+  /* Only eth0's gateware is known to offload anything */
+  ethernetif->csum_caps = 0;
+  return ethernetif;
+}
+
+/**
+ * Whether this driver runs a netif.  Code walking netif_list skips the
+ * others (the SLIP link of slipnet.h) before using ethernetif_ calls.
+ */
+int
+ethernetif_is(struct netif *netif)
+{
+  return netif->linkoutput == low_level_output;
+}
+
+/**
+ * Whether the main loop must call ethernetif_poll() for a netif, because
+ * its core's interrupt is not routed or is masked under load
+ */
+int
+ethernetif_polled(struct netif *netif)
+{
+  struct ethernetif *ethernetif = netif->state;
+
+  return ethernetif->intr_id < 0 || ethernetif->rx_irq.polling;
+}
+
+/**
+ * How the core's RX is running: interrupt or polled, and the counts of
+ * each.  For a core without an interrupt only full_passes counts.
+ */
+const struct ethernetif_rx_irq *
+ethernetif_rx_irq(struct netif *netif)
+{
+  struct ethernetif *ethernetif = netif->state;
+
+  return &ethernetif->rx_irq;
+}
+
+/**
+ * Keep the core's interrupt masked for a while after each pass that empties
+ * the core, so that the frames arriving meanwhile are taken together.
+ * Takes effect from the next such pass.
+ *
+ * @param netif the lwip network interface structure for this ethernetif
+ * @param ms the time, 0 to unmask at once
+ * @return ERR_OK, or ERR_ARG if the core has no interrupt
+ */
+err_t
+ethernetif_set_rx_coalesce(struct netif *netif, u8_t ms)
+{
+  struct ethernetif *ethernetif = netif->state;
+
+  if (ethernetif->intr_id < 0) {
+    return ERR_ARG;
+  }
+  ethernetif->rx_irq.coalesce_ms = ms;
   return ERR_OK;
 }
 
-#endif /* 0 */
+/**
+ * @return the number of the core a netif drives (see ethernetif_core())
+ */
+u8_t
+ethernetif_core_num(struct netif *netif)
+{
+  return (u8_t)((struct ethernetif *)netif->state - eth_states);
+}
+
+/**
+ * @return the bus address of the registers of the core a netif drives
+ */
+u32_t
+ethernetif_base(struct netif *netif)
+{
+  struct ethernetif *ethernetif = netif->state;
+
+  return ethernetif->base;
+}
+
+/**
+ * When the frame being received was found in the core, for software
+ * timestamping (ptp.h).  Only meaningful while the stack handles that
+ * frame, e.g. from a UDP receive callback.
+ *
+ * @return its timebase_stamp()
+ */
+u32_t
+ethernetif_rx_stamp(struct netif *netif)
+{
+  struct ethernetif *ethernetif = netif->state;
+
+  return ethernetif->rx_stamp;
+}
+
+/**
+ * Timestamp the frame that holds p (the pbuf sent, or any pbuf of the
+ * chain handed to netif->linkoutput) as it goes to the core and as the
+ * core finishes sending it, for ethernetif_tx_stamps().  Send p after
+ * this call.  Only the last ETHERNETIF_TX_STAMPS frames asked for are
+ * kept; a frame never sent just loses its slot to a later one.
+ *
+ * @return the handle of the stamps
+ */
+u32_t
+ethernetif_tx_stamp(struct netif *netif, struct pbuf *p)
+{
+  struct ethernetif *ethernetif = netif->state;
+  u32_t handle = ethernetif->tx_stamp_next++;
+  struct ethernetif_tx_stamp *st =
+      &ethernetif->tx_stamps[handle % ETHERNETIF_TX_STAMPS];
+
+  if (st->p != NULL && !(st->state & ETHERNETIF_STAMP_DONE)) {
+    ethernetif->tx_stamps_waiting--;
+  }
+  st->p = p;
+  st->handle = handle;
+  st->state = 0;
+  ethernetif->tx_stamps_waiting++;
+  return handle;
+}
+
+/**
+ * @param handle from ethernetif_tx_stamp()
+ * @param sent receives the timebase_stamp() of the frame going to the core
+ * @param done receives the timebase_stamp() of the driver finding the core
+ *        done with it
+ * @return ETHERNETIF_STAMP_* of the stamps taken so far, or -1 if the
+ *         slot has gone to a later frame
+ */
+int
+ethernetif_tx_stamps(struct netif *netif, u32_t handle,
+                     u32_t *sent, u32_t *done)
+{
+  struct ethernetif *ethernetif = netif->state;
+  struct ethernetif_tx_stamp *st =
+      &ethernetif->tx_stamps[handle % ETHERNETIF_TX_STAMPS];
+
+  if (st->p == NULL || st->handle != handle) {
+    return -1;
+  }
+  *sent = st->sent;
+  *done = st->done;
+  return st->state;
+}
+
+/**
+ * Copy the frame and byte counts of a netif since it was added.  Bytes
+ * include ETH_PAD_SIZE.
+ */
+void
+ethernetif_stats(struct netif *netif, struct ethernetif_stats *stats)
+{
+  struct ethernetif *ethernetif = netif->state;
+
+  *stats = ethernetif->stats;
+}
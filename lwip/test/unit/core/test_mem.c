@@ -1,11 +1,15 @@
 #include "test_mem.h"
 
 #include "lwip/mem.h"
+#include "lwip/memp.h"
 #include "lwip/stats.h"
 
 #if !LWIP_STATS || !MEM_STATS
 #error "This tests needs MEM-statistics enabled"
 #endif
+#if !MEMP_STATS || !MEMP_FAIL_TRACE
+#error "This tests needs MEMP-statistics and the failure trace enabled"
+#endif
 #if LWIP_DNS
 #error "This test needs DNS turned off (as it mallocs on init)"
 #endif
@@ -109,13 +113,55 @@ START_TEST(test_mem_random)
 }
 END_TEST
 
+/** Empty a memp pool and check its high-water mark and the failure trace */
+START_TEST(test_memp_fail_trace)
+{
+  void *elem[MEMP_NUM_UDP_PCB];
+  const struct memp_fail *f;
+  u32_t fails;
+  int i;
+  LWIP_UNUSED_ARG(_i);
+
+  fail_unless(lwip_stats.memp[MEMP_UDP_PCB]->used == 0);
+  fails = memp_fail_count();
+
+  for (i = 0; i < MEMP_NUM_UDP_PCB; i++) {
+    elem[i] = memp_malloc(MEMP_UDP_PCB);
+    fail_unless(elem[i] != NULL);
+  }
+  fail_unless(memp_fail_count() == fails);
+
+  /* One failure more than the trace holds */
+  for (i = 0; i <= MEMP_FAIL_TRACE; i++) {
+    fail_unless(memp_malloc(MEMP_UDP_PCB) == NULL);
+  }
+  fail_unless(memp_fail_count() == fails + MEMP_FAIL_TRACE + 1);
+  fail_unless(memp_fail_get(fails) == NULL);
+  f = memp_fail_get(fails + MEMP_FAIL_TRACE);
+  fail_unless(f != NULL);
+  if (f != NULL) {
+    fail_unless(f->type == MEMP_UDP_PCB);
+    fail_unless(f->origin == NULL);
+  }
+  fail_unless(memp_fail_get(fails + MEMP_FAIL_TRACE + 1) == NULL);
+
+  for (i = 0; i < MEMP_NUM_UDP_PCB; i++) {
+    memp_free(MEMP_UDP_PCB, elem[i]);
+  }
+  fail_unless(lwip_stats.memp[MEMP_UDP_PCB]->used == 0);
+  fail_unless(lwip_stats.memp[MEMP_UDP_PCB]->max == MEMP_NUM_UDP_PCB);
+  fail_unless(lwip_stats.memp[MEMP_UDP_PCB]->err >= MEMP_FAIL_TRACE + 1);
+}
+END_TEST
+
 /** Create the suite including all tests for this module */
 Suite *
 mem_suite(void)
 {
   testfunc tests[] = {
     TESTFUNC(test_mem_one),
-    TESTFUNC(test_mem_random)
+    TESTFUNC(test_mem_random),
+    TESTFUNC(test_memp_fail_trace)
   };
   return create_suite("MEM", tests, sizeof(tests)/sizeof(testfunc), mem_setup, mem_teardown);
 }
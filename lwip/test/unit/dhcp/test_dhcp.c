@@ -120,7 +120,8 @@ static enum tcase {
   TEST_LWIP_DHCP,
   TEST_LWIP_DHCP_NAK,
   TEST_LWIP_DHCP_RELAY,
-  TEST_LWIP_DHCP_NAK_NO_ENDMARKER
+  TEST_LWIP_DHCP_NAK_NO_ENDMARKER,
+  TEST_LWIP_DHCP_REBOOT
 } tcase;
 
 static int debug = 0;
@@ -418,6 +419,49 @@ static err_t lwip_tx_func(struct netif *netif, struct pbuf *p)
     }
     break;
 
+  case TEST_LWIP_DHCP_REBOOT:
+    if (netif_dhcp_data(netif)->state == DHCP_STATE_BOUND) {
+      /* Gratuitous ARP for the address just taken */
+      const u8_t arpproto[] = { 0x08, 0x06 };
+
+      check_pkt(p, 12, arpproto, sizeof(arpproto)); /* eth level proto: arp */
+      break;
+    }
+    {
+      const u8_t ipproto[] = { 0x08, 0x00 };
+      const u8_t bootp_start[] = { 0x01, 0x01, 0x06, 0x00}; /* bootp request, eth, hwaddr len 6, 0 hops */
+      const u8_t ipaddrs[] = { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 };
+
+      check_pkt(p, 0, broadcast, 6); /* eth level dest: broadcast */
+      check_pkt(p, 6, netif->hwaddr, 6); /* eth level src: unit mac */
+
+      check_pkt(p, 12, ipproto, sizeof(ipproto)); /* eth level proto: ip */
+
+      check_pkt(p, 42, bootp_start, sizeof(bootp_start));
+
+      check_pkt(p, 53, ipaddrs, sizeof(ipaddrs)); /* no ciaddr in INIT-REBOOT */
+
+      check_pkt(p, 70, netif->hwaddr, 6); /* mac addr inside bootp */
+
+      check_pkt(p, 278, magic_cookie, sizeof(magic_cookie));
+
+      if (txpacket <= 2) {
+        /* REBOOT_TRIES requests for the cached address... */
+        u8_t dhcp_request_opt[] = { 0x35, 0x01, 0x03 };
+        u8_t requested_ipaddr[] = { 0x32, 0x04, 0xc3, 0xaa, 0xbd, 0xc8 };
+
+        check_pkt_fuzzy(p, 282, dhcp_request_opt, sizeof(dhcp_request_opt));
+        check_pkt_fuzzy(p, 282, requested_ipaddr, sizeof(requested_ipaddr));
+      } else {
+        /* ...then back to discovery */
+        u8_t dhcp_discover_opt[] = { 0x35, 0x01, 0x01 };
+
+        fail_unless(txpacket == 3);
+        check_pkt_fuzzy(p, 282, dhcp_discover_opt, sizeof(dhcp_discover_opt));
+      }
+      break;
+    }
+
   default:
     break;
   }
@@ -905,6 +949,90 @@ START_TEST(test_dhcp_nak_no_endmarker)
 END_TEST
 
 
+/*
+ * Test that a client started with a cached address asks for it straight
+ * away and takes it from the ACK.
+ */
+START_TEST(test_dhcp_reboot)
+{
+  ip4_addr_t addr;
+  ip4_addr_t netmask;
+  ip4_addr_t gw;
+  u32_t xid;
+  LWIP_UNUSED_ARG(_i);
+
+  tcase = TEST_LWIP_DHCP_REBOOT;
+  setdebug(0);
+
+  IP4_ADDR(&addr, 0, 0, 0, 0);
+  IP4_ADDR(&netmask, 0, 0, 0, 0);
+  IP4_ADDR(&gw, 0, 0, 0, 0);
+
+  netif_add(&net_test, &addr, &netmask, &gw, &net_test, testif_init, ethernet_input);
+  netif_set_up(&net_test);
+
+  IP4_ADDR(&addr, 195, 170, 189, 200);
+  dhcp_start_reboot(&net_test, &addr);
+
+  fail_unless(txpacket == 1); /* DHCP request sent, no discover */
+  fail_unless(netif_dhcp_data(&net_test)->state == DHCP_STATE_REBOOTING);
+  xid = htonl(netif_dhcp_data(&net_test)->xid);
+  memcpy(&dhcp_ack[46], &xid, 4); /* insert transaction id */
+  send_pkt(&net_test, dhcp_ack, sizeof(dhcp_ack));
+
+  fail_unless(txpacket == 2); /* Bound without an ARP check, announced */
+  fail_unless(netif_dhcp_data(&net_test)->state == DHCP_STATE_BOUND);
+
+  IP4_ADDR(&netmask, 255, 255, 255, 0);
+  IP4_ADDR(&gw, 195, 170, 189, 171);
+  fail_if(memcmp(&addr, &net_test.ip_addr, sizeof(ip4_addr_t)));
+  fail_if(memcmp(&netmask, &net_test.netmask, sizeof(ip4_addr_t)));
+  fail_if(memcmp(&gw, &net_test.gw, sizeof(ip4_addr_t)));
+
+  netif_remove(&net_test);
+}
+END_TEST
+
+/*
+ * Test that a cached address nobody answers for is given up for
+ * discovery.
+ */
+START_TEST(test_dhcp_reboot_timeout)
+{
+  ip4_addr_t addr;
+  ip4_addr_t netmask;
+  ip4_addr_t gw;
+  int i;
+  LWIP_UNUSED_ARG(_i);
+
+  tcase = TEST_LWIP_DHCP_REBOOT;
+  setdebug(0);
+
+  IP4_ADDR(&addr, 0, 0, 0, 0);
+  IP4_ADDR(&netmask, 0, 0, 0, 0);
+  IP4_ADDR(&gw, 0, 0, 0, 0);
+
+  netif_add(&net_test, &addr, &netmask, &gw, &net_test, testif_init, ethernet_input);
+  netif_set_up(&net_test);
+
+  IP4_ADDR(&addr, 195, 170, 189, 200);
+  dhcp_start_reboot(&net_test, &addr);
+  fail_unless(txpacket == 1);
+
+  /* Timeouts of 1 and 2 seconds */
+  for (i = 0; i < 40; i++) {
+    tick_lwip();
+  }
+  fail_unless(txpacket == 3, "TX %d packets, expected 3", txpacket);
+  fail_unless(netif_dhcp_data(&net_test)->state == DHCP_STATE_SELECTING);
+  IP4_ADDR(&addr, 0, 0, 0, 0);
+  fail_if(memcmp(&addr, &net_test.ip_addr, sizeof(ip4_addr_t)));
+
+  netif_remove(&net_test);
+}
+END_TEST
+
+
 /** Create the suite including all tests for this module */
 Suite *
 dhcp_suite(void)
@@ -913,7 +1041,9 @@ dhcp_suite(void)
     TESTFUNC(test_dhcp),
     TESTFUNC(test_dhcp_nak),
     TESTFUNC(test_dhcp_relayed),
-    TESTFUNC(test_dhcp_nak_no_endmarker)
+    TESTFUNC(test_dhcp_nak_no_endmarker),
+    TESTFUNC(test_dhcp_reboot),
+    TESTFUNC(test_dhcp_reboot_timeout)
   };
   return create_suite("DHCP", tests, sizeof(tests)/sizeof(testfunc), dhcp_setup, dhcp_teardown);
 }
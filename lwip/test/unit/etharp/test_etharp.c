@@ -257,13 +257,71 @@ START_TEST(test_etharp_table)
 }
 END_TEST
 
+/* Entries found through the hash index survive removal of entries before
+   and after them on the same chain */
+START_TEST(test_etharp_hash)
+{
+  err_t err;
+  s8_t idx;
+  const ip4_addr_t *unused_ipaddr;
+  struct eth_addr *unused_ethaddr;
+  ip4_addr_t adrs[ARP_TABLE_SIZE];
+  int i;
+  LWIP_UNUSED_ARG(_i);
+
+  for(i = 0; i < ARP_TABLE_SIZE; i++) {
+    IP4_ADDR(&adrs[i], 192,168,0,i+2);
+    err = etharp_add_static_entry(&adrs[i], &test_ethaddr3);
+    fail_unless(err == ERR_OK);
+  }
+  for(i = 0; i < ARP_TABLE_SIZE; i++) {
+    idx = etharp_find_addr(NULL, &adrs[i], &unused_ethaddr, &unused_ipaddr);
+    fail_unless(idx == i);
+  }
+  /* the table is full: a new address is neither found nor added */
+  {
+    ip4_addr_t other;
+    IP4_ADDR(&other, 192,168,0,200);
+    idx = etharp_find_addr(NULL, &other, &unused_ethaddr, &unused_ipaddr);
+    fail_unless(idx == -1);
+    err = etharp_add_static_entry(&other, &test_ethaddr4);
+    fail_unless(err == ERR_MEM);
+  }
+
+  /* remove every other entry */
+  for(i = 0; i < ARP_TABLE_SIZE; i += 2) {
+    err = etharp_remove_static_entry(&adrs[i]);
+    fail_unless(err == ERR_OK);
+  }
+  for(i = 0; i < ARP_TABLE_SIZE; i++) {
+    idx = etharp_find_addr(NULL, &adrs[i], &unused_ethaddr, &unused_ipaddr);
+    fail_unless(idx == ((i & 1) ? i : -1));
+  }
+
+  /* add them back (into the entries they left) and remove all */
+  for(i = 0; i < ARP_TABLE_SIZE; i += 2) {
+    err = etharp_add_static_entry(&adrs[i], &test_ethaddr3);
+    fail_unless(err == ERR_OK);
+    idx = etharp_find_addr(NULL, &adrs[i], &unused_ethaddr, &unused_ipaddr);
+    fail_unless(idx == i);
+  }
+  for(i = ARP_TABLE_SIZE - 1; i >= 0; i--) {
+    err = etharp_remove_static_entry(&adrs[i]);
+    fail_unless(err == ERR_OK);
+    idx = etharp_find_addr(NULL, &adrs[i], &unused_ethaddr, &unused_ipaddr);
+    fail_unless(idx == -1);
+  }
+}
+END_TEST
+
 
 /** Create the suite including all tests for this module */
 Suite *
 etharp_suite(void)
 {
   testfunc tests[] = {
-    TESTFUNC(test_etharp_table)
+    TESTFUNC(test_etharp_table),
+    TESTFUNC(test_etharp_hash)
   };
   return create_suite("ETHARP", tests, sizeof(tests)/sizeof(testfunc), etharp_setup, etharp_teardown);
 }
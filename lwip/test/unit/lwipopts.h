@@ -49,6 +49,7 @@
 #define TCP_WND                         (10 * TCP_MSS)
 #define LWIP_WND_SCALE                  1
 #define TCP_RCV_SCALE                   0
+#define LWIP_TCP_SACK_OUT               1
 #define PBUF_POOL_SIZE                  400 /* pbuf tests need ~200KByte */
 
 /* Enable IGMP and MDNS for MDNS tests */
@@ -58,5 +59,27 @@
 
 /* Minimal changes to opt.h required for etharp unit tests: */
 #define ETHARP_SUPPORT_STATIC_ENTRIES   1
+/* Few hash chains so that the ARP table tests make entries share them */
+#define ETHARP_TABLE_HASH               1
+#define ETHARP_HASH_SIZE                2
+/* Likewise for the UDP and TCP PCB indexes */
+#define UDP_PCB_HASH                    1
+#define UDP_HASH_SIZE                   2
+#define TCP_PCB_HASH                    1
+#define TCP_HASH_SIZE                   2
+
+/* Reassembly limits for the UDP tests: few enough pbufs per source to hit,
+   more datagrams than that in all */
+#define IP_REASS_MAX_PBUFS_PER_SRC      3
+#define MEMP_NUM_REASSDATA              5
+#define IP_REASS_REJECT_UDP(port)       ((port) == 7000)
+
+/* Remember the last few memp_malloc() failures */
+#define MEMP_FAIL_TRACE                 4
+
+/* Per-layer cycle counts, on a clock that ticks once per read */
+#define LWIP_CYCLE_STATS                1
+extern unsigned int lwip_test_cycle_stamp;
+#define LWIP_CYCLE_STAMP()              (++lwip_test_cycle_stamp)
 
 #endif /* LWIP_HDR_LWIPOPTS_H */
@@ -10,6 +10,8 @@
 #error "This tests needs TCP- and MEMP-statistics enabled"
 #endif
 
+unsigned int lwip_test_cycle_stamp;
+
 /** Remove all pcbs on the given list. */
 static void
 tcp_remove(struct tcp_pcb* pcb_list)
@@ -145,11 +147,12 @@ tcp_set_state(struct tcp_pcb* pcb, enum tcp_state state, ip_addr_t* local_ip,
   /* @todo: remove from previous list */
   pcb->state = state;
   if (state == ESTABLISHED) {
-    TCP_REG(&tcp_active_pcbs, pcb);
+    /* addresses first: TCP_PCB_HASH chains the PCB by them */
     pcb->local_ip.addr = local_ip->addr;
     pcb->local_port = local_port;
     pcb->remote_ip.addr = remote_ip->addr;
     pcb->remote_port = remote_port;
+    TCP_REG_ACTIVE(pcb);
   } else if(state == LISTEN) {
     TCP_REG(&tcp_listen_pcbs.pcbs, pcb);
     pcb->local_ip.addr = local_ip->addr;
@@ -72,6 +72,119 @@ START_TEST(test_tcp_new_abort)
 }
 END_TEST
 
+/** Check that the receive callback is charged to the application layer and
+ * the rest to the layer tcp_input was entered as */
+START_TEST(test_tcp_cycle_stats)
+{
+  struct test_tcp_counters counters;
+  struct tcp_pcb* pcb;
+  struct pbuf* p;
+  char data[] = {1, 2, 3, 4};
+  ip_addr_t remote_ip, local_ip, netmask;
+  u16_t remote_port = 0x100, local_port = 0x101;
+  struct netif netif;
+  struct test_tcp_txcounters txcounters;
+  u8_t i;
+  LWIP_UNUSED_ARG(_i);
+
+  memset(&netif, 0, sizeof(netif));
+  IP_ADDR4(&local_ip, 192, 168, 1, 1);
+  IP_ADDR4(&remote_ip, 192, 168, 1, 2);
+  IP_ADDR4(&netmask,   255, 255, 255, 0);
+  test_tcp_init_netif(&netif, &txcounters, &local_ip, &netmask);
+  memset(&counters, 0, sizeof(counters));
+  counters.expected_data_len = sizeof(data);
+  counters.expected_data = data;
+
+  pcb = test_tcp_new_counters_pcb(&counters);
+  EXPECT_RET(pcb != NULL);
+  tcp_set_state(pcb, ESTABLISHED, &local_ip, &remote_ip, local_port, remote_port);
+  p = tcp_create_rx_segment(pcb, counters.expected_data, sizeof(data), 0, 0, 0);
+  EXPECT_RET(p != NULL);
+
+  stats_cycles_reset();
+  stats_cycles_enter(CYCLES_TCP);
+  test_tcp_input(p, &netif);
+  stats_cycles_exit();
+  EXPECT(counters.recv_calls == 1);
+
+  EXPECT(lwip_cycle_stats.layer[CYCLES_TCP].calls == 1);
+  EXPECT(lwip_cycle_stats.layer[CYCLES_APP].calls == 1);
+  /* the stamp ticks once per change of layer */
+  EXPECT(lwip_cycle_stats.layer[CYCLES_OTHER].cycles == 1);
+  EXPECT(lwip_cycle_stats.layer[CYCLES_TCP].cycles == 2);
+  EXPECT(lwip_cycle_stats.layer[CYCLES_APP].cycles == 1);
+  for (i = 0; i < CYCLES_NUM_LAYERS; i++) {
+    if (i != CYCLES_TCP && i != CYCLES_APP) {
+      EXPECT(lwip_cycle_stats.layer[i].calls == 0);
+    }
+  }
+
+  /* back outside the stack */
+  lwip_test_cycle_stamp += 10;
+  stats_cycles_enter(CYCLES_IP);
+  stats_cycles_exit();
+  EXPECT(lwip_cycle_stats.layer[CYCLES_OTHER].cycles == 12);
+
+  tcp_abort(pcb);
+}
+END_TEST
+
+/** Segments reach their own connection among several from two hosts to
+ * one port, sharing hash chains (TCP_PCB_HASH), also once one is gone */
+START_TEST(test_tcp_demux)
+{
+  struct test_tcp_counters counters[4];
+  struct tcp_pcb* pcb[4];
+  struct pbuf* p;
+  char data[] = {1, 2, 3, 4};
+  ip_addr_t remote_ip[2], local_ip, netmask;
+  u16_t local_port = 0x101;
+  struct netif netif;
+  struct test_tcp_txcounters txcounters;
+  int i;
+  LWIP_UNUSED_ARG(_i);
+
+  memset(&netif, 0, sizeof(netif));
+  IP_ADDR4(&local_ip, 192, 168, 1, 1);
+  IP_ADDR4(&remote_ip[0], 192, 168, 1, 2);
+  IP_ADDR4(&remote_ip[1], 192, 168, 1, 3);
+  IP_ADDR4(&netmask,   255, 255, 255, 0);
+  test_tcp_init_netif(&netif, &txcounters, &local_ip, &netmask);
+  memset(counters, 0, sizeof(counters));
+
+  /* two connections from each host, from ports 0x100 and 0x102 */
+  for (i = 0; i < 4; i++) {
+    pcb[i] = test_tcp_new_counters_pcb(&counters[i]);
+    EXPECT_RET(pcb[i] != NULL);
+    tcp_set_state(pcb[i], ESTABLISHED, &local_ip, &remote_ip[i / 2],
+      local_port, (u16_t)(0x100 + 2 * (i & 1)));
+  }
+  for (i = 3; i >= 0; i--) {
+    p = tcp_create_rx_segment(pcb[i], data, sizeof(data), 0, 0, 0);
+    EXPECT_RET(p != NULL);
+    test_tcp_input(p, &netif);
+  }
+  for (i = 0; i < 4; i++) {
+    EXPECT(counters[i].recv_calls == 1);
+  }
+
+  tcp_abort(pcb[1]);
+  EXPECT(counters[1].err_calls == 1);
+  for (i = 0; i < 4; i += 2) {
+    p = tcp_create_rx_segment(pcb[i], data, sizeof(data), 0, 0, 0);
+    EXPECT_RET(p != NULL);
+    test_tcp_input(p, &netif);
+    EXPECT(counters[i].recv_calls == 2);
+  }
+  EXPECT(counters[3].recv_calls == 1);
+
+  tcp_abort(pcb[0]);
+  tcp_abort(pcb[2]);
+  tcp_abort(pcb[3]);
+}
+END_TEST
+
 /** Create an ESTABLISHED pcb and check if receive callback is called */
 START_TEST(test_tcp_recv_inseq)
 {
@@ -731,6 +844,8 @@ tcp_suite(void)
   testfunc tests[] = {
     TESTFUNC(test_tcp_new_abort),
     TESTFUNC(test_tcp_recv_inseq),
+    TESTFUNC(test_tcp_demux),
+    TESTFUNC(test_tcp_cycle_stats),
     TESTFUNC(test_tcp_malformed_header),
     TESTFUNC(test_tcp_fast_retx_recover),
     TESTFUNC(test_tcp_fast_rexmit_wraparound),
@@ -1016,6 +1016,109 @@ FIN_TEST(test_tcp_recv_ooseq_double_FIN_13, 13)
 FIN_TEST(test_tcp_recv_ooseq_double_FIN_14, 14)
 FIN_TEST(test_tcp_recv_ooseq_double_FIN_15, 15)
 
+#if LWIP_TCP_SACK_OUT
+/** Check that the last packet sent is an ACK with the SACK blocks given
+ * (left and right edge of each, relative to isn) */
+static void
+check_sack(struct pbuf *tx_packets, u32_t isn, const u32_t *blocks, u8_t n)
+{
+  struct pbuf *p = tx_packets;
+  u8_t opts[40];
+  u32_t edge;
+  u16_t hdrlen;
+  u8_t i, off;
+
+  EXPECT_RET(p != NULL);
+  while (p->next != NULL) {
+    p = p->next;
+  }
+  /* the copies start at the IP header */
+  hdrlen = TCPH_HDRLEN(((struct tcp_hdr *)((u8_t *)p->payload + 20))) * 4;
+  EXPECT_RET(hdrlen >= TCP_HLEN + 4 + 8 * n && hdrlen <= TCP_HLEN + 40);
+  EXPECT_RET(pbuf_copy_partial(p, opts, hdrlen - TCP_HLEN, 20 + TCP_HLEN) == hdrlen - TCP_HLEN);
+  /* NOP, NOP, then the SACK option */
+  EXPECT(opts[0] == LWIP_TCP_OPT_NOP && opts[1] == LWIP_TCP_OPT_NOP);
+  EXPECT(opts[2] == LWIP_TCP_OPT_SACK);
+  EXPECT(opts[3] == 2 + 8 * n);
+  for (i = 0; i < 2 * n; i++) {
+    off = 4 + 4 * i;
+    edge = ((u32_t)opts[off] << 24) | ((u32_t)opts[off + 1] << 16) |
+           ((u32_t)opts[off + 2] << 8) | opts[off + 3];
+    EXPECT(edge == isn + blocks[i]);
+  }
+}
+
+/** Out-of-sequence data is reported in SACK blocks, the one with the
+ * segment received last first, and merged as the holes between fill */
+START_TEST(test_tcp_recv_ooseq_sack)
+{
+  struct test_tcp_counters counters;
+  struct test_tcp_txcounters txcounters;
+  struct tcp_pcb* pcb;
+  struct pbuf *p_8, *p_16, *p_12, *pinseq;
+  char data[20];
+  ip_addr_t remote_ip, local_ip, netmask;
+  u16_t remote_port = 0x100, local_port = 0x101;
+  struct netif netif;
+  u32_t isn;
+  static const u32_t one[] = {8, 12};
+  static const u32_t two[] = {16, 20, 8, 12};
+  static const u32_t merged[] = {8, 20};
+  u8_t i;
+  LWIP_UNUSED_ARG(_i);
+
+  for (i = 0; i < sizeof(data); i++) {
+    data[i] = (char)i;
+  }
+  memset(&netif, 0, sizeof(netif));
+  IP_ADDR4(&local_ip, 192, 168, 1, 1);
+  IP_ADDR4(&remote_ip, 192, 168, 1, 2);
+  IP_ADDR4(&netmask,   255, 255, 255, 0);
+  test_tcp_init_netif(&netif, &txcounters, &local_ip, &netmask);
+  txcounters.copy_tx_packets = 1;
+  memset(&counters, 0, sizeof(counters));
+  counters.expected_data_len = sizeof(data);
+  counters.expected_data = data;
+
+  pcb = test_tcp_new_counters_pcb(&counters);
+  EXPECT_RET(pcb != NULL);
+  tcp_set_state(pcb, ESTABLISHED, &local_ip, &remote_ip, local_port, remote_port);
+  /* as if the SYN had offered it */
+  pcb->flags |= TF_SACK;
+  isn = pcb->rcv_nxt;
+
+  pinseq = tcp_create_rx_segment(pcb, &data[0],  8,  0, 0, TCP_ACK);
+  p_8    = tcp_create_rx_segment(pcb, &data[8],  4,  8, 0, TCP_ACK);
+  p_16   = tcp_create_rx_segment(pcb, &data[16], 4, 16, 0, TCP_ACK);
+  p_12   = tcp_create_rx_segment(pcb, &data[12], 4, 12, 0, TCP_ACK);
+  EXPECT_RET(pinseq != NULL && p_8 != NULL && p_16 != NULL && p_12 != NULL);
+
+  test_tcp_input(p_8, &netif);
+  EXPECT(txcounters.num_tx_calls == 1);
+  check_sack(txcounters.tx_packets, isn, one, 1);
+
+  test_tcp_input(p_16, &netif);
+  EXPECT(txcounters.num_tx_calls == 2);
+  check_sack(txcounters.tx_packets, isn, two, 2);
+
+  test_tcp_input(p_12, &netif);
+  EXPECT(txcounters.num_tx_calls == 3);
+  check_sack(txcounters.tx_packets, isn, merged, 1);
+  EXPECT_OOSEQ(tcp_oos_count(pcb) == 3);
+
+  /* the hole is filled: everything is received */
+  test_tcp_input(pinseq, &netif);
+  EXPECT(counters.recved_bytes == sizeof(data));
+  EXPECT(pcb->ooseq == NULL);
+  EXPECT(pcb->rcv_nxt == isn + sizeof(data));
+
+  tcp_abort(pcb);
+  EXPECT(MEMP_STATS_GET(used, MEMP_TCP_PCB) == 0);
+  pbuf_free(txcounters.tx_packets);
+}
+END_TEST
+#endif /* LWIP_TCP_SACK_OUT */
+
 
 /** Create the suite including all tests for this module */
 Suite *
@@ -1043,7 +1146,10 @@ tcp_oos_suite(void)
     TESTFUNC(test_tcp_recv_ooseq_double_FIN_12),
     TESTFUNC(test_tcp_recv_ooseq_double_FIN_13),
     TESTFUNC(test_tcp_recv_ooseq_double_FIN_14),
-    TESTFUNC(test_tcp_recv_ooseq_double_FIN_15)
+    TESTFUNC(test_tcp_recv_ooseq_double_FIN_15),
+#if LWIP_TCP_SACK_OUT
+    TESTFUNC(test_tcp_recv_ooseq_sack)
+#endif
   };
   return create_suite("TCP_OOS", tests, sizeof(tests)/sizeof(testfunc), tcp_oos_setup, tcp_oos_teardown);
 }
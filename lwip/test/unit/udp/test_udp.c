@@ -2,12 +2,130 @@
 
 #include "lwip/udp.h"
 #include "lwip/stats.h"
+#include "lwip/icmp.h"
+#include "lwip/inet_chksum.h"
+#include "lwip/ip4_frag.h"
+#include "lwip/prot/icmp.h"
+#include "lwip/prot/udp.h"
+
+#include <string.h>
 
 #if !LWIP_STATS || !UDP_STATS || !MEMP_STATS
 #error "This tests needs UDP- and MEMP-statistics enabled"
 #endif
 
+static struct netif test_netif;
+static int output_ctr;
+static u8_t last_icmp_type, last_icmp_code;
+
 /* Helper functions */
+static err_t
+test_netif_output(struct netif *netif, struct pbuf *p, const ip4_addr_t *ipaddr)
+{
+  struct icmp_echo_hdr icmphdr;
+  LWIP_UNUSED_ARG(ipaddr);
+
+  fail_unless(netif == &test_netif);
+  output_ctr++;
+  if (pbuf_copy_partial(p, &icmphdr, sizeof(icmphdr), IP_HLEN) == sizeof(icmphdr)) {
+    last_icmp_type = icmphdr.type;
+    last_icmp_code = icmphdr.code;
+  }
+  return ERR_OK;
+}
+
+static err_t
+test_netif_init(struct netif *netif)
+{
+  netif->output = test_netif_output;
+  netif->mtu = 1500;
+  netif->flags = NETIF_FLAG_LINK_UP;
+  return ERR_OK;
+}
+
+/* Feed eth0 a UDP fragment from 192.168.0.`src` to `port`: its first eight
+   bytes of payload (offset 0, carrying the UDP header) or a later eight */
+static void
+input_fragment(u8_t src, u16_t id, u16_t offset, int more, u16_t port)
+{
+  struct pbuf *p = pbuf_alloc(PBUF_RAW, IP_HLEN + 8, PBUF_RAM);
+  struct ip_hdr *iphdr;
+  struct udp_hdr *udphdr;
+  ip4_addr_t addr;
+
+  fail_unless(p != NULL);
+  memset(p->payload, 0, p->len);
+  iphdr = (struct ip_hdr *)p->payload;
+  IPH_VHL_SET(iphdr, 4, IP_HLEN / 4);
+  IPH_LEN_SET(iphdr, lwip_htons(p->len));
+  IPH_ID_SET(iphdr, lwip_htons(id));
+  IPH_OFFSET_SET(iphdr, lwip_htons((offset / 8) | (more ? IP_MF : 0)));
+  IPH_TTL_SET(iphdr, 64);
+  IPH_PROTO_SET(iphdr, IP_PROTO_UDP);
+  IP4_ADDR(&addr, 192,168,0,src);
+  ip4_addr_copy(iphdr->src, addr);
+  ip4_addr_copy(iphdr->dest, *netif_ip4_addr(&test_netif));
+  IPH_CHKSUM_SET(iphdr, inet_chksum(iphdr, IP_HLEN));
+  if (offset == 0) {
+    udphdr = (struct udp_hdr *)(iphdr + 1);
+    udphdr->src = PP_HTONS(1234);
+    udphdr->dest = lwip_htons(port);
+    udphdr->len = PP_HTONS(64);
+  }
+  ip4_input(p, &test_netif);
+}
+
+/* Feed eth0 a whole, empty UDP datagram from 192.168.0.2:1234 to `port` */
+static void
+input_datagram(u16_t port)
+{
+  struct pbuf *p = pbuf_alloc(PBUF_RAW, IP_HLEN + UDP_HLEN, PBUF_RAM);
+  struct ip_hdr *iphdr;
+  struct udp_hdr *udphdr;
+  ip4_addr_t addr;
+
+  fail_unless(p != NULL);
+  memset(p->payload, 0, p->len);
+  iphdr = (struct ip_hdr *)p->payload;
+  IPH_VHL_SET(iphdr, 4, IP_HLEN / 4);
+  IPH_LEN_SET(iphdr, lwip_htons(p->len));
+  IPH_TTL_SET(iphdr, 64);
+  IPH_PROTO_SET(iphdr, IP_PROTO_UDP);
+  IP4_ADDR(&addr, 192,168,0,2);
+  ip4_addr_copy(iphdr->src, addr);
+  ip4_addr_copy(iphdr->dest, *netif_ip4_addr(&test_netif));
+  IPH_CHKSUM_SET(iphdr, inet_chksum(iphdr, IP_HLEN));
+  udphdr = (struct udp_hdr *)(iphdr + 1);
+  udphdr->src = PP_HTONS(1234);
+  udphdr->dest = lwip_htons(port);
+  udphdr->len = PP_HTONS(UDP_HLEN);
+  /* no checksum */
+  ip4_input(p, &test_netif);
+}
+
+/* Counts datagrams per PCB, `arg` pointing at the PCB's counter */
+static void
+count_recv(void *arg, struct udp_pcb *pcb, struct pbuf *p,
+           const ip_addr_t *addr, u16_t port)
+{
+  LWIP_UNUSED_ARG(pcb);
+  LWIP_UNUSED_ARG(addr);
+  LWIP_UNUSED_ARG(port);
+  (*(int *)arg)++;
+  pbuf_free(p);
+}
+
+/* Time out every datagram waiting to be reassembled */
+static void
+reass_remove_all(void)
+{
+  int i;
+  for (i = 0; i <= IP_REASS_MAXAGE; i++) {
+    ip_reass_tmr();
+  }
+  fail_unless(MEMP_STATS_GET(used, MEMP_REASSDATA) == 0);
+}
+
 static void
 udp_remove_all(void)
 {
@@ -27,12 +145,22 @@ udp_remove_all(void)
 static void
 udp_setup(void)
 {
+  ip4_addr_t addr, netmask;
+
   udp_remove_all();
+  IP4_ADDR(&addr, 192,168,0,1);
+  IP4_ADDR(&netmask, 255,255,255,0);
+  netif_add(&test_netif, &addr, &netmask, IP4_ADDR_ANY4, NULL, test_netif_init, NULL);
+  netif_set_up(&test_netif);
+  output_ctr = 0;
+  memset(&ip_reass_drops, 0, sizeof(ip_reass_drops));
 }
 
 static void
 udp_teardown(void)
 {
+  reass_remove_all();
+  netif_remove(&test_netif);
   udp_remove_all();
 }
 
@@ -56,6 +184,112 @@ START_TEST(test_udp_new_remove)
 }
 END_TEST
 
+/** Fragments of datagrams to an IP_REASS_REJECT_UDP port are refused with
+ * an ICMP error and hold no reassembly memory */
+START_TEST(test_udp_reass_reject)
+{
+  LWIP_UNUSED_ARG(_i);
+
+  /* A fragment arriving before the first one does not say its port yet */
+  input_fragment(2, 1, 16, 0, 0);
+  fail_unless(MEMP_STATS_GET(used, MEMP_REASSDATA) == 1);
+  fail_unless(ip_reass_drops.rejected == 0);
+
+  /* The first fragment is rejected, and frees the one queued */
+  input_fragment(2, 1, 0, 1, 7000);
+  fail_unless(ip_reass_drops.rejected == 1);
+  fail_unless(MEMP_STATS_GET(used, MEMP_REASSDATA) == 0);
+  fail_unless(output_ctr == 1);
+  fail_unless(last_icmp_type == ICMP_DUR);
+  fail_unless(last_icmp_code == ICMP_DUR_PROHIBITED);
+
+  /* Fragments following it are dropped without a reply */
+  input_fragment(2, 1, 8, 1, 0);
+  fail_unless(ip_reass_drops.rejected == 2);
+  fail_unless(MEMP_STATS_GET(used, MEMP_REASSDATA) == 0);
+  fail_unless(output_ctr == 1);
+
+  /* Other ports are reassembled as usual */
+  input_fragment(2, 2, 0, 1, 7001);
+  fail_unless(ip_reass_drops.rejected == 2);
+  fail_unless(MEMP_STATS_GET(used, MEMP_REASSDATA) == 1);
+}
+END_TEST
+
+/** One source cannot hold more than IP_REASS_MAX_PBUFS_PER_SRC pbufs
+ * waiting to be reassembled, nor push out another source's datagrams */
+START_TEST(test_udp_reass_src_cap)
+{
+  u16_t id;
+  LWIP_UNUSED_ARG(_i);
+
+  for (id = 0; id < IP_REASS_MAX_PBUFS_PER_SRC; id++) {
+    input_fragment(2, id, 0, 1, 9);
+  }
+  fail_unless(ip_reass_drops.capped == 0);
+  fail_unless(MEMP_STATS_GET(used, MEMP_REASSDATA) == IP_REASS_MAX_PBUFS_PER_SRC);
+
+  input_fragment(2, id, 0, 1, 9);
+  fail_unless(ip_reass_drops.capped == 1);
+  fail_unless(MEMP_STATS_GET(used, MEMP_REASSDATA) == IP_REASS_MAX_PBUFS_PER_SRC);
+
+  input_fragment(3, id, 0, 1, 9);
+  fail_unless(ip_reass_drops.capped == 1);
+  fail_unless(MEMP_STATS_GET(used, MEMP_REASSDATA) == IP_REASS_MAX_PBUFS_PER_SRC + 1);
+}
+END_TEST
+
+/** Datagrams reach the PCB bound to their port, with several ports on one
+ * hash chain, across removal and rebinding, and connected PCBs still win
+ * over unconnected ones on the same port */
+START_TEST(test_udp_demux)
+{
+  struct udp_pcb *pcb[4];
+  int got[4];
+  ip_addr_t peer;
+  int i;
+  LWIP_UNUSED_ARG(_i);
+
+  memset(got, 0, sizeof(got));
+  /* 10, 12 and 14 share a chain with UDP_HASH_SIZE 2 */
+  for (i = 0; i < 3; i++) {
+    pcb[i] = udp_new();
+    fail_unless(pcb[i] != NULL);
+    fail_unless(udp_bind(pcb[i], IP_ADDR_ANY, (u16_t)(10 + 2 * i)) == ERR_OK);
+    udp_recv(pcb[i], count_recv, &got[i]);
+  }
+  input_datagram(10);
+  input_datagram(12);
+  input_datagram(14);
+  input_datagram(14);
+  fail_unless(got[0] == 1 && got[1] == 1 && got[2] == 2);
+  /* Nobody on 16: no delivery (the port unreachable reply is output) */
+  input_datagram(16);
+  fail_unless(got[0] == 1 && got[1] == 1 && got[2] == 2);
+
+  /* Remove the middle of the chain, and move 14 to 11 on the other one */
+  udp_remove(pcb[1]);
+  input_datagram(12);
+  input_datagram(10);
+  fail_unless(got[0] == 2 && got[1] == 1);
+  fail_unless(udp_bind(pcb[2], IP_ADDR_ANY, 11) == ERR_OK);
+  input_datagram(14);
+  input_datagram(11);
+  fail_unless(got[2] == 3);
+
+  /* A PCB connected to the sender takes its datagrams to 10 */
+  pcb[3] = udp_new();
+  fail_unless(pcb[3] != NULL);
+  udp_recv(pcb[3], count_recv, &got[3]);
+  IP_ADDR4(&peer, 192,168,0,2);
+  /* bound to eth0's address, as another PCB has the any address on 10 */
+  fail_unless(udp_bind(pcb[3], &test_netif.ip_addr, 10) == ERR_OK);
+  fail_unless(udp_connect(pcb[3], &peer, 1234) == ERR_OK);
+  input_datagram(10);
+  fail_unless(got[0] == 2 && got[3] == 1);
+}
+END_TEST
+
 
 /** Create the suite including all tests for this module */
 Suite *
@@ -63,6 +297,9 @@ udp_suite(void)
 {
   testfunc tests[] = {
     TESTFUNC(test_udp_new_remove),
+    TESTFUNC(test_udp_reass_reject),
+    TESTFUNC(test_udp_reass_src_cap),
+    TESTFUNC(test_udp_demux),
   };
   return create_suite("UDP", tests, sizeof(tests)/sizeof(testfunc), udp_setup, udp_teardown);
 }
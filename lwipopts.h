@@ -0,0 +1,276 @@
+#ifndef _LWIPOPTS_H_
+#define _LWIPOPTS_H_
+
+// lwipopts.h - lwIP configuration for JAM.
+//
+// Bare metal, single threaded: the main loop polls the netif and runs the
+// lwIP timers, so only the raw API is available.
+
+#define NO_SYS                  1
+#define SYS_LIGHTWEIGHT_PROT    0
+#define LWIP_NETCONN            0
+#define LWIP_SOCKET             0
+// Timeouts run on timer.c's timer wheel
+#define LWIP_TIMERS_CUSTOM      1
+
+// Memory
+//
+// Everything lives in 128 KB of LMB BRAM with no libc heap (nomalloc.c), and
+// no heap for lwIP either.  mem_malloc() (PBUF_RAM and friends) draws
+// from the fixed-size pools in lwippools.h and every other allocation from
+// its own memp pool.  All pool storage is placed in the .lwip_pools section
+// (see LWIP_DECLARE_MEMORY_ALIGNED in arch/cc.h); the Makefile prints the
+// size of each pool after linking.
+#define MEM_ALIGNMENT           4
+#define MEM_LIBC_MALLOC         0
+#define MEMP_MEM_MALLOC         0
+#define MEM_USE_POOLS           1
+#define MEM_USE_POOLS_TRY_BIGGER_POOL 1
+#define MEMP_USE_CUSTOM_POOLS   1
+
+// Ethernet MTU of eth0.  The core's 16 KB buffers take jumbo frames up to
+// 9000 bytes, but each of the driver's RX buffers and the jumbo pool in
+// lwippools.h then cost about 9 KB of BRAM, and every switch and host on
+// the link must accept them too.  TCP keeps TCP_MSS either way; the bulk
+// UDP protocols size their datagrams by the MTU.
+#ifndef ETH_MTU
+#define ETH_MTU                 1500
+#endif
+
+// MTU of the SLIP link on the console UART (slipnet.h), the classic 296
+// bytes: at 9600 baud each takes a third of a second, and TCP sizes its
+// segments by it, so a segment fits the console's output ring with room
+// for more.
+#define SLIP_MAX_SIZE           296
+
+// Received frames normally land in the eth0 driver's own RX buffers, so the
+// pool only backs frames received while those are all in use.  Frames of
+// up to ETH_RX_SMALL_SIZE bytes (register requests, ARP, ICMP, bare ACKs:
+// most of what arrives) take a buffer of the driver's ETH_RX_SMALL pool
+// (lwippools.h) instead, while it has one: ten of those take the BRAM of
+// the driver RX buffer they replace (ETH_RX_BUFS).
+#define PBUF_POOL_SIZE          4
+#define PBUF_POOL_BUFSIZE       1536
+#define ETH_RX_SMALL_BUFS       10
+#define ETH_RX_SMALL_SIZE       128
+
+// The bulk readouts (tcpsrc.h) hand tcp_write() their data by reference,
+// in a PBUF_ROM for each piece of a segment: at most half of
+// TCP_SND_QUEUELEN for each of the two
+#define MEMP_NUM_PBUF           (8 + TCP_SND_QUEUELEN)
+// wbreg, log, bench, discover, TFTP, the SNMP agent (snmpmib.h), the
+// SNTP client (sntpclock.h), the mDNS responder (mdnsd.h), flow control
+// feedback (flowctl.h), DHCP, two for PTP (ptp.h), the telemetry push
+// (telpush.h) and the line protocol exporter (influx.h)
+#define MEMP_NUM_UDP_PCB        14
+// Demultiplex datagrams through a hash of the bound ports rather than a walk
+// of every PCB
+#define UDP_PCB_HASH            1
+// Telemetry, block transfer and KATCP_CLIENTS KATCP connections, one spare
+// for a connection lingering in TIME_WAIT, two iperf sessions (iperf.h),
+// a web UI client (webfs.h), a profile export (pcprof.h), a snapshot
+// client (snap.h), a frame trace export (ftrace.h) and an XADC burst
+// export (xburst.h)
+#define MEMP_NUM_TCP_PCB        12
+// Connections closed from here wait out TIME-WAIT two at most, and
+// quota.h sets idle limits and keepalives: 60 s idle, then three probes
+// 10 s apart
+#define TCP_TW_MAX              2
+#define LWIP_TCP_IDLE_TIMEOUT   1
+#define TCP_KEEPIDLE_DEFAULT    60000UL
+#define TCP_KEEPINTVL_DEFAULT   10000UL
+#define TCP_KEEPCNT_DEFAULT     3U
+#define MEMP_NUM_TCP_PCB_LISTEN 9
+// Find a segment's connection through a hash of its ports and address
+// rather than a walk of every active PCB
+#define TCP_PCB_HASH            1
+// TCP_SND_QUEUELEN for the two bulk connections, and a few for the rest
+#define MEMP_NUM_TCP_SEG        (2 * TCP_SND_QUEUELEN + 8)
+#define MEMP_NUM_REASSDATA      2
+#define MEMP_NUM_FRAG_PBUF      4
+// Fragments hold on to the RX buffers or pool pbufs they arrived in, so
+// reassembly may take half of them and one host a quarter, leaving the rest
+// for unfragmented traffic.
+#define IP_REASS_MAX_PBUFS      4
+#define IP_REASS_MAX_PBUFS_PER_SRC 2
+// The register and control protocols (wbreg 7000, log 7002, bench 7004,
+// discover 7005, announce 7006) fit every request in one frame: a
+// fragmented one is from a misconfigured host and is refused outright.
+#define IP_REASS_REJECT_UDP(port) ((port) >= 7000 && (port) <= 7006)
+#define MEMP_NUM_ARP_QUEUE      4
+// lwIP's own timers (IGMP's included), the flash status poll and
+// background CRC, the TFTP server's (tftp.h) and the SNTP client's.  With
+// LWIP_TIMERS_CUSTOM this sizes timer.c's pool rather than a memp pool.
+#define MEMP_NUM_SYS_TIMEOUT    (LWIP_TCP + IP_REASSEMBLY + LWIP_ARP + \
+                                 2 * LWIP_DHCP + LWIP_IGMP + 4)
+// Room for arpcfg.h's static entries on top of the dynamic ones
+#define ARP_TABLE_SIZE          16
+#define ETHARP_SUPPORT_STATIC_ENTRIES 1
+// Find ARP entries through a hash index rather than a table scan, and keep
+// each PCB's last entry (in its addr_hint) so that a PCB sending to one
+// host goes straight to that host's entry
+#define ETHARP_TABLE_HASH       1
+#define LWIP_NETIF_HWADDRHINT   1
+
+// TCP is sized for bulk transfers across the LAN (wbblk.h firmware upload
+// and capture readout).  Four full segments in flight each way cover the
+// bandwidth-delay product of a switched link with RTTs of a few hundred
+// microseconds.  Each queued segment holds a 1552 byte pool buffer
+// (lwippools.h), so a full send window costs about 6 KB of BRAM, unless
+// it references a bulk readout's ring (tcpsrc.h): then it holds a small
+// header buffer and a PBUF_ROM or two, hence a queue length of four
+// pbufs per full-sized segment.
+// TCP_OVERSIZE lets consecutive tcp_write() calls fill out the last
+// segment's pbuf rather than chaining a new one per call.  Timestamps stay
+// off: they add 12 bytes to every segment, and their RTT samples and wrap
+// protection only pay off with far larger windows.
+#define TCP_MSS                 1460
+#define TCP_WND                 (4 * TCP_MSS)
+#define TCP_SND_BUF             (4 * TCP_MSS)
+#define TCP_SND_QUEUELEN        (4 * TCP_SND_BUF / TCP_MSS)
+#define TCP_OVERSIZE            TCP_MSS
+#define LWIP_TCP_TIMESTAMPS     0
+// Offer SACK, so that a segment lost through a busy switch in an upload
+// costs the sender that segment rather than everything after it.  The
+// blocks are built from the out-of-sequence queue, which the window keeps
+// to a few segments; nothing more is kept per connection.
+#define LWIP_TCP_SACK_OUT       1
+// No connection may hold more than two receive buffers out of sequence,
+// so that the pool stays for the others (quota.h)
+#define TCP_OOSEQ_MAX_PBUFS     2
+// Every second full segment is ACKed at once; any other ACK waits for the
+// next fast timer tick, so run that every 100 ms rather than every 250 ms
+#define TCP_TMR_INTERVAL        100
+
+// The eth0 driver hands received frames to the stack as custom pbufs
+#define LWIP_SUPPORT_CUSTOM_PBUF 1
+
+// Align the IP header on a 32-bit boundary
+#define ETH_PAD_SIZE            2
+
+#define LWIP_ARP                1
+#define LWIP_ETHERNET           1
+#define LWIP_IPV4               1
+#define LWIP_IPV6               0
+#define LWIP_ICMP               1
+#define LWIP_RAW                0
+#define LWIP_UDP                1
+#define LWIP_TCP                1
+// DHCP is chosen at run time (netcfg.h)
+#define LWIP_DHCP               1
+#define LWIP_AUTOIP             0
+// Multicast groups are joined at run time (wbreg.h's WBREG_OP_JOIN) so
+// that one datagram reaches every board listening; eth0 filters the
+// groups' MAC addresses in software (ETHERNETIF_MCAST_FILTERS)
+#define LWIP_IGMP               1
+// All-systems, mDNS, PTP and six joined at run time
+#define MEMP_NUM_IGMP_GROUP     9
+#define LWIP_DNS                0
+
+#define LWIP_NETIF_LINK_CALLBACK 0
+#define LWIP_NETIF_STATUS_CALLBACK 0
+
+// Only the memp pool counts (used, high-water mark, failures), for sizing
+// the pools from real traffic with KATCP's ?memp, a trace of the last
+// allocations that failed, and mem_malloc()'s requests counted by size in
+// 32 byte buckets up to the 1552 byte pool (?memp sizes)
+#define LWIP_STATS              1
+#define LINK_STATS              0
+#define ETHARP_STATS            0
+#define IP_STATS                0
+#define IPFRAG_STATS            0
+#define ICMP_STATS              0
+#define UDP_STATS               0
+#define TCP_STATS               0
+#define MEM_STATS               0
+#define MEMP_STATS              1
+#define MEMP_FAIL_TRACE         16
+#define MEMP_FAIL_TRACE_CALLER() __builtin_return_address(0)
+#define MEM_SIZE_TRACE          49
+#define MEM_SIZE_TRACE_STEP     32
+
+// Checksums use the MicroBlaze routines in chksum.c.  Copies from
+// application buffers into pbufs (tcp_write, pbuf_fill_chksum) sum the data
+// on the way through instead of reading it again later.
+#define LWIP_CHKSUM             mb_chksum
+#define LWIP_CHECKSUM_ON_COPY   1
+#define LWIP_CHKSUM_COPY(dst, src, len) mb_chksum_copy((dst), (src), (len))
+
+// Copies into and out of pbufs (pbuf_take, pbuf_copy, pbuf_copy_partial)
+// use mbmem.c's memcpy.  SMEMCPY's copies are mostly of a constant handful
+// of bytes, which the compiler inlines as loads and stores; only the rest
+// take the call.
+#define MEMCPY(dst, src, len)   mb_memcpy((dst), (src), (len))
+#define SMEMCPY(dst, src, len)  (__builtin_constant_p(len) ? \
+    memcpy((dst), (src), (len)) : mb_memcpy((dst), (src), (len)))
+
+// Let the eth0 driver hand individual checksums to the gateware at runtime
+#define LWIP_CHECKSUM_CTRL_PER_NETIF 1
+
+// TFTP uploads (tftp.h) in blocks filling a frame.  tftp.c holds two
+// blocks while the flash programs, and the server drops what arrives
+// beyond that, so a bigger window only wastes frames.
+#define TFTP_MAX_BLKSIZE        (ETH_MTU - 20 - 8 - 4)
+#define TFTP_MAX_WINDOWSIZE     4
+
+// httpd serves the web UI from flash (webfs.h); the files carry their own
+// headers, and only a 404 page is compiled in (fsdata_custom.c)
+#define LWIP_HTTPD_CUSTOM_FILES      1
+#define LWIP_HTTPD_DYNAMIC_FILE_READ 1
+#define HTTPD_USE_CUSTOM_FSDATA      1
+
+// The dashboard polls /status.json every second: keep its connection open
+// between requests rather than a handshake and a teardown each time.  A
+// connection that neither sends nor is acked for HTTPD_MAX_RETRIES polls
+// of HTTPD_POLL_INTERVAL slow timer ticks (8 s) is closed, idle or not,
+// and when the heap has no room for another connection's state the oldest
+// one goes.
+#define LWIP_HTTPD_SUPPORT_11_KEEPALIVE 1
+#define HTTPD_POLL_INTERVAL          4
+#define HTTPD_MAX_RETRIES            4
+#define LWIP_HTTPD_KILL_OLD_ON_CONNECTIONS_EXCEEDED 1
+
+// /telemetry.ws is handed over to websock.h
+#define LWIP_HTTPD_WEBSOCKET         1
+
+// SNMPv2c agent (snmpmib.h) for the board's own MIB only.  MIB-II is left
+// out: it needs MIB2_STATS, which counts in every layer of the stack on
+// every packet.  OIDs and values are kept to what that MIB needs, since the
+// agent holds several of each on the stack.
+#define LWIP_SNMP               1
+#define SNMP_LWIP_MIB2          0
+#define SNMP_MAX_OBJ_ID_LEN     16
+#define SNMP_MAX_OCTET_STRING_LEN 32
+#ifndef SNMP_COMMUNITY
+#define SNMP_COMMUNITY          "public"
+#endif
+
+// SNTP client for sntpclock.h, which sets its one server and takes the
+// time of each reply.  Polling every minute or so rather than the default
+// hour lets the drift estimate settle in a reasonable time.
+#define SNTP_SET_SYSTEM_TIME_US(sec, us) do { \
+    void sntpclock_set(u32_t, u32_t); \
+    sntpclock_set((sec), (us)); \
+  } while(0)
+#define SNTP_CHECK_RESPONSE     1
+#define SNTP_UPDATE_DELAY       64000
+
+// iperf.c counts the CPU each lwiperf session takes from when it starts
+#define LWIPERF_START_HOOK()    iperf_started()
+
+// Replies leave by the port that owns their source address (ethport.h)
+struct netif;
+struct ip4_addr;
+struct netif *ethport_route_src(const struct ip4_addr *dest,
+    const struct ip4_addr *src);
+#define LWIP_HOOK_IP4_ROUTE_SRC(dest, src) ethport_route_src((dest), (src))
+
+// Count the timer cycles spent in each layer of the stack (lwip/stats.h),
+// for wbreg.h's WBREG_OP_CYCLES.  Each change of layer costs a timer read
+// and a few adds.
+#ifndef LWIP_CYCLE_STATS
+#define LWIP_CYCLE_STATS        1
+#endif
+#define LWIP_CYCLE_STAMP()      timebase_stamp()
+
+#endif // _LWIPOPTS_H_
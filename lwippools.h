@@ -0,0 +1,52 @@
+// lwippools.h - Pools backing mem_malloc() (MEM_USE_POOLS, see lwipopts.h).
+//
+// Sizes include the 16 byte struct pbuf that PBUF_RAM allocations carry and
+// the headroom of the layer the pbuf is allocated at: 36 bytes at PBUF_IP,
+// 56 at PBUF_TRANSPORT (padded Ethernet, IP and TCP headers, the latter
+// even for UDP).  The classes follow the sizes the stack asks for, as
+// MEM_SIZE_TRACE counts them (KATCP's ?memp sizes):
+//
+//   128   TCP segments without data (ACKs, 72 bytes; 76 for a SYN with its
+//         MSS option), the header pbufs of the segments that reference a
+//         bulk readout's data (tcpsrc.h), ARP (60), ICMP errors (88), SNTP
+//         and PTP (120, 116) and UDP replies of up to 56 bytes
+//   256   UDP replies of up to 184 bytes: register reads and watches
+//         (wbreg.h, wbwatch.h), mDNS answers, discovery
+//   512   DHCP (380), longer mDNS and register replies
+//   1552  a full TCP segment (TCP_MSS, 1532), which is also what tcp_write()
+//         takes for a KATCP reply as TCP_OVERSIZE rounds it up, and a
+//         datagram of ETH_UDP_MAX (influx.h, 1544)
+//
+// The 256 byte class was split out of the 512 byte one, which served
+// those replies with half of each buffer unused, in the same BRAM.  A
+// mostly empty pool of a small class still costs little; the large one is
+// sized for one connection's full send window plus a couple more.  With
+// jumbo frames (ETH_MTU over 1500) a pool of two full-size frames backs
+// the bulk UDP replies.  mem_malloc() falls through to a bigger pool when
+// the right one is empty (MEM_USE_POOLS_TRY_BIGGER_POOL), so a burst of
+// one size borrows from the next class rather than fail; being fixed-size
+// blocks, the pools cannot fragment as a heap would
+// (test/unit/test_mempools.c).
+//
+// ETH_RX_SMALL holds the eth0 driver's buffers for short frames
+// (ethernetif.c), each a custom pbuf and ETH_RX_SMALL_SIZE bytes.
+//
+// No include guard: memp_std.h includes this once per expansion.
+
+#if ETH_RX_SMALL_BUFS
+LWIP_MEMPOOL(ETH_RX_SMALL, ETH_RX_SMALL_BUFS, sizeof(struct pbuf_custom) +
+    ((ETH_PAD_SIZE + ETH_RX_SMALL_SIZE + 3) & ~3), "ETH_RX_SMALL")
+#endif
+
+#if MEM_USE_POOLS
+LWIP_MALLOC_MEMPOOL_START
+LWIP_MALLOC_MEMPOOL(20, 128)
+LWIP_MALLOC_MEMPOOL(4, 256)
+LWIP_MALLOC_MEMPOOL(4, 512)
+LWIP_MALLOC_MEMPOOL(6, 1552)
+#if ETH_MTU > 1500
+// Sized for the largest ETH_MTU eth.h allows; the size must be a literal
+LWIP_MALLOC_MEMPOOL(2, 9056)
+#endif
+LWIP_MALLOC_MEMPOOL_END
+#endif
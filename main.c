@@ -45,190 +45,423 @@
  *   ps7_uart    115200 (configured by bootrom/bsp)
  */
 
-#include <stdio.h>
+#include <stdlib.h>
 
 #include "platform.h"
 #include "xil_printf.h"
-#include "sleep.h"
 
+#include "lwip/init.h"
+#include "lwip/netif.h"
+#include "lwip/timeouts.h"
+#include "netif/etharp.h"
+#include "netif/ethernetif.h"
+
+#include "arpcfg.h"
+#include "bbox.h"
+#include "bench.h"
+#include "boot.h"
+#include "console.h"
+#include "crash.h"
+#include "discover.h"
+#include "dma.h"
+#include "eth.h"
+#include "ethmon.h"
+#include "ethport.h"
+#include "fabric.h"
+#include "flowctl.h"
+#include "flash.h"
+#include "flashrd.h"
+#include "ftrace.h"
+#include "fmt.h"
+#include "gwrev.h"
+#include "icap.h"
+#include "influx.h"
+#include "intr.h"
+#include "katcp.h"
+#include "kv.h"
+#include "lmbscrub.h"
+#include "log.h"
+#include "mbox.h"
+#include "mdnsd.h"
+#include "netcfg.h"
+#include "ovl.h"
+#include "pcprof.h"
+#include "preset.h"
+#include "ptp.h"
+#include "quota.h"
+#include "slots.h"
+#include "snap.h"
+#include "sched.h"
+#include "slipnet.h"
+#include "scrub.h"
+#include "snmpmib.h"
+#include "snmptrap.h"
+#include "sntpclock.h"
 #include "spi.h"
+#include "stack.h"
+#include "stream.h"
+#include "telemetry.h"
+#include "telbuf.h"
+#include "telpush.h"
+#include "tftp.h"
+#include "throttle.h"
+#include "timebase.h"
+#include "timer.h"
+#include "uartcmd.h"
+#include "version.h"
+#include "warm.h"
+#include "wdog.h"
+#include "wbblk.h"
+#include "wbbus.h"
+#include "wbeth.h"
+#include "wbpost.h"
+#include "wbmap.h"
+#include "wbreg.h"
+#include "wbshadow.h"
+#include "wbtimed.h"
+#include "wbwatch.h"
+#include "webfs.h"
+#include "work.h"
+#include "xadc.h"
+#include "xadccal.h"
+#include "xburst.h"
 
-int main()
+// Status line period
+#define STATUS_PERIOD_MS (1000)
+
+static struct netif netif;
+
+// Poll hook: receive on each port whose core is not interrupt driven, or
+// is polled while its interrupt is masked under load
+static int
+net_poll(void *arg)
+{
+  struct netif *n;
+  int count = 0;
+
+  for(n = netif_list; n; n = n->next) {
+    if(ethernetif_is(n) && ethernetif_polled(n)) {
+      count += ethernetif_poll(n);
+    }
+  }
+
+  return count;
+}
+
+static struct sched_hook net_hook = SCHED_HOOK_INIT(net_poll, NULL);
+
+static void
+status(void *arg)
 {
     char s[4] = {'\x80', '\x00', '\x00', '\x00'};
     int endian = *((int *)&s);
-    int i, j;
-    float fpga_temp;
-    u8 buf[128];
-    u32 len;
+    s32 mc = xadc_convert(XADC_TEMP, xadc_raw(XADC_TEMP));
+    char c[FMT_FIXED_MAX];
 
-    init_platform();
+    xil_printf("Hello %s endian world at %s C\n",
+        endian < 0 ? "BIG" : "little", fmt_fixed(c, mc, 1000, 1));
+}
 
-    print("\n# JAM starting\n\n");
+static struct timer status_timer = TIMER_INIT(status, NULL);
 
-    print("## SPI Flash Info\n");
+// Report XADC alarms as they happen
+static void
+xadc_alarm(const struct xadc_event *ev, void *arg)
+{
+  s32 mc = xadc_convert(XADC_TEMP, xadc_raw(XADC_TEMP));
 
-    buf[0] = 0x9e;
-    len = 5;
-    send_spi(buf, buf, len, SEND_SPI_MORE);
-    print("RDID:  ");
-    for(i=1; i<len; i++) { // skip munged opcode byte
-      xil_printf(" %02x", buf[i]);
-    }
-    print("\n       ");
-    // Read rest of UID using length from last byte
-    len = buf[--i];
-    send_spi(buf, buf, len, 0);
-    for(i=0; i<len; i++) {
-      xil_printf(" %02x", buf[i]);
-    }
-    print("\n");
+  xil_printf("XADC alarm at %d ms: status %04x, active %04x, %d mC\n",
+      (u32)(ev->time_us / 1000), ev->status, ev->alarms, mc);
+  bbox_event(BBOX_ALARM, ev->alarms, ev->status, mc, 0);
+}
 
-    buf[0] = 0x05;
-    len = 2;
-    send_spi(buf, buf, len, 0);
-    print("RDSR:  ");
-    for(i=1; i<len; i++) { // skip munged opcode byte
-      xil_printf(" %02x", buf[i]);
-    }
-    print("\n");
+// The startup report goes out a section at a time once the network is
+// up: at 9600 baud it takes several seconds, and only a section waits on
+// the console at a time, not the boot.  Sections that talk to the flash
+// directly wait for it to be idle.
 
-    buf[0] = 0xb5;
-    len = 3;
-    send_spi(buf, buf, len, 0);
-    print("RDNVCR:");
-    for(i=1; i<len; i++) { // skip munged opcode byte
-      xil_printf(" %02x", buf[i]);
-    }
-    print("\n");
+// How often the report checks whether the console has drained
+#define REPORT_PERIOD_MS (20)
 
-    buf[0] = 0x85;
-    len = 2;
-    send_spi(buf, buf, len, 0);
-    print("RDVCR: ");
-    for(i=1; i<len; i++) { // skip munged opcode byte
-      xil_printf(" %02x", buf[i]);
-    }
-    print("\n");
+static void
+report_spi()
+{
+  u8 buf[4];
+  u32 len;
+  int i;
 
-    buf[0] = 0x65;
-    len = 2;
-    send_spi(buf, buf, len, 0);
-    print("RDEVCR:");
-    for(i=1; i<len; i++) { // skip munged opcode byte
-      xil_printf(" %02x", buf[i]);
-    }
-    print("\n");
+  print("## SPI Flash Info\n");
 
-    buf[0] = 0x5a; // opcode
-    buf[1] = 0x00; // address
-    buf[2] = 0x00; // address
-    buf[3] = 0x00; // address
-    buf[4] = 0x00; // dummy
-    send_spi(buf, buf, 5, SEND_SPI_MORE);
-    len = 128;
-    send_spi(buf, buf, len, 0);
-    for(i=0; i<len/16; i++) {
-      print(i == 0 ? "RDSFDP:" : "       ");
-      for(j=0; j<16; j++) {
-        xil_printf(" %02x", buf[16*i+j]);
-      }
-      print("\n");
-    }
-    print("\n");
+  // Read by init_flash()
+  print("RDID:  ");
+  for(i=0; i<3; i++) {
+    xil_printf(" %02x", flash_info.id[i]);
+  }
+  xil_printf(" %02x\n       ", flash_info.uid_len);
+  for(i=0; i<flash_info.uid_len; i++) {
+    xil_printf(" %02x", flash_info.uid[i]);
+  }
+  print("\n");
+
+  buf[0] = 0x05;
+  len = 2;
+  send_spi(buf, buf, len, 0);
+  print("RDSR:  ");
+  for(i=1; i<len; i++) { // skip munged opcode byte
+    xil_printf(" %02x", buf[i]);
+  }
+  print("\n");
+
+  buf[0] = 0xb5;
+  len = 3;
+  send_spi(buf, buf, len, 0);
+  print("RDNVCR:");
+  for(i=1; i<len; i++) { // skip munged opcode byte
+    xil_printf(" %02x", buf[i]);
+  }
+  print("\n");
+
+  buf[0] = 0x85;
+  len = 2;
+  send_spi(buf, buf, len, 0);
+  print("RDVCR: ");
+  for(i=1; i<len; i++) { // skip munged opcode byte
+    xil_printf(" %02x", buf[i]);
+  }
+  print("\n");
+
+  buf[0] = 0x65;
+  len = 2;
+  send_spi(buf, buf, len, 0);
+  print("RDEVCR:");
+  for(i=1; i<len; i++) { // skip munged opcode byte
+    xil_printf(" %02x", buf[i]);
+  }
+  print("\n");
+}
+
+static void
+report_read()
+{
+  u8 buf[16];
+  u32 len;
+  int i;
+
+  len = read_flash(0, buf, 16, FLASH_MODE_BEST);
+  print("READ@0:");
+  for(i=0; i<len; i++) {
+    xil_printf(" %02x", buf[i]);
+  }
+  print("\n\n");
+}
 
-    // Unicast ARP packet.  The packet format is based this tcpdump capture of
-    // a unicast ARP packet:
-    //
-    // 00:25:90:9d:aa:41 > 0c:c4:7a:aa:8a:fb, ethertype ARP (0x0806), length 60:
-    // Request who-has 10.0.1.1 tell 10.0.100.49, length 46
-    //      0x0000:  0cc4 7aaa 8afb 0025 909d aa41 0806 0001
-    //      0x0010:  0800 0604 0001 0025 909d aa41 0a00 6431
-    //      0x0020:  0000 0000 0000 0a00 0101 0000 0000 0000
-    //      0x0030:  0000 0000 0000 0000 0000 0000
-    //
-    // The packet sent here has these changes:
-    //
-    // Replace src MAC with 02:02:0a:0a:0a:0a, src IP with 10.10.10.10
-    // Replace dst MAC with 02:02:0a:14:1e:28, dst IP with 10.20.30.40
-    // Add 4 bytes of padding since core requires multiple of 8 bytes
-    int pktlen = 64;
-    char pkt[64] = {
-      0x02, 0x02, 0x0a, 0x14, 0x1e, 0x28, 0x02, 0x02, 0x0a, 0x0a, 0x0a, 0x0a, 0x08, 0x06, 0x00, 0x01,
-      0x08, 0x00, 0x06, 0x04, 0x00, 0x01, 0x02, 0x02, 0x0a, 0x0a, 0x0a, 0x0a, 0x0a, 0x0a, 0x0a, 0x0a,
-      0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x0a, 0x14, 0x1e, 0x28, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-      0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
-    };
-
-    // Create a u32 poitner to packet
-    u32 *pkt32 = (u32 *)pkt;
-
-// From core_info.tab
-#define ETH0_WB_OFFSET (0x292f8)
-#define ETH0_BASE_ADDRESS (XPAR_AXI_SLAVE_WISHBONE_CLASSIC_MASTER_0_BASEADDR + ETH0_WB_OFFSET)
-// From Ethernet MAC
-#define ETH_MAC_BUFFER_LEVEL_OFFSET   (0x18)
-#define ETH_MAC_TX_BUF_OFFSET       (0x4000)
-
-    print("## eth0 memory as u8:\n");
-    for(i=0; i<4; i++) {
-      xil_printf("%02x:", 16*i);
-      for(j=0; j<16; j++) {
-        xil_printf(" %02x", *(((u8 *)ETH0_BASE_ADDRESS) + 16*i+j));
-      }
-      print("\n");
+static void
+report_eth0()
+{
+  int i, j;
+
+  print("## eth0 memory as u8:\n");
+  for(i=0; i<4; i++) {
+    xil_printf("%02x:", 16*i);
+    for(j=0; j<16; j++) {
+      xil_printf(" %02x", *(((u8 *)ETH0_BASE_ADDRESS) + 16*i+j));
     }
     print("\n");
+  }
+  print("\n");
 
-    print("## eth0 memory as u16:\n");
-    for(i=0; i<4; i++) {
-      xil_printf("%02x:", 16*i);
-      for(j=0; j<8; j++) {
-        xil_printf(" %04x", *(((u16 *)ETH0_BASE_ADDRESS) + 8*i+j));
-      }
-      print("\n");
+  print("## eth0 memory as u16:\n");
+  for(i=0; i<4; i++) {
+    xil_printf("%02x:", 16*i);
+    for(j=0; j<8; j++) {
+      xil_printf(" %04x", *(((u16 *)ETH0_BASE_ADDRESS) + 8*i+j));
     }
     print("\n");
+  }
+  print("\n");
 
-    print("## eth0 memory as u32:\n");
-    for(i=0; i<4; i++) {
-      xil_printf("%02x:", 16*i);
-      for(j=0; j<4; j++) {
-        xil_printf(" %08x", *(((u32 *)ETH0_BASE_ADDRESS) + 4*i+j));
-      }
-      print("\n");
+  print("## eth0 memory as u32:\n");
+  for(i=0; i<4; i++) {
+    xil_printf("%02x:", 16*i);
+    for(j=0; j<4; j++) {
+      xil_printf(" %08x", *(((u32 *)ETH0_BASE_ADDRESS) + 4*i+j));
     }
     print("\n");
+  }
+  print("\n");
+}
 
-#if 1
-    // Copy packet to 10 GbE buffer
-    // Xil_Out32(XPAR_AXI_SLAVE_WISHBONE_CLASSIC_MASTER_0_BASEADDR + uAddressOffset + ETH_MAC_CPU_TRANSMIT_BUFFER_LOW_ADDRESS + 4*uIndex, puTransmitPacket[uIndex]);
-    //memcpy((void *)(ETH0_BASE_ADDRESS + ETH_MAC_TX_BUF_OFFSET), pkt, 64);
-    for(i=0; i<16; i++) {
-      Xil_Out32(ETH0_BASE_ADDRESS + ETH_MAC_TX_BUF_OFFSET + i, Xil_Htonl(pkt32[i]));
+static void
+report_wbmap()
+{
+  print("## Wishbone devices\n");
+  dump_wbmap();
+}
+
+static void
+report_bench()
+{
+  if(BENCH_AT_BOOT || bench_at_boot()) {
+    print("## Benchmarks\n");
+    if(ovl_load(OVL_BENCH) == 0) {
+      dump_bench();
+    } else {
+      print("(no overlay image)\n\n");
     }
+  }
+}
 
-    // Set TX buffer level to 60 to send packet
-    *((u16 *)((ETH0_BASE_ADDRESS+ETH_MAC_BUFFER_LEVEL_OFFSET+2)^2)) = Xil_Htons(64/8);
+static void
+report_boot()
+{
+  print("## Boot\n");
+  dump_boot();
+  dump_stack();
+  dump_wdog();
+  dump_intr();
+  dump_crash();
+  dump_icap();
+  dump_gwrev();
+  dump_ovl();
+  dump_dma();
+  dump_stream();
+  dump_slipnet();
+  dump_mbox();
+  print("\n");
+}
 
-    // Loop a bunch of times waiting for packet to send
-    for(i=0; i<10000; i++) {
-      // If length is zero, then packet was sent
-      if(!*((u16 *)((ETH0_BASE_ADDRESS+ETH_MAC_BUFFER_LEVEL_OFFSET+2)^2))) break;
-    }
+static const struct {
+  void (*fn)();
+  // Uses the SPI core itself, as loading an overlay does
+  u8 spi;
+  // Overlay (ovl.h) `fn` runs in, or OVL_NONE
+  u8 ovl;
+} report[] = {
+  { report_spi, 1, OVL_NONE },
+  { dump_flash, 1, OVL_REPORT },
+  { dump_kv, 1, OVL_REPORT },
+  { dump_slots, 1, OVL_REPORT },
+  { dump_scrub, 1, OVL_REPORT },
+  { dump_lmbscrub, 1, OVL_REPORT },
+  { dump_xadc, 1, OVL_REPORT },
+  { report_wbmap, 1, OVL_REPORT },
+  { report_bench, 1, OVL_NONE },
+  { report_read, 1, OVL_NONE },
+  { report_eth0, 0, OVL_NONE },
+  { report_boot, 0, OVL_NONE },
+};
+
+#define NUM_REPORT (sizeof(report) / sizeof(report[0]))
 
-    xil_printf("looped %d times while packet was sending\n", i);
-#endif
+static u32 report_next;
+
+static void report_step(void *arg);
+static struct timer report_timer = TIMER_INIT(report_step, NULL);
+
+static void
+report_step(void *arg)
+{
+  u32 n = report_next;
+
+  if(console_pending() || bench_printing() ||
+     (report[n].spi && (flash_busy() || spi_busy()))) {
+    return;
+  }
+  report_next++;
+  if(report[n].ovl == OVL_NONE || ovl_load(report[n].ovl) == 0) {
+    report[n].fn();
+  } else {
+    print("(no overlay image, section skipped)\n");
+  }
+  if(report_next == NUM_REPORT) {
+    timer_stop(&report_timer);
+    timer_start(&status_timer, 0, STATUS_PERIOD_MS);
+  }
+}
+
+int main()
+{
+    ip4_addr_t ipaddr, netmask, gw;
+
+    init_platform();
+
+    xil_printf("\n# JAM %d.%d starting\n\n", JAM_VERSION_MAJOR,
+        JAM_VERSION_MINOR);
+
+    print("## eth0 netif\n");
+
+    lwip_init();
+
+    // The address comes from init_netcfg()
+    ip4_addr_set_zero(&ipaddr);
+    ip4_addr_set_zero(&netmask);
+    ip4_addr_set_zero(&gw);
+    netif_add(&netif, &ipaddr, &netmask, &gw, NULL,
+        ethernetif_init, ethernet_input);
+    srand(((u32)netif.hwaddr[3] << 16 | netif.hwaddr[4] << 8 |
+        netif.hwaddr[5]) ^ (u32)timebase_cycles());
+    netif_set_default(&netif);
+    netif_set_up(&netif);
+
+    xil_printf("MAC:    %02x:%02x:%02x:%02x:%02x:%02x\n",
+        netif.hwaddr[0], netif.hwaddr[1], netif.hwaddr[2],
+        netif.hwaddr[3], netif.hwaddr[4], netif.hwaddr[5]);
+    init_netcfg(&netif);
+    init_ethport();
+    boot_stage("netif");
 
     print("\n");
 
-    while(1) {
-        fpga_temp = get_fpga_temp();
-        printf("Hello %s endian world at %.1f C\n",
-            endian < 0 ? "BIG" : "little",
-            fpga_temp);
-        sleep(1);
-    }
+    init_arpcfg();
+    init_xadccal();
+    init_wbbus();
+    init_wbpost();
+    init_wbshadow();
+    init_preset();
+    init_throttle();
+    init_fabric();
+    init_flowctl();
+    init_ethmon();
+    init_log();
+    init_wbreg();
+    init_wbeth(&netif);
+    init_wbblk();
+    init_wbwatch();
+    init_snap();
+    init_katcp();
+    init_bench();
+    init_telemetry();
+    init_telbuf();
+    init_bbox();
+    init_telpush();
+    init_influx(&netif);
+    init_pcprof();
+    init_ftrace();
+    init_xburst();
+    init_flashrd();
+    init_tftp();
+    init_webfs();
+    init_snmpmib();
+    init_snmptrap();
+    init_sntpclock();
+    init_ptp(&netif);
+    init_wbtimed();
+    init_discover(&netif);
+    init_mdnsd(&netif);
+    init_warm();
+    init_scrub();
+    init_lmbscrub();
+    init_stream();
+    init_uartcmd();
+    init_slipnet();
+    init_quota();
+    boot_stage("services");
+    xadc_on_alarm(xadc_alarm, NULL);
+    sched_add_poll(&net_hook);
+    timer_start(&report_timer, 0, REPORT_PERIOD_MS);
+    boot_stage("main-loop");
+    init_wdog();
+    sched_run();
 
     cleanup_platform();
     return 0;
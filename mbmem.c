@@ -0,0 +1,143 @@
+// mbmem.c - memcpy and memset tuned for MicroBlaze.
+//
+// newlib's versions are built for a core with a barrel shifter: without
+// one, a source that is not word aligned with the destination falls back
+// to a loop a byte at a time.  Here the destination is aligned first and
+// the bulk moves in words, unrolled by four as in chksum.c.  A source two
+// bytes off still moves in words, put together from two halfword loads with
+// a swaph (no shift); one or three bytes off goes a byte at a time, also
+// unrolled, as no shift-free merge exists for it.
+//
+// This relies on the CPU being little-endian: the halfword at the lower
+// address is the low half of the word.
+
+#include "bswap.h"
+#include "mbmem.h"
+
+// Below this the setup costs more than the word loops gain
+#define MBMEM_SMALL (8)
+
+void *
+mb_memcpy(void *dst, const void *src, u32 len)
+{
+  const u8 *s = (const u8 *)src;
+  u8 *d = (u8 *)dst;
+  const u16 *sh;
+  const u32 *sl;
+  u32 *dl;
+  u32 w0, w1, w2, w3;
+
+  if(len < MBMEM_SMALL) {
+    while(len--) {
+      *d++ = *s++;
+    }
+    return dst;
+  }
+
+  while((u32)d & 3) {
+    *d++ = *s++;
+    len--;
+  }
+
+  dl = (u32 *)d;
+  switch((u32)s & 3) {
+  case 0:
+    sl = (const u32 *)s;
+    for(; len >= 16; len -= 16) {
+      w0 = sl[0];
+      w1 = sl[1];
+      w2 = sl[2];
+      w3 = sl[3];
+      dl[0] = w0;
+      dl[1] = w1;
+      dl[2] = w2;
+      dl[3] = w3;
+      sl += 4;
+      dl += 4;
+    }
+    for(; len >= 4; len -= 4) {
+      *dl++ = *sl++;
+    }
+    s = (const u8 *)sl;
+    break;
+  case 2:
+    sh = (const u16 *)s;
+    for(; len >= 16; len -= 16) {
+      w0 = sh[0] | rot16(sh[1]);
+      w1 = sh[2] | rot16(sh[3]);
+      w2 = sh[4] | rot16(sh[5]);
+      w3 = sh[6] | rot16(sh[7]);
+      dl[0] = w0;
+      dl[1] = w1;
+      dl[2] = w2;
+      dl[3] = w3;
+      sh += 8;
+      dl += 4;
+    }
+    for(; len >= 4; len -= 4) {
+      *dl++ = sh[0] | rot16(sh[1]);
+      sh += 2;
+    }
+    s = (const u8 *)sh;
+    break;
+  default:
+    d = (u8 *)dl;
+    for(; len >= 4; len -= 4) {
+      d[0] = s[0];
+      d[1] = s[1];
+      d[2] = s[2];
+      d[3] = s[3];
+      d += 4;
+      s += 4;
+    }
+    dl = (u32 *)d;
+    break;
+  }
+
+  d = (u8 *)dl;
+  while(len--) {
+    *d++ = *s++;
+  }
+  return dst;
+}
+
+void *
+mb_memset(void *dst, int c, u32 len)
+{
+  u8 *d = (u8 *)dst;
+  u32 *dl;
+  u32 w = (u8)c;
+
+  if(len < MBMEM_SMALL) {
+    while(len--) {
+      *d++ = (u8)c;
+    }
+    return dst;
+  }
+
+  while((u32)d & 3) {
+    *d++ = (u8)c;
+    len--;
+  }
+
+  // The byte in all four lanes; the shift by 8 is paid once
+  w |= w << 8;
+  w |= rot16(w);
+  dl = (u32 *)d;
+  for(; len >= 16; len -= 16) {
+    dl[0] = w;
+    dl[1] = w;
+    dl[2] = w;
+    dl[3] = w;
+    dl += 4;
+  }
+  for(; len >= 4; len -= 4) {
+    *dl++ = w;
+  }
+
+  d = (u8 *)dl;
+  while(len--) {
+    *d++ = (u8)c;
+  }
+  return dst;
+}
@@ -0,0 +1,16 @@
+#ifndef _MBMEM_H_
+#define _MBMEM_H_
+
+// mbmem.h - memcpy and memset tuned for MicroBlaze, plugged into lwIP as
+// MEMCPY (see lwipopts.h) and used on the application's copy paths.
+//
+// Both behave like their libc namesakes and take buffers at any byte
+// address.  bench.h measures them against newlib's.
+
+#include "xil_types.h"
+
+void *mb_memcpy(void *dst, const void *src, u32 len);
+
+void *mb_memset(void *dst, int c, u32 len);
+
+#endif // _MBMEM_H_
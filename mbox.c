@@ -0,0 +1,207 @@
+// mbox.c - Messages between two MicroBlaze cores through shared BRAM.
+
+#include <string.h>
+
+#include "xil_io.h"
+#include "xil_printf.h"
+
+#include "intr.h"
+#include "mbox.h"
+#include "sched.h"
+#include "work.h"
+
+// Wait for the core's earlier loads and stores to complete, so the peer
+// sees a slot's contents before the index that hands it over
+#ifdef __MICROBLAZE__
+#define mbox_barrier() __asm__ volatile ("mbar 1" ::: "memory")
+#else
+#define mbox_barrier() __sync_synchronize()
+#endif
+
+static struct mbox_shared *shm;
+static u32 side;
+
+static struct {
+  u16 type;
+  mbox_fn fn;
+  void *arg;
+} handlers[MBOX_HANDLERS];
+
+static u32 sent;
+static u32 full;
+static u32 received;
+static u32 dropped;
+
+void
+mbox_attach(struct mbox_shared *shared, u32 s)
+{
+  side = s;
+  shm = shared;
+  if(side == 0) {
+    shm->magic = 0;
+    mbox_barrier();
+    memset(shm->ring, 0, sizeof(shm->ring));
+    shm->ring[0].mask = MBOX_SLOTS - 1;
+    shm->ring[1].mask = MBOX_SLOTS - 1;
+    shm->epoch++;
+    mbox_barrier();
+    shm->magic = MBOX_MAGIC;
+  }
+}
+
+int
+mbox_ready()
+{
+  return shm && shm->magic == MBOX_MAGIC;
+}
+
+int
+mbox_send(u16 type, const u32 *words, u32 n)
+{
+  struct ring *r;
+  struct mbox_slot *slot;
+
+  if(n > MBOX_WORDS || !mbox_ready()) {
+    return -1;
+  }
+  r = &shm->ring[!side];
+  if(!ring_space(r)) {
+    full++;
+    return -1;
+  }
+  slot = &shm->slot[!side][ring_head_slot(r)];
+  slot->type = type;
+  slot->len = n;
+  memcpy(slot->data, words, n * sizeof(u32));
+  mbox_barrier();
+  ring_push(r, 1);
+  sent++;
+#ifdef MBOX_DOORBELL
+  Xil_Out32(MBOX_DOORBELL, 1);
+#endif
+  return 0;
+}
+
+int
+mbox_on(u16 type, mbox_fn fn, void *arg)
+{
+  u32 n, slot = MBOX_HANDLERS;
+
+  for(n=0; n<MBOX_HANDLERS; n++) {
+    if(handlers[n].fn && handlers[n].type == type) {
+      slot = n;
+      break;
+    }
+    if(!handlers[n].fn && slot == MBOX_HANDLERS) {
+      slot = n;
+    }
+  }
+  if(slot == MBOX_HANDLERS) {
+    return fn ? -1 : 0;
+  }
+  handlers[slot].type = type;
+  handlers[slot].fn = fn;
+  handlers[slot].arg = arg;
+  return 0;
+}
+
+static void
+mbox_deliver(const struct mbox_slot *slot)
+{
+  u32 n, len = slot->len < MBOX_WORDS ? slot->len : MBOX_WORDS;
+
+  received++;
+  for(n=0; n<MBOX_HANDLERS; n++) {
+    if(handlers[n].fn && handlers[n].type == slot->type) {
+      handlers[n].fn(slot->type, slot->data, len, handlers[n].arg);
+      return;
+    }
+  }
+  dropped++;
+}
+
+u32
+mbox_poll()
+{
+  struct ring *r;
+  u32 i, n;
+
+  if(!mbox_ready()) {
+    return 0;
+  }
+  r = &shm->ring[side];
+  // Only what was there on entry, so a chatty peer cannot hold the loop
+  n = ring_count(r);
+  for(i=0; i<n; i++) {
+    mbox_deliver(&shm->slot[side][ring_tail_slot(r)]);
+    mbox_barrier();
+    ring_pop(r, 1);
+  }
+  return n;
+}
+
+#if MBOX_PRESENT
+#ifdef MBOX_INTR_ID
+static void
+mbox_work(void *arg)
+{
+  mbox_poll();
+}
+
+static struct work rx_work = WORK_INIT(mbox_work, NULL);
+
+static void
+mbox_isr(void *ref)
+{
+  Xil_Out32(MBOX_DOORBELL_ACK, 1);
+  // Also taking whatever came in while the work was queued
+  work_schedule(&rx_work);
+}
+#else
+static int
+mbox_poll_hook(void *arg)
+{
+  return mbox_poll() != 0;
+}
+
+static struct sched_hook poll_hook = SCHED_HOOK_INIT(mbox_poll_hook, NULL);
+#endif
+#endif // MBOX_PRESENT
+
+void
+init_mbox()
+{
+#if MBOX_PRESENT
+  mbox_attach((struct mbox_shared *)MBOX_BASE, MBOX_SIDE);
+#ifdef MBOX_INTR_ID
+  intr_connect(MBOX_INTR_ID, mbox_isr, NULL);
+  // For messages sent before the interrupt was connected
+  work_schedule(&rx_work);
+#else
+  sched_add_poll(&poll_hook);
+#endif
+#endif
+}
+
+void
+mbox_counts(u32 *sent_out, u32 *full_out, u32 *received_out,
+    u32 *dropped_out)
+{
+  *sent_out = sent;
+  *full_out = full;
+  *received_out = received;
+  *dropped_out = dropped;
+}
+
+void
+dump_mbox()
+{
+#if MBOX_PRESENT
+  xil_printf("Mailbox: side %d at %08x, %s, epoch %d: %d sent, %d refused, "
+      "%d received, %d unhandled\n", side, (u32)shm,
+      mbox_ready() ? "ready" : "waiting", shm->epoch, sent, full, received,
+      dropped);
+#else
+  print("Mailbox: single core\n");
+#endif
+}
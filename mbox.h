@@ -0,0 +1,110 @@
+#ifndef _MBOX_H_
+#define _MBOX_H_
+
+// mbox.h - Messages between two MicroBlaze cores through shared BRAM.
+//
+// A dual-port BRAM behind an AXI BRAM controller on each core's bus holds
+// a struct mbox_shared at MBOX_BASE: a ring (ring.h) of message slots each
+// way.  Each side only ever moves the head of the ring it sends on and the
+// tail of the one it receives on, so neither takes a lock; an mbar before
+// each index update keeps the slot's stores and loads ahead of the update
+// that hands the slot over.  Side 0 (the network core, role.h) lays the
+// rings out when it attaches and side 1 waits for MBOX_MAGIC before it
+// uses them.  Should side 0 restart under a running side 1, the rings
+// start over empty and a message in flight may be lost.
+//
+// mbox_send() copies a message into the peer's ring and rings its
+// doorbell: MBOX_DOORBELL, where the gateware has one, is a register whose
+// write raises the peer's interrupt MBOX_INTR_ID, and writing
+// MBOX_DOORBELL_ACK clears it.  The interrupt handler only schedules the
+// work that takes messages off the ring, so a core asleep in the main loop
+// (sched.h) answers at once; without a doorbell a poll hook looks at the
+// ring on every pass instead.  Messages are handed to the handler
+// mbox_on() registered for their type, from the main loop, in order.
+//
+// Without MBOX_BASE, or in a single core build, init_mbox() attaches
+// nothing and mbox_send() fails.
+
+#include "xil_types.h"
+#include "xparameters.h"
+
+#include "ring.h"
+#include "role.h"
+
+#if !defined(MBOX_BASE) && defined(XPAR_AXI_BRAM_CTRL_1_S_AXI_BASEADDR)
+#define MBOX_BASE (XPAR_AXI_BRAM_CTRL_1_S_AXI_BASEADDR)
+#endif
+
+#if defined(MBOX_BASE) && JAM_ROLE != JAM_ROLE_ALL
+#define MBOX_PRESENT (1)
+#else
+#define MBOX_PRESENT (0)
+#endif
+
+// This image's side: 0 for the network core, 1 for housekeeping
+#define MBOX_SIDE (JAM_ROLE == JAM_ROLE_HOUSE)
+
+// Message slots each way (a power of two) and data words in each
+#define MBOX_SLOTS   (16)
+#define MBOX_WORDS   (15)
+
+// Message types with a handler at once
+#define MBOX_HANDLERS (8)
+
+#define MBOX_MAGIC   (0x4d424f58)
+
+// Message types
+#define MBOX_MSG_XADC_SNAPSHOT (1) // xadc.c: latest results and peaks
+#define MBOX_MSG_XADC_EVENT    (2) // xadc.c: an alarm interrupt
+
+struct mbox_slot {
+  u16 type;
+  u16 len;
+  u32 data[MBOX_WORDS];
+};
+
+struct mbox_shared {
+  volatile u32 magic;
+  // Attaches of side 0 so far
+  volatile u32 epoch;
+  // ring[n] and slot[n] carry messages to side n
+  struct ring ring[2];
+  struct mbox_slot slot[2][MBOX_SLOTS];
+};
+
+typedef void (*mbox_fn)(u16 type, const u32 *words, u32 n, void *arg);
+
+// Attach to the mailbox and add its hook.  Call after init_intr() and
+// init_timers().
+void init_mbox();
+
+// Attach side `side` to the mailbox at `shared`.  init_mbox() does this at
+// MBOX_BASE; the unit tests call it on ordinary memory.
+void mbox_attach(struct mbox_shared *shared, u32 side);
+
+// Non-zero once both sides can send
+int mbox_ready();
+
+// Send message `type` of `n` words to the peer.
+//
+// Returns 0 on success, -1 if `n` is over MBOX_WORDS, the peer's ring is
+// full or the mailbox is not ready.
+int mbox_send(u16 type, const u32 *words, u32 n);
+
+// Call `fn` from the main loop with each message of `type`.  NULL `fn`
+// removes the handler.
+//
+// Returns 0 on success, -1 if MBOX_HANDLERS types already have one.
+int mbox_on(u16 type, mbox_fn fn, void *arg);
+
+// Hand the messages waiting to their handlers.  Returns the number taken.
+u32 mbox_poll();
+
+// Messages sent, refused as the ring was full, received, and received
+// without a handler
+void mbox_counts(u32 *sent, u32 *full, u32 *received, u32 *dropped);
+
+// Print the mailbox's side and counts
+void dump_mbox();
+
+#endif // _MBOX_H_
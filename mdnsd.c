@@ -0,0 +1,539 @@
+// mdnsd.c - Multicast DNS responder for the board's services.
+//
+// The response holds, in its answer section, the host's A record and for
+// each service its PTR, SRV and TXT records and the DNS-SD enumeration
+// PTR.  Names are compressed against the first copy of each.  Queries are
+// only parsed far enough to see whether a question names one of ours.
+
+#include <string.h>
+
+#include "lwip/apps/httpd_opts.h"
+#include "lwip/igmp.h"
+#include "lwip/udp.h"
+
+#include "flash.h"
+#include "gwrev.h"
+#include "katcp.h"
+#include "log.h"
+#include "mdnsd.h"
+#include "timebase.h"
+#include "timer.h"
+#include "version.h"
+#include "wbreg.h"
+
+#define DNS_TYPE_A    (1)
+#define DNS_TYPE_PTR  (12)
+#define DNS_TYPE_TXT  (16)
+#define DNS_TYPE_SRV  (33)
+#define DNS_TYPE_ANY  (255)
+
+#define DNS_CLASS_IN  (1)
+// On unique records: replaces what a cache holds for the name.  On a
+// question: the asker wants the answer unicast.
+#define DNS_CLASS_FLUSH (0x8000)
+
+// Room for the longest name of ours, as text
+#define NAME_SIZE (48)
+
+struct service {
+  const char *type;
+  u16 port;
+};
+
+static const struct service services[] = {
+  { "_jam-reg._udp", WBREG_PORT },
+  { "_katcp._tcp", KATCP_PORT },
+  { "_http._tcp", HTTPD_SERVER_PORT },
+};
+
+static const char enum_name[] = "_services._dns-sd._udp";
+
+// Host and instance label, jam-XXXXXX
+static char host[11];
+
+static u8 pkt[MDNSD_PKT_MAX];
+static u16 pkt_len;
+static u8 pkt_full;
+// Where the A record's address goes
+static u16 ip_off;
+// Where the compression pointers are, for legacy replies to move
+static u16 ptrs[7 * LWIP_ARRAYSIZE(services)];
+static u8 num_ptrs;
+
+static struct netif *mdns_netif;
+static struct udp_pcb *mdns_pcb;
+static ip_addr_t group;
+
+static u32 last_ms;
+static u8 multicast_sent;
+static u8 announced;
+
+static void
+put_u8(u32 v)
+{
+  if(pkt_len >= sizeof(pkt)) {
+    pkt_full = 1;
+    return;
+  }
+  pkt[pkt_len++] = v;
+}
+
+static void
+put_u16(u32 v)
+{
+  put_u8(v >> 8);
+  put_u8(v);
+}
+
+static void
+put_bytes(const char *s, u32 len)
+{
+  while(len--) {
+    put_u8(*s++);
+  }
+}
+
+// The labels of dotted name `s`, without the terminating root
+static void
+put_labels(const char *s)
+{
+  const char *dot;
+
+  while(*s) {
+    dot = strchr(s, '.');
+    if(!dot) {
+      dot = s + strlen(s);
+    }
+    put_u8(dot - s);
+    put_bytes(s, dot - s);
+    s = *dot ? dot + 1 : dot;
+  }
+}
+
+// A compression pointer to the name at `off`, ending the name
+static void
+put_ptr(u32 off)
+{
+  if(num_ptrs >= LWIP_ARRAYSIZE(ptrs)) {
+    pkt_full = 1;
+    return;
+  }
+  ptrs[num_ptrs++] = pkt_len;
+  put_u16(0xc000 | off);
+}
+
+// The fixed part of a record whose name has been put; returns where its
+// length goes, for put_end()
+static u32
+put_rr(u32 type, u32 cls)
+{
+  u32 off;
+
+  put_u16(type);
+  put_u16(cls);
+  put_u16(MDNSD_TTL >> 16);
+  put_u16(MDNSD_TTL);
+  off = pkt_len;
+  put_u16(0);
+  return off;
+}
+
+static void
+put_end(u32 off)
+{
+  u32 len = pkt_len - off - 2;
+
+  if(!pkt_full) {
+    pkt[off] = len >> 8;
+    pkt[off + 1] = len;
+  }
+}
+
+// One character-string of a TXT record, `key` followed by the
+// `len` bytes of `val` in hex
+static void
+put_txt_hex(const char *key, const u8 *val, u32 len)
+{
+  static const char digits[] = "0123456789abcdef";
+  u32 n = strlen(key);
+
+  put_u8(n + 2 * len);
+  put_bytes(key, n);
+  while(len--) {
+    put_u8(digits[*val >> 4]);
+    put_u8(digits[*val & 15]);
+    val++;
+  }
+}
+
+static void
+put_txt(u32 gw_version)
+{
+  static const char digits[] = "0123456789";
+  u8 serial[sizeof(flash_info.id) + FLASH_UID_MAX];
+  u8 gw[4];
+  u32 n;
+
+  memcpy(serial, flash_info.id, sizeof(flash_info.id));
+  memcpy(serial + sizeof(flash_info.id), flash_info.uid, flash_info.uid_len);
+  put_txt_hex("serial=", serial, sizeof(flash_info.id) + flash_info.uid_len);
+
+  // Both halves of the version are below ten for a good while yet
+  put_u8(6);
+  put_bytes("fw=", 3);
+  put_u8(digits[JAM_VERSION_MAJOR % 10]);
+  put_u8('.');
+  put_u8(digits[JAM_VERSION_MINOR % 10]);
+
+  for(n=0; n<4; n++) {
+    gw[n] = gw_version >> (24 - 8 * n);
+  }
+  put_txt_hex("gw=0x", gw, sizeof(gw));
+}
+
+static void
+mdnsd_build(u32 gw_version)
+{
+  u32 host_off, local_off, svc_off, inst_off, enum_off = 0;
+  u32 n, rd, answers = 0;
+
+  pkt_len = 0;
+  num_ptrs = 0;
+  // Header: id 0, response, authoritative, answers patched in below
+  put_u16(0);
+  put_u16(0x8400);
+  put_u16(0);
+  put_u16(0);
+  put_u16(0);
+  put_u16(0);
+
+  host_off = pkt_len;
+  put_labels(host);
+  local_off = pkt_len;
+  put_labels("local");
+  put_u8(0);
+  rd = put_rr(DNS_TYPE_A, DNS_CLASS_IN | DNS_CLASS_FLUSH);
+  ip_off = pkt_len;
+  put_u16(0);
+  put_u16(0);
+  put_end(rd);
+  answers++;
+
+  for(n=0; n<LWIP_ARRAYSIZE(services); n++) {
+    svc_off = pkt_len;
+    put_labels(services[n].type);
+    put_ptr(local_off);
+    rd = put_rr(DNS_TYPE_PTR, DNS_CLASS_IN);
+    inst_off = pkt_len;
+    put_labels(host);
+    put_ptr(svc_off);
+    put_end(rd);
+
+    put_ptr(inst_off);
+    rd = put_rr(DNS_TYPE_SRV, DNS_CLASS_IN | DNS_CLASS_FLUSH);
+    put_u16(0); // priority
+    put_u16(0); // weight
+    put_u16(services[n].port);
+    put_ptr(host_off);
+    put_end(rd);
+
+    put_ptr(inst_off);
+    rd = put_rr(DNS_TYPE_TXT, DNS_CLASS_IN | DNS_CLASS_FLUSH);
+    put_txt(gw_version);
+    put_end(rd);
+
+    if(enum_off) {
+      put_ptr(enum_off);
+    } else {
+      enum_off = pkt_len;
+      put_labels(enum_name);
+      put_ptr(local_off);
+    }
+    rd = put_rr(DNS_TYPE_PTR, DNS_CLASS_IN);
+    put_ptr(svc_off);
+    put_end(rd);
+    answers += 4;
+  }
+
+  pkt[6] = answers >> 8;
+  pkt[7] = answers;
+}
+
+static void
+mdnsd_send(const ip_addr_t *addr, u16_t port, u32 id)
+{
+  struct pbuf *p;
+
+  memcpy(pkt + ip_off, &netif_ip4_addr(mdns_netif)->addr, 4);
+  pkt[0] = id >> 8;
+  pkt[1] = id;
+  p = pbuf_alloc(PBUF_TRANSPORT, pkt_len, PBUF_RAM);
+  if(!p) {
+    return;
+  }
+  pbuf_take(p, pkt, pkt_len);
+  udp_sendto_if(mdns_pcb, p, addr, port, mdns_netif);
+  pbuf_free(p);
+}
+
+// The response to a legacy resolver, which wants its question `name`,
+// `type`, `cls` back (RFC 6762 section 6.7) ahead of the answers; those
+// move up by its length, and their compression pointers with them
+static void
+mdnsd_send_legacy(const ip_addr_t *addr, u16_t port, u32 id,
+    const char *name, u32 type, u32 cls)
+{
+  u8 q[NAME_SIZE + 5], *b;
+  struct pbuf *p;
+  const char *dot;
+  u32 n, qlen = 0, at, ptr;
+
+  while(*name) {
+    dot = strchr(name, '.');
+    if(!dot) {
+      dot = name + strlen(name);
+    }
+    q[qlen++] = dot - name;
+    memcpy(q + qlen, name, dot - name);
+    qlen += dot - name;
+    name = *dot ? dot + 1 : dot;
+  }
+  q[qlen++] = 0;
+  q[qlen++] = type >> 8;
+  q[qlen++] = type;
+  q[qlen++] = cls >> 8;
+  q[qlen++] = cls;
+
+  memcpy(pkt + ip_off, &netif_ip4_addr(mdns_netif)->addr, 4);
+  p = pbuf_alloc(PBUF_TRANSPORT, pkt_len + qlen, PBUF_RAM);
+  if(!p) {
+    return;
+  }
+  b = p->payload;
+  memcpy(b, pkt, 12);
+  b[0] = id >> 8;
+  b[1] = id;
+  b[5] = 1;
+  memcpy(b + 12, q, qlen);
+  memcpy(b + 12 + qlen, pkt + 12, pkt_len - 12);
+  for(n=0; n<num_ptrs; n++) {
+    at = ptrs[n] + qlen;
+    ptr = ((b[at] << 8) | b[at + 1]) + qlen;
+    b[at] = ptr >> 8;
+    b[at + 1] = ptr;
+  }
+  udp_sendto_if(mdns_pcb, p, addr, port, mdns_netif);
+  pbuf_free(p);
+}
+
+static u32
+get_u16(const struct pbuf *p, u32 off)
+{
+  return (pbuf_get_at(p, off) << 8) | pbuf_get_at(p, off + 1);
+}
+
+// Read the name at `off` of `p` into `name` as lower-case dotted text,
+// following compression pointers; a name that does not fit `size` bytes
+// reads as "", not one of ours.  Returns the offset past it, or -1 if it is
+// malformed.
+static int
+mdnsd_name(const struct pbuf *p, u32 off, char *name, u32 size)
+{
+  int c, end = -1;
+  u32 n = 0, jumps = 0;
+
+  for(;;) {
+    c = pbuf_try_get_at(p, off);
+    if(c < 0) {
+      return -1;
+    }
+    if((c & 0xc0) == 0xc0) {
+      if(off + 1 >= p->tot_len || ++jumps > 8) {
+        return -1;
+      }
+      if(end < 0) {
+        end = off + 2;
+      }
+      off = ((c & 0x3f) << 8) | pbuf_get_at(p, off + 1);
+      continue;
+    }
+    if(c & 0xc0) {
+      return -1;
+    }
+    off++;
+    if(!c) {
+      break;
+    }
+    if(off + c > p->tot_len) {
+      return -1;
+    }
+    if(n + c + 2 > size) {
+      // Too long: skip the rest
+      n = size;
+      off += c;
+      continue;
+    }
+    if(n) {
+      name[n++] = '.';
+    }
+    while(c--) {
+      name[n] = pbuf_get_at(p, off++);
+      if(name[n] >= 'A' && name[n] <= 'Z') {
+        name[n] += 'a' - 'A';
+      }
+      n++;
+    }
+  }
+  name[n < size ? n : 0] = '\0';
+  return end < 0 ? off : end;
+}
+
+// Whether `name` is `a`, or `a`.`b` if `b` is not NULL, in .local
+static int
+name_is(const char *name, const char *a, const char *b)
+{
+  u32 len = strlen(a);
+
+  if(strncmp(name, a, len) != 0) {
+    return 0;
+  }
+  name += len;
+  if(b) {
+    if(*name++ != '.') {
+      return 0;
+    }
+    len = strlen(b);
+    if(strncmp(name, b, len) != 0) {
+      return 0;
+    }
+    name += len;
+  }
+  return strcmp(name, ".local") == 0;
+}
+
+static int
+mdnsd_ours(const char *name)
+{
+  u32 n;
+
+  if(name_is(name, host, NULL) || name_is(name, enum_name, NULL)) {
+    return 1;
+  }
+  for(n=0; n<LWIP_ARRAYSIZE(services); n++) {
+    if(name_is(name, services[n].type, NULL) ||
+       name_is(name, host, services[n].type)) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+static void
+mdnsd_multicast()
+{
+  mdnsd_send(&group, MDNSD_PORT, 0);
+  multicast_sent = 1;
+  last_ms = timebase_ms();
+}
+
+static void
+mdnsd_recv(void *arg, struct udp_pcb *pcb, struct pbuf *p,
+    const ip_addr_t *addr, u16_t port)
+{
+  char name[NAME_SIZE], qname[NAME_SIZE];
+  u32 n, questions, type, cls, matched = 0, unicast = 1, qtype = 0, qcls = 0;
+  int off = 12;
+
+  // A standard query
+  if(p->tot_len < 12 || (pbuf_get_at(p, 2) & 0xf8)) {
+    pbuf_free(p);
+    return;
+  }
+  questions = get_u16(p, 4);
+  for(n=0; n<questions; n++) {
+    off = mdnsd_name(p, off, name, sizeof(name));
+    if(off < 0 || off + 4 > p->tot_len) {
+      break;
+    }
+    type = get_u16(p, off);
+    cls = get_u16(p, off + 2);
+    off += 4;
+    if((type == DNS_TYPE_A || type == DNS_TYPE_PTR || type == DNS_TYPE_SRV ||
+        type == DNS_TYPE_TXT || type == DNS_TYPE_ANY) && mdnsd_ours(name)) {
+      if(!matched) {
+        strcpy(qname, name);
+        qtype = type;
+        qcls = cls;
+      }
+      matched = 1;
+      unicast &= (cls & DNS_CLASS_FLUSH) != 0;
+    }
+  }
+
+  if(!matched) {
+    // Not ours
+  } else if(port != MDNSD_PORT) {
+    // A one-shot query from a plain resolver: only it listens for the
+    // answer, which must carry its id and the first question of ours
+    mdnsd_send_legacy(addr, port, get_u16(p, 0), qname, qtype, qcls);
+  } else if(unicast) {
+    mdnsd_send(addr, port, 0);
+  } else if(!multicast_sent ||
+      timebase_ms() - last_ms >= MDNSD_HOLDOFF_MS) {
+    mdnsd_multicast();
+  }
+  pbuf_free(p);
+}
+
+static void mdnsd_announce(void *arg);
+
+static struct timer announce_timer = TIMER_INIT(mdnsd_announce, NULL);
+
+static void
+mdnsd_announce(void *arg)
+{
+  // Under DHCP, wait for an address to announce
+  if(ip4_addr_isany_val(*netif_ip4_addr(mdns_netif))) {
+    return;
+  }
+  mdnsd_multicast();
+  if(++announced >= MDNSD_ANNOUNCE_COUNT) {
+    timer_stop(&announce_timer);
+  }
+}
+
+void
+init_mdnsd(struct netif *netif)
+{
+  static const char digits[] = "0123456789abcdef";
+  u32 n;
+
+  memcpy(host, "jam-", 4);
+  for(n=0; n<3; n++) {
+    host[4 + 2 * n] = digits[netif->hwaddr[3 + n] >> 4];
+    host[5 + 2 * n] = digits[netif->hwaddr[3 + n] & 15];
+  }
+  host[10] = '\0';
+
+  mdnsd_build(gwrev());
+  if(pkt_full) {
+    LOG("mdnsd: response does not fit %d bytes", MDNSD_PKT_MAX);
+    return;
+  }
+
+  IP_ADDR4(&group, 224, 0, 0, 251);
+  mdns_netif = netif;
+  mdns_pcb = udp_new();
+  if(!mdns_pcb || udp_bind(mdns_pcb, IP_ADDR_ANY, MDNSD_PORT) != ERR_OK) {
+    return;
+  }
+  // RFC 6762 section 11: receivers check for 255 to tell link-local
+  // traffic
+  mdns_pcb->ttl = 255;
+  udp_recv(mdns_pcb, mdnsd_recv, NULL);
+#if LWIP_IGMP
+  // eth0 only passes the groups joined
+  igmp_joingroup_netif(netif, ip_2_ip4(&group));
+#endif
+  timer_start(&announce_timer, 0, MDNSD_ANNOUNCE_MS);
+}
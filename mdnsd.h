@@ -0,0 +1,51 @@
+#ifndef _MDNSD_H_
+#define _MDNSD_H_
+
+// mdnsd.h - Multicast DNS responder for the board's services.
+//
+// Answers mDNS queries (RFC 6762) on MDNSD_PORT for the host name
+// jam-XXXXXX.local, XXXXXX being the last three bytes of the MAC, and
+// advertises through DNS-SD (RFC 6763) the services
+//
+//   _jam-reg._udp  register access, wbreg.h
+//   _katcp._tcp    KATCP control, katcp.h
+//   _http._tcp     web UI, webfs.h
+//
+// each as the instance jam-XXXXXX, with the TXT record
+//
+//   serial=<hex>   flash ID and unique ID, as discover.h's serial
+//   fw=<major>.<minor>
+//   gw=0x<sys_rev> first word of the gateware's sys_rev device
+//
+// Every record fits one response, which is built once by init_mdnsd()
+// with only the address patched in before each send; a query for any of
+// the names is answered with the whole of it.  The responder does not
+// probe for conflicts: the MAC makes the names unique.  It joins the mDNS
+// group (224.0.0.251) on eth0, so that the driver's multicast filter
+// lets its frames through.
+
+#include "lwip/netif.h"
+
+#define MDNSD_PORT (5353)
+
+// Record TTL, in seconds.  RFC 6762 suggests 120 for records with a host
+// name in them; the rest live no longer, since they change with them.
+#define MDNSD_TTL  (120)
+
+// A response goes to the group at most this often; more queries are
+// answered by the one already sent
+#define MDNSD_HOLDOFF_MS (1000)
+
+// Unsolicited announcements at boot, MDNSD_ANNOUNCE_MS apart, once eth0
+// has an address
+#define MDNSD_ANNOUNCE_COUNT (2)
+#define MDNSD_ANNOUNCE_MS    (1000)
+
+// Room for the response
+#define MDNSD_PKT_MAX (640)
+
+// Build the response and start answering on `netif`.  Call after
+// netif_add() and init_flash().
+void init_mdnsd(struct netif *netif);
+
+#endif // _MDNSD_H_
@@ -0,0 +1,130 @@
+// netcfg.c - eth0's IPv4 configuration (see netcfg.h).
+//
+// Both keys are saved in the background (kv_save()).  The lease is polled
+// rather than hooked into lwIP's DHCP client, and saved only when it
+// differs from the cached one, which on a renewal it rarely does.
+
+#include <string.h>
+
+#include "lwip/dhcp.h"
+
+#include "xil_printf.h"
+
+#include "arpcfg.h"
+#include "bswap.h"
+#include "kv.h"
+#include "log.h"
+#include "netcfg.h"
+#include "timer.h"
+
+static struct netif *cfg_netif;
+
+// As booted with, and as saved for the next boot
+static struct netcfg cfg;
+static struct netcfg next_cfg;
+
+static struct netcfg_lease lease;
+static u8 have_lease;
+// Address the last poll found bound, in network order
+static u32 bound_ip;
+
+static struct kv_save cfg_save = KV_SAVE_INIT(cfg_save, KV_KEY_NETCFG);
+static struct kv_save lease_save = KV_SAVE_INIT(lease_save, KV_KEY_DHCP_LEASE);
+
+static void
+netcfg_poll(void *arg)
+{
+  struct dhcp *dhcp = netif_get_client_data(cfg_netif,
+      LWIP_NETIF_CLIENT_DATA_INDEX_DHCP);
+  struct netcfg_lease l;
+
+  if(!dhcp_supplied_address(cfg_netif)) {
+    return;
+  }
+  memset(&l, 0, sizeof(l));
+  l.ip = ip4_addr_get_u32(netif_ip4_addr(cfg_netif));
+  l.netmask = ip4_addr_get_u32(netif_ip4_netmask(cfg_netif));
+  l.gw = ip4_addr_get_u32(netif_ip4_gw(cfg_netif));
+  l.server = ip4_addr_get_u32(ip_2_ip4(&dhcp->server_ip_addr));
+  l.lease_s = dhcp->offered_t0_lease;
+
+  if(l.ip != bound_ip) {
+    bound_ip = l.ip;
+    LOG("netcfg: DHCP address %x", swap32(l.ip));
+    // Static ARP entries need the subnet to be known
+    arpcfg_reload();
+  }
+  if(!have_lease || memcmp(&l, &lease, sizeof(l)) != 0) {
+    lease = l;
+    have_lease = 1;
+    kv_save(&lease_save, &lease, sizeof(lease));
+  }
+}
+
+static struct timer poll_timer = TIMER_INIT(netcfg_poll, NULL);
+
+void
+netcfg_get(struct netcfg *c)
+{
+  *c = cfg;
+}
+
+void
+netcfg_set(const struct netcfg *c)
+{
+  next_cfg = *c;
+  memset(next_cfg.pad, 0, sizeof(next_cfg.pad));
+  kv_save(&cfg_save, &next_cfg, sizeof(next_cfg));
+}
+
+int
+netcfg_lease(struct netcfg_lease *l)
+{
+  if(!have_lease) {
+    return -1;
+  }
+  *l = lease;
+  return 0;
+}
+
+void
+init_netcfg(struct netif *netif)
+{
+  ip4_addr_t ip, netmask, gw;
+
+  cfg_netif = netif;
+  if(kv_get(KV_KEY_NETCFG, &cfg, sizeof(cfg)) != sizeof(cfg)) {
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.mode = NETCFG_STATIC;
+    NETCFG_DEFAULT_IP(&ip);
+    NETCFG_DEFAULT_NETMASK(&netmask);
+    NETCFG_DEFAULT_GW(&gw);
+    cfg.ip = ip4_addr_get_u32(&ip);
+    cfg.netmask = ip4_addr_get_u32(&netmask);
+    cfg.gw = ip4_addr_get_u32(&gw);
+  }
+  next_cfg = cfg;
+
+  if(cfg.mode != NETCFG_DHCP) {
+    ip4_addr_set_u32(&ip, cfg.ip);
+    ip4_addr_set_u32(&netmask, cfg.netmask);
+    ip4_addr_set_u32(&gw, cfg.gw);
+    netif_set_addr(netif, &ip, &netmask, &gw);
+    xil_printf("IP:     %s (static)\n", ip4addr_ntoa(&ip));
+    return;
+  }
+
+  have_lease = kv_get(KV_KEY_DHCP_LEASE, &lease, sizeof(lease)) ==
+      sizeof(lease);
+  ip4_addr_set_u32(&ip, have_lease ? lease.ip : 0);
+  if(have_lease) {
+    xil_printf("IP:     DHCP, asking for %s again\n", ip4addr_ntoa(&ip));
+  } else {
+    print("IP:     DHCP\n");
+  }
+  if(dhcp_start_reboot(netif, &ip) != ERR_OK) {
+    LOG("netcfg: cannot start DHCP");
+    return;
+  }
+  timer_start(&poll_timer, NETCFG_POLL_MS, NETCFG_POLL_MS);
+}
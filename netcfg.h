@@ -0,0 +1,68 @@
+#ifndef _NETCFG_H_
+#define _NETCFG_H_
+
+// netcfg.h - eth0's IPv4 configuration: static, or DHCP with the lease
+// cached in flash.
+//
+// The configuration is kept in KV_KEY_NETCFG (see kv.h) and set with
+// KATCP's ?net (see katcp.h); a change takes effect at the next boot.
+// Without one eth0 takes the NETCFG_DEFAULT_* address statically.  A
+// static address is set before any service starts, so the board answers
+// as soon as they are up.
+//
+// Under DHCP the last lease is kept in KV_KEY_DHCP_LEASE.  At boot the
+// client starts in INIT-REBOOT with a REQUEST for the cached address
+// (dhcp_start_reboot()): a server that still holds the lease ACKs it in
+// one round trip, rather than the DISCOVER, OFFER, REQUEST, ACK and ARP
+// probe of a fresh lease.  Without a cached lease, or if the server NAKs
+// it or stays silent for a few seconds, the client falls back to DISCOVER.
+
+#include "lwip/netif.h"
+
+#include "xil_types.h"
+
+// Address without a saved configuration
+#define NETCFG_DEFAULT_IP(ipaddr)       IP4_ADDR((ipaddr), 10, 10, 10, 10)
+#define NETCFG_DEFAULT_NETMASK(netmask) IP4_ADDR((netmask), 255, 255, 255, 0)
+#define NETCFG_DEFAULT_GW(gw)           IP4_ADDR((gw), 0, 0, 0, 0)
+
+// How often the DHCP lease is checked for changes to save
+#define NETCFG_POLL_MS  (1000)
+
+#define NETCFG_STATIC (0)
+#define NETCFG_DHCP   (1)
+
+// As stored: addresses in network order, used only by NETCFG_STATIC
+struct netcfg {
+  u8 mode;
+  u8 pad[3];
+  u32 ip;
+  u32 netmask;
+  u32 gw;
+};
+
+// As stored: addresses in network order
+struct netcfg_lease {
+  u32 ip;
+  u32 netmask;
+  u32 gw;
+  u32 server;
+  // Lease time granted, in seconds
+  u32 lease_s;
+};
+
+// Load the configuration and apply it to `netif`, which was added without
+// an address: set the static address, or start DHCP.  Call after
+// netif_set_up() and init_kv().
+void init_netcfg(struct netif *netif);
+
+// The configuration the board booted with
+void netcfg_get(struct netcfg *cfg);
+
+// Save `cfg` for the next boot, in the background
+void netcfg_set(const struct netcfg *cfg);
+
+// Copy the cached DHCP lease into `l`.  Returns 0, or -1 if there is none.
+int netcfg_lease(struct netcfg_lease *l);
+
+#endif // _NETCFG_H_
@@ -0,0 +1,78 @@
+// nomalloc.c - Keep newlib's malloc() out of the image.
+//
+// Nothing in the firmware allocates at run time: lwIP draws from its memp
+// pools (lwipopts.h, lwippools.h) and everything else is static, so
+// lscript.ld leaves no heap.  A library function that still wants one
+// (newlib's exit() machinery, say) links against these instead of
+// newlib's allocator and its sbrk(), which would bring in several KB of
+// .text for a heap that is not there.  Every request fails and is logged
+// with the caller's address; "make" fails the build if newlib's
+// allocator is linked anyway (MALLOC_CHECK).
+
+#include <stddef.h>
+
+#include "log.h"
+
+struct _reent;
+
+void *malloc(size_t size);
+void free(void *p);
+void *calloc(size_t n, size_t size);
+void *realloc(void *p, size_t size);
+void *_malloc_r(struct _reent *r, size_t size);
+void _free_r(struct _reent *r, void *p);
+void *_calloc_r(struct _reent *r, size_t n, size_t size);
+void *_realloc_r(struct _reent *r, void *p, size_t size);
+
+static void *
+nomalloc(size_t size, void *caller)
+{
+  LOG("malloc: %u bytes refused, called from %x", size, (u32)caller);
+  return NULL;
+}
+
+void *
+malloc(size_t size)
+{
+  return nomalloc(size, __builtin_return_address(0));
+}
+
+void
+free(void *p)
+{
+}
+
+void *
+calloc(size_t n, size_t size)
+{
+  return nomalloc(n * size, __builtin_return_address(0));
+}
+
+void *
+realloc(void *p, size_t size)
+{
+  return nomalloc(size, __builtin_return_address(0));
+}
+
+void *
+_malloc_r(struct _reent *r, size_t size)
+{
+  return nomalloc(size, __builtin_return_address(0));
+}
+
+void
+_free_r(struct _reent *r, void *p)
+{
+}
+
+void *
+_calloc_r(struct _reent *r, size_t n, size_t size)
+{
+  return nomalloc(n * size, __builtin_return_address(0));
+}
+
+void *
+_realloc_r(struct _reent *r, void *p, size_t size)
+{
+  return nomalloc(size, __builtin_return_address(0));
+}
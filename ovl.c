@@ -0,0 +1,147 @@
+// ovl.c - Cold code loaded from flash into a shared BRAM window (see
+// ovl.h).
+
+#include "xil_printf.h"
+
+#include "crc32.h"
+#include "flash.h"
+#include "log.h"
+#include "ovl.h"
+#include "slots.h"
+#include "spi.h"
+
+// From lscript.ld: the window, and each overlay's load addresses
+extern u8 __ovl_start[], __ovl_end[];
+extern u8 __load_start_ovl_report[], __load_stop_ovl_report[];
+extern u8 __load_start_ovl_bench[], __load_stop_ovl_bench[];
+
+static const char *const names[OVL_COUNT] = { "report", "bench" };
+
+// Size of each overlay as linked
+static u32
+linked_size(u32 id)
+{
+  switch(id) {
+  case OVL_REPORT:
+    return __load_stop_ovl_report - __load_start_ovl_report;
+  case OVL_BENCH:
+    return __load_stop_ovl_bench - __load_start_ovl_bench;
+  }
+  return 0;
+}
+
+static u8 resident = OVL_NONE;
+static u32 loads;
+static u32 failures;
+
+// Slot table sequence number the image was looked up at
+static u32 image_seq;
+static u8 image_found;
+static int image_slot = -1;
+static u32 image_addr;
+static struct ovl_entry entries[OVL_COUNT];
+
+// Look for the newest image again if the table changed
+static void
+image_find()
+{
+  const struct slot_desc *d;
+  struct ovl_header h;
+  u32 version = 0;
+  int i;
+
+  if(image_found && image_seq == slots.seq) {
+    return;
+  }
+  image_found = 1;
+  image_seq = slots.seq;
+  image_slot = -1;
+
+  for(i=0; i<slots.num; i++) {
+    d = &slots.slot[i];
+    if(i == SLOT_GOLDEN || !d->len || (image_slot >= 0 && d->version < version)) {
+      continue;
+    }
+    if(read_flash_cached(d->addr, (u8 *)&h, sizeof(h)) != sizeof(h) ||
+       h.magic != OVL_MAGIC || h.count != OVL_COUNT || h.size > d->len ||
+       h.window != (u32)__ovl_start ||
+       read_flash_cached(d->addr + sizeof(h), (u8 *)entries,
+         sizeof(entries)) != sizeof(entries)) {
+      continue;
+    }
+    image_slot = i;
+    image_addr = d->addr;
+    version = d->version;
+  }
+}
+
+int
+ovl_load(u32 id)
+{
+  const struct ovl_entry *e = &entries[id];
+
+  if(id == resident) {
+    return 0;
+  }
+  image_find();
+  if(image_slot < 0 || spi_busy() ||
+     flash_suspend(image_addr + e->offset, e->size) != 0) {
+    return -1;
+  }
+  // A half-read window holds nothing
+  resident = OVL_NONE;
+  loads++;
+  if(e->size != linked_size(id) || e->size > __ovl_end - __ovl_start ||
+     read_flash(image_addr + e->offset, __ovl_start, e->size,
+       FLASH_MODE_BEST) != e->size ||
+     crc32(0, __ovl_start, e->size) != e->crc) {
+    failures++;
+    LOG("ovl: overlay %u failed to load from slot %u", id, image_slot);
+    return -1;
+  }
+  resident = id;
+  return 0;
+}
+
+u32
+ovl_resident()
+{
+  return resident;
+}
+
+int
+ovl_slot()
+{
+  image_find();
+  return image_slot;
+}
+
+u32
+ovl_loads()
+{
+  return loads;
+}
+
+u32
+ovl_failures()
+{
+  return failures;
+}
+
+void
+dump_ovl()
+{
+  u32 i;
+
+  xil_printf("Overlays: %d B window, ", __ovl_end - __ovl_start);
+  if(ovl_slot() < 0) {
+    print("no image\n");
+  } else {
+    xil_printf("image in slot %d\n", image_slot);
+  }
+  for(i=0; i<OVL_COUNT; i++) {
+    xil_printf("  %-8s %5d B%s\n", names[i], linked_size(i),
+        i == resident ? ", resident" : "");
+  }
+  xil_printf("  %d loads, %d failed\n", loads, failures);
+}
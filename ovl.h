@@ -0,0 +1,77 @@
+#ifndef _OVL_H_
+#define _OVL_H_
+
+// ovl.h - Cold code loaded from flash into a shared BRAM window.
+//
+// Code that runs rarely, the startup report's dumps and the benchmarks,
+// is linked into overlays instead of .text: OVL_TEXT(name) puts a
+// function in overlay .ovl_<name>, and lscript.ld lays all overlays over
+// one another in a window the size of the largest, with load addresses
+// outside BRAM.  "make" packs them into executable.ovl (tools/mkovl.py),
+// an image written into a slot of its own like the web UI's (see
+// webfs.h), and leaves them out of the BRAM image (executable-bram.elf)
+// that updatemem puts in the bitstream.  The image used is the newest
+// valid one, found again whenever the slot table changes.
+//
+// ovl_load() reads an overlay into the window with the fastest read mode
+// and checks it against the image's CRC-32, unless it is resident
+// already.  One overlay is resident at a time, so resident code calls
+// into an overlay only right after ovl_load() of it succeeded, and an
+// overlay does not call another (NOCROSSREFS in lscript.ld).  Overlays
+// call resident code freely.  Their string constants stay in .rodata.
+//
+// The image must come from the same build as the firmware: an overlay
+// whose size differs from the one linked is refused.
+//
+// Image layout, little-endian: a struct ovl_header, then `count` struct
+// ovl_entry in OVL_* order, then the overlays' code at the offsets the
+// entries give from the start of the image.
+
+#include "xil_types.h"
+
+#define OVL_MAGIC  (0x314c564f) // "OVL1"
+
+// Overlays, in the order "make" packs them (OVERLAYS in the Makefile)
+#define OVL_REPORT (0) // startup report dumps (main.c)
+#define OVL_BENCH  (1) // benchmarks (bench.h)
+#define OVL_COUNT  (2)
+#define OVL_NONE   (0xff)
+
+#define OVL_TEXT(name) __attribute__((section(".ovl." #name)))
+
+struct ovl_header {
+  u32 magic;
+  u32 count;
+  // Bytes in the whole image
+  u32 size;
+  // Address of the window the overlays were linked for
+  u32 window;
+};
+
+struct ovl_entry {
+  u32 offset;
+  u32 size;
+  u32 crc;
+};
+
+// Make overlay `id` resident.  Reads the flash synchronously, so not while
+// flash_busy() or spi_busy().
+//
+// Returns 0 once it is resident, -1 if there is no valid image, the flash
+// is busy or the overlay read back wrong.
+int ovl_load(u32 id);
+
+// Overlay in the window, or OVL_NONE
+u32 ovl_resident();
+
+// Slot holding the image in use, or -1 if there is none
+int ovl_slot();
+
+// Loads from flash so far, and how many failed
+u32 ovl_loads();
+u32 ovl_failures();
+
+// Print the window's size and use, and the image found, on the console
+void dump_ovl();
+
+#endif // _OVL_H_
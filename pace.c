@@ -0,0 +1,44 @@
+// pace.c - Token-bucket pacing of a stream by release times.
+
+#include "pace.h"
+#include "timebase.h"
+
+// Cycles `len` bytes take at the rate
+static u64
+pace_cycles(const struct pace *p, u32 len)
+{
+  return ((u64)len * p->cycles_per_byte) >> PACE_FRAC_BITS;
+}
+
+int
+pace_set(struct pace *p, u32 rate, u32 burst)
+{
+  if(rate && rate < PACE_MIN_RATE) {
+    return -1;
+  }
+  p->rate = rate;
+  p->burst = burst;
+  p->cycles_per_byte = rate ?
+      (u32)(((u64)TIMEBASE_HZ << PACE_FRAC_BITS) / rate) : 0;
+  p->depth = pace_cycles(p, burst);
+  p->full_at = 0;
+  return 0;
+}
+
+u64
+pace_release(struct pace *p, u64 now, u32 len)
+{
+  u64 when;
+
+  if(!p->rate) {
+    return now;
+  }
+  // An idle stream saves up no more than the bucket holds
+  if(p->full_at < now) {
+    p->full_at = now;
+  }
+  p->full_at += pace_cycles(p, len);
+  // Until the shortfall is within the bucket's depth
+  when = p->full_at - p->depth;
+  return p->full_at > p->depth && when > now ? when : now;
+}
@@ -0,0 +1,49 @@
+#ifndef _PACE_H_
+#define _PACE_H_
+
+// pace.h - Token-bucket pacing of a stream by release times.
+//
+// The bucket holds up to `burst` bytes and fills at `rate` bytes a second.
+// A frame may go once the bucket holds its length, which it then takes
+// out.  Rather than counting tokens as time passes, a struct pace keeps
+// the timebase_cycles() at which the bucket will be full again, `full_at`:
+// the bucket is that far short of full, at the rate.  pace_release()
+// gives each frame the time it may go and moves `full_at` on by the
+// frame's length, so a run of frames is spread out at the rate however
+// fast they are offered, after the first `burst` bytes.  This is GCRA, the
+// virtual scheduling form of the token bucket.
+//
+// The rate becomes cycles per byte once, in pace_set(), so that pacing a
+// frame takes a multiply and no division (the core has no divider).
+
+#include "xil_types.h"
+
+// Fraction bits of the cycles per byte
+#define PACE_FRAC_BITS (12)
+
+// Slowest rate, in bytes a second, keeping the cycles per byte in 32 bits
+#define PACE_MIN_RATE  (1000)
+
+struct pace {
+  // Bytes a second, 0 for no pacing, and the bucket's depth in bytes
+  u32 rate;
+  u32 burst;
+  // Timer cycles per byte, with PACE_FRAC_BITS fraction bits
+  u32 cycles_per_byte;
+  // Cycles the bucket takes to fill from empty
+  u64 depth;
+  // timebase_cycles() at which the bucket is full again
+  u64 full_at;
+};
+
+// Pace at `rate` bytes a second with a bucket `burst` bytes deep, starting
+// full, or stop pacing with a `rate` of 0.  Returns 0, or -1 if `rate` is
+// below PACE_MIN_RATE.
+int pace_set(struct pace *p, u32 rate, u32 burst);
+
+// The time at or after `now` at which a frame of `len` bytes may go, in
+// timebase_cycles(), taking it from the bucket.  Frames must be released
+// in the order they were paced.  `now` unless pacing.
+u64 pace_release(struct pace *p, u64 now, u32 len);
+
+#endif // _PACE_H_
@@ -0,0 +1,210 @@
+// pcprof.c - Statistical PC-sampling profiler (see pcprof.h).
+//
+// The tick interrupt hands the sampler the interrupted PC (timebase
+// _set_sampler()); the sampler only bumps a bin, so profiling costs a few
+// dozen cycles a millisecond and nothing while stopped.  The export is
+// served like telemetry.c's: one connection at a time, queued straight
+// from the header and the bins as send buffer space frees up.
+
+#include <string.h>
+
+#include "lwip/tcp.h"
+#include "netif/ethernetif.h"
+
+#include "xil_printf.h"
+
+#include "intr.h"
+#include "log.h"
+#include "pcprof.h"
+#include "sections.h"
+#include "timebase.h"
+
+static u16 bins[PCPROF_BINS] PCPROF_SECTION;
+static volatile u32 samples;
+static volatile u32 other;
+static volatile u8 scale;
+static u8 running;
+
+// Export in progress
+static struct {
+  struct tcp_pcb *pcb;
+  struct pcprof_header hdr;
+  u32 off;
+  u32 len;
+} tx;
+
+// Tick interrupt: count `pc`
+static void
+pcprof_sample(u32 pc)
+{
+  u32 off = pc - PCPROF_BASE;
+  u32 i;
+
+  samples++;
+  if(off >= PCPROF_SPAN) {
+    other++;
+    return;
+  }
+  if(++bins[off >> PCPROF_BIN_SHIFT] == 0xffff) {
+    for(i=0; i<PCPROF_BINS; i++) {
+      bins[i] >>= 1;
+    }
+    scale++;
+  }
+}
+
+void
+pcprof_start()
+{
+  running = 1;
+  timebase_set_sampler(pcprof_sample);
+}
+
+void
+pcprof_stop()
+{
+  running = 0;
+  timebase_set_sampler(NULL);
+}
+
+void
+pcprof_clear()
+{
+  u32 msr = intr_lock();
+
+  memset(bins, 0, sizeof(bins));
+  samples = 0;
+  other = 0;
+  scale = 0;
+  intr_unlock(msr);
+}
+
+int
+pcprof_running()
+{
+  return running;
+}
+
+u32
+pcprof_samples()
+{
+  return samples;
+}
+
+// Queue as much of the export as the send buffer takes, and close the
+// connection once all of it is queued
+static void
+pcprof_send(struct tcp_pcb *pcb)
+{
+  const u8 *src;
+  u32 n;
+
+  while(tx.off < tx.len) {
+    if(tx.off < sizeof(tx.hdr)) {
+      src = (const u8 *)&tx.hdr + tx.off;
+      n = sizeof(tx.hdr) - tx.off;
+    } else {
+      src = (const u8 *)bins + (tx.off - sizeof(tx.hdr));
+      n = tx.len - tx.off;
+    }
+    if(n > tcp_sndbuf(pcb)) {
+      n = tcp_sndbuf(pcb);
+    }
+    if(n > TCP_MSS) {
+      n = TCP_MSS;
+    }
+    if(n == 0) {
+      break;
+    }
+    if(tcp_write(pcb, src, n, TCP_WRITE_FLAG_COPY |
+          (tx.off + n < tx.len ? TCP_WRITE_FLAG_MORE : 0)) != ERR_OK) {
+      break;
+    }
+    tx.off += n;
+  }
+  tcp_output(pcb);
+
+  if(tx.off == tx.len && tcp_close(pcb) == ERR_OK) {
+    tcp_recv(pcb, NULL);
+    tcp_sent(pcb, NULL);
+    tcp_err(pcb, NULL);
+    tx.pcb = NULL;
+  }
+}
+
+static err_t
+pcprof_sent(void *arg, struct tcp_pcb *pcb, u16_t len)
+{
+  pcprof_send(pcb);
+  return ERR_OK;
+}
+
+static err_t
+pcprof_recv(void *arg, struct tcp_pcb *pcb, struct pbuf *p, err_t err)
+{
+  // Nothing is expected from the reader
+  if(p) {
+    tcp_recved(pcb, p->tot_len);
+    pbuf_free(p);
+  }
+  return ERR_OK;
+}
+
+static void
+pcprof_err(void *arg, err_t err)
+{
+  tx.pcb = NULL;
+}
+
+static err_t
+pcprof_accept(void *arg, struct tcp_pcb *pcb, err_t err)
+{
+  struct pcprof_header *h = &tx.hdr;
+
+  if(err != ERR_OK || tx.pcb) {
+    return ERR_MEM;
+  }
+
+  memset(h, 0, sizeof(*h));
+  h->magic = PCPROF_MAGIC;
+  h->version = PCPROF_VERSION;
+  h->header_size = sizeof(*h);
+  h->base = PCPROF_BASE;
+  h->bin_shift = PCPROF_BIN_SHIFT;
+  h->bins = PCPROF_BINS;
+  h->hz = 1000;
+  h->samples = samples;
+  h->other = other;
+  h->scale = scale;
+  h->running = running;
+
+  pcb->tos = ETHERNETIF_TOS_BULK;
+  tx.pcb = pcb;
+  tx.off = 0;
+  tx.len = sizeof(*h) + sizeof(bins);
+
+  LOG("pcprof: export of %d samples", h->samples);
+
+  tcp_arg(pcb, NULL);
+  tcp_recv(pcb, pcprof_recv);
+  tcp_sent(pcb, pcprof_sent);
+  tcp_err(pcb, pcprof_err);
+  pcprof_send(pcb);
+  return ERR_OK;
+}
+
+void
+init_pcprof()
+{
+  struct tcp_pcb *pcb = tcp_new();
+
+  // The section is not zeroed at startup
+  pcprof_clear();
+
+  if(!pcb || tcp_bind(pcb, IP_ADDR_ANY, PCPROF_PORT) != ERR_OK) {
+    xil_printf("pcprof: cannot bind port %d\n", PCPROF_PORT);
+    return;
+  }
+  pcb = tcp_listen(pcb);
+  tcp_accept(pcb, pcprof_accept);
+}
@@ -0,0 +1,70 @@
+#ifndef _PCPROF_H_
+#define _PCPROF_H_
+
+// pcprof.h - Statistical PC-sampling profiler, readable over the network.
+//
+// While the profiler runs, every timebase tick (TIMEBASE's 1 ms interrupt)
+// counts the PC it interrupted in a histogram over local memory, in bins
+// of 1 << PCPROF_BIN_SHIFT bytes.  Time spent with interrupts masked shows
+// up at the instruction that unmasks them, and idle time in intr_wait().
+// A bin about to overflow halves every bin, so the histogram keeps its
+// shape however long it runs; `scale` counts the halvings.
+//
+// Connecting to TCP port PCPROF_PORT fetches the histogram in one
+// transfer: a struct pcprof_header, then `bins` u16 counts, and the
+// connection closes.  Everything is little-endian, as laid out in memory.
+// Bins are read as they are, so ticks during the transfer may or may not
+// be in them.  tools/pcprof.py maps the bins to the symbols of
+// executable.elf.  KATCP's ?prof starts, stops and clears it (katcp.h).
+
+#include "xparameters.h"
+#include "xil_types.h"
+
+#define PCPROF_PORT      (7007)
+
+// Local memory covered, and bytes per bin (16 instructions)
+#define PCPROF_BASE      XPAR_MICROBLAZE_0_LOCAL_MEMORY_ILMB_BRAM_IF_CNTLR_BASEADDR
+#define PCPROF_SPAN      (XPAR_MICROBLAZE_0_LOCAL_MEMORY_ILMB_BRAM_IF_CNTLR_HIGHADDR - \
+    PCPROF_BASE + 1)
+#define PCPROF_BIN_SHIFT (6)
+#define PCPROF_BINS      (PCPROF_SPAN >> PCPROF_BIN_SHIFT)
+
+#define PCPROF_MAGIC     (0x31465250) // "PRF1"
+// Bumped whenever the layout of the export changes
+#define PCPROF_VERSION   (1)
+
+struct pcprof_header {
+  u32 magic;
+  u16 version;
+  u16 header_size;
+  // Address of bin 0, and bytes per bin as a shift
+  u32 base;
+  u16 bin_shift;
+  u16 bins;
+  // Samples per second while running
+  u32 hz;
+  // Samples taken, and those that fell outside the bins
+  u32 samples;
+  u32 other;
+  // Times every bin was halved
+  u8 scale;
+  // Non-zero if still sampling
+  u8 running;
+  u16 pad;
+};
+
+// Clear the histogram and serve it on PCPROF_PORT.  Sampling starts
+// stopped.  Call after init_timebase() and lwip_init().
+void init_pcprof();
+
+void pcprof_start();
+void pcprof_stop();
+void pcprof_clear();
+
+// Non-zero while sampling
+int pcprof_running();
+
+// Samples taken since the last clear
+u32 pcprof_samples();
+
+#endif // _PCPROF_H_
@@ -0,0 +1,94 @@
+// perf.c - Cycle counts of instrumented code paths (see perf.h).
+//
+// Without a barrel shifter or pattern compare, log2 is a binary search of
+// a table of powers of two: five compares a pass.
+
+#include <string.h>
+
+#include "intr.h"
+#include "perf.h"
+
+#if PERF_ENABLE
+
+static struct perf_stats table[PERF_NUM_SITES];
+
+static const u32 pow2[PERF_BUCKETS] = {
+  1u << 0,  1u << 1,  1u << 2,  1u << 3,  1u << 4,  1u << 5,  1u << 6,
+  1u << 7,  1u << 8,  1u << 9,  1u << 10, 1u << 11, 1u << 12, 1u << 13,
+  1u << 14, 1u << 15, 1u << 16, 1u << 17, 1u << 18, 1u << 19, 1u << 20,
+  1u << 21, 1u << 22, 1u << 23, 1u << 24, 1u << 25, 1u << 26, 1u << 27,
+  1u << 28, 1u << 29, 1u << 30, 1u << 31
+};
+
+// floor(log2(c)), or 0 for 0
+static u32
+perf_bucket(u32 c)
+{
+  u32 b = 0;
+
+  if(c >= pow2[b + 16]) {
+    b += 16;
+  }
+  if(c >= pow2[b + 8]) {
+    b += 8;
+  }
+  if(c >= pow2[b + 4]) {
+    b += 4;
+  }
+  if(c >= pow2[b + 2]) {
+    b += 2;
+  }
+  if(c >= pow2[b + 1]) {
+    b += 1;
+  }
+  return b;
+}
+
+void
+perf_record(u32 site, u32 cycles)
+{
+  struct perf_stats *s = &table[site];
+  u32 b = perf_bucket(cycles);
+  u32 msr = intr_lock();
+
+  if(s->count == 0 || cycles < s->min) {
+    s->min = cycles;
+  }
+  if(cycles > s->max) {
+    s->max = cycles;
+  }
+  s->count++;
+  s->sum += cycles;
+  s->hist[b]++;
+
+  intr_unlock(msr);
+}
+
+void
+perf_read(u32 site, struct perf_stats *s)
+{
+  u32 msr = intr_lock();
+
+  *s = table[site];
+  intr_unlock(msr);
+}
+
+void
+perf_reset()
+{
+  u32 msr = intr_lock();
+
+  memset(table, 0, sizeof(table));
+  intr_unlock(msr);
+}
+
+void
+perf_clear(u32 site)
+{
+  u32 msr = intr_lock();
+
+  memset(&table[site], 0, sizeof(table[site]));
+  intr_unlock(msr);
+}
+
+#endif // PERF_ENABLE
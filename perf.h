@@ -0,0 +1,65 @@
+#ifndef _PERF_H_
+#define _PERF_H_
+
+// perf.h - Cycle counts of instrumented code paths.
+//
+// PERF_BEGIN(site) and PERF_END(site) bracket a stretch of code within one
+// block; each pass through it records the timebase_stamp() cycles taken in
+// the site's slot of a static table: passes, min, max, sum and a log2
+// histogram (bucket b counts passes of 2^b to 2^(b+1) - 1 cycles, bucket 0
+// those under 2).  Interrupts that land inside a pass are charged to it.
+//
+// The whole table goes out in one wbreg.h request (WBREG_OP_PERF);
+// tools/perf.py shows it.  Building with PERF_ENABLE 0 (make
+// CFLAGS=-DPERF_ENABLE=0) compiles the macros to nothing.
+
+#include "xil_types.h"
+
+#include "timebase.h"
+
+#ifndef PERF_ENABLE
+#define PERF_ENABLE (1)
+#endif
+
+// Instrumented sites, in the order of the table
+enum perf_site {
+  PERF_SPI,      // send_spi()
+  PERF_ETH_TX,   // eth0's copy of a frame into the core
+  PERF_CHKSUM,   // mb_chksum()
+  PERF_WBREG,    // a wbreg request, from arrival to reply
+  PERF_TICK_LAT, // tick interrupt entry latency, in intr_diag() mode
+  PERF_TICK_JIT, // its change from one tick to the next, likewise
+  PERF_NUM_SITES
+};
+
+#define PERF_BUCKETS (32)
+
+struct perf_stats {
+  u32 count;
+  u32 min;
+  u32 max;
+  u64 sum;
+  u32 hist[PERF_BUCKETS];
+};
+
+#if PERF_ENABLE
+#define PERF_BEGIN(site) u32 perf_t0_##site = timebase_stamp()
+#define PERF_END(site) perf_record((site), timebase_stamp() - perf_t0_##site)
+#else
+#define PERF_BEGIN(site) do { } while(0)
+#define PERF_END(site) do { } while(0)
+#endif
+
+// Charge one pass of `cycles` to `site`.  Safe to call from interrupt
+// handlers.
+void perf_record(u32 site, u32 cycles);
+
+// Copy the counts of `site` into `s`
+void perf_read(u32 site, struct perf_stats *s);
+
+void perf_reset();
+
+// Zero the counts of `site`
+void perf_clear(u32 site);
+
+#endif // _PERF_H_
@@ -32,9 +32,27 @@
 
 #include "xparameters.h"
 #include "xil_cache.h"
-#include "xsysmon.h"
 
+#include "boot.h"
+#include "console.h"
+#include "crash.h"
+#include "dma.h"
+#include "extmem.h"
+#include "flash.h"
+#include "gwrev.h"
+#include "icap.h"
+#include "kv.h"
+#include "load.h"
+#include "mbox.h"
+#include "pt.h"
+#include "slots.h"
+#include "intr.h"
 #include "spi.h"
+#include "stack.h"
+#include "timebase.h"
+#include "timer.h"
+#include "wbmap.h"
+#include "xadc.h"
 
 #include "platform_config.h"
 
@@ -59,10 +77,10 @@ enable_caches()
     Xil_ICacheEnableRegion(CACHEABLE_REGION_MASK);
     Xil_DCacheEnableRegion(CACHEABLE_REGION_MASK);
 #elif __MICROBLAZE__
-#ifdef XPAR_MICROBLAZE_USE_ICACHE
+#if XPAR_MICROBLAZE_USE_ICACHE
     Xil_ICacheEnable();
 #endif
-#ifdef XPAR_MICROBLAZE_USE_DCACHE
+#if XPAR_MICROBLAZE_USE_DCACHE
     Xil_DCacheEnable();
 #endif
 #endif
@@ -85,17 +103,6 @@ init_uart()
     /* Bootrom/BSP configures PS7/PSU UART to 115200 bps */
 }
 
-static XSysMon xsysmon;
-
-void
-init_sysmon()
-{
-    XSysMon_Config *cfg_ptr = XSysMon_LookupConfig(XPAR_SYSMON_0_DEVICE_ID);
-
-    XSysMon_CfgInitialize(&xsysmon, cfg_ptr, cfg_ptr->BaseAddress);
-    XSysMon_SetAvg(&xsysmon, XSM_AVG_256_SAMPLES);
-}
-
 void
 init_platform()
 {
@@ -110,8 +117,31 @@ init_platform()
     /* psu_init();*/
     enable_caches();
     init_uart();
-    init_sysmon();
+    init_intr();
+    init_console();
+    init_timebase();
+    boot_stage("timebase");
+    init_timers();
+    init_load();
+    init_pt();
+    init_extmem();
+    init_dma();
+    init_stack();
+    init_mbox();
+    init_xadc();
+    boot_stage("xadc");
     init_spi();
+    init_flash();
+    boot_stage("flash");
+    init_kv();
+    init_crash();
+    boot_stage("kv");
+    init_slots();
+    boot_stage("slots");
+    // May reload the FPGA from the active slot
+    init_icap();
+    init_wbmap();
+    init_gwrev();
 }
 
 void
@@ -119,9 +149,3 @@ cleanup_platform()
 {
     disable_caches();
 }
-
-float
-get_fpga_temp() {
-    u16 adc_data = XSysMon_GetAdcData(&xsysmon, XSM_CH_TEMP);
-    return XSysMon_RawToTemperature(adc_data);
-}
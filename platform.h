@@ -38,5 +38,4 @@
 void init_platform();
 void cleanup_platform();
 
-float get_fpga_temp();
 #endif
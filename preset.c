@@ -0,0 +1,368 @@
+// preset.c - Register preset scripts (see preset.h).
+//
+// The running script is copied into `run.code`, so storing a script while
+// it runs changes nothing until the next run.  Each pass of step_work runs
+// steps until a wait: a delay or a poll that has not matched yet starts
+// wait_timer, whose expiry runs the pass that goes on.  `run.pc` only
+// moves past a step once it is done, so a pending poll is simply retried.
+
+#include <string.h>
+
+#include "xil_io.h"
+
+#include "log.h"
+#include "preset.h"
+#include "timebase.h"
+#include "timer.h"
+#include "wbbus.h"
+#include "wbpost.h"
+#include "wbreg.h"
+#include "wbshadow.h"
+#include "work.h"
+
+static struct {
+  u8 code[PRESET_MAX_LEN];
+  u32 len;
+  u32 pc;
+  // PRESET_OP_NEXT taken so far
+  u32 next;
+  // timebase_ms() of the start, and the pending poll's deadline
+  u32 start_ms;
+  u32 deadline;
+  u8 polling;
+  u8 stop;
+  preset_done_fn done;
+  void *arg;
+} run;
+
+static struct preset_stats stats;
+
+static void preset_step(void *arg);
+
+static struct work step_work = WORK_INIT(preset_step, NULL);
+static struct timer wait_timer = TIMER_INIT(preset_step, NULL);
+
+static u32
+get32(const u8 *p)
+{
+  return p[0] | (u32)p[1] << 8 | (u32)p[2] << 16 | (u32)p[3] << 24;
+}
+
+static u32
+get16(const u8 *p)
+{
+  return p[0] | (u32)p[1] << 8;
+}
+
+// Bytes of the step at `p`, of which `left` are there, or 0 if it is cut
+// short or unknown
+static u32
+step_len(const u8 *p, u32 left)
+{
+  u32 n;
+
+  switch(p[0]) {
+  case PRESET_OP_END:   n = 1; break;
+  case PRESET_OP_WRITE: n = 9; break;
+  case PRESET_OP_RMW:   n = 13; break;
+  case PRESET_OP_POLL:  n = 15; break;
+  case PRESET_OP_DELAY: n = 5; break;
+  case PRESET_OP_BLOCK: n = left >= 6 ? 6 + 4 * p[5] : 6; break;
+  case PRESET_OP_NEXT:  n = 2; break;
+  default: return 0;
+  }
+  return n <= left ? n : 0;
+}
+
+// Non-zero if `words` words from offset `addr` on lie in the window
+static int
+addr_ok(u32 addr, u32 words)
+{
+  return !(addr & 3) && addr < WBREG_SIZE &&
+      words <= (WBREG_SIZE - addr) >> 2;
+}
+
+int
+preset_check(const u8 *code, u32 len, u32 *at)
+{
+  const u8 *p;
+  u32 pc, n;
+  int ok;
+
+  for(pc=0; pc<len && code[pc] != PRESET_OP_END; pc+=n) {
+    p = code + pc;
+    n = step_len(p, len - pc);
+    ok = n != 0;
+    if(ok && p[0] == PRESET_OP_NEXT) {
+      ok = p[1] < PRESET_MAX;
+    } else if(ok && p[0] != PRESET_OP_DELAY) {
+      ok = addr_ok(get32(p + 1), p[0] == PRESET_OP_BLOCK ? p[5] : 1);
+    }
+    if(!ok) {
+      if(at) {
+        *at = pc;
+      }
+      return PRESET_EINVAL;
+    }
+  }
+  return PRESET_OK;
+}
+
+// Copy stored script `n` into `run`.  Returns PRESET_OK or the status to
+// stop with.
+static int
+preset_load(u32 n)
+{
+  int len;
+
+  len = kv_get(KV_KEY_PRESET + n, run.code, sizeof(run.code));
+  if(len <= 0) {
+    return PRESET_ENOENT;
+  }
+  if(preset_check(run.code, len, NULL) != PRESET_OK) {
+    return PRESET_EINVAL;
+  }
+  run.len = len;
+  run.pc = 0;
+  stats.script = n;
+  return PRESET_OK;
+}
+
+static void
+preset_finish(int status)
+{
+  preset_done_fn done = run.done;
+
+  if(wbpost_fence() != 0 && status == PRESET_OK) {
+    status = PRESET_EBUS;
+  }
+  timer_stop(&wait_timer);
+  stats.running = 0;
+  stats.status = status;
+  stats.at = run.pc;
+  stats.ms = timebase_ms() - run.start_ms;
+  if(status == PRESET_OK) {
+    LOG("preset: script %u done in %u ms", stats.script, stats.ms);
+  } else {
+    LOG("preset: script %u stopped at %u (%u)", stats.script, run.pc,
+        status);
+  }
+  if(done) {
+    done(status, run.arg);
+  }
+}
+
+// Poll the register of the step at `p`, for PRESET_SPIN_US at most.
+// Returns non-zero once it matches; otherwise the run waits on the timer
+// or has stopped.
+static int
+preset_poll(const u8 *p)
+{
+  u32 addr = WBREG_BASE + get32(p + 1);
+  u32 mask = get32(p + 5);
+  u32 value = get32(p + 9);
+  u32 t0 = (u32)timebase_us(), n = 0;
+  struct wbbus_op bus;
+  int match;
+
+  if(!run.polling) {
+    run.polling = 1;
+    run.deadline = timebase_ms() + get16(p + 13);
+  }
+  wbbus_begin(&bus, addr - WBREG_BASE);
+  do {
+    n++;
+    match = (Xil_In32(addr) & mask) == value;
+  } while(!match && !wbbus_failed() &&
+          (u32)timebase_us() - t0 < PRESET_SPIN_US);
+  if(wbbus_end(&bus, n) != 0) {
+    run.polling = 0;
+    preset_finish(PRESET_EBUS);
+    return 0;
+  }
+  if(match) {
+    run.polling = 0;
+    return 1;
+  }
+
+  if((s32)(timebase_ms() - run.deadline) >= 0) {
+    run.polling = 0;
+    preset_finish(PRESET_ETIMEDOUT);
+  } else {
+    timer_start(&wait_timer, 1, 0);
+  }
+  return 0;
+}
+
+static void
+preset_step(void *arg)
+{
+  const u8 *p;
+  u32 i, k, addr, us, words;
+  struct wbbus_op bus;
+  int status;
+
+  if(!stats.running) {
+    return;
+  }
+  for(i=0; i<PRESET_BURST; i++) {
+    if(run.stop) {
+      preset_finish(PRESET_EABORT);
+      return;
+    }
+    if(run.pc >= run.len || run.code[run.pc] == PRESET_OP_END) {
+      preset_finish(PRESET_OK);
+      return;
+    }
+    p = run.code + run.pc;
+    // Every step but PRESET_OP_NEXT has four bytes after its opcode
+    addr = p[0] == PRESET_OP_NEXT ? 0 : get32(p + 1);
+    words = 0;
+    status = PRESET_OK;
+    // Writes are posted (wbpost.h) until a step that reads or waits
+    if((p[0] == PRESET_OP_RMW || p[0] == PRESET_OP_POLL ||
+        p[0] == PRESET_OP_DELAY) && wbpost_fence() != 0) {
+      preset_finish(PRESET_EBUS);
+      return;
+    }
+    switch(p[0]) {
+    case PRESET_OP_WRITE:
+      status = wbpost_write(addr, get32(p + 5));
+      break;
+    case PRESET_OP_RMW:
+      wbbus_begin(&bus, addr);
+      wbshadow_rmw(addr, get32(p + 5), get32(p + 9));
+      words = 1;
+      break;
+    case PRESET_OP_POLL:
+      if(!preset_poll(p)) {
+        return;
+      }
+      break;
+    case PRESET_OP_DELAY:
+      us = get32(p + 1);
+      if(us > PRESET_SPIN_US) {
+        run.pc += 5;
+        timer_start(&wait_timer, (us + 999) / 1000, 0);
+        return;
+      }
+      delay_us(us);
+      break;
+    case PRESET_OP_BLOCK:
+      for(k=0; k<p[5] && status == PRESET_OK; k++) {
+        status = wbpost_write(addr + 4 * k, get32(p + 6 + 4 * k));
+      }
+      break;
+    case PRESET_OP_NEXT:
+      status = ++run.next > PRESET_MAX_NEXT ? PRESET_ELOOP :
+          preset_load(p[1]);
+      if(status != PRESET_OK) {
+        preset_finish(status);
+        return;
+      }
+      continue;
+    }
+    // A bus error stops the run at the step that met it
+    if(status != PRESET_OK || (words && wbbus_end(&bus, words) != 0)) {
+      preset_finish(PRESET_EBUS);
+      return;
+    }
+    run.pc += step_len(p, run.len - run.pc);
+  }
+  if(wbpost_fence() != 0) {
+    preset_finish(PRESET_EBUS);
+    return;
+  }
+  work_schedule(&step_work);
+}
+
+static void
+preset_start(preset_done_fn done, void *arg)
+{
+  run.next = 0;
+  run.polling = 0;
+  run.stop = 0;
+  run.done = done;
+  run.arg = arg;
+  run.start_ms = timebase_ms();
+  stats.running = 1;
+  stats.runs++;
+  work_schedule(&step_work);
+}
+
+int
+preset_run(u32 n, preset_done_fn done, void *arg)
+{
+  if(stats.running || n >= PRESET_MAX || preset_load(n) != PRESET_OK) {
+    return -1;
+  }
+  preset_start(done, arg);
+  return 0;
+}
+
+int
+preset_exec(const u8 *code, u32 len, preset_done_fn done, void *arg)
+{
+  if(stats.running || len > sizeof(run.code) ||
+     preset_check(code, len, NULL) != PRESET_OK) {
+    return -1;
+  }
+  memcpy(run.code, code, len);
+  run.len = len;
+  run.pc = 0;
+  stats.script = PRESET_MAX;
+  preset_start(done, arg);
+  return 0;
+}
+
+void
+preset_stop()
+{
+  if(stats.running) {
+    run.stop = 1;
+    timer_stop(&wait_timer);
+    work_schedule(&step_work);
+  }
+}
+
+static void
+saved(int err, void *arg)
+{
+  if(err) {
+    LOG("preset: save of script %u failed (%d)", (u32)(UINTPTR)arg,
+        err);
+  }
+}
+
+int
+preset_set(u32 n, const u8 *code, u32 len)
+{
+  if(n >= PRESET_MAX || len > PRESET_MAX_LEN ||
+     preset_check(code, len, NULL) != PRESET_OK) {
+    return -1;
+  }
+  return kv_set(KV_KEY_PRESET + n, code, len, saved,
+      (void *)(UINTPTR)n);
+}
+
+int
+preset_len(u32 n)
+{
+  u8 b;
+
+  return n < PRESET_MAX ? kv_get(KV_KEY_PRESET + n, &b, 0) : -1;
+}
+
+const struct preset_stats *
+preset_stats()
+{
+  return &stats;
+}
+
+void
+init_preset()
+{
+  if(preset_len(PRESET_BOOT) > 0) {
+    preset_run(PRESET_BOOT, NULL, NULL);
+  }
+}
@@ -0,0 +1,125 @@
+#ifndef _PRESET_H_
+#define _PRESET_H_
+
+// preset.h - Register preset scripts: gateware bring-up sequences kept in
+// flash and run by the firmware.
+//
+// A script is a string of steps in a compact bytecode, each an opcode
+// byte and its operands, multi-byte ones little-endian.  Addresses are
+// byte offsets into the Wishbone window of wbreg.h and must be word
+// aligned.  Up to PRESET_MAX scripts of at most KV_MAX_VALUE bytes are
+// kept in the config store, script n under KV_KEY_PRESET + n (see kv.h),
+// and set with KATCP's ?preset (see katcp.h).  tools/preset.py assembles
+// them from text.  Script PRESET_BOOT, if there is one, runs at startup,
+// so a board brings its gateware up by itself after a power cycle; any
+// script runs on command too.
+//
+// A script is checked whole before its first step runs: an unknown
+// opcode, a step cut short or a bad address leaves the registers alone.
+// It then runs from the work queue, PRESET_BURST steps a pass, at bus
+// speed.  Writes go through the mirrors of wbshadow.h, so that a
+// read-modify-write of a shadowed register is one bus write, and are
+// posted (wbpost.h): they go out together before the next step that reads
+// or waits and at the end of each pass.  A poll reads
+// its register from the bus until the masked bits match, for up to its
+// timeout: each pass it spins for at most PRESET_SPIN_US and then waits a
+// millisecond on a timer, so that the main loop carries on.
+// Delays up to PRESET_SPIN_US spin, longer ones wait on a timer, rounded
+// up to whole milliseconds.  A script ends at PRESET_OP_END or its last
+// byte, or continues in another with PRESET_OP_NEXT, which is how a
+// sequence outgrows one script's bytes.  One script runs at a time, and
+// stops at a step that meets a bus error, as a register request does.
+
+#include "xil_types.h"
+
+#include "kv.h"
+
+// Scripts kept, and the one run at startup
+#define PRESET_MAX  (4)
+#define PRESET_BOOT (0)
+
+// Longest script
+#define PRESET_MAX_LEN KV_MAX_VALUE
+
+// Steps run per pass of the main loop
+#define PRESET_BURST (32)
+
+// Longest wait spent spinning in one pass, us
+#define PRESET_SPIN_US (100)
+
+// Scripts one run can continue into, beyond the first, so that a cycle of
+// PRESET_OP_NEXT ends
+#define PRESET_MAX_NEXT (PRESET_MAX)
+
+// Opcodes and their operands
+#define PRESET_OP_END   (0x00) // end of the script
+#define PRESET_OP_WRITE (0x01) // addr32 value32: *addr = value
+#define PRESET_OP_RMW   (0x02) // addr32 mask32 value32:
+                               // *addr = (*addr & ~mask) | (value & mask)
+#define PRESET_OP_POLL  (0x03) // addr32 mask32 value32 timeout_ms16: wait
+                               // until (*addr & mask) == value
+#define PRESET_OP_DELAY (0x04) // us32: wait
+#define PRESET_OP_BLOCK (0x05) // addr32 n8 value32 * n: write n words from
+                               // addr on
+#define PRESET_OP_NEXT  (0x06) // n8: go on with script n
+
+// Status of a run
+#define PRESET_OK        (0)
+#define PRESET_ENOENT    (1) // no such script, or none stored
+#define PRESET_EINVAL    (2) // the script is malformed
+#define PRESET_ETIMEDOUT (3) // a poll timed out
+#define PRESET_ELOOP     (4) // more than PRESET_MAX_NEXT PRESET_OP_NEXT
+#define PRESET_EABORT    (5) // stopped by preset_stop()
+#define PRESET_EBUS      (6) // a step met a bus error (see wbbus.h)
+
+typedef void (*preset_done_fn)(int status, void *arg);
+
+struct preset_stats {
+  // A script is running
+  u8 running;
+  // Script of the last run, or PRESET_MAX for one run from a buffer
+  u8 script;
+  // Its status, and the offset of the step it stopped at
+  u8 status;
+  u16 at;
+  // Runs since boot, and the last one's length in ms
+  u32 runs;
+  u32 ms;
+};
+
+// Run script PRESET_BOOT if there is one.  Call after init_kv(),
+// init_timers() and init_wbshadow().
+void init_preset();
+
+// Check the `len` bytes of script at `code`.  Returns PRESET_OK, or
+// PRESET_EINVAL with the offset of the bad step in `*at` (if not NULL).
+int preset_check(const u8 *code, u32 len, u32 *at);
+
+// Run stored script `n`.  `done` (if not NULL) is called with the status
+// once it stops.
+//
+// Returns 0 if started, -1 if a script is running or script `n` is not
+// stored or malformed.
+int preset_run(u32 n, preset_done_fn done, void *arg);
+
+// Run the `len` bytes of script at `code`, which are copied, as
+// preset_run() does
+int preset_exec(const u8 *code, u32 len, preset_done_fn done, void *arg);
+
+// Stop the running script after its current step; `done` gets
+// PRESET_EABORT
+void preset_stop();
+
+// Store the `len` bytes at `code` as script `n` (`len` 0 deletes it), in
+// the background as kv_set() does.
+//
+// Returns 0 if started, -1 if `n` is out of range, the script is malformed
+// or the store is busy.
+int preset_set(u32 n, const u8 *code, u32 len);
+
+// Length of stored script `n`, or -1 if there is none
+int preset_len(u32 n);
+
+const struct preset_stats *preset_stats();
+
+#endif // _PRESET_H_
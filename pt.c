@@ -0,0 +1,180 @@
+// pt.c - Stackless threads (see pt.h).
+//
+// A thread runs from its work item, which pt_wake() and the thread's
+// timer schedule; a thread waiting on a condition is on `polled`, which
+// the poll hook empties each pass, running every thread on it once.  One
+// whose condition still does not hold puts itself back for the next.
+
+#include "load.h"
+#include "pt.h"
+#include "sched.h"
+
+static struct pt *polled;
+
+static void
+unpoll(struct pt *pt)
+{
+  if(!pt->pprev) {
+    return;
+  }
+  *pt->pprev = pt->next;
+  if(pt->next) {
+    pt->next->pprev = pt->pprev;
+  }
+  pt->next = NULL;
+  pt->pprev = NULL;
+}
+
+static void
+pt_run(struct pt *pt)
+{
+  struct load_span span;
+  int r;
+
+  if(!pt->running) {
+    return;
+  }
+  unpoll(pt);
+  load_begin(&span);
+  r = pt->fn(pt);
+  load_end(&span, (u32)pt->fn);
+  if(r == PT_YIELDED) {
+    work_schedule(&pt->work);
+    return;
+  }
+  if(r == PT_WAITING) {
+    return;
+  }
+  pt->running = 0;
+  timer_stop(&pt->timer);
+  if(pt->done) {
+    pt->done(pt);
+  }
+}
+
+static void
+pt_work_fn(void *arg)
+{
+  pt_run(arg);
+}
+
+static void
+pt_timer_fn(void *arg)
+{
+  pt_wake(arg, PT_ETIMEDOUT);
+}
+
+int
+pt_start(struct pt *pt)
+{
+  if(pt->running) {
+    return -1;
+  }
+  pt->lc = 0;
+  pt->woken = 0;
+  pt->err = 0;
+  pt->running = 1;
+  pt->work.fn = pt_work_fn;
+  pt->work.arg = pt;
+  pt->timer.fn = pt_timer_fn;
+  pt->timer.arg = pt;
+  return work_schedule(&pt->work);
+}
+
+int
+pt_running(const struct pt *pt)
+{
+  return pt->running;
+}
+
+void
+pt_stop(struct pt *pt)
+{
+  pt->running = 0;
+  pt->lc = 0;
+  timer_stop(&pt->timer);
+  unpoll(pt);
+}
+
+void
+pt_wake(struct pt *pt, int err)
+{
+  pt->err = err;
+  pt->woken = 1;
+  work_schedule(&pt->work);
+}
+
+void
+pt_flash_done(int err, void *arg)
+{
+  pt_wake(arg, err);
+}
+
+void
+pt_crc_done(int err, u32 crc, void *arg)
+{
+  struct pt *pt = arg;
+
+  pt->value = crc;
+  pt_wake(pt, err);
+}
+
+void
+pt_spi_done(struct spi_xfer *xfer)
+{
+  struct pt *pt = xfer->arg;
+
+  pt->value = xfer->count;
+  pt_wake(pt, xfer->err);
+}
+
+int
+pt_sleep(struct pt *pt, u32 ms)
+{
+  timer_start(&pt->timer, ms, 0);
+  return 0;
+}
+
+void
+pt_poll(struct pt *pt)
+{
+  if(pt->pprev) {
+    return;
+  }
+  pt->next = polled;
+  if(pt->next) {
+    pt->next->pprev = &pt->next;
+  }
+  polled = pt;
+  pt->pprev = &polled;
+}
+
+// Poll hook: run each waiting thread once.  Found work if one went on.
+static int
+pt_poll_fn(void *arg)
+{
+  struct pt *pt, *list = polled;
+  int ran = 0;
+
+  // Threads still waiting go back on `polled`, not on `list`
+  if(list) {
+    list->pprev = &list;
+  }
+  polled = NULL;
+  while((pt = list)) {
+    unpoll(pt);
+    pt_run(pt);
+    if(!pt->pprev) {
+      ran = 1;
+    }
+  }
+  return ran;
+}
+
+static struct sched_hook poll_hook = SCHED_HOOK_INIT(pt_poll_fn, NULL);
+
+void
+init_pt()
+{
+  sched_add_poll(&poll_hook);
+}
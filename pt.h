@@ -0,0 +1,184 @@
+#ifndef _PT_H_
+#define _PT_H_
+
+// pt.h - Stackless threads for handlers that wait, after protothreads.
+//
+// A handler that starts a flash erase, waits for it, programs, waits
+// again and verifies is a chain of callbacks, each picking up the state
+// the one before left.  A thread writes the same handler as one function
+// that awaits each step in turn:
+//
+//   static int
+//   upload(struct pt *pt)
+//   {
+//     PT_BEGIN(pt);
+//     PT_AWAIT(pt, erase_flash(addr, len, pt_flash_done, pt));
+//     if(pt->err) {
+//       PT_EXIT(pt);
+//     }
+//     PT_AWAIT(pt, program_flash(addr, buf, len, pt_flash_done, pt));
+//     ...
+//     PT_END(pt);
+//   }
+//
+// The function returns wherever it waits and is called again, from
+// work_run() (work.h), once what it waits for has happened; PT_BEGIN()
+// jumps back to where it left off.  A thread costs a struct pt and no
+// stack of its own, which is what makes it affordable with one 1 KB stack,
+// but for the same reason its local variables do not survive a wait:
+// state that must goes in a struct the thread's `arg` points to.  A switch
+// statement of its own must not span a wait, as the waits are case
+// labels of PT_BEGIN()'s.
+//
+// A thread waits on a completion callback (PT_AWAIT(), with pt_flash_done,
+// pt_crc_done or pt_spi_done as the callback and the thread as its
+// argument, or pt_wake() from any other), on a timer (PT_SLEEP()), or on a
+// condition checked on every pass of the main loop (PT_WAIT_UNTIL(), and
+// PT_WAIT_REG() for a register behind the Wishbone bridge, as wbwatch.h
+// watches them), with a timeout or without.  Each run of a thread is
+// charged to its function in load.h's accounting.
+
+#include "xil_io.h"
+#include "xil_types.h"
+
+#include "spi.h"
+#include "timer.h"
+#include "work.h"
+
+// What a thread function returns
+#define PT_WAITING (0)
+#define PT_YIELDED (1)
+#define PT_EXITED  (2)
+#define PT_ENDED   (3)
+
+// `err` of a wait that timed out, and of a PT_AWAIT() whose start failed
+#define PT_ETIMEDOUT (-2)
+#define PT_ESTART    (-1)
+
+struct pt {
+  // Line to go on from, 0 at the start
+  u16 lc;
+  u8 running;
+  // Set when what the thread waits for has happened
+  volatile u8 woken;
+  // Result of the last wait: 0, or the error it completed with
+  volatile int err;
+  // Value it completed with, e.g. pt_crc_done's CRC
+  volatile u32 value;
+  int (*fn)(struct pt *pt);
+  // Called once the thread has ended or exited (may be NULL)
+  void (*done)(struct pt *pt);
+  void *arg;
+  // Set up by pt_start()
+  struct work work;
+  struct timer timer;
+  // Links of the threads waiting on a condition, NULL while not
+  struct pt *next;
+  struct pt **pprev;
+};
+
+#define PT_INIT(fn, done, arg) \
+  { 0, 0, 0, 0, 0, (fn), (done), (arg), WORK_INIT(NULL, NULL), \
+    TIMER_INIT(NULL, NULL), NULL, NULL }
+
+#define PT_BEGIN(pt) switch((pt)->lc) { case 0:
+
+#define PT_END(pt) } (pt)->lc = 0; return PT_ENDED
+
+// Give the loop a pass and go on
+#define PT_YIELD(pt) do { \
+    (pt)->lc = __LINE__; \
+    return PT_YIELDED; \
+    case __LINE__:; \
+  } while(0)
+
+#define PT_EXIT(pt) do { \
+    (pt)->lc = 0; \
+    return PT_EXITED; \
+  } while(0)
+
+// Run `start`, which returns 0 once it has started what will call
+// pt_wake() or one of the callbacks below, and wait for that.  `err` is
+// then the error it completed with, or PT_ESTART if `start` failed.
+#define PT_AWAIT(pt, start) do { \
+    (pt)->woken = 0; \
+    (pt)->err = 0; \
+    if((start) != 0) { \
+      (pt)->err = PT_ESTART; \
+      break; \
+    } \
+    (pt)->lc = __LINE__; \
+    case __LINE__: \
+    if(!(pt)->woken) { \
+      return PT_WAITING; \
+    } \
+  } while(0)
+
+#define PT_SLEEP(pt, ms) PT_AWAIT(pt, pt_sleep(pt, ms))
+
+// Wait until `cond` holds, checking it on every pass of the loop
+#define PT_WAIT_UNTIL(pt, cond) do { \
+    (pt)->err = 0; \
+    (pt)->lc = __LINE__; \
+    case __LINE__: \
+    if(!(cond)) { \
+      pt_poll(pt); \
+      return PT_WAITING; \
+    } \
+  } while(0)
+
+// As PT_WAIT_UNTIL(), giving up with PT_ETIMEDOUT after `ms`
+#define PT_WAIT_UNTIL_MS(pt, cond, ms) do { \
+    (pt)->woken = 0; \
+    (pt)->err = 0; \
+    timer_start(&(pt)->timer, (ms), 0); \
+    (pt)->lc = __LINE__; \
+    case __LINE__: \
+    if(cond) { \
+      timer_stop(&(pt)->timer); \
+      (pt)->err = 0; \
+    } else if(!(pt)->woken) { \
+      pt_poll(pt); \
+      return PT_WAITING; \
+    } \
+  } while(0)
+
+// Wait until the bits `mask` of the register at bus address `addr` read
+// `value`, for up to `ms`
+#define PT_WAIT_REG(pt, addr, mask, value, ms) \
+  PT_WAIT_UNTIL_MS(pt, (Xil_In32(addr) & (mask)) == (value), ms)
+
+// Start `pt` from the top, from work_run().  Returns 0, or -1 if it is
+// already running.
+int pt_start(struct pt *pt);
+
+// Non-zero from pt_start() until the thread ends or exits
+int pt_running(const struct pt *pt);
+
+// Stop `pt` where it waits, without calling `done`.  What it waited for
+// must not complete into it afterwards.
+void pt_stop(struct pt *pt);
+
+// Complete the wait of `pt` with `err`, and run it.  Safe to call from
+// interrupt handlers.
+void pt_wake(struct pt *pt, int err);
+
+// Completion callbacks for PT_AWAIT(), with the thread as their argument:
+// flash.h's flash_done_fn and flash_crc_fn (the CRC in `value`), and a
+// submit_spi() transfer's `done`, with the thread in its `arg` and the
+// transfer's count in `value`
+void pt_flash_done(int err, void *arg);
+void pt_crc_done(int err, u32 crc, void *arg);
+void pt_spi_done(struct spi_xfer *xfer);
+
+// Wake `pt` after `ms`, for PT_SLEEP().  Returns 0.
+int pt_sleep(struct pt *pt, u32 ms);
+
+// Check `pt`'s condition on the next pass, for PT_WAIT_UNTIL()
+void pt_poll(struct pt *pt);
+
+// Check the waiting threads' conditions on every pass.  Call after
+// init_timers().
+void init_pt();
+
+#endif // _PT_H_
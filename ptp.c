@@ -0,0 +1,418 @@
+// ptp.c - IEEE 1588 (PTPv2) slave over UDP on eth0 (see ptp.h).
+//
+// Messages are parsed from a copy of their first PTP_MSG_MAX bytes; all
+// fields are big-endian at fixed offsets.  Times are kept as u64 ns since
+// 1970 UTC, the master's already converted.  `epoch` counts the steps
+// this clock made: a Sync and a Delay_Req measured on both sides of one
+// do not make a delay.
+
+#include <string.h>
+
+#include "lwip/igmp.h"
+#include "lwip/ip.h"
+#include "lwip/udp.h"
+#include "netif/ethernetif.h"
+
+#include "log.h"
+#include "ptp.h"
+#include "sntpclock.h"
+#include "timebase.h"
+#include "timer.h"
+
+#define MSG_SYNC       (0x0)
+#define MSG_DELAY_REQ  (0x1)
+#define MSG_FOLLOW_UP  (0x8)
+#define MSG_DELAY_RESP (0x9)
+#define MSG_ANNOUNCE   (0xb)
+
+// Header fields
+#define OFF_TYPE    (0)
+#define OFF_VERSION (1)
+#define OFF_LENGTH  (2)
+#define OFF_DOMAIN  (4)
+#define OFF_FLAGS   (6)
+#define OFF_CORR    (8)
+#define OFF_SOURCE  (20)
+#define OFF_SEQ     (30)
+#define OFF_CONTROL (32)
+#define OFF_INTERVAL (33)
+// Body: the message's timestamp, an Announce's UTC offset, a Delay_Resp's
+// requester
+#define OFF_TIME    (34)
+#define OFF_UTC     (44)
+#define OFF_REQUESTER (44)
+
+#define LEN_SYNC       (44)
+#define LEN_DELAY_RESP (54)
+#define LEN_ANNOUNCE   (64)
+#define PTP_MSG_MAX    LEN_ANNOUNCE
+
+// Port identity: clock identity and port number
+#define PORT_ID_LEN (10)
+
+#define FLAG_TWO_STEP     (0x0200)
+#define FLAG_UTC_VALID    (0x0004)
+#define FLAG_PTP_TIMESCALE (0x0008)
+
+#define NS_PER_S (1000000000ULL)
+
+static struct netif *ptp_netif;
+static struct udp_pcb *event_pcb;
+static struct udp_pcb *general_pcb;
+static ip_addr_t group;
+static u8 enabled = 1;
+
+static struct ptp_stats stats;
+
+// Ours, and the master's
+static u8 port_id[PORT_ID_LEN];
+static u8 master_id[PORT_ID_LEN];
+// timebase_ms() of the master's last Announce, and its UTC offset, s
+static u32 announce_ms;
+static u32 utc_offset;
+
+static u32 epoch;
+
+// A two-step Sync waiting for its Follow_Up: sequence, correction and
+// arrival
+static u8 sync_pending;
+static u16 sync_seq;
+static s64 sync_corr;
+static u64 sync_t2;
+static u64 sync_cycles;
+
+// Last Sync followed: its departure and arrival
+static u8 have_sync;
+static u32 sync_epoch;
+static u64 last_t1;
+static u64 last_t2;
+
+// Delay_Req outstanding, its driver stamps, the Sync before it and when
+// it was sent
+static u8 req_pending;
+static u16 req_seq;
+static u32 req_stamp;
+static u32 req_epoch;
+static u64 req_t1;
+static u64 req_t2;
+static u32 req_ms;
+static u8 have_delay;
+
+// Integral term, ppb
+static s32 drift;
+
+static u32
+get_u16(const u8 *m)
+{
+  return (m[0] << 8) | m[1];
+}
+
+static u32
+get_u32(const u8 *m)
+{
+  return ((u32)m[0] << 24) | (m[1] << 16) | (m[2] << 8) | m[3];
+}
+
+// Timestamp at `m`: 48-bit seconds and 32-bit nanoseconds
+static u64
+get_time(const u8 *m)
+{
+  return ((((u64)get_u16(m) << 32) | get_u32(m + 2)) * NS_PER_S) +
+      get_u32(m + 6);
+}
+
+// Correction field at `m`, in whole ns (it counts 2^-16 ns)
+static s64
+get_corr(const u8 *m)
+{
+  s64 c = ((s64)get_u32(m) << 32) | get_u32(m + 4);
+
+  return c < 0 ? -(s64)((u64)-c >> 16) : (s64)((u64)c >> 16);
+}
+
+// `v` / 2^`shift`, rounded toward zero whatever the sign
+static s32
+scale_down(s32 v, u32 shift)
+{
+  return v < 0 ? -(s32)((u32)-v >> shift) : (s32)((u32)v >> shift);
+}
+
+static void
+ptp_forget()
+{
+  stats.locked = 0;
+  sync_pending = 0;
+  have_sync = 0;
+  req_pending = 0;
+  have_delay = 0;
+  drift = 0;
+}
+
+// Mean path delay from Delay_Req departure `t3` and arrival `t4`
+static void
+ptp_delay(u64 t3, u64 t4)
+{
+  s64 sum = (s64)(req_t2 - req_t1) + (s64)(t4 - t3);
+  s32 d;
+
+  // Sums this far off come from a clock that moved in between
+  if(sum < 0 || sum > 2 * PTP_STEP_NS) {
+    return;
+  }
+  d = (u32)sum >> 1;
+  stats.delays++;
+  if(!have_delay) {
+    stats.delay_ns = d;
+    have_delay = 1;
+  } else {
+    stats.delay_ns += scale_down(d - stats.delay_ns, PTP_DELAY_SHIFT);
+  }
+}
+
+static void
+ptp_send_delay_req()
+{
+  struct pbuf *p;
+  u32 stamp;
+  u8 *m;
+
+  if(ip4_addr_isany_val(*netif_ip4_addr(ptp_netif))) {
+    return;
+  }
+  p = pbuf_alloc(PBUF_TRANSPORT, LEN_SYNC, PBUF_RAM);
+  if(!p) {
+    return;
+  }
+  m = p->payload;
+  memset(m, 0, LEN_SYNC);
+  m[OFF_TYPE] = MSG_DELAY_REQ;
+  m[OFF_VERSION] = 2;
+  m[OFF_LENGTH + 1] = LEN_SYNC;
+  m[OFF_DOMAIN] = PTP_DOMAIN;
+  memcpy(m + OFF_SOURCE, port_id, PORT_ID_LEN);
+  req_seq++;
+  m[OFF_SEQ] = req_seq >> 8;
+  m[OFF_SEQ + 1] = req_seq;
+  m[OFF_CONTROL] = 1;
+  m[OFF_INTERVAL] = 0x7f;
+
+  stamp = ethernetif_tx_stamp(ptp_netif, p);
+  if(udp_sendto_if(event_pcb, p, &group, PTP_EVENT_PORT, ptp_netif) ==
+     ERR_OK) {
+    req_stamp = stamp;
+    req_pending = 1;
+    req_epoch = epoch;
+    req_t1 = last_t1;
+    req_t2 = last_t2;
+    req_ms = timebase_ms();
+    stats.delay_reqs++;
+  }
+  pbuf_free(p);
+}
+
+// Sync departure `t1`, and arrival `t2` at timebase_cycles() `cycles`
+static void
+ptp_sample(u64 t1, u64 t2, u64 cycles)
+{
+  s64 off = (s64)(t2 - t1) - (have_delay ? stats.delay_ns : 0);
+  s32 ppb, integral;
+
+  stats.syncs++;
+  if(!t2 || off > PTP_STEP_NS || off < -PTP_STEP_NS) {
+    stats.offset_ns = off > 0x7fffffff ? 0x7fffffff :
+        off < -0x7fffffff ? -0x7fffffff : (s32)off;
+    if(sntpclock_step(cycles, t1 + (have_delay ? stats.delay_ns : 0)) ==
+       0) {
+      stats.steps++;
+      epoch++;
+      have_sync = 0;
+      return;
+    }
+  } else {
+    stats.offset_ns = off;
+    integral = drift + scale_down(stats.offset_ns, PTP_KI_SHIFT);
+    if(integral > SNTPCLOCK_MAX_DRIFT_PPB) {
+      integral = SNTPCLOCK_MAX_DRIFT_PPB;
+    } else if(integral < -SNTPCLOCK_MAX_DRIFT_PPB) {
+      integral = -SNTPCLOCK_MAX_DRIFT_PPB;
+    }
+    ppb = integral + scale_down(stats.offset_ns, PTP_KP_SHIFT);
+    // The integral only winds while the servo has the clock
+    if(sntpclock_steer(timebase_cycles(), ppb) == 0) {
+      drift = integral;
+      stats.drift_ppb = drift;
+    }
+  }
+
+  have_sync = 1;
+  sync_epoch = epoch;
+  last_t1 = t1;
+  last_t2 = t2;
+  // A Delay_Resp lost leaves req_pending set until the next one is due
+  if(!stats.delay_reqs || timebase_ms() - req_ms >= PTP_DELAY_REQ_MS) {
+    ptp_send_delay_req();
+  }
+}
+
+static void
+ptp_announce(const u8 *m, u32 len)
+{
+  u32 flags = get_u16(m + OFF_FLAGS);
+
+  if(len < LEN_ANNOUNCE) {
+    return;
+  }
+  if(!stats.locked) {
+    memcpy(master_id, m + OFF_SOURCE, PORT_ID_LEN);
+    memcpy(stats.master, master_id, sizeof(stats.master));
+    stats.locked = 1;
+    LOG("ptp: following master %x %x", get_u32(master_id),
+        get_u32(master_id + 4));
+  } else if(memcmp(master_id, m + OFF_SOURCE, PORT_ID_LEN) != 0) {
+    return;
+  }
+  announce_ms = timebase_ms();
+  // The PTP timescale is TAI; without a valid offset, trust the last one
+  if(!(flags & FLAG_PTP_TIMESCALE)) {
+    utc_offset = 0;
+  } else if(flags & FLAG_UTC_VALID) {
+    utc_offset = get_u16(m + OFF_UTC);
+  }
+}
+
+static void
+ptp_recv(void *arg, struct udp_pcb *pcb, struct pbuf *p,
+    const ip_addr_t *addr, u16_t port)
+{
+  u8 m[PTP_MSG_MAX];
+  u32 len, sent, done;
+  u64 cycles, t;
+
+  // Stamped by eth0's driver, so only eth0's frames
+  if(!enabled || ip_current_input_netif() != ptp_netif) {
+    pbuf_free(p);
+    return;
+  }
+  cycles = timebase_widen(ethernetif_rx_stamp(ptp_netif));
+  len = pbuf_copy_partial(p, m, sizeof(m), 0);
+  pbuf_free(p);
+  if(len < LEN_SYNC || (m[OFF_VERSION] & 0xf) != 2 ||
+     m[OFF_DOMAIN] != PTP_DOMAIN) {
+    return;
+  }
+  if((m[OFF_TYPE] & 0xf) == MSG_ANNOUNCE) {
+    ptp_announce(m, len);
+    return;
+  }
+  if(!stats.locked || memcmp(master_id, m + OFF_SOURCE, PORT_ID_LEN) != 0) {
+    return;
+  }
+
+  switch(m[OFF_TYPE] & 0xf) {
+  case MSG_SYNC:
+    t = sntpclock_utc_ns(cycles);
+    if(get_u16(m + OFF_FLAGS) & FLAG_TWO_STEP) {
+      sync_pending = 1;
+      sync_seq = get_u16(m + OFF_SEQ);
+      sync_corr = get_corr(m + OFF_CORR);
+      sync_t2 = t;
+      sync_cycles = cycles;
+    } else {
+      sync_pending = 0;
+      ptp_sample(get_time(m + OFF_TIME) + get_corr(m + OFF_CORR) -
+          utc_offset * NS_PER_S, t, cycles);
+    }
+    break;
+  case MSG_FOLLOW_UP:
+    if(sync_pending && get_u16(m + OFF_SEQ) == sync_seq) {
+      sync_pending = 0;
+      ptp_sample(get_time(m + OFF_TIME) + sync_corr +
+          get_corr(m + OFF_CORR) - utc_offset * NS_PER_S, sync_t2,
+          sync_cycles);
+    }
+    break;
+  case MSG_DELAY_RESP:
+    if(len < LEN_DELAY_RESP || !req_pending ||
+       get_u16(m + OFF_SEQ) != req_seq ||
+       memcmp(port_id, m + OFF_REQUESTER, PORT_ID_LEN) != 0) {
+      break;
+    }
+    req_pending = 0;
+    if(req_epoch == epoch && have_sync && sync_epoch == epoch &&
+       ethernetif_tx_stamps(ptp_netif, req_stamp, &sent, &done) > 0) {
+      ptp_delay(sntpclock_utc_ns(timebase_widen(sent)),
+          get_time(m + OFF_TIME) - get_corr(m + OFF_CORR) -
+          utc_offset * NS_PER_S);
+    }
+    break;
+  }
+}
+
+static void ptp_check(void *arg);
+
+static struct timer check_timer = TIMER_INIT(ptp_check, NULL);
+
+static void
+ptp_check(void *arg)
+{
+  if(stats.locked &&
+     timebase_ms() - announce_ms >= PTP_ANNOUNCE_TIMEOUT_MS) {
+    LOG("ptp: master lost");
+    ptp_forget();
+  }
+}
+
+void
+ptp_enable(int on)
+{
+  enabled = on != 0;
+  if(!enabled) {
+    ptp_forget();
+  }
+}
+
+int
+ptp_enabled()
+{
+  return enabled;
+}
+
+const struct ptp_stats *
+ptp_stats()
+{
+  return &stats;
+}
+
+void
+init_ptp(struct netif *netif)
+{
+  const u8 *mac = netif->hwaddr;
+
+  // EUI-64 from the MAC, port 1
+  port_id[0] = mac[0];
+  port_id[1] = mac[1];
+  port_id[2] = mac[2];
+  port_id[3] = 0xff;
+  port_id[4] = 0xfe;
+  port_id[5] = mac[3];
+  port_id[6] = mac[4];
+  port_id[7] = mac[5];
+  port_id[9] = 1;
+
+  IP_ADDR4(&group, 224, 0, 1, 129);
+  ptp_netif = netif;
+  event_pcb = udp_new();
+  general_pcb = udp_new();
+  if(!event_pcb || !general_pcb ||
+     udp_bind(event_pcb, IP_ADDR_ANY, PTP_EVENT_PORT) != ERR_OK ||
+     udp_bind(general_pcb, IP_ADDR_ANY, PTP_GENERAL_PORT) != ERR_OK) {
+    LOG("ptp: no UDP PCB");
+    return;
+  }
+  udp_recv(event_pcb, ptp_recv, NULL);
+  udp_recv(general_pcb, ptp_recv, NULL);
+#if LWIP_IGMP
+  igmp_joingroup_netif(netif, ip_2_ip4(&group));
+#endif
+  timer_start(&check_timer, 1000, 1000);
+}
@@ -0,0 +1,82 @@
+#ifndef _PTP_H_
+#define _PTP_H_
+
+// ptp.h - IEEE 1588 (PTPv2) slave over UDP on eth0, software timestamped.
+//
+// An ordinary clock that is only ever a slave: it listens on eth0 for the
+// primary PTP group (224.0.1.129) in domain PTP_DOMAIN, follows the first
+// master whose Announce it hears and changes only once that one has been
+// quiet for PTP_ANNOUNCE_TIMEOUT_MS.  Delay is measured end to end: after
+// each Sync (one- or two-step), once every PTP_DELAY_REQ_MS at most, a
+// Delay_Req goes to the group and the master's Delay_Resp names when it
+// arrived.
+//
+// Frames are timestamped by the eth0 driver (ethernetif.h) on the
+// timebase (timebase.h): a Sync when the driver finds it in the core, a
+// Delay_Req when it hands it over.  On a quiet LAN that is good to a few
+// microseconds, two orders of magnitude better than SNTP; the time the
+// frame spends in the core and the driver before its stamp is common to
+// every frame and mostly cancels in the delay.
+//
+// The offset drives a PI servo in fixed point, gains as shifts: the rate
+// of the wall clock (sntpclock.h) is set to correct the integral term's
+// drift plus the proportional term, in parts per billion, after every
+// Sync.  The gains suit one Sync a second.  An offset over PTP_STEP_NS
+// steps the clock instead, as does the first Sync.  A PPS (sntpclock.h)
+// takes precedence; PTP only measures while it keeps the time, and SNTP
+// only names the second while PTP steers.  Times from the master are TAI
+// and converted to UTC with the offset its Announce gives.
+
+#include "lwip/netif.h"
+
+#include "xil_types.h"
+
+#define PTP_EVENT_PORT   (319)
+#define PTP_GENERAL_PORT (320)
+
+#define PTP_DOMAIN (0)
+
+// A master not announcing for this long is dropped, for the next one heard
+#define PTP_ANNOUNCE_TIMEOUT_MS (8000)
+
+// Least time between two Delay_Reqs
+#define PTP_DELAY_REQ_MS (1000)
+
+// Offsets bigger than this, in ns, step the clock rather than steer it
+#define PTP_STEP_NS (1000000)
+
+// PI gains: ppb per ns of offset, as right shifts (1/8 and 1/1024, for
+// software timestamps)
+#define PTP_KP_SHIFT (3)
+#define PTP_KI_SHIFT (10)
+
+// Each delay measured moves the mean path delay 1 / 2^PTP_DELAY_SHIFT of
+// the way
+#define PTP_DELAY_SHIFT (3)
+
+struct ptp_stats {
+  // A master is being followed, and its clock identity
+  u8 locked;
+  u8 master[8];
+  // Syncs followed, the clock steps they caused, Delay_Reqs sent and
+  // Delay_Resps used
+  u32 syncs;
+  u32 steps;
+  u32 delay_reqs;
+  u32 delays;
+  // Last offset from the master, mean path delay and the servo's drift
+  s32 offset_ns;
+  s32 delay_ns;
+  s32 drift_ppb;
+};
+
+// Listen on `netif` (eth0).  Call after init_sntpclock().
+void init_ptp(struct netif *netif);
+
+// Follow masters or ignore them (on at boot)
+void ptp_enable(int on);
+int ptp_enabled();
+
+const struct ptp_stats *ptp_stats();
+
+#endif // _PTP_H_
@@ -0,0 +1,230 @@
+// quota.c - TCP connection quotas by class of service (see quota.h).
+//
+// quota_listen() takes over the listener's accept callback, keeping the
+// service's in `listeners` by port, which a new connection shares with
+// its listener.  A connection admitted goes on to the service's callback;
+// one refused is aborted by lwIP when the callback returns an error.
+
+#include "lwip/priv/tcp_priv.h"
+#include "lwip/stats.h"
+#include "lwip/tcp.h"
+#include "lwip/apps/httpd_opts.h"
+
+#include "flashrd.h"
+#include "ftrace.h"
+#include "katcp.h"
+#include "log.h"
+#include "pcprof.h"
+#include "quota.h"
+#include "snap.h"
+#include "telemetry.h"
+#include "wbblk.h"
+#include "xburst.h"
+
+struct listener {
+  // 0 for a free entry
+  u16 port;
+  u8 cls;
+  tcp_accept_fn accept;
+};
+
+static struct listener listeners[MEMP_NUM_TCP_PCB_LISTEN];
+
+static struct quota_class classes[QUOTA_CLASSES] = {
+  { "control", 0, 0, 0 },
+  { "web", 0, 0, QUOTA_WEB_MAX },
+  { "bulk", 0, 0, QUOTA_BULK_MAX },
+};
+
+// TCP priority of each class's connections: the web one is httpd's own
+static const u8 prios[QUOTA_CLASSES] = {
+  TCP_PRIO_MAX, HTTPD_TCP_PRIO, HTTPD_TCP_PRIO + 1
+};
+
+#if HTTPD_TCP_PRIO + 1 >= TCP_PRIO_MAX
+#error "quota.c needs httpd's connections below the bulk class"
+#endif
+
+// The exports send and close, and httpd closes idle connections itself
+static const struct {
+  u16 port;
+  u8 cls;
+  u32 idle_ms;
+} services[] = {
+  { KATCP_PORT, QUOTA_CONTROL, QUOTA_KATCP_IDLE_MS },
+  { WBBLK_PORT, QUOTA_CONTROL, QUOTA_WBBLK_IDLE_MS },
+  { HTTPD_SERVER_PORT, QUOTA_WEB, 0 },
+  { TELEM_PORT, QUOTA_BULK, 0 },
+  { SNAP_PORT, QUOTA_BULK, 0 },
+  { XBURST_PORT, QUOTA_BULK, 0 },
+  { PCPROF_PORT, QUOTA_BULK, 0 },
+  { FTRACE_PORT, QUOTA_BULK, 0 },
+  { FLASHRD_PORT, QUOTA_BULK, 0 },
+};
+
+static struct tcp_pcb_listen *
+find_listener(u16 port)
+{
+  struct tcp_pcb_listen *lpcb;
+
+  for(lpcb=tcp_listen_pcbs.listen_pcbs; lpcb; lpcb=lpcb->next) {
+    if(lpcb->local_port == port) {
+      break;
+    }
+  }
+  return lpcb;
+}
+
+// Count each class's connections, the one being accepted included
+static void
+quota_count()
+{
+  struct tcp_pcb *pcb;
+  u32 cls;
+
+  for(cls=0; cls<QUOTA_CLASSES; cls++) {
+    classes[cls].active = 0;
+  }
+  for(pcb=tcp_active_pcbs; pcb; pcb=pcb->next) {
+    for(cls=0; cls<QUOTA_CLASSES; cls++) {
+      if(pcb->prio == prios[cls]) {
+        classes[cls].active++;
+        break;
+      }
+    }
+  }
+  for(cls=0; cls<QUOTA_CLASSES; cls++) {
+    if(classes[cls].active > classes[cls].peak) {
+      classes[cls].peak = classes[cls].active;
+    }
+  }
+}
+
+u32
+quota_free_pcbs()
+{
+  const struct stats_mem *s = memp_pools[MEMP_TCP_PCB]->stats;
+
+  return s->used < MEMP_NUM_TCP_PCB ? MEMP_NUM_TCP_PCB - s->used : 0;
+}
+
+u32
+quota_free_pbufs()
+{
+  const struct stats_mem *s = memp_pools[MEMP_PBUF_POOL]->stats;
+
+  return s->used < PBUF_POOL_SIZE ? PBUF_POOL_SIZE - s->used : 0;
+}
+
+static err_t
+quota_accept(void *arg, struct tcp_pcb *pcb, err_t err)
+{
+  struct listener *l = NULL;
+  struct quota_class *c;
+  u32 i;
+  err_t r;
+
+  // No PCB for it: the services have nothing to do with that
+  if(!pcb) {
+    return ERR_MEM;
+  }
+  for(i=0; i<MEMP_NUM_TCP_PCB_LISTEN && !l; i++) {
+    if(listeners[i].port == pcb->local_port) {
+      l = &listeners[i];
+    }
+  }
+  if(!l) {
+    return ERR_VAL;
+  }
+  if(err != ERR_OK) {
+    return l->accept(arg, pcb, err);
+  }
+
+  quota_count();
+  c = &classes[l->cls];
+  if(c->max && c->active > c->max) {
+    c->over_max++;
+    return ERR_MEM;
+  }
+  // The PCB counted in the used ones is this connection's already
+  if(l->cls != QUOTA_CONTROL && (quota_free_pcbs() < QUOTA_RESERVE_PCBS ||
+     quota_free_pbufs() < QUOTA_RESERVE_PBUFS)) {
+    c->reserved++;
+    return ERR_MEM;
+  }
+  r = l->accept(arg, pcb, err);
+  if(r == ERR_OK) {
+    c->accepted++;
+  }
+  return r;
+}
+
+int
+quota_listen(u16 port, u8 cls)
+{
+  struct tcp_pcb_listen *lpcb = find_listener(port);
+  struct listener *l = NULL;
+  u32 i;
+
+  if(!lpcb || cls >= QUOTA_CLASSES) {
+    return -1;
+  }
+  // The same port again, as iperf's server is started anew
+  for(i=0; i<MEMP_NUM_TCP_PCB_LISTEN; i++) {
+    if(listeners[i].port == port || (!l && !listeners[i].port)) {
+      l = &listeners[i];
+    }
+  }
+  if(!l) {
+    return -1;
+  }
+  l->port = port;
+  l->cls = cls;
+  if(lpcb->accept != quota_accept) {
+    l->accept = lpcb->accept;
+  }
+  tcp_setprio((struct tcp_pcb *)lpcb, prios[cls]);
+  tcp_accept((struct tcp_pcb *)lpcb, quota_accept);
+  // Control clients sit idle between requests: probe that they are there
+  if(cls == QUOTA_CONTROL) {
+    ip_set_option(lpcb, SOF_KEEPALIVE);
+  }
+  return 0;
+}
+
+const struct quota_class *
+quota_class(u32 cls)
+{
+  if(cls >= QUOTA_CLASSES) {
+    return NULL;
+  }
+  quota_count();
+  return &classes[cls];
+}
+
+u32
+quota_timewait()
+{
+  struct tcp_pcb *pcb;
+  u32 n = 0;
+
+  for(pcb=tcp_tw_pcbs; pcb; pcb=pcb->next) {
+    n++;
+  }
+  return n;
+}
+
+void
+init_quota()
+{
+  u32 i;
+
+  for(i=0; i<sizeof(services) / sizeof(services[0]); i++) {
+    if(quota_listen(services[i].port, services[i].cls) != 0) {
+      LOG("quota: nothing listens on port %u", services[i].port);
+      continue;
+    }
+    tcp_idle_timeout((struct tcp_pcb *)find_listener(services[i].port),
+        services[i].idle_ms);
+  }
+}
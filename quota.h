@@ -0,0 +1,98 @@
+#ifndef _QUOTA_H_
+#define _QUOTA_H_
+
+// quota.h - TCP connection quotas by class of service.
+//
+// lwIP's pools are fixed: MEMP_NUM_TCP_PCB connections and PBUF_POOL_SIZE
+// receive buffers for everyone.  A few web clients or bulk readouts could
+// take them all and lock the register and KATCP clients out, so every
+// listener is put in a class:
+//
+//   control  KATCP (katcp.h) and block register access (wbblk.h)
+//   web      httpd (webfs.h)
+//   bulk     telemetry, snapshots, bursts, PC profiles, traces, iperf
+//
+// and each connection is admitted in its listener's accept callback,
+// before the service sees it.  A web or bulk connection is refused when
+// its class has QUOTA_WEB_MAX or QUOTA_BULK_MAX connections already, when
+// admitting it would leave fewer than QUOTA_RESERVE_PCBS PCBs free, or
+// when fewer than QUOTA_RESERVE_PBUFS of PBUF_POOL are, so that those are
+// kept for control connections, which are only limited by the pools.
+//
+// Classes are also TCP priorities (tcp_setprio()): control above the
+// rest, then bulk, then web.  When the PCBs run out anyway, e.g. taken by
+// connections half-open or closing, lwIP gives a new connection the PCB
+// of the oldest one of a lower priority, so a KATCP client gets in at the
+// cost of a bulk or web one, never the other way round.  TCP_OOSEQ_MAX_PBUFS
+// (lwipopts.h) keeps any one connection from holding the receive buffers
+// with segments out of order.
+//
+// Connections are counted from lwIP's active list by priority rather than
+// by tracking closes, so no path out of a connection can leak one.  The
+// counts of admissions and refusals go to KATCP's ?quota (katcp.h) and the
+// line protocol export (influx.h).
+//
+// Connections that are done with still hold PCBs.  TCP_TW_MAX (lwipopts.h)
+// caps those in TIME-WAIT, the oldest going first, so that monitoring
+// tools opening a connection per query do not fill the pool for 2 MSL.
+// KATCP and wbblk connections from which nothing arrives for
+// QUOTA_KATCP_IDLE_MS and QUOTA_WBBLK_IDLE_MS are reset
+// (tcp_idle_timeout()), and control connections send keepalives, so that
+// a client that went away without closing is found in TCP_KEEPIDLE_DEFAULT
+// plus TCP_KEEPCNT_DEFAULT probes, even within its idle time.  lwIP counts
+// each of these (tcp_reaped), and ?quota shows them.
+
+#include "xil_types.h"
+
+#define QUOTA_CONTROL (0)
+#define QUOTA_WEB     (1)
+#define QUOTA_BULK    (2)
+#define QUOTA_CLASSES (3)
+
+// Most connections of the capped classes at once
+#define QUOTA_WEB_MAX  (3)
+#define QUOTA_BULK_MAX (4)
+
+// PCBs and PBUF_POOL buffers only control connections may take
+#define QUOTA_RESERVE_PCBS  (3)
+#define QUOTA_RESERVE_PBUFS (1)
+
+// Silence after which a connection is reset
+#define QUOTA_KATCP_IDLE_MS (600000)
+#define QUOTA_WBBLK_IDLE_MS (120000)
+
+struct quota_class {
+  const char *name;
+  // Connections now, and the most at once since boot
+  u16 active;
+  u16 peak;
+  // Most at once, 0 for no limit but the pools
+  u16 max;
+  u16 pad;
+  u32 accepted;
+  // Refused for the class's limit, and to keep the reserve
+  u32 over_max;
+  u32 reserved;
+};
+
+// Put the listener on `port` in class `cls`.  Call once it is listening,
+// with its accept callback set.  Returns 0, or -1 if nothing listens on
+// `port` or every listener already has a class.
+int quota_listen(u16 port, u8 cls);
+
+// Class `cls`, its count of connections brought up to date, or NULL past
+// the last
+const struct quota_class *quota_class(u32 cls);
+
+// PCBs and PBUF_POOL buffers free now
+u32 quota_free_pcbs();
+u32 quota_free_pbufs();
+
+// PCBs in TIME-WAIT now
+u32 quota_timewait();
+
+// Put the services' listeners in their classes.  Call after they are all
+// listening.
+void init_quota();
+
+#endif // _QUOTA_H_
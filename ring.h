@@ -0,0 +1,108 @@
+#ifndef _RING_H_
+#define _RING_H_
+
+// ring.h - Lock-free indices of single-producer, single-consumer rings.
+//
+// The ring is the caller's array of a power-of-two number of entries; a
+// struct ring holds its indices.  head and tail run freely and wrap at 32
+// bits, so the ring holds head - tail entries and the entry of index i is
+// at i & mask.  Only the producer moves head and only the consumer moves
+// tail, so with one side in an interrupt handler and the other in the
+// main loop neither has to mask interrupts.  The processor is a single
+// in-order core and stores reach memory in program order: all either side
+// needs is for the compiler to keep the entry's accesses before the index
+// update that hands it over (ring_barrier()).
+//
+// A history ring, like log.h's, is one whose producer never waits: it
+// moves head on and overwrites the oldest entry, and tail is not used.
+// Readers of entry n copy it and then check with ring_holds() that it was
+// not overwritten while they did.
+
+#include "xil_types.h"
+
+struct ring {
+  // Next entry the producer fills, and the next the consumer takes
+  volatile u32 head;
+  volatile u32 tail;
+  // Entries less 1
+  u32 mask;
+};
+
+#define RING_INIT(size) { 0, 0, (size) - 1 }
+
+// Keep the compiler from moving memory accesses across it
+#define ring_barrier() __asm__ volatile ("" ::: "memory")
+
+static inline u32
+ring_size(const struct ring *r)
+{
+  return r->mask + 1;
+}
+
+// Entries waiting for the consumer
+static inline u32
+ring_count(const struct ring *r)
+{
+  return r->head - r->tail;
+}
+
+// Entries the producer can add
+static inline u32
+ring_space(const struct ring *r)
+{
+  return ring_size(r) - ring_count(r);
+}
+
+// Producer: the slot of the next entry.  Fill it, then ring_push().
+static inline u32
+ring_head_slot(const struct ring *r)
+{
+  return r->head & r->mask;
+}
+
+// Producer: hand over the `n` entries filled from ring_head_slot()
+static inline void
+ring_push(struct ring *r, u32 n)
+{
+  ring_barrier();
+  r->head += n;
+}
+
+// Consumer: the slot of the oldest entry
+static inline u32
+ring_tail_slot(const struct ring *r)
+{
+  return r->tail & r->mask;
+}
+
+// Consumer: entries from ring_tail_slot() before the end of the array
+static inline u32
+ring_run(const struct ring *r)
+{
+  u32 n = ring_count(r), left = ring_size(r) - ring_tail_slot(r);
+
+  return n < left ? n : left;
+}
+
+// Consumer: release the `n` oldest entries once they have been read
+static inline void
+ring_pop(struct ring *r, u32 n)
+{
+  ring_barrier();
+  r->tail += n;
+}
+
+// History ring: non-zero if entry `n` has been written and not yet
+// overwritten
+static inline int
+ring_holds(const struct ring *r, u32 n)
+{
+  u32 head;
+
+  // After the reader's copy
+  ring_barrier();
+  head = r->head;
+  return head - n - 1 < ring_size(r);
+}
+
+#endif // _RING_H_
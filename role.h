@@ -0,0 +1,22 @@
+#ifndef _ROLE_H_
+#define _ROLE_H_
+
+// role.h - Which of the firmware's jobs this image does.
+//
+// One core runs everything (JAM_ROLE_ALL, the default), or the work is
+// split across two MicroBlazes that talk through mbox.h: the network core
+// runs lwIP and every service on it as ever, and the housekeeping core the
+// board health monitoring (xadc.h), whose results and alarms reach the
+// network core's services through the mailbox as if they were local.
+// "make ROLE=net" or "make ROLE=house" builds one of the two images and
+// "make images" both (see the Makefile).
+
+#define JAM_ROLE_ALL   (0)
+#define JAM_ROLE_NET   (1)
+#define JAM_ROLE_HOUSE (2)
+
+#ifndef JAM_ROLE
+#define JAM_ROLE JAM_ROLE_ALL
+#endif
+
+#endif // _ROLE_H_
@@ -0,0 +1,109 @@
+// sched.c - Cooperative run-to-completion scheduler.
+
+#include "intr.h"
+#include "load.h"
+#include "sched.h"
+#include "timebase.h"
+#include "wdog.h"
+#include "work.h"
+
+static struct sched_hook *poll_hooks;
+static struct sched_hook *idle_hooks;
+static u64 idle_cycles;
+// Passes over SCHED_STALL_MS, and the longest pass in timer cycles
+static u32 stalls;
+static u32 longest_pass;
+
+static struct wdog_task loop_task = WDOG_TASK_INIT("loop", WDOG_LOOP_MS);
+
+static void
+hook_add(struct sched_hook **list, struct sched_hook *h)
+{
+  // Keep registration order
+  while(*list) {
+    list = &(*list)->next;
+  }
+  h->next = NULL;
+  *list = h;
+}
+
+void
+sched_add_poll(struct sched_hook *h)
+{
+  hook_add(&poll_hooks, h);
+}
+
+void
+sched_add_idle(struct sched_hook *h)
+{
+  hook_add(&idle_hooks, h);
+}
+
+u64
+sched_idle_cycles()
+{
+  return idle_cycles;
+}
+
+u32
+sched_stalls(u32 *longest_us)
+{
+  *longest_us = longest_pass / TIMEBASE_CYCLES_PER_US;
+  return stalls;
+}
+
+void
+sched_run()
+{
+  struct load_span span;
+  struct sched_hook *h;
+  int busy, n;
+  u32 start, t, pass;
+#if SCHED_IDLE_SLEEP
+  u32 msr;
+#endif
+
+  wdog_add(&loop_task, 1);
+  while(1) {
+    wdog_beat(&loop_task);
+    start = timebase_stamp();
+    busy = work_run();
+    for(h = poll_hooks; h; h = h->next) {
+      // A poll that found nothing is the loop's idle time, not the hook's
+      load_begin(&span);
+      n = h->fn(h->arg);
+      load_end(&span, n ? (u32)h->fn : 0);
+      busy += n;
+    }
+    t = timebase_stamp();
+
+    if(busy) {
+      pass = t - start;
+      if(pass > longest_pass) {
+        longest_pass = pass;
+      }
+      if(pass > SCHED_STALL_MS * TIMEBASE_CYCLES_PER_MS) {
+        stalls++;
+      }
+    } else {
+      idle_cycles += t - start;
+      for(h = idle_hooks; h; h = h->next) {
+        load_begin(&span);
+        h->fn(h->arg);
+        load_end(&span, (u32)h->fn);
+      }
+      t = timebase_stamp();
+#if SCHED_IDLE_SLEEP
+      // Check with interrupts masked so only an interrupt in the instant
+      // before the sleep can be missed
+      msr = intr_lock();
+      if(work_pending()) {
+        intr_unlock(msr);
+      } else {
+        intr_wait();
+      }
+#endif
+      idle_cycles += timebase_stamp() - t;
+    }
+  }
+}
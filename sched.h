@@ -0,0 +1,56 @@
+#ifndef _SCHED_H_
+#define _SCHED_H_
+
+// sched.h - Cooperative run-to-completion scheduler.
+//
+// Everything outside interrupt handlers runs from sched_run()'s loop: work
+// items queued by interrupt handlers (see work.h) including expired timers
+// (see timer.h), poll hooks and, on passes that find nothing to do, idle
+// hooks.  Callbacks run to
+// completion and must not block, so one slow callback delays all others.
+// Each pass beats the watchdog's "loop" task (wdog.h), and each hook's
+// time is charged to it for load.h.
+
+#include "xil_types.h"
+
+// Sleep the CPU (intr_wait()) after the idle hooks if there is still no
+// work.  Latency of anything polled rises to at most one tick, 1 ms.
+#ifndef SCHED_IDLE_SLEEP
+#define SCHED_IDLE_SLEEP (1)
+#endif
+
+// A pass of the loop busy for longer than this is a stall (see
+// sched_stalls()).  The watchdog (wdog.h) allows a pass far longer, so a
+// stall is a slow pass, not a dangerous one.
+#ifndef SCHED_STALL_MS
+#define SCHED_STALL_MS (50)
+#endif
+
+// Poll or idle hook.  Poll hooks return non-zero if they found work; idle
+// hooks' return values are ignored.
+struct sched_hook {
+  int (*fn)(void *arg);
+  void *arg;
+  struct sched_hook *next;
+};
+
+#define SCHED_HOOK_INIT(fn, arg) { (fn), (arg), NULL }
+
+// Call `h` on every pass of the loop
+void sched_add_poll(struct sched_hook *h);
+
+// Call `h` on passes where nothing else ran
+void sched_add_idle(struct sched_hook *h);
+
+// Run the loop.  Does not return.
+void sched_run();
+
+// Timer clock cycles the loop has spent idle: in passes that found nothing
+// to do, less the idle hooks, including the sleeps.  The busy fraction of
+// a stretch of time is one less the share of it that went here.
+u64 sched_idle_cycles();
+
+// Number of stalls so far, and in `longest_us` the longest busy pass yet
+u32 sched_stalls(u32 *longest_us);
+
+#endif // _SCHED_H_
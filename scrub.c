@@ -0,0 +1,304 @@
+// scrub.c - Background health scan of the flash slots (see scrub.h).
+//
+// Each step reads one chunk in every mode, so the CRC-32s of a sector in
+// the different modes are ready to compare as soon as its last chunk is
+// in.  The first mode read also feeds the slot's CRC-32.  Nothing is kept
+// between steps but the CRCs and the position, so a step costs the reads
+// and no buffer.
+
+#include <string.h>
+
+#include "xil_printf.h"
+
+#include "crc32.h"
+#include "kv.h"
+#include "log.h"
+#include "ovl.h"
+#include "sched.h"
+#include "scrub.h"
+#include "spi.h"
+#include "timebase.h"
+
+static struct scrub_record rec;
+
+static struct {
+  // Slot being scanned, slots.seq when its scan began, and the bytes of it
+  // read and to read
+  u8 slot;
+  u32 seq;
+  u32 off;
+  u32 end;
+  u32 image_crc;
+  // CRC-32 of the sector so far in each mode
+  u32 sector_crc[FLASH_NUM_MODES];
+  // Over the pass: time spent reading in each mode, and bytes read
+  u64 cycles[FLASH_NUM_MODES];
+  u32 bytes[FLASH_NUM_MODES];
+  u32 last_ms;
+  u8 resting;
+  // The results have changed since they were saved
+  u8 dirty;
+} scan;
+
+struct scrub_sink {
+  u32 *sector;
+  u32 *image;
+};
+
+static void
+scrub_sink(const u8 *buf, u32 len, void *arg)
+{
+  struct scrub_sink *s = arg;
+
+  *s->sector = crc32(*s->sector, buf, len);
+  if(s->image) {
+    *s->image = crc32(*s->image, buf, len);
+  }
+}
+
+// Bytes of slot `n` to scan: the image, or all of the golden slot
+static u32
+slot_extent(u8 n)
+{
+  if(n >= slots.num) {
+    return 0;
+  }
+  return n == SLOT_GOLDEN ? slots.slot[n].size : slots.slot[n].len;
+}
+
+static void
+scan_slot(u8 n)
+{
+  scan.slot = n;
+  scan.seq = slots.seq;
+  scan.off = 0;
+  scan.end = slot_extent(n);
+  scan.image_crc = 0;
+}
+
+static void
+scrub_save()
+{
+  if(kv_set(KV_KEY_SCRUB, &rec, sizeof(rec), NULL, NULL) == 0) {
+    scan.dirty = 0;
+  }
+}
+
+static void
+scrub_reset()
+{
+  memset(&rec, 0, sizeof(rec));
+  rec.version = SCRUB_VERSION;
+  rec.size = sizeof(rec);
+  rec.last_unstable = SCRUB_NONE;
+  memset(scan.cycles, 0, sizeof(scan.cycles));
+  memset(scan.bytes, 0, sizeof(scan.bytes));
+  scan_slot(0);
+}
+
+// Compare the sector at `addr` across the modes read
+static void
+sector_done(u32 addr)
+{
+  u32 m, ref = 0;
+  int first = 1, bad = 0;
+
+  rec.sectors++;
+  for(m=FLASH_MODE_FAST; m<=FLASH_MODE_BEST; m++) {
+    if(!flash_info.read[m].opcode) {
+      continue;
+    }
+    if(first) {
+      ref = scan.sector_crc[m];
+      first = 0;
+    } else if(scan.sector_crc[m] != ref) {
+      bad = 1;
+    }
+  }
+  if(bad) {
+    LOG("scrub: reads of sector %x disagree between modes", addr);
+    rec.unstable++;
+    rec.last_unstable = addr;
+    scan.dirty = 1;
+  }
+}
+
+// Check the CRC-32 of the slot just scanned
+static void
+slot_done()
+{
+  u32 bit = 1 << scan.slot, want;
+
+  if(scan.slot != SLOT_GOLDEN) {
+    want = slots.slot[scan.slot].crc;
+  } else if(rec.golden_known) {
+    want = rec.golden_crc;
+  } else {
+    rec.golden_known = 1;
+    rec.golden_crc = scan.image_crc;
+    scan.dirty = 1;
+    return;
+  }
+  if(scan.image_crc == want) {
+    if(rec.bad & bit) {
+      rec.bad &= ~bit;
+      scan.dirty = 1;
+    }
+    return;
+  }
+  if(!(rec.bad & bit)) {
+    LOG("scrub: slot %u CRC %08x, expected %08x", scan.slot,
+        scan.image_crc, want);
+    rec.bad |= bit;
+    scan.dirty = 1;
+  }
+}
+
+static void
+pass_done()
+{
+  u32 m;
+
+  rec.passes++;
+  for(m=0; m<FLASH_NUM_MODES; m++) {
+    rec.cycles_per_kb[m] = scan.bytes[m] ?
+        scan.cycles[m] * 1024 / scan.bytes[m] : 0;
+    scan.cycles[m] = 0;
+    scan.bytes[m] = 0;
+  }
+  scrub_save();
+  scan_slot(0);
+  scan.resting = 1;
+}
+
+// Read the next chunk of the slot in each mode
+static void
+scrub_chunk()
+{
+  struct scrub_sink sink;
+  u32 sector = flash_rsv_size();
+  u32 addr = slots.slot[scan.slot].addr + scan.off;
+  u32 n = scan.end - scan.off;
+  u32 m;
+  u64 t;
+
+  if(n > SCRUB_CHUNK) {
+    n = SCRUB_CHUNK;
+  }
+  if(scan.off % sector == 0) {
+    memset(scan.sector_crc, 0, sizeof(scan.sector_crc));
+  }
+  sink.image = &scan.image_crc;
+  for(m=FLASH_MODE_FAST; m<=FLASH_MODE_BEST; m++) {
+    if(!flash_info.read[m].opcode) {
+      continue;
+    }
+    sink.sector = &scan.sector_crc[m];
+    t = timebase_cycles();
+    if(stream_flash(addr, n, m, scrub_sink, &sink) != n) {
+      // The CRCs have taken part of the chunk; start the slot over
+      scan_slot(scan.slot);
+      return;
+    }
+    scan.cycles[m] += timebase_cycles() - t;
+    scan.bytes[m] += n;
+    sink.image = NULL;
+  }
+  scan.off += n;
+  if(scan.off % sector == 0 || scan.off == scan.end) {
+    sector_done(addr - addr % sector);
+  }
+}
+
+// Idle hook: one step every SCRUB_PERIOD_MS, while nothing else uses the
+// flash
+static int
+scrub_idle(void *arg)
+{
+  u32 now = timebase_ms();
+
+  if(now - scan.last_ms < (scan.resting ? SCRUB_REST_MS : SCRUB_PERIOD_MS) ||
+     flash_busy() || spi_busy() || crc_flash_busy() || slots_busy() ||
+     kv_busy()) {
+    return 0;
+  }
+  scan.last_ms = now;
+  scan.resting = 0;
+  if(scan.dirty) {
+    scrub_save();
+    return 0;
+  }
+
+  if(scan.slot >= slots.num) {
+    pass_done();
+  } else if(slots.seq != scan.seq) {
+    // Rewritten or relaid out under the scan
+    scan_slot(scan.slot);
+  } else if(scan.off == scan.end) {
+    if(scan.end) {
+      slot_done();
+    }
+    scan_slot(scan.slot + 1);
+  } else {
+    scrub_chunk();
+  }
+  return 0;
+}
+
+static struct sched_hook idle_hook = SCHED_HOOK_INIT(scrub_idle, NULL);
+
+void
+init_scrub()
+{
+  if(kv_get(KV_KEY_SCRUB, &rec, sizeof(rec)) != sizeof(rec) ||
+     rec.version != SCRUB_VERSION || rec.size != sizeof(rec)) {
+    scrub_reset();
+  }
+  scan_slot(0);
+  scan.last_ms = timebase_ms();
+  sched_add_idle(&idle_hook);
+}
+
+const struct scrub_record *
+scrub_get()
+{
+  return &rec;
+}
+
+int
+scrub_clear()
+{
+  if(kv_set(KV_KEY_SCRUB, NULL, 0, NULL, NULL) != 0) {
+    return -1;
+  }
+  scrub_reset();
+  scan.dirty = 0;
+  scan.resting = 0;
+  return 0;
+}
+
+OVL_TEXT(report) void
+dump_scrub()
+{
+  u32 m;
+
+  xil_printf("Scrub: %d passes, %d sectors, %d unstable", rec.passes,
+      rec.sectors, rec.unstable);
+  if(rec.last_unstable != SCRUB_NONE) {
+    xil_printf(" (last at %08x)", rec.last_unstable);
+  }
+  xil_printf(", bad slots %02x\n", rec.bad);
+  if(rec.golden_known) {
+    xil_printf("  golden slot CRC %08x\n", rec.golden_crc);
+  }
+  for(m=0; m<FLASH_NUM_MODES; m++) {
+    if(rec.cycles_per_kb[m]) {
+      xil_printf("  mode %d: %d cycles/kB\n", m, rec.cycles_per_kb[m]);
+    }
+  }
+  if(scan.resting) {
+    print("  resting\n");
+  } else {
+    xil_printf("  at slot %d, %x of %x\n", scan.slot, scan.off, scan.end);
+  }
+}
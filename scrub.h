@@ -0,0 +1,80 @@
+#ifndef _SCRUB_H_
+#define _SCRUB_H_
+
+// scrub.h - Background health scan of the flash slots.
+//
+// A degrading image is better found while the board is idle than when the
+// FPGA needs it, above all the golden one it falls back to.  When the main
+// loop has nothing to do, an idle hook reads the next SCRUB_CHUNK bytes of
+// the slots (slots.h) once in every read mode from FLASH_MODE_FAST up to
+// FLASH_MODE_BEST, streaming each through a CRC-32 as crc_flash() does.
+// It stands aside for any foreground SPI work: a step is skipped while a
+// program, erase, SPI transfer, background CRC, slot operation or config
+// store write is running, and a slot whose table entry changes mid-scan is
+// started over.
+//
+// Two kinds of fault are looked for:
+// - a smallest-erase sector whose reads disagree between modes, the sign
+//   of cells near their read threshold or of a marginal data line;
+// - a slot whose CRC-32 no longer matches: an update slot's against the
+//   table, the golden one's (which the table does not know) against its
+//   first complete scan.
+//
+// The slots are scanned from 0 up, one step every SCRUB_PERIOD_MS, then the
+// scan rests for SCRUB_REST_MS.  Each mode's read time is measured along
+// the way.  The results go to the config store under KV_KEY_SCRUB at the
+// end of each pass and when a fault is found, and into the telemetry
+// export's header (telemetry.h).
+
+#include "xil_types.h"
+
+#include "flash.h"
+#include "slots.h"
+
+#define SCRUB_VERSION   (1)
+
+// Bytes read in each mode per step, a divisor of flash_rsv_size()
+#define SCRUB_CHUNK     (1024)
+#define SCRUB_PERIOD_MS (20)
+#define SCRUB_REST_MS   (600000)
+
+#define SCRUB_NONE      (0xffffffff)
+
+struct scrub_record {
+  u16 version;
+  u16 size;
+  // Passes over every slot completed, and sectors read
+  u32 passes;
+  u32 sectors;
+  // Sectors whose reads disagreed between modes, and the flash address of
+  // the last (SCRUB_NONE if none)
+  u32 unstable;
+  u32 last_unstable;
+  // Slots whose CRC-32 differed in their last scan, one bit each
+  u8 bad;
+  // Non-zero once golden_crc holds the CRC-32 of the whole golden slot
+  u8 golden_known;
+  u16 pad;
+  u32 golden_crc;
+  // Timer cycles per kB read in each mode over the last pass, 0 for modes
+  // not read
+  u32 cycles_per_kb[FLASH_NUM_MODES];
+};
+
+// Restore the last results and add the idle hook.  Call after init_kv()
+// and init_slots().
+void init_scrub();
+
+// The results so far
+const struct scrub_record *scrub_get();
+
+// Forget the results and the golden slot's CRC, as after the golden image
+// has been rewritten over JTAG, and start a new pass.
+//
+// Returns 0, or -1 if the config store is busy.
+int scrub_clear();
+
+// Print the results and the slot being scanned
+void dump_scrub();
+
+#endif // _SCRUB_H_
@@ -0,0 +1,23 @@
+#ifndef _SECTIONS_H_
+#define _SECTIONS_H_
+
+// sections.h - Linker sections for large static buffers (see lscript.ld).
+//
+// Each section is NOLOAD (not zeroed at startup) and shows up as its own
+// line in "make size", so it is easy to see what a feature costs in BRAM.
+
+// Ethernet frame buffers
+#define PKTBUF_SECTION      __attribute__((section(".pktbuf")))
+// Cached SPI flash contents
+#define FLASH_CACHE_SECTION __attribute__((section(".flash_cache")))
+// Telemetry sample rings
+#define TELEMETRY_SECTION   __attribute__((section(".telemetry")))
+// PC-sampling histogram
+#define PCPROF_SECTION      __attribute__((section(".pcprof")))
+// Kept through a reset that does not reload the bitstream: the watchdog's
+// record of why it fired, and crash dumps
+#define NOINIT_SECTION      __attribute__((section(".noinit")))
+
+// lwIP heap and memp pools use ".lwip_pools" (see arch/cc.h)
+
+#endif // _SECTIONS_H_
@@ -0,0 +1,84 @@
+// sha1.c - SHA-1 (see sha1.h).
+//
+// A block at a time with the 80-word schedule on the stack; the last
+// block or two are padded in a buffer of their own.
+
+#include <string.h>
+
+#include "sha1.h"
+
+#define ROL(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
+
+static void
+sha1_block(u32 *h, const u8 *p)
+{
+  u32 w[80], a, b, c, d, e, f, k, t;
+  int i;
+
+  for(i=0; i<16; i++) {
+    w[i] = (u32)p[4 * i] << 24 | (u32)p[4 * i + 1] << 16 |
+        (u32)p[4 * i + 2] << 8 | p[4 * i + 3];
+  }
+  for(; i<80; i++) {
+    w[i] = ROL(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+  }
+  a = h[0];
+  b = h[1];
+  c = h[2];
+  d = h[3];
+  e = h[4];
+  for(i=0; i<80; i++) {
+    if(i < 20) {
+      f = (b & c) | (~b & d);
+      k = 0x5a827999;
+    } else if(i < 40) {
+      f = b ^ c ^ d;
+      k = 0x6ed9eba1;
+    } else if(i < 60) {
+      f = (b & c) | (b & d) | (c & d);
+      k = 0x8f1bbcdc;
+    } else {
+      f = b ^ c ^ d;
+      k = 0xca62c1d6;
+    }
+    t = ROL(a, 5) + f + e + k + w[i];
+    e = d;
+    d = c;
+    c = ROL(b, 30);
+    b = a;
+    a = t;
+  }
+  h[0] += a;
+  h[1] += b;
+  h[2] += c;
+  h[3] += d;
+  h[4] += e;
+}
+
+void
+sha1(const void *buf, u32 len, u8 *digest)
+{
+  u32 h[5] = { 0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0 };
+  const u8 *p = buf;
+  u8 last[128];
+  u32 n, i;
+  u64 bits = (u64)len * 8;
+
+  for(; len >= 64; p += 64, len -= 64) {
+    sha1_block(h, p);
+  }
+  // The rest, a 1 bit, zeros and the length in bits: one block or two
+  memset(last, 0, sizeof(last));
+  memcpy(last, p, len);
+  last[len] = 0x80;
+  n = len < 56 ? 64 : 128;
+  for(i=0; i<8; i++) {
+    last[n - 1 - i] = bits >> (8 * i);
+  }
+  for(i=0; i<n; i+=64) {
+    sha1_block(h, last + i);
+  }
+  for(i=0; i<SHA1_LEN; i++) {
+    digest[i] = h[i / 4] >> (24 - 8 * (i % 4));
+  }
+}
@@ -0,0 +1,15 @@
+#ifndef _SHA1_H_
+#define _SHA1_H_
+
+// sha1.h - SHA-1 (FIPS 180-4), for the WebSocket handshake (websock.h).
+//
+// Not for anything that must resist an attacker.
+
+#include "xil_types.h"
+
+#define SHA1_LEN (20)
+
+// Put the digest of the `len` bytes at `buf` in `digest`
+void sha1(const void *buf, u32 len, u8 *digest);
+
+#endif // _SHA1_H_
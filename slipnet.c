@@ -0,0 +1,151 @@
+// slipnet.c - IP over SLIP on the console UART (see slipnet.h).
+//
+// slipif reads its input through sio_tryread() and writes a byte at a
+// time through sio_send(), both supplied here: input comes from the ring
+// uartcmd.c fills, output goes through outbyte() into the console's ring.
+
+#include "lwip/init.h"
+#include "lwip/ip.h"
+#include "lwip/sio.h"
+#include "netif/slipif.h"
+
+#include "xil_printf.h"
+
+#include "console.h"
+#include "ring.h"
+#include "sched.h"
+#include "slipnet.h"
+
+#if SLIPNET_ENABLE
+static struct netif slip_netif;
+// slipif's own output, which slipnet_output() wraps
+static netif_output_fn slip_output;
+
+static u8 rx_buf[SLIPNET_RX_SIZE];
+#endif
+static struct ring rx = RING_INIT(SLIPNET_RX_SIZE);
+
+static u32 packets_in;
+static u32 packets_out;
+static u32 tx_drops;
+static u32 rx_drops;
+
+// slipif.c is always linked, so these are too
+sio_fd_t
+sio_open(u8_t devnum)
+{
+  return SLIPNET_ENABLE ? &rx : NULL;
+}
+
+void
+sio_send(u8_t c, sio_fd_t fd)
+{
+  outbyte(c);
+}
+
+u32_t
+sio_tryread(sio_fd_t fd, u8_t *data, u32_t len)
+{
+  u32_t n = 0;
+
+#if SLIPNET_ENABLE
+  for(; n<len && ring_count(&rx); n++) {
+    data[n] = rx_buf[ring_tail_slot(&rx)];
+    ring_pop(&rx, 1);
+  }
+#endif
+  return n;
+}
+
+#if SLIPNET_ENABLE
+static err_t
+slipnet_input(struct pbuf *p, struct netif *netif)
+{
+  packets_in++;
+  return ip_input(p, netif);
+}
+
+// Send the packet only if the console can take all of it, escaped, so no
+// console output lands inside it
+static err_t
+slipnet_output(struct netif *netif, struct pbuf *p, const ip4_addr_t *ipaddr)
+{
+  if(console_space() < 2 * (u32)p->tot_len + 2) {
+    // As a busy serial line would, and TCP resends
+    tx_drops++;
+    return ERR_OK;
+  }
+  packets_out++;
+  return slip_output(netif, p, ipaddr);
+}
+
+static int
+slipnet_poll(void *arg)
+{
+  if(!ring_count(&rx)) {
+    return 0;
+  }
+  slipif_poll(&slip_netif);
+  return 1;
+}
+
+static struct sched_hook poll_hook = SCHED_HOOK_INIT(slipnet_poll, NULL);
+#endif // SLIPNET_ENABLE
+
+void
+init_slipnet()
+{
+#if SLIPNET_ENABLE
+  ip4_addr_t ip, netmask, gw;
+
+  ip4addr_aton(SLIPNET_ADDR, &ip);
+  ip4addr_aton(SLIPNET_NETMASK, &netmask);
+  ip4_addr_set_zero(&gw);
+  if(!netif_add(&slip_netif, &ip, &netmask, &gw, NULL, slipif_init,
+      slipnet_input)) {
+    print("SLIP:   no memory for the link\n");
+    return;
+  }
+  slip_output = slip_netif.output;
+  slip_netif.output = slipnet_output;
+  netif_set_up(&slip_netif);
+  sched_add_poll(&poll_hook);
+  xil_printf("SLIP:   %s, peer %s, on the console UART\n", SLIPNET_ADDR,
+      SLIPNET_PEER);
+#endif
+}
+
+void
+slipnet_rx(u8 c)
+{
+#if SLIPNET_ENABLE
+  if(!ring_space(&rx)) {
+    // slipif sees a corrupted packet and the checksums drop it
+    rx_drops++;
+    return;
+  }
+  rx_buf[ring_head_slot(&rx)] = c;
+  ring_push(&rx, 1);
+#endif
+}
+
+void
+slipnet_counts(u32 *in, u32 *out, u32 *tx, u32 *rx_out)
+{
+  *in = packets_in;
+  *out = packets_out;
+  *tx = tx_drops;
+  *rx_out = rx_drops;
+}
+
+void
+dump_slipnet()
+{
+#if SLIPNET_ENABLE
+  xil_printf("SLIP: %s, peer %s: %d packets in, %d out, %d not sent, "
+      "%d bytes of input lost\n", SLIPNET_ADDR, SLIPNET_PEER, packets_in,
+      packets_out, tx_drops, rx_drops);
+#else
+  print("SLIP: off\n");
+#endif
+}
@@ -0,0 +1,50 @@
+#ifndef _SLIPNET_H_
+#define _SLIPNET_H_
+
+// slipnet.h - IP over SLIP on the console UART, an out-of-band path.
+//
+// lwIP's slipif runs a second netif, point to point, on axi_uartlite_0 at
+// the UART's rate: SLIPNET_ADDR here, SLIPNET_PEER on the host's end (for
+// example slattach plus ifconfig on Linux).  The register, telemetry,
+// KATCP and other services bind to every address, so all of them answer
+// on it as on eth0, through the same handlers; only the rate differs, and
+// nothing of it touches the 10 GbE link.
+//
+// The link shares the UART with the console and uartcmd.h, whose binary
+// frames are SLIP too.  uartcmd.c tells the two apart by the first byte
+// of a frame: an IPv4 header starts with 0x4, which is not one of its
+// opcodes, and those frames are passed to slipif byte for byte.  A packet
+// goes out only if the console's output ring can take it whole, so
+// console text only ever lands between packets; the host drops it as
+// bad frames.
+
+#include "lwip/netif.h"
+
+#include "xil_types.h"
+
+#ifndef SLIPNET_ENABLE
+#define SLIPNET_ENABLE (1)
+#endif
+
+// The link's addresses, in a /30 of their own
+#define SLIPNET_ADDR    "192.168.254.1"
+#define SLIPNET_PEER    "192.168.254.2"
+#define SLIPNET_NETMASK "255.255.255.252"
+
+// Bytes of frame input buffered for slipif between passes (a power of two)
+#define SLIPNET_RX_SIZE (512)
+
+// Add the netif.  Call after init_console() and lwip_init().
+void init_slipnet();
+
+// Pass byte `c` of a frame, its ENDs included, to slipif (uartcmd.c)
+void slipnet_rx(u8 c);
+
+// Packets received and sent, and those dropped because the console's ring
+// had no room for them, or input overflowed
+void slipnet_counts(u32 *in, u32 *out, u32 *tx_drops, u32 *rx_drops);
+
+// Print the link's addresses and counts
+void dump_slipnet();
+
+#endif // _SLIPNET_H_
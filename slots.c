@@ -0,0 +1,586 @@
+// slots.c - Bitstream slots in SPI flash and the table describing them.
+//
+// Every table update is programmed into the next free page of the current
+// table sector, so switching the boot slot costs one page program and the
+// copy with the highest sequence number wins.  When a sector fills up the
+// other one is erased and takes over; the old copies stay readable until
+// the new one is in place.
+//
+// A delta write collects each smallest-erase sector of the image in
+// external memory.  Once the sector is whole, its CRC-32 is compared with a
+// streaming CRC of the flash under it.  Only a sector that differs is
+// erased and programmed, by a thread (pt.h) that awaits each step.
+
+#include <stddef.h>
+#include <string.h>
+
+#include "xil_printf.h"
+
+#include "crc32.h"
+#include "extmem.h"
+#include "flash.h"
+#include "mbmem.h"
+#include "ovl.h"
+#include "pt.h"
+#include "slots.h"
+#include "work.h"
+
+// Images are erased this far ahead of the data being programmed, so that
+// starting an image costs one erase block rather than the whole slot
+#define SLOT_ERASE_STEP SLOT_ALIGN
+
+#define SLOTS_IDLE   (0)
+#define SLOTS_TABLE  (1) // writing the table
+#define SLOTS_ERASE  (2) // erasing a slot
+#define SLOTS_WRITE  (3) // programming image data
+#define SLOTS_VERIFY (4) // CRC of the written image
+#define SLOTS_DELTA  (5) // comparing, erasing or programming a delta sector
+
+struct slot_table slots;
+
+// Table sector in use and its next free page
+static u8 tbl_sector;
+static u32 tbl_page;
+
+static struct {
+  u8 state;
+  flash_done_fn done;
+  void *arg;
+
+  // Table being written and the step to run once it is
+  struct slot_table tbl;
+  void (*then)();
+
+  // Image being written; `open` from slot_begin() to slot_finish()
+  u8 open;
+  u8 slot;
+  u32 len;
+  u32 version;
+  u32 written;
+  u32 erased;
+  u32 chunk;
+  const u8 *data;
+  u32 crc;
+
+  // Delta writes: bytes of the sector collected, and the sectors so far
+  u8 delta;
+  u8 finishing;
+  u32 have;
+  u32 skipped;
+  u32 rewritten;
+} op;
+
+// Sector buffer of delta writes, NULL without external memory
+static u8 *delta_buf;
+
+static void delta_done_work(void *arg);
+static struct work delta_work = WORK_INIT(delta_done_work, NULL);
+
+static u32
+tbl_pages()
+{
+  return flash_rsv_size() / flash_info.page_size;
+}
+
+static u32
+tbl_addr(u8 sector, u32 page)
+{
+  return flash_rsv_addr(FLASH_RSV_SLOTS + sector) +
+    page * flash_info.page_size;
+}
+
+static u32
+table_crc(const struct slot_table *t)
+{
+  return crc32(0, t, offsetof(struct slot_table, crc));
+}
+
+static void
+op_finish(int err)
+{
+  flash_done_fn done = op.done;
+
+  if(err) {
+    op.open = 0;
+  }
+  op.state = SLOTS_IDLE;
+  if(done) {
+    done(err, op.arg);
+  }
+}
+
+static void
+table_written(int err, void *arg)
+{
+  // After an error the page may be partly programmed, so skip it either way
+  tbl_page++;
+  if(!err) {
+    slots = op.tbl;
+  }
+  if(err || !op.then) {
+    op_finish(err);
+    return;
+  }
+  op.then();
+}
+
+static void
+table_program()
+{
+  op.tbl.magic = SLOT_TABLE_MAGIC;
+  op.tbl.seq = slots.seq + 1;
+  op.tbl.crc = table_crc(&op.tbl);
+  if(program_flash(tbl_addr(tbl_sector, tbl_page), (const u8 *)&op.tbl,
+        sizeof(op.tbl), table_written, NULL)) {
+    op_finish(-1);
+  }
+}
+
+static void
+table_erased(int err, void *arg)
+{
+  if(err) {
+    op_finish(err);
+    return;
+  }
+  tbl_sector ^= 1;
+  tbl_page = 0;
+  table_program();
+}
+
+// Write op.tbl as the new table, then run `then` (or finish if NULL)
+static void
+table_write(void (*then)())
+{
+  op.state = SLOTS_TABLE;
+  op.then = then;
+
+  if(tbl_page < tbl_pages()) {
+    table_program();
+    return;
+  }
+  // Current sector is full
+  if(erase_flash(tbl_addr(tbl_sector ^ 1, 0), flash_rsv_size(),
+        table_erased, NULL)) {
+    op_finish(-1);
+  }
+}
+
+// Equal slots below the reserved sectors, golden image active
+static void
+slots_default()
+{
+  u32 size = (flash_rsv_addr(0) / SLOT_DEFAULT_NUM) & ~(SLOT_ALIGN - 1);
+  int i;
+
+  memset(&slots, 0, sizeof(slots));
+  slots.magic = SLOT_TABLE_MAGIC;
+  slots.active = SLOT_GOLDEN;
+  slots.num = SLOT_DEFAULT_NUM;
+  for(i=0; i<SLOT_DEFAULT_NUM; i++) {
+    slots.slot[i].addr = i * size;
+    slots.slot[i].size = size;
+  }
+}
+
+void
+init_slots()
+{
+  struct slot_table t;
+  u32 pages = tbl_pages();
+  int found = 0;
+  u32 p;
+  u8 s;
+
+  for(s=0; s<2; s++) {
+    for(p=0; p<pages; p++) {
+      if(read_flash_cached(tbl_addr(s, p), (u8 *)&t, sizeof(t)) != sizeof(t)) {
+        continue;
+      }
+      // Pages are written in order, so the rest of the sector is empty
+      if(t.magic == SLOT_ERASED) {
+        break;
+      }
+      if(t.magic != SLOT_TABLE_MAGIC || t.num > SLOT_MAX ||
+         t.crc != table_crc(&t)) {
+        continue;
+      }
+      if(!found || (s32)(t.seq - slots.seq) > 0) {
+        slots = t;
+        tbl_sector = s;
+        found = 1;
+      }
+    }
+  }
+
+  delta_buf = extmem_alloc(flash_rsv_size());
+
+  if(!found) {
+    slots_default();
+    // A full sector 1 makes the first write erase and use sector 0
+    tbl_sector = 1;
+    tbl_page = pages;
+    return;
+  }
+
+  // Next write goes to the first erased page after the newest copy
+  for(tbl_page=0; tbl_page<pages; tbl_page++) {
+    if(read_flash_cached(tbl_addr(tbl_sector, tbl_page), (u8 *)&t,
+          sizeof(t.magic)) == sizeof(t.magic) && t.magic == SLOT_ERASED) {
+      break;
+    }
+  }
+}
+
+// Bytes of the slot the next erase step covers
+static u32
+slot_step()
+{
+  u32 n = slots.slot[op.slot].size - op.erased;
+
+  return n < SLOT_ERASE_STEP ? n : SLOT_ERASE_STEP;
+}
+
+static void
+slot_erased(int err, void *arg)
+{
+  if(err) {
+    op_finish(err);
+    return;
+  }
+  op.erased += slot_step();
+  if(op.then) {
+    op.then();
+  } else {
+    op_finish(0);
+  }
+}
+
+// Erase the next step of the slot, then run `then` (or finish if NULL)
+static void
+slot_erase(void (*then)())
+{
+  op.state = SLOTS_ERASE;
+  op.then = then;
+  if(erase_flash(slots.slot[op.slot].addr + op.erased, slot_step(),
+        slot_erased, NULL)) {
+    op_finish(-1);
+  }
+}
+
+static void
+slot_erase_first()
+{
+  slot_erase(NULL);
+}
+
+// Start writing an image, as a delta write if `delta` is set (see
+// slot_begin())
+static int
+begin(u8 slot, u32 len, u32 version, int delta, flash_done_fn done,
+    void *arg)
+{
+  if(op.state != SLOTS_IDLE || flash_busy() || slot == SLOT_GOLDEN ||
+     slot >= slots.num || slot == slots.active ||
+     len == 0 || len > slots.slot[slot].size || (delta && !delta_buf)) {
+    return -1;
+  }
+
+  op.done = done;
+  op.arg = arg;
+  op.open = 1;
+  op.slot = slot;
+  op.len = len;
+  op.version = version;
+  op.written = 0;
+  op.erased = 0;
+  op.delta = delta;
+  op.have = 0;
+  op.skipped = 0;
+  op.rewritten = 0;
+
+  // Delta writes keep the old image to compare with, but it stops being
+  // one now
+  if(delta) {
+    op.tbl = slots;
+    op.tbl.slot[slot].len = 0;
+    op.tbl.slot[slot].version = 0;
+    op.tbl.slot[slot].crc = 0;
+    table_write(NULL);
+    return 0;
+  }
+
+  // Forget the old image before erasing it
+  if(slots.slot[slot].len) {
+    op.tbl = slots;
+    op.tbl.slot[slot].len = 0;
+    op.tbl.slot[slot].version = 0;
+    op.tbl.slot[slot].crc = 0;
+    table_write(slot_erase_first);
+  } else {
+    slot_erase_first();
+  }
+  return 0;
+}
+
+int
+slot_begin(u8 slot, u32 len, u32 version, flash_done_fn done, void *arg)
+{
+  return begin(slot, len, version, 0, done, arg);
+}
+
+int
+slot_begin_delta(u8 slot, u32 len, u32 version, flash_done_fn done,
+    void *arg)
+{
+  return begin(slot, len, version, 1, done, arg);
+}
+
+static void slot_verify();
+static void delta_take();
+
+// Flash address of the sector being collected
+static u32
+delta_addr()
+{
+  return slots.slot[op.slot].addr + op.written - op.have;
+}
+
+// Compare the sector collected with a CRC of the flash under it, and
+// erase and program it if they differ
+static int
+delta_sector(struct pt *pt)
+{
+  PT_BEGIN(pt);
+  PT_AWAIT(pt, crc_flash_start(delta_addr(), op.have, pt_crc_done, pt));
+  if(pt->err) {
+    PT_EXIT(pt);
+  }
+  if(pt->value == crc32(0, delta_buf, op.have)) {
+    op.skipped++;
+    PT_EXIT(pt);
+  }
+  PT_AWAIT(pt, erase_flash(delta_addr(), flash_rsv_size(), pt_flash_done,
+        pt));
+  if(pt->err) {
+    PT_EXIT(pt);
+  }
+  PT_AWAIT(pt, program_flash(delta_addr(), delta_buf, op.have,
+        pt_flash_done, pt));
+  if(!pt->err) {
+    op.rewritten++;
+  }
+  PT_END(pt);
+}
+
+static void
+delta_sector_ended(struct pt *pt)
+{
+  if(pt->err) {
+    op_finish(pt->err);
+    return;
+  }
+  op.have = 0;
+  delta_take();
+}
+
+static struct pt delta_pt = PT_INIT(delta_sector, delta_sector_ended, NULL);
+
+static void
+delta_done_work(void *arg)
+{
+  if(op.state == SLOTS_DELTA && !op.finishing) {
+    op_finish(0);
+  }
+}
+
+// Collect the rest of op.chunk, comparing each sector once it is whole
+// (or the last one, when finishing), and finish once the chunk is taken
+static void
+delta_take()
+{
+  u32 n = flash_rsv_size() - op.have;
+
+  op.state = SLOTS_DELTA;
+  if(n > op.chunk) {
+    n = op.chunk;
+  }
+  mb_memcpy(delta_buf + op.have, op.data, n);
+  op.have += n;
+  op.written += n;
+  op.data += n;
+  op.chunk -= n;
+
+  if(op.have == flash_rsv_size() || (op.finishing && op.have)) {
+    if(pt_start(&delta_pt)) {
+      op_finish(-1);
+    }
+    return;
+  }
+  if(op.finishing) {
+    slot_verify();
+    return;
+  }
+  // `done` must not run before slot_write() returns
+  work_schedule(&delta_work);
+}
+
+static void
+slot_wrote(int err, void *arg)
+{
+  if(!err) {
+    op.written += op.chunk;
+  }
+  op_finish(err);
+}
+
+// Program op.chunk bytes at op.data, erasing ahead as needed
+static void
+slot_program()
+{
+  if(op.written + op.chunk > op.erased) {
+    slot_erase(slot_program);
+    return;
+  }
+  op.state = SLOTS_WRITE;
+  if(program_flash(slots.slot[op.slot].addr + op.written, op.data, op.chunk,
+        slot_wrote, NULL)) {
+    op_finish(-1);
+  }
+}
+
+int
+slot_write(const u8 *data, u32 len, flash_done_fn done, void *arg)
+{
+  if(op.state != SLOTS_IDLE || flash_busy() || !op.open ||
+     len > op.len - op.written || (op.delta && crc_flash_busy())) {
+    return -1;
+  }
+
+  op.done = done;
+  op.arg = arg;
+  op.data = data;
+  op.chunk = len;
+  if(op.delta) {
+    op.finishing = 0;
+    delta_take();
+    return 0;
+  }
+  if(op.written + len > op.erased) {
+    slot_erase(slot_program);
+    return 0;
+  }
+  op.state = SLOTS_WRITE;
+  if(program_flash(slots.slot[op.slot].addr + op.written, data, len,
+        slot_wrote, NULL)) {
+    op.state = SLOTS_IDLE;
+    return -1;
+  }
+  return 0;
+}
+
+static void
+slot_verified(int err, u32 crc, void *arg)
+{
+  struct slot_desc *d;
+
+  if(err || crc != op.crc) {
+    op_finish(-1);
+    return;
+  }
+
+  op.tbl = slots;
+  d = &op.tbl.slot[op.slot];
+  d->len = op.written;
+  d->version = op.version;
+  d->crc = crc;
+  table_write(NULL);
+}
+
+static void
+slot_verify()
+{
+  op.state = SLOTS_VERIFY;
+  if(crc_flash_start(slots.slot[op.slot].addr, op.written, slot_verified,
+        NULL)) {
+    op_finish(-1);
+  }
+}
+
+int
+slot_finish(u32 crc, flash_done_fn done, void *arg)
+{
+  if(op.state != SLOTS_IDLE || flash_busy() || !op.open || !op.written ||
+     crc_flash_busy()) {
+    return -1;
+  }
+
+  op.done = done;
+  op.arg = arg;
+  op.open = 0;
+  op.crc = crc;
+  if(op.delta) {
+    // The last sector, whole or not
+    op.finishing = 1;
+    op.chunk = 0;
+    delta_take();
+    return 0;
+  }
+  slot_verify();
+  return 0;
+}
+
+void
+slot_delta_counts(u32 *skipped, u32 *rewritten)
+{
+  *skipped = op.skipped;
+  *rewritten = op.rewritten;
+}
+
+int
+slot_activate(u8 slot, flash_done_fn done, void *arg)
+{
+  // The golden image is always bootable
+  if(op.state != SLOTS_IDLE || flash_busy() || slot >= slots.num ||
+     (slot != SLOT_GOLDEN && !slots.slot[slot].len) ||
+     (op.open && op.slot == slot)) {
+    return -1;
+  }
+
+  op.done = done;
+  op.arg = arg;
+  op.tbl = slots;
+  op.tbl.active = slot;
+  table_write(NULL);
+  return 0;
+}
+
+int
+slots_busy()
+{
+  return op.state != SLOTS_IDLE;
+}
+
+OVL_TEXT(report) void
+dump_slots()
+{
+  const struct slot_desc *d;
+  int i;
+
+  xil_printf("Slots (seq %d, table sector %d page %d, delta writes %s):\n",
+      slots.seq, tbl_sector, tbl_page, delta_buf ? "on" : "off");
+  for(i=0; i<slots.num; i++) {
+    d = &slots.slot[i];
+    xil_printf("  %c%d %08x %5d KB  ", i == slots.active ? '*' : ' ', i,
+        d->addr, d->size >> 10);
+    if(d->len) {
+      xil_printf("v%d, %d B, crc %08x\n", d->version, d->len, d->crc);
+    } else {
+      xil_printf("%s\n", i == SLOT_GOLDEN ? "golden" : "empty");
+    }
+  }
+  if(op.skipped || op.rewritten) {
+    xil_printf("  last delta write: %d sectors left, %d rewritten\n",
+        op.skipped, op.rewritten);
+  }
+}
@@ -0,0 +1,94 @@
+#ifndef _SLOTS_H_
+#define _SLOTS_H_
+
+// slots.h - Bitstream slots in SPI flash and the table describing them.
+//
+// Slot 0 holds the golden image and is never written by the firmware.  The
+// others take updates.  The table records each slot's image and which slot
+// the FPGA is to boot next; it lives in two reserved flash sectors and is
+// cached in BRAM.
+
+#include "xil_types.h"
+
+#include "flash.h"
+
+#define SLOT_MAX    (4)
+#define SLOT_GOLDEN (0)
+
+// Slots laid out when flash has no table, and their alignment (the usual
+// large erase block)
+#define SLOT_DEFAULT_NUM (2)
+#define SLOT_ALIGN       (64 << 10)
+
+// A table copy starts with "SLT1" read as a little-endian word; an erased
+// page reads as all ones.  The bootloader (app.h) reads the table too.
+#define SLOT_TABLE_MAGIC (0x31544c53)
+#define SLOT_ERASED      (0xffffffff)
+
+struct slot_desc {
+  // Flash region of the slot
+  u32 addr;
+  u32 size;
+  // Image length (0 if the slot holds no valid image), version and CRC-32
+  u32 len;
+  u32 version;
+  u32 crc;
+};
+
+struct slot_table {
+  u32 magic;
+  // Incremented on every write; the highest valid copy in flash wins
+  u32 seq;
+  // Slot to boot next
+  u8 active;
+  u8 num;
+  u16 pad;
+  struct slot_desc slot[SLOT_MAX];
+  // CRC-32 of the fields above
+  u32 crc;
+};
+
+extern struct slot_table slots;
+
+// Load the newest valid table from flash, or lay out SLOT_DEFAULT_NUM
+// equal slots below the reserved sectors if there is none.  Call after
+// init_flash().
+void init_slots();
+
+// Writing an image into a slot other than the golden or active one:
+//
+//   slot_begin()   marks the slot empty and erases its first block;
+//                  `len` bounds the image, which may turn out shorter
+//   slot_write()   programs the next chunk, erasing the blocks it reaches
+//                  first; `data` must stay valid until `done` is called
+//   slot_finish()  checks the CRC-32 of what was written against `crc` and
+//                  records it as the image in the table
+//
+// Each runs in the background and calls `done` with 0 on success or -1 on
+// error.  They return 0 if started, -1 if busy or the arguments are bad.
+int slot_begin(u8 slot, u32 len, u32 version, flash_done_fn done, void *arg);
+int slot_write(const u8 *data, u32 len, flash_done_fn done, void *arg);
+int slot_finish(u32 crc, flash_done_fn done, void *arg);
+
+// slot_begin() for a delta write, which leaves alone the smallest-erase
+// sectors that already hold the new image's data: each is collected in
+// external memory and compared with the flash by CRC-32 before it is
+// erased and programmed.  Fails without external memory.
+int slot_begin_delta(u8 slot, u32 len, u32 version, flash_done_fn done,
+    void *arg);
+
+// Sectors the last delta write left as they were, and those it erased and
+// programmed
+void slot_delta_counts(u32 *skipped, u32 *rewritten);
+
+// Make `slot` (which must hold a valid image) the one booted next.  Costs a
+// single page program.
+int slot_activate(u8 slot, flash_done_fn done, void *arg);
+
+// Returns non-zero while a slot operation is in progress
+int slots_busy();
+
+// Print the table
+void dump_slots();
+
+#endif // _SLOTS_H_
@@ -0,0 +1,372 @@
+// snap.c - Arm, trigger and read out the gateware's snapshot blocks.
+//
+// One connection is served at a time, through the same steps as wbblk.c:
+// the request is collected from received data, a poll hook watches the
+// armed blocks, and the round is pulled by the send window (tcpsrc.h) as
+// send buffer space frees up, each block's header and BRAM going straight
+// into the ring the segments reference.  The BRAMs are read with the eth0
+// copy routines (ethbuf.h), which are unrolled and use the CDMA where
+// there is one.  Requests that arrive while a request runs wait in the
+// received data (tcprx.h).
+
+#include <string.h>
+
+#include "xil_io.h"
+
+#include "lwip/tcp.h"
+#include "netif/ethernetif.h"
+
+#include "bswap.h"
+#include "gwrev.h"
+#include "sched.h"
+#include "snap.h"
+#include "tcprx.h"
+#include "tcpsrc.h"
+#include "timebase.h"
+#include "wbmap.h"
+#include "wbreg.h"
+
+#define SNAP_REQ  (0) // collecting a request
+#define SNAP_WAIT (1) // blocks armed, waiting for them to be done
+#define SNAP_SEND (2) // streaming the round
+
+#define SNAP_FLAGS (SNAP_FLAG_MANUAL | SNAP_FLAG_VALID | SNAP_FLAG_CIRCULAR)
+
+struct snap_block {
+  // Bus addresses of its devices, and the BRAM's size
+  u32 ctrl;
+  u32 status;
+  u32 bram;
+  u32 size;
+  u8 done;
+  u32 time_ms;
+  u32 len;
+};
+
+static struct {
+  struct tcp_pcb *pcb;
+  u8 state;
+  struct snap_req req;
+  char names[SNAP_MAX][SNAP_NAME_MAX];
+  // Bytes of the request collected
+  u32 have;
+  struct snap_block blk[SNAP_MAX];
+  u16 round;
+  u32 armed_ms;
+  // Block being sent, whether its header is queued, and the bus address
+  // and bytes left of its data
+  u32 cur;
+  u8 hdr_sent;
+  u32 addr;
+  u32 left;
+  struct tcprx rx;
+  struct tcpsrc tx;
+} snap;
+
+static err_t snap_input(struct tcp_pcb *pcb);
+
+// Forget the connection and drop unconsumed data
+static void
+snap_reset()
+{
+  tcprx_free(&snap.rx);
+  snap.pcb = NULL;
+  snap.state = SNAP_REQ;
+}
+
+// Close the connection, after anything queued has been sent.  Returns
+// what a callback must return.
+static err_t
+snap_close(struct tcp_pcb *pcb)
+{
+  err_t err = tcprx_close(&snap.rx, pcb);
+
+  snap_reset();
+  return err;
+}
+
+// Fill in the header of block `n`
+static void
+snap_header(struct snap_hdr *h, u32 n, u8 status, u32 len)
+{
+  h->block = n;
+  h->status = status;
+  h->round = swap16(snap.round);
+  h->time_ms = swap32(status == WBREG_OK ? snap.blk[n].time_ms : 0);
+  h->len = swap32(len);
+}
+
+// Answer a bad request for block `n` and close.  Returns what a callback
+// must return.
+static err_t
+snap_fail(struct tcp_pcb *pcb, u32 n, u8 status)
+{
+  struct snap_hdr h;
+
+  snap_header(&h, n, status, 0);
+  tcpsrc_write(&snap.tx, &h, sizeof(h));
+  tcp_output(pcb);
+  return snap_close(pcb);
+}
+
+// Find the devices of block `name`.  Returns 0, or -1 if one is missing.
+static int
+snap_lookup(struct snap_block *b, const char *name)
+{
+  static const char *const suffix[] = { "_ctrl", "_status", "_bram" };
+  const struct wbmap_entry *e[3];
+  char dev[WBMAP_NAME_MAX];
+  u32 len = strlen(name);
+  u32 i;
+
+  for(i=0; i<3; i++) {
+    memcpy(dev, name, len);
+    strcpy(dev + len, suffix[i]);
+    e[i] = wbmap_find(dev);
+    if(!e[i]) {
+      return -1;
+    }
+  }
+  b->ctrl = WBREG_BASE + e[0]->offset;
+  b->status = WBREG_BASE + e[1]->offset + gwrev_snap->status_off;
+  b->bram = WBREG_BASE + e[2]->offset;
+  b->size = e[2]->size;
+  return 0;
+}
+
+// Arm every block of the request for the next round
+static void
+snap_arm()
+{
+  struct snap_block *b;
+  u32 n;
+
+  for(n=0; n<snap.req.count; n++) {
+    b = &snap.blk[n];
+    b->done = 0;
+    // The block arms on the rising edge
+    Xil_Out32(b->ctrl, snap.req.flags);
+    Xil_Out32(b->ctrl, snap.req.flags | SNAP_CTRL_ARM);
+  }
+  snap.armed_ms = timebase_ms();
+  snap.state = SNAP_WAIT;
+}
+
+// Fill callback of a round: each block's header and then its data, up to
+// `len` bytes of them
+static u32
+snap_fill(void *dst, u32 len, void *arg)
+{
+  struct snap_block *b;
+  u8 *p = dst;
+  u32 n, got = 0;
+
+  while(snap.cur < snap.req.count) {
+    b = &snap.blk[snap.cur];
+    if(!snap.hdr_sent) {
+      if(len - got < sizeof(struct snap_hdr)) {
+        break;
+      }
+      snap_header((struct snap_hdr *)(p + got), snap.cur,
+          b->done ? WBREG_OK : WBREG_ETIMEDOUT, b->done ? b->len : 0);
+      got += sizeof(struct snap_hdr);
+      snap.hdr_sent = 1;
+      snap.addr = b->bram;
+      snap.left = b->done ? b->len : 0;
+    }
+    n = len - got;
+    if(n > snap.left) {
+      n = snap.left;
+    }
+    if(n) {
+      gwrev_snap->read_bram((u32 *)(p + got), snap.addr, n / 4);
+      got += n;
+      snap.addr += n;
+      snap.left -= n;
+    }
+    if(snap.left) {
+      break;
+    }
+    snap.cur++;
+    snap.hdr_sent = 0;
+  }
+  return got;
+}
+
+// Queue as much of the round as the send buffer takes, and go on to the
+// next round or request once it is all queued
+static err_t
+snap_send(struct tcp_pcb *pcb)
+{
+  tcpsrc_pump(&snap.tx);
+
+  if(snap.cur < snap.req.count) {
+    return ERR_OK;
+  }
+  tcpsrc_set_fill(&snap.tx, NULL, NULL);
+  if(++snap.round < snap.req.repeat) {
+    snap_arm();
+    return ERR_OK;
+  }
+  snap.state = SNAP_REQ;
+  snap.have = 0;
+  return snap_input(pcb);
+}
+
+// Check the request just collected and start on it.  Returns what a
+// callback must return.
+static err_t
+snap_start(struct tcp_pcb *pcb)
+{
+  u32 n;
+
+  for(n=0; n<snap.req.count; n++) {
+    snap.names[n][SNAP_NAME_MAX - 1] = '\0';
+    if(snap_lookup(&snap.blk[n], snap.names[n]) != 0) {
+      return snap_fail(pcb, n, WBREG_ENOENT);
+    }
+  }
+  snap.round = 0;
+  snap_arm();
+  return ERR_OK;
+}
+
+// Collect a request from received data and start it once it is whole.
+// Returns what a callback must return.
+static err_t
+snap_input(struct tcp_pcb *pcb)
+{
+  struct snap_req *r = &snap.req;
+  u32 want;
+
+  if(snap.state != SNAP_REQ) {
+    return ERR_OK;
+  }
+  if(snap.have < sizeof(*r)) {
+    while(snap.rx.p && snap.have < sizeof(*r)) {
+      snap.have += tcprx_take(&snap.rx, pcb, (u8 *)r + snap.have,
+          sizeof(*r) - snap.have);
+    }
+    if(snap.have < sizeof(*r)) {
+      return ERR_OK;
+    }
+    if(r->count == 0 || r->count > SNAP_MAX || (r->flags & ~SNAP_FLAGS)) {
+      return snap_fail(pcb, 0, WBREG_ELEN);
+    }
+    r->repeat = swap16(r->repeat);
+    r->timeout_ms = swap32(r->timeout_ms);
+    if(r->repeat == 0) {
+      r->repeat = 1;
+    }
+  }
+  want = sizeof(*r) + r->count * SNAP_NAME_MAX;
+  while(snap.rx.p && snap.have < want) {
+    snap.have += tcprx_take(&snap.rx, pcb,
+        (u8 *)snap.names + snap.have - sizeof(*r), want - snap.have);
+  }
+  if(snap.have < want) {
+    return ERR_OK;
+  }
+  return snap_start(pcb);
+}
+
+// Watch the armed blocks, and start sending when all are done or time is
+// up
+static int
+snap_poll(void *arg)
+{
+  struct snap_block *b;
+  u32 n, st;
+  int all = 1;
+
+  if(snap.state != SNAP_WAIT) {
+    return 0;
+  }
+  for(n=0; n<snap.req.count; n++) {
+    b = &snap.blk[n];
+    if(b->done) {
+      continue;
+    }
+    st = Xil_In32(b->status);
+    if(!(st & SNAP_STATUS_DONE)) {
+      all = 0;
+      continue;
+    }
+    b->done = 1;
+    b->time_ms = timebase_ms();
+    b->len = (st & SNAP_STATUS_BYTES) < b->size ?
+        (st & SNAP_STATUS_BYTES) & ~3 : b->size;
+  }
+  if(!all && timebase_ms() - snap.armed_ms < snap.req.timeout_ms) {
+    return 0;
+  }
+  snap.state = SNAP_SEND;
+  snap.cur = 0;
+  snap.hdr_sent = 0;
+  tcpsrc_set_fill(&snap.tx, snap_fill, NULL);
+  snap_send(snap.pcb);
+  return 1;
+}
+
+static struct sched_hook poll_hook = SCHED_HOOK_INIT(snap_poll, NULL);
+
+static err_t
+snap_recv(void *arg, struct tcp_pcb *pcb, struct pbuf *p, err_t err)
+{
+  if(!p) {
+    return snap_close(pcb);
+  }
+
+  tcprx_add(&snap.rx, p);
+  return snap_input(pcb);
+}
+
+static err_t
+snap_sent(void *arg, struct tcp_pcb *pcb, u16_t len)
+{
+  tcpsrc_sent(&snap.tx, len);
+  if(snap.state == SNAP_SEND) {
+    return snap_send(pcb);
+  }
+  return ERR_OK;
+}
+
+static void
+snap_err(void *arg, err_t err)
+{
+  snap_reset();
+}
+
+static err_t
+snap_accept(void *arg, struct tcp_pcb *pcb, err_t err)
+{
+  if(err != ERR_OK || snap.pcb) {
+    return ERR_MEM;
+  }
+
+  // Readouts queue behind register replies on eth0
+  pcb->tos = ETHERNETIF_TOS_BULK;
+  snap.pcb = pcb;
+  snap.state = SNAP_REQ;
+  snap.have = 0;
+  tcprx_init(&snap.rx);
+  tcpsrc_init(&snap.tx, pcb, NULL, NULL);
+
+  tcp_recv(pcb, snap_recv);
+  tcp_sent(pcb, snap_sent);
+  tcp_err(pcb, snap_err);
+  return ERR_OK;
+}
+
+void
+init_snap()
+{
+  struct tcp_pcb *pcb = tcp_new();
+
+  sched_add_poll(&poll_hook);
+  if(!pcb || tcp_bind(pcb, IP_ADDR_ANY, SNAP_PORT) != ERR_OK) {
+    return;
+  }
+  pcb = tcp_listen(pcb);
+  tcp_accept(pcb, snap_accept);
+}
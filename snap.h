@@ -0,0 +1,69 @@
+#ifndef _SNAP_H_
+#define _SNAP_H_
+
+// snap.h - Arm, trigger and read out the gateware's snapshot blocks.
+//
+// A snapshot block is three devices in core_info.tab (wbmap.h), as the
+// CASPER snapshot block lays them out: <name>_ctrl, <name>_status and
+// <name>_bram.  Raising ctrl's SNAP_CTRL_ARM bit arms it; once the trigger
+// has come and the BRAM has filled, status has SNAP_STATUS_DONE and the
+// number of bytes captured.
+//
+// A connection to SNAP_PORT carries a sequence of requests, each a struct
+// snap_req followed by `count` block names, NUL-padded to SNAP_NAME_MAX.
+// For each of `repeat` rounds the server arms every block named, polls
+// them from the main loop until all are done or `timeout_ms` has passed
+// since it armed them, and sends, block by block in request order, a
+// struct snap_hdr and then `len` bytes of its BRAM.  Data goes as
+// big-endian 32-bit words, the same as wbblk.h's, and so do the header
+// fields.  Only then does the next round arm the blocks again or the next
+// request start.  A request with a bad status is answered with one
+// snap_hdr and the connection closed.
+//
+// The gateware gives them no interrupt line, so the wait is a poll each
+// pass of the loop: a trigger is seen within a pass, and as the blocks
+// stop capturing on their own, a slow pass costs nothing but latency.
+
+#include "xil_types.h"
+
+#define SNAP_PORT          (7008)
+
+// Blocks in a request, and the longest name with its NUL
+#define SNAP_MAX           (4)
+#define SNAP_NAME_MAX      (24)
+
+// Request flags, passed on to ctrl
+#define SNAP_FLAG_MANUAL   (0x02) // trigger at once instead of on the input
+#define SNAP_FLAG_VALID    (0x04) // capture every clock, ignoring valid
+#define SNAP_FLAG_CIRCULAR (0x08) // capture until the trigger, not after
+
+#define SNAP_CTRL_ARM      (0x01)
+#define SNAP_STATUS_DONE   (0x80000000)
+#define SNAP_STATUS_BYTES  (0x7fffffff)
+
+// snap_hdr statuses are wbreg.h's: WBREG_OK, WBREG_ELEN (bad count or
+// flags), WBREG_ENOENT (no such block) and WBREG_ETIMEDOUT (not done in
+// time, no data follows)
+
+struct snap_req {
+  u8 count;
+  u8 flags;
+  u16 repeat;
+  u32 timeout_ms;
+};
+
+struct snap_hdr {
+  // Index of the block in the request
+  u8 block;
+  u8 status;
+  // Round, from 0
+  u16 round;
+  // timebase_ms() when it was seen done
+  u32 time_ms;
+  u32 len;
+};
+
+// Listen on SNAP_PORT and start polling.  Call after lwip_init().
+void init_snap();
+
+#endif // _SNAP_H_
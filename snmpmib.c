@@ -0,0 +1,602 @@
+// snmpmib.c - SNMP agent with the board's enterprise MIB (see snmpmib.h).
+//
+// Every table is one of lwIP's simple read-only tables, whose cells are
+// worked out from the live structures as the agent asks for them; nothing
+// is gathered ahead of a request.  The tables indexed by one number
+// counting from 1 share get_row() and next_row() over a cell function
+// that fails for a row or column that does not exist.
+
+#include <string.h>
+
+#include "lwip/apps/snmp.h"
+#include "lwip/apps/snmp_scalar.h"
+#include "lwip/apps/snmp_table.h"
+#include "lwip/netif.h"
+#include "lwip/tcp.h"
+#include "lwip/memp.h"
+#include "lwip/ip4_frag.h"
+#include "lwip/stats.h"
+#include "netif/ethernetif.h"
+
+#include "ethmon.h"
+#include "load.h"
+#include "sched.h"
+#include "slots.h"
+#include "snmpmib.h"
+#include "snmptrap.h"
+#include "telemetry.h"
+#include "timebase.h"
+#include "version.h"
+#include "wbwatch.h"
+#include "xadc.h"
+
+// Value of column `col` of row `row`, or SNMP_ERR_NOSUCHINSTANCE
+typedef snmp_err_t (*cell_fn)(u32_t col, u32 row,
+    union snmp_variant_value *value, u32_t *len);
+
+static snmp_err_t
+get_row(const u32_t *column, const u32_t *row_oid, u8_t row_oid_len,
+    union snmp_variant_value *value, u32_t *len, cell_fn cell)
+{
+  if(row_oid_len != 1) {
+    return SNMP_ERR_NOSUCHINSTANCE;
+  }
+  return cell(*column, row_oid[0], value, len);
+}
+
+// First row below `rows` past `row_oid` that has the column
+static snmp_err_t
+next_row(const u32_t *column, struct snmp_obj_id *row_oid,
+    union snmp_variant_value *value, u32_t *len, u32 rows, cell_fn cell)
+{
+  // Row n is past n.x as well as n
+  u32 row = row_oid->len ? row_oid->id[0] : 0;
+
+  while(row < rows) {
+    row++;
+    if(cell(*column, row, value, len) == SNMP_ERR_NOERROR) {
+      row_oid->id[0] = row;
+      row_oid->len = 1;
+      return SNMP_ERR_NOERROR;
+    }
+  }
+  return SNMP_ERR_NOSUCHINSTANCE;
+}
+
+// The get_cell_value and get_next_cell_instance_and_value methods of table
+// `name`, of `rows` rows
+#define ROW_TABLE(name, rows, cell) \
+  static snmp_err_t \
+  name##_get(const u32_t *column, const u32_t *row_oid, u8_t row_oid_len, \
+      union snmp_variant_value *value, u32_t *len) \
+  { \
+    return get_row(column, row_oid, row_oid_len, value, len, cell); \
+  } \
+  static snmp_err_t \
+  name##_next(const u32_t *column, struct snmp_obj_id *row_oid, \
+      union snmp_variant_value *value, u32_t *len) \
+  { \
+    return next_row(column, row_oid, value, len, rows, cell); \
+  }
+
+// Channel `ch` is in the XADC's scan
+static int
+xadc_scanned(u32 ch)
+{
+  return ch < XADC_AUX(0) || ((XADC_AUX_CHANNELS >> (ch - XADC_AUX(0))) & 1);
+}
+
+// --- jamBoard (1) ---
+
+static const struct snmp_scalar_array_node_def board_nodes[] = {
+  { 1, SNMP_ASN1_TYPE_TIMETICKS, SNMP_NODE_INSTANCE_READ_ONLY }, // jamUptime
+  { 2, SNMP_ASN1_TYPE_GAUGE, SNMP_NODE_INSTANCE_READ_ONLY },     // jamVersionMajor
+  { 3, SNMP_ASN1_TYPE_GAUGE, SNMP_NODE_INSTANCE_READ_ONLY },     // jamVersionMinor
+  { 4, SNMP_ASN1_TYPE_COUNTER, SNMP_NODE_INSTANCE_READ_ONLY },   // jamTelemRecords
+  { 5, SNMP_ASN1_TYPE_COUNTER, SNMP_NODE_INSTANCE_READ_ONLY },   // jamXadcEvents
+  { 6, SNMP_ASN1_TYPE_COUNTER, SNMP_NODE_INSTANCE_READ_ONLY },   // jamStalls
+  { 7, SNMP_ASN1_TYPE_GAUGE, SNMP_NODE_INSTANCE_READ_ONLY },     // jamLongestPass
+  { 8, SNMP_ASN1_TYPE_GAUGE, SNMP_NODE_INSTANCE_READ_ONLY },     // jamLoad
+};
+
+static s16_t
+board_get(const struct snmp_scalar_array_node_def *node, void *value)
+{
+  u32_t *v = (u32_t *)value;
+  u32 longest_us, stalls;
+
+  switch(node->oid) {
+  case 1:
+    *v = timebase_ms() / 10;
+    break;
+  case 2:
+    *v = JAM_VERSION_MAJOR;
+    break;
+  case 3:
+    *v = JAM_VERSION_MINOR;
+    break;
+  case 4:
+    *v = telem_count();
+    break;
+  case 5:
+    *v = xadc_event_count();
+    break;
+  case 6:
+  case 7:
+    stalls = sched_stalls(&longest_us);
+    *v = node->oid == 6 ? stalls : longest_us;
+    break;
+  case 8:
+    *v = load_stats()->load_pm;
+    break;
+  default:
+    return 0;
+  }
+  return sizeof(*v);
+}
+
+static const struct snmp_scalar_array_node board_node =
+  SNMP_SCALAR_CREATE_ARRAY_NODE(1, board_nodes, board_get, NULL, NULL);
+
+// --- jamXadcTable (2), indexed by channel + 1 ---
+
+static const struct snmp_table_simple_col_def xadc_columns[] = {
+  { 2, SNMP_ASN1_TYPE_INTEGER, SNMP_VARIANT_VALUE_TYPE_S32 }, // jamXadcValue
+  { 3, SNMP_ASN1_TYPE_GAUGE, SNMP_VARIANT_VALUE_TYPE_U32 },   // jamXadcRaw
+  { 4, SNMP_ASN1_TYPE_INTEGER, SNMP_VARIANT_VALUE_TYPE_S32 }, // jamXadcPeakMin
+  { 5, SNMP_ASN1_TYPE_INTEGER, SNMP_VARIANT_VALUE_TYPE_S32 }, // jamXadcPeakMax
+};
+
+static snmp_err_t
+xadc_cell(u32_t col, u32 row, union snmp_variant_value *value, u32_t *len)
+{
+  u32 ch = row - 1;
+
+  if(!row || row > XADC_NUM_CHANNELS || !xadc_scanned(ch)) {
+    return SNMP_ERR_NOSUCHINSTANCE;
+  }
+  switch(col) {
+  case 2:
+    value->s32 = xadc_convert(ch, xadc_raw(ch));
+    break;
+  case 3:
+    value->u32 = xadc_raw(ch);
+    break;
+  case 4:
+  case 5:
+    // Only the on-chip sensors have their extremes tracked
+    if(ch > XADC_VBRAM) {
+      return SNMP_ERR_NOSUCHINSTANCE;
+    }
+    value->s32 = xadc_convert(ch, xadc_peak(ch, col == 5));
+    break;
+  default:
+    return SNMP_ERR_NOSUCHINSTANCE;
+  }
+  return SNMP_ERR_NOERROR;
+}
+
+ROW_TABLE(xadc, XADC_NUM_CHANNELS, xadc_cell)
+
+static const struct snmp_table_simple_node xadc_table =
+  SNMP_TABLE_CREATE_SIMPLE(2, xadc_columns, xadc_get, xadc_next);
+
+// --- jamTelemTable (3), indexed by record sequence number + 1 and
+// channel + 1 ---
+
+static const struct snmp_table_simple_col_def telem_columns[] = {
+  { 3, SNMP_ASN1_TYPE_GAUGE, SNMP_VARIANT_VALUE_TYPE_U32 },   // jamTelemTime
+  { 4, SNMP_ASN1_TYPE_GAUGE, SNMP_VARIANT_VALUE_TYPE_U32 },   // jamTelemSamples
+  { 5, SNMP_ASN1_TYPE_GAUGE, SNMP_VARIANT_VALUE_TYPE_U32 },   // jamTelemEvents
+  { 6, SNMP_ASN1_TYPE_INTEGER, SNMP_VARIANT_VALUE_TYPE_S32 }, // jamTelemMin
+  { 7, SNMP_ASN1_TYPE_INTEGER, SNMP_VARIANT_VALUE_TYPE_S32 }, // jamTelemMax
+  { 8, SNMP_ASN1_TYPE_INTEGER, SNMP_VARIANT_VALUE_TYPE_S32 }, // jamTelemMean
+};
+
+// Read straight out of the ring, which does not move while the agent runs
+static snmp_err_t
+telem_cell(u32_t col, u32 rec, u32 row, union snmp_variant_value *value)
+{
+  const struct telem_record *r = rec ? telem_peek(rec - 1) : NULL;
+  u32 ch = row - 1;
+
+  if(!r || !row || row > XADC_NUM_CHANNELS || !xadc_scanned(ch)) {
+    return SNMP_ERR_NOSUCHINSTANCE;
+  }
+  switch(col) {
+  case 3:
+    value->u32 = r->time_ms;
+    break;
+  case 4:
+    value->u32 = r->samples;
+    break;
+  case 5:
+    value->u32 = r->events;
+    break;
+  case 6:
+    value->s32 = xadc_convert(ch, r->min[ch]);
+    break;
+  case 7:
+    value->s32 = xadc_convert(ch, r->max[ch]);
+    break;
+  case 8:
+    value->s32 = xadc_convert(ch, r->mean[ch]);
+    break;
+  default:
+    return SNMP_ERR_NOSUCHINSTANCE;
+  }
+  return SNMP_ERR_NOERROR;
+}
+
+static snmp_err_t
+telem_get(const u32_t *column, const u32_t *row_oid, u8_t row_oid_len,
+    union snmp_variant_value *value, u32_t *len)
+{
+  if(row_oid_len != 2) {
+    return SNMP_ERR_NOSUCHINSTANCE;
+  }
+  return telem_cell(*column, row_oid[0], row_oid[1], value);
+}
+
+static snmp_err_t
+telem_next(const u32_t *column, struct snmp_obj_id *row_oid,
+    union snmp_variant_value *value, u32_t *len)
+{
+  u32 count = telem_count();
+  u32 first = telem_first();
+  u32 rec = row_oid->len ? row_oid->id[0] : 0;
+  u32 ch = row_oid->len > 1 ? row_oid->id[1] : 0;
+
+  // Records before the oldest one kept start over at its first channel
+  if(rec <= first) {
+    rec = first + 1;
+    ch = 0;
+  }
+  for(; rec && rec <= count; rec++, ch = 0) {
+    while(ch < XADC_NUM_CHANNELS) {
+      ch++;
+      if(telem_cell(*column, rec, ch, value) == SNMP_ERR_NOERROR) {
+        row_oid->id[0] = rec;
+        row_oid->id[1] = ch;
+        row_oid->len = 2;
+        return SNMP_ERR_NOERROR;
+      }
+    }
+  }
+  return SNMP_ERR_NOSUCHINSTANCE;
+}
+
+static const struct snmp_table_simple_node telem_table =
+  SNMP_TABLE_CREATE_SIMPLE(3, telem_columns, telem_get, telem_next);
+
+// --- jamSlotTable (4), indexed by slot + 1 ---
+
+static const struct snmp_table_simple_col_def slot_columns[] = {
+  { 2, SNMP_ASN1_TYPE_GAUGE, SNMP_VARIANT_VALUE_TYPE_U32 },   // jamSlotAddr
+  { 3, SNMP_ASN1_TYPE_GAUGE, SNMP_VARIANT_VALUE_TYPE_U32 },   // jamSlotSize
+  { 4, SNMP_ASN1_TYPE_GAUGE, SNMP_VARIANT_VALUE_TYPE_U32 },   // jamSlotLength
+  { 5, SNMP_ASN1_TYPE_GAUGE, SNMP_VARIANT_VALUE_TYPE_U32 },   // jamSlotVersion
+  { 6, SNMP_ASN1_TYPE_GAUGE, SNMP_VARIANT_VALUE_TYPE_U32 },   // jamSlotCrc
+  { 7, SNMP_ASN1_TYPE_INTEGER, SNMP_VARIANT_VALUE_TYPE_S32 }, // jamSlotActive
+};
+
+static snmp_err_t
+slot_cell(u32_t col, u32 row, union snmp_variant_value *value, u32_t *len)
+{
+  const struct slot_desc *d;
+
+  if(!row || row > slots.num) {
+    return SNMP_ERR_NOSUCHINSTANCE;
+  }
+  d = &slots.slot[row - 1];
+  switch(col) {
+  case 2:
+    value->u32 = d->addr;
+    break;
+  case 3:
+    value->u32 = d->size;
+    break;
+  case 4:
+    value->u32 = d->len;
+    break;
+  case 5:
+    value->u32 = d->version;
+    break;
+  case 6:
+    value->u32 = d->crc;
+    break;
+  case 7:
+    // TruthValue
+    value->s32 = row - 1 == slots.active ? 1 : 2;
+    break;
+  default:
+    return SNMP_ERR_NOSUCHINSTANCE;
+  }
+  return SNMP_ERR_NOERROR;
+}
+
+ROW_TABLE(slot, SLOT_MAX, slot_cell)
+
+static const struct snmp_table_simple_node slot_table =
+  SNMP_TABLE_CREATE_SIMPLE(4, slot_columns, slot_get, slot_next);
+
+// --- jamWatchTable (5), indexed by watch slot + 1 ---
+
+static const struct snmp_table_simple_col_def watch_columns[] = {
+  { 2, SNMP_ASN1_TYPE_GAUGE, SNMP_VARIANT_VALUE_TYPE_U32 },   // jamWatchAddr
+  { 3, SNMP_ASN1_TYPE_GAUGE, SNMP_VARIANT_VALUE_TYPE_U32 },   // jamWatchMask
+  { 4, SNMP_ASN1_TYPE_GAUGE, SNMP_VARIANT_VALUE_TYPE_U32 },   // jamWatchValue
+  { 5, SNMP_ASN1_TYPE_COUNTER, SNMP_VARIANT_VALUE_TYPE_U32 }, // jamWatchChanges
+  { 6, SNMP_ASN1_TYPE_COUNTER, SNMP_VARIANT_VALUE_TYPE_U32 }, // jamWatchReports
+};
+
+static snmp_err_t
+watch_cell(u32_t col, u32 row, union snmp_variant_value *value, u32_t *len)
+{
+  u32 addr, mask, v, changes, reports;
+
+  if(!row || wbwatch_get(row - 1, &addr, &mask, &v) ||
+     wbwatch_counts(row - 1, &changes, &reports)) {
+    return SNMP_ERR_NOSUCHINSTANCE;
+  }
+  switch(col) {
+  case 2:
+    value->u32 = addr;
+    break;
+  case 3:
+    value->u32 = mask;
+    break;
+  case 4:
+    value->u32 = v;
+    break;
+  case 5:
+    value->u32 = changes;
+    break;
+  case 6:
+    value->u32 = reports;
+    break;
+  default:
+    return SNMP_ERR_NOSUCHINSTANCE;
+  }
+  return SNMP_ERR_NOERROR;
+}
+
+ROW_TABLE(watch, WBWATCH_MAX, watch_cell)
+
+static const struct snmp_table_simple_node watch_table =
+  SNMP_TABLE_CREATE_SIMPLE(5, watch_columns, watch_get, watch_next);
+
+// --- jamPoolTable (6), indexed by memp pool + 1 ---
+
+static const struct snmp_table_simple_col_def pool_columns[] = {
+  { 2, SNMP_ASN1_TYPE_OCTET_STRING, SNMP_VARIANT_VALUE_TYPE_CONST_PTR }, // jamPoolName
+  { 3, SNMP_ASN1_TYPE_GAUGE, SNMP_VARIANT_VALUE_TYPE_U32 },   // jamPoolUsed
+  { 4, SNMP_ASN1_TYPE_GAUGE, SNMP_VARIANT_VALUE_TYPE_U32 },   // jamPoolMax
+  { 5, SNMP_ASN1_TYPE_GAUGE, SNMP_VARIANT_VALUE_TYPE_U32 },   // jamPoolSize
+  { 6, SNMP_ASN1_TYPE_COUNTER, SNMP_VARIANT_VALUE_TYPE_U32 }, // jamPoolErrors
+};
+
+static snmp_err_t
+pool_cell(u32_t col, u32 row, union snmp_variant_value *value, u32_t *len)
+{
+  const struct memp_desc *d;
+
+  if(!row || row > MEMP_MAX) {
+    return SNMP_ERR_NOSUCHINSTANCE;
+  }
+  d = memp_pools[row - 1];
+  switch(col) {
+  case 2:
+    value->const_ptr = d->desc;
+    *len = strlen(d->desc);
+    break;
+  case 3:
+    value->u32 = d->stats->used;
+    break;
+  case 4:
+    value->u32 = d->stats->max;
+    break;
+  case 5:
+    value->u32 = d->stats->avail;
+    break;
+  case 6:
+    value->u32 = d->stats->err;
+    break;
+  default:
+    return SNMP_ERR_NOSUCHINSTANCE;
+  }
+  return SNMP_ERR_NOERROR;
+}
+
+ROW_TABLE(pool, MEMP_MAX, pool_cell)
+
+static const struct snmp_table_simple_node pool_table =
+  SNMP_TABLE_CREATE_SIMPLE(6, pool_columns, pool_get, pool_next);
+
+// --- jamNet (7) ---
+
+static const struct snmp_scalar_array_node_def net_nodes[] = {
+  { 1, SNMP_ASN1_TYPE_COUNTER, SNMP_NODE_INSTANCE_READ_ONLY }, // jamNetRxHolds
+  { 2, SNMP_ASN1_TYPE_COUNTER, SNMP_NODE_INSTANCE_READ_ONLY }, // jamNetRxNomemDrops
+  { 3, SNMP_ASN1_TYPE_COUNTER, SNMP_NODE_INSTANCE_READ_ONLY }, // jamNetMempFailures
+  { 4, SNMP_ASN1_TYPE_COUNTER, SNMP_NODE_INSTANCE_READ_ONLY }, // jamNetReassRejected
+  { 5, SNMP_ASN1_TYPE_COUNTER, SNMP_NODE_INSTANCE_READ_ONLY }, // jamNetReassCapped
+};
+
+static s16_t
+net_get(const struct snmp_scalar_array_node_def *node, void *value)
+{
+  u32_t *v = (u32_t *)value;
+  u32_t holds, drops;
+
+  switch(node->oid) {
+  case 1:
+  case 2:
+    ethernetif_rx_nomem(netif_default, &holds, &drops);
+    *v = node->oid == 1 ? holds : drops;
+    break;
+  case 3:
+    *v = memp_fail_count();
+    break;
+  case 4:
+    *v = ip_reass_drops.rejected;
+    break;
+  case 5:
+    *v = ip_reass_drops.capped;
+    break;
+  default:
+    return 0;
+  }
+  return sizeof(*v);
+}
+
+static const struct snmp_scalar_array_node net_node =
+  SNMP_SCALAR_CREATE_ARRAY_NODE(7, net_nodes, net_get, NULL, NULL);
+
+#if LWIP_CYCLE_STATS
+// --- jamCycleTable (8), indexed by enum lwip_cycle_layer + 1 ---
+
+static const struct snmp_table_simple_col_def cycle_columns[] = {
+  { 2, SNMP_ASN1_TYPE_COUNTER, SNMP_VARIANT_VALUE_TYPE_U32 }, // jamCycleCalls
+  { 3, SNMP_ASN1_TYPE_COUNTER, SNMP_VARIANT_VALUE_TYPE_U32 }, // jamCycleCount
+};
+
+static snmp_err_t
+cycle_cell(u32_t col, u32 row, union snmp_variant_value *value, u32_t *len)
+{
+  if(!row || row > CYCLES_NUM_LAYERS) {
+    return SNMP_ERR_NOSUCHINSTANCE;
+  }
+  switch(col) {
+  case 2:
+    value->u32 = lwip_cycle_stats.layer[row - 1].calls;
+    break;
+  case 3:
+    value->u32 = lwip_cycle_stats.layer[row - 1].cycles;
+    break;
+  default:
+    return SNMP_ERR_NOSUCHINSTANCE;
+  }
+  return SNMP_ERR_NOERROR;
+}
+
+ROW_TABLE(cycle, CYCLES_NUM_LAYERS, cycle_cell)
+
+static const struct snmp_table_simple_node cycle_table =
+  SNMP_TABLE_CREATE_SIMPLE(8, cycle_columns, cycle_get, cycle_next);
+#endif // LWIP_CYCLE_STATS
+
+// --- jamTraps (9) ---
+
+static const struct snmp_scalar_array_node_def traps_nodes[] = {
+  { 1, SNMP_ASN1_TYPE_COUNTER, SNMP_NODE_INSTANCE_READ_ONLY }, // jamTrapsSent
+  { 2, SNMP_ASN1_TYPE_COUNTER, SNMP_NODE_INSTANCE_READ_ONLY }, // jamTrapsCoalesced
+};
+
+static s16_t
+traps_get(const struct snmp_scalar_array_node_def *node, void *value)
+{
+  u32_t *v = (u32_t *)value;
+  u32 sent, coalesced;
+
+  sent = snmptrap_counts(&coalesced);
+  switch(node->oid) {
+  case 1:
+    *v = sent;
+    break;
+  case 2:
+    *v = coalesced;
+    break;
+  default:
+    return 0;
+  }
+  return sizeof(*v);
+}
+
+static const struct snmp_scalar_array_node traps_node =
+  SNMP_SCALAR_CREATE_ARRAY_NODE(9, traps_nodes, traps_get, NULL, NULL);
+
+// --- jamEthTable (10), indexed by core + 1 ---
+
+static const struct snmp_table_simple_col_def eth_columns[] = {
+  { 2, SNMP_ASN1_TYPE_INTEGER, SNMP_VARIANT_VALUE_TYPE_S32 }, // jamEthLink
+  { 3, SNMP_ASN1_TYPE_COUNTER, SNMP_VARIANT_VALUE_TYPE_U32 }, // jamEthLinkChanges
+  { 4, SNMP_ASN1_TYPE_COUNTER, SNMP_VARIANT_VALUE_TYPE_U32 }, // jamEthTxFrames
+  { 5, SNMP_ASN1_TYPE_COUNTER, SNMP_VARIANT_VALUE_TYPE_U32 }, // jamEthRxFrames
+  { 6, SNMP_ASN1_TYPE_COUNTER, SNMP_VARIANT_VALUE_TYPE_U32 }, // jamEthTxOverflows
+  { 7, SNMP_ASN1_TYPE_COUNTER, SNMP_VARIANT_VALUE_TYPE_U32 }, // jamEthTxFull
+  { 8, SNMP_ASN1_TYPE_COUNTER, SNMP_VARIANT_VALUE_TYPE_U32 }, // jamEthRxOverflows
+  { 9, SNMP_ASN1_TYPE_COUNTER, SNMP_VARIANT_VALUE_TYPE_U32 }, // jamEthRxBad
+  { 10, SNMP_ASN1_TYPE_GAUGE, SNMP_VARIANT_VALUE_TYPE_U32 },  // jamEthTxRate
+  { 11, SNMP_ASN1_TYPE_GAUGE, SNMP_VARIANT_VALUE_TYPE_U32 },  // jamEthRxRate
+  { 12, SNMP_ASN1_TYPE_GAUGE, SNMP_VARIANT_VALUE_TYPE_U32 },  // jamEthTxOverflowRate
+  { 13, SNMP_ASN1_TYPE_GAUGE, SNMP_VARIANT_VALUE_TYPE_U32 },  // jamEthTxFullRate
+  { 14, SNMP_ASN1_TYPE_GAUGE, SNMP_VARIANT_VALUE_TYPE_U32 },  // jamEthRxOverflowRate
+  { 15, SNMP_ASN1_TYPE_GAUGE, SNMP_VARIANT_VALUE_TYPE_U32 },  // jamEthRxBadRate
+};
+
+static snmp_err_t
+eth_cell(u32_t col, u32 row, union snmp_variant_value *value, u32_t *len)
+{
+  const struct ethmon_core *e = row ? ethmon_core(row - 1) : NULL;
+  u32 i;
+
+  if(!e) {
+    return SNMP_ERR_NOSUCHINSTANCE;
+  }
+  switch(col) {
+  case 2:
+    // 1 up, 2 down, 3 unknown
+    value->s32 = e->link == ETHMON_LINK_UP ? 1 :
+        e->link == ETHMON_LINK_DOWN ? 2 : 3;
+    break;
+  case 3:
+    value->u32 = e->link_changes;
+    break;
+  default:
+    i = col < 10 ? col - 4 : col - 10;
+    if(col < 4 || col > 15 || !((e->have >> i) & 1)) {
+      return SNMP_ERR_NOSUCHINSTANCE;
+    }
+    value->u32 = col < 10 ? e->count[i] : e->rate[i];
+    break;
+  }
+  return SNMP_ERR_NOERROR;
+}
+
+ROW_TABLE(eth, ETH_MAX_CORES, eth_cell)
+
+static const struct snmp_table_simple_node eth_table =
+  SNMP_TABLE_CREATE_SIMPLE(10, eth_columns, eth_get, eth_next);
+
+// In OID order
+static const struct snmp_node *const jam_nodes[] = {
+  &board_node.node.node,
+  &xadc_table.node.node,
+  &telem_table.node.node,
+  &slot_table.node.node,
+  &watch_table.node.node,
+  &pool_table.node.node,
+  &net_node.node.node,
+#if LWIP_CYCLE_STATS
+  &cycle_table.node.node,
+#endif
+  &traps_node.node.node,
+  &eth_table.node.node,
+};
+
+static const struct snmp_tree_node jam_root = SNMP_CREATE_TREE_NODE(1, jam_nodes);
+
+static const u32_t jam_base_oid[] = { SNMPMIB_OID };
+static const struct snmp_mib jam_mib = SNMP_MIB_CREATE(jam_base_oid, &jam_root.node);
+static const struct snmp_mib *mibs[] = { &jam_mib };
+
+static const struct snmp_obj_id device_oid = { SNMPMIB_OID_LEN, { SNMPMIB_OID } };
+
+void
+init_snmpmib()
+{
+  snmp_set_mibs(mibs, LWIP_ARRAYSIZE(mibs));
+  snmp_set_device_enterprise_oid(&device_oid);
+  snmp_init();
+}
@@ -0,0 +1,44 @@
+#ifndef _SNMPMIB_H_
+#define _SNMPMIB_H_
+
+// snmpmib.h - SNMP agent with the board's enterprise MIB.
+//
+// lwIP's SNMPv2c agent answers on UDP port 161 with the read community
+// SNMP_COMMUNITY (lwipopts.h).  It serves only the MIB below, defined in
+// tools/JAM-MIB.txt; MIB-II is left out (see lwipopts.h).  Under
+// 1.3.6.1.4.1.SNMPMIB_ENTERPRISE.1:
+//
+//   .1  jamBoard      uptime, firmware version, telemetry records, XADC
+//                     alarm events and main loop stalls so far
+//   .2  jamXadcTable  latest result and extremes of each XADC channel
+//   .3  jamTelemTable min, max and mean of every channel in each record
+//                     still in the telemetry ring (telemetry.h)
+//   .4  jamSlotTable  flash slots (slots.h)
+//   .5  jamWatchTable register watches and their counts (wbwatch.h)
+//   .6  jamPoolTable  memp pool use, high-water marks and failures
+//   .7  jamNet        eth0 RX holds and drops, memp failures, reassembly
+//                     drops
+//   .8  jamCycleTable cycles spent in each layer of the stack
+//                     (LWIP_CYCLE_STATS)
+//   .9  jamTraps      traps sent and events coalesced (snmptrap.h)
+//   .10 jamEthTable   link state, counters and rates of each 10 GbE
+//                     core's data path (ethmon.h)
+//
+// Values are read from the live structures as the agent encodes each one,
+// so a response is not one snapshot.
+
+// IANA private enterprise number the MIB lives under, and whose .1 the
+// agent gives as its device OID in traps.  lwIP's own until the site
+// registers one.
+#ifndef SNMPMIB_ENTERPRISE
+#define SNMPMIB_ENTERPRISE (26381)
+#endif
+
+// The MIB's root, as a list of sub-identifiers
+#define SNMPMIB_OID     1, 3, 6, 1, 4, 1, SNMPMIB_ENTERPRISE, 1
+#define SNMPMIB_OID_LEN (8)
+
+// Start the agent.  Call after lwip_init().
+void init_snmpmib();
+
+#endif // _SNMPMIB_H_
@@ -0,0 +1,270 @@
+// snmptrap.c - SNMP traps for board health events (see snmptrap.h).
+//
+// Each class remembers the event count its last trap covered.  The poll
+// sends one when the count has moved and the class's holdoff has run out;
+// a trap that cannot be sent (no memory) leaves the count where it was,
+// so the events go in the next attempt, a holdoff later.
+
+#include <string.h>
+
+#include "lwip/apps/snmp.h"
+#include "lwip/tcp.h"
+#include "lwip/memp.h"
+
+#include "kv.h"
+#include "load.h"
+#include "sched.h"
+#include "snmpmib.h"
+#include "snmptrap.h"
+#include "throttle.h"
+#include "timebase.h"
+#include "timer.h"
+#include "xadc.h"
+
+#define TRAP_XADC  (0)
+#define TRAP_STALL (1)
+#define TRAP_POOL  (2)
+#define TRAP_THROTTLE (3)
+#define TRAP_LOAD  (4)
+#define NUM_TRAPS  (5)
+
+// Most varbinds in a trap
+#define TRAP_VARBINDS (4)
+
+struct trap_class {
+  // Event count the last trap covered, and timebase_ms() of the attempt
+  u32 seen;
+  u32 sent_ms;
+  u8 tried;
+};
+
+static struct trap_class classes[NUM_TRAPS];
+static u32 traps_sent;
+static u32 traps_coalesced;
+
+// Manager as stored, in network order (0 for none)
+static u32 dest;
+
+struct trap {
+  struct snmp_varbind vb[TRAP_VARBINDS];
+  u32_t value[TRAP_VARBINDS];
+  u8 n;
+};
+
+static const u32_t jam_oid[] = { SNMPMIB_OID };
+
+// Add the varbind SNMPMIB_OID.`sub` (`len` sub-identifiers) with `len`
+// bytes of `value` of ASN.1 type `type`
+static void
+trap_add(struct trap *t, const u32_t *sub, u8_t sub_len, u8_t type,
+    const void *value, u16_t len)
+{
+  struct snmp_varbind *vb = &t->vb[t->n];
+
+  memset(vb, 0, sizeof(*vb));
+  snmp_oid_combine(&vb->oid, jam_oid, LWIP_ARRAYSIZE(jam_oid), sub, sub_len);
+  vb->type = type;
+  vb->value = (void *)value;
+  vb->value_len = len;
+  if(t->n) {
+    vb->prev = &t->vb[t->n - 1];
+    vb->prev->next = vb;
+  }
+  t->n++;
+}
+
+static void
+trap_add_u32(struct trap *t, const u32_t *sub, u8_t sub_len, u8_t type,
+    u32 value)
+{
+  t->value[t->n] = value;
+  trap_add(t, sub, sub_len, type, &t->value[t->n], sizeof(u32_t));
+}
+
+// jamTrapEvents.0
+static const u32_t oid_events[] = { 9, 3, 0 };
+
+static void
+trap_xadc(struct trap *t)
+{
+  static const u32_t oid_status[] = { 9, 4, 0 }; // jamTrapStatus.0
+  static const u32_t oid_alarms[] = { 9, 5, 0 }; // jamTrapAlarms.0
+  static const u32_t oid_temp[] = { 2, 1, 2, XADC_TEMP + 1 }; // jamXadcValue
+  struct xadc_event ev;
+
+  if(xadc_event(xadc_event_count() - 1, &ev) == 0) {
+    trap_add_u32(t, oid_status, LWIP_ARRAYSIZE(oid_status),
+        SNMP_ASN1_TYPE_GAUGE, ev.status);
+    trap_add_u32(t, oid_alarms, LWIP_ARRAYSIZE(oid_alarms),
+        SNMP_ASN1_TYPE_GAUGE, ev.alarms);
+  }
+  trap_add_u32(t, oid_temp, LWIP_ARRAYSIZE(oid_temp),
+      SNMP_ASN1_TYPE_INTEGER, xadc_convert(XADC_TEMP, xadc_raw(XADC_TEMP)));
+}
+
+static void
+trap_stall(struct trap *t)
+{
+  static const u32_t oid_longest[] = { 1, 7, 0 }; // jamLongestPass.0
+  u32 longest_us;
+
+  sched_stalls(&longest_us);
+  trap_add_u32(t, oid_longest, LWIP_ARRAYSIZE(oid_longest),
+      SNMP_ASN1_TYPE_GAUGE, longest_us);
+}
+
+static void
+trap_pool(struct trap *t)
+{
+  u32_t oid_name[] = { 6, 1, 2, 0 };   // jamPoolName
+  u32_t oid_errors[] = { 6, 1, 6, 0 }; // jamPoolErrors
+  const struct memp_fail *f = memp_fail_get(memp_fail_count() - 1);
+  const struct memp_desc *d;
+
+  if(!f) {
+    return;
+  }
+  d = memp_pools[f->type];
+  oid_name[3] = oid_errors[3] = f->type + 1;
+  trap_add(t, oid_name, LWIP_ARRAYSIZE(oid_name), SNMP_ASN1_TYPE_OCTET_STRING,
+      d->desc, strlen(d->desc));
+  trap_add_u32(t, oid_errors, LWIP_ARRAYSIZE(oid_errors),
+      SNMP_ASN1_TYPE_COUNTER, d->stats->err);
+}
+
+static void
+trap_throttle(struct trap *t)
+{
+  static const u32_t oid_level[] = { 9, 6, 0 }; // jamTrapLevel.0
+  static const u32_t oid_temp[] = { 2, 1, 2, XADC_TEMP + 1 }; // jamXadcValue
+  struct throttle_event ev;
+
+  if(throttle_event(throttle_event_count() - 1, &ev) == 0) {
+    trap_add_u32(t, oid_level, LWIP_ARRAYSIZE(oid_level),
+        SNMP_ASN1_TYPE_GAUGE, ev.to);
+  }
+  trap_add_u32(t, oid_temp, LWIP_ARRAYSIZE(oid_temp),
+      SNMP_ASN1_TYPE_INTEGER, xadc_convert(XADC_TEMP, xadc_raw(XADC_TEMP)));
+}
+static void
+trap_load(struct trap *t)
+{
+  static const u32_t oid_load[] = { 1, 8, 0 }; // jamLoad.0
+
+  trap_add_u32(t, oid_load, LWIP_ARRAYSIZE(oid_load), SNMP_ASN1_TYPE_GAUGE,
+      load_stats()->load_pm);
+}
+
+// Events of class `n` so far
+static u32
+trap_count(u32 n)
+{
+  u32 longest_us;
+
+  switch(n) {
+  case TRAP_XADC:
+    return xadc_event_count();
+  case TRAP_STALL:
+    return sched_stalls(&longest_us);
+  case TRAP_THROTTLE:
+    return throttle_event_count();
+  case TRAP_LOAD:
+    return load_alert_count();
+  default:
+    return memp_fail_count();
+  }
+}
+
+static void
+trap_poll(void *arg)
+{
+  struct trap_class *c;
+  struct trap t;
+  u32 n, count, now = timebase_ms();
+
+  if(!dest) {
+    return;
+  }
+  for(n=0, c=classes; n<NUM_TRAPS; n++, c++) {
+    count = trap_count(n);
+    if(count == c->seen ||
+       (c->tried && now - c->sent_ms < SNMPTRAP_HOLDOFF_MS)) {
+      continue;
+    }
+    c->tried = 1;
+    c->sent_ms = now;
+
+    t.n = 0;
+    trap_add_u32(&t, oid_events, LWIP_ARRAYSIZE(oid_events),
+        SNMP_ASN1_TYPE_GAUGE, count - c->seen);
+    if(n == TRAP_XADC) {
+      trap_xadc(&t);
+    } else if(n == TRAP_STALL) {
+      trap_stall(&t);
+    } else if(n == TRAP_THROTTLE) {
+      trap_throttle(&t);
+    } else if(n == TRAP_LOAD) {
+      trap_load(&t);
+    } else {
+      trap_pool(&t);
+    }
+    if(snmp_send_trap_specific(n + 1, t.vb) != ERR_OK) {
+      continue;
+    }
+    traps_sent++;
+    traps_coalesced += count - c->seen - 1;
+    c->seen = count;
+  }
+}
+
+static struct timer poll_timer = TIMER_INIT(trap_poll, NULL);
+
+static struct kv_save save = KV_SAVE_INIT(save, KV_KEY_SNMP_TRAP);
+
+// Point the agent's one trap destination at `dest`
+static void
+snmptrap_apply()
+{
+  ip4_addr_t ip;
+
+  ip4_addr_set_u32(&ip, dest);
+  snmp_trap_dst_ip_set(0, &ip);
+  snmp_trap_dst_enable(0, dest != 0);
+}
+
+void
+snmptrap_set_dest(const ip4_addr_t *ip)
+{
+  u32 n;
+
+  dest = ip ? ip4_addr_get_u32(ip) : 0;
+  snmptrap_apply();
+  // Only events from here on are news to the new manager
+  for(n=0; n<NUM_TRAPS; n++) {
+    classes[n].seen = trap_count(n);
+  }
+  kv_save(&save, &dest, dest ? sizeof(dest) : 0);
+}
+
+void
+snmptrap_get_dest(ip4_addr_t *ip)
+{
+  ip4_addr_set_u32(ip, dest);
+}
+
+u32
+snmptrap_counts(u32 *coalesced)
+{
+  *coalesced = traps_coalesced;
+  return traps_sent;
+}
+
+void
+init_snmptrap()
+{
+  if(kv_get(KV_KEY_SNMP_TRAP, &dest, sizeof(dest)) != sizeof(dest)) {
+    dest = 0;
+  }
+  snmptrap_apply();
+  timer_start(&poll_timer, SNMPTRAP_POLL_MS, SNMPTRAP_POLL_MS);
+}
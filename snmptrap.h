@@ -0,0 +1,45 @@
+#ifndef _SNMPTRAP_H_
+#define _SNMPTRAP_H_
+
+// snmptrap.h - SNMP traps for board health events (see snmpmib.h).
+//
+// SNMPv1 enterprise-specific traps go to one manager, whose address is
+// kept in KV_KEY_SNMP_TRAP (see kv.h) and set with KATCP's ?snmp-trap
+// (see katcp.h).  Their specific codes are the notifications jam.0.n of
+// tools/JAM-MIB.txt:
+//
+//   1  jamXadcAlarm     XADC alarm interrupts (xadc.h)
+//   2  jamStall         main loop stalls (SCHED_STALL_MS, sched.h)
+//   3  jamPoolExhausted memp pool allocations that failed
+//   4  jamThrottle      thermal throttling level changes (throttle.h)
+//   5  jamOverload      CPU load alerts (load.h)
+//
+// The event counts are polled every SNMPTRAP_POLL_MS rather than hooked,
+// so an alarm storm costs nothing past its interrupts.  Each class sends
+// at most one trap every SNMPTRAP_HOLDOFF_MS; events meanwhile are
+// coalesced into the next, which carries how many it stands for
+// (jamTrapEvents) and the details of the latest.
+
+#include "lwip/ip4_addr.h"
+
+#include "xil_types.h"
+
+#define SNMPTRAP_POLL_MS    (100)
+#define SNMPTRAP_HOLDOFF_MS (1000)
+
+// Load the saved manager and start polling.  Call after init_snmpmib()
+// and init_kv().
+void init_snmptrap();
+
+// Send traps to `ip`, or to nobody if it is NULL or any.  Takes effect at
+// once and is saved in the background.
+void snmptrap_set_dest(const ip4_addr_t *ip);
+
+// The manager traps go to, any if none
+void snmptrap_get_dest(ip4_addr_t *ip);
+
+// Traps sent so far, and in `coalesced` the events folded into another
+// event's trap
+u32 snmptrap_counts(u32 *coalesced);
+
+#endif // _SNMPTRAP_H_
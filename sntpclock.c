@@ -0,0 +1,341 @@
+// sntpclock.c - Wall-clock time from SNTP (see sntpclock.h).
+//
+// The clock is the line through the last sample at the current rate.  A
+// new sample's error against that line, over the cycles since the last,
+// is the rate's error; a fraction of it goes into the rate, and the line
+// moves to the new sample.  A PPS edge moves the line to itself, and the
+// rate towards the second it measured.  The capture interrupt only notes
+// the edge's cycles; pps_work, from the main loop, does the divisions.
+
+#include "lwip/apps/sntp.h"
+
+#include "intr.h"
+#include "kv.h"
+#include "log.h"
+#include "sntpclock.h"
+#include "timebase.h"
+#include "wbmap.h"
+#include "wbshadow.h"
+#include "work.h"
+
+// Furthest from TIMEBASE_HZ cycles a second between edges may be
+#define PPS_SLACK (TIMEBASE_HZ >> 11)
+
+// Fraction bits of the line's time, which the rate's product leaves once
+// shifted to microseconds: 62.5 ns steps
+#define FRAC_BITS (4)
+
+// One ppb of drift in the rate's units, in 2^-16
+#define PPB_SCALE ((u32)(((u64)SNTPCLOCK_NOMINAL << 16) / 1000000000))
+
+static u8 synced;
+static u64 base_cycles;
+// UTC at base_cycles, in 2^-FRAC_BITS us
+static u64 base_utc;
+// Microseconds per cycle, in 2^-SNTPCLOCK_SHIFT
+static u32 rate = SNTPCLOCK_NOMINAL;
+// timebase_ms() of the last sntpclock_steer()
+static u8 steered;
+static u32 steer_ms;
+
+static struct sntpclock_stats stats;
+
+// Server as stored, in network order (0 for none)
+static u32 server;
+
+// Cycles of the last edge, as captured, and of the one before it
+static volatile u64 pps_edge;
+static u64 pps_last;
+static u8 pps_have_last;
+// timebase_ms() of the last edge the clock followed
+static u32 pps_ms;
+static const struct wbmap_entry *pps_dev;
+
+static int
+pps_locked()
+{
+  return stats.pps_locked &&
+      timebase_ms() - pps_ms < SNTPCLOCK_PPS_TIMEOUT_MS;
+}
+
+// SNTP defers to another source steering the clock, as to the PPS
+static int
+disciplined()
+{
+  return pps_locked() ||
+      (steered && timebase_ms() - steer_ms < SNTPCLOCK_STEER_TIMEOUT_MS);
+}
+
+// UTC at `cycles`, in 2^-FRAC_BITS us
+static u64
+line(u64 cycles)
+{
+  u64 c, lo, hi;
+
+  // c * rate >> (SNTPCLOCK_SHIFT - FRAC_BITS), from the two halves of c
+  c = cycles - base_cycles;
+  lo = (u64)(u32)c * rate;
+  hi = (u64)(u32)(c >> 32) * rate;
+  return base_utc + ((hi + (lo >> 32)) >> (SNTPCLOCK_SHIFT - 32 - FRAC_BITS));
+}
+
+u64
+sntpclock_utc_us(u64 cycles)
+{
+  return synced ? line(cycles) >> FRAC_BITS : 0;
+}
+
+u64
+sntpclock_utc_ns(u64 cycles)
+{
+  u64 t;
+
+  if(!synced) {
+    return 0;
+  }
+  t = line(cycles);
+  return (t >> FRAC_BITS) * 1000 +
+      (((u32)t & ((1 << FRAC_BITS) - 1)) * 1000 >> FRAC_BITS);
+}
+
+u64
+sntpclock_cycles(u64 utc_ns)
+{
+  u64 t, dt;
+
+  if(!synced) {
+    return 0;
+  }
+  // In 2^-FRAC_BITS us; dt / rate is whole 2^32 cycles
+  t = (utc_ns / 1000 << FRAC_BITS) + ((utc_ns % 1000) << FRAC_BITS) / 1000;
+  if(t < base_utc) {
+    return base_cycles;
+  }
+  dt = t - base_utc;
+  return base_cycles + ((dt / rate) << 32) + ((dt % rate) << 32) / rate;
+}
+
+int
+sntpclock_step(u64 cycles, u64 utc_ns)
+{
+  u64 us = utc_ns / 1000;
+
+  if(pps_locked()) {
+    return -1;
+  }
+  if(synced) {
+    LOG("sntpclock: stepped %d us", (s32)(us - sntpclock_utc_us(cycles)));
+  }
+  stats.steps++;
+  stats.pps_locked = 0;
+  synced = 1;
+  base_cycles = cycles;
+  base_utc = (us << FRAC_BITS) +
+      ((u32)(utc_ns - us * 1000) << FRAC_BITS) / 1000;
+  return 0;
+}
+
+int
+sntpclock_steer(u64 cycles, s32 drift_ppb)
+{
+  u32 mag = drift_ppb < 0 ? -drift_ppb : drift_ppb;
+  u32 adj;
+
+  if(!synced || pps_locked()) {
+    return -1;
+  }
+  if(mag > SNTPCLOCK_MAX_DRIFT_PPB) {
+    mag = SNTPCLOCK_MAX_DRIFT_PPB;
+  }
+  adj = (u64)mag * PPB_SCALE >> 16;
+  // Through the point the line is at now, so the time does not jump
+  base_utc = line(cycles);
+  base_cycles = cycles;
+  rate = drift_ppb < 0 ? SNTPCLOCK_NOMINAL + adj : SNTPCLOCK_NOMINAL - adj;
+  steered = 1;
+  steer_ms = timebase_ms();
+  return 0;
+}
+
+u64
+now_utc_us()
+{
+  return sntpclock_utc_us(timebase_cycles());
+}
+
+void
+sntpclock_stats(struct sntpclock_stats *s)
+{
+  *s = stats;
+  s->pps_locked = pps_locked();
+  s->drift_ppb = (s64)(s32)(SNTPCLOCK_NOMINAL - rate) * 1000000000 /
+      SNTPCLOCK_NOMINAL;
+}
+
+// Pull the rate towards the one that would have predicted `err_us` over
+// `dt` cycles
+static void
+sntpclock_adjust(s32 err_us, u64 dt)
+{
+  u32 mag = err_us < 0 ? -err_us : err_us;
+  u32 adj = ((u64)mag << SNTPCLOCK_SHIFT) / dt >> SNTPCLOCK_GAIN_SHIFT;
+  u32 lo = SNTPCLOCK_NOMINAL - SNTPCLOCK_MAX_DRIFT;
+  u32 hi = SNTPCLOCK_NOMINAL + SNTPCLOCK_MAX_DRIFT;
+
+  rate = err_us < 0 ? rate - adj : rate + adj;
+  if(rate < lo) {
+    rate = lo;
+  } else if(rate > hi) {
+    rate = hi;
+  }
+}
+
+void
+sntpclock_set(u32 sec, u32 us)
+{
+  u64 cycles = timebase_cycles();
+  u64 utc = (u64)sec * 1000000 + us;
+  u64 dt = cycles - base_cycles;
+  s64 err = utc - sntpclock_utc_us(cycles);
+
+  stats.syncs++;
+  stats.last_ms = timebase_ms();
+  if(disciplined() && err < 500000 && err > -500000) {
+    // The PPS or PTP keeps the time; SNTP only names its seconds
+    stats.offset_us = err;
+    return;
+  }
+  if(!synced || err > SNTPCLOCK_STEP_US || err < -SNTPCLOCK_STEP_US) {
+    if(synced) {
+      LOG("sntpclock: stepped %d ms", (s32)(err / 1000));
+    }
+    stats.steps++;
+    stats.offset_us = 0;
+    // The next edge's second is named afresh
+    stats.pps_locked = 0;
+  } else if(dt < (u64)SNTPCLOCK_MIN_INTERVAL_MS * TIMEBASE_CYCLES_PER_MS) {
+    // Only the offset: keep the older base, so that the next sample's
+    // interval is long enough to measure the rate over
+    stats.offset_us = err;
+    return;
+  } else {
+    stats.offset_us = err;
+    sntpclock_adjust(err, dt);
+  }
+  synced = 1;
+  base_cycles = cycles;
+  base_utc = utc << FRAC_BITS;
+}
+
+// Follow the edge pps_edge
+static void
+sntpclock_pps(void *arg)
+{
+  u32 msr = intr_lock();
+  u64 cycles = pps_edge;
+  u64 dt, utc, sec;
+  u32 measured, predicted;
+
+  intr_unlock(msr);
+  dt = cycles - pps_last;
+  stats.pps_edges++;
+  pps_last = cycles;
+  // A missed or spurious edge starts the lock over
+  if(!pps_have_last || dt < TIMEBASE_HZ - PPS_SLACK ||
+     dt > TIMEBASE_HZ + PPS_SLACK) {
+    pps_have_last = 1;
+    stats.pps_locked = 0;
+    return;
+  }
+  stats.pps_cycles = dt;
+  if(!synced) {
+    // No second to name it with yet
+    return;
+  }
+
+  measured = ((u64)1000000 << SNTPCLOCK_SHIFT) / dt;
+  if(pps_locked()) {
+    // A second after the last edge; the clock put it `predicted` cycles on
+    predicted = ((u64)1000000 << SNTPCLOCK_SHIFT) / rate;
+    stats.pps_offset_ns = (s32)(predicted - (u32)dt) * 1000 /
+        TIMEBASE_CYCLES_PER_US;
+    if(measured > rate) {
+      rate += (measured - rate) >> SNTPCLOCK_PPS_GAIN_SHIFT;
+    } else {
+      rate -= (rate - measured) >> SNTPCLOCK_PPS_GAIN_SHIFT;
+    }
+    sec = (base_utc >> FRAC_BITS) + 1000000;
+  } else {
+    utc = sntpclock_utc_us(cycles);
+    sec = (utc + 500000) / 1000000 * 1000000;
+    stats.pps_offset_ns = (s32)(sec - utc) * 1000;
+    rate = measured;
+    LOG("sntpclock: locked to PPS, %d us off", (s32)(sec - utc));
+  }
+  base_cycles = cycles;
+  base_utc = sec << FRAC_BITS;
+  pps_ms = timebase_ms();
+  stats.pps_locked = 1;
+
+  if(pps_dev) {
+    wbshadow_write(pps_dev->offset, (u32)(sec / 1000000) + 1);
+    wbshadow_write(pps_dev->offset + 4, (u32)dt);
+  }
+}
+
+static struct work pps_work = WORK_INIT(sntpclock_pps, NULL);
+
+// From the timer interrupt
+static void
+pps_capture(u64 cycles)
+{
+  pps_edge = cycles;
+  work_schedule(&pps_work);
+}
+
+static struct kv_save save = KV_SAVE_INIT(save, KV_KEY_SNTP);
+
+// Restart the client on `server`: the first request goes out at once
+static void
+sntpclock_apply()
+{
+  ip_addr_t ip;
+
+  sntp_stop();
+  ip_addr_set_ip4_u32(&ip, server);
+  sntp_setserver(0, &ip);
+  if(server) {
+    sntp_init();
+  }
+}
+
+void
+sntpclock_set_server(const ip4_addr_t *ip)
+{
+  server = ip ? ip4_addr_get_u32(ip) : 0;
+  sntpclock_apply();
+  kv_save(&save, &server, server ? sizeof(server) : 0);
+}
+
+void
+sntpclock_get_server(ip4_addr_t *ip)
+{
+  ip4_addr_set_u32(ip, server);
+}
+
+void
+init_sntpclock()
+{
+  if(kv_get(KV_KEY_SNTP, &server, sizeof(server)) != sizeof(server)) {
+    server = 0;
+  }
+  sntp_setoperatingmode(SNTP_OPMODE_POLL);
+  sntpclock_apply();
+
+  pps_dev = wbmap_find(SNTPCLOCK_DEV);
+  if(pps_dev && (pps_dev->size < 8 || !(pps_dev->mode & WBMAP_MODE_W))) {
+    LOG("sntpclock: device %s unusable", SNTPCLOCK_DEV);
+    pps_dev = NULL;
+  }
+  timebase_on_capture(pps_capture);
+}
@@ -0,0 +1,145 @@
+#ifndef _SNTPCLOCK_H_
+#define _SNTPCLOCK_H_
+
+// sntpclock.h - Wall-clock time from SNTP, on the timebase (timebase.h).
+//
+// lwIP's SNTP client polls one server every SNTP_UPDATE_DELAY (lwipopts.h).
+// The server is kept in KV_KEY_SNTP (see kv.h) and set with KATCP's ?sntp
+// (see katcp.h).  Each reply is a (UTC, timebase_cycles()) sample; between
+// samples UTC is interpolated from the timebase at a rate that tracks the
+// timer crystal's drift against the server.
+//
+// The interpolation is a base, a cycle count and a fixed-point rate of
+// microseconds per cycle, so reading the time costs two 32 x 32 bit
+// multiplies and no division.  Divisions happen once per sample.
+//
+// SNTP takes the server's transmit time as the time of arrival, so the
+// clock runs late by the one-way delay to the server, and a reply queued
+// in the stack adds its queueing time to that sample's error.
+//
+// A 1PPS routed to the timer's capture input (timebase.h) does far
+// better.  Each edge is timestamped to the timer cycle; SNTP only names
+// the second, so it must be within half a second.  Once two edges have
+// come a second apart (to within SNTPCLOCK_MAX_DRIFT), every edge moves
+// the line's base to the whole second it marks and the rate to the one
+// the last second measured, and SNTP samples no longer steer the clock
+// while edges keep coming.  Time then tracks the PPS to well under a
+// microsecond.  The gateware's timestamp registers, if the register map
+// has a SNTPCLOCK_DEV device, get the UTC second of the next edge and the
+// cycles the last second took after each edge, so that gateware loading
+// its own counter on the PPS agrees with the firmware across the array.
+
+#include "lwip/ip4_addr.h"
+
+#include "xil_types.h"
+
+#include "timebase.h"
+
+// Fraction bits of the rate, in microseconds per timer cycle.  At 100 MHz
+// one step of it is 1.5 ppb.
+#define SNTPCLOCK_SHIFT     (36)
+
+// A sample further than this from the interpolated time steps the clock
+// to it, leaving the rate alone
+#define SNTPCLOCK_STEP_US   (100000)
+
+// Samples closer together than this only correct the offset: over a short
+// interval the server's jitter swamps the drift
+#define SNTPCLOCK_MIN_INTERVAL_MS (15000)
+
+// Each sample corrects the rate by 1 / 2^SNTPCLOCK_GAIN_SHIFT of the
+// error it shows, averaging out jitter
+#define SNTPCLOCK_GAIN_SHIFT (2)
+
+// Furthest the rate may be pulled from nominal, in 2^-SNTPCLOCK_SHIFT: a
+// crystal worse than about 500 ppm is broken
+#define SNTPCLOCK_MAX_DRIFT (SNTPCLOCK_NOMINAL >> 11)
+#define SNTPCLOCK_MAX_DRIFT_PPB (488281)
+
+// sntpclock_steer() keeps SNTP from steering the clock for this long
+#define SNTPCLOCK_STEER_TIMEOUT_MS (10000)
+
+// Nominal rate of a perfect timer crystal
+#define SNTPCLOCK_NOMINAL \
+  ((u32)((1000000ULL << SNTPCLOCK_SHIFT) / TIMEBASE_HZ))
+
+// Edges a second apart lock the clock to the PPS until none has come in
+// this long
+#define SNTPCLOCK_PPS_TIMEOUT_MS (2500)
+
+// Each edge averages 1 / 2^SNTPCLOCK_PPS_GAIN_SHIFT of the second it
+// measured into the rate, smoothing the capture's one-cycle jitter
+#define SNTPCLOCK_PPS_GAIN_SHIFT (2)
+
+// Gateware timestamp registers (wbmap.h): word 0 the UTC second of the
+// next PPS edge, word 1 the timer cycles of the last second
+#define SNTPCLOCK_DEV "timestamp"
+
+struct sntpclock_stats {
+  // Samples taken, and those that stepped the clock
+  u32 syncs;
+  u32 steps;
+  // timebase_ms() of the last sample
+  u32 last_ms;
+  // Last sample minus the interpolated time, in microseconds
+  s32 offset_us;
+  // Timer crystal's drift the rate corrects, in parts per billion (fast
+  // positive)
+  s32 drift_ppb;
+  // PPS edges seen, whether the clock follows them, the timer cycles of
+  // the last second and the last edge's offset from the clock, in ns
+  u32 pps_edges;
+  u8 pps_locked;
+  u32 pps_cycles;
+  s32 pps_offset_ns;
+};
+
+// Load the saved server and start polling it, and follow the PPS.  Call
+// after lwip_init(), init_kv() and init_timebase().
+void init_sntpclock();
+
+// Poll `ip` for the time, or nothing if it is NULL or any.  Takes effect
+// at once and is saved in the background.  The clock keeps running on its
+// last rate while no server answers.
+void sntpclock_set_server(const ip4_addr_t *ip);
+
+// The server polled, any if none
+void sntpclock_get_server(ip4_addr_t *ip);
+
+// Microseconds since 1970-01-01 00:00 UTC at timebase_cycles() `cycles`,
+// or 0 before the first sample.  `cycles` should be no earlier than the
+// last sample.
+u64 sntpclock_utc_us(u64 cycles);
+
+// As sntpclock_utc_us(), in nanoseconds, to 62.5 ns
+u64 sntpclock_utc_ns(u64 cycles);
+
+// The other way round: timebase_cycles() at `utc_ns` nanoseconds since
+// 1970 UTC, on the clock's line as it is now, or 0 before the first sample.
+// A time before the last sample maps to the sample.  Divides, unlike the
+// others.
+u64 sntpclock_cycles(u64 utc_ns);
+
+// Microseconds since 1970-01-01 00:00 UTC now, or 0 before the first
+// sample
+u64 now_utc_us();
+
+// Set the clock to `utc_ns` nanoseconds since 1970 UTC at timebase_cycles()
+// `cycles`, for another time source (ptp.h).  Returns 0, or -1 while the
+// PPS keeps the time.
+int sntpclock_step(u64 cycles, u64 utc_ns);
+
+// Run the clock on from `cycles` on, where it is now, at the rate that
+// corrects a timer crystal drift of `drift_ppb` (fast positive), for
+// another time source's servo.  SNTP stops steering the clock until no
+// call has come for SNTPCLOCK_STEER_TIMEOUT_MS.  Returns 0, or -1 before
+// the first sample or while the PPS keeps the time.
+int sntpclock_steer(u64 cycles, s32 drift_ppb);
+
+void sntpclock_stats(struct sntpclock_stats *s);
+
+// Take a sample of `sec` seconds and `us` microseconds since 1970 UTC,
+// now.  lwIP's SNTP client calls this (SNTP_SET_SYSTEM_TIME_US).
+void sntpclock_set(u32 sec, u32 us);
+
+#endif // _SNTPCLOCK_H_
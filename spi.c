@@ -1,9 +1,14 @@
-// spi.c - Use SPI core to access flash.
+// spi.c - Use SPI core to access flash and the other slaves on it.
 
 #include "xparameters.h"
 #include "xspi.h"
 
+#include "intr.h"
+#include "log.h"
+#include "perf.h"
 #include "spi.h"
+#include "timebase.h"
+#include "work.h"
 
 // Missing macros
 #ifndef XSpi_GetTFOcyReg
@@ -23,8 +28,73 @@
 #define XSpi_IntrClear(InstancePtr, ClearMask) \
   XSpi_WriteReg(((InstancePtr)->BaseAddr),  XSP_IISR_OFFSET, (ClearMask))
 
+// Depth of the TX and RX fifos
+#define SPI_FIFO_DEPTH XPAR_SPI_0_FIFO_DEPTH
+
+// Polls of an empty rx fifo before giving up on a transfer
+#define SPI_RX_TIMEOUT (1000)
+
+// Interrupts used by asynchronous transfers
+#define SPI_ASYNC_INTRS (XSP_INTR_TX_EMPTY_MASK | XSP_INTR_TX_HALF_EMPTY_MASK)
+
+// Faults the core latches in its interrupt status, which spi_check() counts
+#define SPI_FAULTS (XSP_INTR_MODE_FAULT_MASK | XSP_INTR_RX_OVERRUN_MASK)
+
+// Control register bits a device sets (spi.h's SPI_CPOL and the rest)
+#define SPI_MODE_MASK (XSP_CR_CLK_POLARITY_MASK | XSP_CR_CLK_PHASE_MASK | \
+    XSP_CR_LSB_MSB_FIRST_MASK)
+
+// The core's registers, at their address in xparameters.h.  Everything
+// past init_spi() goes through these rather than the XSpi macros, which
+// load the address from xspi on each access; XSpi only sets the core up
+// and dumps it.
+#define SPI_BASE XPAR_SPI_0_BASEADDR
+
+static inline u32
+spi_reg(u32 off)
+{
+  return XSpi_ReadReg(SPI_BASE, off);
+}
+
+static inline void
+spi_set_reg(u32 off, u32 val)
+{
+  XSpi_WriteReg(SPI_BASE, off, val);
+}
+
 static XSpi xspi;
 
+const struct spi_dev spi_flash = { 0x1, 0 };
+
+struct spi_stats spi_stats;
+
+// Device of the open transaction, or of the last one
+static const struct spi_dev *cur_dev = &spi_flash;
+
+// Status of the last synchronous transfer, and timebase_cycles() when the
+// asynchronous queue last became non-empty
+static int spi_err;
+static u64 queue_start;
+
+// Asynchronous transfers.  The head of the queue is on the wire; completed
+// transfers move to the done list until done_work runs their callbacks.
+static struct spi_xfer *xfer_head;
+static struct spi_xfer *xfer_tail;
+static u32 xfer_tx; // bytes of xfer_head written to the tx fifo
+static u32 xfer_rx; // bytes of xfer_head read from the rx fifo
+// Times a polling xfer_head has been sent, and whether the queue waits for
+// poll_work to send it again
+static u32 xfer_polls;
+static u8 xfer_paused;
+static struct spi_xfer *done_head;
+static struct spi_xfer *done_tail;
+
+static void spi_isr(void *ref);
+static void spi_done_work(void *arg);
+static struct work done_work = WORK_INIT(spi_done_work, NULL);
+static void spi_poll_work(void *arg);
+static struct work poll_work = WORK_INIT(spi_poll_work, NULL);
+
 void
 init_spi()
 {
@@ -47,12 +117,142 @@ init_spi()
         XSP_CR_TXFIFO_RESET_MASK  |
         XSP_CR_RXFIFO_RESET_MASK);
 
-    // Ensure interrupt generation is disabled and just use polling
+    // Interrupt generation is only enabled while asynchronous transfers are
+    // queued; send_spi() polls
     XSpi_IntrGlobalDisable(&xspi);
+    XSpi_IntrDisable(&xspi, XSP_INTR_ALL);
+    intr_connect_fast(XPAR_INTC_0_SPI_0_VEC_ID, spi_isr, NULL);
+}
+
+static void spi_close();
+
+// Start a transaction with `dev` (NULL for spi_flash) unless one is already
+// open with it
+static void
+spi_open(const struct spi_dev *dev)
+{
+  u16 control_reg = spi_reg(XSP_CR_OFFSET);
+
+  if(!dev) {
+    dev = &spi_flash;
+  }
+  // A transaction left open for another device ends here
+  if((control_reg & XSP_CR_ENABLE_MASK) && dev != cur_dev) {
+    spi_close();
+    control_reg = spi_reg(XSP_CR_OFFSET);
+  }
+  if(!(control_reg & XSP_CR_ENABLE_MASK)) {
+    // Reset fifos and set the clock mode while deselected
+    control_reg &= ~SPI_MODE_MASK;
+    control_reg |= (dev->mode & SPI_MODE_MASK) |
+        XSP_CR_TXFIFO_RESET_MASK | XSP_CR_RXFIFO_RESET_MASK;
+    spi_set_reg(XSP_CR_OFFSET, control_reg);
+
+    // Enable (take pins out of tri-state and allow master transactions)
+    spi_set_reg(XSP_CR_OFFSET, (spi_reg(XSP_CR_OFFSET) |
+        XSP_CR_ENABLE_MASK) & ~XSP_CR_TRANS_INHIBIT_MASK);
+
+    // Select slave
+    spi_set_reg(XSP_SSR_OFFSET, ~dev->ss);
+    cur_dev = dev;
+  }
+}
+
+// Count and clear the faults latched since the last check.  Returns SPI_OK
+// or the error they mean.
+static int
+spi_check()
+{
+  u32 st = spi_reg(XSP_IISR_OFFSET) & SPI_FAULTS;
+
+  if(!st) {
+    return SPI_OK;
+  }
+  spi_set_reg(XSP_IISR_OFFSET, st);
+  if(st & XSP_INTR_RX_OVERRUN_MASK) {
+    spi_stats.overruns++;
+  }
+  if(st & XSP_INTR_MODE_FAULT_MASK) {
+    spi_stats.mode_faults++;
+    return SPI_EMODF;
+  }
+  return SPI_EOVERRUN;
+}
+
+// Account for a synchronous transfer begun at `start` that ended with
+// `err`.  Returns SPI_OK or the error it ended with.
+static int
+spi_end(u64 start, int err)
+{
+  spi_stats.busy_cycles += timebase_cycles() - start;
+  if(err == SPI_OK) {
+    err = spi_check();
+  } else {
+    spi_check();
+  }
+  if(err == SPI_ETIMEDOUT) {
+    spi_stats.timeouts++;
+    LOG("spi: rx fifo empty for %u polls", SPI_RX_TIMEOUT);
+  }
+  spi_err = err;
+  return err;
+}
+
+// Close the current transaction
+static void
+spi_close()
+{
+  // De-select slave
+  spi_set_reg(XSP_SSR_OFFSET, ~0);
+
+  // Disable (tri-state pins)
+  spi_set_reg(XSP_CR_OFFSET, spi_reg(XSP_CR_OFFSET) & ~XSP_CR_ENABLE_MASK);
+  spi_stats.xfers++;
+}
+
+// Write up to `n` bytes from `src` to the tx fifo without getting more than a
+// fifo's worth ahead of the rx side (`in_flight` is the number of bytes
+// written but not yet read back), so the rx fifo can never overflow.
+//
+// Returns the number of bytes written.
+static u32
+spi_fill(const u8 *src, u32 n, u32 in_flight)
+{
+  u32 room = SPI_FIFO_DEPTH - in_flight;
+  u32 i;
+
+  if(n > room) {
+    n = room;
+  }
+  for(i=0; i<n; i++) {
+    spi_set_reg(XSP_DTR_OFFSET, src[i]);
+  }
+  spi_stats.bytes += n;
+  return n;
+}
+
+// Read everything waiting in the rx fifo into `dst`.
+//
+// Returns the number of bytes read.
+static u32
+spi_drain(u8 *dst)
+{
+  u32 i, n;
+
+  if(spi_reg(XSP_SR_OFFSET) & XSP_SR_RX_EMPTY_MASK) {
+    return 0;
+  }
+  // Occupancy register holds count - 1
+  n = spi_reg(XSP_RFO_OFFSET) + 1;
+  for(i=0; i<n; i++) {
+    dst[i] = spi_reg(XSP_DRR_OFFSET) & 0xff;
+  }
+  return n;
 }
 
 // SPI transaction function
 //
+// `dev` is the device addressed
 // `src` is pointer to buffer to send
 // `dst` is pointer to buffer into which received byts are stored
 //       can be equal to `src` to do an "in-place" transaction
@@ -60,79 +260,344 @@ init_spi()
 // `opt` is bitmask of option flags
 //       SEND_SPI_MORE leaves the transaction open
 //
-// Returns `len` on success; less than `len` on error.
+// Returns `len` on success; less than `len` on error (0 while asynchronous
+// transfers are queued), with the reason from spi_error().
+u32
+send_spi_dev(const struct spi_dev *dev, u8 *src, u8 *dst, u32 len, u32 opt)
+{
+  u32 tx_remaining = len;
+  u32 rx_remaining = len;
+  u32 n;
+  int idle = 0;
+  u64 start;
+
+  // The core belongs to the asynchronous queue until it drains
+  if(xfer_head) {
+    spi_err = SPI_EBUSY;
+    return 0;
+  }
+  PERF_BEGIN(PERF_SPI);
+  start = timebase_cycles();
+
+  spi_open(dev);
+
+  // Keep the tx fifo topped up while draining the rx fifo so SCK never stops
+  // mid-transfer.  Since src stays ahead of dst, in-place transactions still
+  // work.
+  while(rx_remaining > 0) {
+    n = spi_fill(src, tx_remaining, rx_remaining - tx_remaining);
+    src += n;
+    tx_remaining -= n;
+
+    n = spi_drain(dst);
+    if(n == 0) {
+      // If "timed out", close the transaction so the next one starts clean
+      if(++idle == SPI_RX_TIMEOUT) {
+        spi_close();
+        spi_end(start, SPI_ETIMEDOUT);
+        return len - rx_remaining;
+      }
+      continue;
+    }
+    idle = 0;
+    dst += n;
+    rx_remaining -= n;
+  }
+
+  // If not doing more, close transaction
+  if(!(opt & SEND_SPI_MORE)) {
+    spi_close();
+  }
+
+  PERF_END(PERF_SPI);
+  if(spi_end(start, SPI_OK) != SPI_OK) {
+    // Close what SEND_SPI_MORE left open
+    if(opt & SEND_SPI_MORE) {
+      spi_close();
+    }
+    return 0;
+  }
+  return len;
+}
+
+// send_spi_dev() to the flash
 u32
 send_spi(u8 *src, u8 *dst, u32 len, u32 opt)
 {
-  int i;
-  u8  bytes_to_xfer; // send in chunks of 16
-  u32 bytes_remaining = len;
-  u16 control_reg = XSpi_GetControlReg(&xspi);
+  return send_spi_dev(&spi_flash, src, dst, len, opt);
+}
 
-  // If not already enabled, start a new transaction
-  if(!(control_reg & XSP_CR_ENABLE_MASK)) {
-    // Reset fifos
-		control_reg |= (XSP_CR_TXFIFO_RESET_MASK | XSP_CR_RXFIFO_RESET_MASK);
-    XSpi_SetControlReg(&xspi, control_reg);
+// Receive-only SPI transaction with the flash
+//
+// Clocks out `len` idle (0xff) bytes and hands the received data to `sink`
+// as each burst leaves the rx fifo, so nothing larger than one fifo's worth
+// is buffered.  `opt` is as for send_spi().
+//
+// Returns `len` on success; less than `len` on error (0 while asynchronous
+// transfers are queued), with the reason from spi_error().
+u32
+recv_spi(u32 len, u32 opt, spi_sink_fn sink, void *arg)
+{
+  static const u8 idle_bytes[SPI_FIFO_DEPTH] = {
+    [0 ... SPI_FIFO_DEPTH-1] = 0xff
+  };
+  u8 burst[SPI_FIFO_DEPTH];
+  u32 tx_remaining = len;
+  u32 rx_remaining = len;
+  u32 n;
+  int idle = 0;
+  u64 start;
 
-    // Enable (take pins out of tri-state and allow master transactions)
-    XSpi_Enable(&xspi);
+  if(xfer_head) {
+    spi_err = SPI_EBUSY;
+    return 0;
+  }
+  start = timebase_cycles();
+
+  spi_open(&spi_flash);
 
-    // Select slave.  Be sure to use the "...Reg()" form of the setter since we
-    // are not using the higher level XSpi functions.
-    XSpi_SetSlaveSelectReg(&xspi, ~1);
+  while(rx_remaining > 0) {
+    tx_remaining -= spi_fill(idle_bytes, tx_remaining,
+        rx_remaining - tx_remaining);
+
+    n = spi_drain(burst);
+    if(n == 0) {
+      if(++idle == SPI_RX_TIMEOUT) {
+        spi_close();
+        spi_end(start, SPI_ETIMEDOUT);
+        return len - rx_remaining;
+      }
+      continue;
+    }
+    idle = 0;
+    sink(burst, n, arg);
+    rx_remaining -= n;
   }
 
-  // Send until done
-  while(bytes_remaining > 0) {
-    // Send data in chunks up to 16 bytes (FIFO depth) long
-    bytes_to_xfer = bytes_remaining < 16 ? bytes_remaining : 16;
+  if(!(opt & SEND_SPI_MORE)) {
+    spi_close();
+  }
 
-    // Write data to tx fifo
-    for(i=0; i < bytes_to_xfer; i++) {
-      // Post-increment src
-      XSpi_WriteReg(xspi.BaseAddr, XSP_DTR_OFFSET, *src++);
+  if(spi_end(start, SPI_OK) != SPI_OK) {
+    if(opt & SEND_SPI_MORE) {
+      spi_close();
     }
+    return 0;
+  }
+  return len;
+}
+
+int
+spi_error()
+{
+  return spi_err;
+}
+
+// Move xfer_head to the done list with `err` and make the next transfer
+// current
+static void
+spi_complete(int err)
+{
+  struct spi_xfer *x = xfer_head;
+
+  if(err == SPI_OK) {
+    err = spi_check();
+  }
+  if(err == SPI_ETIMEDOUT) {
+    spi_stats.timeouts++;
+  }
+  // A fault may have cost bytes that were counted
+  x->count = err == SPI_OK || err == SPI_ETIMEDOUT ? xfer_rx : 0;
+  x->err = err;
+  // Close the transaction after an error too, so the next one starts clean
+  if(!(x->opt & SEND_SPI_MORE) || err != SPI_OK) {
+    spi_close();
+  }
 
-    // Loop many time or until until tx fifo is empty
-    for(i=0; i<1000; i++) {
-      if(XSpi_GetStatusReg(&xspi) & XSP_SR_TX_EMPTY_MASK) {
-        break;
+  xfer_head = x->next;
+  if(!xfer_head) {
+    xfer_tail = NULL;
+  }
+  xfer_tx = 0;
+  xfer_rx = 0;
+  xfer_polls = 0;
+
+  x->next = NULL;
+  if(done_tail) {
+    done_tail->next = x;
+  } else {
+    done_head = x;
+  }
+  done_tail = x;
+  work_schedule(&done_work);
+}
+
+// Move the asynchronous queue along.  Called with interrupts masked.
+static void
+spi_service()
+{
+  struct spi_xfer *x;
+  int idle, err;
+
+  while(!xfer_paused && (x = xfer_head)) {
+    spi_open(x->dev);
+    xfer_rx += spi_drain(x->dst + xfer_rx);
+    xfer_tx += spi_fill(x->src + xfer_tx, x->len - xfer_tx, xfer_tx - xfer_rx);
+
+    // Wait for the tx fifo half empty interrupt to refill it
+    if(xfer_tx < x->len) {
+      return;
+    }
+
+    // Everything has been written.  Once the tx fifo is empty the last byte
+    // arrives within one byte time, so wait for it here rather than take
+    // another interrupt.
+    for(idle = 0; xfer_rx < x->len && idle < SPI_RX_TIMEOUT; idle++) {
+      if(!(spi_reg(XSP_SR_OFFSET) & XSP_SR_TX_EMPTY_MASK)) {
+        // Come back on the tx empty interrupt
+        return;
       }
+      xfer_rx += spi_drain(x->dst + xfer_rx);
     }
 
-    // If "timed out"
-    if(i == 1000) {
-      // Uh-oh, print some details
-      xil_printf("looped %d times waiting for spi tx fifo empty\n", i);
-      // Show SPI registers
-      dump_spi();
-      return len - bytes_remaining;
+    err = xfer_rx < x->len ? SPI_ETIMEDOUT : SPI_OK;
+
+    // A poll whose bits are still set goes again from the main loop, so
+    // the wait costs a status read per pass rather than the CPU
+    if(err == SPI_OK && (x->opt & SPI_XFER_POLL) &&
+       (x->dst[x->len - 1] & x->mask)) {
+      if(!x->tries || ++xfer_polls < x->tries) {
+        spi_close();
+        spi_stats.polls++;
+        xfer_tx = 0;
+        xfer_rx = 0;
+        xfer_paused = 1;
+        work_schedule(&poll_work);
+        return;
+      }
+      xfer_rx = 0;
+      err = SPI_ETIMEDOUT;
     }
+    spi_complete(err);
+  }
+  if(xfer_paused) {
+    return;
+  }
+
+  // Queue is empty
+  spi_stats.busy_cycles += timebase_cycles() - queue_start;
+  spi_set_reg(XSP_DGIER_OFFSET, 0);
+  spi_set_reg(XSP_IIER_OFFSET, spi_reg(XSP_IIER_OFFSET) & ~SPI_ASYNC_INTRS);
+}
+
+static void
+spi_isr(void *ref)
+{
+  // Faults stay latched for spi_check()
+  spi_set_reg(XSP_IISR_OFFSET, spi_reg(XSP_IISR_OFFSET) & ~SPI_FAULTS);
+  spi_service();
+}
 
-    // Read bytes from rx fifo
-    for(i=0; i < bytes_to_xfer; i++) {
-      if(XSpi_GetStatusReg(&xspi) & XSP_SR_RX_EMPTY_MASK) {
-        // Underflow!
-        return len - bytes_remaining;
+// Run the callbacks of completed transfers
+static void
+spi_done_work(void *arg)
+{
+  struct spi_xfer *x;
+  u32 msr;
+
+  while(1) {
+    msr = intr_lock();
+    x = done_head;
+    if(x) {
+      done_head = x->next;
+      if(!done_head) {
+        done_tail = NULL;
       }
-      // Post-increment dst, decrement bytes_remaining
-      *(dst++) = XSpi_ReadReg(xspi.BaseAddr, XSP_DRR_OFFSET) & 0xff;
-      bytes_remaining--;
+    }
+    intr_unlock(msr);
+
+    if(!x) {
+      break;
+    }
+    if(x->done) {
+      x->done(x);
     }
   }
+}
 
-  // If not doing more, close transaction
-  if(!(opt & SEND_SPI_MORE)) {
-    // De-select slave.  Be sure to use the "...Reg()" form of the setter since
-    // we are not using the higher level XSpi functions.
-    XSpi_SetSlaveSelectReg(&xspi, ~0);
+// Send the polling transfer at the head of the queue again
+static void
+spi_poll_work(void *arg)
+{
+  u32 msr = intr_lock();
 
-    // Disable (tri-state pins)
-    XSpi_Disable(&xspi);
+  xfer_paused = 0;
+  spi_service();
+  intr_unlock(msr);
+}
+
+// Queue a list of asynchronous SPI transactions, linked by `next` from
+// `first` and ending with NULL
+//
+// The list goes on the wire back to back, with nothing queued in between,
+// and a SPI_XFER_POLL transfer holds up the ones after it until its bits
+// clear: WREN, a program and a status poll go as one list with one
+// callback.  Otherwise as submit_spi().
+//
+// Returns 0.
+int
+submit_spi_chain(struct spi_xfer *first)
+{
+  struct spi_xfer *last;
+  u32 msr = intr_lock();
+
+  for(last=first; ; last=last->next) {
+    last->count = 0;
+    last->err = SPI_OK;
+    if(!last->next) {
+      break;
+    }
+  }
+  if(xfer_tail) {
+    xfer_tail->next = first;
+    xfer_tail = last;
+  } else {
+    xfer_head = first;
+    xfer_tail = last;
+    queue_start = timebase_cycles();
+    spi_set_reg(XSP_IISR_OFFSET, SPI_ASYNC_INTRS);
+    spi_set_reg(XSP_IIER_OFFSET, spi_reg(XSP_IIER_OFFSET) | SPI_ASYNC_INTRS);
+    spi_set_reg(XSP_DGIER_OFFSET, XSP_GINTR_ENABLE_MASK);
+    // Core was idle, so start now
+    spi_service();
   }
 
-  return len;
+  intr_unlock(msr);
+
+  return 0;
+}
+
+// Queue an asynchronous SPI transaction
+//
+// Transfers run in the order submitted, each with its `dev`.  One with
+// SEND_SPI_MORE in `opt` leaves the transaction open for the next one to
+// the same device, as with send_spi().  `xfer`
+// and its buffers must stay valid until its `done` callback runs from
+// work_run() with `count` set.
+//
+// Returns 0.
+int
+submit_spi(struct spi_xfer *xfer)
+{
+  xfer->next = NULL;
+  return submit_spi_chain(xfer);
+}
+
+// Returns non-zero while asynchronous transfers are queued
+int
+spi_busy()
+{
+  return xfer_head != NULL;
 }
 
 // Dump contents of SPI registers
@@ -142,11 +607,16 @@ dump_spi()
   xil_printf("SPI controller registers:\n");
   xil_printf("  SPICR  %08x\n", XSpi_GetControlReg(&xspi));
   xil_printf("  SPISR  %08x\n", XSpi_GetStatusReg(&xspi));
-  xil_printf("  SPISSR %08x\n", XSpi_GetSlaveSelectReg(&xspi));
+  xil_printf("  SPISSR %08x (last device %x, mode %03x)\n",
+      XSpi_GetSlaveSelectReg(&xspi), cur_dev->ss, cur_dev->mode);
   xil_printf("  TFOCYR %08x\n", XSpi_GetTFOcyReg(&xspi));
   xil_printf("  RFOCYR %08x\n", XSpi_GetRFOcyReg(&xspi));
   xil_printf("  DGIER  %08x\n",
                 XSpi_IsIntrGlobalEnabled(&xspi) ? XSP_GINTR_ENABLE_MASK : 0);
   xil_printf("  IPISR  %08x\n", XSpi_IntrGetStatus(&xspi));
   xil_printf("  IPIER  %08x\n", XSpi_IntrGetEnabled(&xspi));
+  xil_printf("  %d transfers, %d bytes, %d polls\n", spi_stats.xfers,
+      spi_stats.bytes, spi_stats.polls);
+  xil_printf("  %d timeouts, %d overruns, %d mode faults\n",
+      spi_stats.timeouts, spi_stats.overruns, spi_stats.mode_faults);
 }
@@ -1,10 +1,94 @@
 #ifndef _SPI_H_
 #define _SPI_H_
 
+#include "xil_types.h"
+
+// A slave on the core: the slave select bits asserted for it, and its
+// clock mode as the core's control register bits.  The core is set up for
+// a device as each transaction starts, and one left open for another
+// device is closed first.  Bytes are the core's fixed 8-bit transfer width.
+#define SPI_CPOL      (0x008) // SCK idles high
+#define SPI_CPHA      (0x010) // data sampled on the second edge
+#define SPI_LSB_FIRST (0x200)
+
+struct spi_dev {
+  u32 ss;
+  u32 mode;
+};
+
+// The configuration flash: slave select 0, mode 0
+extern const struct spi_dev spi_flash;
+
 #define SEND_SPI_MORE (0x01)
+// submit_spi(): send the transfer again, once per pass of the main loop,
+// until the last byte received has none of `mask` set
+#define SPI_XFER_POLL (0x02)
+
+// Why a transfer came up short: spi_error() after send_spi() and
+// recv_spi(), and a submitted transfer's `err`
+#define SPI_OK        (0)
+#define SPI_EBUSY     (-1) // asynchronous transfers queued
+#define SPI_ETIMEDOUT (-2) // rx fifo stayed empty, or a poll ran out of tries
+#define SPI_EOVERRUN  (-3) // rx fifo overrun: received bytes were lost
+#define SPI_EMODF     (-4) // mode fault: another master drove slave select
+
+// Asynchronous transfer descriptor for submit_spi()
+struct spi_xfer {
+  // Device addressed, or NULL for spi_flash
+  const struct spi_dev *dev;
+  u8 *src;
+  u8 *dst;
+  u32 len;
+  u32 opt;
+  // With SPI_XFER_POLL: the bits to wait on, and the most times the
+  // transfer is sent (0 for no limit).  Each time is a whole command, sent
+  // again from `src`, so `dst` must be a separate buffer.
+  u8 mask;
+  u32 tries;
+  // Called from work_run() once the transfer is done (may be NULL)
+  void (*done)(struct spi_xfer *xfer);
+  void *arg;
+  // Set by the driver: bytes transferred (less than `len` on error, 0 if a
+  // poll ran out of tries), and SPI_OK or why
+  u32 count;
+  int err;
+  // Next transfer of a submit_spi_chain() list; the driver's once queued
+  struct spi_xfer *next;
+};
+
+// Consumer of received data for recv_spi(), called once per rx fifo burst
+typedef void (*spi_sink_fn)(const u8 *buf, u32 len, void *arg);
+
+// Counts since boot, or the last clear (WBREG_OP_SPI)
+struct spi_stats {
+  // Slave select cycles, and bytes each way
+  u32 xfers;
+  u32 bytes;
+  // Transfers ended by each error
+  u32 timeouts;
+  u32 overruns;
+  u32 mode_faults;
+  // Status polls sent again (SPI_XFER_POLL)
+  u32 polls;
+  // timebase_cycles() spent in send_spi() and recv_spi(), or with
+  // asynchronous transfers queued
+  u64 busy_cycles;
+};
+
+extern struct spi_stats spi_stats;
 
 void init_spi();
+u32 send_spi_dev(const struct spi_dev *dev, u8 *src, u8 *dst, u32 len,
+    u32 opt);
 u32 send_spi(u8 *src, u8 *dst, u32 len, u32 opt);
+u32 recv_spi(u32 len, u32 opt, spi_sink_fn sink, void *arg);
+
+// SPI_OK, or why the last send_spi() or recv_spi() came up short
+int spi_error();
+
+int submit_spi(struct spi_xfer *xfer);
+int submit_spi_chain(struct spi_xfer *first);
+int spi_busy();
 
 void dump_spi();
 
@@ -0,0 +1,109 @@
+// stack.c - Stack high-water mark and overflow guard (see stack.h).
+
+#include "xparameters.h"
+#include "xil_printf.h"
+
+#include "log.h"
+#include "stack.h"
+#include "timer.h"
+
+#define STACK_PAINT (0x5a5a5a5au)
+#define STACK_GUARD (0xdeadbeefu)
+
+// Words left unpainted below the caller's stack pointer: init_stack()'s own
+// frame and what it calls
+#define STACK_PAINT_MARGIN (16)
+
+// From lscript.ld: the lowest address, and one past the highest
+extern u32 _stack_end[];
+extern u32 _stack[];
+
+static u8 tripped;
+
+static u32 *
+stack_pointer()
+{
+  u32 *sp;
+
+#ifdef __MICROBLAZE__
+  __asm__ volatile("addk %0, r1, r0" : "=r"(sp));
+#else
+  sp = __builtin_frame_address(0);
+#endif
+  return sp;
+}
+
+static void
+stack_check(void *arg)
+{
+  if(tripped || stack_guard_ok()) {
+    return;
+  }
+  tripped = 1;
+  LOG("stack: guard overwritten, peak %u of %u", stack_peak(), stack_size());
+  xil_printf("stack: guard overwritten, .noinit below may be corrupt\n");
+}
+
+static struct timer check_timer = TIMER_INIT(stack_check, NULL);
+
+void
+init_stack()
+{
+  u32 *p, *top = stack_pointer() - STACK_PAINT_MARGIN;
+
+  for(p = _stack_end; p < _stack_end + STACK_GUARD_WORDS; p++) {
+    *p = STACK_GUARD;
+  }
+  for(; p < top; p++) {
+    *p = STACK_PAINT;
+  }
+
+#if XPAR_MICROBLAZE_USE_STACK_PROTECTION && defined(__MICROBLAZE__)
+  // Stack limit low and high: r1-relative accesses outside raise a
+  // stack protection exception
+  __asm__ volatile("mts rslr, %0" : : "r"(_stack_end));
+  __asm__ volatile("mts rshr, %0" : : "r"(_stack));
+#endif
+
+  timer_start(&check_timer, STACK_CHECK_MS, STACK_CHECK_MS);
+}
+
+u32
+stack_size()
+{
+  return (u32)_stack - (u32)_stack_end;
+}
+
+u32
+stack_peak()
+{
+  u32 *p = _stack_end + STACK_GUARD_WORDS;
+
+  if(!stack_guard_ok()) {
+    return stack_size();
+  }
+  while(p < _stack && *p == STACK_PAINT) {
+    p++;
+  }
+  return (u32)_stack - (u32)p;
+}
+
+int
+stack_guard_ok()
+{
+  u32 i;
+
+  for(i=0; i<STACK_GUARD_WORDS; i++) {
+    if(_stack_end[i] != STACK_GUARD) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+void
+dump_stack()
+{
+  xil_printf("Stack: %d of %d B at peak%s\n", stack_peak(), stack_size(),
+      stack_guard_ok() ? "" : ", guard overwritten");
+}
@@ -0,0 +1,38 @@
+#ifndef _STACK_H_
+#define _STACK_H_
+
+// stack.h - Stack high-water mark and overflow guard.
+//
+// The one stack (_STACK_SIZE in lscript.ld) serves main() and every
+// interrupt handler.  init_stack() paints the part not yet in use, so the
+// deepest point it ever reached can be found later as the lowest word no
+// longer painted.  Its lowest STACK_GUARD_WORDS words hold a separate
+// pattern that is checked every STACK_CHECK_MS: a stack that got that
+// deep has already overwritten the .noinit records below it (lscript.ld
+// leaves no heap), or soon will.
+//
+// With XPAR_MICROBLAZE_USE_STACK_PROTECTION in the hardware, the stack
+// limit registers are set to the stack's bounds too, and the BSP's
+// hardware exception handler halts the CPU at the first access outside
+// them instead of letting it run on corrupted.
+
+#include "xil_types.h"
+
+#define STACK_GUARD_WORDS (4)
+#define STACK_CHECK_MS    (100)
+
+// Paint the stack and arm the guard.  Call after init_timers(), and
+// before the deep calls of startup.
+void init_stack();
+
+// Bytes of stack, and the most ever in use
+u32 stack_size();
+u32 stack_peak();
+
+// Whether the guard words are intact
+int stack_guard_ok();
+
+// Print the stack's size and peak on the console
+void dump_stack();
+
+#endif // _STACK_H_
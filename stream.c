@@ -0,0 +1,170 @@
+// stream.c - Messages over a MicroBlaze AXI4-Stream (FSL) link.
+
+#include "xil_printf.h"
+
+#include "sched.h"
+#include "stream.h"
+
+static struct {
+  u16 type;
+  stream_fn fn;
+  void *arg;
+} handlers[STREAM_HANDLERS];
+
+static u32 sent;
+static u32 received;
+static u32 dropped;
+static u32 errors;
+
+#if STREAM_PRESENT
+// The message coming in: its type, data words expected and so far, or
+// skipping to the next header after a framing error
+static u16 rx_type;
+static u32 rx_want;
+static u32 rx_have;
+static u8 rx_body;
+static u8 rx_skip;
+static u32 rx_buf[STREAM_MAX_WORDS];
+
+static void
+stream_deliver()
+{
+  u32 n;
+
+  received++;
+  for(n=0; n<STREAM_HANDLERS; n++) {
+    if(handlers[n].fn && handlers[n].type == rx_type) {
+      handlers[n].fn(rx_type, rx_buf, rx_have, handlers[n].arg);
+      return;
+    }
+  }
+  dropped++;
+}
+
+static void
+stream_header(u32 word)
+{
+  rx_type = STREAM_HDR_TYPE(word);
+  rx_want = STREAM_HDR_LEN(word);
+  rx_have = 0;
+  rx_skip = 0;
+  if(rx_want > STREAM_MAX_WORDS) {
+    errors++;
+    rx_skip = 1;
+    rx_body = 0;
+  } else if(rx_want == 0) {
+    rx_body = 0;
+    stream_deliver();
+  } else {
+    rx_body = 1;
+  }
+}
+
+static int
+stream_poll(void *arg)
+{
+  u32 word, n;
+  int ctrl;
+
+  for(n=0; n<STREAM_POLL_WORDS; n++) {
+    ctrl = stream_try_get(&word);
+    if(ctrl < 0) {
+      break;
+    }
+    if(ctrl) {
+      if(rx_body) {
+        // The message before was cut short
+        errors++;
+      }
+      stream_header(word);
+    } else if(rx_body) {
+      rx_buf[rx_have++] = word;
+      if(rx_have == rx_want) {
+        rx_body = 0;
+        stream_deliver();
+      }
+    } else if(!rx_skip) {
+      errors++;
+      rx_skip = 1;
+    }
+  }
+  return n != 0;
+}
+
+static struct sched_hook poll_hook = SCHED_HOOK_INIT(stream_poll, NULL);
+#endif // STREAM_PRESENT
+
+int
+stream_send(u16 type, const u32 *words, u32 n)
+{
+#if STREAM_PRESENT
+  u32 i;
+
+  if(n > STREAM_MAX_WORDS) {
+    return -1;
+  }
+  stream_put(STREAM_HDR(type, n), 1);
+  for(i=0; i<n; i++) {
+    stream_put(words[i], 0);
+  }
+  sent++;
+  return 0;
+#else
+  return -1;
+#endif
+}
+
+int
+stream_on(u16 type, stream_fn fn, void *arg)
+{
+  u32 n, slot = STREAM_HANDLERS;
+
+  if(!STREAM_PRESENT) {
+    return -1;
+  }
+  for(n=0; n<STREAM_HANDLERS; n++) {
+    if(handlers[n].fn && handlers[n].type == type) {
+      slot = n;
+      break;
+    }
+    if(!handlers[n].fn && slot == STREAM_HANDLERS) {
+      slot = n;
+    }
+  }
+  if(slot == STREAM_HANDLERS) {
+    return fn ? -1 : 0;
+  }
+  handlers[slot].type = type;
+  handlers[slot].fn = fn;
+  handlers[slot].arg = arg;
+  return 0;
+}
+
+void
+stream_counts(u32 *sent_out, u32 *received_out, u32 *dropped_out,
+    u32 *errors_out)
+{
+  *sent_out = sent;
+  *received_out = received;
+  *dropped_out = dropped;
+  *errors_out = errors;
+}
+
+void
+init_stream()
+{
+#if STREAM_PRESENT
+  sched_add_poll(&poll_hook);
+#endif
+}
+
+void
+dump_stream()
+{
+#if STREAM_PRESENT
+  xil_printf("Stream: link %d, %d sent, %d received, %d unhandled, "
+      "%d framing errors\n", STREAM_LINK, sent, received, dropped, errors);
+#else
+  print("Stream: no links\n");
+#endif
+}
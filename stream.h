@@ -0,0 +1,166 @@
+#ifndef _STREAM_H_
+#define _STREAM_H_
+
+// stream.h - Messages over a MicroBlaze AXI4-Stream (FSL) link.
+//
+// Where the gateware gives the processor stream links
+// (XPAR_MICROBLAZE_0_FSL_LINKS), link STREAM_LINK carries command words to
+// the fabric (M_AXIS) and event words back (S_AXIS).  A put or get is one
+// instruction against the link's FIFO, where a register behind the
+// Wishbone bridge takes an AXI round trip each way, so the hottest control
+// loops can use the word helpers below directly.
+//
+// On top of the words, a message is a header word with the stream's
+// control bit (TLAST on the AXI side) set, STREAM_HDR(type, n), and then
+// n data words without it.  stream_send() puts one whole.  Events are
+// taken from the link by a poll hook on each pass of the main loop, a
+// message being allowed to arrive over several passes, and handed to the
+// handler stream_on() registered for their type.  A data word where a
+// header belongs, a header inside a message or one over STREAM_MAX_WORDS
+// long is counted as a framing error and skipped up to the next header.
+//
+// The link is the main loop's: interrupt handlers must not use it, and
+// code using the word helpers must not interleave its words with a
+// message stream_send() or the gateware is sending.
+//
+// Without stream links everything below is a stub that fails.
+
+#include "xil_types.h"
+#include "xparameters.h"
+
+#if defined(XPAR_MICROBLAZE_0_FSL_LINKS) && XPAR_MICROBLAZE_0_FSL_LINKS > 0
+#define STREAM_PRESENT   (1)
+#else
+#define STREAM_PRESENT   (0)
+#endif
+
+// Link used.  The instructions name it, so it is fixed at build time.
+#ifndef STREAM_LINK
+#define STREAM_LINK      (0)
+#endif
+
+// Data words a message carries at most
+#define STREAM_MAX_WORDS (64)
+
+// Message types with a handler at once
+#define STREAM_HANDLERS  (8)
+
+// Words the poll hook takes off the link per pass at most
+#define STREAM_POLL_WORDS (256)
+
+#define STREAM_HDR(type, n) ((u32)(type) << 16 | (n))
+#define STREAM_HDR_TYPE(h)  ((h) >> 16)
+#define STREAM_HDR_LEN(h)   ((h) & 0xffff)
+
+#define STREAM_STR(x) #x
+#define STREAM_XSTR(x) STREAM_STR(x)
+#define STREAM_RFSL "rfsl" STREAM_XSTR(STREAM_LINK)
+
+// MSR bit the get instructions set when the control bit is not the one
+// they expect.  It is sticky and the core has no msrclr, so it is cleared
+// with a read-modify-write of MSR straight after the test.
+#define STREAM_MSR_FSL   (0x10)
+#define STREAM_CLEAR_FSL "mfs\t%1,rmsr\n\tandi\t%2,%1,-17\n\tmts\trmsr,%2"
+
+// Put `word` on the link, waiting while its FIFO is full.  Non-zero
+// `ctrl` sets the control bit.
+static inline void
+stream_put(u32 word, int ctrl)
+{
+#if STREAM_PRESENT
+  if(ctrl) {
+    __asm__ volatile ("cput\t%0," STREAM_RFSL :: "d" (word));
+  } else {
+    __asm__ volatile ("put\t%0," STREAM_RFSL :: "d" (word));
+  }
+#endif
+}
+
+// Like stream_put() without waiting.  Returns 0, or -1 if the FIFO is
+// full or there is no link.
+static inline int
+stream_try_put(u32 word, int ctrl)
+{
+#if STREAM_PRESENT
+  u32 full;
+
+  // The carry is set if the put did not happen
+  if(ctrl) {
+    __asm__ volatile ("ncput\t%1," STREAM_RFSL "\n\taddic\t%0,r0,0"
+        : "=d" (full) : "d" (word));
+  } else {
+    __asm__ volatile ("nput\t%1," STREAM_RFSL "\n\taddic\t%0,r0,0"
+        : "=d" (full) : "d" (word));
+  }
+  return full ? -1 : 0;
+#else
+  return -1;
+#endif
+}
+
+// Take the next word off the link without waiting.  Returns 1 if it had
+// the control bit set, 0 if not, or -1 if the FIFO is empty or there is
+// no link.
+static inline int
+stream_try_get(u32 *word)
+{
+#if STREAM_PRESENT
+  u32 msr, tmp, empty;
+
+  // A get expecting a data word takes a control word too, flagging it in
+  // MSR.  The carry is set if there was nothing to take.
+  __asm__ volatile ("nget\t%0," STREAM_RFSL "\n\taddic\t%3,r0,0\n\t"
+      STREAM_CLEAR_FSL
+      : "=&d" (*word), "=&d" (msr), "=&d" (tmp), "=&d" (empty));
+  if(empty) {
+    return -1;
+  }
+  return (msr & STREAM_MSR_FSL) != 0;
+#else
+  return -1;
+#endif
+}
+
+// Like stream_try_get(), waiting for a word
+static inline int
+stream_get(u32 *word)
+{
+#if STREAM_PRESENT
+  u32 msr, tmp;
+
+  __asm__ volatile ("get\t%0," STREAM_RFSL "\n\t" STREAM_CLEAR_FSL
+      : "=&d" (*word), "=&d" (msr), "=&d" (tmp));
+  return (msr & STREAM_MSR_FSL) != 0;
+#else
+  return -1;
+#endif
+}
+
+// Called from the main loop with each event of the type registered, its
+// `n` data words in `words`
+typedef void (*stream_fn)(u16 type, const u32 *words, u32 n, void *arg);
+
+// Put a message of `type` with `n` data words on the link, waiting for
+// room.
+//
+// Returns 0, or -1 if there is no link or `n` is over STREAM_MAX_WORDS.
+int stream_send(u16 type, const u32 *words, u32 n);
+
+// Hand events of `type` to `fn` (NULL to stop).  Replaces any handler of
+// `type`.
+//
+// Returns 0, or -1 if there is no link or STREAM_HANDLERS types already
+// have handlers.
+int stream_on(u16 type, stream_fn fn, void *arg);
+
+// Messages sent and received, received with no handler, and framing
+// errors, so far
+void stream_counts(u32 *sent, u32 *received, u32 *dropped, u32 *errors);
+
+// Add the poll hook.  Call before anything registers handlers.
+void init_stream();
+
+// Print the link and its counters
+void dump_stream();
+
+#endif // _STREAM_H_
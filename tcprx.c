@@ -0,0 +1,87 @@
+// tcprx.c - Received data of a TCP connection, taken as it is parsed.
+
+#include "tcprx.h"
+
+void
+tcprx_init(struct tcprx *r)
+{
+  r->p = NULL;
+  r->off = 0;
+}
+
+void
+tcprx_add(struct tcprx *r, struct pbuf *p)
+{
+  if(r->p) {
+    pbuf_cat(r->p, p);
+  } else {
+    r->p = p;
+    r->off = 0;
+  }
+}
+
+u32
+tcprx_len(const struct tcprx *r)
+{
+  return r->p ? r->p->tot_len - r->off : 0;
+}
+
+u32
+tcprx_take(struct tcprx *r, struct tcp_pcb *pcb, void *dst, u32 len)
+{
+  u32 n;
+
+  if(!r->p) {
+    return 0;
+  }
+  n = pbuf_copy_partial(r->p, dst, len, r->off);
+  tcprx_drop(r, pcb, n);
+  return n;
+}
+
+void
+tcprx_drop(struct tcprx *r, struct tcp_pcb *pcb, u32 len)
+{
+  struct pbuf *q;
+
+  tcp_recved(pcb, len);
+  r->off += len;
+  // Free the pbufs used up
+  while(r->p && r->off >= r->p->len) {
+    r->off -= r->p->len;
+    q = r->p->next;
+    if(q) {
+      pbuf_ref(q);
+    }
+    pbuf_free(r->p);
+    r->p = q;
+  }
+}
+
+void
+tcprx_free(struct tcprx *r)
+{
+  if(r->p) {
+    pbuf_free(r->p);
+    r->p = NULL;
+  }
+}
+
+err_t
+tcprx_close(struct tcprx *r, struct tcp_pcb *pcb)
+{
+  // Unread data would make tcp_close() reset the connection
+  if(r->p) {
+    tcp_recved(pcb, tcprx_len(r));
+    tcprx_free(r);
+  }
+  tcp_arg(pcb, NULL);
+  tcp_recv(pcb, NULL);
+  tcp_sent(pcb, NULL);
+  tcp_err(pcb, NULL);
+  if(tcp_close(pcb) != ERR_OK) {
+    tcp_abort(pcb);
+    return ERR_ABRT;
+  }
+  return ERR_OK;
+}
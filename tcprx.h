@@ -0,0 +1,51 @@
+#ifndef _TCPRX_H_
+#define _TCPRX_H_
+
+// tcprx.h - Received data of a TCP connection, taken as it is parsed.
+//
+// A service's recv callback hands each pbuf to tcprx_add(), and its parser
+// takes bytes off the front as it gets to them.  They are acknowledged
+// (tcp_recved()) as they are taken, so the window opens with what the
+// service has consumed rather than with what arrived, and a peer sending
+// requests faster than they are served is held back by it.
+//
+// tcprx_close() acknowledges whatever is left before closing: unread data
+// would make tcp_close() reset the connection, and lose replies still
+// queued.
+
+#include "xil_types.h"
+
+#include "lwip/tcp.h"
+
+struct tcprx {
+  // Received data not yet taken, from `off` in its first pbuf
+  struct pbuf *p;
+  u32 off;
+};
+
+// Start with nothing received
+void tcprx_init(struct tcprx *r);
+
+// Queue `p`, just received, after what is there
+void tcprx_add(struct tcprx *r, struct pbuf *p);
+
+// Bytes received and not yet taken
+u32 tcprx_len(const struct tcprx *r);
+
+// Copy up to `len` bytes off the front into `dst` and acknowledge them on
+// `pcb`.  Returns how many, 0 if there is nothing.
+u32 tcprx_take(struct tcprx *r, struct tcp_pcb *pcb, void *dst, u32 len);
+
+// Drop `len` bytes off the front, no more than tcprx_len(), and
+// acknowledge them on `pcb`
+void tcprx_drop(struct tcprx *r, struct tcp_pcb *pcb, u32 len);
+
+// Free what is left, for a connection that has gone away
+void tcprx_free(struct tcprx *r);
+
+// Close `pcb` after anything queued has been sent: acknowledge and free
+// what is left, take the callbacks away and tcp_close() it, or abort it if
+// that fails.  Returns what a callback must return.
+err_t tcprx_close(struct tcprx *r, struct tcp_pcb *pcb);
+
+#endif // _TCPRX_H_
@@ -0,0 +1,121 @@
+// tcpsrc.c - Bulk sending on a TCP connection, pulled by its send window.
+
+#include "mbmem.h"
+#include "tcpsrc.h"
+
+// Offset in the ring `n` bytes past the tail
+static u32
+tcpsrc_pos(const struct tcpsrc *s, u32 n)
+{
+  n += s->tail;
+  return n >= TCPSRC_SIZE ? n - TCPSRC_SIZE : n;
+}
+
+void
+tcpsrc_init(struct tcpsrc *s, struct tcp_pcb *pcb, tcpsrc_fill_fn fill,
+    void *arg)
+{
+  s->pcb = pcb;
+  s->fill = fill;
+  s->arg = arg;
+  s->tail = 0;
+  s->queued = 0;
+  s->filled = 0;
+  s->more = 0;
+}
+
+void
+tcpsrc_set_fill(struct tcpsrc *s, tcpsrc_fill_fn fill, void *arg)
+{
+  s->fill = fill;
+  s->arg = arg;
+}
+
+// Hand what is filled in to tcp_write(), a run up to the end of the ring
+// at a time.  Returns 0, or -1 if tcp_write() is out of memory, in which
+// case the rest waits for the next pump.
+static int
+tcpsrc_queue(struct tcpsrc *s)
+{
+  u32 pos, n, run;
+
+  while(s->queued < s->filled) {
+    pos = tcpsrc_pos(s, s->queued);
+    n = s->filled - s->queued;
+    run = TCPSRC_SIZE - pos;
+    if(n > run) {
+      n = run;
+    }
+    if(tcp_write(s->pcb, (u8 *)s->buf + pos, n,
+          s->more || s->queued + n < s->filled ?
+          TCP_WRITE_FLAG_MORE : 0) != ERR_OK) {
+      return -1;
+    }
+    s->queued += n;
+  }
+  return 0;
+}
+
+int
+tcpsrc_write(struct tcpsrc *s, const void *data, u32 len)
+{
+  u32 pos, run;
+
+  if(len > TCPSRC_SIZE - s->filled) {
+    return -1;
+  }
+  pos = tcpsrc_pos(s, s->filled);
+  run = TCPSRC_SIZE - pos;
+  if(len <= run) {
+    mb_memcpy((u8 *)s->buf + pos, data, len);
+  } else {
+    mb_memcpy((u8 *)s->buf + pos, data, run);
+    mb_memcpy(s->buf, (const u8 *)data + run, len - run);
+  }
+  s->filled += len;
+  s->more = 0;
+  tcpsrc_queue(s);
+  return 0;
+}
+
+void
+tcpsrc_pump(struct tcpsrc *s)
+{
+  u32 pos, n, got;
+
+  while(tcpsrc_queue(s) == 0 && s->fill) {
+    // The room before the end of the ring, whole words of it
+    pos = tcpsrc_pos(s, s->filled);
+    n = TCPSRC_SIZE - s->filled;
+    if(n > TCPSRC_SIZE - pos) {
+      n = TCPSRC_SIZE - pos;
+    }
+    if(n > tcp_sndbuf(s->pcb)) {
+      n = tcp_sndbuf(s->pcb);
+    }
+    n &= ~3;
+    if(n == 0) {
+      break;
+    }
+    got = s->fill((u8 *)s->buf + pos, n, s->arg);
+    if(got == 0) {
+      break;
+    }
+    s->filled += got;
+    s->more = got == n;
+  }
+  tcp_output(s->pcb);
+}
+
+void
+tcpsrc_sent(struct tcpsrc *s, u16 len)
+{
+  // The connection's own bytes only; nothing else may have been sent
+  if(len > s->queued) {
+    len = s->queued;
+  }
+  s->tail = tcpsrc_pos(s, len);
+  s->queued -= len;
+  s->filled -= len;
+  tcpsrc_pump(s);
+}
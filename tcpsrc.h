@@ -0,0 +1,70 @@
+#ifndef _TCPSRC_H_
+#define _TCPSRC_H_
+
+// tcpsrc.h - Bulk sending on a TCP connection, pulled by its send window.
+//
+// A service streaming a readout registers a fill callback, and the source
+// calls it for as much as the send buffer takes whenever there is room:
+// once on tcpsrc_pump() and again on each acknowledgement, from the
+// service's sent callback (tcpsrc_sent()).  The callback writes straight
+// into the source's ring, and the ring is handed to tcp_write() without
+// TCP_WRITE_FLAG_COPY, so the segments reference it (PBUF_ROM) instead of
+// taking a copy: the bytes stay put until the peer acknowledges them,
+// since a retransmission sends them again.  That saves a copy of every
+// byte, and the segments take a small header buffer from the pools rather
+// than a full-sized one.
+//
+// Every byte the connection sends must go through the source, headers
+// with tcpsrc_write(), so that what the peer acknowledges is the oldest
+// part of the ring.  The ring holds a send buffer (TCP_SND_BUF), so it
+// never runs out of room before tcp_write() would.  The fill callback gets
+// a word-aligned `dst` and a `len` of whole words as long as everything
+// written so far is whole words.
+
+#include "xil_types.h"
+
+#include "lwip/tcp.h"
+
+#define TCPSRC_SIZE (TCP_SND_BUF & ~3)
+
+// Write up to `len` bytes of the stream to `dst`.  Returns the bytes
+// written, 0 when there is nothing more for now.
+typedef u32 (*tcpsrc_fill_fn)(void *dst, u32 len, void *arg);
+
+struct tcpsrc {
+  struct tcp_pcb *pcb;
+  tcpsrc_fill_fn fill;
+  void *arg;
+  // Offset of the oldest byte not yet acknowledged, the bytes from there
+  // handed to tcp_write() and the bytes filled in
+  u32 tail;
+  u32 queued;
+  u32 filled;
+  // The last fill was cut short by the room left, so more follows
+  u8 more;
+  u32 buf[TCPSRC_SIZE / 4];
+};
+
+// Start sending on `pcb` with an empty ring, pulling from `fill` (which
+// may be NULL while there is only tcpsrc_write() to send).
+void tcpsrc_init(struct tcpsrc *s, struct tcp_pcb *pcb, tcpsrc_fill_fn fill,
+    void *arg);
+
+// Pull from `fill` from now on, NULL to stop
+void tcpsrc_set_fill(struct tcpsrc *s, tcpsrc_fill_fn fill, void *arg);
+
+// Copy `len` bytes into the ring to go out ahead of anything filled
+// later, and queue them.
+//
+// Returns 0, or -1 if the ring has no room for them (nothing is copied).
+int tcpsrc_write(struct tcpsrc *s, const void *data, u32 len);
+
+// Queue what is filled in, fill whatever room is left and send.  Call
+// once the fill callback has something new.
+void tcpsrc_pump(struct tcpsrc *s);
+
+// Release the `len` bytes the peer acknowledged and pump.  Call from the
+// connection's sent callback.
+void tcpsrc_sent(struct tcpsrc *s, u16 len);
+
+#endif // _TCPSRC_H_
@@ -0,0 +1,360 @@
+// telbuf.c - Store-and-forward of telemetry datagrams (see telbuf.h).
+//
+// The ring's indices count bytes, so a record may wrap around the end of
+// `ram`.  The flash log's ends are free-running byte offsets into the
+// sectors, like the ring's: records from `rd` up to `prog` are programmed,
+// and those from `prog` up to `wr` sit in `stage`, which is programmed at
+// `prog` once it is full.  `erased` is the end of the sectors erased ahead
+// of the writes.  The record at the reading end is looked up once and
+// kept in `cur` until it is popped.
+
+#include <string.h>
+
+#include "flash.h"
+#include "log.h"
+#include "ring.h"
+#include "slots.h"
+#include "telbuf.h"
+#include "timer.h"
+
+#define REC_SIZE(len) ((sizeof(struct telbuf_rec) + (len) + 3) & ~3)
+
+// What the flash log is doing
+#define FL_IDLE    (0)
+#define FL_ERASE   (1)
+#define FL_PROGRAM (2)
+
+// Where the oldest record is
+#define CUR_NONE   (0)
+#define CUR_FLASH  (1)
+#define CUR_RAM    (2)
+
+static u8 ram[TELBUF_RAM_SIZE];
+static struct ring rq = RING_INIT(TELBUF_RAM_SIZE);
+
+static u8 stage[TELBUF_STAGE];
+
+// Flash address of the sectors, the size of one and of all, or 0 for no
+// flash log
+static u32 fl_base;
+static u32 fl_sector;
+static u32 fl_size;
+static u32 rd, prog, wr, erased;
+static u8 fl_state;
+
+static struct telbuf_rec cur;
+static u8 cur_at;
+
+static struct telbuf_stats stats;
+
+static void
+ram_in(u32 at, const void *src, u32 len)
+{
+  u32 slot = at & rq.mask, n = TELBUF_RAM_SIZE - slot;
+
+  if(n > len) {
+    n = len;
+  }
+  memcpy(ram + slot, src, n);
+  memcpy(ram, (const u8 *)src + n, len - n);
+}
+
+static void
+ram_out(u32 at, void *dst, u32 len)
+{
+  u32 slot = at & rq.mask, n = TELBUF_RAM_SIZE - slot;
+
+  if(n > len) {
+    n = len;
+  }
+  memcpy(dst, ram + slot, n);
+  memcpy((u8 *)dst + n, ram, len - n);
+}
+
+// Flash address of log offset `off`
+static u32
+fl_addr(u32 off)
+{
+  return fl_base + (off & (fl_size - 1));
+}
+
+// Bytes left in the sector of log offset `off`
+static u32
+fl_left(u32 off)
+{
+  return fl_sector - (off & (fl_sector - 1));
+}
+
+// Read `len` bytes at log offset `off`, from the stage if they are not
+// programmed yet.  Returns 0, or -1 if the flash is busy.
+static int
+fl_read(u32 off, void *dst, u32 len)
+{
+  if(off - prog < wr - prog) {
+    memcpy(dst, stage + (off - prog), len);
+    return 0;
+  }
+  return read_flash(fl_addr(off), dst, len, FLASH_MODE_BEST) == len ? 0 : -1;
+}
+
+// Drop the whole flash log, after a failed program
+static void
+fl_reset()
+{
+  stats.dropped_bytes += wr - rd;
+  wr += fl_left(wr);
+  rd = prog = wr;
+  if(cur_at == CUR_FLASH) {
+    cur_at = CUR_NONE;
+  }
+}
+
+static void
+erase_done(int err, void *arg)
+{
+  fl_state = FL_IDLE;
+  if(err) {
+    stats.errors++;
+    return;
+  }
+  erased += fl_sector;
+}
+
+static void
+program_done(int err, void *arg)
+{
+  fl_state = FL_IDLE;
+  flash_cache_invalidate(fl_addr(prog), wr - prog);
+  if(err) {
+    stats.errors++;
+    fl_reset();
+    return;
+  }
+  stats.programs++;
+  prog = wr;
+}
+
+// Start programming the stage, erasing its sector first if need be.
+// Returns 0 if started, -1 if the flash is busy.
+static int
+fl_flush()
+{
+  u32 oldest;
+
+  if((s32)(wr - erased) > 0) {
+    // The log has come round to its oldest sector
+    oldest = erased + fl_sector - fl_size;
+    if((s32)(oldest - rd) > 0) {
+      stats.dropped_bytes += oldest - rd;
+      rd = oldest;
+      if(cur_at == CUR_FLASH) {
+        cur_at = CUR_NONE;
+      }
+    }
+    if(erase_flash(fl_addr(erased), fl_sector, erase_done, NULL) != 0) {
+      return -1;
+    }
+    fl_state = FL_ERASE;
+    return 0;
+  }
+  if(program_flash(fl_addr(prog), stage, wr - prog, program_done, NULL)
+     != 0) {
+    return -1;
+  }
+  fl_state = FL_PROGRAM;
+  return 0;
+}
+
+// Move the ring's oldest records into the stage while it is over the mark,
+// and program the stage once it is full.  Returns non-zero while there is
+// more to do.
+static int
+telbuf_spill()
+{
+  struct telbuf_rec h;
+  u32 size;
+
+  if(fl_state != FL_IDLE) {
+    return 1;
+  }
+  while(ring_count(&rq) > TELBUF_SPILL_MARK) {
+    // Found in the ring while the flash log was empty, it is still first
+    if(cur_at == CUR_RAM) {
+      cur_at = CUR_NONE;
+    }
+    ram_out(rq.tail, &h, sizeof(h));
+    size = REC_SIZE(h.len);
+    if(fl_left(wr) < size) {
+      if(wr != prog) {
+        return fl_flush() == 0;
+      }
+      // Left erased, for the reader to skip
+      if(rd == wr) {
+        rd += fl_left(wr);
+      }
+      wr += fl_left(wr);
+      prog = wr;
+    }
+    if(wr - prog + size > TELBUF_STAGE) {
+      return fl_flush() == 0;
+    }
+    ram_out(rq.tail, stage + (wr - prog), size);
+    ring_pop(&rq, size);
+    wr += size;
+    stats.spilled++;
+  }
+  return 0;
+}
+
+static void telbuf_poll(void *arg);
+
+static struct timer poll_timer = TIMER_INIT(telbuf_poll, NULL);
+
+static void
+telbuf_poll(void *arg)
+{
+  if(!telbuf_spill() && fl_state == FL_IDLE) {
+    timer_stop(&poll_timer);
+  }
+}
+
+int
+telbuf_put(const void *data, u32 len, u8 tag)
+{
+  struct telbuf_rec h;
+  u32 size = REC_SIZE(len);
+
+  if(!len || len > TELBUF_MAX) {
+    return -1;
+  }
+  while(ring_space(&rq) < size) {
+    ram_out(rq.tail, &h, sizeof(h));
+    ring_pop(&rq, REC_SIZE(h.len));
+    stats.dropped++;
+    if(cur_at == CUR_RAM) {
+      cur_at = CUR_NONE;
+    }
+  }
+  h.len = len;
+  h.tag = tag;
+  h.pad = 0;
+  ram_in(rq.head, &h, sizeof(h));
+  ram_in(rq.head + sizeof(h), data, len);
+  ring_push(&rq, size);
+  stats.stored++;
+  if(fl_size && ring_count(&rq) > TELBUF_SPILL_MARK &&
+     !timer_pending(&poll_timer)) {
+    timer_start(&poll_timer, TELBUF_POLL_MS, TELBUF_POLL_MS);
+  }
+  return 0;
+}
+
+u32
+telbuf_next(u8 *tag)
+{
+  while(cur_at == CUR_NONE && rd != wr) {
+    // No record fits before the sector's end
+    if(fl_left(rd) < REC_SIZE(1)) {
+      rd += fl_left(rd);
+      continue;
+    }
+    if(fl_read(rd, &cur, sizeof(cur)) != 0) {
+      return 0;
+    }
+    // Erased where the writes skipped to the next sector, or not a record
+    if(cur.len == TELBUF_ERASED || !cur.len || cur.len > TELBUF_MAX ||
+       REC_SIZE(cur.len) > fl_left(rd)) {
+      rd += fl_left(rd);
+      if((s32)(rd - wr) > 0) {
+        rd = wr;
+      }
+      continue;
+    }
+    cur_at = CUR_FLASH;
+  }
+  if(cur_at == CUR_NONE && rd == wr && ring_count(&rq)) {
+    ram_out(rq.tail, &cur, sizeof(cur));
+    cur_at = CUR_RAM;
+  }
+  if(cur_at == CUR_NONE) {
+    return 0;
+  }
+  *tag = cur.tag;
+  return cur.len;
+}
+
+u32
+telbuf_read(void *dst)
+{
+  u8 tag;
+
+  if(!telbuf_next(&tag)) {
+    return 0;
+  }
+  if(cur_at == CUR_RAM) {
+    ram_out(rq.tail + sizeof(cur), dst, cur.len);
+  } else if(fl_read(rd + sizeof(cur), dst, cur.len) != 0) {
+    return 0;
+  }
+  return cur.len;
+}
+
+void
+telbuf_pop()
+{
+  if(cur_at == CUR_RAM) {
+    ring_pop(&rq, REC_SIZE(cur.len));
+  } else if(cur_at == CUR_FLASH) {
+    rd += REC_SIZE(cur.len);
+    // Read out before it was programmed: no need to program it now
+    if(rd == wr && fl_state != FL_PROGRAM) {
+      prog = wr;
+    }
+  } else {
+    return;
+  }
+  cur_at = CUR_NONE;
+  stats.read++;
+}
+
+int
+telbuf_pending()
+{
+  return rd != wr || ring_count(&rq) != 0;
+}
+
+const struct telbuf_stats *
+telbuf_stats()
+{
+  stats.ram_bytes = ring_count(&rq) + (wr - prog);
+  stats.flash_bytes = (s32)(prog - rd) > 0 ? prog - rd : 0;
+  return &stats;
+}
+
+void
+init_telbuf()
+{
+  u32 base;
+  int i;
+
+  timer_stop(&poll_timer);
+  rq.head = rq.tail = 0;
+  rd = prog = wr = erased = 0;
+  fl_size = 0;
+  fl_state = FL_IDLE;
+  cur_at = CUR_NONE;
+  memset(&stats, 0, sizeof(stats));
+  if(!flash_info.size) {
+    return;
+  }
+  base = flash_rsv_addr(FLASH_RSV_TELBUF);
+  for(i=0; i<slots.num; i++) {
+    if(slots.slot[i].addr + slots.slot[i].size > base) {
+      LOG("telbuf: slot %d overlaps the flash log", i);
+      return;
+    }
+  }
+  fl_base = base;
+  fl_sector = flash_rsv_size();
+  fl_size = FLASH_RSV_TELBUF_SECTORS * fl_sector;
+}
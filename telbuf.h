@@ -0,0 +1,92 @@
+#ifndef _TELBUF_H_
+#define _TELBUF_H_
+
+// telbuf.h - Store-and-forward of telemetry datagrams through link
+// outages.
+//
+// A datagram that could not go to a collector, its link down or its next
+// hop not answering ARP, is kept here instead of lost, with a tag saying
+// which collectors missed it (telpush.h), and sent once they are back.
+// Records go first into a TELBUF_RAM_SIZE byte ring in BRAM.  Once that
+// is more than TELBUF_SPILL_MARK full, the oldest move into the flash
+// sectors FLASH_RSV_TELBUF (flash.h), a circular log, collected into a
+// TELBUF_STAGE byte stage and programmed a stage, several pages, at a
+// time.  Each sector is erased as the log reaches it; when the log comes
+// round to its oldest sector that sector's records are dropped, as are
+// the ring's oldest when flash cannot take them.  Records are read back
+// oldest first, from flash (or the stage) and then from the ring.
+//
+// Flash holds nothing across a restart: the log's ends are kept in BRAM
+// only.  If the slot table (slots.h) lays a bitstream over the sectors,
+// as one written before they were reserved may, only the ring is used.
+//
+// A record is a struct telbuf_rec and its data, padded to a word.  In
+// flash a record never crosses a sector: the rest of a sector too short
+// for the next one is left erased, and a length of TELBUF_ERASED skips it.
+
+#include "xil_types.h"
+
+#include "eth.h"
+
+// The BRAM ring, a power of two, and how full it gets before spilling
+#define TELBUF_RAM_SIZE   (8192)
+#define TELBUF_SPILL_MARK (TELBUF_RAM_SIZE / 2)
+
+// Bytes programmed into flash at once, a multiple of its 256-byte page
+#define TELBUF_STAGE      (2048)
+
+// Longest record's data
+#define TELBUF_MAX        ETH_UDP_MAX
+
+// How often the spill runs while there is anything to move or program
+#define TELBUF_POLL_MS    (10)
+
+#define TELBUF_ERASED     (0xffff)
+
+struct telbuf_rec {
+  u16 len;
+  u8 tag;
+  u8 pad;
+};
+
+struct telbuf_stats {
+  u32 stored;
+  u32 spilled;
+  u32 read;
+  // Records dropped from the ring, and bytes of flash dropped with the
+  // oldest sector
+  u32 dropped;
+  u32 dropped_bytes;
+  // Stages programmed, and erases and programs that failed
+  u32 programs;
+  u32 errors;
+  // Bytes held now in BRAM (the stage included) and in flash
+  u32 ram_bytes;
+  u32 flash_bytes;
+};
+
+// Keep the `len` bytes at `data` (at most TELBUF_MAX) with `tag`.  Returns
+// 0, or -1 if `len` is 0 or too long.
+int telbuf_put(const void *data, u32 len, u8 tag);
+
+// The length of the oldest record, with its tag in `tag`, or 0 if there is
+// none or it cannot be read yet (its flash is busy)
+u32 telbuf_next(u8 *tag);
+
+// Copy the oldest record into `dst`, which has room for telbuf_next()'s
+// length.  Returns the length, or 0 as telbuf_next() does.
+u32 telbuf_read(void *dst);
+
+// Drop the oldest record, once telbuf_next() has found it
+void telbuf_pop();
+
+// Non-zero if any record is held
+int telbuf_pending();
+
+const struct telbuf_stats *telbuf_stats();
+
+// Start empty, and find the flash sectors.  Call after init_flash() and
+// init_slots().
+void init_telbuf();
+
+#endif // _TELBUF_H_
@@ -0,0 +1,347 @@
+// telemetry.c - Board health history and its binary export.
+//
+// A periodic timer takes the snapshots and accumulates them; the record is
+// written into the ring when the window closes.  The TCP server serves one
+// connection at a time.  The export is generated on the fly from the ring,
+// one segment at a time as send buffer space frees up, so it needs no copy
+// of the history.  A record overwritten while its export is in flight goes
+// out as the newer record; its time_ms tells the reader.
+
+#include <string.h>
+
+#include "lwip/tcp.h"
+#include "netif/ethernetif.h"
+
+#include "xil_printf.h"
+
+#include "extmem.h"
+#include "log.h"
+#include "mbmem.h"
+#include "sections.h"
+#include "sntpclock.h"
+#include "telemetry.h"
+#include "timebase.h"
+#include "timer.h"
+#include "wdog.h"
+
+// Samples are due every TELEM_SAMPLE_MS
+#define TELEM_WDOG_MS (1000)
+
+static struct wdog_task wdog_task = WDOG_TASK_INIT("telemetry", TELEM_WDOG_MS);
+
+#if EXTMEM_SIZE
+// From external memory if it passed its check, else ring_bram
+static struct telem_record ring_bram[TELEM_RECORDS] TELEMETRY_SECTION;
+static struct telem_record *ring = ring_bram;
+static u32 ring_size = TELEM_RECORDS;
+#else
+static struct telem_record ring[TELEM_RECORDS] TELEMETRY_SECTION;
+static const u32 ring_size = TELEM_RECORDS;
+#endif
+static u32 ring_count;
+// Number of the first record since telem_resume()
+static u32 ring_base;
+
+// Window being accumulated
+static struct {
+  u32 time_ms;
+  u32 samples;
+  u32 events;
+  u16 min[XADC_NUM_CHANNELS];
+  u16 max[XADC_NUM_CHANNELS];
+  u32 sum[XADC_NUM_CHANNELS];
+} win;
+
+// Export in progress
+static struct {
+  struct tcp_pcb *pcb;
+  struct telem_header hdr;
+  u32 off;
+  u32 len;
+} tx;
+// Staging for one segment of it
+static u8 tx_seg[TCP_MSS] TELEMETRY_SECTION;
+
+static void
+telem_sample(void *arg)
+{
+  struct xadc_snapshot s;
+  struct telem_record *r;
+  u32 ch;
+
+  wdog_beat(&wdog_task);
+  xadc_snapshot(&s);
+
+  if(win.samples == 0) {
+    win.time_ms = s.time_ms;
+    win.events = xadc_event_count();
+    for(ch=0; ch<XADC_NUM_CHANNELS; ch++) {
+      win.min[ch] = win.max[ch] = s.raw[ch];
+      win.sum[ch] = 0;
+    }
+  }
+  for(ch=0; ch<XADC_NUM_CHANNELS; ch++) {
+    if(s.raw[ch] < win.min[ch]) {
+      win.min[ch] = s.raw[ch];
+    }
+    if(s.raw[ch] > win.max[ch]) {
+      win.max[ch] = s.raw[ch];
+    }
+    win.sum[ch] += s.raw[ch];
+  }
+  if(++win.samples < TELEM_WINDOW) {
+    return;
+  }
+
+  r = &ring[ring_count & (ring_size - 1)];
+  memset(r, 0, sizeof(*r));
+  r->time_ms = win.time_ms;
+  r->samples = win.samples;
+  r->events = xadc_event_count() - win.events;
+  for(ch=0; ch<XADC_NUM_CHANNELS; ch++) {
+    r->min[ch] = win.min[ch];
+    r->max[ch] = win.max[ch];
+    r->mean[ch] = win.sum[ch] / win.samples;
+  }
+  ring_count++;
+  win.samples = 0;
+}
+
+static struct timer sample_timer = TIMER_INIT(telem_sample, NULL);
+static struct timer_deadline sample_deadline =
+    TIMER_DEADLINE_INIT("telemetry", TELEM_DEADLINE_US);
+
+u32
+telem_count()
+{
+  return ring_count;
+}
+
+u32
+telem_first()
+{
+  return ring_count - ring_base > ring_size ?
+      ring_count - ring_size : ring_base;
+}
+
+void
+telem_resume(u32 count)
+{
+  ring_count = ring_base = count;
+}
+
+const struct telem_record *
+telem_peek(u32 n)
+{
+  if(n >= ring_count || n < telem_first()) {
+    return NULL;
+  }
+  return &ring[n & (ring_size - 1)];
+}
+
+int
+telem_record(u32 n, struct telem_record *r)
+{
+  const struct telem_record *p = telem_peek(n);
+
+  if(!p) {
+    return -1;
+  }
+  *r = *p;
+  return 0;
+}
+
+// Copy `len` bytes of the export at offset `off` into `dst`
+static void
+telem_read(u32 off, u8 *dst, u32 len)
+{
+  const struct telem_header *h = &tx.hdr;
+  const u32 rs = sizeof(struct telem_record);
+  const u32 rec_end = sizeof(*h) + h->records * rs;
+  struct xadc_event ev;
+  const u8 *src;
+  u32 item, n;
+
+  while(len) {
+    if(off < sizeof(*h)) {
+      src = (const u8 *)h + off;
+      n = sizeof(*h) - off;
+    } else if(off < rec_end) {
+      item = (off - sizeof(*h)) / rs;
+      n = (off - sizeof(*h)) % rs;
+      src = (const u8 *)&ring[(h->first_record + item) & (ring_size - 1)];
+      src += n;
+      n = rs - n;
+    } else {
+      item = (off - rec_end) / sizeof(ev);
+      n = (off - rec_end) % sizeof(ev);
+      // An event overwritten since the header was built reads as zeroes
+      if(xadc_event(h->first_event + item, &ev) != 0) {
+        memset(&ev, 0, sizeof(ev));
+      }
+      src = (const u8 *)&ev + n;
+      n = sizeof(ev) - n;
+    }
+    if(n > len) {
+      n = len;
+    }
+    mb_memcpy(dst, src, n);
+    dst += n;
+    off += n;
+    len -= n;
+  }
+}
+
+// Queue as much of the export as the send buffer takes, and close the
+// connection once all of it is queued.  A close that fails for lack of
+// memory is retried on the next acknowledgement.
+static void
+telem_send(struct tcp_pcb *pcb)
+{
+  u32 n;
+
+  while(tx.off < tx.len) {
+    n = tcp_sndbuf(pcb);
+    if(n > sizeof(tx_seg)) {
+      n = sizeof(tx_seg);
+    }
+    if(n > tx.len - tx.off) {
+      n = tx.len - tx.off;
+    }
+    if(n == 0) {
+      break;
+    }
+    telem_read(tx.off, tx_seg, n);
+    if(tcp_write(pcb, tx_seg, n, TCP_WRITE_FLAG_COPY |
+          (tx.off + n < tx.len ? TCP_WRITE_FLAG_MORE : 0)) != ERR_OK) {
+      break;
+    }
+    tx.off += n;
+  }
+  tcp_output(pcb);
+
+  if(tx.off == tx.len && tcp_close(pcb) == ERR_OK) {
+    tcp_recv(pcb, NULL);
+    tcp_sent(pcb, NULL);
+    tcp_err(pcb, NULL);
+    tx.pcb = NULL;
+  }
+}
+
+static err_t
+telem_sent(void *arg, struct tcp_pcb *pcb, u16_t len)
+{
+  telem_send(pcb);
+  return ERR_OK;
+}
+
+static err_t
+telem_recv(void *arg, struct tcp_pcb *pcb, struct pbuf *p, err_t err)
+{
+  // Nothing is expected from the reader
+  if(p) {
+    tcp_recved(pcb, p->tot_len);
+    pbuf_free(p);
+  }
+  return ERR_OK;
+}
+
+static void
+telem_err(void *arg, err_t err)
+{
+  tx.pcb = NULL;
+}
+
+static err_t
+telem_accept(void *arg, struct tcp_pcb *pcb, err_t err)
+{
+  struct telem_header *h = &tx.hdr;
+  const struct ethmon_core *e;
+  u32 count, n, ch;
+
+  if(err != ERR_OK || tx.pcb) {
+    return ERR_MEM;
+  }
+
+  memset(h, 0, sizeof(*h));
+  h->magic = TELEM_MAGIC;
+  h->version = TELEM_VERSION;
+  h->header_size = sizeof(struct telem_header);
+  h->record_size = sizeof(struct telem_record);
+  h->event_size = sizeof(struct xadc_event);
+  h->channels = XADC_NUM_CHANNELS;
+  h->window_ms = TELEM_SAMPLE_MS * TELEM_WINDOW;
+  h->now_ms = timebase_ms();
+  h->now_utc_us = now_utc_us();
+
+  h->first_record = telem_first();
+  h->records = ring_count - h->first_record;
+
+  count = xadc_event_count();
+  n = count < XADC_EVENTS ? count : XADC_EVENTS;
+  h->first_event = count - n;
+  h->events = n;
+
+  for(ch=0; ch<TELEM_PEAKS; ch++) {
+    h->peak_min[ch] = xadc_peak(ch, 0);
+    h->peak_max[ch] = xadc_peak(ch, 1);
+  }
+  for(n=0; n<ETH_MAX_CORES; n++) {
+    if((e = ethmon_core(n))) {
+      h->eth[n].present = 1;
+      h->eth[n].link = e->link;
+      h->eth[n].link_changes = e->link_changes;
+      memcpy(h->eth[n].rate, e->rate, sizeof(e->rate));
+    }
+  }
+  h->scrub = *scrub_get();
+  for(n=0; n<XADC_NUM_AUX; n++) {
+    h->aux_cal[n] = *xadccal_get(n);
+  }
+  h->load = *load_stats();
+  for(n=0; n<=LOAD_OTHER; n++) {
+    h->tasks[n] = *load_task(n);
+  }
+  h->lmbscrub = *lmbscrub_stats();
+
+  pcb->tos = ETHERNETIF_TOS_TELEMETRY;
+  tx.pcb = pcb;
+  tx.off = 0;
+  tx.len = sizeof(*h) + h->records * sizeof(struct telem_record) +
+      h->events * sizeof(struct xadc_event);
+
+  LOG("telemetry: export of %d records, %d events", h->records, h->events);
+
+  tcp_arg(pcb, NULL);
+  tcp_recv(pcb, telem_recv);
+  tcp_sent(pcb, telem_sent);
+  tcp_err(pcb, telem_err);
+  telem_send(pcb);
+  return ERR_OK;
+}
+
+void
+init_telemetry()
+{
+  struct tcp_pcb *pcb = tcp_new();
+#if EXTMEM_SIZE
+  struct telem_record *ext;
+
+  ext = extmem_alloc(sizeof(*ext) * TELEM_EXT_RECORDS);
+  if(ext) {
+    ring = ext;
+    ring_size = TELEM_EXT_RECORDS;
+  }
+#endif
+
+  wdog_add(&wdog_task, 1);
+  timer_set_deadline(&sample_timer, &sample_deadline);
+  timer_start(&sample_timer, 0, TELEM_SAMPLE_MS);
+
+  if(!pcb || tcp_bind(pcb, IP_ADDR_ANY, TELEM_PORT) != ERR_OK) {
+    xil_printf("telemetry: cannot bind port %d\n", TELEM_PORT);
+    return;
+  }
+  pcb = tcp_listen(pcb);
+  tcp_accept(pcb, telem_accept);
+}
@@ -0,0 +1,129 @@
+#ifndef _TELEMETRY_H_
+#define _TELEMETRY_H_
+
+// telemetry.h - Board health history and its binary export.
+//
+// XADC snapshots are taken every TELEM_SAMPLE_MS and folded into a record
+// of per-channel min/max/mean every TELEM_WINDOW samples.  The last
+// TELEM_RECORDS records are kept in a ring in the .telemetry section, or the
+// last TELEM_EXT_RECORDS in external memory where the gateware has it
+// (extmem.h).
+//
+// Connecting to TCP port TELEM_PORT fetches the whole history in one
+// transfer: the server sends a struct telem_header, the records it counts
+// oldest first, then the XADC alarm events it counts, and closes the
+// connection.  Everything is little-endian, as laid out in memory.  The
+// header also carries the 10 GbE cores' latest link state and rates
+// (ethmon.h), the flash health scan's results (scrub.h), the
+// calibration of the aux inputs (xadccal.h), the CPU load, in all and
+// task by task (load.h), and the local memory's ECC errors (lmbscrub.h).
+
+#include "xil_types.h"
+
+#include "ethmon.h"
+#include "lmbscrub.h"
+#include "load.h"
+#include "scrub.h"
+#include "xadc.h"
+#include "xadccal.h"
+
+#define TELEM_PORT       (7001)
+
+#define TELEM_SAMPLE_MS  (10)
+// A sample must start this soon after it is due (timer.h), in us
+#define TELEM_DEADLINE_US (2000)
+#define TELEM_WINDOW     (10)
+// Powers of two.  An export counts its records in a u16.
+#define TELEM_RECORDS    (64)
+#define TELEM_EXT_RECORDS (16384)
+
+#define TELEM_MAGIC      (0x314d4c54) // "TLM1"
+// Bumped whenever the layout of the export changes
+#define TELEM_VERSION    (7)
+
+// Aggregate of one window, raw XADC results (see xadc_convert())
+struct telem_record {
+  // timebase_ms() of the first sample
+  u32 time_ms;
+  u16 samples;
+  // XADC alarm events during the window
+  u16 events;
+  u16 min[XADC_NUM_CHANNELS];
+  u16 max[XADC_NUM_CHANNELS];
+  u16 mean[XADC_NUM_CHANNELS];
+};
+
+// On-chip sensors the XADC itself tracks the extremes of
+#define TELEM_PEAKS (4) // XADC_TEMP, XADC_VCCINT, XADC_VCCAUX, XADC_VBRAM
+
+struct telem_header {
+  u32 magic;
+  u16 version;
+  // Sizes of this header, a record and an event, so readers can skip
+  // fields added after them
+  u16 header_size;
+  u16 record_size;
+  u16 event_size;
+  u16 channels;
+  u16 window_ms;
+  // timebase_ms() when the export began
+  u32 now_ms;
+  // Sequence number of the first record sent, and how many follow
+  u32 first_record;
+  u16 records;
+  // How many events follow the records, and the number of the first
+  u16 events;
+  u32 first_event;
+  // Extremes of the first TELEM_PEAKS channels since the XADC was reset,
+  // caught at the full conversion rate
+  u16 peak_min[TELEM_PEAKS];
+  u16 peak_max[TELEM_PEAKS];
+  // Microseconds since 1970 UTC at now_ms (sntpclock.h), 0 if the clock
+  // is not set.  Maps every time_ms in the export to wall-clock time.
+  u64 now_utc_us;
+  // Each core's latest ethmon sample, all zero for a core not there
+  struct telem_eth {
+    u8 present;
+    u8 link;
+    u16 link_changes;
+    u32 rate[ETHMON_COUNTERS];
+  } eth[ETH_MAX_CORES];
+  // As scrub_get() has them
+  struct scrub_record scrub;
+  // Calibration of each aux channel (xadccal.h), for scaling its raw
+  // results
+  struct xadccal_entry aux_cal[XADC_NUM_AUX];
+  // As load_stats() and load_task() have them, entry LOAD_OTHER last;
+  // entries with fn 0 and no runs are unused
+  struct load_stats load;
+  struct load_task tasks[LOAD_TASKS + 1];
+  // As lmbscrub_stats() has them, all 0 without LMB ECC
+  struct lmbscrub_stats lmbscrub;
+};
+
+// Start sampling and listen on TELEM_PORT.  Call after lwip_init().
+void init_telemetry();
+
+// Number of records so far, counting those before a telem_resume().  The
+// next record gets this number.
+u32 telem_count();
+
+// Number of the oldest record kept
+u32 telem_first();
+
+// Carry the numbering on from `count`, as after a restart (warm.h).  The
+// records before it are gone.
+void telem_resume(u32 count);
+
+// Copy record `n` (counting from 0) into `r`.
+//
+// Returns 0 on success, -1 if it does not exist yet or has been
+// overwritten.
+int telem_record(u32 n, struct telem_record *r);
+
+// Record `n` where it lies in the ring, or NULL if it does not exist yet or
+// has been overwritten.  Only good until the main loop runs on: the ring
+// wraps round over it in time.
+const struct telem_record *telem_peek(u32 n);
+
+#endif // _TELEMETRY_H_
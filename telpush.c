@@ -0,0 +1,386 @@
+// telpush.c - Telemetry pushed to collectors over UDP (see telpush.h).
+//
+// The datagram being filled lives in `buf`, the header at its front.  A
+// sample is encoded as it is taken, against `prev`, so nothing but the
+// last sample is kept.  Each sample is checked to fit before it is
+// encoded, at its worst of five bytes a field, so a batch of large jumps
+// goes early rather than overflowing.
+
+#include <string.h>
+
+#include "lwip/etharp.h"
+#include "lwip/ip4.h"
+#include "lwip/stats.h"
+#include "lwip/udp.h"
+
+#include "kv.h"
+#include "log.h"
+#include "pace.h"
+#include "sched.h"
+#include "telbuf.h"
+#include "telpush.h"
+#include "timebase.h"
+#include "timer.h"
+
+#define VARINT_MAX (5)
+
+static struct telpush_dest dests[TELPUSH_DESTS];
+static struct telpush_stats stats;
+static struct udp_pcb *pcb;
+
+static u8 buf[ETH_UDP_MAX];
+static u32 len;
+static u16 seq;
+// Datagrams since the last keyframe, and a keyframe asked for
+static u32 since_key;
+static u8 want_key;
+// Destinations down, a bit each, when the datagram in `buf` began
+static u8 down;
+
+// Datagrams held through an outage go no sooner than `backfill_at`
+static struct pace backfill_pace;
+static u64 backfill_at;
+
+// The sample being encoded, and the one before
+static u32 cur[TELPUSH_FIELDS];
+// timebase_ms() when `cur` was taken
+static u32 cur_ms;
+static u32 prev[TELPUSH_FIELDS];
+static u64 prev_cycles;
+static u64 prev_idle;
+
+// Write `d` as a zigzag varint at `p`.  Returns the bytes written.
+static u32
+put_zigzag(u8 *p, u32 d)
+{
+  // Zigzag: 0, -1, 1, -2 ... to 0, 1, 2, 3 ...
+  u32 z = (d << 1) ^ (d & 0x80000000 ? 0xffffffff : 0), n = 0;
+
+  while(z >= 0x80) {
+    p[n++] = z | 0x80;
+    z >>= 7;
+  }
+  p[n++] = z;
+  return n;
+}
+
+// Append `v` as the zigzag varint of its difference from `*last`
+static void
+put_delta(u32 v, u32 *last)
+{
+  len += put_zigzag(buf + len, v - *last);
+  *last = v;
+}
+
+static void
+put_header(struct telpush_header *h, u8 flags, u16 n, u32 time_ms)
+{
+  h->magic = TELPUSH_MAGIC;
+  h->version = TELPUSH_VERSION;
+  h->flags = flags;
+  h->seq = n;
+  h->channels = XADC_NUM_CHANNELS;
+  h->cores = ETH_MAX_CORES;
+  h->counters = ETHMON_COUNTERS;
+  h->pools = MEMP_MAX;
+  h->samples = 0;
+  h->sample_ms = TELPUSH_SAMPLE_MS;
+  h->time_ms = time_ms;
+}
+
+// Take a sample into `v`
+static void
+telpush_sample(u32 *v)
+{
+  const struct ethmon_core *e;
+  u64 cycles = timebase_cycles(), idle = sched_idle_cycles(), span;
+  u32 n = 0, i, k, longest_us;
+  struct xadc_snapshot s;
+
+  xadc_snapshot(&s);
+  for(i=0; i<XADC_NUM_CHANNELS; i++) {
+    v[n++] = s.raw[i];
+  }
+  for(i=0; i<ETH_MAX_CORES; i++) {
+    e = ethmon_core(i);
+    v[n++] = e ? e->link : 0;
+    for(k=0; k<ETHMON_COUNTERS; k++) {
+      v[n++] = e ? e->count[k] : 0;
+    }
+  }
+  for(i=0; i<MEMP_MAX; i++) {
+    v[n++] = memp_pools[i]->stats->max;
+  }
+  span = cycles - prev_cycles;
+  v[n++] = span && prev_cycles ?
+      (u32)((span - (idle - prev_idle)) * 1000 / span) : 0;
+  v[n++] = sched_stalls(&longest_us);
+  prev_cycles = cycles;
+  prev_idle = idle;
+}
+
+// Send the `n` bytes at `data` to the destinations in `mask`
+static void
+telpush_send(const u8 *data, u32 n, u8 mask)
+{
+  struct pbuf *p;
+  ip4_addr_t ip;
+  u32 i;
+
+  for(i=0; i<TELPUSH_DESTS; i++) {
+    if(!dests[i].ip || !(mask & 1 << i)) {
+      continue;
+    }
+    p = pbuf_alloc(PBUF_TRANSPORT, n, PBUF_RAM);
+    if(!p) {
+      stats.errors++;
+      continue;
+    }
+    memcpy(p->payload, data, n);
+    ip4_addr_set_u32(&ip, dests[i].ip);
+    if(udp_sendto(pcb, p, &ip, dests[i].port) != ERR_OK) {
+      stats.errors++;
+    }
+    pbuf_free(p);
+  }
+}
+
+// Send the datagram in `buf` to every destination, holding it for those
+// that are down
+static void
+telpush_flush()
+{
+  struct telpush_header *h = (struct telpush_header *)buf;
+  u8 held = 0;
+  u32 i;
+
+  for(i=0; i<TELPUSH_DESTS; i++) {
+    if(dests[i].ip && (down & 1 << i)) {
+      held |= 1 << i;
+    }
+  }
+  telpush_send(buf, len, ~held);
+  if(held && telbuf_put(buf, len, held) == 0) {
+    stats.held++;
+  }
+  stats.datagrams++;
+  stats.bytes += len;
+  if(h->flags & TELPUSH_KEY) {
+    stats.keyframes++;
+  }
+  len = 0;
+}
+
+// Non-zero if datagrams to `d` can go: an interface that is up, with its
+// link up, routes to it, and the next hop is in the ARP table
+static int
+telpush_reachable(const struct telpush_dest *d)
+{
+  struct netif *netif;
+  struct eth_addr *mac;
+  const ip4_addr_t *unused;
+  ip4_addr_t dst, hop;
+
+  ip4_addr_set_u32(&dst, d->ip);
+  netif = ip4_route(&dst);
+  if(!netif || !netif_is_up(netif) || !netif_is_link_up(netif)) {
+    return 0;
+  }
+  if(!(netif->flags & NETIF_FLAG_ETHARP) || ip4_addr_ismulticast(&dst) ||
+     ip4_addr_isbroadcast(&dst, netif)) {
+    return 1;
+  }
+  ip4_addr_copy(hop, dst);
+  if(!ip4_addr_netcmp(&dst, netif_ip4_addr(netif), netif_ip4_netmask(netif))
+     && !ip4_addr_isany_val(*netif_ip4_gw(netif))) {
+    ip4_addr_copy(hop, *netif_ip4_gw(netif));
+  }
+  if(etharp_find_addr(netif, &hop, &mac, &unused) >= 0) {
+    return 1;
+  }
+  // So that the entry is there once it answers
+  etharp_request(netif, &hop);
+  return 0;
+}
+
+// The destinations down now, a bit each
+static u8
+telpush_down()
+{
+  u8 mask = 0;
+  u32 i;
+
+  for(i=0; i<TELPUSH_DESTS; i++) {
+    if(dests[i].ip && !telpush_reachable(&dests[i])) {
+      mask |= 1 << i;
+    }
+  }
+  return mask;
+}
+
+// Send on the datagrams held, oldest first, as the pace allows and while
+// the destinations each is for are up
+static void
+telpush_backfill()
+{
+  u64 now = timebase_cycles();
+  struct pbuf *p;
+  u32 n, i;
+  u8 tag;
+
+  while(backfill_at <= now && (n = telbuf_next(&tag))) {
+    // Destinations switched off since
+    for(i=0; i<TELPUSH_DESTS; i++) {
+      if(!dests[i].ip) {
+        tag &= ~(1 << i);
+      }
+    }
+    if(tag & down) {
+      return;
+    }
+    if(tag) {
+      p = pbuf_alloc(PBUF_RAW, n, PBUF_RAM);
+      if(!p) {
+        return;
+      }
+      if(telbuf_read(p->payload) != n) {
+        pbuf_free(p);
+        return;
+      }
+      ((struct telpush_header *)p->payload)->flags |= TELPUSH_BACKFILL;
+      telpush_send(p->payload, n, tag);
+      pbuf_free(p);
+      stats.backfilled++;
+      backfill_at = pace_release(&backfill_pace, now, n);
+    }
+    telbuf_pop();
+  }
+}
+
+// Non-zero if there is anyone to push to
+static int
+telpush_wanted()
+{
+  u32 i;
+
+  for(i=0; i<TELPUSH_DESTS; i++) {
+    if(dests[i].ip) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+// Timer: take a sample and add it to the batch
+static void
+telpush_poll(void *arg)
+{
+  struct telpush_header *h = (struct telpush_header *)buf;
+  u32 i;
+
+  // Sampled regardless, so the first busy fraction covers one sample
+  telpush_sample(cur);
+  cur_ms = timebase_ms();
+  if(!telpush_wanted()) {
+    return;
+  }
+  if(len && len + TELPUSH_FIELDS * VARINT_MAX > sizeof(buf)) {
+    telpush_flush();
+  }
+  if(!len) {
+    // Those that went down or came back need a run of their own
+    i = telpush_down();
+    if(i != down) {
+      down = i;
+      want_key = 1;
+    }
+    if(want_key || since_key >= TELPUSH_KEY_EVERY - 1) {
+      memset(prev, 0, sizeof(prev));
+      want_key = 0;
+      since_key = 0;
+      put_header(h, TELPUSH_KEY, seq++, cur_ms);
+    } else {
+      since_key++;
+      put_header(h, 0, seq++, cur_ms);
+    }
+    len = sizeof(*h);
+  }
+  for(i=0; i<TELPUSH_FIELDS; i++) {
+    put_delta(cur[i], &prev[i]);
+  }
+  if(++h->samples == TELPUSH_BATCH) {
+    telpush_flush();
+  }
+  telpush_backfill();
+}
+
+static struct timer poll_timer = TIMER_INIT(telpush_poll, NULL);
+
+static struct kv_save save = KV_SAVE_INIT(save, KV_KEY_TELPUSH);
+
+int
+telpush_set_dest(u32 n, const ip4_addr_t *ip, u16 port)
+{
+  if(n >= TELPUSH_DESTS) {
+    return -1;
+  }
+  dests[n].ip = ip ? ip4_addr_get_u32(ip) : 0;
+  dests[n].port = dests[n].ip ? port : 0;
+  // The new collector needs a keyframe to start from; the batch so far
+  // goes to the old ones
+  if(len) {
+    telpush_flush();
+  }
+  want_key = 1;
+  kv_save(&save, dests, sizeof(dests));
+  return 0;
+}
+
+const struct telpush_dest *
+telpush_dest(u32 n)
+{
+  return n < TELPUSH_DESTS ? &dests[n] : NULL;
+}
+
+u32
+telpush_keyframe(u8 *dst, u32 max, u16 n)
+{
+  struct telpush_header *h = (struct telpush_header *)dst;
+  u32 at = sizeof(*h), i;
+
+  if(max < TELPUSH_KEYFRAME_MAX) {
+    return 0;
+  }
+  put_header(h, TELPUSH_KEY, n, cur_ms);
+  h->samples = 1;
+  for(i=0; i<TELPUSH_FIELDS; i++) {
+    at += put_zigzag(dst + at, cur[i]);
+  }
+  return at;
+}
+
+const struct telpush_stats *
+telpush_stats()
+{
+  return &stats;
+}
+
+void
+init_telpush()
+{
+  if(kv_get(KV_KEY_TELPUSH, dests, sizeof(dests)) != sizeof(dests)) {
+    memset(dests, 0, sizeof(dests));
+  }
+  // Bound so that collectors see one source port
+  pcb = udp_new();
+  if(!pcb || udp_bind(pcb, IP_ADDR_ANY, TELPUSH_PORT) != ERR_OK) {
+    LOG("telpush: cannot bind port %u", TELPUSH_PORT);
+    return;
+  }
+#if LWIP_MULTICAST_TX_OPTIONS
+  udp_set_multicast_ttl(pcb, TELPUSH_TTL);
+#endif
+  pace_set(&backfill_pace, TELPUSH_BACKFILL_RATE, TELPUSH_BACKFILL_BURST);
+  want_key = 1;
+  timer_start(&poll_timer, TELPUSH_SAMPLE_MS, TELPUSH_SAMPLE_MS);
+}
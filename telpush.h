@@ -0,0 +1,133 @@
+#ifndef _TELPUSH_H_
+#define _TELPUSH_H_
+
+// telpush.h - Telemetry pushed to collectors in batched, delta-encoded UDP
+// datagrams.
+//
+// Every TELPUSH_SAMPLE_MS the publisher takes a sample of
+// TELPUSH_FIELDS values: the raw result of every XADC channel, each 10 GbE
+// core's link state and counters (ethmon.h), the high-water mark of each
+// memp pool, the main loop's busy time over the sample in 1/1000ths and
+// its stalls so far (sched.h).  TELPUSH_BATCH samples go out together in
+// one datagram to each destination, TELPUSH_DESTS at most, which may be
+// multicast groups (sent with TTL TELPUSH_TTL).  Collectors then take one
+// datagram a second from each board instead of polling it.
+//
+// A datagram is a struct telpush_header, little-endian, then `samples`
+// samples, each of the fields in the order above as a LEB128 varint of
+// the zigzag-encoded difference from the same field of the sample
+// before.  A keyframe (TELPUSH_KEY), every TELPUSH_KEY_EVERY datagrams,
+// takes its first sample's differences from 0, so it stands alone; the
+// others go on from the last sample of the datagram before, and a
+// collector that missed one waits for the next keyframe.  `seq` says
+// when one went missing.  A batch that would outgrow ETH_UDP_MAX goes
+// out early.  tools/telpush.py listens and decodes.
+//
+// A destination is down while no interface up with its link up routes to
+// it or, unicast, its next hop has no ARP entry.  The datagrams it misses
+// are held by telbuf.h, in BRAM and then flash, each with the set of
+// destinations that missed it, and sent to them again once they are back,
+// behind the live datagrams and paced to TELPUSH_BACKFILL_RATE, with
+// TELPUSH_BACKFILL set.  Each change in which destinations are down starts
+// a keyframe, so the datagrams held for a destination run on from one and
+// the live ones after it start again from one: a collector decodes the two
+// as separate runs, each with its own `seq`.
+//
+// Destinations are kept in KV_KEY_TELPUSH (kv.h) and set with KATCP's
+// ?telpush (katcp.h).
+//
+// The web UI takes the same samples one at a time over a WebSocket
+// (websock.h), each a keyframe of its own from telpush_keyframe().
+
+#include "lwip/ip4_addr.h"
+#include "lwip/memp.h"
+
+#include "xil_types.h"
+
+#include "eth.h"
+#include "ethmon.h"
+#include "xadc.h"
+
+#define TELPUSH_PORT      (7012)
+
+#define TELPUSH_SAMPLE_MS (100)
+#define TELPUSH_BATCH     (10)
+#define TELPUSH_KEY_EVERY (16)
+#define TELPUSH_DESTS     (2)
+#define TELPUSH_TTL       (8)
+
+// Pace of the datagrams held through an outage once they can go, in bytes
+// a second, and the bucket's depth
+#define TELPUSH_BACKFILL_RATE  (16000)
+#define TELPUSH_BACKFILL_BURST (4 * ETH_UDP_MAX)
+
+#define TELPUSH_MAGIC     (0x31555054) // "TPU1"
+// Bumped whenever the layout of a datagram changes
+#define TELPUSH_VERSION   (1)
+
+// Header flags
+#define TELPUSH_KEY       (0x01)
+#define TELPUSH_BACKFILL  (0x02) // held through an outage and sent late
+
+// Values in a sample
+#define TELPUSH_FIELDS (XADC_NUM_CHANNELS + \
+    ETH_MAX_CORES * (1 + ETHMON_COUNTERS) + MEMP_MAX + 2)
+
+// Bytes a keyframe of one sample takes at most
+#define TELPUSH_KEYFRAME_MAX (sizeof(struct telpush_header) + \
+    TELPUSH_FIELDS * 5)
+
+struct telpush_header {
+  u32 magic;
+  u8 version;
+  u8 flags;
+  u16 seq;
+  // Fields of each kind, in their order in a sample
+  u8 channels;
+  u8 cores;
+  u8 counters;
+  u8 pools;
+  u16 samples;
+  u16 sample_ms;
+  // timebase_ms() of the first sample
+  u32 time_ms;
+};
+
+// As stored: the address in network order, 0 for none
+struct telpush_dest {
+  u32 ip;
+  u16 port;
+  u16 pad;
+};
+
+struct telpush_stats {
+  u32 datagrams;
+  u32 keyframes;
+  u32 bytes;
+  // Datagrams lwIP would not send
+  u32 errors;
+  // Datagrams held for destinations that were down, and sent to them since
+  u32 held;
+  u32 backfilled;
+};
+
+// Load the saved destinations and start sampling.  Call after lwip_init(),
+// init_kv() and init_telbuf().
+void init_telpush();
+
+// Push to `ip`:`port` as destination `n`, or stop pushing there if `ip` is
+// NULL or any.  Takes effect at once, with a keyframe, and is saved in the
+// background.  Returns 0, or -1 if `n` is out of range.
+int telpush_set_dest(u32 n, const ip4_addr_t *ip, u16 port);
+
+// Destination `n`, or NULL past the last
+const struct telpush_dest *telpush_dest(u32 n);
+
+// Write the latest sample into `dst` as a datagram of its own, a keyframe
+// numbered `n`.  Returns its length, or 0 if `max` is less than
+// TELPUSH_KEYFRAME_MAX.
+u32 telpush_keyframe(u8 *dst, u32 max, u16 n);
+
+const struct telpush_stats *telpush_stats();
+
+#endif // _TELPUSH_H_
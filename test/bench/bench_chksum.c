@@ -0,0 +1,113 @@
+// bench_chksum.c - The checksum routines lwIP is built with (chksum.h), at
+// the lengths and alignments the stack hands them, against what they
+// replace: memcpy() and a separate sum for the copying one.
+
+#include <stdio.h>
+#include <string.h>
+
+#include "jam_bench.h"
+
+#include "chksum.h"
+
+#include "lwip/inet_chksum.h"
+#include "lwip/pbuf.h"
+
+#define BUF_LEN (9000)
+
+// Word aligned, with room to start 3 bytes in
+static u32 src_buf[(BUF_LEN + 4) / 4];
+static u32 dst_buf[(BUF_LEN + 4) / 4];
+
+struct span {
+  u16 len;
+  u8 off;
+};
+
+static void
+sum(void *arg, u32 n)
+{
+  const struct span *s = arg;
+  const u8 *p = (const u8 *)src_buf + s->off;
+
+  while(n--) {
+    bench_sink += mb_chksum(p, s->len);
+  }
+}
+
+static void
+sum_copy(void *arg, u32 n)
+{
+  const struct span *s = arg;
+
+  while(n--) {
+    bench_sink += mb_chksum_copy(dst_buf, (const u8 *)src_buf + s->off,
+        s->len);
+  }
+}
+
+static void
+copy_then_sum(void *arg, u32 n)
+{
+  const struct span *s = arg;
+
+  while(n--) {
+    memcpy(dst_buf, (const u8 *)src_buf + s->off, s->len);
+    bench_sink += mb_chksum(dst_buf, s->len);
+  }
+}
+
+// inet_chksum_pbuf() over a chain split at odd lengths, as a segment
+// built from several writes is
+static void
+sum_chain(void *arg, u32 n)
+{
+  struct pbuf *p = arg;
+
+  while(n--) {
+    bench_sink += inet_chksum_pbuf(p);
+  }
+}
+
+void
+bench_chksum()
+{
+  static const struct span spans[] = {
+    { 20, 0 }, { 64, 0 }, { 1500, 0 }, { 1500, 1 }, { 1500, 2 },
+    { 1500, 3 }, { 9000, 0 },
+  };
+  static const struct span copy1500 = { 1500, 0 };
+  static const struct span copy1500_2 = { 1500, 2 };
+  struct pbuf *chain, *q;
+  char name[64];
+  u32 i;
+
+  for(i=0; i<sizeof(src_buf) / 4; i++) {
+    src_buf[i] = i * 2654435761u;
+  }
+
+  bench_section("chksum: mb_chksum(), by length and offset from a word");
+  for(i=0; i<sizeof(spans) / sizeof(spans[0]); i++) {
+    snprintf(name, sizeof(name), "%u bytes at +%u", spans[i].len,
+        spans[i].off);
+    bench_run(name, sum, (void *)&spans[i], spans[i].len);
+  }
+
+  bench_section("chksum: copying");
+  bench_run("memcpy(), mb_chksum(), 1500 bytes (baseline)",
+      copy_then_sum, (void *)&copy1500, 1500);
+  bench_run("mb_chksum_copy(), 1500 bytes", sum_copy, (void *)&copy1500,
+      1500);
+  bench_run("mb_chksum_copy(), 1500 bytes at +2", sum_copy,
+      (void *)&copy1500_2, 1500);
+
+  bench_section("chksum: pbuf chains");
+  chain = pbuf_alloc(PBUF_RAW, 501, PBUF_RAM);
+  q = pbuf_alloc(PBUF_RAW, 500, PBUF_RAM);
+  pbuf_cat(chain, q);
+  q = pbuf_alloc(PBUF_RAW, 499, PBUF_RAM);
+  pbuf_cat(chain, q);
+  (void)pbuf_take(chain, src_buf, chain->tot_len);
+  bench_run("inet_chksum_pbuf(), 501 + 500 + 499 bytes", sum_chain, chain,
+      chain->tot_len);
+  pbuf_free(chain);
+}
@@ -0,0 +1,77 @@
+// bench_pbuf.c - pbuf allocation: each kind and size a driver or
+// application takes, allocated and freed at once, so the pools and the
+// heap stay warm.
+
+#include "jam_bench.h"
+
+#include "lwip/pbuf.h"
+
+struct alloc {
+  pbuf_layer layer;
+  u16 len;
+  pbuf_type type;
+};
+
+static void
+alloc_free(void *arg, u32 n)
+{
+  const struct alloc *a = arg;
+  struct pbuf *p;
+
+  while(n--) {
+    p = pbuf_alloc(a->layer, a->len, a->type);
+    bench_sink += p != NULL;
+    pbuf_free(p);
+  }
+}
+
+// A reference to application data, as udp_send() of a buffer takes
+static void
+ref_free(void *arg, u32 n)
+{
+  static u8 data[1024];
+  struct pbuf *p;
+
+  while(n--) {
+    p = pbuf_alloc(PBUF_TRANSPORT, sizeof(data), PBUF_REF);
+    p->payload = data;
+    bench_sink += p->len;
+    pbuf_free(p);
+  }
+}
+
+// A header pbuf put in front of a data one, as lwIP's output paths do
+static void
+cat_free(void *arg, u32 n)
+{
+  struct pbuf *h, *p;
+
+  while(n--) {
+    h = pbuf_alloc(PBUF_TRANSPORT, 0, PBUF_RAM);
+    p = pbuf_alloc(PBUF_RAW, 1024, PBUF_ROM);
+    pbuf_cat(h, p);
+    bench_sink += h->tot_len;
+    pbuf_free(h);
+  }
+}
+
+void
+bench_pbuf()
+{
+  static const struct alloc ram64 = { PBUF_TRANSPORT, 64, PBUF_RAM };
+  static const struct alloc ram1500 = { PBUF_RAW, 1500, PBUF_RAM };
+  static const struct alloc pool1500 = { PBUF_RAW, 1500, PBUF_POOL };
+  // Three pool pbufs at PBUF_POOL_BUFSIZE
+  static const struct alloc pool4k = { PBUF_RAW, 4096, PBUF_POOL };
+  static const struct alloc rom = { PBUF_RAW, 1024, PBUF_ROM };
+
+  bench_section("pbuf: alloc and free");
+  bench_run("PBUF_RAM, 64 bytes at PBUF_TRANSPORT", alloc_free,
+      (void *)&ram64, 0);
+  bench_run("PBUF_RAM, 1500 bytes", alloc_free, (void *)&ram1500, 0);
+  bench_run("PBUF_POOL, 1500 bytes", alloc_free, (void *)&pool1500, 0);
+  bench_run("PBUF_POOL, 4096 bytes chained", alloc_free, (void *)&pool4k, 0);
+  bench_run("PBUF_ROM", alloc_free, (void *)&rom, 0);
+  bench_run("PBUF_REF to a buffer", ref_free, NULL, 0);
+  bench_run("PBUF_RAM header, pbuf_cat of a PBUF_ROM", cat_free, NULL, 0);
+}
@@ -0,0 +1,177 @@
+// bench_tcp.c - tcp_input() of in-order data segments on an established
+// connection, read as they arrive, at full and small sizes and behind
+// other connections in tcp_active_pcbs.  The stack's ACKs, one every
+// second full segment, go out to the interface and are dropped.
+
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "jam_bench.h"
+
+#include "lwip/priv/tcp_priv.h"
+#include "lwip/prot/tcp.h"
+#include "lwip/tcp.h"
+
+#define LOCAL_PORT (7000)
+#define PEER_PORT  (40000)
+#define PEER_ISS   (0x10000000)
+#define LOCAL_ISS  (0x20000000)
+
+struct stream {
+  struct tcp_pcb *pcb;
+  u8 frame[IP_HLEN + TCP_HLEN + TCP_MSS];
+  u16 len;
+  u16 payload;
+  // Sequence number of the next segment, and the one `frame` carries
+  u32 seq;
+  u32 frame_seq;
+};
+
+static err_t
+recv_free(void *arg, struct tcp_pcb *pcb, struct pbuf *p, err_t err)
+{
+  if(p) {
+    tcp_recved(pcb, p->tot_len);
+    pbuf_free(p);
+  }
+  return ERR_OK;
+}
+
+static struct tcp_pcb *
+established(u16 peer_port)
+{
+  struct tcp_pcb *pcb = tcp_new();
+
+  if(!pcb) {
+    return NULL;
+  }
+  ip_addr_copy_from_ip4(pcb->local_ip, bench_local);
+  ip_addr_copy_from_ip4(pcb->remote_ip, bench_peer);
+  pcb->local_port = LOCAL_PORT;
+  pcb->remote_port = peer_port;
+  pcb->state = ESTABLISHED;
+  pcb->mss = TCP_MSS;
+  pcb->rcv_nxt = PEER_ISS;
+  pcb->rcv_ann_right_edge = pcb->rcv_nxt + pcb->rcv_wnd;
+  pcb->snd_nxt = pcb->lastack = pcb->snd_lbb = LOCAL_ISS;
+  pcb->snd_wl1 = PEER_ISS;
+  pcb->snd_wl2 = LOCAL_ISS;
+  pcb->snd_wnd = pcb->snd_wnd_max = TCP_WND;
+  TCP_REG_ACTIVE(pcb);
+  return pcb;
+}
+
+// The one's complement sum of a field changed from `old` to `now`, over
+// checksum `sum` (RFC 1624)
+static u16
+sum_update(u16 sum, u16 old, u16 now)
+{
+  u32 s = (u16)~sum + (u16)~old + now;
+
+  s = (s & 0xffff) + (s >> 16);
+  s = (s & 0xffff) + (s >> 16);
+  return ~s;
+}
+
+static void
+make_stream(struct stream *s, u16 payload)
+{
+  u8 l4[TCP_HLEN + TCP_MSS];
+  struct tcp_hdr *h = (struct tcp_hdr *)l4;
+
+  memset(l4, 0xa5, sizeof(l4));
+  h->src = lwip_htons(PEER_PORT);
+  h->dest = lwip_htons(LOCAL_PORT);
+  h->seqno = lwip_htonl(PEER_ISS);
+  h->ackno = lwip_htonl(LOCAL_ISS);
+  TCPH_HDRLEN_FLAGS_SET(h, TCP_HLEN / 4, TCP_ACK | TCP_PSH);
+  h->wnd = lwip_htons(TCP_WND);
+  h->chksum = 0;
+  h->urgp = 0;
+  s->payload = payload;
+  s->len = bench_frame(s->frame, IP_PROTO_TCP, l4, TCP_HLEN + payload,
+      offsetof(struct tcp_hdr, chksum));
+  s->seq = s->frame_seq = PEER_ISS;
+}
+
+// Move the frame's sequence number on to the next segment's
+static void
+next_seq(struct stream *s)
+{
+  struct tcp_hdr *h = (struct tcp_hdr *)(s->frame + IP_HLEN);
+  u16 sum = lwip_ntohs(h->chksum);
+
+  sum = sum_update(sum, s->frame_seq >> 16, s->seq >> 16);
+  sum = sum_update(sum, s->frame_seq & 0xffff, s->seq & 0xffff);
+  h->seqno = lwip_htonl(s->seq);
+  h->chksum = lwip_htons(sum);
+  s->frame_seq = s->seq;
+}
+
+static void
+input(void *arg, u32 n)
+{
+  struct stream *s = arg;
+
+  while(n--) {
+    next_seq(s);
+    bench_input(s->frame, s->len);
+    s->seq += s->payload;
+  }
+}
+
+static void
+run(const char *name, u16 payload, struct tcp_pcb *pcb)
+{
+  struct stream s;
+  u32 before;
+
+  make_stream(&s, payload);
+  s.pcb = pcb;
+  // Pick up where the last run left the connection
+  s.seq = pcb->rcv_nxt;
+  before = pcb->rcv_nxt;
+  bench_run(name, input, &s, payload);
+  if(pcb->rcv_nxt == before || pcb->rcv_nxt != s.seq) {
+    printf("  (segments not taken: rcv_nxt %08x, sent to %08x)\n",
+        pcb->rcv_nxt, s.seq);
+  }
+}
+
+void
+bench_tcp()
+{
+  struct tcp_pcb *pcb, *others[MEMP_NUM_TCP_PCB - 1];
+  u32 n = 0;
+  char name[64];
+
+  bench_netif_up();
+  pcb = established(PEER_PORT);
+  if(!pcb) {
+    printf("\ntcp: no PCB free\n");
+    return;
+  }
+  tcp_recv(pcb, recv_free);
+  // tcp_new() with the pool spent would take it for the others
+  tcp_setprio(pcb, TCP_PRIO_MAX);
+
+  bench_section("tcp: tcp_input() of in-order segments, read at once");
+  run("1460-byte segments", TCP_MSS, pcb);
+  run("64-byte segments", 64, pcb);
+  // Registered after it, so ahead of it in the list
+  while(n < MEMP_NUM_TCP_PCB - 1 &&
+        (others[n] = established(PEER_PORT + 1 + n)) != NULL) {
+    n++;
+  }
+  snprintf(name, sizeof(name), "1460-byte segments, %u connections ahead",
+      n);
+  run(name, TCP_MSS, pcb);
+  snprintf(name, sizeof(name), "64-byte segments, %u connections ahead", n);
+  run(name, 64, pcb);
+
+  while(n) {
+    tcp_abort(others[--n]);
+  }
+  tcp_abort(pcb);
+}
@@ -0,0 +1,114 @@
+// bench_udp.c - udp_input()'s demultiplexing: datagrams to the PCB bound
+// first, which udp_bind() leaves at the tail of udp_pcbs, behind more and
+// more others, and to a port nobody has (an ICMP port unreachable back).
+
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "jam_bench.h"
+
+#include "lwip/prot/udp.h"
+#include "lwip/udp.h"
+
+#define BASE_PORT (10000)
+#define PAYLOAD   (64)
+
+struct dgram {
+  u8 frame[IP_HLEN + UDP_HLEN + PAYLOAD];
+  u16 len;
+};
+
+static u32 received;
+
+static void
+recv_free(void *arg, struct udp_pcb *pcb, struct pbuf *p,
+    const ip_addr_t *addr, u16_t port)
+{
+  received++;
+  pbuf_free(p);
+}
+
+static void
+make_dgram(struct dgram *d, u16 port)
+{
+  u8 l4[UDP_HLEN + PAYLOAD];
+  struct udp_hdr *h = (struct udp_hdr *)l4;
+
+  memset(l4, 0x5a, sizeof(l4));
+  h->src = lwip_htons(40000);
+  h->dest = lwip_htons(port);
+  h->len = lwip_htons(sizeof(l4));
+  h->chksum = 0;
+  d->len = bench_frame(d->frame, IP_PROTO_UDP, l4, sizeof(l4),
+      offsetof(struct udp_hdr, chksum));
+}
+
+static void
+input(void *arg, u32 n)
+{
+  const struct dgram *d = arg;
+
+  while(n--) {
+    bench_input(d->frame, d->len);
+  }
+}
+
+// What the driver's part costs: the pool pbuf, the copy into it and the
+// free, with no stack
+static void
+baseline(void *arg, u32 n)
+{
+  const struct dgram *d = arg;
+  struct pbuf *p;
+
+  while(n--) {
+    p = pbuf_alloc(PBUF_RAW, d->len, PBUF_POOL);
+    pbuf_take(p, d->frame, d->len);
+    pbuf_free(p);
+  }
+}
+
+void
+bench_udp()
+{
+  static const u32 counts[] = { 1, 2, 4, 8, MEMP_NUM_UDP_PCB };
+  struct udp_pcb *pcbs[MEMP_NUM_UDP_PCB];
+  struct dgram to_first, to_none;
+  u32 bound = 0, i;
+  char name[64];
+
+  bench_netif_up();
+  make_dgram(&to_first, BASE_PORT);
+  make_dgram(&to_none, BASE_PORT - 1);
+
+  bench_section("udp: ip4_input() of 64-byte datagrams");
+  bench_run("pool pbuf, copy and free (baseline)", baseline, &to_first,
+      to_first.len);
+  for(i=0; i<sizeof(counts) / sizeof(counts[0]); i++) {
+    // What lwip_init() left free: the firmware's own PCBs are not here
+    while(bound < counts[i]) {
+      pcbs[bound] = udp_new();
+      if(!pcbs[bound]) {
+        break;
+      }
+      udp_bind(pcbs[bound], IP_ADDR_ANY, BASE_PORT + bound);
+      udp_recv(pcbs[bound], recv_free, NULL);
+      bound++;
+    }
+    if(bound < counts[i]) {
+      break;
+    }
+    snprintf(name, sizeof(name), "to the last of %u PCBs", bound);
+    received = 0;
+    bench_run(name, input, &to_first, to_first.len);
+    if(!received) {
+      printf("  (none delivered)\n");
+    }
+  }
+  snprintf(name, sizeof(name), "to no PCB, past %u", bound);
+  bench_run(name, input, &to_none, to_none.len);
+  while(bound) {
+    udp_remove(pcbs[--bound]);
+  }
+}
@@ -0,0 +1,89 @@
+// jam_bench.c - Runs the host micro-benchmarks (see jam_bench.h).
+//
+// usage: jam_bench [filter]
+//
+// With a filter only the rows whose names contain it run.
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "jam_bench.h"
+
+#include "sim.h"
+#include "timer.h"
+
+#include "lwip/init.h"
+
+volatile u32 bench_sink;
+
+static const char *filter;
+
+static u64
+now_ns()
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (u64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void
+bench_section(const char *title)
+{
+  printf("\n%s\n", title);
+}
+
+void
+bench_run(const char *name, bench_fn *fn, void *arg, u32 bytes)
+{
+  u64 t, best = ~0ull;
+  u32 n = 1, i;
+  double ns;
+
+  if(filter && !strstr(name, filter)) {
+    return;
+  }
+  // Calibrate, which also warms the caches
+  for(;;) {
+    t = now_ns();
+    fn(arg, n);
+    t = now_ns() - t;
+    if(t >= BENCH_PASS_NS || n >= (1u << 30)) {
+      break;
+    }
+    n = t < BENCH_PASS_NS / 64 ? n * 8 : n * 2;
+  }
+  for(i=0; i<BENCH_PASSES; i++) {
+    t = now_ns();
+    fn(arg, n);
+    t = now_ns() - t;
+    if(t < best) {
+      best = t;
+    }
+  }
+  ns = (double)best / n;
+  printf("  %-44s %12.0f/s %10.1f ns", name, 1e9 / ns, ns);
+  if(bytes) {
+    printf(" %9.1f MB/s", bytes / ns * 1e3);
+  }
+  printf("\n");
+}
+
+int
+main(int argc, char **argv)
+{
+  if(argc > 1) {
+    filter = argv[1];
+  }
+  sim_init();
+  lwip_init();
+  init_timers();
+
+  printf("  %-44s %14s %13s\n", "", "ops", "each");
+  bench_pbuf();
+  bench_chksum();
+  bench_udp();
+  bench_tcp();
+  return 0;
+}
@@ -0,0 +1,61 @@
+#ifndef _JAM_BENCH_H_
+#define _JAM_BENCH_H_
+
+// jam_bench.h - Host micro-benchmarks of lwIP and the firmware's hot
+// paths, built with the board's lwipopts.h against the simulated board
+// (sim.h), like the unit tests but optimised and without sanitizers.
+//
+// Each benchmark hands bench_run() a loop of `n` operations.  bench_run()
+// grows `n` until a pass takes BENCH_PASS_NS, keeps the fastest of
+// BENCH_PASSES passes and prints a row: operations a second, ns each and,
+// for an operation over `bytes`, MB/s.  The times are the host CPU's, not
+// the MicroBlaze's: compare rows of one host before and after a change to
+// the code under them, and rows against the baseline row of their
+// section, not across machines.
+
+#include "xil_types.h"
+
+#include "lwip/ip4_addr.h"
+#include "lwip/netif.h"
+
+#define BENCH_PASS_NS (20000000)
+#define BENCH_PASSES  (5)
+
+typedef void (bench_fn)(void *arg, u32 n);
+
+// Start a section of rows
+void bench_section(const char *title);
+
+// Time `fn` and print its row, unless the row's name misses the filter
+// given on the command line
+void bench_run(const char *name, bench_fn *fn, void *arg, u32 bytes);
+
+// Keeps results the compiler would otherwise drop
+extern volatile u32 bench_sink;
+
+// An interface at bench_local, bench_peer's subnet: frames from the peer
+// come in through bench_input(), and those sent are counted in bench_sent
+// and dropped
+extern struct netif bench_netif;
+extern ip4_addr_t bench_local;
+extern ip4_addr_t bench_peer;
+extern u32 bench_sent;
+
+void bench_netif_up(void);
+
+// Build in `frame` an IPv4 datagram from the peer carrying `l4_len` bytes
+// of `l4`, its checksum, at `l4_chksum` bytes in, filled in.  Returns its
+// length.
+u16 bench_frame(u8 *frame, u8 proto, const u8 *l4, u16 l4_len,
+    u16 l4_chksum);
+
+// Pass `frame` up in a PBUF_POOL pbuf, as eth0's driver would
+void bench_input(const u8 *frame, u16 len);
+
+// The suites
+void bench_pbuf(void);
+void bench_chksum(void);
+void bench_udp(void);
+void bench_tcp(void);
+
+#endif // _JAM_BENCH_H_
@@ -0,0 +1,49 @@
+// fuzz_kv.c - init_kv() and kv_get() over arbitrary config store sectors.
+//
+// The input is laid over both sectors (the rest stays erased), as a power
+// cut or bit rot could leave them.
+
+#include <string.h>
+
+#include "flash.h"
+#include "flashsim.h"
+#include "kv.h"
+#include "sim.h"
+#include "spi.h"
+#include "timer.h"
+
+#include "lwip/init.h"
+
+int LLVMFuzzerTestOneInput(const u8 *data, size_t size);
+
+static u8 booted;
+
+int
+LLVMFuzzerTestOneInput(const u8 *data, size_t size)
+{
+  u8 *mem, buf[KV_MAX_VALUE];
+  u32 base, len;
+  int key;
+
+  if(!booted) {
+    sim_init();
+    lwip_init();
+    init_timers();
+    init_spi();
+    init_flash();
+    booted = 1;
+  }
+
+  mem = flashsim_mem();
+  base = flash_rsv_addr(FLASH_RSV_KV);
+  len = 2 * flash_rsv_size();
+  memset(mem + base, 0xff, len);
+  memcpy(mem + base, data, size < len ? size : len);
+  flash_cache_invalidate(0, flash_info.size);
+
+  init_kv();
+  for(key=0; key<256; key++) {
+    kv_get(key, buf, sizeof(buf));
+  }
+  return 0;
+}
@@ -0,0 +1,46 @@
+// fuzz_wbreg.c - wbreg_exec() on arbitrary requests, in a buffer sized the
+// way wbreg_recv() sizes it, so a reply longer than wbreg_reply_len()
+// promised overruns.
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "sim.h"
+#include "timer.h"
+#include "wbreg.h"
+
+#include "lwip/init.h"
+
+int LLVMFuzzerTestOneInput(const u8 *data, size_t size);
+
+static u8 booted;
+
+int
+LLVMFuzzerTestOneInput(const u8 *data, size_t size)
+{
+  struct wbreg_hdr *h;
+  u32 need;
+  u8 *buf;
+
+  if(!booted) {
+    sim_init();
+    lwip_init();
+    init_timers();
+    booted = 1;
+  }
+  if(size < sizeof(*h) || size > ETH_UDP_MAX) {
+    return 0;
+  }
+  need = wbreg_reply_len((const struct wbreg_hdr *)data);
+  buf = malloc(need > size ? need : size);
+  memcpy(buf, data, size);
+  h = (struct wbreg_hdr *)buf;
+
+  // These need the UDP sender that wbreg_recv() has
+  if(h->op != WBREG_OP_WATCH && h->op != WBREG_OP_UNWATCH &&
+     h->op != WBREG_OP_JOIN && h->op != WBREG_OP_LEAVE) {
+    wbreg_exec(h, (u32 *)(h + 1), (size - sizeof(*h)) / 4);
+  }
+  free(buf);
+  return 0;
+}
@@ -0,0 +1,362 @@
+// flashsim.c - Model of the Micron N25Q SPI flash for host builds (see
+// flashsim.h).
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "flashsim.h"
+
+#define OP_PP     (0x02)
+#define OP_READ   (0x03)
+#define OP_WRDI   (0x04)
+#define OP_RDSR   (0x05)
+#define OP_WREN   (0x06)
+#define OP_FAST   (0x0b)
+#define OP_PP4    (0x12)
+#define OP_SFDP   (0x5a)
+#define OP_RDID   (0x9e)
+#define OP_RDID2  (0x9f)
+#define OP_RDEAR  (0xc8)
+#define OP_WREAR  (0xc5)
+#define OP_BULK   (0xc7)
+#define OP_BULK2  (0x60)
+#define OP_PES    (0x75)
+#define OP_PER    (0x7a)
+#define OP_WRVCR  (0x81)
+#define OP_RDVCR  (0x85)
+#define OP_WREVCR (0x61)
+#define OP_RDEVCR (0x65)
+
+// Power-on configuration registers: default dummy counts, XIP off, no
+// wrap; extended SPI protocol, 30 ohm driver
+#define VCR_RESET  (0xfb)
+#define EVCR_RESET (0xdf)
+
+#define SR_WIP (0x01)
+#define SR_WEL (0x02)
+
+#define PAGE_SIZE (256)
+
+// Micron, N25Q 3 V, 128 Mb; then the length of the unique ID
+static const u8 rdid[4] = { 0x20, 0xba, 0x18, 0x10 };
+static const u8 uid[16] = {
+  0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77,
+  0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff
+};
+
+// Read and erase opcodes: address bytes, power-on dummy bytes (as the SPI
+// core counts them), lines of the dummy phase if the VCR sets its count,
+// and erase size
+static const struct {
+  u8 opcode;
+  u8 addr_bytes;
+  u8 dummy;
+  u8 lines;
+  u32 erase;
+} ops[] = {
+  { OP_READ, 3, 0, 0, 0 }, { 0x13, 4, 0, 0, 0 },
+  { OP_FAST, 3, 1, 1, 0 }, { 0x0c, 4, 1, 1, 0 },
+  { 0x3b,    3, 1, 1, 0 }, { 0x3c, 4, 1, 1, 0 },
+  { 0xbb,    3, 2, 2, 0 }, { 0xbc, 4, 2, 2, 0 },
+  { 0x6b,    3, 1, 1, 0 }, { 0x6c, 4, 1, 1, 0 },
+  { 0xeb,    3, 5, 4, 0 }, { 0xec, 4, 5, 4, 0 },
+  { OP_SFDP, 3, 1, 0, 0 },
+  { OP_PP,   3, 0, 0, 0 }, { OP_PP4, 4, 0, 0, 0 },
+  { 0x20,    3, 0, 0, 4 << 10 },  { 0x21, 4, 0, 0, 4 << 10 },
+  { 0x52,    3, 0, 0, 32 << 10 }, { 0x5c, 4, 0, 0, 32 << 10 },
+  { 0xd8,    3, 0, 0, 64 << 10 }, { 0xdc, 4, 0, 0, 64 << 10 }
+};
+
+#define NUM_OPS (sizeof(ops) / sizeof(ops[0]))
+
+static u8 *mem;
+
+static struct {
+  int sel;
+  // Bytes of the current command so far, and its entry in ops[] (-1 if it
+  // has no address)
+  u32 pos;
+  u8 opcode;
+  int op;
+  u32 addr;
+  u32 hdr_len;
+  u8 page[PAGE_SIZE];
+  u32 page_len;
+  u8 ear;
+  u8 vcr;
+  u8 evcr;
+  u8 wel;
+  u32 busy;
+  // Non-zero while the command keeping WIP set is an erase, and the busy
+  // polls it had left when it was suspended
+  u8 erasing;
+  u32 suspended;
+  u32 suspends;
+  u32 ops;
+  u32 cut;
+  u8 garble;
+} fl;
+
+u8 *
+flashsim_mem()
+{
+  if(!mem) {
+    mem = malloc(FLASHSIM_SIZE);
+  }
+  return mem;
+}
+
+void
+flashsim_reset()
+{
+  memset(flashsim_mem(), 0xff, FLASHSIM_SIZE);
+  memset(&fl, 0, sizeof(fl));
+  fl.cut = ~0u;
+  fl.vcr = VCR_RESET;
+  fl.evcr = EVCR_RESET;
+}
+
+u32
+flashsim_ops()
+{
+  return fl.ops;
+}
+
+u32
+flashsim_suspends()
+{
+  return fl.suspends;
+}
+
+void
+flashsim_garble(u8 opcode)
+{
+  fl.garble = opcode;
+}
+
+u8
+flashsim_vcr()
+{
+  return fl.vcr;
+}
+
+u8
+flashsim_evcr()
+{
+  return fl.evcr;
+}
+
+// Dummy bytes of ops[i]: the VCR's count if it sets one, in the SPI core's
+// FIFO bytes
+static u32
+op_dummy(int i)
+{
+  u32 n = fl.vcr >> 4;
+
+  if(!ops[i].lines || n == 0 || n == 15) {
+    return ops[i].dummy;
+  }
+  return n * ops[i].lines / 8;
+}
+
+void
+flashsim_cut(u32 n)
+{
+  fl.cut = fl.ops + n;
+}
+
+// Returns non-zero if a program or erase may go ahead, counting it
+static int
+flashsim_accept()
+{
+  if(!fl.wel || fl.busy || fl.suspended) {
+    return 0;
+  }
+  fl.wel = 0;
+  fl.busy = FLASHSIM_BUSY_POLLS;
+  if(fl.ops == fl.cut) {
+    return 0;
+  }
+  fl.ops++;
+  return 1;
+}
+
+// Complete the command at deselect
+static void
+flashsim_end()
+{
+  u32 i, base, size;
+
+  if(fl.pos == 0) {
+    return;
+  }
+  if(fl.busy && fl.opcode != OP_RDSR && fl.opcode != OP_PES) {
+    return;
+  }
+
+  switch(fl.opcode) {
+  case OP_PES:
+    if(fl.busy && fl.erasing) {
+      fl.suspended = fl.busy;
+      fl.busy = 0;
+      fl.suspends++;
+    }
+    return;
+  case OP_PER:
+    if(fl.suspended) {
+      fl.busy = fl.suspended;
+      fl.suspended = 0;
+    }
+    return;
+  case OP_WREN:
+    fl.wel = 1;
+    return;
+  case OP_WRDI:
+    fl.wel = 0;
+    return;
+  case OP_WREAR:
+  case OP_WRVCR:
+  case OP_WREVCR:
+    fl.wel = 0;
+    return;
+  case OP_BULK:
+  case OP_BULK2:
+    if(flashsim_accept()) {
+      memset(mem, 0xff, FLASHSIM_SIZE);
+      fl.erasing = 1;
+    }
+    return;
+  }
+
+  if(fl.op < 0 || fl.pos < fl.hdr_len) {
+    return;
+  }
+  size = ops[fl.op].erase;
+  if(size) {
+    if(flashsim_accept()) {
+      memset(mem + (fl.addr & ~(size - 1)), 0xff, size);
+      fl.erasing = 1;
+    }
+    return;
+  }
+  if(fl.opcode == OP_PP || fl.opcode == OP_PP4) {
+    if(flashsim_accept()) {
+      fl.erasing = 0;
+      // Data past the end of the page wraps to its start
+      base = fl.addr & ~(PAGE_SIZE - 1);
+      for(i=0; i<fl.page_len; i++) {
+        mem[base + ((fl.addr + i) & (PAGE_SIZE - 1))] &= fl.page[i];
+      }
+    }
+  }
+}
+
+void
+flashsim_select(int sel)
+{
+  if(fl.sel && !sel) {
+    flashsim_end();
+  }
+  fl.sel = sel;
+  fl.pos = 0;
+  fl.page_len = 0;
+}
+
+u8
+flashsim_xfer(u8 mosi)
+{
+  u32 n = fl.pos++;
+  u32 i;
+
+  if(!fl.sel) {
+    return 0xff;
+  }
+
+  if(n == 0) {
+    fl.opcode = mosi;
+    fl.op = -1;
+    fl.addr = 0;
+    for(i=0; i<NUM_OPS; i++) {
+      if(ops[i].opcode == mosi) {
+        fl.op = i;
+        fl.hdr_len = 1 + ops[i].addr_bytes + op_dummy(i);
+        break;
+      }
+    }
+    return 0xff;
+  }
+
+  switch(fl.opcode) {
+  case OP_RDID:
+  case OP_RDID2:
+    n--;
+    if(n < sizeof(rdid)) {
+      return rdid[n];
+    }
+    n -= sizeof(rdid);
+    return n < sizeof(uid) ? uid[n] : 0x00;
+  case OP_RDSR:
+    i = (fl.busy ? SR_WIP : 0) | (fl.wel ? SR_WEL : 0);
+    if(fl.busy) {
+      fl.busy--;
+    }
+    return i;
+  case OP_RDEAR:
+    return fl.ear;
+  case OP_WREAR:
+    if(n == 1 && fl.wel && !fl.busy) {
+      fl.ear = mosi;
+    }
+    return 0xff;
+  case OP_RDVCR:
+    return fl.vcr;
+  case OP_RDEVCR:
+    return fl.evcr;
+  case OP_WRVCR:
+    if(n == 1 && fl.wel && !fl.busy) {
+      fl.vcr = mosi;
+    }
+    return 0xff;
+  case OP_WREVCR:
+    if(n == 1 && fl.wel && !fl.busy) {
+      fl.evcr = mosi;
+    }
+    return 0xff;
+  }
+
+  if(fl.op < 0) {
+    return 0xff;
+  }
+
+  // Address, most significant byte first
+  if(n <= ops[fl.op].addr_bytes) {
+    fl.addr = (fl.addr << 8) | mosi;
+    if(n == ops[fl.op].addr_bytes) {
+      if(ops[fl.op].addr_bytes == 3) {
+        fl.addr |= (u32)fl.ear << 24;
+      }
+      fl.addr &= FLASHSIM_SIZE - 1;
+    }
+    return 0xff;
+  }
+  if(n < fl.hdr_len) {
+    return 0xff;
+  }
+
+  if(fl.opcode == OP_PP || fl.opcode == OP_PP4) {
+    // The last PAGE_SIZE bytes sent are programmed
+    if(fl.page_len == PAGE_SIZE) {
+      memmove(fl.page, fl.page + 1, PAGE_SIZE - 1);
+      fl.page_len--;
+    }
+    fl.page[fl.page_len++] = mosi;
+    return 0xff;
+  }
+  if(ops[fl.op].erase || fl.opcode == OP_SFDP || fl.busy) {
+    return 0xff;
+  }
+
+  // Reads wrap at the end of the part
+  i = (fl.addr + n - fl.hdr_len) & (FLASHSIM_SIZE - 1);
+  return fl.opcode == fl.garble ? mem[i] ^ 0x10 : mem[i];
+}
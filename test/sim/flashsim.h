@@ -0,0 +1,56 @@
+#ifndef _FLASHSIM_H_
+#define _FLASHSIM_H_
+
+// flashsim.h - Model of the Micron N25Q SPI flash for host builds.
+//
+// A 16 MB part without SFDP tables, so init_flash() keeps its N25Q
+// defaults.  It answers RDID, RDSR, WREN, WREAR, page program, the 4 KB,
+// 32 KB, 64 KB and bulk erases and every read mode of flash.h, with their
+// dummy bytes: the power-on counts, or the volatile configuration
+// register's (RDVCR/WRVCR; RDEVCR/WREVCR only hold their value).  Programs and
+// erases take effect when slave select is released, as on the part, and keep
+// the write-in-progress bit set for FLASHSIM_BUSY_POLLS status reads.  An erase
+// may be suspended (PES) and resumed (PER); while suspended, reads see the part
+// and programs and erases are refused.
+//
+// flashsim_cut() simulates a power cut: once the given number of programs
+// and erases have been accepted, later ones are dropped, so a test can
+// check what a reset at that point would leave on flash.
+
+#include "xil_types.h"
+
+#define FLASHSIM_SIZE (16 << 20)
+
+// RDSR polls a program or erase keeps WIP set for
+#define FLASHSIM_BUSY_POLLS (2)
+
+// Erase the whole part and clear the power cut
+void flashsim_reset();
+
+// Slave select `sel` (non-zero selects).  Deselecting ends the command.
+void flashsim_select(int sel);
+
+// Shift one byte in and return the byte shifted out
+u8 flashsim_xfer(u8 mosi);
+
+// Flash contents, for tests to inspect or preload
+u8 *flashsim_mem();
+
+// Programs and erases accepted since flashsim_reset()
+u32 flashsim_ops();
+
+// Erase suspends since flashsim_reset()
+u32 flashsim_suspends();
+
+// Flip a data bit in reads with `opcode` (0 for none), as a data line with
+// a fault would, until flashsim_reset()
+void flashsim_garble(u8 opcode);
+
+// Volatile and enhanced volatile configuration registers
+u8 flashsim_vcr();
+u8 flashsim_evcr();
+
+// Drop every program and erase after the next `ops`
+void flashsim_cut(u32 ops);
+
+#endif // _FLASHSIM_H_
@@ -0,0 +1,95 @@
+#ifndef XIL_IO_H
+#define XIL_IO_H
+
+// xil_io.h - Host stand-in for the standalone BSP's xil_io.h.
+//
+// The BSP's version dereferences the address; this one hands every access
+// to the simulated bus (sim.h).  The host build copies it over the BSP's
+// in its include directory, so the drivers' own #include "xil_io.h" finds
+// it too.
+
+#include "xil_types.h"
+#include "xil_printf.h"
+
+u32 sim_read(UINTPTR addr, u32 size);
+void sim_write(UINTPTR addr, u32 val, u32 size);
+
+u16 Xil_EndianSwap16(u16 Data);
+u32 Xil_EndianSwap32(u32 Data);
+
+#define INLINE inline
+
+#define INST_SYNC
+#define DATA_SYNC
+
+static INLINE u8
+Xil_In8(UINTPTR Addr)
+{
+  return sim_read(Addr, 1);
+}
+
+static INLINE u16
+Xil_In16(UINTPTR Addr)
+{
+  return sim_read(Addr, 2);
+}
+
+static INLINE u32
+Xil_In32(UINTPTR Addr)
+{
+  return sim_read(Addr, 4);
+}
+
+static INLINE void
+Xil_Out8(UINTPTR Addr, u8 Value)
+{
+  sim_write(Addr, Value, 1);
+}
+
+static INLINE void
+Xil_Out16(UINTPTR Addr, u16 Value)
+{
+  sim_write(Addr, Value, 2);
+}
+
+static INLINE void
+Xil_Out32(UINTPTR Addr, u32 Value)
+{
+  sim_write(Addr, Value, 4);
+}
+
+// The CPU is little-endian, like the host
+#define Xil_In16LE  Xil_In16
+#define Xil_In32LE  Xil_In32
+#define Xil_Out16LE Xil_Out16
+#define Xil_Out32LE Xil_Out32
+#define Xil_Htons   Xil_EndianSwap16
+#define Xil_Htonl   Xil_EndianSwap32
+#define Xil_Ntohs   Xil_EndianSwap16
+#define Xil_Ntohl   Xil_EndianSwap32
+
+static INLINE u16
+Xil_In16BE(UINTPTR Addr)
+{
+  return Xil_EndianSwap16(Xil_In16(Addr));
+}
+
+static INLINE u32
+Xil_In32BE(UINTPTR Addr)
+{
+  return Xil_EndianSwap32(Xil_In32(Addr));
+}
+
+static INLINE void
+Xil_Out16BE(UINTPTR Addr, u16 Value)
+{
+  Xil_Out16(Addr, Xil_EndianSwap16(Value));
+}
+
+static INLINE void
+Xil_Out32BE(UINTPTR Addr, u32 Value)
+{
+  Xil_Out32(Addr, Xil_EndianSwap32(Value));
+}
+
+#endif // XIL_IO_H
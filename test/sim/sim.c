@@ -0,0 +1,430 @@
+// sim.c - Simulated board for host builds of the firmware (see sim.h).
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "xil_assert.h"
+#include "xparameters.h"
+#include "xtmrctr_l.h"
+
+#include "lwip/sys.h"
+
+#include "flashsim.h"
+#include "intr.h"
+#include "sched.h"
+#include "sim.h"
+#include "spisim.h"
+#include "timebase.h"
+#include "wbreg.h"
+#include "work.h"
+
+#define SIM_MAX_REGIONS (8)
+#define SIM_MAX_IRQS    (32)
+
+struct sim_region {
+  u32 base;
+  u32 len;
+  sim_read_fn rd;
+  sim_write_fn wr;
+  void *dev;
+  // Memory regions
+  u8 *ram;
+};
+
+static struct sim_region regions[SIM_MAX_REGIONS];
+static u32 num_regions;
+
+static u64 cycles;
+// Of them, those sim_idle() spent
+static u64 idle_cycles;
+
+// INTC inputs: handler, its argument and the line's level
+static struct {
+  XInterruptHandler fn;
+  void *ref;
+  u8 level;
+} irqs[SIM_MAX_IRQS];
+
+// CPU interrupts unmasked, and whether an ISR is running
+static u8 intr_on;
+static u8 in_isr;
+
+static u8 *wishbone;
+
+void
+sim_map(u32 base, u32 len, sim_read_fn rd, sim_write_fn wr, void *dev)
+{
+  struct sim_region *r;
+
+  if(num_regions == SIM_MAX_REGIONS) {
+    fprintf(stderr, "sim: too many regions\n");
+    abort();
+  }
+  r = &regions[num_regions++];
+  memset(r, 0, sizeof(*r));
+  r->base = base;
+  r->len = len;
+  r->rd = rd;
+  r->wr = wr;
+  r->dev = dev;
+}
+
+u8 *
+sim_map_ram(u32 base, u32 len)
+{
+  u8 *ram = calloc(1, len);
+
+  sim_map(base, len, NULL, NULL, NULL);
+  regions[num_regions - 1].ram = ram;
+  return ram;
+}
+
+static struct sim_region *
+sim_find(UINTPTR addr, u32 size)
+{
+  struct sim_region *r;
+  u32 i;
+
+  // Newest first, so a model can cover part of a region mapped before it
+  for(i=num_regions; i--; ) {
+    r = &regions[i];
+    if(addr >= r->base && addr - r->base + size <= r->len) {
+      return r;
+    }
+  }
+  fprintf(stderr, "sim: bus error at %#lx\n", (unsigned long)addr);
+  abort();
+}
+
+u32
+sim_read(UINTPTR addr, u32 size)
+{
+  struct sim_region *r = sim_find(addr, size);
+  u32 off = addr - r->base;
+  u32 v = 0;
+
+  if(!r->ram) {
+    return r->rd(r->dev, off, size);
+  }
+  memcpy(&v, r->ram + off, size);
+  return v;
+}
+
+void
+sim_write(UINTPTR addr, u32 val, u32 size)
+{
+  struct sim_region *r = sim_find(addr, size);
+  u32 off = addr - r->base;
+
+  if(!r->ram) {
+    r->wr(r->dev, off, val, size);
+    return;
+  }
+  memcpy(r->ram + off, &val, size);
+}
+
+// axi_timer_0: only counter 1, free-running, is read
+static u32
+timer_read(void *dev, u32 off, u32 size)
+{
+  if(off == XTC_TIMER_COUNTER_OFFSET + XTC_TCR_OFFSET) {
+    cycles += SIM_READ_CYCLES;
+    return (u32)cycles;
+  }
+  return 0;
+}
+
+static void
+timer_write(void *dev, u32 off, u32 val, u32 size)
+{
+}
+
+void
+sim_reset()
+{
+  u32 i;
+
+  for(i=0; i<num_regions; i++) {
+    free(regions[i].ram);
+  }
+  num_regions = 0;
+  wishbone = NULL;
+  memset(irqs, 0, sizeof(irqs));
+  intr_on = 1;
+  in_isr = 0;
+}
+
+// The drivers build with their asserts here, and one that fails fails the
+// test rather than spinning in Xil_Assert()
+static void
+sim_assert(const char8 *file, s32 line)
+{
+  fprintf(stderr, "sim: driver assert at %s:%d\n", file, line);
+  abort();
+}
+
+void
+sim_init()
+{
+  Xil_AssertSetCallback(sim_assert);
+  sim_reset();
+  wishbone = sim_map_ram(WBREG_BASE, WBREG_SIZE);
+  sim_map(XPAR_TMRCTR_0_BASEADDR, 0x10000, timer_read, timer_write, NULL);
+  flashsim_reset();
+  spisim_reset();
+}
+
+u8 *
+sim_wishbone()
+{
+  return wishbone;
+}
+
+u64
+sim_cycles()
+{
+  return cycles;
+}
+
+void
+sim_advance(u64 n)
+{
+  cycles += n;
+}
+
+void
+sim_idle(u64 n)
+{
+  cycles += n;
+  idle_cycles += n;
+}
+
+// Take every interrupt that is pending and connected
+static void
+sim_irq_take()
+{
+  u32 id;
+  int taken = 1;
+
+  while(taken && intr_on && !in_isr) {
+    taken = 0;
+    for(id=0; id<SIM_MAX_IRQS; id++) {
+      if(irqs[id].level && irqs[id].fn) {
+        in_isr = 1;
+        irqs[id].fn(irqs[id].ref);
+        in_isr = 0;
+        taken = 1;
+      }
+    }
+  }
+}
+
+void
+sim_irq(u8 id, int level)
+{
+  irqs[id].level = level != 0;
+  sim_irq_take();
+}
+
+XInterruptHandler
+sim_irq_handler(u8 id)
+{
+  return irqs[id].fn;
+}
+
+// The tick's work item (timebase_on_tick())
+static struct work *tick_work;
+
+// sched_add_poll()'s hooks
+static struct sched_hook *poll_hooks;
+
+void
+sim_run_ms(u32 ms)
+{
+  struct sched_hook *h;
+
+  for(; ms; ms--) {
+    cycles += TIMEBASE_CYCLES_PER_MS - cycles % TIMEBASE_CYCLES_PER_MS;
+    if(tick_work) {
+      work_schedule(tick_work);
+    }
+    while(work_run()) {
+    }
+    // Once a millisecond, as polls that always find work would never let
+    // the loop finish
+    for(h = poll_hooks; h; h = h->next) {
+      h->fn(h->arg);
+    }
+    while(work_run()) {
+    }
+  }
+}
+
+int
+sim_run_until(int (*done)(void *arg), void *arg, u32 ms)
+{
+  while(!done(arg)) {
+    if(ms-- == 0) {
+      return 0;
+    }
+    sim_run_ms(1);
+  }
+  return 1;
+}
+
+// Stand-ins for intr.c
+
+int
+intr_connect(u8 id, XInterruptHandler handler, void *ref)
+{
+  irqs[id].fn = handler;
+  irqs[id].ref = ref;
+  sim_irq_take();
+  return 0;
+}
+
+int
+intr_connect_fast(u8 id, XInterruptHandler handler, void *ref)
+{
+  return intr_connect(id, handler, ref);
+}
+
+void
+intr_set_prio(u8 id, u8 prio)
+{
+}
+
+void
+intr_enable(u8 id)
+{
+}
+
+void
+intr_disable(u8 id)
+{
+}
+
+u32
+intr_lock()
+{
+  u32 msr = intr_on;
+
+  intr_on = 0;
+  return msr;
+}
+
+void
+intr_unlock(u32 msr)
+{
+  if(msr) {
+    intr_on = 1;
+    sim_irq_take();
+  }
+}
+
+void
+intr_wait()
+{
+  intr_on = 1;
+  sim_run_ms(1);
+}
+
+// Stand-ins for sched.c: sim_run_ms() is the loop, idle only as long as
+// sim_idle() says
+
+u64
+sched_idle_cycles()
+{
+  return idle_cycles;
+}
+
+void
+sched_add_poll(struct sched_hook *h)
+{
+  struct sched_hook **list = &poll_hooks;
+
+  while(*list && *list != h) {
+    list = &(*list)->next;
+  }
+  if(!*list) {
+    h->next = NULL;
+    *list = h;
+  }
+}
+
+// Stand-ins for timebase.c.  Each reads the timer on the board, so each
+// takes as long as a read.
+
+u64
+timebase_cycles()
+{
+  cycles += SIM_READ_CYCLES;
+  return cycles;
+}
+
+u64
+timebase_widen(u32 stamp)
+{
+  u64 now = timebase_cycles();
+
+  return now - ((u32)now - stamp);
+}
+
+u64
+timebase_us()
+{
+  return timebase_cycles() / TIMEBASE_CYCLES_PER_US;
+}
+
+u32
+timebase_ms()
+{
+  return timebase_cycles() / TIMEBASE_CYCLES_PER_MS;
+}
+
+u32
+timebase_since_ms(u32 ms)
+{
+  u64 now = timebase_cycles();
+
+  return now - (u64)ms * TIMEBASE_CYCLES_PER_MS;
+}
+
+u32_t
+sys_now()
+{
+  return timebase_ms();
+}
+
+void
+timebase_on_tick(struct work *w)
+{
+  tick_work = w;
+}
+
+void
+timebase_on_capture(void (*fn)(u64 cycles))
+{
+}
+
+void
+timebase_set_sampler(void (*fn)(u32 pc))
+{
+}
+
+void
+timebase_set_monitor(void (*fn)(u32 pc))
+{
+}
+
+void
+timebase_set_alarm(void (*fn)(u32 ms))
+{
+}
+
+void
+delay_us(u32 us)
+{
+  cycles += (u64)us * TIMEBASE_CYCLES_PER_US;
+}
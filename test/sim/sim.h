@@ -0,0 +1,75 @@
+#ifndef _SIM_H_
+#define _SIM_H_
+
+// sim.h - Simulated board for host builds of the firmware.
+//
+// The firmware reaches its peripherals through Xil_In32() and friends; the
+// host build's xil_io.h (sim/include) sends those to sim_read() and
+// sim_write(), which dispatch on the address to a region: plain memory
+// (the Wishbone window) or a device model (the SPI core, the timer).  An
+// access outside every region aborts, as a bus error would hang the board.
+//
+// Time only moves when the test says so: the timer (at TIMEBASE_HZ, as on
+// the board) counts SIM_READ_CYCLES per read of its counter, delay_us()
+// adds its delay and sim_run_ms() steps whole milliseconds, running
+// interrupts, work and timers as the main loop would.  Interrupts are taken
+// as soon as a model raises its line with the CPU's interrupts unmasked, so
+// ISRs run where they would on the board.
+
+#include "xil_types.h"
+#include "xil_exception.h"
+
+// Cycles one read of the timer's counter takes
+#define SIM_READ_CYCLES (10)
+
+// Register access handlers of a device model.  `off` is from the region's
+// base and `size` is 1, 2 or 4.
+typedef u32 (*sim_read_fn)(void *dev, u32 off, u32 size);
+typedef void (*sim_write_fn)(void *dev, u32 off, u32 val, u32 size);
+
+// Map `len` bytes at `base` to a device model.  It answers for them in
+// front of any region mapped before it.
+void sim_map(u32 base, u32 len, sim_read_fn rd, sim_write_fn wr, void *dev);
+
+// Map `len` bytes at `base` to zeroed memory, and return it
+u8 *sim_map_ram(u32 base, u32 len);
+
+// Forget every mapping and reset interrupts.  sim_init() maps the board
+// again.  Time keeps running, and the tick's work item, poll hooks and the
+// firmware's own state are kept, as timers armed by the firmware expect
+// it.
+void sim_reset();
+
+// Map the board: the Wishbone window, the SPI core with the flash behind
+// it (spisim.c, flashsim.c) and the timer
+void sim_init();
+
+u32 sim_read(UINTPTR addr, u32 size);
+void sim_write(UINTPTR addr, u32 val, u32 size);
+
+// Timer cycles since the program started
+u64 sim_cycles();
+void sim_advance(u64 cycles);
+
+// Advance time by `cycles` the main loop spends idle (sched_idle_cycles())
+void sim_idle(u64 cycles);
+
+// Run `ms` milliseconds of the main loop: each millisecond a tick, pending
+// work and one pass of the sched.h poll hooks
+void sim_run_ms(u32 ms);
+
+// Run the main loop until `done` returns non-zero, for up to `ms`
+// milliseconds.  Returns non-zero if it did.
+int sim_run_until(int (*done)(void *arg), void *arg, u32 ms);
+
+// Set the level of INTC input `id`, taking the interrupt if it is high,
+// connected and the CPU's interrupts are unmasked
+void sim_irq(u8 id, int level);
+
+// Interrupt handler connected to `id`, or NULL
+XInterruptHandler sim_irq_handler(u8 id);
+
+// Wishbone window memory
+u8 *sim_wishbone();
+
+#endif // _SIM_H_
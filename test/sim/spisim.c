@@ -0,0 +1,191 @@
+// spisim.c - Model of the AXI Quad SPI core for host builds (see spisim.h).
+
+#include "xparameters.h"
+#include "xspi_l.h"
+
+#include "flashsim.h"
+#include "sim.h"
+#include "spisim.h"
+
+#define SPISIM_FIFO_DEPTH XPAR_SPI_0_FIFO_DEPTH
+
+// Register values after a software reset
+#define SPISIM_CR_RESET  (XSP_CR_TRANS_INHIBIT_MASK | XSP_CR_MANUAL_SS_MASK)
+#define SPISIM_SSR_RESET (0xffffffff)
+
+static struct {
+  u32 dgier;
+  u32 ipisr;
+  u32 ipier;
+  u32 cr;
+  u32 ssr;
+  // Bytes written while the core could not send them
+  u8 tx[SPISIM_FIFO_DEPTH];
+  u32 tx_count;
+  u8 rx[SPISIM_FIFO_DEPTH];
+  u32 rx_head;
+  u32 rx_count;
+  u32 bytes;
+} spi;
+
+// Drive the INTC input from the interrupt registers
+static void
+spisim_update_irq()
+{
+  sim_irq(XPAR_INTC_0_SPI_0_VEC_ID,
+      (spi.dgier & XSP_GINTR_ENABLE_MASK) && (spi.ipisr & spi.ipier));
+}
+
+static int
+spisim_running()
+{
+  return (spi.cr & XSP_CR_ENABLE_MASK) && (spi.cr & XSP_CR_MASTER_MODE_MASK) &&
+      !(spi.cr & XSP_CR_TRANS_INHIBIT_MASK);
+}
+
+// Send whatever the transmit FIFO holds
+static void
+spisim_drain()
+{
+  u32 i;
+  u8 miso;
+
+  if(!spisim_running() || !spi.tx_count) {
+    return;
+  }
+  for(i=0; i<spi.tx_count; i++) {
+    miso = (spi.ssr & 1) ? 0xff : flashsim_xfer(spi.tx[i]);
+    if(spi.rx_count == SPISIM_FIFO_DEPTH) {
+      spi.ipisr |= XSP_INTR_RX_OVERRUN_MASK;
+      continue;
+    }
+    spi.rx[(spi.rx_head + spi.rx_count) % SPISIM_FIFO_DEPTH] = miso;
+    spi.rx_count++;
+  }
+  spi.bytes += spi.tx_count;
+  spi.tx_count = 0;
+  spi.ipisr |= XSP_INTR_TX_EMPTY_MASK | XSP_INTR_TX_HALF_EMPTY_MASK;
+  spisim_update_irq();
+}
+
+static void
+spisim_soft_reset()
+{
+  spi.dgier = 0;
+  spi.ipisr = 0;
+  spi.ipier = 0;
+  spi.cr = SPISIM_CR_RESET;
+  spi.ssr = SPISIM_SSR_RESET;
+  spi.tx_count = 0;
+  spi.rx_count = 0;
+  flashsim_select(0);
+  spisim_update_irq();
+}
+
+static u32
+spisim_read(void *dev, u32 off, u32 size)
+{
+  u32 v, sr;
+
+  switch(off) {
+  case XSP_DGIER_OFFSET:
+    return spi.dgier;
+  case XSP_IISR_OFFSET:
+    return spi.ipisr;
+  case XSP_IIER_OFFSET:
+    return spi.ipier;
+  case XSP_CR_OFFSET:
+    return spi.cr;
+  case XSP_SR_OFFSET:
+    sr = 0;
+    if(!spi.rx_count) {
+      sr |= XSP_SR_RX_EMPTY_MASK;
+    }
+    if(spi.rx_count == SPISIM_FIFO_DEPTH) {
+      sr |= XSP_SR_RX_FULL_MASK;
+    }
+    if(!spi.tx_count) {
+      sr |= XSP_SR_TX_EMPTY_MASK;
+    }
+    if(spi.tx_count == SPISIM_FIFO_DEPTH) {
+      sr |= XSP_SR_TX_FULL_MASK;
+    }
+    return sr;
+  case XSP_DRR_OFFSET:
+    if(!spi.rx_count) {
+      return 0;
+    }
+    v = spi.rx[spi.rx_head];
+    spi.rx_head = (spi.rx_head + 1) % SPISIM_FIFO_DEPTH;
+    spi.rx_count--;
+    return v;
+  case XSP_SSR_OFFSET:
+    return spi.ssr;
+  case XSP_TFO_OFFSET:
+    return spi.tx_count ? spi.tx_count - 1 : 0;
+  case XSP_RFO_OFFSET:
+    return spi.rx_count ? spi.rx_count - 1 : 0;
+  }
+  return 0;
+}
+
+static void
+spisim_write(void *dev, u32 off, u32 val, u32 size)
+{
+  switch(off) {
+  case XSP_DGIER_OFFSET:
+    spi.dgier = val & XSP_GINTR_ENABLE_MASK;
+    break;
+  case XSP_IISR_OFFSET:
+    // Toggle on write
+    spi.ipisr ^= val;
+    break;
+  case XSP_IIER_OFFSET:
+    spi.ipier = val;
+    break;
+  case XSP_SRR_OFFSET:
+    if(val == XSP_SRR_RESET_MASK) {
+      spisim_soft_reset();
+    }
+    return;
+  case XSP_CR_OFFSET:
+    if(val & XSP_CR_TXFIFO_RESET_MASK) {
+      spi.tx_count = 0;
+    }
+    if(val & XSP_CR_RXFIFO_RESET_MASK) {
+      spi.rx_count = 0;
+    }
+    spi.cr = val & ~(XSP_CR_TXFIFO_RESET_MASK | XSP_CR_RXFIFO_RESET_MASK);
+    spisim_drain();
+    break;
+  case XSP_DTR_OFFSET:
+    if(spi.tx_count == SPISIM_FIFO_DEPTH) {
+      break;
+    }
+    spi.tx[spi.tx_count++] = val;
+    spisim_drain();
+    break;
+  case XSP_SSR_OFFSET:
+    if((spi.ssr ^ val) & 1) {
+      flashsim_select(!(val & 1));
+    }
+    spi.ssr = val;
+    break;
+  }
+  spisim_update_irq();
+}
+
+void
+spisim_reset()
+{
+  sim_map(XPAR_SPI_0_BASEADDR, XPAR_SPI_0_HIGHADDR - XPAR_SPI_0_BASEADDR + 1,
+      spisim_read, spisim_write, NULL);
+  spi.bytes = 0;
+  spisim_soft_reset();
+}
+
+u32
+spisim_bytes()
+{
+  return spi.bytes;
+}
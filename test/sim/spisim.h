@@ -0,0 +1,21 @@
+#ifndef _SPISIM_H_
+#define _SPISIM_H_
+
+// spisim.h - Model of the AXI Quad SPI core (standard mode) for host builds.
+//
+// Bytes written to the transmit FIFO go out as soon as the core is enabled
+// as a master with transfers uninhibited: each is handed to the flash model
+// while slave select 0 is asserted (or clocks in 0xff otherwise) and the
+// byte it returns lands in the receive FIFO.  The transmit FIFO therefore
+// reads as empty whenever it can drain, and every drain raises the
+// tx-empty and tx-half-empty interrupts.
+
+#include "xil_types.h"
+
+// Map the core's registers and reset it
+void spisim_reset();
+
+// Bytes transferred since spisim_reset()
+u32 spisim_bytes();
+
+#endif // _SPISIM_H_
@@ -0,0 +1,138 @@
+// stubs.c - Host stand-ins for the BSP and firmware pieces the layers under
+// test call but that have no place on the simulated board.
+
+#include <stdarg.h>
+#include <stdio.h>
+
+#include "xil_io.h"
+#include "xil_printf.h"
+
+#include "netif/ethernetif.h"
+
+#include "crash.h"
+#include "icap.h"
+#include "slots.h"
+#include "sntpclock.h"
+
+void
+xil_printf(const char8 *fmt, ...)
+{
+  va_list ap;
+
+  va_start(ap, fmt);
+  vprintf(fmt, ap);
+  va_end(ap);
+}
+
+void
+print(const char8 *s)
+{
+  fputs(s, stdout);
+}
+
+u16
+Xil_EndianSwap16(u16 x)
+{
+  return (x >> 8) | (x << 8);
+}
+
+u32
+Xil_EndianSwap32(u32 x)
+{
+  return (x >> 24) | ((x >> 8) & 0xff00) | ((x << 8) & 0xff0000) | (x << 24);
+}
+
+// No eth0: requests are never answered in place
+u16_t
+ethernetif_rx_room(struct pbuf *p)
+{
+  return 0;
+}
+
+int
+ethernetif_is(struct netif *netif)
+{
+  return 0;
+}
+
+u32_t
+ethernetif_rx_stamp(struct netif *netif)
+{
+  return 0;
+}
+
+u32_t
+ethernetif_tx_stamp(struct netif *netif, struct pbuf *p)
+{
+  return 0;
+}
+
+int
+ethernetif_tx_stamps(struct netif *netif, u32_t handle,
+                     u32_t *sent, u32_t *done)
+{
+  return -1;
+}
+
+// No further ports: everything routes by destination
+struct netif *
+ethport_route_src(const ip4_addr_t *dest, const ip4_addr_t *src)
+{
+  return NULL;
+}
+
+// No eth0 to drain the log to, and the 32-bit format IDs of log.h do not
+// hold a host pointer
+void
+log_write(u32 id, u32 a, u32 b, u32 c, u32 d)
+{
+}
+
+// No exceptions on the host: the tests call wbbus_fault() themselves
+void
+crash_on_bus_error(crash_bus_fn fn)
+{
+}
+
+// Nor a crash before this boot
+const struct crash_record *
+crash_last(int *fresh)
+{
+  *fresh = 0;
+  return NULL;
+}
+
+// No ICAP: booted from the golden image, nothing amiss
+u32
+icap_bootsts()
+{
+  return 0;
+}
+
+u8
+icap_slot()
+{
+  return SLOT_GOLDEN;
+}
+
+// No SNTP server: the wall clock is never set, so timed writes are refused
+u64
+sntpclock_utc_ns(u64 cycles)
+{
+  return 0;
+}
+
+u64
+sntpclock_cycles(u64 utc_ns)
+{
+  return 0;
+}
+
+u64
+now_utc_us()
+{
+  return 0;
+}
+
+// No slot table: the tests that need one fill it in
+struct slot_table slots;
@@ -0,0 +1,40 @@
+#ifndef _JAM_CHECK_H_
+#define _JAM_CHECK_H_
+
+// jam_check.h - Common header of the firmware's unit tests (check
+// framework), after lwip/test/unit/lwip_check.h.
+
+#include <check.h>
+#include <stdlib.h>
+
+// Unlike lwIP's, EXPECT_RET() evaluates `x` once, so it can wrap the call
+// under test
+#define EXPECT(x) fail_unless(x)
+#define EXPECT_RET(x) do { \
+    int expect_ok_ = (x) != 0; \
+    fail_unless(expect_ok_, "Assertion '%s' failed", # x); \
+    if(!expect_ok_) { return; } \
+  } while(0)
+
+typedef struct {
+  TFun func;
+  const char *name;
+} testfunc;
+
+#define TESTFUNC(x) { (x), "" # x "" }
+
+// Modified function from check.h, supplying the function name
+#define tcase_add_named_test(tc, tf) \
+  _tcase_add_test((tc), (tf).func, (tf).name, 0, 0, 0, 1)
+
+typedef Suite *(suite_getter_fn)(void);
+
+Suite *create_suite(const char *name, testfunc *tests, size_t num_tests,
+    SFun setup, SFun teardown);
+
+// Fixture shared by the suites: map the simulated board (sim.h) with an
+// erased flash and bring up the SPI core and the flash layer on it
+void jam_board_setup(void);
+void jam_board_teardown(void);
+
+#endif // _JAM_CHECK_H_
@@ -0,0 +1,127 @@
+// jam_unittests.c - Runs the firmware's unit test suites on the host.
+
+#include "jam_check.h"
+
+#include "flash.h"
+#include "flashsim.h"
+#include "pt.h"
+#include "sim.h"
+#include "spi.h"
+#include "timer.h"
+
+#include "test_bitstream.h"
+#include "test_bootldr.h"
+#include "test_flash.h"
+#include "test_fmt.h"
+#include "test_heatshrink.h"
+#include "test_kv.h"
+#include "test_load.h"
+#include "test_mbmem.h"
+#include "test_mbox.h"
+#include "test_mempools.h"
+#include "test_pace.h"
+#include "test_preset.h"
+#include "test_pt.h"
+#include "test_ring.h"
+#include "test_spi.h"
+#include "test_tcprx.h"
+#include "test_tcpsrc.h"
+#include "test_telbuf.h"
+#include "test_bbox.h"
+#include "test_sha1.h"
+#include "test_timer.h"
+#include "test_wbbus.h"
+#include "test_wbmap.h"
+#include "test_wbpost.h"
+#include "test_wbreg.h"
+#include "test_wbshadow.h"
+
+#include "lwip/init.h"
+
+Suite *
+create_suite(const char *name, testfunc *tests, size_t num_tests,
+    SFun setup, SFun teardown)
+{
+  size_t i;
+  Suite *s = suite_create(name);
+
+  for(i=0; i<num_tests; i++) {
+    TCase *tc_core = tcase_create(name);
+    if(setup != NULL || teardown != NULL) {
+      tcase_add_checked_fixture(tc_core, setup, teardown);
+    }
+    tcase_add_named_test(tc_core, tests[i]);
+    suite_add_tcase(s, tc_core);
+  }
+  return s;
+}
+
+void
+jam_board_setup(void)
+{
+  sim_init();
+  init_spi();
+  init_flash();
+  flash_cache_invalidate(0, flash_info.size);
+}
+
+void
+jam_board_teardown(void)
+{
+  // Nothing may be left running into the next test
+  fail_if(flash_busy());
+  fail_if(spi_busy());
+}
+
+int
+main(void)
+{
+  int number_failed;
+  SRunner *sr;
+  size_t i;
+  suite_getter_fn *suites[] = {
+    spi_suite,
+    flash_suite,
+    kv_suite,
+    wbreg_suite,
+    fmt_suite,
+    bitstream_suite,
+    heatshrink_suite,
+    ring_suite,
+    mbox_suite,
+    mbmem_suite,
+    tcpsrc_suite,
+    tcprx_suite,
+    pace_suite,
+    bootldr_suite,
+    preset_suite,
+    wbshadow_suite,
+    wbbus_suite,
+    wbpost_suite,
+    load_suite,
+    timer_suite,
+    pt_suite,
+    mempools_suite,
+    telbuf_suite,
+    bbox_suite,
+    sha1_suite,
+    wbmap_suite
+  };
+  size_t num = sizeof(suites)/sizeof(suites[0]);
+
+  // Before the timers, as it starts lwIP's cyclic ones
+  sim_init();
+  lwip_init();
+  init_timers();
+  init_pt();
+
+  sr = srunner_create((suites[0])());
+  for(i=1; i<num; i++) {
+    srunner_add_suite(sr, (suites[i])());
+  }
+
+  srunner_run_all(sr, CK_NORMAL);
+  number_failed = srunner_ntests_failed(sr);
+  srunner_free(sr);
+  return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
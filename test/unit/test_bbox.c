@@ -0,0 +1,176 @@
+// test_bbox.c - Blackbox event log against the flash model: the boot's
+// event, staging in the page buffer, finding the end again after a reset
+// and the log coming round to its oldest sector.
+
+#include <string.h>
+
+#include "test_bbox.h"
+
+#include "bbox.h"
+#include "crc32.h"
+#include "flash.h"
+#include "sim.h"
+#include "slots.h"
+
+// The whole log as tftp's "get blackbox" reads it
+static struct bbox_rec log_buf[FLASH_RSV_BBOX_SECTORS * 65536 /
+    sizeof(struct bbox_rec)];
+
+// Read the log and check it: the records that are not erased are whole
+// and in sequence.  Returns how many there are, with the first sequence
+// number in `first`.
+static u32
+read_log(u32 *first)
+{
+  u32 n = bbox_size() / sizeof(log_buf[0]), i, count = 0;
+
+  EXPECT(bbox_size() <= sizeof(log_buf));
+  EXPECT(bbox_read(0, log_buf, bbox_size()) == bbox_size());
+  for(i=0; i<n; i++) {
+    if(log_buf[i].seq == 0xffffffff && log_buf[i].crc == 0xffffffff) {
+      continue;
+    }
+    EXPECT(log_buf[i].crc == crc32(0, &log_buf[i],
+          offsetof(struct bbox_rec, crc)));
+    if(count) {
+      EXPECT(log_buf[i].seq == *first + count);
+    } else {
+      *first = log_buf[i].seq;
+    }
+    count++;
+  }
+  return count;
+}
+
+// Record `count` alarm events, numbered in `a` from `first`, giving the
+// flash time after each page's worth
+static void
+alarms(u32 first, u32 count)
+{
+  u32 i;
+
+  for(i=0; i<count; i++) {
+    bbox_event(BBOX_ALARM, 1, first + i, 0, 0);
+    if(i % BBOX_PER_PAGE == BBOX_PER_PAGE - 1) {
+      sim_run_ms(50);
+    }
+  }
+}
+
+static void
+bbox_setup(void)
+{
+  jam_board_setup();
+  memset(&slots, 0, sizeof(slots));
+  init_bbox();
+  // The boot's event, programmed at once
+  sim_run_ms(100);
+}
+
+static void
+bbox_teardown(void)
+{
+  sim_run_ms(100);
+  jam_board_teardown();
+}
+
+START_TEST(test_bbox_boot)
+{
+  const struct bbox_stats *s = bbox_stats();
+  u32 first;
+
+  EXPECT(bbox_size() == FLASH_RSV_BBOX_SECTORS * flash_rsv_size());
+  EXPECT(s->seq == 1 && s->erases == 1 && s->partial == 1);
+  EXPECT(s->errors == 0 && s->lost == 0);
+  EXPECT(read_log(&first) == 1 && first == 0);
+  // The newest sector reads last
+  EXPECT(log_buf[bbox_size() / sizeof(log_buf[0]) -
+      flash_rsv_size() / sizeof(log_buf[0])].type == BBOX_BOOT);
+}
+END_TEST
+
+START_TEST(test_bbox_stage)
+{
+  const struct bbox_stats *s = bbox_stats();
+  u32 first;
+
+  // Waits in BRAM, but reads back all the same
+  alarms(0, 3);
+  sim_run_ms(100);
+  EXPECT(s->partial == 1);
+  EXPECT(read_log(&first) == 4);
+  // Programmed once the stage times out
+  sim_run_ms(BBOX_STAGE_MS);
+  EXPECT(s->partial == 2);
+  // Filling the page programs it whole
+  alarms(3, BBOX_PER_PAGE - 4);
+  sim_run_ms(100);
+  EXPECT(s->pages == 1 && s->partial == 2);
+  EXPECT(read_log(&first) == BBOX_PER_PAGE && first == 0);
+
+  // More than the queue holds at once are lost, and counted
+  for(first=0; first<BBOX_QUEUE + 2; first++) {
+    bbox_event(BBOX_ALARM, 1, 100 + first, 0, 0);
+  }
+  EXPECT(s->lost == 2);
+}
+END_TEST
+
+START_TEST(test_bbox_rescan)
+{
+  const struct bbox_stats *s = bbox_stats();
+  u32 first, n;
+
+  alarms(0, 2 * BBOX_PER_PAGE + 3);
+  bbox_event(BBOX_NOTE, 1, 2, 3, 4);
+  sim_run_ms(100);
+  n = read_log(&first);
+  EXPECT(n == 2 * BBOX_PER_PAGE + 5);
+
+  // As after a reset: the log picks up where it stopped
+  init_bbox();
+  EXPECT(s->seq == n);
+  sim_run_ms(100);
+  alarms(1000, BBOX_PER_PAGE);
+  sim_run_ms(BBOX_STAGE_MS + 100);
+  EXPECT(read_log(&first) == n + 1 + BBOX_PER_PAGE && first == 0);
+  EXPECT(s->erases == 0);
+}
+END_TEST
+
+START_TEST(test_bbox_wrap)
+{
+  const struct bbox_stats *s = bbox_stats();
+  u32 per_sector = flash_rsv_size() / sizeof(struct bbox_rec);
+  u32 total = FLASH_RSV_BBOX_SECTORS * per_sector + 3 * BBOX_PER_PAGE;
+  u32 first, n;
+
+  // More than the log holds: the oldest sector goes, the rest in order
+  alarms(0, total);
+  sim_run_ms(100);
+  EXPECT(s->erases == FLASH_RSV_BBOX_SECTORS + 1 && s->errors == 0);
+  n = read_log(&first);
+  // The boot's event among them
+  EXPECT(n == (FLASH_RSV_BBOX_SECTORS - 1) * per_sector +
+      3 * BBOX_PER_PAGE + 1);
+  EXPECT(first + n == total + 1);
+
+  // And found again, in the sector that came round
+  sim_run_ms(BBOX_STAGE_MS);
+  init_bbox();
+  EXPECT(s->seq == total + 1);
+}
+END_TEST
+
+Suite *
+bbox_suite(void)
+{
+  testfunc tests[] = {
+    TESTFUNC(test_bbox_boot),
+    TESTFUNC(test_bbox_stage),
+    TESTFUNC(test_bbox_rescan),
+    TESTFUNC(test_bbox_wrap),
+  };
+  return create_suite("bbox", tests, sizeof(tests)/sizeof(testfunc),
+      bbox_setup, bbox_teardown);
+}
@@ -0,0 +1,8 @@
+#ifndef _TEST_BBOX_H_
+#define _TEST_BBOX_H_
+
+#include "jam_check.h"
+
+Suite *bbox_suite(void);
+
+#endif // _TEST_BBOX_H_
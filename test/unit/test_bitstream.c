@@ -0,0 +1,103 @@
+// test_bitstream.c - bit_parse() and bit_check() on .bit and .bin starts.
+
+#include <string.h>
+
+#include "test_bitstream.h"
+
+#include "bitstream.h"
+
+#define XC7K325T (0x03651093)
+
+// A .bin start as the tools write it: padding, bus width, sync, then the
+// packets up to the IDCODE write
+static const u8 bin[] = {
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0x00, 0x00, 0x00, 0xbb, 0x11, 0x22, 0x00, 0x44,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xaa, 0x99, 0x55, 0x66, 0x20, 0x00, 0x00, 0x00,
+  0x30, 0x02, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, // WBSTAR
+  0x30, 0x00, 0x80, 0x01, 0x00, 0x00, 0x00, 0x00, // CMD
+  0x20, 0x00, 0x00, 0x00, 0x30, 0x01, 0x20, 0x02, // COR0, 2 words
+  0x02, 0x00, 0x3f, 0xe5, 0x00, 0x00, 0x00, 0x00,
+  0x30, 0x01, 0x80, 0x01, 0x03, 0x65, 0x10, 0x93, // IDCODE
+  0x30, 0x00, 0x80, 0x01, 0x00, 0x00, 0x00, 0x09
+};
+
+// The same behind a .bit header
+static u8 bit[256];
+static u32 bit_len;
+
+static void
+make_bit()
+{
+  static const u8 hdr[] = {
+    0x00, 0x09, 0x0f, 0xf0, 0x0f, 0xf0, 0x0f, 0xf0, 0x0f, 0xf0, 0x00,
+    0x00, 0x01,
+    'a', 0x00, 0x05, 't', 'o', 'p', ';', '\0',
+    'b', 0x00, 0x0d, '7', 'k', '3', '2', '5', 't', 'f', 'f', 'g', '9', '0',
+    '0', '\0',
+    'c', 0x00, 0x02, '1', '\0',
+    'd', 0x00, 0x02, '2', '\0',
+    'e', 0x00, 0x00, 0x00, sizeof(bin)
+  };
+
+  memcpy(bit, hdr, sizeof(hdr));
+  memcpy(bit + sizeof(hdr), bin, sizeof(bin));
+  bit_len = sizeof(hdr) + sizeof(bin);
+}
+
+START_TEST(test_bitstream_bin)
+{
+  struct bit_info info;
+
+  EXPECT_RET(bit_parse(bin, sizeof(bin), &info) == BIT_OK);
+  EXPECT(info.data_off == 0 && info.sync_off == 24);
+  EXPECT(info.idcode == XC7K325T && info.part[0] == '\0');
+  EXPECT(bit_check(bin, sizeof(bin), XC7K325T) == BIT_OK);
+  // The revision does not matter, nor an unknown device
+  EXPECT(bit_check(bin, sizeof(bin), XC7K325T | 0x30000000) == BIT_OK);
+  EXPECT(bit_check(bin, sizeof(bin), 0) == BIT_OK);
+  EXPECT(bit_check(bin, sizeof(bin), 0x03631093) == BIT_EIDCODE);
+}
+END_TEST
+
+START_TEST(test_bitstream_bit)
+{
+  struct bit_info info;
+
+  make_bit();
+  EXPECT_RET(bit_parse(bit, bit_len, &info) == BIT_OK);
+  EXPECT(info.data_off == bit_len - sizeof(bin));
+  EXPECT(info.idcode == XC7K325T);
+  EXPECT(strcmp(info.part, "7k325tffg900") == 0);
+
+  // Cut off in the header
+  EXPECT(bit_parse(bit, 30, &info) == BIT_EHEADER);
+  bit[21] = 'z';
+  EXPECT(bit_parse(bit, bit_len, &info) == BIT_EHEADER);
+}
+END_TEST
+
+START_TEST(test_bitstream_bad)
+{
+  static const u8 text[] = "<html>not a bitstream</html>";
+  struct bit_info info;
+
+  EXPECT(bit_parse(text, sizeof(text), &info) == BIT_ENOSYNC);
+  // Cut off before the IDCODE write, and in it
+  EXPECT(bit_parse(bin, 64, &info) == BIT_ENOID);
+  EXPECT(bit_parse(bin, sizeof(bin) - 12, &info) == BIT_ENOID);
+}
+END_TEST
+
+Suite *
+bitstream_suite(void)
+{
+  testfunc tests[] = {
+    TESTFUNC(test_bitstream_bin),
+    TESTFUNC(test_bitstream_bit),
+    TESTFUNC(test_bitstream_bad),
+  };
+  return create_suite("BITSTREAM", tests, sizeof(tests)/sizeof(testfunc),
+      NULL, NULL);
+}
@@ -0,0 +1,8 @@
+#ifndef _TEST_BITSTREAM_H_
+#define _TEST_BITSTREAM_H_
+
+#include "jam_check.h"
+
+Suite *bitstream_suite(void);
+
+#endif // _TEST_BITSTREAM_H_
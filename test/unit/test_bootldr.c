@@ -0,0 +1,188 @@
+// test_bootldr.c - The bootloader's choice of image from the flash model:
+// the newest valid one, an older one when it fails its CRC, the golden one
+// with no table or nothing else left, and nothing once that fails too;
+// and compressed images decoded into place.
+
+#include <stddef.h>
+#include <string.h>
+
+#include "test_bootldr.h"
+
+#include "bootldr/bootldr.h"
+#include "crc32.h"
+#include "flashsim.h"
+#include "slots.h"
+
+#define LOAD  (0x8)
+#define SIZE  (5000)
+#define ENTRY (0x50)
+
+// Stands in for BRAM below the loader
+static u8 bram[APP_BOOT_BASE];
+
+// hsencode.py of 600 bytes of (i % 40) * 3
+#define PLAIN_SIZE (600)
+static const u8 packed[] = {
+  0x80, 0x40, 0xe0, 0xd0, 0x98, 0x64, 0x3e, 0x25, 0x15, 0x8c, 0x46, 0xe3,
+  0xd2, 0x19, 0x24, 0x9e, 0x55, 0x2d, 0x98, 0x4c, 0xe6, 0xd3, 0x99, 0xe4,
+  0xfe, 0x85, 0x45, 0xa4, 0x52, 0xe9, 0xd5, 0x1a, 0xa5, 0x5e, 0xb5, 0x5d,
+  0xb0, 0x58, 0xec, 0xd6, 0x9b, 0x65, 0xbe, 0xe5, 0x75, 0x13, 0xff, 0x13,
+  0xff, 0x13, 0xff, 0x13, 0xff, 0x13, 0xaf
+};
+
+static void
+put_header(u32 addr, struct app_header *h)
+{
+  h->magic = APP_MAGIC;
+  h->load = LOAD;
+  h->entry = ENTRY;
+  h->hcrc = crc32(0, h, offsetof(struct app_header, hcrc));
+  memcpy(flashsim_mem() + addr, h, sizeof(*h));
+}
+
+// Write an image of SIZE bytes seeded by `seed` at `addr`
+static void
+put_image(u32 addr, u8 seed)
+{
+  u8 *mem = flashsim_mem() + addr + sizeof(struct app_header);
+  struct app_header h;
+  u32 i;
+
+  for(i=0; i<SIZE; i++) {
+    mem[i] = (u8)(seed + i * 13);
+  }
+  h.size = SIZE;
+  h.crc = crc32(0, mem, SIZE);
+  h.packed = 0;
+  put_header(addr, &h);
+}
+
+// Write the compressed image of `packed` at `addr`
+static void
+put_packed(u32 addr)
+{
+  static u8 plain[PLAIN_SIZE];
+  struct app_header h;
+  u32 i;
+
+  for(i=0; i<PLAIN_SIZE; i++) {
+    plain[i] = (i % 40) * 3;
+  }
+  memcpy(flashsim_mem() + addr + sizeof(h), packed, sizeof(packed));
+  h.size = PLAIN_SIZE;
+  h.crc = crc32(0, plain, PLAIN_SIZE);
+  h.packed = sizeof(packed);
+  put_header(addr, &h);
+}
+
+static int
+loaded(u32 addr)
+{
+  return memcmp(bram + LOAD, flashsim_mem() + addr + sizeof(struct app_header),
+      SIZE) == 0;
+}
+
+// A table of three 4 MB slots, slot 1 and 2 with images of versions 3
+// and 5, in the first page of the table's second sector
+static void
+put_table()
+{
+  struct slot_table t;
+  u32 i;
+
+  memset(&t, 0, sizeof(t));
+  t.magic = SLOT_TABLE_MAGIC;
+  t.seq = 7;
+  t.num = 3;
+  for(i=0; i<t.num; i++) {
+    t.slot[i].addr = i << 22;
+    t.slot[i].size = 4 << 20;
+  }
+  t.slot[1].len = sizeof(struct app_header) + SIZE;
+  t.slot[1].version = 3;
+  t.slot[2].len = sizeof(struct app_header) + SIZE;
+  t.slot[2].version = 5;
+  t.crc = crc32(0, &t, offsetof(struct slot_table, crc));
+  memcpy(flashsim_mem() + BOOT_FLASH_SIZE -
+      (FLASH_RSV_SECTORS - FLASH_RSV_SLOTS - 1) * BOOT_RSV_SIZE, &t,
+      sizeof(t));
+}
+
+START_TEST(test_bootldr_newest)
+{
+  struct app_header h;
+
+  put_table();
+  put_image(1 << 22, 1);
+  put_image(2 << 22, 2);
+  EXPECT(boot_image(bram, &h) == 2);
+  EXPECT(h.entry == ENTRY && loaded(2 << 22));
+
+  // A flipped bit in the newest falls back to the older one
+  flashsim_mem()[(2 << 22) + sizeof(h) + 100] ^= 0x10;
+  EXPECT(boot_image(bram, &h) == 1);
+  EXPECT(loaded(1 << 22));
+}
+END_TEST
+
+START_TEST(test_bootldr_packed)
+{
+  struct app_header h;
+  u32 i;
+
+  put_table();
+  put_image(1 << 22, 1);
+  put_packed(2 << 22);
+  EXPECT(boot_image(bram, &h) == 2);
+  EXPECT(h.size == PLAIN_SIZE && h.packed == sizeof(packed));
+  for(i=0; i<PLAIN_SIZE; i++) {
+    EXPECT_RET(bram[LOAD + i] == (i % 40) * 3);
+  }
+
+  // A stream that decodes wrong fails the CRC, whichever part is hit
+  flashsim_mem()[(2 << 22) + sizeof(h) + 10] ^= 0x40;
+  EXPECT(boot_image(bram, &h) == 1);
+  put_packed(2 << 22);
+  memset(flashsim_mem() + (2 << 22) + sizeof(h) + sizeof(packed) - 8, 0,
+      8);
+  EXPECT(boot_image(bram, &h) == 1);
+  EXPECT(loaded(1 << 22));
+}
+END_TEST
+
+START_TEST(test_bootldr_golden)
+{
+  struct app_header h;
+  u32 golden = (4 << 20) - APP_GOLDEN_SIZE;
+  // No table: the end of slots_default()'s slot 0, 64 KB short of 8 MB
+  u32 dflt = (8 << 20) - SLOT_ALIGN - APP_GOLDEN_SIZE;
+
+  EXPECT(boot_image(bram, &h) == -1);
+  put_image(dflt, 4);
+  EXPECT(boot_image(bram, &h) == SLOT_GOLDEN);
+  EXPECT(loaded(dflt));
+
+  // With a table, once neither image in the other slots passes
+  put_table();
+  put_image(golden, 9);
+  put_image(1 << 22, 1);
+  flashsim_mem()[1 << 22] ^= 1;
+  EXPECT(boot_image(bram, &h) == SLOT_GOLDEN);
+  EXPECT(loaded(golden));
+
+  flashsim_mem()[golden + sizeof(h)] ^= 1;
+  EXPECT(boot_image(bram, &h) == -1);
+}
+END_TEST
+
+Suite *
+bootldr_suite(void)
+{
+  testfunc tests[] = {
+    TESTFUNC(test_bootldr_newest),
+    TESTFUNC(test_bootldr_packed),
+    TESTFUNC(test_bootldr_golden),
+  };
+  return create_suite("bootldr", tests, sizeof(tests)/sizeof(testfunc),
+      jam_board_setup, jam_board_teardown);
+}
@@ -0,0 +1,8 @@
+#ifndef _TEST_BOOTLDR_H_
+#define _TEST_BOOTLDR_H_
+
+#include "jam_check.h"
+
+Suite *bootldr_suite(void);
+
+#endif // _TEST_BOOTLDR_H_
@@ -0,0 +1,252 @@
+// test_flash.c - Reads in every mode, background program and erase, the
+// read cache, configuration register tuning and CRCs against the flash
+// model.
+
+#include <string.h>
+
+#include "test_flash.h"
+
+#include "crc32.h"
+#include "flash.h"
+#include "flashsim.h"
+#include "sim.h"
+#include "spi.h"
+
+static int prog_err;
+static int prog_calls;
+
+static void
+prog_done(int err, void *arg)
+{
+  prog_err = err;
+  prog_calls++;
+}
+
+static int
+flash_idle(void *arg)
+{
+  return !flash_busy();
+}
+
+// Fill `len` bytes of the model at `addr` with a pattern seeded by `seed`
+static void
+fill(u32 addr, u32 len, u8 seed)
+{
+  u8 *mem = flashsim_mem();
+  u32 i;
+
+  for(i=0; i<len; i++) {
+    mem[addr + i] = (u8)(seed + i * 7);
+  }
+}
+
+static int
+all(const u8 *p, u32 len, u8 v)
+{
+  while(len--) {
+    if(*p++ != v) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+START_TEST(test_flash_defaults)
+{
+  // The model has no SFDP tables
+  EXPECT(!flash_info.sfdp);
+  EXPECT(flash_info.size == 16 << 20);
+  EXPECT(flash_info.id[0] == 0x20 && flash_info.uid_len == 16);
+}
+END_TEST
+
+START_TEST(test_flash_read_modes)
+{
+  static u8 buf[1000];
+  u32 mode;
+
+  fill(0x123456, sizeof(buf), 3);
+  for(mode=0; mode<FLASH_NUM_MODES; mode++) {
+    memset(buf, 0, sizeof(buf));
+    EXPECT(read_flash(0x123456, buf, sizeof(buf), mode) == sizeof(buf));
+    EXPECT(memcmp(buf, flashsim_mem() + 0x123456, sizeof(buf)) == 0);
+  }
+}
+END_TEST
+
+START_TEST(test_flash_erase)
+{
+  u8 *mem = flashsim_mem();
+  u32 ops = flashsim_ops();
+
+  memset(mem + 0x30000, 0, 0x30000);
+  prog_calls = 0;
+
+  // 4 KB, then 64 KB, then 4 KB again
+  EXPECT_RET(erase_flash(0x3f000, 0x12000, prog_done, NULL) == 0);
+  EXPECT(flash_busy());
+  EXPECT(erase_flash(0x50000, 0x1000, prog_done, NULL) == -1);
+  EXPECT_RET(sim_run_until(flash_idle, NULL, 1000));
+  EXPECT(prog_calls == 1 && prog_err == 0);
+  EXPECT(flashsim_ops() - ops == 3);
+  EXPECT(all(mem + 0x3e000, 0x1000, 0x00));
+  EXPECT(all(mem + 0x3f000, 0x12000, 0xff));
+  EXPECT(all(mem + 0x51000, 0x1000, 0x00));
+
+  // Misaligned
+  EXPECT(erase_flash(0x3f800, 0x1000, prog_done, NULL) == -1);
+}
+END_TEST
+
+START_TEST(test_flash_erase_suspend)
+{
+  static u8 buf[300];
+  u8 *mem = flashsim_mem();
+  u32 suspends = flashsim_suspends();
+
+  memset(mem + 0x60000, 0, 0x10000);
+  fill(0x123400, sizeof(buf), 3);
+  prog_calls = 0;
+
+  // Reads elsewhere suspend the erase; reads of the block being erased fail
+  EXPECT_RET(erase_flash(0x60000, 0x10000, prog_done, NULL) == 0);
+  sim_run_ms(1);
+  EXPECT(flash_busy());
+  EXPECT(read_flash(0x123400, buf, sizeof(buf), FLASH_MODE_FAST) ==
+      sizeof(buf));
+  EXPECT(memcmp(buf, mem + 0x123400, sizeof(buf)) == 0);
+  EXPECT(flashsim_suspends() - suspends == 1);
+  EXPECT(read_flash(0x123400, buf, 16, FLASH_MODE_READ) == 16);
+  EXPECT(flashsim_suspends() - suspends == 1);
+  EXPECT(read_flash(0x6ff00, buf, 16, FLASH_MODE_READ) == 0);
+
+  // And the erase resumes
+  EXPECT_RET(sim_run_until(flash_idle, NULL, 1000));
+  EXPECT(prog_calls == 1 && prog_err == 0);
+  EXPECT(all(mem + 0x60000, 0x10000, 0xff));
+}
+END_TEST
+
+START_TEST(test_flash_program)
+{
+  static u8 src[700];
+  u8 *mem = flashsim_mem();
+  u32 ops = flashsim_ops();
+  u32 i;
+
+  for(i=0; i<sizeof(src); i++) {
+    src[i] = i ^ 0x5a;
+  }
+  prog_calls = 0;
+
+  // Starts and ends part way through a page: four page programs
+  EXPECT_RET(program_flash(0x10080, src, sizeof(src), prog_done, NULL) == 0);
+  EXPECT(read_flash(0, src, 1, FLASH_MODE_READ) == 0);
+  EXPECT_RET(sim_run_until(flash_idle, NULL, 1000));
+  EXPECT(prog_calls == 1 && prog_err == 0);
+  EXPECT(flashsim_ops() - ops == 4);
+  EXPECT(all(mem + 0x10000, 0x80, 0xff));
+  EXPECT(memcmp(mem + 0x10080, src, sizeof(src)) == 0);
+  EXPECT(all(mem + 0x10080 + sizeof(src), 0x100, 0xff));
+}
+END_TEST
+
+START_TEST(test_flash_cache)
+{
+  static u8 buf[600];
+  struct flash_cache_stats before = flash_cache_stats;
+  static u8 src[16];
+
+  fill(0x200000, sizeof(buf), 9);
+  EXPECT(read_flash_cached(0x200010, buf, sizeof(buf)) == sizeof(buf));
+  EXPECT(memcmp(buf, flashsim_mem() + 0x200010, sizeof(buf)) == 0);
+  EXPECT(flash_cache_stats.misses > before.misses);
+
+  before = flash_cache_stats;
+  EXPECT(read_flash_cached(0x200010, buf, 100) == 100);
+  EXPECT(flash_cache_stats.hits > before.hits);
+  EXPECT(flash_cache_stats.misses == before.misses);
+
+  // Programming drops the lines it covers
+  memset(src, 0, sizeof(src));
+  EXPECT_RET(program_flash(0x200020, src, sizeof(src), prog_done, NULL) == 0);
+  EXPECT_RET(sim_run_until(flash_idle, NULL, 1000));
+  EXPECT(read_flash_cached(0x200010, buf, 64) == 64);
+  EXPECT(all(buf + 0x10, sizeof(src), 0x00));
+}
+END_TEST
+
+START_TEST(test_flash_tune)
+{
+  struct flash_info saved = flash_info;
+  static u8 buf[200];
+  u8 wren[1], evcr[2];
+  u32 m;
+
+  // Blank flash shows nothing, so nothing changes
+  flash_tune();
+  EXPECT(flashsim_vcr() == 0xfb);
+
+  fill(0, 0x100, 11);
+  fill(0x1000, sizeof(buf), 5);
+  flash_tune();
+  EXPECT((flashsim_vcr() >> 4) == 8);
+  EXPECT(flash_info.read[FLASH_MODE_QUAD_IO].dummy_cycles == 8);
+  for(m=0; m<FLASH_NUM_MODES; m++) {
+    memset(buf, 0, sizeof(buf));
+    EXPECT(read_flash(0x1000, buf, sizeof(buf), m) == sizeof(buf));
+    EXPECT(memcmp(buf, flashsim_mem() + 0x1000, sizeof(buf)) == 0);
+  }
+
+  // From power-on, a mode that reads wrong data is dropped and the part
+  // keeps the counts and drive strength it had
+  flash_info = saved;
+  flashsim_reset();
+  fill(0, 0x100, 11);
+  fill(0x1000, sizeof(buf), 5);
+  flashsim_garble(0xeb);
+  // A 20 ohm driver, as a tune at a faster SCK leaves it
+  wren[0] = 0x06;
+  evcr[0] = 0x61;
+  evcr[1] = 0xdd;
+  EXPECT_RET(send_spi(wren, wren, 1, 0) == 1);
+  EXPECT_RET(send_spi(evcr, evcr, 2, 0) == 2);
+  flash_tune();
+  EXPECT(flashsim_vcr() == 0xfb);
+  EXPECT(flashsim_evcr() == 0xdd);
+  EXPECT(!flash_info.read[FLASH_MODE_QUAD_IO].opcode);
+  EXPECT(flash_info.read[FLASH_MODE_QUAD].opcode == 0x6b);
+  EXPECT(read_flash(0x1000, buf, sizeof(buf), FLASH_MODE_BEST) ==
+      sizeof(buf));
+  EXPECT(memcmp(buf, flashsim_mem() + 0x1000, sizeof(buf)) == 0);
+
+  flash_info = saved;
+}
+END_TEST
+
+START_TEST(test_flash_crc)
+{
+  u32 crc = 0;
+
+  fill(0x400000, 5000, 1);
+  EXPECT(crc_flash(0x400000, 5000, &crc) == 0);
+  EXPECT(crc == crc32(0, flashsim_mem() + 0x400000, 5000));
+}
+END_TEST
+
+Suite *
+flash_suite(void)
+{
+  testfunc tests[] = {
+    TESTFUNC(test_flash_defaults),
+    TESTFUNC(test_flash_read_modes),
+    TESTFUNC(test_flash_erase),
+    TESTFUNC(test_flash_erase_suspend),
+    TESTFUNC(test_flash_program),
+    TESTFUNC(test_flash_cache),
+    TESTFUNC(test_flash_tune),
+    TESTFUNC(test_flash_crc),
+  };
+  return create_suite("flash", tests, sizeof(tests)/sizeof(testfunc),
+      jam_board_setup, jam_board_teardown);
+}
@@ -0,0 +1,8 @@
+#ifndef _TEST_FLASH_H_
+#define _TEST_FLASH_H_
+
+#include "jam_check.h"
+
+Suite *flash_suite(void);
+
+#endif // _TEST_FLASH_H_
@@ -0,0 +1,63 @@
+// test_fmt.c - fmt_fixed()'s rounding, signs and field sizes.
+
+#include <string.h>
+
+#include "test_fmt.h"
+
+#include "fmt.h"
+
+static int
+fixed_is(s32 v, u32 div, u32 places, const char *want)
+{
+  char buf[FMT_FIXED_MAX];
+
+  return strcmp(fmt_fixed(buf, v, div, places), want) == 0;
+}
+
+START_TEST(test_fmt_fixed)
+{
+  EXPECT(fixed_is(0, 1000, 3, "0.000"));
+  EXPECT(fixed_is(1234, 1000, 3, "1.234"));
+  EXPECT(fixed_is(45678, 1000, 1, "45.7"));
+  EXPECT(fixed_is(7, 100, 2, "0.07"));
+  EXPECT(fixed_is(12, 10, 0, "1"));
+  EXPECT(fixed_is(1500000, 1000000, 0, "2"));
+}
+END_TEST
+
+START_TEST(test_fmt_round)
+{
+  // Half away from zero, carrying into the integer part
+  EXPECT(fixed_is(1250, 1000, 1, "1.3"));
+  EXPECT(fixed_is(1249, 1000, 1, "1.2"));
+  EXPECT(fixed_is(9996, 1000, 2, "10.00"));
+  EXPECT(fixed_is(-1250, 1000, 1, "-1.3"));
+  EXPECT(fixed_is(-9996, 1000, 2, "-10.00"));
+}
+END_TEST
+
+START_TEST(test_fmt_sign)
+{
+  char buf[FMT_FIXED_MAX];
+
+  EXPECT(fixed_is(-5, 1000, 3, "-0.005"));
+  // Nothing left to be negative after rounding
+  EXPECT(fixed_is(-4, 1000, 2, "0.00"));
+  EXPECT(fixed_is(-2147483647 - 1, 1, 0, "-2147483648"));
+  EXPECT(fixed_is(-2147483647 - 1, 1000, 3, "-2147483.648"));
+  fmt_fixed(buf, -2147483647 - 1, 1, 3);
+  EXPECT(strlen(buf) < FMT_FIXED_MAX);
+}
+END_TEST
+
+Suite *
+fmt_suite(void)
+{
+  testfunc tests[] = {
+    TESTFUNC(test_fmt_fixed),
+    TESTFUNC(test_fmt_round),
+    TESTFUNC(test_fmt_sign),
+  };
+  return create_suite("FMT", tests, sizeof(tests)/sizeof(testfunc),
+      NULL, NULL);
+}
@@ -0,0 +1,8 @@
+#ifndef _TEST_FMT_H_
+#define _TEST_FMT_H_
+
+#include "jam_check.h"
+
+Suite *fmt_suite(void);
+
+#endif // _TEST_FMT_H_
@@ -0,0 +1,80 @@
+// test_heatshrink.c - hs_decode() on a stream from tools/hsencode.py, whole
+// and a byte at a time.
+
+#include <string.h>
+
+#include "test_heatshrink.h"
+
+#include "heatshrink.h"
+
+// hsencode.py of 0..9, 300 zeros, "abcabcabcab" and 40 0xff bytes
+static const u8 packed[] = {
+  0x80, 0x40, 0x60, 0x50, 0x38, 0x24, 0x16, 0x0d, 0x07, 0x84, 0x42, 0x60,
+  0x00, 0x0f, 0xe0, 0x0f, 0xe0, 0x05, 0x56, 0x1b, 0x15, 0x8c, 0x04, 0x1f,
+  0xfe, 0x00, 0x4c
+};
+
+static u8 plain[361];
+
+static void
+make_plain()
+{
+  u32 i;
+
+  for(i=0; i<10; i++) {
+    plain[i] = i;
+  }
+  memset(&plain[10], 0, 300);
+  memcpy(&plain[310], "abcabcabcab", 11);
+  memset(&plain[321], 0xff, 40);
+}
+
+START_TEST(test_hs_whole)
+{
+  static struct hs_dec d;
+  static u8 out[400];
+  const u8 *in = packed;
+  u32 in_len = sizeof(packed);
+
+  make_plain();
+  hs_init(&d);
+  EXPECT(hs_decode(&d, &in, &in_len, out, sizeof(out)) == sizeof(plain));
+  EXPECT(in_len == 0 && in == packed + sizeof(packed));
+  EXPECT(memcmp(out, plain, sizeof(plain)) == 0);
+}
+END_TEST
+
+START_TEST(test_hs_pieces)
+{
+  static struct hs_dec d;
+  static u8 out[400];
+  const u8 *in;
+  u32 in_len, i, n = 0;
+
+  // Input a byte at a time, output 7 bytes at a time
+  make_plain();
+  hs_init(&d);
+  for(i=0; i<sizeof(packed); i++) {
+    in = &packed[i];
+    in_len = 1;
+    while(in_len) {
+      n += hs_decode(&d, &in, &in_len, out + n, 7);
+    }
+    // Whatever the last byte leaves decodable
+    n += hs_decode(&d, &in, &in_len, out + n, sizeof(out) - n);
+  }
+  EXPECT(n == sizeof(plain));
+  EXPECT(memcmp(out, plain, sizeof(plain)) == 0);
+}
+END_TEST
+
+Suite *
+heatshrink_suite(void)
+{
+  testfunc tests[] = {
+    TESTFUNC(test_hs_whole),
+    TESTFUNC(test_hs_pieces),
+  };
+  return create_suite("HEATSHRINK", tests, sizeof(tests)/sizeof(testfunc),
+      NULL, NULL);
+}
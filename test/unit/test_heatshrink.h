@@ -0,0 +1,8 @@
+#ifndef _TEST_HEATSHRINK_H_
+#define _TEST_HEATSHRINK_H_
+
+#include "jam_check.h"
+
+Suite *heatshrink_suite(void);
+
+#endif // _TEST_HEATSHRINK_H_
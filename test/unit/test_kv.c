@@ -0,0 +1,225 @@
+// test_kv.c - The config store against the flash model: set, get, delete,
+// compaction into the spare sector, power cuts part way through and
+// background saves.
+
+#include <string.h>
+
+#include "test_kv.h"
+
+#include "flash.h"
+#include "flashsim.h"
+#include "kv.h"
+#include "sim.h"
+
+#define KEY_A (10)
+#define KEY_B (11)
+#define KEY_C (12)
+
+// Sets of a 200 byte value that fill more than a sector
+#define FILL_SETS (30)
+#define FILL_LEN  (200)
+
+static int kv_err;
+
+static void
+kv_done(int err, void *arg)
+{
+  kv_err = err;
+}
+
+static int
+kv_idle(void *arg)
+{
+  return !kv_busy();
+}
+
+// kv_set() and wait for it.  Returns its error.
+static int
+kv_set_wait(u8 key, const void *val, u32 len)
+{
+  kv_err = -2;
+  if(kv_set(key, val, len, kv_done, NULL) != 0) {
+    return -1;
+  }
+  if(!sim_run_until(kv_idle, NULL, 5000)) {
+    return -1;
+  }
+  return kv_err;
+}
+
+// What a reset does: forget the cached flash and scan it again
+static void
+kv_reboot()
+{
+  flash_cache_invalidate(0, flash_info.size);
+  init_kv();
+}
+
+static void
+kv_setup(void)
+{
+  jam_board_setup();
+  init_kv();
+}
+
+START_TEST(test_kv_set_get)
+{
+  char buf[16];
+
+  EXPECT(kv_get(KEY_A, buf, sizeof(buf)) == -1);
+  EXPECT_RET(kv_set_wait(KEY_A, "hello", 5) == 0);
+  memset(buf, 0, sizeof(buf));
+  EXPECT(kv_get(KEY_A, buf, sizeof(buf)) == 5);
+  EXPECT(memcmp(buf, "hello", 5) == 0);
+
+  // Latest record wins, and survives a reset
+  EXPECT_RET(kv_set_wait(KEY_A, "bye", 3) == 0);
+  kv_reboot();
+  memset(buf, 0, sizeof(buf));
+  EXPECT(kv_get(KEY_A, buf, sizeof(buf)) == 3);
+  EXPECT(memcmp(buf, "bye", 3) == 0);
+
+  // Short buffers get the start of the value and its full length
+  EXPECT(kv_get(KEY_A, buf, 1) == 3);
+
+  EXPECT(kv_set(KV_MAX_KEYS, "x", 1, kv_done, NULL) == -1);
+  EXPECT(kv_set(KEY_A, buf, KV_MAX_VALUE + 1, kv_done, NULL) == -1);
+}
+END_TEST
+
+START_TEST(test_kv_delete)
+{
+  char buf[4];
+
+  EXPECT_RET(kv_set_wait(KEY_A, "abc", 3) == 0);
+  EXPECT_RET(kv_set_wait(KEY_A, NULL, 0) == 0);
+  EXPECT(kv_get(KEY_A, buf, sizeof(buf)) == -1);
+  kv_reboot();
+  EXPECT(kv_get(KEY_A, buf, sizeof(buf)) == -1);
+}
+END_TEST
+
+START_TEST(test_kv_compact)
+{
+  static u8 val[FILL_LEN];
+  u8 buf[FILL_LEN];
+  int i;
+
+  EXPECT_RET(kv_set_wait(KEY_B, "keep", 4) == 0);
+  for(i=0; i<FILL_SETS; i++) {
+    memset(val, i, sizeof(val));
+    EXPECT_RET(kv_set_wait(KEY_C, val, sizeof(val)) == 0);
+    EXPECT(kv_get(KEY_C, buf, sizeof(buf)) == FILL_LEN && buf[0] == i);
+  }
+  kv_reboot();
+  EXPECT(kv_get(KEY_B, buf, sizeof(buf)) == 4 && memcmp(buf, "keep", 4) == 0);
+  EXPECT(kv_get(KEY_C, buf, sizeof(buf)) == FILL_LEN);
+  EXPECT(buf[0] == FILL_SETS - 1 && buf[FILL_LEN - 1] == FILL_SETS - 1);
+}
+END_TEST
+
+// Run the sequence a reset may interrupt: fill the store through a
+// compaction with KEY_C, then change KEY_A
+static void
+kv_sequence()
+{
+  static u8 val[FILL_LEN];
+  int i;
+
+  for(i=0; i<FILL_SETS; i++) {
+    memset(val, i, sizeof(val));
+    kv_set_wait(KEY_C, val, sizeof(val));
+  }
+  kv_set_wait(KEY_A, "new", 3);
+}
+
+START_TEST(test_kv_power_cut)
+{
+  u8 buf[FILL_LEN];
+  u32 ops, n, i;
+  int len;
+
+  // Count the programs and erases of the whole sequence
+  EXPECT_RET(kv_set_wait(KEY_A, "old", 3) == 0);
+  EXPECT_RET(kv_set_wait(KEY_B, "keep", 4) == 0);
+  ops = flashsim_ops();
+  kv_sequence();
+  ops = flashsim_ops() - ops;
+  EXPECT_RET(ops > FILL_SETS);
+
+  for(n=0; n<=ops; n++) {
+    flashsim_reset();
+    kv_reboot();
+    EXPECT_RET(kv_set_wait(KEY_A, "old", 3) == 0);
+    EXPECT_RET(kv_set_wait(KEY_B, "keep", 4) == 0);
+
+    // Power goes after `n` more programs and erases
+    flashsim_cut(n);
+    kv_sequence();
+    kv_reboot();
+
+    // Untouched keys survive; changed ones hold a value that was set
+    len = kv_get(KEY_B, buf, sizeof(buf));
+    EXPECT(len == 4 && memcmp(buf, "keep", 4) == 0);
+    len = kv_get(KEY_A, buf, sizeof(buf));
+    EXPECT(len == 3 &&
+        (memcmp(buf, "old", 3) == 0 || memcmp(buf, "new", 3) == 0));
+    len = kv_get(KEY_C, buf, sizeof(buf));
+    if(len != -1) {
+      EXPECT(len == FILL_LEN);
+      for(i=1; i<FILL_LEN; i++) {
+        if(buf[i] != buf[0]) {
+          break;
+        }
+      }
+      EXPECT(i == FILL_LEN && buf[0] < FILL_SETS);
+    }
+  }
+  flashsim_reset();
+}
+END_TEST
+
+static struct kv_save save = KV_SAVE_INIT(save, KEY_A);
+
+static int
+kv_saved(void *arg)
+{
+  return !save.saving && !save.dirty && !kv_busy();
+}
+
+// A save that finds the store busy waits for it; changes made meanwhile
+// end up saved, the latest last
+START_TEST(test_kv_save)
+{
+  char val[4] = "one";
+  char buf[4];
+
+  EXPECT_RET(kv_set(KEY_B, "busy", 4, kv_done, NULL) == 0);
+  kv_save(&save, val, 3);
+  EXPECT(save.dirty);
+  memcpy(val, "two", 3);
+  kv_save(&save, val, 3);
+  EXPECT_RET(sim_run_until(kv_saved, NULL, 5000));
+  EXPECT(kv_get(KEY_A, buf, sizeof(buf)) == 3 && memcmp(buf, "two", 3) == 0);
+  EXPECT(kv_get(KEY_B, buf, sizeof(buf)) == 4);
+
+  // Length 0 deletes it
+  kv_save(&save, val, 0);
+  EXPECT_RET(sim_run_until(kv_saved, NULL, 5000));
+  EXPECT(kv_get(KEY_A, buf, sizeof(buf)) == -1);
+}
+END_TEST
+
+Suite *
+kv_suite(void)
+{
+  testfunc tests[] = {
+    TESTFUNC(test_kv_set_get),
+    TESTFUNC(test_kv_delete),
+    TESTFUNC(test_kv_compact),
+    TESTFUNC(test_kv_power_cut),
+    TESTFUNC(test_kv_save),
+  };
+  return create_suite("kv", tests, sizeof(tests)/sizeof(testfunc),
+      kv_setup, jam_board_teardown);
+}
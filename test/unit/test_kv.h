@@ -0,0 +1,8 @@
+#ifndef _TEST_KV_H_
+#define _TEST_KV_H_
+
+#include "jam_check.h"
+
+Suite *kv_suite(void);
+
+#endif // _TEST_KV_H_
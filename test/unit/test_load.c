@@ -0,0 +1,163 @@
+// test_load.c - load.h's accounting on the simulated timebase: a task's
+// own time leaves out what it dispatched, a window's shares follow the
+// busy and idle time in it, the alert rises and clears with hysteresis,
+// and tasks past LOAD_TASKS share one entry.
+
+#include "test_load.h"
+
+#include "load.h"
+#include "sim.h"
+#include "timebase.h"
+#include "work.h"
+
+// Stand-in for a nested task, e.g. a timer run from the work item
+#define NESTED_FN (0x1000)
+
+// The timer reads of load_begin() and load_end() show up in the times
+#define SLACK (4 * SIM_READ_CYCLES)
+
+static void
+busy_work(void *arg)
+{
+  struct load_span span;
+
+  sim_advance(1000);
+  load_begin(&span);
+  sim_advance(3000);
+  load_end(&span, NESTED_FN);
+  sim_advance(1000);
+}
+
+static struct work work = WORK_INIT(busy_work, NULL);
+
+// Entry of the function at `fn`, or NULL
+static const struct load_task *
+find(u32 fn)
+{
+  const struct load_task *t;
+  u32 n;
+
+  for(n=0; (t = load_task(n)); n++) {
+    if(t->fn == fn) {
+      return t;
+    }
+  }
+  return NULL;
+}
+
+START_TEST(test_load_nested)
+{
+  const struct load_task *outer, *inner;
+
+  load_reset();
+  EXPECT(work_schedule(&work) == 0);
+  EXPECT(work_run() == 1);
+
+  outer = find((u32)busy_work);
+  inner = find(NESTED_FN);
+  EXPECT_RET(outer && inner);
+  EXPECT(outer->runs == 1 && inner->runs == 1);
+  EXPECT(outer->cycles >= 2000 && outer->cycles <= 2000 + SLACK);
+  EXPECT(inner->cycles >= 3000 && inner->cycles <= 3000 + SLACK);
+  EXPECT(outer->max_cycles == outer->cycles);
+  EXPECT(load_stats()->tasks == 2);
+}
+END_TEST
+
+START_TEST(test_load_window)
+{
+  const struct load_stats *s = load_stats();
+  struct load_span span;
+  u32 windows = s->windows;
+
+  // A quarter of the window in one task, the rest idle
+  load_reset();
+  load_begin(&span);
+  sim_advance(TIMEBASE_HZ / 4);
+  load_end(&span, NESTED_FN);
+  sim_idle(TIMEBASE_HZ / 4 * 3);
+  load_window();
+
+  EXPECT(s->windows == windows + 1);
+  EXPECT(s->busy_pm >= 250 && s->busy_pm <= 251);
+  EXPECT(s->load_pm == s->busy_pm && s->peak_pm == s->busy_pm);
+  EXPECT(find(NESTED_FN)->share_pm >= 249 &&
+      find(NESTED_FN)->share_pm <= 250);
+
+  // Nothing but idle: the task's share goes, the rolling load falls by an
+  // eighth of the way
+  sim_idle(TIMEBASE_HZ);
+  load_window();
+  EXPECT(find(NESTED_FN)->share_pm == 0);
+  EXPECT(s->busy_pm <= 1);
+  EXPECT(s->load_pm >= 218 && s->load_pm <= 220);
+  EXPECT(s->peak_pm >= 250);
+}
+END_TEST
+
+START_TEST(test_load_alert)
+{
+  const struct load_stats *s = load_stats();
+  u32 alerts = load_alert_count(), n;
+
+  load_set_alert(500);
+  load_reset();
+  sim_advance(TIMEBASE_HZ);
+  load_window();
+  EXPECT(s->load_pm >= 999);
+  EXPECT(s->alert && load_alert_count() == alerts + 1);
+
+  // Clears only LOAD_ALERT_HYST_PM under the threshold, and once
+  for(n=0; n<20 && s->alert; n++) {
+    EXPECT(s->load_pm > 500 - LOAD_ALERT_HYST_PM);
+    sim_idle(TIMEBASE_HZ);
+    load_window();
+  }
+  EXPECT(!s->alert && n > 1);
+  EXPECT(s->load_pm <= 500 - LOAD_ALERT_HYST_PM);
+  EXPECT(load_alert_count() == alerts + 1);
+
+  // A threshold of 1000 never alerts
+  load_set_alert(1000);
+  sim_advance(10 * TIMEBASE_HZ);
+  load_window();
+  EXPECT(!s->alert);
+  load_set_alert(LOAD_ALERT_PM);
+}
+END_TEST
+
+START_TEST(test_load_other)
+{
+  struct load_span span;
+  u32 i;
+
+  load_reset();
+  for(i=0; i<LOAD_TASKS + 4; i++) {
+    load_begin(&span);
+    load_end(&span, NESTED_FN + 4 * i);
+  }
+  EXPECT(load_stats()->tasks == LOAD_TASKS);
+  EXPECT(load_task(LOAD_OTHER)->fn == 0);
+  EXPECT(load_task(LOAD_OTHER)->runs == 4);
+  EXPECT(find(NESTED_FN + 4 * (LOAD_TASKS - 1))->runs == 1);
+
+  // Charged to no one
+  load_begin(&span);
+  load_end(&span, 0);
+  EXPECT(load_task(LOAD_OTHER)->runs == 4);
+  EXPECT(load_task(LOAD_OTHER + 1) == NULL);
+}
+END_TEST
+
+Suite *
+load_suite(void)
+{
+  testfunc tests[] = {
+    TESTFUNC(test_load_nested),
+    TESTFUNC(test_load_window),
+    TESTFUNC(test_load_alert),
+    TESTFUNC(test_load_other),
+  };
+  return create_suite("load", tests, sizeof(tests)/sizeof(testfunc),
+      jam_board_setup, jam_board_teardown);
+}
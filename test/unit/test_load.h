@@ -0,0 +1,8 @@
+#ifndef _TEST_LOAD_H_
+#define _TEST_LOAD_H_
+
+#include "jam_check.h"
+
+Suite *load_suite(void);
+
+#endif // _TEST_LOAD_H_
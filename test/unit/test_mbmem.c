@@ -0,0 +1,73 @@
+// test_mbmem.c - mbmem.c's memcpy and memset against libc's at every
+// alignment of both ends, across the short-copy cutoff and the unrolled
+// loops' tails.
+
+#include <string.h>
+
+#include "test_mbmem.h"
+
+#include "mbmem.h"
+
+#define BUF (96)
+// Untouched bytes either side of what is written
+#define GUARD (0xa5)
+
+static void
+pattern(u8 *p, u32 n)
+{
+  u32 i;
+
+  for(i=0; i<n; i++) {
+    p[i] = i * 7 + 1;
+  }
+}
+
+START_TEST(test_mbmem_copy)
+{
+  u32 src[BUF / 4], got[BUF / 4], want[BUF / 4];
+  u32 so, d, len;
+
+  pattern((u8 *)src, BUF);
+  for(so=0; so<4; so++) {
+    for(d=0; d<4; d++) {
+      for(len=0; len<=BUF-8; len++) {
+        memset(got, GUARD, BUF);
+        memset(want, GUARD, BUF);
+        memcpy((u8 *)want + d, (u8 *)src + so, len);
+        EXPECT(mb_memcpy((u8 *)got + d, (u8 *)src + so, len) ==
+            (u8 *)got + d);
+        EXPECT(memcmp(got, want, BUF) == 0);
+      }
+    }
+  }
+}
+END_TEST
+
+START_TEST(test_mbmem_set)
+{
+  u32 got[BUF / 4], want[BUF / 4];
+  u32 d, len;
+
+  for(d=0; d<4; d++) {
+    for(len=0; len<=BUF-4; len++) {
+      memset(got, GUARD, BUF);
+      memset(want, GUARD, BUF);
+      // Only the low byte of the value counts
+      memset((u8 *)want + d, 0x3c, len);
+      EXPECT(mb_memset((u8 *)got + d, 0x13c, len) == (u8 *)got + d);
+      EXPECT(memcmp(got, want, BUF) == 0);
+    }
+  }
+}
+END_TEST
+
+Suite *
+mbmem_suite(void)
+{
+  testfunc tests[] = {
+    TESTFUNC(test_mbmem_copy),
+    TESTFUNC(test_mbmem_set),
+  };
+  return create_suite("MBMEM", tests, sizeof(tests)/sizeof(testfunc),
+      NULL, NULL);
+}
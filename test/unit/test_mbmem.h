@@ -0,0 +1,8 @@
+#ifndef _TEST_MBMEM_H_
+#define _TEST_MBMEM_H_
+
+#include "jam_check.h"
+
+Suite *mbmem_suite(void);
+
+#endif // _TEST_MBMEM_H_
@@ -0,0 +1,151 @@
+// test_mbox.c - mbox.h's rings between two cores: sending, delivery to
+// handlers, a full ring and the peer waiting for side 0.  The peer's half
+// is played by writing the shared layout directly.
+
+#include <string.h>
+
+#include "test_mbox.h"
+
+#include "mbox.h"
+
+static struct mbox_shared shm;
+
+static u32 got_type;
+static u32 got_words[MBOX_WORDS];
+static u32 got_n;
+static u32 calls;
+
+static void
+handler(u16 type, const u32 *words, u32 n, void *arg)
+{
+  got_type = type;
+  got_n = n;
+  memcpy(got_words, words, n * sizeof(u32));
+  calls++;
+}
+
+// Hand a message to side 0 as side 1 would
+static void
+peer_send(u16 type, const u32 *words, u32 n)
+{
+  struct ring *r = &shm.ring[0];
+  struct mbox_slot *slot = &shm.slot[0][ring_head_slot(r)];
+
+  slot->type = type;
+  slot->len = n;
+  memcpy(slot->data, words, n * sizeof(u32));
+  ring_push(r, 1);
+}
+
+static void
+mbox_setup(void)
+{
+  memset(&shm, 0xa5, sizeof(shm));
+  calls = 0;
+}
+
+static void
+mbox_teardown(void)
+{
+  mbox_on(1, NULL, NULL);
+  mbox_on(2, NULL, NULL);
+}
+
+START_TEST(test_mbox_send)
+{
+  u32 words[3] = { 1, 2, 3 };
+  u32 epoch;
+
+  mbox_attach(&shm, 0);
+  EXPECT(mbox_ready());
+  epoch = shm.epoch;
+  EXPECT(ring_count(&shm.ring[0]) == 0);
+  EXPECT(ring_count(&shm.ring[1]) == 0);
+
+  EXPECT(mbox_send(7, words, 3) == 0);
+  EXPECT(ring_count(&shm.ring[1]) == 1);
+  EXPECT(shm.slot[1][0].type == 7);
+  EXPECT(shm.slot[1][0].len == 3);
+  EXPECT(memcmp(shm.slot[1][0].data, words, sizeof(words)) == 0);
+  EXPECT(mbox_send(7, words, MBOX_WORDS + 1) == -1);
+
+  // Attaching again starts the rings over
+  mbox_attach(&shm, 0);
+  EXPECT(shm.epoch == epoch + 1);
+  EXPECT(ring_count(&shm.ring[1]) == 0);
+}
+END_TEST
+
+START_TEST(test_mbox_poll)
+{
+  u32 words[2] = { 0x1234, 0x5678 };
+  u32 sent, full, received, dropped, dropped_before;
+
+  mbox_attach(&shm, 0);
+  mbox_counts(&sent, &full, &received, &dropped_before);
+  EXPECT(mbox_on(1, handler, NULL) == 0);
+  peer_send(1, words, 2);
+  peer_send(2, words, 1);
+  EXPECT(mbox_poll() == 2);
+  EXPECT(calls == 1);
+  EXPECT(got_type == 1);
+  EXPECT(got_n == 2);
+  EXPECT(got_words[1] == 0x5678);
+  EXPECT(ring_count(&shm.ring[0]) == 0);
+  mbox_counts(&sent, &full, &received, &dropped);
+  EXPECT(dropped == dropped_before + 1);
+  EXPECT(mbox_poll() == 0);
+}
+END_TEST
+
+START_TEST(test_mbox_full)
+{
+  u32 i, sent, full, received, dropped, full_before;
+
+  mbox_attach(&shm, 0);
+  mbox_counts(&sent, &full_before, &received, &dropped);
+  for(i=0; i<MBOX_SLOTS; i++) {
+    EXPECT(mbox_send(1, &i, 1) == 0);
+  }
+  EXPECT(mbox_send(1, &i, 1) == -1);
+  mbox_counts(&sent, &full, &received, &dropped);
+  EXPECT(full == full_before + 1);
+
+  // The peer takes one, and there is room again
+  ring_pop(&shm.ring[1], 1);
+  EXPECT(mbox_send(1, &i, 1) == 0);
+  EXPECT(shm.slot[1][0].data[0] == MBOX_SLOTS);
+}
+END_TEST
+
+START_TEST(test_mbox_side1)
+{
+  u32 word = 42;
+
+  // Not before side 0 has laid the rings out
+  mbox_attach(&shm, 1);
+  EXPECT(!mbox_ready());
+  EXPECT(mbox_send(1, &word, 1) == -1);
+  EXPECT(mbox_poll() == 0);
+
+  mbox_attach(&shm, 0);
+  mbox_attach(&shm, 1);
+  EXPECT(mbox_ready());
+  EXPECT(mbox_send(1, &word, 1) == 0);
+  EXPECT(ring_count(&shm.ring[0]) == 1);
+  EXPECT(shm.slot[0][0].data[0] == 42);
+}
+END_TEST
+
+Suite *
+mbox_suite(void)
+{
+  testfunc tests[] = {
+    TESTFUNC(test_mbox_send),
+    TESTFUNC(test_mbox_poll),
+    TESTFUNC(test_mbox_full),
+    TESTFUNC(test_mbox_side1),
+  };
+  return create_suite("MBOX", tests, sizeof(tests)/sizeof(testfunc),
+      mbox_setup, mbox_teardown);
+}
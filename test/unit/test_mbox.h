@@ -0,0 +1,8 @@
+#ifndef _TEST_MBOX_H_
+#define _TEST_MBOX_H_
+
+#include "jam_check.h"
+
+Suite *mbox_suite(void);
+
+#endif // _TEST_MBOX_H_
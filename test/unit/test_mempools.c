@@ -0,0 +1,242 @@
+// test_mempools.c - mem_malloc() on lwippools.h's classes: the stack's
+// PBUF_RAM allocations land in the classes lwippools.h sizes for them,
+// a class that runs out borrows from the next, and no mix of allocations
+// and frees leaves less room than there was.
+
+#include <string.h>
+
+#include "test_mempools.h"
+
+#include "eth.h"
+
+#include "lwip/mem.h"
+#include "lwip/memp.h"
+#include "lwip/pbuf.h"
+#include "lwip/ip4_addr.h"
+#include "lwip/prot/dhcp.h"
+#include "lwip/prot/tcp.h"
+#include "lwip/stats.h"
+
+// What mem_malloc() asks of a pool for `len` bytes
+#define HELPER_LEN LWIP_MEM_ALIGN_SIZE(sizeof(struct memp_malloc_helper))
+
+// Most allocations live at once in the random mix
+#define LIVE_MAX (64)
+
+static u16
+pool_used(memp_t pool)
+{
+  return memp_pools[pool]->stats->used;
+}
+
+// Largest request `pool` takes
+static u32
+pool_len(memp_t pool)
+{
+  return memp_pools[pool]->size - HELPER_LEN;
+}
+
+static u32 seed;
+
+static u32
+rand_next()
+{
+  seed = seed * 1103515245 + 12345;
+  return seed >> 8;
+}
+
+// Request pbuf_alloc() makes of mem_malloc() for a PBUF_RAM of `len` at
+// `layer`: 16 bytes of struct pbuf on the target, more on the host
+static u32
+alloc_len(pbuf_layer layer, u32 len)
+{
+  u32 off = PBUF_LINK_ENCAPSULATION_HLEN;
+
+  switch(layer) {
+  case PBUF_TRANSPORT:
+    off += PBUF_TRANSPORT_HLEN;
+    // Fall through
+  case PBUF_IP:
+    off += PBUF_IP_HLEN;
+    // Fall through
+  case PBUF_LINK:
+    off += PBUF_LINK_HLEN;
+    break;
+  default:
+    break;
+  }
+  return LWIP_MEM_ALIGN_SIZE(LWIP_MEM_ALIGN_SIZE(sizeof(struct pbuf)) + off) +
+      LWIP_MEM_ALIGN_SIZE(len);
+}
+
+START_TEST(test_mempools_classes)
+{
+  static const struct {
+    pbuf_layer layer;
+    u16 len;
+    // The class lwippools.h sizes for it
+    memp_t pool;
+  } allocs[] = {
+    // A TCP segment without data, and the header pbuf of tcpsrc.h's
+    { PBUF_IP, TCP_HLEN, MEMP_POOL_128 },
+    { PBUF_TRANSPORT, 0, MEMP_POOL_128 },
+    // ARP, SNTP, DHCP
+    { PBUF_LINK, 28, MEMP_POOL_128 },
+    { PBUF_TRANSPORT, 48, MEMP_POOL_128 },
+    { PBUF_TRANSPORT, sizeof(struct dhcp_msg), MEMP_POOL_512 },
+    // A full segment, and a full datagram
+    { PBUF_TRANSPORT, TCP_MSS, MEMP_POOL_1552 },
+    { PBUF_TRANSPORT, ETH_UDP_MAX, MEMP_POOL_1552 },
+  };
+  struct pbuf *p;
+  u32 i, len, bucket;
+  memp_t pool;
+  u16 used, next;
+
+  for(i=0; i<sizeof(allocs) / sizeof(allocs[0]); i++) {
+    mem_size_reset();
+    used = pool_used(allocs[i].pool);
+    p = pbuf_alloc(allocs[i].layer, allocs[i].len, PBUF_RAM);
+    EXPECT_RET(p != NULL);
+    EXPECT(pool_used(allocs[i].pool) == used + 1);
+    bucket = alloc_len(allocs[i].layer, allocs[i].len) / MEM_SIZE_TRACE_STEP;
+    if(bucket >= MEM_SIZE_TRACE) {
+      bucket = MEM_SIZE_TRACE - 1;
+    }
+    EXPECT(mem_size_count(bucket) == 1);
+    pbuf_free(p);
+    EXPECT(pool_used(allocs[i].pool) == used);
+  }
+  EXPECT(mem_size_count(MEM_SIZE_TRACE) == 0);
+
+  // The longest UDP payload each class takes, and one byte more goes up
+  for(pool=MEMP_POOL_FIRST; pool<MEMP_POOL_LAST; pool++) {
+    len = pool_len(pool) - alloc_len(PBUF_TRANSPORT, 0);
+    used = pool_used(pool);
+    next = pool_used(pool + 1);
+    p = pbuf_alloc(PBUF_TRANSPORT, len, PBUF_RAM);
+    EXPECT_RET(p != NULL);
+    EXPECT(pool_used(pool) == used + 1);
+    pbuf_free(p);
+    p = pbuf_alloc(PBUF_TRANSPORT, len + 1, PBUF_RAM);
+    EXPECT_RET(p != NULL);
+    EXPECT(pool_used(pool) == used);
+    EXPECT(pool_used(pool + 1) == next + 1);
+    pbuf_free(p);
+  }
+}
+END_TEST
+
+START_TEST(test_mempools_borrow)
+{
+  static void *small[64];
+  u16 used128 = pool_used(MEMP_POOL_128);
+  u16 used256 = pool_used(MEMP_POOL_256);
+  u32 n = 0, i;
+  void *m;
+
+  // Fill the smallest class; the next request goes to the next one up
+  while(pool_used(MEMP_POOL_128) < memp_pools[MEMP_POOL_128]->num) {
+    EXPECT_RET(n < sizeof(small) / sizeof(small[0]));
+    small[n] = mem_malloc(60);
+    EXPECT_RET(small[n] != NULL);
+    n++;
+  }
+  m = mem_malloc(60);
+  EXPECT(m != NULL);
+  EXPECT(pool_used(MEMP_POOL_256) == used256 + 1);
+  mem_free(m);
+
+  // Every other block free is room for as many, as no heap would be
+  for(i=0; i<n; i+=2) {
+    mem_free(small[i]);
+  }
+  for(i=0; i<n; i+=2) {
+    small[i] = mem_malloc(120);
+    EXPECT(small[i] != NULL);
+  }
+  EXPECT(pool_used(MEMP_POOL_256) == used256);
+  for(i=0; i<n; i++) {
+    mem_free(small[i]);
+  }
+  EXPECT(pool_used(MEMP_POOL_128) == used128);
+}
+END_TEST
+
+START_TEST(test_mempools_fragment)
+{
+  static void *live[LIVE_MAX];
+  static void *fill[64];
+  u16 used[MEMP_MAX];
+  u32 i, k, n, len, pick;
+  memp_t pool;
+
+  for(pool=MEMP_POOL_FIRST; pool<=MEMP_POOL_LAST; pool++) {
+    used[pool] = pool_used(pool);
+  }
+  memset(live, 0, sizeof(live));
+  seed = 1;
+
+  // The stack's mix: mostly headers and short replies, some full segments
+  for(i=0; i<20000; i++) {
+    k = rand_next() % LIVE_MAX;
+    if(live[k]) {
+      mem_free(live[k]);
+      live[k] = NULL;
+      continue;
+    }
+    pick = rand_next() % 100;
+    if(pick < 60) {
+      len = 40 + rand_next() % 88;
+    } else if(pick < 85) {
+      len = 129 + rand_next() % 380;
+    } else {
+      len = 600 + rand_next() % 950;
+    }
+    // Running out is fine, as long as it does not last
+    live[k] = mem_malloc(len);
+  }
+  for(k=0; k<LIVE_MAX; k++) {
+    if(live[k]) {
+      mem_free(live[k]);
+    }
+  }
+  for(pool=MEMP_POOL_FIRST; pool<=MEMP_POOL_LAST; pool++) {
+    EXPECT(pool_used(pool) == used[pool]);
+  }
+
+  // Every class still fills to the last block, largest first so that
+  // none borrows
+  n = 0;
+  for(pool=MEMP_POOL_LAST; ; pool--) {
+    k = n;
+    while(n < sizeof(fill) / sizeof(fill[0]) &&
+        (fill[n] = mem_malloc(pool_len(pool)))) {
+      n++;
+    }
+    EXPECT(n - k == memp_pools[pool]->num - used[pool]);
+    EXPECT(pool_used(pool) == memp_pools[pool]->num);
+    if(pool == MEMP_POOL_FIRST) {
+      break;
+    }
+  }
+  while(n) {
+    mem_free(fill[--n]);
+  }
+  for(pool=MEMP_POOL_FIRST; pool<=MEMP_POOL_LAST; pool++) {
+    EXPECT(pool_used(pool) == used[pool]);
+  }
+}
+END_TEST
+
+Suite *
+mempools_suite(void)
+{
+  testfunc tests[] = {
+    TESTFUNC(test_mempools_classes),
+    TESTFUNC(test_mempools_borrow),
+    TESTFUNC(test_mempools_fragment),
+  };
+  return create_suite("mempools", tests, sizeof(tests)/sizeof(testfunc),
+      jam_board_setup, jam_board_teardown);
+}
@@ -0,0 +1,8 @@
+#ifndef _TEST_MEMPOOLS_H_
+#define _TEST_MEMPOOLS_H_
+
+#include "jam_check.h"
+
+Suite *mempools_suite(void);
+
+#endif // _TEST_MEMPOOLS_H_
@@ -0,0 +1,53 @@
+// test_pace.c - pace.h's release times: a full bucket's burst, then frames
+// spaced at the rate, and an idle stream refilling no further than full.
+
+#include "test_pace.h"
+
+#include "pace.h"
+#include "timebase.h"
+
+// 1 MB/s on the simulated timebase: 100 cycles a byte
+#define RATE   (1000000)
+#define CPB    (TIMEBASE_HZ / RATE)
+
+START_TEST(test_pace_bucket)
+{
+  struct pace p;
+  u64 now = 1000;
+  u32 i;
+
+  EXPECT(pace_set(&p, 0, 0) == 0);
+  EXPECT(pace_release(&p, now, 1000) == now);
+  EXPECT(pace_set(&p, PACE_MIN_RATE - 1, 3000) == -1);
+
+  // Three frames fill the bucket's 3000 bytes, then one per 1000 bytes
+  EXPECT(pace_set(&p, RATE, 3000) == 0);
+  for(i=0; i<3; i++) {
+    EXPECT(pace_release(&p, now, 1000) == now);
+  }
+  for(i=1; i<=4; i++) {
+    EXPECT(pace_release(&p, now, 1000) == now + i * 1000 * CPB);
+  }
+
+  // Released on time, the stream keeps to the rate
+  now += 4 * 1000 * CPB;
+  EXPECT(pace_release(&p, now, 500) == now + 500 * CPB);
+
+  // Long idle saves up one bucket, no more
+  now += 1000000000;
+  for(i=0; i<6; i++) {
+    EXPECT(pace_release(&p, now, 500) == now);
+  }
+  EXPECT(pace_release(&p, now, 500) == now + 500 * CPB);
+}
+END_TEST
+
+Suite *
+pace_suite(void)
+{
+  testfunc tests[] = {
+    TESTFUNC(test_pace_bucket),
+  };
+  return create_suite("PACE", tests, sizeof(tests)/sizeof(testfunc),
+      NULL, NULL);
+}
@@ -0,0 +1,8 @@
+#ifndef _TEST_PACE_H_
+#define _TEST_PACE_H_
+
+#include "jam_check.h"
+
+Suite *pace_suite(void);
+
+#endif // _TEST_PACE_H_
@@ -0,0 +1,261 @@
+// test_preset.c - Register preset scripts against the simulated Wishbone
+// window: each step's effect, a poll that waits and one that times out,
+// malformed scripts refused before any write, and stored scripts chained
+// with PRESET_OP_NEXT, a cycle of them or a missing one ending the run.
+
+#include <string.h>
+
+#include "test_preset.h"
+
+#include "kv.h"
+#include "preset.h"
+#include "sim.h"
+#include "wbreg.h"
+
+static u8 code[PRESET_MAX_LEN];
+static u32 code_len;
+
+static int done_status;
+
+static void
+done(int status, void *arg)
+{
+  done_status = status;
+}
+
+static int
+stopped(void *arg)
+{
+  return !preset_stats()->running;
+}
+
+static int
+kv_idle(void *arg)
+{
+  return !kv_busy();
+}
+
+static void
+put8(u32 v)
+{
+  code[code_len++] = v;
+}
+
+static void
+put32(u32 v)
+{
+  u32 i;
+
+  for(i=0; i<4; i++) {
+    put8(v >> (8 * i));
+  }
+}
+
+static void
+step(u8 op, u32 addr)
+{
+  put8(op);
+  put32(addr);
+}
+
+static u32
+wb_word(u32 off)
+{
+  u32 v;
+
+  memcpy(&v, sim_wishbone() + off, 4);
+  return v;
+}
+
+static void
+wb_set(u32 off, u32 v)
+{
+  memcpy(sim_wishbone() + off, &v, 4);
+}
+
+static void
+preset_setup(void)
+{
+  jam_board_setup();
+  init_kv();
+  code_len = 0;
+  done_status = -1;
+}
+
+START_TEST(test_preset_steps)
+{
+  u32 i;
+
+  wb_set(0x104, 0xaabbccdd);
+  step(PRESET_OP_WRITE, 0x100);
+  put32(0x11223344);
+  step(PRESET_OP_RMW, 0x104);
+  put32(0x0000ff00);
+  put32(0x12345678);
+  step(PRESET_OP_BLOCK, 0x200);
+  put8(3);
+  for(i=0; i<3; i++) {
+    put32(0x1000 + i);
+  }
+  // Long enough to wait on the timer
+  step(PRESET_OP_DELAY, 2500);
+  step(PRESET_OP_POLL, 0x108);
+  put32(0x3);
+  put32(0x1);
+  put8(100);
+  put8(0);
+  step(PRESET_OP_WRITE, 0x10c);
+  put32(0xdeadbeef);
+  put8(PRESET_OP_END);
+  // Past the end, never run
+  step(PRESET_OP_WRITE, 0x110);
+  put32(1);
+
+  EXPECT_RET(preset_exec(code, code_len, done, NULL) == 0);
+  EXPECT(preset_exec(code, code_len, done, NULL) == -1);
+  sim_run_ms(10);
+  EXPECT(wb_word(0x100) == 0x11223344);
+  EXPECT(wb_word(0x104) == 0xaabb56dd);
+  for(i=0; i<3; i++) {
+    EXPECT(wb_word(0x200 + 4 * i) == 0x1000 + i);
+  }
+  // Still polling
+  EXPECT(preset_stats()->running);
+  EXPECT(wb_word(0x10c) == 0);
+
+  wb_set(0x108, 0x5);
+  EXPECT_RET(sim_run_until(stopped, NULL, 10));
+  EXPECT(done_status == PRESET_OK);
+  EXPECT(wb_word(0x10c) == 0xdeadbeef);
+  EXPECT(wb_word(0x110) == 0);
+  EXPECT(preset_stats()->script == PRESET_MAX);
+  EXPECT(preset_stats()->ms >= 10);
+}
+END_TEST
+
+START_TEST(test_preset_timeout)
+{
+  u32 poll;
+
+  step(PRESET_OP_WRITE, 0x100);
+  put32(1);
+  poll = code_len;
+  step(PRESET_OP_POLL, 0x104);
+  put32(0x80000000);
+  put32(0x80000000);
+  put8(5);
+  put8(0);
+  step(PRESET_OP_WRITE, 0x108);
+  put32(1);
+
+  EXPECT_RET(preset_exec(code, code_len, done, NULL) == 0);
+  EXPECT_RET(sim_run_until(stopped, NULL, 20));
+  EXPECT(done_status == PRESET_ETIMEDOUT);
+  EXPECT(preset_stats()->at == poll);
+  EXPECT(preset_stats()->ms >= 5);
+  EXPECT(wb_word(0x100) == 1 && wb_word(0x108) == 0);
+}
+END_TEST
+
+START_TEST(test_preset_malformed)
+{
+  u32 at;
+
+  // A good step, then a misaligned address: nothing is written
+  step(PRESET_OP_WRITE, 0x100);
+  put32(1);
+  step(PRESET_OP_WRITE, 0x102);
+  put32(1);
+  EXPECT(preset_check(code, code_len, &at) == PRESET_EINVAL && at == 9);
+  EXPECT(preset_exec(code, code_len, done, NULL) == -1);
+  EXPECT(preset_set(1, code, code_len) == -1);
+  sim_run_ms(2);
+  EXPECT(wb_word(0x100) == 0);
+
+  // Outside the window, running off its end, cut short, unknown
+  code_len = 0;
+  step(PRESET_OP_RMW, WBREG_SIZE);
+  put32(0);
+  put32(0);
+  EXPECT(preset_check(code, code_len, NULL) == PRESET_EINVAL);
+  code_len = 0;
+  step(PRESET_OP_BLOCK, WBREG_SIZE - 8);
+  put8(3);
+  put32(0);
+  put32(0);
+  put32(0);
+  EXPECT(preset_check(code, code_len, NULL) == PRESET_EINVAL);
+  EXPECT(preset_check(code, code_len - 4, NULL) == PRESET_EINVAL);
+  code[5] = 2;
+  EXPECT(preset_check(code, code_len - 4, NULL) == PRESET_OK);
+  code_len = 0;
+  put8(PRESET_OP_NEXT);
+  put8(PRESET_MAX);
+  EXPECT(preset_check(code, code_len, NULL) == PRESET_EINVAL);
+  code[0] = 0x7f;
+  EXPECT(preset_check(code, code_len, NULL) == PRESET_EINVAL);
+}
+END_TEST
+
+START_TEST(test_preset_stored)
+{
+  u8 next[2] = { PRESET_OP_NEXT, 0 };
+
+  step(PRESET_OP_RMW, 0x100);
+  put32(0x1);
+  put32(0x1);
+  EXPECT_RET(preset_set(1, code, code_len) == 0);
+  EXPECT_RET(sim_run_until(kv_idle, NULL, 5000));
+  EXPECT(preset_len(1) == code_len);
+
+  // Script 0 goes on with script 1
+  code_len = 0;
+  step(PRESET_OP_WRITE, 0x104);
+  put32(7);
+  put8(PRESET_OP_NEXT);
+  put8(1);
+  EXPECT_RET(preset_set(0, code, code_len) == 0);
+  EXPECT_RET(sim_run_until(kv_idle, NULL, 5000));
+
+  EXPECT(preset_run(2, done, NULL) == -1);
+  EXPECT_RET(preset_run(0, done, NULL) == 0);
+  EXPECT_RET(sim_run_until(stopped, NULL, 10));
+  EXPECT(done_status == PRESET_OK);
+  EXPECT(preset_stats()->script == 1);
+  EXPECT(wb_word(0x104) == 7 && wb_word(0x100) == 1);
+
+  // Script 1 going back to script 0 never ends on its own
+  code_len = 0;
+  step(PRESET_OP_RMW, 0x100);
+  put32(0x1);
+  put32(0x1);
+  put8(PRESET_OP_NEXT);
+  put8(0);
+  EXPECT_RET(preset_set(1, code, code_len) == 0);
+  EXPECT_RET(sim_run_until(kv_idle, NULL, 5000));
+  EXPECT_RET(preset_run(0, done, NULL) == 0);
+  EXPECT_RET(sim_run_until(stopped, NULL, 10));
+  EXPECT(done_status == PRESET_ELOOP);
+
+  // Deleted, it is gone, and going on with it stops the run
+  EXPECT_RET(preset_set(1, NULL, 0) == 0);
+  EXPECT_RET(sim_run_until(kv_idle, NULL, 5000));
+  EXPECT(preset_len(1) == -1);
+  EXPECT(preset_exec(next, sizeof(next), done, NULL) == 0);
+  EXPECT_RET(sim_run_until(stopped, NULL, 10));
+  EXPECT(done_status == PRESET_ENOENT);
+}
+END_TEST
+
+Suite *
+preset_suite(void)
+{
+  testfunc tests[] = {
+    TESTFUNC(test_preset_steps),
+    TESTFUNC(test_preset_timeout),
+    TESTFUNC(test_preset_malformed),
+    TESTFUNC(test_preset_stored),
+  };
+  return create_suite("preset", tests, sizeof(tests)/sizeof(testfunc),
+      preset_setup, jam_board_teardown);
+}
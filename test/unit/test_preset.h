@@ -0,0 +1,8 @@
+#ifndef _TEST_PRESET_H_
+#define _TEST_PRESET_H_
+
+#include "jam_check.h"
+
+Suite *preset_suite(void);
+
+#endif // _TEST_PRESET_H_
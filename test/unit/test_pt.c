@@ -0,0 +1,168 @@
+// test_pt.c - pt.h's threads on the simulated main loop: a thread goes on
+// from each wait where it left off once the completion, timer or
+// condition it waits on comes, times out, and runs `done` at its end.
+
+#include <string.h>
+
+#include "test_pt.h"
+
+#include "pt.h"
+#include "sim.h"
+#include "wbreg.h"
+
+// Clear of the offsets the other suites use
+#define REG_OFF (0x8100)
+
+struct steps {
+  // Where the thread got to, and the `err` of each wait
+  u32 step;
+  int err[4];
+  // Start functions fail while this is set
+  u8 fail;
+  u32 ended;
+};
+
+static struct steps steps;
+static struct pt *waiting;
+
+static int
+start_op(struct pt *pt)
+{
+  if(steps.fail) {
+    return -1;
+  }
+  waiting = pt;
+  return 0;
+}
+
+static int
+await_thread(struct pt *pt)
+{
+  struct steps *s = pt->arg;
+
+  PT_BEGIN(pt);
+  s->step = 1;
+  PT_AWAIT(pt, start_op(pt));
+  s->err[0] = pt->err;
+  s->step = 2;
+  PT_AWAIT(pt, start_op(pt));
+  s->err[1] = pt->err;
+  s->step = 3;
+  PT_END(pt);
+}
+
+static void
+ended(struct pt *pt)
+{
+  ((struct steps *)pt->arg)->ended++;
+}
+
+START_TEST(test_pt_await)
+{
+  struct pt pt = PT_INIT(await_thread, ended, &steps);
+
+  memset(&steps, 0, sizeof(steps));
+  EXPECT(pt_start(&pt) == 0);
+  EXPECT(pt_start(&pt) == -1);
+  sim_run_ms(1);
+  EXPECT(steps.step == 1 && waiting == &pt);
+
+  // Nothing until the completion
+  sim_run_ms(5);
+  EXPECT(steps.step == 1);
+  pt_wake(&pt, -7);
+  steps.fail = 1;
+  sim_run_ms(1);
+  EXPECT(steps.err[0] == -7);
+  // The second start fails, which ends the thread
+  EXPECT(steps.step == 3 && steps.err[1] == PT_ESTART);
+  EXPECT(!pt_running(&pt) && steps.ended == 1);
+}
+END_TEST
+
+static int
+sleep_thread(struct pt *pt)
+{
+  struct steps *s = pt->arg;
+
+  PT_BEGIN(pt);
+  PT_SLEEP(pt, 10);
+  s->step = 1;
+  PT_YIELD(pt);
+  s->step = 2;
+  PT_WAIT_REG(pt, WBREG_BASE + REG_OFF, 0x10, 0x10, 20);
+  s->err[0] = pt->err;
+  s->step = 3;
+  PT_WAIT_REG(pt, WBREG_BASE + REG_OFF, 0x10, 0, 20);
+  s->err[1] = pt->err;
+  s->step = 4;
+  PT_END(pt);
+}
+
+static void
+reg_set(u32 v)
+{
+  memcpy(sim_wishbone() + REG_OFF, &v, 4);
+}
+
+START_TEST(test_pt_sleep_wait)
+{
+  struct pt pt = PT_INIT(sleep_thread, ended, &steps);
+
+  memset(&steps, 0, sizeof(steps));
+  reg_set(0);
+  EXPECT(pt_start(&pt) == 0);
+  sim_run_ms(9);
+  EXPECT(steps.step == 0);
+  sim_run_ms(3);
+  EXPECT(steps.step == 2);
+
+  // The bit comes up before the timeout
+  sim_run_ms(5);
+  EXPECT(steps.step == 2);
+  reg_set(0x30);
+  sim_run_ms(1);
+  EXPECT(steps.step == 3 && steps.err[0] == 0);
+
+  // It stays up past the timeout
+  sim_run_ms(19);
+  EXPECT(steps.step == 3);
+  sim_run_ms(3);
+  EXPECT(steps.step == 4 && steps.err[1] == PT_ETIMEDOUT);
+  EXPECT(!pt_running(&pt) && steps.ended == 1);
+}
+END_TEST
+
+START_TEST(test_pt_stop)
+{
+  struct pt pt = PT_INIT(sleep_thread, ended, &steps);
+
+  memset(&steps, 0, sizeof(steps));
+  reg_set(0);
+  EXPECT(pt_start(&pt) == 0);
+  sim_run_ms(12);
+  EXPECT(steps.step == 2);
+  pt_stop(&pt);
+  reg_set(0x10);
+  sim_run_ms(30);
+  EXPECT(steps.step == 2 && steps.ended == 0);
+
+  // From the top again
+  EXPECT(pt_start(&pt) == 0);
+  sim_run_ms(12);
+  EXPECT(steps.step == 3);
+  pt_stop(&pt);
+}
+END_TEST
+
+Suite *
+pt_suite(void)
+{
+  testfunc tests[] = {
+    TESTFUNC(test_pt_await),
+    TESTFUNC(test_pt_sleep_wait),
+    TESTFUNC(test_pt_stop),
+  };
+  return create_suite("pt", tests, sizeof(tests)/sizeof(testfunc),
+      jam_board_setup, jam_board_teardown);
+}
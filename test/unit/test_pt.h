@@ -0,0 +1,8 @@
+#ifndef _TEST_PT_H_
+#define _TEST_PT_H_
+
+#include "jam_check.h"
+
+Suite *pt_suite(void);
+
+#endif // _TEST_PT_H_
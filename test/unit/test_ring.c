@@ -0,0 +1,85 @@
+// test_ring.c - ring.h's indices: filling, draining in runs across the
+// wrap, and a history ring's overwrite check.
+
+#include "test_ring.h"
+
+#include "ring.h"
+
+START_TEST(test_ring_spsc)
+{
+  struct ring r = RING_INIT(8);
+  u8 buf[8];
+  u32 i, n;
+
+  EXPECT(ring_count(&r) == 0);
+  EXPECT(ring_space(&r) == 8);
+  for(i=0; i<8; i++) {
+    buf[ring_head_slot(&r)] = i;
+    ring_push(&r, 1);
+  }
+  EXPECT(ring_space(&r) == 0);
+  EXPECT(ring_run(&r) == 8);
+
+  ring_pop(&r, 5);
+  for(i=8; i<13; i++) {
+    buf[ring_head_slot(&r)] = i;
+    ring_push(&r, 1);
+  }
+  // 5..7 before the end of the array, then 8..12 from its start
+  EXPECT(ring_count(&r) == 8);
+  n = ring_run(&r);
+  EXPECT(n == 3);
+  EXPECT(buf[ring_tail_slot(&r)] == 5);
+  ring_pop(&r, n);
+  EXPECT(ring_run(&r) == 5);
+  EXPECT(buf[ring_tail_slot(&r)] == 8);
+  ring_pop(&r, 5);
+  EXPECT(ring_count(&r) == 0);
+  EXPECT(ring_run(&r) == 0);
+}
+END_TEST
+
+START_TEST(test_ring_wrap)
+{
+  struct ring r = RING_INIT(4);
+
+  // Indices run freely through the 32-bit wrap
+  r.head = r.tail = 0xfffffffe;
+  ring_push(&r, 3);
+  EXPECT(ring_count(&r) == 3);
+  EXPECT(ring_space(&r) == 1);
+  EXPECT(ring_run(&r) == 2);
+  ring_pop(&r, 2);
+  EXPECT(ring_tail_slot(&r) == 0);
+  EXPECT(ring_run(&r) == 1);
+}
+END_TEST
+
+START_TEST(test_ring_history)
+{
+  struct ring r = RING_INIT(4);
+
+  EXPECT(!ring_holds(&r, 0));
+  ring_push(&r, 3);
+  EXPECT(ring_holds(&r, 0));
+  EXPECT(ring_holds(&r, 2));
+  EXPECT(!ring_holds(&r, 3));
+  ring_push(&r, 2);
+  // Entry 0 is overwritten by entry 4
+  EXPECT(!ring_holds(&r, 0));
+  EXPECT(ring_holds(&r, 1));
+  EXPECT(ring_holds(&r, 4));
+}
+END_TEST
+
+Suite *
+ring_suite(void)
+{
+  testfunc tests[] = {
+    TESTFUNC(test_ring_spsc),
+    TESTFUNC(test_ring_wrap),
+    TESTFUNC(test_ring_history),
+  };
+  return create_suite("RING", tests, sizeof(tests)/sizeof(testfunc),
+      NULL, NULL);
+}
@@ -0,0 +1,8 @@
+#ifndef _TEST_RING_H_
+#define _TEST_RING_H_
+
+#include "jam_check.h"
+
+Suite *ring_suite(void);
+
+#endif // _TEST_RING_H_
@@ -0,0 +1,68 @@
+// test_sha1.c - sha1() against FIPS 180 and RFC 6455's examples, and the
+// lengths either side of the padding's second block.
+
+#include <stdio.h>
+#include <string.h>
+
+#include "test_sha1.h"
+
+#include "sha1.h"
+
+static int
+digest_is(const void *buf, u32 len, const char *want)
+{
+  u8 d[SHA1_LEN];
+  char hex[2 * SHA1_LEN + 1];
+  int i;
+
+  sha1(buf, len, d);
+  for(i=0; i<SHA1_LEN; i++) {
+    sprintf(hex + 2 * i, "%02x", d[i]);
+  }
+  return strcmp(hex, want) == 0;
+}
+
+START_TEST(test_sha1_vectors)
+{
+  const char *two = "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
+
+  EXPECT(digest_is("", 0, "da39a3ee5e6b4b0d3255bfef95601890afd80709"));
+  EXPECT(digest_is("abc", 3, "a9993e364706816aba3e25717850c26c9cd0d89d"));
+  EXPECT(digest_is(two, strlen(two),
+      "84983e441c3bd26ebaae4aa1f95129e5e54670f1"));
+}
+END_TEST
+
+START_TEST(test_sha1_padding)
+{
+  u8 a[64];
+
+  memset(a, 'a', sizeof(a));
+  // The length still fits after the 1 bit, and then it does not
+  EXPECT(digest_is(a, 55, "c1c8bbdc22796e28c0e15163d20899b65621d65a"));
+  EXPECT(digest_is(a, 64, "0098ba824b5c16427bd7a1122a5a442a25ec644d"));
+}
+END_TEST
+
+START_TEST(test_sha1_websocket)
+{
+  const char *key = "dGhlIHNhbXBsZSBub25jZQ=="
+    "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+
+  // Base64, "s3pPLMBiTxaQ9kYGzzhZRbK+xOo="
+  EXPECT(digest_is(key, strlen(key),
+      "b37a4f2cc0624f1690f64606cf385945b2bec4ea"));
+}
+END_TEST
+
+Suite *
+sha1_suite(void)
+{
+  testfunc tests[] = {
+    TESTFUNC(test_sha1_vectors),
+    TESTFUNC(test_sha1_padding),
+    TESTFUNC(test_sha1_websocket),
+  };
+  return create_suite("SHA1", tests, sizeof(tests)/sizeof(testfunc),
+      NULL, NULL);
+}
@@ -0,0 +1,8 @@
+#ifndef _TEST_SHA1_H_
+#define _TEST_SHA1_H_
+
+#include "jam_check.h"
+
+Suite *sha1_suite(void);
+
+#endif // _TEST_SHA1_H_
@@ -0,0 +1,302 @@
+// test_spi.c - send_spi(), recv_spi(), submit_spi() and its lists and status
+// polls, devices, faults and the statistics, against the SPI core and flash
+// models.
+
+#include <string.h>
+
+#include "xil_io.h"
+#include "xspi_l.h"
+
+#include "test_spi.h"
+
+#include "flashsim.h"
+#include "intr.h"
+#include "sim.h"
+#include "spi.h"
+#include "spisim.h"
+
+// RDID: Micron, N25Q 128 Mb, 16 bytes of unique ID
+static const u8 rdid[4] = { 0x20, 0xba, 0x18, 0x10 };
+
+static int xfers_done;
+
+static void
+xfer_done(struct spi_xfer *xfer)
+{
+  xfers_done++;
+}
+
+static void
+sink_append(const u8 *buf, u32 len, void *arg)
+{
+  u8 **dst = (u8 **)arg;
+
+  memcpy(*dst, buf, len);
+  *dst += len;
+}
+
+static int
+none_queued(void *arg)
+{
+  return !spi_busy() && xfers_done == *(int *)arg;
+}
+
+START_TEST(test_spi_rdid)
+{
+  u8 buf[5] = { 0x9e };
+
+  EXPECT_RET(send_spi(buf, buf, sizeof(buf), 0) == sizeof(buf));
+  EXPECT(memcmp(&buf[1], rdid, sizeof(rdid)) == 0);
+}
+END_TEST
+
+START_TEST(test_spi_more)
+{
+  u8 buf[5] = { 0x9e };
+
+  // The second call carries on where the first left off
+  EXPECT_RET(send_spi(buf, buf, 2, SEND_SPI_MORE) == 2);
+  EXPECT_RET(send_spi(&buf[2], &buf[2], 3, 0) == 3);
+  EXPECT(memcmp(&buf[1], rdid, sizeof(rdid)) == 0);
+
+  // Without SEND_SPI_MORE the next call is a new command
+  buf[0] = 0x9e;
+  EXPECT_RET(send_spi(buf, buf, 1, 0) == 1);
+  EXPECT_RET(send_spi(buf, buf, 1, 0) == 1);
+  EXPECT(buf[0] == 0xff);
+}
+END_TEST
+
+START_TEST(test_spi_recv)
+{
+  u8 op = 0x9e;
+  u8 buf[64];
+  u8 *p = buf;
+
+  // Longer than the FIFO, so it comes in bursts
+  EXPECT_RET(send_spi(&op, &op, 1, SEND_SPI_MORE) == 1);
+  EXPECT_RET(recv_spi(40, 0, sink_append, &p) == 40);
+  EXPECT(p == buf + 40);
+  EXPECT(memcmp(buf, rdid, sizeof(rdid)) == 0);
+  EXPECT(buf[4] == 0x00 && buf[19] == 0xff);
+}
+END_TEST
+
+START_TEST(test_spi_async)
+{
+  static u8 buf[40];
+  static struct spi_xfer xfer;
+  u32 start = spisim_bytes();
+  int want = xfers_done + 1;
+  u8 b = 0x9e;
+  u32 msr;
+
+  memset(buf, 0, sizeof(buf));
+  buf[0] = 0x9e;
+  memset(&xfer, 0, sizeof(xfer));
+  xfer.src = xfer.dst = buf;
+  xfer.len = sizeof(buf);
+  xfer.done = xfer_done;
+
+  // With interrupts masked the transfer waits on the tx half empty
+  // interrupt, and the core belongs to it
+  msr = intr_lock();
+  EXPECT(submit_spi(&xfer) == 0);
+  EXPECT(spi_busy());
+  EXPECT(send_spi(&b, &b, 1, 0) == 0);
+  intr_unlock(msr);
+
+  EXPECT_RET(sim_run_until(none_queued, &want, 10));
+  EXPECT(xfer.count == sizeof(buf));
+  EXPECT(memcmp(&buf[1], rdid, sizeof(rdid)) == 0);
+  EXPECT(spisim_bytes() - start == sizeof(buf));
+}
+END_TEST
+
+START_TEST(test_spi_async_chain)
+{
+  static u8 cmd[1], data[4];
+  static struct spi_xfer x0, x1;
+  int want = xfers_done + 2;
+
+  cmd[0] = 0x9e;
+  memset(data, 0, sizeof(data));
+  memset(&x0, 0, sizeof(x0));
+  memset(&x1, 0, sizeof(x1));
+  x0.src = x0.dst = cmd;
+  x0.len = 1;
+  x0.opt = SEND_SPI_MORE;
+  x0.done = xfer_done;
+  x1.src = x1.dst = data;
+  x1.len = sizeof(data);
+  x1.done = xfer_done;
+
+  EXPECT(submit_spi(&x0) == 0);
+  EXPECT(submit_spi(&x1) == 0);
+  EXPECT_RET(sim_run_until(none_queued, &want, 10));
+  EXPECT(memcmp(data, rdid, sizeof(rdid)) == 0);
+}
+END_TEST
+
+START_TEST(test_spi_poll)
+{
+  static u8 wren[1], erase[4], rdsr_op[2], rdsr[2];
+  static struct spi_xfer x0, x1, x2;
+  u32 start = spisim_bytes();
+  int want = xfers_done + 1;
+
+  memset(&x0, 0, sizeof(x0));
+  memset(&x1, 0, sizeof(x1));
+  memset(&x2, 0, sizeof(x2));
+  wren[0] = 0x06;
+  x0.src = x0.dst = wren;
+  x0.len = 1;
+  x0.next = &x1;
+  erase[0] = 0x20;
+  erase[1] = erase[2] = erase[3] = 0;
+  x1.src = x1.dst = erase;
+  x1.len = sizeof(erase);
+  x1.next = &x2;
+  rdsr_op[0] = 0x05;
+  x2.src = rdsr_op;
+  x2.dst = rdsr;
+  x2.len = sizeof(rdsr);
+  x2.opt = SPI_XFER_POLL;
+  x2.mask = 0x01;
+  x2.tries = 2;
+  x2.done = xfer_done;
+
+  // The erase keeps WIP set for FLASHSIM_BUSY_POLLS reads: two tries are
+  // not enough
+  EXPECT(submit_spi_chain(&x0) == 0);
+  EXPECT_RET(sim_run_until(none_queued, &want, 10));
+  EXPECT(x2.count == 0);
+  EXPECT(spisim_bytes() - start == 1 + 4 + 2 * 2);
+
+  // Until the bit clears
+  x2.tries = 0;
+  want++;
+  EXPECT(submit_spi(&x2) == 0);
+  EXPECT_RET(sim_run_until(none_queued, &want, 10));
+  EXPECT(x2.count == sizeof(rdsr) && !(rdsr[1] & 0x01));
+}
+END_TEST
+
+START_TEST(test_spi_stats)
+{
+  static u8 buf[40];
+  static struct spi_xfer xfer;
+  u8 b[5] = { 0x9e };
+  struct spi_stats before = spi_stats;
+  u32 msr;
+
+  EXPECT_RET(send_spi(b, b, sizeof(b), 0) == sizeof(b));
+  EXPECT(spi_error() == SPI_OK);
+  EXPECT(spi_stats.xfers - before.xfers == 1);
+  EXPECT(spi_stats.bytes - before.bytes == sizeof(b));
+  EXPECT(spi_stats.busy_cycles > before.busy_cycles);
+
+  // The core belongs to the queue
+  memset(&xfer, 0, sizeof(xfer));
+  xfer.src = xfer.dst = buf;
+  xfer.len = sizeof(buf);
+  msr = intr_lock();
+  submit_spi(&xfer);
+  EXPECT(send_spi(b, b, 1, 0) == 0);
+  EXPECT(spi_error() == SPI_EBUSY);
+  intr_unlock(msr);
+  EXPECT_RET(sim_run_until(none_queued, &xfers_done, 10));
+  EXPECT(xfer.count == sizeof(buf) && xfer.err == SPI_OK);
+  EXPECT(spi_stats.timeouts == before.timeouts);
+}
+END_TEST
+
+START_TEST(test_spi_fault)
+{
+  u8 b[5] = { 0x9e };
+  u32 isr = XPAR_SPI_0_BASEADDR + XSP_IISR_OFFSET;
+  u32 cr = XPAR_SPI_0_BASEADDR + XSP_CR_OFFSET;
+  struct spi_stats before = spi_stats;
+
+  // A faulted transfer is closed and counted once
+  Xil_Out32(isr, XSP_INTR_MODE_FAULT_MASK);
+  EXPECT(send_spi(b, b, sizeof(b), 0) == 0);
+  EXPECT(spi_error() == SPI_EMODF);
+  EXPECT(spi_stats.xfers - before.xfers == 1);
+  EXPECT(spi_stats.mode_faults - before.mode_faults == 1);
+
+  // Including one SEND_SPI_MORE would have left open
+  b[0] = 0x9e;
+  Xil_Out32(isr, XSP_INTR_MODE_FAULT_MASK);
+  EXPECT(send_spi(b, b, 2, SEND_SPI_MORE) == 0);
+  EXPECT(spi_stats.xfers - before.xfers == 2);
+  EXPECT(!(Xil_In32(cr) & XSP_CR_ENABLE_MASK));
+
+  b[0] = 0x9e;
+  EXPECT_RET(send_spi(b, b, sizeof(b), 0) == sizeof(b));
+  EXPECT(memcmp(&b[1], rdid, sizeof(rdid)) == 0);
+  EXPECT(spi_stats.xfers - before.xfers == 3);
+}
+END_TEST
+
+START_TEST(test_spi_dev)
+{
+  static const struct spi_dev other = { 0x2, SPI_CPOL | SPI_CPHA };
+  static u8 buf[5], id[5];
+  static struct spi_xfer x[2];
+  u8 b[5] = { 0x9e, 0, 0, 0, 0 };
+  u32 cr = XPAR_SPI_0_BASEADDR + XSP_CR_OFFSET;
+  int want = 1;
+
+  // Another slave is selected with its own clock mode, not the flash's
+  EXPECT_RET(send_spi_dev(&other, b, b, sizeof(b), 0) == sizeof(b));
+  EXPECT(b[1] == 0xff && b[4] == 0xff);
+  EXPECT((Xil_In32(cr) & (XSP_CR_CLK_POLARITY_MASK | XSP_CR_CLK_PHASE_MASK)) ==
+      (XSP_CR_CLK_POLARITY_MASK | XSP_CR_CLK_PHASE_MASK));
+
+  // A transaction left open for the flash ends before the other's starts
+  b[0] = 0x9e;
+  EXPECT_RET(send_spi(b, b, 2, SEND_SPI_MORE) == 2);
+  EXPECT(b[1] == rdid[0]);
+  EXPECT_RET(send_spi_dev(&other, b, b, 1, 0) == 1);
+  b[0] = 0x9e;
+  EXPECT_RET(send_spi(b, b, sizeof(b), 0) == sizeof(b));
+  EXPECT(memcmp(&b[1], rdid, sizeof(rdid)) == 0);
+  EXPECT(!(Xil_In32(cr) & (XSP_CR_CLK_POLARITY_MASK | XSP_CR_CLK_PHASE_MASK)));
+
+  // Queued transfers switch devices too
+  memset(x, 0, sizeof(x));
+  memset(buf, 0x9e, sizeof(buf));
+  id[0] = 0x9e;
+  x[0].dev = &other;
+  x[0].src = x[0].dst = buf;
+  x[0].len = sizeof(buf);
+  x[1].src = x[1].dst = id;
+  x[1].len = sizeof(id);
+  x[1].done = xfer_done;
+  x[0].next = &x[1];
+  xfers_done = 0;
+  submit_spi_chain(&x[0]);
+  EXPECT_RET(sim_run_until(none_queued, &want, 10));
+  EXPECT(buf[1] == 0xff && x[0].count == sizeof(buf));
+  EXPECT(memcmp(&id[1], rdid, sizeof(rdid)) == 0);
+}
+END_TEST
+
+Suite *
+spi_suite(void)
+{
+  testfunc tests[] = {
+    TESTFUNC(test_spi_rdid),
+    TESTFUNC(test_spi_more),
+    TESTFUNC(test_spi_recv),
+    TESTFUNC(test_spi_async),
+    TESTFUNC(test_spi_async_chain),
+    TESTFUNC(test_spi_poll),
+    TESTFUNC(test_spi_stats),
+    TESTFUNC(test_spi_fault),
+    TESTFUNC(test_spi_dev),
+  };
+  return create_suite("SPI", tests, sizeof(tests)/sizeof(testfunc),
+      jam_board_setup, jam_board_teardown);
+}
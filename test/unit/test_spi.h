@@ -0,0 +1,8 @@
+#ifndef _TEST_SPI_H_
+#define _TEST_SPI_H_
+
+#include "jam_check.h"
+
+Suite *spi_suite(void);
+
+#endif // _TEST_SPI_H_
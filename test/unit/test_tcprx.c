@@ -0,0 +1,100 @@
+// test_tcprx.c - tcprx.h on a connection that never receives for real:
+// bytes come off the front in order across pbufs, the window reopens with
+// what is taken, and closing acknowledges the rest instead of resetting.
+
+#include <string.h>
+
+#include "test_tcprx.h"
+
+#include "tcprx.h"
+
+#include "lwip/priv/tcp_priv.h"
+
+static struct tcprx rx;
+
+// A pbuf of `len` bytes counting up from `first`, taken off the window as
+// if just received
+static struct pbuf *
+new_pbuf(struct tcp_pcb *pcb, u8 first, u32 len)
+{
+  struct pbuf *p = pbuf_alloc(PBUF_RAW, len, PBUF_RAM);
+  u32 i;
+
+  fail_if(p == NULL);
+  for(i=0; i<len; i++) {
+    ((u8 *)p->payload)[i] = first + i;
+  }
+  pcb->rcv_wnd -= len;
+  return p;
+}
+
+static struct tcp_pcb *
+new_pcb()
+{
+  struct tcp_pcb *pcb = tcp_new();
+
+  fail_if(pcb == NULL);
+  pcb->state = ESTABLISHED;
+  pcb->mss = TCP_MSS;
+  return pcb;
+}
+
+START_TEST(test_tcprx_take)
+{
+  struct tcp_pcb *pcb = new_pcb();
+  u8 buf[20];
+  u32 i;
+
+  tcprx_init(&rx);
+  EXPECT(tcprx_take(&rx, pcb, buf, sizeof(buf)) == 0);
+  tcprx_add(&rx, new_pbuf(pcb, 0, 10));
+  tcprx_add(&rx, new_pbuf(pcb, 10, 10));
+  tcprx_add(&rx, new_pbuf(pcb, 20, 10));
+  EXPECT(tcprx_len(&rx) == 30);
+  EXPECT(pcb->rcv_wnd == TCP_WND - 30);
+
+  // Across the end of the first pbuf, which is freed
+  EXPECT(tcprx_take(&rx, pcb, buf, 4) == 4);
+  EXPECT(tcprx_take(&rx, pcb, buf + 4, 12) == 12);
+  for(i=0; i<16; i++) {
+    EXPECT(buf[i] == i);
+  }
+  EXPECT(tcprx_len(&rx) == 14 && rx.off == 6);
+  EXPECT(pcb->rcv_wnd == TCP_WND - 14);
+
+  // Dropping to the end of one leaves the next at its start
+  tcprx_drop(&rx, pcb, 4);
+  EXPECT(tcprx_len(&rx) == 10 && rx.off == 0);
+  EXPECT(tcprx_take(&rx, pcb, buf, sizeof(buf)) == 10);
+  EXPECT(buf[0] == 20 && buf[9] == 29);
+  EXPECT(rx.p == NULL && tcprx_len(&rx) == 0);
+  EXPECT(pcb->rcv_wnd == TCP_WND);
+  tcp_abort(pcb);
+}
+END_TEST
+
+START_TEST(test_tcprx_close)
+{
+  struct tcp_pcb *pcb = new_pcb();
+
+  // Unread data is acknowledged, so the close sends a FIN, not a reset
+  tcprx_init(&rx);
+  tcprx_add(&rx, new_pbuf(pcb, 0, 10));
+  EXPECT(tcprx_close(&rx, pcb) == ERR_OK);
+  EXPECT(rx.p == NULL);
+  EXPECT(pcb->rcv_wnd == TCP_WND);
+  EXPECT(pcb->state == FIN_WAIT_1);
+  tcp_abort(pcb);
+}
+END_TEST
+
+Suite *
+tcprx_suite(void)
+{
+  testfunc tests[] = {
+    TESTFUNC(test_tcprx_take),
+    TESTFUNC(test_tcprx_close),
+  };
+  return create_suite("TCPRX", tests, sizeof(tests)/sizeof(testfunc),
+      NULL, NULL);
+}
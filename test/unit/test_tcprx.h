@@ -0,0 +1,8 @@
+#ifndef _TEST_TCPRX_H_
+#define _TEST_TCPRX_H_
+
+#include "jam_check.h"
+
+Suite *tcprx_suite(void);
+
+#endif // _TEST_TCPRX_H_
@@ -0,0 +1,149 @@
+// test_tcpsrc.c - tcpsrc.h on a connection that never sends: what it
+// queues references its ring, in order across the wrap, and each
+// acknowledgement pulls more from the fill callback.
+
+#include <string.h>
+
+#include "test_tcpsrc.h"
+
+#include "tcpsrc.h"
+
+#include "lwip/priv/tcp_priv.h"
+
+// The stream: a 12 byte header, then counting words
+#define HDR_LEN (12)
+
+static u8 ref[HDR_LEN + 4 * 2048];
+
+// Words the fill callback has written, and where it stops
+static u32 words;
+static u32 words_end;
+
+static struct tcpsrc src;
+
+static u32
+count_fill(void *dst, u32 len, void *arg)
+{
+  u32 n = len / 4;
+
+  if(n > words_end - words) {
+    n = words_end - words;
+  }
+  memcpy(dst, ref + HDR_LEN + 4 * words, 4 * n);
+  words += n;
+  return 4 * n;
+}
+
+static struct tcp_pcb *
+new_pcb()
+{
+  struct tcp_pcb *pcb = tcp_new();
+  u32 i;
+
+  for(i=0; i<HDR_LEN; i++) {
+    ref[i] = 0xa0 + i;
+  }
+  for(i=0; i<2048; i++) {
+    memcpy(ref + HDR_LEN + 4 * i, &i, 4);
+  }
+  words = 0;
+  words_end = 2048;
+
+  fail_if(pcb == NULL);
+  pcb->state = ESTABLISHED;
+  pcb->mss = TCP_MSS;
+  pcb->snd_wnd_max = TCP_WND;
+  // A closed window keeps everything queued
+  pcb->snd_wnd = 0;
+  return pcb;
+}
+
+// Check the queued segments carry the stream from `off` on, straight out
+// of the ring.  Returns the bytes queued.
+static u32
+check_queued(struct tcp_pcb *pcb, u32 off)
+{
+  struct tcp_seg *seg;
+  struct pbuf *q;
+  u32 n = 0;
+
+  for(seg=pcb->unsent; seg; seg=seg->next) {
+    // seg->p holds the headers, the data follows
+    for(q=seg->p->next; q; q=q->next) {
+      EXPECT((u8 *)q->payload >= (u8 *)src.buf &&
+          (u8 *)q->payload + q->len <= (u8 *)src.buf + TCPSRC_SIZE);
+      EXPECT(memcmp(q->payload, ref + off + n, q->len) == 0);
+      n += q->len;
+    }
+  }
+  return n;
+}
+
+// The peer acknowledges the first `count` segments
+static void
+ack_segs(struct tcp_pcb *pcb, u32 count)
+{
+  struct tcp_seg *seg;
+  u32 len = 0;
+
+  while(count-- && (seg = pcb->unsent)) {
+    pcb->unsent = seg->next;
+    len += seg->len;
+    pcb->snd_queuelen -= pbuf_clen(seg->p);
+    tcp_seg_free(seg);
+  }
+  pcb->snd_buf += len;
+  tcpsrc_sent(&src, len);
+}
+
+START_TEST(test_tcpsrc_stream)
+{
+  struct tcp_pcb *pcb = new_pcb();
+  struct tcp_seg *seg;
+  u32 off, len;
+
+  tcpsrc_init(&src, pcb, NULL, NULL);
+  EXPECT(tcpsrc_write(&src, ref, HDR_LEN) == 0);
+  tcpsrc_set_fill(&src, count_fill, NULL);
+  tcpsrc_pump(&src);
+  // The send buffer and the ring are full
+  EXPECT(tcp_sndbuf(pcb) == 0);
+  EXPECT(check_queued(pcb, 0) == TCPSRC_SIZE);
+  EXPECT(tcpsrc_write(&src, ref, 4) != 0);
+
+  // Room freed at the front is filled at the start of the ring
+  len = pcb->unsent->len;
+  ack_segs(pcb, 1);
+  off = len;
+  EXPECT(tcp_sndbuf(pcb) == 0);
+  EXPECT(check_queued(pcb, off) == TCPSRC_SIZE);
+  EXPECT(words == (TCPSRC_SIZE + len - HDR_LEN) / 4);
+
+  // The fill callback runs out: the last segment is pushed
+  for(seg=pcb->unsent; seg; seg=seg->next) {
+    off += seg->len;
+  }
+  words_end = words + 100;
+  ack_segs(pcb, 100);
+  EXPECT(check_queued(pcb, off) == 400);
+  for(seg=pcb->unsent; seg->next; seg=seg->next) {
+  }
+  EXPECT(TCPH_FLAGS(seg->tcphdr) & TCP_PSH);
+
+  tcpsrc_set_fill(&src, NULL, NULL);
+  ack_segs(pcb, 100);
+  EXPECT(pcb->unsent == NULL);
+  EXPECT(tcp_sndbuf(pcb) == TCP_SND_BUF);
+  tcp_abort(pcb);
+}
+END_TEST
+
+Suite *
+tcpsrc_suite(void)
+{
+  testfunc tests[] = {
+    TESTFUNC(test_tcpsrc_stream),
+  };
+  return create_suite("TCPSRC", tests, sizeof(tests)/sizeof(testfunc),
+      NULL, NULL);
+}
@@ -0,0 +1,8 @@
+#ifndef _TEST_TCPSRC_H_
+#define _TEST_TCPSRC_H_
+
+#include "jam_check.h"
+
+Suite *tcpsrc_suite(void);
+
+#endif // _TEST_TCPSRC_H_
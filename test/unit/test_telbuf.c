@@ -0,0 +1,175 @@
+// test_telbuf.c - Telemetry held through outages against the flash model:
+// the BRAM ring alone, the spill into flash and back, and the log coming
+// round to its oldest sector.
+
+#include <string.h>
+
+#include "test_telbuf.h"
+
+#include "flash.h"
+#include "sim.h"
+#include "slots.h"
+#include "telbuf.h"
+
+// Records of a datagram's size, numbered from their first word
+#define REC_LEN (900)
+
+static u32 rec[REC_LEN / 4];
+
+static void
+put_rec(u32 n)
+{
+  u32 i;
+
+  for(i=0; i<REC_LEN / 4; i++) {
+    rec[i] = n * 1000 + i;
+  }
+  EXPECT(telbuf_put(rec, REC_LEN, n & 3) == 0);
+}
+
+// Read the oldest record, waiting out the flash.  Returns its number, or
+// -1 if none is held.
+static int
+get_rec()
+{
+  u8 tag;
+  u32 i, n;
+  int tries;
+
+  for(tries=0; !telbuf_next(&tag); tries++) {
+    if(!telbuf_pending() || tries == 100) {
+      return -1;
+    }
+    sim_run_ms(1);
+  }
+  EXPECT(telbuf_next(&tag) == REC_LEN);
+  EXPECT(telbuf_read(rec) == REC_LEN);
+  n = rec[0] / 1000;
+  for(i=0; i<REC_LEN / 4; i++) {
+    EXPECT(rec[i] == n * 1000 + i);
+  }
+  EXPECT(tag == (n & 3));
+  telbuf_pop();
+  return n;
+}
+
+// Put `count` records from `first`, giving the spill time after each
+static void
+put_recs(u32 first, u32 count)
+{
+  u32 i;
+
+  for(i=0; i<count; i++) {
+    put_rec(first + i);
+    sim_run_ms(50);
+  }
+}
+
+static void
+telbuf_setup(void)
+{
+  jam_board_setup();
+  memset(&slots, 0, sizeof(slots));
+  init_telbuf();
+}
+
+static void
+telbuf_teardown(void)
+{
+  sim_run_ms(100);
+  jam_board_teardown();
+}
+
+START_TEST(test_telbuf_ram)
+{
+  u8 tag;
+
+  EXPECT(!telbuf_pending() && telbuf_next(&tag) == 0);
+  EXPECT(telbuf_put(rec, 0, 0) == -1);
+  EXPECT(telbuf_put(rec, TELBUF_MAX + 1, 0) == -1);
+  put_recs(0, 3);
+  EXPECT(telbuf_stats()->spilled == 0);
+  EXPECT(get_rec() == 0);
+  EXPECT(get_rec() == 1);
+  put_recs(3, 1);
+  EXPECT(get_rec() == 2);
+  EXPECT(get_rec() == 3);
+  EXPECT(get_rec() == -1);
+}
+END_TEST
+
+START_TEST(test_telbuf_spill)
+{
+  const struct telbuf_stats *s = telbuf_stats();
+  int i;
+
+  // Several sectors' worth, well past the ring
+  put_recs(0, 40);
+  EXPECT(s->spilled > 0 && s->programs > 0 && s->errors == 0);
+  EXPECT(s->dropped == 0 && s->dropped_bytes == 0);
+  EXPECT(telbuf_stats()->flash_bytes > 0);
+  EXPECT(s->ram_bytes <= TELBUF_SPILL_MARK + TELBUF_STAGE);
+
+  // Read out half, then more arrive behind the rest
+  for(i=0; i<20; i++) {
+    EXPECT(get_rec() == i);
+  }
+  put_recs(40, 20);
+  for(i=20; i<60; i++) {
+    EXPECT(get_rec() == i);
+  }
+  EXPECT(get_rec() == -1);
+  EXPECT(s->read == 60);
+}
+END_TEST
+
+START_TEST(test_telbuf_wrap)
+{
+  const struct telbuf_stats *s = telbuf_stats();
+  u32 total = FLASH_RSV_TELBUF_SECTORS * flash_rsv_size() / REC_LEN + 20;
+  int n, last = -1;
+
+  // More than the log holds: the oldest sectors go, the rest in order
+  put_recs(0, total);
+  EXPECT(s->dropped_bytes > 0 && s->dropped == 0);
+  while((n = get_rec()) >= 0) {
+    EXPECT(n > last);
+    last = n;
+  }
+  EXPECT(last == total - 1);
+  EXPECT(s->read < total && s->read > total / 2);
+}
+END_TEST
+
+START_TEST(test_telbuf_no_flash)
+{
+  const struct telbuf_stats *s = telbuf_stats();
+  int n, first;
+
+  // A slot laid over the sectors leaves the ring only
+  slots.num = 1;
+  slots.slot[0].size = flash_info.size;
+  init_telbuf();
+  put_recs(0, 20);
+  EXPECT(s->spilled == 0 && s->dropped > 0);
+  first = get_rec();
+  EXPECT(first == s->dropped);
+  for(n=first + 1; n<20; n++) {
+    EXPECT(get_rec() == n);
+  }
+  EXPECT(get_rec() == -1);
+}
+END_TEST
+
+Suite *
+telbuf_suite(void)
+{
+  testfunc tests[] = {
+    TESTFUNC(test_telbuf_ram),
+    TESTFUNC(test_telbuf_spill),
+    TESTFUNC(test_telbuf_wrap),
+    TESTFUNC(test_telbuf_no_flash),
+  };
+  return create_suite("telbuf", tests, sizeof(tests)/sizeof(testfunc),
+      telbuf_setup, telbuf_teardown);
+}
@@ -0,0 +1,8 @@
+#ifndef _TEST_TELBUF_H_
+#define _TEST_TELBUF_H_
+
+#include "jam_check.h"
+
+Suite *telbuf_suite(void);
+
+#endif // _TEST_TELBUF_H_
@@ -0,0 +1,137 @@
+// test_timer.c - timer.h's run order and deadlines on the simulated
+// timebase: the timers one timer_run() catches up on run earliest deadline
+// first, whichever tick they expired on, and a timer with a deadline of
+// its own records how late it started and whether it missed.
+
+#include <string.h>
+
+#include "test_timer.h"
+
+#include "sim.h"
+#include "timebase.h"
+#include "timer.h"
+
+static char order[8];
+static u32 ran;
+
+static void
+record(void *arg)
+{
+  if(ran < sizeof(order) - 1) {
+    order[ran++] = *(const char *)arg;
+  }
+}
+
+static struct timer a = TIMER_INIT(record, "a");
+static struct timer b = TIMER_INIT(record, "b");
+static struct timer c = TIMER_INIT(record, "c");
+static struct timer d = TIMER_INIT(record, "d");
+
+static struct timer_deadline a_deadline = TIMER_DEADLINE_INIT("a", 5000);
+static struct timer_deadline b_deadline = TIMER_DEADLINE_INIT("b", 100);
+static struct timer_deadline c_deadline = TIMER_DEADLINE_INIT("c", 10000);
+
+static void
+stop_c(void *arg)
+{
+  timer_stop(&c);
+}
+
+static void
+order_reset()
+{
+  memset(order, 0, sizeof(order));
+  ran = 0;
+}
+
+START_TEST(test_timer_edf)
+{
+  timer_run();
+  order_reset();
+  timer_set_deadline(&a, &a_deadline);
+  timer_set_deadline(&b, &b_deadline);
+  timer_set_deadline(&c, &c_deadline);
+
+  // The same tick: the shorter deadline first.  c expires first but is
+  // due at 3 + 10 ms; d, without a deadline of its own, at 4 ms plus its
+  // delay, so ahead of a and c.
+  timer_start(&a, 5, 0);
+  timer_start(&b, 5, 0);
+  timer_start(&c, 3, 0);
+  timer_start(&d, 4, 0);
+  sim_advance(30 * TIMEBASE_CYCLES_PER_MS);
+  timer_run();
+  EXPECT(strcmp(order, "bdac") == 0);
+  EXPECT(!timer_pending(&a) && !timer_pending(&c));
+}
+END_TEST
+
+START_TEST(test_timer_stop_released)
+{
+  struct timer stopper = TIMER_INIT(stop_c, NULL);
+
+  timer_run();
+  order_reset();
+  timer_set_deadline(&stopper, &b_deadline);
+  timer_set_deadline(&a, &a_deadline);
+  // c, without a deadline of its own, goes between the two
+  c.rt = NULL;
+  timer_start(&a, 1, 0);
+  timer_start(&stopper, 1, 0);
+  timer_start(&c, 1, 0);
+  sim_advance(2 * TIMEBASE_CYCLES_PER_MS);
+  timer_run();
+  EXPECT(strcmp(order, "a") == 0);
+  EXPECT(!timer_pending(&c));
+}
+END_TEST
+
+START_TEST(test_timer_deadline)
+{
+  static struct timer_deadline e_deadline = TIMER_DEADLINE_INIT("e", 1000);
+  struct timer e = TIMER_INIT(record, "e");
+  u32 misses = timer_stats()->misses, n;
+  const struct timer_deadline *found = NULL;
+
+  timer_run();
+  order_reset();
+  timer_set_deadline(&e, &e_deadline);
+  // Listed once however often it is given
+  timer_set_deadline(&e, &e_deadline);
+  for(n=0; timer_deadline(n); n++) {
+    if(timer_deadline(n) == &e_deadline) {
+      EXPECT(!found);
+      found = timer_deadline(n);
+    }
+  }
+  EXPECT_RET(found);
+
+  // 3 ms late: a miss
+  timer_start(&e, 10, 10);
+  sim_advance(13 * TIMEBASE_CYCLES_PER_MS);
+  timer_run();
+  EXPECT(e_deadline.runs == 1 && e_deadline.misses == 1);
+  EXPECT(e_deadline.late >= 3 * TIMEBASE_CYCLES_PER_MS);
+  EXPECT(e_deadline.late < 4 * TIMEBASE_CYCLES_PER_MS);
+  EXPECT(timer_stats()->misses == misses + 1);
+
+  // On time from the tick
+  sim_run_ms(10);
+  EXPECT(e_deadline.runs == 2 && e_deadline.misses == 1);
+  EXPECT(e_deadline.late < TIMEBASE_CYCLES_PER_US);
+  EXPECT(e_deadline.late_max == e_deadline.late_sum - e_deadline.late);
+  timer_stop(&e);
+}
+END_TEST
+
+Suite *
+timer_suite(void)
+{
+  testfunc tests[] = {
+    TESTFUNC(test_timer_edf),
+    TESTFUNC(test_timer_stop_released),
+    TESTFUNC(test_timer_deadline),
+  };
+  return create_suite("timer", tests, sizeof(tests)/sizeof(testfunc),
+      jam_board_setup, jam_board_teardown);
+}
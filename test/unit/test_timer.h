@@ -0,0 +1,8 @@
+#ifndef _TEST_TIMER_H_
+#define _TEST_TIMER_H_
+
+#include "jam_check.h"
+
+Suite *timer_suite(void);
+
+#endif // _TEST_TIMER_H_
@@ -0,0 +1,160 @@
+// test_wbbus.c - Bus errors on the simulated Wishbone window: a slave that
+// answers with an error, as the exception handler sees it, failing
+// wbreg_exec() requests and batches, and the statistics charged to the
+// device or the unmapped region.
+
+#include <string.h>
+
+#include "test_wbbus.h"
+
+#include "bswap.h"
+#include "sim.h"
+#include "wbbus.h"
+#include "wbreg.h"
+
+// Clear of the devices in core_info.tab and of the other suites' offsets
+#define BAD_OFF (0x9000)
+#define BAD_LEN (0x10)
+
+static u32 bad_accesses;
+
+// A slave that errors every cycle, as the handler hears of it
+static u32
+bad_read(void *dev, u32 off, u32 size)
+{
+  bad_accesses++;
+  wbbus_fault(WBREG_BASE + BAD_OFF + off);
+  return 0xdeadbeef;
+}
+
+static void
+bad_write(void *dev, u32 off, u32 val, u32 size)
+{
+  bad_accesses++;
+  wbbus_fault(WBREG_BASE + BAD_OFF + off);
+}
+
+// The faulting slave covers a few words of the window's memory
+static void
+wbbus_setup(void)
+{
+  jam_board_setup();
+  sim_map(WBREG_BASE + BAD_OFF, BAD_LEN, bad_read, bad_write, NULL);
+  init_wbbus();
+  bad_accesses = 0;
+}
+
+// Statistics of the unmapped region
+static const struct wbbus_stats *
+unmapped()
+{
+  const struct wbbus_stats *s;
+  const struct wbmap_entry *e;
+  u32 n;
+
+  for(n=0; (s = wbbus_stats(n, &e)); n++) {
+    if(!e) {
+      return s;
+    }
+  }
+  return NULL;
+}
+
+START_TEST(test_wbbus_read)
+{
+  static struct {
+    struct wbreg_hdr h;
+    u32 words[4];
+  } req;
+  const struct wbbus_stats *s = unmapped();
+  u32 runs, faults, ear, n;
+
+  EXPECT_RET(s != NULL);
+  runs = s->runs;
+  faults = wbbus_faults(&ear);
+
+  // A read that faults returns no words
+  memset(&req, 0, sizeof(req));
+  req.h.op = WBREG_OP_READ;
+  req.h.addr = swap32(BAD_OFF);
+  req.h.count = swap16(4);
+  n = wbreg_exec(&req.h, req.words, 0);
+  EXPECT(req.h.status == WBREG_EBUS);
+  EXPECT(n == sizeof(req.h));
+  // And stops at the first error
+  EXPECT(bad_accesses == 1);
+  EXPECT(wbbus_faults(&ear) == faults + 1 && ear == WBREG_BASE + BAD_OFF);
+  EXPECT(s->runs == runs + 1 && s->faults >= 1);
+
+  // Sound words next to it read as ever
+  req.h.addr = swap32(BAD_OFF + BAD_LEN);
+  req.h.count = swap16(2);
+  n = wbreg_exec(&req.h, req.words, 0);
+  EXPECT(req.h.status == WBREG_OK);
+  EXPECT(n == sizeof(req.h) + 8);
+  EXPECT(s->runs == runs + 2 && s->words >= 2);
+
+  // A fault the handler does not own is left to crash
+  EXPECT(wbbus_fault(WBREG_BASE - 4) == 0);
+  EXPECT(wbbus_fault(WBREG_BASE + WBREG_SIZE) == 0);
+  EXPECT(wbbus_faults(&ear) == faults + 1);
+}
+END_TEST
+
+START_TEST(test_wbbus_write)
+{
+  static struct {
+    struct wbreg_hdr h;
+    u32 words[4];
+  } req;
+
+  memset(&req, 0, sizeof(req));
+  req.h.op = WBREG_OP_WRITE;
+  req.h.addr = swap32(BAD_OFF);
+  req.h.count = swap16(2);
+  wbreg_exec(&req.h, req.words, 2);
+  EXPECT(req.h.status == WBREG_EBUS);
+  EXPECT(bad_accesses == 1);
+}
+END_TEST
+
+START_TEST(test_wbbus_batch)
+{
+  static struct {
+    struct wbreg_hdr h;
+    struct wbreg_entry e[3];
+  } req;
+  u32 n;
+
+  // Write, fault, and the third entry never runs
+  memset(&req, 0, sizeof(req));
+  req.h.op = WBREG_OP_BATCH;
+  req.h.count = swap16(3);
+  req.e[0].op = WBREG_B_WRITE;
+  req.e[0].addr = swap32(BAD_OFF + BAD_LEN);
+  req.e[0].value = swap32(5);
+  req.e[1].op = WBREG_B_READ;
+  req.e[1].addr = swap32(BAD_OFF + 4);
+  req.e[2].op = WBREG_B_WRITE;
+  req.e[2].addr = swap32(BAD_OFF + BAD_LEN + 4);
+  req.e[2].value = swap32(6);
+  n = wbreg_exec(&req.h, (u32 *)req.e, sizeof(req.e) / 4);
+  EXPECT(req.h.status == WBREG_EBUS);
+  EXPECT(n == sizeof(req.h) + 4);
+  EXPECT(sim_wishbone()[BAD_OFF + BAD_LEN] == 5);
+  EXPECT(sim_wishbone()[BAD_OFF + BAD_LEN + 4] == 0);
+  EXPECT(bad_accesses == 1);
+}
+END_TEST
+
+Suite *
+wbbus_suite(void)
+{
+  testfunc tests[] = {
+    TESTFUNC(test_wbbus_read),
+    TESTFUNC(test_wbbus_write),
+    TESTFUNC(test_wbbus_batch),
+  };
+  return create_suite("wbbus", tests, sizeof(tests)/sizeof(testfunc),
+      wbbus_setup, jam_board_teardown);
+}
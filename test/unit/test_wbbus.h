@@ -0,0 +1,8 @@
+#ifndef _TEST_WBBUS_H_
+#define _TEST_WBBUS_H_
+
+#include "jam_check.h"
+
+Suite *wbbus_suite(void);
+
+#endif // _TEST_WBBUS_H_
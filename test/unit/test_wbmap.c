@@ -0,0 +1,140 @@
+// test_wbmap.c - Device tables loaded from the booted slot's image: taken
+// when whole and in order, and the built-in one kept otherwise.
+
+#include <string.h>
+
+#include "test_wbmap.h"
+
+#include "crc32.h"
+#include "flashsim.h"
+#include "sim.h"
+#include "slots.h"
+#include "wbmap.h"
+
+// The stub icap_slot() boots the golden slot: a bitstream's worth of
+// bytes, then the table
+#define SLOT_ADDR (0)
+#define BIT_LEN   (1000)
+
+static const char *names[] = { "adc_ctrl", "ddc_bram", "sys_rev" };
+
+// Put a table of `names` after the bitstream, with the names in reverse
+// order if `swap`, and record the image in the slot table.  Returns the flash
+// address of the table's CRC.
+static u32
+put_map(int swap, u8 mode)
+{
+  u8 *mem = flashsim_mem() + SLOT_ADDR;
+  struct wbmap_rec r[3];
+  struct wbmap_trailer t;
+  char strings[64];
+  u32 i, n = 3, len = 0, at;
+
+  memset(mem, 0x5a, BIT_LEN);
+  memset(r, 0, sizeof(r));
+  for(i=0; i<n; i++) {
+    r[i].offset = 0x1000 * (i + 1);
+    r[i].size = 0x100;
+    r[i].mode = i == 1 ? mode : WBMAP_MODE_RW;
+    r[i].name = len;
+    strcpy(strings + len, names[swap ? n - 1 - i : i]);
+    len += strlen(strings + len) + 1;
+  }
+  at = BIT_LEN;
+  memcpy(mem + at, r, sizeof(r));
+  memcpy(mem + at + sizeof(r), strings, len);
+  t.magic = WBMAP_MAGIC;
+  t.count = n;
+  t.strings = len;
+  t.crc = crc32(0, mem + at, sizeof(r) + len);
+  at += sizeof(r) + len;
+  memcpy(mem + at, &t, sizeof(t));
+
+  slots.num = 1;
+  slots.slot[0].addr = SLOT_ADDR;
+  slots.slot[0].size = 1 << 20;
+  slots.slot[0].len = at + sizeof(t);
+  return SLOT_ADDR + at + offsetof(struct wbmap_trailer, crc);
+}
+
+static void
+wbmap_setup(void)
+{
+  jam_board_setup();
+  memset(&slots, 0, sizeof(slots));
+}
+
+static void
+wbmap_teardown(void)
+{
+  // The other suites use the built-in table
+  memset(&slots, 0, sizeof(slots));
+  init_wbmap();
+  jam_board_teardown();
+}
+
+START_TEST(test_wbmap_builtin)
+{
+  u32 n = wbmap_count();
+
+  // No table after the image, nor any image
+  init_wbmap();
+  EXPECT(wbmap_slot() == -1 && wbmap_count() == n);
+  put_map(0, WBMAP_MODE_RW);
+  slots.slot[0].len = BIT_LEN;
+  init_wbmap();
+  EXPECT(wbmap_slot() == -1 && wbmap_count() == n);
+}
+END_TEST
+
+START_TEST(test_wbmap_loaded)
+{
+  const struct wbmap_entry *e;
+  u32 i;
+
+  put_map(0, WBMAP_MODE_R | WBMAP_MODE_SHADOW);
+  init_wbmap();
+  EXPECT(wbmap_slot() == 0 && wbmap_count() == 3);
+  for(i=0; i<3; i++) {
+    e = wbmap_find(names[i]);
+    EXPECT(e && e == wbmap_get(i) && !strcmp(e->name, names[i]));
+    EXPECT(e->offset == 0x1000 * (i + 1) && e->size == 0x100);
+  }
+  EXPECT(wbmap_find("ddc_bram")->mode ==
+      (WBMAP_MODE_R | WBMAP_MODE_SHADOW));
+  EXPECT(wbmap_find("eth0") == NULL && wbmap_get(3) == NULL);
+}
+END_TEST
+
+START_TEST(test_wbmap_refused)
+{
+  u32 n = wbmap_count();
+  u32 crc;
+
+  // Out of order
+  put_map(1, WBMAP_MODE_RW);
+  init_wbmap();
+  EXPECT(wbmap_slot() == -1 && wbmap_count() == n);
+  // No access mode
+  put_map(0, WBMAP_MODE_SHADOW);
+  init_wbmap();
+  EXPECT(wbmap_slot() == -1 && wbmap_count() == n);
+  // A bit flipped
+  crc = put_map(0, WBMAP_MODE_RW);
+  flashsim_mem()[crc] ^= 1;
+  init_wbmap();
+  EXPECT(wbmap_slot() == -1 && wbmap_count() == n);
+}
+END_TEST
+
+Suite *
+wbmap_suite(void)
+{
+  testfunc tests[] = {
+    TESTFUNC(test_wbmap_builtin),
+    TESTFUNC(test_wbmap_loaded),
+    TESTFUNC(test_wbmap_refused),
+  };
+  return create_suite("wbmap", tests, sizeof(tests)/sizeof(testfunc),
+      wbmap_setup, wbmap_teardown);
+}
@@ -0,0 +1,8 @@
+#ifndef _TEST_WBMAP_H_
+#define _TEST_WBMAP_H_
+
+#include "jam_check.h"
+
+Suite *wbmap_suite(void);
+
+#endif // _TEST_WBMAP_H_
@@ -0,0 +1,104 @@
+// test_wbpost.c - Posted writes against the simulated Wishbone window:
+// nothing reaches the bus before a fence, a word written twice goes out
+// once, a full queue and a write to an ordered device fence it, and a
+// wbreg.h batch reads back what it wrote before.
+
+#include <string.h>
+
+#include "test_wbpost.h"
+
+#include "bswap.h"
+#include "sim.h"
+#include "wbpost.h"
+#include "wbreg.h"
+
+// Clear of the offsets the other suites use
+#define BASE_OFF (0xa000)
+
+static const struct wbmap_entry ord = {
+  "ord", BASE_OFF + 0x100, 0x8, WBMAP_MODE_RW | WBMAP_MODE_ORDERED
+};
+
+static u32
+wb_word(u32 off)
+{
+  u32 v;
+
+  memcpy(&v, sim_wishbone() + off, 4);
+  return v;
+}
+
+START_TEST(test_wbpost_combine)
+{
+  EXPECT(wbpost_write(BASE_OFF, 1) == 0);
+  EXPECT(wbpost_write(BASE_OFF + 4, 2) == 0);
+  EXPECT(wbpost_write(BASE_OFF, 3) == 0);
+  EXPECT(wbpost_pending() == 2);
+  EXPECT(wb_word(BASE_OFF) == 0);
+
+  EXPECT(wbpost_fence() == 0);
+  EXPECT(wbpost_pending() == 0);
+  EXPECT(wb_word(BASE_OFF) == 3 && wb_word(BASE_OFF + 4) == 2);
+}
+END_TEST
+
+START_TEST(test_wbpost_fences)
+{
+  u32 i;
+
+  // A full queue goes out to make room
+  for(i=0; i<=WBPOST_MAX; i++) {
+    EXPECT(wbpost_write(BASE_OFF + 4 * i, i + 1) == 0);
+  }
+  EXPECT(wbpost_pending() == 1);
+  EXPECT(wb_word(BASE_OFF) == 1);
+  EXPECT(wb_word(BASE_OFF + 4 * (WBPOST_MAX - 1)) == WBPOST_MAX);
+  EXPECT(wb_word(BASE_OFF + 4 * WBPOST_MAX) == 0);
+
+  // An ordered write lands after everything before it, and at once
+  EXPECT_RET(wbpost_order(&ord) == 0);
+  EXPECT(wbpost_write(ord.offset, 9) == 0);
+  EXPECT(wbpost_pending() == 0);
+  EXPECT(wb_word(BASE_OFF + 4 * WBPOST_MAX) == WBPOST_MAX + 1);
+  EXPECT(wb_word(ord.offset) == 9);
+}
+END_TEST
+
+START_TEST(test_wbpost_batch)
+{
+  static struct {
+    struct wbreg_hdr h;
+    struct wbreg_entry e[3];
+  } req;
+
+  memset(&req, 0, sizeof(req));
+  req.h.op = WBREG_OP_BATCH;
+  req.h.count = swap16(3);
+  req.e[0].op = WBREG_B_WRITE;
+  req.e[0].addr = swap32(BASE_OFF);
+  req.e[0].value = swap32(5);
+  req.e[1].op = WBREG_B_READ;
+  req.e[1].addr = swap32(BASE_OFF);
+  req.e[2].op = WBREG_B_WRITE;
+  req.e[2].addr = swap32(BASE_OFF + 4);
+  req.e[2].value = swap32(6);
+  wbreg_exec(&req.h, (u32 *)req.e, sizeof(req.e) / 4);
+  EXPECT(req.h.status == WBREG_OK);
+  EXPECT(swap32(((u32 *)req.e)[1]) == 5);
+  // The last write went out with the end of the batch
+  EXPECT(wbpost_pending() == 0);
+  EXPECT(wb_word(BASE_OFF + 4) == 6);
+}
+END_TEST
+
+Suite *
+wbpost_suite(void)
+{
+  testfunc tests[] = {
+    TESTFUNC(test_wbpost_combine),
+    TESTFUNC(test_wbpost_fences),
+    TESTFUNC(test_wbpost_batch),
+  };
+  return create_suite("wbpost", tests, sizeof(tests)/sizeof(testfunc),
+      jam_board_setup, jam_board_teardown);
+}
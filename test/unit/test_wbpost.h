@@ -0,0 +1,8 @@
+#ifndef _TEST_WBPOST_H_
+#define _TEST_WBPOST_H_
+
+#include "jam_check.h"
+
+Suite *wbpost_suite(void);
+
+#endif // _TEST_WBPOST_H_
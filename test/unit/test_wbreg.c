@@ -0,0 +1,311 @@
+// test_wbreg.c - wbreg_exec() against the simulated Wishbone window.
+
+#include <string.h>
+
+#include "test_wbreg.h"
+
+#include "bswap.h"
+#include "sim.h"
+#include "spi.h"
+#include "wbreg.h"
+#include "wbtimed.h"
+
+static struct {
+  struct wbreg_hdr h;
+  u32 words[WBREG_MAX_WORDS];
+} req;
+
+static void
+req_init(u8 op, u32 addr, u32 count)
+{
+  memset(&req, 0, sizeof(req));
+  req.h.id = 1;
+  req.h.op = op;
+  req.h.addr = swap32(addr);
+  req.h.count = swap16(count);
+}
+
+// Word `off` bytes into the window
+static u32
+wb_word(u32 off)
+{
+  u32 v;
+
+  memcpy(&v, sim_wishbone() + off, 4);
+  return v;
+}
+
+static void
+wb_set(u32 off, u32 v)
+{
+  memcpy(sim_wishbone() + off, &v, 4);
+}
+
+static void
+batch_entry(u32 i, u8 op, u32 addr, u32 value, u32 mask, u16 timeout_us)
+{
+  struct wbreg_entry *e = (struct wbreg_entry *)req.words + i;
+
+  e->op = op;
+  e->timeout_us = swap16(timeout_us);
+  e->addr = swap32(addr);
+  e->value = swap32(value);
+  e->mask = swap32(mask);
+}
+
+START_TEST(test_wbreg_write_read)
+{
+  u32 len;
+
+  req_init(WBREG_OP_WRITE, 0x100, 2);
+  req.words[0] = swap32(0x11223344);
+  req.words[1] = swap32(0x55667788);
+  len = wbreg_exec(&req.h, req.words, 2);
+  EXPECT(len == sizeof(req.h));
+  EXPECT(req.h.status == WBREG_OK);
+  EXPECT(wb_word(0x100) == 0x11223344 && wb_word(0x104) == 0x55667788);
+
+  req_init(WBREG_OP_READ, 0x100, 2);
+  EXPECT(wbreg_reply_len(&req.h) == sizeof(req.h) + 8);
+  len = wbreg_exec(&req.h, req.words, 0);
+  EXPECT(len == sizeof(req.h) + 8);
+  EXPECT(req.h.status == WBREG_OK);
+  EXPECT(swap32(req.words[0]) == 0x11223344);
+  EXPECT(swap32(req.words[1]) == 0x55667788);
+}
+END_TEST
+
+START_TEST(test_wbreg_noinc)
+{
+  u32 i;
+
+  req_init(WBREG_OP_WRITE | WBREG_OP_NOINC, 0x200, 3);
+  for(i=0; i<3; i++) {
+    req.words[i] = swap32(i + 1);
+  }
+  EXPECT(wbreg_exec(&req.h, req.words, 3) == sizeof(req.h));
+  // Plain memory keeps the last write
+  EXPECT(wb_word(0x200) == 3 && wb_word(0x204) == 0);
+
+  req_init(WBREG_OP_READ | WBREG_OP_NOINC, 0x200, 2);
+  EXPECT(wbreg_exec(&req.h, req.words, 0) == sizeof(req.h) + 8);
+  EXPECT(swap32(req.words[0]) == 3 && swap32(req.words[1]) == 3);
+}
+END_TEST
+
+// Unpack the `n` packed words of req.words into `out`, of room for `max`.
+// Returns the words unpacked.
+static u32
+unpack(u32 n, u32 *out, u32 max)
+{
+  u32 i = 0, len = 0, c, run;
+
+  while(i < n) {
+    c = swap32(req.words[i++]);
+    run = c & ~WBREG_PACK_KIND;
+    EXPECT(run && len + run <= max);
+    if((c & WBREG_PACK_KIND) == WBREG_PACK_LITERAL) {
+      EXPECT(i + run <= n);
+      while(run--) {
+        out[len++] = swap32(req.words[i++]);
+      }
+    } else if((c & WBREG_PACK_KIND) == WBREG_PACK_ZERO) {
+      EXPECT(run >= WBREG_PACK_MIN_ZERO);
+      while(run--) {
+        out[len++] = 0;
+      }
+    } else {
+      EXPECT((c & WBREG_PACK_KIND) == WBREG_PACK_REPEAT);
+      EXPECT(run >= WBREG_PACK_MIN_REPEAT && i < n);
+      while(run--) {
+        out[len++] = swap32(req.words[i]);
+      }
+      i++;
+    }
+  }
+  return len;
+}
+
+START_TEST(test_wbreg_pack)
+{
+  static u32 got[4096];
+  u32 len, i, n = 4096;
+
+  // Mostly zero, with a repeated block and a few scattered words
+  memset(sim_wishbone(), 0, n * 4);
+  for(i=100; i<400; i++) {
+    wb_set(i * 4, 0xdeadbeef);
+  }
+  for(i=1000; i<n; i+=97) {
+    wb_set(i * 4, i);
+  }
+  wb_set(4, 1);
+  wb_set(8, 2);
+  req_init(WBREG_OP_READ | WBREG_OP_PACK, 0, n);
+  EXPECT(wbreg_reply_len(&req.h) == sizeof(req.h) + WBREG_MAX_WORDS * 4);
+  len = wbreg_exec(&req.h, req.words, 0);
+  EXPECT(req.h.status == WBREG_OK && swap16(req.h.count) == n);
+  EXPECT(len > sizeof(req.h) && len < sizeof(req.h) + n * 4 / 20);
+  EXPECT(unpack((len - sizeof(req.h)) / 4, got, n) == n);
+  for(i=0; i<n; i++) {
+    EXPECT(got[i] == wb_word(i * 4));
+  }
+
+  // No runs at all: one word more than the words read
+  for(i=0; i<16; i++) {
+    wb_set(i * 4, i + 1);
+  }
+  req_init(WBREG_OP_READ | WBREG_OP_PACK, 0, 16);
+  len = wbreg_exec(&req.h, req.words, 0);
+  EXPECT(len == sizeof(req.h) + 17 * 4);
+  EXPECT(unpack(17, got, 16) == 16 && got[15] == 16);
+
+  // Too many words that do not pack to fit
+  for(i=0; i<2 * WBREG_MAX_WORDS; i++) {
+    wb_set(i * 4, i + 1);
+  }
+  req_init(WBREG_OP_READ | WBREG_OP_PACK, 0, 2 * WBREG_MAX_WORDS);
+  EXPECT(wbreg_exec(&req.h, req.words, 0) == sizeof(req.h));
+  EXPECT(req.h.status == WBREG_ELEN);
+}
+END_TEST
+
+START_TEST(test_wbreg_errors)
+{
+  // Misaligned, past the window, wrapping
+  req_init(WBREG_OP_READ, 2, 1);
+  wbreg_exec(&req.h, req.words, 0);
+  EXPECT(req.h.status == WBREG_EADDR);
+  req_init(WBREG_OP_READ, WBREG_SIZE - 4, 2);
+  wbreg_exec(&req.h, req.words, 0);
+  EXPECT(req.h.status == WBREG_EADDR);
+  req_init(WBREG_OP_READ | WBREG_OP_NOINC, WBREG_SIZE - 4, 2);
+  wbreg_exec(&req.h, req.words, 0);
+  EXPECT(req.h.status == WBREG_OK);
+
+  // Too long, or short of data
+  req_init(WBREG_OP_READ, 0, WBREG_MAX_WORDS + 1);
+  EXPECT(wbreg_reply_len(&req.h) == sizeof(req.h));
+  wbreg_exec(&req.h, req.words, 0);
+  EXPECT(req.h.status == WBREG_ELEN);
+  req_init(WBREG_OP_WRITE, 0, 4);
+  wbreg_exec(&req.h, req.words, 3);
+  EXPECT(req.h.status == WBREG_ELEN);
+
+  req_init(0x7f, 0, 0);
+  EXPECT(wbreg_exec(&req.h, req.words, 0) == sizeof(req.h));
+  EXPECT(req.h.status == WBREG_EOP);
+}
+END_TEST
+
+START_TEST(test_wbreg_batch)
+{
+  u32 len;
+
+  wb_set(0x300, 0xffff0000);
+  req_init(WBREG_OP_BATCH, 0, 4);
+  batch_entry(0, WBREG_B_WRITE, 0x304, 0x12345678, 0, 0);
+  batch_entry(1, WBREG_B_RMW, 0x300, 0x00ff00ff, 0x0000ffff, 0);
+  batch_entry(2, WBREG_B_READ, 0x300, 0, 0, 0);
+  batch_entry(3, WBREG_B_WAIT, 0x304, 0x5678, 0xffff, 10);
+  len = wbreg_exec(&req.h, req.words, 4 * sizeof(struct wbreg_entry) / 4);
+  EXPECT(req.h.status == WBREG_OK);
+  EXPECT(len == sizeof(req.h) + 16 && swap16(req.h.count) == 4);
+  EXPECT(swap32(req.words[0]) == 0);
+  EXPECT(swap32(req.words[1]) == 0xffff0000);
+  EXPECT(swap32(req.words[2]) == 0xffff00ff);
+  EXPECT(swap32(req.words[3]) == 0x12345678);
+  EXPECT(wb_word(0x304) == 0x12345678);
+}
+END_TEST
+
+START_TEST(test_wbreg_batch_stop)
+{
+  u64 t0;
+  u32 len;
+
+  // A wait that times out stops the batch at its index
+  req_init(WBREG_OP_BATCH, 0, 3);
+  batch_entry(0, WBREG_B_WRITE, 0x400, 1, 0, 0);
+  batch_entry(1, WBREG_B_WAIT, 0x400, 2, 0xff, 50);
+  batch_entry(2, WBREG_B_WRITE, 0x404, 1, 0, 0);
+  t0 = sim_cycles();
+  len = wbreg_exec(&req.h, req.words, 3 * sizeof(struct wbreg_entry) / 4);
+  EXPECT(req.h.status == WBREG_ETIMEDOUT);
+  EXPECT(swap16(req.h.count) == 1 && len == sizeof(req.h) + 4);
+  EXPECT(sim_cycles() - t0 >= 50 * TIMEBASE_CYCLES_PER_US);
+  EXPECT(wb_word(0x404) == 0);
+
+  // Bad address and short data
+  req_init(WBREG_OP_BATCH, 0, 1);
+  batch_entry(0, WBREG_B_READ, WBREG_SIZE, 0, 0, 0);
+  wbreg_exec(&req.h, req.words, sizeof(struct wbreg_entry) / 4);
+  EXPECT(req.h.status == WBREG_EADDR && req.h.count == 0);
+  req_init(WBREG_OP_BATCH, 0, 2);
+  wbreg_exec(&req.h, req.words, sizeof(struct wbreg_entry) / 4);
+  EXPECT(req.h.status == WBREG_ELEN);
+}
+END_TEST
+
+START_TEST(test_wbreg_spi)
+{
+  const struct wbreg_spi *s = (const struct wbreg_spi *)req.words;
+  u8 b[2] = { 0x05 };
+  u32 len;
+
+  EXPECT_RET(send_spi(b, b, sizeof(b), 0) == sizeof(b));
+  req_init(WBREG_OP_SPI, 0, 0);
+  EXPECT(wbreg_reply_len(&req.h) == sizeof(req.h) + sizeof(*s));
+  len = wbreg_exec(&req.h, req.words, 0);
+  EXPECT(len == sizeof(req.h) + sizeof(*s) && req.h.status == WBREG_OK);
+  EXPECT(swap16(req.h.count) == 1 && swap32(req.h.addr) == TIMEBASE_HZ);
+  EXPECT(swap32(s->xfers) == spi_stats.xfers && spi_stats.xfers > 0);
+  EXPECT(swap32(s->busy_lo) == (u32)spi_stats.busy_cycles);
+
+  // A non-zero address clears them
+  req_init(WBREG_OP_SPI, 1, 0);
+  wbreg_exec(&req.h, req.words, 0);
+  EXPECT(swap32(s->bytes) > 0 && spi_stats.bytes == 0);
+}
+END_TEST
+
+START_TEST(test_wbreg_at)
+{
+  // Checked as a write, then refused without a wall clock
+  req_init(WBREG_OP_AT, 0x100, WBTIMED_WORDS + 1);
+  wbreg_exec(&req.h, req.words, 2 + WBTIMED_WORDS + 1);
+  EXPECT(req.h.status == WBREG_ELEN);
+  req_init(WBREG_OP_AT, 0x102, 1);
+  wbreg_exec(&req.h, req.words, 3);
+  EXPECT(req.h.status == WBREG_EADDR);
+  req_init(WBREG_OP_AT, 0x100, 1);
+  req.words[0] = swap32(2000000000);
+  req.words[2] = swap32(1);
+  wbreg_exec(&req.h, req.words, 3);
+  EXPECT(req.h.status == WBREG_ETIME && wb_word(0x100) == 0);
+
+  // None pending
+  req_init(WBREG_OP_AT_LIST, 0, 0);
+  EXPECT(wbreg_reply_len(&req.h) ==
+         sizeof(req.h) + WBTIMED_MAX * sizeof(struct wbreg_at));
+  EXPECT(wbreg_exec(&req.h, req.words, 0) == sizeof(req.h));
+  EXPECT(req.h.status == WBREG_OK && req.h.count == 0);
+}
+END_TEST
+
+Suite *
+wbreg_suite(void)
+{
+  testfunc tests[] = {
+    TESTFUNC(test_wbreg_write_read),
+    TESTFUNC(test_wbreg_noinc),
+    TESTFUNC(test_wbreg_pack),
+    TESTFUNC(test_wbreg_errors),
+    TESTFUNC(test_wbreg_batch),
+    TESTFUNC(test_wbreg_batch_stop),
+    TESTFUNC(test_wbreg_spi),
+    TESTFUNC(test_wbreg_at),
+  };
+  return create_suite("wbreg", tests, sizeof(tests)/sizeof(testfunc),
+      jam_board_setup, jam_board_teardown);
+}
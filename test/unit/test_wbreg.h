@@ -0,0 +1,8 @@
+#ifndef _TEST_WBREG_H_
+#define _TEST_WBREG_H_
+
+#include "jam_check.h"
+
+Suite *wbreg_suite(void);
+
+#endif // _TEST_WBREG_H_
@@ -0,0 +1,147 @@
+// test_wbshadow.c - Shadow registers against the simulated Wishbone
+// window: reads and read-modify-writes served from the mirror, a
+// write-only device starting from 0, wbreg_exec() going through the
+// mirror, and flush and refresh.
+
+#include <string.h>
+
+#include "test_wbshadow.h"
+
+#include "bswap.h"
+#include "sim.h"
+#include "wbreg.h"
+#include "wbshadow.h"
+
+// Clear of the offsets the other suites use
+static const struct wbmap_entry cfg = {
+  "cfg", 0x8000, 0x10, WBMAP_MODE_RW | WBMAP_MODE_SHADOW
+};
+static const struct wbmap_entry ctl = {
+  "ctl", 0x8010, 0x8, WBMAP_MODE_W | WBMAP_MODE_SHADOW
+};
+
+static u32
+wb_word(u32 off)
+{
+  u32 v;
+
+  memcpy(&v, sim_wishbone() + off, 4);
+  return v;
+}
+
+static void
+wb_set(u32 off, u32 v)
+{
+  memcpy(sim_wishbone() + off, &v, 4);
+}
+
+START_TEST(test_wbshadow_rmw)
+{
+  u32 saved;
+
+  wb_set(0x8004, 0x11223344);
+  EXPECT_RET(wbshadow_add(&cfg) == 0);
+  EXPECT(wbshadow_add(&cfg) == 0);
+  wbshadow_refresh(&cfg);
+  saved = wbshadow_saved();
+
+  // Served from the mirror, not the bus
+  wb_set(0x8004, 0);
+  EXPECT(wbshadow_read(0x8004) == 0x11223344);
+  EXPECT(wbshadow_rmw(0x8004, 0xff00, 0x5500) == 0x11223344);
+  EXPECT(wb_word(0x8004) == 0x11225544);
+  EXPECT(wbshadow_read(0x8004) == 0x11225544);
+  EXPECT(wbshadow_saved() == saved + 3);
+
+  // Words outside it go to the bus
+  wb_set(0x8020, 7);
+  EXPECT(wbshadow_read(0x8020) == 7);
+  EXPECT(wbshadow_saved() == saved + 3);
+
+  // The gateware lost it, or changed it
+  wb_set(0x8004, 0);
+  EXPECT(wbshadow_flush(&cfg) == 4);
+  EXPECT(wb_word(0x8004) == 0x11225544);
+  wb_set(0x8008, 9);
+  EXPECT(wbshadow_refresh(NULL) >= 4);
+  EXPECT(wbshadow_read(0x8008) == 9);
+}
+END_TEST
+
+START_TEST(test_wbshadow_write_only)
+{
+  struct wbmap_entry bad = { "bad", 0x8014, 0x8, WBMAP_MODE_RW };
+
+  wb_set(0x8010, 0xffffffff);
+  EXPECT_RET(wbshadow_add(&ctl) == 0);
+  wbshadow_flush(&ctl);
+  EXPECT(wb_word(0x8010) == 0);
+
+  // A register that cannot be read takes a read-modify-write
+  wbshadow_rmw(0x8010, 0x1, 0x1);
+  wbshadow_rmw(0x8010, 0x4, 0x4);
+  EXPECT(wb_word(0x8010) == 0x5);
+  EXPECT(wbshadow_refresh(&ctl) == 0);
+  EXPECT(wbshadow_read(0x8010) == 0x5);
+
+  // Overlapping or misaligned
+  EXPECT(wbshadow_add(&bad) == -1);
+  bad.offset = 0x8082;
+  EXPECT(wbshadow_add(&bad) == -1);
+}
+END_TEST
+
+START_TEST(test_wbshadow_wbreg)
+{
+  static struct {
+    struct wbreg_hdr h;
+    u32 words[8];
+  } req;
+  struct wbreg_entry *e = (struct wbreg_entry *)req.words;
+
+  EXPECT_RET(wbshadow_add(&cfg) == 0);
+  memset(&req, 0, sizeof(req));
+  req.h.op = WBREG_OP_WRITE;
+  req.h.addr = swap32(0x8000);
+  req.h.count = swap16(2);
+  req.words[0] = swap32(0xa);
+  req.words[1] = swap32(0xb);
+  wbreg_exec(&req.h, req.words, 2);
+  EXPECT(req.h.status == WBREG_OK);
+  EXPECT(wb_word(0x8000) == 0xa && wbshadow_read(0x8004) == 0xb);
+
+  // Reads come from the mirror
+  wb_set(0x8000, 0);
+  memset(&req, 0, sizeof(req));
+  req.h.op = WBREG_OP_READ;
+  req.h.addr = swap32(0x8000);
+  req.h.count = swap16(2);
+  wbreg_exec(&req.h, req.words, 0);
+  EXPECT(swap32(req.words[0]) == 0xa && swap32(req.words[1]) == 0xb);
+
+  // And so does a batch read-modify-write's old value
+  memset(&req, 0, sizeof(req));
+  req.h.op = WBREG_OP_BATCH;
+  req.h.count = swap16(1);
+  e->op = WBREG_B_RMW;
+  e->addr = swap32(0x8000);
+  e->mask = swap32(0xf0);
+  e->value = swap32(0x30);
+  wbreg_exec(&req.h, req.words, sizeof(*e) / 4);
+  EXPECT(req.h.status == WBREG_OK);
+  EXPECT(swap32(req.words[0]) == 0xa);
+  EXPECT(wb_word(0x8000) == 0x3a);
+}
+END_TEST
+
+Suite *
+wbshadow_suite(void)
+{
+  testfunc tests[] = {
+    TESTFUNC(test_wbshadow_rmw),
+    TESTFUNC(test_wbshadow_write_only),
+    TESTFUNC(test_wbshadow_wbreg),
+  };
+  return create_suite("wbshadow", tests, sizeof(tests)/sizeof(testfunc),
+      jam_board_setup, jam_board_teardown);
+}
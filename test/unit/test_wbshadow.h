@@ -0,0 +1,8 @@
+#ifndef _TEST_WBSHADOW_H_
+#define _TEST_WBSHADOW_H_
+
+#include "jam_check.h"
+
+Suite *wbshadow_suite(void);
+
+#endif // _TEST_WBSHADOW_H_
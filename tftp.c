@@ -0,0 +1,541 @@
+// tftp.c - Bitstream slot uploads and downloads over TFTP.
+//
+// An upload holds at most two blocks, both as references to the pbufs they
+// arrived in: `cur`, being programmed one segment at a time, and `next`,
+// whose ACK the server holds back (TFTP_WRITE_PENDING) until `cur` is done.
+// With `cur` taken as soon as it starts programming, the client sends the
+// next block while the flash is busy with this one.  Blocks the server
+// drops while `next` is pending are resent after its ACK (see
+// tftp_server.c), which is how the flash holds back a client sending
+// several blocks per ACK.
+//
+// A compressed upload is decoded from `cur` into `obuf` instead, which is
+// programmed each time it fills.  The decoder's window and `obuf` are all
+// the memory it takes.
+//
+// The slot is only erased once the first block is in, and for a bitstream
+// slot only if that block parses as a bitstream for this FPGA or starts a
+// firmware image (app.h), so a bad upload fails on its first block with
+// the flash untouched.
+
+#include <string.h>
+
+#include "lwip/apps/tftp_server.h"
+
+#include "app.h"
+#include "bbox.h"
+#include "bitstream.h"
+#include "crc32.h"
+#include "flash.h"
+#include "heatshrink.h"
+#include "icap.h"
+#include "log.h"
+#include "ovl.h"
+#include "slots.h"
+#include "tftp.h"
+#include "webfs.h"
+
+// Decoded data programmed at a time, enough for bit_check() to find the
+// IDCODE in the first
+#define TFTP_INFLATE_BUF (512)
+
+// tf.slot of a read of the blackbox log, and of a flash range
+#define TFTP_BLACKBOX    (0xff)
+#define TFTP_FLASH       (0xfe)
+
+static struct {
+  // Handed to the server and not yet closed
+  u8 open;
+  u8 write;
+  u8 slot;
+  // Uploads: the slot is for a bitstream, not the web UI, the overlays or
+  // the firmware, and it is a delta write (slot_begin_delta())
+  u8 bitstream;
+  u8 delta;
+  // Compressed uploads (heatshrink.h): the slot has been begun, and obuf's
+  // data is being programmed
+  u8 packed;
+  u8 begun;
+  u8 obuf_busy;
+  // The short block that ends an upload has been taken
+  u8 last;
+  // A slot operation is in flight
+  u8 busy;
+  u8 failed;
+  // Bytes read or taken so far, and the CRC-32 of those taken
+  u32 off;
+  u32 crc;
+  // Reads of a slot or a flash range: where, and how much
+  u32 rd_addr;
+  u32 rd_len;
+  // Block being programmed, its segment in flight, and the one waiting
+  struct pbuf *cur;
+  struct pbuf *seg;
+  struct pbuf *next;
+  // Compressed uploads: bytes of `seg` decoded, and of obuf filled
+  u32 in_off;
+  u32 olen;
+  struct hs_dec dec;
+  u8 obuf[TFTP_INFLATE_BUF];
+} tf;
+
+static void pump();
+static int tftp_first(const u8 *buf, u32 len);
+
+// "slotN" names slot N; returns -1 for any other name.  Words after a dot
+// are left for name_word().
+static int
+name_slot(const char *fname)
+{
+  if(strncmp(fname, "slot", 4) || fname[4] < '0' || fname[4] > '9' ||
+     (fname[5] && fname[5] != '.')) {
+    return -1;
+  }
+  return fname[4] - '0';
+}
+
+// Hex digits of `s` up to a dot or the end into `*v`.  Returns the rest of
+// `s` after the dot, "" at the end, or NULL if there were no digits or
+// something else.
+static const char *
+name_hex(const char *s, u32 *v)
+{
+  const char *p;
+  u32 d;
+
+  *v = 0;
+  for(p=s; *p && *p != '.'; p++) {
+    if(*p >= '0' && *p <= '9') {
+      d = *p - '0';
+    } else if(*p >= 'a' && *p <= 'f') {
+      d = *p - 'a' + 10;
+    } else if(*p >= 'A' && *p <= 'F') {
+      d = *p - 'A' + 10;
+    } else {
+      return NULL;
+    }
+    if(*v >> 28) {
+      return NULL;
+    }
+    *v = *v << 4 | d;
+  }
+  if(p == s) {
+    return NULL;
+  }
+  return *p ? p + 1 : p;
+}
+
+// "flash.<addr>.<len>", in hex, names `len` bytes of the flash at
+// `addr`, and "flash.<addr>" the rest of it from there.  Returns 0 with
+// the range in `*addr` and `*len`, or -1 for any other name or a range
+// outside the flash.
+static int
+name_flash(const char *fname, u32 *addr, u32 *len)
+{
+  const char *p;
+
+  if(strncmp(fname, "flash.", 6) ||
+     !(p = name_hex(fname + 6, addr)) || *addr > flash_info.size) {
+    return -1;
+  }
+  *len = flash_info.size - *addr;
+  if(*p && (!(p = name_hex(p, len)) || *p ||
+            *len > flash_info.size - *addr)) {
+    return -1;
+  }
+  return 0;
+}
+
+// Whether `word` is one of the dot-separated words of `fname`, as "delta"
+// is of "slot2.hs.delta"
+static int
+name_word(const char *fname, const char *word)
+{
+  u32 n = strlen(word);
+  const char *p;
+
+  for(p=fname; p; p=strchr(p, '.')) {
+    if(*p == '.') {
+      p++;
+    }
+    if(strncmp(p, word, n) == 0 && (p[n] == '\0' || p[n] == '.')) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+// First slot that takes updates and holds none of the web UI, the
+// overlays and the firmware booted, or SLOT_GOLDEN if there is none
+static u8
+inactive_slot()
+{
+  int web = webfs_slot(), ovl = ovl_slot(), app = app_slot();
+  u8 i;
+
+  for(i=0; i<slots.num; i++) {
+    if(i != SLOT_GOLDEN && i != slots.active && i != web && i != ovl &&
+       i != app) {
+      return i;
+    }
+  }
+  return SLOT_GOLDEN;
+}
+
+static u32
+next_version()
+{
+  u32 v = 0;
+  u8 i;
+
+  for(i=0; i<slots.num; i++) {
+    if(slots.slot[i].len && slots.slot[i].version > v) {
+      v = slots.slot[i].version;
+    }
+  }
+  return v + 1;
+}
+
+static void
+release()
+{
+  if(tf.cur) {
+    pbuf_free(tf.cur);
+  }
+  if(tf.next) {
+    pbuf_free(tf.next);
+  }
+  tf.cur = tf.seg = tf.next = NULL;
+}
+
+// Give up on the upload; the server reports it to the client
+static void
+fail()
+{
+  release();
+  tf.failed = 1;
+  tftp_write_done(-1);
+}
+
+// slot_begin() or slot_write() is done
+static void
+slot_done(int err, void *arg)
+{
+  tf.busy = 0;
+  if(!tf.open) {
+    release();
+    return;
+  }
+  if(err) {
+    LOG("tftp: slot %d write failed at %d bytes", tf.slot, tf.off);
+    fail();
+    return;
+  }
+  if(tf.obuf_busy) {
+    tf.obuf_busy = 0;
+    tf.olen = 0;
+  } else if(tf.seg && !tf.packed) {
+    tf.seg = tf.seg->next;
+  }
+  pump();
+}
+
+// Program the decoded data in obuf, beginning the slot with the first.
+// Returns 0, or -1 on error.
+static int
+write_obuf()
+{
+  if(!tf.begun) {
+    tf.begun = 1;
+    return tftp_first(tf.obuf, tf.olen);
+  }
+  tf.crc = crc32(tf.crc, tf.obuf, tf.olen);
+  if(slot_write(tf.obuf, tf.olen, slot_done, NULL)) {
+    return -1;
+  }
+  tf.obuf_busy = 1;
+  tf.busy = 1;
+  return 0;
+}
+
+// Decode the rest of `cur` into obuf.  Returns non-zero if that filled it.
+static int
+inflate()
+{
+  const u8 *in;
+  u32 in_len;
+
+  while(tf.seg && tf.olen < sizeof(tf.obuf)) {
+    in = (const u8 *)tf.seg->payload + tf.in_off;
+    in_len = tf.seg->len - tf.in_off;
+    tf.olen += hs_decode(&tf.dec, &in, &in_len, tf.obuf + tf.olen,
+        sizeof(tf.obuf) - tf.olen);
+    tf.in_off = tf.seg->len - in_len;
+    if(!in_len) {
+      tf.seg = tf.seg->next;
+      tf.in_off = 0;
+    }
+  }
+  return tf.olen == sizeof(tf.obuf);
+}
+
+static void
+finished(int err, void *arg)
+{
+  u32 skipped, rewritten;
+
+  tf.busy = 0;
+  if(err) {
+    LOG("tftp: slot %d failed verification", tf.slot);
+  } else {
+    LOG("tftp: slot %d holds %d bytes, crc %08x", tf.slot,
+        slots.slot[tf.slot].len, tf.crc);
+  }
+  if(tf.packed) {
+    LOG("tftp: slot %d image came as %d bytes", tf.slot, tf.off);
+  }
+  if(tf.delta) {
+    slot_delta_counts(&skipped, &rewritten);
+    LOG("tftp: delta write left %d sectors, rewrote %d", skipped, rewritten);
+  }
+  bbox_event(BBOX_UPDATE, tf.slot, err ? -1 : 0, slots.slot[tf.slot].len,
+      tf.crc);
+  // Acknowledges the last block if the client is still there
+  tftp_write_done(err ? -1 : 0);
+}
+
+// Program the rest of `cur`, then `next`, then verify once the last block
+// is in.  Called when no slot operation is in flight.
+static void
+pump()
+{
+  const u8 *in = NULL;
+  u32 in_len = 0;
+
+  for(;;) {
+    if(tf.packed) {
+      if(inflate()) {
+        if(write_obuf()) {
+          fail();
+        }
+        return;
+      }
+    }
+    while(tf.seg && !tf.seg->len) {
+      tf.seg = tf.seg->next;
+    }
+    if(tf.seg && !tf.packed) {
+      if(slot_write(tf.seg->payload, tf.seg->len, slot_done, NULL)) {
+        fail();
+      } else {
+        tf.busy = 1;
+      }
+      return;
+    }
+    if(tf.cur) {
+      pbuf_free(tf.cur);
+      tf.cur = NULL;
+    }
+    if(!tf.next) {
+      break;
+    }
+    tf.cur = tf.seg = tf.next;
+    tf.next = NULL;
+    tf.in_off = 0;
+    // The last block is acknowledged by finished()
+    if(!tf.last) {
+      tftp_write_done(0);
+    }
+  }
+
+  if(tf.last) {
+    // What the decoder still has, then the partly filled obuf
+    if(tf.packed) {
+      tf.olen += hs_decode(&tf.dec, &in, &in_len, tf.obuf + tf.olen,
+          sizeof(tf.obuf) - tf.olen);
+      if(tf.olen) {
+        if(write_obuf()) {
+          fail();
+        }
+        return;
+      }
+    }
+    if(slot_finish(tf.crc, finished, NULL)) {
+      fail();
+    } else {
+      tf.busy = 1;
+    }
+  }
+}
+
+static void *
+tftp_open(const char *fname, const char *mode, u8_t write)
+{
+  int slot = name_slot(fname);
+  u32 addr, len;
+
+  if(tf.open || tf.busy || slots_busy() || strcmp(mode, "octet")) {
+    return NULL;
+  }
+
+  if(!write && !strcmp(fname, "blackbox")) {
+    if(!bbox_size()) {
+      return NULL;
+    }
+    slot = TFTP_BLACKBOX;
+  } else if(!write && name_flash(fname, &addr, &len) == 0) {
+    slot = TFTP_FLASH;
+    tf.rd_addr = addr;
+    tf.rd_len = len;
+  } else if(!write) {
+    if(slot < 0 || slot >= slots.num || !slots.slot[slot].len) {
+      return NULL;
+    }
+    tf.rd_addr = slots.slot[slot].addr;
+    tf.rd_len = slots.slot[slot].len;
+  } else {
+    if(slot < 0) {
+      slot = inactive_slot();
+    }
+    // As slot_begin() checks, once the first block is in
+    if(slot == SLOT_GOLDEN || slot >= slots.num || slot == slots.active) {
+      return NULL;
+    }
+    tf.bitstream = slot != webfs_slot() && slot != ovl_slot() &&
+      slot != app_slot();
+    tf.delta = name_word(fname, "delta");
+    tf.packed = name_word(fname, "hs");
+    tf.begun = 0;
+    tf.obuf_busy = 0;
+    tf.olen = 0;
+    tf.in_off = 0;
+    hs_init(&tf.dec);
+  }
+
+  tf.open = 1;
+  tf.write = write;
+  tf.slot = slot;
+  tf.last = 0;
+  tf.failed = 0;
+  tf.off = 0;
+  tf.crc = 0;
+  return &tf;
+}
+
+static void
+tftp_close(void *handle)
+{
+  if(tf.write && !tf.last) {
+    LOG("tftp: slot %d upload abandoned at %d bytes", tf.slot, tf.off);
+  }
+  tf.open = 0;
+  // Otherwise dropped when the slot operation ends
+  if(!tf.busy) {
+    release();
+  }
+}
+
+static int
+tftp_read(void *handle, void *buf, int bytes)
+{
+  u32 n;
+
+  if(tf.slot == TFTP_BLACKBOX) {
+    n = bbox_size() - tf.off;
+    if(n > (u32)bytes) {
+      n = bytes;
+    }
+    if(n && bbox_read(tf.off, buf, n) != n) {
+      return -1;
+    }
+    tf.off += n;
+    return n;
+  }
+  n = tf.rd_len - tf.off;
+  if(n > (u32)bytes) {
+    n = bytes;
+  }
+  if(n && read_flash(tf.rd_addr + tf.off, buf, n, FLASH_MODE_BEST) != n) {
+    return -1;
+  }
+  tf.off += n;
+  return n;
+}
+
+// Check the first `len` bytes of an image and start on the slot.  Returns
+// 0, or -1 to refuse the upload.
+static int
+tftp_first(const u8 *buf, u32 len)
+{
+  int err;
+
+  // A firmware image may go in any slot a bitstream could
+  if(tf.bitstream && !app_check(buf, len)) {
+    err = bit_check(buf, len, icap_idcode());
+    if(err != BIT_OK) {
+      LOG("tftp: slot %d upload is no bitstream for this FPGA (%d)",
+          tf.slot, err);
+      return -1;
+    }
+  }
+  if(tf.delta) {
+    err = slot_begin_delta(tf.slot, slots.slot[tf.slot].size, next_version(),
+        slot_done, NULL);
+  } else {
+    err = slot_begin(tf.slot, slots.slot[tf.slot].size, next_version(),
+        slot_done, NULL);
+  }
+  if(err) {
+    return -1;
+  }
+  tf.busy = 1;
+  return 0;
+}
+
+static int
+tftp_write(void *handle, struct pbuf *p)
+{
+  struct pbuf *q;
+
+  if(tf.failed || p->tot_len > slots.slot[tf.slot].size - tf.off) {
+    return -1;
+  }
+  // Blocks arrive in one pbuf each
+  if(!tf.packed && tf.off == 0 && tftp_first(p->payload, p->len) != 0) {
+    tf.failed = 1;
+    return -1;
+  }
+
+  // Compressed uploads: of the decoded data, in write_obuf()
+  for(q=p; q && !tf.packed; q=q->next) {
+    tf.crc = crc32(tf.crc, q->payload, q->len);
+  }
+  tf.off += p->tot_len;
+  tf.last = p->tot_len < tftp_blksize();
+
+  // The server takes no more blocks while one is pending, so `next` is
+  // free
+  pbuf_ref(p);
+  tf.next = p;
+  if(!tf.busy) {
+    pump();
+  }
+
+  if(tf.failed) {
+    return -1;
+  }
+  return tf.next || tf.last ? TFTP_WRITE_PENDING : 0;
+}
+
+static const struct tftp_context tftp_ctx = {
+  tftp_open,
+  tftp_close,
+  tftp_read,
+  tftp_write,
+};
+
+void
+init_tftp()
+{
+  tftp_init(&tftp_ctx);
+}
@@ -0,0 +1,48 @@
+#ifndef _TFTP_H_
+#define _TFTP_H_
+
+// tftp.h - Bitstream slot uploads and downloads over TFTP.
+//
+// "tftp -m binary <board> -c put image.bin" writes an image into the
+// first slot that is neither the golden nor the active one, nor holds the
+// web UI, the overlays or the firmware the bootloader runs (see slots.h,
+// webfs.h, ovl.h and app.h); a file named
+// "slotN" goes to slot N instead.  Each block is programmed
+// straight from the frame it arrived in, while the next one is on its
+// way, and the CRC-32 of the data is kept as it goes.  The last block is
+// only acknowledged once the slot has been read back against that CRC and
+// recorded in the table, so a client that sees success has a bootable
+// image; making it the one booted is left to slot_activate().  Images are
+// given one more than the highest version in the table.  Uploads to a
+// bitstream slot must start with a bitstream header or sync word and
+// load on this FPGA's IDCODE (bitstream.h), or with a firmware image
+// header (app.h), or they are refused on the first block, before
+// anything is erased.
+//
+// "put image.bin delta" (or "slotN.delta") is a delta write
+// (slot_begin_delta()): only the sectors whose data changed are erased and
+// programmed, so a small change to the image in the slot costs a few
+// sectors.  The log records how many sectors were left and how many
+// rewritten.
+//
+// A ".hs" word in the name, as in "put image.hs slot2.hs", marks the file
+// as compressed with heatshrink (heatshrink.h, tools/hsencode.py).  It is
+// decoded as it arrives, TFTP_INFLATE_BUF bytes at a time, into the page
+// programs, and the image checked and recorded is the decoded one.  The
+// words combine, as in "slot2.hs.delta".
+//
+// Clients may ask for blocks filling a frame (blksize, RFC 2348) and,
+// for uploads, up to TFTP_MAX_WINDOWSIZE blocks per ACK (windowsize,
+// RFC 7440), as with "curl --tftp-blksize 1468 -T image.bin".
+//
+// "get slotN" reads back the image in slot N, and "get blackbox" the
+// blackbox event log (bbox.h).  "get flash.<addr>.<len>", both in hex,
+// reads any range of the flash, and "get flash.<addr>" the rest of it
+// from `addr`, as for backing up calibration sectors; flashrd.h streams
+// ranges over TCP for the bigger jobs.  Only octet mode is served and one
+// transfer runs at a time.
+
+// Serve TFTP_PORT.  Call after init_slots().
+void init_tftp();
+
+#endif // _TFTP_H_
@@ -0,0 +1,142 @@
+// throttle.c - Thermal throttling of the gateware (see throttle.h).
+//
+// The ladder is walked rather than divided into: it has a handful of
+// rungs.  `rung_ms` is when the level last changed, for the hold before
+// it may fall.
+
+#include "log.h"
+#include "ring.h"
+#include "throttle.h"
+#include "timebase.h"
+#include "timer.h"
+#include "wbbus.h"
+#include "wbmap.h"
+#include "wbshadow.h"
+#include "xadc.h"
+
+static const struct wbmap_entry *dev;
+
+static u8 level;
+static u8 pinned;
+static u32 rung_ms;
+
+// A history ring (ring.h), filled from the main loop
+static struct throttle_event events[THROTTLE_EVENTS];
+static struct ring event_ring = RING_INIT(THROTTLE_EVENTS);
+
+// Threshold that raises the level to `n` (1 to THROTTLE_LEVELS)
+static s32
+rung(u32 n)
+{
+  return THROTTLE_START_MC + (s32)(n - 1) * THROTTLE_STEP_MC;
+}
+
+static void
+throttle_set(u32 to, u8 cause, s32 temp_mc, s32 vccint_mv)
+{
+  struct throttle_event *ev = &events[ring_head_slot(&event_ring)];
+  struct wbbus_op op;
+
+  ev->time_ms = timebase_ms();
+  ev->from = level;
+  ev->to = to;
+  ev->cause = cause;
+  ev->temp_mc = temp_mc;
+  ev->vccint_mv = vccint_mv;
+  ring_push(&event_ring, 1);
+  LOG("throttle: level %u -> %u (cause %u, %d mC, %d mV)", level, to, cause,
+      temp_mc, vccint_mv);
+
+  level = to;
+  rung_ms = ev->time_ms;
+  if(dev) {
+    wbbus_begin(&op, dev->offset);
+    wbshadow_write(dev->offset, to);
+    if(wbbus_end(&op, 1) != 0) {
+      LOG("throttle: bus error writing %s", THROTTLE_DEV);
+    }
+  }
+}
+
+static void
+throttle_poll(void *arg)
+{
+  s32 temp = xadc_convert(XADC_TEMP, xadc_raw(XADC_TEMP));
+  s32 vccint = xadc_convert(XADC_VCCINT, xadc_raw(XADC_VCCINT));
+  u32 to = level;
+
+  if(pinned) {
+    return;
+  }
+  while(to < THROTTLE_LEVELS && temp >= rung(to + 1)) {
+    to++;
+  }
+  if(to > level) {
+    throttle_set(to, THROTTLE_TEMP, temp, vccint);
+  } else if(level < THROTTLE_LEVELS &&
+            vccint < XADC_VCCINT_LO_MV + THROTTLE_VCCINT_MV) {
+    throttle_set(level + 1, THROTTLE_SUPPLY, temp, vccint);
+  } else if(level && temp < rung(level) - THROTTLE_HYST_MC &&
+            timebase_ms() - rung_ms >= THROTTLE_HOLD_MS) {
+    throttle_set(level - 1, THROTTLE_TEMP, temp, vccint);
+  }
+}
+
+static struct timer poll_timer = TIMER_INIT(throttle_poll, NULL);
+static struct timer_deadline poll_deadline =
+    TIMER_DEADLINE_INIT("throttle", THROTTLE_DEADLINE_US);
+
+void
+init_throttle()
+{
+  struct wbbus_op op;
+
+  dev = wbmap_find(THROTTLE_DEV);
+  if(!dev) {
+    LOG("throttle: no %s in the register map", THROTTLE_DEV);
+  } else {
+    wbbus_begin(&op, dev->offset);
+    wbshadow_write(dev->offset, 0);
+    wbbus_end(&op, 1);
+  }
+  timer_set_deadline(&poll_timer, &poll_deadline);
+  timer_start(&poll_timer, THROTTLE_PERIOD_MS, THROTTLE_PERIOD_MS);
+}
+
+u32
+throttle_level(int *p)
+{
+  *p = pinned;
+  return level;
+}
+
+int
+throttle_pin(int to)
+{
+  if(to > THROTTLE_LEVELS) {
+    return -1;
+  }
+  pinned = to >= 0;
+  if(pinned && (u32)to != level) {
+    throttle_set(to, THROTTLE_MANUAL,
+        xadc_convert(XADC_TEMP, xadc_raw(XADC_TEMP)),
+        xadc_convert(XADC_VCCINT, xadc_raw(XADC_VCCINT)));
+  }
+  return 0;
+}
+
+u32
+throttle_event_count()
+{
+  return event_ring.head;
+}
+
+int
+throttle_event(u32 n, struct throttle_event *ev)
+{
+  if(!ring_holds(&event_ring, n)) {
+    return -1;
+  }
+  *ev = events[n & event_ring.mask];
+  return 0;
+}
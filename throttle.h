@@ -0,0 +1,89 @@
+#ifndef _THROTTLE_H_
+#define _THROTTLE_H_
+
+// throttle.h - Thermal throttling of the gateware ahead of the XADC's
+// over-temperature shutdown.
+//
+// Every THROTTLE_PERIOD_MS the controller compares the FPGA temperature
+// against a ladder of thresholds, THROTTLE_START_MC and every
+// THROTTLE_STEP_MC above it, and writes the level it reaches, 0 (full
+// rate) to THROTTLE_LEVELS, to word 0 of the gateware's THROTTLE_DEV
+// register (wbmap.h), through wbshadow.h.  What a level does is the
+// gateware's: switch channels off, lower a processing rate.  The level
+// rises as soon as the temperature crosses a threshold, as far as it
+// takes, and falls one step at a time, after THROTTLE_HOLD_MS at that
+// level and only once the temperature is THROTTLE_HYST_MC below the
+// threshold that raised it, so a board sitting on a threshold does not
+// toggle.  VCCINT sagging below XADC_VCCINT_LO_MV + THROTTLE_VCCINT_MV
+// (a supply at its limit under the load) raises the level one step each
+// period too.  The top level is meant to keep a board out of the
+// XADC's 125 C OT shutdown, which resets the FPGA and all of its state.
+//
+// Each change is logged and kept in a history of THROTTLE_EVENTS, which
+// KATCP's ?throttle lists (katcp.h) and which sends the jamThrottle trap
+// (snmptrap.h).  ?throttle also pins the level by hand.  Without the
+// device in the register map the controller still runs and reports what
+// it would do.
+
+#include "xil_types.h"
+
+// Register map device taking the level
+#define THROTTLE_DEV "thermal_throttle"
+
+#define THROTTLE_LEVELS    (4)
+#define THROTTLE_PERIOD_MS (250)
+#define THROTTLE_HOLD_MS   (5000)
+// A poll must start this soon after it is due (timer.h), in us
+#define THROTTLE_DEADLINE_US (20000)
+
+// Temperature ladder, milli-degrees C
+#ifndef THROTTLE_START_MC
+#define THROTTLE_START_MC  (80000)
+#endif
+#ifndef THROTTLE_STEP_MC
+#define THROTTLE_STEP_MC   (5000)
+#endif
+#define THROTTLE_HYST_MC   (3000)
+
+// Margin over the VCCINT alarm threshold that counts as sagging, mV
+#define THROTTLE_VCCINT_MV (10)
+
+// Changes kept (a power of two)
+#define THROTTLE_EVENTS    (16)
+
+// Why the level changed
+#define THROTTLE_TEMP    (0) // up or down the temperature ladder
+#define THROTTLE_SUPPLY  (1) // VCCINT sagging
+#define THROTTLE_MANUAL  (2) // pinned or released by hand
+
+struct throttle_event {
+  // timebase_ms() of the change
+  u32 time_ms;
+  u8 from;
+  u8 to;
+  u8 cause;
+  u8 pad;
+  // Temperature (mC) and VCCINT (mV) at the time
+  s32 temp_mc;
+  s32 vccint_mv;
+};
+
+// Look up THROTTLE_DEV, write level 0 and start the controller.  Call
+// after init_xadc(), init_wbshadow() and init_timers().
+void init_throttle();
+
+// Current level, and in `pinned` whether it was pinned by hand
+u32 throttle_level(int *pinned);
+
+// Pin the level at `level` (at most THROTTLE_LEVELS), or hand it back to
+// the controller if negative.  Returns 0, or -1 if `level` is too high.
+int throttle_pin(int level);
+
+// Number of changes so far
+u32 throttle_event_count();
+
+// Copy change `n` (counting from 0) into `ev`.  Returns 0, or -1 if it has
+// not happened yet or has been overwritten.
+int throttle_event(u32 n, struct throttle_event *ev);
+
+#endif // _THROTTLE_H_
@@ -0,0 +1,254 @@
+// timebase.c - 64-bit timebase and millisecond tick on axi_timer_0.
+//
+// Counter 0 counts down from TIMEBASE_CYCLES_PER_MS - 1 and reloads
+// itself, interrupting once a millisecond.  The interrupt counts ticks, so
+// milliseconds are just the tick count and finer time adds the counter's
+// progress through the current tick.  Counter 1 just counts up, for
+// timebase_stamp(), in capture mode: an edge on the timer's capture input
+// (a 1PPS, where the gateware routes one there) latches the count into
+// its load register and interrupts, sharing the tick's interrupt line.
+
+#include "xparameters.h"
+#include "xtmrctr.h"
+
+#include "lwip/sys.h"
+
+#include "intr.h"
+#include "timebase.h"
+
+#define TIMEBASE_BASE XPAR_TMRCTR_0_BASEADDR
+
+static XTmrCtr xtmrctr;
+
+// Ticks (milliseconds) since init_timebase()
+static volatile u64 tb_ticks;
+
+static struct work *tick_work;
+static void (*volatile tick_sampler)(u32 pc);
+static void (*volatile tick_monitor)(u32 pc);
+static void (*volatile capture_fn)(u64 cycles);
+static void (*volatile alarm_fn)(u32 ms);
+
+// Hand the capture to capture_fn, as timebase_cycles()
+static void
+timebase_capture()
+{
+  u32 latched = XTmrCtr_ReadReg(TIMEBASE_BASE, 1, XTC_TLR_OFFSET);
+  void (*fn)(u64 cycles) = capture_fn;
+
+  if(fn) {
+    fn(timebase_widen(latched));
+  }
+}
+
+static void
+timebase_isr(void *ref)
+{
+  // Counter 0 reloaded as the interrupt fired, so its progress since is
+  // the entry latency
+  u32 tcr = XTmrCtr_ReadReg(TIMEBASE_BASE, 0, XTC_TCR_OFFSET);
+  u32 csr = XTmrCtr_ReadReg(TIMEBASE_BASE, 0, XTC_TCSR_OFFSET);
+  u32 csr1 = XTmrCtr_ReadReg(TIMEBASE_BASE, 1, XTC_TCSR_OFFSET);
+  void (*sampler)(u32 pc) = tick_sampler;
+  void (*monitor)(u32 pc) = tick_monitor;
+  void (*alarm)(u32 ms) = alarm_fn;
+  u32 pc;
+
+  // r14 holds the interrupted PC: the compiler never allocates it, and
+  // neither the fast entry (intr.c) nor the BSP's handler and the INTC
+  // driver touch it
+  __asm__ volatile ("addk %0, r14, r0" : "=r" (pc));
+
+  if(csr1 & XTC_CSR_INT_OCCURED_MASK) {
+    XTmrCtr_WriteReg(TIMEBASE_BASE, 1, XTC_TCSR_OFFSET, csr1);
+  }
+  if(!(csr & XTC_CSR_INT_OCCURED_MASK)) {
+    // Only the capture
+    timebase_capture();
+    return;
+  }
+  // Writing the interrupt bit back clears it
+  XTmrCtr_WriteReg(TIMEBASE_BASE, 0, XTC_TCSR_OFFSET, csr);
+  tb_ticks++;
+  intr_note_latency(TIMEBASE_CYCLES_PER_MS - 1 - tcr, pc);
+  if(alarm) {
+    alarm((u32)tb_ticks);
+  }
+
+  if(tick_work) {
+    work_schedule(tick_work);
+  }
+  if(sampler) {
+    sampler(pc);
+  }
+  if(monitor) {
+    monitor(pc);
+  }
+  // After the tick is counted, so that the edge's cycles are right
+  if(csr1 & XTC_CSR_INT_OCCURED_MASK) {
+    timebase_capture();
+  }
+}
+
+void
+init_timebase()
+{
+    XTmrCtr_Initialize(&xtmrctr, XPAR_TMRCTR_0_DEVICE_ID);
+
+    XTmrCtr_SetOptions(&xtmrctr, 0, XTC_INT_MODE_OPTION |
+        XTC_AUTO_RELOAD_OPTION | XTC_DOWN_COUNT_OPTION);
+    XTmrCtr_SetResetValue(&xtmrctr, 0, TIMEBASE_CYCLES_PER_MS - 1);
+
+    // Auto reload, in capture mode, lets each edge replace the last
+    XTmrCtr_SetOptions(&xtmrctr, 1, XTC_AUTO_RELOAD_OPTION |
+        XTC_CAPTURE_MODE_OPTION | XTC_INT_MODE_OPTION);
+    XTmrCtr_SetResetValue(&xtmrctr, 1, 0);
+
+    intr_connect_fast(XPAR_INTC_0_TMRCTR_0_VEC_ID, timebase_isr, NULL);
+    XTmrCtr_Start(&xtmrctr, 0);
+    XTmrCtr_Start(&xtmrctr, 1);
+}
+
+// Whole ticks and cycles into the current tick
+static void
+timebase_read(u64 *ticks, u32 *cycles)
+{
+  u32 msr = intr_lock();
+  u32 tcr = XTmrCtr_ReadReg(TIMEBASE_BASE, 0, XTC_TCR_OFFSET);
+  u64 t = tb_ticks;
+
+  // The counter reloaded but its interrupt hasn't been taken yet: read it
+  // again to be sure the value is from after the reload
+  if(XTmrCtr_ReadReg(TIMEBASE_BASE, 0, XTC_TCSR_OFFSET) &
+     XTC_CSR_INT_OCCURED_MASK) {
+    tcr = XTmrCtr_ReadReg(TIMEBASE_BASE, 0, XTC_TCR_OFFSET);
+    t++;
+  }
+
+  intr_unlock(msr);
+
+  *ticks = t;
+  *cycles = TIMEBASE_CYCLES_PER_MS - 1 - tcr;
+}
+
+u64
+timebase_cycles()
+{
+  u64 ticks;
+  u32 cycles;
+
+  timebase_read(&ticks, &cycles);
+  return ticks * TIMEBASE_CYCLES_PER_MS + cycles;
+}
+
+u32
+timebase_since_ms(u32 ms)
+{
+  u64 ticks;
+  u32 cycles;
+
+  timebase_read(&ticks, &cycles);
+  return ((u32)ticks - ms) * TIMEBASE_CYCLES_PER_MS + cycles;
+}
+
+// Cycles into a tick in microseconds.  The core has no divider, and
+// __udivsi3 takes a few hundred cycles, so this is long division by
+// TIMEBASE_CYCLES_PER_US against a table of its multiples: a compare and
+// a subtract for each of the ten bits a tick's microseconds need.
+static const u32 us_steps[] = {
+  TIMEBASE_CYCLES_PER_US << 9, TIMEBASE_CYCLES_PER_US << 8,
+  TIMEBASE_CYCLES_PER_US << 7, TIMEBASE_CYCLES_PER_US << 6,
+  TIMEBASE_CYCLES_PER_US << 5, TIMEBASE_CYCLES_PER_US << 4,
+  TIMEBASE_CYCLES_PER_US << 3, TIMEBASE_CYCLES_PER_US << 2,
+  TIMEBASE_CYCLES_PER_US << 1, TIMEBASE_CYCLES_PER_US,
+};
+
+static inline u32
+tick_cycles_to_us(u32 cycles)
+{
+  u32 i, us = 0;
+
+  for(i=0; i<sizeof(us_steps)/sizeof(us_steps[0]); i++) {
+    us += us;
+    if(cycles >= us_steps[i]) {
+      cycles -= us_steps[i];
+      us++;
+    }
+  }
+  return us;
+}
+
+// The stamp is read straight after the cycles, so a stamp comes out a few
+// cycles early (under 0.2 us)
+u64
+timebase_widen(u32 stamp)
+{
+  u64 now = timebase_cycles();
+
+  return now - (timebase_stamp() - stamp);
+}
+
+u64
+timebase_us()
+{
+  u64 ticks;
+  u32 cycles;
+
+  timebase_read(&ticks, &cycles);
+  return ticks * 1000 + tick_cycles_to_us(cycles);
+}
+
+u32
+timebase_ms()
+{
+  u32 msr = intr_lock();
+  u32 ms = (u32)tb_ticks;
+
+  intr_unlock(msr);
+  return ms;
+}
+
+u32_t
+sys_now()
+{
+  return timebase_ms();
+}
+
+void
+timebase_on_tick(struct work *w)
+{
+  tick_work = w;
+}
+
+void
+timebase_on_capture(void (*fn)(u64 cycles))
+{
+  capture_fn = fn;
+}
+
+void
+timebase_set_sampler(void (*fn)(u32 pc))
+{
+  tick_sampler = fn;
+}
+
+void
+timebase_set_monitor(void (*fn)(u32 pc))
+{
+  tick_monitor = fn;
+}
+
+void
+timebase_set_alarm(void (*fn)(u32 ms))
+{
+  alarm_fn = fn;
+}
+
+void
+delay_us(u32 us)
+{
+  u64 end = timebase_cycles() + (u64)us * TIMEBASE_CYCLES_PER_US;
+
+  while((s64)(timebase_cycles() - end) < 0)
+    ;
+}
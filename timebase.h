@@ -0,0 +1,76 @@
+#ifndef _TIMEBASE_H_
+#define _TIMEBASE_H_
+
+// timebase.h - 64-bit timebase and millisecond tick on axi_timer_0.
+
+#include "xparameters.h"
+#include "xil_io.h"
+#include "xil_types.h"
+#include "xtmrctr_l.h"
+
+#include "work.h"
+
+// Timebase clock
+#define TIMEBASE_HZ XPAR_TMRCTR_0_CLOCK_FREQ_HZ
+#define TIMEBASE_CYCLES_PER_MS (TIMEBASE_HZ / 1000)
+#define TIMEBASE_CYCLES_PER_US (TIMEBASE_HZ / 1000000)
+
+// Start the timebase.  Call after init_intr() and before anything that
+// needs the time.
+void init_timebase();
+
+// Timer clock cycles since init_timebase()
+u64 timebase_cycles();
+
+// timebase_cycles() at which timebase_stamp() returned `stamp`, for a stamp
+// less than 2^32 cycles (42 s at 100 MHz) old
+u64 timebase_widen(u32 stamp);
+
+// Microseconds since init_timebase()
+u64 timebase_us();
+
+// Milliseconds since init_timebase(), wrapping.  Also lwIP's sys_now().
+u32 timebase_ms();
+
+// Timer clock cycles since millisecond `ms` (as timebase_ms() counts them)
+// began, for a `ms` less than 42 s ago.  No division, unlike going
+// through timebase_cycles().
+u32 timebase_since_ms(u32 ms);
+
+// Schedule `w` from every tick interrupt (one per millisecond)
+void timebase_on_tick(struct work *w);
+
+// Call `fn` (NULL for none) from the timer interrupt with the
+// timebase_cycles() of each rising edge on the timer's capture input, for
+// sntpclock.h's 1PPS.  Interrupts are masked, so keep it short.
+void timebase_on_capture(void (*fn)(u64 cycles));
+
+// Call `fn` (NULL for none) from every tick interrupt with the PC it
+// interrupted, for pcprof.h.  It runs with interrupts masked, so keep it
+// short.
+void timebase_set_sampler(void (*fn)(u32 pc));
+
+// Likewise for the watchdog supervisor (wdog.h), which needs the PC if the
+// main loop is stuck
+void timebase_set_monitor(void (*fn)(u32 pc));
+
+// Call `fn` (NULL for none) from every tick interrupt, first, with the
+// millisecond (as timebase_ms() counts them) that begins, for the timed
+// writes of wbtimed.h.  Interrupts are masked, so it must return quickly
+// unless it is waiting for a moment within the tick.
+void timebase_set_alarm(void (*fn)(u32 ms));
+
+// Busy-wait for `us` microseconds
+void delay_us(u32 us);
+
+// Free-running count of timer clock cycles, wrapping at 32 bits.  A single
+// register read, for timing short stretches of code: take the difference
+// of two stamps.
+static inline u32
+timebase_stamp()
+{
+  return Xil_In32(XPAR_TMRCTR_0_BASEADDR + XTC_TIMER_COUNTER_OFFSET +
+      XTC_TCR_OFFSET);
+}
+
+#endif // _TIMEBASE_H_
@@ -0,0 +1,439 @@
+// timer.c - Millisecond timers on a hierarchical timer wheel.
+//
+// The first level has a slot for each of the next TV0_SIZE milliseconds;
+// each of the TVN_LEVELS levels above it has TVN_SIZE slots, each covering
+// a whole turn of the level below.  A timer goes into the slot of the
+// lowest level whose range covers its expiry, and every time a level
+// completes a turn the next slot of the level above is redistributed
+// (cascaded) into it.  This also provides lwIP's timeouts
+// (LWIP_TIMERS_CUSTOM) in place of timeouts.c's sorted list.
+//
+// timer_run() first releases every tick it has to catch up on, moving
+// each expired timer into `ready`, kept sorted by deadline, then runs
+// `ready` from the front.  `due` orders it: microseconds from the first
+// tick released to the deadline, compared as a signed difference.  The
+// list is an ordinary timer list, so stopping a released timer takes it
+// out and timer_pending() holds until its callback runs.
+
+#include "lwip/timeouts.h"
+
+#include "load.h"
+#include "timebase.h"
+#include "timer.h"
+#include "work.h"
+
+#define TV0_BITS   (8)
+#define TVN_BITS   (6)
+#define TVN_LEVELS (3)
+#define TV0_SIZE   (1 << TV0_BITS)
+#define TVN_SIZE   (1 << TVN_BITS)
+#define TV0_MASK   (TV0_SIZE - 1)
+#define TVN_MASK   (TVN_SIZE - 1)
+
+// First bit of the expiry time that indexes level `n` above the first
+#define TVN_SHIFT(n) (TV0_BITS + (n) * TVN_BITS)
+
+static struct timer *tv0[TV0_SIZE];
+static struct timer *tvn[TVN_LEVELS][TVN_SIZE];
+
+// Next tick to process; every timer due before it has run
+static u32 wheel_now;
+
+// Timers released and waiting to run, earliest deadline first, and the
+// first tick released into it
+static struct timer *ready;
+static u32 ready_base;
+static u8 running;
+
+static struct timer_deadline *deadlines;
+static struct timer_stats stats;
+
+static void timer_work_fn(void *arg);
+static struct work timer_work = WORK_INIT(timer_work_fn, NULL);
+
+static void
+list_add(struct timer **head, struct timer *t)
+{
+  t->next = *head;
+  if(t->next) {
+    t->next->pprev = &t->next;
+  }
+  *head = t;
+  t->pprev = head;
+}
+
+static void
+list_del(struct timer *t)
+{
+  *t->pprev = t->next;
+  if(t->next) {
+    t->next->pprev = t->pprev;
+  }
+  t->next = NULL;
+  t->pprev = NULL;
+}
+
+// Put `t` in the slot for its expiry
+static void
+wheel_add(struct timer *t)
+{
+  u32 expires = t->expires;
+  u32 delta = expires - wheel_now;
+  struct timer **slot;
+
+  if((s32)delta < 0) {
+    // Already due: next tick
+    slot = &tv0[wheel_now & TV0_MASK];
+  } else if(delta < (1 << TVN_SHIFT(0))) {
+    slot = &tv0[expires & TV0_MASK];
+  } else if(delta < (1 << TVN_SHIFT(1))) {
+    slot = &tvn[0][(expires >> TVN_SHIFT(0)) & TVN_MASK];
+  } else if(delta < (1 << TVN_SHIFT(2))) {
+    slot = &tvn[1][(expires >> TVN_SHIFT(1)) & TVN_MASK];
+  } else {
+    slot = &tvn[2][(expires >> TVN_SHIFT(2)) & TVN_MASK];
+  }
+  list_add(slot, t);
+}
+
+// Redistribute tvn[level][index] into the levels below.  Returns `index`.
+static u32
+cascade(int level, u32 index)
+{
+  struct timer *t = tvn[level][index];
+  struct timer *next;
+
+  tvn[level][index] = NULL;
+  for(; t; t = next) {
+    next = t->next;
+    t->next = NULL;
+    t->pprev = NULL;
+    wheel_add(t);
+  }
+  return index;
+}
+
+// Deadline of `t` after its expiry, in us, while it runs periodically or
+// has its own
+static u32
+deadline_us(const struct timer *t)
+{
+  if(t->rt) {
+    return t->rt->deadline_us;
+  }
+  return (t->period < TIMER_DEADLINE_CAP_MS ? t->period :
+      TIMER_DEADLINE_CAP_MS) * 1000;
+}
+
+// Put expired `t` into `ready` by its deadline, behind any it ties with
+static void
+ready_add(struct timer *t)
+{
+  struct timer **p = &ready;
+  u32 rel;
+
+  if(t->rt || t->period) {
+    rel = deadline_us(t);
+  } else {
+    rel = (t->due < TIMER_DEADLINE_CAP_MS ? t->due :
+        TIMER_DEADLINE_CAP_MS) * 1000;
+  }
+  t->due = (t->expires - ready_base) * 1000 + rel;
+  while(*p && (s32)((*p)->due - t->due) <= 0) {
+    p = &(*p)->next;
+  }
+  list_add(p, t);
+}
+
+// Release tick wheel_now
+static void
+wheel_step()
+{
+  u32 now = wheel_now;
+  u32 index = now & TV0_MASK;
+  struct timer *t;
+  int level;
+
+  if(index == 0) {
+    for(level=0; level<TVN_LEVELS; level++) {
+      if(cascade(level, (now >> TVN_SHIFT(level)) & TVN_MASK)) {
+        break;
+      }
+    }
+  }
+
+  wheel_now = now + 1;
+  while((t = tv0[index])) {
+    list_del(t);
+    ready_add(t);
+  }
+}
+
+// Record the start of `t`'s run, `late` cycles after its expiry.  A
+// one-shot without a deadline of its own cannot miss.
+static void
+timer_account(struct timer *t, u32 late)
+{
+  struct timer_deadline *d = t->rt;
+  u32 rel, miss;
+
+  stats.runs++;
+  if(!d && !t->period) {
+    return;
+  }
+  rel = deadline_us(t);
+  miss = rel < 0xffffffff / TIMEBASE_CYCLES_PER_US &&
+      late > rel * TIMEBASE_CYCLES_PER_US;
+  stats.misses += miss;
+  if(d) {
+    d->runs++;
+    d->misses += miss;
+    d->late = late;
+    if(late > d->late_max) {
+      d->late_max = late;
+    }
+    d->late_sum += late;
+  }
+}
+
+void
+timer_run()
+{
+  u32 now = timebase_ms();
+  struct load_span span;
+  struct timer *t;
+
+  // Not again from a callback
+  if(running) {
+    return;
+  }
+  running = 1;
+  ready_base = wheel_now;
+  while((s32)(now - wheel_now) >= 0) {
+    wheel_step();
+  }
+
+  while((t = ready)) {
+    list_del(t);
+    timer_account(t, timebase_since_ms(t->expires));
+    // Requeue before running so the callback can stop or restart it.  A
+    // timer that fell more than a period behind skips the missed runs.
+    if(t->period) {
+      t->expires += t->period;
+      if((s32)(t->expires - wheel_now) < 0) {
+        t->expires = wheel_now + t->period - 1;
+      }
+      wheel_add(t);
+    }
+    load_begin(&span);
+    t->fn(t->arg);
+    load_end(&span, (u32)t->fn);
+  }
+  running = 0;
+}
+
+static void
+timer_work_fn(void *arg)
+{
+  timer_run();
+}
+
+void
+init_timers()
+{
+  wheel_now = timebase_ms();
+  timebase_on_tick(&timer_work);
+}
+
+void
+timer_start(struct timer *t, u32 delay, u32 period)
+{
+  timer_stop(t);
+  if(delay > TIMER_MAX_MS) {
+    delay = TIMER_MAX_MS;
+  }
+  if(period > TIMER_MAX_MS) {
+    period = TIMER_MAX_MS;
+  }
+  t->expires = timebase_ms() + delay;
+  t->period = period;
+  t->due = delay;
+  wheel_add(t);
+}
+
+void
+timer_stop(struct timer *t)
+{
+  if(t->pprev) {
+    list_del(t);
+  }
+}
+
+int
+timer_pending(const struct timer *t)
+{
+  return t->pprev != NULL;
+}
+
+u32
+timer_next()
+{
+  u32 now = timebase_ms();
+  u32 ahead = wheel_now - now;
+  u32 i;
+
+  // Ticks waiting to be processed
+  if((s32)ahead <= 0) {
+    return 0;
+  }
+
+  // The first level holds exactly the timers of the next TV0_SIZE ticks;
+  // anything later waits for a cascade at the end of this turn at least
+  for(i=0; i<TV0_SIZE; i++) {
+    if(tv0[(wheel_now + i) & TV0_MASK]) {
+      return ahead + i;
+    }
+  }
+  return ahead + TV0_SIZE - (wheel_now & TV0_MASK);
+}
+
+void
+timer_set_deadline(struct timer *t, struct timer_deadline *d)
+{
+  struct timer_deadline **p = &deadlines;
+
+  t->rt = d;
+  while(*p && *p != d) {
+    p = &(*p)->next;
+  }
+  if(!*p) {
+    d->next = NULL;
+    *p = d;
+  }
+}
+
+const struct timer_deadline *
+timer_deadline(u32 n)
+{
+  const struct timer_deadline *d = deadlines;
+
+  while(d && n--) {
+    d = d->next;
+  }
+  return d;
+}
+
+const struct timer_stats *
+timer_stats()
+{
+  return &stats;
+}
+
+#if LWIP_TIMERS_CUSTOM
+
+// lwIP timeouts.  sys_timeout() takes a timer from a pool of
+// MEMP_NUM_SYS_TIMEOUT.
+
+struct sys_timer {
+  struct timer timer;
+  // NULL if the entry is free
+  sys_timeout_handler h;
+  void *arg;
+};
+
+static struct sys_timer sys_timers[MEMP_NUM_SYS_TIMEOUT];
+
+static void
+sys_timer_fn(void *arg)
+{
+  struct sys_timer *st = (struct sys_timer *)arg;
+  sys_timeout_handler h = st->h;
+  struct load_span span;
+
+  // Free the entry first so the handler can reuse it
+  st->h = NULL;
+  // Charged to the handler rather than to this for all of lwIP's
+  load_begin(&span);
+  h(st->arg);
+  load_end(&span, (u32)h);
+}
+
+void
+sys_timeout(u32_t msecs, sys_timeout_handler handler, void *arg)
+{
+  struct sys_timer *st;
+
+  for(st = sys_timers; st < &sys_timers[MEMP_NUM_SYS_TIMEOUT]; st++) {
+    if(!st->h) {
+      break;
+    }
+  }
+  if(st == &sys_timers[MEMP_NUM_SYS_TIMEOUT]) {
+    LWIP_ASSERT("sys_timeout: MEMP_NUM_SYS_TIMEOUT exhausted", 0);
+    return;
+  }
+
+  st->h = handler;
+  st->arg = arg;
+  st->timer.fn = sys_timer_fn;
+  st->timer.arg = st;
+  timer_start(&st->timer, msecs, 0);
+}
+
+void
+sys_untimeout(sys_timeout_handler handler, void *arg)
+{
+  struct sys_timer *st;
+
+  for(st = sys_timers; st < &sys_timers[MEMP_NUM_SYS_TIMEOUT]; st++) {
+    if(st->h == handler && st->arg == arg) {
+      timer_stop(&st->timer);
+      st->h = NULL;
+      return;
+    }
+  }
+}
+
+// Run one of lwIP's cyclic timers and rearm it
+static void
+cyclic_timer(void *arg)
+{
+  const struct lwip_cyclic_timer *cyclic =
+    (const struct lwip_cyclic_timer *)arg;
+
+  cyclic->handler();
+  sys_timeout(cyclic->interval_ms, cyclic_timer, arg);
+}
+
+void
+sys_timeouts_init(void)
+{
+  int i;
+
+  // With custom timers tcp_timer_needed() does nothing, so the TCP timer
+  // runs all the time like the others
+  for(i=0; i<lwip_num_cyclic_timers; i++) {
+    sys_timeout(lwip_cyclic_timers[i].interval_ms, cyclic_timer,
+        (void *)&lwip_cyclic_timers[i]);
+  }
+}
+
+void
+sys_check_timeouts(void)
+{
+  timer_run();
+}
+
+void
+sys_restart_timeouts(void)
+{
+  // Expiry times are absolute, so there is nothing to rebase
+}
+
+u32_t
+sys_timeouts_sleeptime(void)
+{
+  return timer_next();
+}
+
+#endif // LWIP_TIMERS_CUSTOM
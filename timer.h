@@ -0,0 +1,102 @@
+#ifndef _TIMER_H_
+#define _TIMER_H_
+
+// timer.h - Millisecond timers on a hierarchical timer wheel.
+//
+// Starting, stopping and expiring a timer are all O(1).  Expired timers'
+// callbacks run from the work queue, scheduled by the timebase tick, so
+// they are in the main context like everything else.  Timers must only be
+// started and stopped from the main context.
+//
+// Each expiry releases a job with a deadline, and the jobs released by
+// the ticks one timer_run() catches up on run earliest deadline first
+// rather than in the wheel's order, so that a timer with little slack
+// does not wait behind one with plenty.  A timer's deadline is the one
+// timer_set_deadline() gave it, in microseconds after its expiry, or else
+// its period, or for a one-shot the delay it was started with: a timer
+// that runs often or soon is in a hurry.  A timer with a deadline of its
+// own also records how late each run started after its expiry (the
+// jitter) and how many started past the deadline, for KATCP's ?timers
+// (katcp.h).  Misses against a deadline of its own or a period are
+// counted for all timers together; a one-shot without one cannot miss.
+
+#include "xil_types.h"
+
+// A timer's deadline and run record
+struct timer_deadline {
+  const char *name;
+  // Start by this long after the expiry
+  u32 deadline_us;
+  u32 runs;
+  u32 misses;
+  // How late runs started, in timer cycles: the last, the most, and all
+  // of them for the mean
+  u32 late;
+  u32 late_max;
+  u64 late_sum;
+  struct timer_deadline *next;
+};
+
+#define TIMER_DEADLINE_INIT(name, us) { (name), (us), 0, 0, 0, 0, 0, NULL }
+
+struct timer {
+  struct timer *next;
+  // Link pointing at this timer, NULL while stopped
+  struct timer **pprev;
+  // timebase_ms() the timer expires at
+  u32 expires;
+  // Milliseconds between expiries, 0 for one-shot
+  u32 period;
+  void (*fn)(void *arg);
+  void *arg;
+  // Until it expires, a one-shot's delay; then its place in the run order
+  u32 due;
+  // Its own deadline, or NULL
+  struct timer_deadline *rt;
+};
+
+#define TIMER_INIT(fn, arg) { NULL, NULL, 0, 0, (fn), (arg), 0, NULL }
+
+// Deadlines are capped at this for the run order, about 16 minutes, in
+// ms: all later ones are alike
+#define TIMER_DEADLINE_CAP_MS (1000000)
+
+struct timer_stats {
+  // Jobs run, and those that started past their deadline
+  u32 runs;
+  u32 misses;
+};
+
+// Longest delay or period (about 17 hours); longer ones are clamped
+#define TIMER_MAX_MS ((1 << 26) - (1 << 20))
+
+// Hook the wheel to the timebase tick.  Call after init_timebase().
+void init_timers();
+
+// Run `t` in `delay` ms, then every `period` ms (0 runs it once).
+// Restarts `t` if it is already running.
+void timer_start(struct timer *t, u32 delay, u32 period);
+
+// Stop `t`.  Safe to call from its own callback.
+void timer_stop(struct timer *t);
+
+// Returns non-zero if `t` is running
+int timer_pending(const struct timer *t);
+
+// Run the callbacks of timers that have expired
+void timer_run();
+
+// Upper bound on the milliseconds until the next timer expires
+u32 timer_next();
+
+// Give `t` the deadline and run record `d`, which names it for ?timers.
+// Takes effect from its next expiry.
+void timer_set_deadline(struct timer *t, struct timer_deadline *d);
+
+// Deadline `n` of those given, in the order they were, or NULL past the
+// last
+const struct timer_deadline *timer_deadline(u32 n);
+
+const struct timer_stats *timer_stats();
+
+#endif // _TIMER_H_
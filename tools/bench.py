@@ -0,0 +1,94 @@
+#!/usr/bin/env python3
+# bench.py - Run JAM's micro-benchmarks and print the results (see
+# bench.h).
+#
+# usage: bench.py [--csv] [board-ip]
+#
+# --csv prints one comma-separated line a result, with the raw cycle
+# counts, for comparing runs.  The UDP test's datagrams come back to this
+# host's discard port.
+
+import argparse
+import socket
+import struct
+
+BENCH_PORT = 7004
+BENCH_MAGIC = 0x31434e42
+HEADER = struct.Struct('<IIHHI')
+RESULT = struct.Struct('<BBBBIII')
+
+TARGETS = ['lmb', 'wishbone', 'spi', 'xadc', 'eth0']
+PATTERNS = ['read1', 'write1', 'read-seq', 'write-seq', 'read-fix',
+            'write-fix', 'copy-in', 'copy-out', 'alu', 'memcpy-in',
+            'memcpy-out', 'chksum', 'flash-read', 'snapshot', 'udp-send',
+            'driver', 'memcpy', 'mb-memcpy', 'memset', 'mb-memset',
+            'loopback']
+ALU = 8
+FLASH_MODES = ['read', 'fast', 'dual', 'dual-io', 'quad', 'quad-io']
+FLASH_READ = 12
+# Driver calls against the register reads they wrap; compare a CHECKED=1
+# build's results with a release build's for the cost of the asserts
+DRIVERS = ['adc-data', 'xadc-reg', 'min-max', 'spi-ss', 'spi-reg']
+DRIVER = 15
+# newlib's memcpy and mbmem.c's, by the source's offset past a word
+MEMCPY = (16, 17)
+
+
+def name(names, n):
+    return names[n] if n < len(names) else str(n)
+
+
+def main():
+    ap = argparse.ArgumentParser()
+    ap.add_argument('board', nargs='?', default='10.10.10.10')
+    ap.add_argument('--csv', action='store_true')
+    opts = ap.parse_args()
+
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.settimeout(5)
+    sock.sendto(b'\0', (opts.board, BENCH_PORT))
+    data, _ = sock.recvfrom(2048)
+    magic, hz, count, size, overhead = HEADER.unpack_from(data)
+    if magic != BENCH_MAGIC:
+        raise SystemExit('bad reply')
+
+    results = []
+    off = HEADER.size
+    for _ in range(count):
+        results.append(RESULT.unpack_from(data, off))
+        off += size
+
+    if opts.csv:
+        print('hz,%d,overhead,%d' % (hz, overhead))
+        print('target,pattern,width,arg,accesses,min_cycles,max_cycles')
+        for target, pattern, width, arg, n, lo, hi in results:
+            print('%s,%s,%d,%d,%d,%d,%d' % (
+                name(TARGETS, target), name(PATTERNS, pattern), width, arg,
+                n, lo, hi))
+        return
+
+    print('timer %d MHz, stamps take %d cycles' % (hz // 1000000, overhead))
+    print('%-8s %-10s %-7s %8s %10s %10s %10s %8s' % (
+        'target', 'pattern', 'width', 'accesses', 'min/acc', 'max/acc',
+        'ns/acc', 'MB/s'))
+    for target, pattern, width, arg, n, lo, hi in results:
+        mbps = '-'
+        # alu's "accesses" are instructions and driver's calls: min/acc is
+        # cycles per one
+        if n > 1 and lo and pattern not in (ALU, DRIVER):
+            mbps = '%.1f' % (n * width * hz / lo / 1e6)
+        label = name(PATTERNS, pattern)
+        if pattern == FLASH_READ:
+            label = 'flash-%s' % name(FLASH_MODES, arg)
+        elif pattern == DRIVER:
+            label = name(DRIVERS, arg)
+        elif pattern in MEMCPY:
+            label = '%s+%d' % (label, arg)
+        print('%-8s %-10s %-7s %8d %10.2f %10.2f %10.1f %8s' % (
+            name(TARGETS, target), label, 'u%d' % (8 * width)
+            if width <= 4 else '%dB' % width, n, lo / n, hi / n,
+            lo / n * 1e9 / hz, mbps))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,87 @@
+#!/usr/bin/env python3
+# blackbox.py - Print the blackbox event log (see bbox.h).
+#
+# usage: blackbox.py [board-ip] [--file blackbox.bin]
+#
+# Fetches the log with "tftp -m binary <board> -c get blackbox" unless
+# --file names one fetched already.  Records that are erased or fail
+# their CRC are skipped, and the rest printed in sequence order.
+
+import argparse
+import os
+import struct
+import subprocess
+import tempfile
+import time
+import zlib
+
+REC = struct.Struct('<IIIHHIIII')
+
+BOOT, ALARM, LINK, UPDATE, NOTE = 1, 2, 3, 4, 5
+RESETS = {0: 'power', 1: 'watchdog', 2: 'watchdog-timer', 3: 'crash'}
+LINKS = {0: 'down', 1: 'up', 2: 'unknown'}
+
+
+def fetch(board):
+    fd, path = tempfile.mkstemp(suffix='.bin')
+    os.close(fd)
+    try:
+        subprocess.run(['tftp', '-m', 'binary', board, '-c', 'get',
+                        'blackbox', path], check=True)
+        with open(path, 'rb') as f:
+            return f.read()
+    finally:
+        os.unlink(path)
+
+
+def records(data):
+    out = []
+    for off in range(0, len(data) - REC.size + 1, REC.size):
+        raw = data[off:off + REC.size]
+        if raw == b'\xff' * REC.size:
+            continue
+        r = REC.unpack(raw)
+        if zlib.crc32(raw[:-4]) != r[-1]:
+            continue
+        out.append(r)
+    return sorted(out, key=lambda r: r[0])
+
+
+def describe(kind, arg, a, b, c):
+    if kind == BOOT:
+        return 'boot %s version %d.%d bootsts %08x %s %08x' % (
+            RESETS.get(arg, arg), a >> 16, a & 0xffff, b,
+            'slot' if arg in (0, 2) else 'detail', c)
+    if kind == ALARM:
+        t = b - (1 << 32) if b & 0x80000000 else b
+        return 'alarm active %04x status %04x %.3f C' % (arg, a, t / 1e3)
+    if kind == LINK:
+        return 'link eth%d %s' % (arg, LINKS.get(a, a))
+    if kind == UPDATE:
+        return 'update slot %d %s %d bytes crc %08x' % (
+            arg, 'failed' if a else 'ok', b, c)
+    if kind == NOTE:
+        return 'note %d %08x %08x %08x' % (arg, a, b, c)
+    return 'type %d arg %d %08x %08x %08x' % (kind, arg, a, b, c)
+
+
+def main():
+    ap = argparse.ArgumentParser()
+    ap.add_argument('board', nargs='?', default='10.10.10.10')
+    ap.add_argument('--file')
+    opts = ap.parse_args()
+
+    if opts.file:
+        with open(opts.file, 'rb') as f:
+            data = f.read()
+    else:
+        data = fetch(opts.board)
+    for seq, utc_s, ms, kind, arg, a, b, c, _ in records(data):
+        when = (time.strftime('%Y-%m-%d %H:%M:%S', time.gmtime(utc_s))
+                if utc_s else '-')
+        print('%8d %19s %10d.%03d  %s' % (seq, when, ms // 1000, ms % 1000,
+                                         describe(kind, arg, a, b, c)))
+
+
+if __name__ == '__main__':
+    main()
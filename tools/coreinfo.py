@@ -0,0 +1,117 @@
+#!/usr/bin/env python3
+# coreinfo.py - Turn the gateware's core_info.tab into core_info.h.
+#
+# usage: coreinfo.py core_info.tab core_info.h [core_info.map]
+#
+# Each line of core_info.tab names one device behind the Wishbone bridge:
+#
+#   name  mode  offset  size
+#
+# with `mode` 1 (read only), 2 (write only) or 3 (read/write), plus 4 for
+# a device of configuration registers to mirror in BRAM (wbshadow.h) and 8
+# for one whose writes must reach the bus in order (wbpost.h), and
+# `offset` and `size` in hex bytes.  Blank lines and lines starting with
+# '#' are skipped.  The header defines CORE_<NAME>_OFFSET and CORE_<NAME>_SIZE
+# for each device, and CORE_INFO_TABLE, the initializer of wbmap.c's table,
+# sorted by name for binary search.
+#
+# With a third file it also writes the table in the binary format the
+# firmware loads from a slot (wbmap.h), to be appended to the bitstream:
+#
+#   cat top.bin core_info.map > image.bin
+
+import re
+import struct
+import sys
+import zlib
+
+NAME_MAX = 32  # WBMAP_NAME_MAX in wbmap.h, with the NUL
+NAME = re.compile(r'^[A-Za-z_][A-Za-z0-9_]*$')
+
+
+def parse(path):
+    devs = {}
+    with open(path) as f:
+        for num, line in enumerate(f, 1):
+            fields = line.split()
+            if not fields or fields[0].startswith('#'):
+                continue
+            where = '%s:%d' % (path, num)
+            if len(fields) != 4:
+                sys.exit('%s: expected "name mode offset size"' % where)
+            name, mode, offset, size = fields
+            if not NAME.match(name) or len(name) >= NAME_MAX:
+                sys.exit('%s: bad device name "%s"' % (where, name))
+            if name in devs:
+                sys.exit('%s: device "%s" listed twice' % (where, name))
+            try:
+                mode = int(mode)
+                offset = int(offset, 16)
+                size = int(size, 16)
+            except ValueError:
+                sys.exit('%s: bad number' % where)
+            if mode & 3 == 0 or mode & ~15:
+                sys.exit('%s: mode must be 1, 2 or 3, plus 4 to shadow '
+                         'and 8 to order' % where)
+            devs[name] = (mode, offset, size)
+    return devs
+
+
+# struct wbmap_rec and struct wbmap_trailer, little-endian
+WBMAP_MAGIC = 0x314d4257
+REC = struct.Struct('<IIHBx')
+TRAILER = struct.Struct('<IHHI')
+
+
+def binary(devs):
+    names = sorted(devs, key=lambda n: n.encode())
+    recs = b''
+    strings = b''
+    for name in names:
+        mode, offset, size = devs[name]
+        recs += REC.pack(offset, size, len(strings), mode)
+        strings += name.encode() + b'\0'
+    if len(names) > 0xffff or len(strings) > 0xffff:
+        sys.exit('too many devices for the binary table')
+    body = recs + strings
+    return body + TRAILER.pack(WBMAP_MAGIC, len(names), len(strings),
+                               zlib.crc32(body))
+
+
+def main():
+    if len(sys.argv) not in (3, 4):
+        sys.exit('usage: coreinfo.py core_info.tab core_info.h '
+                 '[core_info.map]')
+    src, dst = sys.argv[1:3]
+    devs = parse(src)
+    if len(sys.argv) == 4:
+        with open(sys.argv[3], 'wb') as f:
+            f.write(binary(devs))
+
+    out = []
+    out.append('#ifndef _CORE_INFO_H_')
+    out.append('#define _CORE_INFO_H_')
+    out.append('')
+    out.append('// core_info.h - Generated from %s by tools/coreinfo.py.' % src)
+    out.append('// Do not edit.')
+    out.append('')
+    for name in sorted(devs):
+        mode, offset, size = devs[name]
+        macro = 'CORE_' + name.upper()
+        out.append('#define %s_OFFSET (0x%x)' % (macro, offset))
+        out.append('#define %s_SIZE (0x%x)' % (macro, size))
+    out.append('')
+    # strcmp() order, the order wbmap_find() searches in
+    out.append('#define CORE_INFO_TABLE \\')
+    for name in sorted(devs, key=lambda n: n.encode()):
+        mode, offset, size = devs[name]
+        out.append('  { "%s", 0x%x, 0x%x, %d }, \\' % (name, offset, size, mode))
+    out.append('')
+    out.append('#endif // _CORE_INFO_H_')
+
+    with open(dst, 'w') as f:
+        f.write('\n'.join(out) + '\n')
+
+
+if __name__ == '__main__':
+    main()
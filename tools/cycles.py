@@ -0,0 +1,61 @@
+#!/usr/bin/env python3
+# cycles.py - Show where the stack's time goes, layer by layer (see
+# WBREG_OP_CYCLES in wbreg.h).
+#
+# usage: cycles.py [board-ip] [--interval SECONDS]
+#
+# Samples the counts twice and prints each layer's share of the interval.
+# "other" is everything outside the stack, idle time included.
+
+import argparse
+import socket
+import struct
+import time
+
+WBREG_PORT = 7000
+OP_CYCLES = 0x09
+HDR = struct.Struct('>IBBHI')
+LAYERS = ['other', 'netif-rx', 'ethernet', 'ip', 'udp', 'tcp', 'app',
+          'netif-tx']
+
+
+def sample(sock, board, ident):
+    sock.sendto(HDR.pack(ident, OP_CYCLES, 0, 0, 0), (board, WBREG_PORT))
+    while True:
+        data, _ = sock.recvfrom(2048)
+        rid, op, status, count, hz = HDR.unpack_from(data)
+        if rid == ident:
+            break
+    if status:
+        raise SystemExit('board has no cycle counts (status %d)' % status)
+    words = struct.unpack_from('>%dI' % (2 * count), data, HDR.size)
+    return hz, list(zip(words[0::2], words[1::2]))
+
+
+def main():
+    ap = argparse.ArgumentParser()
+    ap.add_argument('board', nargs='?', default='10.10.10.10')
+    ap.add_argument('--interval', type=float, default=1.0)
+    opts = ap.parse_args()
+
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.settimeout(2)
+    hz, before = sample(sock, opts.board, 1)
+    time.sleep(opts.interval)
+    _, after = sample(sock, opts.board, 2)
+
+    diff = [((c1 - c0) & 0xffffffff, (t1 - t0) & 0xffffffff)
+            for (c0, t0), (c1, t1) in zip(before, after)]
+    total = sum(t for _, t in diff) or 1
+    print('%-9s %10s %12s %7s %10s' % (
+        'layer', 'calls', 'cycles', 'share', 'cyc/call'))
+    for n, (calls, cycles) in enumerate(diff):
+        name = LAYERS[n] if n < len(LAYERS) else 'layer%d' % n
+        print('%-9s %10d %12d %6.1f%% %10s' % (
+            name, calls, cycles, 100.0 * cycles / total,
+            '%d' % (cycles // calls) if calls else '-'))
+    print('timer %d MHz, %.3f s sampled' % (hz // 1000000, total / hz))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,74 @@
+#!/usr/bin/env python3
+# discover.py - Find JAM boards with one broadcast probe (see discover.h).
+#
+# usage: discover.py [-b broadcast-address] [-t seconds] [-l]
+#
+# With -l, listen for the boards' periodic announcements instead.
+
+import argparse
+import socket
+import struct
+
+DISC_PORT = 7005
+DISC_ANNOUNCE_PORT = 7006
+DISC_PROBE = 0x3f4d414a
+DISC_MAGIC = 0x314d414a
+INFO = struct.Struct('<IHBx20sII6sH4s4s4sI8HI')
+
+FEATURES = ['wbreg', 'telemetry', 'log', 'wbblk', 'bench', 'katcp', 'wbeth', 'tftp']
+
+
+def show(data, seen):
+    if len(data) < INFO.size:
+        return
+    f = INFO.unpack_from(data)
+    magic, size, uid_len, serial, fw, gw, mac, features = f[:8]
+    ip, netmask, gwaddr, uptime = f[8:12]
+    ports = f[12:20]
+    mtu = f[20]
+    if magic != DISC_MAGIC or mac in seen:
+        return
+    seen.add(mac)
+    feat = ['%s:%d' % (name, ports[n]) if name != 'wbeth' else
+            '%s:0x%04x' % (name, ports[n])
+            for n, name in enumerate(FEATURES) if features & (1 << n)]
+    print('%-15s %s serial %s fw %d.%d gw %08x mtu %d up %ds' % (
+        socket.inet_ntoa(ip), ':'.join('%02x' % b for b in mac),
+        serial[:3 + uid_len].hex(), fw >> 16, fw & 0xffff, gw, mtu,
+        uptime // 1000))
+    print('                %s' % ' '.join(feat))
+
+
+def main():
+    ap = argparse.ArgumentParser()
+    ap.add_argument('-b', '--broadcast', default='255.255.255.255')
+    ap.add_argument('-t', '--timeout', type=float, default=1.0)
+    ap.add_argument('-l', '--listen', action='store_true')
+    opts = ap.parse_args()
+
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.setsockopt(socket.SOL_SOCKET, socket.SO_BROADCAST, 1)
+    # Room for every board's answer arriving at once
+    sock.setsockopt(socket.SOL_SOCKET, socket.SO_RCVBUF, 1 << 20)
+    if opts.listen:
+        sock.bind(('', DISC_ANNOUNCE_PORT))
+    else:
+        sock.sendto(struct.pack('<I', DISC_PROBE),
+                    (opts.broadcast, DISC_PORT))
+    sock.settimeout(opts.timeout)
+
+    seen = set()
+    while True:
+        try:
+            data, _ = sock.recvfrom(2048)
+        except socket.timeout:
+            if not opts.listen:
+                break
+            continue
+        show(data, seen)
+    if not opts.listen:
+        print('%d boards' % len(seen))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,92 @@
+#!/usr/bin/env python3
+# flashread.py - Read flash ranges back from boards, for backups and audits
+# (see flashrd.h).
+#
+# usage: flashread.py board-ip [board-ip ...] [--range addr:len ...]
+#                     [-o file] [--crc]
+#
+# Without --range the whole flash is read.  With one board -o writes the
+# ranges, one after another, to the file; with several each board's go to
+# <file>.<board>.  --crc prints the CRC-32 of each range instead of, or
+# as well as, saving it, to compare boards across a rack.
+
+import argparse
+import socket
+import struct
+import sys
+import zlib
+
+FLASHRD_PORT = 7014
+FLASHRD_ALL = 0xffffffff
+REQ = struct.Struct('>II')
+HDR = struct.Struct('>B3xII')
+STATUS = {0: 'ok', 1: 'out of range'}
+
+
+def recv_exact(sock, n):
+    buf = bytearray()
+    while len(buf) < n:
+        chunk = sock.recv(min(n - len(buf), 1 << 20))
+        if not chunk:
+            raise EOFError('connection closed after %d of %d bytes'
+                           % (len(buf), n))
+        buf += chunk
+    return bytes(buf)
+
+
+def read_ranges(board, ranges):
+    sock = socket.create_connection((board, FLASHRD_PORT), timeout=10)
+    sock.setsockopt(socket.SOL_SOCKET, socket.SO_RCVBUF, 1 << 20)
+    out = []
+    try:
+        # The requests queue on the board, so the reads go back to back
+        sock.sendall(b''.join(REQ.pack(a, n) for a, n in ranges))
+        for _ in ranges:
+            status, addr, n = HDR.unpack(recv_exact(sock, HDR.size))
+            if status:
+                raise IOError('%s: %s' % (board, STATUS.get(status, status)))
+            out.append((addr, recv_exact(sock, n)))
+    finally:
+        sock.close()
+    return out
+
+
+def parse_range(s):
+    a, _, n = s.partition(':')
+    return int(a, 0), int(n, 0) if n else FLASHRD_ALL
+
+
+def main():
+    ap = argparse.ArgumentParser()
+    ap.add_argument('boards', nargs='+')
+    ap.add_argument('--range', action='append', type=parse_range,
+                    help='addr:len, len to the end of the flash if left out')
+    ap.add_argument('-o', '--output')
+    ap.add_argument('--crc', action='store_true')
+    opts = ap.parse_args()
+
+    ranges = opts.range or [(0, FLASHRD_ALL)]
+    failed = 0
+    for board in opts.boards:
+        try:
+            got = read_ranges(board, ranges)
+        except (OSError, EOFError) as e:
+            print('%s: %s' % (board, e), file=sys.stderr)
+            failed += 1
+            continue
+        if opts.output:
+            path = opts.output
+            if len(opts.boards) > 1:
+                path = '%s.%s' % (opts.output, board)
+            with open(path, 'wb') as f:
+                for _, data in got:
+                    f.write(data)
+        if opts.crc or not opts.output:
+            for addr, data in got:
+                print('%s %08x %8x %08x' % (board, addr, len(data),
+                                            zlib.crc32(data)))
+    sys.exit(1 if failed else 0)
+
+
+if __name__ == '__main__':
+    main()
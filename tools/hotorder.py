@@ -0,0 +1,98 @@
+#!/usr/bin/env python3
+# hotorder.py - Turn the board's PC-sampling profile into the order the
+# linker lays out .text in (hotorder.ld, included by lscript.ld).
+#
+# usage: hotorder.py [-e executable.elf] [--nm mb-nm] [--cover PCT]
+#                    [--cold COUNT] [-o hotorder.ld] [board-ip]
+#
+# The functions that took --cover percent of the samples (see pcprof.py)
+# are listed hottest first, so that they sit together.  mb-ld relaxes a
+# call or branch whose target is within 32 KiB to one instruction, without
+# the imm prefix, and the hot paths' calls to each other are the ones that
+# count.  Each function is matched with its clones (.constprop, .isra,
+# .lto_priv) whatever their numbers, so the order survives rebuilds; one
+# that has since gone away or been renamed just matches nothing.  The
+# largest resident functions never sampled are listed as candidates for
+# an overlay (ovl.h).
+#
+# Profile the ELF given, with the load the order is for, then rebuild.
+
+import argparse
+import os
+import subprocess
+import sys
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+import pcprof  # noqa: E402
+
+
+def ovl_start(elf, nm):
+    out = subprocess.run([nm, elf], check=True, stdout=subprocess.PIPE,
+                         universal_newlines=True).stdout
+    for line in out.splitlines():
+        f = line.split()
+        if len(f) == 3 and f[2] == '__ovl_start':
+            return int(f[0], 16)
+    return None
+
+
+def main():
+    ap = argparse.ArgumentParser()
+    ap.add_argument('board', nargs='?', default='10.10.10.10')
+    ap.add_argument('-e', '--elf', default='executable.elf')
+    ap.add_argument('--nm', default='mb-nm')
+    ap.add_argument('--cover', type=float, default=99.0)
+    ap.add_argument('--cold', type=int, default=10)
+    ap.add_argument('-o', '--output', default='hotorder.ld')
+    opts = ap.parse_args()
+
+    prof = pcprof.fetch(opts.board)
+    syms = pcprof.load_symbols(opts.elf, opts.nm)
+    hits = pcprof.attribute(prof, syms)
+    if not prof['samples']:
+        raise SystemExit('no samples: start the profiler with "?prof start"')
+
+    # By the name in the source, a function's clones counted with it
+    base = {}
+    for name, count in hits.items():
+        if name.startswith('<'):
+            continue
+        name = name.split('.')[0]
+        base[name] = base.get(name, 0) + count
+    total = sum(hits.values())
+    order = []
+    seen = 0
+    for name, count in sorted(base.items(), key=lambda x: (-x[1], x[0])):
+        if seen >= total * opts.cover / 100:
+            break
+        order.append(name)
+        seen += count
+    size = {}
+    for _, ssize, name in syms:
+        size[name.split('.')[0]] = size.get(name.split('.')[0], 0) + ssize
+    hot_bytes = sum(size.get(n, 0) for n in order)
+
+    with open(opts.output, 'w') as f:
+        f.write('/* Hot functions, hottest first: written by tools/hotorder.py'
+                '\n   from %d samples of %s, %d functions of %d bytes over '
+                '%.1f%% of them. */\n' % (
+                    prof['samples'], os.path.basename(opts.elf), len(order),
+                    hot_bytes, 100.0 * seen / total))
+        for name in order:
+            f.write('*(.text.%s .text.%s.*)\n' % (name, name))
+    print('%s: %d functions, %d bytes, %.1f%% of %d samples' % (
+        opts.output, len(order), hot_bytes, 100.0 * seen / total,
+        prof['samples']))
+
+    end = ovl_start(opts.elf, opts.nm)
+    cold = [(ssize, name) for addr, ssize, name in syms
+            if (end is None or addr < end) and
+            name.split('.')[0] not in base]
+    if cold and opts.cold:
+        print('Largest resident functions never sampled:')
+        for ssize, name in sorted(cold, reverse=True)[:opts.cold]:
+            print('  %-32s %6d' % (name, ssize))
+
+
+if __name__ == '__main__':
+    main()
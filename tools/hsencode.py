@@ -0,0 +1,83 @@
+#!/usr/bin/env python3
+# hsencode.py - Compress an image for a compressed TFTP upload (see tftp.h),
+# in heatshrink's format with the board's window and length sizes
+# (heatshrink.h), for hosts without "heatshrink -e -w 8 -l 7".
+#
+# usage: hsencode.py image.bin image.hs
+
+import sys
+
+WINDOW_BITS = 8
+COUNT_BITS = 7
+WINDOW = 1 << WINDOW_BITS
+MAX_COUNT = 1 << COUNT_BITS
+# A back-reference costs more than literals below this length
+MIN_MATCH = 2
+
+
+class BitWriter:
+    def __init__(self):
+        self.out = bytearray()
+        self.acc = 0
+        self.nbits = 0
+
+    def put(self, value, n):
+        self.acc = (self.acc << n) | value
+        self.nbits += n
+        while self.nbits >= 8:
+            self.nbits -= 8
+            self.out.append((self.acc >> self.nbits) & 0xff)
+        self.acc &= (1 << self.nbits) - 1
+
+    def finish(self):
+        if self.nbits:
+            self.out.append((self.acc << (8 - self.nbits)) & 0xff)
+        return bytes(self.out)
+
+
+def longest_match(data, pos):
+    best_len, best_off = 0, 0
+    limit = min(MAX_COUNT, len(data) - pos)
+    for off in range(1, min(WINDOW, pos) + 1):
+        n = 0
+        # Matches may run into the bytes they produce
+        while n < limit and data[pos - off + n] == data[pos + n]:
+            n += 1
+        if n > best_len:
+            best_len, best_off = n, off
+            if n == limit:
+                break
+    return best_len, best_off
+
+
+def encode(data):
+    w = BitWriter()
+    pos = 0
+    while pos < len(data):
+        n, off = longest_match(data, pos)
+        if n >= MIN_MATCH:
+            w.put(0, 1)
+            w.put(off - 1, WINDOW_BITS)
+            w.put(n - 1, COUNT_BITS)
+            pos += n
+        else:
+            w.put(1, 1)
+            w.put(data[pos], 8)
+            pos += 1
+    return w.finish()
+
+
+def main():
+    if len(sys.argv) != 3:
+        raise SystemExit('usage: hsencode.py image.bin image.hs')
+    with open(sys.argv[1], 'rb') as f:
+        data = f.read()
+    out = encode(data)
+    with open(sys.argv[2], 'wb') as f:
+        f.write(out)
+    print('%d -> %d bytes (%.1fx)' % (len(data), len(out),
+                                     len(data) / max(len(out), 1)))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,73 @@
+#!/usr/bin/env python3
+# logdecode.py - Receive and format JAM's binary log (see log.h).
+#
+# usage: logdecode.py [-f executable.logfmt] [board-ip]
+#
+# Subscribes to the board's log by sending it a datagram on LOG_PORT, then
+# prints each entry with its format string from the .logfmt table that
+# "make" extracts next to the ELF.
+
+import argparse
+import re
+import socket
+import struct
+
+LOG_PORT = 7002
+LOG_MAGIC = 0x31474f4c
+HEADER = struct.Struct('<IIHHII')
+CONV = re.compile(r'%[-+ #0]*\d*(?:\.\d+)?[a-zA-Z%]')
+
+
+def load_formats(path):
+    with open(path, 'rb') as f:
+        return f.read()
+
+
+def format_entry(table, ident, args):
+    end = table.find(b'\0', ident)
+    if ident >= len(table) or end < 0:
+        return '<unknown message %#x> %s' % (ident, ' '.join(map(hex, args)))
+    fmt = table[ident:end].decode('ascii', 'replace')
+    vals = []
+    for conv in CONV.findall(fmt):
+        if conv == '%%':
+            continue
+        v = args[len(vals)] if len(vals) < len(args) else 0
+        # %d is signed on the board
+        if conv[-1] in 'di' and v & 0x80000000:
+            v -= 1 << 32
+        vals.append(v)
+    try:
+        return fmt % tuple(vals)
+    except (TypeError, ValueError):
+        return fmt + ' ' + ' '.join(map(hex, args))
+
+
+def main():
+    ap = argparse.ArgumentParser()
+    ap.add_argument('-f', '--formats', default='executable.logfmt')
+    ap.add_argument('board', nargs='?', default='10.10.10.10')
+    opts = ap.parse_args()
+
+    table = load_formats(opts.formats)
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.sendto(b'\0', (opts.board, LOG_PORT))
+
+    expect = None
+    while True:
+        data, _ = sock.recvfrom(2048)
+        magic, seq, count, size, hz, lost = HEADER.unpack_from(data)
+        if magic != LOG_MAGIC:
+            continue
+        if expect is not None and seq != expect:
+            print('-- %d entries missed' % ((seq - expect) & 0xffffffff))
+        expect = (seq + count) & 0xffffffff
+        off = HEADER.size
+        for _ in range(count):
+            time, ident, *args = struct.unpack_from('<II4I', data, off)
+            off += size
+            print('%12.6f %s' % (time / hz, format_entry(table, ident, args)))
+
+
+if __name__ == '__main__':
+    main()
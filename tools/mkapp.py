@@ -0,0 +1,97 @@
+#!/usr/bin/env python3
+# mkapp.py - Pack the firmware into an image for the bootloader (app.h).
+#
+# usage: mkapp.py [--objcopy mb-objcopy] [--objdump mb-objdump] [--nm mb-nm]
+#                 [--entry _start1] [--packed] [-o executable.app]
+#                 executable-bram.elf
+#
+# The image holds everything the ELF loads except the reset vector, which
+# stays the loader's, from the lowest address up.  With --packed it is
+# compressed with heatshrink (tools/hsencode.py), which the loader decodes
+# as it reads.  Write it into a spare
+# slot with, for instance, "tftp <board> -c put executable.app slot3" (see
+# tftp.h).  The golden image goes in the last 128 KB of slot 0 instead,
+# programmed along with the golden bitstream.
+
+import argparse
+import os
+import struct
+import subprocess
+import sys
+import tempfile
+import zlib
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+import hsencode  # noqa: E402
+
+APP_MAGIC = 0x31505041
+APP_BOOT_BASE = 0x1f000
+HEADER = struct.Struct('<IIIIII')
+
+
+def symbol(nm, elf, name):
+    for line in subprocess.check_output([nm, elf]).decode().splitlines():
+        f = line.split()
+        if len(f) == 3 and f[2] == name:
+            return int(f[0], 16)
+    raise SystemExit('%s: no %s' % (elf, name))
+
+
+def lowest(objdump, elf):
+    # Lowest address loaded but the reset vector's, from the section
+    # headers: a line with the name and addresses, one with the flags
+    out = subprocess.check_output([objdump, '-h', elf]).decode()
+    lines = out.splitlines()
+    addrs = []
+    for sec, flags in zip(lines, lines[1:]):
+        f = sec.split()
+        if (len(f) == 7 and f[1] != '.vectors.reset' and
+                'LOAD' in flags and int(f[2], 16)):
+            addrs.append(int(f[4], 16))
+    if not addrs:
+        raise SystemExit('%s: nothing to load' % elf)
+    return min(addrs)
+
+
+def image(objcopy, elf):
+    with tempfile.TemporaryDirectory() as d:
+        out = os.path.join(d, 'app.bin')
+        subprocess.check_call([objcopy, '-O', 'binary',
+                               '--remove-section=.vectors.reset', elf, out])
+        with open(out, 'rb') as f:
+            return f.read()
+
+
+def main():
+    ap = argparse.ArgumentParser()
+    ap.add_argument('--objcopy', default='mb-objcopy')
+    ap.add_argument('--objdump', default='mb-objdump')
+    ap.add_argument('--nm', default='mb-nm')
+    ap.add_argument('--entry', default='_start1')
+    ap.add_argument('--packed', action='store_true')
+    ap.add_argument('-o', '--output', default='executable.app')
+    ap.add_argument('elf')
+    opts = ap.parse_args()
+
+    data = image(opts.objcopy, opts.elf)
+    load = lowest(opts.objdump, opts.elf)
+    entry = symbol(opts.nm, opts.elf, opts.entry)
+    if load + len(data) > APP_BOOT_BASE:
+        raise SystemExit('%s: %d bytes at %#x run into the bootloader' %
+                         (opts.elf, len(data), load))
+    if not load <= entry < load + len(data):
+        raise SystemExit('%s: entry %#x is outside the image' %
+                         (opts.elf, entry))
+    stored = hsencode.encode(data) if opts.packed else data
+    head = HEADER.pack(APP_MAGIC, len(data), load, entry, zlib.crc32(data),
+                       len(stored) if opts.packed else 0)
+    out = head + struct.pack('<I', zlib.crc32(head)) + stored
+    with open(opts.output, 'wb') as f:
+        f.write(out)
+    print('%s: %d bytes at %#x, entry %#x%s' % (
+        opts.output, len(data), load, entry,
+        ', %d compressed' % len(stored) if opts.packed else ''))
+
+
+if __name__ == '__main__':
+    main()
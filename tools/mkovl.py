@@ -0,0 +1,65 @@
+#!/usr/bin/env python3
+# mkovl.py - Pack the firmware's overlays into an image for ovl.h.
+#
+# usage: mkovl.py [--objcopy mb-objcopy] [--nm mb-nm] [-o executable.ovl]
+#                 executable.elf name...
+#
+# Each name is an overlay, section .ovl_<name> of the ELF, in the order of
+# their OVL_* numbers.  Write the image into a spare slot, for instance
+# with "tftp <board> -c put executable.ovl slot3" (see tftp.h); it has to
+# come from the same build as the firmware running.
+
+import argparse
+import os
+import struct
+import subprocess
+import tempfile
+import zlib
+
+OVL_MAGIC = 0x314c564f
+HEADER = struct.Struct('<IIII')
+ENTRY = struct.Struct('<III')
+
+
+def section(objcopy, elf, name):
+    with tempfile.TemporaryDirectory() as d:
+        out = os.path.join(d, name + '.bin')
+        subprocess.check_call([objcopy, '-O', 'binary',
+                               '--only-section=.ovl_' + name, elf, out])
+        with open(out, 'rb') as f:
+            return f.read()
+
+
+def window(nm, elf):
+    for line in subprocess.check_output([nm, elf]).decode().splitlines():
+        f = line.split()
+        if len(f) == 3 and f[2] == '__ovl_start':
+            return int(f[0], 16)
+    raise SystemExit('%s: no __ovl_start' % elf)
+
+
+def main():
+    ap = argparse.ArgumentParser()
+    ap.add_argument('--objcopy', default='mb-objcopy')
+    ap.add_argument('--nm', default='mb-nm')
+    ap.add_argument('-o', '--output', default='executable.ovl')
+    ap.add_argument('elf')
+    ap.add_argument('names', nargs='+')
+    opts = ap.parse_args()
+
+    code = [section(opts.objcopy, opts.elf, n) for n in opts.names]
+    off = HEADER.size + ENTRY.size * len(code)
+    entries = b''
+    for c in code:
+        entries += ENTRY.pack(off, len(c), zlib.crc32(c))
+        off += len(c)
+    out = HEADER.pack(OVL_MAGIC, len(code), off,
+                      window(opts.nm, opts.elf)) + entries + b''.join(code)
+    with open(opts.output, 'wb') as f:
+        f.write(out)
+    print('%s: %s, %d bytes' % (opts.output, ', '.join(
+        '%s %d' % (n, len(c)) for n, c in zip(opts.names, code)), len(out)))
+
+
+if __name__ == '__main__':
+    main()
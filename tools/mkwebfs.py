@@ -0,0 +1,81 @@
+#!/usr/bin/env python3
+# mkwebfs.py - Build a web UI image for webfs.h from a directory of files.
+#
+# usage: mkwebfs.py [-o webfs.img] directory
+#
+# Every file is stored under its path from `directory` ("/index.html"),
+# with its HTTP response headers in front.  Content that gzip shrinks is
+# stored gzip'd, and served so whether or not the browser asked for it;
+# every current browser accepts it.  The headers are HTTP/1.1 with a
+# Content-Length, so the connection stays open for the next request.  Write the
+# image into a spare slot, for instance with
+# "tftp <board> -c put webfs.img slot2" (see tftp.h).
+
+import argparse
+import gzip
+import os
+import struct
+import zlib
+
+WEBFS_MAGIC = 0x31534657
+HEADER = struct.Struct('<IIII')
+ENTRY = struct.Struct('<IIII')
+
+TYPES = {
+    '.html': 'text/html', '.htm': 'text/html', '.css': 'text/css',
+    '.js': 'application/javascript', '.json': 'application/json',
+    '.svg': 'image/svg+xml', '.png': 'image/png', '.gif': 'image/gif',
+    '.jpg': 'image/jpeg', '.ico': 'image/x-icon', '.txt': 'text/plain',
+}
+
+
+def response(name, body):
+    status = '404 File not found' if name.startswith('/404.') else '200 OK'
+    ctype = TYPES.get(os.path.splitext(name)[1].lower(),
+                      'application/octet-stream')
+    hdr = ['HTTP/1.1 %s' % status, 'Server: jam',
+           'Content-Type: %s' % ctype]
+    packed = gzip.compress(body, 9, mtime=0)
+    if len(packed) < len(body):
+        body = packed
+        hdr.append('Content-Encoding: gzip')
+    hdr.append('Content-Length: %d' % len(body))
+    return ('\r\n'.join(hdr) + '\r\n\r\n').encode() + body
+
+
+def main():
+    ap = argparse.ArgumentParser()
+    ap.add_argument('-o', '--output', default='webfs.img')
+    ap.add_argument('directory')
+    opts = ap.parse_args()
+
+    files = []
+    for root, _, names in os.walk(opts.directory):
+        for n in sorted(names):
+            path = os.path.join(root, n)
+            name = '/' + os.path.relpath(path, opts.directory).replace(
+                os.sep, '/')
+            with open(path, 'rb') as f:
+                files.append((name, response(name, f.read())))
+    files.sort()
+
+    names = b''
+    data = b''
+    base = HEADER.size + ENTRY.size * len(files)
+    entries = []
+    for name, body in files:
+        entries.append((name, base + len(names), len(data), len(body)))
+        names += name.encode() + b'\0'
+        data += body
+
+    out = b''.join(ENTRY.pack(zlib.crc32(n.encode()), off,
+                              base + len(names) + d, size)
+                   for n, off, d, size in entries) + names + data
+    out = HEADER.pack(WEBFS_MAGIC, len(files), HEADER.size + len(out), 0) + out
+    with open(opts.output, 'wb') as f:
+        f.write(out)
+    print('%s: %d files, %d bytes' % (opts.output, len(files), len(out)))
+
+
+if __name__ == '__main__':
+    main()
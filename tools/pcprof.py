@@ -0,0 +1,105 @@
+#!/usr/bin/env python3
+# pcprof.py - Fetch the board's PC-sampling profile and show where the time
+# goes, function by function (see pcprof.h).
+#
+# usage: pcprof.py [-e executable.elf] [--nm mb-nm] [-n COUNT] [board-ip]
+#
+# Reads the histogram from PCPROF_PORT and the symbols of the ELF with nm.
+# A bin is 64 bytes, so a bin shared by two functions is split between
+# them by the bytes each has in it.  Start sampling first with KATCP's
+# "?prof start".
+
+import argparse
+import bisect
+import socket
+import struct
+import subprocess
+
+PCPROF_PORT = 7007
+PCPROF_MAGIC = 0x31465250
+HEADER = struct.Struct('<IHHIHHIIIBBH')
+
+
+def fetch(board):
+    sock = socket.create_connection((board, PCPROF_PORT), timeout=5)
+    data = b''
+    while True:
+        chunk = sock.recv(65536)
+        if not chunk:
+            break
+        data += chunk
+    sock.close()
+    (magic, version, hsize, base, shift, nbins, hz, samples, other,
+     scale, running, _) = HEADER.unpack_from(data)
+    if magic != PCPROF_MAGIC:
+        raise SystemExit('not a profile (magic %#x)' % magic)
+    bins = struct.unpack_from('<%dH' % nbins, data, hsize)
+    return dict(version=version, base=base, shift=shift, hz=hz,
+                samples=samples, other=other, scale=scale, running=running,
+                bins=bins)
+
+
+def load_symbols(elf, nm):
+    out = subprocess.run([nm, '-n', '-S', '--defined-only', elf],
+                         check=True, stdout=subprocess.PIPE,
+                         universal_newlines=True).stdout
+    syms = []
+    for line in out.splitlines():
+        f = line.split()
+        if len(f) == 4 and f[2] in 'tTwW':
+            syms.append((int(f[0], 16), int(f[1], 16), f[3]))
+    return syms
+
+
+def attribute(prof, syms):
+    """Samples by function, a bin shared by several split by their bytes"""
+    starts = [s[0] for s in syms]
+    size = 1 << prof['shift']
+
+    hits = {}
+    for n, count in enumerate(prof['bins']):
+        if not count:
+            continue
+        lo = prof['base'] + n * size
+        hi = lo + size
+        i = max(bisect.bisect_right(starts, lo) - 1, 0)
+        shares = []
+        while i < len(syms) and syms[i][0] < hi:
+            addr, ssize, name = syms[i]
+            overlap = min(hi, addr + ssize) - max(lo, addr)
+            if overlap > 0:
+                shares.append((name, overlap))
+            i += 1
+        covered = sum(o for _, o in shares) or 1
+        if not shares:
+            shares = [('<%#x>' % lo, 1)]
+        for name, overlap in shares:
+            hits[name] = hits.get(name, 0) + count * overlap / covered
+    return hits
+
+
+def main():
+    ap = argparse.ArgumentParser()
+    ap.add_argument('board', nargs='?', default='10.10.10.10')
+    ap.add_argument('-e', '--elf', default='executable.elf')
+    ap.add_argument('--nm', default='mb-nm')
+    ap.add_argument('-n', '--count', type=int, default=30)
+    opts = ap.parse_args()
+
+    prof = fetch(opts.board)
+    syms = load_symbols(opts.elf, opts.nm)
+    hits = attribute(prof, syms)
+
+    total = sum(hits.values()) or 1
+    print('%7s %10s  %s' % ('share', 'samples', 'function'))
+    for name, count in sorted(hits.items(), key=lambda x: -x[1])[
+            :opts.count]:
+        print('%6.2f%% %10d  %s' % (100.0 * count / total,
+                                    count * (1 << prof['scale']), name))
+    print('%d samples at %d Hz (%.1f s), %d outside memory, %s' % (
+        prof['samples'], prof['hz'], prof['samples'] / prof['hz'],
+        prof['other'], 'running' if prof['running'] else 'stopped'))
+
+
+if __name__ == '__main__':
+    main()
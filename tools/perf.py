@@ -0,0 +1,69 @@
+#!/usr/bin/env python3
+# perf.py - Show the cycle counts of the firmware's instrumented code paths
+# (see perf.h and WBREG_OP_PERF in wbreg.h).
+#
+# usage: perf.py [board-ip] [--clear] [--hist]
+#
+# Prints each site's passes and min/mean/max time, and with --hist its
+# log2 histogram.  --clear zeroes the counts once read.
+
+import argparse
+import socket
+import struct
+
+WBREG_PORT = 7000
+OP_PERF = 0x0c
+HDR = struct.Struct('>IBBHI')
+BUCKETS = 32
+SITE = struct.Struct('>5I%dI' % BUCKETS)
+SITES = ['spi', 'eth-tx', 'chksum', 'wbreg', 'tick-latency',
+         'tick-jitter']
+
+
+def fetch(board, clear):
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.settimeout(2)
+    sock.sendto(HDR.pack(1, OP_PERF, 0, 0, 1 if clear else 0),
+                (board, WBREG_PORT))
+    data, _ = sock.recvfrom(4096)
+    _, _, status, count, hz = HDR.unpack_from(data)
+    if status:
+        raise SystemExit('board has no perf counts (status %d)' % status)
+    sites = [SITE.unpack_from(data, HDR.size + n * SITE.size)
+             for n in range(count)]
+    return hz, sites
+
+
+def fmt_us(cycles, hz):
+    return '%.2f' % (1e6 * cycles / hz)
+
+
+def main():
+    ap = argparse.ArgumentParser()
+    ap.add_argument('board', nargs='?', default='10.10.10.10')
+    ap.add_argument('--clear', action='store_true')
+    ap.add_argument('--hist', action='store_true')
+    opts = ap.parse_args()
+
+    hz, sites = fetch(opts.board, opts.clear)
+    print('%-8s %10s %10s %10s %10s' % (
+        'site', 'passes', 'min us', 'mean us', 'max us'))
+    for n, s in enumerate(sites):
+        count, lo, hi, sum_hi, sum_lo = s[:5]
+        name = SITES[n] if n < len(SITES) else 'site%d' % n
+        total = (sum_hi << 32) | sum_lo
+        if not count:
+            print('%-8s %10d %10s %10s %10s' % (name, 0, '-', '-', '-'))
+            continue
+        print('%-8s %10d %10s %10s %10s' % (
+            name, count, fmt_us(lo, hz), fmt_us(total / count, hz),
+            fmt_us(hi, hz)))
+        if opts.hist:
+            for b, c in enumerate(s[5:]):
+                if c:
+                    print('    >= %10d cycles %10d' % (1 << b if b else 0, c))
+    print('timer %d MHz' % (hz // 1000000))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,112 @@
+#!/usr/bin/env python3
+# preset.py - Assemble a register preset script for the firmware (preset.h).
+#
+# usage: preset.py [--set n | --exec | -o script.bin] script.txt
+#
+# The script is text, one step a line, '#' to the end of a line being a
+# comment.  Numbers are decimal or 0x-prefixed hex, addresses byte offsets
+# into the Wishbone window:
+#
+#   write addr value
+#   rmw addr mask value
+#   poll addr mask value timeout-ms
+#   delay us
+#   block addr value ...
+#   next n
+#
+# With --set or --exec it prints the KATCP request that stores the script
+# or runs it once, escaped, e.g. for "nc <board> 7147"; with -o it writes
+# the bytecode.
+
+import argparse
+import struct
+import sys
+
+OPS = {
+    'write': (0x01, 2),
+    'rmw': (0x02, 3),
+    'poll': (0x03, 4),
+    'delay': (0x04, 1),
+    'block': (0x05, None),
+    'next': (0x06, 1),
+}
+PRESET_MAX = 4
+PRESET_MAX_LEN = 240
+BLOCK_MAX = 255
+ESCAPES = {0x5c: b'\\\\', 0x20: b'\\_', 0x00: b'\\0', 0x0a: b'\\n',
+           0x0d: b'\\r', 0x1b: b'\\e', 0x09: b'\\t'}
+
+
+def step(words, where):
+    name = words[0].lower()
+    if name not in OPS:
+        raise SystemExit('%s: unknown step %s' % (where, words[0]))
+    op, argc = OPS[name]
+    try:
+        args = [int(w, 0) for w in words[1:]]
+    except ValueError:
+        raise SystemExit('%s: bad number' % where)
+    if argc is not None and len(args) != argc:
+        raise SystemExit('%s: %s takes %d arguments' % (where, name, argc))
+    if name == 'next':
+        if not 0 <= args[0] < PRESET_MAX:
+            raise SystemExit('%s: no script %d' % (where, args[0]))
+        return struct.pack('<BB', op, args[0])
+    if name != 'delay' and args[0] & 3:
+        raise SystemExit('%s: address %#x is not word aligned' %
+                         (where, args[0]))
+    if name == 'block':
+        if not 2 <= len(args) <= BLOCK_MAX + 1:
+            raise SystemExit('%s: block takes an address and 1 to %d words'
+                             % (where, BLOCK_MAX))
+        return struct.pack('<BIB%dI' % (len(args) - 1), op, args[0],
+                           len(args) - 1, *args[1:])
+    if name == 'poll':
+        return struct.pack('<BIIIH', op, *args)
+    return struct.pack('<B%dI' % len(args), op, *args)
+
+
+def assemble(f, name):
+    out = b''
+    for n, line in enumerate(f, 1):
+        words = line.split('#', 1)[0].split()
+        if words:
+            out += step(words, '%s:%d' % (name, n))
+    if len(out) > PRESET_MAX_LEN:
+        raise SystemExit('%s: %d bytes, more than %d: split it with next' %
+                         (name, len(out), PRESET_MAX_LEN))
+    return out
+
+
+def escape(data):
+    if not data:
+        return b'\\@'
+    return b''.join(ESCAPES.get(c, bytes([c])) for c in data)
+
+
+def main():
+    ap = argparse.ArgumentParser()
+    g = ap.add_mutually_exclusive_group(required=True)
+    g.add_argument('--set', type=int, metavar='N')
+    g.add_argument('--exec', action='store_true')
+    g.add_argument('-o', '--output')
+    ap.add_argument('script')
+    opts = ap.parse_args()
+
+    with open(opts.script) as f:
+        code = assemble(f, opts.script)
+    if opts.output:
+        with open(opts.output, 'wb') as f:
+            f.write(code)
+        return
+    if opts.set is not None:
+        if not 0 <= opts.set < PRESET_MAX:
+            raise SystemExit('no script %d' % opts.set)
+        req = b'?preset set %d ' % opts.set
+    else:
+        req = b'?preset exec '
+    sys.stdout.buffer.write(req + escape(code) + b'\n')
+
+
+if __name__ == '__main__':
+    main()
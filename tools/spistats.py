@@ -0,0 +1,49 @@
+#!/usr/bin/env python3
+# spistats.py - Show the SPI core's transfer and error counts (see
+# struct spi_stats in spi.h and WBREG_OP_SPI in wbreg.h).
+#
+# usage: spistats.py [board-ip] [--clear]
+#
+# --clear zeroes the counts once read.
+
+import argparse
+import socket
+import struct
+
+WBREG_PORT = 7000
+OP_SPI = 0x0d
+HDR = struct.Struct('>IBBHI')
+STATS = struct.Struct('>8I')
+
+
+def fetch(board, clear):
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.settimeout(2)
+    sock.sendto(HDR.pack(1, OP_SPI, 0, 0, 1 if clear else 0),
+                (board, WBREG_PORT))
+    data, _ = sock.recvfrom(4096)
+    _, _, status, _, hz = HDR.unpack_from(data)
+    if status:
+        raise SystemExit('board has no SPI counts (status %d)' % status)
+    return hz, STATS.unpack_from(data, HDR.size)
+
+
+def main():
+    ap = argparse.ArgumentParser()
+    ap.add_argument('board', nargs='?', default='10.10.10.10')
+    ap.add_argument('--clear', action='store_true')
+    opts = ap.parse_args()
+
+    hz, s = fetch(opts.board, opts.clear)
+    xfers, nbytes, timeouts, overruns, mode_faults, polls, hi, lo = s
+    print('transfers   %10d' % xfers)
+    print('bytes       %10d' % nbytes)
+    print('polls       %10d' % polls)
+    print('timeouts    %10d' % timeouts)
+    print('overruns    %10d' % overruns)
+    print('mode faults %10d' % mode_faults)
+    print('busy        %10.3f ms' % (1e3 * ((hi << 32) | lo) / hz))
+
+
+if __name__ == '__main__':
+    main()
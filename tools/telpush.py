@@ -0,0 +1,114 @@
+#!/usr/bin/env python3
+# telpush.py - Receive the boards' pushed telemetry and print each sample
+# (see telpush.h).
+#
+# usage: telpush.py [-p PORT] [-g GROUP] [--fields]
+#
+# Listens on PORT (7012), joining multicast GROUP if given, and prints a
+# line per sample: the board, its timebase ms and every field.  Point a
+# board at it with KATCP's "?telpush 0 collector-ip" (or the group).
+# Datagrams before a board's first keyframe, and after one that went
+# missing, cannot be decoded and are skipped until the next keyframe.
+# Those the board held through an outage and sent late are decoded as a
+# run of their own and marked "late".
+
+import argparse
+import socket
+import struct
+
+TELPUSH_PORT = 7012
+TELPUSH_MAGIC = 0x31555054
+TELPUSH_KEY = 0x01
+TELPUSH_BACKFILL = 0x02
+HEADER = struct.Struct('<IBBHBBBBHHI')
+
+
+def varints(data, off):
+    while off < len(data):
+        v = shift = 0
+        while True:
+            b = data[off]
+            off += 1
+            v |= (b & 0x7f) << shift
+            shift += 7
+            if not b & 0x80:
+                break
+        # Zigzag back to a signed difference
+        yield (v >> 1) ^ -(v & 1)
+
+
+def field_names(channels, cores, counters, pools):
+    names = ['xadc%d' % i for i in range(channels)]
+    for c in range(cores):
+        names.append('eth%d.link' % c)
+        names += ['eth%d.c%d' % (c, k) for k in range(counters)]
+    names += ['pool%d.max' % i for i in range(pools)]
+    return names + ['busy', 'stalls']
+
+
+class Board:
+    def __init__(self):
+        self.last = None
+        self.seq = None
+
+
+def decode(board, data):
+    (magic, version, flags, seq, channels, cores, counters, pools, samples,
+     sample_ms, time_ms) = HEADER.unpack_from(data)
+    if magic != TELPUSH_MAGIC:
+        return None
+    nfields = channels + cores * (1 + counters) + pools + 2
+    if flags & TELPUSH_KEY:
+        board.last = [0] * nfields
+    elif (board.last is None or board.seq is None or
+          seq != (board.seq + 1) & 0xffff):
+        board.last = None
+    board.seq = seq
+    if board.last is None:
+        return None
+    deltas = list(varints(data, HEADER.size))
+    out = []
+    for s in range(samples):
+        row = deltas[s * nfields:(s + 1) * nfields]
+        board.last = [(a + d) & 0xffffffff for a, d in zip(board.last, row)]
+        out.append((time_ms + s * sample_ms, list(board.last)))
+    return field_names(channels, cores, counters, pools), out
+
+
+def main():
+    ap = argparse.ArgumentParser()
+    ap.add_argument('-p', '--port', type=int, default=TELPUSH_PORT)
+    ap.add_argument('-g', '--group', help='multicast group to join')
+    ap.add_argument('--fields', action='store_true',
+                    help='print the field names once')
+    opts = ap.parse_args()
+
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    sock.bind(('', opts.port))
+    if opts.group:
+        mreq = socket.inet_aton(opts.group) + socket.inet_aton('0.0.0.0')
+        sock.setsockopt(socket.IPPROTO_IP, socket.IP_ADD_MEMBERSHIP, mreq)
+
+    # Live and late runs of each board
+    boards = {}
+    shown = False
+    while True:
+        data, (addr, _) = sock.recvfrom(2048)
+        if len(data) < HEADER.size:
+            continue
+        late = bool(data[5] & TELPUSH_BACKFILL)
+        r = decode(boards.setdefault((addr, late), Board()), data)
+        if not r:
+            continue
+        names, rows = r
+        if opts.fields and not shown:
+            print('board ms ' + ' '.join(names))
+            shown = True
+        for ms, values in rows:
+            print('%s %d %s%s' % (addr, ms, ' '.join(str(v) for v in values),
+                                  ' late' if late else ''))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,123 @@
+#!/usr/bin/env python3
+# uartcmd.py - Script JAM over its UART in the binary mode of uartcmd.h.
+#
+# usage: uartcmd.py [--port DEV] peek addr [count]
+#        uartcmd.py [--port DEV] poke addr value ...
+#        uartcmd.py [--port DEV] stats
+#        uartcmd.py [--port DEV] get key
+#        uartcmd.py [--port DEV] set key [hex]
+#
+# Needs pyserial.  The baud rate is the gateware's (XPAR_UARTLITE_0_BAUDRATE)
+# and defaults to 9600.  Console output between frames is skipped.
+
+import argparse
+import struct
+import sys
+import zlib
+
+END, ESC, ESC_END, ESC_ESC = 0xc0, 0xdb, 0xdc, 0xdd
+OP_PEEK, OP_POKE, OP_STATS, OP_BENCH, OP_GET, OP_SET = range(1, 7)
+OP_REPLY = 0x80
+STATUS = ['ok', 'invalid request', 'bad address', 'busy', 'not set']
+STATS = struct.Struct('<7I')
+STATS_NAMES = ['uptime-ms', 'stalls', 'longest-us', 'tx-dropped',
+               'rx-dropped', 'frames', 'bad-frames']
+
+
+def slip(data):
+    out = bytearray([END])
+    for c in data:
+        if c == END:
+            out += bytes([ESC, ESC_END])
+        elif c == ESC:
+            out += bytes([ESC, ESC_ESC])
+        else:
+            out.append(c)
+    out.append(END)
+    return bytes(out)
+
+
+def read_frame(ser):
+    # Skip to an END, then collect up to the next
+    while True:
+        c = ser.read(1)
+        if not c:
+            raise SystemExit('no reply')
+        if c[0] == END:
+            break
+    data = bytearray()
+    esc = False
+    while True:
+        c = ser.read(1)
+        if not c:
+            raise SystemExit('reply cut short')
+        c = c[0]
+        if c == END:
+            return bytes(data)
+        if esc:
+            c = {ESC_END: END, ESC_ESC: ESC}.get(c, c)
+            esc = False
+        elif c == ESC:
+            esc = True
+            continue
+        data.append(c)
+
+
+def request(ser, op, data, seq):
+    body = struct.pack('<BBBB', op, seq, 0, 0) + data
+    ser.write(slip(body + struct.pack('<I', zlib.crc32(body))))
+    for _ in range(8):
+        frame = read_frame(ser)
+        if len(frame) < 8:
+            continue
+        body, crc = frame[:-4], struct.unpack('<I', frame[-4:])[0]
+        if zlib.crc32(body) != crc:
+            raise SystemExit('bad reply CRC')
+        rop, rseq, status, _ = struct.unpack_from('<BBBB', body)
+        if rop == op | OP_REPLY and rseq == seq:
+            if status:
+                raise SystemExit(STATUS[status] if status < len(STATUS)
+                                 else 'status %d' % status)
+            return body[4:]
+    raise SystemExit('no reply')
+
+
+def number(s):
+    return int(s, 0)
+
+
+def main():
+    ap = argparse.ArgumentParser()
+    ap.add_argument('--port', default='/dev/ttyUSB1')
+    ap.add_argument('--baud', type=int, default=9600)
+    ap.add_argument('cmd', choices=['peek', 'poke', 'stats', 'get', 'set'])
+    ap.add_argument('args', nargs='*')
+    opts = ap.parse_args()
+
+    import serial
+    ser = serial.Serial(opts.port, opts.baud, timeout=2)
+    seq = 1
+    a = opts.args
+
+    if opts.cmd == 'peek':
+        addr, count = number(a[0]), number(a[1]) if len(a) > 1 else 1
+        data = request(ser, OP_PEEK, struct.pack('<II', addr, count), seq)
+        for i, (w,) in enumerate(struct.iter_unpack('<I', data)):
+            print('%08x: %08x' % (addr + 4 * i, w))
+    elif opts.cmd == 'poke':
+        words = [number(x) for x in a]
+        request(ser, OP_POKE, struct.pack('<%dI' % len(words), *words), seq)
+    elif opts.cmd == 'stats':
+        data = request(ser, OP_STATS, b'', seq)
+        for n, v in zip(STATS_NAMES, STATS.unpack_from(data)):
+            print('%-11s %d' % (n, v))
+    elif opts.cmd == 'get':
+        data = request(ser, OP_GET, bytes([number(a[0])]), seq)
+        print(data.hex())
+    else:
+        value = bytes.fromhex(a[1]) if len(a) > 1 else b''
+        request(ser, OP_SET, bytes([number(a[0])]) + value, seq)
+
+
+if __name__ == '__main__':
+    sys.exit(main())
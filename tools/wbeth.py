@@ -0,0 +1,88 @@
+#!/usr/bin/env python3
+# wbeth.py - Peek and poke registers over raw Ethernet (see wbeth.h).
+#
+# usage: wbeth.py IFACE read ADDR [COUNT] [--pack]
+#        wbeth.py IFACE write ADDR VALUE...
+#
+# Needs a raw socket, so run it as root (Linux only).  Requests go to the
+# broadcast address, so the board needs no IP address or ARP entry; the
+# reply names its MAC address.  --pack asks for the words packed as runs
+# (WBREG_OP_PACK, wbreg.h), for large, sparse reads.
+
+import argparse
+import socket
+import struct
+
+WBETH_TYPE = 0x88b5
+HDR = struct.Struct('>IBBHI')
+OP_READ, OP_WRITE = 1, 2
+OP_PACK = 0x20
+PACK_LITERAL, PACK_ZERO, PACK_REPEAT = 0, 1, 2
+STATUS = ['ok', 'bad opcode', 'bad address', 'bad length', 'timed out',
+          'no such device', 'no room', 'duplicate']
+
+
+def unpack(data):
+    words = struct.unpack('>%dI' % (len(data) // 4), data[:len(data) & ~3])
+    out = []
+    i = 0
+    while i < len(words):
+        kind, run = words[i] >> 30, words[i] & 0x3fffffff
+        i += 1
+        if kind == PACK_LITERAL:
+            out.extend(words[i:i + run])
+            i += run
+        elif kind == PACK_ZERO:
+            out.extend([0] * run)
+        else:
+            out.extend([words[i]] * run)
+            i += 1
+    return out
+
+
+def main():
+    ap = argparse.ArgumentParser()
+    ap.add_argument('iface')
+    ap.add_argument('op', choices=['read', 'write'])
+    ap.add_argument('addr', type=lambda s: int(s, 0))
+    ap.add_argument('values', nargs='*', type=lambda s: int(s, 0))
+    ap.add_argument('--pack', action='store_true')
+    opts = ap.parse_args()
+
+    sock = socket.socket(socket.AF_PACKET, socket.SOCK_RAW,
+                         socket.htons(WBETH_TYPE))
+    sock.bind((opts.iface, WBETH_TYPE))
+    sock.settimeout(1)
+    mac = sock.getsockname()[4]
+
+    if opts.op == 'read':
+        count = opts.values[0] if opts.values else 1
+        req = HDR.pack(1, OP_READ | (OP_PACK if opts.pack else 0), 0, count,
+                       opts.addr)
+    else:
+        req = HDR.pack(1, OP_WRITE, 0, len(opts.values), opts.addr)
+        req += struct.pack('>%dI' % len(opts.values), *opts.values)
+    frame = b'\xff' * 6 + mac + struct.pack('>H', WBETH_TYPE) + req
+    sock.send(frame)
+
+    while True:
+        data = sock.recv(2048)
+        if data[6:12] == mac:
+            continue
+        ident, op, status, count, addr = HDR.unpack_from(data, 14)
+        if ident == 1:
+            break
+    board = ':'.join('%02x' % b for b in data[6:12])
+    print('%s: %s' % (board, STATUS[status] if status < len(STATUS)
+                      else 'status %d' % status))
+    if opts.op == 'read' and status == 0:
+        if opts.pack:
+            words = unpack(data[14 + HDR.size:])[:count]
+        else:
+            words = struct.unpack_from('>%dI' % count, data, 14 + HDR.size)
+        for i, w in enumerate(words):
+            print('%08x: %08x' % (addr + 4 * i, w))
+
+
+if __name__ == '__main__':
+    main()
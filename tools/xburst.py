@@ -0,0 +1,71 @@
+#!/usr/bin/env python3
+# xburst.py - Fetch the board's last XADC burst capture and print it as
+# time and value, one sample a line (see xburst.h).
+#
+# usage: xburst.py [--raw] [board-ip]
+#
+# Take or arm a burst first with KATCP's "?xburst start|arm channel".
+# Values are scaled as xadc_convert() does: milli-degrees C for the
+# temperature, millivolts for the rest.
+
+import argparse
+import socket
+import struct
+
+XBURST_PORT = 7011
+XBURST_MAGIC = 0x31524258
+HEADER = struct.Struct('<IHHBBBBHHIIIII')
+STATES = ['idle', 'armed', 'done', 'failed']
+TRIGGERS = ['command', 'alarm']
+TEMP, VCCINT, VCCAUX, VBRAM = 0, 1, 2, 3
+
+
+def fetch(board):
+    sock = socket.create_connection((board, XBURST_PORT), timeout=5)
+    data = b''
+    while True:
+        chunk = sock.recv(65536)
+        if not chunk:
+            break
+        data += chunk
+    sock.close()
+    (magic, version, hsize, channel, state, trigger, _, count, want, hz,
+     cycles, status, lo, hi) = HEADER.unpack_from(data)
+    if magic != XBURST_MAGIC:
+        raise SystemExit('not a burst (magic %#x)' % magic)
+    samples = struct.unpack_from('<%dH' % count, data, hsize)
+    return dict(version=version, channel=channel, state=state,
+                trigger=trigger, want=want, hz=hz, cycles=cycles,
+                status=status, time_us=lo | hi << 32, samples=samples)
+
+
+def convert(channel, raw):
+    code = raw >> 4
+    if channel == TEMP:
+        return code * 503975 / 4096.0 - 273150
+    if channel in (VCCINT, VCCAUX, VBRAM):
+        return code * 3000 / 4096.0
+    return code * 1000 / 4096.0
+
+
+def main():
+    ap = argparse.ArgumentParser()
+    ap.add_argument('board', nargs='?', default='10.10.10.10')
+    ap.add_argument('--raw', action='store_true',
+                    help='print the raw 16-bit results')
+    opts = ap.parse_args()
+
+    b = fetch(opts.board)
+    n = len(b['samples'])
+    period = b['cycles'] / b['hz'] / (n - 1) if n > 1 else 0
+    print('# channel %d, %s, %s trigger (status %#x), %d of %d samples, '
+          '%.3f us apart' % (b['channel'], STATES[b['state']],
+                             TRIGGERS[b['trigger']], b['status'], n,
+                             b['want'], period * 1e6))
+    for i, raw in enumerate(b['samples']):
+        value = raw if opts.raw else '%.1f' % convert(b['channel'], raw)
+        print('%.3f %s' % (i * period * 1e6, value))
+
+
+if __name__ == '__main__':
+    main()
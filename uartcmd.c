@@ -0,0 +1,558 @@
+// uartcmd.c - Out-of-band command console on the UART (see uartcmd.h).
+//
+// Input is taken UARTCMD_POLL_BYTES at a time.  A text line is run when
+// its CR or LF arrives, a frame when its closing END does.  Both share
+// one buffer, as only one can be coming in at once; a frame's reply is
+// built over its request and SLIP-encoded a byte at a time into the
+// console's ring once it is known to fit.
+
+#include <string.h>
+
+#include "xil_io.h"
+#include "xil_printf.h"
+
+#include "bench.h"
+#include "console.h"
+#include "crc32.h"
+#include "flash.h"
+#include "kv.h"
+#include "ovl.h"
+#include "sched.h"
+#include "slipnet.h"
+#include "spi.h"
+#include "timebase.h"
+#include "uartcmd.h"
+#include "wbreg.h"
+
+#define HDR_SIZE (sizeof(struct uartcmd_hdr))
+#define CRC_SIZE (4)
+#define BUF_SIZE (HDR_SIZE + UARTCMD_MAX_DATA + CRC_SIZE)
+
+// Arguments of a text command at most, the command included
+#define MAX_ARGS (4)
+
+// The line or frame coming in, word aligned for the replies' words
+static u32 buf_words[BUF_SIZE / 4];
+static u8 *const buf = (u8 *)buf_words;
+static u32 len;
+// In a frame, in one for slipnet.h, after an ESC in a frame, past the end
+// of the buffer, or after a CR (whose LF is then not a second line end)
+static u8 in_frame;
+static u8 in_ip;
+static u8 esc;
+static u8 over;
+static u8 cr;
+
+static u32 frames;
+static u32 bad_frames;
+
+// Bus words a request may cover, and those a text peek prints per line
+#define PEEK_MAX  (UARTCMD_MAX_DATA / 4)
+#define PEEK_LINE (4)
+
+static int
+uartcmd_number(const char *s, u32 *v)
+{
+  u32 base = 10, d;
+
+  if(s[0] == '0' && (s[1] == 'x' || s[1] == 'X')) {
+    base = 16;
+    s += 2;
+  }
+  if(!*s) {
+    return -1;
+  }
+  for(*v=0; *s; s++) {
+    if(*s >= '0' && *s <= '9') {
+      d = *s - '0';
+    } else if(base == 16 && (*s | 0x20) >= 'a' && (*s | 0x20) <= 'f') {
+      d = (*s | 0x20) - 'a' + 10;
+    } else {
+      return -1;
+    }
+    *v = *v * base + d;
+  }
+  return 0;
+}
+
+// Non-zero if `count` words from bus offset `addr` are all behind the
+// bridge
+static int
+bus_range(u32 addr, u32 count)
+{
+  return !(addr & 3) && count && addr < WBREG_SIZE &&
+      count <= (WBREG_SIZE - addr) / 4;
+}
+
+static void
+stats_get(struct uartcmd_stats *s)
+{
+  s->uptime_ms = timebase_ms();
+  s->stalls = sched_stalls(&s->longest_us);
+  s->tx_dropped = console_dropped();
+  s->rx_dropped = console_rx_dropped();
+  s->frames = frames;
+  s->bad_frames = bad_frames;
+}
+
+static void
+get32(const u8 *p, u32 *v)
+{
+  *v = p[0] | p[1] << 8 | p[2] << 16 | (u32)p[3] << 24;
+}
+
+static void
+put32(u8 *p, u32 v)
+{
+  p[0] = v;
+  p[1] = v >> 8;
+  p[2] = v >> 16;
+  p[3] = v >> 24;
+}
+
+// The text commands
+
+static void
+text_help(int argc, char **argv)
+{
+  print("peek addr [count], poke addr value, stats, bench, get key, "
+      "set key [hex]\n");
+}
+
+static void
+text_peek(int argc, char **argv)
+{
+  u32 addr, count = 1, i;
+
+  if(argc < 2 || uartcmd_number(argv[1], &addr) != 0 ||
+     (argc > 2 && uartcmd_number(argv[2], &count) != 0) ||
+     count > PEEK_MAX || !bus_range(addr, count)) {
+    print("usage: peek addr [count], within the bus and word aligned\n");
+    return;
+  }
+  for(i=0; i<count; i++, addr+=4) {
+    if(i % PEEK_LINE == 0) {
+      xil_printf("%08x:", addr);
+    }
+    xil_printf(" %08x", Xil_In32(WBREG_BASE + addr));
+    if(i % PEEK_LINE == PEEK_LINE - 1 || i == count - 1) {
+      print("\n");
+    }
+  }
+}
+
+static void
+text_poke(int argc, char **argv)
+{
+  u32 addr, value;
+
+  if(argc != 3 || uartcmd_number(argv[1], &addr) != 0 ||
+     uartcmd_number(argv[2], &value) != 0 || !bus_range(addr, 1)) {
+    print("usage: poke addr value, within the bus and word aligned\n");
+    return;
+  }
+  Xil_Out32(WBREG_BASE + addr, value);
+}
+
+static void
+text_stats(int argc, char **argv)
+{
+  struct uartcmd_stats s;
+
+  stats_get(&s);
+  xil_printf("uptime %d ms, %d stalls (longest %d us), console dropped "
+      "%d out %d in, %d frames, %d bad\n", s.uptime_ms, s.stalls,
+      s.longest_us, s.tx_dropped, s.rx_dropped, s.frames, s.bad_frames);
+}
+
+static void
+text_bench(int argc, char **argv)
+{
+  if(flash_busy() || spi_busy()) {
+    print("flash busy\n");
+  } else if(ovl_load(OVL_BENCH) != 0) {
+    print("no overlay image\n");
+  } else {
+    dump_bench();
+  }
+}
+
+static void
+text_get(int argc, char **argv)
+{
+  u32 key;
+  int n, i;
+
+  if(argc != 2 || uartcmd_number(argv[1], &key) != 0 ||
+     key >= KV_MAX_KEYS) {
+    print("usage: get key\n");
+    return;
+  }
+  // The line is done with, so the buffer holds the value
+  n = kv_get(key, buf, KV_MAX_VALUE);
+  if(n < 0) {
+    print("not set\n");
+    return;
+  }
+  xil_printf("%d:", n);
+  for(i=0; i<n; i++) {
+    xil_printf(" %02x", buf[i]);
+  }
+  print("\n");
+}
+
+static int
+hex_digit(char c)
+{
+  if(c >= '0' && c <= '9') {
+    return c - '0';
+  }
+  c |= 0x20;
+  return c >= 'a' && c <= 'f' ? c - 'a' + 10 : -1;
+}
+
+static void
+text_set(int argc, char **argv)
+{
+  u32 key, n = 0;
+  const char *p;
+  char *val = NULL;
+  int hi, lo;
+
+  if(argc < 2 || argc > 3 || uartcmd_number(argv[1], &key) != 0 ||
+     key >= KV_MAX_KEYS) {
+    print("usage: set key [hex]\n");
+    return;
+  }
+  // The value is decoded over its own text, which it never overtakes
+  if(argc == 3) {
+    val = argv[2];
+    for(p=val; *p; p+=2) {
+      if((hi = hex_digit(p[0])) < 0 || (lo = hex_digit(p[1])) < 0 ||
+         n == KV_MAX_VALUE) {
+        print("usage: set key [hex], whole bytes\n");
+        return;
+      }
+      val[n++] = hi << 4 | lo;
+    }
+  }
+  if(kv_set(key, val, n, NULL, NULL) != 0) {
+    print("config store busy\n");
+  }
+}
+
+static const struct {
+  const char *name;
+  void (*fn)(int argc, char **argv);
+} commands[] = {
+  { "help", text_help },
+  { "peek", text_peek },
+  { "poke", text_poke },
+  { "stats", text_stats },
+  { "bench", text_bench },
+  { "get", text_get },
+  { "set", text_set },
+};
+
+#define NUM_COMMANDS (sizeof(commands) / sizeof(commands[0]))
+
+static void
+run_line()
+{
+  char *argv[MAX_ARGS], *p = (char *)buf;
+  int argc = 0;
+  u32 n;
+
+  buf[len] = 0;
+  while(*p && argc < MAX_ARGS) {
+    while(*p == ' ') {
+      *p++ = 0;
+    }
+    if(*p) {
+      argv[argc++] = p;
+    }
+    while(*p && *p != ' ') {
+      p++;
+    }
+  }
+  if(!argc) {
+    return;
+  }
+  for(n=0; n<NUM_COMMANDS; n++) {
+    if(strcmp(argv[0], commands[n].name) == 0) {
+      commands[n].fn(argc, argv);
+      return;
+    }
+  }
+  print("unknown command, try help\n");
+}
+
+// The binary requests.  Each reads the request's `n` data bytes at `data`
+// and leaves the reply's there, returning its length and setting
+// `status`.
+
+static u32
+op_peek(u8 *data, u32 n, u8 *status)
+{
+  u32 addr, count, i;
+
+  if(n != 8) {
+    *status = UARTCMD_EINVAL;
+    return 0;
+  }
+  get32(data, &addr);
+  get32(data + 4, &count);
+  if(count > PEEK_MAX || !bus_range(addr, count)) {
+    *status = UARTCMD_EADDR;
+    return 0;
+  }
+  for(i=0; i<count; i++) {
+    put32(data + i * 4, Xil_In32(WBREG_BASE + addr + i * 4));
+  }
+  return count * 4;
+}
+
+static u32
+op_poke(u8 *data, u32 n, u8 *status)
+{
+  u32 addr, v, i;
+
+  if(n < 8 || (n & 3)) {
+    *status = UARTCMD_EINVAL;
+    return 0;
+  }
+  get32(data, &addr);
+  if(!bus_range(addr, n / 4 - 1)) {
+    *status = UARTCMD_EADDR;
+    return 0;
+  }
+  for(i=4; i<n; i+=4) {
+    get32(data + i, &v);
+    Xil_Out32(WBREG_BASE + addr + i - 4, v);
+  }
+  return 0;
+}
+
+static u32
+op_stats(u8 *data, u32 n, u8 *status)
+{
+  struct uartcmd_stats s;
+
+  stats_get(&s);
+  memcpy(data, &s, sizeof(s));
+  return sizeof(s);
+}
+
+static u32
+op_bench(u8 *data, u32 n, u8 *status)
+{
+  struct bench_header h;
+  u32 count;
+
+  if(flash_busy() || spi_busy()) {
+    *status = UARTCMD_EBUSY;
+    return 0;
+  }
+  count = ovl_load(OVL_BENCH) == 0 ? bench_run(
+      (struct bench_result *)(data + sizeof(h)),
+      (UARTCMD_MAX_DATA - sizeof(h)) / sizeof(struct bench_result),
+      NULL) : 0;
+  bench_fill_header(&h, count);
+  memcpy(data, &h, sizeof(h));
+  return sizeof(h) + count * sizeof(struct bench_result);
+}
+
+static u32
+op_get(u8 *data, u32 n, u8 *status)
+{
+  int got;
+
+  if(n != 1 || data[0] >= KV_MAX_KEYS) {
+    *status = UARTCMD_EINVAL;
+    return 0;
+  }
+  got = kv_get(data[0], data, KV_MAX_VALUE);
+  if(got < 0) {
+    *status = UARTCMD_ENOENT;
+    return 0;
+  }
+  return got;
+}
+
+static u32
+op_set(u8 *data, u32 n, u8 *status)
+{
+  if(n < 1 || n - 1 > KV_MAX_VALUE || data[0] >= KV_MAX_KEYS) {
+    *status = UARTCMD_EINVAL;
+  } else if(kv_set(data[0], data + 1, n - 1, NULL, NULL) != 0) {
+    *status = UARTCMD_EBUSY;
+  }
+  return 0;
+}
+
+static u32 (*const ops[])(u8 *data, u32 n, u8 *status) = {
+  NULL, op_peek, op_poke, op_stats, op_bench, op_get, op_set,
+};
+
+#define NUM_OPS (sizeof(ops) / sizeof(ops[0]))
+
+static void
+slip_byte(u8 c)
+{
+  if(c == UARTCMD_SLIP_END) {
+    outbyte(UARTCMD_SLIP_ESC);
+    outbyte(UARTCMD_SLIP_ESC_END);
+  } else if(c == UARTCMD_SLIP_ESC) {
+    outbyte(UARTCMD_SLIP_ESC);
+    outbyte(UARTCMD_SLIP_ESC_ESC);
+  } else {
+    outbyte(c);
+  }
+}
+
+static void
+run_frame()
+{
+  struct uartcmd_hdr *h = (struct uartcmd_hdr *)buf;
+  u32 crc, n, i, need;
+
+  if(len < HDR_SIZE + CRC_SIZE) {
+    // SLIP senders often open with an extra END to flush line noise
+    if(len) {
+      bad_frames++;
+    }
+    return;
+  }
+  get32(buf + len - CRC_SIZE, &crc);
+  if(over || crc32(0, buf, len - CRC_SIZE) != crc) {
+    bad_frames++;
+    return;
+  }
+
+  n = len - HDR_SIZE - CRC_SIZE;
+  h->status = UARTCMD_OK;
+  if(h->op < NUM_OPS && ops[h->op]) {
+    n = ops[h->op](buf + HDR_SIZE, n, &h->status);
+  } else {
+    h->status = UARTCMD_EINVAL;
+    n = 0;
+  }
+  h->op |= UARTCMD_OP_REPLY;
+  n += HDR_SIZE;
+  put32(buf + n, crc32(0, buf, n));
+  n += CRC_SIZE;
+
+  // Whole or not at all: the host resends after a timeout
+  for(i=0, need=2; i<n; i++) {
+    need += buf[i] == UARTCMD_SLIP_END || buf[i] == UARTCMD_SLIP_ESC ? 2 : 1;
+  }
+  if(console_space() < need) {
+    return;
+  }
+  frames++;
+  outbyte(UARTCMD_SLIP_END);
+  for(i=0; i<n; i++) {
+    slip_byte(buf[i]);
+  }
+  outbyte(UARTCMD_SLIP_END);
+}
+
+// Add `c` to the frame coming in
+static void
+frame_byte(u8 c)
+{
+  if(c == UARTCMD_SLIP_END) {
+    run_frame();
+    in_frame = 0;
+    len = 0;
+    over = 0;
+    return;
+  }
+  if(esc) {
+    esc = 0;
+    c = c == UARTCMD_SLIP_ESC_END ? UARTCMD_SLIP_END :
+        c == UARTCMD_SLIP_ESC_ESC ? UARTCMD_SLIP_ESC : c;
+  } else if(c == UARTCMD_SLIP_ESC) {
+    esc = 1;
+    return;
+  }
+  if(len == BUF_SIZE) {
+    over = 1;
+  } else {
+    buf[len++] = c;
+  }
+}
+
+// Add `c` to the line coming in
+static void
+line_byte(u8 c)
+{
+  int was_cr = cr;
+
+  cr = c == '\r';
+  if(c == '\n' && was_cr) {
+    return;
+  }
+  if(c == '\r' || c == '\n') {
+    print("\n");
+    if(over) {
+      print("line too long\n");
+    } else {
+      run_line();
+    }
+    len = 0;
+    over = 0;
+  } else if(c == '\b' || c == 0x7f) {
+    if(len) {
+      len--;
+      print("\b \b");
+    }
+  } else if(len == UARTCMD_LINE) {
+    over = 1;
+  } else if(c >= ' ') {
+    buf[len++] = c;
+    outbyte(c);
+  }
+}
+
+static int
+uartcmd_poll(void *arg)
+{
+  u8 in[UARTCMD_POLL_BYTES];
+  u32 n, i;
+
+  n = console_read(in, sizeof(in));
+  for(i=0; i<n; i++) {
+    if(in_ip) {
+      slipnet_rx(in[i]);
+      in_ip = in[i] != UARTCMD_SLIP_END;
+    } else if(in_frame && SLIPNET_ENABLE && !len && !esc &&
+        (in[i] & 0xf0) == 0x40) {
+      // An IPv4 header: the frame is slipif's, END and all
+      in_frame = 0;
+      in_ip = 1;
+      slipnet_rx(UARTCMD_SLIP_END);
+      slipnet_rx(in[i]);
+    } else if(in_frame) {
+      frame_byte(in[i]);
+    } else if(in[i] == UARTCMD_SLIP_END) {
+      // A frame drops the partial line before it
+      in_frame = 1;
+      len = 0;
+      esc = 0;
+      over = 0;
+      cr = 0;
+    } else {
+      line_byte(in[i]);
+    }
+  }
+  return n != 0;
+}
+
+static struct sched_hook poll_hook = SCHED_HOOK_INIT(uartcmd_poll, NULL);
+
+void
+init_uartcmd()
+{
+  sched_add_poll(&poll_hook);
+}
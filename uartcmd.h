@@ -0,0 +1,102 @@
+#ifndef _UARTCMD_H_
+#define _UARTCMD_H_
+
+// uartcmd.h - Out-of-band command console on the UART.
+//
+// A poll hook takes the console's input (console.h) a little at a time,
+// so typing at the board or scripting it never holds up the network.
+// Two forms share the line, told apart by their first byte:
+//
+// Text, for people: a line of at most UARTCMD_LINE characters, echoed as
+// typed, ending in CR or LF.  Numbers are decimal or 0x hex.
+//
+//   help                       list the commands
+//   peek addr [count]          read `count` (default 1) words of the bus
+//   poke addr value            write a word of the bus
+//   stats                      uptime, main-loop stalls, console drops
+//                              and frames
+//   bench                      run the bench.h suite and print its table
+//   get key                    print a config store (kv.h) value as hex
+//   set key [hex]              set a config store value (none deletes it)
+//
+// Bus addresses are byte offsets behind the Wishbone bridge, word aligned,
+// as in wbreg.h.
+//
+// Binary, for scripts at the UART's full rate: SLIP frames (RFC 1055),
+// each opened and closed by UARTCMD_SLIP_END.  Text is never 0xc0, so a
+// frame can follow a line at any point.  A frame is a struct uartcmd_hdr,
+// then the request's data, then the CRC-32 (crc32.h) of everything
+// before it, at most UARTCMD_MAX_DATA bytes of data in all; frames that
+// are too long or fail the CRC are counted and dropped without a reply.
+// The reply is a frame of the same form with `op` | UARTCMD_OP_REPLY, the
+// request's `seq` and `status` filled in.  Fields and words are
+// little-endian, the processor's order, as in bench.h's replies.
+//
+// Frames whose first byte is 0x4x are IPv4 packets for slipnet.h instead.
+//
+// The frame goes into the console's output ring whole or not at all, and
+// console output is written only from the main loop, so log lines never
+// land inside one; hosts skip anything outside a frame.
+
+#include "xil_types.h"
+
+// Longest text line
+#define UARTCMD_LINE      (80)
+
+// Most data a frame carries, either way
+#define UARTCMD_MAX_DATA  (512)
+
+// Input bytes the poll hook takes per pass at most
+#define UARTCMD_POLL_BYTES (64)
+
+// SLIP bytes
+#define UARTCMD_SLIP_END     (0xc0)
+#define UARTCMD_SLIP_ESC     (0xdb)
+#define UARTCMD_SLIP_ESC_END (0xdc)
+#define UARTCMD_SLIP_ESC_ESC (0xdd)
+
+// Opcodes
+#define UARTCMD_OP_PEEK  (0x01) // u32 addr, u32 count; the reply carries
+                                // the words read
+#define UARTCMD_OP_POKE  (0x02) // u32 addr, then the words to write
+#define UARTCMD_OP_STATS (0x03) // the reply carries a struct uartcmd_stats
+#define UARTCMD_OP_BENCH (0x04) // run the bench.h suite; the reply carries
+                                // its struct bench_header and as many
+                                // struct bench_result as fit
+#define UARTCMD_OP_GET   (0x05) // u8 key; the reply carries its value
+#define UARTCMD_OP_SET   (0x06) // u8 key, then the value (none deletes it);
+                                // the reply comes once it is queued
+#define UARTCMD_OP_REPLY (0x80)
+
+// Status
+#define UARTCMD_OK       (0)
+#define UARTCMD_EINVAL   (1) // unknown opcode or malformed request
+#define UARTCMD_EADDR    (2) // bus address unaligned or out of range
+#define UARTCMD_EBUSY    (3) // flash or config store busy, try again
+#define UARTCMD_ENOENT   (4) // config key not set
+
+struct uartcmd_hdr {
+  u8 op;
+  // Chosen by the host to pair replies with requests
+  u8 seq;
+  u8 status;
+  u8 pad;
+};
+
+struct uartcmd_stats {
+  u32 uptime_ms;
+  // Main-loop stalls (sched.h) and the longest busy pass
+  u32 stalls;
+  u32 longest_us;
+  // Console output and input dropped
+  u32 tx_dropped;
+  u32 rx_dropped;
+  // Frames answered, and dropped as too long or failing the CRC
+  u32 frames;
+  u32 bad_frames;
+};
+
+// Add the poll hook.  Call after init_console().
+void init_uartcmd();
+
+#endif // _UARTCMD_H_
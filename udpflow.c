@@ -0,0 +1,348 @@
+// udpflow.c - UDP fast-send path for streams to a fixed destination.
+//
+// Sums are of halfwords as they sit in memory, like lwIP's inet_chksum(),
+// so the patched fields go in swapped and the results are stored as they
+// are.  The template is word aligned (ETH_PAD_SIZE is 2), so it goes in
+// front of the data a word at a time.
+
+#include <stddef.h>
+#include <string.h>
+
+#include "lwip/etharp.h"
+#include "lwip/ip.h"
+#include "netif/ethernet.h"
+#include "netif/ethernetif.h"
+
+#include "bswap.h"
+#include "chksum.h"
+#include "mbmem.h"
+#include "sched.h"
+#include "timebase.h"
+#include "udpflow.h"
+
+#if UDPFLOW_HDR_LEN & 3
+#error "udpflow needs ETH_PAD_SIZE 2 to keep the headers word aligned"
+#endif
+
+#define FLOW_IP(hdr)  ((struct ip_hdr *)((u8 *)(hdr) + SIZEOF_ETH_HDR))
+#define FLOW_UDP(hdr) ((struct udp_hdr *)((u8 *)(hdr) + SIZEOF_ETH_HDR + IP_HLEN))
+
+// Registered flows, and the frames they hold between them
+static struct udpflow *flows;
+static u32 held_total;
+
+// Fold a sum of up to 65536 halfwords to 16 bits
+static u32
+fold_sum(u32 sum)
+{
+  sum = (sum & 0xffff) + (rot16(sum) & 0xffff);
+  return (sum & 0xffff) + (rot16(sum) & 0xffff);
+}
+
+// Non-zero if the stack, not the gateware, makes checksum `flag`
+static int
+flow_csum(struct netif *netif, u16 flag)
+{
+#if LWIP_CHECKSUM_CTRL_PER_NETIF
+  return (netif->chksum_flags & flag) != 0;
+#else
+  return 1;
+#endif
+}
+
+// Rebuild the template from the interface's addresses and the ARP table
+static void
+flow_refresh(struct udpflow *f)
+{
+  struct netif *netif = f->netif;
+  struct eth_hdr *e = (struct eth_hdr *)f->hdr;
+  struct ip_hdr *ip = FLOW_IP(f->hdr);
+  struct udp_hdr *u = FLOW_UDP(f->hdr);
+  struct eth_addr *mac;
+  const ip4_addr_t *unused;
+
+  f->refreshed = timebase_ms();
+
+  ip4_addr_copy(f->next_hop, f->dst);
+  if(!ip4_addr_ismulticast(&f->dst) &&
+     !ip4_addr_netcmp(&f->dst, netif_ip4_addr(netif), netif_ip4_netmask(netif))
+     && !ip4_addr_isany_val(*netif_ip4_gw(netif))) {
+    ip4_addr_copy(f->next_hop, *netif_ip4_gw(netif));
+  }
+
+  memcpy(&e->src, netif->hwaddr, ETH_HWADDR_LEN);
+  e->type = PP_HTONS(ETHTYPE_IP);
+
+  memset(ip, 0, IP_HLEN + UDP_HLEN);
+  IPH_VHL_SET(ip, 4, IP_HLEN / 4);
+  IPH_TOS_SET(ip, f->tos);
+  IPH_TTL_SET(ip, UDP_TTL);
+  IPH_PROTO_SET(ip, IP_PROTO_UDP);
+  ip4_addr_copy(ip->src, *netif_ip4_addr(netif));
+  ip4_addr_copy(ip->dest, f->dst);
+  u->src = swap16(f->src_port);
+  u->dest = swap16(f->dst_port);
+
+  // Length, ID and checksums are still zero
+  f->ip_sum = mb_chksum(ip, IP_HLEN);
+  f->udp_sum = mb_chksum(&ip->src, 8) + mb_chksum(u, UDP_HLEN) +
+      swap16(IP_PROTO_UDP);
+
+  if(ip4_addr_isbroadcast(&f->dst, netif)) {
+    memcpy(&e->dest, &ethbroadcast, ETH_HWADDR_LEN);
+    f->resolved = 1;
+  } else if(ip4_addr_ismulticast(&f->dst)) {
+    // The group's MAC address: 01:00:5e and the low 23 bits of the group
+    e->dest.addr[0] = LL_IP4_MULTICAST_ADDR_0;
+    e->dest.addr[1] = LL_IP4_MULTICAST_ADDR_1;
+    e->dest.addr[2] = LL_IP4_MULTICAST_ADDR_2;
+    e->dest.addr[3] = ip4_addr2(&f->dst) & 0x7f;
+    e->dest.addr[4] = ip4_addr3(&f->dst);
+    e->dest.addr[5] = ip4_addr4(&f->dst);
+    f->resolved = 1;
+  } else if(etharp_find_addr(netif, &f->next_hop, &mac, &unused) >= 0) {
+    memcpy(&e->dest, mac, ETH_HWADDR_LEN);
+    f->resolved = 1;
+  } else if(f->resolved) {
+    // The entry expired, since nothing here refreshes it: keep sending to
+    // the old address while asking again
+    etharp_request(netif, &f->next_hop);
+  }
+}
+
+// Hand the frames held that are due to eth0's TX queue, in order, until
+// it is full.  Returns the number queued.
+static u32
+flow_release(struct udpflow *f, u64 now)
+{
+  struct pbuf *p;
+  u32 n = 0;
+
+  while(f->held && f->held_at[f->held_first] <= now) {
+    p = f->held_p[f->held_first];
+    if(ethernetif_tx_queue(f->netif, p, NULL, NULL, NULL) == ERR_MEM) {
+      break;
+    }
+    pbuf_free(p);
+    f->held_first = (f->held_first + 1) % UDPFLOW_HOLD;
+    f->held--;
+    held_total--;
+    n++;
+  }
+  return n;
+}
+
+static int
+pace_poll(void *arg)
+{
+  struct udpflow *f;
+  u32 n = 0;
+  u64 now;
+
+  if(!held_total) {
+    return 0;
+  }
+  now = timebase_cycles();
+  for(f=flows; f; f=f->next) {
+    n += flow_release(f, now);
+  }
+  return n != 0;
+}
+
+static struct sched_hook pace_hook = SCHED_HOOK_INIT(pace_poll, NULL);
+
+// Queue the frame `p` of a paced flow when the bucket allows, holding it
+// until then.  The caller still owns `p`.
+static err_t
+flow_pace(struct udpflow *f, struct pbuf *p)
+{
+  u64 now, when;
+  u8 n;
+
+  if(f->held == UDPFLOW_HOLD) {
+    f->pace_drops++;
+    return ERR_MEM;
+  }
+  now = timebase_cycles();
+  flow_release(f, now);
+  when = pace_release(&f->pace, now, p->tot_len - ETH_PAD_SIZE);
+  if(!f->held && when <= now &&
+     ethernetif_tx_queue(f->netif, p, NULL, NULL, NULL) == ERR_OK) {
+    return ERR_OK;
+  }
+  // Due but the TX queue is full, or not yet due
+  n = (f->held_first + f->held) % UDPFLOW_HOLD;
+  pbuf_ref(p);
+  f->held_p[n] = p;
+  f->held_at[n] = when;
+  f->held++;
+  held_total++;
+  return ERR_OK;
+}
+
+// Put the headers in front of the `len` bytes of data in `p`, summing to
+// `sum`, and send it.  Frees `p`.
+static int
+flow_output(struct udpflow *f, struct pbuf *p, u16 len, u32 sum)
+{
+  struct ip_hdr *ip;
+  struct udp_hdr *u;
+  u32 *d, i, tot_len, ulen, id, c;
+  err_t err;
+
+  if(!f->resolved || timebase_ms() - f->refreshed >= UDPFLOW_REFRESH_MS) {
+    flow_refresh(f);
+  }
+  if(pbuf_header(p, UDPFLOW_HDR_LEN)) {
+    pbuf_free(p);
+    return -1;
+  }
+
+  d = p->payload;
+  for(i=0; i<UDPFLOW_HDR_LEN/4; i++) {
+    d[i] = f->hdr[i];
+  }
+  ip = FLOW_IP(d);
+  u = FLOW_UDP(d);
+
+  tot_len = swap16(IP_HLEN + UDP_HLEN + len);
+  ulen = swap16(UDP_HLEN + len);
+  id = swap16(f->ip_id++);
+  IPH_LEN_SET(ip, tot_len);
+  IPH_ID_SET(ip, id);
+  if(flow_csum(f->netif, NETIF_CHECKSUM_GEN_IP)) {
+    IPH_CHKSUM_SET(ip, ~fold_sum(f->ip_sum + tot_len + id) & 0xffff);
+  }
+  u->len = ulen;
+  if(flow_csum(f->netif, NETIF_CHECKSUM_GEN_UDP)) {
+    c = ~fold_sum(f->udp_sum + ulen + ulen + sum) & 0xffff;
+    u->chksum = c ? c : 0xffff;
+  }
+
+  if(f->resolved && (f->pace.rate || f->held)) {
+    err = flow_pace(f, p);
+  } else if(f->resolved) {
+    err = ethernetif_tx_queue(f->netif, p, NULL, NULL, NULL);
+  } else {
+    // etharp_query() wants the IP packet and queues a copy
+    pbuf_header(p, -SIZEOF_ETH_HDR);
+    err = etharp_query(f->netif, &f->next_hop, p);
+  }
+  pbuf_free(p);
+
+  return err == ERR_OK ? 0 : -1;
+}
+
+int
+udpflow_connect(struct udpflow *f, const ip4_addr_t *dst, u16 src_port,
+    u16 dst_port)
+{
+  memset(f, 0, offsetof(struct udpflow, tos));
+  f->netif = ip4_route(dst);
+  if(!f->netif) {
+    return -1;
+  }
+  ip4_addr_copy(f->dst, *dst);
+  f->src_port = src_port;
+  f->dst_port = dst_port;
+  flow_refresh(f);
+  return 0;
+}
+
+void
+udpflow_register(struct udpflow *f, const char *name)
+{
+  if(!flows) {
+    sched_add_poll(&pace_hook);
+  }
+  f->name = name;
+  f->next = flows;
+  flows = f;
+}
+
+struct udpflow *
+udpflow_find(const char *name)
+{
+  struct udpflow *f;
+
+  for(f=flows; f; f=f->next) {
+    if(strcmp(f->name, name) == 0) {
+      return f;
+    }
+  }
+  return NULL;
+}
+
+struct udpflow *
+udpflow_next(struct udpflow *f)
+{
+  return f ? f->next : flows;
+}
+
+int
+udpflow_set_pace(struct udpflow *f, u32 rate, u32 burst)
+{
+  u32 n;
+
+  if(!f->name || pace_set(&f->pace, rate, burst) != 0) {
+    return -1;
+  }
+  if(!rate) {
+    for(n=0; n<UDPFLOW_HOLD; n++) {
+      f->held_at[n] = 0;
+    }
+  }
+  return 0;
+}
+
+void
+udpflow_set_tos(struct udpflow *f, u8 tos)
+{
+  f->tos = tos;
+  if(f->netif) {
+    flow_refresh(f);
+  }
+}
+
+struct pbuf *
+udpflow_alloc(u16 len)
+{
+  struct pbuf *p;
+
+  if(len > UDPFLOW_MAX) {
+    return NULL;
+  }
+  p = pbuf_alloc(PBUF_RAW, UDPFLOW_HDR_LEN + len, PBUF_RAM);
+  if(p) {
+    pbuf_header(p, -UDPFLOW_HDR_LEN);
+  }
+  return p;
+}
+
+int
+udpflow_send(struct udpflow *f, struct pbuf *p)
+{
+  u32 sum = 0;
+
+  if(flow_csum(f->netif, NETIF_CHECKSUM_GEN_UDP)) {
+    sum = mb_chksum(p->payload, p->len);
+  }
+  return flow_output(f, p, p->len, sum);
+}
+
+int
+udpflow_write(struct udpflow *f, const void *data, u16 len)
+{
+  struct pbuf *p = udpflow_alloc(len);
+  u32 sum = 0;
+
+  if(!p) {
+    return -1;
+  }
+  if(flow_csum(f->netif, NETIF_CHECKSUM_GEN_UDP)) {
+    sum = mb_chksum_copy(p->payload, data, len);
+  } else {
+    mb_memcpy(p->payload, data, len);
+  }
+  return flow_output(f, p, len, sum);
+}
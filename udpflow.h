@@ -0,0 +1,136 @@
+#ifndef _UDPFLOW_H_
+#define _UDPFLOW_H_
+
+// udpflow.h - UDP fast-send path for streams to a fixed destination.
+//
+// A flow keeps a template of the Ethernet, IP and UDP headers of its
+// datagrams and the one's complement sums of their constant fields, built
+// once by udpflow_connect() and rebuilt every UDPFLOW_REFRESH_MS.  Sending
+// copies the template in front of the data, patches the lengths, IP ID
+// and checksums and queues the frame on eth0 with ethernetif_tx_queue(),
+// skipping udp_sendto(), ip4_output_if() and etharp_output().
+//
+// Until the next hop's MAC address is in the ARP table, datagrams go
+// through etharp_query() instead, which sends the ARP request and queues
+// them on the entry.  A multicast destination needs no ARP: the flow
+// sends to the group's MAC address from the start, one frame however
+// many hosts joined it.  Datagrams are never fragmented, so they carry
+// UDPFLOW_MAX bytes at most.
+//
+// A flow registered under a name (udpflow_register()) can be paced by a
+// token bucket (pace.h), set with KATCP's ?pace: frames beyond the bucket
+// wait among the flow's held frames, each with the time it may go, and a
+// poll hook hands them to eth0's TX queue once that time comes.  A
+// sleeping main loop wakes every tick, so a frame goes up to 1 ms late at
+// worst, but the next one's time is counted from when it was due, so the
+// rate holds.  With UDPFLOW_HOLD frames already held, sending fails as it
+// does with the TX queue full.
+
+#include "lwip/netif.h"
+#include "lwip/pbuf.h"
+#include "lwip/prot/ethernet.h"
+#include "lwip/prot/ip4.h"
+#include "lwip/prot/udp.h"
+
+#include "xil_types.h"
+
+#include "eth.h"
+#include "pace.h"
+
+// Bytes of header, from the start of the frame (ETH_PAD_SIZE included)
+#define UDPFLOW_HDR_LEN (SIZEOF_ETH_HDR + IP_HLEN + UDP_HLEN)
+
+// Longest datagram, filling a frame at eth0's MTU
+#define UDPFLOW_MAX ETH_UDP_MAX
+
+// How often the template picks up a new MAC or IP address
+#define UDPFLOW_REFRESH_MS (10000)
+
+// Frames a paced flow holds back at most
+#define UDPFLOW_HOLD (8)
+
+// Bucket depth when ?pace gives none: a few full datagrams
+#define UDPFLOW_PACE_BURST (4 * UDPFLOW_MAX)
+
+struct udpflow {
+  struct netif *netif;
+  ip4_addr_t dst;
+  // dst, or the gateway if dst is off the subnet
+  ip4_addr_t next_hop;
+  // Host order
+  u16 src_port;
+  u16 dst_port;
+  u16 ip_id;
+  // Non-zero once hdr holds the next hop's MAC address
+  u8 resolved;
+  u8 pad;
+  // timebase_ms() of the last refresh
+  u32 refreshed;
+  // Sums of the constant IP header fields and of the constant UDP header
+  // and pseudo-header fields, unfolded
+  u32 ip_sum;
+  u32 udp_sum;
+  u32 hdr[UDPFLOW_HDR_LEN / 4];
+
+  // From here on kept by udpflow_connect()
+
+  // IP TOS byte, which also picks eth0's TX class (netif/ethernetif.h)
+  u8 tos;
+  // Frames held for pacing: `held` of them from held_first, each with the
+  // timebase_cycles() it may go at
+  u8 held;
+  u8 held_first;
+  struct pbuf *held_p[UDPFLOW_HOLD];
+  u64 held_at[UDPFLOW_HOLD];
+  struct pace pace;
+  // Frames refused with UDPFLOW_HOLD held
+  u32 pace_drops;
+  // Name given to udpflow_register(), NULL if not registered, and the next
+  // registered flow
+  const char *name;
+  struct udpflow *next;
+};
+
+// Register `f` under `name` (kept, not copied), so that ?pace can find it
+// and its held frames are released.  Call once, before udpflow_connect()
+// or after.
+void udpflow_register(struct udpflow *f, const char *name);
+
+// The registered flow called `name`, or NULL
+struct udpflow *udpflow_find(const char *name);
+
+// The registered flow after `f`, or the first with NULL
+struct udpflow *udpflow_next(struct udpflow *f);
+
+// Pace registered flow `f` at `rate` bytes a second, frames included, with
+// a bucket `burst` bytes deep, or stop pacing with a `rate` of 0, which
+// lets the frames held go at once.  Returns 0, or -1 if `f` is not
+// registered or the rate is below PACE_MIN_RATE.
+int udpflow_set_pace(struct udpflow *f, u32 rate, u32 burst);
+
+// Set up `f` to send from `src_port` to `dst`:`dst_port` on the interface
+// that routes to `dst`.  Returns 0, or -1 if there is no route.
+int udpflow_connect(struct udpflow *f, const ip4_addr_t *dst, u16 src_port,
+    u16 dst_port);
+
+// Send with IP TOS byte `tos` from now on, ETHERNETIF_TOS_TELEMETRY or
+// ETHERNETIF_TOS_BULK to queue behind eth0's control frames.  It is 0
+// until set, and udpflow_connect() keeps it.
+void udpflow_set_tos(struct udpflow *f, u8 tos);
+
+// A pbuf with room for `len` bytes of data after the flow's headers, or
+// NULL if out of memory.  Fill in the payload and pass it to
+// udpflow_send().
+struct pbuf *udpflow_alloc(u16 len);
+
+// Send `p`, from udpflow_alloc(), and free it: unlike udp_send(), the
+// frame goes out from `p` itself.  Returns 0, or -1 if the frame could not
+// be queued (eth0's TX queue is full, a paced flow holds UDPFLOW_HOLD
+// frames, or no ARP entry could be made).
+int udpflow_send(struct udpflow *f, struct pbuf *p);
+
+// Send `len` bytes at `data`, summing them as they are copied.  Returns
+// as udpflow_send().
+int udpflow_write(struct udpflow *f, const void *data, u16 len);
+
+#endif // _UDPFLOW_H_
@@ -0,0 +1,15 @@
+#ifndef _VERSION_H_
+#define _VERSION_H_
+
+// version.h - Firmware version.
+//
+// Bump JAM_VERSION_MINOR for compatible additions to the protocols and
+// JAM_VERSION_MAJOR when a host tool has to change.
+
+#define JAM_VERSION_MAJOR (0)
+#define JAM_VERSION_MINOR (1)
+
+// As reported by discover.h: major in the high 16 bits, minor in the low
+#define JAM_VERSION ((JAM_VERSION_MAJOR << 16) | JAM_VERSION_MINOR)
+
+#endif // _VERSION_H_
@@ -0,0 +1,203 @@
+// warm.c - Runtime state kept across restarts (see warm.h).
+//
+// The blob is built in a static buffer rather than on the 1 KB stack;
+// kv_set() copies it, so the buffer is free again once the set is queued.
+
+#include <string.h>
+
+#include "lwip/etharp.h"
+#include "lwip/netif.h"
+
+#include "arpcfg.h"
+#include "kv.h"
+#include "log.h"
+#include "telemetry.h"
+#include "timer.h"
+#include "warm.h"
+#include "wbreg.h"
+
+static struct warm_state cur;
+// As last saved or restored, so saves that change nothing are skipped
+static struct warm_state last;
+
+static u8 restored;
+static u8 saving;
+static u32 saves;
+
+// Hosts to ask for once eth0 has an address, and checks left
+static u32 arp_host[WARM_HOSTS];
+static u32 arp_hosts;
+static u32 arp_tries;
+
+static int
+warm_is_static(u32 ip)
+{
+  const struct arpcfg_entry *e;
+  u32 n;
+
+  for(n=0; (e = arpcfg_get(n)); n++) {
+    if(e->ip == ip) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+static void
+warm_collect(struct warm_state *w)
+{
+  struct warm_watch *ww;
+  struct eth_addr *mac;
+  struct netif *nif;
+  ip4_addr_t *ip;
+  ip_addr_t sub;
+  u32 i, v;
+
+  memset(w, 0, sizeof(*w));
+  w->version = WARM_VERSION;
+  w->size = sizeof(*w);
+  w->telem_count = telem_count();
+  if(wbwatch_subscriber(&sub, &w->notify_port) == 0) {
+    w->notify_ip = ip4_addr_get_u32(ip_2_ip4(&sub));
+  }
+  for(i=0; i<ARP_TABLE_SIZE && w->hosts < WARM_HOSTS; i++) {
+    if(etharp_get_entry(i, &ip, &nif, &mac) &&
+       !warm_is_static(ip4_addr_get_u32(ip))) {
+      w->host[w->hosts++] = ip4_addr_get_u32(ip);
+    }
+  }
+  for(i=0; i<WBWATCH_MAX; i++) {
+    ww = &w->watch[w->watches];
+    if(wbwatch_get(i, &ww->addr, &ww->mask, &v) == 0) {
+      ww->period_ms = wbwatch_period(i);
+      w->watches++;
+    }
+  }
+}
+
+static void
+warm_arp(void *arg);
+
+static struct timer arp_timer = TIMER_INIT(warm_arp, NULL);
+
+static void
+warm_arp(void *arg)
+{
+  struct netif *nif = netif_default;
+  ip4_addr_t ip;
+  u32 i;
+
+  if(!nif || ip4_addr_isany_val(*netif_ip4_addr(nif))) {
+    if(++arp_tries == WARM_ARP_TRIES) {
+      timer_stop(&arp_timer);
+    }
+    return;
+  }
+  for(i=0; i<arp_hosts; i++) {
+    ip4_addr_set_u32(&ip, arp_host[i]);
+    etharp_request(nif, &ip);
+  }
+  timer_stop(&arp_timer);
+}
+
+static void
+warm_restore()
+{
+  struct warm_state *w = &cur;
+  ip_addr_t ip;
+  u32 i;
+
+  if(kv_get(KV_KEY_WARM, w, sizeof(*w)) != sizeof(*w) ||
+     w->version != WARM_VERSION || w->size != sizeof(*w) ||
+     w->hosts > WARM_HOSTS || w->watches > WBWATCH_MAX) {
+    return;
+  }
+  telem_resume(w->telem_count +
+      WARM_SAVE_MS / (TELEM_SAMPLE_MS * TELEM_WINDOW) + 1);
+  for(i=0; i<w->watches; i++) {
+    wbwatch_add(w->watch[i].addr, w->watch[i].mask, w->watch[i].period_ms);
+  }
+  if(w->notify_ip) {
+    ip_addr_set_ip4_u32(&ip, w->notify_ip);
+    wbreg_subscribe(&ip, w->notify_port);
+  }
+  arp_hosts = w->hosts;
+  memcpy(arp_host, w->host, arp_hosts * sizeof(arp_host[0]));
+  if(arp_hosts) {
+    timer_start(&arp_timer, 0, WARM_ARP_MS);
+  }
+  last = *w;
+  restored = 1;
+  LOG("warm: restored %u watches, %u hosts", w->watches, w->hosts);
+}
+
+static void
+warm_saved(int err, void *arg)
+{
+  saving = 0;
+  if(err) {
+    LOG("warm: save failed (%d)", err);
+    // Try again next period
+    memset(&last, 0, sizeof(last));
+  } else {
+    saves++;
+  }
+}
+
+static void
+warm_tick(void *arg)
+{
+  warm_collect(&cur);
+  if(memcmp(&cur, &last, sizeof(cur)) != 0) {
+    warm_save();
+  }
+}
+
+static struct timer save_timer = TIMER_INIT(warm_tick, NULL);
+
+void
+init_warm()
+{
+  warm_restore();
+  timer_start(&save_timer, WARM_SAVE_MS, WARM_SAVE_MS);
+}
+
+int
+warm_save()
+{
+  if(saving) {
+    return -1;
+  }
+  warm_collect(&cur);
+  if(kv_set(KV_KEY_WARM, &cur, sizeof(cur), warm_saved, NULL) != 0) {
+    return -1;
+  }
+  saving = 1;
+  last = cur;
+  if(!timer_pending(&save_timer)) {
+    timer_start(&save_timer, WARM_SAVE_MS, WARM_SAVE_MS);
+  }
+  return 0;
+}
+
+int
+warm_clear()
+{
+  if(saving || kv_set(KV_KEY_WARM, NULL, 0, NULL, NULL) != 0) {
+    return -1;
+  }
+  timer_stop(&save_timer);
+  return 0;
+}
+
+int
+warm_restored()
+{
+  return restored;
+}
+
+u32
+warm_saves()
+{
+  return saves;
+}
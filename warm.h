@@ -0,0 +1,70 @@
+#ifndef _WARM_H_
+#define _WARM_H_
+
+// warm.h - Runtime state kept across restarts.
+//
+// After a restart the board would otherwise learn again what it learned at
+// run time.  The address configuration, DHCP lease and static ARP entries
+// already have their own keys (netcfg.h, arpcfg.h).  This keeps the rest
+// in one versioned blob under KV_KEY_WARM:
+// - the register watches and their subscriber (wbwatch.h);
+// - the hosts in the ARP cache, asked for again as soon as eth0 has an
+//   address, so they answer before traffic to them waits on ARP;
+// - the telemetry record count, so record numbers carry on instead of
+//   starting over (telemetry.h).
+//
+// The blob is saved every WARM_SAVE_MS when it has changed, and by
+// warm_save() before a planned restart (KATCP's ?warm save).  The count
+// saved is behind by up to a save period of records, so it resumes that
+// far ahead.  A blob of another WARM_VERSION is ignored.
+
+#include "xil_types.h"
+
+#include "wbwatch.h"
+
+#define WARM_VERSION  (1)
+
+#define WARM_SAVE_MS  (60000)
+// ARP cache hosts kept
+#define WARM_HOSTS    (8)
+// How often, and how many times, to check for an address to ask from
+#define WARM_ARP_MS   (100)
+#define WARM_ARP_TRIES (300)
+
+struct warm_watch {
+  u32 addr;
+  u32 mask;
+  u32 period_ms;
+};
+
+// KV_MAX_VALUE bytes with WARM_HOSTS and WBWATCH_MAX at their defaults
+struct warm_state {
+  u16 version;
+  u16 size;
+  u32 telem_count;
+  // Watch subscriber, 0 for none
+  u32 notify_ip;
+  u16 notify_port;
+  u8 hosts;
+  u8 watches;
+  u32 host[WARM_HOSTS];
+  struct warm_watch watch[WBWATCH_MAX];
+};
+
+// Restore the last blob saved and start saving.  Call once the services
+// it restores are up: after init_wbreg(), init_wbwatch() and
+// init_telemetry().
+void init_warm();
+
+// Save the state now.  Returns 0 if the write was queued, -1 if the
+// config store is busy.
+int warm_save();
+
+// Forget the saved state: the next boot starts cold
+int warm_clear();
+
+// Whether this boot restored a blob, and blobs saved since
+int warm_restored();
+u32 warm_saves();
+
+#endif // _WARM_H_
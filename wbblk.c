@@ -0,0 +1,267 @@
+// wbblk.c - Bulk block transfers of Wishbone memory over TCP.
+//
+// One connection is served at a time.  Reads are pulled by the send
+// window (tcpsrc.h): the bus is read by words straight into the ring the
+// segments reference, as send buffer space frees up (the bridge needs word
+// accesses, so tcp_write() cannot take the data from the bus itself).
+// Writes go to the bus as received data arrives, through a segment-sized
+// staging buffer.  Received data that arrives while a read is still
+// streaming is kept (tcprx.h) and picked up when it is done.
+
+#include "xil_io.h"
+
+#include "lwip/tcp.h"
+#include "netif/ethernetif.h"
+
+#include "bswap.h"
+#include "tcprx.h"
+#include "tcpsrc.h"
+#include "wbblk.h"
+#include "wbreg.h"
+
+#define BLK_HDR   (0) // collecting a request header
+#define BLK_READ  (1) // streaming a read
+#define BLK_WRITE (2) // receiving write data
+
+static struct {
+  struct tcp_pcb *pcb;
+  u8 state;
+  struct wbblk_hdr hdr;
+  u32 hdr_have;
+  // The reply header did not fit in the send buffer yet
+  u8 reply_pending;
+  // Bus address and bytes left of the current transfer
+  u32 addr;
+  u32 left;
+  struct tcprx rx;
+  struct tcpsrc tx;
+} blk;
+
+static u32 stage[TCP_MSS / 4];
+
+static err_t blk_input(struct tcp_pcb *pcb);
+
+// Forget the connection and drop unconsumed data
+static void
+blk_reset()
+{
+  tcprx_free(&blk.rx);
+  blk.pcb = NULL;
+}
+
+// Close the connection, after anything queued has been sent.  Returns
+// what a callback must return.
+static err_t
+blk_close(struct tcp_pcb *pcb)
+{
+  err_t err = tcprx_close(&blk.rx, pcb);
+
+  blk_reset();
+  return err;
+}
+
+// Send the current header back, or leave it pending until there is room
+static void
+blk_reply(struct tcp_pcb *pcb)
+{
+  struct wbblk_hdr h = blk.hdr;
+
+  h.addr = swap32(h.addr);
+  h.len = swap32(h.len);
+  blk.reply_pending = tcpsrc_write(&blk.tx, &h, sizeof(h)) != 0;
+  if(!blk.reply_pending) {
+    tcp_output(pcb);
+  }
+}
+
+// Fill callback of a read: the next `len` bytes of it from the bus
+static u32
+blk_fill(void *dst, u32 len, void *arg)
+{
+  u32 *w = dst;
+  u32 i;
+
+  if(len > blk.left) {
+    len = blk.left;
+  }
+  for(i=0; i<len/4; i++) {
+    w[i] = swap32(Xil_In32(blk.addr + 4 * i));
+  }
+  blk.addr += len;
+  blk.left -= len;
+  return len;
+}
+
+// Queue as much of the read as the send buffer takes, and go back to
+// received data once it is all queued
+static err_t
+blk_send(struct tcp_pcb *pcb)
+{
+  // The header goes first
+  if(blk.reply_pending) {
+    return ERR_OK;
+  }
+  tcpsrc_set_fill(&blk.tx, blk_fill, NULL);
+  tcpsrc_pump(&blk.tx);
+
+  if(blk.left) {
+    return ERR_OK;
+  }
+  tcpsrc_set_fill(&blk.tx, NULL, NULL);
+  blk.state = BLK_HDR;
+  return blk_input(pcb);
+}
+
+// Check the request just collected and start on it.  Returns what a
+// callback must return.
+static err_t
+blk_start(struct tcp_pcb *pcb)
+{
+  struct wbblk_hdr *h = &blk.hdr;
+
+  h->addr = swap32(h->addr);
+  h->len = swap32(h->len);
+  h->status = WBREG_OK;
+  if(h->op != WBBLK_OP_READ && h->op != WBBLK_OP_WRITE) {
+    h->status = WBREG_EOP;
+  } else if(((h->addr | h->len) & 3) || h->addr > WBREG_SIZE ||
+            h->len > WBREG_SIZE - h->addr) {
+    h->status = WBREG_EADDR;
+  }
+
+  blk.addr = WBREG_BASE + h->addr;
+  blk.left = h->len;
+  blk.hdr_have = 0;
+
+  if(h->status != WBREG_OK) {
+    blk_reply(pcb);
+    return blk_close(pcb);
+  }
+  if(h->op == WBBLK_OP_READ) {
+    blk.state = BLK_READ;
+    blk_reply(pcb);
+    return blk_send(pcb);
+  }
+  if(blk.left) {
+    blk.state = BLK_WRITE;
+  } else {
+    blk_reply(pcb);
+  }
+  return ERR_OK;
+}
+
+// Consume received data until it runs out or a read has to stream.
+// Returns what a callback must return.
+static err_t
+blk_input(struct tcp_pcb *pcb)
+{
+  err_t err;
+  u32 n, i;
+
+  // Requests wait for the reply to the last one to be queued
+  while(blk.state != BLK_READ && !blk.reply_pending) {
+    if(blk.state == BLK_HDR) {
+      if(blk.hdr_have < sizeof(blk.hdr)) {
+        if(!blk.rx.p) {
+          break;
+        }
+        blk.hdr_have += tcprx_take(&blk.rx, pcb, (u8 *)&blk.hdr + blk.hdr_have,
+            sizeof(blk.hdr) - blk.hdr_have);
+      }
+      if(blk.hdr_have == sizeof(blk.hdr)) {
+        err = blk_start(pcb);
+        if(err != ERR_OK || !blk.pcb) {
+          return err;
+        }
+      }
+    } else {
+      // Whole words only; the rest of a split word waits for more data
+      n = tcprx_len(&blk.rx);
+      if(n > blk.left) {
+        n = blk.left;
+      }
+      if(n > sizeof(stage)) {
+        n = sizeof(stage);
+      }
+      n &= ~3;
+      if(n == 0) {
+        break;
+      }
+      n = tcprx_take(&blk.rx, pcb, stage, n);
+      for(i=0; i<n/4; i++) {
+        Xil_Out32(blk.addr + 4 * i, swap32(stage[i]));
+      }
+      blk.addr += n;
+      blk.left -= n;
+      if(!blk.left) {
+        blk.state = BLK_HDR;
+        blk_reply(pcb);
+      }
+    }
+  }
+  return ERR_OK;
+}
+
+static err_t
+blk_recv(void *arg, struct tcp_pcb *pcb, struct pbuf *p, err_t err)
+{
+  if(!p) {
+    return blk_close(pcb);
+  }
+
+  tcprx_add(&blk.rx, p);
+  return blk_input(pcb);
+}
+
+static err_t
+blk_sent(void *arg, struct tcp_pcb *pcb, u16_t len)
+{
+  tcpsrc_sent(&blk.tx, len);
+  if(blk.reply_pending) {
+    blk_reply(pcb);
+  }
+  if(blk.state == BLK_READ) {
+    return blk_send(pcb);
+  }
+  return blk_input(pcb);
+}
+
+static void
+blk_err(void *arg, err_t err)
+{
+  blk_reset();
+}
+
+static err_t
+blk_accept(void *arg, struct tcp_pcb *pcb, err_t err)
+{
+  if(err != ERR_OK || blk.pcb) {
+    return ERR_MEM;
+  }
+
+  // Block transfers queue behind register replies on eth0
+  pcb->tos = ETHERNETIF_TOS_BULK;
+  blk.pcb = pcb;
+  blk.state = BLK_HDR;
+  blk.hdr_have = 0;
+  blk.reply_pending = 0;
+  tcprx_init(&blk.rx);
+  tcpsrc_init(&blk.tx, pcb, NULL, NULL);
+
+  tcp_recv(pcb, blk_recv);
+  tcp_sent(pcb, blk_sent);
+  tcp_err(pcb, blk_err);
+  return ERR_OK;
+}
+
+void
+init_wbblk()
+{
+  struct tcp_pcb *pcb = tcp_new();
+
+  if(!pcb || tcp_bind(pcb, IP_ADDR_ANY, WBBLK_PORT) != ERR_OK) {
+    return;
+  }
+  pcb = tcp_listen(pcb);
+  tcp_accept(pcb, blk_accept);
+}
@@ -0,0 +1,36 @@
+#ifndef _WBBLK_H_
+#define _WBBLK_H_
+
+// wbblk.h - Bulk block transfers of Wishbone memory over TCP.
+//
+// A connection to WBBLK_PORT carries a sequence of requests, each a
+// struct wbblk_hdr.  For a read the server answers with the header
+// (status filled in) followed by `len` bytes read from the bus.  For a
+// write the client sends `len` bytes after the header and the server
+// answers with the header once they have all been written.  Addresses
+// are offsets into the window of wbreg.h, and `addr` and `len` must be
+// word aligned.  Data goes as big-endian 32-bit words, the same as
+// wbreg.h's.  A request with a bad status is answered and the connection
+// closed.
+
+#include "xil_types.h"
+
+#define WBBLK_PORT (7003)
+
+#define WBBLK_OP_READ  (0x01)
+#define WBBLK_OP_WRITE (0x02)
+
+// Status values are wbreg.h's WBREG_OK, WBREG_EOP and WBREG_EADDR
+
+struct wbblk_hdr {
+  u8 op;
+  u8 status;
+  u16 pad;
+  u32 addr;
+  u32 len;
+};
+
+// Listen on WBBLK_PORT.  Call after lwip_init().
+void init_wbblk();
+
+#endif // _WBBLK_H_
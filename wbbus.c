@@ -0,0 +1,127 @@
+// wbbus.c - Bus errors and access statistics for the Wishbone bridge (see
+// wbbus.h).
+//
+// The devices are looked up by offset in `order`, their numbers sorted by
+// offset at startup, with a binary search.  `faulted` is set by the
+// exception handler and read after each run, so it is volatile; nothing
+// else in a run depends on it.
+
+#include "crash.h"
+#include "timebase.h"
+#include "wbbus.h"
+#include "wbreg.h"
+
+#define UNMAPPED (WBBUS_REGIONS - 1)
+
+static struct wbbus_stats stats[WBBUS_REGIONS];
+static u8 order[UNMAPPED];
+static u32 num_devs;
+
+static volatile u8 faulted;
+static volatile u32 fault_count;
+static volatile u32 fault_ear;
+
+// Device number of offset `off`, or UNMAPPED
+static u32
+wbbus_region(u32 off)
+{
+  const struct wbmap_entry *e;
+  u32 lo = 0, hi = num_devs, mid;
+
+  // Last device starting at or below `off`
+  while(lo < hi) {
+    mid = (lo + hi) / 2;
+    if(wbmap_get(order[mid])->offset <= off) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  if(lo) {
+    e = wbmap_get(order[lo - 1]);
+    if(off - e->offset < e->size) {
+      return order[lo - 1];
+    }
+  }
+  return UNMAPPED;
+}
+
+void
+wbbus_begin(struct wbbus_op *op, u32 off)
+{
+  faulted = 0;
+  op->region = wbbus_region(off);
+  op->t0 = timebase_stamp();
+}
+
+int
+wbbus_end(struct wbbus_op *op, u32 words)
+{
+  struct wbbus_stats *s = &stats[op->region];
+  u32 cycles = timebase_stamp() - op->t0;
+
+  s->runs++;
+  s->words += words;
+  s->cycles += cycles;
+  if(cycles > s->max_cycles) {
+    s->max_cycles = cycles;
+  }
+  if(faulted) {
+    s->faults++;
+    return -1;
+  }
+  return 0;
+}
+
+int
+wbbus_failed()
+{
+  return faulted;
+}
+
+int
+wbbus_fault(u32 ear)
+{
+  if(ear - WBREG_BASE >= WBREG_SIZE) {
+    return 0;
+  }
+  faulted = 1;
+  fault_count++;
+  fault_ear = ear;
+  return 1;
+}
+
+const struct wbbus_stats *
+wbbus_stats(u32 n, const struct wbmap_entry **dev)
+{
+  if(n > num_devs) {
+    return NULL;
+  }
+  *dev = n < num_devs ? wbmap_get(n) : NULL;
+  return &stats[n < num_devs ? n : UNMAPPED];
+}
+
+u32
+wbbus_faults(u32 *ear)
+{
+  *ear = fault_ear;
+  return fault_count;
+}
+
+void
+init_wbbus()
+{
+  u32 i, j, n;
+
+  // Insertion sort: a handful of devices, once
+  num_devs = wbmap_count() < UNMAPPED ? wbmap_count() : UNMAPPED;
+  for(i=0; i<num_devs; i++) {
+    n = i;
+    for(j=i; j && wbmap_get(order[j - 1])->offset > wbmap_get(n)->offset;
+        j--) {
+      order[j] = order[j - 1];
+    }
+    order[j] = n;
+  }
+  crash_on_bus_error(wbbus_fault);
+}
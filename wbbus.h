@@ -0,0 +1,91 @@
+#ifndef _WBBUS_H_
+#define _WBBUS_H_
+
+// wbbus.h - Bus errors and access statistics for the Wishbone bridge.
+//
+// A Wishbone cycle no slave acknowledges, at an address the gateware does
+// not decode, holds the AXI bridge and the CPU's load or store with it.
+// Gateware that ends such a cycle with an error after a timeout (the
+// bridge's or the AXI interconnect's) answers it with SLVERR or DECERR,
+// which a processor built with data bus exceptions
+// (XPAR_MICROBLAZE_0_M_AXI_D_BUS_EXCEPTION) takes as an exception.  Its
+// handler (wbbus_fault(), through crash.h) checks that EAR is in the
+// bridge window, notes the fault and returns, so the program goes on
+// after the failed access instead of resetting: a read leaves garbage, a
+// write is lost.  A data bus error outside the window is still a crash.
+//
+// Code that accesses the bridge on someone's behalf brackets each run of
+// accesses with wbbus_begin() and wbbus_end(), which says whether any of
+// them faulted, so that the request fails at once with an error instead
+// of returning garbage: wbreg.h's WBREG_EBUS, a KATCP "fail bus_error"
+// (katcp.h), a preset script's PRESET_EBUS (preset.h).  wbbus_end() also
+// charges the run's words and timer cycles to the device of wbmap.h the
+// run started in, or to the unmapped region past the last device, for
+// KATCP's ?bus.  A fault taken by an interrupt handler inside a run fails
+// the run too.
+//
+// Built without the exception (WBBUS_FAULTS 0), faults are not caught:
+// an unanswered cycle hangs until the watchdog resets the board, as
+// before, and only the statistics remain.
+
+#include "xil_types.h"
+#include "xparameters.h"
+#include "microblaze_exceptions_g.h"
+
+#include "wbmap.h"
+
+#if defined(MICROBLAZE_EXCEPTIONS_ENABLED) && \
+    defined(XPAR_MICROBLAZE_0_M_AXI_D_BUS_EXCEPTION) && \
+    XPAR_MICROBLAZE_0_M_AXI_D_BUS_EXCEPTION
+#define WBBUS_FAULTS (1)
+#else
+#define WBBUS_FAULTS (0)
+#endif
+
+// Devices with statistics of their own, the unmapped region included
+#define WBBUS_REGIONS (16)
+
+struct wbbus_stats {
+  // Runs, words accessed and runs that faulted
+  u32 runs;
+  u32 words;
+  u32 faults;
+  // Timer cycles in all and the most one run took
+  u64 cycles;
+  u32 max_cycles;
+};
+
+// A run in progress
+struct wbbus_op {
+  u32 t0;
+  u8 region;
+};
+
+// Sort the devices for the lookup by offset and catch the bridge's bus
+// errors.  Call after init_crash().
+void init_wbbus();
+
+// Start a run of accesses at offset `off` from WBREG_BASE
+void wbbus_begin(struct wbbus_op *op, u32 off);
+
+// End the run `op`, of `words` accesses.  Returns 0, or -1 if an access
+// faulted since wbbus_begin().
+int wbbus_end(struct wbbus_op *op, u32 words);
+
+// Non-zero if an access faulted since the last wbbus_begin(), for loops
+// that should stop early
+int wbbus_failed();
+
+// The data bus exception's handler, given EAR.  Returns non-zero if the
+// fault was in the bridge window and has been noted.
+int wbbus_fault(u32 ear);
+
+// Statistics of region `n`: the devices with statistics of their own in
+// wbmap.h's order, then the unmapped region, then NULL.  `dev` is set to
+// the device, NULL for the unmapped region.
+const struct wbbus_stats *wbbus_stats(u32 n, const struct wbmap_entry **dev);
+
+// Faults since boot, and the address of the last (0 for none)
+u32 wbbus_faults(u32 *ear);
+
+#endif // _WBBUS_H_
@@ -0,0 +1,65 @@
+// wbeth.c - Register access in raw Ethernet frames.
+//
+// The reply is built over the request in the driver's RX buffer and the
+// frame sent straight back with the MAC addresses swapped, except for a
+// read whose reply outgrows the buffer, which is copied to a new pbuf.
+
+#include <string.h>
+
+#include "netif/ethernet.h"
+#include "netif/ethernetif.h"
+
+#include "wbeth.h"
+#include "wbreg.h"
+
+static void
+wbeth_input(struct netif *netif, struct pbuf *p)
+{
+  struct pbuf *r = p;
+  struct eth_hdr *e = p->payload;
+  struct wbreg_hdr *h = (struct wbreg_hdr *)(e + 1);
+  u32 have, need, len;
+
+  if(p->len < SIZEOF_ETH_HDR + sizeof(*h) || ((u32)h & 3) ||
+     (!eth_addr_cmp(&e->dest, (struct eth_addr *)netif->hwaddr) &&
+      !eth_addr_cmp(&e->dest, &ethbroadcast))) {
+    pbuf_free(p);
+    return;
+  }
+  have = (p->tot_len - SIZEOF_ETH_HDR - sizeof(*h)) / 4;
+  need = SIZEOF_ETH_HDR + wbreg_reply_len(h);
+
+  if(p->next || need > ethernetif_rx_room(p)) {
+    r = pbuf_alloc(PBUF_RAW, need > p->tot_len ? need : p->tot_len, PBUF_RAM);
+    if(!r) {
+      pbuf_free(p);
+      return;
+    }
+    pbuf_copy_partial(p, r->payload, p->tot_len, 0);
+    e = r->payload;
+    h = (struct wbreg_hdr *)(e + 1);
+  }
+
+  if(h->op == WBREG_OP_WATCH) {
+    h->status = WBREG_EOP;
+    len = sizeof(*h);
+  } else {
+    len = wbreg_exec(h, (u32 *)(h + 1), have);
+  }
+  r->len = r->tot_len = SIZEOF_ETH_HDR + len;
+
+  memcpy(&e->dest, &e->src, ETH_HWADDR_LEN);
+  memcpy(&e->src, netif->hwaddr, ETH_HWADDR_LEN);
+  netif->linkoutput(netif, r);
+
+  if(r != p) {
+    pbuf_free(r);
+  }
+  pbuf_free(p);
+}
+
+void
+init_wbeth(struct netif *netif)
+{
+  ethernetif_set_raw_input(netif, WBETH_TYPE, wbeth_input);
+}
@@ -0,0 +1,22 @@
+#ifndef _WBETH_H_
+#define _WBETH_H_
+
+// wbeth.h - Register access in raw Ethernet frames.
+//
+// Frames of EtherType WBETH_TYPE addressed to eth0 (or broadcast) carry
+// one request of wbreg.h's protocol each, from the first payload byte on,
+// and the reply comes back to the sender's MAC address the same way.
+// They are handled in the eth0 driver's input path, ahead of ARP and IP,
+// so they work before the board has an IP address and skip the IP and
+// UDP headers and checksums.  Replies are not cached, so a retransmitted
+// write runs again, and watches can only be set over UDP.
+
+#include "lwip/netif.h"
+
+// IEEE 802 local experimental EtherType 1
+#define WBETH_TYPE (0x88b5)
+
+// Start answering frames on `netif`.  Call after netif_add().
+void init_wbeth(struct netif *netif);
+
+#endif // _WBETH_H_
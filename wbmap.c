@@ -0,0 +1,178 @@
+// wbmap.c - Named devices behind the Wishbone bridge.
+//
+// A loaded table is read whole into `buf`, records and strings after room
+// for its entries, which are then made from the records in front of
+// them, the names pointing into the strings where they lie.
+
+#include <string.h>
+
+#include "xil_printf.h"
+
+#include "core_info.h"
+#include "crc32.h"
+#include "extmem.h"
+#include "flash.h"
+#include "icap.h"
+#include "log.h"
+#include "ovl.h"
+#include "slots.h"
+#include "wbmap.h"
+
+static const struct wbmap_entry builtin[] = {
+  CORE_INFO_TABLE
+};
+
+#define BUILTIN_SIZE (sizeof(builtin) / sizeof(builtin[0]))
+
+static const struct wbmap_entry *table = builtin;
+static u32 table_size = BUILTIN_SIZE;
+static int table_slot = -1;
+
+#if !EXTMEM_SIZE
+static u32 bram_buf[WBMAP_LOAD_BRAM / 4];
+#endif
+
+// Check the records and strings of `t` in `blob` and make entries of
+// them in `e`.  Returns 0, or -1 if the table is bad.
+static int
+wbmap_build(struct wbmap_entry *e, const u8 *blob,
+    const struct wbmap_trailer *t)
+{
+  const struct wbmap_rec *r = (const struct wbmap_rec *)blob;
+  const char *strings = (const char *)(r + t->count);
+  u32 i, n;
+
+  if(crc32(0, blob, t->count * sizeof(*r) + t->strings) != t->crc) {
+    return -1;
+  }
+  for(i=0; i<t->count; i++) {
+    if(r[i].name >= t->strings) {
+      return -1;
+    }
+    n = strnlen(strings + r[i].name, t->strings - r[i].name);
+    if(n == 0 || n >= WBMAP_NAME_MAX || r[i].name + n == t->strings ||
+       !(r[i].mode & WBMAP_MODE_RW) ||
+       (r[i].mode & ~(WBMAP_MODE_RW | WBMAP_MODE_SHADOW |
+                      WBMAP_MODE_ORDERED))) {
+      return -1;
+    }
+    e[i].name = strings + r[i].name;
+    e[i].offset = r[i].offset;
+    e[i].size = r[i].size;
+    e[i].mode = r[i].mode;
+    // wbmap_find() needs them in order
+    if(i && strcmp(e[i - 1].name, e[i].name) >= 0) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+void
+init_wbmap()
+{
+  const struct slot_desc *d;
+  struct wbmap_trailer t;
+  struct wbmap_entry *e;
+  u32 len, need, at;
+  u8 slot = icap_slot();
+
+  table = builtin;
+  table_size = BUILTIN_SIZE;
+  table_slot = -1;
+  if(slot >= slots.num) {
+    return;
+  }
+  d = &slots.slot[slot];
+  if(d->len < sizeof(t) ||
+     read_flash(d->addr + d->len - sizeof(t), (u8 *)&t, sizeof(t),
+       FLASH_MODE_BEST) != sizeof(t) || t.magic != WBMAP_MAGIC) {
+    return;
+  }
+  len = t.count * sizeof(struct wbmap_rec) + t.strings;
+  // Entries first, then the records and strings, word aligned
+  at = t.count * sizeof(*e);
+  need = at + ((len + 3) & ~3);
+  if(len + sizeof(t) > d->len ||
+     need > (EXTMEM_SIZE ? WBMAP_LOAD_EXT : WBMAP_LOAD_BRAM)) {
+    LOG("wbmap: slot %u table of %u bytes is too big", slot, need);
+    return;
+  }
+#if EXTMEM_SIZE
+  e = extmem_alloc(need);
+  if(!e) {
+    LOG("wbmap: no memory for slot %u table", slot);
+    return;
+  }
+#else
+  e = (struct wbmap_entry *)bram_buf;
+#endif
+  if(read_flash(d->addr + d->len - sizeof(t) - len, (u8 *)e + at, len,
+        FLASH_MODE_BEST) != len ||
+     wbmap_build(e, (const u8 *)e + at, &t) != 0) {
+    LOG("wbmap: slot %u table is bad, using the built-in one", slot);
+    return;
+  }
+  table = e;
+  table_size = t.count;
+  table_slot = slot;
+}
+
+int
+wbmap_slot()
+{
+  return table_slot;
+}
+
+u32
+wbmap_count()
+{
+  return table_size;
+}
+
+const struct wbmap_entry *
+wbmap_get(u32 n)
+{
+  return n < table_size ? &table[n] : NULL;
+}
+
+const struct wbmap_entry *
+wbmap_find(const char *name)
+{
+  u32 lo = 0, hi = table_size, mid;
+  int c;
+
+  while(lo < hi) {
+    mid = (lo + hi) / 2;
+    c = strcmp(name, table[mid].name);
+    if(c == 0) {
+      return &table[mid];
+    }
+    if(c < 0) {
+      hi = mid;
+    } else {
+      lo = mid + 1;
+    }
+  }
+  return NULL;
+}
+
+OVL_TEXT(report) void
+dump_wbmap()
+{
+  static const char modes[][3] = { "--", "r-", "-w", "rw" };
+  u32 i;
+
+  if(table_slot < 0) {
+    print("(built in)\n");
+  } else {
+    xil_printf("(from slot %d)\n", table_slot);
+  }
+  for(i=0; i<table_size; i++) {
+    xil_printf("%-20s %s 0x%05x 0x%05x%s%s\n", table[i].name,
+        modes[table[i].mode & WBMAP_MODE_RW], table[i].offset,
+        table[i].size,
+        table[i].mode & WBMAP_MODE_SHADOW ? " shadowed" : "",
+        table[i].mode & WBMAP_MODE_ORDERED ? " ordered" : "");
+  }
+}
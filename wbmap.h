@@ -0,0 +1,95 @@
+#ifndef _WBMAP_H_
+#define _WBMAP_H_
+
+// wbmap.h - Named devices behind the Wishbone bridge.
+//
+// The table is generated at build time from core_info.tab (see
+// tools/coreinfo.py) and lives in .rodata, sorted by name.  Offsets are
+// from WBREG_BASE, the same as the addresses in wbreg.h and wbblk.h.
+//
+// Each gateware revision moves devices about, so the image in a slot
+// (slots.h) may carry its own table after the bitstream, in the format
+// below, and init_wbmap() takes the one of the slot this configuration
+// was loaded from (icap_slot()) in place of the built-in table.  Activating
+// another slot changes the gateware at the next boot, and the table with
+// it, so that the two always match; nothing looks a device up before
+// init_wbmap(), and the table then stays put, so the entries found may be
+// kept.  "coreinfo.py core_info.tab core_info.h core_info.map" writes
+// the table, to go after the bitstream as in "cat top.bin core_info.map >
+// image.bin" before the upload (tftp.h).  The CORE_<NAME>_OFFSET macros
+// stay those of the build.
+//
+// The table, little-endian as the processor stores it, is `count` struct
+// wbmap_rec sorted by name in strcmp() order, then `strings` bytes of NUL
+// terminated names, then a struct wbmap_trailer, which ends the image.  A
+// table that is not sorted, has a bad name or mode or fails its CRC is
+// refused, and the built-in one stays.  It is loaded into external memory
+// where there is some, else into WBMAP_LOAD_BRAM bytes of BRAM.
+
+#include "xil_types.h"
+
+// Longest device name, with its NUL
+#define WBMAP_NAME_MAX (32)
+
+// Access modes
+#define WBMAP_MODE_R  (1)
+#define WBMAP_MODE_W  (2)
+#define WBMAP_MODE_RW (WBMAP_MODE_R | WBMAP_MODE_W)
+// Flag: mirror the device's words in BRAM (see wbshadow.h)
+#define WBMAP_MODE_SHADOW (4)
+// Flag: keep the device's writes in order (see wbpost.h)
+#define WBMAP_MODE_ORDERED (8)
+
+struct wbmap_entry {
+  const char *name;
+  u32 offset;
+  u32 size;
+  u32 mode;
+};
+
+// "WBM1" read as a little-endian word
+#define WBMAP_MAGIC     (0x314d4257)
+
+// The most a loaded table may take, with its entries, without external
+// memory and with it
+#define WBMAP_LOAD_BRAM (4096)
+#define WBMAP_LOAD_EXT  (65536)
+
+struct wbmap_rec {
+  u32 offset;
+  u32 size;
+  // Offset of the name in the strings
+  u16 name;
+  u8 mode;
+  u8 pad;
+};
+
+struct wbmap_trailer {
+  u32 magic;
+  u16 count;
+  u16 strings;
+  // CRC-32 of the records and the strings
+  u32 crc;
+};
+
+// Load the table of the slot this configuration came from, if its image
+// has one.  Call after init_icap() and init_extmem(), before anything
+// looks a device up.
+void init_wbmap();
+
+// Slot the table came from, or -1 for the built-in one
+int wbmap_slot();
+
+// Number of devices
+u32 wbmap_count();
+
+// Device `n` in name order, or NULL past the end
+const struct wbmap_entry *wbmap_get(u32 n);
+
+// The device called `name`, or NULL if there is none
+const struct wbmap_entry *wbmap_find(const char *name);
+
+// Print the table
+void dump_wbmap();
+
+#endif // _WBMAP_H_
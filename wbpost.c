@@ -0,0 +1,124 @@
+// wbpost.c - Posted writes to gateware registers (see wbpost.h).
+//
+// The queue is two arrays, offsets and values, in the order posted, so
+// that the values of a run of consecutive offsets already lie in BRAM as
+// the CDMA wants them.  Replacing a queued word is a search of the queue,
+// at most WBPOST_MAX compares, far cheaper than the bus write it saves.
+
+#include "dma.h"
+#include "log.h"
+#include "wbbus.h"
+#include "wbpost.h"
+#include "wbreg.h"
+#include "wbshadow.h"
+
+static u32 offs[WBPOST_MAX];
+static u32 vals[WBPOST_MAX];
+static u32 count;
+
+static const struct wbmap_entry *ordered[WBPOST_ORDERED];
+static u32 num_ordered;
+
+static int
+is_ordered(u32 off)
+{
+  u32 i;
+
+  for(i=0; i<num_ordered; i++) {
+    if(off - ordered[i]->offset < ordered[i]->size) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+int
+wbpost_order(const struct wbmap_entry *e)
+{
+  if(num_ordered == WBPOST_ORDERED) {
+    return -1;
+  }
+  ordered[num_ordered++] = e;
+  return 0;
+}
+
+// Issue the `n` queued writes from `first` on, to consecutive words
+static void
+issue_run(u32 first, u32 n)
+{
+  u32 off = offs[first], i;
+  void *dst = (void *)(UINTPTR)(WBREG_BASE + off);
+
+  if(!wbshadow_overlaps(off, n * 4) && dma_usable(dst, &vals[first], n * 4) &&
+     copy_dma(dst, &vals[first], n * 4) == DMA_OK) {
+    return;
+  }
+  for(i=0; i<n && !wbbus_failed(); i++) {
+    wbshadow_write(off + 4 * i, vals[first + i]);
+  }
+}
+
+int
+wbpost_fence()
+{
+  struct wbbus_op run;
+  u32 i, n;
+  int status = 0;
+
+  for(i=0; i<count && status == 0; i+=n) {
+    for(n=1; i + n < count && offs[i + n] == offs[i] + 4 * n; n++) {
+    }
+    wbbus_begin(&run, offs[i]);
+    issue_run(i, n);
+    status = wbbus_end(&run, n);
+  }
+  count = 0;
+  return status;
+}
+
+int
+wbpost_write(u32 off, u32 value)
+{
+  struct wbbus_op run;
+  u32 i;
+  int status = 0;
+
+  if(is_ordered(off)) {
+    status = wbpost_fence();
+    wbbus_begin(&run, off);
+    wbshadow_write(off, value);
+    return wbbus_end(&run, 1) != 0 ? -1 : status;
+  }
+  for(i=0; i<count; i++) {
+    if(offs[i] == off) {
+      vals[i] = value;
+      return 0;
+    }
+  }
+  if(count == WBPOST_MAX) {
+    status = wbpost_fence();
+  }
+  offs[count] = off;
+  vals[count] = value;
+  count++;
+  return status;
+}
+
+u32
+wbpost_pending()
+{
+  return count;
+}
+
+void
+init_wbpost()
+{
+  const struct wbmap_entry *e;
+  u32 i;
+
+  for(i=0; (e = wbmap_get(i)); i++) {
+    if((e->mode & WBMAP_MODE_ORDERED) && wbpost_order(e) != 0) {
+      LOG("wbpost: no room to order device %u", i);
+    }
+  }
+}
@@ -0,0 +1,52 @@
+#ifndef _WBPOST_H_
+#define _WBPOST_H_
+
+// wbpost.h - Posted writes to gateware registers, issued in bulk.
+//
+// A bulk configuration (a wbreg.h batch, a preset script of preset.h) is
+// mostly independent register writes, each of which holds the CPU until
+// its write response comes back through the bridge.  Writes posted here
+// are queued in BRAM instead and issued together at the next fence:
+// runs of consecutive words the CDMA can copy go out as one burst
+// (dma.h), the rest back to back from a tight loop.  A write to a word
+// already queued replaces it, so only the last value reaches the bus.
+//
+// Order is kept only where the register map asks for it: writes to a
+// device marked WBMAP_MODE_ORDERED (8 added to its mode in core_info.tab,
+// see tools/coreinfo.py) fence the queue and go out at once, so they are
+// ordered against every write before and after them.  Other queued writes
+// may reach the bus in any order, and merged.  Callers fence before a
+// read, a poll or a delay that depends on the writes, and at the end of
+// the request; nothing fences by itself.  Shadowed words (wbshadow.h) go
+// through the mirror when issued.
+
+#include "xil_types.h"
+
+#include "wbmap.h"
+
+// Writes queued at most; posting one more fences first
+#define WBPOST_MAX (32)
+
+// Devices marked ordered at most
+#define WBPOST_ORDERED (8)
+
+// Note the devices of wbmap.h marked WBMAP_MODE_ORDERED
+void init_wbpost();
+
+// Treat device `e`'s writes as ordered.  Returns 0, or -1 if there is no
+// room.
+int wbpost_order(const struct wbmap_entry *e);
+
+// Queue a write of `value` to the word at offset `off` from WBREG_BASE
+// (word aligned, within the bridge window).  Returns 0, or -1 if a write
+// this issued met a bus error (see wbbus.h).
+int wbpost_write(u32 off, u32 value);
+
+// Issue every queued write and wait for them.  Returns 0, or -1 if one met
+// a bus error; the queue is empty either way.
+int wbpost_fence();
+
+// Writes queued
+u32 wbpost_pending();
+
+#endif // _WBPOST_H_
@@ -0,0 +1,842 @@
+// wbreg.c - UDP access to gateware registers behind the Wishbone bridge.
+//
+// Requests are answered in the receive pbuf: the reply is written over the
+// request and the pbuf sent straight back, so the common case allocates
+// nothing but the header pbuf lwIP prepends to a PBUF_REF payload.  Only a
+// read whose reply does not fit in the receive buffer gets a new pbuf.
+// Replies are copied into the client's session before they go, and a
+// retransmit is answered with a new pbuf from there.
+
+#include <string.h>
+
+#include "xil_io.h"
+
+#include "lwip/igmp.h"
+#include "lwip/ip.h"
+#include "lwip/stats.h"
+#include "lwip/udp.h"
+#include "netif/ethernetif.h"
+
+#include "bswap.h"
+#include "dma.h"
+#include "perf.h"
+#include "spi.h"
+#include "timebase.h"
+#include "wbbus.h"
+#include "wbpost.h"
+#include "wbreg.h"
+#include "wbshadow.h"
+#include "wbtimed.h"
+#include "wbwatch.h"
+
+static struct udp_pcb *wbreg_pcb;
+
+// Kinds of struct wbreg_cached
+#define CACHED_FREE  (0)
+#define CACHED_REPLY (1) // the reply is in `data`
+#define CACHED_RERUN (2) // too long, but running it again is harmless
+#define CACHED_LOST  (3) // too long, and not safe to run again
+
+struct wbreg_cached {
+  // Request id, as it came
+  u32 id;
+  u16 len;
+  u8 kind;
+  u32 data[WBREG_CACHE_BYTES / 4];
+};
+
+struct wbreg_session {
+  ip_addr_t addr;
+  u16_t port; // 0 for a free slot
+  // timebase_ms() of the last request
+  u32 used_ms;
+  // Next cache slot to fill
+  u32 next;
+  struct wbreg_cached cache[WBREG_CACHE];
+  // Driver stamps (ethernetif_tx_stamp()) of the last stamped reply, on
+  // `stamp_netif` (NULL for none), and its request id
+  struct netif *stamp_netif;
+  u32 stamp;
+  u32 stamp_id;
+};
+
+static struct wbreg_session sessions[WBREG_SESSIONS];
+
+// Session of `addr`:`port`, taking over the least recently used one if it
+// has none
+static struct wbreg_session *
+wbreg_session(const ip_addr_t *addr, u16_t port)
+{
+  struct wbreg_session *s, *lru = &sessions[0];
+  u32 now = timebase_ms();
+  u32 i;
+
+  for(i=0, s=sessions; i<WBREG_SESSIONS; i++, s++) {
+    if(s->port == port && ip_addr_cmp(&s->addr, addr)) {
+      s->used_ms = now;
+      return s;
+    }
+    if(!s->port || (lru->port && now - s->used_ms > now - lru->used_ms)) {
+      lru = s;
+    }
+  }
+  memset(lru, 0, sizeof(*lru));
+  ip_addr_copy(lru->addr, *addr);
+  lru->port = port;
+  lru->used_ms = now;
+  return lru;
+}
+
+static struct wbreg_cached *
+wbreg_cached(struct wbreg_session *s, u32 id)
+{
+  u32 i;
+
+  for(i=0; i<WBREG_CACHE; i++) {
+    if(s->cache[i].kind != CACHED_FREE && s->cache[i].id == id) {
+      return &s->cache[i];
+    }
+  }
+  return NULL;
+}
+
+// Remember reply `h` of `len` bytes to request `id`
+static void
+wbreg_remember(struct wbreg_session *s, u32 id, const struct wbreg_hdr *h,
+    u32 len)
+{
+  struct wbreg_cached *c = wbreg_cached(s, id);
+
+  if(!c) {
+    c = &s->cache[s->next];
+    s->next = (s->next + 1) % WBREG_CACHE;
+  }
+  c->id = id;
+  c->len = 0;
+  if(len <= sizeof(c->data)) {
+    c->kind = CACHED_REPLY;
+    c->len = len;
+    memcpy(c->data, h, len);
+  } else if((h->op & ~(WBREG_OP_STAMPS | WBREG_OP_PACK)) == WBREG_OP_READ ||
+             (h->op & ~WBREG_OP_STAMPS) == WBREG_OP_LIST) {
+    c->kind = CACHED_RERUN;
+  } else {
+    c->kind = CACHED_LOST;
+  }
+}
+
+// Answer a retransmit of `p` from `c`.  Returns 0 if it was answered, -1
+// if the request should just run again.
+static int
+wbreg_replay(struct udp_pcb *pcb, struct pbuf *p, const struct wbreg_cached *c,
+    const ip_addr_t *addr, u16_t port)
+{
+  struct wbreg_hdr *h;
+  struct pbuf *r;
+
+  if(c->kind == CACHED_RERUN) {
+    return -1;
+  }
+  if(c->kind == CACHED_REPLY) {
+    r = pbuf_alloc(PBUF_TRANSPORT, c->len, PBUF_RAM);
+    if(r) {
+      pbuf_take(r, c->data, c->len);
+      udp_sendto(pcb, r, addr, port);
+      pbuf_free(r);
+    }
+    return 0;
+  }
+  // The request header is still there to answer with
+  h = p->payload;
+  h->status = WBREG_EDUP;
+  h->count = 0;
+  p->len = p->tot_len = sizeof(*h);
+  udp_sendto(pcb, p, addr, port);
+  return 0;
+}
+
+// Run the `count` batch entries behind `h` (`have` words arrived), leaving
+// the results over them.  Returns the number of result words.
+static u32
+wbreg_batch(struct wbreg_hdr *h, u32 *words, u32 count, u32 have)
+{
+  const struct wbreg_entry *entries = (const struct wbreg_entry *)words;
+  struct wbreg_entry e;
+  struct wbbus_op op;
+  u32 i, v, t0;
+
+  if(have < count * (sizeof(e) / 4)) {
+    h->status = WBREG_ELEN;
+    return 0;
+  }
+
+  for(i=0; i<count; i++) {
+    // Result i overwrites the start of entry i; nothing after it
+    e = entries[i];
+    e.addr = swap32(e.addr);
+    e.value = swap32(e.value);
+    e.mask = swap32(e.mask);
+    if((e.addr & 3) || e.addr >= WBREG_SIZE) {
+      h->status = WBREG_EADDR;
+      break;
+    }
+
+    // Writes are posted (wbpost.h) until an entry that reads, or the end
+    if(e.op == WBREG_B_WRITE) {
+      if(wbpost_write(e.addr, e.value) != 0) {
+        h->status = WBREG_EBUS;
+        break;
+      }
+      words[i] = 0;
+      continue;
+    }
+    if(wbpost_fence() != 0) {
+      h->status = WBREG_EBUS;
+      break;
+    }
+
+    v = 0;
+    wbbus_begin(&op, e.addr);
+    switch(e.op) {
+    case WBREG_B_READ:
+      v = wbshadow_read(e.addr);
+      break;
+    case WBREG_B_RMW:
+      v = wbshadow_rmw(e.addr, e.mask, e.value);
+      break;
+    case WBREG_B_WAIT:
+      // Always from the bus: the gateware is what changes the word
+      t0 = (u32)timebase_us();
+      while(((v = Xil_In32(WBREG_BASE + e.addr)) & e.mask) != e.value &&
+            !wbbus_failed()) {
+        if((u32)timebase_us() - t0 > swap16(e.timeout_us)) {
+          h->status = WBREG_ETIMEDOUT;
+          break;
+        }
+      }
+      break;
+    default:
+      h->status = WBREG_EOP;
+      break;
+    }
+    if(wbbus_end(&op, 1) != 0) {
+      h->status = WBREG_EBUS;
+    }
+    if(h->status != WBREG_OK) {
+      break;
+    }
+    words[i] = swap32(v);
+  }
+  if(wbpost_fence() != 0 && h->status == WBREG_OK) {
+    h->status = WBREG_EBUS;
+  }
+
+  h->count = swap16(i);
+  return i;
+}
+
+static void
+wbreg_dev(struct wbreg_dev *d, const struct wbmap_entry *e)
+{
+  memset(d, 0, sizeof(*d));
+  d->offset = swap32(e->offset);
+  d->size = swap32(e->size);
+  d->mode = e->mode;
+  strncpy(d->name, e->name, sizeof(d->name) - 1);
+}
+
+// Look up the `len` byte name behind `h` (`have` words arrived) and leave
+// its device over it.  Returns the number of reply words.
+static u32
+wbreg_lookup(struct wbreg_hdr *h, u32 *words, u32 len, u32 have)
+{
+  const struct wbmap_entry *e;
+  char name[WBMAP_NAME_MAX];
+
+  if(len > have * 4) {
+    h->status = WBREG_ELEN;
+    return 0;
+  }
+  if(len >= sizeof(name)) {
+    h->status = WBREG_ENOENT;
+    return 0;
+  }
+  memcpy(name, words, len);
+  name[len] = 0;
+  e = wbmap_find(name);
+  if(!e) {
+    h->status = WBREG_ENOENT;
+    return 0;
+  }
+  wbreg_dev((struct wbreg_dev *)words, e);
+  return sizeof(struct wbreg_dev) / 4;
+}
+
+// List up to `count` devices from number `first` on behind `h`.  Returns
+// the number of reply words.
+static u32
+wbreg_list(struct wbreg_hdr *h, u32 *words, u32 count, u32 first)
+{
+  struct wbreg_dev *d = (struct wbreg_dev *)words;
+  const struct wbmap_entry *e;
+  u32 i;
+
+  if(count > WBREG_MAX_DEVS) {
+    count = WBREG_MAX_DEVS;
+  }
+  for(i=0; i<count && (e = wbmap_get(first + i)); i++) {
+    wbreg_dev(&d[i], e);
+  }
+  h->count = swap16(i);
+  h->addr = swap32(wbmap_count());
+  return i * (sizeof(*d) / 4);
+}
+
+// Copy lwIP's cycle counts behind `h`, zeroing them if `clear`.  Returns
+// the number of reply words.
+static u32
+wbreg_cycles(struct wbreg_hdr *h, u32 *words, u32 clear)
+{
+#if LWIP_CYCLE_STATS
+  struct wbreg_cycles *c = (struct wbreg_cycles *)words;
+  u32 i;
+
+  for(i=0; i<CYCLES_NUM_LAYERS; i++) {
+    c[i].calls = swap32(lwip_cycle_stats.layer[i].calls);
+    c[i].cycles = swap32(lwip_cycle_stats.layer[i].cycles);
+  }
+  if(clear) {
+    stats_cycles_reset();
+  }
+  h->count = swap16(CYCLES_NUM_LAYERS);
+  h->addr = swap32(TIMEBASE_HZ);
+  return CYCLES_NUM_LAYERS * (sizeof(*c) / 4);
+#else
+  h->status = WBREG_EOP;
+  return 0;
+#endif
+}
+
+// Copy the perf.h counts behind `h`, zeroing them if `clear`.  Returns the
+// number of reply words.
+static u32
+wbreg_perf(struct wbreg_hdr *h, u32 *words, u32 clear)
+{
+#if PERF_ENABLE
+  static struct perf_stats s;
+  struct wbreg_perf *p = (struct wbreg_perf *)words;
+  u32 i, b;
+
+  for(i=0; i<PERF_NUM_SITES; i++, p++) {
+    perf_read(i, &s);
+    p->count = swap32(s.count);
+    p->min = swap32(s.min);
+    p->max = swap32(s.max);
+    p->sum_hi = swap32((u32)(s.sum >> 32));
+    p->sum_lo = swap32((u32)s.sum);
+    for(b=0; b<PERF_BUCKETS; b++) {
+      p->hist[b] = swap32(s.hist[b]);
+    }
+  }
+  if(clear) {
+    perf_reset();
+  }
+  h->count = swap16(PERF_NUM_SITES);
+  h->addr = swap32(TIMEBASE_HZ);
+  return PERF_NUM_SITES * (sizeof(*p) / 4);
+#else
+  h->status = WBREG_EOP;
+  return 0;
+#endif
+}
+
+// Copy the SPI statistics behind `h`, zeroing them if `clear`.  Returns
+// the number of reply words.
+static u32
+wbreg_spi(struct wbreg_hdr *h, u32 *words, u32 clear)
+{
+  struct wbreg_spi *s = (struct wbreg_spi *)words;
+
+  s->xfers = swap32(spi_stats.xfers);
+  s->bytes = swap32(spi_stats.bytes);
+  s->timeouts = swap32(spi_stats.timeouts);
+  s->overruns = swap32(spi_stats.overruns);
+  s->mode_faults = swap32(spi_stats.mode_faults);
+  s->polls = swap32(spi_stats.polls);
+  s->busy_hi = swap32((u32)(spi_stats.busy_cycles >> 32));
+  s->busy_lo = swap32((u32)spi_stats.busy_cycles);
+  if(clear) {
+    memset(&spi_stats, 0, sizeof(spi_stats));
+  }
+  h->count = swap16(1);
+  h->addr = swap32(TIMEBASE_HZ);
+  return sizeof(*s) / 4;
+}
+
+// Set or clear the watch on `addr` for request `h`
+static void
+wbreg_watch(struct wbreg_hdr *h, u32 *words, u32 addr, u32 count, u32 have)
+{
+  if((addr & 3) || addr >= WBREG_SIZE) {
+    h->status = WBREG_EADDR;
+  } else if(h->op == WBREG_OP_UNWATCH) {
+    if(wbwatch_remove(WBREG_BASE + addr) != 0) {
+      h->status = WBREG_ENOENT;
+    }
+  } else if(have < 1) {
+    h->status = WBREG_ELEN;
+  } else if(wbwatch_add(WBREG_BASE + addr, swap32(words[0]), count) != 0) {
+    h->status = WBREG_ENOSPC;
+  }
+}
+
+// Queue the timed write of request `h`, `count` words from `addr`
+static void
+wbreg_at(struct wbreg_hdr *h, u32 *words, u32 addr, u32 count, u32 have)
+{
+  u32 i, handle;
+  u64 utc_ns;
+  int err;
+
+  if(count < 1 || count > WBTIMED_WORDS || have < 2 + count) {
+    h->status = WBREG_ELEN;
+    return;
+  }
+  // Mirrored words need the main loop (wbshadow.h)
+  if((addr & 3) || addr + (count - 1) * 4 >= WBREG_SIZE ||
+     wbshadow_overlaps(addr, count * 4)) {
+    h->status = WBREG_EADDR;
+    return;
+  }
+  utc_ns = (u64)swap32(words[0]) * 1000000000 + swap32(words[1]);
+  for(i=0; i<count; i++) {
+    words[i] = swap32(words[2 + i]);
+  }
+  err = wbtimed_add(addr, words, count, utc_ns, &handle);
+  if(err == -1) {
+    h->status = WBREG_ENOSPC;
+  } else if(err != 0) {
+    h->status = WBREG_ETIME;
+  } else {
+    h->addr = swap32(handle);
+  }
+}
+
+// Fill `words` with the timed writes
+static u32
+wbreg_at_list(struct wbreg_hdr *h, u32 *words)
+{
+  struct wbreg_at *a = (struct wbreg_at *)words;
+  const struct wbtimed_write *w;
+  u32 i, n = 0;
+
+  for(i=0; i<WBTIMED_MAX; i++) {
+    if(!(w = wbtimed_get(i))) {
+      continue;
+    }
+    a[n].handle = swap32(w->handle);
+    a[n].state = swap32(w->state);
+    a[n].sec = swap32((u32)(w->utc_ns / 1000000000));
+    a[n].ns = swap32((u32)(w->utc_ns % 1000000000));
+    a[n].addr = swap32(w->addr);
+    a[n].skew_ns = swap32(w->skew_ns);
+    n++;
+  }
+  h->count = swap16(n);
+  return n * sizeof(*a) / 4;
+}
+
+// Join or leave the multicast group `addr` (host order) for request `h`
+static void
+wbreg_group(struct wbreg_hdr *h, u32 addr)
+{
+  ip4_addr_t group;
+  err_t err;
+
+  // 224.0.0.0/24 (all-systems, mDNS) is the stack's own
+  ip4_addr_set_u32(&group, swap32(addr));
+  if(!ip4_addr_ismulticast(&group) || (addr & 0xffffff00) == 0xe0000000) {
+    h->status = WBREG_EADDR;
+    return;
+  }
+  if(h->op == WBREG_OP_JOIN) {
+    err = igmp_joingroup(IP4_ADDR_ANY4, &group);
+  } else {
+    err = igmp_leavegroup(IP4_ADDR_ANY4, &group);
+  }
+  if(err != ERR_OK) {
+    h->status = h->op == WBREG_OP_JOIN ? WBREG_ENOSPC : WBREG_ENOENT;
+  }
+}
+
+// Packs the words of a WBREG_OP_PACK read into `out` as they are read.
+// The last words, `same` of `v`, wait to see how long their run gets:
+// long enough, they go out as a run of their own, or else onto the
+// literal run whose control word is at `lit`.
+struct wbreg_pack {
+  u32 *out;
+  u32 len;
+  u32 lit;
+  u32 lit_len;
+  u32 v;
+  u32 same;
+  u8 full;
+};
+
+static void
+pack_put(struct wbreg_pack *k, u32 w)
+{
+  if(k->len == WBREG_MAX_WORDS) {
+    k->full = 1;
+    return;
+  }
+  k->out[k->len++] = swap32(w);
+}
+
+// Put out the run waiting in `k`
+static void
+pack_flush(struct wbreg_pack *k)
+{
+  u32 n = k->same;
+
+  k->same = 0;
+  if(!n) {
+    return;
+  }
+  if(n >= (k->v ? WBREG_PACK_MIN_REPEAT : WBREG_PACK_MIN_ZERO)) {
+    k->lit_len = 0;
+    pack_put(k, (k->v ? WBREG_PACK_REPEAT : WBREG_PACK_ZERO) | n);
+    if(k->v) {
+      pack_put(k, k->v);
+    }
+    return;
+  }
+  if(!k->lit_len) {
+    k->lit = k->len;
+    pack_put(k, WBREG_PACK_LITERAL);
+  }
+  k->lit_len += n;
+  while(n--) {
+    pack_put(k, k->v);
+  }
+  if(!k->full) {
+    k->out[k->lit] = swap32(WBREG_PACK_LITERAL | k->lit_len);
+  }
+}
+
+static void
+pack_word(struct wbreg_pack *k, u32 w)
+{
+  if(k->same && w == k->v) {
+    k->same++;
+    return;
+  }
+  pack_flush(k);
+  k->v = w;
+  k->same = 1;
+}
+
+// Read `count` words from `addr` into `words` packed, through the mirror
+// if `shadow`.  Returns the packed words, or 0 with WBREG_ELEN if they do
+// not fit.
+static u32
+wbreg_read_packed(struct wbreg_hdr *h, u32 *words, u32 addr, u32 count,
+    u32 step, int shadow)
+{
+  struct wbreg_pack k;
+  u32 i;
+
+  memset(&k, 0, sizeof(k));
+  k.out = words;
+  for(i=0; i<count && !k.full && !wbbus_failed(); i++, addr+=step) {
+    pack_word(&k, shadow ? wbshadow_read(addr - WBREG_BASE) :
+        Xil_In32(addr));
+  }
+  pack_flush(&k);
+  if(k.full) {
+    h->status = WBREG_ELEN;
+    return 0;
+  }
+  return k.len;
+}
+
+u32
+wbreg_exec(struct wbreg_hdr *h, u32 *words, u32 have)
+{
+  u32 count = swap16(h->count);
+  u32 addr = swap32(h->addr);
+  u32 step = h->op & WBREG_OP_NOINC ? 0 : 4;
+  u32 last = addr + (count ? count - 1 : 0) * step;
+  u32 i, reply = 0;
+  struct wbbus_op run;
+  int shadow;
+
+  h->status = WBREG_OK;
+  if(h->op == WBREG_OP_BATCH) {
+    return sizeof(*h) + wbreg_batch(h, words, count, have) * 4;
+  }
+  if(h->op == WBREG_OP_LOOKUP) {
+    return sizeof(*h) + wbreg_lookup(h, words, count, have) * 4;
+  }
+  if(h->op == WBREG_OP_LIST) {
+    return sizeof(*h) + wbreg_list(h, words, count, addr) * 4;
+  }
+  if(h->op == WBREG_OP_WATCH || h->op == WBREG_OP_UNWATCH) {
+    wbreg_watch(h, words, addr, count, have);
+    return sizeof(*h);
+  }
+  if(h->op == WBREG_OP_CYCLES) {
+    return sizeof(*h) + wbreg_cycles(h, words, addr) * 4;
+  }
+  if(h->op == WBREG_OP_PERF) {
+    return sizeof(*h) + wbreg_perf(h, words, addr) * 4;
+  }
+  if(h->op == WBREG_OP_SPI) {
+    return sizeof(*h) + wbreg_spi(h, words, addr) * 4;
+  }
+  if(h->op == WBREG_OP_JOIN || h->op == WBREG_OP_LEAVE) {
+    wbreg_group(h, addr);
+    return sizeof(*h);
+  }
+  if(h->op == WBREG_OP_AT) {
+    wbreg_at(h, words, addr, count, have);
+    return sizeof(*h);
+  }
+  if(h->op == WBREG_OP_AT_LIST) {
+    return sizeof(*h) + wbreg_at_list(h, words) * 4;
+  }
+  if((addr & 3) || last < addr || last >= WBREG_SIZE) {
+    h->status = WBREG_EADDR;
+    return sizeof(*h);
+  }
+  if(count > WBREG_MAX_WORDS &&
+     (h->op & ~WBREG_OP_NOINC) != (WBREG_OP_READ | WBREG_OP_PACK)) {
+    h->status = WBREG_ELEN;
+    return sizeof(*h);
+  }
+  switch(h->op & ~WBREG_OP_NOINC) {
+  case WBREG_OP_READ:
+  case WBREG_OP_READ | WBREG_OP_PACK:
+    break;
+  case WBREG_OP_WRITE:
+    if(have < count) {
+      h->status = WBREG_ELEN;
+      return sizeof(*h);
+    }
+    break;
+  default:
+    h->status = WBREG_EOP;
+    return sizeof(*h);
+  }
+  // Mirrored words (wbshadow.h) go one at a time, through the mirror
+  shadow = wbshadow_overlaps(addr, last - addr + 4);
+  wbbus_begin(&run, addr);
+  addr += WBREG_BASE;
+
+  if(h->op & WBREG_OP_PACK) {
+    reply = wbreg_read_packed(h, words, addr, count, step, shadow);
+  } else if((h->op & ~WBREG_OP_NOINC) == WBREG_OP_READ) {
+    reply = count;
+    if(shadow) {
+      for(i=0; i<count; i++, addr+=step) {
+        words[i] = swap32(wbshadow_read(addr - WBREG_BASE));
+      }
+    } else if(step && dma_usable(words, (void *)addr, count * 4) &&
+              copy_dma(words, (void *)addr, count * 4) == DMA_OK) {
+      // A block the CDMA can fetch is swapped in place after it; the CPU
+      // reads it again after a DMA error
+      for(i=0; i<count; i++) {
+        words[i] = swap32(words[i]);
+      }
+    } else {
+      for(i=0; i<count && !wbbus_failed(); i++, addr+=step) {
+        words[i] = swap32(Xil_In32(addr));
+      }
+    }
+  } else if(shadow) {
+    for(i=0; i<count && !wbbus_failed(); i++, addr+=step) {
+      wbshadow_write(addr - WBREG_BASE, swap32(words[i]));
+    }
+  } else if(step && dma_usable((void *)addr, words, count * 4)) {
+    // Swapped in place for the CDMA, as the reply does not carry them
+    for(i=0; i<count; i++) {
+      words[i] = swap32(words[i]);
+    }
+    if(copy_dma((void *)addr, words, count * 4) != DMA_OK) {
+      for(i=0; i<count && !wbbus_failed(); i++, addr+=step) {
+        Xil_Out32(addr, words[i]);
+      }
+    }
+  } else {
+    for(i=0; i<count && !wbbus_failed(); i++, addr+=step) {
+      Xil_Out32(addr, swap32(words[i]));
+    }
+  }
+  // A faulted access fails the request rather than return what it read
+  if(wbbus_end(&run, count) != 0) {
+    h->status = WBREG_EBUS;
+    reply = 0;
+  }
+  return sizeof(*h) + reply * 4;
+}
+
+u32
+wbreg_reply_len(const struct wbreg_hdr *h)
+{
+  u32 count = swap16(h->count);
+
+  if(h->op == WBREG_OP_LOOKUP) {
+    return sizeof(*h) + sizeof(struct wbreg_dev);
+  }
+  if(h->op == WBREG_OP_LIST) {
+    return sizeof(*h) +
+        (count < WBREG_MAX_DEVS ? count : WBREG_MAX_DEVS) *
+        sizeof(struct wbreg_dev);
+  }
+#if LWIP_CYCLE_STATS
+  if(h->op == WBREG_OP_CYCLES) {
+    return sizeof(*h) + CYCLES_NUM_LAYERS * sizeof(struct wbreg_cycles);
+  }
+#endif
+#if PERF_ENABLE
+  if(h->op == WBREG_OP_PERF) {
+    return sizeof(*h) + PERF_NUM_SITES * sizeof(struct wbreg_perf);
+  }
+#endif
+  if(h->op == WBREG_OP_SPI) {
+    return sizeof(*h) + sizeof(struct wbreg_spi);
+  }
+  if(h->op == WBREG_OP_AT_LIST) {
+    return sizeof(*h) + WBTIMED_MAX * sizeof(struct wbreg_at);
+  }
+  if((h->op & ~WBREG_OP_NOINC) == (WBREG_OP_READ | WBREG_OP_PACK)) {
+    return sizeof(*h) +
+        (count < WBREG_MAX_WORDS ? count + 1 : WBREG_MAX_WORDS) * 4;
+  }
+  if((h->op == WBREG_OP_BATCH ||
+      (h->op & ~WBREG_OP_NOINC) == WBREG_OP_READ) &&
+     count <= WBREG_MAX_WORDS) {
+    return sizeof(*h) + count * 4;
+  }
+  return sizeof(*h);
+}
+
+// Fill in the trailer `t` of the reply to request `id` from `netif`,
+// which arrived at driver stamp `rx` and started at `start`
+static void
+wbreg_stamps(struct wbreg_stamps *t, struct wbreg_session *s, u32 id,
+    struct netif *netif, u32 rx, u32 start)
+{
+  u32 sent = 0, done = 0;
+  int flags = -1;
+
+  if(s->stamp_netif) {
+    flags = ethernetif_tx_stamps(s->stamp_netif, s->stamp, &sent, &done);
+  }
+  t->hz = swap32(TIMEBASE_HZ);
+  t->rx = swap32(rx);
+  t->start = swap32(start);
+  t->prev_id = s->stamp_netif ? s->stamp_id : 0;
+  t->prev_flags = swap32(flags > 0 ? flags : 0);
+  t->prev_sent = swap32(sent);
+  t->prev_done = swap32(done);
+  s->stamp_netif = netif;
+  s->stamp_id = id;
+  t->reply = swap32(timebase_stamp());
+}
+
+static void
+wbreg_recv(void *arg, struct udp_pcb *pcb, struct pbuf *p,
+    const ip_addr_t *addr, u16_t port)
+{
+  struct wbreg_session *s;
+  struct wbreg_cached *c;
+  struct netif *netif = ip_current_input_netif();
+  struct pbuf *r = p;
+  struct wbreg_hdr *h;
+  u32 id, need, len, rx = 0, start = timebase_stamp();
+  u8 stamps;
+  PERF_BEGIN(PERF_WBREG);
+
+  if(p->len < sizeof(*h) || ((u32)p->payload & 3)) {
+    pbuf_free(p);
+    return;
+  }
+  h = p->payload;
+  id = h->id;
+  s = wbreg_session(addr, port);
+  c = wbreg_cached(s, id);
+  if(c && wbreg_replay(pcb, p, c, addr, port) == 0) {
+    pbuf_free(p);
+    return;
+  }
+  // The trailer is UDP's alone: wbreg_exec() sees the bare opcode
+  stamps = h->op & WBREG_OP_STAMPS;
+  h->op &= ~WBREG_OP_STAMPS;
+  need = wbreg_reply_len(h);
+  if(stamps && need + sizeof(struct wbreg_stamps) <= ETH_UDP_MAX) {
+    need += sizeof(struct wbreg_stamps);
+  } else {
+    stamps = 0;
+  }
+  if(netif && !ethernetif_is(netif)) {
+    netif = NULL;
+  }
+  if(netif) {
+    rx = ethernetif_rx_stamp(netif);
+  }
+
+  // No room to reply in place: copy the request to a new pbuf big enough
+  // for either
+  if(p->next || need > ethernetif_rx_room(p)) {
+    r = pbuf_alloc(PBUF_TRANSPORT, need > p->tot_len ? need : p->tot_len,
+        PBUF_RAM);
+    if(!r) {
+      pbuf_free(p);
+      return;
+    }
+    pbuf_copy_partial(p, r->payload, p->tot_len, 0);
+    h = r->payload;
+  }
+
+  len = wbreg_exec(h, (u32 *)(h + 1), (p->tot_len - sizeof(*h)) / 4);
+  if(h->op == WBREG_OP_WATCH && h->status == WBREG_OK) {
+    wbwatch_subscribe(pcb, addr, port);
+  }
+  if(stamps) {
+    h->op |= WBREG_OP_STAMPS;
+    wbreg_stamps((struct wbreg_stamps *)((u8 *)h + len), s, id, netif, rx,
+        start);
+    len += sizeof(struct wbreg_stamps);
+  }
+  r->len = r->tot_len = len;
+  wbreg_remember(s, id, h, len);
+
+  if(stamps && netif) {
+    s->stamp = ethernetif_tx_stamp(netif, r);
+  }
+  udp_sendto(pcb, r, addr, port);
+  if(r != p) {
+    pbuf_free(r);
+  }
+  pbuf_free(p);
+  PERF_END(PERF_WBREG);
+}
+
+void
+init_wbreg()
+{
+  wbreg_pcb = udp_new();
+  if(!wbreg_pcb || udp_bind(wbreg_pcb, IP_ADDR_ANY, WBREG_PORT) != ERR_OK) {
+    return;
+  }
+  udp_recv(wbreg_pcb, wbreg_recv, NULL);
+}
+
+void
+wbreg_subscribe(const ip_addr_t *addr, u16_t port)
+{
+  if(wbreg_pcb) {
+    wbwatch_subscribe(wbreg_pcb, addr, port);
+  }
+}
@@ -0,0 +1,296 @@
+#ifndef _WBREG_H_
+#define _WBREG_H_
+
+// wbreg.h - UDP access to gateware registers behind the Wishbone bridge.
+//
+// Each datagram to WBREG_PORT is one request: a struct wbreg_hdr, followed
+// for writes by `count` data words.  The reply goes back to the sender
+// with the same header, `status` filled in, followed for reads by the
+// words read.  All fields and data words are big-endian.
+//
+// Addresses are byte offsets from XPAR_AXI_SLAVE_WISHBONE_CLASSIC_MASTER_0
+// _BASEADDR and must be word aligned.  Accesses are 32 bits wide.
+//
+// Boards that joined a multicast group (WBREG_OP_JOIN) all run the
+// requests sent to it: one datagram configures a whole rack, each board
+// replying on its own.
+//
+// Each client (IP address and port) gets a session that remembers its last
+// WBREG_CACHE replies by request `id`.  A request whose `id` matches one
+// of them is a retransmit: it is answered from the cache without touching
+// the bus again, so a lost reply never runs a write twice.  Clients should
+// use a new `id` for every request.  Replies longer than
+// WBREG_CACHE_BYTES are not kept: a retransmitted read is simply run
+// again, and anything else gets WBREG_EDUP.
+//
+// The devices of wbmap.h can be looked up by name, or listed, so hosts
+// need not be rebuilt when the gateware layout changes: resolve the names
+// once per session and use the offsets from then on.
+
+#include "lwip/ip_addr.h"
+
+#include "xparameters.h"
+#include "xil_types.h"
+
+#include "eth.h"
+#include "perf.h"
+
+#include "wbmap.h"
+
+#define WBREG_PORT (7000)
+
+#define WBREG_BASE XPAR_AXI_SLAVE_WISHBONE_CLASSIC_MASTER_0_BASEADDR
+#define WBREG_SIZE (XPAR_AXI_SLAVE_WISHBONE_CLASSIC_MASTER_0_HIGHADDR - \
+    WBREG_BASE + 1)
+
+// Opcodes
+#define WBREG_OP_READ   (0x01) // read `count` words
+#define WBREG_OP_WRITE  (0x02) // write `count` words
+#define WBREG_OP_BATCH  (0x03) // run `count` struct wbreg_entry (`addr` is
+                               // unused)
+#define WBREG_OP_LOOKUP (0x04) // find the device named by the `count` bytes
+                               // of data (padded with zeroes to a whole
+                               // word); the reply carries its struct
+                               // wbreg_dev
+#define WBREG_OP_LIST   (0x05) // list up to `count` devices from number
+                               // `addr` on; the reply's `count` is the
+                               // number of struct wbreg_dev that follow and
+                               // its `addr` the number of devices in all
+#define WBREG_OP_WATCH  (0x06) // watch the bits of `addr` set in the one
+                               // data word, reporting at most every `count`
+                               // ms (see wbwatch.h); notifications go to
+                               // the sender
+#define WBREG_OP_UNWATCH (0x07) // stop watching `addr`
+#define WBREG_OP_NOTIFY (0x08) // sent by the board: `count` struct
+                               // wbreg_change follow and `id` counts
+                               // notifications, so gaps show losses
+#define WBREG_OP_CYCLES (0x09) // read the stack's per-layer cycle counts;
+                               // the reply's `count` is the number of
+                               // struct wbreg_cycles that follow and its
+                               // `addr` the timer clock in Hz.  A non-zero
+                               // `addr` zeroes the counts once read.
+#define WBREG_OP_JOIN  (0x0a) // join the IPv4 multicast group `addr`
+                              // (outside 224.0.0.0/24), so that requests
+                              // sent to it on WBREG_PORT run here too;
+                              // replies still go to the sender alone
+#define WBREG_OP_LEAVE (0x0b) // leave the group `addr`.  Joins count:
+                              // the board stays in a group until it has
+                              // been left as often as joined.
+#define WBREG_OP_PERF  (0x0c) // read the cycle counts of perf.h's sites;
+                              // the reply's `count` is the number of
+                              // struct wbreg_perf that follow and its
+                              // `addr` the timer clock in Hz.  A non-zero
+                              // `addr` zeroes the counts once read.
+#define WBREG_OP_SPI   (0x0d) // read the SPI core's statistics (spi.h);
+                              // one struct wbreg_spi follows and the
+                              // reply's `addr` is the timer clock in Hz.
+                              // A non-zero `addr` zeroes them once read.
+#define WBREG_OP_AT    (0x0e) // write `count` words (1 to WBTIMED_WORDS)
+                              // from `addr` at a moment on the wall clock
+                              // (see wbtimed.h): the data is its UTC
+                              // seconds and nanoseconds, then the words.
+                              // The reply's `addr` is the write's handle.
+#define WBREG_OP_AT_LIST (0x0f) // list the timed writes pending or done;
+                                // the reply's `count` is the number of
+                                // struct wbreg_at that follow
+// Flag: access the same address `count` times (e.g. a FIFO port) rather
+// than consecutive words
+#define WBREG_OP_NOINC  (0x80)
+// Flag, on any request over UDP: the reply ends with a struct
+// wbreg_stamps.  A reply that would then not fit in one datagram comes
+// without it and the flag clear.
+#define WBREG_OP_STAMPS (0x40)
+// Flag, on WBREG_OP_READ: the words read come packed as runs (see
+// WBREG_PACK_*), encoded as they are read, and `count` may go past
+// WBREG_MAX_WORDS as long as the packed words fit in one reply
+// (WBREG_ELEN otherwise, with no words).  The reply's `count` is the
+// words read; how many packed words follow is in its length.
+#define WBREG_OP_PACK   (0x20)
+
+// Status
+#define WBREG_OK        (0)
+#define WBREG_EOP       (1) // unknown opcode
+#define WBREG_EADDR     (2) // misaligned or outside the bridge window, or
+                            // not a group that can be joined
+#define WBREG_ELEN      (3) // datagram shorter than the request, or the
+                            // reply would not fit in one
+#define WBREG_ETIMEDOUT (4) // a batch wait condition was not met in time
+#define WBREG_ENOENT    (5) // no device by that name, no watch on that
+                            // address, or not in that group
+#define WBREG_ENOSPC    (6) // no room for another watch or group
+#define WBREG_EDUP      (7) // retransmit of a request that already ran and
+                            // whose reply was too long to keep
+#define WBREG_EBUS      (8) // a bus error on the bridge (see wbbus.h); a
+                            // read returns no words, a write may be partial
+#define WBREG_ETIME     (9) // a timed write's moment has passed or is too
+                            // far ahead, or the wall clock is not set
+
+// A packed read reply is a series of runs, each a control word of the run's
+// kind in the top two bits and its length in words in the rest.  A
+// literal run is followed by its words, a repeat by the one word it
+// repeats, a zero run by nothing.  Zero runs are at least
+// WBREG_PACK_MIN_ZERO words and repeats WBREG_PACK_MIN_REPEAT, so packing
+// never costs more than one word over the words read.
+#define WBREG_PACK_LITERAL (0u << 30)
+#define WBREG_PACK_ZERO    (1u << 30)
+#define WBREG_PACK_REPEAT  (2u << 30)
+#define WBREG_PACK_KIND    (3u << 30)
+#define WBREG_PACK_MIN_ZERO   (2)
+#define WBREG_PACK_MIN_REPEAT (3)
+
+struct wbreg_hdr {
+  // Echoed back so the host can match replies to requests
+  u32 id;
+  u8 op;
+  u8 status;
+  u16 count;
+  u32 addr;
+};
+
+// Batch entry operations
+#define WBREG_B_READ    (0x01) // result = *addr
+#define WBREG_B_WRITE   (0x02) // *addr = value
+#define WBREG_B_RMW     (0x03) // *addr = (*addr & ~mask) | (value & mask);
+                               // result = the old *addr
+#define WBREG_B_WAIT    (0x04) // poll until (*addr & mask) == value, for up
+                               // to `timeout_us`; result = the last *addr
+
+// One step of a batch.  Entries run in order in a single pass and the
+// reply carries one result word per entry run (0 for writes).  A bad
+// entry or a wait that times out stops the batch: the reply's status says
+// why and its `count` is the index of the entry that failed, with the
+// results of the ones before it.  Consecutive writes are posted and go
+// out together (wbpost.h) before the next entry that reads and at the
+// end, so a bus error one of them meets fails the batch there.
+// Waits hold up the main loop, so keep them short.
+struct wbreg_entry {
+  u8 op;
+  u8 pad;
+  u16 timeout_us;
+  u32 addr;
+  u32 value;
+  u32 mask;
+};
+
+// One device in a lookup or list reply
+struct wbreg_dev {
+  u32 offset;
+  u32 size;
+  u8 mode; // WBMAP_MODE_*
+  u8 pad[3];
+  // NUL-terminated
+  char name[WBMAP_NAME_MAX];
+};
+
+// One watched register's changes since its last notification.  Watched
+// registers are read continuously, so never watch one whose reads have
+// side effects.
+struct wbreg_change {
+  u32 addr;
+  // Value in the last notification (or when the watch was set), and now
+  u32 old;
+  u32 value;
+  // Low 32 bits of timebase_us() at the first change
+  u32 time_us;
+  // Changes seen since the last notification
+  u32 changes;
+};
+
+// Time lwIP spent in one layer of the stack (enum lwip_cycle_layer in
+// lwip/stats.h, in order), leaving out the layers it called.  Both wrap at
+// 32 bits, so sample them more often than every 2^32 timer cycles and take
+// differences.
+struct wbreg_cycles {
+  u32 calls;
+  u32 cycles;
+};
+
+// One perf.h site's passes (enum perf_site, in order): the sum is split
+// in two words, high first, and hist[b] counts the passes of 2^b to
+// 2^(b+1) - 1 cycles
+struct wbreg_perf {
+  u32 count;
+  u32 min;
+  u32 max;
+  u32 sum_hi;
+  u32 sum_lo;
+  u32 hist[PERF_BUCKETS];
+};
+
+// spi.h's struct spi_stats, with the busy time split in two words, high
+// first
+struct wbreg_spi {
+  u32 xfers;
+  u32 bytes;
+  u32 timeouts;
+  u32 overruns;
+  u32 mode_faults;
+  u32 polls;
+  u32 busy_hi;
+  u32 busy_lo;
+};
+
+// One timed write (wbtimed.h): `state` is a WBTIMED_* and `skew_ns`, for
+// one done, how late its first word went out on the wall clock (early if
+// negative)
+struct wbreg_at {
+  u32 handle;
+  u32 state;
+  u32 sec;
+  u32 ns;
+  u32 addr;
+  s32 skew_ns;
+};
+
+// Where a request's time on the board went (WBREG_OP_STAMPS), in
+// timebase_stamp() cycles that wrap at 32 bits: eth0's driver finding the
+// request in the core (0 from another link), wbreg taking it from the
+// stack and the reply going back to it.  The reply itself cannot say when
+// it left, so the trailer also carries the driver's stamps of the last
+// stamped reply to the same client, with its request id: handed to the
+// core, and the core found done sending it.  `prev_flags` says which of
+// those were taken (ETHERNETIF_STAMP_SENT 1, ETHERNETIF_STAMP_DONE 2, see
+// netif/ethernetif.h), 0 for none.  A retransmit answered from the cache
+// repeats the first reply's trailer.
+struct wbreg_stamps {
+  u32 hz;
+  u32 rx;
+  u32 start;
+  u32 reply;
+  u32 prev_id;
+  u32 prev_flags;
+  u32 prev_sent;
+  u32 prev_done;
+};
+
+// Words in the largest request or reply, and devices in the largest list
+// reply: as many as fit in one frame at eth0's MTU (362 words at 1500,
+// 2240 with 9000-byte jumbo frames)
+#define WBREG_MAX_WORDS ((ETH_UDP_MAX - sizeof(struct wbreg_hdr)) / 4)
+#define WBREG_MAX_DEVS ((ETH_UDP_MAX - sizeof(struct wbreg_hdr)) / \
+    sizeof(struct wbreg_dev))
+
+// Client sessions, least recently used first to go, and replies each
+// remembers
+#define WBREG_SESSIONS    (4)
+#define WBREG_CACHE       (4)
+// Longest reply kept (header and 62 words)
+#define WBREG_CACHE_BYTES (256)
+
+// Listen on WBREG_PORT.  Call after lwip_init().
+void init_wbreg();
+
+// Send watch notifications (wbwatch.h) from WBREG_PORT to `addr`:`port`,
+// as a WBREG_OP_WATCH from there would
+void wbreg_subscribe(const ip_addr_t *addr, u16_t port);
+
+// Check and execute the request `h` with `words` (request data, reply data
+// or both) behind it, of which `have` arrived, leaving the reply over them.
+// Returns the reply length.  For transports other than UDP; requests that
+// need a UDP sender (WBREG_OP_WATCH) are the caller's to refuse.
+u32 wbreg_exec(struct wbreg_hdr *h, u32 *words, u32 have);
+
+// Bytes a reply to `h` can need
+u32 wbreg_reply_len(const struct wbreg_hdr *h);
+
+#endif // _WBREG_H_
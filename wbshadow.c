@@ -0,0 +1,180 @@
+// wbshadow.c - Shadow copies in BRAM of gateware control registers (see
+// wbshadow.h).
+//
+// The mirrored devices are kept in a short array searched in order, so an
+// access to a word that is not mirrored costs a compare per device before
+// going to the bus.  The words of device n are pool[first[n]] on.
+
+#include "xil_io.h"
+
+#include "log.h"
+#include "wbreg.h"
+#include "wbshadow.h"
+
+static const struct wbmap_entry *devs[WBSHADOW_DEVS];
+static u16 first[WBSHADOW_DEVS];
+static u32 num_devs;
+static u32 used;
+static u32 pool[WBSHADOW_WORDS];
+static u32 saved;
+
+// Mirror of the word at offset `off`, or NULL
+static u32 *
+shadow_word(u32 off)
+{
+  const struct wbmap_entry *e;
+  u32 i;
+
+  for(i=0; i<num_devs; i++) {
+    e = devs[i];
+    if(off - e->offset < e->size) {
+      return &pool[first[i] + ((off - e->offset) >> 2)];
+    }
+  }
+  return NULL;
+}
+
+int
+wbshadow_overlaps(u32 off, u32 len)
+{
+  const struct wbmap_entry *e;
+  u32 i;
+
+  for(i=0; i<num_devs; i++) {
+    e = devs[i];
+    if(off < e->offset + e->size && e->offset < off + len) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+// Index of device `e` in `devs`, or -1 if it is not mirrored
+static int
+shadow_index(const struct wbmap_entry *e)
+{
+  u32 i;
+
+  for(i=0; i<num_devs; i++) {
+    if(devs[i] == e || (devs[i]->offset == e->offset &&
+       devs[i]->size == e->size)) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+int
+wbshadow_add(const struct wbmap_entry *e)
+{
+  u32 i, words = e->size >> 2;
+
+  if(shadow_index(e) >= 0) {
+    return 0;
+  }
+  if(((e->offset | e->size) & 3) || e->offset >= WBREG_SIZE ||
+     e->size > WBREG_SIZE - e->offset || num_devs == WBSHADOW_DEVS ||
+     words > WBSHADOW_WORDS - used || wbshadow_overlaps(e->offset, e->size)) {
+    return -1;
+  }
+  devs[num_devs] = e;
+  first[num_devs] = used;
+  for(i=0; i<words; i++) {
+    pool[used + i] = 0;
+  }
+  num_devs++;
+  used += words;
+  wbshadow_refresh(e);
+  return 0;
+}
+
+u32
+wbshadow_read(u32 off)
+{
+  u32 *w = shadow_word(off);
+
+  if(w) {
+    saved++;
+    return *w;
+  }
+  return Xil_In32(WBREG_BASE + off);
+}
+
+void
+wbshadow_write(u32 off, u32 value)
+{
+  u32 *w = shadow_word(off);
+
+  Xil_Out32(WBREG_BASE + off, value);
+  if(w) {
+    *w = value;
+  }
+}
+
+u32
+wbshadow_rmw(u32 off, u32 mask, u32 value)
+{
+  u32 old = wbshadow_read(off);
+
+  wbshadow_write(off, (old & ~mask) | (value & mask));
+  return old;
+}
+
+u32
+wbshadow_flush(const struct wbmap_entry *e)
+{
+  int only = e ? shadow_index(e) : -1;
+  u32 i, k, n = 0;
+
+  for(i=0; i<num_devs; i++) {
+    if((e && (int)i != only) || !(devs[i]->mode & WBMAP_MODE_W)) {
+      continue;
+    }
+    for(k=0; k<devs[i]->size >> 2; k++, n++) {
+      Xil_Out32(WBREG_BASE + devs[i]->offset + 4 * k, pool[first[i] + k]);
+    }
+  }
+  return n;
+}
+
+u32
+wbshadow_refresh(const struct wbmap_entry *e)
+{
+  int only = e ? shadow_index(e) : -1;
+  u32 i, k, n = 0;
+
+  for(i=0; i<num_devs; i++) {
+    if((e && (int)i != only) || !(devs[i]->mode & WBMAP_MODE_R)) {
+      continue;
+    }
+    for(k=0; k<devs[i]->size >> 2; k++, n++) {
+      pool[first[i] + k] = Xil_In32(WBREG_BASE + devs[i]->offset + 4 * k);
+    }
+  }
+  return n;
+}
+
+const struct wbmap_entry *
+wbshadow_get(u32 n)
+{
+  return n < num_devs ? devs[n] : NULL;
+}
+
+u32
+wbshadow_saved()
+{
+  return saved;
+}
+
+void
+init_wbshadow()
+{
+  const struct wbmap_entry *e;
+  u32 i;
+
+  for(i=0; (e = wbmap_get(i)); i++) {
+    if((e->mode & WBMAP_MODE_SHADOW) && wbshadow_add(e) != 0) {
+      LOG("wbshadow: no room to mirror device %u (%u bytes)", i, e->size);
+    }
+  }
+}
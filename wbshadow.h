@@ -0,0 +1,75 @@
+#ifndef _WBSHADOW_H_
+#define _WBSHADOW_H_
+
+// wbshadow.h - Shadow copies in BRAM of gateware control registers.
+//
+// A device of the register map marked WBMAP_MODE_SHADOW (mode 4 added to
+// its mode in core_info.tab, see tools/coreinfo.py) has every word it
+// holds mirrored here.  Writes go to the bus and the mirror; reads, and
+// the read half of a read-modify-write, come from the mirror without a bus
+// transaction.  That halves the cost of a read-modify-write, and makes
+// one possible at all on a write-only register, which otherwise reads
+// back as whatever the gateware returns.
+//
+// Only mark devices whose words change when the firmware writes them and
+// at no other time: configuration, not status, counters or FIFO ports.
+// Readable words start as read from the bus at startup, write-only ones
+// as 0, the value gateware registers conventionally reset to.  After the
+// gateware changed a device behind the firmware's back, wbshadow_refresh()
+// reads it again; after the gateware lost its registers, wbshadow_flush()
+// writes the mirror back.
+//
+// wbreg.h's requests, KATCP's register requests (katcp.h) and the preset
+// scripts of preset.h go through these calls, so all of them see the same
+// values.  Code that writes a shadowed device with Xil_Out32() directly
+// leaves the mirror stale.
+
+#include "xil_types.h"
+
+#include "wbmap.h"
+
+// Words mirrored in all, and devices
+#define WBSHADOW_WORDS (128)
+#define WBSHADOW_DEVS  (8)
+
+// Mirror the devices of wbmap.h marked WBMAP_MODE_SHADOW, as far as there
+// is room.  Call before anything writes them.
+void init_wbshadow();
+
+// Mirror device `e`, word aligned, reading its words if it is readable.
+// Returns 0 (also if `e` is already mirrored), or -1 if there is no room
+// or `e` overlaps another mirrored device.
+int wbshadow_add(const struct wbmap_entry *e);
+
+// Non-zero if any of the `len` bytes at offset `off` are mirrored.  Means
+// such a range must be accessed a word at a time through the calls below
+// rather than in bulk (e.g. by DMA).
+int wbshadow_overlaps(u32 off, u32 len);
+
+// Word at offset `off` (word aligned, within the bridge window), from the
+// mirror if it is mirrored and the bus otherwise
+u32 wbshadow_read(u32 off);
+
+// Write `value` to the word at offset `off`, and its mirror if any
+void wbshadow_write(u32 off, u32 value);
+
+// Replace the bits `mask` of the word at offset `off` with those of
+// `value`.  Returns the old word.  One bus transaction on a mirrored word,
+// two on any other.
+u32 wbshadow_rmw(u32 off, u32 mask, u32 value);
+
+// Write the mirror of device `e`, or of every mirrored device if NULL,
+// back to the bus.  Returns the words written.
+u32 wbshadow_flush(const struct wbmap_entry *e);
+
+// Read the words of device `e`, or of every mirrored device if NULL, into
+// the mirror again, where they are readable.  Returns the words read.
+u32 wbshadow_refresh(const struct wbmap_entry *e);
+
+// Mirrored device `n`, or NULL past the last
+const struct wbmap_entry *wbshadow_get(u32 n);
+
+// Bus reads the mirror has saved since boot
+u32 wbshadow_saved();
+
+#endif // _WBSHADOW_H_
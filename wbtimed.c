@@ -0,0 +1,190 @@
+// wbtimed.c - Register writes timed on the wall clock (see wbtimed.h).
+//
+// A write goes from QUEUED to ARMED in the main loop's arm timer, which
+// runs every millisecond while any is pending.  The tick interrupt only
+// writes the armed ones and sets `fired`; the arm timer then works out the
+// skew, which needs the wall clock, and marks them DONE.
+
+#include "xil_io.h"
+
+#include "intr.h"
+#include "sntpclock.h"
+#include "timebase.h"
+#include "timer.h"
+#include "wbreg.h"
+#include "wbtimed.h"
+
+#define LATE_CYCLES ((s64)WBTIMED_LATE_US * TIMEBASE_CYCLES_PER_US)
+
+static struct wbtimed_write writes[WBTIMED_MAX];
+static struct wbtimed_stats stats;
+static u32 next_handle;
+
+// The tick interrupt: make the armed writes whose moment comes before the
+// next tick, earliest first
+static void
+wbtimed_alarm(u32 ms)
+{
+  struct wbtimed_write *w, *first;
+  s32 left, least;
+  u32 i, a;
+
+  for(;;) {
+    first = NULL;
+    least = TIMEBASE_CYCLES_PER_MS;
+    for(i=0; i<WBTIMED_MAX; i++) {
+      w = &writes[i];
+      if(w->state != WBTIMED_ARMED || w->fired) {
+        continue;
+      }
+      left = (s32)(w->due - timebase_stamp());
+      if(left < least) {
+        least = left;
+        first = w;
+      }
+    }
+    if(!first) {
+      return;
+    }
+    while((s32)(first->due - timebase_stamp()) > 0) {
+    }
+    a = WBREG_BASE + first->addr;
+    Xil_Out32(a, first->words[0]);
+    first->stamp = timebase_stamp();
+    for(i=1; i<first->count; i++) {
+      Xil_Out32(a + 4 * i, first->words[i]);
+    }
+    first->fired = 1;
+  }
+}
+
+static void
+wbtimed_finish(struct wbtimed_write *w, u8 state)
+{
+  s32 skew;
+
+  w->state = state;
+  if(state == WBTIMED_MISSED) {
+    stats.missed++;
+    return;
+  }
+  skew = (s32)(sntpclock_utc_ns(timebase_widen(w->stamp)) - w->utc_ns);
+  w->skew_ns = skew;
+  stats.skew_last = skew;
+  if(!stats.done || skew < stats.skew_min) {
+    stats.skew_min = skew;
+  }
+  if(!stats.done || skew > stats.skew_max) {
+    stats.skew_max = skew;
+  }
+  stats.skew_sum += skew;
+  stats.done++;
+}
+
+static void wbtimed_arm(void *arg);
+
+static struct timer arm_timer = TIMER_INIT(wbtimed_arm, NULL);
+
+// Arm the writes due soon, and finish those the tick interrupt made
+static void
+wbtimed_arm(void *arg)
+{
+  struct wbtimed_write *w;
+  u64 now, due;
+  u32 i, pending = 0, msr;
+
+  for(i=0; i<WBTIMED_MAX; i++) {
+    w = &writes[i];
+    if(w->state == WBTIMED_ARMED && w->fired) {
+      wbtimed_finish(w, WBTIMED_DONE);
+    }
+    if(w->state != WBTIMED_QUEUED) {
+      pending += w->state == WBTIMED_ARMED;
+      continue;
+    }
+    due = sntpclock_cycles(w->utc_ns);
+    now = timebase_cycles();
+    if(!due || (s64)(now - due) > LATE_CYCLES) {
+      wbtimed_finish(w, WBTIMED_MISSED);
+      continue;
+    }
+    pending++;
+    if((s64)(due - now) > WBTIMED_ARM_MS * TIMEBASE_CYCLES_PER_MS) {
+      continue;
+    }
+    // The interrupt reads the state and the moment together
+    msr = intr_lock();
+    w->due = timebase_stamp() + (u32)(due - now);
+    w->fired = 0;
+    w->state = WBTIMED_ARMED;
+    intr_unlock(msr);
+  }
+  if(!pending) {
+    timer_stop(&arm_timer);
+  }
+}
+
+int
+wbtimed_add(u32 addr, const u32 *words, u32 count, u64 utc_ns, u32 *handle)
+{
+  struct wbtimed_write *w = NULL;
+  u64 now = sntpclock_utc_ns(timebase_cycles());
+  u32 i;
+
+  if(!now || utc_ns <= now ||
+     utc_ns - now > (u64)WBTIMED_AHEAD_S * 1000000000) {
+    return -2;
+  }
+  // A free slot, or else the oldest result
+  for(i=0; i<WBTIMED_MAX; i++) {
+    if(writes[i].state == WBTIMED_FREE) {
+      w = &writes[i];
+      break;
+    }
+    if((writes[i].state == WBTIMED_DONE ||
+        writes[i].state == WBTIMED_MISSED) &&
+       (!w || (s32)(writes[i].handle - w->handle) < 0)) {
+      w = &writes[i];
+    }
+  }
+  if(!w) {
+    return -1;
+  }
+  w->handle = next_handle++;
+  w->count = count;
+  w->utc_ns = utc_ns;
+  w->addr = addr;
+  for(i=0; i<count; i++) {
+    w->words[i] = words[i];
+  }
+  w->skew_ns = 0;
+  w->fired = 0;
+  w->state = WBTIMED_QUEUED;
+  stats.queued++;
+  *handle = w->handle;
+  if(!timer_pending(&arm_timer)) {
+    timer_start(&arm_timer, 1, 1);
+  }
+  return 0;
+}
+
+const struct wbtimed_write *
+wbtimed_get(u32 n)
+{
+  if(n >= WBTIMED_MAX || writes[n].state == WBTIMED_FREE) {
+    return NULL;
+  }
+  return &writes[n];
+}
+
+const struct wbtimed_stats *
+wbtimed_stats()
+{
+  return &stats;
+}
+
+void
+init_wbtimed()
+{
+  timebase_set_alarm(wbtimed_alarm);
+}
@@ -0,0 +1,103 @@
+#ifndef _WBTIMED_H_
+#define _WBTIMED_H_
+
+// wbtimed.h - Register writes timed on the wall clock, for actions taken
+// in lockstep across boards.
+//
+// Commands sent to a hundred boards one after another spread an action
+// (arming a capture, switching a mode) over tens of milliseconds.  A
+// timed write carries the moment it is to happen instead, in UTC on the
+// clock of sntpclock.h (disciplined by SNTP, PTP or a PPS), so the host
+// sends it to every board well ahead, with no real-time guarantees of its
+// own, and each board makes the write at that moment.
+//
+// Within WBTIMED_ARM_MS of its moment the main loop converts a write's
+// UTC to the timebase (sntpclock_cycles(), so that the clock's
+// corrections until then count) and arms it.  The tick interrupt of the
+// millisecond it falls in then waits for the cycle with interrupts masked
+// and writes the words, so that the main loop's latency does not count,
+// at the cost of masking interrupts for up to a millisecond at each
+// moment.  Each write's skew, the UTC the first word went out at less the
+// moment asked for, is kept with it, and those of all writes are summed
+// up in wbtimed_stats(): boards whose clocks agree act to within their
+// clocks' agreement and a few cycles.
+//
+// A write whose moment has passed by more than WBTIMED_LATE_US when it
+// comes to be armed, behind a stalled main loop or a clock step, is
+// dropped rather than made out of step, and counted as missed.
+//
+// wbreg.h's WBREG_OP_AT queues writes over the network, alone or to a
+// multicast group for a whole array at once, and WBREG_OP_AT_LIST reports
+// them; KATCP's ?timed (katcp.h) shows the totals.
+
+#include "xil_types.h"
+
+// Writes queued or kept with their results at once, and words in each
+#define WBTIMED_MAX   (8)
+#define WBTIMED_WORDS (4)
+
+// How soon before its moment a write is armed
+#define WBTIMED_ARM_MS (2)
+
+// Latest a write may still be made, and furthest ahead one may be queued
+#define WBTIMED_LATE_US  (1000)
+#define WBTIMED_AHEAD_S  (3600)
+
+// States of a write
+#define WBTIMED_FREE   (0)
+#define WBTIMED_QUEUED (1)
+#define WBTIMED_ARMED  (2)
+#define WBTIMED_DONE   (3)
+#define WBTIMED_MISSED (4)
+
+struct wbtimed_write {
+  // Counts writes queued since boot
+  u32 handle;
+  u8 state;
+  // Set by the tick interrupt once the words are written
+  volatile u8 fired;
+  u16 count;
+  // The moment, in ns since 1970 UTC
+  u64 utc_ns;
+  // Offset of the first register from WBREG_BASE (wbreg.h), and the words
+  u32 addr;
+  u32 words[WBTIMED_WORDS];
+  // For a write done, the UTC of the first word less `utc_ns`
+  s32 skew_ns;
+  // timebase_stamp() of the moment once armed, and of the first word
+  u32 due;
+  u32 stamp;
+};
+
+struct wbtimed_stats {
+  u32 queued;
+  u32 done;
+  u32 missed;
+  // Skews of the writes done, in ns: the last, the least, the most, and
+  // all of them for the mean
+  s32 skew_last;
+  s32 skew_min;
+  s32 skew_max;
+  s64 skew_sum;
+};
+
+// Write the `count` words `words` (host order, 1 to WBTIMED_WORDS of them)
+// to the registers from offset `addr` at `utc_ns` nanoseconds since 1970
+// UTC.  The offsets must be checked already.  Returns 0 with the write's
+// handle in `handle`, -1 if WBTIMED_MAX writes are pending, or -2 if the
+// clock is not set or the moment is not between now and WBTIMED_AHEAD_S
+// from now.
+int wbtimed_add(u32 addr, const u32 *words, u32 count, u64 utc_ns,
+    u32 *handle);
+
+// Write slot `n` (below WBTIMED_MAX), pending or with its result, or NULL
+// if it is free
+const struct wbtimed_write *wbtimed_get(u32 n);
+
+const struct wbtimed_stats *wbtimed_stats();
+
+// Take timed writes, from the tick interrupt.  Call after init_timebase()
+// and init_sntpclock().
+void init_wbtimed();
+
+#endif // _WBTIMED_H_
@@ -0,0 +1,202 @@
+// wbwatch.c - Change notifications for registers behind the Wishbone bridge.
+//
+// The poll hook reads each watch and notes the first change since its
+// last report; a watch whose period has run out since then reports, and
+// everything reported in one pass goes in a single datagram.
+
+#include "xil_io.h"
+
+#include "bswap.h"
+#include "sched.h"
+#include "timebase.h"
+#include "wbreg.h"
+#include "wbwatch.h"
+
+struct watch {
+  u32 addr; // 0 for a free slot
+  u32 mask;
+  u32 period_ms;
+  // Value last reported, and the latest read
+  u32 reported;
+  u32 value;
+  // timebase_ms() of the last report
+  u32 reported_ms;
+  // Changes since the last report, and timebase_us() of the first
+  u32 changes;
+  u32 first_us;
+  // Changes and reports since the watch was set
+  u32 total_changes;
+  u32 reports;
+};
+
+static struct watch watches[WBWATCH_MAX];
+
+static struct udp_pcb *notify_pcb;
+static ip_addr_t notify_addr;
+static u16_t notify_port;
+static u32 notify_seq;
+
+static struct watch *
+wbwatch_find(u32 addr)
+{
+  u32 i;
+
+  for(i=0; i<WBWATCH_MAX; i++) {
+    if(watches[i].addr == addr) {
+      return &watches[i];
+    }
+  }
+  return NULL;
+}
+
+int
+wbwatch_add(u32 addr, u32 mask, u32 period_ms)
+{
+  struct watch *w = wbwatch_find(addr);
+
+  if(!w && !(w = wbwatch_find(0))) {
+    return -1;
+  }
+  w->mask = mask;
+  w->period_ms = period_ms;
+  w->reported = w->value = Xil_In32(addr);
+  w->reported_ms = timebase_ms();
+  w->changes = 0;
+  w->total_changes = w->reports = 0;
+  w->addr = addr;
+  return 0;
+}
+
+int
+wbwatch_remove(u32 addr)
+{
+  struct watch *w = wbwatch_find(addr);
+
+  if(!addr || !w) {
+    return -1;
+  }
+  w->addr = 0;
+  return 0;
+}
+
+int
+wbwatch_get(u32 n, u32 *addr, u32 *mask, u32 *value)
+{
+  if(n >= WBWATCH_MAX || !watches[n].addr) {
+    return -1;
+  }
+  *addr = watches[n].addr;
+  *mask = watches[n].mask;
+  *value = watches[n].value;
+  return 0;
+}
+
+int
+wbwatch_counts(u32 n, u32 *changes, u32 *reports)
+{
+  if(n >= WBWATCH_MAX || !watches[n].addr) {
+    return -1;
+  }
+  *changes = watches[n].total_changes;
+  *reports = watches[n].reports;
+  return 0;
+}
+
+u32
+wbwatch_period(u32 n)
+{
+  if(n >= WBWATCH_MAX || !watches[n].addr) {
+    return 0;
+  }
+  return watches[n].period_ms;
+}
+
+void
+wbwatch_subscribe(struct udp_pcb *pcb, const ip_addr_t *addr, u16_t port)
+{
+  notify_pcb = pcb;
+  ip_addr_copy(notify_addr, *addr);
+  notify_port = port;
+}
+
+int
+wbwatch_subscriber(ip_addr_t *addr, u16_t *port)
+{
+  if(!notify_pcb) {
+    return -1;
+  }
+  ip_addr_copy(*addr, notify_addr);
+  *port = notify_port;
+  return 0;
+}
+
+// Send the `n` changes in `c`
+static void
+wbwatch_notify(const struct wbreg_change *c, u32 n)
+{
+  struct wbreg_hdr h;
+  struct pbuf *p;
+
+  p = pbuf_alloc(PBUF_TRANSPORT, sizeof(h) + n * sizeof(*c), PBUF_RAM);
+  if(!p) {
+    return;
+  }
+  h.id = swap32(notify_seq++);
+  h.op = WBREG_OP_NOTIFY;
+  h.status = WBREG_OK;
+  h.count = swap16(n);
+  h.addr = 0;
+  pbuf_take(p, &h, sizeof(h));
+  pbuf_take_at(p, c, n * sizeof(*c), sizeof(h));
+  udp_sendto(notify_pcb, p, &notify_addr, notify_port);
+  pbuf_free(p);
+}
+
+// Poll hook
+static int
+wbwatch_poll(void *arg)
+{
+  struct wbreg_change c[WBWATCH_MAX];
+  struct watch *w;
+  u32 i, n = 0, v, now = timebase_ms();
+
+  for(i=0, w=watches; i<WBWATCH_MAX; i++, w++) {
+    if(!w->addr) {
+      continue;
+    }
+    v = Xil_In32(w->addr);
+    if((v ^ w->value) & w->mask) {
+      w->total_changes++;
+      if(!w->changes++) {
+        w->first_us = (u32)timebase_us();
+      }
+      w->value = v;
+    }
+    if(!w->changes || now - w->reported_ms < w->period_ms) {
+      continue;
+    }
+    c[n].addr = swap32(w->addr - WBREG_BASE);
+    c[n].old = swap32(w->reported);
+    c[n].value = swap32(w->value);
+    c[n].time_us = swap32(w->first_us);
+    c[n].changes = swap32(w->changes);
+    n++;
+    w->reported = w->value;
+    w->reported_ms = now;
+    w->changes = 0;
+    w->reports++;
+  }
+
+  if(n && notify_port) {
+    wbwatch_notify(c, n);
+  }
+  return n;
+}
+
+static struct sched_hook poll_hook = SCHED_HOOK_INIT(wbwatch_poll, NULL);
+
+void
+init_wbwatch()
+{
+  sched_add_poll(&poll_hook);
+}
@@ -0,0 +1,54 @@
+#ifndef _WBWATCH_H_
+#define _WBWATCH_H_
+
+// wbwatch.h - Change notifications for registers behind the Wishbone bridge.
+//
+// Each watch names a register, the bits of it that matter and a period.
+// The main loop reads every watched register on every pass, so no change
+// that lasts a pass is missed, and reports it to the subscriber with a
+// UDP notification.  Changes are coalesced: a watch reports at most once
+// per period, with the value it last reported, the latest value and the
+// time of the first change since.
+//
+// wbreg.h's WBREG_OP_WATCH and WBREG_OP_UNWATCH manage the watches over
+// the network; the notifications are described there.
+
+#include "lwip/udp.h"
+
+#include "xil_types.h"
+
+// Watches at once
+#define WBWATCH_MAX (16)
+
+// Watch the bits `mask` of the register at bus address `addr`, reporting
+// at most every `period_ms` (0 for every change).  Replaces any watch on
+// `addr`.  The current value is the baseline.
+//
+// Returns 0 on success, -1 if there are already WBWATCH_MAX watches.
+int wbwatch_add(u32 addr, u32 mask, u32 period_ms);
+
+// Stop watching `addr`.  Returns 0 on success, -1 if it was not watched.
+int wbwatch_remove(u32 addr);
+
+// Watch slot `n` (below WBWATCH_MAX): its register, mask and the value
+// last read.  Returns 0, or -1 if the slot is free.
+int wbwatch_get(u32 n, u32 *addr, u32 *mask, u32 *value);
+
+// Changes seen and reports sent by watch slot `n` since its watch was set.
+// Returns 0, or -1 if the slot is free.
+int wbwatch_counts(u32 n, u32 *changes, u32 *reports);
+
+// Period of watch slot `n`, or 0 if the slot is free
+u32 wbwatch_period(u32 n);
+
+// Send notifications through `pcb` to `addr`:`port`
+void wbwatch_subscribe(struct udp_pcb *pcb, const ip_addr_t *addr,
+    u16_t port);
+
+// Where notifications go.  Returns 0, or -1 if nobody has subscribed.
+int wbwatch_subscriber(ip_addr_t *addr, u16_t *port);
+
+// Start polling the watches
+void init_wbwatch();
+
+#endif // _WBWATCH_H_
@@ -0,0 +1,162 @@
+// wdog.c - Watchdog supervisor on axi_timebase_wdt_0 (see wdog.h).
+
+#include <string.h>
+
+#include "xparameters.h"
+#include "xil_printf.h"
+#include "xwdttb.h"
+
+#include "intr.h"
+#include "log.h"
+#include "sections.h"
+#include "timebase.h"
+#include "wdog.h"
+
+static XWdtTb xwdttb;
+static u8 running;
+
+static struct wdog_task *tasks;
+
+// Set for good by the first late task
+static u8 failed;
+static u32 check_ms;
+
+static struct wdog_record record NOINIT_SECTION;
+// The last reset's, taken out of `record` at startup
+static struct wdog_record last;
+static u8 have_last;
+static u8 expired;
+
+void
+wdog_add(struct wdog_task *t, int armed)
+{
+  struct wdog_task **list = &tasks;
+  u32 msr;
+
+  while(*list) {
+    list = &(*list)->next;
+  }
+  t->beat_ms = timebase_ms();
+  t->armed = armed != 0;
+  t->next = NULL;
+  msr = intr_lock();
+  *list = t;
+  intr_unlock(msr);
+}
+
+void
+wdog_beat(struct wdog_task *t)
+{
+  t->beat_ms = timebase_ms();
+}
+
+void
+wdog_arm(struct wdog_task *t)
+{
+  t->beat_ms = timebase_ms();
+  t->armed = 1;
+}
+
+void
+wdog_disarm(struct wdog_task *t)
+{
+  t->armed = 0;
+}
+
+static void
+wdog_fail(const struct wdog_task *t, u32 n, u32 pc, u32 now, u32 late)
+{
+  failed = 1;
+  record.pc = pc;
+  record.time_ms = now;
+  record.late_ms = late;
+  strncpy(record.task, t->name, WDOG_NAME_MAX - 1);
+  record.task[WDOG_NAME_MAX - 1] = 0;
+  record.magic = WDOG_MAGIC;
+  LOG("wdog: task %u late by %u ms at pc %x", n, late, pc);
+}
+
+// From the tick interrupt
+static void
+wdog_check(u32 pc)
+{
+  const struct wdog_task *t;
+  u32 now = timebase_ms(), late, n;
+
+  if(failed || now - check_ms < WDOG_CHECK_MS) {
+    return;
+  }
+  check_ms = now;
+  for(t = tasks, n = 0; t; t = t->next, n++) {
+    late = now - t->beat_ms;
+    if(t->armed && late > t->deadline_ms) {
+      wdog_fail(t, n, pc, now, late);
+      return;
+    }
+  }
+  XWdtTb_RestartWdt(&xwdttb);
+}
+
+void
+init_wdog()
+{
+  if(record.magic == WDOG_MAGIC) {
+    last = record;
+    last.task[WDOG_NAME_MAX - 1] = 0;
+    have_last = 1;
+  }
+  record.magic = 0;
+
+  if(XWdtTb_Initialize(&xwdttb, XPAR_WDTTB_0_DEVICE_ID) != XST_SUCCESS) {
+    return;
+  }
+  // The reset status survives the reset it caused
+  expired = XWdtTb_IsWdtExpired(&xwdttb) != 0;
+  check_ms = timebase_ms();
+  XWdtTb_Start(&xwdttb);
+  running = 1;
+  timebase_set_monitor(wdog_check);
+}
+
+void
+wdog_expire()
+{
+  failed = 1;
+  if(!running &&
+     XWdtTb_Initialize(&xwdttb, XPAR_WDTTB_0_DEVICE_ID) == XST_SUCCESS) {
+    XWdtTb_Start(&xwdttb);
+    running = 1;
+  }
+}
+
+const struct wdog_record *
+wdog_last_reset(int *exp)
+{
+  *exp = expired;
+  return have_last ? &last : NULL;
+}
+
+const struct wdog_task *
+wdog_get(u32 n)
+{
+  const struct wdog_task *t = tasks;
+
+  while(t && n--) {
+    t = t->next;
+  }
+  return t;
+}
+
+void
+dump_wdog()
+{
+  if(have_last) {
+    xil_printf("Watchdog reset: %s %d ms late at pc %08x, %d ms up\n",
+        last.task, last.late_ms, last.pc, last.time_ms);
+  } else if(expired) {
+    print("Watchdog reset, no record (interrupts masked, or a crash?)\n");
+  }
+  if(!running) {
+    print("Watchdog not running\n");
+  }
+}
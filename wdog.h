@@ -0,0 +1,89 @@
+#ifndef _WDOG_H_
+#define _WDOG_H_
+
+// wdog.h - Watchdog supervisor on axi_timebase_wdt_0.
+//
+// Tasks register a heartbeat deadline and beat as they make progress: the
+// main loop on every pass (sched.c), telemetry on every sample and the
+// flash on every step of a program or erase.  A task can be disarmed while
+// it has nothing to do, as the flash is between operations.  Every
+// WDOG_CHECK_MS the tick interrupt checks the armed tasks and restarts
+// the hardware watchdog only if all of them beat within their deadline,
+// so a board that still answers pings but has a wedged task resets instead
+// of running on half-broken.
+//
+// The first late task stops the restarts for good.  Its name, how late it
+// was and the PC the tick interrupted (where the main loop is spinning, if
+// it is stuck) go to a record in .noinit that survives the reset; the
+// next boot reports it on the console and with KATCP's ?wdog.  The
+// hardware resets the board on the second expiry of its interval, which
+// is set in the gateware (WDT_INTERVAL, 2^30 cycles or about 10.7 s at
+// 100 MHz by default, so about 21 s).  A stuck loop with interrupts
+// masked stops the check too: then the reset comes without a record.
+
+#include "xil_types.h"
+
+#define WDOG_CHECK_MS (100)
+
+// The main loop's deadline.  Generous: the startup report waits on the
+// console for a few seconds in places.
+#define WDOG_LOOP_MS  (5000)
+
+#define WDOG_MAGIC    (0x31474457) // "WDG1"
+#define WDOG_NAME_MAX (12)
+
+struct wdog_task {
+  const char *name;
+  u32 deadline_ms;
+  // timebase_ms() of the last beat
+  volatile u32 beat_ms;
+  volatile u8 armed;
+  struct wdog_task *next;
+};
+
+#define WDOG_TASK_INIT(name, deadline_ms) { (name), (deadline_ms), 0, 0, NULL }
+
+// Why the supervisor let the watchdog fire
+struct wdog_record {
+  u32 magic;
+  // PC the tick interrupted, and timebase_ms() then
+  u32 pc;
+  u32 time_ms;
+  // Milliseconds since the task's last beat
+  u32 late_ms;
+  char task[WDOG_NAME_MAX];
+};
+
+// Keep `t`'s heartbeat, armed or not: a task armed from the start must
+// beat within its deadline of startup.  May be called before
+// init_wdog().
+void wdog_add(struct wdog_task *t, int armed);
+
+// Note progress.  Safe to call from interrupt handlers.
+void wdog_beat(struct wdog_task *t);
+
+// Start or stop checking `t` (wdog_arm() also beats)
+void wdog_arm(struct wdog_task *t);
+void wdog_disarm(struct wdog_task *t);
+
+// Take the last reset's record and start the watchdog.  Call just before
+// sched_run(): startup itself is not supervised.
+void init_wdog();
+
+// Stop restarting the watchdog for good, starting it if init_wdog() has
+// not, so that it resets the board.  For crash handlers (crash.h): safe to
+// call with interrupts and exceptions off.
+void wdog_expire();
+
+// Why the last reset happened: the supervisor's record, or NULL if it did
+// not fire.  `expired` is set when the hardware watchdog reset the board,
+// with or without a record.
+const struct wdog_record *wdog_last_reset(int *expired);
+
+// Registered task `n`, or NULL past the last
+const struct wdog_task *wdog_get(u32 n);
+
+// Print the last reset's record, if any, on the console
+void dump_wdog();
+
+#endif // _WDOG_H_
@@ -0,0 +1,158 @@
+// webfs.c - Web UI files served by lwIP's httpd straight from flash.
+//
+// These are httpd's LWIP_HTTPD_CUSTOM_FILES hooks.  Lookups read the
+// header, entries and names through the flash cache, where they stay hot
+// between requests; file data is read with read_flash() in whole send
+// buffers so that it does not push them out.
+
+#include <string.h>
+
+#include "lwip/apps/fs.h"
+#include "lwip/apps/httpd.h"
+
+#include "crc32.h"
+#include "flash.h"
+#include "slots.h"
+#include "webfs.h"
+#include "webstatus.h"
+
+// Slot table sequence number the image was looked up at
+static u32 image_seq;
+static u8 image_found;
+static int image_slot = -1;
+static u32 image_addr;
+static struct webfs_header image;
+
+// Look for the newest image again if the table changed
+static void
+image_find()
+{
+  const struct slot_desc *d;
+  struct webfs_header h;
+  u32 version = 0;
+  int i;
+
+  if(image_found && image_seq == slots.seq) {
+    return;
+  }
+  image_found = 1;
+  image_seq = slots.seq;
+  image_slot = -1;
+
+  for(i=0; i<slots.num; i++) {
+    d = &slots.slot[i];
+    if(i == SLOT_GOLDEN || !d->len || (image_slot >= 0 && d->version < version)) {
+      continue;
+    }
+    if(read_flash_cached(d->addr, (u8 *)&h, sizeof(h)) != sizeof(h) ||
+       h.magic != WEBFS_MAGIC || h.size > d->len ||
+       h.count > (h.size - sizeof(h)) / sizeof(struct webfs_entry)) {
+      continue;
+    }
+    image_slot = i;
+    image_addr = d->addr;
+    image = h;
+    version = d->version;
+  }
+}
+
+// Compare the NUL-terminated name at image offset `off` with `name`
+static int
+name_matches(u32 off, const char *name, u32 len)
+{
+  char buf[32];
+  u32 n;
+
+  // Include the terminator
+  len++;
+  while(len) {
+    n = len < sizeof(buf) ? len : sizeof(buf);
+    if(off + n > image.size ||
+       read_flash_cached(image_addr + off, (u8 *)buf, n) != n ||
+       memcmp(buf, name, n)) {
+      return 0;
+    }
+    off += n;
+    name += n;
+    len -= n;
+  }
+  return 1;
+}
+
+int
+fs_open_custom(struct fs_file *file, const char *name)
+{
+  struct webfs_entry e;
+  u32 len = strlen(name);
+  u32 hash = crc32(0, name, len);
+  u32 addr, i;
+
+  if(webstatus_open(file, name)) {
+    return 1;
+  }
+
+  image_find();
+  if(image_slot < 0) {
+    return 0;
+  }
+
+  addr = image_addr + sizeof(image);
+  for(i=0; i<image.count; i++, addr+=sizeof(e)) {
+    if(read_flash_cached(addr, (u8 *)&e, sizeof(e)) != sizeof(e)) {
+      return 0;
+    }
+    if(e.hash != hash || !name_matches(e.name, name, len)) {
+      continue;
+    }
+    if(e.data > image.size || e.len > image.size - e.data) {
+      return 0;
+    }
+    memset(file, 0, sizeof(*file));
+    // data stays NULL so that httpd reads the file through fs_read()
+    file->len = e.len;
+    file->pextension = (void *)(image_addr + e.data);
+    file->flags = FS_FILE_FLAGS_HEADER_INCLUDED |
+      FS_FILE_FLAGS_HEADER_PERSISTENT;
+    return 1;
+  }
+  return 0;
+}
+
+void
+fs_close_custom(struct fs_file *file)
+{
+}
+
+int
+fs_read_custom(struct fs_file *file, char *buffer, int count)
+{
+  u32 addr = (u32)file->pextension + file->index;
+  int n = file->len - file->index;
+
+  if(file->flags & WEBSTATUS_FLAG) {
+    return webstatus_read(file, buffer, count);
+  }
+  if(n > count) {
+    n = count;
+  }
+  // While a program or erase runs the flash cannot be read; sending
+  // nothing now has httpd try again from its poll
+  if(read_flash(addr, (u8 *)buffer, n, FLASH_MODE_BEST) != n) {
+    return 0;
+  }
+  file->index += n;
+  return n;
+}
+
+int
+webfs_slot()
+{
+  image_find();
+  return image_slot;
+}
+
+void
+init_webfs()
+{
+  httpd_init();
+}
@@ -0,0 +1,46 @@
+#ifndef _WEBFS_H_
+#define _WEBFS_H_
+
+// webfs.h - Web UI files served by lwIP's httpd straight from flash.
+//
+// The files live in an image built by tools/mkwebfs.py and written into a
+// slot of its own (see slots.h and tftp.h), not in BRAM: each file is
+// stored with its HTTP response headers already formatted and its content
+// gzip'd, so the server only copies flash into TCP segments.  The image
+// used is the newest valid one, found again whenever the slot table
+// changes, so an upload takes effect with the next request.  The only
+// file compiled in (fsdata_custom.c) is a bare 404 page for when there is
+// no image or it has none.  /status.json is generated (see webstatus.h).
+//
+// Image layout, little-endian: a struct webfs_header, `count` struct
+// webfs_entry, then the NUL-terminated names and the file data, which
+// entries locate by their offset from the start of the image.
+
+#include "xil_types.h"
+
+#define WEBFS_MAGIC (0x31534657) // "WFS1"
+
+struct webfs_header {
+  u32 magic;
+  u32 count;
+  // Bytes in the whole image
+  u32 size;
+  u32 pad;
+};
+
+struct webfs_entry {
+  // crc32() of the name, checked before comparing the name itself
+  u32 hash;
+  u32 name;
+  // Headers and content, `len` bytes in all
+  u32 data;
+  u32 len;
+};
+
+// Serve HTTPD_SERVER_PORT.  Call after init_slots().
+void init_webfs();
+
+// Slot holding the image in use, or -1 if there is none
+int webfs_slot();
+
+#endif // _WEBFS_H_
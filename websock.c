@@ -0,0 +1,344 @@
+// websock.c - Telemetry pushed to the web UI over WebSocket (see
+// websock.h).
+//
+// The message is built in `msg`, leaving WS_HDR_MAX bytes in front for
+// the frame header, which is written last, right before the encoded
+// datagram, so the frame goes to tcp_write() as it lies.  Each viewer's
+// parser keeps the header of the frame coming in in `hdr` until it is
+// whole, then takes the payload: a ping's into `ping` to send back, any
+// other's only counted off.
+
+#include <string.h>
+
+#include "lwip/apps/httpd.h"
+#include "lwip/tcp.h"
+#include "netif/ethernetif.h"
+
+#include "sha1.h"
+#include "telpush.h"
+#include "timebase.h"
+#include "timer.h"
+#include "websock.h"
+
+#define WS_GUID "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"
+// Clients send keys of 24 characters
+#define WS_KEY_MAX (32)
+#define WS_KEY_HDR "Sec-WebSocket-Key:"
+
+#define WS_FIN     (0x80)
+#define WS_MASKED  (0x80)
+#define WS_BINARY  (0x2)
+#define WS_CLOSE   (0x8)
+#define WS_PING    (0x9)
+#define WS_PONG    (0xa)
+// Longest payload of a control frame
+#define WS_CONTROL_MAX (125)
+
+// A frame header with a 16-bit length
+#define WS_HDR_MAX (4)
+
+struct viewer {
+  struct tcp_pcb *pcb;
+  u32 period_ms;
+  u32 last_ms;
+  // Header of the frame coming in, its bytes so far, and the payload
+  // bytes still to come
+  u8 hdr[14];
+  u8 hlen;
+  u32 left;
+  u8 ping[WS_CONTROL_MAX];
+  u8 ping_len;
+};
+
+static struct viewer viewers[WEBSOCK_VIEWERS];
+static struct websock_stats stats;
+
+static u8 msg[WS_HDR_MAX + TELPUSH_KEYFRAME_MAX];
+static u16 seq;
+
+static void websock_push(void *arg);
+
+static struct timer push_timer = TIMER_INIT(websock_push, NULL);
+
+// Bytes in the header of the frame coming in, as far as it is known yet
+static u32
+hdr_len(const struct viewer *v)
+{
+  u32 n = 2;
+
+  if(v->hlen < 2) {
+    return n;
+  }
+  if((v->hdr[1] & 0x7f) == 126) {
+    n += 2;
+  } else if((v->hdr[1] & 0x7f) == 127) {
+    n += 8;
+  }
+  if(v->hdr[1] & WS_MASKED) {
+    n += 4;
+  }
+  return n;
+}
+
+// Forget the viewer and close its connection.  Returns ERR_ABRT if the
+// connection had to be aborted instead.
+static err_t
+viewer_close(struct viewer *v)
+{
+  struct tcp_pcb *pcb = v->pcb;
+
+  tcp_arg(pcb, NULL);
+  tcp_recv(pcb, NULL);
+  tcp_sent(pcb, NULL);
+  tcp_err(pcb, NULL);
+  v->pcb = NULL;
+  stats.viewers--;
+  if(tcp_close(pcb) != ERR_OK) {
+    tcp_abort(pcb);
+    return ERR_ABRT;
+  }
+  return ERR_OK;
+}
+
+// The frame coming in is whole: answer a ping or a close.  Returns 0, or
+// what viewer_close() does once closed.
+static err_t
+viewer_frame(struct viewer *v)
+{
+  u8 reply[2] = { WS_FIN, 0 };
+  u8 op = v->hdr[0] & 0xf;
+
+  v->hlen = 0;
+  if(op == WS_CLOSE) {
+    reply[0] |= WS_CLOSE;
+    tcp_write(v->pcb, reply, sizeof(reply), TCP_WRITE_FLAG_COPY);
+    return viewer_close(v);
+  }
+  if(op == WS_PING) {
+    reply[0] |= WS_PONG;
+    reply[1] = v->ping_len;
+    if(tcp_sndbuf(v->pcb) >= sizeof(reply) + v->ping_len &&
+       tcp_write(v->pcb, reply, sizeof(reply), TCP_WRITE_FLAG_COPY |
+         TCP_WRITE_FLAG_MORE) == ERR_OK) {
+      tcp_write(v->pcb, v->ping, v->ping_len, TCP_WRITE_FLAG_COPY);
+      tcp_output(v->pcb);
+    }
+  }
+  return ERR_OK;
+}
+
+// Take the next byte from the viewer
+static err_t
+viewer_rx(struct viewer *v, u8 b)
+{
+  const u8 *h = v->hdr;
+
+  if(v->hlen < hdr_len(v)) {
+    v->hdr[v->hlen++] = b;
+    if(v->hlen < hdr_len(v)) {
+      return ERR_OK;
+    }
+    v->left = h[1] & 0x7f;
+    if(v->left == 126) {
+      v->left = h[2] << 8 | h[3];
+    } else if(v->left == 127) {
+      // Nothing a viewer sends comes near 4 GB
+      v->left = (u32)h[6] << 24 | h[7] << 16 | h[8] << 8 | h[9];
+    }
+    v->ping_len = 0;
+    return v->left ? ERR_OK : viewer_frame(v);
+  }
+  if((h[0] & 0xf) == WS_PING && v->ping_len < sizeof(v->ping)) {
+    if(h[1] & WS_MASKED) {
+      b ^= h[v->hlen - 4 + (v->ping_len & 3)];
+    }
+    v->ping[v->ping_len++] = b;
+  }
+  return --v->left ? ERR_OK : viewer_frame(v);
+}
+
+static err_t
+websock_recv(void *arg, struct tcp_pcb *pcb, struct pbuf *p, err_t err)
+{
+  struct viewer *v = arg;
+  err_t e = ERR_OK;
+  u16 i;
+
+  if(!p) {
+    return viewer_close(v);
+  }
+  tcp_recved(pcb, p->tot_len);
+  for(i=0; i<p->tot_len && v->pcb; i++) {
+    e = viewer_rx(v, pbuf_get_at(p, i));
+  }
+  pbuf_free(p);
+  return e;
+}
+
+static void
+websock_err(void *arg, err_t err)
+{
+  struct viewer *v = arg;
+
+  v->pcb = NULL;
+  stats.viewers--;
+}
+
+// Timer: send those due a message the latest sample
+static void
+websock_push(void *arg)
+{
+  struct viewer *v;
+  u32 now = timebase_ms(), n = 0, i;
+  u8 *m = msg;
+
+  if(!stats.viewers) {
+    timer_stop(&push_timer);
+    return;
+  }
+  for(i=0; i<WEBSOCK_VIEWERS; i++) {
+    v = &viewers[i];
+    // Half a sample early is near enough
+    if(!v->pcb || now - v->last_ms + TELPUSH_SAMPLE_MS / 2 < v->period_ms) {
+      continue;
+    }
+    v->last_ms = now;
+    if(!n) {
+      n = telpush_keyframe(msg + WS_HDR_MAX, sizeof(msg) - WS_HDR_MAX, seq++);
+      if(n < 126) {
+        m = msg + WS_HDR_MAX - 2;
+        m[1] = n;
+        n += 2;
+      } else {
+        m = msg;
+        m[1] = 126;
+        m[2] = n >> 8;
+        m[3] = n;
+        n += 4;
+      }
+      m[0] = WS_FIN | WS_BINARY;
+    }
+    if(tcp_sndbuf(v->pcb) < n ||
+       tcp_write(v->pcb, m, n, TCP_WRITE_FLAG_COPY) != ERR_OK) {
+      stats.skipped++;
+      continue;
+    }
+    tcp_output(v->pcb);
+    stats.messages++;
+    stats.bytes += n;
+  }
+}
+
+// The period asked for in `uri`'s query, or WEBSOCK_PERIOD_MS
+static u32
+uri_period(const char *q)
+{
+  u32 ms = 0;
+
+  if(strncmp(q, "?ms=", 4)) {
+    return WEBSOCK_PERIOD_MS;
+  }
+  for(q += 4; *q >= '0' && *q <= '9' && ms <= WEBSOCK_MAX_MS; q++) {
+    ms = ms * 10 + *q - '0';
+  }
+  if(ms < TELPUSH_SAMPLE_MS) {
+    return TELPUSH_SAMPLE_MS;
+  }
+  return ms > WEBSOCK_MAX_MS ? WEBSOCK_MAX_MS : ms;
+}
+
+// Write the base64 of the `n` bytes at `src` into `dst`, NUL-terminated
+static void
+base64(char *dst, const u8 *src, u32 n)
+{
+  static const char digits[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  u32 i, w;
+
+  for(i=0; i<n; i+=3) {
+    w = src[i] << 16 | (i + 1 < n ? src[i + 1] << 8 : 0) |
+        (i + 2 < n ? src[i + 2] : 0);
+    *dst++ = digits[w >> 18];
+    *dst++ = digits[(w >> 12) & 0x3f];
+    *dst++ = i + 1 < n ? digits[(w >> 6) & 0x3f] : '=';
+    *dst++ = i + 2 < n ? digits[w & 0x3f] : '=';
+  }
+  *dst = 0;
+}
+
+u8_t
+httpd_websocket_upgrade(struct tcp_pcb *pcb, const char *uri,
+    const char *hdrs, u16_t hdrs_len)
+{
+  static const char head[] = "HTTP/1.1 101 Switching Protocols\r\n"
+    "Upgrade: websocket\r\n"
+    "Connection: Upgrade\r\n"
+    "Sec-WebSocket-Accept: ";
+  char key[WS_KEY_MAX + sizeof(WS_GUID)];
+  char reply[sizeof(head) + 4 * ((SHA1_LEN + 2) / 3) + 4];
+  u8 digest[SHA1_LEN];
+  struct viewer *v = NULL;
+  const char *k, *end = hdrs + hdrs_len;
+  u32 n = strlen(WEBSOCK_URI), i;
+
+  if(strncmp(uri, WEBSOCK_URI, n) || (uri[n] && uri[n] != '?')) {
+    return 0;
+  }
+  for(i=0; i<WEBSOCK_VIEWERS; i++) {
+    if(!viewers[i].pcb) {
+      v = &viewers[i];
+      break;
+    }
+  }
+  k = lwip_strnstr(hdrs, WS_KEY_HDR, hdrs_len);
+  if(!v || !k) {
+    return 0;
+  }
+  for(k += strlen(WS_KEY_HDR); k < end && *k == ' '; k++) {
+  }
+  for(n=0; k + n < end && k[n] != '\r' && k[n] != ' '; n++) {
+    if(n == WS_KEY_MAX) {
+      return 0;
+    }
+  }
+  if(!n) {
+    return 0;
+  }
+
+  // The accept value, the one time this connection needs it
+  memcpy(key, k, n);
+  memcpy(key + n, WS_GUID, sizeof(WS_GUID) - 1);
+  sha1(key, n + sizeof(WS_GUID) - 1, digest);
+  memcpy(reply, head, sizeof(head) - 1);
+  base64(reply + sizeof(head) - 1, digest, SHA1_LEN);
+  strcat(reply, "\r\n\r\n");
+  if(tcp_write(pcb, reply, strlen(reply), TCP_WRITE_FLAG_COPY) != ERR_OK) {
+    return 0;
+  }
+
+  memset(v, 0, sizeof(*v));
+  v->pcb = pcb;
+  v->period_ms = uri_period(uri + strlen(WEBSOCK_URI));
+  v->last_ms = timebase_ms() - v->period_ms;
+  stats.viewers++;
+  stats.upgrades++;
+
+  pcb->tos = ETHERNETIF_TOS_TELEMETRY;
+  tcp_nagle_disable(pcb);
+  tcp_arg(pcb, v);
+  tcp_recv(pcb, websock_recv);
+  tcp_sent(pcb, NULL);
+  tcp_poll(pcb, NULL, 0);
+  tcp_err(pcb, websock_err);
+  tcp_output(pcb);
+  if(!timer_pending(&push_timer)) {
+    timer_start(&push_timer, TELPUSH_SAMPLE_MS, TELPUSH_SAMPLE_MS);
+  }
+  return 1;
+}
+
+const struct websock_stats *
+websock_stats()
+{
+  return &stats;
+}
@@ -0,0 +1,41 @@
+#ifndef _WEBSOCK_H_
+#define _WEBSOCK_H_
+
+// websock.h - Telemetry pushed to the web UI over WebSocket (RFC 6455).
+//
+// A GET of WEBSOCK_URI asking for "Upgrade: websocket" is taken from
+// httpd (LWIP_HTTPD_WEBSOCKET) and answered with the handshake, its
+// Sec-WebSocket-Accept hashed once, as the connection opens.  From then
+// on the board sends a binary message every `ms` milliseconds, as given
+// in the URI ("/telemetry.ws?ms=500"), or every WEBSOCK_PERIOD_MS: a
+// telpush datagram (telpush.h) of the latest sample alone, a keyframe, so
+// each message decodes on its own.  A viewer then keeps one socket open
+// rather than polling /status.json.
+//
+// A message is encoded once per sample, straight after the room kept in
+// front of it for its frame header, and the same bytes are queued to each
+// viewer due one.  A viewer whose send buffer has no room skips it.  From
+// the viewer only pings, answered, and a close are heeded; anything else
+// is read and dropped.  WEBSOCK_VIEWERS are served at once at most.
+
+#include "xil_types.h"
+
+#define WEBSOCK_URI       "/telemetry.ws"
+#define WEBSOCK_VIEWERS   (4)
+#define WEBSOCK_PERIOD_MS (1000)
+// Longest `ms` a viewer may ask for; the shortest is TELPUSH_SAMPLE_MS
+#define WEBSOCK_MAX_MS    (60000)
+
+struct websock_stats {
+  // Viewers connected now, and since boot
+  u32 viewers;
+  u32 upgrades;
+  u32 messages;
+  u32 bytes;
+  // Messages a viewer had no room for
+  u32 skipped;
+};
+
+const struct websock_stats *websock_stats();
+
+#endif // _WEBSOCK_H_
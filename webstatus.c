@@ -0,0 +1,320 @@
+// webstatus.c - Live board status as JSON for the web UI (see webfs.h).
+//
+// The file's pextension holds the number of the next item and its len is
+// ST_OPEN_LEN until the last item is written, when it becomes the bytes
+// actually sent, so that httpd sees the end of the file there.  Items are
+// written through a `struct out` over the send buffer, which stops taking
+// bytes once one does not fit; the item is then taken back whole.
+//
+// Past the headers the document goes out chunked, a chunk per send buffer:
+// ST_CHUNK_HDR bytes are kept in front of the items for the chunk's size,
+// and 2 bytes behind them for its CRLF.  ST_LAST is the empty chunk that
+// ends the document.
+
+#include <string.h>
+
+#include "lwip/netif.h"
+#include "lwip/tcp.h"
+#include "lwip/memp.h"
+#include "lwip/ip4_frag.h"
+#include "netif/ethernetif.h"
+
+#include "telemetry.h"
+#include "timebase.h"
+#include "version.h"
+#include "wbwatch.h"
+#include "webstatus.h"
+#include "xadc.h"
+
+// Length of the file until its end is known
+#define ST_OPEN_LEN (0x40000000)
+
+#define ST_HEADERS (0)
+#define ST_BOARD   (1)
+#define ST_XADC    (2)
+#define ST_TELEM   (3)
+#define ST_POOLS   (4)
+#define ST_POOL    (5) // one per memp pool
+#define ST_NET     (ST_POOL + MEMP_MAX)
+#define ST_WATCHES (ST_NET + 1)
+#define ST_WATCH   (ST_WATCHES + 1) // one per watch slot
+#define ST_END     (ST_WATCH + WBWATCH_MAX)
+#define ST_LAST    (ST_END + 1)
+#define ST_DONE    (ST_LAST + 1)
+
+// A chunk's size, as 4 hex digits and CRLF: httpd sends no more than
+// 0xffff bytes at a time
+#define ST_CHUNK_HDR (6)
+
+struct out {
+  char *buf;
+  int len;
+  int max;
+  int full;
+};
+
+static void
+put(struct out *o, const char *s, int n)
+{
+  if(o->full || n > o->max - o->len) {
+    o->full = 1;
+    return;
+  }
+  memcpy(o->buf + o->len, s, n);
+  o->len += n;
+}
+
+static void
+put_str(struct out *o, const char *s)
+{
+  put(o, s, strlen(s));
+}
+
+static void
+put_udec(struct out *o, u32 v)
+{
+  char d[10];
+  int n = sizeof(d);
+
+  do {
+    d[--n] = '0' + v % 10;
+    v /= 10;
+  } while(v);
+  put(o, d + n, sizeof(d) - n);
+}
+
+static void
+put_sdec(struct out *o, s32 v)
+{
+  if(v < 0) {
+    put(o, "-", 1);
+    v = -v;
+  }
+  put_udec(o, v);
+}
+
+// As a JSON string, "0x" and eight digits
+static void
+put_hex(struct out *o, u32 v)
+{
+  static const char digits[] = "0123456789abcdef";
+  char d[12];
+  int i;
+
+  d[0] = '"';
+  d[1] = '0';
+  d[2] = 'x';
+  for(i=0; i<8; i++) {
+    d[3 + i] = digits[(v >> (28 - 4 * i)) & 0xf];
+  }
+  d[11] = '"';
+  put(o, d, sizeof(d));
+}
+
+// `"name":` preceded by a comma unless `first`
+static void
+put_key(struct out *o, const char *name, int first)
+{
+  put_str(o, first ? "\"" : ",\"");
+  put_str(o, name);
+  put_str(o, "\":");
+}
+
+// Some watch slot below `n` is in use
+static int
+watch_before(u32 n)
+{
+  u32 addr, mask, value;
+
+  while(n--) {
+    if(!wbwatch_get(n, &addr, &mask, &value)) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+static void
+emit(u32 item, struct out *o)
+{
+  const struct memp_desc *d;
+  struct telem_record r;
+  u32 n, a, b, c;
+
+  if(item == ST_HEADERS) {
+    put_str(o, "HTTP/1.1 200 OK\r\n"
+        "Content-Type: application/json\r\n"
+        "Cache-Control: no-cache\r\n"
+        "Transfer-Encoding: chunked\r\n\r\n");
+  } else if(item == ST_BOARD) {
+    put_str(o, "{");
+    put_key(o, "uptime_ms", 1);
+    put_udec(o, timebase_ms());
+    put_key(o, "version", 0);
+    put_str(o, "\"");
+    put_udec(o, JAM_VERSION_MAJOR);
+    put_str(o, ".");
+    put_udec(o, JAM_VERSION_MINOR);
+    put_str(o, "\"");
+  } else if(item == ST_XADC) {
+    put_key(o, "xadc", 0);
+    put_str(o, "{");
+    put_key(o, "temp_mc", 1);
+    put_sdec(o, xadc_convert(XADC_TEMP, xadc_raw(XADC_TEMP)));
+    put_key(o, "vccint_mv", 0);
+    put_sdec(o, xadc_convert(XADC_VCCINT, xadc_raw(XADC_VCCINT)));
+    put_key(o, "vccaux_mv", 0);
+    put_sdec(o, xadc_convert(XADC_VCCAUX, xadc_raw(XADC_VCCAUX)));
+    put_key(o, "vbram_mv", 0);
+    put_sdec(o, xadc_convert(XADC_VBRAM, xadc_raw(XADC_VBRAM)));
+    put_str(o, "}");
+  } else if(item == ST_TELEM) {
+    n = telem_count();
+    put_key(o, "telemetry", 0);
+    put_str(o, "{");
+    put_key(o, "records", 1);
+    put_udec(o, n);
+    if(n && !telem_record(n - 1, &r)) {
+      put_key(o, "last_ms", 0);
+      put_udec(o, r.time_ms);
+      put_key(o, "events", 0);
+      put_udec(o, r.events);
+      put_key(o, "temp_max_mc", 0);
+      put_sdec(o, xadc_convert(XADC_TEMP, r.max[XADC_TEMP]));
+    }
+    put_str(o, "}");
+  } else if(item == ST_POOLS) {
+    put_key(o, "pools", 0);
+    put_str(o, "[");
+  } else if(item < ST_NET) {
+    n = item - ST_POOL;
+    d = memp_pools[n];
+    put_str(o, n ? ",{" : "{");
+    put_key(o, "name", 1);
+    put_str(o, "\"");
+    put_str(o, d->desc);
+    put_str(o, "\"");
+    put_key(o, "used", 0);
+    put_udec(o, d->stats->used);
+    put_key(o, "max", 0);
+    put_udec(o, d->stats->max);
+    put_key(o, "avail", 0);
+    put_udec(o, d->stats->avail);
+    put_key(o, "err", 0);
+    put_udec(o, d->stats->err);
+    put_str(o, "}");
+  } else if(item == ST_NET) {
+    ethernetif_rx_nomem(netif_default, &a, &b);
+    put_str(o, "]");
+    put_key(o, "memp_fails", 0);
+    put_udec(o, memp_fail_count());
+    put_key(o, "eth0", 0);
+    put_str(o, "{");
+    put_key(o, "rx_held", 1);
+    put_udec(o, a);
+    put_key(o, "rx_nomem_drops", 0);
+    put_udec(o, b);
+    put_str(o, "}");
+    put_key(o, "reass", 0);
+    put_str(o, "{");
+    put_key(o, "rejected", 1);
+    put_udec(o, ip_reass_drops.rejected);
+    put_key(o, "capped", 0);
+    put_udec(o, ip_reass_drops.capped);
+    put_str(o, "}");
+  } else if(item == ST_WATCHES) {
+    put_key(o, "watches", 0);
+    put_str(o, "[");
+  } else if(item < ST_END) {
+    n = item - ST_WATCH;
+    if(wbwatch_get(n, &a, &b, &c)) {
+      return;
+    }
+    put_str(o, watch_before(n) ? ",{" : "{");
+    put_key(o, "addr", 1);
+    put_hex(o, a);
+    put_key(o, "mask", 0);
+    put_hex(o, b);
+    put_key(o, "value", 0);
+    put_hex(o, c);
+    put_str(o, "}");
+  } else if(item == ST_END) {
+    put_str(o, "]}\n");
+  } else {
+    put_str(o, "0\r\n\r\n");
+  }
+}
+
+int
+webstatus_open(struct fs_file *file, const char *name)
+{
+  if(strcmp(name, WEBSTATUS_URI)) {
+    return 0;
+  }
+  memset(file, 0, sizeof(*file));
+  file->len = ST_OPEN_LEN;
+  file->pextension = (void *)ST_HEADERS;
+  file->flags = FS_FILE_FLAGS_HEADER_INCLUDED |
+    FS_FILE_FLAGS_HEADER_PERSISTENT | WEBSTATUS_FLAG;
+  return 1;
+}
+
+int
+webstatus_read(struct fs_file *file, char *buf, int count)
+{
+  static const char hex[] = "0123456789abcdef";
+  struct out o = { buf, 0, count, 0 };
+  u32 item = (u32)file->pextension;
+  int start, body, i, n;
+
+  if(item == ST_HEADERS) {
+    emit(item, &o);
+    if(o.full) {
+      return FS_READ_EOF;
+    }
+    item++;
+  }
+
+  // The body items, as one chunk
+  body = o.len + ST_CHUNK_HDR;
+  if(item < ST_LAST && body + 2 < count) {
+    o.len = body;
+    o.max = count - 2;
+    for(; item < ST_LAST; item++) {
+      start = o.len;
+      emit(item, &o);
+      if(o.full) {
+        o.len = start;
+        break;
+      }
+    }
+    o.full = 0;
+    o.max = count;
+    if(o.len == body) {
+      o.len = body - ST_CHUNK_HDR;
+    } else {
+      n = o.len - body;
+      for(i=0; i<4; i++) {
+        buf[body - ST_CHUNK_HDR + i] = hex[(n >> (12 - 4 * i)) & 0xf];
+      }
+      put(&o, "\r\n", 2);
+      memcpy(buf + body - 2, "\r\n", 2);
+    }
+  }
+  if(item == ST_LAST) {
+    emit(item, &o);
+    if(!o.full) {
+      item++;
+    }
+  }
+  if(!o.len && item < ST_DONE) {
+    return FS_READ_EOF;
+  }
+
+  file->pextension = (void *)item;
+  file->index += o.len;
+  if(item == ST_DONE) {
+    file->len = file->index;
+  }
+  return o.len;
+}
@@ -0,0 +1,35 @@
+#ifndef _WEBSTATUS_H_
+#define _WEBSTATUS_H_
+
+// webstatus.h - Live board status as JSON for the web UI (see webfs.h).
+//
+// GET /status.json returns uptime, firmware version, the XADC's on-chip
+// sensors, the telemetry ring, every memp pool's use, high-water mark and
+// failures, eth0's RX holds and drops, the reassembly drops and each
+// register watch (see wbwatch.h).
+//
+// Nothing is built ahead of the response and nothing is allocated for
+// it: the document is a fixed sequence of items, each written straight
+// into httpd's send buffer as that buffer is filled, and the open file
+// keeps the number of the next item.  An item that does not fit waits for
+// the next send.  Values are read as their item is written, so a response
+// is not one snapshot.  Its length is not known until the end, so the
+// document is sent with chunked transfer coding, a chunk per send, and
+// the connection can stay open for the next poll.
+
+#include "lwip/apps/fs.h"
+
+#define WEBSTATUS_URI "/status.json"
+
+// fs_file flag marking a file webstatus_read() writes
+#define WEBSTATUS_FLAG (0x80)
+
+// If `name` is WEBSTATUS_URI, open it into `file` and return 1; otherwise
+// return 0
+int webstatus_open(struct fs_file *file, const char *name);
+
+// Write up to `count` bytes of whole items into `buf`.  Returns the bytes
+// written, or FS_READ_EOF if the next item cannot fit in `count`.
+int webstatus_read(struct fs_file *file, char *buf, int count);
+
+#endif // _WEBSTATUS_H_
@@ -0,0 +1,60 @@
+// work.c - Deferred work queue drained by the main loop.
+
+#include "intr.h"
+#include "load.h"
+#include "work.h"
+
+static struct work *queue[WORK_QUEUE_LEN];
+static volatile u8 head; // next slot to fill
+static volatile u8 tail; // next slot to run
+
+int
+work_schedule(struct work *w)
+{
+  u32 msr = intr_lock();
+  u8 next;
+  int rc = 0;
+
+  if(!w->pending) {
+    next = (head + 1) % WORK_QUEUE_LEN;
+    if(next == tail) {
+      rc = -1;
+    } else {
+      w->pending = 1;
+      queue[head] = w;
+      head = next;
+    }
+  }
+
+  intr_unlock(msr);
+
+  return rc;
+}
+
+int
+work_run()
+{
+  struct load_span span;
+  struct work *w;
+  int count = 0;
+
+  while(tail != head) {
+    w = queue[tail];
+    tail = (tail + 1) % WORK_QUEUE_LEN;
+    // Clear pending before running so `fn` (or an interrupt while it runs)
+    // can reschedule the item.
+    w->pending = 0;
+    load_begin(&span);
+    w->fn(w->arg);
+    load_end(&span, (u32)w->fn);
+    count++;
+  }
+
+  return count;
+}
+
+int
+work_pending()
+{
+  return tail != head;
+}
@@ -0,0 +1,34 @@
+#ifndef _WORK_H_
+#define _WORK_H_
+
+// work.h - Deferred work queue drained by the main loop.
+//
+// Interrupt handlers do the minimum at interrupt level and schedule a work
+// item for the rest.  A work item is queued at most once until it has run,
+// so repeated interrupts coalesce into a single call.
+
+#include "xil_types.h"
+
+struct work {
+  void (*fn)(void *arg);
+  void *arg;
+  volatile u8 pending;
+};
+
+#define WORK_INIT(fn, arg) { (fn), (arg), 0 }
+
+// Number of distinct work items that can be pending at once
+#define WORK_QUEUE_LEN (16)
+
+// Queue `w` to run from work_run().  Safe to call from interrupt handlers.
+//
+// Returns 0 if queued (or already pending), -1 if the queue is full.
+int work_schedule(struct work *w);
+
+// Run all pending work items.  Returns the number run.
+int work_run();
+
+// Returns non-zero if work items are waiting to run
+int work_pending();
+
+#endif // _WORK_H_
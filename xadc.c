@@ -0,0 +1,585 @@
+// xadc.c - XADC sequencer, board health snapshots and alarms.
+//
+// The sequencer runs in continuous mode over the on-chip sensors, VP/VN and
+// the aux inputs in XADC_AUX_CHANNELS, with the ADC and supply sensor
+// calibration channel in the scan.  Results are read straight from the
+// result registers, so unlike XSysMon_GetAdcData() in single channel mode
+// nothing ever waits on the ADC.
+//
+// Aux inputs behind an external mux (XADC_EXT_MUX) are the same scan: the
+// sequencer puts each channel's number on MUXADDR as it converts it.
+//
+// The alarm interrupt handler timestamps each crossing into a ring of
+// events and schedules a work item that hands them to the alarm handler.
+// It runs an armed burst first, while the crossing is fresh.  A burst
+// saves CFR0 and CFR1, which hold the channel, the averaging and the
+// sequencer mode, and writes them back once done, the sequencer stopped
+// in between as the channel registers need.
+//
+// Split across two cores (role.h), the housekeeping core does all of that
+// and also sends every event, and a snapshot every XADC_PUBLISH_MS, over
+// mbox.h.  The network core never touches the XADC: it keeps the latest
+// snapshot and feeds the events into its own ring, stamped as they arrive.
+
+#include "xparameters.h"
+#include "xsysmon.h"
+#include "xil_printf.h"
+
+#include "intr.h"
+#include "log.h"
+#include "mbox.h"
+#include "ovl.h"
+#include "ring.h"
+#include "role.h"
+#include "timebase.h"
+#include "timer.h"
+#include "work.h"
+#include "xadc.h"
+
+#define XADC_BASE XPAR_SYSMON_0_BASEADDR
+
+// The XADC is on this core's bus, or the housekeeping core's
+#define XADC_LOCAL (JAM_ROLE != JAM_ROLE_NET)
+
+// Snapshots sent to the network core: the raw results two to a word, then
+// the peaks of the on-chip sensors, lowest then highest
+#define XADC_RAW_WORDS  ((XADC_NUM_CHANNELS + 1) / 2)
+#define XADC_PEAKS      (XADC_VBRAM + 1)
+#define XADC_SNAP_WORDS (XADC_RAW_WORDS + XADC_PEAKS)
+
+// Full scale of each channel type over the 12-bit code.  The temperature
+// transfer function is code * 503.975 / 4096 - 273.15 C (UG480), the
+// on-chip supplies have a 3 V range and VP/VN and the aux inputs 1 V.
+#define XADC_CODE_SHIFT    (4)
+#define XADC_TEMP_FS_MC    (503975)
+#define XADC_TEMP_OFFS_MC  (273150)
+#define XADC_SUPPLY_FS_MV  (3000)
+#define XADC_INPUT_FS_MV   (1000)
+
+// Sequencer channels other than the aux inputs
+#define XADC_SEQ_SENSORS (XSM_SEQ_CH_TEMP | XSM_SEQ_CH_VCCINT | \
+    XSM_SEQ_CH_VCCAUX | XSM_SEQ_CH_VBRAM | XSM_SEQ_CH_VPVN)
+#define XADC_SEQ_CHANNELS (XADC_SEQ_SENSORS | \
+    ((u64)XADC_AUX_CHANNELS << XSM_SEQ_CH_AUX_SHIFT))
+
+// Channels in the scan, bit n for index n
+#define XADC_SCANNED (((1 << XADC_AUX(0)) - 1) | \
+    ((u32)XADC_AUX_CHANNELS << XADC_AUX(0)))
+
+// Alarms raised, and the interrupts that report them (the temperature and
+// OT alarms also interrupt as they clear)
+#define XADC_ALARMS (XSM_CFR1_OT_MASK | XSM_CFR1_ALM_TEMP_MASK | \
+    XSM_CFR1_ALM_VCCINT_MASK | XSM_CFR1_ALM_VCCAUX_MASK | \
+    XSM_CFR1_ALM_VBRAM_MASK)
+#define XADC_ALARM_INTRS (XSM_IPIXR_OT_MASK | XSM_IPIXR_OT_DEACTIVE_MASK | \
+    XSM_IPIXR_TEMP_MASK | XSM_IPIXR_TEMP_DEACTIVE_MASK | \
+    XSM_IPIXR_VCCINT_MASK | XSM_IPIXR_VCCAUX_MASK | XSM_IPIXR_VBRAM_MASK)
+
+#if XADC_LOCAL
+static XSysMon xsysmon;
+#else
+// The housekeeping core's latest snapshot and peaks
+static struct xadc_snapshot remote;
+static u16 remote_peak[2][XADC_PEAKS];
+#endif
+
+// A history ring (ring.h) filled by the interrupt handler
+static struct xadc_event events[XADC_EVENTS];
+static struct ring event_ring = RING_INIT(XADC_EVENTS);
+// Events handed to alarm_fn so far
+static u32 event_done;
+
+// The last burst and its samples
+static struct xadc_burst burst;
+static u16 burst_samples[XADC_BURST_SAMPLES];
+
+static xadc_alarm_fn alarm_fn;
+static void *alarm_arg;
+
+static void xadc_alarm_work(void *arg);
+static struct work alarm_work = WORK_INIT(xadc_alarm_work, NULL);
+
+#if XADC_LOCAL
+// Result register of each channel index below the aux inputs
+static const u16 xadc_reg[XADC_AUX(0)] = {
+  [XADC_TEMP]   = XSM_TEMP_OFFSET,
+  [XADC_VCCINT] = XSM_VCCINT_OFFSET,
+  [XADC_VCCAUX] = XSM_VCCAUX_OFFSET,
+  [XADC_VBRAM]  = XSM_VBRAM_OFFSET,
+  [XADC_VPVN]   = XSM_VPVN_OFFSET,
+};
+#endif
+
+#if XADC_LOCAL
+// XSysMon channel of each channel index below the aux inputs
+static const u8 xadc_chan[XADC_AUX(0)] = {
+  [XADC_TEMP]   = XSM_CH_TEMP,
+  [XADC_VCCINT] = XSM_CH_VCCINT,
+  [XADC_VCCAUX] = XSM_CH_VCCAUX,
+  [XADC_VBRAM]  = XSM_CH_VBRAM,
+  [XADC_VPVN]   = XSM_CH_VPVN,
+};
+
+static u32 xadc_offset(u32 ch);
+static void xadc_burst_capture(u8 trigger, u32 status);
+#endif
+
+static const char *const xadc_name[XADC_AUX(0)] = {
+  [XADC_TEMP]   = "temp",
+  [XADC_VCCINT] = "vccint",
+  [XADC_VCCAUX] = "vccaux",
+  [XADC_VBRAM]  = "vbram",
+  [XADC_VPVN]   = "vpvn",
+};
+
+// Add an event to the ring, from the interrupt handler or, on the network
+// core, from the main loop
+static void
+xadc_record(u32 status, u32 alarms)
+{
+  struct xadc_event *ev = &events[ring_head_slot(&event_ring)];
+
+  ev->time_us = timebase_us();
+  ev->status = status;
+  ev->alarms = alarms;
+  ring_push(&event_ring, 1);
+  LOG("xadc: alarm status %04x, active %04x", ev->status, ev->alarms);
+
+  work_schedule(&alarm_work);
+}
+
+#if XADC_LOCAL
+static void
+xadc_isr(void *ref)
+{
+  u32 status = XSysMon_ReadReg(XADC_BASE, XSM_IPISR_OFFSET) & XADC_ALARM_INTRS;
+
+  // Writing the bits back clears them
+  XSysMon_WriteReg(XADC_BASE, XSM_IPISR_OFFSET, status);
+  if(status && burst.state == XADC_BURST_ARMED) {
+    xadc_burst_capture(XADC_TRIGGER_ALARM, status);
+  }
+  if(status) {
+    xadc_record(status, XSysMon_ReadReg(XADC_BASE, XSM_AOR_OFFSET));
+  }
+}
+#endif
+
+// Work: pass new events to the alarm handler
+static void
+xadc_alarm_work(void *arg)
+{
+  struct xadc_event ev;
+
+  u32 count = event_ring.head;
+
+  // Events overwritten before we got to them are skipped
+  if(count - event_done > XADC_EVENTS) {
+    event_done = count - XADC_EVENTS;
+  }
+  while(event_done != count) {
+    if(xadc_event(event_done++, &ev) != 0) {
+      continue;
+    }
+#if JAM_ROLE == JAM_ROLE_HOUSE
+    {
+      u32 words[2] = { ev.status, ev.alarms };
+
+      mbox_send(MBOX_MSG_XADC_EVENT, words, 2);
+    }
+#endif
+    if(alarm_fn) {
+      alarm_fn(&ev, alarm_arg);
+    }
+  }
+}
+
+#if JAM_ROLE == JAM_ROLE_HOUSE
+// Timer: send a snapshot to the network core
+static void
+xadc_publish(void *arg)
+{
+  struct xadc_snapshot s;
+  u32 words[XADC_SNAP_WORDS] = { 0 };
+  u32 ch;
+
+  xadc_snapshot(&s);
+  for(ch=0; ch<XADC_NUM_CHANNELS; ch++) {
+    words[ch / 2] |= (u32)s.raw[ch] << (ch & 1) * 16;
+  }
+  for(ch=0; ch<XADC_PEAKS; ch++) {
+    words[XADC_RAW_WORDS + ch] = xadc_peak(ch, 0) | (u32)xadc_peak(ch, 1) << 16;
+  }
+  mbox_send(MBOX_MSG_XADC_SNAPSHOT, words, XADC_SNAP_WORDS);
+}
+
+static struct timer publish_timer = TIMER_INIT(xadc_publish, NULL);
+static struct timer_deadline publish_deadline =
+    TIMER_DEADLINE_INIT("xadc", XADC_PUBLISH_DEADLINE_US);
+#endif
+
+#if !XADC_LOCAL
+static void
+xadc_remote_snapshot(u16 type, const u32 *words, u32 n, void *arg)
+{
+  u32 ch;
+
+  if(n < XADC_SNAP_WORDS) {
+    return;
+  }
+  remote.time_ms = timebase_ms();
+  for(ch=0; ch<XADC_NUM_CHANNELS; ch++) {
+    remote.raw[ch] = words[ch / 2] >> (ch & 1) * 16;
+  }
+  for(ch=0; ch<XADC_PEAKS; ch++) {
+    remote_peak[0][ch] = words[XADC_RAW_WORDS + ch];
+    remote_peak[1][ch] = words[XADC_RAW_WORDS + ch] >> 16;
+  }
+}
+
+static void
+xadc_remote_event(u16 type, const u32 *words, u32 n, void *arg)
+{
+  if(n >= 2) {
+    xadc_record(words[0], words[1]);
+  }
+}
+#endif
+
+#if XADC_LOCAL
+
+// Program alarm threshold register `reg` with `value` of channel `ch`
+static void
+xadc_threshold(u8 reg, u32 ch, s32 value)
+{
+  XSysMon_SetAlarmThreshold(&xsysmon, reg, xadc_unconvert(ch, value));
+}
+
+#endif
+
+void
+init_xadc()
+{
+#if XADC_LOCAL
+    XSysMon_Config *cfg_ptr = XSysMon_LookupConfig(XPAR_SYSMON_0_DEVICE_ID);
+
+    XSysMon_CfgInitialize(&xsysmon, cfg_ptr, cfg_ptr->BaseAddress);
+
+    // The channel registers only take writes with the sequencer stopped
+    XSysMon_SetSequencerMode(&xsysmon, XSM_SEQ_MODE_SAFE);
+    XSysMon_SetAvg(&xsysmon, XADC_AVG);
+    XSysMon_SetSeqInputMode(&xsysmon,
+        (u32)XADC_AUX_BIPOLAR << XSM_SEQ_CH_AUX_SHIFT);
+    XSysMon_SetSeqAcqTime(&xsysmon,
+        (u32)XADC_AUX_SETTLE << XSM_SEQ_CH_AUX_SHIFT);
+#if XADC_EXT_MUX
+    XSysMon_SetExtenalMux(&xsysmon, XADC_EXT_MUX_INPUT);
+#endif
+    XSysMon_SetSeqAvgEnables(&xsysmon, XADC_SEQ_CHANNELS);
+    XSysMon_SetSeqChEnables(&xsysmon, XADC_SEQ_CHANNELS | XSM_SEQ_CH_CALIB);
+    XSysMon_SetCalibEnables(&xsysmon, XSM_CFR1_CAL_PS_GAIN_OFFSET_MASK |
+        XSM_CFR1_CAL_ADC_GAIN_OFFSET_MASK);
+
+    XSysMon_SetAlarmEnables(&xsysmon, 0);
+    xadc_threshold(XSM_ATR_TEMP_UPPER, XADC_TEMP, XADC_TEMP_HI_MC);
+    xadc_threshold(XSM_ATR_TEMP_LOWER, XADC_TEMP, XADC_TEMP_LO_MC);
+    xadc_threshold(XSM_ATR_VCCINT_UPPER, XADC_VCCINT, XADC_VCCINT_HI_MV);
+    xadc_threshold(XSM_ATR_VCCINT_LOWER, XADC_VCCINT, XADC_VCCINT_LO_MV);
+    xadc_threshold(XSM_ATR_VCCAUX_UPPER, XADC_VCCAUX, XADC_VCCAUX_HI_MV);
+    xadc_threshold(XSM_ATR_VCCAUX_LOWER, XADC_VCCAUX, XADC_VCCAUX_LO_MV);
+    xadc_threshold(XSM_ATR_VBRAM_UPPER, XADC_VBRAM, XADC_VBRAM_HI_MV);
+    xadc_threshold(XSM_ATR_VBRAM_LOWER, XADC_VBRAM, XADC_VBRAM_LO_MV);
+    XSysMon_SetAlarmEnables(&xsysmon, XADC_ALARMS);
+
+    XSysMon_SetSequencerMode(&xsysmon, XSM_SEQ_MODE_CONTINPASS);
+
+    XSysMon_IntrClear(&xsysmon, XSM_IPIXR_ALL_MASK);
+    intr_connect(XPAR_INTC_0_SYSMON_0_VEC_ID, xadc_isr, NULL);
+    XSysMon_IntrEnable(&xsysmon, XADC_ALARM_INTRS);
+    XSysMon_IntrGlobalEnable(&xsysmon);
+#if JAM_ROLE == JAM_ROLE_HOUSE
+    timer_set_deadline(&publish_timer, &publish_deadline);
+    timer_start(&publish_timer, 0, XADC_PUBLISH_MS);
+#endif
+#else
+    mbox_on(MBOX_MSG_XADC_SNAPSHOT, xadc_remote_snapshot, NULL);
+    mbox_on(MBOX_MSG_XADC_EVENT, xadc_remote_event, NULL);
+#endif
+}
+
+#if XADC_LOCAL
+// Result register of channel index `ch`
+static u32
+xadc_offset(u32 ch)
+{
+  if(ch >= XADC_AUX(0)) {
+    return XSM_AUX00_OFFSET + 4 * (ch - XADC_AUX(0));
+  }
+  return xadc_reg[ch];
+}
+#endif
+
+u16
+xadc_raw(u32 ch)
+{
+  if(ch >= XADC_NUM_CHANNELS || !(XADC_SCANNED & (1 << ch))) {
+    return 0;
+  }
+#if XADC_LOCAL
+  return XSysMon_ReadReg(XADC_BASE, xadc_offset(ch));
+#else
+  return remote.raw[ch];
+#endif
+}
+
+void
+xadc_snapshot(struct xadc_snapshot *s)
+{
+#if XADC_LOCAL
+  u32 ch;
+
+  s->time_ms = timebase_ms();
+  for(ch=0; ch<XADC_NUM_CHANNELS; ch++) {
+    s->raw[ch] = XADC_SCANNED & (1 << ch) ?
+        XSysMon_ReadReg(XADC_BASE, xadc_offset(ch)) : 0;
+  }
+#else
+  *s = remote;
+#endif
+}
+
+u16
+xadc_peak(u32 ch, int max)
+{
+#if XADC_LOCAL
+  if(ch > XADC_VBRAM) {
+    return 0;
+  }
+  // Straight from the registers, which are in channel order, rather than
+  // through XSysMon_GetMinMaxMeasurement() and its asserts
+  return XSysMon_ReadReg(XADC_BASE,
+      (max ? XSM_MAX_TEMP_OFFSET : XSM_MIN_TEMP_OFFSET) + 4 * ch);
+#else
+  return ch > XADC_VBRAM ? 0 : remote_peak[!!max][ch];
+#endif
+}
+
+s32
+xadc_convert(u32 ch, u16 raw)
+{
+  // 4095 * 503975 still fits in 32 bits
+  u32 code = raw >> XADC_CODE_SHIFT;
+
+  // Bipolar: 12-bit two's complement, the same step over +-0.5 V
+  if(ch >= XADC_AUX(0) && (XADC_AUX_BIPOLAR & (1 << (ch - XADC_AUX(0))))) {
+    code = (raw & 0x8000 ? 0x10000 - raw : raw) >> XADC_CODE_SHIFT;
+    code = (code * XADC_INPUT_FS_MV) >> 12;
+    return raw & 0x8000 ? -(s32)code : (s32)code;
+  }
+
+  switch(ch) {
+  case XADC_TEMP:
+    return (s32)((code * XADC_TEMP_FS_MC) >> 12) - XADC_TEMP_OFFS_MC;
+  case XADC_VCCINT:
+  case XADC_VCCAUX:
+  case XADC_VBRAM:
+    return (code * XADC_SUPPLY_FS_MV) >> 12;
+  default:
+    return (code * XADC_INPUT_FS_MV) >> 12;
+  }
+}
+
+u16
+xadc_unconvert(u32 ch, s32 value)
+{
+  u32 fs, code;
+
+  switch(ch) {
+  case XADC_TEMP:
+    value += XADC_TEMP_OFFS_MC;
+    fs = XADC_TEMP_FS_MC;
+    break;
+  case XADC_VCCINT:
+  case XADC_VCCAUX:
+  case XADC_VBRAM:
+    fs = XADC_SUPPLY_FS_MV;
+    break;
+  default:
+    fs = XADC_INPUT_FS_MV;
+    break;
+  }
+
+  if(value <= 0) {
+    return 0;
+  }
+  code = ((u32)value << 12) / fs;
+  if(code > 0xfff) {
+    code = 0xfff;
+  }
+  return code << XADC_CODE_SHIFT;
+}
+
+#if XADC_LOCAL
+// Capture the burst set up in `burst`, with interrupts locked
+static void
+xadc_burst_capture(u8 trigger, u32 status)
+{
+  u32 off = xadc_offset(burst.channel), msr, cfr0, cfr1, sr, t0 = 0, t, i;
+  u32 chan = burst.channel < XADC_AUX(0) ? xadc_chan[burst.channel] :
+      XSM_CH_AUX_MIN + burst.channel - XADC_AUX(0);
+
+  msr = intr_lock();
+  burst.trigger = trigger;
+  burst.status = status;
+  burst.time_us = timebase_us();
+  burst.count = 0;
+  burst.cycles = 0;
+  cfr0 = XSysMon_ReadReg(XADC_BASE, XSM_CFR0_OFFSET);
+  cfr1 = XSysMon_ReadReg(XADC_BASE, XSM_CFR1_OFFSET);
+  XSysMon_SetSequencerMode(&xsysmon, XSM_SEQ_MODE_SAFE);
+  XSysMon_SetAvg(&xsysmon, XSM_AVG_0_SAMPLES);
+  XSysMon_SetSequencerMode(&xsysmon, XSM_SEQ_MODE_SINGCHAN);
+  XSysMon_SetSingleChParams(&xsysmon, chan, FALSE, FALSE, FALSE);
+#if XADC_EXT_MUX
+  // The mux only carries the aux inputs; on-chip sensors go direct
+  if(burst.channel < XADC_AUX(0)) {
+    XSysMon_WriteReg(XADC_BASE, XSM_CFR0_OFFSET,
+        XSysMon_ReadReg(XADC_BASE, XSM_CFR0_OFFSET) & ~XSM_CFR0_MUX_MASK);
+  }
+#endif
+
+  // A conversion of the old channel may be pending; the status bit
+  // toggles on a write, so only a set one is written back
+  if(XSysMon_ReadReg(XADC_BASE, XSM_IPISR_OFFSET) & XSM_IPIXR_EOC_MASK) {
+    XSysMon_WriteReg(XADC_BASE, XSM_IPISR_OFFSET, XSM_IPIXR_EOC_MASK);
+  }
+  for(i=0; i<burst.want; i++) {
+    t = timebase_stamp();
+    while(!((sr = XSysMon_ReadReg(XADC_BASE, XSM_IPISR_OFFSET)) &
+          XSM_IPIXR_EOC_MASK) &&
+          timebase_stamp() - t <=
+          XADC_BURST_TIMEOUT_US * TIMEBASE_CYCLES_PER_US) {
+    }
+    if(!(sr & XSM_IPIXR_EOC_MASK)) {
+      break;
+    }
+    XSysMon_WriteReg(XADC_BASE, XSM_IPISR_OFFSET, XSM_IPIXR_EOC_MASK);
+    burst_samples[i] = XSysMon_ReadReg(XADC_BASE, off);
+    t = timebase_stamp();
+    if(i == 0) {
+      t0 = t;
+    }
+    burst.cycles = t - t0;
+  }
+  burst.count = i;
+  burst.state = i == burst.want ? XADC_BURST_DONE : XADC_BURST_FAILED;
+
+  XSysMon_SetSequencerMode(&xsysmon, XSM_SEQ_MODE_SAFE);
+  XSysMon_WriteReg(XADC_BASE, XSM_CFR0_OFFSET, cfr0);
+  XSysMon_WriteReg(XADC_BASE, XSM_CFR1_OFFSET, cfr1);
+  intr_unlock(msr);
+}
+#endif
+
+// Set up a burst of `n` samples of `ch`.  Returns 0, or -1 if it cannot be.
+static int
+xadc_burst_setup(u32 ch, u32 n)
+{
+  u32 msr;
+
+  if(!XADC_LOCAL || ch >= XADC_NUM_CHANNELS || n == 0 ||
+     n > XADC_BURST_SAMPLES) {
+    return -1;
+  }
+  // Not while the alarm handler may be taking an armed one
+  msr = intr_lock();
+  burst.state = XADC_BURST_IDLE;
+  burst.channel = ch;
+  burst.want = n;
+  intr_unlock(msr);
+  return 0;
+}
+
+int
+xadc_burst_start(u32 ch, u32 n)
+{
+  if(xadc_burst_setup(ch, n) != 0) {
+    return -1;
+  }
+#if XADC_LOCAL
+  xadc_burst_capture(XADC_TRIGGER_COMMAND, 0);
+#endif
+  LOG("xadc: burst of %u samples of channel %u", burst.count, ch);
+  return 0;
+}
+
+int
+xadc_burst_arm(u32 ch, u32 n)
+{
+  if(xadc_burst_setup(ch, n) != 0) {
+    return -1;
+  }
+  burst.state = XADC_BURST_ARMED;
+  return 0;
+}
+
+void
+xadc_burst_cancel()
+{
+  if(burst.state == XADC_BURST_ARMED) {
+    burst.state = XADC_BURST_IDLE;
+  }
+}
+
+const struct xadc_burst *
+xadc_burst(const u16 **samples)
+{
+  *samples = burst_samples;
+  return &burst;
+}
+
+void
+xadc_on_alarm(xadc_alarm_fn fn, void *arg)
+{
+  alarm_fn = fn;
+  alarm_arg = arg;
+}
+
+u32
+xadc_event_count()
+{
+  return event_ring.head;
+}
+
+int
+xadc_event(u32 n, struct xadc_event *ev)
+{
+  if(!ring_holds(&event_ring, n)) {
+    return -1;
+  }
+  *ev = events[n & event_ring.mask];
+  // The handler may have written over it meanwhile
+  return ring_holds(&event_ring, n) ? 0 : -1;
+}
+
+OVL_TEXT(report) void
+dump_xadc()
+{
+  struct xadc_snapshot s;
+  u32 ch;
+
+  xadc_snapshot(&s);
+  xil_printf("XADC%s:\n", XADC_LOCAL ? "" : " (housekeeping core)");
+  for(ch=0; ch<XADC_NUM_CHANNELS; ch++) {
+    if(!(XADC_SCANNED & (1 << ch))) {
+      continue;
+    }
+    if(ch < XADC_AUX(0)) {
+      xil_printf("  %s", xadc_name[ch]);
+    } else {
+      xil_printf("  aux%d", ch - XADC_AUX(0));
+    }
+    xil_printf(" %04x %d %s\n", s.raw[ch], xadc_convert(ch, s.raw[ch]),
+        ch == XADC_TEMP ? "mC" : "mV");
+  }
+}
@@ -0,0 +1,216 @@
+#ifndef _XADC_H_
+#define _XADC_H_
+
+// xadc.h - XADC sequencer, board health snapshots and alarms.
+//
+// The sequencer scans every channel below continuously, so the latest
+// result of each is always waiting in its register and a snapshot is just
+// a pass of register reads.  The XADC compares each on-chip sensor against
+// its alarm thresholds as it converts it and interrupts on a crossing.
+//
+// A burst captures one channel at the ADC's full rate instead, to see
+// supply droop or a transient the averaged scan smooths over: the
+// sequencer is switched to single channel mode without averaging, the
+// CPU polls each end of conversion and copies the result into a BRAM
+// buffer of up to XADC_BURST_SAMPLES, and the scan then resumes as it
+// was.  It runs with interrupts locked, a few microseconds a sample, and
+// starts on command or, once armed, in the handler of the next alarm, so
+// the capture starts within a few microseconds of the crossing.  There
+// is no pre-trigger history: the CPU cannot keep up a ring at that rate
+// alongside everything else.  The rate is the ADC clock's (the clock
+// divider in the IP's configuration) over 26 cycles a conversion, at
+// most 1 MSPS; each burst records the time it took, so readers scale the
+// samples by what was achieved.  xburst.h serves the last burst over TCP.
+
+#include "xil_types.h"
+
+// Channel indices in struct xadc_snapshot
+#define XADC_TEMP         (0)
+#define XADC_VCCINT       (1)
+#define XADC_VCCAUX       (2)
+#define XADC_VBRAM        (3)
+#define XADC_VPVN         (4)
+#define XADC_AUX(n)       (5 + (n))
+#define XADC_NUM_AUX      (16)
+#define XADC_NUM_CHANNELS (5 + XADC_NUM_AUX)
+
+// Aux inputs (VAUXP/VAUXN[n]) in the scan, bit n for aux channel n.  Leave
+// out the ones the board does not wire up to shorten the scan.
+#ifndef XADC_AUX_CHANNELS
+#define XADC_AUX_CHANNELS (0xffff)
+#endif
+
+// Aux inputs through an external multiplexer.  With XADC_EXT_MUX set the
+// sequencer drives the mux address pins (MUXADDR) with the aux channel it
+// scans and converts the mux output on XADC_EXT_MUX_INPUT (an XSM_CH_
+// channel: the dedicated VP/VN or one aux pair) instead of each VAUX pair;
+// results still land in each aux channel's register, so everything below
+// sees them as aux channels.  One hardware-sequenced scan covers every
+// sensor on the mux with no firmware switching it.
+#ifndef XADC_EXT_MUX
+#define XADC_EXT_MUX (0)
+#endif
+#ifndef XADC_EXT_MUX_INPUT
+#define XADC_EXT_MUX_INPUT XSM_CH_VPVN
+#endif
+
+// Aux inputs converted bipolar (+-0.5 V, two's complement), and those
+// given 10 ADC clocks to settle instead of 4, bit n for aux channel n.  A
+// mux needs the longer settling when its output has the input's RC behind
+// it.
+#ifndef XADC_AUX_BIPOLAR
+#define XADC_AUX_BIPOLAR (0)
+#endif
+#ifndef XADC_AUX_SETTLE
+#define XADC_AUX_SETTLE (XADC_EXT_MUX ? XADC_AUX_CHANNELS : 0)
+#endif
+
+// Samples averaged into each result (an XSM_AVG_* value).  Each channel
+// takes about 1 us per sample, so a full scan of all channels at 16
+// samples comes round in under 0.4 ms.
+#ifndef XADC_AVG
+#define XADC_AVG XSM_AVG_16_SAMPLES
+#endif
+
+// Alarm thresholds.  The temperature alarm raises above XADC_TEMP_HI_MC and
+// clears again below XADC_TEMP_LO_MC; the supply alarms raise outside
+// their window.  Over-temperature (OT) keeps its factory 125 C threshold.
+#ifndef XADC_TEMP_HI_MC
+#define XADC_TEMP_HI_MC   (85000)
+#define XADC_TEMP_LO_MC   (75000)
+#endif
+#ifndef XADC_VCCINT_LO_MV
+#define XADC_VCCINT_LO_MV (950)
+#define XADC_VCCINT_HI_MV (1050)
+#endif
+#ifndef XADC_VCCAUX_LO_MV
+#define XADC_VCCAUX_LO_MV (1710)
+#define XADC_VCCAUX_HI_MV (1890)
+#endif
+#ifndef XADC_VBRAM_LO_MV
+#define XADC_VBRAM_LO_MV  (950)
+#define XADC_VBRAM_HI_MV  (1050)
+#endif
+
+// Alarm events kept for readers (a power of two)
+#define XADC_EVENTS (16)
+
+// Samples a burst captures at most, and longest wait for one conversion
+#define XADC_BURST_SAMPLES    (1024)
+#define XADC_BURST_TIMEOUT_US (20)
+
+// Burst states
+#define XADC_BURST_IDLE   (0) // none captured yet
+#define XADC_BURST_ARMED  (1) // waiting for an alarm
+#define XADC_BURST_DONE   (2)
+#define XADC_BURST_FAILED (3) // a conversion never came
+
+// What started a burst
+#define XADC_TRIGGER_COMMAND (0)
+#define XADC_TRIGGER_ALARM   (1)
+
+// Period of the snapshots the housekeeping core sends the network core
+// (role.h)
+#ifndef XADC_PUBLISH_MS
+#define XADC_PUBLISH_MS (100)
+#endif
+
+// A snapshot must go this soon after it is due (timer.h), in us
+#define XADC_PUBLISH_DEADLINE_US (10000)
+
+struct xadc_snapshot {
+  // timebase_ms() when the results were read
+  u32 time_ms;
+  // Raw results, 12 bits left-justified in 16 (xadc_convert() scales
+  // them).  0 for channels out of the scan.
+  u16 raw[XADC_NUM_CHANNELS];
+};
+
+// One alarm interrupt
+struct xadc_event {
+  // timebase_us() in the interrupt handler, or on the network core when
+  // the event arrived from the housekeeping core
+  u64 time_us;
+  // Interrupt status bits (XSM_IPIXR_*) that raised it
+  u32 status;
+  // Alarm outputs active at the time (XSM_AOR_*)
+  u32 alarms;
+};
+
+struct xadc_burst {
+  u8 state;
+  u8 channel;
+  u8 trigger;
+  // Samples asked for and captured
+  u16 want;
+  u16 count;
+  // Interrupt status bits (XSM_IPIXR_*) of the alarm that triggered it
+  u32 status;
+  // timebase_us() at the start, and timer cycles from the first sample to
+  // the last
+  u64 time_us;
+  u32 cycles;
+};
+
+typedef void (*xadc_alarm_fn)(const struct xadc_event *ev, void *arg);
+
+// Set up the sequencer and alarms and start scanning.  On the network core
+// of a two-core build (role.h), take the results and events from the
+// mailbox instead.
+void init_xadc();
+
+// Latest raw result of channel `ch`
+u16 xadc_raw(u32 ch);
+
+// Read the latest result of every channel into `s`.  Never waits for a
+// conversion.
+void xadc_snapshot(struct xadc_snapshot *s);
+
+// Lowest (`max` zero) or highest raw result of XADC_TEMP, XADC_VCCINT,
+// XADC_VCCAUX or XADC_VBRAM since the XADC was reset, as tracked by the
+// XADC at its full conversion rate.  0 for other channels.
+u16 xadc_peak(u32 ch, int max);
+
+// Scale raw result `raw` of channel `ch` to milli-degrees C (XADC_TEMP) or
+// millivolts at the pin (the rest), in integer arithmetic.  Bipolar aux
+// inputs (XADC_AUX_BIPOLAR) come out signed.  xadccal.h scales the aux
+// inputs on to what the board's sensors measure.
+s32 xadc_convert(u32 ch, u16 raw);
+
+// Inverse of xadc_convert(): the raw result for `value`
+u16 xadc_unconvert(u32 ch, s32 value);
+
+// Call `fn` from the main loop with each alarm event, to take protective
+// action.  Replaces any earlier handler.
+void xadc_on_alarm(xadc_alarm_fn fn, void *arg);
+
+// Number of alarm events so far
+u32 xadc_event_count();
+
+// Copy alarm event `n` (counting from 0) into `ev`.
+//
+// Returns 0 on success, -1 if it has not happened yet or has been
+// overwritten (only the last XADC_EVENTS are kept).
+int xadc_event(u32 n, struct xadc_event *ev);
+
+// Capture `n` samples (1 to XADC_BURST_SAMPLES) of channel `ch` now.
+// Returns 0 once done, or -1 if the arguments are bad or the XADC is on
+// the other core (role.h).  Replaces the last burst, and cancels an armed
+// one.
+int xadc_burst_start(u32 ch, u32 n);
+
+// Capture as xadc_burst_start() does in the handler of the next alarm.
+// Returns 0 if armed, or -1 as xadc_burst_start() does.
+int xadc_burst_arm(u32 ch, u32 n);
+
+// Disarm a burst waiting for an alarm
+void xadc_burst_cancel();
+
+// The last burst, and its samples (raw results, as in struct
+// xadc_snapshot) in `*samples`
+const struct xadc_burst *xadc_burst(const u16 **samples);
+
+// Print the latest results
+void dump_xadc();
+
+#endif // _XADC_H_
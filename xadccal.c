@@ -0,0 +1,62 @@
+// xadccal.c - Calibration of the board sensors on the XADC aux inputs (see
+// xadccal.h).
+//
+// `cal` is the stored value, saved in the background (kv_save()).
+
+#include "kv.h"
+#include "xadccal.h"
+
+static struct xadccal_entry cal[XADC_NUM_AUX];
+
+static struct kv_save save = KV_SAVE_INIT(save, KV_KEY_XADC_CAL);
+
+void
+init_xadccal()
+{
+  u32 n;
+
+  if(kv_get(KV_KEY_XADC_CAL, cal, sizeof(cal)) == sizeof(cal)) {
+    return;
+  }
+  for(n=0; n<XADC_NUM_AUX; n++) {
+    cal[n].gain = XADCCAL_UNITY;
+    cal[n].offset = 0;
+  }
+}
+
+int
+xadccal_set(u32 n, s32 gain, s32 offset)
+{
+  if(n >= XADC_NUM_AUX) {
+    return -1;
+  }
+  cal[n].gain = gain;
+  cal[n].offset = offset;
+  kv_save(&save, cal, sizeof(cal));
+  return 0;
+}
+
+const struct xadccal_entry *
+xadccal_get(u32 n)
+{
+  return n < XADC_NUM_AUX ? &cal[n] : NULL;
+}
+
+s32
+xadccal_value(u32 ch, u16 raw)
+{
+  const struct xadccal_entry *e;
+  s32 mv = xadc_convert(ch, raw);
+  s64 p;
+  u64 mag;
+
+  if(ch < XADC_AUX(0) || ch >= XADC_NUM_CHANNELS) {
+    return mv;
+  }
+  e = &cal[ch - XADC_AUX(0)];
+  // Shift the magnitude: a right shift of a negative value is
+  // implementation-defined
+  p = (s64)mv * e->gain;
+  mag = (p < 0 ? -p : p) >> 16;
+  return (p < 0 ? -(s32)mag : (s32)mag) + e->offset;
+}
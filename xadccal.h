@@ -0,0 +1,47 @@
+#ifndef _XADCCAL_H_
+#define _XADCCAL_H_
+
+// xadccal.h - Calibration of the board sensors on the XADC aux inputs.
+//
+// The aux inputs, directly or behind an external mux (xadc.h), carry the
+// board's own voltage and current sensors through dividers and sense
+// amplifiers.  Each aux channel has a gain and an offset that take the
+// millivolts at the pin (xadc_convert()) to what the sensor measures:
+//
+//   value = mV * gain / 65536 + offset
+//
+// in whatever unit suits it (mV for a rail behind a divider, mA for a
+// sense amplifier).  Until set, a channel reads in mV at the pin (gain
+// 65536, offset 0).  The constants are saved to KV_KEY_XADC_CAL (kv.h) in
+// the background, set with KATCP's ?xadc-cal (katcp.h), and go out in
+// telemetry.h's export header, so that its raw records scale the same way
+// without the board.
+
+#include "xil_types.h"
+
+#include "xadc.h"
+
+// Gain of a channel not calibrated
+#define XADCCAL_UNITY (65536)
+
+// As stored, one for each aux channel
+struct xadccal_entry {
+  s32 gain;
+  s32 offset;
+};
+
+// Load the saved constants.  Call after init_kv().
+void init_xadccal();
+
+// Calibrate aux channel `n` (0 to XADC_NUM_AUX - 1).  Takes effect at
+// once.  Returns 0, or -1 if `n` is out of range.
+int xadccal_set(u32 n, s32 gain, s32 offset);
+
+// Constants of aux channel `n`, or NULL past the last
+const struct xadccal_entry *xadccal_get(u32 n);
+
+// Raw result `raw` of channel `ch` scaled: calibrated for an aux channel,
+// as xadc_convert() for the rest
+s32 xadccal_value(u32 ch, u16 raw);
+
+#endif // _XADCCAL_H_
@@ -0,0 +1,144 @@
+// xburst.c - Export of the last XADC burst capture (see xburst.h).
+//
+// Served as pcprof.c serves its histogram: one connection at a time,
+// queued straight from the header and the samples as send buffer space
+// frees up.
+
+#include <string.h>
+
+#include "lwip/tcp.h"
+#include "netif/ethernetif.h"
+
+#include "xil_printf.h"
+
+#include "log.h"
+#include "timebase.h"
+#include "xadc.h"
+#include "xburst.h"
+
+// Export in progress
+static struct {
+  struct tcp_pcb *pcb;
+  struct xburst_header hdr;
+  const u16 *samples;
+  u32 off;
+  u32 len;
+} tx;
+
+static void
+xburst_send(struct tcp_pcb *pcb)
+{
+  const u8 *src;
+  u32 n;
+
+  while(tx.off < tx.len) {
+    if(tx.off < sizeof(tx.hdr)) {
+      src = (const u8 *)&tx.hdr + tx.off;
+      n = sizeof(tx.hdr) - tx.off;
+    } else {
+      src = (const u8 *)tx.samples + (tx.off - sizeof(tx.hdr));
+      n = tx.len - tx.off;
+    }
+    if(n > tcp_sndbuf(pcb)) {
+      n = tcp_sndbuf(pcb);
+    }
+    if(n > TCP_MSS) {
+      n = TCP_MSS;
+    }
+    if(n == 0) {
+      break;
+    }
+    if(tcp_write(pcb, src, n, TCP_WRITE_FLAG_COPY |
+          (tx.off + n < tx.len ? TCP_WRITE_FLAG_MORE : 0)) != ERR_OK) {
+      break;
+    }
+    tx.off += n;
+  }
+  tcp_output(pcb);
+
+  if(tx.off == tx.len && tcp_close(pcb) == ERR_OK) {
+    tcp_recv(pcb, NULL);
+    tcp_sent(pcb, NULL);
+    tcp_err(pcb, NULL);
+    tx.pcb = NULL;
+  }
+}
+
+static err_t
+xburst_sent(void *arg, struct tcp_pcb *pcb, u16_t len)
+{
+  xburst_send(pcb);
+  return ERR_OK;
+}
+
+static err_t
+xburst_recv(void *arg, struct tcp_pcb *pcb, struct pbuf *p, err_t err)
+{
+  // Nothing is expected from the reader
+  if(p) {
+    tcp_recved(pcb, p->tot_len);
+    pbuf_free(p);
+  }
+  return ERR_OK;
+}
+
+static void
+xburst_err(void *arg, err_t err)
+{
+  tx.pcb = NULL;
+}
+
+static err_t
+xburst_accept(void *arg, struct tcp_pcb *pcb, err_t err)
+{
+  struct xburst_header *h = &tx.hdr;
+  const struct xadc_burst *b;
+
+  if(err != ERR_OK || tx.pcb) {
+    return ERR_MEM;
+  }
+
+  b = xadc_burst(&tx.samples);
+  memset(h, 0, sizeof(*h));
+  h->magic = XBURST_MAGIC;
+  h->version = XBURST_VERSION;
+  h->header_size = sizeof(*h);
+  h->channel = b->channel;
+  h->state = b->state;
+  h->trigger = b->trigger;
+  // An armed burst still holds the samples of the one before
+  h->count = b->state == XADC_BURST_ARMED ? 0 : b->count;
+  h->want = b->want;
+  h->hz = TIMEBASE_HZ;
+  h->cycles = b->cycles;
+  h->status = b->status;
+  h->time_us_lo = (u32)b->time_us;
+  h->time_us_hi = (u32)(b->time_us >> 32);
+
+  pcb->tos = ETHERNETIF_TOS_BULK;
+  tx.pcb = pcb;
+  tx.off = 0;
+  tx.len = sizeof(*h) + 2 * h->count;
+
+  LOG("xburst: export of %u samples", h->count);
+
+  tcp_arg(pcb, NULL);
+  tcp_recv(pcb, xburst_recv);
+  tcp_sent(pcb, xburst_sent);
+  tcp_err(pcb, xburst_err);
+  xburst_send(pcb);
+  return ERR_OK;
+}
+
+void
+init_xburst()
+{
+  struct tcp_pcb *pcb = tcp_new();
+
+  if(!pcb || tcp_bind(pcb, IP_ADDR_ANY, XBURST_PORT) != ERR_OK) {
+    xil_printf("xburst: cannot bind port %d\n", XBURST_PORT);
+    return;
+  }
+  pcb = tcp_listen(pcb);
+  tcp_accept(pcb, xburst_accept);
+}
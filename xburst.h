@@ -0,0 +1,48 @@
+#ifndef _XBURST_H_
+#define _XBURST_H_
+
+// xburst.h - Export of the last XADC burst capture over the network.
+//
+// Connecting to TCP port XBURST_PORT fetches the last burst of xadc.h in
+// one transfer: a struct xburst_header, then `count` u16 raw results, and
+// the connection closes.  Everything is little-endian, as laid out in
+// memory.  The rate the samples came at is (count - 1) * hz / cycles.  A
+// burst taken during the transfer may overwrite samples not yet sent, so
+// a reader that triggers on alarms should check `time_us` of a second
+// fetch.  KATCP's ?xburst takes and arms bursts (katcp.h), and
+// tools/xburst.py fetches one and scales it.
+
+#include "xil_types.h"
+
+#define XBURST_PORT    (7011)
+
+#define XBURST_MAGIC   (0x31524258) // "XBR1"
+// Bumped whenever the layout of the export changes
+#define XBURST_VERSION (1)
+
+struct xburst_header {
+  u32 magic;
+  u16 version;
+  u16 header_size;
+  // Channel index (XADC_TEMP ...), XADC_BURST_ state and XADC_TRIGGER_
+  u8 channel;
+  u8 state;
+  u8 trigger;
+  u8 pad;
+  // Samples that follow, and those asked for
+  u16 count;
+  u16 want;
+  // Timer clock, and timer cycles from the first sample to the last
+  u32 hz;
+  u32 cycles;
+  // XSM_IPIXR_ bits of the alarm that triggered it
+  u32 status;
+  // timebase_us() at the start
+  u32 time_us_lo;
+  u32 time_us_hi;
+};
+
+// Serve the last burst on XBURST_PORT.  Call after lwip_init().
+void init_xburst();
+
+#endif // _XBURST_H_